@@ -130,16 +130,21 @@ int wave_io_read (char *File_Name_In, wave_transf_des *Wave_Trans);
 int wave_io_write (char *File_Name_In, wave_transf_des *Wave_Trans);
 int wave_io_free (wave_transf_des *Wave_Trans);
 int wave_io_alloc (wave_transf_des *Wave_Trans, int Type_Transform, int Nbr_Plan, int Nl, int Nc);
+int wave_io_store (const char *File_Name, wave_transf_des *Wave_Trans);
+wave_transf_des *wave_io_lookup (const char *File_Name);
+void wave_io_store_clear ();
 float *f_vector_alloc(int Nbr_Elem);
 int wavelet_transform_file (float *Imag, int Nl, int Nc, char *File_Name_Transform, int Type_Transform, int Nbr_Plan, WORD *data);
 int wavelet_transform_file_float (float *Imag, int Nl, int Nc, char *File_Name_Transform, int Type_Transform, int Nbr_Plan);
 int wavelet_transform(float *Imag, int Nl, int Nc, wave_transf_des *Wavelet, int Type_Transform, int Nbr_Plan, WORD *data);
 int wavelet_transform_float(float *Imag, int Nl, int Nc, wave_transf_des *Wavelet, int Type_Transform, int Nbr_Plan);
 int wavelet_transform_data (float *Imag, int Nl, int Nc, wave_transf_des *Wavelet, int Type_Transform, int Nbr_Plan);
+int wavelet_extract_plan (float *Imag, int Nl, int Nc, int Type_Transform, int Nbr_Plan, int Num_Plan);
 int pave_2d_linear_smooth (const float *Imag, float *Smooth, int Nl, int Nc, int Num_Plan);
 int pave_2d_tfo (float *Pict, float *Pave, int Nl, int Nc, int Nbr_Plan, int Type_To);
 int pave_2d_build (float *Pave, float *Imag, int Nl, int Nc, int Nbr_Plan, const float *coef);
 int pave_2d_extract_plan (float *Pave, float *Imag, int Nl, int Nc, int Num_Plan);
+int pave_2d_plan (float *Imag, int Nl, int Nc, int Nbr_Plan, int Num_Plan, int Type_To);
 int pave_2d_bspline_smooth (const float *Imag, float *Smooth, int Nl, int Nc, int Num_Plan);
 int prepare_rawdata(float *Imag, int Nl, int Nc, WORD *data);
 int wavelet_reconstruct_data (wave_transf_des *Wavelet, float *Imag, float *coef);
@@ -20,6 +20,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <math.h>
 #include <gsl/gsl_statistics_double.h>
 #include <gsl/gsl_matrix.h>
@@ -39,6 +40,7 @@
 #include "algos/sorting.h"
 #include "algos/siril_wcs.h"
 #include "algos/star_finder.h"
+#include "algos/psf_solver.h"
 #include "filters/median.h"
 
 #include "PSF.h"
@@ -53,6 +55,7 @@
 #define FTOL 1e-3
 
 #define DEBUG_PSF 0 // flag to show progress of fitting process - may flood output if numerous stars
+#define PSF_GSL_REFERENCE 0 // flag to fit the detected stars with GSL too instead of psf_solver, for comparison
 
 const double radian_conversion = ((3600.0 * 180.0) / M_PI) / 1.0E3;
 
@@ -575,70 +578,41 @@ static void callback(const size_t iter, void *params, const gsl_multifit_nlinear
 }
 #endif
 
-/* The function returns the fitted parameters with angle. However it returns
- * NULL if the number of parameters is => to the pixel number.
- */
-static psf_star *psf_minimiz_angle(gsl_matrix* z, double background, double sat, int convergence, gboolean from_peaker, gboolean for_photometry, struct phot_config *phot_set, gboolean verbose, starprofile profile, psf_error *error) {
-	size_t i, j, k = 0;
+/* Computes the mask of the unsaturated pixels and the initial values of the
+ * fitted variables, in the order of psf_Gaussian_f_ang() and psf_Moffat_f_ang().
+ * Returns the number of pixels to fit, 0 on error */
+static size_t psf_init_fit(gsl_matrix* z, double background, double sat, int convergence, gboolean from_peaker,
+		starprofile profile, gboolean *mask, double *x_init, int *max_iter, psf_error *error) {
 	size_t NbRows = z->size1; //characteristics of the selection : height and width
 	size_t NbCols = z->size2;
 	const size_t p = (profile == PSF_GAUSSIAN) ? 7 : 8;	// Number of parameters fitted
-	int status;
-	gboolean *mask = NULL;
-	gsl_vector *MaxV = NULL;
-	gsl_matrix *covar = NULL;
-	psf_star *psf = NULL;
-	double *y = NULL;
-	int max_iter;
-	gsl_multifit_nlinear_workspace *work = NULL;
+	size_t k = 0;
 
-	if (error) *error = PSF_NO_ERR;
 	// computing the mask to discard clipped values
-	mask = malloc(NbRows * NbCols * sizeof(gboolean));
-	if (!mask) {
-		PRINT_ALLOC_ERR;
-		if (error) *error = PSF_ERR_ALLOC;
-		goto free_and_exit;
-	}
-	for (i = 0; i < NbRows; i++) {
-		for (j = 0; j < NbCols; j++) {
+	for (size_t i = 0; i < NbRows; i++) {
+		for (size_t j = 0; j < NbCols; j++) {
 			mask[NbCols * i + j] = gsl_matrix_get(z, i, j) < sat;
 			if (mask[NbCols * i + j]) k++;
 		}
 	}
 
-	const size_t n = k;
-	if (n <= p) { // could happen if star is mostly saturated (hand-selection case)
+	if (k <= p) { // could happen if star is mostly saturated (hand-selection case)
 		if (error) *error = PSF_ERR_WINDOW_TOO_SMALL;
-		goto free_and_exit;
+		return 0;
 	}
 
-	psf = new_psf_star();
-	covar = gsl_matrix_alloc(p, p);
-	y = malloc(n * sizeof(double));
-	if (!psf || !covar || !y) {
-		PRINT_ALLOC_ERR;
-		if (error) *error = PSF_ERR_ALLOC;
-		if (psf) free_psf(psf);
-		psf = NULL;
-		goto free_and_exit;
-	}
-
-	max_iter = MAX_ITER_ANGLE * ((k < NbRows * NbCols) ? 3 : 1) * convergence * ((profile == PSF_GAUSSIAN) ? 1 : 2);
+	*max_iter = MAX_ITER_ANGLE * ((k < NbRows * NbCols) ? 3 : 1) * convergence * ((profile == PSF_GAUSSIAN) ? 1 : 2);
 
-	MaxV = psf_init_data(z, background, from_peaker);
+	gsl_vector *MaxV = psf_init_data(z, background, from_peaker);
 	if (!MaxV) {
 		PRINT_ALLOC_ERR;
 		if (error) *error = PSF_ERR_ALLOC;
-		free_psf(psf);
-		psf = NULL;
-		goto free_and_exit;
+		return 0;
 	}
 
 	double beta = (profile == PSF_GAUSSIAN) ? -1. : 2; // TODO: to be changed if we implement PSF_MOFFAT_BFIXED
 	double fbeta = (profile == PSF_GAUSSIAN) ? 0. : acos(2. * beta / MOFFAT_BETA_UBOUND - 1.);
 
-	struct PSF_data d = { n, y, NbRows, NbCols, 0. , mask };
 	double FWHM = gsl_vector_get(MaxV, 3);
 	double roundness = gsl_vector_get(MaxV, 4) / gsl_vector_get(MaxV, 3);
 	double a_init = gsl_vector_get(MaxV, 5) * M_PI / 180.; // angle in radians
@@ -649,76 +623,31 @@ static psf_star *psf_minimiz_angle(gsl_matrix* z, double background, double sat,
 		a_init = 0.;
 	}
 	double fr = acos(2. * roundness - 1.); // r = 0.5 *(cos(fc)+1) to bound it between 0 and 1
-	double x0_init = gsl_vector_get(MaxV, 1);
-	double y0_init = gsl_vector_get(MaxV, 2);
-	double x_init[8] = { background, // B
-						gsl_vector_get(MaxV, 0), // A
-						x0_init, // x0
-						y0_init, // y0
-						S_from_FWHM(FWHM, beta, profile), // SX
-						fr, //
-						a_init, // angle
-						fbeta}; // beta = betamax * 0.5 * (cos(fbeta) + 1)
-	gsl_vector_view x = gsl_vector_view_array(x_init, p);
-
-	gsl_multifit_nlinear_parameters fdf_params = gsl_multifit_nlinear_default_parameters();
-	fdf_params.trs = gsl_multifit_nlinear_trs_lm; // levenberg-marquardt
-	gsl_multifit_nlinear_fdf fdf;
-	if (profile == PSF_GAUSSIAN) {
-		fdf.f = &psf_Gaussian_f_ang;
-		fdf.df = &psf_Gaussian_df_ang;
-	} else {
-		fdf.f = &psf_Moffat_f_ang;
-		fdf.df = &psf_Moffat_df_ang;
-	}
-	fdf.fvv = NULL;
-	fdf.n = n;
-	fdf.p = p;
-	fdf.params = &d;
-
-	k = 0;
-	for (i = 0; i < NbRows; i++) {
-		for (j = 0; j < NbCols; j++) {
-			if (mask[NbCols * i + j]) {
-				y[k] = gsl_matrix_get(z, i, j);
-				k++;
-			}
-		}
-	}
-	g_assert(k == n);
-
-	const gsl_multifit_nlinear_type *T = gsl_multifit_nlinear_trust;
-	work = gsl_multifit_nlinear_alloc(T, &fdf_params, n, p);
-	int info;
-
-	/* initialize solver */
-	gsl_multifit_nlinear_init(&x.vector, &fdf, work);
-
-	/* iterate until convergence */
-#if DEBUG_PSF
-	struct callback_params c_params = { profile };
-	status = gsl_multifit_nlinear_driver(max_iter, XTOL, GTOL, FTOL,
-	callback, &c_params, &info, work);
-#else
-	status = gsl_multifit_nlinear_driver(max_iter, XTOL, GTOL, FTOL,
-	NULL, NULL, &info, work);
-#endif
+	x_init[0] = background; // B
+	x_init[1] = gsl_vector_get(MaxV, 0); // A
+	x_init[2] = gsl_vector_get(MaxV, 1); // x0
+	x_init[3] = gsl_vector_get(MaxV, 2); // y0
+	x_init[4] = S_from_FWHM(FWHM, beta, profile); // SX
+	x_init[5] = fr;
+	x_init[6] = a_init; // angle
+	x_init[7] = fbeta; // beta = betamax * 0.5 * (cos(fbeta) + 1)
+	gsl_vector_free(MaxV);
+	return k;
+}
 
-	if (status != GSL_SUCCESS) {
-		if (error) *error = PSF_ERR_DIVERGED;
+/* Builds the star from the fitted variables and their variance. Returns NULL
+ * if the solution is degenerate */
+static psf_star *psf_make_star(gsl_matrix *z, const double *fit, const double *var, double rmse,
+		starprofile profile, gboolean for_photometry, struct phot_config *phot_set, gboolean verbose, psf_error *error) {
+	psf_star *psf = new_psf_star();
+	if (!psf) {
+		PRINT_ALLOC_ERR;
+		if (error) *error = PSF_ERR_ALLOC;
+		return NULL;
 	}
-#if DEBUG_PSF
-	siril_debug_print("Successful criterion#:%d\n",info);
-#endif
-
-	/* computing the covariance to estimate the errors*/
-	gsl_matrix * J;
 
-	J = gsl_multifit_nlinear_jac(work);
-	gsl_multifit_nlinear_covar (J, 0.0, covar);
-
-#define FIT(i) gsl_vector_get(work->x, i)
-#define ERR(i) sqrt(gsl_matrix_get(covar,i,i))	//for now, errors are not displayed
+#define FIT(i) fit[i]
+#define ERR(i) sqrt(var[i])	//for now, errors are not displayed
 
 	/*Output structure with parameters fitted */
 	psf->profile = profile;
@@ -740,8 +669,7 @@ static psf_star *psf_minimiz_angle(gsl_matrix* z, double background, double sat,
 	 */
 	if (fabs(psf->angle) > 10000) {
 		free_psf(psf);
-		psf = NULL;
-		goto free_and_exit;
+		return NULL;
 	}
 	/* The angle must be => -90 and <= 90
 	 * Otherwise, the solution may be degenerate
@@ -776,7 +704,7 @@ static psf_star *psf_minimiz_angle(gsl_matrix* z, double background, double sat,
 		psf->phot_is_valid = FALSE;
 	}
 	//RMSE
-	psf->rmse = d.rmse;
+	psf->rmse = rmse;
 	// absolute uncertainties
 	// TODO: this will need to be revisited if of use as we are using intermediate variables
 	psf->B_err = ERR(0) / FIT(0);
@@ -787,12 +715,136 @@ static psf_star *psf_minimiz_angle(gsl_matrix* z, double background, double sat,
 	psf->sy_err = ERR(5) / FIT(5);
 	psf->ang_err = ERR(6) / FIT(6);
 	psf->beta_err = (profile == PSF_GAUSSIAN) ? 0. : ERR(7) / FIT(7);
+#undef FIT
+#undef ERR
+	return psf;
+}
+
+/* The function returns the fitted parameters with angle. However it returns
+ * NULL if the number of parameters is => to the pixel number.
+ */
+static psf_star *psf_minimiz_angle(gsl_matrix* z, double background, double sat, int convergence, gboolean from_peaker, gboolean for_photometry, struct phot_config *phot_set, gboolean verbose, starprofile profile, psf_error *error) {
+	size_t i, j, k;
+	size_t NbRows = z->size1; //characteristics of the selection : height and width
+	size_t NbCols = z->size2;
+	const size_t p = (profile == PSF_GAUSSIAN) ? 7 : 8;	// Number of parameters fitted
+	int status;
+	gboolean *mask = NULL;
+	gsl_matrix *covar = NULL;
+	psf_star *psf = NULL;
+	double *y = NULL, *coords = NULL;
+	int max_iter;
+	gsl_multifit_nlinear_workspace *work = NULL;
+	/* the stars of the detection are fitted with the dedicated solver, the
+	 * GSL one remains the reference for the other uses */
+	const gboolean use_solver = from_peaker && !PSF_GSL_REFERENCE;
+	double x_init[8];
+
+	if (error) *error = PSF_NO_ERR;
+	mask = malloc(NbRows * NbCols * sizeof(gboolean));
+	if (!mask) {
+		PRINT_ALLOC_ERR;
+		if (error) *error = PSF_ERR_ALLOC;
+		goto free_and_exit;
+	}
+	const size_t n = psf_init_fit(z, background, sat, convergence, from_peaker, profile, mask, x_init, &max_iter, error);
+	if (!n)
+		goto free_and_exit;
+
+	y = malloc(n * sizeof(double));
+	if (use_solver)
+		coords = malloc(2 * n * sizeof(double));
+	else covar = gsl_matrix_alloc(p, p);
+	if (!y || (use_solver ? !coords : !covar)) {
+		PRINT_ALLOC_ERR;
+		if (error) *error = PSF_ERR_ALLOC;
+		goto free_and_exit;
+	}
+
+	struct PSF_data d = { n, y, NbRows, NbCols, 0. , mask };
+	k = 0;
+	for (i = 0; i < NbRows; i++) {
+		for (j = 0; j < NbCols; j++) {
+			if (mask[NbCols * i + j]) {
+				y[k] = gsl_matrix_get(z, i, j);
+				if (use_solver) {
+					coords[k] = j + 0.5;
+					coords[n + k] = i + 0.5;
+				}
+				k++;
+			}
+		}
+	}
+	g_assert(k == n);
+
+	double fit[8], var[8] = { 0. };
+	if (use_solver) {
+		struct psf_solver_data sd = { n, y, coords, coords + n };
+		memcpy(fit, x_init, sizeof(fit));
+		status = psf_solver_fit(&sd, profile, max_iter, XTOL, GTOL, fit, var, &d.rmse);
+		if (status) {
+			if (error) *error = PSF_ERR_DIVERGED;
+		}
+	} else {
+		gsl_vector_view x = gsl_vector_view_array(x_init, p);
+
+		gsl_multifit_nlinear_parameters fdf_params = gsl_multifit_nlinear_default_parameters();
+		fdf_params.trs = gsl_multifit_nlinear_trs_lm; // levenberg-marquardt
+		gsl_multifit_nlinear_fdf fdf;
+		if (profile == PSF_GAUSSIAN) {
+			fdf.f = &psf_Gaussian_f_ang;
+			fdf.df = &psf_Gaussian_df_ang;
+		} else {
+			fdf.f = &psf_Moffat_f_ang;
+			fdf.df = &psf_Moffat_df_ang;
+		}
+		fdf.fvv = NULL;
+		fdf.n = n;
+		fdf.p = p;
+		fdf.params = &d;
+
+		const gsl_multifit_nlinear_type *T = gsl_multifit_nlinear_trust;
+		work = gsl_multifit_nlinear_alloc(T, &fdf_params, n, p);
+		int info;
+
+		/* initialize solver */
+		gsl_multifit_nlinear_init(&x.vector, &fdf, work);
+
+		/* iterate until convergence */
+#if DEBUG_PSF
+		struct callback_params c_params = { profile };
+		status = gsl_multifit_nlinear_driver(max_iter, XTOL, GTOL, FTOL,
+		callback, &c_params, &info, work);
+#else
+		status = gsl_multifit_nlinear_driver(max_iter, XTOL, GTOL, FTOL,
+		NULL, NULL, &info, work);
+#endif
+
+		if (status != GSL_SUCCESS) {
+			if (error) *error = PSF_ERR_DIVERGED;
+		}
+#if DEBUG_PSF
+		siril_debug_print("Successful criterion#:%d\n",info);
+#endif
+
+		/* computing the covariance to estimate the errors*/
+		gsl_matrix * J;
+
+		J = gsl_multifit_nlinear_jac(work);
+		gsl_multifit_nlinear_covar (J, 0.0, covar);
+		for (i = 0; i < p; i++) {
+			fit[i] = gsl_vector_get(work->x, i);
+			var[i] = gsl_matrix_get(covar, i, i);
+		}
+	}
+
+	psf = psf_make_star(z, fit, var, d.rmse, profile, for_photometry, phot_set, verbose, error);
 
 	//we free the memory
 free_and_exit:
 	if (y) free(y);
+	if (coords) free(coords);
 	if (mask) free(mask);
-	if (MaxV) gsl_vector_free(MaxV);
 	if(work) gsl_multifit_nlinear_free(work);
 	if (covar) gsl_matrix_free(covar);
 	return psf;
@@ -882,6 +934,16 @@ psf_star *psf_get_minimisation(fits *fit, int layer, rectangle *area,
 	return result;
 }
 
+static gboolean psf_result_is_valid(const psf_star *psf, psf_error *error) {
+	if (!isfinite(psf->fwhmx) || !isfinite(psf->fwhmy) ||
+			psf->fwhmx <= 0.0 || psf->fwhmy <= 0.0) {
+		if (error && *error == PSF_NO_ERR)
+			*error = PSF_ERR_DIVERGED;
+		return FALSE;
+	}
+	return TRUE;
+}
+
 /* This function is the global minimisation. Every call to the minimisation
  * must come over here.
  * If fit_angle, it will check if the difference between Sx and Sy is larger
@@ -908,11 +970,8 @@ psf_star *psf_global_minimisation(gsl_matrix* z, double bg, double sat, int conv
 //	photometry_computed = TRUE;
 
 	/* We quickly test the result. If it is bad we return NULL */
-	if (!isfinite(psf->fwhmx) || !isfinite(psf->fwhmy) ||
-			psf->fwhmx <= 0.0 || psf->fwhmy <= 0.0) {
+	if (!psf_result_is_valid(psf, error)) {
 		free_psf(psf);
-		if (error && *error == PSF_NO_ERR)
-			*error = PSF_ERR_DIVERGED;
 		return NULL;
 	}
 
@@ -937,6 +996,159 @@ psf_star *psf_global_minimisation(gsl_matrix* z, double bg, double sat, int conv
 	return psf;
 }
 
+/* nb boxes of the same size fitted together by the batched solver, each with
+ * its own background and saturation level */
+static void psf_fit_batch(gsl_matrix **z, int nb, const double *bg, const double *sat, int convergence,
+		gboolean from_peaker, gboolean for_photometry, struct phot_config *phot_set,
+		starprofile profile, psf_star **psf, psf_error *error) {
+	const size_t NbRows = z[0]->size1, NbCols = z[0]->size2;
+	const size_t npix = NbRows * NbCols;
+	const int L = PSF_SOLVER_LANES;
+	double x[PSF_SOLVER_LANES][PSF_SOLVER_MAX_PARAMS], var[PSF_SOLVER_LANES][PSF_SOLVER_MAX_PARAMS];
+	double rmse[PSF_SOLVER_LANES];
+	int max_iter[PSF_SOLVER_LANES], status[PSF_SOLVER_LANES], lane_of[PSF_SOLVER_LANES];
+	size_t n[PSF_SOLVER_LANES];
+	g_assert(nb <= L);
+#if PSF_GSL_REFERENCE
+	for (int s = 0; s < nb; s++)
+		psf[s] = psf_global_minimisation(z[s], bg[s], sat[s], convergence, from_peaker, for_photometry, phot_set, FALSE, profile, &error[s]);
+	return;
+#endif
+
+	gboolean *mask = malloc(npix * sizeof(gboolean));
+	double *y = calloc(npix * L, sizeof(double));
+	double *w = calloc(npix * L, sizeof(double));
+	if (!mask || !y || !w) {
+		PRINT_ALLOC_ERR;
+		for (int s = 0; s < nb; s++) {
+			psf[s] = NULL;
+			error[s] = PSF_ERR_ALLOC;
+		}
+		free(mask);
+		free(y);
+		free(w);
+		return;
+	}
+
+	/* boxes that cannot be fitted are not given a lane */
+	int nl = 0;
+	for (int s = 0; s < nb; s++) {
+		psf[s] = NULL;
+		error[s] = PSF_NO_ERR;
+		n[nl] = psf_init_fit(z[s], bg[s], sat[s], convergence, from_peaker, profile, mask, x[nl], &max_iter[nl], &error[s]);
+		if (!n[nl])
+			continue;
+		for (size_t k = 0; k < npix; k++) {
+			y[k * L + nl] = gsl_matrix_get(z[s], k / NbCols, k % NbCols);
+			w[k * L + nl] = mask[k] ? 1. : 0.;
+		}
+		lane_of[nl++] = s;
+	}
+
+	if (nl > 0) {
+		struct psf_solver_batch b = { nl, npix, NbCols, y, w, n };
+		psf_solver_fit_batch(&b, profile, max_iter, XTOL, GTOL, x, var, rmse, status);
+	}
+
+	for (int l = 0; l < nl; l++) {
+		int s = lane_of[l];
+		if (status[l])
+			error[s] = PSF_ERR_DIVERGED;
+		psf_star *star = psf_make_star(z[s], x[l], var[l], rmse[l], profile, for_photometry, phot_set, FALSE, &error[s]);
+		if (star && !psf_result_is_valid(star, &error[s])) {
+			free_psf(star);
+			star = NULL;
+		}
+		psf[s] = star;
+	}
+	free(mask);
+	free(y);
+	free(w);
+}
+
+/* Same as psf_global_minimisation() for the star detection, on nb boxes of
+ * the same size fitted together by the batched solver. nb must not exceed
+ * PSF_SOLVER_LANES. psf and error receive the result of each box, NULL for
+ * the failed fits */
+void psf_global_minimisation_batch(gsl_matrix **z, int nb, double bg, const double *sat, int convergence,
+		starprofile profile, psf_star **psf, psf_error *error) {
+	double bgs[PSF_SOLVER_LANES];
+	g_assert(nb <= PSF_SOLVER_LANES);
+	for (int s = 0; s < nb; s++)
+		bgs[s] = bg;
+	psf_fit_batch(z, nb, bgs, sat, convergence, TRUE, FALSE, NULL, profile, psf, error);
+}
+
+/* Same as psf_get_minimisation() with photometry, on nb areas of the same size
+ * of a layer fitted together by the batched solver, as done for the catalogue
+ * stars of the colour calibration. nb must not exceed PSF_SOLVER_LANES. psf
+ * and error receive the result of each area, NULL for the failed fits */
+void psf_get_minimisation_batch(fits *fit, int layer, const rectangle *areas, int nb,
+		struct phot_config *phot_set, starprofile profile, psf_star **psf, psf_error *error) {
+	g_assert(nb <= PSF_SOLVER_LANES);
+	for (int s = 0; s < nb; s++) {
+		psf[s] = NULL;
+		error[s] = PSF_NO_ERR;
+	}
+	if (nb == 0)
+		return;
+	if (fit->type != DATA_USHORT && fit->type != DATA_FLOAT) {
+		for (int s = 0; s < nb; s++)
+			error[s] = PSF_ERR_UNSUPPORTED;
+		return;
+	}
+	const int w = areas[0].w, h = areas[0].h;
+	double *zbuf = malloc((size_t) nb * w * h * sizeof(double));
+	if (!zbuf) {
+		PRINT_ALLOC_ERR;
+		for (int s = 0; s < nb; s++)
+			error[s] = PSF_ERR_ALLOC;
+		return;
+	}
+	gsl_matrix_view views[PSF_SOLVER_LANES];
+	gsl_matrix *z[PSF_SOLVER_LANES];
+	double bg[PSF_SOLVER_LANES], sat[PSF_SOLVER_LANES];
+	psf_star *results[PSF_SOLVER_LANES];
+	psf_error errors[PSF_SOLVER_LANES];
+	int box_of[PSF_SOLVER_LANES];
+	int nz = 0;
+	for (int s = 0; s < nb; s++) {
+		const rectangle *area = &areas[s];
+		g_assert(area->w == w && area->h == h);
+		double b = background(fit, layer, (rectangle *) area, SINGLE_THREADED);
+		if (b == -1.0) {
+			error[s] = PSF_ERR_INVALID_IMAGE;
+			continue;
+		}
+		views[nz] = gsl_matrix_view_array(zbuf + (size_t) nz * w * h, h, w);
+		z[nz] = &views[nz].matrix;
+		// same extraction as psf_get_minimisation(), top-down in FITS coordinates
+		size_t start = (size_t) (fit->ry - area->y - h) * fit->rx + area->x;
+		for (int i = 0; i < h; i++) {
+			for (int j = 0; j < w; j++) {
+				size_t k = start + (size_t) i * fit->rx + j;
+				double v = fit->type == DATA_USHORT ? (double) fit->pdata[layer][k] : (double) fit->fpdata[layer][k];
+				gsl_matrix_set(z[nz], i, j, v);
+			}
+		}
+		bg[nz] = b;
+		sat[nz] = fit->type == DATA_FLOAT ? 1. : (fit->orig_bitpix == BYTE_IMG) ? UCHAR_MAX_DOUBLE : USHRT_MAX_DOUBLE;
+		box_of[nz++] = s;
+	}
+	if (nz > 0)
+		psf_fit_batch(z, nz, bg, sat, com.pref.starfinder_conf.convergence, FALSE, TRUE, phot_set, profile, results, errors);
+	for (int l = 0; l < nz; l++) {
+		int s = box_of[l];
+		psf[s] = results[l];
+		error[s] = errors[l];
+		if (psf[s]) {
+			fwhm_to_arcsec_if_needed(fit, psf[s]);
+			psf[s]->layer = layer;
+		}
+	}
+	free(zbuf);
+}
+
 static gchar *build_wcs_url(gchar *ra, gchar *dec) {
 	if (!has_wcs(&gfit)) return NULL;
 
@@ -95,6 +95,10 @@ psf_star *psf_get_minimisation(fits *fit, int layer, rectangle *area,
 psf_star *psf_global_minimisation(gsl_matrix* z, double bg, double sat, int convergence,
 		gboolean from_peaker, gboolean for_photometry, struct phot_config *phot_set, gboolean verbose,
 		starprofile profile, psf_error *error);
+void psf_global_minimisation_batch(gsl_matrix **z, int nb, double bg, const double *sat, int convergence,
+		starprofile profile, psf_star **psf, psf_error *error);
+void psf_get_minimisation_batch(fits *fit, int layer, const rectangle *areas, int nb,
+		struct phot_config *phot_set, starprofile profile, psf_star **psf, psf_error *error);
 
 gchar *format_psf_result(psf_star *result, const rectangle *area, fits *fit, gchar **url);
 void fwhm_to_arcsec_if_needed(fits*, psf_star*);
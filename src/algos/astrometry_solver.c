@@ -1299,7 +1299,17 @@ static int siril_platesolve(psf_star **stars, int nb_stars, struct astrometry_da
 	double ra = -1., dec = -1.;
 	double ra0 = args->ref_stars->center_ra;
 	double dec0 = args->ref_stars->center_dec;
-	ret = match_catalog(stars, nb_stars, args->ref_stars, args->scale, args->trans_order, &t, &ra, &dec);
+	if (args->has_prior) {
+		/* in a sequence, the catalogue is projected around the solution of
+		 * a previous image, so that few iterations are needed; the usual
+		 * solve from the catalogue center is the fallback */
+		ret = match_catalog_from(stars, nb_stars, args->ref_stars, args->scale, args->trans_order,
+				args->prior_ra, args->prior_dec, &t, &ra, &dec);
+		if (ret > 0)
+			siril_debug_print("solve from the previous solution failed, solving from the catalogue center\n");
+	}
+	if (!args->has_prior || ret > 0)
+		ret = match_catalog(stars, nb_stars, args->ref_stars, args->scale, args->trans_order, &t, &ra, &dec);
 	if (ret <= 0) { // we update the solution - but if near_solve, we do a last solve with a new catalogue fetched at the center if it was too far away
 		double dist = compute_coords_distance(ra0, dec0, ra, dec) * 60.; // distance from last fetched catalogue and solution center in arcmin
 		if (!ret && args->near_solve && dist > 0.15 * args->used_fov) {
@@ -1368,14 +1378,15 @@ static int siril_platesolve(psf_star **stars, int nb_stars, struct astrometry_da
 	return ret;
 }
 
-static int match_catalog(psf_star **stars, int nb_stars, siril_catalogue *siril_cat, double scale, int order, TRANS *trans_out, double *ra_out, double *dec_out) {
+/* the catalogue is first projected around (ra0, dec0), which can be a prior
+ * of the image center instead of the center of the catalogue */
+static int match_catalog_from(psf_star **stars, int nb_stars, siril_catalogue *siril_cat, double scale, int order,
+		double ra0, double dec0, TRANS *trans_out, double *ra_out, double *dec_out) {
 	TRANS trans = { 0 };
 	int nobj = AT_MATCH_CATALOG_NBRIGHT;
 	int max_trials = 5;
 	s_star *star_list_A = NULL, *star_list_B = NULL;
 	psf_star **cstars = NULL;
-	double ra0 = siril_cat->center_ra;
-	double dec0 = siril_cat->center_dec;
 	int ret = SOLVE_NO_MATCH;
 
 	double a = 1.0 + (com.pref.astrometry.percent_scale_range / 100.0);
@@ -1502,6 +1513,11 @@ clearup:
 	return ret;
 }
 
+static int match_catalog(psf_star **stars, int nb_stars, siril_catalogue *siril_cat, double scale, int order, TRANS *trans_out, double *ra_out, double *dec_out) {
+	return match_catalog_from(stars, nb_stars, siril_cat, scale, order,
+			siril_cat->center_ra, siril_cat->center_dec, trans_out, ra_out, dec_out);
+}
+
 /*********************** finding asnet bash first **********************/
 
 // Retrieves and caches asnet_version. Returns true if asnet works
@@ -1636,6 +1652,20 @@ static int local_asnet_platesolve(psf_star **stars, int nb_stars, struct astrome
 	}
 
 	gchar *table_filename = replace_ext(args->filename, ".xyls");
+	gchar *wcs_filename = replace_ext(args->filename, ".wcs");
+	if (args->exchange_dir) {
+		/* the star list and the solution of the frames of a sequence go through
+		 * the exchange directory, in memory, solve-field writes its outputs
+		 * next to its input */
+		gchar *base = g_path_get_basename(table_filename);
+		g_free(table_filename);
+		table_filename = g_build_filename(args->exchange_dir, base, NULL);
+		g_free(base);
+		base = g_path_get_basename(wcs_filename);
+		g_free(wcs_filename);
+		wcs_filename = g_build_filename(args->exchange_dir, base, NULL);
+		g_free(base);
+	}
 #ifdef _WIN32
 	gchar *stopfile = g_build_filename(com.wd, "stop", NULL);
 	if (!g_path_is_absolute(table_filename)) {
@@ -1649,6 +1679,7 @@ static int local_asnet_platesolve(psf_star **stars, int nb_stars, struct astrome
 	if (save_list_as_FITS_table(table_filename, stars, nb_stars, args->rx_solver, args->ry_solver)) {
 		siril_log_message(_("Failed to create the input data for solve-field\n"));
 		g_free(table_filename);
+		g_free(wcs_filename);
 		g_free(stopfile);
 		return SOLVE_ASNET_PROC;
 	}
@@ -1746,6 +1777,10 @@ static int local_asnet_platesolve(psf_star **stars, int nb_stars, struct astrome
 		fprintf(stderr,"cannot create temporary file: exiting solve-field");
 		g_free(asnetscript);
 		g_free(command);
+		g_free(table_filename);
+		g_free(wcs_filename);
+		g_free(stopfile);
+		g_free(asnet_shell);
 		return SOLVE_ASNET_PROC;
 	}
 	/* Write data to this file  */
@@ -1765,15 +1800,18 @@ static int local_asnet_platesolve(psf_star **stars, int nb_stars, struct astrome
 	gint child_stdout;
 	g_autoptr(GError) error = NULL;
 
+	gint64 start = siril_tool_begin(EXT_ASNET);
 	siril_spawn_host_async_with_pipes(NULL, sfargs, NULL,
 			G_SPAWN_LEAVE_DESCRIPTORS_OPEN | G_SPAWN_SEARCH_PATH,
 			NULL, NULL, NULL, NULL, &child_stdout, NULL, &error);
 	if (error != NULL) {
+		siril_tool_end(EXT_ASNET, start);
 		siril_log_color_message("Spawning solve-field failed: %s\n", "red", error->message);
 		if (!com.pref.astrometry.keep_xyls_files)
 			if (g_unlink(table_filename))
 				siril_debug_print("Error unlinking table_filename\n");
 		g_free(table_filename);
+		g_free(wcs_filename);
 		g_free(stopfile);
 #ifdef _WIN32
 		g_free(asnet_shell);
@@ -1813,6 +1851,7 @@ static int local_asnet_platesolve(psf_star **stars, int nb_stars, struct astrome
 	g_object_unref(stream);
 	if (!g_close(child_stdout, &error))
 		siril_debug_print("%s\n", error->message);
+	siril_tool_end(EXT_ASNET, start);
 	if (!com.pref.astrometry.keep_xyls_files)
 		if (g_unlink(table_filename)) {
 			siril_debug_print("Error unlinking table_filename\n");
@@ -1825,14 +1864,15 @@ static int local_asnet_platesolve(psf_star **stars, int nb_stars, struct astrome
 	g_free(asnet_path);
 #endif
 	if (!success) {
+		g_free(wcs_filename);
 		return SOLVE_NO_MATCH;
 	}
 
 	/* get the results from the .wcs file */
-	gchar *wcs_filename = replace_ext(args->filename, ".wcs");
 	fits result = { 0 };
 	if (read_fits_metadata_from_path_first_HDU(wcs_filename, &result)) {
 		siril_log_color_message(_("Could not read the solution from solve-field (expected in file %s)\n"), "red", wcs_filename);
+		g_free(wcs_filename);
 		return SOLVE_NO_MATCH;
 	}
 
@@ -2012,7 +2052,15 @@ static int astrometry_prepare_hook(struct generic_seq_args *arg) {
 	if (args->solver == SOLVER_LOCALASNET) {
 		com.child_is_running = EXT_ASNET;
 		g_unlink("stop"); // make sure the flag file for cancel is not already in the folder
+#ifndef _WIN32
+		/* the cygwin builds of solve-field on Windows cannot read native paths
+		 * outside of the working directory, they keep the current layout */
+		if (!com.pref.astrometry.keep_xyls_files && !com.pref.astrometry.keep_wcs_files) {
+			args->exchange_dir = siril_create_exchange_dir("asnet");
+		}
+#endif
 	}
+	args->has_prior = FALSE;
 	if (!args->nocache)
 		return get_catalog_stars(args->ref_stars);
 	args->seqprogress = 0; // initialize success counter
@@ -2143,9 +2191,33 @@ static int astrometry_image_hook(struct generic_seq_args *arg, int o, int i, fit
 		aargs->distofilename = g_strdup(aargs_master->distofilename);
 	}
 	process_plate_solver_input(aargs);
+	if (aargs->solver == SOLVER_SIRIL && !aargs->nocache) {
+#ifdef _OPENMP
+		omp_set_lock(&arg->lock);
+#endif
+		aargs->has_prior = aargs_master->has_prior;
+		aargs->prior_ra = aargs_master->prior_ra;
+		aargs->prior_dec = aargs_master->prior_dec;
+#ifdef _OPENMP
+		omp_unset_lock(&arg->lock);
+#endif
+	}
 
 	int retval = GPOINTER_TO_INT(plate_solver(aargs));
 
+	if (!retval && aargs->solver == SOLVER_SIRIL && !aargs->nocache && has_wcs(fit)) {
+		// crpix is at the image center, crval is the center of this frame
+#ifdef _OPENMP
+		omp_set_lock(&arg->lock);
+#endif
+		aargs_master->has_prior = TRUE;
+		aargs_master->prior_ra = fit->keywords.wcslib->crval[0];
+		aargs_master->prior_dec = fit->keywords.wcslib->crval[1];
+#ifdef _OPENMP
+		omp_unset_lock(&arg->lock);
+#endif
+	}
+
 	if (retval) {
 		siril_log_color_message(_("Image %s did not solve\n"), "red", root);
 		arg->seq->imgparam[o].incl = FALSE;
@@ -2192,6 +2264,8 @@ static int astrometry_finalize_hook(struct generic_seq_args *arg) {
 	siril_log_color_message(_("%d images successfully platesolved out of %d included\n"), "green", aargs->seqprogress, arg->nb_filtered_images);
 	if (aargs->seqskipped > 0)
 		siril_log_color_message(_("(%d were already solved and skipped)\n"), "green", aargs->seqskipped);
+	if (aargs->solver == SOLVER_LOCALASNET)
+		siril_tool_log_stats(EXT_ASNET, "solve-field");
 	if (arg->has_output)
 		seq_finalize_hook(arg);
 	else if (arg->seq->type == SEQ_FITSEQ) {
@@ -2221,6 +2295,7 @@ finish:
 		siril_catalog_free(aargs->ref_stars);
 	if (aargs->distofilename)
 		g_free(aargs->distofilename);
+	siril_remove_exchange_dir(aargs->exchange_dir);
 	free(aargs);
 	if (com.child_is_running == EXT_ASNET && g_unlink("stop"))
 		siril_debug_print("g_unlink() failed\n");
@@ -2277,6 +2352,9 @@ void start_sequence_astrometry(sequence *seq, struct astrometry_data *args) {
 	seqargs->parallel = seq->type != SEQ_FITSEQ;
 #endif
 	args->numthreads = (seqargs->parallel) ? 1 : com.max_thread;
+	/* each solve-field process loads the index files, their number is
+	 * limited independently of the number of threads */
+	siril_tool_set_max_concurrent(EXT_ASNET, com.pref.astrometry.max_asnet_processes);
 	seqargs->prepare_hook = astrometry_prepare_hook;
 	seqargs->image_hook = astrometry_image_hook;
 	seqargs->finalize_hook = astrometry_finalize_hook;
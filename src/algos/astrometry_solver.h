@@ -85,10 +85,13 @@ struct astrometry_data {
 	rectangle solvearea;	// area in case of manual selection or autocrop
 	gboolean uncentered;	// solvearea is not centered with image
 	gboolean asnet_checked;	// local asnet availability already checked
+	gchar *exchange_dir;	// directory of the solve-field files of a sequence, owned by the sequence arguments
 	gboolean near_solve; // if this flag is false, ref_stars conesearch is done once (mainly when catalogs are not local)
 	gboolean asnet_blind_pos; // if this flag is true, no position is passed to asnet, the solve is blind in position
 	gboolean asnet_blind_res; // if this flag is true, no resolution is passed to asnet, the solve is blind in scale
 	int numthreads; //nb of threads that can be used
+	gboolean has_prior;	// prior_ra and prior_dec give the approximate image center
+	double prior_ra, prior_dec;	// from the last solved image of a sequence
 
 	/* results */
 	int ret;		// return value
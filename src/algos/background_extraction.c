@@ -49,52 +49,8 @@
 
 #define SAMPLE_SIZE 25		// must be odd to compute a radius
 
-//C contains background function
-#define C(i) (gsl_vector_get(c,(i)))
-
-static double poly_4(gsl_vector *c, double x, double y) {
-	double value = C(0) + C(1) * x + C(2) * y + (x * x) * C(3) + (x * y) * C(4)
-			+ (y * y) * C(5) + (x * x) * x * C(6) + (x * x) * y * C(7)
-			+ x * (y * y) * C(8)+ (y * y) * y * C(9) + (x * x) * (x * x) * C(10)
-			+ (x * x) * (x * y) * C(11) + (x * x) * (y * y) * C(12)
-			+ (x * y) * (y * y) * C(13) + (y * y) * (y * y) * C(14);
-
-	return (value);
-}
-
-static double poly_3(gsl_vector *c, double x, double y) {
-	double value = C(0) + C(1) * x + C(2) * y + (x * x) * C(3) + (y * x) * C(4)
-			+ (y * y) * C(5) + (x * x) * x * C(6) + (x * x) * y * C(7) + x * (y * y) * C(8)
-			+ (y * y) * y * C(9);
-
-	return (value);
-}
-
-static double poly_2(gsl_vector *c, double x, double y) {
-	double value = C(0) + C(1) * x + C(2) * y + C(3) * (x * x) + C(4) * (y * x)
-			+ C(5) * (y * y);
-
-	return (value);
-}
-
-static double poly_1(gsl_vector *c, double x, double y) {
-	double value = C(0) + C(1) * x + C(2) * y;
-
-	return (value);
-}
-
-/* this function come from GSL 2.7 */
-static double siril_gsl_vector_sum(const gsl_vector *v) {
-	size_t i;
-	double sum = 0;
-
-	for (i = 0; i < v->size; ++i) {
-		double vi = gsl_vector_get(v, i);
-		sum += vi;
-	}
-
-	return sum;
-}
+#define RBF_MIN_SCALING 4	// the RBF model is evaluated on a grid at least 4 times smaller
+#define RBF_MAX_GRID 1024	// and with at most 1024 points on its long side
 
 static gboolean computeBackground_RBF(GSList *list, double *background, int channel, unsigned int width, unsigned int height, double smoothing, gchar **err, int threads) {
 	/* Implementation of RBF interpolation with a thin-plate Kernel k(r) = r^2 * log(r)
@@ -127,8 +83,11 @@ static gboolean computeBackground_RBF(GSList *list, double *background, int chan
 	f = gsl_vector_calloc(n + 1);
 	coef = gsl_vector_calloc(n + 1);
 
-	/* Scaling */
-	int scaling_factor = 4;
+	/* Scaling: the model is smooth and its evaluation costs one kernel per
+	 * sample and grid point, so the grid size is bounded for large images
+	 * and the result is upsampled bicubically */
+	int long_side = (int) max(width, height);
+	int scaling_factor = max(RBF_MIN_SCALING, (long_side + RBF_MAX_GRID - 1) / RBF_MAX_GRID);
 	int width_scaled = round_to_int(width / scaling_factor);
 	int height_scaled = round_to_int(height / scaling_factor);
 
@@ -224,32 +183,44 @@ static gboolean computeBackground_RBF(GSList *list, double *background, int chan
 	}
 
 	/* Calculate background from coefficients coef */
+	const double *w = gsl_vector_const_ptr(coef, 0);
+	int *sample_x = malloc(n * sizeof(int));
+	int *sample_y = malloc(n * sizeof(int));
+	if (!sample_x || !sample_y) {
+		PRINT_ALLOC_ERR;
+		free(sample_x);
+		free(sample_y);
+		gsl_permutation_free(p);
+		gsl_matrix_free(K);
+		gsl_vector_free(f);
+		gsl_vector_free(coef);
+		free(background_scaled);
+		free(kernel_scaled);
+		free(list_array);
+		return FALSE;
+	}
+	for (int k = 0; k < n; k++) {
+		// rounding may put a sample on the grid border
+		sample_x[k] = min((int)list_array[k][0], width_scaled - 1);
+		sample_y[k] = min((int)list_array[k][1], height_scaled - 1);
+	}
 #ifdef _OPENMP
-#pragma omp parallel num_threads(threads)
-#endif
-	{
-		gsl_vector *A = gsl_vector_calloc(n + 1);
-#ifdef _OPENMP
-#pragma omp for
+#pragma omp parallel for num_threads(threads) schedule(static)
 #endif
-		for (int i = 0; i < height_scaled; i++) {
-			for (int j = 0; j < width_scaled; j++) {
-				for (int k = 0; k < n; k++) {
-					int deltax = abs(j - (int)list_array[k][0]);
-					int deltay = abs(i - (int)list_array[k][1]);
-					gsl_vector_set(A, k, kernel_scaled[deltax + deltay * width_scaled]);
-				}
-
-				gsl_vector_set(A, n, 1.0);
-				gsl_vector_mul(A, coef);
-
-				double pixel = siril_gsl_vector_sum(A);
-				background_scaled[j + i * width_scaled] = pixel;
+	for (int i = 0; i < height_scaled; i++) {
+		double *row = background_scaled + i * width_scaled;
+		for (int j = 0; j < width_scaled; j++) {
+			double pixel = 0.0;
+			for (int k = 0; k < n; k++) {
+				int deltax = abs(j - sample_x[k]);
+				int deltay = abs(i - sample_y[k]);
+				pixel += w[k] * kernel_scaled[deltax + deltay * width_scaled];
 			}
+			row[j] = pixel + w[n];
 		}
-
-		gsl_vector_free(A);
 	}
+	free(sample_x);
+	free(sample_y);
 
 
 	cvResizeArray(background_scaled, background, height_scaled, width_scaled, height, width);
@@ -264,7 +235,7 @@ static gboolean computeBackground_RBF(GSList *list, double *background, int chan
 	return TRUE;
 }
 
-static gboolean computeBackground_Polynom(GSList *list, double *background, int channel, unsigned int width, unsigned int height, poly_order order, gchar **err) {
+static gboolean computeBackground_Polynom(GSList *list, double *background, int channel, unsigned int width, unsigned int height, poly_order order, gchar **err, int threads) {
 	size_t k = 0;
 	double chisq, pixel;
 	gsl_matrix *J, *cov;
@@ -361,24 +332,28 @@ static gboolean computeBackground_Polynom(GSList *list, double *background, int
 		return FALSE;
 	}
 
-	// Calculation of the background with the same dimension that the input matrix.
+	/* Calculation of the background with the same dimension that the input matrix.
+	 * The lower orders use the first terms of the 4th order polynomial, which is
+	 * evaluated for each row as a polynomial in x with Horner's method:
+	 * C0 + C1 x + C2 y + C3 x² + C4 xy + C5 y² + C6 x³ + C7 x²y + C8 xy² + C9 y³
+	 * + C10 x⁴ + C11 x³y + C12 x²y² + C13 xy³ + C14 y⁴ */
+	double C[NPARAM_POLY4] = { 0.0 };
+	for (int i = 0; i < nbParam; i++)
+		C[i] = gsl_vector_get(c, i);
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(threads) schedule(static)
+#endif
 	for (unsigned int i = 0; i < height; i++) {
+		double y = (double) i;
+		double b0 = C[0] + y * (C[2] + y * (C[5] + y * (C[9] + y * C[14])));
+		double b1 = C[1] + y * (C[4] + y * (C[8] + y * C[13]));
+		double b2 = C[3] + y * (C[7] + y * C[12]);
+		double b3 = C[6] + y * C[11];
+		double b4 = C[10];
+		double *row = background + (size_t) i * width;
 		for (unsigned int j = 0; j < width; j++) {
-			switch (order) {
-			case BACKGROUND_POLY_1:
-				pixel = poly_1(c, (double) j, (double) i);
-				break;
-			case BACKGROUND_POLY_2:
-				pixel = poly_2(c, (double) j, (double) i);
-				break;
-			case BACKGROUND_POLY_3:
-				pixel = poly_3(c, (double) j, (double) i);
-				break;
-			default:
-			case BACKGROUND_POLY_4:
-				pixel = poly_4(c, (double) j, (double) i);
-			}
-			background[j + i * width] = pixel;
+			double x = (double) j;
+			row[j] = b0 + x * (b1 + x * (b2 + x * (b3 + x * b4)));
 		}
 	}
 
@@ -557,34 +532,6 @@ static float* convert_fits_to_luminance(fits *fit, threading_type threads) {
 	return image;
 }
 
-static void convert_img_to_fits(double *image, fits *fit, int channel) {
-	const int height = fit->ry;
-	const int width = fit->rx;
-	if (fit->type == DATA_USHORT) {
-		WORD *buf = fit->pdata[channel];
-		size_t out_idx = 0;
-		for (int y = 0; y < height; ++y) {
-			size_t in_idx = (height - y - 1) * width;
-			for (int x = 0; x < width; ++x) {
-				buf[out_idx] = round_to_WORD(image[in_idx] * USHRT_MAX);
-				in_idx++;
-				out_idx++;
-			}
-		}
-	} else if (fit->type == DATA_FLOAT) {
-		float *buf = fit->fpdata[channel];
-		size_t out_idx = 0;
-		for (int y = 0; y < height; ++y) {
-			size_t in_idx = (height - y - 1) * width;
-			for (int x = 0; x < width; ++x) {
-				buf[out_idx] = (float) image[in_idx];
-				in_idx++;
-				out_idx++;
-			}
-		}
-	}
-}
-
 GSList *generate_samples(fits *fit, int nb_per_line, double tolerance, int size, const char **error, threading_type threads) {
 	int nx = fit->rx;
 	int ny = fit->ry;
@@ -687,32 +634,77 @@ static GSList *update_median_samples(GSList *orig, fits *fit) {
 	return orig;
 }
 
-static void remove_gradient(double *img, const double *background, double background_mean, size_t ndata, background_correction type, threading_type threads) {
-	switch (type) {
-		default:
-		case BACKGROUND_CORRECTION_SUBTRACT:
+/* xorshift generator of the dithering, one per row to process them in parallel */
+static inline guint32 dither_next(guint32 *state) {
+	guint32 x = *state;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	return *state = x;
+}
+
+/* Removes the background, computed upside down like the image of
+ * convert_fits_to_img, from the channel of fit in place, converting the
+ * pixels and adding the dithering in the same pass */
+static void remove_gradient_from_fits(fits *fit, int channel, const double *background,
+		double background_mean, background_correction type, gboolean add_dither, threading_type threads) {
+	const int height = fit->ry;
+	const int width = fit->rx;
+	const size_t ndata = (size_t) width * height;
+	const double invnorm = 1.0 / USHRT_MAX;
+	WORD *ubuf = fit->type == DATA_USHORT ? fit->pdata[channel] : NULL;
+	float *fbuf = fit->type == DATA_FLOAT ? fit->fpdata[channel] : NULL;
+
+	double mean = 0.0;
+	if (type == BACKGROUND_CORRECTION_DIVIDE) {
+		threading_type mean_threads = threads;
 #ifdef _OPENMP
-			limit_threading(&threads, 300000, ndata);
-#pragma omp parallel for num_threads(threads) schedule(static)
+		limit_threading(&mean_threads, 300000, ndata);
+#pragma omp parallel for num_threads(mean_threads) schedule(static) reduction(+:mean)
 #endif
-			for (size_t i = 0; i < ndata; i++) {
-				img[i] -= background[i];
-				img[i] += background_mean;
-			}
-			break;
-		case BACKGROUND_CORRECTION_DIVIDE:
-			{
-				double mean = gsl_stats_mean(img, 1, ndata);
+		for (size_t i = 0; i < ndata; i++)
+			mean += ubuf ? ubuf[i] * invnorm : fbuf[i];
+		mean /= ndata;
+	}
+
+	guint32 seed = add_dither ? siril_random_uint() : 0;
 #ifdef _OPENMP
-				limit_threading(&threads, 300000, ndata);
+	limit_threading(&threads, 300000 / width, height);
 #pragma omp parallel for num_threads(threads) schedule(static)
 #endif
-				for (size_t i = 0; i < ndata; i++) {
-					img[i] /= background[i];
-					img[i] *= mean;
-				}
+	for (int y = 0; y < height; y++) {
+		const double *bkg = background + (size_t) (height - y - 1) * width;
+		size_t idx = (size_t) y * width;
+		guint32 state = (seed ^ ((guint32) y * 2654435761u)) | 1;
+		for (int x = 0; x < width; x++, idx++) {
+			double pixel = ubuf ? ubuf[idx] * invnorm : fbuf[idx];
+			if (add_dither) {
+				/* add dithering in order to avoid colour banding */
+				pixel += (dither_next(&state) & 0xFFFFF) * (1.0f / (1ULL << 36));
 			}
+			if (type == BACKGROUND_CORRECTION_DIVIDE)
+				pixel = pixel / bkg[x] * mean;
+			else pixel = pixel - bkg[x] + background_mean;
+			if (ubuf)
+				ubuf[idx] = round_to_WORD(pixel * USHRT_MAX);
+			else fbuf[idx] = (float) pixel;
+		}
+	}
+}
+
+static GSList *copy_sample_list(GSList *list) {
+	GSList *copy = NULL;
+	for (GSList *l = list; l; l = l->next) {
+		background_sample *sample = malloc(sizeof(background_sample));
+		if (!sample) {
+			PRINT_ALLOC_ERR;
+			free_background_sample_list(copy);
+			return NULL;
+		}
+		memcpy(sample, l->data, sizeof(background_sample));
+		copy = g_slist_prepend(copy, sample);
 	}
+	return g_slist_reverse(copy);
 }
 
 /************* PUBLIC FUNCTIONS *************/
@@ -815,14 +807,6 @@ gpointer remove_gradient_from_image(gpointer p) {
 		return GINT_TO_POINTER(1);
 	}
 
-	const size_t n = gfit.naxes[0] * gfit.naxes[1];
-	double *image = malloc(n * sizeof(double));
-	if (!image) {
-		free(background);
-		PRINT_ALLOC_ERR;
-		return GINT_TO_POINTER(1);
-	}
-
 	/* Make sure to update local median. Useful if undo is pressed */
 	update_median_samples(com.grad_samples, &gfit);
 
@@ -834,14 +818,13 @@ gpointer remove_gradient_from_image(gpointer p) {
 		gboolean interpolation_worked = TRUE;
 		if (args->interpolation_method == BACKGROUND_INTER_POLY) {
 			interpolation_worked = computeBackground_Polynom(com.grad_samples, background, channel,
-					gfit.rx, gfit.ry, args->degree, &error);
+					gfit.rx, gfit.ry, args->degree, &error, args->threads);
 		} else {
 			interpolation_worked = computeBackground_RBF(com.grad_samples, background, channel,
 					gfit.rx, gfit.ry, args->smoothing, &error, args->threads);
 		}
 
 		if (!interpolation_worked) {
-			free(image);
 			free(background);
 			queue_error_message_dialog(_("Not enough samples."), error);
 			if (!args->from_ui) {
@@ -859,9 +842,7 @@ gpointer remove_gradient_from_image(gpointer p) {
 		else
 			c_name = _("monochrome");
 		siril_log_message(_("Background extraction from %s channel.\n"), c_name);
-		convert_fits_to_img(&gfit, image, channel, args->dither);
-		remove_gradient(image, background, background_mean, n, args->correction, MULTI_THREADED);
-		convert_img_to_fits(image, &gfit, channel);
+		remove_gradient_from_fits(&gfit, channel, background, background_mean, args->correction, args->dither, MULTI_THREADED);
 
 	}
 	siril_log_message(_("Background with %s interpolation computed.\n"),
@@ -869,7 +850,6 @@ gpointer remove_gradient_from_image(gpointer p) {
 	gettimeofday(&t_end, NULL);
 	show_time(t_start, t_end);
 	/* free memory */
-	free(image);
 	free(background);
 	invalidate_stats_from_fit(&gfit);
 	if (!args->from_ui) {
@@ -914,123 +894,78 @@ static GSList* rescale_sample_list_for_cfa(GSList *original_list, fits *fit) {
 	return new_list;
 }
 
-/* uses samples from com.grad_samples */
-gpointer remove_gradient_from_cfa_image(gpointer p) {
-	struct background_data *args = (struct background_data *)p;
-	sensor_pattern pattern;
-	if (!strncmp(gfit.keywords.bayer_pattern, "RGGB", 4)) {
-		pattern = BAYER_FILTER_RGGB;
-	} else if (!strncmp(gfit.keywords.bayer_pattern, "BGGR", 4)) {
-		pattern = BAYER_FILTER_BGGR;
-	} else if (!strncmp(gfit.keywords.bayer_pattern, "GBRG", 4)) {
-		pattern = BAYER_FILTER_GBRG;
-	} else if (!strncmp(gfit.keywords.bayer_pattern, "GRBG", 4)) {
-		pattern = BAYER_FILTER_GBRG;
-	} else {
-		siril_log_color_message(_("Error: unsupported CFA pattern for this operation.\n"), "red");
-		return GINT_TO_POINTER(1);
-	}
-	gchar *error = NULL;
-	struct timeval t_start, t_end;
-	gettimeofday(&t_start, NULL);
+struct cfa_gradient_data {
+	struct background_data *args;
+	gchar *error;
+	gboolean not_enough_samples;
+};
 
-	// Allocate an array of fits* and the fits objects themselves. These will hold the subchannels
-	fits** cfachans = calloc(4, sizeof(fits*));
-	for (int i = 0 ; i < 4 ; i++) {
-		cfachans[i] = calloc(1, sizeof(fits));
-	}
+static int cfa_gradient_channel_hook(fits *subchannel, int channel, void *user, int threads) {
+	struct cfa_gradient_data *data = (struct cfa_gradient_data *) user;
+	struct background_data *args = data->args;
+	GSList *samples = rescale_sample_list_for_cfa(com.grad_samples, subchannel);
 
-	// Split the FITS into the 4 subchannels
-	int ret = 1;
-	if (gfit.type == DATA_USHORT) {
-		ret = split_cfa_ushort(&gfit, cfachans[0], cfachans[1], cfachans[2], cfachans[3]);
-	}
-	else if (gfit.type == DATA_FLOAT) {
-		ret = split_cfa_float(&gfit, cfachans[0], cfachans[1], cfachans[2], cfachans[3]);
-	}
-	if (ret) {
-		siril_log_color_message(_("Error splitting into CFA subcannels, aborting...\n"), "red");
-		for (int i = 0 ; i < 4 ; i++) {
-			clearfits(cfachans[i]);
-			free(cfachans[i]);
-		}
-		free(cfachans);
-		return GINT_TO_POINTER(1);
+	if (!samples) {
+		siril_log_color_message(_("Failed to adapt background samples for CFA image\n"), "red");
+		return 1;
 	}
 
-	for (int i = 0; i < 4; i++) {
-		fits *subchannel = cfachans[i];
-
-		GSList *samples = rescale_sample_list_for_cfa(com.grad_samples, subchannel);
-
-		if (!samples) {
-			siril_log_color_message(_("Failed to adapt background samples for CFA image\n"), "red");
-			return GINT_TO_POINTER(1);
-		}
+	const size_t n = subchannel->naxes[0] * subchannel->naxes[1];
+	double *background = (double*)malloc(n * sizeof(double));
+	if (!background) {
+		free_background_sample_list(samples);
+		PRINT_ALLOC_ERR;
+		return 1;
+	}
 
-		double *background = (double*)malloc(subchannel->naxes[0] * subchannel->naxes[1] * sizeof(double));
-		if (!background) {
-			PRINT_ALLOC_ERR;
-			siril_log_message(_("Out of memory - aborting"));
-			return GINT_TO_POINTER(1);
-		}
+	double background_mean = get_background_mean(samples, 1);
+	/* compute background */
+	gboolean interpolation_worked = TRUE;
+	if (args->interpolation_method == BACKGROUND_INTER_POLY) {
+		interpolation_worked = computeBackground_Polynom(samples, background, 0,
+				subchannel->rx, subchannel->ry, args->degree, &data->error, threads);
+	} else {
+		interpolation_worked = computeBackground_RBF(samples, background, 0,
+				subchannel->rx, subchannel->ry, args->smoothing, &data->error, threads);
+	}
 
-		const size_t n = subchannel->naxes[0] * subchannel->naxes[1];
-		double *image = malloc(n * sizeof(double));
-		if (!image) {
-			free(background);
-			free_background_sample_list(samples);
-			PRINT_ALLOC_ERR;
-			return GINT_TO_POINTER(1);
-		}
+	if (!interpolation_worked) {
+		free(background);
+		free_background_sample_list(samples);
+		data->not_enough_samples = TRUE;
+		return 1;
+	}
+	/* remove background */
+	remove_gradient_from_fits(subchannel, 0, background, background_mean, args->correction, args->dither, (threading_type)threads);
+	free(background);
+	free_background_sample_list(samples);
+	return 0;
+}
 
-		double background_mean = get_background_mean(samples, 1);
-		/* compute background */
-		gboolean interpolation_worked = TRUE;
-		if (args->interpolation_method == BACKGROUND_INTER_POLY) {
-			interpolation_worked = computeBackground_Polynom(samples, background, 0,
-					subchannel->rx, subchannel->ry, args->degree, &error);
-		} else {
-			interpolation_worked = computeBackground_RBF(samples, background, 0,
-					subchannel->rx, subchannel->ry, args->smoothing, &error, args->threads);
-		}
+/* uses samples from com.grad_samples */
+gpointer remove_gradient_from_cfa_image(gpointer p) {
+	struct background_data *args = (struct background_data *)p;
+	struct timeval t_start, t_end;
+	gettimeofday(&t_start, NULL);
 
-		if (!interpolation_worked) {
-			free(image);
-			free(background);
-			queue_error_message_dialog(_("Not enough samples."), error);
+	struct cfa_gradient_data data = { .args = args };
+	if (process_cfa_channels(&gfit, cfa_gradient_channel_hook, &data, args->threads)) {
+		if (data.not_enough_samples) {
+			queue_error_message_dialog(_("Not enough samples."), data.error);
 			if (!args->from_ui) {
 				free_background_sample_list(com.grad_samples);
 				com.grad_samples = NULL;
 			}
-			for (int i = 0 ; i < 4 ; i++) {
-				clearfits(cfachans[i]);
-				free(cfachans[i]);
-			}
-			free(cfachans);
 			free(args);
 			siril_add_idle(end_background, NULL);
-			return GINT_TO_POINTER(1);
 		}
-		/* remove background */
-		convert_fits_to_img(subchannel, image, 0, args->dither);
-		remove_gradient(image, background, background_mean, n, args->correction, MULTI_THREADED);
-		convert_img_to_fits(image, subchannel, 0);
-		free(image);
-		free(background);
-		free_background_sample_list(samples);
-
+		return GINT_TO_POINTER(1);
 	}
-	fits *out = merge_cfa(cfachans[0], cfachans[1], cfachans[2], cfachans[3], pattern);
-	fits_swap_image_data(out, &gfit); // Efficiently move the merged pixeldata from out to gfit
-	clearfits(out);
-	free(out);
 	siril_log_message(_("Background with %s interpolation computed for CFA image.\n"),
 			(args->interpolation_method == BACKGROUND_INTER_POLY) ? "polynomial" : "RBF");
 	gettimeofday(&t_end, NULL);
 	show_time(t_start, t_end);
 	/* free memory */
-	invalidate_stats_from_fit(&gfit);
 	if (!args->from_ui) {
 		free_background_sample_list(com.grad_samples);
 		com.grad_samples = NULL;
@@ -1052,26 +987,29 @@ static int background_image_hook(struct generic_seq_args *args, int o, int i, fi
 		return 1;
 	}
 
-	const char *err;
-	GSList *samples = generate_samples(fit, b_args->nb_of_samples, b_args->tolerance, SAMPLE_SIZE, &err, (threading_type)threads);
-	if (!samples) {
-		siril_log_color_message(_("Failed to generate background samples for image %d: %s\n"), "red", i, _(err));
-		free(background);
-		return 1;
-	}
-
-	/* If RGB we need to update all local median, not only the first one */
-	if (fit->naxes[2] > 1) {
-		samples = update_median_samples(samples, fit);
-	}
+	GSList *samples;
+	if (b_args->samples) {
+		/* the positions of the samples of the reference image, with the
+		 * medians of this image */
+		samples = copy_sample_list(b_args->samples);
+		if (!samples || !update_median_samples(samples, fit)) {
+			free_background_sample_list(samples);
+			free(background);
+			return 1;
+		}
+	} else {
+		const char *err;
+		samples = generate_samples(fit, b_args->nb_of_samples, b_args->tolerance, SAMPLE_SIZE, &err, (threading_type)threads);
+		if (!samples) {
+			siril_log_color_message(_("Failed to generate background samples for image %d: %s\n"), "red", i, _(err));
+			free(background);
+			return 1;
+		}
 
-	const size_t n = fit->naxes[0] * fit->naxes[1];
-	double *image = malloc(n * sizeof(double));
-	if (!image) {
-		free(background);
-		free_background_sample_list(samples);
-		PRINT_ALLOC_ERR;
-		return 1;
+		/* If RGB we need to update all local median, not only the first one */
+		if (fit->naxes[2] > 1) {
+			samples = update_median_samples(samples, fit);
+		}
 	}
 
 	double background_mean = get_background_mean(samples, fit->naxes[2]);
@@ -1080,7 +1018,7 @@ static int background_image_hook(struct generic_seq_args *args, int o, int i, fi
 		gboolean interpolation_worked = TRUE;
 		gchar *error = NULL;
 		if (b_args->interpolation_method == BACKGROUND_INTER_POLY){
-			interpolation_worked = computeBackground_Polynom(samples, background, channel, fit->rx, fit->ry, b_args->degree, &error);
+			interpolation_worked = computeBackground_Polynom(samples, background, channel, fit->rx, fit->ry, b_args->degree, &error, threads);
 		} else {
 			interpolation_worked = computeBackground_RBF(samples, background, channel, fit->rx, fit->ry, b_args->smoothing, &error, threads);
 		}
@@ -1089,18 +1027,14 @@ static int background_image_hook(struct generic_seq_args *args, int o, int i, fi
 			if (error) {
 				siril_log_message(error);
 			}
-			free(image);
 			free(background);
 			free_background_sample_list(samples);
 			return 1;
 		}
 		/* remove background */
-		convert_fits_to_img(fit, image, channel, b_args->dither);
-		remove_gradient(image, background, background_mean, fit->naxes[0] * fit->naxes[1], b_args->correction, (threading_type)threads);
-		convert_img_to_fits(image, fit, channel);
+		remove_gradient_from_fits(fit, channel, background, background_mean, b_args->correction, b_args->dither, (threading_type)threads);
 	}
 	/* free memory */
-	free(image);
 	free(background);
 	free_background_sample_list(samples);
 
@@ -1117,124 +1051,80 @@ static int background_image_hook(struct generic_seq_args *args, int o, int i, fi
  * ready for drizzle.                                                                      *
  ******************************************************************************************/
 
-static int bgcfa_image_hook(struct generic_seq_args *args, int o, int i, fits *fit,
-		rectangle *_, int threads) {
-	struct background_data *b_args = (struct background_data*) args->user;
-	if (b_args->interpolation_method == BACKGROUND_INTER_RBF) {
-		siril_log_color_message(_("Warning: RBF background removal is not recommended for CFA images. Only linear background removal is recommended.\n"), "salmon");
-	} else if (b_args->degree > 1) {
-		siril_log_color_message(_("Warning: polynomial background removal order > 1 is not recommended for CFA images. Only linear background removal is recommended.\n"), "salmon");
-	}
-	// Obtain CFA pattern as a sensor_pattern
-	fits metadata = { 0 };
-	seq_read_frame_metadata(args->seq, i, &metadata);
-	sensor_pattern pattern;
-	if (!strncmp(metadata.keywords.bayer_pattern, "RGGB", 4)) {
-		pattern = BAYER_FILTER_RGGB;
-	} else if (!strncmp(metadata.keywords.bayer_pattern, "BGGR", 4)) {
-		pattern = BAYER_FILTER_BGGR;
-	} else if (!strncmp(metadata.keywords.bayer_pattern, "GBRG", 4)) {
-		pattern = BAYER_FILTER_GBRG;
-	} else if (!strncmp(metadata.keywords.bayer_pattern, "GRBG", 4)) {
-		pattern = BAYER_FILTER_GBRG;
-	} else {
-		siril_log_color_message(_("Error: unsupported CFA pattern for this operation.\n"), "red");
-		return 1;
-	}
-
-	// Allocate an array of fits* and the fits objects themselves. These will hold the subchannels
-	fits** cfachans = calloc(4, sizeof(fits*));
-	for (int i = 0 ; i < 4 ; i++) {
-		cfachans[i] = calloc(1, sizeof(fits));
-	}
-
-	// Split the FITS into the 4 subchannels
-	int ret = 1;
-	if (fit->type == DATA_USHORT) {
-		ret = split_cfa_ushort(fit, cfachans[0], cfachans[1], cfachans[2], cfachans[3]);
-	}
-	else if (fit->type == DATA_FLOAT) {
-		ret = split_cfa_float(fit, cfachans[0], cfachans[1], cfachans[2], cfachans[3]);
-	}
-	if (ret) {
-		siril_log_color_message(_("Error splitting into CFA subcannels, aborting...\n"), "red");
-		for (int i = 0 ; i < 4 ; i++) {
-			clearfits(cfachans[i]);
-			free(cfachans[i]);
-		}
-		free(cfachans);
+static int bgcfa_channel_hook(fits *subchannel, int channel, void *user, int threads) {
+	struct background_data *b_args = (struct background_data*) user;
+	double *background = (double*)malloc(subchannel->naxes[0] * subchannel->naxes[1] * sizeof(double));
+	if (!background) {
+		PRINT_ALLOC_ERR;
+		siril_log_message(_("Out of memory - aborting"));
 		return 1;
 	}
 
-	// Clear the original fit image data, we will put the result back into it later
-	free(fit->data);
-	free(fit->fdata);
-	fit->data = fit->pdata[0] = fit->pdata[1] = fit->pdata[2] = NULL;
-	fit->fdata = fit->fpdata[0] = fit->fpdata[1] = fit->fpdata[2] = NULL;
-
-
-	// Carry out background removal on each subchannel in turn
-	for (int i = 0 ; i < 4 ; i++) {
-		fits *subchannel = cfachans[i];
-		double *background = (double*)malloc(subchannel->naxes[0] * subchannel->naxes[1] * sizeof(double));
-		if (!background) {
-			PRINT_ALLOC_ERR;
-			siril_log_message(_("Out of memory - aborting"));
-			return 1;
-		}
-
-		const char *err;
-		GSList *samples = generate_samples(subchannel, b_args->nb_of_samples, b_args->tolerance, SAMPLE_SIZE, &err, (threading_type)threads);
+	GSList *samples;
+	if (b_args->samples) {
+		samples = rescale_sample_list_for_cfa(b_args->samples, subchannel);
 		if (!samples) {
-			siril_log_color_message(_("Failed to generate background samples for image %d: %s\n"), "red", i, _(err));
+			siril_log_color_message(_("Failed to adapt background samples for CFA image\n"), "red");
 			free(background);
 			return 1;
 		}
-
-		const size_t n = subchannel->naxes[0] * subchannel->naxes[1];
-		double *image = malloc(n * sizeof(double));
-		if (!image) {
+	} else {
+		const char *err;
+		samples = generate_samples(subchannel, b_args->nb_of_samples, b_args->tolerance, SAMPLE_SIZE, &err, (threading_type)threads);
+		if (!samples) {
+			siril_log_color_message(_("Failed to generate background samples for CFA channel %d: %s\n"), "red", channel, _(err));
 			free(background);
-			free_background_sample_list(samples);
-			PRINT_ALLOC_ERR;
 			return 1;
 		}
+	}
 
-		double background_mean = get_background_mean(samples, subchannel->naxes[2]);
-		/* compute background */
-		gboolean interpolation_worked = TRUE;
-		gchar *error = NULL;
-		if (b_args->interpolation_method == BACKGROUND_INTER_POLY){
-			interpolation_worked = computeBackground_Polynom(samples, background, 0, subchannel->rx, subchannel->ry, b_args->degree, &error);
-		} else {
-			interpolation_worked = computeBackground_RBF(samples, background, 0, subchannel->rx, subchannel->ry, b_args->smoothing, &error, threads);
-		}
+	double background_mean = get_background_mean(samples, subchannel->naxes[2]);
+	/* compute background */
+	gboolean interpolation_worked = TRUE;
+	gchar *error = NULL;
+	if (b_args->interpolation_method == BACKGROUND_INTER_POLY){
+		interpolation_worked = computeBackground_Polynom(samples, background, 0, subchannel->rx, subchannel->ry, b_args->degree, &error, threads);
+	} else {
+		interpolation_worked = computeBackground_RBF(samples, background, 0, subchannel->rx, subchannel->ry, b_args->smoothing, &error, threads);
+	}
 
-		if (!interpolation_worked) {
-			if (error) {
-				siril_log_message(error);
-			}
-			free(image);
-			free(background);
-			free_background_sample_list(samples);
-			return 1;
+	if (!interpolation_worked) {
+		if (error) {
+			siril_log_message(error);
 		}
-		/* remove background */
-		convert_fits_to_img(subchannel, image, 0, b_args->dither);
-		remove_gradient(image, background, background_mean, subchannel->naxes[0] * subchannel->naxes[1], b_args->correction, (threading_type)threads);
-		convert_img_to_fits(image, subchannel, 0);
-		/* free memory */
-		free(image);
 		free(background);
 		free_background_sample_list(samples);
+		return 1;
 	}
-	fits *out = merge_cfa(cfachans[0], cfachans[1], cfachans[2], cfachans[3], pattern);
-	fits_swap_image_data(out, fit); // Efficiently move the merged pixeldata from out to fit
-	clearfits(out);
-	free(out);
+	/* remove background */
+	remove_gradient_from_fits(subchannel, 0, background, background_mean, b_args->correction, b_args->dither, (threading_type)threads);
+	/* free memory */
+	free(background);
+	free_background_sample_list(samples);
 	return 0;
 }
 
+static int bgcfa_image_hook(struct generic_seq_args *args, int o, int i, fits *fit,
+		rectangle *_, int threads) {
+	struct background_data *b_args = (struct background_data*) args->user;
+	if (b_args->interpolation_method == BACKGROUND_INTER_RBF) {
+		siril_log_color_message(_("Warning: RBF background removal is not recommended for CFA images. Only linear background removal is recommended.\n"), "salmon");
+	} else if (b_args->degree > 1) {
+		siril_log_color_message(_("Warning: polynomial background removal order > 1 is not recommended for CFA images. Only linear background removal is recommended.\n"), "salmon");
+	}
+	// the CFA pattern may only be in the metadata of the frame
+	if (fit->keywords.bayer_pattern[0] == '\0') {
+		fits metadata = { 0 };
+		if (!seq_read_frame_metadata(args->seq, i, &metadata))
+			g_strlcpy(fit->keywords.bayer_pattern, metadata.keywords.bayer_pattern, FLEN_VALUE);
+		clearfits(&metadata);
+	}
+
+	// The 4 CFA subchannels are split, processed independently and merged back
+	// in the frame, without writing them
+	return process_cfa_channels(fit, bgcfa_channel_hook, b_args, threads);
+}
+
 static int background_mem_limits_hook(struct generic_seq_args *args, gboolean for_writer) {
 	unsigned int MB_per_image, MB_avail;
 
@@ -1245,17 +1135,17 @@ static int background_mem_limits_hook(struct generic_seq_args *args, gboolean fo
 		 * generate_samples convert_fits_to_luminance allocates         rx * ry * sizeof(float)
 		 * generate_samples allocates a buffer for MAD computation      rx * ry * sizeof(double)
 		 * both are freed at generate_samples exit
-		 * for color images:
-		 *	update_median_for_rgb_samples allocates for median      rx * ry * sizeof(double)
-		 * freed at update_median_for_rgb_samples exit
-		 * remove_gradient_from_image allocates the background image to rx * ry * sizeof(double)
-		 * remove_gradient_from_image allocates the image            to rx * ry * sizeof(double)
+		 * for color images or with the samples of the reference image:
+		 *	update_median_samples allocates for median               rx * ry * sizeof(double)
+		 * freed at update_median_samples exit
+		 * the image hook allocates the background image to          rx * ry * sizeof(double)
+		 * the background is removed from the frame in place
 		 *
 		 * so at maximum, ignoring the samples, we need 2 times the double channel size.
 		 *
-		 * Despite creating the CFA subsequences, peak memory use does not increase when handling
-		 * a CFA sequence as we free the pixel data in fit before starting to process each of the
-		 * subchannels (essentially we are doing the same operation on 4 FITS each 1/4 the size)
+		 * For a CFA sequence, the 4 subchannels of the frame are kept in memory with the frame
+		 * and merged back in place, but the double buffers are then only 1/4 of the size, so
+		 * peak memory use does not increase.
 		 *
 		 */
 		uint64_t double_channel_size = args->seq->rx * args->seq->ry * sizeof(double);
@@ -1303,9 +1193,34 @@ static int background_mem_limits_hook(struct generic_seq_args *args, gboolean fo
 	return limit;
 }
 
+static int bg_extract_prepare_hook(struct generic_seq_args *args) {
+	struct background_data *data = (struct background_data *) args->user;
+	if (data->ref_samples) {
+		/* the samples are placed once on the reference image, the frames
+		 * only update their medians */
+		fits ref = { 0 };
+		int ref_index = sequence_find_refimage(args->seq);
+		if (seq_read_frame(args->seq, ref_index, &ref, FALSE, -1)) {
+			siril_log_color_message(_("Could not read the reference image\n"), "red");
+			return 1;
+		}
+		const char *err;
+		data->samples = generate_samples(&ref, data->nb_of_samples, data->tolerance, SAMPLE_SIZE, &err, MULTI_THREADED);
+		clearfits(&ref);
+		if (!data->samples) {
+			siril_log_color_message(_("Failed to generate background samples for the reference image: %s\n"), "red", _(err));
+			return 1;
+		}
+		siril_log_message(_("Using the %u background samples of the reference image %d for all images\n"),
+				g_slist_length(data->samples), ref_index + 1);
+	}
+	return seq_prepare_hook(args);
+}
+
 int bg_extract_finalize_hook(struct generic_seq_args *args) {
 	struct background_data *data = (struct background_data *) args->user;
 	int retval = seq_finalize_hook(args);
+	free_background_sample_list(data->samples);
 	free(data);
 	return retval;
 }
@@ -1324,7 +1239,7 @@ void apply_background_extraction_to_sequence(struct background_data *background_
 	args->filtering_criterion = seq_filter_included;
 	args->nb_filtered_images = background_args->seq->selnum;
 	args->compute_mem_limits_hook = background_mem_limits_hook;
-	args->prepare_hook = seq_prepare_hook;
+	args->prepare_hook = bg_extract_prepare_hook;
 	args->finalize_hook = bg_extract_finalize_hook;
 	args->image_hook = background_args->is_cfa ? bgcfa_image_hook : background_image_hook;
 	args->stop_on_error = FALSE;
@@ -35,6 +35,8 @@ struct background_data {
 	sequence *seq;
 	char *seqEntry;
 	gboolean is_cfa;
+	gboolean ref_samples;	// sequence: the samples of the reference image are used for all
+	GSList *samples;	// the samples of the reference image
 };
 
 typedef struct sample {
@@ -0,0 +1,197 @@
+/*
+ * This file is part of Siril, an astronomy image processor.
+ * Copyright (C) 2005-2011 Francois Meyer (dulle at free.fr)
+ * Copyright (C) 2012-2025 team free-astro (see more in AUTHORS file)
+ * Reference site is https://siril.org
+ *
+ * Siril is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Siril is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Siril. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Bilateral filter computed on a downsampled grid, as described by Paris and
+ * Durand, "A Fast Approximation of the Bilateral Filter using a Signal
+ * Processing Approach", 2006. Pixels are accumulated in cells of the size of
+ * the spatial and range sigmas, the grid is blurred with a small gaussian and
+ * the result is interpolated back at each pixel, so the cost does not depend
+ * on the spatial radius.
+ * The range coordinate is the sum of the channels, like the L1 colour distance
+ * used by the OpenCV implementation on colour images. */
+
+#include <math.h>
+#include <string.h>
+
+#include "core/siril.h"
+#include "core/proto.h"
+#include "core/OS_utils.h"
+#include "core/siril_log.h"
+
+#include "bilateral_grid.h"
+
+#define GRID_PAD 2
+#define GRID_MAX_RANGE_BINS 256
+
+/* dimensions of the grid, the range axis is the fastest varying */
+enum { AXIS_Z, AXIS_X, AXIS_Y };
+
+/* 5-tap binomial kernel, sigma of one cell */
+static void blur_axis(const float *src, float *dst, const int n[3], const size_t step[3], int axis, int stride) {
+	static const float w[5] = { 1.f / 16.f, 4.f / 16.f, 6.f / 16.f, 4.f / 16.f, 1.f / 16.f };
+	const int b = (axis + 1) % 3, c = (axis + 2) % 3;
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(com.max_thread) schedule(static) collapse(2)
+#endif
+	for (int ic = 0; ic < n[c]; ic++) {
+		for (int ib = 0; ib < n[b]; ib++) {
+			size_t base = ib * step[b] + ic * step[c];
+			for (int k = 0; k < n[axis]; k++) {
+				float *out = dst + (base + k * step[axis]) * stride;
+				for (int ch = 0; ch < stride; ch++)
+					out[ch] = 0.f;
+				for (int t = -2; t <= 2; t++) {
+					int kk = k + t;
+					if (kk < 0 || kk >= n[axis])
+						continue;
+					const float *in = src + (base + kk * step[axis]) * stride;
+					for (int ch = 0; ch < stride; ch++)
+						out[ch] += w[t + 2] * in[ch];
+				}
+			}
+		}
+	}
+}
+
+/* Filters the float image in place. d and sigma_space have the meaning of the
+ * OpenCV bilateralFilter arguments. Returns 1 when the grid is not suitable
+ * for these parameters and the direct filter should be used instead */
+int bilateral_grid_filter(fits *fit, double d, double sigma_col, double sigma_space) {
+	if (fit->type != DATA_FLOAT || sigma_col <= 0.0 || sigma_space <= 0.0)
+		return 1;
+	int radius = d > 0.0 ? (int) (d / 2.0) : (int) round(sigma_space * 1.5);
+	if (radius < BILATERAL_GRID_MIN_RADIUS)
+		return 1;
+	/* the direct filter truncates its kernel to the window */
+	const double ss = min(sigma_space, radius / 1.5);
+	const double sr = sigma_col;
+	if (ss < 2.0)
+		return 1;
+
+	const int rx = fit->rx, ry = fit->ry;
+	const int nch = (int) fit->naxes[2];
+	const int stride = nch + 1;	// channel sums and weight
+	const size_t npixels = (size_t) rx * ry;
+
+	float *range = malloc(npixels * sizeof(float));
+	if (!range) {
+		PRINT_ALLOC_ERR;
+		return 1;
+	}
+	float rmin = FLT_MAX, rmax = -FLT_MAX;
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(com.max_thread) schedule(static) reduction(min:rmin) reduction(max:rmax)
+#endif
+	for (size_t i = 0; i < npixels; i++) {
+		float r = 0.f;
+		for (int c = 0; c < nch; c++)
+			r += fit->fpdata[c][i];
+		range[i] = r;
+		rmin = min(rmin, r);
+		rmax = max(rmax, r);
+	}
+
+	int n[3];
+	n[AXIS_Z] = (int) ((rmax - rmin) / sr) + 1 + 2 * GRID_PAD;
+	n[AXIS_X] = (int) ((rx - 1) / ss) + 1 + 2 * GRID_PAD;
+	n[AXIS_Y] = (int) ((ry - 1) / ss) + 1 + 2 * GRID_PAD;
+	const size_t ncells = (size_t) n[AXIS_Z] * n[AXIS_X] * n[AXIS_Y];
+	if (n[AXIS_Z] > GRID_MAX_RANGE_BINS + 2 * GRID_PAD ||
+			2 * ncells * stride * sizeof(float) > get_available_memory() / 2) {
+		siril_debug_print("bilateral grid: %d range bins, using the direct filter\n", n[AXIS_Z]);
+		free(range);
+		return 1;
+	}
+	const size_t step[3] = { 1, n[AXIS_Z], (size_t) n[AXIS_Z] * n[AXIS_X] };
+	siril_debug_print("bilateral grid: %d x %d x %d cells\n", n[AXIS_X], n[AXIS_Y], n[AXIS_Z]);
+
+	float *grid = calloc(ncells * stride, sizeof(float));
+	float *tmp = malloc(ncells * stride * sizeof(float));
+	int *row_cell = malloc(ry * sizeof(int));
+	if (!grid || !tmp || !row_cell) {
+		PRINT_ALLOC_ERR;
+		free(grid);
+		free(tmp);
+		free(row_cell);
+		free(range);
+		return 1;
+	}
+
+	/* splat: each thread owns a row of cells, so no atomics are needed */
+	for (int y = 0; y < ry; y++)
+		row_cell[y] = (int) (y / ss + 0.5) + GRID_PAD;
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(com.max_thread) schedule(dynamic)
+#endif
+	for (int gy = 0; gy < n[AXIS_Y]; gy++) {
+		for (int y = 0; y < ry; y++) {
+			if (row_cell[y] != gy)
+				continue;
+			for (int x = 0; x < rx; x++) {
+				size_t i = (size_t) y * rx + x;
+				int gx = (int) (x / ss + 0.5) + GRID_PAD;
+				int gz = (int) ((range[i] - rmin) / sr + 0.5) + GRID_PAD;
+				float *cell = grid + (gy * step[AXIS_Y] + gx * step[AXIS_X] + gz) * stride;
+				for (int c = 0; c < nch; c++)
+					cell[c] += fit->fpdata[c][i];
+				cell[nch] += 1.f;
+			}
+		}
+	}
+
+	blur_axis(grid, tmp, n, step, AXIS_Z, stride);
+	blur_axis(tmp, grid, n, step, AXIS_X, stride);
+	blur_axis(grid, tmp, n, step, AXIS_Y, stride);
+
+	/* slice: trilinear interpolation of the blurred grid */
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(com.max_thread) schedule(static)
+#endif
+	for (int y = 0; y < ry; y++) {
+		float fy = (float) (y / ss) + GRID_PAD;
+		int y0 = (int) fy;
+		float wy = fy - y0;
+		for (int x = 0; x < rx; x++) {
+			size_t i = (size_t) y * rx + x;
+			float fx = (float) (x / ss) + GRID_PAD;
+			float fz = (float) ((range[i] - rmin) / sr) + GRID_PAD;
+			int x0 = (int) fx, z0 = (int) fz;
+			float wx = fx - x0, wz = fz - z0;
+			float acc[4] = { 0.f };
+			for (int k = 0; k < 8; k++) {
+				int dx = k & 1, dy = (k >> 1) & 1, dz = (k >> 2) & 1;
+				float w = (dx ? wx : 1.f - wx) * (dy ? wy : 1.f - wy) * (dz ? wz : 1.f - wz);
+				const float *cell = tmp + ((y0 + dy) * step[AXIS_Y] + (x0 + dx) * step[AXIS_X] + z0 + dz) * stride;
+				for (int c = 0; c < stride; c++)
+					acc[c] += w * cell[c];
+			}
+			if (acc[nch] > 0.f) {
+				for (int c = 0; c < nch; c++)
+					fit->fpdata[c][i] = acc[c] / acc[nch];
+			}
+		}
+	}
+
+	free(grid);
+	free(tmp);
+	free(row_cell);
+	free(range);
+	return 0;
+}
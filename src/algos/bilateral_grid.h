@@ -0,0 +1,11 @@
+#ifndef SRC_ALGOS_BILATERAL_GRID_H_
+#define SRC_ALGOS_BILATERAL_GRID_H_
+
+#include "core/siril.h"
+
+/* below this radius, the direct bilateral filter is faster than the grid */
+#define BILATERAL_GRID_MIN_RADIUS 8
+
+int bilateral_grid_filter(fits *fit, double d, double sigma_col, double sigma_space);
+
+#endif /* SRC_ALGOS_BILATERAL_GRID_H_ */
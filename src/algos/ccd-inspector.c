@@ -307,6 +307,7 @@ static void set_edge_square(gchar **panel) {
 	int cvport = gfit.naxes[2] > 1 ? RGB_VPORT : RED_VPORT;
 
 	struct image_view *view = &gui.view[cvport];
+	complete_display_remap(cvport);
 
 	siril_open_dialog("edge_dialog");
 	if (edge_surface)
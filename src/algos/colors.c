@@ -114,6 +114,58 @@ void hsl_to_rgb_float_sat(float h, float sl, float l, float * r, float * g,
 		}
 	}
 }
+/* Same as rgb_to_hsl_float_sat() on n pixels of planar buffers, written
+ * without branches so that the compiler can vectorise it. Pixels below the
+ * low threshold get h = s = l = 0 */
+void rgb_to_hsl_float_sat_batch(const float *r, const float *g, const float *b, float low,
+		float *h, float *s, float *l, size_t n) {
+	for (size_t i = 0; i < n; i++) {
+		const float R = r[i], G = g[i], B = b[i];
+		const float v = max(max(R, G), B);
+		const float m = min(min(R, G), B);
+		const float vm = v - m;
+		const float L = (m + v) / 2.f;
+		const gboolean coloured = vm > 0.f;
+		const float d = coloured ? vm : 1.f;
+		float den = (L <= 0.5f) ? (v + m) : (2.f - v - m);
+		den = coloured ? den : 1.f;
+		const float r2 = (v - R) / d, g2 = (v - G) / d, b2 = (v - B) / d;
+		const float hr = (G == m ? 5.f + b2 : 1.f - g2);
+		const float hg = (B == m ? 1.f + r2 : 3.f - b2);
+		const float hb = (R == m ? 3.f + g2 : 5.f - r2);
+		const float H = (R == v) ? hr : ((G == v) ? hg : hb);
+		const gboolean below = m + v < low + low;
+		l[i] = below ? 0.f : L;
+		s[i] = (below || !coloured) ? 0.f : vm / den;
+		h[i] = (below || !coloured) ? 0.f : H;
+	}
+}
+
+/* Same as hsl_to_rgb_float_sat() on n pixels of planar buffers, without
+ * branches */
+void hsl_to_rgb_float_sat_batch(const float *h, const float *s, const float *l,
+		float *r, float *g, float *b, size_t n) {
+	for (size_t i = 0; i < n; i++) {
+		const float H = h[i] >= 6.f ? h[i] - 6.f : h[i];
+		const float S = s[i], L = l[i];
+		const float v = (L <= 0.5f) ? (L * (1.f + S)) : (L + S - L * S);
+		const gboolean positive = v > 0.f;
+		const float m = L + L - v;
+		const float sv = (v - m) / (positive ? v : 1.f);
+		const int sextant = H;
+		const float fract = H - sextant;
+		const float vsf = v * sv * fract;
+		const float mid1 = m + vsf;
+		const float mid2 = v - vsf;
+		const float R = (sextant == 0 || sextant == 5) ? v : (sextant == 1 ? mid2 : (sextant == 4 ? mid1 : m));
+		const float G = (sextant == 1 || sextant == 2) ? v : (sextant == 0 ? mid1 : (sextant == 3 ? mid2 : m));
+		const float B = (sextant == 3 || sextant == 4) ? v : (sextant == 2 ? mid1 : (sextant == 5 ? mid2 : m));
+		r[i] = positive ? R : 0.f;
+		g[i] = positive ? G : 0.f;
+		b[i] = positive ? B : 0.f;
+	}
+}
+
 /*
  *  * RGB-HSL transforms.
  *   * Ken Fishkin, Pixar Inc., January 1989.
@@ -868,14 +920,14 @@ static gpointer extract_channels_ushort(gpointer p) {
 		lab_type = TYPE_Lab_16_PLANAR;
 		threaded = !get_thread_run();
 		// We use sRGB as the fallback for non-color managed images
-		transform = cmsCreateTransformTHR((threaded ? com.icc.context_threaded : com.icc.context_single), image_profile, trans_type, cielab_profile, lab_type, INTENT_PERCEPTUAL, com.icc.rendering_flags);
+		transform = siril_transform_acquire((threaded ? com.icc.context_threaded : com.icc.context_single), image_profile, trans_type, cielab_profile, lab_type, INTENT_PERCEPTUAL, com.icc.rendering_flags);
 		cmsCloseProfile(cielab_profile);
 		cmsCloseProfile(image_profile);
 		datasize = sizeof(WORD);
 		bytesperline = args->fit->rx * datasize;
 		bytesperplane = args->fit->rx * args->fit->ry * datasize;
 		cmsDoTransformLineStride(transform, args->fit->data, args->fit->data, args->fit->rx, args->fit->ry, bytesperline, bytesperline, bytesperplane, bytesperplane);
-		cmsDeleteTransform(transform);
+		siril_transform_release(transform);
 	}
 	gchar *fitfilter = g_strdup(args->fit->keywords.filter);
 	if (desc) {
@@ -1003,14 +1055,14 @@ static gpointer extract_channels_float(gpointer p) {
 			trans_type = get_planar_formatter_type(sig, args->fit->type, FALSE);
 			lab_type = TYPE_Lab_FLT_PLANAR;
 			threaded = !get_thread_run();
-			transform = cmsCreateTransformTHR((threaded ? com.icc.context_threaded : com.icc.context_single), image_profile, trans_type, cielab_profile, lab_type, com.pref.icc.processing_intent, com.icc.rendering_flags);
+			transform = siril_transform_acquire((threaded ? com.icc.context_threaded : com.icc.context_single), image_profile, trans_type, cielab_profile, lab_type, com.pref.icc.processing_intent, com.icc.rendering_flags);
 			cmsCloseProfile(cielab_profile);
 			cmsCloseProfile(image_profile);
 			datasize = sizeof(float);
 			bytesperline = args->fit->rx * datasize;
 			bytesperplane = args->fit->rx * args->fit->ry * datasize;
 			cmsDoTransformLineStride(transform, args->fit->fdata, args->fit->fdata, args->fit->rx, args->fit->ry, bytesperline, bytesperline, bytesperplane, bytesperplane);
-			cmsDeleteTransform(transform);
+			siril_transform_release(transform);
 			/*  Convert L* to Siril 0.0 - 1.0 range
 			* TODO: long term, make Siril able to cope with images with different ranges
 			* by accounting for them in the display transform
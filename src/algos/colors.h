@@ -28,6 +28,8 @@ struct ccm_data {
 
 void rgb_to_hsl_float_sat(float, float, float, float, float *, float *, float *);
 void hsl_to_rgb_float_sat(float, float, float, float *, float *, float *);
+void rgb_to_hsl_float_sat_batch(const float *r, const float *g, const float *b, float low, float *h, float *s, float *l, size_t n);
+void hsl_to_rgb_float_sat_batch(const float *h, const float *s, const float *l, float *r, float *g, float *b, size_t n);
 void rgb_to_hsl(double, double, double, double *, double *, double *);
 void hsl_to_rgb(double, double, double, double *, double *, double *);
 void rgb_to_hslf(float r, float g, float b, float *h, float *s, float *l);
@@ -28,6 +28,7 @@
 #include "core/icc_profile.h"
 #include "core/processing.h"
 #include "core/siril_log.h"
+#include "core/trace.h"
 #include "io/sequence.h"
 #include "io/image_format_fits.h"
 #include "algos/demosaicing.h"
@@ -77,90 +78,83 @@ static inline int FC(const size_t row, const size_t col, const uint32_t filters)
 	return filters >> (((row << 1 & 14) + (col & 1)) << 1) & 3;
 }
 
+/* offsets of the red, the two green and the blue pixels in a 2x2 cell */
+static void super_pixel_offsets(sensor_pattern pattern, int width, size_t off[4]) {
+	switch (pattern) {
+	default:
+	case BAYER_FILTER_RGGB:
+		off[0] = 0; off[1] = 1; off[2] = width; off[3] = width + 1;
+		break;
+	case BAYER_FILTER_BGGR:
+		off[3] = 0; off[1] = 1; off[2] = width; off[0] = width + 1;
+		break;
+	case BAYER_FILTER_GBRG:
+		off[1] = 0; off[3] = 1; off[0] = width; off[2] = width + 1;
+		break;
+	case BAYER_FILTER_GRBG:
+		off[1] = 0; off[0] = 1; off[3] = width; off[2] = width + 1;
+		break;
+	}
+}
+
+/* for odd sizes, the last column and row of the super pixel image have no
+ * complete cell, they are copied from the previous ones */
+#define SUPER_PIXEL_FILL_EDGES(newbuf, width, height) { \
+	const int new_rx = width / 2 + width % 2; \
+	const int new_ry = height / 2 + height % 2; \
+	if (width & 1 && new_rx > 1) { \
+		for (int y = 0; y < height / 2; y++) { \
+			size_t last = ((size_t) y * new_rx + new_rx - 1) * 3; \
+			memcpy(newbuf + last, newbuf + last - 3, 3 * sizeof(*newbuf)); \
+		} \
+	} \
+	if (height & 1 && new_ry > 1) \
+		memcpy(newbuf + (size_t) (new_ry - 1) * new_rx * 3, \
+				newbuf + (size_t) (new_ry - 2) * new_rx * 3, new_rx * 3 * sizeof(*newbuf)); \
+}
+
 /* width and height are sizes of the original image */
 static void super_pixel_ushort(const WORD *buf, WORD *newbuf, int width, int height,
 		sensor_pattern pattern) {
-	long i = 0;
+	const int new_rx = width / 2 + width % 2;
+	size_t off[4];
+	super_pixel_offsets(pattern, width, off);
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(com.max_thread) schedule(static)
+#endif
 	for (int row = 0; row < height - 1; row += 2) {
-		for (int col = 0; col < width - 1; col += 2) {
-			float tmp;
-			switch (pattern) {
-			default:
-			case BAYER_FILTER_RGGB:
-				newbuf[i + 0] = buf[col + row * width];
-				tmp = buf[1 + col + row * width];
-				tmp += buf[col + (1 + row) * width];
-				newbuf[i + 1] = round_to_WORD(tmp * 0.5f);
-				newbuf[i + 2] = buf[1 + col + (1 + row) * width];
-				break;
-			case BAYER_FILTER_BGGR:
-				newbuf[i + 2] = buf[col + row * width];
-				tmp = buf[1 + col + row * width];
-				tmp += buf[(col + row * width) + width];
-				newbuf[i + 1] = round_to_WORD(tmp * 0.5f);
-				newbuf[i + 0] = buf[(1 + col + row * width) + width];
-				break;
-			case BAYER_FILTER_GBRG:
-				newbuf[i + 2] = buf[1 + col + row * width];
-				newbuf[i + 0] = buf[(col + row * width) + width];
-				tmp = buf[col + row * width];
-				tmp += buf[(1 + col + row * width) + width];
-				newbuf[i + 1] = round_to_WORD(tmp * 0.5f);
-				break;
-			case BAYER_FILTER_GRBG:
-				newbuf[i + 0] = buf[1 + col + row * width];
-				newbuf[i + 2] = buf[(col + row * width) + width];
-				tmp = buf[col + row * width];
-				tmp += buf[(1 + col + row * width) + width];
-				newbuf[i + 1] = round_to_WORD(tmp * 0.5f);
-				break;
-			}
-			i += 3;
+		const WORD *in = buf + (size_t) row * width;
+		WORD *out = newbuf + (size_t) (row / 2) * new_rx * 3;
+		for (int col = 0; col < width - 1; col += 2, out += 3) {
+			const WORD *cell = in + col;
+			out[0] = cell[off[0]];
+			out[1] = round_to_WORD(((float) cell[off[1]] + (float) cell[off[2]]) * 0.5f);
+			out[2] = cell[off[3]];
 		}
 	}
+	SUPER_PIXEL_FILL_EDGES(newbuf, width, height);
 }
 
 /* width and height are sizes of the original image */
 static void super_pixel_float(const float *buf, float *newbuf, int width, int height,
 		sensor_pattern pattern) {
-	long i = 0;
+	const int new_rx = width / 2 + width % 2;
+	size_t off[4];
+	super_pixel_offsets(pattern, width, off);
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(com.max_thread) schedule(static)
+#endif
 	for (int row = 0; row < height - 1; row += 2) {
-		for (int col = 0; col < width - 1; col += 2) {
-			float tmp;
-			switch (pattern) {
-			default:
-			case BAYER_FILTER_RGGB:
-				newbuf[i + 0] = buf[col + row * width];
-				tmp = buf[1 + col + row * width];
-				tmp += buf[col + (1 + row) * width];
-				newbuf[i + 1] = tmp * 0.5f;
-				newbuf[i + 2] = buf[1 + col + (1 + row) * width];
-				break;
-			case BAYER_FILTER_BGGR:
-				newbuf[i + 2] = buf[col + row * width];
-				tmp = buf[1 + col + row * width];
-				tmp += buf[(col + row * width) + width];
-				newbuf[i + 1] = tmp * 0.5f;
-				newbuf[i + 0] = buf[(1 + col + row * width) + width];
-				break;
-			case BAYER_FILTER_GBRG:
-				newbuf[i + 2] = buf[1 + col + row * width];
-				newbuf[i + 0] = buf[(col + row * width) + width];
-				tmp = buf[col + row * width];
-				tmp += buf[(1 + col + row * width) + width];
-				newbuf[i + 1] = tmp * 0.5f;
-				break;
-			case BAYER_FILTER_GRBG:
-				newbuf[i + 0] = buf[1 + col + row * width];
-				newbuf[i + 2] = buf[(col + row * width) + width];
-				tmp = buf[col + row * width];
-				tmp += buf[(1 + col + row * width) + width];
-				newbuf[i + 1] = tmp * 0.5f;
-				break;
-			}
-			i += 3;
+		const float *in = buf + (size_t) row * width;
+		float *out = newbuf + (size_t) (row / 2) * new_rx * 3;
+		for (int col = 0; col < width - 1; col += 2, out += 3) {
+			const float *cell = in + col;
+			out[0] = cell[off[0]];
+			out[1] = (cell[off[1]] + cell[off[2]]) * 0.5f;
+			out[2] = cell[off[3]];
 		}
 	}
+	SUPER_PIXEL_FILL_EDGES(newbuf, width, height);
 }
 
 /***************************************************
@@ -194,26 +188,30 @@ static void ClearBorders(WORD *rgb, int sx, int sy, int w) {
 	}
 }
 
-/* OpenCV's Bayer decoding */
-static int bayer_Bilinear(const WORD *bayer, WORD *rgb, int sx, int sy,
+/* OpenCV's Bayer decoding, rows are independent and computed in parallel */
+static int bayer_Bilinear(const WORD *bayer_data, WORD *rgb_data, int sx, int sy,
 		sensor_pattern tile) {
 	const int bayerStep = sx;
 	const int rgbStep = 3 * sx;
-	int width = sx;
-	int height = sy;
-	int blue = tile == BAYER_FILTER_BGGR || tile == BAYER_FILTER_GBRG ? -1 : 1;
-	int start_with_green = tile == BAYER_FILTER_GBRG
+	const int width = sx - 2;
+	const int height = sy - 2;
+	const int first_blue = tile == BAYER_FILTER_BGGR || tile == BAYER_FILTER_GBRG ? -1 : 1;
+	const int first_start_with_green = tile == BAYER_FILTER_GBRG
 			|| tile == BAYER_FILTER_GRBG;
 
 	if (tile > BAYER_FILTER_MAX || tile < BAYER_FILTER_MIN)
 		return -1;
 
-	ClearBorders(rgb, sx, sy, 1);
-	rgb += rgbStep + 3 + 1;
-	height -= 2;
-	width -= 2;
+	ClearBorders(rgb_data, sx, sy, 1);
 
-	for (; height--; bayer += bayerStep, rgb += rgbStep) {
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(com.max_thread) schedule(static)
+#endif
+	for (int r = 0; r < height; r++) {
+		const WORD *bayer = bayer_data + (size_t) r * bayerStep;
+		WORD *rgb = rgb_data + (size_t) (r + 1) * rgbStep + 3 + 1;
+		const int blue = (r & 1) ? -first_blue : first_blue;
+		const int start_with_green = (r & 1) ? !first_start_with_green : first_start_with_green;
 		int t0, t1;
 		const WORD *bayerEnd = bayer + width;
 
@@ -269,15 +267,7 @@ static int bayer_Bilinear(const WORD *bayer, WORD *rgb, int sx, int sy,
 			rgb[-blue] = round_to_WORD(t0);
 			rgb[0] = round_to_WORD(t1);
 			rgb[blue] = bayer[bayerStep + 1];
-			bayer++;
-			rgb += 3;
 		}
-
-		bayer -= width;
-		rgb -= width * 3;
-
-		blue = -blue;
-		start_with_green = !start_with_green;
 	}
 
 	return 0;
@@ -314,10 +304,9 @@ static int bayer_VNG(const WORD *bayer, WORD *dst, int sx, int sy,
 			+1, 0, +1, -1, 0, -1 };
 	const int height = sy, width = sx;
 	const signed char *cp;
-	WORD (*brow[5])[3], *pix; /* [FD] */
-	int code[8][2][320], *ip, gval[8], gmin, gmax, sum[4];
+	int code[8][2][320], *ip;
 	int row, col, x, y, x1, x2, y1, y2, t, weight, grads, color, diag;
-	int g, diff, thold, num, c;
+	int g;
 	unsigned long int filters; /* [FD] */
 
 	/* first, use bilinear bayer decoding */
@@ -380,15 +369,25 @@ static int bayer_VNG(const WORD *bayer, WORD *dst, int sx, int sy,
 			}
 		}
 	}
-	brow[4] = calloc(width * 3, sizeof **brow);
-	//merror (brow[4], "vng_interpolate()");
-	for (row = 0; row < 3; row++)
-		brow[row] = brow[4] + row * width;
-	for (row = 2; row < height - 2; row++) { /* Do VNG interpolation */
-		for (col = 2; col < width - 2; col++) {
-			pix = dst + (row * width + col) * 3; /* [FD] */
-			ip = code[row & 7][col & 1];
-			memset(gval, 0, sizeof gval);
+	/* the interpolation reads the bilinear result around each pixel, it is
+	 * kept in a copy so that the rows can be computed in parallel */
+	size_t nbdata = (size_t) width * height * 3;
+	WORD *lin = malloc(nbdata * sizeof(WORD));
+	if (!lin) {
+		PRINT_ALLOC_ERR;
+		return -1;
+	}
+	memcpy(lin, dst, nbdata * sizeof(WORD));
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(com.max_thread) schedule(static)
+#endif
+	for (int row = 2; row < height - 2; row++) { /* Do VNG interpolation */
+		for (int col = 2; col < width - 2; col++) {
+			const WORD *pix = lin + (row * width + col) * 3; /* [FD] */
+			WORD *out = dst + (row * width + col) * 3;
+			const int *ip = code[row & 7][col & 1];
+			int gval[8] = { 0 }, sum[4] = { 0 };
+			int g, diff, gmin, gmax, thold, num, color;
 			while ((g = ip[0]) != INT_MAX) { /* Calculate gradients */
 				diff = ABSOLU(pix[g] - pix[ip[1]]) << ip[2];
 				gval[ip[3]] += diff;
@@ -407,16 +406,13 @@ static int bayer_VNG(const WORD *bayer, WORD *dst, int sx, int sy,
 				if (gmax < gval[g])
 					gmax = gval[g];
 			}
-			if (gmax == 0) {
-				memcpy(brow[2][col], pix, 3 * sizeof *dst); /* [FD] */
-				continue;
-			}
+			if (gmax == 0)
+				continue;	// already the bilinear value
 			thold = gmin + (gmax >> 1);
-			memset(sum, 0, sizeof sum);
 			color = FC(row, col, filters);
 			for (num = g = 0; g < 8; g++, ip += 2) { /* Average the neighbors */
 				if (gval[g] <= thold) {
-					for (c = 0; c < 3; c++) /* [FD] */
+					for (int c = 0; c < 3; c++) /* [FD] */
 						if (c == color && ip[1])
 							sum[c] += (pix[c] + pix[ip[1]]) >> 1;
 						else
@@ -424,31 +420,20 @@ static int bayer_VNG(const WORD *bayer, WORD *dst, int sx, int sy,
 					num++;
 				}
 			}
-			for (c = 0; c < 3; c++) { /* [FD] Save to buffer */
-				t = pix[color];
+			for (int c = 0; c < 3; c++) { /* [FD] Save to image */
+				int t = pix[color];
 				if (c != color)
 					t += (sum[c] - sum[color]) / num;
-				//~ CLIP16(t,brow[2][col][c], 16); /* [FD] */
-				brow[2][col][c] = round_to_WORD(t); /* [FD] */
+				out[c] = round_to_WORD(t); /* [FD] */
 			}
 		}
-		if (row > 3) /* Write buffer to image */
-			memcpy(dst + 3 * ((row - 2) * width + 2), brow[0] + 2,
-					(width - 4) * 3 * sizeof *dst); /* [FD] */
-		for (g = 0; g < 4; g++)
-			brow[(g - 1) & 3] = brow[g];
-	}
-	memcpy(dst + 3 * ((row - 2) * width + 2), brow[0] + 2,
-			(width - 4) * 3 * sizeof *dst);
-	memcpy(dst + 3 * ((row - 1) * width + 2), brow[1] + 2,
-			(width - 4) * 3 * sizeof *dst);
-	free(brow[4]);
+	}
+	free(lin);
 
 	return 0;
 }
 
 /* AHD interpolation ported from dcraw to libdc1394 by Samuel Audet */
-static gboolean ahd_inited = FALSE; /* WARNING: not multi-processor safe */
 
 #define LIM(x,min,max) MAX(min,MIN(x,max))
 #define ULIM(x,y,z) ((y) < (z) ? LIM(x,y,z) : LIM(x,z,y))
@@ -501,27 +486,138 @@ static void cam_to_cielab(const uint16_t cam[3], float lab[3]) /* [SA] */
  */
 #define TS 256 /* Tile Size */
 
-static int bayer_AHD(const WORD *bayer, WORD *dst, int sx, int sy,
-		sensor_pattern pattern) {
-	int i, j, top, left, row, col, tr, tc, fc, c, d, val, hm[2];
+static gpointer init_cielab(gpointer data) {
+	cam_to_cielab(NULL, NULL);
+	return NULL;
+}
+
+/* interpolates a tile of TS x TS pixels of the image, buffer is the work
+ * memory of the tile, of 26 * TS * TS bytes */
+static void ahd_interpolate_tile(WORD *dst, int width, int height, uint32_t filters,
+		int top, int left, char *buffer) {
+	int i, j, row, col, tr, tc, fc, c, d, val, hm[2];
 	/* the following has the same type as the image */
 	uint16_t (*pix)[3], (*rix)[3]; /* [SA] */
 	static const int dir[4] = { -1, 1, -TS, TS };
 	unsigned ldiff[2][4], abdiff[2][4], leps, abeps;
 	float flab[3];
-	uint16_t (*rgb)[TS][TS][3]; /* [SA] */
-	short (*lab)[TS][TS][3];
-	char (*homo)[TS][TS], *buffer;
+	uint16_t (*rgb)[TS][TS][3] = (uint16_t (*)[TS][TS][3]) buffer; /* [SA] */
+	short (*lab)[TS][TS][3] = (short (*)[TS][TS][3]) (buffer + 12 * TS * TS);
+	char (*homo)[TS][TS] = (char (*)[TS][TS]) (buffer + 24 * TS * TS);
+
+	memset(rgb, 0, 12 * TS * TS);
+
+	/* Interpolate green horizontally and vertically: */
+	for (row = ((top < 2) ? 2 : top);
+			row < top + TS && row < height - 2; row++) {
+		col = left + (FC(row,left, filters) == 1);
+		if (col < 2)
+			col += 2;
+		for (fc = FC(row, col, filters); col < left + TS && col < width - 2;
+				col += 2) {
+			pix = (uint16_t (*)[3]) dst + (row * width + col); /* [SA] */
+			val = ((pix[-1][1] + pix[0][fc] + pix[1][1]) * 2
+					- pix[-2][fc] - pix[2][fc]) >> 2;
+			rgb[0][row - top][col - left][1] = ULIM(val, pix[-1][1],
+					pix[1][1]);
+			val = ((pix[-width][1] + pix[0][fc] + pix[width][1]) * 2
+					- pix[-2 * width][fc] - pix[2 * width][fc]) >> 2;
+			rgb[1][row - top][col - left][1] = ULIM(val, pix[-width][1],
+					pix[width][1]);
+		}
+	}
+	/* Interpolate red and blue, and convert to CIELab: */
+	for (d = 0; d < 2; d++)
+		for (row = top + 1; row < top + TS - 1 && row < height - 1;
+				row++)
+			for (col = left + 1; col < left + TS - 1 && col < width - 1;
+					col++) {
+				pix = (uint16_t (*)[3]) dst + (row * width + col); /* [SA] */
+				rix = &rgb[d][row - top][col - left];
+				if ((c = 2 - FC(row, col, filters)) == 1) {
+					c = FC(row + 1, col, filters);
+					val = pix[0][1]
+							+ ((pix[-1][2 - c] + pix[1][2 - c]
+									- rix[-1][1] - rix[1][1]) >> 1);
+					rix[0][2 - c] = round_to_WORD(val); /* [SA] */
+					val = pix[0][1]
+							+ ((pix[-width][c] + pix[width][c]
+									- rix[-TS][1] - rix[TS][1]) >> 1);
+				} else
+					val = rix[0][1]
+							+ ((pix[-width - 1][c] + pix[-width + 1][c]
+									+ pix[+width - 1][c]
+									+ pix[+width + 1][c]
+									- rix[-TS - 1][1] - rix[-TS + 1][1]
+									- rix[+TS - 1][1] - rix[+TS + 1][1]
+									+ 1) >> 2);
+				rix[0][c] = round_to_WORD((double) val); /* [SA] */
+				c = FC(row, col, filters);
+				rix[0][c] = pix[0][c];
+				cam_to_cielab(rix[0], flab);
+				for (c = 0; c < 3; c++)
+					lab[d][row - top][col - left][c] = 64 * flab[c];
+			}
+	/* Build homogeneity maps from the CIELab images: */
+	memset(homo, 0, 2 * TS * TS);
+	for (row = top + 2; row < top + TS - 2 && row < height; row++) {
+		tr = row - top;
+		for (col = left + 2; col < left + TS - 2 && col < width;
+				col++) {
+			tc = col - left;
+			for (d = 0; d < 2; d++)
+				for (i = 0; i < 4; i++)
+					ldiff[d][i] = ABSOLU(
+							lab[d][tr][tc][0]
+									- lab[d][tr][tc + dir[i]][0]);
+			leps = MIN(MAX(ldiff[0][0],ldiff[0][1]),
+					MAX(ldiff[1][2],ldiff[1][3]));
+			for (d = 0; d < 2; d++)
+				for (i = 0; i < 4; i++)
+					if (i >> 1 == d || ldiff[d][i] <= leps)
+						abdiff[d][i] =
+								SQR(
+										lab[d][tr][tc][1]
+												- lab[d][tr][tc + dir[i]][1]) + SQR(lab[d][tr][tc][2] -lab[d][tr][tc+dir[i]][2]);
+			abeps = MIN(MAX(abdiff[0][0],abdiff[0][1]),
+					MAX(abdiff[1][2],abdiff[1][3]));
+			for (d = 0; d < 2; d++)
+				for (i = 0; i < 4; i++)
+					if (ldiff[d][i] <= leps && abdiff[d][i] <= abeps)
+						homo[d][tr][tc]++;
+		}
+	}
+	/* Combine the most homogenous pixels for the final result: */
+	for (row = top + 3; row < top + TS - 3 && row < height - 3; row++) {
+		tr = row - top;
+		for (col = left + 3; col < left + TS - 3 && col < width - 3;
+				col++) {
+			tc = col - left;
+			for (d = 0; d < 2; d++)
+				for (hm[d] = 0, i = tr - 1; i <= tr + 1; i++)
+					for (j = tc - 1; j <= tc + 1; j++)
+						hm[d] += homo[d][i][j];
+			if (hm[0] != hm[1])
+				for (c = 0; c < 3; c++)
+					dst[(row * width + col) * 3 + c] = round_to_WORD(
+							rgb[hm[1] > hm[0]][tr][tc][c]); /* [SA] */
+			else
+				for (c = 0; c < 3; c++)
+					dst[(row * width + col) * 3 + c] = round_to_WORD(
+							(rgb[0][tr][tc][c] + rgb[1][tr][tc][c])
+									>> 1); /* [SA] */
+		}
+	}
+}
+
+static int bayer_AHD(const WORD *bayer, WORD *dst, int sx, int sy,
+		sensor_pattern pattern) {
+	static GOnce cielab_once = G_ONCE_INIT;
 	/* start - new code for libdc1394 */
 	uint32_t filters;
 	const int height = sy, width = sx;
-	int x, y;
 
-	if (ahd_inited == FALSE) {
-		/* WARNING: this might not be multi-processor safe */
-		cam_to_cielab(NULL, NULL);
-		ahd_inited = TRUE;
-	}
+	g_once(&cielab_once, init_cielab, NULL);
 
 	switch (pattern) {
 	case BAYER_FILTER_BGGR:
@@ -541,8 +637,11 @@ static int bayer_AHD(const WORD *bayer, WORD *dst, int sx, int sy,
 	}
 
 	/* fill-in destination with known exact values */
-	for (y = 0; y < height; y++) {
-		for (x = 0; x < width; x++) {
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(com.max_thread) schedule(static)
+#endif
+	for (int y = 0; y < height; y++) {
+		for (int x = 0; x < width; x++) {
 			int channel = FC(y, x, filters);
 			dst[(y * width + x) * 3 + channel] = bayer[y * width + x];
 		}
@@ -576,121 +675,36 @@ static int bayer_AHD(const WORD *bayer, WORD *dst, int sx, int sy,
 	}
 	/* end - code from border_interpolate(int border) */
 
-	buffer = (char *) malloc(26 * TS * TS); /* 1664 kB */
-	/* merror (buffer, "ahd_interpolate()"); */
-	rgb = (uint16_t (*)[TS][TS][3]) buffer; /* [SA] */
-	lab = (short (*)[TS][TS][3]) (buffer + 12 * TS * TS);
-	homo = (char (*)[TS][TS]) (buffer + 24 * TS * TS);
-
-	for (top = 0; top < height; top += TS - 6)
-		for (left = 0; left < width; left += TS - 6) {
-			memset(rgb, 0, 12 * TS * TS);
-
-			/* Interpolate green horizontally and vertically: */
-			for (row = ((top < 2) ? 2 : top);
-					row < top + TS && row < height - 2; row++) {
-				col = left + (FC(row,left, filters) == 1);
-				if (col < 2)
-					col += 2;
-				for (fc = FC(row, col, filters); col < left + TS && col < width - 2;
-						col += 2) {
-					pix = (uint16_t (*)[3]) dst + (row * width + col); /* [SA] */
-					val = ((pix[-1][1] + pix[0][fc] + pix[1][1]) * 2
-							- pix[-2][fc] - pix[2][fc]) >> 2;
-					rgb[0][row - top][col - left][1] = ULIM(val, pix[-1][1],
-							pix[1][1]);
-					val = ((pix[-width][1] + pix[0][fc] + pix[width][1]) * 2
-							- pix[-2 * width][fc] - pix[2 * width][fc]) >> 2;
-					rgb[1][row - top][col - left][1] = ULIM(val, pix[-width][1],
-							pix[width][1]);
-				}
-			}
-			/* Interpolate red and blue, and convert to CIELab: */
-			for (d = 0; d < 2; d++)
-				for (row = top + 1; row < top + TS - 1 && row < height - 1;
-						row++)
-					for (col = left + 1; col < left + TS - 1 && col < width - 1;
-							col++) {
-						pix = (uint16_t (*)[3]) dst + (row * width + col); /* [SA] */
-						rix = &rgb[d][row - top][col - left];
-						if ((c = 2 - FC(row, col, filters)) == 1) {
-							c = FC(row + 1, col, filters);
-							val = pix[0][1]
-									+ ((pix[-1][2 - c] + pix[1][2 - c]
-											- rix[-1][1] - rix[1][1]) >> 1);
-							rix[0][2 - c] = round_to_WORD(val); /* [SA] */
-							val = pix[0][1]
-									+ ((pix[-width][c] + pix[width][c]
-											- rix[-TS][1] - rix[TS][1]) >> 1);
-						} else
-							val = rix[0][1]
-									+ ((pix[-width - 1][c] + pix[-width + 1][c]
-											+ pix[+width - 1][c]
-											+ pix[+width + 1][c]
-											- rix[-TS - 1][1] - rix[-TS + 1][1]
-											- rix[+TS - 1][1] - rix[+TS + 1][1]
-											+ 1) >> 2);
-						rix[0][c] = round_to_WORD((double) val); /* [SA] */
-						c = FC(row, col, filters);
-						rix[0][c] = pix[0][c];
-						cam_to_cielab(rix[0], flab);
-						for (c = 0; c < 3; c++)
-							lab[d][row - top][col - left][c] = 64 * flab[c];
-					}
-			/* Build homogeneity maps from the CIELab images: */
-			memset(homo, 0, 2 * TS * TS);
-			for (row = top + 2; row < top + TS - 2 && row < height; row++) {
-				tr = row - top;
-				for (col = left + 2; col < left + TS - 2 && col < width;
-						col++) {
-					tc = col - left;
-					for (d = 0; d < 2; d++)
-						for (i = 0; i < 4; i++)
-							ldiff[d][i] = ABSOLU(
-									lab[d][tr][tc][0]
-											- lab[d][tr][tc + dir[i]][0]);
-					leps = MIN(MAX(ldiff[0][0],ldiff[0][1]),
-							MAX(ldiff[1][2],ldiff[1][3]));
-					for (d = 0; d < 2; d++)
-						for (i = 0; i < 4; i++)
-							if (i >> 1 == d || ldiff[d][i] <= leps)
-								abdiff[d][i] =
-										SQR(
-												lab[d][tr][tc][1]
-														- lab[d][tr][tc + dir[i]][1]) + SQR(lab[d][tr][tc][2] -lab[d][tr][tc+dir[i]][2]);
-					abeps = MIN(MAX(abdiff[0][0],abdiff[0][1]),
-							MAX(abdiff[1][2],abdiff[1][3]));
-					for (d = 0; d < 2; d++)
-						for (i = 0; i < 4; i++)
-							if (ldiff[d][i] <= leps && abdiff[d][i] <= abeps)
-								homo[d][tr][tc]++;
-				}
-			}
-			/* Combine the most homogenous pixels for the final result: */
-			for (row = top + 3; row < top + TS - 3 && row < height - 3; row++) {
-				tr = row - top;
-				for (col = left + 3; col < left + TS - 3 && col < width - 3;
-						col++) {
-					tc = col - left;
-					for (d = 0; d < 2; d++)
-						for (hm[d] = 0, i = tr - 1; i <= tr + 1; i++)
-							for (j = tc - 1; j <= tc + 1; j++)
-								hm[d] += homo[d][i][j];
-					if (hm[0] != hm[1])
-						for (c = 0; c < 3; c++)
-							dst[(row * width + col) * 3 + c] = round_to_WORD(
-									rgb[hm[1] > hm[0]][tr][tc][c]); /* [SA] */
-					else
-						for (c = 0; c < 3; c++)
-							dst[(row * width + col) * 3 + c] = round_to_WORD(
-									(rgb[0][tr][tc][c] + rgb[1][tr][tc][c])
-											>> 1); /* [SA] */
-				}
+	/* the tiles overlap by 6 pixels: the tiles of the same parity in both
+	 * directions do not interact and are processed in parallel, in 4 passes */
+	const int step = TS - 6;
+	const int ntiles_x = (width + step - 1) / step;
+	const int ntiles = ((height + step - 1) / step) * ntiles_x;
+	int retval = 0;
+#ifdef _OPENMP
+#pragma omp parallel num_threads(com.max_thread)
+#endif
+	{
+		char *buffer = malloc(26 * TS * TS); /* 1664 kB */
+		if (!buffer) {
+			PRINT_ALLOC_ERR;
+			retval = -1;
+		}
+		for (int pass = 0; pass < 4; pass++) {
+#ifdef _OPENMP
+#pragma omp for schedule(dynamic)
+#endif
+			for (int t = 0; t < ntiles; t++) {
+				int ty = t / ntiles_x, tx = t % ntiles_x;
+				if (!buffer || ((ty & 1) << 1 | (tx & 1)) != pass)
+					continue;
+				ahd_interpolate_tile(dst, width, height, filters, ty * step, tx * step, buffer);
 			}
 		}
-	free(buffer);
+		free(buffer);
+	}
 
-	return 0;
+	return retval;
 }
 
 #define fcol(row, col) xtrans[(row) % 6][(col) % 6]
@@ -699,7 +713,6 @@ static int bayer_AHD(const WORD *bayer, WORD *dst, int sx, int sy,
  * It is a simple algorithm. Certainly not the best (probably the worst) but it works yet. */
 static int fast_xtrans_interpolate(const WORD *bayer, WORD *dst, int sx, int sy,
 		unsigned int xtrans[6][6]) {
-	uint32_t filters = 9;
 	const int height = sy, width = sx;
 	int row;
 
@@ -718,52 +731,72 @@ static int fast_xtrans_interpolate(const WORD *bayer, WORD *dst, int sx, int sy,
 					for (x = col - 1; x != col + 2; x++)
 						if (y < (unsigned int) height
 								&& x < (unsigned int) width) {
-							f = FC(y, x, filters);
-							sum[f] += dst[(y * width + x) * 3 + f]; /* [SA] */
+							f = fcol(y, x);
+							sum[f] += bayer[y * width + x];
 							sum[f + 4]++;
 						}
-				f = FC(row, col, filters);
+				f = fcol(row, col);
+				dst[(row * width + col) * 3 + f] = bayer[row * width + col];
 				for (c = 0; c < 3; c++)
 					if (c != f && sum[c + 4]) /* [SA] */
 						dst[(row * width + col) * 3 + c] = sum[c] / sum[c + 4]; /* [SA] */
 			}
 	}
 	/* end - code from border_interpolate(int border) */
+
+	/* the colours of the 3x3 neighbourhood only depend on the phase of the
+	 * pixel in the 6-pixel period, they are tabulated once per row instead of
+	 * being looked up for each neighbour */
 #ifdef _OPENMP
 #pragma omp parallel for num_threads(com.max_thread) schedule(static)
 #endif
 	for (row = 1; row < (height - 1); row ++) {
-		int col;
-		for (col = 1; col < (width - 1); col ++) {
+		unsigned char colors[6][9], center[6];
+		for (int p = 0; p < 6; p++) {
+			for (int k = 0; k < 9; k++)
+				colors[p][k] = fcol(row + k / 3 - 1, p + 6 + k % 3 - 1);
+			center[p] = fcol(row, p);
+		}
+		const WORD *above = bayer + (size_t) (row - 1) * width;
+		const WORD *line = bayer + (size_t) row * width;
+		const WORD *below = bayer + (size_t) (row + 1) * width;
+		WORD *out = dst + (size_t) row * width * 3;
+		int p = 1;	// phase of col in the pattern
+		for (int col = 1; col < (width - 1); col ++) {
 			float sum[3] = { 0.f };
-
-			int v, h;
-			for (v = -1; v <= 1; v++) {
-				for (h = -1; h <= 1; h++) {
-					sum[fcol(row + v, col + h)] += bayer[(col + h) + (row + v) * width];
-				}
-			}
-
-			switch (fcol(row, col)) {
+			const unsigned char *c = colors[p];
+			sum[c[0]] += above[col - 1];
+			sum[c[1]] += above[col];
+			sum[c[2]] += above[col + 1];
+			sum[c[3]] += line[col - 1];
+			sum[c[4]] += line[col];
+			sum[c[5]] += line[col + 1];
+			sum[c[6]] += below[col - 1];
+			sum[c[7]] += below[col];
+			sum[c[8]] += below[col + 1];
+
+			WORD *px = out + (size_t) col * 3;
+			switch (center[p]) {
 			case 0: /* Red */
-				dst[(row * width + col) * 3 + 0] = bayer[col + row * width];
-				dst[(row * width + col) * 3 + 1] = sum[1] * 0.2f;
-				dst[(row * width + col) * 3 + 2] = sum[2] * 0.33333333f;
+				px[0] = line[col];
+				px[1] = sum[1] * 0.2f;
+				px[2] = sum[2] * 0.33333333f;
 				break;
 
 			case 1: /* Green */
-				dst[(row * width + col) * 3 + 0] = sum[0] * 0.5f;
-				dst[(row * width + col) * 3 + 1] = bayer[col + row * width];
-				dst[(row * width + col) * 3 + 2] = sum[2] * 0.5f;
+				px[0] = sum[0] * 0.5f;
+				px[1] = line[col];
+				px[2] = sum[2] * 0.5f;
 				break;
 
 			case 2: /* Blue */
-				dst[(row * width + col) * 3 + 0] = sum[0] * 0.33333333f;
-				dst[(row * width + col) * 3 + 1] = sum[1] * 0.2f;
-				dst[(row * width + col) * 3 + 2] = bayer[col + row * width];
+				px[0] = sum[0] * 0.33333333f;
+				px[1] = sum[1] * 0.2f;
+				px[2] = line[col];
 				break;
 			}
-
+			if (++p == 6)
+				p = 0;
 		}
 	}
 	return 0;
@@ -1087,6 +1120,73 @@ void get_debayer_area(const rectangle *area, rectangle *debayer_area,
 	assert(debayer_area->w > 2);
 }
 
+/* Same as get_debayer_area() for debayer_area_layer_ushort(), which only needs
+ * a margin of one pixel around the requested area */
+void get_debayer_layer_area(const rectangle *area, rectangle *raw_area,
+		const rectangle *image_area) {
+	int x0 = max(area->x - 1, 0);
+	int y0 = max(area->y - 1, 0);
+	int x1 = min(area->x + area->w, image_area->w - 1);
+	int y1 = min(area->y + area->h, image_area->h - 1);
+	*raw_area = (rectangle) { x0, y0, x1 - x0 + 1, y1 - y0 + 1 };
+}
+
+static inline int cfa_pixel(const WORD *raw, const rectangle *r, int x, int y) {
+	// mirrored at the borders of the image, the mirrored pixel has the same colour
+	if (x < r->x)
+		x = 2 * r->x - x;
+	else if (x >= r->x + r->w)
+		x = 2 * (r->x + r->w - 1) - x;
+	if (y < r->y)
+		y = 2 * r->y - y;
+	else if (y >= r->y + r->h)
+		y = 2 * (r->y + r->h - 1) - y;
+	return raw[(size_t)(y - r->y) * r->w + x - r->x];
+}
+
+/* Bilinear demosaicing of one layer of an area of a Bayer image, without
+ * computing the other layers or a full RGB buffer, so that sequences of CFA
+ * images can be read band by band. raw contains the CFA data of raw_area, as
+ * given by get_debayer_layer_area(), pattern is the filter at the origin of the
+ * image and dest receives the area->w * area->h pixels of the layer */
+int debayer_area_layer_ushort(const WORD *raw, const rectangle *raw_area,
+		const rectangle *area, sensor_pattern pattern, int layer, WORD *dest) {
+	static const int colors[4][2][2] = {
+		[BAYER_FILTER_RGGB] = { { RLAYER, GLAYER }, { GLAYER, BLAYER } },
+		[BAYER_FILTER_BGGR] = { { BLAYER, GLAYER }, { GLAYER, RLAYER } },
+		[BAYER_FILTER_GBRG] = { { GLAYER, BLAYER }, { RLAYER, GLAYER } },
+		[BAYER_FILTER_GRBG] = { { GLAYER, RLAYER }, { BLAYER, GLAYER } }
+	};
+	if (pattern < BAYER_FILTER_MIN || pattern > BAYER_FILTER_MAX ||
+			layer < 0 || layer > 2 || raw_area->w < 2 || raw_area->h < 2)
+		return 1;
+	const int (*cfa)[2] = colors[pattern];
+	for (int j = 0; j < area->h; j++) {
+		int y = area->y + j;
+		WORD *out = dest + (size_t)j * area->w;
+		for (int i = 0; i < area->w; i++) {
+			int x = area->x + i;
+			int color = cfa[y & 1][x & 1];
+			int value;
+			if (color == layer) {
+				value = cfa_pixel(raw, raw_area, x, y);
+			} else if (layer == GLAYER) {
+				value = (cfa_pixel(raw, raw_area, x - 1, y) + cfa_pixel(raw, raw_area, x + 1, y) +
+						cfa_pixel(raw, raw_area, x, y - 1) + cfa_pixel(raw, raw_area, x, y + 1) + 2) >> 2;
+			} else if (color == GLAYER) {
+				if (cfa[y & 1][(x + 1) & 1] == layer)
+					value = (cfa_pixel(raw, raw_area, x - 1, y) + cfa_pixel(raw, raw_area, x + 1, y) + 1) >> 1;
+				else value = (cfa_pixel(raw, raw_area, x, y - 1) + cfa_pixel(raw, raw_area, x, y + 1) + 1) >> 1;
+			} else {
+				value = (cfa_pixel(raw, raw_area, x - 1, y - 1) + cfa_pixel(raw, raw_area, x + 1, y - 1) +
+						cfa_pixel(raw, raw_area, x - 1, y + 1) + cfa_pixel(raw, raw_area, x + 1, y + 1) + 2) >> 2;
+			}
+			out[i] = (WORD) value;
+		}
+	}
+	return 0;
+}
+
 void clear_Bayer_information(fits *fit) {
 	memset(fit->keywords.bayer_pattern, 0, FLEN_VALUE);
 }
@@ -1210,11 +1310,14 @@ static int debayer_float(fits* fit, interpolation_method interpolation, sensor_p
 }
 
 int debayer(fits *fit, interpolation_method interpolation, sensor_pattern pattern) {
+	int retval = -1;
+	gint64 span = trace_begin();
 	if (fit->type == DATA_USHORT)
-		return debayer_ushort(fit, interpolation, pattern);
+		retval = debayer_ushort(fit, interpolation, pattern);
 	else if (fit->type == DATA_FLOAT)
-		return debayer_float(fit, interpolation, pattern);
-	else return -1;
+		retval = debayer_float(fit, interpolation, pattern);
+	trace_end(span, "image", "decode", -1);
+	return retval;
 }
 
 // gets the index in filter_pattern
@@ -37,6 +37,10 @@ void apply_mergecfa_to_sequence(struct merge_cfa_data *merge_cfa_args);
 void get_debayer_area(const rectangle *area, rectangle *debayer_area,
 		const rectangle *image_area, int *debayer_offset_x,
 		int *debayer_offset_y);
+void get_debayer_layer_area(const rectangle *area, rectangle *raw_area,
+		const rectangle *image_area);
+int debayer_area_layer_ushort(const WORD *raw, const rectangle *raw_area,
+		const rectangle *area, sensor_pattern pattern, int layer, WORD *dest);
 
 #ifdef __cplusplus
 extern "C" {
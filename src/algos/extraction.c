@@ -26,6 +26,7 @@
 #include "algos/siril_wcs.h"
 #include "algos/demosaicing.h"
 #include "algos/geometry.h"
+#include "algos/statistics.h"
 #include "io/image_format_fits.h"
 #include "io/sequence.h"
 #include "extraction.h"
@@ -1062,6 +1063,66 @@ int split_cfa_float(fits *in, fits *cfa0, fits *cfa1, fits *cfa2, fits *cfa3) {
 	return 0;
 }
 
+/* writes the 4 sub-images from split_cfa back in the CFA image, in place */
+static void merge_cfa_in_place(fits *fit, fits *cfa[4]) {
+	const int width = fit->rx / 2, height = fit->ry / 2;
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(com.max_thread) schedule(static)
+#endif
+	for (int y = 0; y < height; y++) {
+		/* same order as in split_cfa because of the read orientation */
+		size_t row1 = (size_t) (2 * y) * fit->rx, row0 = row1 + fit->rx;
+		size_t j = (size_t) y * width;
+		for (int x = 0; x < width; x++, j++) {
+			if (fit->type == DATA_USHORT) {
+				fit->data[row0 + 2 * x] = cfa[0]->data[j];
+				fit->data[row1 + 2 * x] = cfa[1]->data[j];
+				fit->data[row0 + 2 * x + 1] = cfa[2]->data[j];
+				fit->data[row1 + 2 * x + 1] = cfa[3]->data[j];
+			} else {
+				fit->fdata[row0 + 2 * x] = cfa[0]->fdata[j];
+				fit->fdata[row1 + 2 * x] = cfa[1]->fdata[j];
+				fit->fdata[row0 + 2 * x + 1] = cfa[2]->fdata[j];
+				fit->fdata[row1 + 2 * x + 1] = cfa[3]->fdata[j];
+			}
+		}
+	}
+}
+
+/* Splits a Bayer CFA image in its 4 sub-images, calls hook on each of them and
+ * writes the result back in the image, so that operations made independently
+ * on each CFA channel of a sequence do not need to write the 4 split
+ * sequences and to merge them back. The image keeps its metadata and its
+ * size, returns non-zero on error, in which case the image is unchanged. */
+int process_cfa_channels(fits *fit, cfa_channel_hook hook, void *user, int threads) {
+	int pattern = get_cfa_pattern_index_from_string(fit->keywords.bayer_pattern);
+	if (fit->naxes[2] != 1 || pattern < BAYER_FILTER_MIN || pattern > BAYER_FILTER_MAX) {
+		siril_log_color_message(_("Error: unsupported CFA pattern for this operation.\n"), "red");
+		return 1;
+	}
+	fits *cfa[4];
+	for (int c = 0; c < 4; c++)
+		cfa[c] = calloc(1, sizeof(fits));
+	int ret = 1;
+	if (fit->type == DATA_USHORT)
+		ret = split_cfa_ushort(fit, cfa[0], cfa[1], cfa[2], cfa[3]);
+	else if (fit->type == DATA_FLOAT)
+		ret = split_cfa_float(fit, cfa[0], cfa[1], cfa[2], cfa[3]);
+	if (ret)
+		siril_log_color_message(_("Error splitting into CFA subchannels, aborting...\n"), "red");
+	for (int c = 0; c < 4 && !ret; c++)
+		ret = hook(cfa[c], c, user, threads);
+	if (!ret) {
+		merge_cfa_in_place(fit, cfa);
+		invalidate_stats_from_fit(fit);
+	}
+	for (int c = 0; c < 4; c++) {
+		clearfits(cfa[c]);
+		free(cfa[c]);
+	}
+	return ret;
+}
+
 int split_cfa_image_hook(struct generic_seq_args *args, int o, int i, fits *fit, rectangle *_, int threads) {
 	int ret = 1;
 	struct multi_output_data *multi_args = (struct multi_output_data *) args->user;
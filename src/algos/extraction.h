@@ -32,4 +32,7 @@ int split_cfa_ushort(fits *in, fits *cfa0, fits *cfa1, fits *cfa2, fits *cfa3);
 int split_cfa_float(fits *in, fits *cfa0, fits *cfa1, fits *cfa2, fits *cfa3);
 void apply_split_cfa_to_sequence(struct multi_output_data *multi_args);
 
+typedef int (*cfa_channel_hook)(fits *cfa_channel, int channel, void *user, int threads);
+int process_cfa_channels(fits *fit, cfa_channel_hook hook, void *user, int threads);
+
 #endif
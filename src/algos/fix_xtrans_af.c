@@ -22,7 +22,6 @@
 #include "core/siril.h"
 #include "core/siril_log.h"
 #include "algos/statistics.h"
-#include "algos/siril_random.h"
 #include "io/conversion.h"
 #include "io/image_format_fits.h"
 
@@ -126,33 +125,72 @@ char get_pixel_type(rectangle af, int x, int y, af_pixel_matrix *af_matrix) {
 	}
 }
 
+/* intersection of the inclusive rectangles a and b, clipped to the image.
+ * Returns FALSE if it is empty */
+static gboolean intersect_areas(rectangle a, rectangle b, int width, int height,
+		int *x0, int *x1, int *y0, int *y1) {
+	*x0 = max(max(a.x, b.x), 0);
+	*y0 = max(max(a.y, b.y), 0);
+	*x1 = min(min(a.x + a.w, b.x + b.w), width - 1);
+	*y1 = min(min(a.y + a.h, b.y + b.h), height - 1);
+	return *x0 <= *x1 && *y0 <= *y1;
+}
+
+/* first column >= x0 with the phase p in the 6 columns of the pattern */
+static inline int first_column_of_phase(int x0, int p) {
+	return x0 + (p - x0 % 6 + 6) % 6;
+}
+
+/* deterministic value in [0, 1) for a pixel, a thread-safe replacement of a
+ * random number used for the dithering of the integer fudge */
+static inline float pixel_dither(guint32 i) {
+	i = (i ^ 61) ^ (i >> 16);
+	i *= 9;
+	i ^= i >> 4;
+	i *= 0x27d4eb2d;
+	i ^= i >> 15;
+	return (float) (i >> 8) / 16777216.f;
+}
+
 static int subtract_fudge(fits *fit, rectangle af, float fudge, af_pixel_matrix *af_matrix, char af_type ) {
 	int width = fit->rx;
 	int height = fit->ry;
+	int x0, x1, y0, y1;
+
+	if (!intersect_areas(af, af, width, height, &x0, &x1, &y0, &y1))
+		return 0;
 
 	if (fit->type == DATA_USHORT) {
 		WORD *buf = fit->pdata[RLAYER];
 		WORD fudgew = (WORD)fudge; // truncated on purpose
+		float frac = fudge - (float) fudgew;
 
 		unsigned long total_fudgew = 0, total_pixels = 0;
 
-		for (unsigned int y = 0; y < height; y++) {
-			for (unsigned int x = 0; x < width; x++) {
-				if (get_pixel_type(af, x, y, af_matrix) == af_type) {
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(com.max_thread) schedule(static) reduction(+:total_fudgew,total_pixels)
+#endif
+		for (int y = y0; y <= y1; y++) {
+			const char *pattern_row = (*af_matrix)[y % 12];
+			WORD *line = buf + (size_t) y * width;
+			for (int p = 0; p < 6; p++) {
+				if (pattern_row[p] != af_type)
+					continue;
+				for (int x = first_column_of_phase(x0, p); x <= x1; x += 6) {
 					// This is an auto focus pixel.  Subtract the fudge.
 
-					// Randomly add a 1 to some pixels to bring the average correction close to the computed value.
-					WORD fudgew_rand = siril_random_float() >= fudge - (float) fudgew ? fudgew : fudgew + 1;
+					// Add a 1 to some pixels to bring the average correction close to the computed value.
+					WORD fudgew_rand = pixel_dither((guint32) (x + (size_t) y * width)) >= frac ? fudgew : fudgew + 1;
 
 					// Save for debugging.
 					total_fudgew += fudgew_rand;
 					total_pixels += 1;
 
 					// Prevent driving the unsigned pixel negative.  Not a worry for normal use cases.
-					if (fudgew_rand >= buf[x + y * width]) {
-						buf[x + y * width] = 0;
+					if (fudgew_rand >= line[x]) {
+						line[x] = 0;
 					} else {
-						buf[x + y * width] -= fudgew_rand;
+						line[x] -= fudgew_rand;
 					}
 				}
 			}
@@ -167,12 +205,18 @@ static int subtract_fudge(fits *fit, rectangle af, float fudge, af_pixel_matrix
 	} else if (fit->type == DATA_FLOAT) {
 		float *buf = fit->fpdata[RLAYER];
 
-		for (unsigned int y = 0; y < height; y++) {
-			for (unsigned int x = 0; x < width; x++) {
-				if (get_pixel_type(af, x, y, af_matrix) == af_type) {
-					// This is an auto focus pixel.  Subtract the fudge.
-					buf[x + y * width] -= fudge;
-				}
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(com.max_thread) schedule(static)
+#endif
+		for (int y = y0; y <= y1; y++) {
+			const char *pattern_row = (*af_matrix)[y % 12];
+			float *line = buf + (size_t) y * width;
+			for (int p = 0; p < 6; p++) {
+				if (pattern_row[p] != af_type)
+					continue;
+				// This is an auto focus pixel.  Subtract the fudge.
+				for (int x = first_column_of_phase(x0, p); x <= x1; x += 6)
+					line[x] -= fudge;
 			}
 		}
 	}
@@ -262,79 +306,69 @@ int fix_xtrans_ac(fits *fit) {
 	}
 
 	// Loop through sample rectangle and count/sum AF and non-AF pixels.
-	for (unsigned int y = sam.y; y <= (sam.y + sam.h); y++) {
-		for (unsigned int x = sam.x; x <= (sam.x + sam.w); x++) {
-			double pixel = fit->type == DATA_FLOAT ?
-							(double) fbuf[x + y * fit->rx] :
-							(double) buf[x + y * fit->rx];
-
-			switch (get_pixel_type(af, x, y, &af_matrix)) {
-			case 'G': // This is a Green (non-AF) pixel.
-				af_types[0].nfcount++;
-				af_types[1].nfcount++;
-				af_types[2].nfcount++;
-				af_types[3].nfcount++;
-				af_types[0].nfsum += pixel;
-				af_types[1].nfsum += pixel;
-				af_types[2].nfsum += pixel;
-				af_types[3].nfsum += pixel;
-				break;
-			case '0':
-				af_types[0].afcount++;
-				af_types[1].nfcount++;
-				af_types[2].nfcount++;
-				af_types[3].nfcount++;
-				af_types[0].afsum += pixel;
-				af_types[1].nfsum += pixel;
-				af_types[2].nfsum += pixel;
-				af_types[3].nfsum += pixel;
-				break;
-			case '1':
-				af_types[0].nfcount++;
-				af_types[1].afcount++;
-				af_types[2].nfcount++;
-				af_types[3].nfcount++;
-				af_types[0].nfsum += pixel;
-				af_types[1].afsum += pixel;
-				af_types[2].nfsum += pixel;
-				af_types[3].nfsum += pixel;
-				break;
-			case '2':
-				af_types[0].nfcount++;
-				af_types[1].nfcount++;
-				af_types[2].afcount++;
-				af_types[3].nfcount++;
-				af_types[0].nfsum += pixel;
-				af_types[1].nfsum += pixel;
-				af_types[2].afsum += pixel;
-				af_types[3].nfsum += pixel;
-				break;
-			case '3':
-				af_types[0].nfcount++;
-				af_types[1].nfcount++;
-				af_types[2].nfcount++;
-				af_types[3].afcount++;
-				af_types[0].nfsum += pixel;
-				af_types[1].nfsum += pixel;
-				af_types[2].nfsum += pixel;
-				af_types[3].afsum += pixel;
-				break;
-			// case '-': // If we want to include R and B.
-		 	// 	af_types[0].nfcount++;
-		 	// 	af_types[1].nfcount++;
-		 	// 	af_types[2].nfcount++;
-		 	// 	af_types[3].nfcount++;
-		 	// 	af_types[0].nfsum += pixel;
-		 	// 	af_types[1].nfsum += pixel;
-		 	// 	af_types[2].nfsum += pixel;
-		 	// 	af_types[3].nfsum += pixel;
-		 	// 	break;
-			default:
-				break;
+	// Only the part inside the AF rectangle is used, the sums are made per
+	// pixel type: index 0 for the green non-AF pixels, 1 to 4 for the AF types.
+	double type_sum[5] = { 0.0 };
+	long type_count[5] = { 0L };
+	int x0, x1, y0, y1;
+	if (intersect_areas(af, sam, fit->rx, fit->ry, &x0, &x1, &y0, &y1)) {
+#ifdef _OPENMP
+#pragma omp parallel num_threads(com.max_thread)
+#endif
+		{
+			double sum[5] = { 0.0 };
+			long count[5] = { 0L };
+#ifdef _OPENMP
+#pragma omp for schedule(static)
+#endif
+			for (int y = y0; y <= y1; y++) {
+				const char *pattern_row = af_matrix[y % 12];
+				size_t offset = (size_t) y * fit->rx;
+				for (int p = 0; p < 6; p++) {
+					int t;
+					if (pattern_row[p] == 'G')
+						t = 0;
+					else if (pattern_row[p] >= '0' && pattern_row[p] <= '3')
+						t = pattern_row[p] - '0' + 1;
+					else continue;	// red and blue are not used
+					double s = 0.0;
+					long n = 0L;
+					int x = first_column_of_phase(x0, p);
+					if (fit->type == DATA_FLOAT) {
+						for (; x <= x1; x += 6, n++)
+							s += (double) fbuf[offset + x];
+					} else {
+						for (; x <= x1; x += 6, n++)
+							s += (double) buf[offset + x];
+					}
+					sum[t] += s;
+					count[t] += n;
+				}
+			}
+#ifdef _OPENMP
+#pragma omp critical
+#endif
+			for (int t = 0; t < 5; t++) {
+				type_sum[t] += sum[t];
+				type_count[t] += count[t];
 			}
 		}
 	}
 
+	// For each AF type, all the other green pixels are non-AF pixels.
+	double green_sum = 0.0;
+	long green_count = 0L;
+	for (int t = 0; t < 5; t++) {
+		green_sum += type_sum[t];
+		green_count += type_count[t];
+	}
+	for (int f = 0; f < 4; f++) {
+		af_types[f].afsum = type_sum[f + 1];
+		af_types[f].afcount = type_count[f + 1];
+		af_types[f].nfsum = green_sum - type_sum[f + 1];
+		af_types[f].nfcount = green_count - type_count[f + 1];
+	}
+
 	for (int f = 0; f < 4; f++) {
 
 		// Make sure we have a valid sample.
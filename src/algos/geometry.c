@@ -186,6 +186,12 @@ static void fit_update_buffer(fits *fit, void *newbuf, int width, int height, in
 	}
 }
 
+/* The output rows are computed in parallel, by chunks of BINNING_CHUNK pixels
+ * accumulated in a local array: each input row is read contiguously with the
+ * stride of the binning, which vectorises, while the sum of each pixel keeps
+ * the order of its block, column by column */
+#define BINNING_CHUNK 256
+
 static void fits_binning_float(fits *fit, int bin_factor, gboolean mean) {
 	if (bin_factor == 0) // Bin 0 would be nonsensical.
 		return;
@@ -194,30 +200,34 @@ static void fits_binning_float(fits *fit, int bin_factor, gboolean mean) {
 	int new_width = width / bin_factor;
 	int new_height = height / bin_factor;
 
-	size_t npixels = new_width * new_height;
+	size_t npixels = (size_t)new_width * new_height;
 
 	float *newbuf = malloc(npixels * fit->naxes[2] * sizeof(float));
 	if (!newbuf) {
 		PRINT_ALLOC_ERR;
 		return;
 	}
+	int c = bin_factor * bin_factor;
 
 	for (int channel = 0; channel < fit->naxes[2]; channel++) {
-		const float *buf = fit->fdata + (width * height) * channel;
-
-		long k = 0 + channel * npixels;
-		for (int row = 0, nrow = 0; row < height - bin_factor + 1; row += bin_factor, nrow++) {
-			for (int col = 0, ncol = 0; col < width - bin_factor + 1; col += bin_factor, ncol++) {
-				int c = 0;
-				newbuf[k] = 0;
+		const float *buf = fit->fdata + ((size_t)width * height) * channel;
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(com.max_thread) schedule(static)
+#endif
+		for (int nrow = 0; nrow < new_height; nrow++) {
+			float *out = newbuf + channel * npixels + (size_t)nrow * new_width;
+			for (int ncol = 0; ncol < new_width; ncol += BINNING_CHUNK) {
+				int n = min(BINNING_CHUNK, new_width - ncol);
+				float acc[BINNING_CHUNK] = { 0.f };
 				for (int i = 0; i < bin_factor; i++) {
 					for (int j = 0; j < bin_factor; j++) {
-						newbuf[k] += buf[i + col + (j + row) * width];
-						c++;
+						const float *in = buf + (size_t)(nrow * bin_factor + j) * width + ncol * bin_factor + i;
+						for (int k = 0; k < n; k++)
+							acc[k] += in[k * bin_factor];
 					}
 				}
-				if (mean) newbuf[k] /= c;
-				k++;
+				for (int k = 0; k < n; k++)
+					out[ncol + k] = mean ? acc[k] / c : acc[k];
 			}
 		}
 	}
@@ -233,48 +243,57 @@ static void fits_binning_ushort(fits *fit, int bin_factor, gboolean mean) {
 	int new_width = width / bin_factor;
 	int new_height = height / bin_factor;
 
-	size_t npixels = new_width * new_height;
+	size_t npixels = (size_t)new_width * new_height;
 
 	WORD *newbuf = malloc(npixels * fit->naxes[2] * sizeof(WORD));
 	if (!newbuf) {
 		PRINT_ALLOC_ERR;
 		return;
 	}
+	int c = bin_factor * bin_factor;
 
 	for (int channel = 0; channel < fit->naxes[2]; channel++) {
-		const WORD *buf = fit->data + (width * height) * channel;
-
-		long k = 0 + channel * npixels;
-		for (int row = 0, nrow = 0; row < height - bin_factor + 1; row += bin_factor, nrow++) {
-			for (int col = 0, ncol = 0; col < width - bin_factor + 1; col += bin_factor, ncol++) {
-				int c = 0;
-				int tmp = 0;
-				for (int i = 0; i < bin_factor; i++) {
-					for (int j = 0; j < bin_factor; j++) {
-						tmp += (buf[i + col + (j + row) * width]);
-						c++;
+		const WORD *buf = fit->data + ((size_t)width * height) * channel;
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(com.max_thread) schedule(static)
+#endif
+		for (int nrow = 0; nrow < new_height; nrow++) {
+			WORD *out = newbuf + channel * npixels + (size_t)nrow * new_width;
+			for (int ncol = 0; ncol < new_width; ncol += BINNING_CHUNK) {
+				int n = min(BINNING_CHUNK, new_width - ncol);
+				int acc[BINNING_CHUNK] = { 0 };
+				for (int j = 0; j < bin_factor; j++) {
+					const WORD *row = buf + (size_t)(nrow * bin_factor + j) * width + ncol * bin_factor;
+					for (int i = 0; i < bin_factor; i++) {
+						for (int k = 0; k < n; k++)
+							acc[k] += row[k * bin_factor + i];
 					}
 				}
-				if (mean) tmp /= c;
-				newbuf[k] = truncate_to_WORD(tmp);
-				k++;
+				for (int k = 0; k < n; k++)
+					out[ncol + k] = truncate_to_WORD(mean ? acc[k] / c : acc[k]);
 			}
 		}
 	}
 	fit_update_buffer(fit, newbuf, new_width, new_height, bin_factor);
 }
 
+/* bins the pixel data only, without logging or updating the GUI, for
+ * temporary images */
+void fits_binning_data(fits *fit, int factor, gboolean mean) {
+	if (fit->type == DATA_USHORT) {
+		fits_binning_ushort(fit, factor, mean);
+	} else if (fit->type == DATA_FLOAT) {
+		fits_binning_float(fit, factor, mean);
+	}
+}
+
 int fits_binning(fits *fit, int factor, gboolean mean) {
 	struct timeval t_start, t_end;
 
 	siril_log_color_message(_("Binning x%d: processing...\n"), "green", factor);
 	gettimeofday(&t_start, NULL);
 	on_clear_roi(); // ROI is cleared on geometry-altering operations
-	if (fit->type == DATA_USHORT) {
-		fits_binning_ushort(fit, factor, mean);
-	} else if (fit->type == DATA_FLOAT) {
-		fits_binning_float(fit, factor, mean);
-	}
+	fits_binning_data(fit, factor, mean);
 
 	free_wcs(fit);
 	reset_wcsdata(fit);
@@ -664,11 +683,41 @@ gint64 crop_compute_size_hook(struct generic_seq_args *args, int nb_frames) {
 	return (gint64)(fullseqsize * ratio);
 }
 
+/* only the cropped area of the frames is read */
+static gboolean crop_input_area_hook(struct generic_seq_args *args, int i, rectangle *area) {
+	struct crop_sequence_data *c_args = (struct crop_sequence_data*) args->user;
+	int rx = args->seq->is_variable ? args->seq->imgparam[i].rx : args->seq->rx;
+	int ry = args->seq->is_variable ? args->seq->imgparam[i].ry : args->seq->ry;
+	if (rx <= 0 || ry <= 0 || c_args->area.x + c_args->area.w > rx || c_args->area.y + c_args->area.h > ry)
+		return FALSE;	// read whole to fail in crop() as before
+	*area = c_args->area;
+	return TRUE;
+}
+
+/* same as crop() for an image of which only the area was read */
+static int crop_read_area(struct generic_seq_args *args, int i, fits *fit, rectangle *area) {
+	invalidate_stats_from_fit(fit);
+	if (has_wcs(fit)) {
+		int orig_ry = args->seq->is_variable ? args->seq->imgparam[i].ry : args->seq->ry;
+		int target_rx, target_ry;
+		Homography H = { 0 };
+		GetMatrixReframe(fit, *area, 0., 1, &target_rx, &target_ry, &H);
+		cvApplyFlips(&H, orig_ry, target_ry);
+		reframe_astrometry_data(fit, &H);
+		update_wcsdata_from_wcs(fit);
+		update_fits_header(fit);
+	}
+	return 0;
+}
+
 int crop_image_hook(struct generic_seq_args *args, int o, int i, fits *fit,
-		rectangle *_, int threads) {
+		rectangle *read_area, int threads) {
 	struct crop_sequence_data *c_args = (struct crop_sequence_data*) args->user;
 
-	int ret = crop(fit, &(c_args->area));
+	int ret;
+	if (read_area && read_area->w > 0)
+		ret = crop_read_area(args, i, fit, read_area);
+	else ret = crop(fit, &(c_args->area));
 
 	if (!ret) {
 		char log[90];
@@ -771,7 +820,6 @@ int scale_finalize_hook(struct generic_seq_args *args) {
 	return retval;
 }
 
-/* TODO: should we use the partial image? */
 gpointer crop_sequence(struct crop_sequence_data *crop_sequence_data) {
 	struct generic_seq_args *args = create_default_seqargs(crop_sequence_data->seq);
 	args->filtering_criterion = seq_filter_included;
@@ -779,6 +827,7 @@ gpointer crop_sequence(struct crop_sequence_data *crop_sequence_data) {
 	args->compute_size_hook = crop_compute_size_hook;
 	args->prepare_hook = seq_prepare_hook;
 	args->finalize_hook = crop_finalize_hook;
+	args->input_area_hook = crop_input_area_hook;
 	args->image_hook = crop_image_hook;
 	args->stop_on_error = FALSE;
 	args->description = _("Crop Sequence");
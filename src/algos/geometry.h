@@ -20,6 +20,7 @@ struct scale_sequence_data {
 	int retvalue;
 };
 
+void fits_binning_data(fits *fit, int factor, gboolean mean);
 int fits_binning(fits *fit, int factor, gboolean mean);
 
 int verbose_resize_gaussian(fits *image, int toX, int toY, opencv_interpolation interpolation, gboolean clamp);
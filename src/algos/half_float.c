@@ -0,0 +1,34 @@
+/*
+ * This file is part of Siril, an astronomy image processor.
+ * Copyright (C) 2005-2011 Francois Meyer (dulle at free.fr)
+ * Copyright (C) 2012-2025 team free-astro (see more in AUTHORS file)
+ * Reference site is https://siril.org
+ *
+ * Siril is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Siril is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Siril. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Conversions between float and half precision, based on the public domain
+ * code of Fabian Giesen (https://gist.github.com/rygorous/2156668). */
+
+#include "half_float.h"
+
+void float_to_half_row(const float *in, half_float *out, size_t n) {
+	for (size_t i = 0; i < n; i++)
+		out[i] = float_to_half(in[i]);
+}
+
+void half_to_float_row(const half_float *in, float *out, size_t n) {
+	for (size_t i = 0; i < n; i++)
+		out[i] = half_to_float(in[i]);
+}
@@ -0,0 +1,56 @@
+#ifndef SRC_ALGOS_HALF_FLOAT_H_
+#define SRC_ALGOS_HALF_FLOAT_H_
+
+#include <glib.h>
+
+/* IEEE 754 binary16 storage of float data, with round to nearest even.
+ * The 11 bits of mantissa give a relative precision of 4.9e-4, values down
+ * to 6.1e-5 are normal and smaller ones are kept as denormals.
+ * The conversions are done with integer and float operations only, without
+ * branches for the normal values, so that the row versions vectorize. */
+
+typedef guint16 half_float;
+
+static inline float half_to_float(half_float h) {
+	union { guint32 u; float f; } o;
+	const guint32 shifted_exp = 0x7c00u << 13;
+	const union { guint32 u; float f; } magic = { 113u << 23 };
+	o.u = (h & 0x7fffu) << 13;	// exponent and mantissa
+	guint32 exp = shifted_exp & o.u;
+	o.u += (127u - 15u) << 23;	// exponent adjust
+	if (exp == shifted_exp)		// Inf or NaN
+		o.u += (128u - 16u) << 23;
+	else if (exp == 0) {		// zero or denormal: renormalize
+		o.u += 1u << 23;
+		o.f -= magic.f;
+	}
+	o.u |= (guint32) (h & 0x8000u) << 16;	// sign
+	return o.f;
+}
+
+static inline half_float float_to_half(float f) {
+	union { guint32 u; float f; } in = { .f = f };
+	const guint32 f32infty = 255u << 23;
+	const guint32 f16max = (127u + 16u) << 23;
+	const union { guint32 u; float f; } denorm_magic = { ((127u - 15u) + (23u - 10u) + 1u) << 23 };
+	guint32 sign = in.u & 0x80000000u;
+	guint32 o;
+	in.u ^= sign;
+	if (in.u >= f16max)	// too large for a half: Inf, or NaN kept as NaN
+		o = in.u > f32infty ? 0x7e00u : 0x7c00u;
+	else if (in.u < (113u << 23)) {	// denormal or zero
+		in.f += denorm_magic.f;
+		o = in.u - denorm_magic.u;
+	} else {
+		guint32 mant_odd = (in.u >> 13) & 1u;
+		in.u += ((guint32) (15 - 127) << 23) + 0xfffu;	// rebias and round
+		in.u += mant_odd;
+		o = in.u >> 13;
+	}
+	return (half_float) (o | (sign >> 16));
+}
+
+void float_to_half_row(const float *in, half_float *out, size_t n);
+void half_to_float_row(const half_float *in, float *out, size_t n);
+
+#endif /* SRC_ALGOS_HALF_FLOAT_H_ */
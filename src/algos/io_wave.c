@@ -106,6 +106,7 @@
 #include <string.h>
 
 #include "core/siril.h"
+#include "core/OS_utils.h"
 #include "gui/utils.h"
 #include "algos/Def_Math.h"
 #include "algos/Def_Mem.h"
@@ -315,3 +316,67 @@ int wave_io_alloc(wave_transf_des *Wave_Trans, int Type_Transform, int Nbr_Plan,
 }
 
 /****************************************************************************/
+
+/* Transforms are kept in memory, indexed by the name of the file they would
+ * have been written to, as long as they fit in half of the available memory.
+ * The GUI sliders and the wrecons command then only redo the reconstruction
+ * instead of reading all plans back from the temporary directory. */
+static GHashTable *wave_store = NULL;
+static guint64 wave_store_size = 0;
+G_LOCK_DEFINE_STATIC(wave_store_lock);
+
+static void wave_store_free_entry(gpointer data) {
+	wave_transf_des *Wave_Trans = (wave_transf_des *) data;
+	wave_store_size -= (guint64) wave_io_size_data(Wave_Trans->Nbr_Ligne,
+			Wave_Trans->Nbr_Col, Wave_Trans->Nbr_Plan,
+			Wave_Trans->Type_Wave_Transform) * sizeof(float);
+	wave_io_free(Wave_Trans);
+	free(Wave_Trans);
+}
+
+/* takes ownership of the data of Wave_Trans and returns 0 if it was kept, 1
+ * if it does not fit in memory and must be written to a file */
+int wave_io_store(const char *File_Name, wave_transf_des *Wave_Trans) {
+	guint64 size = (guint64) wave_io_size_data(Wave_Trans->Nbr_Ligne,
+			Wave_Trans->Nbr_Col, Wave_Trans->Nbr_Plan,
+			Wave_Trans->Type_Wave_Transform) * sizeof(float);
+	int retval = 1;
+
+	G_LOCK(wave_store_lock);
+	if (!wave_store)
+		wave_store = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+				wave_store_free_entry);
+	/* replace the previous transform of the same file */
+	g_hash_table_remove(wave_store, File_Name);
+
+	if (wave_store_size + size <= get_available_memory() / 2) {
+		wave_transf_des *stored = malloc(sizeof(wave_transf_des));
+		if (stored) {
+			memcpy(stored, Wave_Trans, sizeof(wave_transf_des));
+			g_hash_table_insert(wave_store, g_strdup(File_Name), stored);
+			wave_store_size += size;
+			retval = 0;
+		}
+	}
+	G_UNLOCK(wave_store_lock);
+	if (retval)
+		siril_debug_print("wavelet transform of %s written to disk\n", File_Name);
+	return retval;
+}
+
+/* returns the transform kept in memory for this file or NULL */
+wave_transf_des *wave_io_lookup(const char *File_Name) {
+	wave_transf_des *Wave_Trans = NULL;
+	G_LOCK(wave_store_lock);
+	if (wave_store)
+		Wave_Trans = g_hash_table_lookup(wave_store, File_Name);
+	G_UNLOCK(wave_store_lock);
+	return Wave_Trans;
+}
+
+void wave_io_store_clear() {
+	G_LOCK(wave_store_lock);
+	if (wave_store)
+		g_hash_table_remove_all(wave_store);
+	G_UNLOCK(wave_store_lock);
+}
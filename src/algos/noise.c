@@ -32,8 +32,31 @@
 
 #include "noise.h"
 
+/* the fast estimate uses this number of evenly spaced rows at most */
+#define NOISE_FAST_ROWS 512
+
 static GThread *thread;
 
+/* Same estimate as the bgnoise of the statistics, the median of the noise of
+ * the rows, but on NOISE_FAST_ROWS evenly spaced rows instead of all rows.
+ * The difference is the sampling error of that median, about 0.1% on gaussian
+ * noise in 6000x4000 images, decreasing with the width of the images. */
+static int fast_bgnoise(fits *fit, int chan, double *noise) {
+	long row_step = max(1, fit->ry / NOISE_FAST_ROWS);
+	int status = 0;
+	if (fit->type == DATA_USHORT) {
+		siril_fits_img_noise1_ushort(fit->pdata[chan], fit->rx, fit->ry, row_step,
+				1, 0, noise, MULTI_THREADED, &status);
+	} else {
+		siril_fits_img_noise1_float(fit->fpdata[chan], fit->rx, fit->ry, row_step,
+				1, 0.f, noise, MULTI_THREADED, &status);
+		// normalized like the statistics
+		if (fit->bitpix != FLOAT_IMG)
+			*noise *= (fit->bitpix == BYTE_IMG) ? UCHAR_MAX_DOUBLE : USHRT_MAX_DOUBLE;
+	}
+	return status;
+}
+
 static gboolean end_noise(gpointer p) {
 	struct noise_data *args = (struct noise_data *) p;
 	stop_processing_thread();
@@ -59,13 +82,19 @@ gpointer noise_worker(gpointer p) {
 		gettimeofday(&args->t_start, NULL);
 	}
 
-	imstats *stats[3];
-	int retval = compute_all_channels_statistics_single_image(args->fit, STATS_SIGMEAN, MULTI_THREADED, stats);
+	imstats *stats[3] = { NULL };
+	int retval = 0;
+	if (args->fast) {
+		for (int chan = 0; chan < args->fit->naxes[2] && !retval; chan++)
+			retval = fast_bgnoise(args->fit, chan, &args->bgnoise[chan]);
+	}
+	else retval = compute_all_channels_statistics_single_image(args->fit, STATS_SIGMEAN, MULTI_THREADED, stats);
 	for (int chan = 0; chan < args->fit->naxes[2]; chan++) {
 		if (!retval) {
-			args->bgnoise[chan] = stats[chan]->bgnoise;
-			args->mean_noise += stats[chan]->bgnoise;
-			double norm = stats[chan]->normValue;
+			if (!args->fast)
+				args->bgnoise[chan] = stats[chan]->bgnoise;
+			args->mean_noise += args->bgnoise[chan];
+			double norm = args->fit->bitpix == BYTE_IMG ? UCHAR_MAX_DOUBLE : USHRT_MAX_DOUBLE;
 
 			if (args->display_results) {
 				if (args->fit->type == DATA_USHORT)
@@ -116,6 +145,7 @@ void evaluate_noise_in_image() {
 	struct noise_data *args = malloc(sizeof(struct noise_data));
 	args->fit = &gfit;
 	args->use_idle = TRUE;
+	args->fast = FALSE;
 	args->display_results = TRUE;
 	args->display_start_end = TRUE;
 	memset(args->bgnoise, 0.0, sizeof(double[3]));
@@ -132,6 +162,7 @@ void bgnoise_async(fits *fit, gboolean display_values) {
 	struct noise_data *args = malloc(sizeof(struct noise_data));
 	args->fit = fit;
 	args->use_idle = FALSE;
+	args->fast = TRUE;
 	args->display_start_end = FALSE;
 	args->display_results = display_values;
 	memset(args->bgnoise, 0.0, sizeof(double[3]));
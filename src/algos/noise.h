@@ -8,6 +8,7 @@ struct noise_data {
 	gboolean display_start_end;
 	gboolean display_results;
 	gboolean use_idle; // will free this struct, display things and call stop_processing_thread()
+	gboolean fast; // estimate the noise on a subset of the rows, not cached in the statistics
 	fits *fit;
 
 	double bgnoise[3];
@@ -155,7 +155,10 @@ int pave_2d_tfo(float *Pict, float *Pave, int Nl, int Nc, int Nbr_Plan,
 			pave_2d_linear_smooth(Plan, Imag, Nl, Nc, Num_Plan);
 			break;
 		case TO_PAVE_BSPLINE:
-			pave_2d_bspline_smooth(Plan, Imag, Nl, Nc, Num_Plan);
+			if (pave_2d_bspline_smooth(Plan, Imag, Nl, Nc, Num_Plan)) {
+				free(Imag);
+				return 1;
+			}
 			break;
 		default:
 			fprintf(stderr, "pave_2d.c: unknown transform\n");
@@ -218,59 +221,122 @@ int pave_2d_extract_plan(float *Pave, float *Imag, int Nl, int Nc, int Num_Plan)
 
 /***************************************************************************/
 
+/* Computes the plan Num_Plan of the transform in place in Imag, without
+ * storing the whole transform: only the current and the next smoothed images
+ * are kept in memory. */
+int pave_2d_plan(float *Imag, int Nl, int Nc, int Nbr_Plan, int Num_Plan,
+		int Type_To) {
+	size_t npix = (size_t) Nl * Nc;
+	float *Smooth = f_vector_alloc(npix);
+	if (Smooth == NULL)
+		return 1;
+
+	float *cur = Imag, *next = Smooth;
+	int last = min(Num_Plan, Nbr_Plan - 2);
+	for (int k = 0; k <= last; k++) {
+		int retval = 0;
+		switch (Type_To) {
+		case TO_PAVE_LINEAR:
+			retval = pave_2d_linear_smooth(cur, next, Nl, Nc, k);
+			break;
+		case TO_PAVE_BSPLINE:
+			retval = pave_2d_bspline_smooth(cur, next, Nl, Nc, k);
+			break;
+		default:
+			retval = 1;
+		}
+		if (retval) {
+			free(Smooth);
+			return 1;
+		}
+		if (k == Num_Plan) {
+			/* wavelet coefficients of this scale */
+#ifdef _OPENMP
+#pragma omp parallel for simd num_threads(com.max_thread) schedule(static)
+#endif
+			for (size_t i = 0; i < npix; i++)
+				cur[i] -= next[i];
+			break;
+		}
+		float *t = cur;
+		cur = next;
+		next = t;
+	}
+	/* cur holds the result, either the plan or the low resolution image */
+	if (cur != Imag)
+		memcpy(Imag, cur, npix * sizeof(float));
+	free(Smooth);
+	return 0;
+}
+
+/***************************************************************************/
+
+/* The B3-spline kernel is the outer product of (1, 4, 6, 4, 1) / 16 by itself,
+ * so the smoothing is done as a horizontal pass followed by a vertical one,
+ * 10 taps per pixel instead of 25. Border pixels are replicated as in the
+ * linear smoothing; away from the borders the passes are plain contiguous
+ * loops that the compiler vectorizes. */
 int pave_2d_bspline_smooth(const float *Imag, float *Smooth, int Nl, int Nc,
 		int Num_Plan) {
-
+	const float h0 = 0.375f, h1 = 0.25f, h2 = 0.0625f;
 	int Step = pow(2., (float) Num_Plan) + 0.5;
+	size_t npix = (size_t) Nl * Nc;
+
+	float *tmp = malloc(npix * sizeof(float));
+	if (!tmp) {
+		PRINT_ALLOC_ERR;
+		return 1;
+	}
+
+	/* columns that can be read without clamping */
+	int jmin = min(2 * Step, Nc);
+	int jmax = max(jmin, Nc - 2 * Step);
 
 #ifdef _OPENMP
-#pragma omp parallel for simd num_threads(com.max_thread) schedule(static) collapse(2)
+#pragma omp parallel for num_threads(com.max_thread) schedule(static)
 #endif
 	for (int i = 0; i < Nl; i++) {
-		for (int j = 0; j < Nc; j++) {
-			int indi1 = test_ind(i - Step, Nl);
-			int indj1 = test_ind (j - Step, Nc);
-			int indi2 = test_ind (i + Step, Nl);
-			int indj2 = test_ind (j + Step,Nc);
-			int indi3 = test_ind (i - 2 * Step, Nl);
-			int indj3 = test_ind (j - 2 * Step,Nc);
-			int indi4 = test_ind (i + 2 * Step, Nl);
-			int indj4 = test_ind (j + 2 * Step,Nc);
-
-
-			Smooth [i * Nc + j] = 0.00390625 * ( Imag [indi3 * Nc + indj3]
-										+ Imag [indi3 * Nc + indj4]
-										+ Imag [indi4 * Nc + indj3]
-										+ Imag [indi4 * Nc + indj4])
-							+ 0.015625 * ( Imag [indi4 * Nc + indj2]
-										+ Imag [indi3 * Nc + indj2]
-										+ Imag [indi4 * Nc + indj1]
-										+ Imag [indi3 * Nc + indj1]
-
-										+ Imag [indi2 * Nc + indj3]
-										+ Imag [indi2 * Nc + indj4]
-										+ Imag [indi1 * Nc + indj3]
-										+ Imag [indi1 * Nc + indj4])
-
-							+ 0.0234375 * ( Imag [indi3 * Nc + j]
-										+ Imag [indi4 * Nc + j]
-										+ Imag [i * Nc + indj3]
-										+ Imag [i * Nc + indj4])
-
-							+ 0.06250 * ( Imag [indi1 * Nc + indj1]
-										+ Imag [indi1 * Nc + indj2]
-										+ Imag [indi2 * Nc + indj1]
-										+ Imag [indi2* Nc + indj2])
-
-							+ 0.09375 * ( Imag [indi1 * Nc + j]
-										+ Imag [indi2 * Nc + j]
-										+ Imag [i * Nc + indj1]
-										+ Imag [i * Nc + indj2])
-
-							+ 0.140625 * Imag [i * Nc + j];
+		const float *in = Imag + (size_t) i * Nc;
+		float *out = tmp + (size_t) i * Nc;
+		for (int j = 0; j < jmin; j++) {
+			out[j] = h2 * (in[test_ind(j - 2 * Step, Nc)] + in[test_ind(j + 2 * Step, Nc)])
+				+ h1 * (in[test_ind(j - Step, Nc)] + in[test_ind(j + Step, Nc)])
+				+ h0 * in[j];
+		}
+#ifdef _OPENMP
+#pragma omp simd
+#endif
+		for (int j = jmin; j < jmax; j++) {
+			out[j] = h2 * (in[j - 2 * Step] + in[j + 2 * Step])
+				+ h1 * (in[j - Step] + in[j + Step])
+				+ h0 * in[j];
+		}
+		for (int j = jmax; j < Nc; j++) {
+			out[j] = h2 * (in[test_ind(j - 2 * Step, Nc)] + in[test_ind(j + 2 * Step, Nc)])
+				+ h1 * (in[test_ind(j - Step, Nc)] + in[test_ind(j + Step, Nc)])
+				+ h0 * in[j];
+		}
+	}
 
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(com.max_thread) schedule(static)
+#endif
+	for (int i = 0; i < Nl; i++) {
+		const float *r3 = tmp + (size_t) test_ind(i - 2 * Step, Nl) * Nc;
+		const float *r1 = tmp + (size_t) test_ind(i - Step, Nl) * Nc;
+		const float *r0 = tmp + (size_t) i * Nc;
+		const float *r2 = tmp + (size_t) test_ind(i + Step, Nl) * Nc;
+		const float *r4 = tmp + (size_t) test_ind(i + 2 * Step, Nl) * Nc;
+		float *out = Smooth + (size_t) i * Nc;
+#ifdef _OPENMP
+#pragma omp simd
+#endif
+		for (int j = 0; j < Nc; j++) {
+			out[j] = h2 * (r3[j] + r4[j]) + h1 * (r1[j] + r2[j]) + h0 * r0[j];
 		}
 	}
+
+	free(tmp);
 	return 0;
 }
 
@@ -37,6 +37,7 @@
 #include "algos/photometry.h"
 #include "algos/spcc.h"
 #include "algos/PSF.h"
+#include "algos/psf_solver.h"
 #include "algos/astrometry_solver.h"
 #include "algos/star_finder.h"
 #include "algos/siril_wcs.h"
@@ -163,6 +164,72 @@ int make_selection_around_a_star(pcc_star star, rectangle *area, fits *fit) {
 	return 0;
 }
 
+/* photometry of a catalogue star in the three channels */
+struct star_phot {
+	double mag[3];
+	psf_error error;
+	gboolean valid;
+};
+
+/* All the boxes around the catalogue stars have the same size, so the stars
+ * are measured PSF_SOLVER_LANES at a time by the batched solver. A star that
+ * fails in a channel is not measured in the next ones. Returns an array of
+ * nb_stars results to be freed, NULL on allocation failure */
+static struct star_phot *measure_catalogue_stars(fits *fit, pcc_star *stars, int nb_stars, struct phot_config *ps) {
+	struct star_phot *phot = calloc(nb_stars, sizeof(struct star_phot));
+	if (!phot) {
+		PRINT_ALLOC_ERR;
+		return NULL;
+	}
+	const int L = PSF_SOLVER_LANES;
+	const int nb_batches = (nb_stars + L - 1) / L;
+	gint progress = 0;
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(com.max_thread) schedule(dynamic) shared(progress)
+#endif
+	for (int batch = 0; batch < nb_batches; batch++) {
+		if (!get_thread_run())
+			continue;
+		rectangle areas[PSF_SOLVER_LANES];
+		int star_of[PSF_SOLVER_LANES];
+		int nb = 0;
+		int last = min(nb_stars, (batch + 1) * L);
+		for (int i = batch * L; i < last; i++) {
+			if (make_selection_around_a_star(stars[i], &areas[nb], fit)) {
+				siril_debug_print("star %d is outside image or too close to border\n", i);
+				phot[i].error = PSF_ERR_OUT_OF_WINDOW;
+				continue;
+			}
+			phot[i].valid = TRUE;
+			star_of[nb++] = i;
+		}
+		for (int chan = 0; chan < 3 && nb > 0; chan++) {
+			psf_star *results[PSF_SOLVER_LANES];
+			psf_error errors[PSF_SOLVER_LANES];
+			psf_get_minimisation_batch(fit, chan, areas, nb, ps, com.pref.starfinder_conf.profile, results, errors);
+			int kept = 0;
+			for (int l = 0; l < nb; l++) {
+				int i = star_of[l];
+				if (!results[l] || !results[l]->phot_is_valid || errors[l] != PSF_NO_ERR) {
+					phot[i].valid = FALSE;
+					phot[i].error = errors[l];
+					siril_debug_print("photometry failed for star %d, error %d\n", i, errors[l]);
+				} else {
+					phot[i].mag[chan] = results[l]->mag;
+					areas[kept] = areas[l];
+					star_of[kept++] = i;
+				}
+				if (results[l])
+					free_psf(results[l]);
+			}
+			nb = kept;
+		}
+		g_atomic_int_add(&progress, last - batch * L);
+		set_progress_bar_data(NULL, (double) g_atomic_int_get(&progress) / (double) nb_stars);
+	}
+	return phot;
+}
+
 static gchar *generate_title(const gchar *type, double arg, double br, double sig, gchar *wr, int nb_stars, int nb_excl, float *kw) {
 	return g_strdup_printf(_("White Balance summary\n"
 			"<span size=\"small\">"
@@ -225,9 +292,9 @@ static int get_spcc_white_balance_coeffs(struct photometric_cc_data *args, float
 
 	struct phot_config *ps = phot_set_adjusted_for_image(fit);
 	siril_debug_print("aperture: %2.1f%s\tinner: %2.1f\touter: %2.1f\n", ps->aperture, ps->force_radius?"":" (auto)", ps->inner, ps->outer);
-	gint ngood = 0, progress = 0;
+	gint ngood = 0;
 	gint errors[PSF_ERR_MAX_VALUE] = { 0 };
-	double minwl[3], maxwl[3];
+	double minwl[3], maxwl[3], weights[3][XPSAMPLED_LEN];
 	for (int chan = 0 ; chan < 3 ; chan++) {
 		get_spectrum_from_args(args, &response[chan], chan);
 		/* The idea here is that in narrowband mode we integrate the interpolated response (with no filtering
@@ -236,49 +303,35 @@ static int get_spcc_white_balance_coeffs(struct photometric_cc_data *args, float
 		 * wavelength range. This principle is used in the flux and WB calcs too. */
 		minwl[chan] = args->nb_mode ? args->nb_center[chan] - (args->nb_bandwidth[chan]/2) : XPSAMPLED_MIN_WL;
 		maxwl[chan] = args->nb_mode ? args->nb_center[chan] + (args->nb_bandwidth[chan]/2) : XPSAMPLED_MAX_WL;
+		/* the response is the same for all stars, its product with the
+		 * integration weights is computed once and each star then only
+		 * needs a dot product with its spectrum */
+		xpsampled_weighted_response(weights[chan], &response[chan], minwl[chan], maxwl[chan]);
 	}
 
+	struct star_phot *phot = measure_catalogue_stars(fit, stars, nb_stars, ps);
+	if (!phot) {
+		free(ps);
+		free(irg);
+		free(ibg);
+		free(crg);
+		free(cbg);
+		return 1;
+	}
 #ifdef _OPENMP
-#pragma omp parallel for num_threads(com.max_thread) schedule(guided) shared(progress, ngood)
+#pragma omp parallel for num_threads(com.max_thread) schedule(guided) shared(ngood)
 #endif
 	for (int i = 0; i < nb_stars; i++) {
 		if (!get_thread_run())
 			continue;
-		rectangle area = { 0 };
-		double flux[3] = { 0.0, 0.0, 0.0 };
-
-		// Update the progress bar
-		if (!(g_atomic_int_get(&progress) % 16))	// every 16 iterations
-			set_progress_bar_data(NULL, (double) progress / (double) nb_stars);
-		g_atomic_int_inc(&progress);
-
-		// Make a selection 'area' around the ith star in the list of pcc_stars passed to the function
-		if (make_selection_around_a_star(stars[i], &area, fit)) {
-			siril_debug_print("star %d is outside image or too close to border\n", i);
-			g_atomic_int_inc(errors+PSF_ERR_OUT_OF_WINDOW);
-			continue;
-		}
-
-		// Do photometry on each channel of the ith star; we compute the flux
-		gboolean no_phot = FALSE;
-		psf_error error = PSF_NO_ERR;
-		for (int chan = 0; chan < 3 && !no_phot; chan ++) {
-			// Photometry
-			psf_star *photometry = psf_get_minimisation(fit, chan, &area, TRUE, ps, FALSE, com.pref.starfinder_conf.profile, &error);
-			if (!photometry || !photometry->phot_is_valid || error != PSF_NO_ERR) {
-				no_phot = TRUE;
-			} else {
-				// Flux calculation
-				flux[chan] = pow(10., -0.4 * photometry->mag);
-			}
-			if (photometry)
-				free_psf(photometry);
-		}
-		if (no_phot) {
-			g_atomic_int_inc(errors+error);
-			siril_debug_print("photometry failed for star %d, error %d\n", i, error);
+		// Photometry of the ith star in each channel; we compute the flux
+		if (!phot[i].valid) {
+			g_atomic_int_inc(errors + phot[i].error);
 			continue;
 		}
+		double flux[3];
+		for (int chan = 0; chan < 3; chan++)
+			flux[chan] = pow(10., -0.4 * phot[i].mag[chan]);
 
 		// Compute the image red/green rations from the ratios of r/b flux and b/g flux
 		irg[i] = flux[RLAYER]/flux[GLAYER];
@@ -292,12 +345,9 @@ static int get_spcc_white_balance_coeffs(struct photometric_cc_data *args, float
 		// Convert flux to relative photon count normalized at 550nm
 		flux_to_relcount(&star_spectrum);
 
-		// Compute the expected response (product of catalogue flux and instrument response)
-		xpsampled flux_expected = init_xpsampled();
-		for (int chan = 0 ; chan < 3 ; chan++) {
-			multiply_xpsampled(&flux_expected, &response[chan], &star_spectrum);
-			ref_flux[chan] = integrate_xpsampled(&flux_expected, minwl[chan], maxwl[chan]);
-		}
+		// Compute the expected response (integral of catalogue flux times instrument response)
+		for (int chan = 0 ; chan < 3 ; chan++)
+			ref_flux[chan] = xpsampled_dot(weights[chan], &star_spectrum);
 
 		// Compute the catalogue r/g and b/g ratios
 		crg[i] = ref_flux[RLAYER]/ref_flux[GLAYER];
@@ -316,6 +366,7 @@ static int get_spcc_white_balance_coeffs(struct photometric_cc_data *args, float
 		g_atomic_int_inc(errors + PSF_NO_ERR);
 		g_atomic_int_inc(&ngood);
 	}
+	free(phot);
 	free(ps);
 	// Calculate white reference ratios
 	double white_flux[3];
@@ -328,7 +379,8 @@ static int get_spcc_white_balance_coeffs(struct photometric_cc_data *args, float
 	xpsampled white_expected[3] = { init_xpsampled(), init_xpsampled(), init_xpsampled() };
 	for (int chan = 0 ; chan < 3 ; chan++) {
 		multiply_xpsampled(&white_expected[chan], &response[chan], &white_spectrum);
-		white_flux[chan] = integrate_xpsampled(&white_expected[chan], minwl[chan], maxwl[chan]);
+		// same quadrature as the stars, so that the ratios are comparable
+		white_flux[chan] = xpsampled_dot(weights[chan], &white_spectrum);
 	}
 	wrg = white_flux[RLAYER]/white_flux[GLAYER];
 	wbg = white_flux[BLAYER]/white_flux[GLAYER];
@@ -506,7 +558,7 @@ static int get_pcc_white_balance_coeffs(struct photometric_cc_data *args, float
 
 	struct phot_config *ps = phot_set_adjusted_for_image(fit);
 	siril_debug_print("aperture: %2.1f%s\tinner: %2.1f\touter: %2.1f\n", ps->aperture, ps->force_radius?"":" (auto)", ps->inner, ps->outer);
-	gint ngood = 0, progress = 0;
+	gint ngood = 0;
 	gint errors[PSF_ERR_MAX_VALUE] = { 0 };
 
 	cmsHPROFILE xyzprofile = NULL;
@@ -545,40 +597,29 @@ static int get_pcc_white_balance_coeffs(struct photometric_cc_data *args, float
 		return 1;
 	}
 
+	struct star_phot *phot = measure_catalogue_stars(fit, stars, nb_stars, ps);
+	if (!phot) {
+		cmsDeleteTransform(transform);
+		free(ps);
+		free(data[RLAYER]);
+		free(data[GLAYER]);
+		free(data[BLAYER]);
+		return 1;
+	}
 #ifdef _OPENMP
-#pragma omp parallel for num_threads(com.max_thread) schedule(guided) shared(progress, ngood)
+#pragma omp parallel for num_threads(com.max_thread) schedule(guided) shared(ngood)
 #endif
 	for (int i = 0; i < nb_stars; i++) {
 		if (!get_thread_run())
 			continue;
-		rectangle area = { 0 };
-		float flux[3] = { 0.f, 0.f, 0.f };
+		float flux[3];
 		float r, g, b, bv;
-		if (!(g_atomic_int_get(&progress) % 16))	// every 16 iterations
-			set_progress_bar_data(NULL, (double) progress / (double) nb_stars);
-		g_atomic_int_inc(&progress);
-
-		if (make_selection_around_a_star(stars[i], &area, fit)) {
-			siril_debug_print("star %d is outside image or too close to border\n", i);
-			g_atomic_int_inc(errors+PSF_ERR_OUT_OF_WINDOW);
-			continue;
-		}
-
-		gboolean no_phot = FALSE;
-		psf_error error = PSF_NO_ERR;
-		for (int chan = 0; chan < 3 && !no_phot; chan ++) {
-			psf_star *photometry = psf_get_minimisation(fit, chan, &area, TRUE, ps, FALSE, com.pref.starfinder_conf.profile, &error);
-			if (!photometry || !photometry->phot_is_valid || error != PSF_NO_ERR)
-				no_phot = TRUE;
-			else flux[chan] = powf(10.f, -0.4f * (float) photometry->mag);
-			if (photometry)
-				free_psf(photometry);
-		}
-		if (no_phot) {
-			g_atomic_int_inc(errors + error);
-			siril_debug_print("photometry failed for star %d, error %d\n", i, error);
+		if (!phot[i].valid) {
+			g_atomic_int_inc(errors + phot[i].error);
 			continue;
 		}
+		for (int chan = 0; chan < 3; chan++)
+			flux[chan] = powf(10.f, -0.4f * (float) phot[i].mag[chan]);
 		// get r g b coefficient
 		// If the Gaia Teff field is populated (CAT_GAIADR3 and
 		// CAT_GAIADR3_DIRECT), use that as it should be more accurate.
@@ -607,6 +648,7 @@ static int get_pcc_white_balance_coeffs(struct photometric_cc_data *args, float
 		g_atomic_int_inc(errors + PSF_NO_ERR);
 		g_atomic_int_inc(&ngood);
 	}
+	free(phot);
 	if (transform)
 		cmsDeleteTransform(transform);
 	free(ps);
@@ -83,6 +83,128 @@ struct phot_config *phot_set_adjusted_for_image(const fits *fit) {
 	return retval;
 }
 
+/* Aperture and annulus masks of a star centre position, cached as the
+ * apertures of a sequence or of the stars of an image mostly share their
+ * radii. The key is the radii in 1/APERTURE_RADIUS_STEPS pixel and the
+ * sub-pixel phase of the centre in 1/APERTURE_PHASES pixel, which moves
+ * the aperture edge by less than the photometric noise. */
+#define APERTURE_PHASES 16
+#define APERTURE_RADIUS_STEPS 256
+#define APERTURE_CACHE_SIZE 1024
+
+struct aperture_mask {
+	gint ref;
+	int r, r1, r2, qx, qy;	// the key
+	int half;		// offset of the centre pixel in the mask
+	int size;		// the mask has size * size pixels
+	float *weight;		// coverage of each pixel by the aperture
+	guint8 *annulus;	// 1 for the pixels of the sky annulus
+	int *first, *last;	// range of the non-null weights of each row
+	double total;		// sum of the weights
+};
+
+static struct aperture_mask *aperture_cache[APERTURE_CACHE_SIZE];
+static GMutex aperture_cache_mutex;
+
+static void aperture_mask_unref(struct aperture_mask *mask) {
+	if (!g_atomic_int_dec_and_test(&mask->ref))
+		return;
+	free(mask->weight);
+	free(mask->annulus);
+	free(mask->first);
+	free(mask->last);
+	free(mask);
+}
+
+/* same coverage as the former per-pixel computation: 1 inside radius - 0.5,
+ * decreasing linearly to 0 at radius + 0.5 */
+static struct aperture_mask *aperture_mask_new(int r, int r1, int r2, int qx, int qy) {
+	struct aperture_mask *mask = calloc(1, sizeof(struct aperture_mask));
+	if (!mask)
+		return NULL;
+	mask->ref = 1;
+	mask->r = r; mask->r1 = r1; mask->r2 = r2;
+	mask->qx = qx; mask->qy = qy;
+	double radius = (double)r / APERTURE_RADIUS_STEPS;
+	double inner = (double)r1 / APERTURE_RADIUS_STEPS;
+	double outer = (double)r2 / APERTURE_RADIUS_STEPS;
+	mask->half = (int)ceil(fmax(radius + 0.5, outer)) + 3;	// margin for the bounding box rounding
+	mask->size = 2 * mask->half + 2;
+	size_t npix = (size_t)mask->size * mask->size;
+	mask->weight = malloc(npix * sizeof(float));
+	mask->annulus = malloc(npix);
+	mask->first = malloc(mask->size * sizeof(int));
+	mask->last = malloc(mask->size * sizeof(int));
+	if (!mask->weight || !mask->annulus || !mask->first || !mask->last) {
+		aperture_mask_unref(mask);
+		return NULL;
+	}
+	double rmin_sq = (radius - 0.5) * (radius - 0.5);
+	double r1_sq = inner * inner, r2_sq = outer * outer;
+	double fx = (double)qx / APERTURE_PHASES, fy = (double)qy / APERTURE_PHASES;
+	for (int j = 0; j < mask->size; j++) {
+		double dy = j - mask->half - fy;
+		mask->first[j] = mask->size;
+		mask->last[j] = 0;
+		for (int i = 0; i < mask->size; i++) {
+			double dx = i - mask->half - fx;
+			double d_sq = dx * dx + dy * dy;
+			double f = d_sq < rmin_sq ? 1.0 : radius - sqrt(d_sq) + 0.5;
+			size_t k = (size_t)j * mask->size + i;
+			mask->weight[k] = f > 0.0 ? f : 0.0f;
+			mask->annulus[k] = d_sq < r2_sq && d_sq > r1_sq;
+			if (f > 0.0) {
+				if (i < mask->first[j]) mask->first[j] = i;
+				mask->last[j] = i + 1;
+				mask->total += f;
+			}
+		}
+	}
+	return mask;
+}
+
+static gboolean mask_matches(const struct aperture_mask *mask, int r, int r1, int r2, int qx, int qy) {
+	return mask && mask->r == r && mask->r1 == r1 && mask->r2 == r2 && mask->qx == qx && mask->qy == qy;
+}
+
+/* returns a reference on the mask, to release with aperture_mask_unref() */
+static struct aperture_mask *aperture_mask_get(double radius, double inner, double outer, int qx, int qy) {
+	int r = round_to_int(radius * APERTURE_RADIUS_STEPS);
+	int r1 = round_to_int(inner * APERTURE_RADIUS_STEPS);
+	int r2 = round_to_int(outer * APERTURE_RADIUS_STEPS);
+	guint slot = ((guint)r * 7919u + (guint)r1 * 104729u + (guint)r2 * 1299709u +
+			(guint)qy * APERTURE_PHASES + (guint)qx) % APERTURE_CACHE_SIZE;
+	g_mutex_lock(&aperture_cache_mutex);
+	struct aperture_mask *mask = aperture_cache[slot];
+	if (mask_matches(mask, r, r1, r2, qx, qy)) {
+		g_atomic_int_inc(&mask->ref);
+		g_mutex_unlock(&aperture_cache_mutex);
+		return mask;
+	}
+	g_mutex_unlock(&aperture_cache_mutex);
+
+	/* built without the lock, the radii of the stars differ with automatic
+	 * apertures and the threads would otherwise wait for each other */
+	struct aperture_mask *new_mask = aperture_mask_new(r, r1, r2, qx, qy);
+	if (!new_mask)
+		return NULL;
+	g_mutex_lock(&aperture_cache_mutex);
+	mask = aperture_cache[slot];
+	if (mask_matches(mask, r, r1, r2, qx, qy)) {
+		/* inserted by another thread meanwhile, the first one is kept */
+		g_atomic_int_inc(&mask->ref);
+		g_mutex_unlock(&aperture_cache_mutex);
+		aperture_mask_unref(new_mask);
+		return mask;
+	}
+	if (mask)
+		aperture_mask_unref(mask);
+	aperture_cache[slot] = new_mask;
+	g_atomic_int_inc(&new_mask->ref);
+	g_mutex_unlock(&aperture_cache_mutex);
+	return new_mask;
+}
+
 /* Function that compute all photometric data. The result must be freed */
 photometry *getPhotometryData(gsl_matrix* z, const psf_star *psf,
 		struct phot_config *phot_set, gboolean verbose, psf_error *error) {
@@ -90,7 +212,7 @@ photometry *getPhotometryData(gsl_matrix* z, const psf_star *psf,
 	int height = z->size1;
 	int n_sky = 0, ret;
 	int x, y, x1, y1, x2, y2;
-	double r1, r2, r, rmin_sq, appRadius;
+	double r1, r2, appRadius;
 	double apmag = 0.0, mean = 0.0, stdev = 0.0, area = 0.0;
 	gboolean valid = TRUE;
 	photometry *phot;
@@ -148,36 +270,66 @@ photometry *getPhotometryData(gsl_matrix* z, const psf_star *psf,
 		return NULL;
 	}
 
-	r1 *= r1;	// we square the radii to avoid doing
-	r2 *= r2;	// sqrts for radius checks in the loop
-	rmin_sq = (appRadius - 0.5) * (appRadius - 0.5);
+	/* the mask is placed on the pixel containing the star centre, phase is
+	 * the position of the centre in this pixel */
+	int cx = (int)xc, cy = (int)yc;
+	int qx = round_to_int((xc - cx) * APERTURE_PHASES);
+	int qy = round_to_int((yc - cy) * APERTURE_PHASES);
+	if (qx == APERTURE_PHASES) { cx++; qx = 0; }
+	if (qy == APERTURE_PHASES) { cy++; qy = 0; }
+	struct aperture_mask *mask = aperture_mask_get(appRadius, r1, r2, qx, qy);
+	if (!mask) {
+		PRINT_ALLOC_ERR;
+		free(data);
+		if (error) *error = PSF_ERR_ALLOC;
+		return NULL;
+	}
 	double lo = phot_set->minval, hi = phot_set->maxval;
 
 	/* from the matrix containing pixel data, we extract pixels within
 	 * limits of pixel value and of distance to the star centre for
-	 * background evaluation */
+	 * background evaluation. Rows with only valid pixels get the aperture
+	 * flux as a dot product with the mask weights */
 	for (y = y1; y <= y2; ++y) {
-		int yp = (y - yc) * (y - yc);
+		const double *row = z->data + (size_t)y * z->tda;
+		int my = y - cy + mask->half;
+		int off = mask->half - cx;	// from image to mask columns
+		const float *weight = mask->weight + (size_t)my * mask->size;
+		const guint8 *annulus = mask->annulus + (size_t)my * mask->size;
+		gboolean row_valid = TRUE;
 		for (x = x1; x <= x2; ++x) {
-			r = yp + (x - xc) * (x - xc);
-			double pixel = gsl_matrix_get(z, y, x);
+			double pixel = row[x];
 			if (pixel > lo && pixel < hi) {
-				double f = (r < rmin_sq ? 1 : appRadius - sqrt(r) + 0.5);
-				if (f >= 0) {
-					area += f;
-					apmag += pixel * f;
-				}
-				/* annulus */
-				if (r < r2 && r > r1) {
-					data[n_sky] = pixel;
-					n_sky++;
+				if (annulus[x + off])
+					data[n_sky++] = pixel;
+			} else row_valid = FALSE;
+		}
+		int xa = max(x1, mask->first[my] - off);
+		int xb = min(x2 + 1, mask->last[my] - off);
+		if (row_valid) {
+			double rowflux = 0.0, rowarea = 0.0;
+#ifdef _OPENMP
+#pragma omp simd reduction(+:rowflux,rowarea)
+#endif
+			for (x = xa; x < xb; ++x) {
+				rowflux += row[x] * weight[x + off];
+				rowarea += weight[x + off];
+			}
+			apmag += rowflux;
+			area += rowarea;
+		} else {
+			valid = FALSE;
+			if (error) *error = PSF_ERR_INVALID_PIX_VALUE;
+			for (x = xa; x < xb; ++x) {
+				double pixel = row[x];
+				if (pixel > lo && pixel < hi) {
+					apmag += pixel * weight[x + off];
+					area += weight[x + off];
 				}
-			} else {
-				valid = FALSE;
-				if (error) *error = PSF_ERR_INVALID_PIX_VALUE;
 			}
 		}
 	}
+	aperture_mask_unref(mask);
 	if (area < 1.0) {
 		siril_debug_print("area is < 1: not enough pixels of star data, too small aperture?\n");
 		free(data);
@@ -193,7 +345,7 @@ photometry *getPhotometryData(gsl_matrix* z, const psf_star *psf,
 		return NULL;
 	}
 
-	ret = robustmean(n_sky, data, &mean, &stdev);
+	ret = robustmean_binned(n_sky, data, &mean, &stdev);
 	free(data);
 	if (ret > 0) {
 		if (error) *error = PSF_ERR_MEAN_FAILED;
@@ -597,10 +749,19 @@ gpointer light_curve_worker(gpointer arg) {
 	framing_mode framing = REGISTERED_FRAME;
 	if (framing == REGISTERED_FRAME && !args->seq->regparam[args->layer])
 		framing = FOLLOW_STAR_FRAME;
-	// someday we should move the area in the seqpsf args, not needed for now
-	for (int star_index = 0; star_index < args->nb; star_index++) {
-		com.selection = args->areas[star_index];
-		if (seqpsf(args->seq, args->layer, FALSE, FALSE, framing, FALSE, TRUE)) {
+	// all stars are analysed in the same pass on the sequence
+	int first_set;
+	for (first_set = 0; first_set < MAX_SEQPSF && args->seq->photometry[first_set]; first_set++);
+	if (seqpsf_multi(args->seq, args->layer, args->areas, args->nb, framing)) {
+		siril_log_message(_("Failed to analyse the variable star photometry\n"));
+		retval = 1;
+	} else {
+		for (int star_index = 0; star_index < args->nb && first_set + star_index < MAX_SEQPSF; star_index++) {
+			psf_star **set = args->seq->photometry[first_set + star_index];
+			int i;
+			for (i = 0; i < args->seq->number && !set[i]; i++);
+			if (i < args->seq->number)
+				continue;
 			if (star_index == 0) {
 				siril_log_message(_("Failed to analyse the variable star photometry\n"));
 				retval = 1;
@@ -609,11 +770,9 @@ gpointer light_curve_worker(gpointer arg) {
 			else siril_log_message(_("Failed to analyse the photometry of reference star %d\n"),
 					star_index);
 		}
-
 		if (args->seq == &com.seq)
 			queue_redraw(REDRAW_OVERLAY);
 	}
-	memset(&com.selection, 0, sizeof(rectangle));
 	args->force_rad = com.pref.phot_set.force_radius;	// Retrieve the Aperture state (fixed/dynamic)
 	/* analyse data and create the light curve */
 	if (!retval)
@@ -0,0 +1,624 @@
+/*
+ * This file is part of Siril, an astronomy image processor.
+ * Copyright (C) 2005-2011 Francois Meyer (dulle at free.fr)
+ * Copyright (C) 2012-2025 team free-astro (see more in AUTHORS file)
+ * Reference site is https://siril.org
+ *
+ * Siril is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Siril is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Siril. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Levenberg-Marquardt solver dedicated to the PSF models of PSF.c, used for
+ * the fits of star detection. It solves the same problem as the GSL trust
+ * region solver, with the same parametrization, but the number of parameters
+ * is known at compile time, the normal equations are accumulated on the
+ * stack by blocks of pixels instead of storing the Jacobian, and nothing is
+ * allocated during the fit. */
+
+#include <math.h>
+#include <float.h>
+
+#include "core/siril.h"
+#include "algos/PSF.h"
+
+#include "psf_solver.h"
+
+#define LM_BLOCK 64		// pixels per block of Jacobian columns
+#define LM_MAX_REJECTIONS 15	// rejected steps before giving up an iteration
+#define LM_MU_INIT 1e-3		// initial damping, relative to the scaling
+
+#define P_MAX PSF_SOLVER_MAX_PARAMS
+
+/* model parameters derived from the fitted variables, see psf_Gaussian_f_ang()
+ * and psf_Moffat_f_ang() in PSF.c */
+struct model_params {
+	double B, A, x0, y0;
+	double SX, SY, r, sc;
+	double ca, sa;
+	double beta, sfbeta;
+};
+
+static inline void unpack_params(const double *x, int p, struct model_params *m) {
+	m->B = x[0];
+	m->A = x[1];
+	m->x0 = x[2];
+	m->y0 = x[3];
+	m->SX = fabs(x[4]);
+	m->r = 0.5 * (cos(x[5]) + 1.);
+	m->SY = m->r * m->r * m->SX;
+	m->sc = sin(x[5]);
+	m->ca = cos(x[6]);
+	m->sa = sin(x[6]);
+	if (p == 8) {
+		m->beta = MOFFAT_BETA_UBOUND * 0.5 * (cos(x[7]) + 1.);
+		m->sfbeta = sin(x[7]);
+	} else {
+		m->beta = -1.;
+		m->sfbeta = 0.;
+	}
+}
+
+/* sum of the squared residuals */
+static inline double eval_cost(const struct psf_solver_data *d, const double *x, const int p) {
+	struct model_params m;
+	unpack_params(x, p, &m);
+	const double *px = d->px, *py = d->py, *y = d->y;
+	const double iSX = 1. / m.SX, iSY = 1. / m.SY;
+	double sum = 0.;
+	if (p == 7) {
+#pragma omp simd reduction(+:sum)
+		for (size_t k = 0; k < d->n; k++) {
+			double dx = px[k] - m.x0, dy = py[k] - m.y0;
+			double tx = m.ca * dx - m.sa * dy;
+			double ty = m.sa * dx + m.ca * dy;
+			double res = m.B + m.A * exp(-(tx * tx * iSX + ty * ty * iSY)) - y[k];
+			sum += res * res;
+		}
+	} else {
+#pragma omp simd reduction(+:sum)
+		for (size_t k = 0; k < d->n; k++) {
+			double dx = px[k] - m.x0, dy = py[k] - m.y0;
+			double tx = m.ca * dx - m.sa * dy;
+			double ty = m.sa * dx + m.ca * dy;
+			double res = m.B + m.A * pow(1. + tx * tx * iSX + ty * ty * iSY, -m.beta) - y[k];
+			sum += res * res;
+		}
+	}
+	return sum;
+}
+
+/* sum of the squared residuals, and the normal equations: lower triangle of
+ * J^T.J and gradient J^T.f. The Jacobian columns are the ones of
+ * psf_Gaussian_df_ang() and psf_Moffat_df_ang() */
+static inline double eval_normal(const struct psf_solver_data *d, const double *x, const int p,
+		double JtJ[P_MAX][P_MAX], double *g) {
+	struct model_params m;
+	unpack_params(x, p, &m);
+	double jc[P_MAX][LM_BLOCK];
+	double res[LM_BLOCK];
+	const double iSX = 1. / m.SX, iSY = 1. / m.SY;
+	const double cross = 1. / m.SX - 1. / m.SY;
+	double sum = 0.;
+
+	for (int a = 0; a < p; a++) {
+		g[a] = 0.;
+		for (int b = 0; b <= a; b++)
+			JtJ[a][b] = 0.;
+	}
+
+	for (size_t start = 0; start < d->n; start += LM_BLOCK) {
+		const size_t len = (d->n - start < LM_BLOCK) ? d->n - start : LM_BLOCK;
+		const double *px = d->px + start, *py = d->py + start, *y = d->y + start;
+		if (p == 7) {
+#pragma omp simd reduction(+:sum)
+			for (size_t k = 0; k < len; k++) {
+				double dx = px[k] - m.x0, dy = py[k] - m.y0;
+				double tx = m.ca * dx - m.sa * dy;
+				double ty = m.sa * dx + m.ca * dy;
+				double tmpc = exp(-(tx * tx * iSX + ty * ty * iSY));
+				double Ac = m.A * tmpc;
+				res[k] = m.B + Ac - y[k];
+				sum += res[k] * res[k];
+				jc[0][k] = 1.;
+				jc[1][k] = tmpc;
+				jc[2][k] = 2. * Ac * (tx * iSX * m.ca + ty * iSY * m.sa);
+				jc[3][k] = 2. * Ac * (-tx * iSX * m.sa + ty * iSY * m.ca);
+				jc[4][k] = Ac * (tx * tx * iSX * iSX + ty * ty * iSX * iSX / (m.r * m.r));
+				jc[5][k] = -Ac * m.sc * ty * ty * iSY / m.r;
+				jc[6][k] = 2. * Ac * tx * ty * cross;
+			}
+		} else {
+#pragma omp simd reduction(+:sum)
+			for (size_t k = 0; k < len; k++) {
+				double dx = px[k] - m.x0, dy = py[k] - m.y0;
+				double tx = m.ca * dx - m.sa * dy;
+				double ty = m.sa * dx + m.ca * dy;
+				double tmpa = 1. + tx * tx * iSX + ty * ty * iSY;
+				double tmpb = pow(tmpa, -m.beta);
+				double tmpc = m.A * m.beta * tmpb / tmpa;
+				res[k] = m.B + m.A * tmpb - y[k];
+				sum += res[k] * res[k];
+				jc[0][k] = 1.;
+				jc[1][k] = tmpb;
+				jc[2][k] = 2. * tmpc * (tx * iSX * m.ca + ty * iSY * m.sa);
+				jc[3][k] = 2. * tmpc * (-tx * iSX * m.sa + ty * iSY * m.ca);
+				jc[4][k] = tmpc * (tx * tx * iSX * iSX + ty * ty * iSX * iSX / (m.r * m.r));
+				jc[5][k] = -tmpc * m.sc * ty * ty * iSY / m.r;
+				jc[6][k] = 2. * tmpc * tx * ty * cross;
+				jc[7][k] = 0.5 * m.A * MOFFAT_BETA_UBOUND * m.sfbeta * log(tmpa) * tmpb;
+			}
+		}
+		for (int a = 0; a < p; a++) {
+			double ga = 0.;
+#pragma omp simd reduction(+:ga)
+			for (size_t k = 0; k < len; k++)
+				ga += jc[a][k] * res[k];
+			g[a] += ga;
+			for (int b = 0; b <= a; b++) {
+				double s = 0.;
+#pragma omp simd reduction(+:s)
+				for (size_t k = 0; k < len; k++)
+					s += jc[a][k] * jc[b][k];
+				JtJ[a][b] += s;
+			}
+		}
+	}
+	return sum;
+}
+
+/* in-place Cholesky decomposition of the lower triangle of a, returns 1 if
+ * the matrix is not positive definite */
+static inline int cholesky_decomp(double a[P_MAX][P_MAX], const int p) {
+	for (int j = 0; j < p; j++) {
+		double s = a[j][j];
+		for (int k = 0; k < j; k++)
+			s -= a[j][k] * a[j][k];
+		if (!(s > 0.) || !isfinite(s))
+			return 1;
+		a[j][j] = sqrt(s);
+		for (int i = j + 1; i < p; i++) {
+			double t = a[i][j];
+			for (int k = 0; k < j; k++)
+				t -= a[i][k] * a[j][k];
+			a[i][j] = t / a[j][j];
+		}
+	}
+	return 0;
+}
+
+static inline void cholesky_solve(double L[P_MAX][P_MAX], const int p, const double *b, double *x) {
+	for (int i = 0; i < p; i++) {
+		double t = b[i];
+		for (int k = 0; k < i; k++)
+			t -= L[i][k] * x[k];
+		x[i] = t / L[i][i];
+	}
+	for (int i = p - 1; i >= 0; i--) {
+		double t = x[i];
+		for (int k = i + 1; k < p; k++)
+			t -= L[k][i] * x[k];
+		x[i] = t / L[i][i];
+	}
+}
+
+/* diagonal of (J^T.J)^-1, left to 0 if the matrix is singular */
+static void covariance_diag(double JtJ[P_MAX][P_MAX], const int p, double *var) {
+	double L[P_MAX][P_MAX];
+	for (int a = 0; a < p; a++) {
+		var[a] = 0.;
+		for (int b = 0; b <= a; b++)
+			L[a][b] = JtJ[a][b];
+	}
+	if (cholesky_decomp(L, p))
+		return;
+	for (int a = 0; a < p; a++) {
+		double e[P_MAX] = { 0. }, col[P_MAX];
+		e[a] = 1.;
+		cholesky_solve(L, p, e, col);
+		var[a] = col[a];
+	}
+}
+
+/* convergence tests of gsl_multifit_nlinear_test() */
+static inline gboolean test_xtol(const double *x, const double *dx, const int p, double xtol) {
+	for (int i = 0; i < p; i++) {
+		if (fabs(dx[i]) > xtol * (fabs(x[i]) + xtol))
+			return FALSE;
+	}
+	return TRUE;
+}
+
+static inline gboolean test_gtol(const double *x, const double *g, const int p, double cost, double gtol) {
+	double gmax = 0.;
+	for (int i = 0; i < p; i++) {
+		double gi = fabs(g[i]) * fmax(fabs(x[i]), 1.);
+		if (gi > gmax)
+			gmax = gi;
+	}
+	return gmax <= gtol * fmax(0.5 * cost, 1.);
+}
+
+/* p is a constant in the two callers, which get their own copy of the
+ * solver and of its loops */
+static inline int lm_fit(const struct psf_solver_data *d, const int p, int max_iter,
+		double xtol, double gtol, double *x, double *var, double *rmse) {
+	double JtJ[P_MAX][P_MAX], g[P_MAX], D[P_MAX];
+	double L[P_MAX][P_MAX], b[P_MAX], dx[P_MAX], xt[P_MAX];
+	double mu = LM_MU_INIT, nu = 2.;
+	int retval = 1;
+
+	double cost = eval_normal(d, x, p, JtJ, g);
+	if (!isfinite(cost))
+		return 1;
+	for (int i = 0; i < p; i++)
+		D[i] = fmax(JtJ[i][i], DBL_EPSILON);
+
+	for (int iter = 0; iter < max_iter; iter++) {
+		gboolean accepted = FALSE;
+		for (int rejected = 0; !accepted && rejected < LM_MAX_REJECTIONS; rejected++) {
+			for (int a = 0; a < p; a++) {
+				for (int c = 0; c <= a; c++)
+					L[a][c] = JtJ[a][c];
+				L[a][a] += mu * D[a];
+				b[a] = -g[a];
+			}
+			if (cholesky_decomp(L, p)) {
+				mu *= nu;
+				nu *= 2.;
+				continue;
+			}
+			cholesky_solve(L, p, b, dx);
+			for (int i = 0; i < p; i++)
+				xt[i] = x[i] + dx[i];
+			double cost_t = eval_cost(d, xt, p);
+			/* gain ratio of the step, the cost being twice the one of
+			 * the usual formulation */
+			double pred = 0.;
+			for (int i = 0; i < p; i++)
+				pred += dx[i] * (mu * D[i] * dx[i] - g[i]);
+			double rho = (cost - cost_t) / pred;
+			if (isfinite(cost_t) && pred > 0. && rho > 0.) {
+				for (int i = 0; i < p; i++)
+					x[i] = xt[i];
+				double t = 2. * rho - 1.;
+				mu *= fmax(1. / 3., 1. - t * t * t);
+				nu = 2.;
+				accepted = TRUE;
+			} else {
+				mu *= nu;
+				nu *= 2.;
+			}
+		}
+		if (!accepted) {
+			// no progress: failure on the first iteration, a minimum otherwise
+			if (iter > 0)
+				retval = 0;
+			break;
+		}
+		cost = eval_normal(d, x, p, JtJ, g);
+		for (int i = 0; i < p; i++)
+			D[i] = fmax(D[i], JtJ[i][i]);
+		if (test_xtol(x, dx, p, xtol) || test_gtol(x, g, p, cost, gtol)) {
+			retval = 0;
+			break;
+		}
+	}
+
+	covariance_diag(JtJ, p, var);
+	*rmse = sqrt(cost / d->n);
+	return retval;
+}
+
+static int lm_fit_gaussian(const struct psf_solver_data *d, int max_iter,
+		double xtol, double gtol, double *x, double *var, double *rmse) {
+	return lm_fit(d, 7, max_iter, xtol, gtol, x, var, rmse);
+}
+
+static int lm_fit_moffat(const struct psf_solver_data *d, int max_iter,
+		double xtol, double gtol, double *x, double *var, double *rmse) {
+	return lm_fit(d, 8, max_iter, xtol, gtol, x, var, rmse);
+}
+
+/* Fits the PSF model of profile on the data, x containing the 7 (Gaussian)
+ * or 8 (Moffat) initial variables in the order of psf_minimiz_angle(). On
+ * return, x contains the fitted variables, var the diagonal of their
+ * covariance matrix and rmse the RMS of the residuals.
+ * Returns 0 on convergence, 1 if it did not converge in max_iter iterations
+ * (x is still set to the last position) */
+int psf_solver_fit(const struct psf_solver_data *data, starprofile profile, int max_iter,
+		double xtol, double gtol, double *x, double *var, double *rmse) {
+	if (profile == PSF_GAUSSIAN)
+		return lm_fit_gaussian(data, max_iter, xtol, gtol, x, var, rmse);
+	return lm_fit_moffat(data, max_iter, xtol, gtol, x, var, rmse);
+}
+
+/******************************************************************************/
+/* Batched version: up to PSF_SOLVER_LANES boxes of the same size are fitted
+ * together, the pixel loops running over the lanes so that the model and
+ * Jacobian of all boxes are computed in the same SIMD registers. Each lane
+ * keeps its own damping and stops iterating on its own convergence. */
+
+#define LANES PSF_SOLVER_LANES
+
+/* derived model parameters, one per lane */
+struct lane_params {
+	double B[LANES], A[LANES], x0[LANES], y0[LANES];
+	double iSX[LANES], iSY[LANES], cross[LANES], ir2[LANES], scr[LANES];
+	double ca[LANES], sa[LANES];
+	double beta[LANES], sfb[LANES];
+};
+
+static inline void unpack_lanes(double x[LANES][P_MAX], const int p, struct lane_params *q) {
+	for (int l = 0; l < LANES; l++) {
+		struct model_params m;
+		unpack_params(x[l], p, &m);
+		q->B[l] = m.B;
+		q->A[l] = m.A;
+		q->x0[l] = m.x0;
+		q->y0[l] = m.y0;
+		q->iSX[l] = 1. / m.SX;
+		q->iSY[l] = 1. / m.SY;
+		q->cross[l] = 1. / m.SX - 1. / m.SY;
+		q->ir2[l] = 1. / (m.r * m.r);
+		q->scr[l] = m.sc / m.r;
+		q->ca[l] = m.ca;
+		q->sa[l] = m.sa;
+		q->beta[l] = m.beta;
+		q->sfb[l] = 0.5 * MOFFAT_BETA_UBOUND * m.sfbeta;
+	}
+}
+
+static inline void batch_eval_cost(const struct psf_solver_batch *b, double x[LANES][P_MAX], const int p,
+		double *cost) {
+	struct lane_params q;
+	unpack_lanes(x, p, &q);
+	double sum[LANES] = { 0. };
+	size_t k = 0;
+	for (size_t i = 0; i < b->npix / b->ncols; i++) {
+		const double fy = i + 0.5;
+		for (size_t j = 0; j < b->ncols; j++, k++) {
+			const double fx = j + 0.5;
+			const double *y = b->y + k * LANES, *w = b->w + k * LANES;
+#pragma omp simd
+			for (int l = 0; l < LANES; l++) {
+				double dx = fx - q.x0[l], dy = fy - q.y0[l];
+				double tx = q.ca[l] * dx - q.sa[l] * dy;
+				double ty = q.sa[l] * dx + q.ca[l] * dy;
+				double u = tx * tx * q.iSX[l] + ty * ty * q.iSY[l];
+				double model = (p == 7) ? exp(-u) : pow(1. + u, -q.beta[l]);
+				double res = w[l] * (q.B[l] + q.A[l] * model - y[l]);
+				sum[l] += res * res;
+			}
+		}
+	}
+	for (int l = 0; l < LANES; l++)
+		cost[l] = sum[l];
+}
+
+static inline void batch_eval_normal(const struct psf_solver_batch *b, double x[LANES][P_MAX], const int p,
+		double JtJ[P_MAX][P_MAX][LANES], double g[P_MAX][LANES], double *cost) {
+	struct lane_params q;
+	unpack_lanes(x, p, &q);
+	double sum[LANES] = { 0. };
+	for (int a = 0; a < p; a++) {
+		for (int l = 0; l < LANES; l++) {
+			g[a][l] = 0.;
+			for (int c = 0; c <= a; c++)
+				JtJ[a][c][l] = 0.;
+		}
+	}
+	size_t k = 0;
+	for (size_t i = 0; i < b->npix / b->ncols; i++) {
+		const double fy = i + 0.5;
+		for (size_t j = 0; j < b->ncols; j++, k++) {
+			const double fx = j + 0.5;
+			const double *y = b->y + k * LANES, *w = b->w + k * LANES;
+#pragma omp simd
+			for (int l = 0; l < LANES; l++) {
+				double jac[P_MAX];
+				double dx = fx - q.x0[l], dy = fy - q.y0[l];
+				double tx = q.ca[l] * dx - q.sa[l] * dy;
+				double ty = q.sa[l] * dx + q.ca[l] * dy;
+				double u = tx * tx * q.iSX[l] + ty * ty * q.iSY[l];
+				double model, tmpc;
+				if (p == 7) {
+					model = exp(-u);
+					tmpc = w[l] * q.A[l] * model;
+				} else {
+					double tmpa = 1. + u;
+					model = pow(tmpa, -q.beta[l]);
+					tmpc = w[l] * q.A[l] * q.beta[l] * model / tmpa;
+					jac[7] = w[l] * q.A[l] * q.sfb[l] * log(tmpa) * model;
+				}
+				double res = w[l] * (q.B[l] + q.A[l] * model - y[l]);
+				jac[0] = w[l];
+				jac[1] = w[l] * model;
+				jac[2] = 2. * tmpc * (tx * q.iSX[l] * q.ca[l] + ty * q.iSY[l] * q.sa[l]);
+				jac[3] = 2. * tmpc * (-tx * q.iSX[l] * q.sa[l] + ty * q.iSY[l] * q.ca[l]);
+				jac[4] = tmpc * q.iSX[l] * q.iSX[l] * (tx * tx + ty * ty * q.ir2[l]);
+				jac[5] = -tmpc * q.scr[l] * ty * ty * q.iSY[l];
+				jac[6] = 2. * tmpc * tx * ty * q.cross[l];
+				sum[l] += res * res;
+				for (int a = 0; a < p; a++) {
+					g[a][l] += jac[a] * res;
+					for (int c = 0; c <= a; c++)
+						JtJ[a][c][l] += jac[a] * jac[c];
+				}
+			}
+		}
+	}
+	for (int l = 0; l < LANES; l++)
+		cost[l] = sum[l];
+}
+
+static inline void copy_lane(double JtJ[P_MAX][P_MAX][LANES], double g[P_MAX][LANES], const double *cost,
+		double dJtJ[P_MAX][P_MAX][LANES], double dg[P_MAX][LANES], double *dcost, int l, const int p) {
+	for (int a = 0; a < p; a++) {
+		dg[a][l] = g[a][l];
+		for (int c = 0; c <= a; c++)
+			dJtJ[a][c][l] = JtJ[a][c][l];
+	}
+	dcost[l] = cost[l];
+}
+
+/* same algorithm as lm_fit(), run on all lanes at once */
+static inline void lm_fit_batch(const struct psf_solver_batch *b, const int p, const int *max_iter,
+		double xtol, double gtol, double (*xout)[P_MAX], double (*var)[P_MAX], double *rmse, int *status) {
+	const int nl = b->nb_lanes;
+	double x[LANES][P_MAX], xt[LANES][P_MAX], dx[LANES][P_MAX], D[LANES][P_MAX];
+	double JtJ[P_MAX][P_MAX][LANES], g[P_MAX][LANES], cost[LANES];
+	double nJtJ[P_MAX][P_MAX][LANES], ng[P_MAX][LANES], ncost[LANES];
+	double cost_t[LANES], pred[LANES], mu[LANES], nu[LANES];
+	int iter[LANES], rejected[LANES];
+	gboolean active[LANES], proposed[LANES], accepted[LANES];
+
+	// unused lanes compute the first one, their results are ignored
+	for (int l = 0; l < LANES; l++) {
+		for (int i = 0; i < P_MAX; i++)
+			x[l][i] = xout[l < nl ? l : 0][i];
+	}
+
+	batch_eval_normal(b, x, p, JtJ, g, cost);
+	int nb_active = 0;
+	for (int l = 0; l < LANES; l++) {
+		active[l] = l < nl && isfinite(cost[l]);
+		if (active[l])
+			nb_active++;
+		if (l < nl)
+			status[l] = 1;
+		for (int i = 0; i < p; i++)
+			D[l][i] = fmax(JtJ[i][i][l], DBL_EPSILON);
+		mu[l] = LM_MU_INIT;
+		nu[l] = 2.;
+		iter[l] = 0;
+		rejected[l] = 0;
+	}
+
+	while (nb_active > 0) {
+		/* step proposal of each lane */
+		for (int l = 0; l < LANES; l++) {
+			double L[P_MAX][P_MAX], rhs[P_MAX];
+			proposed[l] = FALSE;
+			for (int i = 0; i < p; i++)
+				xt[l][i] = x[l][i];
+			if (!active[l])
+				continue;
+			for (int a = 0; a < p; a++) {
+				for (int c = 0; c <= a; c++)
+					L[a][c] = JtJ[a][c][l];
+				L[a][a] += mu[l] * D[l][a];
+				rhs[a] = -g[a][l];
+			}
+			if (cholesky_decomp(L, p)) {
+				mu[l] *= nu[l];
+				nu[l] *= 2.;
+				if (++rejected[l] >= LM_MAX_REJECTIONS) {
+					status[l] = iter[l] > 0 ? 0 : 1;
+					active[l] = FALSE;
+					nb_active--;
+				}
+				continue;
+			}
+			cholesky_solve(L, p, rhs, dx[l]);
+			pred[l] = 0.;
+			for (int i = 0; i < p; i++) {
+				xt[l][i] = x[l][i] + dx[l][i];
+				pred[l] += dx[l][i] * (mu[l] * D[l][i] * dx[l][i] - g[i][l]);
+			}
+			proposed[l] = TRUE;
+		}
+
+		batch_eval_cost(b, xt, p, cost_t);
+
+		gboolean any_accepted = FALSE;
+		for (int l = 0; l < LANES; l++) {
+			accepted[l] = FALSE;
+			if (!proposed[l])
+				continue;
+			double rho = (cost[l] - cost_t[l]) / pred[l];
+			if (isfinite(cost_t[l]) && pred[l] > 0. && rho > 0.) {
+				for (int i = 0; i < p; i++)
+					x[l][i] = xt[l][i];
+				double t = 2. * rho - 1.;
+				mu[l] *= fmax(1. / 3., 1. - t * t * t);
+				nu[l] = 2.;
+				rejected[l] = 0;
+				iter[l]++;
+				accepted[l] = any_accepted = TRUE;
+			} else {
+				mu[l] *= nu[l];
+				nu[l] *= 2.;
+				if (++rejected[l] >= LM_MAX_REJECTIONS) {
+					status[l] = iter[l] > 0 ? 0 : 1;
+					active[l] = FALSE;
+					nb_active--;
+				}
+			}
+		}
+		if (!any_accepted)
+			continue;
+
+		batch_eval_normal(b, x, p, nJtJ, ng, ncost);
+		for (int l = 0; l < LANES; l++) {
+			if (!accepted[l])
+				continue;
+			copy_lane(nJtJ, ng, ncost, JtJ, g, cost, l, p);
+			double gl[P_MAX];
+			for (int i = 0; i < p; i++) {
+				D[l][i] = fmax(D[l][i], JtJ[i][i][l]);
+				gl[i] = g[i][l];
+			}
+			if (test_xtol(x[l], dx[l], p, xtol) || test_gtol(x[l], gl, p, cost[l], gtol)) {
+				status[l] = 0;
+				active[l] = FALSE;
+				nb_active--;
+			} else if (iter[l] >= max_iter[l]) {
+				active[l] = FALSE;
+				nb_active--;
+			}
+		}
+	}
+
+	for (int l = 0; l < nl; l++) {
+		double M[P_MAX][P_MAX];
+		for (int a = 0; a < p; a++) {
+			for (int c = 0; c <= a; c++)
+				M[a][c] = JtJ[a][c][l];
+		}
+		covariance_diag(M, p, var[l]);
+		rmse[l] = sqrt(cost[l] / b->n[l]);
+		for (int i = 0; i < p; i++)
+			xout[l][i] = x[l][i];
+	}
+}
+
+static void lm_fit_batch_gaussian(const struct psf_solver_batch *b, const int *max_iter, double xtol, double gtol,
+		double (*x)[P_MAX], double (*var)[P_MAX], double *rmse, int *status) {
+	lm_fit_batch(b, 7, max_iter, xtol, gtol, x, var, rmse, status);
+}
+
+static void lm_fit_batch_moffat(const struct psf_solver_batch *b, const int *max_iter, double xtol, double gtol,
+		double (*x)[P_MAX], double (*var)[P_MAX], double *rmse, int *status) {
+	lm_fit_batch(b, 8, max_iter, xtol, gtol, x, var, rmse, status);
+}
+
+/* Fits b->nb_lanes boxes at once, see psf_solver_fit() for the arguments,
+ * which are given per lane here. The pixel values and weights are stored
+ * pixel first: y[k * PSF_SOLVER_LANES + lane] */
+void psf_solver_fit_batch(const struct psf_solver_batch *b, starprofile profile, const int *max_iter,
+		double xtol, double gtol, double (*x)[PSF_SOLVER_MAX_PARAMS], double (*var)[PSF_SOLVER_MAX_PARAMS],
+		double *rmse, int *status) {
+	if (profile == PSF_GAUSSIAN)
+		lm_fit_batch_gaussian(b, max_iter, xtol, gtol, x, var, rmse, status);
+	else lm_fit_batch_moffat(b, max_iter, xtol, gtol, x, var, rmse, status);
+}
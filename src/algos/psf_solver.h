@@ -0,0 +1,35 @@
+#ifndef _PSF_SOLVER_H_
+#define _PSF_SOLVER_H_
+
+#include "core/siril.h"
+
+#define PSF_SOLVER_MAX_PARAMS 8
+
+/* the unmasked pixels of a PSF fitting box: values and coordinates of the
+ * pixel centres in the box */
+struct psf_solver_data {
+	size_t n;
+	const double *y;
+	const double *px;
+	const double *py;
+};
+
+/* boxes of the same size fitted together, one per lane */
+#define PSF_SOLVER_LANES 8
+
+struct psf_solver_batch {
+	int nb_lanes;		// number of boxes, up to PSF_SOLVER_LANES
+	size_t npix;		// number of pixels of a box
+	size_t ncols;		// width of the boxes
+	const double *y;	// pixel values, y[k * PSF_SOLVER_LANES + lane]
+	const double *w;	// same layout, 1 for fitted pixels and 0 for masked ones
+	const size_t *n;	// number of fitted pixels of each lane
+};
+
+int psf_solver_fit(const struct psf_solver_data *data, starprofile profile, int max_iter,
+		double xtol, double gtol, double *x, double *var, double *rmse);
+void psf_solver_fit_batch(const struct psf_solver_batch *b, starprofile profile, const int *max_iter,
+		double xtol, double gtol, double (*x)[PSF_SOLVER_MAX_PARAMS], double (*var)[PSF_SOLVER_MAX_PARAMS],
+		double *rmse, int *status);
+
+#endif /* _PSF_SOLVER_H_ */
@@ -31,6 +31,8 @@
 #include "core/siril_log.h"
 #include "gui/utils.h"
 #include "gui/progress_and_log.h"
+#include "core/processing.h"
+#include "io/sequence.h"
 #include "algos/quality.h"
 
 static double QualityEstimate_ushort(fits *fit, int layer);
@@ -429,3 +431,66 @@ int FindCentre(fits *fit, float *x_avg, float *y_avg) {
 		return _FindCentre_Barycentre_float(fit, x1, y1, x2, y2, x_avg, y_avg);
 	}
 }
+
+/* ranking of the frames of a sequence with the quality estimate, without
+ * registering them */
+
+static int quality_prepare_hook(struct generic_seq_args *args) {
+	struct quality_data *q_args = (struct quality_data *) args->user;
+	check_or_allocate_regparam(args->seq, q_args->layer);
+	return 0;
+}
+
+static int quality_image_hook(struct generic_seq_args *args, int o, int i, fits *fit,
+		rectangle *_, int threads) {
+	struct quality_data *q_args = (struct quality_data *) args->user;
+	// the estimate is computed on the green pixels of CFA images
+	if (fit->naxes[2] == 1)
+		interpolate_nongreen(fit);
+	double quality = QualityEstimate(fit, q_args->layer);
+	if (quality < 0.0)
+		return 1;
+	args->seq->regparam[q_args->layer][i].quality = quality;
+	return 0;
+}
+
+static int quality_finalize_hook(struct generic_seq_args *args) {
+	struct quality_data *q_args = (struct quality_data *) args->user;
+	sequence *seq = args->seq;
+	if (!args->retval && seq->regparam[q_args->layer]) {
+		int best = -1, worst = -1;
+		for (int i = 0; i < seq->number; i++) {
+			if (!seq->imgparam[i].incl)
+				continue;
+			double quality = seq->regparam[q_args->layer][i].quality;
+			if (quality <= 0.0)
+				continue;
+			if (best < 0 || quality > seq->regparam[q_args->layer][best].quality)
+				best = i;
+			if (worst < 0 || quality < seq->regparam[q_args->layer][worst].quality)
+				worst = i;
+		}
+		if (best >= 0)
+			siril_log_message(_("Best frame: #%d, quality %g, worst frame: #%d, quality %g\n"),
+					best + 1, seq->regparam[q_args->layer][best].quality,
+					worst + 1, seq->regparam[q_args->layer][worst].quality);
+		writeseqfile(seq);
+	}
+	free(q_args);
+	return 0;
+}
+
+void apply_quality_to_sequence(struct quality_data *q_args) {
+	struct generic_seq_args *args = create_default_seqargs(q_args->seq);
+	args->filtering_criterion = seq_filter_included;
+	args->nb_filtered_images = q_args->seq->selnum;
+	args->prepare_hook = quality_prepare_hook;
+	args->finalize_hook = quality_finalize_hook;
+	args->image_hook = quality_image_hook;
+	args->description = _("Frame quality");
+	args->has_output = FALSE;
+	args->new_seq_prefix = NULL;
+	args->user = q_args;
+
+	start_in_new_thread(generic_sequence_worker, args);
+}
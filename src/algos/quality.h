@@ -33,10 +33,19 @@
 
 #undef DEBUG
 
+struct quality_data {
+	sequence *seq;
+	int layer;
+};
+
 double QualityEstimate(fits *fit, int layer);
 int FindCentre(fits *fit, float *x_avg, float *y_avg);
 
 // from quality_float.c
 double QualityEstimate_float(fits *fit, int layer);
 
+/* computes the quality of the selected images of a sequence in a
+ * background worker, stored in the registration data of the layer */
+void apply_quality_to_sequence(struct quality_data *args);
+
 #endif /* SRC_QUALITY_H_ */
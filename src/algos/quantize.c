@@ -48,10 +48,10 @@ static int FnMeanSigma_float(float *array, long npix, int nullcheck,
 static int FnMeanSigma_int(int *array, long npix, int nullcheck, int nullvalue,
 		long *ngoodpix, double *mean, double *sigma, int *status);
 
-static int FnNoise1_ushort(WORD *array, long nx, long ny, int nullcheck,
+static int FnNoise1_ushort(WORD *array, long nx, long ny, long row_step, int nullcheck,
 		WORD nullvalue, double *noise, threading_type threads, int *status);
 
-static int FnNoise1_float(float *array, long nx, long ny, int nullcheck,
+static int FnNoise1_float(float *array, long nx, long ny, long row_step, int nullcheck,
 		float nullvalue, double *noise, threading_type threads, int *status);
 
 
@@ -110,7 +110,7 @@ int *status) /* error status */
 	}
 
 	if (noise1) {
-		FnNoise1_ushort(array, nx, ny, nullcheck, nullvalue, &xnoise, threads, status);
+		FnNoise1_ushort(array, nx, ny, 1, nullcheck, nullvalue, &xnoise, threads, status);
 
 		*noise1 = xnoise;
 	}
@@ -180,7 +180,7 @@ int *status) /* error status */
 	}
 
 	if (noise1) {
-		FnNoise1_float(array, nx, ny, nullcheck, nullvalue, &xnoise, threads, status);
+		FnNoise1_float(array, nx, ny, 1, nullcheck, nullvalue, &xnoise, threads, status);
 
 		*noise1 = xnoise;
 	}
@@ -205,6 +205,21 @@ int *status) /* error status */
 	return (*status);
 }
 
+/*--------------------------------------------------------------------------*/
+/* Fast estimates of the 1st order noise, from one row out of row_step. The
+ * noise is the median of the estimates of the rows, the estimate of a subset
+ * of evenly spaced rows only differs from it by the sampling error of that
+ * median. */
+int siril_fits_img_noise1_ushort(WORD *array, long nx, long ny, long row_step,
+		int nullcheck, WORD nullvalue, double *noise1, threading_type threads, int *status) {
+	return FnNoise1_ushort(array, nx, ny, max(row_step, 1), nullcheck, nullvalue, noise1, threads, status);
+}
+
+int siril_fits_img_noise1_float(float *array, long nx, long ny, long row_step,
+		int nullcheck, float nullvalue, double *noise1, threading_type threads, int *status) {
+	return FnNoise1_float(array, nx, ny, max(row_step, 1), nullcheck, nullvalue, noise1, threads, status);
+}
+
 /*--------------------------------------------------------------------------*/
 static int FnMeanSigma_ushort(WORD *array, /*  2 dimensional array of image pixels */
 long npix, /* number of pixels in the image */
@@ -1207,6 +1222,7 @@ int *status) /* error status */
 static int FnNoise1_ushort(WORD *array, /*  2 dimensional array of image pixels */
 long nx, /* number of pixels in each row of the image */
 long ny, /* number of rows in the image */
+long row_step, /* only one row out of row_step is used, 1 for all */
 int nullcheck, /* check for null values, if true */
 WORD nullvalue, /* value of null pixels, if nullcheck is true */
 /* returned parameters */
@@ -1257,7 +1273,7 @@ int *status) /* error status */
 #ifdef _OPENMP
 #pragma omp for schedule(static)
 #endif
-			for (jj = 0; jj < ny; jj++) {
+			for (jj = 0; jj < ny; jj += row_step) {
 				long ii, kk, nvals;
 				rowpix = array + (jj * nx); /* point to first pixel in the row */
 				int iter;
@@ -1351,6 +1367,7 @@ int *status) /* error status */
 static int FnNoise1_float(float *array, /*  2 dimensional array of image pixels */
 long nx, /* number of pixels in each row of the image */
 long ny, /* number of rows in the image */
+long row_step, /* only one row out of row_step is used, 1 for all */
 int nullcheck, /* check for null values, if true */
 float nullvalue, /* value of null pixels, if nullcheck is true */
 /* returned parameters */
@@ -1407,7 +1424,7 @@ row of the image.
 #ifdef _OPENMP
 #pragma omp for schedule(static)
 #endif
-		for (jj = 0; jj < ny; jj++) {
+		for (jj = 0; jj < ny; jj += row_step) {
 			long ii, kk, nvals;
 			rowpix = array + (jj * nx); /* point to first pixel in the row */
 			int iter;
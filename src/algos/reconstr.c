@@ -145,11 +145,14 @@ int reget_rawdata(float *Imag, int Nl, int Nc, WORD *buf) {
 
 int wavelet_reconstruct_file(char *File_Name_Transform, float *coef, WORD *data) {
 	float *Imag;
-	wave_transf_des Wavelet;
+	wave_transf_des Wavelet, *stored;
 	int Nl, Nc;
 
-	/* read the wavelet file */
-	if (wave_io_read(File_Name_Transform, &Wavelet))
+	/* use the transform kept in memory or read the wavelet file */
+	stored = wave_io_lookup(File_Name_Transform);
+	if (stored)
+		Wavelet = *stored;
+	else if (wave_io_read(File_Name_Transform, &Wavelet))
 		return 1;
 
 	Nl = Wavelet.Nbr_Ligne;
@@ -172,16 +175,20 @@ int wavelet_reconstruct_file(char *File_Name_Transform, float *coef, WORD *data)
 	/* get and view result */
 	reget_rawdata(Imag, Nl, Nc, data);
 
-	wave_io_free(&Wavelet);
+	if (!stored)
+		wave_io_free(&Wavelet);
 	free(Imag);
 	return 0;
 }
 
 int wavelet_reconstruct_file_float(char *File_Name_Transform, float *coef, float *data) {
-	wave_transf_des Wavelet;
+	wave_transf_des Wavelet, *stored;
 
-	/* read the wavelet file */
-	if (wave_io_read(File_Name_Transform, &Wavelet))
+	/* use the transform kept in memory or read the wavelet file */
+	stored = wave_io_lookup(File_Name_Transform);
+	if (stored)
+		Wavelet = *stored;
+	else if (wave_io_read(File_Name_Transform, &Wavelet))
 		return 1;
 
 	// Sanity check before using values read from file
@@ -196,7 +203,8 @@ int wavelet_reconstruct_file_float(char *File_Name_Transform, float *coef, float
 
 	wavelet_reconstruct_data(&Wavelet, data, coef);
 
-	wave_io_free(&Wavelet);
+	if (!stored)
+		wave_io_free(&Wavelet);
 	return 0;
 }
 
@@ -25,6 +25,7 @@
 #include "core/processing.h"
 #include "core/siril_networking.h"
 #include "io/annotation_catalogues.h"
+#include "io/ephemeris_cache.h"
 #include "algos/PSF.h"
 #include "algos/siril_wcs.h"
 #include "algos/astrometry_solver.h"
@@ -38,6 +39,8 @@
  * for QUERY_SERVER_EPHEMCC and QUERY_SERVER_SIMBAD_PHOTO) and stores the
  * result in the local annotation catalogues and returns it in the argument if
  * non-NULL */
+static int report_found_item(sky_object_query_args *args, siril_cat_index target_cat, gboolean check_for_duplicates);
+
 int parse_catalog_buffer(const gchar *buffer, sky_object_query_args *args) {
 	gchar **token, *objname = NULL, *objtype = NULL;
 	int nargs;
@@ -213,28 +216,59 @@ int parse_catalog_buffer(const gchar *buffer, sky_object_query_args *args) {
 	}
 	g_strfreev(token);
 
-	if (!args->retval && args->item) {
-		gchar *alpha = siril_world_cs_alpha_format_from_double(args->item->ra, " %02dh%02dm%04.1lfs");
-		gchar *delta = siril_world_cs_delta_format_from_double(args->item->dec, "%c%02d°%02d\'%04.1lf\"");
-		GString *msg = g_string_new("");
-		g_string_append_printf(msg, _("Found %s"), args->item->name);
-		if (args->item->alias)
-			g_string_append_printf(msg, _(" (aka %s)"), args->item->alias);
-		g_string_append_printf(msg, _(" at coordinates: %s, %s\n"), alpha, delta);
-		gchar *printout = g_string_free(msg, FALSE);
-		siril_log_message(printout);
-		g_free(printout);
-		g_free(alpha);
-		g_free(delta);
-		if (target_cat != CAT_UNDEF) {
-			add_item_in_catalogue(args->item, target_cat, check_for_duplicates);
-			set_annotation_visibility(target_cat, TRUE);	// and display it
-		}
-		return 0;
-	}
+	if (!args->retval && args->item)
+		return report_found_item(args, target_cat, check_for_duplicates);
 	return 1;
 }
 
+/* logs the object found and stores it in the local annotation catalogue */
+static int report_found_item(sky_object_query_args *args, siril_cat_index target_cat, gboolean check_for_duplicates) {
+	gchar *alpha = siril_world_cs_alpha_format_from_double(args->item->ra, " %02dh%02dm%04.1lfs");
+	gchar *delta = siril_world_cs_delta_format_from_double(args->item->dec, "%c%02d°%02d\'%04.1lf\"");
+	GString *msg = g_string_new("");
+	g_string_append_printf(msg, _("Found %s"), args->item->name);
+	if (args->item->alias)
+		g_string_append_printf(msg, _(" (aka %s)"), args->item->alias);
+	g_string_append_printf(msg, _(" at coordinates: %s, %s\n"), alpha, delta);
+	gchar *printout = g_string_free(msg, FALSE);
+	siril_log_message(printout);
+	g_free(printout);
+	g_free(alpha);
+	g_free(delta);
+	if (target_cat != CAT_UNDEF) {
+		add_item_in_catalogue(args->item, target_cat, check_for_duplicates);
+		set_annotation_visibility(target_cat, TRUE);	// and display it
+	}
+	return 0;
+}
+
+// returns a string describing the site coordinates on Earth in a format suited for queries
+static gchar *retrieve_site_coord(fits *fit) {
+	if (fit->keywords.sitelat < -90.0 || fit->keywords.sitelong < 0.0)
+		return g_strdup("@500");
+	double elev = (fit->keywords.siteelev < DEFAULT_DOUBLE_VALUE + 1.) ? 0. : fit->keywords.siteelev;
+	return g_strdup_printf("%+f,%+f,%f", fit->keywords.sitelat, fit->keywords.sitelong, elev);
+}
+
+/* position interpolated from the series of positions of the object around
+ * the date of the image, fetched once for all the images of the session */
+static cat_item *search_in_ephemerides(sky_object_query_args *args) {
+	if (!args->fit->keywords.date_obs)
+		return NULL;
+	gchar *site = retrieve_site_coord(args->fit);
+	double jd = date_time_to_Julian(args->fit->keywords.date_obs);
+	args->item = ephemeris_cache_lookup(args->prefix, args->name, site, jd);
+	g_free(site);
+	if (!args->item)
+		return NULL;
+	args->item->alias = g_strdup(args->name); // we store the name that was queried
+	args->item->sitelon = args->fit->keywords.sitelong;
+	args->item->sitelat = args->fit->keywords.sitelat;
+	args->item->siteelev = args->fit->keywords.siteelev;
+	report_found_item(args, CAT_AN_USER_SSO, TRUE);
+	return args->item;
+}
+
 /* this should be the new entry point for single object search from their name */
 int cached_object_lookup(sky_object_query_args *args) {
 	gboolean solarsystem = args->prefix != NULL;
@@ -256,6 +290,8 @@ int cached_object_lookup(sky_object_query_args *args) {
 		}
 	} else {
 		args->item = search_in_solar_annotations(args);
+		if (!args->item)
+			args->item = search_in_ephemerides(args);
 	}
 	if (!args->item) {
 		gchar *result = search_in_online_catalogs(args);
@@ -404,16 +440,6 @@ gboolean has_nonzero_coords() {
 	return FALSE;
 }
 
-// returns a string describing the site coordinates on Earth in a format suited for queries
-#ifdef HAVE_LIBCURL
-static gchar *retrieve_site_coord(fits *fit) {
-	if (fit->keywords.sitelat < -90.0 || fit->keywords.sitelong < 0.0)
-		return g_strdup("@500");
-	double elev = (fit->keywords.siteelev < DEFAULT_DOUBLE_VALUE + 1.) ? 0. : fit->keywords.siteelev;
-	return g_strdup_printf("%+f,%+f,%f", fit->keywords.sitelat, fit->keywords.sitelong, elev);
-}
-#endif
-
 // free the result with free
 char *search_in_online_catalogs(sky_object_query_args *args) {
 #ifndef HAVE_LIBCURL
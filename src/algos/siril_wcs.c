@@ -230,6 +230,87 @@ int wcs2pix(fits *fit, double ra, double dec, double *x, double *y) {
 	return status;
 }
 
+/* below this number of points, the projection is done in a single call */
+#define WCS_BATCH_CHUNK 4096
+
+/* TAN projections without distortion are half of the solutions we get, and
+ * the inverse gnomonic projection is short enough to be done directly, which
+ * avoids the generic path of wcslib for the large catalogues */
+static gboolean wcs_is_plain_tan(const wcsprm_t *wcs) {
+	if (wcs->flag != WCSSET || wcs->naxis != 2 || wcs->lng != 0 || wcs->lat != 1)
+		return FALSE;
+	if (strcmp(wcs->ctype[0], "RA---TAN") || strcmp(wcs->ctype[1], "DEC--TAN"))
+		return FALSE;
+	for (int i = 0; i < 2; i++) {
+		if (wcs->cunit[i][0] != '\0' && strcmp(wcs->cunit[i], "deg"))
+			return FALSE;
+	}
+	return wcs->lin.dispre == NULL && wcs->lin.disseq == NULL
+		&& wcs->cel.offset == 0 && wcs->cel.ref[2] == 180.0;
+}
+
+static void wcss2p_tan(const wcsprm_t *wcs, int n, const double *world, double *pixcrd, int *status) {
+	const double a0 = wcs->crval[0] * DEGTORAD, d0 = wcs->crval[1] * DEGTORAD;
+	const double sind0 = sin(d0), cosd0 = cos(d0);
+	const double *m = wcs->lin.imgpix;
+	const double crpix0 = wcs->crpix[0], crpix1 = wcs->crpix[1];
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(com.max_thread) schedule(static) if (n >= 2 * WCS_BATCH_CHUNK)
+#endif
+	for (int i = 0; i < n; i++) {
+		double da = world[2 * i] * DEGTORAD - a0, d = world[2 * i + 1] * DEGTORAD;
+		double sind = sin(d), cosd = cos(d), cosda = cos(da);
+		double cosc = sind0 * sind + cosd0 * cosd * cosda;
+		if (cosc <= 0.0) {
+			// on the other hemisphere, wcslib also rejects them
+			status[i] = 1;
+			continue;
+		}
+		double xi = cosd * sin(da) / cosc * RADTODEG;
+		double eta = (cosd0 * sind - sind0 * cosd * cosda) / cosc * RADTODEG;
+		pixcrd[2 * i] = m[0] * xi + m[1] * eta + crpix0;
+		pixcrd[2 * i + 1] = m[2] * xi + m[3] * eta + crpix1;
+		status[i] = 0;
+	}
+}
+
+/* wcss2p modifies the wcsprm it is given, so each thread projects its chunks
+ * with its own copy */
+static int wcss2p_chunked(wcsprm_t *wcs, int n, const double *world, double *phi, double *theta,
+		double *intcrd, double *pixcrd, int *status) {
+	int nchunks = (n + WCS_BATCH_CHUNK - 1) / WCS_BATCH_CHUNK;
+	int retval = WCSERR_SUCCESS;
+#ifdef _OPENMP
+	if (nchunks > 1 && com.max_thread > 1) {
+#pragma omp parallel num_threads(com.max_thread)
+		{
+			wcsprm_t *copy = wcs_deepcopy(wcs, NULL);
+#pragma omp for schedule(dynamic)
+			for (int k = 0; k < nchunks; k++) {
+				int start = k * WCS_BATCH_CHUNK;
+				int nb = min(WCS_BATCH_CHUNK, n - start);
+				int chunkstatus;
+				if (copy)
+					chunkstatus = wcss2p(copy, nb, 2, world + 2 * start, phi + start, theta + start,
+							intcrd + 2 * start, pixcrd + 2 * start, status + start);
+				else chunkstatus = WCSERR_MEMORY;
+				if (chunkstatus != WCSERR_SUCCESS) {
+#pragma omp critical
+					{
+						if (retval == WCSERR_SUCCESS || retval == WCSERR_BAD_WORLD)
+							retval = chunkstatus;
+					}
+				}
+			}
+			if (copy && !wcsfree(copy))
+				free(copy);
+		}
+		return retval;
+	}
+#endif
+	return wcss2p(wcs, n, 2, world, phi, theta, intcrd, pixcrd, status);
+}
+
 // same as wcs2pix except it takes a world array as input
 // world is an array with [ra1, dec1, ra2, dec2...ran, decn], i.e 2n elements (row major)
 // it returns an allocated array of statuses (instead of a single status), which must be freed
@@ -242,19 +323,41 @@ int *wcs2pix_array(fits *fit, int n, double *world, double *x, double *y) {
 		for (int i = 0; i < n; i++)
 			y[i] = -1.0;
 	}
-	// can't pass NULL to the values we don't want to retrieve (intcrd, phi, theta)
-	double *intcrd = malloc((2 * n) * sizeof(double));
 	double *pixcrd = malloc((2 * n) * sizeof(double));
-	double *phi = malloc(n * sizeof(double));
-	double *theta = malloc(n * sizeof(double));
-	int c = 0;
 	int *status = calloc((unsigned)n , sizeof(int));
-	int globstatus = wcss2p(fit->keywords.wcslib, n, 2, world, phi, theta, intcrd, pixcrd, status);
+	if (!pixcrd || !status) {
+		PRINT_ALLOC_ERR;
+		free(pixcrd);
+		free(status);
+		return NULL;
+	}
+	wcsprm_t *wcs = fit->keywords.wcslib;
+	if (wcs->flag != WCSSET)
+		wcsset(wcs);
+	int globstatus;
+	if (wcs_is_plain_tan(wcs)) {
+		wcss2p_tan(wcs, n, world, pixcrd, status);
+		globstatus = WCSERR_SUCCESS;
+	} else {
+		// can't pass NULL to the values we don't want to retrieve (intcrd, phi, theta)
+		double *intcrd = malloc((2 * n) * sizeof(double));
+		double *phi = malloc(n * sizeof(double));
+		double *theta = malloc(n * sizeof(double));
+		if (intcrd && phi && theta)
+			globstatus = wcss2p_chunked(wcs, n, world, phi, theta, intcrd, pixcrd, status);
+		else {
+			PRINT_ALLOC_ERR;
+			globstatus = WCSERR_MEMORY;
+		}
+		free(intcrd);
+		free(phi);
+		free(theta);
+	}
 	if (globstatus == WCSERR_SUCCESS || globstatus == WCSERR_BAD_WORLD) {// we accept BAD_WORLD as it does not mean all of the conversions failed
 		for (int i = 0; i < n; i++) {
 			if (!status[i]) {
-				double xx = pixcrd[c++];
-				double yy = pixcrd[c++];
+				double xx = pixcrd[2 * i];
+				double yy = pixcrd[2 * i + 1];
 				// return values even if outside (required for celestial grid display)
 				// In WCS convention, origin of the grid is at (-0.5, -0.5) wrt siril grid
 				if (x) x[i] = xx - 0.5;
@@ -264,18 +367,13 @@ int *wcs2pix_array(fits *fit, int n, double *world, double *x, double *y) {
 					// wcss2p returns values between 0 and 9, picking a new one
 					status[i] = 10;
 				}
-			} else {
-				c += 2;
 			}
 		}
 	} else {
 		free(status);
 		status = NULL;
 	}
-	free(intcrd);
 	free(pixcrd);
-	free(phi);
-	free(theta);
 	return status;
 }
 
@@ -565,6 +565,88 @@ void sortnet (WORD *a, size_t n) {
 }
 #undef sw
 
+/*
+ * Median network for several arrays at once
+ * The comparators of Batcher's odd-even merge sort are generated for n values,
+ * then pruned backwards to keep only those on which the middle element(s)
+ * depend.
+ * @param n size of the arrays [1, SORTNET_MEDIAN_MAX]
+ * @param pairs output comparators, SORTNET_MEDIAN_MAX_PAIRS allocated
+ * @return the number of comparators, or -1 if n is not supported
+ */
+int sortnet_median_pairs(int n, sortnet_pair *pairs) {
+	if (n < 1 || n > SORTNET_MEDIAN_MAX)
+		return -1;
+	int nb = 0;
+	for (int p = 1; p < n; p <<= 1) {
+		for (int k = p; k >= 1; k >>= 1) {
+			for (int j = k % p; j + k < n; j += 2 * k) {
+				for (int i = 0; i < k && i + j + k < n; i++) {
+					if ((i + j) / (2 * p) == (i + j + k) / (2 * p)) {
+						if (nb == SORTNET_MEDIAN_MAX_PAIRS)
+							return -1;
+						pairs[nb].i = i + j;
+						pairs[nb].j = i + j + k;
+						nb++;
+					}
+				}
+			}
+		}
+	}
+
+	/* pruning: a comparator is useful if one of its outputs is needed */
+	gboolean needed[SORTNET_MEDIAN_MAX] = { FALSE };
+	needed[n / 2] = TRUE;
+	if (n % 2 == 0)
+		needed[n / 2 - 1] = TRUE;
+	int kept = nb;
+	for (int c = nb - 1; c >= 0; c--) {
+		if (needed[pairs[c].i] || needed[pairs[c].j]) {
+			needed[pairs[c].i] = needed[pairs[c].j] = TRUE;
+			pairs[--kept] = pairs[c];
+		}
+	}
+	memmove(pairs, pairs + kept, (nb - kept) * sizeof(sortnet_pair));
+	return nb - kept;
+}
+
+/*
+ * Medians of lanes arrays of size n, stored interleaved: a[index * lanes + lane].
+ * The network is branch-free and applied to all lanes in the same loop, which
+ * is vectorised by the compiler.
+ * @param a arrays (warning: partially sorted in place)
+ * @param n size of each array
+ * @param lanes number of arrays
+ * @param pairs, nb_pairs the network from sortnet_median_pairs() for n
+ * @param medians output, lanes medians, the middle two elements are averaged
+ * for even sizes
+ */
+void sortnet_median_batch_float(float *a, int n, int lanes, const sortnet_pair *pairs,
+		int nb_pairs, double *medians) {
+	for (int c = 0; c < nb_pairs; c++) {
+		float *ai = a + pairs[c].i * lanes;
+		float *aj = a + pairs[c].j * lanes;
+#ifdef _OPENMP
+#pragma omp simd
+#endif
+		for (int l = 0; l < lanes; l++) {
+			float lo = aj[l] < ai[l] ? aj[l] : ai[l];
+			float hi = ai[l] < aj[l] ? aj[l] : ai[l];
+			ai[l] = lo;
+			aj[l] = hi;
+		}
+	}
+	const float *mid = a + (n / 2) * lanes;
+	if (n % 2 == 0) {
+		const float *mid1 = mid - lanes;
+		for (int l = 0; l < lanes; l++)
+			medians[l] = ((double) mid1[l] + mid[l]) / 2.0;
+	} else {
+		for (int l = 0; l < lanes; l++)
+			medians[l] = mid[l];
+	}
+}
+
 /*
  * Histogram median for very large array of unsigned short
  * (C) Emmanuel Brandt 2019-02
@@ -24,6 +24,16 @@ double sortnet_median_double(double *a, size_t n);
 double sortnet_median_float(float *a, size_t n);
 void sortnet(WORD *a, size_t n);
 
+/* Sorting network computing the medians of several small arrays at once */
+#define SORTNET_MEDIAN_MAX 64
+#define SORTNET_MEDIAN_MAX_PAIRS 1024
+typedef struct {
+	guint8 i, j;
+} sortnet_pair;
+int sortnet_median_pairs(int n, sortnet_pair *pairs);
+void sortnet_median_batch_float(float *a, int n, int lanes, const sortnet_pair *pairs,
+		int nb_pairs, double *medians);
+
 gint strcompare(gconstpointer *a, gconstpointer *b);
 
 #endif
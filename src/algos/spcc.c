@@ -258,6 +258,36 @@ double integrate_xpsampled(const xpsampled *xps, const double minwl, const doubl
 	return result;
 }
 
+/* Fills w with the response multiplied by the quadrature weights of the
+ * integral over [minwl, maxwl] of the linear interpolation of the samples.
+ * The integral of the product of the response with any spectrum is then the
+ * dot product of w with the spectrum, which is how the catalogue fluxes of the
+ * stars are computed once the instrument response is known. */
+void xpsampled_weighted_response(double *w, const xpsampled *response, const double minwl, const double maxwl) {
+	const double *x = response->x;
+	for (int i = 0 ; i < XPSAMPLED_LEN ; i++)
+		w[i] = 0.0;
+	for (int i = 0 ; i < XPSAMPLED_LEN - 1 ; i++) {
+		double l = max(minwl, x[i]), r = min(maxwl, x[i + 1]);
+		if (r <= l)
+			continue;
+		double h = x[i + 1] - x[i];
+		double ul = (l - x[i]) / h, ur = (r - x[i]) / h;
+		double second = h * (ur * ur - ul * ul) * 0.5;
+		w[i] += h * (ur - ul) - second;
+		w[i + 1] += second;
+	}
+	for (int i = 0 ; i < XPSAMPLED_LEN ; i++)
+		w[i] *= response->y[i];
+}
+
+double xpsampled_dot(const double *w, const xpsampled *xps) {
+	double sum = 0.0;
+	for (int i = 0 ; i < XPSAMPLED_LEN ; i++)
+		sum += w[i] * xps->y[i];
+	return sum;
+}
+
 double xpsampled_wl_weighted_sum(xpsampled *a) {
 	xpsampled b = init_xpsampled();
 	for (int i = 0 ; i < XPSAMPLED_LEN ; i++) {
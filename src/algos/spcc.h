@@ -16,6 +16,8 @@ void multiply_xpsampled(xpsampled *result, const xpsampled *a, const xpsampled *
 void multiply_xpsampled_scalar(xpsampled *a, const float b);
 double integrate_xpsampled(const xpsampled *xps, const double minimum, const double maximum);
 double xpsampled_wl_weighted_sum(xpsampled *a);
+void xpsampled_weighted_response(double *w, const xpsampled *response, const double minwl, const double maxwl);
+double xpsampled_dot(const double *w, const xpsampled *xps);
 void flux_to_relcount(xpsampled *xps);
 gpointer spectrophotometric_cc_standalone(gpointer p);
 cmsCIExyY xpsampled_to_xyY(xpsampled* xps, const cmf_pref cmf, const double minwl, const double maxwl);
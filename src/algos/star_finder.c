@@ -30,8 +30,11 @@
 
 #include "core/siril.h"
 #include "core/proto.h"
+#include "core/processing.h"
 #include "core/siril_log.h"
 #include "algos/PSF.h"
+#include "algos/psf_solver.h"
+#include "algos/geometry.h"
 #include "algos/star_finder.h"
 #include "algos/statistics.h"
 #include "algos/sorting.h"
@@ -53,6 +56,9 @@
 #define SAT_DETECTION_RANGE 0.1 // fraction of the dynamic range (frame max - bg) below local max value above which the 8 adjacent pixels must remain to consider we have a saturation plateau
 #define MAX_BOX_RADIUS 200 // max allowable value for R (the radius of the box that is passed to PSF fitting)
 #define MAX_RADIUS_RATIO_DUP 0.2 // The fraction of the box radius to classify as a duplicate
+#define MIN_BINNED_RADIUS 3 // min radius of the search box when detecting on a binned image
+#define TRACKING_MIN_STARS 10 // min number of stars kept by tracking, full detection otherwise
+#define TRACKING_MIN_KEPT 0.7 // min fraction of the previous stars kept by tracking
 
 // Use this flag to print canditates rejection output (0 or 1, only works if SIRIL_OUTPUT_DEBUG is on)
 #define DEBUG_STAR_DETECTION 0
@@ -137,139 +143,97 @@ static int star_cmp_by_mag_est(const void *a, const void *b) {
 	return 0;
 }
 
-// Finds if the point xx,yy is already listed in the candidates within matchradius
-// The list is crawled in reverse order to return TRUE faster
-// When the next candidate is further away (along y axis) than the current box radius, the search breaks and returns FALSE
-static gboolean candidate_is_duplicate(int xx, int yy, int boxradius, starc *candidates, int nbstars) {
-	int matchradius = (int)((double)boxradius * MAX_RADIUS_RATIO_DUP);
-	matchradius = max(matchradius, 1); // just in case we find zero
-					   // we go though the list in reverse order as we may break out faster
-	for (int i = nbstars - 1; i >= 0; i--) {
-		if (abs(xx - candidates[i].x) + abs(yy - candidates[i].y) <= matchradius)
-			return TRUE;
-		if (yy - candidates[i].y > boxradius) // if yy is further away than the box radius, we won't find a duplicate anymore
-			break;
-	}
-	return FALSE;
+#define PEAKER_MIN_BAND_ROWS 64	// minimum height of the bands of rows searched in parallel
+#define DUP_GRID_CELL 16	// size of the cells of the grid used to find duplicates
+
+/* grid of buckets of the candidates, by position, to find duplicates */
+struct candidate_grid {
+	int ncx, ncy;
+	int *head;	// first candidate of each cell, -1 if none
+	int *next;	// next candidate of the same cell, -1 if none
+};
+
+static int candidate_grid_init(struct candidate_grid *grid, int nx, int ny) {
+	grid->ncx = nx / DUP_GRID_CELL + 1;
+	grid->ncy = ny / DUP_GRID_CELL + 1;
+	grid->head = malloc((size_t)grid->ncx * grid->ncy * sizeof(int));
+	grid->next = malloc(MAX_STARS * sizeof(int));
+	if (!grid->head || !grid->next)
+		return 1;
+	for (size_t i = 0; i < (size_t)grid->ncx * grid->ncy; i++)
+		grid->head[i] = -1;
+	return 0;
 }
 
-/* peaker is the function that searches for stars in an image.
- * It is based on two old implementations that have been refined here over time:
- * 1. Copyleft (L) 1998 Kenneth J. Mighell (Kitt Peak National Observatory)
- * 2. DAOFIND by Peter Stetson, 1987.
- * This is a peak detector on a smoother image (now using Gaussian blur) which
- * identifies any pixel greater than its eight neighbors. The candidates are
- * then checked for consistency before being fitted to Gaussian or Moffat star
- * profiles (PSF).
- */
-
-static int minimize_candidates(fits *image, star_finder_params *sf, starc *candidates, int nb_candidates, int layer, double dynrange, psf_star ***retval, gboolean limit_nbstars, int maxstars, starprofile profile, int threads);
-
-psf_star **peaker(image *image, int layer, star_finder_params *sf, int *nb_stars, rectangle *area, gboolean showtime, gboolean limit_nbstars, int maxstars, starprofile profile, int threads) {
-	int nx = image->fit->rx;
-	int ny = image->fit->ry;
-	int areaX0 = 0;
-	int areaY0 = 0;
-	int areaX1 = nx;
-	int areaY1 = ny;
-	int nbstars = 0;
-	double bg, bgnoise, maxi;
-	float threshold, norm;
-	float **smooth_image;
-	fits smooth_fit = { 0 };
-	starc *candidates;
-	struct timeval t_start, t_end;
-	WORD **image_ushort = NULL;
-	float **image_float = NULL;
-
-	assert(nx > 0 && ny > 0);
-	gboolean ismono = (image->fit->naxes[2] == 1);
-
-	if (showtime) {
-		siril_log_color_message(_("Findstar: processing for channel %d...\n"), "green", layer);
-		gettimeofday(&t_start, NULL);
-	}
-	else siril_log_message(_("Findstar: processing for channel %d...\n"), layer);
-
-	/* running statistics on the input image is best as it caches them */
-	threshold = compute_threshold(image, sf->sigma * 5.0, layer, area, &norm, &bg, &bgnoise, &maxi, threads);
-	if (norm == 0.0f)
-		return NULL;
-
-	siril_debug_print("Threshold: %f (background level: %f, noise: %f, norm: %f)\n", threshold, bg, bgnoise, norm);
-
-	/* Applying a Gaussian filter to select candidates */
-	if (extract_fits(image->fit, &smooth_fit, layer, TRUE)) {
-		siril_log_color_message(_("Failed to copy the image for processing\n"), "red");
-		return NULL;
-	}
-
-	//if (cvUnsharpFilter(&smooth_fit, 3, 0)) {
-	if (gaussian_blur_RT(&smooth_fit, KERNEL_SIZE, threads)) {
-		siril_log_color_message(_("Could not apply Gaussian filter, aborting\n"), "red");
-		clearfits(&smooth_fit);
-		return NULL;
-	}
+static void candidate_grid_free(struct candidate_grid *grid) {
+	free(grid->head);
+	free(grid->next);
+}
 
-	/* Build 2D representation of smoothed image upside-down */
-	smooth_image = malloc(ny * sizeof(float *));
-	if (!smooth_image) {
-		PRINT_ALLOC_ERR;
-		clearfits(&smooth_fit);
-		return NULL;
-	}
-	for (int k = 0; k < ny; k++) {
-		smooth_image[ny - k - 1] = smooth_fit.fdata + k * nx;
-	}
+static inline int grid_cell(int v, int ncells) {
+	int c = v / DUP_GRID_CELL;
+	return c < 0 ? 0 : (c >= ncells ? ncells - 1 : c);
+}
 
-	if (area && area->w != 0 && area->h != 0) {
-		areaX0 = area->x;
-		areaY0 = area->y;
-		areaX1 = area->w + areaX0;
-		areaY1 = area->h + areaY0;
+static void candidate_grid_add(struct candidate_grid *grid, starc *candidates, int index) {
+	int cell = grid_cell(candidates[index].y, grid->ncy) * grid->ncx + grid_cell(candidates[index].x, grid->ncx);
+	grid->next[index] = grid->head[cell];
+	grid->head[cell] = index;
+}
 
-		if (areaX1 > nx || areaY1 > ny) {
-			siril_log_color_message(_("Selection is larger than image\n"), "red");
-			clearfits(&smooth_fit);
-			free(smooth_image);
-			return NULL;
+// Finds if the point xx,yy is already listed in the candidates within matchradius
+// Only the cells of the grid in reach of matchradius are searched
+static gboolean candidate_grid_is_duplicate(struct candidate_grid *grid, int xx, int yy, int boxradius, starc *candidates) {
+	int matchradius = (int)((double)boxradius * MAX_RADIUS_RATIO_DUP);
+	matchradius = max(matchradius, 1); // just in case we find zero
+	int cx0 = grid_cell(xx - matchradius, grid->ncx), cx1 = grid_cell(xx + matchradius, grid->ncx);
+	int cy0 = grid_cell(yy - matchradius, grid->ncy), cy1 = grid_cell(yy + matchradius, grid->ncy);
+	for (int cy = cy0; cy <= cy1; cy++) {
+		for (int cx = cx0; cx <= cx1; cx++) {
+			for (int i = grid->head[cy * grid->ncx + cx]; i >= 0; i = grid->next[i]) {
+				if (abs(xx - candidates[i].x) + abs(yy - candidates[i].y) <= matchradius)
+					return TRUE;
+			}
 		}
 	}
+	return FALSE;
+}
 
-	/* Build 2D representation of input image upside-down */
-	data_type itype = image->fit->type;
-	if (itype == DATA_USHORT) {
-		image_ushort = malloc(ny * sizeof(WORD *));
-		for (int k = 0; k < ny; k++)
-			image_ushort[ny - k - 1] = image->fit->pdata[layer] + k * nx;	}
-	else if (itype == DATA_FLOAT) {
-		image_float = malloc(ny * sizeof(float *));
-		for (int k = 0; k < ny; k++)
-			image_float[ny - k - 1] = image->fit->fpdata[layer] + k * nx;
-	}
-	else return 0;
-
-	candidates = malloc(MAX_STARS * sizeof(starc));
-	if (!candidates) {
-		free(image_ushort);
-		free(image_float);
-		clearfits(&smooth_fit);
-		free(smooth_image);
-		PRINT_ALLOC_ERR;
-		return NULL;
-	}
-
-	int r = sf->radius;
+/* parameters of the candidate search, shared by the bands of rows */
+struct peaker_scan {
+	float **smooth_image;
+	WORD **image_ushort;
+	float **image_float;
+	data_type itype;
+	gboolean ismono;
+	int nx, ny, r;
+	int areaX0, areaY0, areaX1, areaY1;
+	float threshold, norm;
+	double bg, locthreshold, minsatlevel, satrange, s_factor;
+};
+
+/* Searches for candidate stars in the rows [ystart, yend) of the filtered
+ * image. Candidates are returned in the scan order, duplicates are removed
+ * later. nb is set to -1 on allocation failure */
+static starc *scan_candidates(const struct peaker_scan *ps, int ystart, int yend, int *nb) {
+	float **smooth_image = ps->smooth_image;
+	WORD **image_ushort = ps->image_ushort;
+	float **image_float = ps->image_float;
+	data_type itype = ps->itype;
+	gboolean ismono = ps->ismono;
+	int nx = ps->nx, ny = ps->ny, r = ps->r;
+	int areaX0 = ps->areaX0, areaY0 = ps->areaY0, areaX1 = ps->areaX1, areaY1 = ps->areaY1;
+	float threshold = ps->threshold, norm = ps->norm;
+	double bg = ps->bg, locthreshold = ps->locthreshold;
+	double minsatlevel = ps->minsatlevel, satrange = ps->satrange, s_factor = ps->s_factor;
 	int boxsize = (2 * r + 1)*(2 * r + 1);
-	double locthreshold = sf->sigma * 5.0 * bgnoise;
 	double sat = 0.;
-	double dynrange = (min(maxi, norm) - bg);
-	double minsatlevel = dynrange * SAT_THRESHOLD; // the level above background at which pixels are considered to have saturated or be close to saturation
-	double satrange = dynrange * SAT_DETECTION_RANGE; // the max variation level that defines the plateau of saturation
-	double s_factor = sqrt(-2. * log(DENSITY_THRESHOLD));
-	siril_debug_print("Min saturation level: %3.1f\n", minsatlevel);
-	/* Search for candidate stars in the filtered image */
-	for (int y = r + areaY0; y < areaY1 - r; y++) {
+	starc *candidates = NULL;
+	int nbstars = 0, alloc = 0;
+
+	for (int y = ystart; y < yend; y++) {
+		if (processing_cancelled())
+			break;
 		for (int x = r + areaX0; x < areaX1 - r; x++) {
 			float pixel = smooth_image[y][x];
 			float pixel0 = 0.f;
@@ -511,11 +475,17 @@ psf_star **peaker(image *image, int layer, star_finder_params *sf, int *nb_stars
 					if (dA > 2. || dSr > 2. || dSc > 2. || max(Ar,Ac) < locthreshold)
 						bingo = FALSE;
 
-				if (bingo && nbstars < MAX_STARS) {
-					if (nbstars > 0 && candidate_is_duplicate(xx, yy, R, candidates, nbstars)) {
-						if (DEBUG_STAR_DETECTION)
-							siril_debug_print("candidate is a duplicate\n");
-						continue; // avoid duplicates for large saturated stars
+				if (bingo) {
+					if (nbstars == alloc) {
+						alloc = alloc ? alloc * 2 : 256;
+						starc *tmp = realloc(candidates, alloc * sizeof(starc));
+						if (!tmp) {
+							PRINT_ALLOC_ERR;
+							free(candidates);
+							*nb = -1;
+							return NULL;
+						}
+						candidates = tmp;
 					}
 					candidates[nbstars].x = xx;
 					candidates[nbstars].y = yy;
@@ -536,12 +506,183 @@ psf_star **peaker(image *image, int layer, star_finder_params *sf, int *nb_stars
 		}
 		if (nbstars == MAX_STARS) break;
 	}
+	*nb = nbstars;
+	return candidates;
+}
+
+/* peaker is the function that searches for stars in an image.
+ * It is based on two old implementations that have been refined here over time:
+ * 1. Copyleft (L) 1998 Kenneth J. Mighell (Kitt Peak National Observatory)
+ * 2. DAOFIND by Peter Stetson, 1987.
+ * This is a peak detector on a smoother image (now using Gaussian blur) which
+ * identifies any pixel greater than its eight neighbors. The candidates are
+ * then checked for consistency before being fitted to Gaussian or Moffat star
+ * profiles (PSF).
+ */
+
+static int minimize_candidates(fits *image, star_finder_params *sf, starc *candidates, int nb_candidates, int layer, double dynrange, psf_star ***retval, gboolean limit_nbstars, int maxstars, starprofile profile, int threads);
+
+psf_star **peaker(image *image, int layer, star_finder_params *sf, int *nb_stars, rectangle *area, gboolean showtime, gboolean limit_nbstars, int maxstars, starprofile profile, int threads) {
+	int nx = image->fit->rx;
+	int ny = image->fit->ry;
+	int areaX0 = 0;
+	int areaY0 = 0;
+	int areaX1 = nx;
+	int areaY1 = ny;
+	int nbstars = 0;
+	double bg, bgnoise, maxi;
+	float threshold, norm;
+	float **smooth_image;
+	fits smooth_fit = { 0 };
+	starc *candidates;
+	struct timeval t_start, t_end;
+	WORD **image_ushort = NULL;
+	float **image_float = NULL;
+
+	assert(nx > 0 && ny > 0);
+	gboolean ismono = (image->fit->naxes[2] == 1);
+
+	if (showtime) {
+		siril_log_color_message(_("Findstar: processing for channel %d...\n"), "green", layer);
+		gettimeofday(&t_start, NULL);
+	}
+	else siril_log_message(_("Findstar: processing for channel %d...\n"), layer);
+
+	/* running statistics on the input image is best as it caches them */
+	threshold = compute_threshold(image, sf->sigma * 5.0, layer, area, &norm, &bg, &bgnoise, &maxi, threads);
+	if (norm == 0.0f)
+		return NULL;
+
+	siril_debug_print("Threshold: %f (background level: %f, noise: %f, norm: %f)\n", threshold, bg, bgnoise, norm);
+
+	/* Applying a Gaussian filter to select candidates */
+	if (extract_fits(image->fit, &smooth_fit, layer, TRUE)) {
+		siril_log_color_message(_("Failed to copy the image for processing\n"), "red");
+		return NULL;
+	}
+
+	//if (cvUnsharpFilter(&smooth_fit, 3, 0)) {
+	if (gaussian_blur_RT(&smooth_fit, KERNEL_SIZE, threads)) {
+		siril_log_color_message(_("Could not apply Gaussian filter, aborting\n"), "red");
+		clearfits(&smooth_fit);
+		return NULL;
+	}
+
+	/* Build 2D representation of smoothed image upside-down */
+	smooth_image = malloc(ny * sizeof(float *));
+	if (!smooth_image) {
+		PRINT_ALLOC_ERR;
+		clearfits(&smooth_fit);
+		return NULL;
+	}
+	for (int k = 0; k < ny; k++) {
+		smooth_image[ny - k - 1] = smooth_fit.fdata + k * nx;
+	}
+
+	if (area && area->w != 0 && area->h != 0) {
+		areaX0 = area->x;
+		areaY0 = area->y;
+		areaX1 = area->w + areaX0;
+		areaY1 = area->h + areaY0;
+
+		if (areaX1 > nx || areaY1 > ny) {
+			siril_log_color_message(_("Selection is larger than image\n"), "red");
+			clearfits(&smooth_fit);
+			free(smooth_image);
+			return NULL;
+		}
+	}
+
+	/* Build 2D representation of input image upside-down */
+	data_type itype = image->fit->type;
+	if (itype == DATA_USHORT) {
+		image_ushort = malloc(ny * sizeof(WORD *));
+		for (int k = 0; k < ny; k++)
+			image_ushort[ny - k - 1] = image->fit->pdata[layer] + k * nx;	}
+	else if (itype == DATA_FLOAT) {
+		image_float = malloc(ny * sizeof(float *));
+		for (int k = 0; k < ny; k++)
+			image_float[ny - k - 1] = image->fit->fpdata[layer] + k * nx;
+	}
+	else return 0;
+
+	candidates = malloc(MAX_STARS * sizeof(starc));
+	if (!candidates) {
+		free(image_ushort);
+		free(image_float);
+		clearfits(&smooth_fit);
+		free(smooth_image);
+		PRINT_ALLOC_ERR;
+		return NULL;
+	}
+
+	int r = sf->radius;
+	double locthreshold = sf->sigma * 5.0 * bgnoise;
+	double dynrange = (min(maxi, norm) - bg);
+	double minsatlevel = dynrange * SAT_THRESHOLD; // the level above background at which pixels are considered to have saturated or be close to saturation
+	double satrange = dynrange * SAT_DETECTION_RANGE; // the max variation level that defines the plateau of saturation
+	double s_factor = sqrt(-2. * log(DENSITY_THRESHOLD));
+	siril_debug_print("Min saturation level: %3.1f\n", minsatlevel);
+	/* Search for candidate stars in the filtered image, by bands of rows */
+	struct peaker_scan ps = { smooth_image, image_ushort, image_float, itype, ismono, nx, ny, r,
+		areaX0, areaY0, areaX1, areaY1, threshold, norm, bg, locthreshold, minsatlevel, satrange, s_factor };
+	int ystart = r + areaY0, yend = areaY1 - r;
+	int nb_bands = max(1, min(threads * 4, (yend - ystart) / PEAKER_MIN_BAND_ROWS));
+	starc **band_candidates = calloc(nb_bands, sizeof(starc *));
+	int *band_nb = calloc(nb_bands, sizeof(int));
+	struct candidate_grid grid = { 0 };
+	gboolean failed = !band_candidates || !band_nb || candidate_grid_init(&grid, nx, ny);
+	if (!failed) {
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic) num_threads(threads) if(threads > 1)
+#endif
+		for (int b = 0; b < nb_bands; b++) {
+			int y0 = ystart + (int)((gint64)(yend - ystart) * b / nb_bands);
+			int y1 = ystart + (int)((gint64)(yend - ystart) * (b + 1) / nb_bands);
+			band_candidates[b] = scan_candidates(&ps, y0, y1, &band_nb[b]);
+		}
+		/* merging the bands in the scan order, avoiding duplicates for
+		 * large saturated stars */
+		for (int b = 0; b < nb_bands; b++) {
+			if (band_nb[b] < 0)
+				failed = TRUE;
+			for (int c = 0; c < band_nb[b] && nbstars < MAX_STARS; c++) {
+				starc *cand = &band_candidates[b][c];
+				if (candidate_grid_is_duplicate(&grid, cand->x, cand->y, cand->R, candidates)) {
+					if (DEBUG_STAR_DETECTION)
+						siril_debug_print("candidate is a duplicate\n");
+					continue;
+				}
+				candidates[nbstars] = *cand;
+				candidate_grid_add(&grid, candidates, nbstars);
+				nbstars++;
+			}
+			free(band_candidates[b]);
+		}
+	}
+	free(band_candidates);
+	free(band_nb);
+	candidate_grid_free(&grid);
+	if (failed) {
+		PRINT_ALLOC_ERR;
+		free(image_ushort);
+		free(image_float);
+		clearfits(&smooth_fit);
+		free(smooth_image);
+		free(candidates);
+		return NULL;
+	}
 	free(smooth_image);
 	clearfits(&smooth_fit);
 	siril_debug_print("Candidates for stars: %d\n", nbstars);
 	/* Check if candidates are stars by minimizing a PSF on each */
-	psf_star **results;
+	psf_star **results = NULL;
 	nbstars = minimize_candidates(image->fit, sf, candidates, nbstars, layer, dynrange, &results, limit_nbstars, maxstars, profile, threads);
+	if (processing_cancelled()) {
+		/* the lists interrupted by a stop are incomplete */
+		free_fitted_stars(results);
+		nbstars = 0;
+	}
 	if (nbstars == 0)
 		results = NULL;
 	sort_stars_by_mag(results, nbstars);
@@ -560,6 +701,20 @@ psf_star **peaker(image *image, int layer, star_finder_params *sf, int *nb_stars
 	return results;
 }
 
+/* candidate of a fitting round, sorted by box size to make batches */
+struct fit_slot {
+	int R;
+	int candidate;
+};
+
+static int fit_slot_cmp(const void *a, const void *b) {
+	const struct fit_slot *sa = (const struct fit_slot *)a;
+	const struct fit_slot *sb = (const struct fit_slot *)b;
+	if (sa->R != sb->R)
+		return sa->R < sb->R ? -1 : 1;
+	return (sa->candidate > sb->candidate) - (sa->candidate < sb->candidate);
+}
+
 /* returns number of stars found, result is in parameters */
 static int minimize_candidates(fits *image, star_finder_params *sf, starc *candidates, int nb_candidates, int layer, double dynrange, psf_star ***retval, gboolean limit_nbstars, int maxstars, starprofile profile, int threads) {
 	int nx = image->rx;
@@ -597,12 +752,17 @@ static int minimize_candidates(fits *image, star_finder_params *sf, starc *candi
 	}
 
 	psf_star **results = new_fitted_stars(nb_candidates);
-	if (!results) {
+	struct fit_slot *slots = malloc((nb_candidates + 1) * sizeof(struct fit_slot));
+	int *batch_start = malloc((nb_candidates + 1) * sizeof(int));
+	if (!results || !slots || !batch_start) {
 		PRINT_ALLOC_ERR;
 		if (image_float)
 			free(image_float);
 		if (image_ushort)
 			free(image_ushort);
+		free(results);
+		free(slots);
+		free(batch_start);
 		return 0;
 	}
 
@@ -621,87 +781,126 @@ static int minimize_candidates(fits *image, star_finder_params *sf, starc *candi
 		if (upper_limit > nb_candidates)
 			upper_limit = nb_candidates;
 		//siril_debug_print("round %d from %d to %d candidates\n", round, lower_limit_for_this_round, upper_limit);
+		/* candidates with the same box size are fitted together by the
+		 * batched solver, the results keep the order of the candidates */
+		int nb_round = upper_limit - lower_limit_for_this_round;
+		for (int c = 0; c < nb_round; c++) {
+			slots[c].R = candidates[lower_limit_for_this_round + c].R;
+			slots[c].candidate = lower_limit_for_this_round + c;
+		}
+		qsort(slots, nb_round, sizeof(struct fit_slot), fit_slot_cmp);
+		int nb_batches = 0;
+		for (int c = 0; c < nb_round; c++) {
+			if (c == 0 || slots[c].R != slots[c - 1].R || c - batch_start[nb_batches - 1] == PSF_SOLVER_LANES)
+				batch_start[nb_batches++] = c;
+		}
+		batch_start[nb_batches] = nb_round;
+
 #ifdef _OPENMP
-#pragma omp parallel for schedule(static) num_threads(threads) if(threads > 1) shared(psf_failure)
+#pragma omp parallel for schedule(dynamic) num_threads(threads) if(threads > 1) shared(psf_failure)
 #endif
-		for (int candidate = lower_limit_for_this_round; candidate < upper_limit; candidate++) {
-			if (limit_nbstars && nbstars >= maxstars)
+		for (int batch = 0; batch < nb_batches; batch++) {
+			int first = batch_start[batch], nb = batch_start[batch + 1] - first;
+			int R = slots[first].R;
+			size_t side = R * 2 + 1;
+			if (processing_cancelled()) {
+				for (int l = 0; l < nb; l++)
+					results[slots[first + l].candidate] = NULL;
+				continue;
+			}
+			double *zbuf = malloc(nb * side * side * sizeof(double));
+			if (!zbuf) {
+				PRINT_ALLOC_ERR;
+				for (int l = 0; l < nb; l++)
+					results[slots[first + l].candidate] = NULL;
 				continue;
-			int x = candidates[candidate].x, y = candidates[candidate].y;
-			int R = candidates[candidate].R;
-			int ii, jj, i, j;
-			gsl_matrix *z = gsl_matrix_alloc(R * 2 + 1, R * 2 + 1);
-			/* FILL z */
-			if (image->type == DATA_USHORT) {
-				for (jj = 0, j = y - R; j <= y + R; j++, jj++) {
-					for (ii = 0, i = x - R; i <= x + R; i++, ii++) {
-						gsl_matrix_set(z, jj, ii, (double)image_ushort[j][i]);
+			}
+			gsl_matrix_view views[PSF_SOLVER_LANES];
+			gsl_matrix *z[PSF_SOLVER_LANES];
+			double sat[PSF_SOLVER_LANES];
+			psf_star *stars[PSF_SOLVER_LANES];
+			psf_error errors[PSF_SOLVER_LANES];
+			for (int l = 0; l < nb; l++) {
+				const starc *cand = &candidates[slots[first + l].candidate];
+				int x = cand->x, y = cand->y;
+				int ii, jj, i, j;
+				views[l] = gsl_matrix_view_array(zbuf + l * side * side, side, side);
+				z[l] = &views[l].matrix;
+				/* FILL z */
+				if (image->type == DATA_USHORT) {
+					for (jj = 0, j = y - R; j <= y + R; j++, jj++) {
+						for (ii = 0, i = x - R; i <= x + R; i++, ii++) {
+							gsl_matrix_set(z[l], jj, ii, (double)image_ushort[j][i]);
+						}
 					}
-				}
-			} else {
-				for (jj = 0, j = y - R; j <= y + R; j++, jj++) {
-					for (ii = 0, i = x - R; i <= x + R; i++, ii++) {
-						gsl_matrix_set(z, jj, ii, (double)image_float[j][i]);
+				} else {
+					for (jj = 0, j = y - R; j <= y + R; j++, jj++) {
+						for (ii = 0, i = x - R; i <= x + R; i++, ii++) {
+							gsl_matrix_set(z[l], jj, ii, (double)image_float[j][i]);
+						}
 					}
 				}
+				sat[l] = cand->sat;
 			}
-			psf_error error;
-			psf_star *cur_star = psf_global_minimisation(z, bg, candidates[candidate].sat, com.pref.starfinder_conf.convergence, TRUE, FALSE, NULL, FALSE, profile, &error);
-			gsl_matrix_free(z);
-			if (cur_star) {
-				gchar errmsg[SF_ERRMSG_LEN] = "";
-				sf_errors star_invalidated = reject_star(cur_star, sf, &candidates[candidate], dynrange, minA, maxA, (DEBUG_STAR_DETECTION) ? errmsg : NULL);
-				if (error != PSF_ERR_DIVERGED && star_invalidated <= accepted_level) { // we don't return NULL on convergence errors so we need to catch that PSF has not diverged
-					cur_star->layer = layer;
-					cur_star->xpos = (x - R) + cur_star->x0;
-					cur_star->ypos = (y - R) + cur_star->y0;
-					cur_star->sat = candidates[candidate].sat;
-					cur_star->R = candidates[candidate].R;
-					cur_star->has_saturated = (cur_star->A > dynrange);
+			psf_global_minimisation_batch(z, nb, bg, sat, com.pref.starfinder_conf.convergence, profile, stars, errors);
+			free(zbuf);
+
+			for (int l = 0; l < nb; l++) {
+				int candidate = slots[first + l].candidate;
+				int x = candidates[candidate].x, y = candidates[candidate].y;
+				psf_star *cur_star = stars[l];
+				psf_error error = errors[l];
+				results[candidate] = NULL;
+				if (cur_star) {
+					gchar errmsg[SF_ERRMSG_LEN] = "";
+					sf_errors star_invalidated = reject_star(cur_star, sf, &candidates[candidate], dynrange, minA, maxA, (DEBUG_STAR_DETECTION) ? errmsg : NULL);
+					if (error != PSF_ERR_DIVERGED && star_invalidated <= accepted_level) { // we don't return NULL on convergence errors so we need to catch that PSF has not diverged
+						cur_star->layer = layer;
+						cur_star->xpos = (x - R) + cur_star->x0;
+						cur_star->ypos = (y - R) + cur_star->y0;
+						cur_star->sat = candidates[candidate].sat;
+						cur_star->R = candidates[candidate].R;
+						cur_star->has_saturated = (cur_star->A > dynrange);
 #if DEBUG_STAR_DETECTION
-					if (star_invalidated > SF_OK)
-						siril_debug_print("Candidate #%5d: X: %5d, Y: %5d - criterion #%2d failed (but star kept)\n%s", candidate, x, y, star_invalidated, errmsg);
+						if (star_invalidated > SF_OK)
+							siril_debug_print("Candidate #%5d: X: %5d, Y: %5d - criterion #%2d failed (but star kept)\n%s", candidate, x, y, star_invalidated, errmsg);
 #endif
-					if (threads > 1)
 						results[candidate] = cur_star;
-					else results[nbstars++] = cur_star;
-				} else {
+					} else {
 #if DEBUG_STAR_DETECTION
-					siril_debug_print("Candidate #%5d: X: %5d, Y: %5d - criterion #%2d failed\n%s", candidate, x, y, star_invalidated, errmsg);
+						siril_debug_print("Candidate #%5d: X: %5d, Y: %5d - criterion #%2d failed\n%s", candidate, x, y, star_invalidated, errmsg);
 #endif
-					free_psf(cur_star);
-					if (threads > 1)
-						results[candidate] = NULL;
-				}
-			} else {
-				if (threads > 1) results[candidate] = NULL;
+						free_psf(cur_star);
+					}
+				} else {
 #if DEBUG_STAR_DETECTION
-				siril_debug_print("Candidate #%5d: X: %5d, Y: %5d - PSF fit failed with error %d\n", candidate, x, y, error);
+					siril_debug_print("Candidate #%5d: X: %5d, Y: %5d - PSF fit failed with error %d\n", candidate, x, y, error);
 #endif
-				g_atomic_int_inc(&psf_failure);
+					g_atomic_int_inc(&psf_failure);
+				}
 			}
 		}
-		if (threads > 1) {
-			// we kept the candidates at the same indices to keep the list ordered, now we compact it
-			for (int candidate = lower_limit_for_this_round; candidate < upper_limit; candidate++) {
-				if (limit_nbstars && nbstars >= maxstars) {
-					if (results[candidate])
-						free_psf(results[candidate]);
-					continue;
-				}
-				if (results[candidate] && candidate >= nbstars)
-					results[nbstars++] = results[candidate];
+		// we kept the candidates at the same indices to keep the list ordered, now we compact it
+		for (int candidate = lower_limit_for_this_round; candidate < upper_limit; candidate++) {
+			if (limit_nbstars && nbstars >= maxstars) {
+				if (results[candidate])
+					free_psf(results[candidate]);
+				continue;
 			}
+			if (results[candidate] && candidate >= nbstars)
+				results[nbstars++] = results[candidate];
 		}
 		results[nbstars] = NULL;
 		//siril_debug_print("after round %d, found %d stars\n", round, nbstars);
 		round++;
-	} while (limit_nbstars && nbstars < maxstars && upper_limit < nb_candidates);
+	} while (limit_nbstars && nbstars < maxstars && upper_limit < nb_candidates && !processing_cancelled());
 	float psf_failure_rate = (float)psf_failure / (float)upper_limit;
 	if (psf_failure_rate > 0.5)
 		siril_log_color_message(_("More than half of PSF fits have failed - try increasing the convergence criterion\n"), "red");
 	if (retval)
 		*retval = results;
+	free(slots);
+	free(batch_start);
 	if (image_ushort) free(image_ushort);
 	if (image_float) free(image_float);
 	return nbstars;
@@ -815,8 +1014,13 @@ float filtered_FWHM_average(psf_star **stars, int nb) {
 	return retval;
 }
 
+static int check_star_cache(const gchar *star_list, struct starfinder_data *sfargs);
+
 /* looks for the list file, tries to load it, returns TRUE on success */
 static gboolean check_star_list(gchar *filename, struct starfinder_data *sfargs) {
+	int cache_status = check_star_cache(filename, sfargs);
+	if (cache_status >= 0)
+		return cache_status;
 	FILE *fd = g_fopen(filename, "r");
 	if (!fd)
 		return FALSE;
@@ -998,6 +1202,204 @@ int save_list(gchar *filename, int max_stars_fitted, psf_star **stars, int nbsta
 	return 0;
 }
 
+/* binary star list cache, saved next to the text star list of sequence
+ * images. It is read instead of the text list, which is slower to parse
+ * and does not keep the exact parameters and fitted values */
+#define STAR_CACHE_MAGIC "SIRILSTR"
+#define STAR_CACHE_VERSION 1
+
+struct star_cache_header {
+	char magic[8];
+	guint32 version;
+	guint32 record_size;
+	gint32 nb_stars;
+	gint32 max_stars;
+	gint32 layer;
+	gint32 radius;
+	gint32 relax_checks;
+	gint32 profile;
+	double sigma, roundness, min_beta, min_A, max_A, max_r;
+};
+
+struct star_cache_record {
+	gint32 layer;
+	gint32 has_saturated;
+	gint32 profile;
+	gint32 padding;
+	double B, A, beta, xpos, ypos, fwhmx, fwhmy, fwhmx_arcsec, fwhmy_arcsec;
+	double angle, rmse, mag, ra, dec;
+};
+
+gchar *get_star_cache_filename(const gchar *star_list) {
+	if (g_str_has_suffix(star_list, ".lst"))
+		return g_strdup_printf("%.*sbin", (int)strlen(star_list) - 3, star_list);
+	return g_strdup_printf("%s.bin", star_list);
+}
+
+/* returns 1 if the cache was loaded, 0 if it was found but is not usable for
+ * the current parameters and -1 if there is no valid cache to read for the
+ * list, in which case the text list should be tried */
+static int check_star_cache(const gchar *star_list, struct starfinder_data *sfargs) {
+	gchar *filename = get_star_cache_filename(star_list);
+	GStatBuf cache_stat, list_stat;
+	if (g_stat(filename, &cache_stat) ||
+			(!g_stat(star_list, &list_stat) && list_stat.st_mtime > cache_stat.st_mtime)) {
+		// the text list was written by something else after the cache
+		g_free(filename);
+		return -1;
+	}
+	gchar *contents = NULL;
+	gsize length;
+	if (!g_file_get_contents(filename, &contents, &length, NULL)) {
+		g_free(filename);
+		return -1;
+	}
+	siril_debug_print("star cache file %s found, checking...\n", filename);
+	struct star_cache_header header;
+	if (length < sizeof header) {
+		g_free(contents);
+		g_free(filename);
+		return -1;
+	}
+	memcpy(&header, contents, sizeof header);
+	if (memcmp(header.magic, STAR_CACHE_MAGIC, 8) || header.version != STAR_CACHE_VERSION ||
+			header.record_size != sizeof(struct star_cache_record) ||
+			header.nb_stars < 0 || header.nb_stars >= MAX_STARS ||
+			length != sizeof header + (gsize)header.nb_stars * header.record_size) {
+		siril_debug_print("invalid star cache file, ignoring it\n");
+		g_free(contents);
+		g_free(filename);
+		return -1;
+	}
+
+	const star_finder_params *sf = &com.pref.starfinder_conf;
+	gboolean params_ok = header.sigma == sf->sigma && header.roundness == sf->roundness &&
+		header.radius == sf->radius && header.relax_checks == sf->relax_checks &&
+		header.profile == sf->profile && header.min_beta == sf->min_beta &&
+		header.max_stars >= sfargs->max_stars_fitted && header.layer == sfargs->layer &&
+		header.min_A == sf->min_A && header.max_A == sf->max_A && header.max_r == sf->max_r;
+	siril_debug_print("params check: %d\n", params_ok);
+	if (!params_ok) {
+		g_free(contents);
+		g_free(filename);
+		return 0;
+	}
+	if (header.max_stars > sfargs->max_stars_fitted)
+		sfargs->max_stars_fitted = header.max_stars;
+
+	if (sfargs->stars) {
+		psf_star **stars = new_fitted_stars(header.nb_stars);
+		if (!stars) {
+			PRINT_ALLOC_ERR;
+			g_free(contents);
+			g_free(filename);
+			return -1;
+		}
+		const char *ptr = contents + sizeof header;
+		for (int i = 0; i < header.nb_stars; i++, ptr += sizeof(struct star_cache_record)) {
+			struct star_cache_record r;
+			memcpy(&r, ptr, sizeof r);
+			psf_star *s = new_psf_star();
+			if (!s) {
+				PRINT_ALLOC_ERR;
+				free_fitted_stars(stars);
+				g_free(contents);
+				g_free(filename);
+				return -1;
+			}
+			s->layer = r.layer;
+			s->has_saturated = r.has_saturated;
+			s->profile = r.profile;
+			s->B = r.B;
+			s->A = r.A;
+			s->beta = r.beta;
+			s->xpos = r.xpos;
+			s->ypos = r.ypos;
+			s->fwhmx = r.fwhmx;
+			s->fwhmy = r.fwhmy;
+			s->fwhmx_arcsec = r.fwhmx_arcsec;
+			s->fwhmy_arcsec = r.fwhmy_arcsec;
+			s->angle = r.angle;
+			s->rmse = r.rmse;
+			s->mag = r.mag;
+			s->ra = r.ra;
+			s->dec = r.dec;
+			s->units = (s->fwhmx_arcsec > 0. && s->fwhmy_arcsec > 0.) ? "\"" : "px";
+			stars[i] = s;
+			stars[i + 1] = NULL;
+		}
+		*sfargs->stars = stars;
+	}
+	siril_log_message(_("Found %d stars with same settings in %s, skipping detection\n"), header.nb_stars, filename);
+	if (sfargs->nb_stars) *sfargs->nb_stars = header.nb_stars;
+	g_free(contents);
+	g_free(filename);
+	return 1;
+}
+
+int save_star_cache(const gchar *star_list, int max_stars_fitted, psf_star **stars, int nbstars, const star_finder_params *sf, int layer) {
+	if (nbstars <= 0) {
+		nbstars = 0;
+		if (stars)
+			while (stars[nbstars]) nbstars++;
+	}
+	gsize length = sizeof(struct star_cache_header) + (gsize)nbstars * sizeof(struct star_cache_record);
+	gchar *contents = g_malloc0(length);
+	struct star_cache_header header = { 0 };
+	memcpy(header.magic, STAR_CACHE_MAGIC, 8);
+	header.version = STAR_CACHE_VERSION;
+	header.record_size = sizeof(struct star_cache_record);
+	header.nb_stars = nbstars;
+	header.max_stars = max_stars_fitted;
+	header.layer = layer;
+	header.radius = sf->radius;
+	header.relax_checks = sf->relax_checks;
+	header.profile = sf->profile;
+	header.sigma = sf->sigma;
+	header.roundness = sf->roundness;
+	header.min_beta = sf->min_beta;
+	header.min_A = sf->min_A;
+	header.max_A = sf->max_A;
+	header.max_r = sf->max_r;
+	memcpy(contents, &header, sizeof header);
+
+	char *ptr = contents + sizeof header;
+	for (int i = 0; i < nbstars; i++, ptr += sizeof(struct star_cache_record)) {
+		const psf_star *s = stars[i];
+		struct star_cache_record r = { 0 };
+		r.layer = s->layer;
+		r.has_saturated = s->has_saturated;
+		r.profile = s->profile;
+		r.B = s->B;
+		r.A = s->A;
+		r.beta = s->beta;
+		r.xpos = s->xpos;
+		r.ypos = s->ypos;
+		r.fwhmx = s->fwhmx;
+		r.fwhmy = s->fwhmy;
+		r.fwhmx_arcsec = s->fwhmx_arcsec;
+		r.fwhmy_arcsec = s->fwhmy_arcsec;
+		r.angle = s->angle;
+		r.rmse = s->rmse;
+		r.mag = s->mag + com.magOffset;	// as in the text list
+		r.ra = s->ra;
+		r.dec = s->dec;
+		memcpy(ptr, &r, sizeof r);
+	}
+
+	gchar *filename = get_star_cache_filename(star_list);
+	GError *error = NULL;
+	int retval = 0;
+	if (!g_file_set_contents(filename, contents, length, &error)) {
+		siril_log_message(_("Cannot save star list %s: %s\n"), filename, error->message);
+		g_clear_error(&error);
+		retval = 1;
+	}
+	g_free(filename);
+	g_free(contents);
+	return retval;
+}
+
 /* saving a list of sources to the input format of solve-field, the astrometry.net
  * plate solver, as described here:
  * http://astrometry.net/doc/readme.html#source-lists-xylists
@@ -1087,6 +1489,42 @@ int save_list_as_FITS_table(const char *filename, psf_star **stars, int nbstars,
 	return retval;
 }
 
+/* stars of the last frame processed in tracking mode, with their positions
+ * in that frame */
+struct star_tracks {
+	int index;		// index in the sequence of the frame, -1 if none yet
+	psf_star **stars;
+	int nb_stars;
+	int nb_tracked;		// number of frames processed by tracking
+	int nb_detected;	// number of frames processed by the full detection
+};
+
+static void update_star_tracks(struct star_tracks *tracks, int index, psf_star **stars, int nb_stars) {
+	free_fitted_stars(tracks->stars);
+	tracks->stars = NULL;
+	tracks->nb_stars = 0;
+	tracks->index = -1;
+	if (!stars || nb_stars <= 0)
+		return;
+	tracks->stars = new_fitted_stars(nb_stars);
+	if (!tracks->stars) {
+		PRINT_ALLOC_ERR;
+		return;
+	}
+	for (int k = 0; k < nb_stars; k++)
+		tracks->stars[k] = duplicate_psf(stars[k]);
+	tracks->stars[nb_stars] = NULL;
+	tracks->nb_stars = nb_stars;
+	tracks->index = index;
+}
+
+static void free_star_tracks(struct star_tracks *tracks) {
+	if (!tracks)
+		return;
+	free_fitted_stars(tracks->stars);
+	free(tracks);
+}
+
 static int findstar_compute_mem_limits(struct generic_seq_args *args, gboolean for_writer) {
 	unsigned int MB_per_image, MB_avail, required = 0;
 	// using output scale of 0. as this does not produce output image
@@ -1275,6 +1713,12 @@ int findstar_finalize_hook(struct generic_seq_args *args) {
 		g_free(data->startable);
 	if (data->starfile)
 		g_free(data->starfile);
+	if (data->tracks) {
+		siril_log_message(_("Star tracking: %d images processed from the previous star list, %d with a full detection\n"),
+				data->tracks->nb_tracked, data->tracks->nb_detected);
+		free_star_tracks(data->tracks);
+		data->tracks = NULL;
+	}
 	printf("findstar_args have been freed\n");
 	return 0;
 }
@@ -1321,6 +1765,17 @@ int apply_findstar_to_sequence(struct starfinder_data *findstar_args) {
 		ref.keywords.wcslib = NULL;	// don't free it
 		clearfits(&ref);
 	}
+	if (findstar_args->track_stars) {
+		/* each frame starts from the stars of the previous one */
+		findstar_args->tracks = calloc(1, sizeof(struct star_tracks));
+		if (!findstar_args->tracks) {
+			PRINT_ALLOC_ERR;
+			free(args);
+			return 1;
+		}
+		findstar_args->tracks->index = -1;
+		args->parallel = FALSE;
+	}
 	if (findstar_args->already_in_thread) {
 		int retval = GPOINTER_TO_INT(generic_sequence_worker(args));
 		free(args);
@@ -1330,6 +1785,172 @@ int apply_findstar_to_sequence(struct starfinder_data *findstar_args) {
 	return 0;
 }
 
+/* Fits a star in a box of radius R centred on (xf, yf), given in display
+ * coordinates with pixel edges at integer positions, the background and
+ * saturation levels being known. Returns NULL if the box is not entirely in
+ * the image or if the fit failed. */
+static psf_star *fit_star_in_box(fits *fit, int layer, double xf, double yf, int R,
+		double B, double sat, starprofile profile) {
+	int nx = fit->rx, ny = fit->ry;
+	int x = (int) floor(xf);
+	int y = (int) floor(yf);
+	if (x - R < 0 || y - R < 0 || x + R >= nx || y + R >= ny)
+		return NULL;
+	gsl_matrix *z = gsl_matrix_alloc(R * 2 + 1, R * 2 + 1);
+	if (!z)
+		return NULL;
+	for (int jj = 0, j = y - R; j <= y + R; j++, jj++) {
+		size_t row = (size_t)(ny - 1 - j) * nx;
+		for (int ii = 0, i = x - R; i <= x + R; i++, ii++) {
+			double v = (fit->type == DATA_USHORT) ? (double)fit->pdata[layer][row + i] :
+				(double)fit->fpdata[layer][row + i];
+			gsl_matrix_set(z, jj, ii, v);
+		}
+	}
+	psf_error error;
+	psf_star *cur_star = psf_global_minimisation(z, B, sat, com.pref.starfinder_conf.convergence, TRUE, FALSE, NULL, FALSE, profile, &error);
+	gsl_matrix_free(z);
+	if (!cur_star)
+		return NULL;
+	if (error == PSF_ERR_DIVERGED) {
+		free_psf(cur_star);
+		return NULL;
+	}
+	cur_star->layer = layer;
+	cur_star->xpos = (x - R) + cur_star->x0;
+	cur_star->ypos = (y - R) + cur_star->y0;
+	cur_star->sat = sat;
+	cur_star->R = R;
+	return cur_star;
+}
+
+/* Fast detection for registration: the stars are detected on a binned copy
+ * of the layer, then fitted again on the full resolution image, in boxes
+ * scaled from the binned ones. Only the stars kept by the detection are
+ * fitted at full resolution, so the cost of the peaker on the full image is
+ * avoided while the positions keep their full accuracy. */
+static psf_star **peaker_binned(image *im, int layer, int factor, star_finder_params *sf, int *nb_stars,
+		gboolean limit_nbstars, int maxstars, starprofile profile, int threads) {
+	fits *fit = im->fit;
+	fits binned = { 0 };
+	*nb_stars = 0;
+	if (extract_fits(fit, &binned, layer, FALSE))
+		return NULL;
+	fits_binning_data(&binned, factor, TRUE);
+	int binned_ry = binned.ry;
+
+	star_finder_params sfb = *sf;
+	sfb.radius = max(sf->radius / factor, MIN_BINNED_RADIUS);
+	image imb = { .fit = &binned, .from_seq = NULL, .index_in_seq = -1 };
+	int nb = 0;
+	psf_star **bstars = peaker(&imb, 0, &sfb, &nb, NULL, FALSE, limit_nbstars, maxstars, profile, threads);
+	clearfits(&binned);
+	if (!bstars)
+		return NULL;
+
+	int ny = fit->ry;
+	psf_star **results = new_fitted_stars(nb);
+	if (!results) {
+		PRINT_ALLOC_ERR;
+		free_fitted_stars(bstars);
+		return NULL;
+	}
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static) num_threads(threads) if(threads > 1)
+#endif
+	for (int k = 0; k < nb; k++) {
+		psf_star *bs = bstars[k];
+		results[k] = NULL;
+		/* binned position to the full image, pixel edges being at integer
+		 * positions: binning starts from the first data row, which is the
+		 * bottom of the displayed image */
+		double xf = bs->xpos * factor;
+		double yf = ny - factor * (binned_ry - bs->ypos);
+		int R = min(bs->R * factor, MAX_BOX_RADIUS);
+		psf_star *cur_star = fit_star_in_box(fit, layer, xf, yf, R, bs->B, bs->sat, profile);
+		if (!cur_star)
+			continue;
+		cur_star->has_saturated = bs->has_saturated;
+		results[k] = cur_star;
+	}
+	free_fitted_stars(bstars);
+
+	// compacting, keeping the order of the detection
+	int n = 0;
+	for (int k = 0; k < nb; k++) {
+		if (results[k])
+			results[n++] = results[k];
+	}
+	results[n] = NULL;
+	siril_debug_print("binned x%d detection: %d stars, %d refined\n", factor, nb, n);
+	*nb_stars = n;
+	return results;
+}
+
+/* Tracking mode for sequences: instead of the full detection, the stars of
+ * the previous frame are fitted again in small boxes around their positions
+ * predicted in the current frame, from the registration data if both frames
+ * have some, at the same position otherwise. A track is lost if its fit
+ * fails, moves away from the prediction or is no longer star-like. Returns
+ * NULL when too many tracks are lost, the caller then falls back to the full
+ * detection. */
+static psf_star **track_stars(image *im, int layer, const struct star_tracks *tracks,
+		const star_finder_params *sf, int *nb_stars, starprofile profile, int threads) {
+	fits *fit = im->fit;
+	sequence *seq = im->from_seq;
+	*nb_stars = 0;
+	if (!tracks->stars || tracks->nb_stars < TRACKING_MIN_STARS)
+		return NULL;
+	gboolean use_H = seq && seq->regparam && seq->regparam[layer] &&
+		guess_transform_from_H(seq->regparam[layer][tracks->index].H) != NULL_TRANSFORMATION &&
+		guess_transform_from_H(seq->regparam[layer][im->index_in_seq].H) != NULL_TRANSFORMATION;
+
+	int nb = tracks->nb_stars;
+	psf_star **results = new_fitted_stars(nb);
+	if (!results) {
+		PRINT_ALLOC_ERR;
+		return NULL;
+	}
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static) num_threads(threads) if(threads > 1)
+#endif
+	for (int k = 0; k < nb; k++) {
+		const psf_star *prev = tracks->stars[k];
+		results[k] = NULL;
+		double x = prev->xpos, y = prev->ypos;
+		if (use_H)
+			cvTransfPoint(&x, &y, seq->regparam[layer][tracks->index].H,
+					seq->regparam[layer][im->index_in_seq].H, 1.);
+		int R = prev->R > 0 ? min(prev->R, MAX_BOX_RADIUS) : sf->radius;
+		psf_star *cur_star = fit_star_in_box(fit, layer, x, y, R, prev->B, prev->sat, profile);
+		if (!cur_star)
+			continue;
+		double r = cur_star->fwhmy / cur_star->fwhmx;
+		if (isnan(cur_star->mag) || isnan(r) || cur_star->fwhmx <= 0.0 || cur_star->fwhmy <= 0.0 ||
+				r < sf->roundness || r > sf->max_r ||
+				fabs(cur_star->xpos - x) > 0.5 * R || fabs(cur_star->ypos - y) > 0.5 * R) {
+			free_psf(cur_star);
+			continue;
+		}
+		cur_star->has_saturated = prev->has_saturated;
+		results[k] = cur_star;
+	}
+
+	int n = 0;
+	for (int k = 0; k < nb; k++) {
+		if (results[k])
+			results[n++] = results[k];
+	}
+	results[n] = NULL;
+	siril_debug_print("tracking from frame %d: %d stars, %d kept\n", tracks->index, nb, n);
+	if (n < TRACKING_MIN_STARS || n < TRACKING_MIN_KEPT * nb) {
+		free_fitted_stars(results);
+		return NULL;
+	}
+	*nb_stars = n;
+	return results;
+}
+
 gboolean end_findstar(gpointer p);	// in the GUI file
 
 // for a single image
@@ -1350,10 +1971,28 @@ gpointer findstar_worker(gpointer p) {
 		args->im.fit = green_fit;
 		siril_log_color_message(_("Undebayered CFA image. Detection is done on green pixels only, using interpolation\n"), "salmon");
 	}
-	psf_star **stars = peaker(&args->im, args->layer, &com.pref.starfinder_conf, &nbstars,
-			selection, args->update_GUI, limit_stars, args->max_stars_fitted, com.pref.starfinder_conf.profile, threads);
+	psf_star **stars = NULL;
+	gboolean tracked = FALSE;
+	if (args->tracks && args->tracks->index >= 0 && !selection && args->layer >= 0) {
+		stars = track_stars(&args->im, args->layer, args->tracks, &com.pref.starfinder_conf,
+				&nbstars, com.pref.starfinder_conf.profile, threads);
+		tracked = stars != NULL;
+	}
+	if (!tracked) {
+		if (args->detection_binning > 1 && !selection && args->layer >= 0)
+			stars = peaker_binned(&args->im, args->layer, args->detection_binning, &com.pref.starfinder_conf,
+					&nbstars, limit_stars, args->max_stars_fitted, com.pref.starfinder_conf.profile, threads);
+		else stars = peaker(&args->im, args->layer, &com.pref.starfinder_conf, &nbstars,
+				selection, args->update_GUI, limit_stars, args->max_stars_fitted, com.pref.starfinder_conf.profile, threads);
+	}
 	if (green_fit)
 		clearfits(green_fit);
+	if (args->tracks && !selection) {
+		if (tracked)
+			args->tracks->nb_tracked++;
+		else args->tracks->nb_detected++;
+		update_star_tracks(args->tracks, args->im.index_in_seq, stars, nbstars);
+	}
 
 	double fwhm = 0.0;
 	if (stars) {
@@ -1412,6 +2051,11 @@ gpointer findstar_worker(gpointer p) {
 				&com.pref.starfinder_conf, args->layer, args->update_GUI)) {
 		retval = 1;
 	}
+	if (args->starfile && args->im.from_seq &&
+			save_star_cache(args->starfile, args->max_stars_fitted, stars, nbstars,
+				&com.pref.starfinder_conf, args->layer)) {
+		retval = 1;
+	}
 
 	if (args->startable &&
 			save_list_as_FITS_table(args->startable, stars, nbstars,
@@ -11,6 +11,8 @@ typedef struct {
 	int index_in_seq;
 } image;
 
+struct star_tracks;
+
 struct starfinder_data {
 	image im;
 	int layer;
@@ -31,6 +33,9 @@ struct starfinder_data {
 	gboolean process_all_images;	// for sequence operation
 	gboolean already_in_thread;
 	gboolean keep_stars; // TRUE to avoid freeing stars in findstar_worker
+	int detection_binning;	// if > 1, detect on an image binned by this factor
+	gboolean track_stars;	// for sequences, start from the stars of the previous frame
+	struct star_tracks *tracks;	// run-time data of the tracking mode
 };
 
 struct star_candidate_struct {
@@ -74,6 +79,8 @@ float filtered_FWHM_average(psf_star **stars, int nb);
 int apply_findstar_to_sequence(struct starfinder_data *findstar_args);
 gpointer findstar_worker(gpointer p);
 int save_list(gchar *filename, int max_stars_fitted, psf_star **stars, int nbstars, const star_finder_params *sf, int layer, gboolean verbose);
+gchar *get_star_cache_filename(const gchar *star_list);
+int save_star_cache(const gchar *star_list, int max_stars_fitted, psf_star **stars, int nbstars, const star_finder_params *sf, int layer);
 int save_list_as_FITS_table(const char *filename, psf_star **stars, int nbstars, int rx, int ry);
 float measure_image_FWHM(fits *fit, int channel);
 struct starfinder_data *findstar_image_worker(const struct starfinder_data *findstar_args, int o, int i, fits *fit, rectangle *_, int threads);
@@ -142,55 +142,98 @@ float siril_stats_ushort_mad(const WORD* data, const size_t n, const double m,
 	return mad;
 }
 
-static double siril_stats_ushort_bwmv(const WORD* data, const size_t n,
-		const double mad, const double median, threading_type threads) {
-
-	double bwmv = 0.0;
-	double up = 0.0, down = 0.0;
-
-	if (mad > 0.0) {
+/* The estimators based on the median are all computed from one histogram of
+ * the data, without copying them: the exact median, the MAD from the histogram
+ * of the absolute deviations to the median, the average absolute deviation and
+ * the biweight midvariance as sums over the bins */
+static unsigned int *ushort_histogram(const WORD *data, size_t n, gboolean skip_null, threading_type threads) {
+	unsigned int *h = calloc(USHRT_MAX + 1, sizeof(unsigned int));
+	if (!h) {
+		PRINT_ALLOC_ERR;
+		return NULL;
+	}
 #ifdef _OPENMP
-	threads = limit_threading(&threads, 150000, n);
-#pragma omp parallel for num_threads(threads) schedule(static) reduction(+:up,down) if(threads>1)
+	threads = limit_threading(&threads, 2000000, n);
+#pragma omp parallel num_threads(threads) if (threads > 1)
 #endif
-		for (size_t i = 0; i < n; i++) {
-			double yi, ai, yi2;
-
-			yi = ((double) data[i] - median) / (9 * mad);
-			yi2 = yi * yi;
-			ai = (fabs(yi) < 1.0) ? 1.0 : 0.0;
-
-			up += ai * SQR((double ) data[i] - median) * SQR(SQR (1 - yi2));
-			down += (ai * (1 - yi2) * (1 - 5 * yi2));
+	{
+		unsigned int *hthr = calloc(USHRT_MAX + 1, sizeof(unsigned int));
+		if (!hthr) {
+			PRINT_ALLOC_ERR;
+		} else {
+#ifdef _OPENMP
+#pragma omp for schedule(static) nowait
+#endif
+			for (size_t i = 0; i < n; i++)
+				hthr[data[i]]++;
+#ifdef _OPENMP
+#pragma omp critical
+#endif
+			{
+				for (int i = 0; i <= USHRT_MAX; i++)
+					h[i] += hthr[i];
+			}
+			free(hthr);
 		}
-
-		bwmv = n * (up / (down * down));
 	}
+	if (skip_null)
+		h[0] = 0;
+	return h;
+}
 
-	return bwmv;
+/* same result as histogram_median() on the n values of the histogram */
+static double median_from_histogram(const unsigned int *h, size_t n) {
+	if (n == 0)
+		return 0.0;
+	size_t i = 0, j = 0, k = n / 2;
+	size_t sum = 0;
+	if (n % 2 == 0) {
+		for (; sum <= k - 1; j++)
+			sum += h[j];
+		i = j;
+	}
+	for (; sum <= k; i++)
+		sum += h[i];
+	return (n % 2 == 0) ? (double) (i + j - 2) / 2.0 : (double) (i - 1);
 }
 
-static WORD* reassign_to_non_null_data_ushort(WORD *data, size_t inputlen, size_t outputlen, int free_input) {
-	size_t i, j = 0;
-	WORD *ndata = malloc(outputlen * sizeof(WORD));
-	if (!ndata) {
+static double mad_from_histogram(const unsigned int *h, size_t n, double m) {
+	unsigned int *dev = calloc(USHRT_MAX + 1, sizeof(unsigned int));
+	if (!dev) {
 		PRINT_ALLOC_ERR;
-		return NULL;
+		return 0.0;
 	}
+	int median = round_to_int(m);	// as siril_stats_ushort_mad()
+	for (int i = 0; i <= USHRT_MAX; i++)
+		dev[abs(i - median)] += h[i];
+	double mad = median_from_histogram(dev, n);
+	free(dev);
+	return mad;
+}
 
-	for (i = 0; i < inputlen; i++) {
-		if (data[i] > 0) {
-			if (j >= outputlen) {
-				fprintf(stderr, "\n- stats MISMATCH in sizes (in: %zu, out: %zu), THIS IS A BUG: seqfile is wrong *********\n\n", inputlen, outputlen);
-				break;
-			}
-			ndata[j] = data[i];
-			j++;
-		}
+static double absdev_from_histogram(const unsigned int *h, size_t n, double m) {
+	double sum = 0.0;
+	for (int i = 0; i <= USHRT_MAX; i++)
+		if (h[i])
+			sum += h[i] * fabs(i - m);
+	return sum / n;
+}
+
+static double bwmv_from_histogram(const unsigned int *h, size_t n, double mad, double median) {
+	double up = 0.0, down = 0.0;
+	if (mad <= 0.0)
+		return 0.0;
+	for (int i = 0; i <= USHRT_MAX; i++) {
+		if (!h[i])
+			continue;
+		double yi = ((double) i - median) / (9 * mad);
+		if (fabs(yi) >= 1.0)
+			continue;
+		double yi2 = yi * yi;
+		up += h[i] * SQR((double) i - median) * SQR(SQR(1 - yi2));
+		down += h[i] * (1 - yi2) * (1 - 5 * yi2);
 	}
-	if (free_input)
-		free(data);
-	return ndata;
+	return n * (up / (down * down));
 }
 
 static void siril_stats_ushort_minmax(WORD *min_out, WORD *max_out,
@@ -335,56 +378,47 @@ static imstats* statistics_internal_ushort(fits *fit, int layer, rectangle *sele
 		return NULL;
 	}
 
-	/* we exclude 0 if some computations remain to be done or copy data if
-	 * median has to be computed (this is deactivated in the ngoodpix computation) */
-	if (fit && compute_median && stat->total != stat->ngoodpix) {
-		data = reassign_to_non_null_data_ushort(data, stat->total, stat->ngoodpix, free_data);
-		if (!data) {
-			if (stat_is_local) free(stat);
-			return NULL;
-		}
-		free_data = 1;
-	}
+	/* the null pixels are excluded from the median based estimators
+	 * (this is deactivated in the ngoodpix computation) */
+	gboolean skip_null = fit && stat->total != stat->ngoodpix;
 
-	/* Calculation of median */
-	if (compute_median && stat->median == NULL_STATS) {
+	/* Calculation of median, average absolute deviation from the median,
+	 * median absolute deviation and biweight midvariance, from one histogram */
+	gboolean need_mad = (option & (STATS_MAD | STATS_BWMV | STATS_IKSS)) && stat->mad == NULL_STATS;
+	if ((compute_median && stat->median == NULL_STATS) || need_mad ||
+			((option & STATS_AVGDEV) && stat->avgDev == NULL_STATS) ||
+			((option & STATS_BWMV) && stat->sqrtbwmv == NULL_STATS)) {
 		if (!data) {
 			if (stat_is_local) free(stat);
 			return NULL;	// not in cache, don't compute
 		}
-		siril_debug_print("- stats %p fit %p (%d): computing median\n", stat, fit, layer);
-		stat->median = histogram_median(data, stat->ngoodpix, threads);
-	}
-
-	/* Calculation of average absolute deviation from the median */
-	if ((option & STATS_AVGDEV) && stat->avgDev == NULL_STATS) {
-		if (!data) {
+		unsigned int *h = ushort_histogram(data, stat->total, skip_null, threads);
+		if (!h) {
 			if (stat_is_local) free(stat);
-			return NULL;	// not in cache, don't compute
+			if (free_data) free(data);
+			return NULL;
 		}
-		siril_debug_print("- stats %p fit %p (%d): computing absdev\n", stat, fit, layer);
-		stat->avgDev = gsl_stats_ushort_absdev_m(data, 1, stat->ngoodpix, stat->median);
-	}
+		size_t n = 0;
+		for (int i = 0; i <= USHRT_MAX; i++)
+			n += h[i];
 
-	/* Calculation of median absolute deviation */
-	if (((option & STATS_MAD) || (option & STATS_BWMV) || (option & STATS_IKSS)) && stat->mad == NULL_STATS) {
-		if (!data) {
-			if (stat_is_local) free(stat);
-			return NULL;	// not in cache, don't compute
+		if (stat->median == NULL_STATS) {
+			siril_debug_print("- stats %p fit %p (%d): computing median\n", stat, fit, layer);
+			stat->median = median_from_histogram(h, n);
 		}
-		siril_debug_print("- stats %p fit %p (%d): computing mad\n", stat, fit, layer);
-		stat->mad = siril_stats_ushort_mad(data, stat->ngoodpix, stat->median, threads);
-	}
-
-	/* Calculation of Bidweight Midvariance */
-	if ((option & STATS_BWMV) && stat->sqrtbwmv == NULL_STATS) {
-		if (!data) {
-			if (stat_is_local) free(stat);
-			return NULL;	// not in cache, don't compute
+		if ((option & STATS_AVGDEV) && stat->avgDev == NULL_STATS) {
+			siril_debug_print("- stats %p fit %p (%d): computing absdev\n", stat, fit, layer);
+			stat->avgDev = absdev_from_histogram(h, n, stat->median);
 		}
-		siril_debug_print("- stats %p fit %p (%d): computing bimid\n", stat, fit, layer);
-		double bwmv = siril_stats_ushort_bwmv(data, stat->ngoodpix, stat->mad, stat->median, threads);
-		stat->sqrtbwmv = sqrt(bwmv);
+		if (need_mad) {
+			siril_debug_print("- stats %p fit %p (%d): computing mad\n", stat, fit, layer);
+			stat->mad = mad_from_histogram(h, n, stat->median);
+		}
+		if ((option & STATS_BWMV) && stat->sqrtbwmv == NULL_STATS) {
+			siril_debug_print("- stats %p fit %p (%d): computing bimid\n", stat, fit, layer);
+			stat->sqrtbwmv = sqrt(bwmv_from_histogram(h, n, stat->mad, stat->median));
+		}
+		free(h);
 	}
 
 
@@ -405,12 +439,20 @@ static imstats* statistics_internal_ushort(fits *fit, int layer, rectangle *sele
 		double normValue = (fit->bitpix == BYTE_IMG) ? UCHAR_MAX_DOUBLE : USHRT_MAX_DOUBLE;
 		/* we convert in the [0, 1] range */
 		float invertNormValue = (float)(1.0 / normValue);
+		if (skip_null) {
+			size_t j = 0;
+			for (size_t i = 0; i < stat->total && j < stat->ngoodpix; i++) {
+				if (data[i] > 0)
+					newdata[j++] = (float) data[i] * invertNormValue;
+			}
+		} else {
 #ifdef _OPENMP
-		int loopthreads = limit_threading(&threads, 400000, stat->ngoodpix);
+			int loopthreads = limit_threading(&threads, 400000, stat->ngoodpix);
 #pragma omp parallel for num_threads(loopthreads) if (loopthreads>1) schedule(static)
 #endif
-		for (size_t i = 0; i < stat->ngoodpix; i++) {
-			newdata[i] = (float) data[i] * invertNormValue;
+			for (size_t i = 0; i < stat->ngoodpix; i++) {
+				newdata[i] = (float) data[i] * invertNormValue;
+			}
 		}
 
 		float med = (float)(stat->median) * invertNormValue;
@@ -715,6 +757,18 @@ void clear_stats(sequence *seq, int layer) {
 	}
 }
 
+/* calls free_stats on the stats of all layers of an image of a sequence */
+void clear_stats_of_image(sequence *seq, int image_index) {
+	if (!seq->stats)
+		return;
+	for (int layer = 0; layer < seq->nb_layers; layer++) {
+		if (seq->stats[layer] && seq->stats[layer][image_index]) {
+			free_stats(seq->stats[layer][image_index]);
+			seq->stats[layer][image_index] = NULL;
+		}
+	}
+}
+
 /* calls free_stats on all stats of a sequence */
 void clear_stats_bkp(sequence *seq, int layer) {
 	if (seq->stats_bkp && seq->stats_bkp[layer]) {
@@ -39,6 +39,7 @@ int compute_means_from_flat_cfa(fits *fit, double mean[36]);
 void allocate_stats(imstats **stat);
 imstats* free_stats(imstats *stat);
 void clear_stats(sequence *seq, int layer);
+void clear_stats_of_image(sequence *seq, int image_index);
 void clear_stats_bkp(sequence *seq, int layer);
 
 void add_stats_to_fit(fits *fit, int layer, imstats *stat);
@@ -56,7 +57,7 @@ float siril_stats_ushort_sd_64(const WORD data[], const int N);
 float siril_stats_ushort_sd_32(const WORD data[], const int N);
 float siril_stats_ushort_mad(const WORD* data, const size_t n, const double m, threading_type threads);
 float siril_stats_float_sd(const float data[], const int N, float *mean);
-double siril_stats_float_mad(const float *data, const size_t n, const double m, threading_type threads, float *buffer);
+double siril_stats_float_mad(const float *data, const size_t n, const double m, threading_type threads);
 float siril_stats_trmean_from_sorted_data(const float trim, const float sorted_data[], const size_t stride, const size_t size);
 
 int compute_all_channels_statistics_seqimage(sequence *seq, int image_index, fits *fit, int option,
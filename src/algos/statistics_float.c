@@ -89,36 +89,98 @@ float siril_stats_float_sd(const float data[], const int N, float *m) {
 	return sqrtf((float)(accumulator / (N - 1)));
 }
 
-/* For a univariate data set X1, X2, ..., Xn, the MAD is defined as the median
- * of the absolute deviations from the data's median:
- *  MAD = median (| Xi − median(X) |)
- */
-double siril_stats_float_mad(const float *data, const size_t n, const double m, threading_type threads, float *buffer) {
-	double mad;
-	const float median = (float)m;
-	float *tmp = buffer ? buffer : malloc(n * sizeof(float));
-	if (!tmp) {
-		PRINT_ALLOC_ERR;
-		return 0.0;
-	}
-
+#define HISTO_VALUE(x) (deviation ? fabsf((x) - center) : (x))
+
+/* Median of the n values of data, or of their absolute deviations from center,
+ * excluding the null values if skip_null. It gives the same result as
+ * histogram_median_float() on a copy of the values, the same histogram of at
+ * most 65536 bins being built and interpolated, but reads the data instead. */
+static float histogram_median_float_nocopy(const float *data, size_t n, gboolean skip_null,
+		gboolean deviation, float center, threading_type threads) {
+	size_t size = 0;
+	float minVal = FLT_MAX, maxVal = -FLT_MAX;
 #ifdef _OPENMP
 	threads = limit_threading(&threads, 400000, n);
-#pragma omp parallel for num_threads(threads) if(threads>1) schedule(static)
+#pragma omp parallel for num_threads(threads) if(threads>1) schedule(static) reduction(min:minVal) reduction(max:maxVal) reduction(+:size)
 #endif
 	for (size_t i = 0; i < n; i++) {
-		tmp[i] = fabsf(data[i] - median);
+		if (skip_null && data[i] == 0.f)
+			continue;
+		const float v = HISTO_VALUE(data[i]);
+		minVal = v < minVal ? v : minVal;
+		maxVal = maxVal < v ? v : maxVal;
+		size++;
+	}
+	if (size == 0)
+		return 0.f;
+	if (fabsf(maxVal - minVal) == 0.f)
+		return minVal;
+
+	const unsigned int histoSize = min(65536, size);
+	const float scale = (histoSize - 1) / (maxVal - minVal);
+	guint32 *histo = calloc(histoSize, sizeof(guint32));
+	if (!histo) {
+		PRINT_ALLOC_ERR;
+		return 0.f;
+	}
+#ifdef _OPENMP
+#pragma omp parallel num_threads(threads) if(threads>1)
+#endif
+	{
+		guint32 *histothr = threads > 1 ? calloc(histoSize, sizeof(guint32)) : histo;
+		if (!histothr) {
+			PRINT_ALLOC_ERR;
+		} else {
+#ifdef _OPENMP
+#pragma omp for schedule(static) nowait
+#endif
+			for (size_t i = 0; i < n; i++) {
+				if (skip_null && data[i] == 0.f)
+					continue;
+				histothr[(guint16) (scale * (HISTO_VALUE(data[i]) - minVal))]++;
+			}
+			if (histothr != histo) {
+#ifdef _OPENMP
+#pragma omp critical
+#endif
+				{
+					for (unsigned int i = 0; i < histoSize; i++)
+						histo[i] += histothr[i];
+				}
+				free(histothr);
+			}
+		}
 	}
 
-	mad = histogram_median_float(tmp, n, threads);
-	if (!buffer) {
-	    free(tmp);
+	size_t k = 0, count = 0;
+	const float thresh = 0.5f * size;
+	while (count < thresh)
+		count += histo[k++];
+	float median;
+	if (k > 0) {	// interpolate
+		const size_t count_ = count - histo[k - 1];
+		const float c0 = count - thresh;
+		const float c1 = thresh - count_;
+		median = (c1 * k + c0 * (k - 1)) / (c0 + c1);
+	} else {
+		median = k;
 	}
-	return mad;
+	free(histo);
+	median /= scale;
+	median += minVal;
+	return median < minVal ? minVal : (median > maxVal ? maxVal : median);
 }
 
-static double siril_stats_float_bwmv(const float* data, const size_t n,
-		const float mad, const float median, threading_type threads) {
+/* For a univariate data set X1, X2, ..., Xn, the MAD is defined as the median
+ * of the absolute deviations from the data's median:
+ *  MAD = median (| Xi − median(X) |)
+ */
+double siril_stats_float_mad(const float *data, const size_t n, const double m, threading_type threads) {
+	return histogram_median_float_nocopy(data, n, FALSE, TRUE, (float) m, threads);
+}
+
+static double siril_stats_float_bwmv(const float* data, const size_t n, gboolean skip_null,
+		const size_t ngood, const float mad, const float median, threading_type threads) {
 	double bwmv = 0.0;
 	double up = 0.0, down = 0.0;
 
@@ -129,6 +191,8 @@ static double siril_stats_float_bwmv(const float* data, const size_t n,
 #pragma omp parallel for num_threads(threads) if(threads>1) schedule(static) reduction(+:up,down)
 #endif
 		for (size_t i = 0; i < n; i++) {
+			if (skip_null && data[i] == 0.f)
+				continue;
 			const float i_med = data[i] - median;
 
 			const float yi = i_med * factor;
@@ -138,12 +202,23 @@ static double siril_stats_float_bwmv(const float* data, const size_t n,
 			down += (1 - yi2) * (1 - 5 * yi2);
 		}
 
-		bwmv = n * (up / (down * down));
+		bwmv = ngood * (up / (down * down));
 	}
 
 	return bwmv;
 }
 
+static double siril_stats_float_absdev(const float *data, const size_t n, gboolean skip_null,
+		const size_t ngood, const double m) {
+	double sum = 0.0;
+	for (size_t i = 0; i < n; i++) {
+		if (skip_null && data[i] == 0.f)
+			continue;
+		sum += fabs(data[i] - m);
+	}
+	return sum / ngood;
+}
+
 float siril_stats_trmean_from_sorted_data(const float trim,
 		const float sorted_data[], const size_t stride, const size_t size) {
 	if (trim >= 0.5f) {
@@ -185,12 +260,12 @@ int IKSS(float *data, size_t n, double *location, double *scale, gboolean multit
 			break;
 		}
 		m = gsl_stats_float_median_from_sorted_data(data + i, 1, j - i);
-		mad = siril_stats_float_mad(data + i, j - i, m, multithread, buffer);
+		mad = siril_stats_float_mad(data + i, j - i, m, multithread);
 		if (mad == 0.0f) {
 			free(buffer);
 			return 1;
 		}
-		s = sqrt(siril_stats_float_bwmv(data + i, j - i, mad, m, multithread));
+		s = sqrt(siril_stats_float_bwmv(data + i, j - i, FALSE, j - i, mad, m, multithread));
 		if (s < 2E-23) {
 			*location = m;
 			*scale = 0;
@@ -235,13 +310,13 @@ int IKSSlite(float *data, size_t n, const float median, float mad, double *locat
 		return 1;
 
 	*location = histogram_median_float(data, kept, threads);
-	mad = siril_stats_float_mad(data, kept, *location, threads, NULL);
+	mad = siril_stats_float_mad(data, kept, *location, threads);
 	if (mad == 0.0f) {
 		siril_log_color_message(_("MAD is null. Statistics cannot be computed.\n"), "red");
 		return 1;
 	}
 
-	*scale = sqrt(siril_stats_float_bwmv(data, kept, mad, *location, threads)) *.991;
+	*scale = sqrt(siril_stats_float_bwmv(data, kept, FALSE, kept, mad, *location, threads)) *.991;
 	/* 0.991 factor is to keep consistency with IKSS scale */
 	return 0;
 }
@@ -421,15 +496,22 @@ imstats* statistics_internal_float(fits *fit, int layer, rectangle *selection, i
 	}
 
 
-	/* we exclude 0 if some computations remain to be done or copy data if
-	 * median has to be computed */
+	/* we exclude 0 from the median based estimators, skipping them when reading
+	 * the data, or copying the data for IKSS which modifies them */
+	size_t ndata = stat->ngoodpix;
+	gboolean skip_null = FALSE;
 	if (ACTIVATE_NULLCHECK_FLOAT && fit && compute_median && stat->total != stat->ngoodpix) {
-		data = reassign_to_non_null_data_float(data, stat->total, stat->ngoodpix, free_data);
-		if (!data) {
-			if (stat_is_local) free(stat);
-			return NULL;
+		if ((option & STATS_IKSS) && (stat->location == NULL_STATS || stat->scale == NULL_STATS)) {
+			data = reassign_to_non_null_data_float(data, stat->total, stat->ngoodpix, free_data);
+			if (!data) {
+				if (stat_is_local) free(stat);
+				return NULL;
+			}
+			free_data = 1;
+		} else {
+			ndata = stat->total;
+			skip_null = TRUE;
 		}
-		free_data = 1;
 	}
 
 
@@ -440,7 +522,7 @@ imstats* statistics_internal_float(fits *fit, int layer, rectangle *selection, i
 			return NULL;	// not in cache, don't compute
 		}
 		siril_debug_print("- stats %p fit %p (%d): computing median\n", stat, fit, layer);
-		stat->median = histogram_median_float(data, stat->ngoodpix, threads) * stat->normValue;
+		stat->median = histogram_median_float_nocopy(data, ndata, skip_null, FALSE, 0.f, threads) * stat->normValue;
 	}
 
 	/* Calculation of average absolute deviation from the median */
@@ -450,7 +532,7 @@ imstats* statistics_internal_float(fits *fit, int layer, rectangle *selection, i
 			return NULL;	// not in cache, don't compute
 		}
 		siril_debug_print("- stats %p fit %p (%d): computing absdev\n", stat, fit, layer);
-		stat->avgDev = gsl_stats_float_absdev_m(data, 1, stat->ngoodpix, stat->median / stat->normValue) * stat->normValue;
+		stat->avgDev = siril_stats_float_absdev(data, ndata, skip_null, stat->ngoodpix, stat->median / stat->normValue) * stat->normValue;
 	}
 
 	/* Calculation of median absolute deviation */
@@ -460,7 +542,7 @@ imstats* statistics_internal_float(fits *fit, int layer, rectangle *selection, i
 			return NULL;	// not in cache, don't compute
 		}
 		siril_debug_print("- stats %p fit %p (%d): computing mad\n", stat, fit, layer);
-		stat->mad = siril_stats_float_mad(data, stat->ngoodpix, stat->median / stat->normValue, threads, NULL) * stat->normValue;
+		stat->mad = histogram_median_float_nocopy(data, ndata, skip_null, TRUE, (float) (stat->median / stat->normValue), threads) * stat->normValue;
 	}
 
 	/* Calculation of Bidweight Midvariance */
@@ -470,7 +552,7 @@ imstats* statistics_internal_float(fits *fit, int layer, rectangle *selection, i
 			return NULL;	// not in cache, don't compute
 		}
 		siril_debug_print("- stats %p fit %p (%d): computing bimid\n", stat, fit, layer);
-		double bwmv = siril_stats_float_bwmv(data, stat->ngoodpix, stat->mad / stat->normValue, stat->median / stat->normValue, threads);
+		double bwmv = siril_stats_float_bwmv(data, ndata, skip_null, stat->ngoodpix, stat->mad / stat->normValue, stat->median / stat->normValue, threads);
 		stat->sqrtbwmv = sqrt(bwmv) * stat->normValue;
 	}
 
@@ -575,11 +657,10 @@ static double dhampel(double x) {
 	return 0.0;
 }
 
-static double qmedD(int n, double *a)
+static double qmedD_k(int n, double *a, int k)
 	/* Vypocet medianu algoritmem Quick Median (Wirth) */
 {
 	double w;
-	int k = ((n & 1) ? (n / 2) : ((n / 2) - 1));
 	int l = 0;
 	int r = n - 1;
 
@@ -608,6 +689,10 @@ static double qmedD(int n, double *a)
 	return a[k];
 }
 
+static double qmedD(int n, double *a) {
+	return qmedD_k(n, a, (n & 1) ? (n / 2) : ((n / 2) - 1));
+}
+
 static float Qn0(const float sorted_data[], const size_t stride, const size_t n) {
 	const size_t wsize = n * (n - 1) / 2;
 	const size_t n_2 = n / 2;
@@ -764,6 +849,112 @@ int robustmean(int n, const double *x, double *mean, double *stdev)
 	return 0;
 }
 
+/* k-th smallest value of a, found with successive histograms narrowing the
+ * range that contains it, without ordering the values. a is overwritten */
+#define SELECT_BINS 256
+static double histogram_select(double *a, int n, int k) {
+	while (n > 32) {
+		double vmin = a[0], vmax = a[0];
+		for (int i = 1; i < n; i++) {
+			if (a[i] < vmin) vmin = a[i];
+			if (a[i] > vmax) vmax = a[i];
+		}
+		if (vmax == vmin)
+			return vmin;
+		double scale = SELECT_BINS / (vmax - vmin);
+		int counts[SELECT_BINS] = { 0 };
+		for (int i = 0; i < n; i++)
+			counts[min((int)((a[i] - vmin) * scale), SELECT_BINS - 1)]++;
+		int b = 0;
+		while (k >= counts[b])
+			k -= counts[b++];
+		int m = 0;
+		for (int i = 0; i < n; i++)
+			if (min((int)((a[i] - vmin) * scale), SELECT_BINS - 1) == b)
+				a[m++] = a[i];
+		n = m;
+	}
+	return qmedD_k(n, a, k);
+}
+
+/* same estimator as robustmean(), with the median and MAD found by
+ * histogram selection and the Newton iterations run on a histogram of the
+ * values, of width BINS_PER_SIGMA bins per initial scale estimate. It is made
+ * for large samples like photometry annuli, smaller ones use robustmean() */
+#define BINS_PER_SIGMA 16
+#define BINNED_HALF_RANGE 168	// (hampel_c + 2) * BINS_PER_SIGMA
+#define NB_BINS (2 * BINNED_HALF_RANGE + 1)
+
+int robustmean_binned(int n, const double *x, double *mean, double *stdev) {
+	if (n < 2 * NB_BINS)
+		return robustmean(n, x, mean, stdev);
+
+	double *xx = malloc(n * sizeof(double));
+	if (!xx) {
+		PRINT_ALLOC_ERR;
+		return 1;
+	}
+	int k = ((n & 1) ? (n / 2) : ((n / 2) - 1));	// as qmedD
+	memcpy(xx, x, n * sizeof(double));
+	double a = histogram_select(xx, n, k);
+	for (int i = 0; i < n; i++)
+		xx[i] = fabs(x[i] - a);
+	double s = histogram_select(xx, n, k) / 0.6745;
+	free(xx);
+
+	/* almost identical points on input */
+	if (fabs(s) < epsilon(s)) {
+		if (mean)
+			*mean = a;
+		if (stdev) {
+			double sum = 0.0;
+			for (int i = 0; i < n; i++)
+				sum += (x[i] - a) * (x[i] - a);
+			*stdev = sqrt(sum / n);
+		}
+		return 0;
+	}
+
+	/* values further than hampel_c scales from the location have no
+	 * influence, the range kept leaves a margin for its moves */
+	int counts[NB_BINS] = { 0 };
+	double width = s / BINS_PER_SIGMA;
+	double lo = a - (BINNED_HALF_RANGE + 0.5) * width;
+	for (int i = 0; i < n; i++) {
+		double b = (x[i] - lo) / width;
+		if (b >= 0.0 && b < NB_BINS)
+			counts[(int)b]++;
+	}
+
+	double dt = 0;
+	double c = s * s * n * n / (n - 1);
+	for (int it = 1; it <= maxit; it++) {
+		double sum1, sum2, sum3;
+		sum1 = sum2 = sum3 = 0.0;
+		for (int b = 0; b < NB_BINS; b++) {
+			if (!counts[b])
+				continue;
+			double r = (lo + (b + 0.5) * width - a) / s;
+			double psir = hampel(r);
+			sum1 += counts[b] * psir;
+			sum2 += counts[b] * dhampel(r);
+			sum3 += counts[b] * psir * psir;
+		}
+		if (fabs(sum2) < epsilon(sum2))
+			break;
+		double d = s * sum1 / sum2;
+		a = a + d;
+		dt = c * sum3 / (sum2 * sum2);
+		if ((it > 2) && ((d * d < 1e-4 * dt) || (fabs(d) < 10.0 * epsilon(d))))
+			break;
+	}
+	if (mean)
+		*mean = a;
+	if (stdev)
+		*stdev = (dt > 0 ? sqrt(dt) : 0);
+	return 0;
+}
+
 double robust_median_f(fits *fit, rectangle *area, int chan, float lower, float upper) {
 	uint32_t x0, y0, x1,y1;
 	if (area) {
@@ -15,5 +15,6 @@ float siril_stats_robust_mean(const float sorted_data[],
 		const size_t stride, const size_t size, double *deviation);
 
 int robustmean(int n, const double *x, double *mean, double *stdev);
+int robustmean_binned(int n, const double *x, double *mean, double *stdev);
 
 #endif
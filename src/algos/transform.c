@@ -162,7 +162,10 @@ int wavelet_transform_file(float *Imag, int Nl, int Nc,
 			Nbr_Plan)) {
 		return 1;
 	}
+	if (!wave_io_store(File_Name_Transform, &Wavelet))
+		return 0;
 	if (wave_io_write(File_Name_Transform, &Wavelet)) {
+		wave_io_free(&Wavelet);
 		return 1;
 	}
 
@@ -184,7 +187,10 @@ int wavelet_transform_file_float(float *Imag, int Nl, int Nc,
 			Nbr_Plan)) {
 		return 1;
 	}
+	if (!wave_io_store(File_Name_Transform, &Wavelet))
+		return 0;
 	if (wave_io_write(File_Name_Transform, &Wavelet)) {
+		wave_io_free(&Wavelet);
 		return 1;
 	}
 
@@ -227,6 +233,25 @@ int wavelet_transform_float(float *Imag, int Nl, int Nc,
 }
 /*****************************************************************************/
 
+/* replaces Imag by the plan Num_Plan of its transform in Nbr_Plan plans,
+ * without computing and storing the other plans */
+int wavelet_extract_plan(float *Imag, int Nl, int Nc, int Type_Transform,
+		int Nbr_Plan, int Num_Plan) {
+	int Min = (Nl < Nc) ? Nl : Nc;
+	int temp = pow(2., (double) Nbr_Plan + 2.) + 0.5;
+	if (Min < temp || Num_Plan < 0 || Num_Plan >= Nbr_Plan) {
+		siril_log_message(_("wavelet_transform_data: bad plane number\n"));
+		return 1;
+	}
+	if (Type_Transform != TO_PAVE_LINEAR && Type_Transform != TO_PAVE_BSPLINE) {
+		printf("wavelet_transform_data: wrong transform type\n");
+		return 1;
+	}
+	return pave_2d_plan(Imag, Nl, Nc, Nbr_Plan, Num_Plan, Type_Transform);
+}
+
+/*****************************************************************************/
+
 
 int wavelet_transform_data(float *Imag, int Nl, int Nc,
 		wave_transf_des *Wavelet, int Type_Transform, int Nbr_Plan) {
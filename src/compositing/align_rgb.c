@@ -24,6 +24,9 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <math.h>
+#include <complex.h>
+#include <fftw3.h>
 
 #include "core/siril.h"
 #include "gui/utils.h"
@@ -31,6 +34,7 @@
 #include "gui/progress_and_log.h"
 #include "gui/PSF_list.h"
 #include "core/proto.h"
+#include "core/siril_log.h"
 #include "registration/registration.h"
 #include "io/sequence.h"
 #include "io/single_image.h"
@@ -141,6 +145,199 @@ static void compose() {
 	}
 }
 
+/* Direct alignment of the channels of an RGB image on the green channel, by
+ * phase correlation of a square area. The three channels are transformed by a
+ * single batched plan, the plans are kept for the last size and executed on
+ * the buffers of each call, so this can be called from several threads, for
+ * example on each frame of a sequence. */
+static struct {
+	int size;
+	fftwf_plan forward, backward;
+} rgb_dft_plans = { 0, NULL, NULL };
+static GMutex rgb_dft_mutex;
+
+static gboolean get_rgb_dft_plans(int size, float *img, fftwf_complex *spec,
+		fftwf_plan *forward, fftwf_plan *backward) {
+	g_mutex_lock(&rgb_dft_mutex);
+	if (rgb_dft_plans.size != size) {
+		if (rgb_dft_plans.forward)
+			fftwf_destroy_plan(rgb_dft_plans.forward);
+		if (rgb_dft_plans.backward)
+			fftwf_destroy_plan(rgb_dft_plans.backward);
+		int n[2] = { size, size };
+		int specsize = size * (size / 2 + 1);
+		// FFTW_ESTIMATE does not touch the buffers
+		rgb_dft_plans.forward = fftwf_plan_many_dft_r2c(2, n, 3, img, NULL, 1, size * size,
+				spec, NULL, 1, specsize, FFTW_ESTIMATE);
+		rgb_dft_plans.backward = fftwf_plan_many_dft_c2r(2, n, 3, spec, NULL, 1, specsize,
+				img, NULL, 1, size * size, FFTW_ESTIMATE | FFTW_DESTROY_INPUT);
+		rgb_dft_plans.size = (rgb_dft_plans.forward && rgb_dft_plans.backward) ? size : 0;
+	}
+	*forward = rgb_dft_plans.forward;
+	*backward = rgb_dft_plans.backward;
+	gboolean ok = rgb_dft_plans.size == size;
+	g_mutex_unlock(&rgb_dft_mutex);
+	return ok;
+}
+
+/* sub-pixel position of a peak from its two neighbours, fitting a parabola */
+static double parabolic_peak_offset(float left, float centre, float right) {
+	double denom = left - 2.0 * centre + right;
+	if (denom >= 0.0)
+		return 0.0;
+	double offset = 0.5 * (left - right) / denom;
+	return max(-0.5, min(0.5, offset));
+}
+
+/* value of a channel at a non-integer position, 0 outside of the image */
+static float bilinear_sample(const fits *fit, const float *src, double x, double y) {
+	int x0 = (int) floor(x), y0 = (int) floor(y);
+	float wx = (float) (x - x0), wy = (float) (y - y0);
+	float value = 0.f;
+	for (int k = 0; k < 4; k++) {
+		int xx = x0 + (k & 1), yy = y0 + (k >> 1);
+		if (xx < 0 || yy < 0 || xx >= (int) fit->rx || yy >= (int) fit->ry)
+			continue;
+		float w = ((k & 1) ? wx : 1.f - wx) * ((k >> 1) ? wy : 1.f - wy);
+		value += w * src[(size_t) yy * fit->rx + xx];
+	}
+	return value;
+}
+
+/* shifts a channel in place: the pixel at x, y takes the value at x + dx, y + dy */
+static int shift_channel(fits *fit, int channel, double dx, double dy) {
+	const size_t npixels = fit->rx * fit->ry;
+	float *src = malloc(npixels * sizeof(float));
+	if (!src) {
+		PRINT_ALLOC_ERR;
+		return 1;
+	}
+	for (size_t i = 0; i < npixels; i++)
+		src[i] = fit->type == DATA_FLOAT ? fit->fpdata[channel][i] : (float) fit->pdata[channel][i];
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(com.max_thread) schedule(static)
+#endif
+	for (int y = 0; y < (int) fit->ry; y++) {
+		size_t index = (size_t) y * fit->rx;
+		for (int x = 0; x < (int) fit->rx; x++) {
+			float value = bilinear_sample(fit, src, x + dx, y + dy);
+			if (fit->type == DATA_FLOAT)
+				fit->fpdata[channel][index + x] = value;
+			else fit->pdata[channel][index + x] = roundf_to_WORD(value);
+		}
+	}
+	free(src);
+	return 0;
+}
+
+/* Computes the shifts of the red and blue channels relative to the green one
+ * on the square area (in display coordinates) and applies them to fit.
+ * shifts receives dx and dy for each channel, in image rows counted upwards.
+ * Returns 0 on success */
+int rgb_align_dft_fit(fits *fit, const rectangle *area, double shifts[3][2]) {
+	if (fit->naxes[2] != 3 || area->w != area->h || area->w < 8 ||
+			area->x < 0 || area->y < 0 || area->x + area->w > (int) fit->rx ||
+			area->y + area->h > (int) fit->ry)
+		return 1;
+	const int size = area->w;
+	const size_t sqsize = (size_t) size * size;
+	const size_t specsize = (size_t) size * (size / 2 + 1);
+	float *img = fftwf_malloc(3 * sqsize * sizeof(float));
+	fftwf_complex *spec = fftwf_malloc(3 * specsize * sizeof(fftwf_complex));
+	fftwf_plan forward, backward;
+	if (!img || !spec) {
+		PRINT_ALLOC_ERR;
+		fftwf_free(img);
+		fftwf_free(spec);
+		return 1;
+	}
+	if (!get_rgb_dft_plans(size, img, spec, &forward, &backward)) {
+		fftwf_free(img);
+		fftwf_free(spec);
+		return 1;
+	}
+
+	/* the area without its mean, the rows of the display area are stored
+	 * bottom-up in the image */
+	const int y0 = fit->ry - area->y - area->h;
+	for (int c = 0; c < 3; c++) {
+		float *dst = img + c * sqsize;
+		double sum = 0.0;
+		for (int y = 0; y < size; y++) {
+			size_t index = (size_t) (y0 + y) * fit->rx + area->x;
+			for (int x = 0; x < size; x++) {
+				float v = fit->type == DATA_FLOAT ? fit->fpdata[c][index + x] : (float) fit->pdata[c][index + x];
+				dst[y * size + x] = v;
+				sum += v;
+			}
+		}
+		float mean = (float) (sum / sqsize);
+		for (size_t i = 0; i < sqsize; i++)
+			dst[i] -= mean;
+	}
+
+	fftwf_execute_dft_r2c(forward, img, spec);
+	/* normalised cross-power spectra of red and blue with green, the green
+	 * slot is transformed back too but ignored */
+	const fftwf_complex *ref = spec + specsize;
+	for (int c = 0; c < 3; c += 2) {
+		fftwf_complex *cs = spec + c * specsize;
+		for (size_t i = 0; i < specsize; i++) {
+			fftwf_complex cross = cs[i] * conjf(ref[i]);
+			float mag = cabsf(cross);
+			cs[i] = mag > 1e-12f ? cross / mag : 0.f;
+		}
+	}
+	fftwf_execute_dft_c2r(backward, spec, img);
+
+	shifts[GLAYER][0] = shifts[GLAYER][1] = 0.0;
+	for (int c = 0; c < 3; c += 2) {
+		const float *corr = img + c * sqsize;
+		size_t peak = 0;
+		for (size_t i = 1; i < sqsize; i++)
+			if (corr[i] > corr[peak])
+				peak = i;
+		int py = peak / size, px = peak % size;
+		#define CORR(x, y) corr[(size_t) (((y) + size) % size) * size + (((x) + size) % size)]
+		double dx = px + parabolic_peak_offset(CORR(px - 1, py), corr[peak], CORR(px + 1, py));
+		double dy = py + parabolic_peak_offset(CORR(px, py - 1), corr[peak], CORR(px, py + 1));
+		#undef CORR
+		if (dx > size / 2) dx -= size;
+		if (dy > size / 2) dy -= size;
+		shifts[c][0] = dx;
+		shifts[c][1] = dy;
+	}
+	fftwf_free(img);
+	fftwf_free(spec);
+
+	/* the channel is the green one moved by the shift */
+	for (int c = 0; c < 3; c += 2) {
+		if ((shifts[c][0] != 0.0 || shifts[c][1] != 0.0) && shift_channel(fit, c, shifts[c][0], shifts[c][1]))
+			return 1;
+	}
+	invalidate_stats_from_fit(fit);
+	return 0;
+}
+
+static void rgb_align_dft() {
+	struct registration_args regargs = { 0 };
+	double shifts[3][2];
+	initialize_methods();
+	get_the_registration_area(&regargs, reg_methods[1]);
+	set_cursor_waiting(TRUE);
+	if (rgb_align_dft_fit(&gfit, &regargs.selection, shifts)) {
+		set_progress_bar_data(_("Error in channels alignment."), PROGRESS_DONE);
+		set_cursor_waiting(FALSE);
+		return;
+	}
+	siril_log_message(_("Red channel shifted by %.2f, %.2f px, blue channel by %.2f, %.2f px\n"),
+			-shifts[RLAYER][0], -shifts[RLAYER][1], -shifts[BLAYER][0], -shifts[BLAYER][1]);
+	set_progress_bar_data(_("Registration complete."), PROGRESS_DONE);
+	adjust_cutoff_from_updated_gfit();
+	redraw(REMAP_ALL);
+	set_cursor_waiting(FALSE);
+}
+
 int rgb_align(int m) {
 	struct registration_args regargs = { 0 };
 	struct registration_method *method;
@@ -148,6 +345,11 @@ int rgb_align(int m) {
 	int retval1 = 0, retval2 = 0;
 
 	initialize_methods();
+	if (reg_methods[m]->method_ptr == register_shift_dft) {
+		// translations only, the channels are aligned directly
+		rgb_align_dft();
+		return 0;
+	}
 	initialize_internal_rgb_sequence();
 	set_cursor_waiting(TRUE);
 	set_progress_bar_data(NULL, PROGRESS_RESET);
@@ -21,6 +21,9 @@
 #ifndef SRC_COMPOSITING_ALIGN_RGB_H_
 #define SRC_COMPOSITING_ALIGN_RGB_H_
 
+#include "core/siril.h"
+
 void rgb_align(int m);
+int rgb_align_dft_fit(fits *fit, const rectangle *area, double shifts[3][2]);
 
 #endif /* SRC_COMPOSITING_ALIGN_RGB_H_ */
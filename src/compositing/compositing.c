@@ -124,14 +124,11 @@ static void grid_remove_row(int layer, int free_the_row);
 static int has_fit(int layer);
 static int number_of_images_loaded();
 static void update_compositing_registration_interface();
-static float get_composition_pixel_value(int fits_index, int reg_layer, int x, int y);
-static void increment_pixel_components_from_layer_value(int fits_index, GdkRGBA *rgbpixel, float vlayer_pixel_value);
 static void increment_pixel_components_from_layer_saturated_value(int fits_index, GdkRGBA *rgbpixel, float layer_pixel_value);
 static void colors_align_and_compose();		// the rgb procedure
 static void luminance_and_colors_align_and_compose();	// the lrgb procedure
 static void color_has_been_updated(int layer);
 static void update_color_from_saturation(int layer, double newl);
-static void rgb_pixel_limiter(GdkRGBA *pixel);
 static void clear_pixel(GdkRGBA *pixel);
 static void update_result(int and_refresh);
 static void populate_filter_lists();
@@ -1018,43 +1015,135 @@ float get_normalized_pixel_value(int fits_index, float layer_pixel_value) {
 	return tmp;
 }
 
-/* get the pixel value at coordinates x,y for image in layers[fits_index]->the_fit.
- * x and y are given in buffer coordinates, not image coordinates.
- * Handles (not yet - binning and) registration offset */
-static float get_composition_pixel_value(int fits_index, int reg_layer, int x, int y) {
-	int realX = x, realY = y;
-	if (seq && seq->regparam && reg_layer < seq->number && reg_layer >= 0) {
-		double dx = 0.0, dy = 0.0;
+/* A layer prepared for the composition: the registration shift, the
+ * normalization and the colour are resolved once for the whole image instead
+ * of for each pixel */
+struct composition_layer {
+	const float *fdata;
+	const WORD *data;
+	int rx, ry;
+	int dx, dy;		// registration shift in pixels
+	gboolean normalize;
+	float scale, offset;
+	float color[3];
+};
+
+/* fills layer l of the composition from layers[fits_index]. reg_layer is the
+ * index of the image in the internal sequence, -1 if it is not registered */
+static void prepare_composition_layer(struct composition_layer *l, int fits_index, int reg_layer) {
+	fits *fit = &layers[fits_index]->the_fit;
+	l->fdata = fit->type == DATA_FLOAT ? fit->fdata : NULL;
+	l->data = fit->type == DATA_USHORT ? fit->data : NULL;
+	l->rx = fit->rx;
+	l->ry = fit->ry;
+	l->dx = 0;
+	l->dy = 0;
+	if (seq && seq->regparam && reg_layer < seq->number && reg_layer >= 0 &&
+			the_type == SHIFT_TRANSFORMATION) {
 		// Not needed except for shift transformation
-		if (the_type == SHIFT_TRANSFORMATION)
-			translation_from_H(seq->regparam[0][reg_layer].H, &dx, &dy);
-		// all images have one layer, hence the 0 below
-		realX = x - round_to_int(dx);
-		if (realX < 0 || realX >= layers[fits_index]->the_fit.rx) return 0.0f;
-		realY = y - round_to_int(dy);
-		if (realY < 0 || realY >= layers[fits_index]->the_fit.ry) return 0.0f;
-	}
-	float pixel_value;
-	if (layers[fits_index]->the_fit.type == DATA_FLOAT)
-		pixel_value = layers[fits_index]->the_fit.fpdata[0][realX + realY * layers[fits_index]->the_fit.rx];
-	else if (layers[fits_index]->the_fit.type == DATA_USHORT)
-		pixel_value = (float) layers[fits_index]->the_fit.pdata[0][realX + realY * layers[fits_index]->the_fit.rx] / USHRT_MAX_SINGLE;
-	else
-		pixel_value = 0.f;
+		double dx = 0.0, dy = 0.0;
+		translation_from_H(seq->regparam[0][reg_layer].H, &dx, &dy);
+		l->dx = round_to_int(dx);
+		l->dy = round_to_int(dy);
+	}
+	l->normalize = coeff != NULL;
 	if (coeff) {
-		// normalization
-		pixel_value = get_normalized_pixel_value(fits_index, pixel_value);
+		int index = has_fit(0) ? fits_index : fits_index - 1;
+		l->scale = (float) coeff->scale[index];
+		l->offset = (float) coeff->offset[index];
 	}
-	return pixel_value;
+	l->color[RLAYER] = (float) layers[fits_index]->color.red;
+	l->color[GLAYER] = (float) layers[fits_index]->color.green;
+	l->color[BLAYER] = (float) layers[fits_index]->color.blue;
 }
 
-/* increments the color values in rgbpixel from the pixel value for a particular
- * layer. GdkRGBA values are stored in the [0, 1] interval. */
-static void increment_pixel_components_from_layer_value(int fits_index, GdkRGBA *rgbpixel, float layer_pixel_value) {
-	GdkRGBA *layer_color = &layers[fits_index]->color;
-	rgbpixel->red += layer_color->red * layer_pixel_value;
-	rgbpixel->green += layer_color->green * layer_pixel_value;
-	rgbpixel->blue += layer_color->blue * layer_pixel_value;
+/* gets the values of row y of the result from a composition layer in row,
+ * 0 outside of the shifted layer */
+static void get_composition_row(const struct composition_layer *l, int y, int width, float *row) {
+	memset(row, 0, width * sizeof(float));
+	int sy = y - l->dy;
+	if (sy < 0 || sy >= l->ry || (!l->fdata && !l->data))
+		return;
+	int xstart = max(0, l->dx), xend = min(width, l->rx + l->dx);
+	size_t offset = (size_t) sy * l->rx - l->dx;
+	if (l->fdata) {
+		const float *src = l->fdata + offset;
+		for (int x = xstart; x < xend; x++)
+			row[x] = src[x];
+	} else {
+		const WORD *src = l->data + offset;
+		for (int x = xstart; x < xend; x++)
+			row[x] = src[x] / USHRT_MAX_SINGLE;
+	}
+	if (l->normalize) {
+		for (int x = xstart; x < xend; x++)
+			row[x] = row[x] * l->scale - l->offset;
+	}
+}
+
+/* composes row y of the colour layers in gfit, using tmp as a row buffer.
+ * When summing all layers to get the RGB values for one pixel, it may
+ * overflow, the values are limited to 1 */
+static void compose_color_row(const struct composition_layer *clayers, int nb_layers, int y, float *tmp) {
+	const int width = gfit.rx;
+	float *out[3];
+	for (int c = 0; c < 3; c++) {
+		out[c] = gfit.fpdata[c] + (size_t) y * width;
+		memset(out[c], 0, width * sizeof(float));
+	}
+	for (int i = 0; i < nb_layers; i++) {
+		const struct composition_layer *l = clayers + i;
+		get_composition_row(l, y, width, tmp);
+		for (int c = 0; c < 3; c++) {
+			const float color = l->color[c];
+			if (color == 0.f)
+				continue;
+			float *o = out[c];
+			for (int x = 0; x < width; x++)
+				o[x] += color * max(tmp[x], 0.f);
+		}
+	}
+	for (int c = 0; c < 3; c++) {
+		float *o = out[c];
+		for (int x = 0; x < width; x++)
+			o[x] = min(o[x], 1.f);
+	}
+}
+
+/* prepares the loaded colour layers, returns their number */
+static int prepare_color_layers(struct composition_layer *clayers, gboolean use_sequence_index) {
+	int nb = 0;
+	for (int layer = 1; layers[layer]; layer++) {
+		if (has_fit(layer)) {
+			int reg_layer = layer;
+			if (use_sequence_index)
+				reg_layer = seq ? internal_sequence_find_index(seq, &layers[layer]->the_fit) : -1;
+			prepare_composition_layer(clayers + nb, layer, reg_layer);
+			nb++;
+		}
+	}
+	return nb;
+}
+
+/* per-thread row buffers for the composition */
+static float *alloc_composition_rows(int nb_rows, int *nb_threads) {
+#ifdef _OPENMP
+	*nb_threads = com.max_thread;
+#else
+	*nb_threads = 1;
+#endif
+	float *rows = malloc((size_t) *nb_threads * nb_rows * gfit.rx * sizeof(float));
+	if (!rows)
+		PRINT_ALLOC_ERR;
+	return rows;
+}
+
+static int get_composition_thread() {
+#ifdef _OPENMP
+	return omp_get_thread_num();
+#else
+	return 0;
+#endif
 }
 
 /* increments the color values in rgbpixel from the saturated pixel value for a
@@ -1144,7 +1233,6 @@ void on_composition_combo_coloringtype_changed(GtkComboBox *widget, gpointer use
 /* Image composition without luminance. Used for RGB composition for example.
  * Result is in gfit. */
 static void colors_align_and_compose() {
-	int x, y;
 	if (no_color_available()) return;
 	// Sort the date_obs and pic the earliest one
 	GList *date_obs_list = NULL;
@@ -1176,30 +1264,20 @@ static void colors_align_and_compose() {
 	}
 	g_list_free(date_obs_list);
 	fprintf(stdout, "colour layers only composition\n");
+	struct composition_layer clayers[MAX_LAYERS];
+	int nb_layers = prepare_color_layers(clayers, TRUE);
+	int nb_threads;
+	float *rows = alloc_composition_rows(1, &nb_threads);
+	if (!rows)
+		return;
 #ifdef _OPENMP
-#pragma omp parallel for num_threads(com.max_thread) private(y,x) schedule(static)
+#pragma omp parallel for num_threads(nb_threads) schedule(static)
 #endif
-	for (y = 0; y < gfit.ry; ++y) {
-		for (x = 0; x < gfit.rx; ++x) {
-			int layer;
-			GdkRGBA pixel;
-			clear_pixel(&pixel);
-			for (layer = 1; layers[layer]; layer++) {
-				if (has_fit(layer)) {
-					int reg_layer = seq ? internal_sequence_find_index(seq, &layers[layer]->the_fit) : -1;
-					float layer_value = get_composition_pixel_value(layer, reg_layer, x, y);
-					if (layer_value > 0.0f)
-						increment_pixel_components_from_layer_value(layer, &pixel, layer_value);
-				}
-			}
-
-			rgb_pixel_limiter(&pixel);
-			size_t dst_index = y * gfit.rx + x;
-			gfit.fpdata[RLAYER][dst_index] = pixel.red;
-			gfit.fpdata[GLAYER][dst_index] = pixel.green;
-			gfit.fpdata[BLAYER][dst_index] = pixel.blue;
-		}
+	for (int y = 0; y < gfit.ry; ++y) {
+		float *tmp = rows + (size_t) get_composition_thread() * gfit.rx;
+		compose_color_row(clayers, nb_layers, y, tmp);
 	}
+	free(rows);
 }
 
 /* This function fills the data in the gfit image with LRGB information from
@@ -1208,7 +1286,6 @@ static void colors_align_and_compose() {
 static void luminance_and_colors_align_and_compose() {
 	/* Each pixel is transformed from RGB to HSI, I is replaced by the
 	 * luminance layer's value and transformed back to RGB. */
-	guint x, y;
 	assert(has_fit(0));
 	// Copy the date_obs field from the luminance layer
 	if (layers[0]->the_fit.keywords.date_obs) {
@@ -1232,61 +1309,66 @@ static void luminance_and_colors_align_and_compose() {
 	image_find_minmax(&layers[0]->the_fit);
 	double norm = (double)(layers[0]->the_fit.maxi);
 
+	struct composition_layer clayers[MAX_LAYERS], luminance;
+	int nb_layers = prepare_color_layers(clayers, FALSE);
+	prepare_composition_layer(&luminance, 0, 0);
+	int nb_threads;
+	float *rows = alloc_composition_rows(2, &nb_threads);
+	if (!rows)
+		return;
+
 #ifdef _OPENMP
-#pragma omp parallel for num_threads(com.max_thread) private(y,x) schedule(static)
+#pragma omp parallel for num_threads(nb_threads) schedule(static)
 #endif
-	for (y = 0; y < gfit.ry; y++) {
-		for (x = 0; x < gfit.rx; x++) {
-			int layer;
+	for (guint y = 0; y < gfit.ry; y++) {
+		float *tmp = rows + (size_t) get_composition_thread() * 2 * gfit.rx;
+		float *lum = tmp + gfit.rx;
+		/* get color information */
+		compose_color_row(clayers, nb_layers, y, tmp);
+		get_composition_row(&luminance, y, gfit.rx, lum);
+		size_t index = (size_t) y * gfit.rx;
+		float *r = gfit.fpdata[RLAYER] + index;
+		float *g = gfit.fpdata[GLAYER] + index;
+		float *b = gfit.fpdata[BLAYER] + index;
+		for (guint x = 0; x < gfit.rx; x++) {
 			gdouble h, s, i;
 			gdouble X, Y, Z;
-			gdouble a, b;
-			/* get color information */
-			GdkRGBA pixel;
-			clear_pixel(&pixel);
-			for (layer = 1; layers[layer]; layer++) {
-				if (has_fit(layer)) {
-					float layer_value = get_composition_pixel_value(layer, layer, x, y);
-					if (layer_value > 0.0f)
-						increment_pixel_components_from_layer_value(layer, &pixel, layer_value);
-				}
-			}
-			rgb_pixel_limiter(&pixel);
+			gdouble A, B;
+			gdouble red, green, blue;
 
 			switch (coloring_type) {
 			case HSL:
-				rgb_to_hsl(pixel.red, pixel.green, pixel.blue, &h, &s, &i);
+				rgb_to_hsl(r[x], g[x], b[x], &h, &s, &i);
 				/* add luminance by replacing it in the HSI */
-				i = (double) get_composition_pixel_value(0, 0, x, y) / norm;
+				i = (double) lum[x] / norm;
 				/* converting back to RGB */
-				hsl_to_rgb(h, s, i, &pixel.red, &pixel.green, &pixel.blue);
+				hsl_to_rgb(h, s, i, &red, &green, &blue);
 				break;
 			case HSV:
-				rgb_to_hsv(pixel.red, pixel.green, pixel.blue, &h, &s, &i);
+				rgb_to_hsv(r[x], g[x], b[x], &h, &s, &i);
 				/* add luminance by replacing it in the HSI */
-				i = (double) get_composition_pixel_value(0, 0, x, y) / norm;
+				i = (double) lum[x] / norm;
 				/* converting back to RGB */
-				hsv_to_rgb(h, s, i, &pixel.red, &pixel.green, &pixel.blue);
+				hsv_to_rgb(h, s, i, &red, &green, &blue);
 				break;
 			case CIELAB:
-				rgb_to_xyz(pixel.red, pixel.green, pixel.blue, &X, &Y, &Z);
-				xyz_to_LAB(X, Y, Z, &i, &a, &b);
-				i = (double) get_composition_pixel_value(0, 0, x, y) / norm;
+			default:
+				rgb_to_xyz(r[x], g[x], b[x], &X, &Y, &Z);
+				xyz_to_LAB(X, Y, Z, &i, &A, &B);
+				i = (double) lum[x] / norm;
 				i *= 100.0;		// 0 < L < 100
-				LAB_to_xyz(i, a, b, &X, &Y, &Z);
-				xyz_to_rgb(X, Y, Z, &pixel.red, &pixel.green, &pixel.blue);
+				LAB_to_xyz(i, A, B, &X, &Y, &Z);
+				xyz_to_rgb(X, Y, Z, &red, &green, &blue);
 				break;
 			}
 
-			rgb_pixel_limiter(&pixel);
-
 			/* and store in gfit */
-			size_t dst_index = y * gfit.rx + x;
-			gfit.fpdata[RLAYER][dst_index] = pixel.red;
-			gfit.fpdata[GLAYER][dst_index] = pixel.green;
-			gfit.fpdata[BLAYER][dst_index] = pixel.blue;
+			r[x] = (float) min(red, 1.0);
+			g[x] = (float) min(green, 1.0);
+			b[x] = (float) min(blue, 1.0);
 		}
 	}
+	free(rows);
 }
 
 void on_compositing_cancel_clicked(GtkButton *button, gpointer user_data){
@@ -1301,22 +1383,6 @@ void on_composition_dialog_hide(GtkWidget *widget, gpointer   user_data) {
 	}
 }
 
-/* When summing all layers to get the RGB values for one pixel, it may overflow.
- * This procedure defines what happens in that case. */
-static void rgb_pixel_limiter(GdkRGBA *pixel) {
-#ifdef DEBUG
-	if (pixel->red > 1.2f || pixel->green > 1.2f || pixel->blue > 1.2f)
-		fprintf(stdout, "large overflow %g,%g,%g\n", pixel->red,
-				pixel->green, pixel->blue);
-#endif
-	if (pixel->red >= 1.0f)
-		pixel->red = 1.0f;
-	if (pixel->green >= 1.0f)
-		pixel->green = 1.0f;
-	if (pixel->blue >= 1.0f)
-		pixel->blue = 1.0f;
-}
-
 /* initializes a GdkRGBA to black */
 static void clear_pixel(GdkRGBA *pixel) {
 	pixel->red = 0.0f;
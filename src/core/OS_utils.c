@@ -30,6 +30,7 @@
 #include <string.h>
 #include <fcntl.h>
 #include <errno.h>
+#include <glib/gstdio.h>
 
 #ifdef _WIN32
 #include <windows.h>
@@ -49,6 +50,11 @@
 #if defined(__unix__) || defined(OS_OSX)
 #include <sys/param.h>		// define or not BSD macro
 #endif
+#if defined(__linux__)
+#include <sched.h>
+#include <sys/vfs.h>
+#include <linux/magic.h>
+#endif
 #ifdef OS_OSX
 #include <AppKit/AppKit.h>
 #include <mach/task.h>
@@ -73,6 +79,8 @@
 #include "core/siril.h"
 #include "core/proto.h"
 #include "core/siril_log.h"
+#include "core/processing_tasks.h"
+#include "io/frame_cache.h"
 #include "gui/utils.h"
 #include "gui/progress_and_log.h"
 #include "gui/message_dialog.h"
@@ -207,10 +215,8 @@ static guint64 get_used_RAM_memory() {
 	if (fd < 0)
 		return (guint64) 0;
 
-	if (lseek(fd, 0, SEEK_SET))
-		return (guint64) 0;
-
-	size = read(fd, buffer, sizeof(buffer) - 1);
+	// pread does not move the offset, the memory sampler reads it in parallel
+	size = pread(fd, buffer, sizeof(buffer) - 1, 0);
 
 	if (size <= 0)
 		return (guint64) 0;
@@ -545,6 +551,7 @@ int get_available_cpu_cgroups() {
 #endif
 
 void init_num_procs() {
+	init_numa_topology();
 	/* Get CPU number and set the number of threads */
 #ifdef _OPENMP
 	int num_proc = (int) g_get_num_processors();
@@ -560,6 +567,9 @@ void init_num_procs() {
 		siril_log_message(_("Using cgroups limit on the number of processors: %d\n"), cgroups_num_proc);
 		com.max_thread = cgroups_num_proc;
 	}
+	if (get_numa_node_count() > 1)
+		siril_log_message(_("%d NUMA nodes detected, stacking threads will be spread over them.\n"),
+				get_numa_node_count());
 	omp_set_max_active_levels(INT_MAX);
 	int max_levels_supported = omp_get_max_active_levels();
 	int supports_nesting = max_levels_supported > 1;
@@ -574,6 +584,93 @@ void init_num_procs() {
 #endif
 }
 
+#if defined(__linux__)
+/* NUMA topology, from /sys/devices/system/node: the CPUs of each memory node
+ * that the process is allowed to use, and the CPUs of the process, to restore
+ * the affinity of the threads that were bound to a node */
+static int numa_nb_nodes = 0;
+static cpu_set_t *numa_node_cpus = NULL;
+static cpu_set_t process_cpus;
+
+static gboolean parse_cpu_list(const gchar *list, cpu_set_t *set) {
+	CPU_ZERO(set);
+	gchar **ranges = g_strsplit(list, ",", -1);
+	for (int i = 0; ranges[i]; i++) {
+		int first, last;
+		int n = sscanf(ranges[i], "%d-%d", &first, &last);
+		if (n == 1)
+			last = first;
+		else if (n != 2)
+			continue;
+		for (int cpu = max(first, 0); cpu <= last && cpu < CPU_SETSIZE; cpu++)
+			CPU_SET(cpu, set);
+	}
+	g_strfreev(ranges);
+	return CPU_COUNT(set) > 0;
+}
+
+static void init_numa_topology() {
+	if (sched_getaffinity(0, sizeof(cpu_set_t), &process_cpus))
+		return;
+	GDir *dir = g_dir_open("/sys/devices/system/node", 0, NULL);
+	if (!dir)
+		return;
+	GArray *nodes = g_array_new(FALSE, FALSE, sizeof(cpu_set_t));
+	const gchar *name;
+	while ((name = g_dir_read_name(dir))) {
+		int node;
+		if (sscanf(name, "node%d", &node) != 1)
+			continue;
+		gchar *path = g_strdup_printf("/sys/devices/system/node/%s/cpulist", name);
+		gchar *content = NULL;
+		cpu_set_t cpus, usable;
+		if (g_file_get_contents(path, &content, NULL, NULL) &&
+				parse_cpu_list(g_strstrip(content), &cpus)) {
+			CPU_AND(&usable, &cpus, &process_cpus);
+			// nodes without CPUs for us, memory-only or excluded by a cpuset
+			if (CPU_COUNT(&usable) > 0)
+				g_array_append_val(nodes, usable);
+		}
+		g_free(content);
+		g_free(path);
+	}
+	g_dir_close(dir);
+	numa_nb_nodes = nodes->len;
+	numa_node_cpus = (cpu_set_t *) g_array_free(nodes, FALSE);
+}
+
+int get_numa_node_count() {
+	return numa_nb_nodes;
+}
+
+/* binds the calling thread to the CPUs of a node, the memory it touches first
+ * is then allocated on that node */
+gboolean numa_bind_current_thread(int node) {
+	if (numa_nb_nodes < 2)
+		return FALSE;
+	return !sched_setaffinity(0, sizeof(cpu_set_t), &numa_node_cpus[node % numa_nb_nodes]);
+}
+
+void numa_unbind_current_thread() {
+	if (numa_nb_nodes > 1)
+		sched_setaffinity(0, sizeof(cpu_set_t), &process_cpus);
+}
+#else
+static void init_numa_topology() {
+}
+
+int get_numa_node_count() {
+	return 0;
+}
+
+gboolean numa_bind_current_thread(int node) {
+	return FALSE;
+}
+
+void numa_unbind_current_thread() {
+}
+#endif
+
 /**
  * Gets available memory in bytes.
  * @return available memory in Bytes, 0 if it fails.
@@ -744,11 +841,14 @@ guint64 get_available_memory() {
 }
 
 /**
- * Get max memory depending on memory management mode
+ * Get max memory depending on memory management mode, the share of the task
+ * for the threads working for a processing task
  * @return return the max memory
  */
 int get_max_memory_in_MB() {
-	int retval;
+	int retval = processing_task_max_memory_in_MB();
+	if (retval > 0)
+		return retval;
 	switch (com.pref.mem_mode) {
 		default:
 		case RATIO:
@@ -756,7 +856,10 @@ int get_max_memory_in_MB() {
 					(double)get_available_memory() / BYTES_IN_A_MB);
 			break;
 		case AMOUNT:
-			retval = round_to_int(com.pref.memory_amount * 1024.0);
+			/* the memory of the frame cache is already taken from the
+			 * available memory of the ratio */
+			retval = max(round_to_int(com.pref.memory_amount * 1024.0 -
+						(double)frame_cache_get_used() / BYTES_IN_A_MB), 0);
 	}
 	if (sizeof(void *) == 4 && retval > 1900) {
 		siril_log_message(_("Limiting processing to 1900 MiB allocations (32-bit system)\n"));
@@ -858,6 +961,89 @@ gboolean allow_to_open_files(int nb_frames, int *nb_allowed_file) {
 	return nb_frames < maxfile;
 }
 
+/**
+ * Get the modification time and size of a file, the time with the resolution
+ * of the file system, so that a file rewritten in the same second is seen as
+ * modified.
+ * @param path the file
+ * @param mtime the modification time in nanoseconds since the epoch
+ * @param size the size in bytes
+ * @return 0 on success, 1 if the file cannot be read
+ */
+int get_file_state(const char *path, gint64 *mtime, gint64 *size) {
+#ifdef _WIN32
+	WIN32_FILE_ATTRIBUTE_DATA attr;
+	wchar_t *wpath = g_utf8_to_utf16(path, -1, NULL, NULL, NULL);
+	BOOL ok = wpath && GetFileAttributesExW(wpath, GetFileExInfoStandard, &attr);
+	g_free(wpath);
+	if (!ok)
+		return 1;
+	/* FILETIME counts 100 ns intervals since 1601 */
+	guint64 ticks = ((guint64) attr.ftLastWriteTime.dwHighDateTime << 32) | attr.ftLastWriteTime.dwLowDateTime;
+	*mtime = ((gint64) ticks - G_GINT64_CONSTANT(116444736000000000)) * 100;
+	*size = ((gint64) attr.nFileSizeHigh << 32) | attr.nFileSizeLow;
+#else
+	GStatBuf st;
+	if (g_stat(path, &st))
+		return 1;
+#ifdef __APPLE__
+	*mtime = (gint64) st.st_mtimespec.tv_sec * G_GINT64_CONSTANT(1000000000) + st.st_mtimespec.tv_nsec;
+#else
+	*mtime = (gint64) st.st_mtim.tv_sec * G_GINT64_CONSTANT(1000000000) + st.st_mtim.tv_nsec;
+#endif
+	*size = (gint64) st.st_size;
+#endif
+	return 0;
+}
+
+/* TRUE if path is on a file system kept in memory. The user runtime directory
+ * is a tmpfs on Linux with systemd, it is a cache directory on disk on macOS,
+ * Windows and without XDG_RUNTIME_DIR */
+static gboolean is_memory_backed(const gchar *path) {
+#if defined(__linux__)
+	struct statfs st;
+	if (statfs(path, &st))
+		return FALSE;
+	return st.f_type == TMPFS_MAGIC || st.f_type == RAMFS_MAGIC;
+#else
+	return FALSE;
+#endif
+}
+
+/**
+ * Creates a private directory in the user runtime directory to exchange the
+ * files of each frame of a sequence with an external program, if the runtime
+ * directory is in memory.
+ * @param prefix name of the program, for the name of the directory
+ * @return the path of the directory, to remove with siril_remove_exchange_dir(),
+ * or NULL if the files must be exchanged in the working directory
+ */
+gchar *siril_create_exchange_dir(const gchar *prefix) {
+	const gchar *runtime_dir = g_get_user_runtime_dir();
+	if (!is_memory_backed(runtime_dir)) {
+		siril_debug_print("%s is not in memory, using the working directory for %s\n", runtime_dir, prefix);
+		return NULL;
+	}
+	gchar *name = g_strdup_printf("siril-%s-XXXXXX", prefix);
+	gchar *dir = g_build_filename(runtime_dir, name, NULL);
+	g_free(name);
+	if (!g_mkdtemp(dir)) {
+		siril_debug_print("could not create the %s exchange directory, using the working directory\n", prefix);
+		g_free(dir);
+		return NULL;
+	}
+	return dir;
+}
+
+/* removes the empty directory created by siril_create_exchange_dir() and frees dir */
+void siril_remove_exchange_dir(gchar *dir) {
+	if (!dir)
+		return;
+	if (g_rmdir(dir))
+		siril_debug_print("could not remove the exchange directory %s\n", dir);
+	g_free(dir);
+}
+
 GInputStream *siril_input_stream_from_stdin() {
 	GInputStream *input_stream = NULL;
 #ifdef _WIN32
@@ -958,6 +1144,13 @@ char* siril_real_path(const char *source) {
 }
 #endif
 
+/**
+ * Returns the resident memory of the process in bytes, 0 if unknown.
+ */
+guint64 get_used_memory() {
+	return get_used_RAM_memory();
+}
+
 // for debug purposes
 void log_used_mem(gchar *when) {
 	guint64 used = get_used_RAM_memory();
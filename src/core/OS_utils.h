@@ -33,6 +33,7 @@ gboolean update_displayed_memory();
 int test_available_space(gint64 req_size);
 
 guint64 get_available_memory();
+guint64 get_used_memory();
 int get_max_memory_in_MB();
 void log_used_mem(gchar *when);
 
@@ -40,6 +41,11 @@ int get_available_cpu_cgroups();
 
 void init_num_procs();
 
+/* NUMA nodes with CPUs usable by the process, 0 if unknown */
+int get_numa_node_count();
+gboolean numa_bind_current_thread(int node);
+void numa_unbind_current_thread();
+
 long get_pathmax(void);
 
 GInputStream *siril_input_stream_from_stdin();
@@ -52,6 +58,12 @@ char* siril_real_path(const char *source);
 
 gboolean allow_to_open_files(int nb_frames, int *nb_allowed_file);
 
+/* modification time in nanoseconds and size of a file */
+int get_file_state(const char *path, gint64 *mtime, gint64 *size);
+
+gchar *siril_create_exchange_dir(const gchar *prefix);
+void siril_remove_exchange_dir(gchar *dir);
+
 #ifdef __cplusplus
 }
 #endif
@@ -22,11 +22,13 @@
 #include <stdio.h>
 #include <math.h>
 #include <complex.h>
+#include <float.h>
 #include <fftw3.h>
 
 #include "core/siril.h"
 #include "core/proto.h"
 #include "core/siril_log.h"
+#include "core/cpu_dispatch.h"
 #include "algos/statistics.h"
 #include "gui/message_dialog.h"
 #include "gui/progress_and_log.h"
@@ -34,6 +36,7 @@
 #include "io/image_format_fits.h"
 
 #include "arithm.h"
+#include "pixel_kernels.h"
 
 /*****************************************************************************
  *       S I R I L      A R I T H M E T I C      O P E R A T I O N S         *
@@ -88,42 +91,14 @@ static int soper_ushort_to_ushort(fits *a, float scalar, image_operator oper) {
 static int soper_ushort_to_float(fits *a, float scalar, image_operator oper) {
 	if (!a) return 1;
 	if (!a->data) return 1;
-	WORD *data = NULL;
-	float *result= NULL;
-	size_t i, n = a->naxes[0] * a->naxes[1] * a->naxes[2];
+	size_t n = a->naxes[0] * a->naxes[1] * a->naxes[2];
 	if (!n) return 1;
-	data = a->data;
-	result = malloc(n * sizeof(float));
+	float *result = malloc(n * sizeof(float));
 	if (!result) {
 		PRINT_ALLOC_ERR;
 		return 1;
 	}
-	if (oper == OPER_DIV) {
-		scalar = 1.0f / scalar;
-		oper = OPER_MUL;
-	}
-
-	switch (oper) {
-		case OPER_ADD:
-			for (i = 0; i < n; ++i) {
-				float pixel = ushort_to_float_bitpix(a, data[i]);
-				result[i] = pixel + scalar;
-			}
-			break;
-		case OPER_SUB:
-			for (i = 0; i < n; ++i) {
-				float pixel = ushort_to_float_bitpix(a, data[i]);
-				result[i] = pixel - scalar;
-			}
-			break;
-		case OPER_MUL:
-		default:
-			for (i = 0; i < n; ++i) {
-				float pixel = ushort_to_float_bitpix(a, data[i]);
-				result[i] = pixel * scalar;
-			}
-			break;
-	}
+	kernel_soper_to_float(a, result, oper, scalar);
 	fit_replace_buffer(a, result, DATA_FLOAT);
 	return 0;
 }
@@ -150,32 +125,9 @@ int soper_unscaled_div_ushort_to_float(fits *a, int scalar) {
 static int soper_float(fits *a, float scalar, image_operator oper) {
 	if (!a) return 1;
 	if (!a->fdata) return 1;
-	float *data = a->fdata;
-	size_t i, n = a->naxes[0] * a->naxes[1] * a->naxes[2];
+	size_t n = a->naxes[0] * a->naxes[1] * a->naxes[2];
 	if (!n) return 1;
-	if (oper == OPER_DIV) {
-		scalar = 1.0f / scalar;
-		oper = OPER_MUL;
-	}
-
-	switch (oper) {
-		case OPER_ADD:
-			for (i = 0; i < n; ++i) {
-				data[i] = data[i] + scalar;
-			}
-			break;
-		case OPER_SUB:
-			for (i = 0; i < n; ++i) {
-				data[i] = data[i] - scalar;
-			}
-			break;
-		case OPER_MUL:
-		default:
-			for (i = 0; i < n; ++i) {
-				data[i] = data[i] * scalar;
-			}
-			break;
-	}
+	kernel_soper_to_float(a, a->fdata, oper, scalar);
 	invalidate_stats_from_fit(a);
 	return 0;
 }
@@ -203,112 +155,18 @@ static int imoper_to_ushort(fits *a, fits *b, image_operator oper, float factor)
 	if (!a) return 1;
 	if (!a->data) return 1;
 	if (!b) return 1;
-	size_t i, n = a->naxes[0] * a->naxes[1] * a->naxes[2];
+	size_t n = a->naxes[0] * a->naxes[1] * a->naxes[2];
 	if (!n) return 1;
 	if (memcmp(a->naxes, b->naxes, sizeof a->naxes)) {
 		siril_log_color_message(_("Images must have same dimensions.\n"), "red");
 		return 1;
 	}
 
-	if (b->type == DATA_USHORT) {
-		if (!b->data) return 1;
-		WORD *abuf = a->data, *bbuf = b->data;
-		if (oper == OPER_DIV) {
-			for (i = 0; i < n; ++i) {
-				if (bbuf[i] == 0)
-					abuf[i] = 0;
-				else {
-					float aval = (float) abuf[i];
-					float bval = (float) bbuf[i];
-					if (factor != 1.0f)
-						abuf[i] = roundf_to_WORD(factor * (aval / bval));
-					else
-						abuf[i] = roundf_to_WORD(aval / bval);
-				}
-			}
-		} else if (oper == OPER_MUL) {
-			for (i = 0; i < n; ++i) {
-				if (bbuf[i] == 0)
-					abuf[i] = 0;
-				else {
-					float aval = (float) abuf[i];
-					float bval = (float) bbuf[i];
-					if (factor != 1.0f)
-						abuf[i] = roundf_to_WORD(factor * (aval * bval));
-					else
-						abuf[i] = roundf_to_WORD(aval * bval);
-				}
-			}
-		} else {
-			for (i = 0; i < n; ++i) {
-				int aval = (int) abuf[i];
-				int bval = (int) bbuf[i];
-				switch (oper) {
-				case OPER_ADD:
-					abuf[i] = truncate_to_WORD(aval + bval);
-					break;
-				case OPER_SUB:
-					abuf[i] = truncate_to_WORD(aval - bval);
-					break;
-				default:	// OPER_MUL, OPER_DIV handled above
-					break;
-				}
-
-				if (factor != 1.0f)
-					abuf[i] = roundf_to_WORD(factor * (float) abuf[i]);
-			}
-		}
-	} else if (b->type == DATA_FLOAT) {
-		if (!b->fdata) return 1;
-		WORD *abuf = a->data;
-		float *bbuf = b->fdata;
-		float norm = (a->bitpix == BYTE_IMG) ? UCHAR_MAX_SINGLE : USHRT_MAX_SINGLE;
+	if (b->type == DATA_USHORT && !b->data) return 1;
+	if (b->type == DATA_FLOAT && !b->fdata) return 1;
+	if (!(b->type == DATA_FLOAT || b->type == DATA_USHORT)) return 1;
 
-		if (oper == OPER_DIV) {
-			for (i = 0; i < n; ++i) {
-				if (bbuf[i] == 0.f)
-					abuf[i] = 0;
-				else {
-					float aval = (float) abuf[i];
-					float bval = bbuf[i] * norm;
-					if (factor != 1.0f)
-						abuf[i] = roundf_to_WORD(factor * (aval / bval));
-					else
-						abuf[i] = roundf_to_WORD(aval / bval);
-				}
-			}
-		} else if (oper == OPER_MUL) {
-			for (i = 0; i < n; ++i) {
-				if (bbuf[i] == 0.f)
-					abuf[i] = 0;
-				else {
-					float aval = (float) abuf[i];
-					float bval = bbuf[i] * norm;
-					if (factor != 1.0f)
-						abuf[i] = roundf_to_WORD(factor * (aval * bval));
-					else
-						abuf[i] = roundf_to_WORD(aval * bval);
-				}
-			}
-		} else {
-			for (i = 0; i < n; ++i) {
-				int aval = (int) abuf[i];
-				int bval = roundf_to_int(bbuf[i] * norm);
-				switch (oper) {
-				case OPER_ADD:
-					abuf[i] = truncate_to_WORD(aval + bval);
-					break;
-				case OPER_SUB:
-					abuf[i] = truncate_to_WORD(aval - bval);
-					break;
-				default:	// OPER_MUL and OPER_DIV handled above
-					break;
-				}
-				if (factor != 1.0f)
-					abuf[i] = roundf_to_WORD(factor * (float) abuf[i]);
-			}
-		}
-	}
+	kernel_imoper_to_ushort(a, b, oper, factor);
 	invalidate_stats_from_fit(a);
 	a->neg_ratio = 0.0f;
 	return 0;
@@ -343,34 +201,7 @@ int imoper_to_float(fits *a, fits *b, image_operator oper, float factor) {
 	if (b->type == DATA_FLOAT && (!b->fdata)) { free(result); return 1; }
 	if (!(b->type == DATA_FLOAT || b->type == DATA_USHORT)) { free(result); return 1; }
 
-	size_t nb_negative = 0;
-	for (size_t i = 0; i < n; ++i) {
-		float aval = a->type == DATA_USHORT ? ushort_to_float_bitpix(a, a->data[i]) : a->fdata[i];
-		float bval = b->type == DATA_USHORT ? ushort_to_float_bitpix(b, b->data[i]) : b->fdata[i];
-		switch (oper) {
-			case OPER_ADD:
-				result[i] = aval + bval;
-				break;
-			case OPER_SUB:
-				result[i] = aval - bval;
-				break;
-			case OPER_MUL:
-				result[i] = aval * bval;
-				break;
-			case OPER_DIV:
-				if (bval == 0.0f)
-					result[i] = 0.0f;
-				else result[i] = aval / bval;
-		}
-		if (factor != 1.0f)
-			result[i] *= factor;
-		if (result[i] > 1.0f)	// should we truncate by default?
-			result[i] = 1.0f;
-		if (result[i] < -1.0f)	// Here we want to clip all garbages pixels.
-			result[i] = 0.0f;
-		if (result[i] < 0.0f)
-			nb_negative++;
-	}
+	size_t nb_negative = kernel_imoper_to_float(a, b, result, oper, factor);
 	a->neg_ratio = (float)((double)nb_negative / n);
 	if (a->type == DATA_USHORT)
 		fit_replace_buffer(a, result, DATA_FLOAT);
@@ -404,6 +235,283 @@ int siril_fdiv(fits *a, fits *b, float coef, gboolean allow_32bits) {
 	return imoper_with_factor(a, b, OPER_DIV, coef, allow_32bits);
 }
 
+#define ARITH_BLOCK 2048
+
+/* loads len pixels from start of an image in [0, 1] as float */
+static void arith_load_block(float *dst, const fits *f, size_t start, size_t len) {
+	if (f->type == DATA_USHORT) {
+		const WORD *src = f->data + start;
+		// same as ushort_to_float_bitpix()
+		const float norm = f->orig_bitpix == BYTE_IMG ? INV_UCHAR_MAX_SINGLE : INV_USHRT_MAX_SINGLE;
+#ifdef _OPENMP
+#pragma omp simd
+#endif
+		for (size_t k = 0; k < len; k++)
+			dst[k] = (float)src[k] * norm;
+	} else {
+		memcpy(dst, f->fdata + start, len * sizeof(float));
+	}
+}
+
+void arith_chain_init(struct arith_chain *chain) {
+	chain->nb_steps = 0;
+}
+
+static struct arith_step *arith_chain_new_step(struct arith_chain *chain) {
+	if (chain->nb_steps >= ARITH_CHAIN_MAX_STEPS) {
+		siril_debug_print("arithmetic chain is full\n");
+		return NULL;
+	}
+	struct arith_step *step = &chain->steps[chain->nb_steps++];
+	memset(step, 0, sizeof(struct arith_step));
+	return step;
+}
+
+/* adds v = v oper value, a division by a scalar being done as the
+ * multiplication by its inverse, like soper() */
+int arith_chain_add_scalar(struct arith_chain *chain, image_operator oper, float value, arith_clip clip) {
+	if (oper == OPER_DIV && value == 0.f)
+		return 1;
+	struct arith_step *step = arith_chain_new_step(chain);
+	if (!step)
+		return 1;
+	step->oper = oper == OPER_DIV ? OPER_MUL : oper;
+	step->value = oper == OPER_DIV ? 1.0f / value : value;
+	step->clip = clip;
+	return 0;
+}
+
+/* adds v = v oper (scale * image), image being read in [0, 1] and a division by
+ * a null pixel giving 0, like imoper() */
+int arith_chain_add_image(struct arith_chain *chain, image_operator oper, const fits *image,
+		float scale, arith_clip clip) {
+	struct arith_step *step = arith_chain_new_step(chain);
+	if (!step)
+		return 1;
+	step->oper = oper;
+	step->image = image;
+	step->value = scale;
+	step->clip = clip;
+	return 0;
+}
+
+SIMD_BODY void arith_step_block_body(float *v, float *m, size_t len, const struct arith_step *step) {
+	if (step->image) {
+		if (step->value != 1.0f) {
+#ifdef _OPENMP
+#pragma omp simd
+#endif
+			for (size_t k = 0; k < len; k++)
+				m[k] *= step->value;
+		}
+		switch (step->oper) {
+			case OPER_ADD:
+				for (size_t k = 0; k < len; k++)
+					v[k] += m[k];
+				break;
+			case OPER_SUB:
+				for (size_t k = 0; k < len; k++)
+					v[k] -= m[k];
+				break;
+			case OPER_MUL:
+				for (size_t k = 0; k < len; k++)
+					v[k] *= m[k];
+				break;
+			case OPER_DIV:
+				for (size_t k = 0; k < len; k++) {
+					float q = v[k] / m[k];
+					v[k] = m[k] == 0.0f ? 0.0f : q;
+				}
+				break;
+		}
+	} else {
+		const float value = step->value;
+		switch (step->oper) {
+			case OPER_ADD:
+				for (size_t k = 0; k < len; k++)
+					v[k] += value;
+				break;
+			case OPER_SUB:
+				for (size_t k = 0; k < len; k++)
+					v[k] -= value;
+				break;
+			case OPER_MUL:
+			case OPER_DIV:	// inverted when added
+				for (size_t k = 0; k < len; k++)
+					v[k] *= value;
+				break;
+		}
+	}
+
+	switch (step->clip) {
+		case ARITH_CLIP_NONE:
+			break;
+		case ARITH_CLIP_IMOPER:
+			for (size_t k = 0; k < len; k++)
+				v[k] = v[k] > 1.0f ? 1.0f : (v[k] < -1.0f ? 0.0f : v[k]);
+			break;
+		case ARITH_CLIP_RANGE:
+			for (size_t k = 0; k < len; k++)
+				v[k] = v[k] < 0.f ? 0.f : (v[k] > 1.f ? 1.f : v[k]);
+			break;
+		case ARITH_CLIP_NEG:
+			for (size_t k = 0; k < len; k++)
+				v[k] = v[k] < 0.f ? 0.f : v[k];
+			break;
+	}
+}
+
+/* the inner loops of the chains, built for each instruction set */
+typedef void (*arith_step_fn)(float *, float *, size_t, const struct arith_step *);
+SIMD_VARIANTS(arith_step_fn, arith_step_block, (float *v, float *m, size_t len, const struct arith_step *step),
+		(v, m, len, step))
+
+/* Applies the steps of the chain to a, in a single pass over the data by
+ * blocks that stay in the cache. The values are computed in float in [0, 1],
+ * the result is stored as out_type, 16-bit data being rounded to the range of
+ * the original bit depth of a.
+ * If negatives is not NULL, it receives for each step the number of negative
+ * values after it. The images of the steps must have the size of a.
+ * Returns 0 on success, 1 if an image has a different size or type. */
+int arith_chain_apply(fits *a, const struct arith_chain *chain, data_type out_type,
+		size_t *negatives, int threads) {
+	const int nb_steps = chain->nb_steps;
+	if (a->type != DATA_USHORT && a->type != DATA_FLOAT)
+		return 1;
+	if (out_type != DATA_USHORT && out_type != DATA_FLOAT)
+		return 1;
+	for (int s = 0; s < nb_steps; s++) {
+		const fits *image = chain->steps[s].image;
+		if (!image)
+			continue;
+		if (memcmp(a->naxes, image->naxes, sizeof a->naxes))
+			return 1;
+		if (!(image->type == DATA_USHORT && image->data) &&
+				!(image->type == DATA_FLOAT && image->fdata))
+			return 1;
+	}
+	size_t n = a->naxes[0] * a->naxes[1] * a->naxes[2];
+	if (!n)
+		return 1;
+
+	/* each block is loaded before being written, so the ushort to ushort and
+	 * the float to float cases are done in place */
+	void *result = NULL;
+	if (out_type == a->type)
+		result = out_type == DATA_USHORT ? (void *) a->data : (void *) a->fdata;
+	else result = malloc(n * (out_type == DATA_USHORT ? sizeof(WORD) : sizeof(float)));
+	if (!result) {
+		PRINT_ALLOC_ERR;
+		return 1;
+	}
+	const float out_norm = a->orig_bitpix == BYTE_IMG ? UCHAR_MAX_SINGLE : USHRT_MAX_SINGLE;
+	size_t nb_blocks = (n + ARITH_BLOCK - 1) / ARITH_BLOCK;
+	size_t neg[ARITH_CHAIN_MAX_STEPS] = { 0 };
+
+#ifdef _OPENMP
+#pragma omp parallel num_threads(threads) if(threads > 1)
+#endif
+	{
+		size_t thread_neg[ARITH_CHAIN_MAX_STEPS] = { 0 };
+#ifdef _OPENMP
+#pragma omp for schedule(static)
+#endif
+		for (size_t b = 0; b < nb_blocks; b++) {
+			float v[ARITH_BLOCK], m[ARITH_BLOCK];
+			size_t start = b * ARITH_BLOCK;
+			size_t len = min(ARITH_BLOCK, n - start);
+			arith_load_block(v, a, start, len);
+			for (int s = 0; s < nb_steps; s++) {
+				if (chain->steps[s].image)
+					arith_load_block(m, chain->steps[s].image, start, len);
+				SIMD_CALL(arith_step_block)(v, m, len, &chain->steps[s]);
+				if (negatives) {
+					size_t nb = 0;
+					for (size_t k = 0; k < len; k++)
+						nb += v[k] < 0.0f;
+					thread_neg[s] += nb;
+				}
+			}
+			if (out_type == DATA_FLOAT)
+				memcpy((float *) result + start, v, len * sizeof(float));
+			else {
+				WORD *out = (WORD *) result + start;
+				for (size_t k = 0; k < len; k++)
+					out[k] = roundf_to_WORD(v[k] * out_norm);
+			}
+		}
+		if (negatives) {
+#ifdef _OPENMP
+#pragma omp critical
+#endif
+			for (int s = 0; s < nb_steps; s++)
+				neg[s] += thread_neg[s];
+		}
+	}
+
+	if (negatives)
+		memcpy(negatives, neg, nb_steps * sizeof(size_t));
+	if (out_type != a->type) {
+		int orig_bitpix = a->orig_bitpix;
+		fit_replace_buffer(a, result, out_type);
+		if (out_type == DATA_USHORT && orig_bitpix == BYTE_IMG)
+			a->bitpix = a->orig_bitpix = BYTE_IMG;
+	}
+	else invalidate_stats_from_fit(a);
+	return 0;
+}
+
+/* Adds the calibration steps to a chain:
+ *	v = (v - bias_level) or (v - bias), then - dark, then * coef / flat
+ * bias_level is used if bias is NULL and it is lower than FLT_MAX, any of the
+ * masters can be NULL. The steps clip the values like soper(), imoper() and
+ * siril_fdiv() with 32-bit output.
+ * Returns the index of the dark step, -1 if there is no dark. */
+int arith_chain_add_calibration(struct arith_chain *chain, float bias_level, const fits *bias,
+		const fits *dark, const fits *flat, float coef) {
+	int dark_step = -1;
+	if (bias)
+		arith_chain_add_image(chain, OPER_SUB, bias, 1.0f, ARITH_CLIP_IMOPER);
+	else if (bias_level < FLT_MAX)
+		arith_chain_add_scalar(chain, OPER_SUB, bias_level, ARITH_CLIP_NONE);
+	if (dark) {
+		dark_step = chain->nb_steps;
+		arith_chain_add_image(chain, OPER_SUB, dark, 1.0f, ARITH_CLIP_IMOPER);
+	}
+	if (flat) {
+		if (coef != 1.0f) {
+			arith_chain_add_image(chain, OPER_DIV, flat, 1.0f, ARITH_CLIP_NONE);
+			arith_chain_add_scalar(chain, OPER_MUL, coef, ARITH_CLIP_IMOPER);
+		}
+		else arith_chain_add_image(chain, OPER_DIV, flat, 1.0f, ARITH_CLIP_IMOPER);
+	}
+	return dark_step;
+}
+
+/* Calibration of a frame with float output in a single pass over the data,
+ * see arith_chain_add_calibration(). The result is the same as soper() and
+ * imoper() then siril_fdiv() with 32-bit output, but the image is read and
+ * written only once.
+ * The ratio of negative pixels after the dark subtraction is returned in
+ * dark_neg_ratio if not NULL, raw->neg_ratio is the one after the last master.
+ * Returns 0 on success, 1 if an image has a different size or type. */
+int calibrate_fused(fits *raw, float bias_level, const fits *bias, const fits *dark,
+		const fits *flat, float coef, float *dark_neg_ratio, int threads) {
+	struct arith_chain chain;
+	arith_chain_init(&chain);
+	int dark_step = arith_chain_add_calibration(&chain, bias_level, bias, dark, flat, coef);
+
+	size_t negatives[ARITH_CHAIN_MAX_STEPS];
+	if (arith_chain_apply(raw, &chain, DATA_FLOAT, negatives, threads))
+		return 1;
+	size_t n = raw->naxes[0] * raw->naxes[1] * raw->naxes[2];
+	if (dark_neg_ratio)
+		*dark_neg_ratio = dark_step >= 0 ? (float)((double)negatives[dark_step] / n) : 0.f;
+	if (bias || dark || flat)
+		raw->neg_ratio = (float)((double)negatives[chain.nb_steps - 1] / n);
+	return 0;
+}
+
 // a = max(a, b)
 int addmax(fits *a, fits *b) {
 	size_t i, n = a->naxes[0] * a->naxes[1] * a->naxes[2];
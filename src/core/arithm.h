@@ -34,6 +34,29 @@ typedef enum {
 	OPER_DIV
 } image_operator;
 
+/* clipping applied after a step of an arithmetic chain */
+typedef enum {
+	ARITH_CLIP_NONE,
+	ARITH_CLIP_IMOPER,	// values above 1 to 1 and below -1 to 0, like imoper()
+	ARITH_CLIP_RANGE,	// to [0, 1], like clip()
+	ARITH_CLIP_NEG		// negative values to 0, like clipneg()
+} arith_clip;
+
+#define ARITH_CHAIN_MAX_STEPS 8
+
+struct arith_step {
+	image_operator oper;
+	const fits *image;	// image operand, NULL for a scalar operand
+	float value;		// the scalar operand, or the scale of the image operand
+	arith_clip clip;
+};
+
+/* a sequence of (v oper operand) operations, applied in a single pass */
+struct arith_chain {
+	struct arith_step steps[ARITH_CHAIN_MAX_STEPS];
+	int nb_steps;
+};
+
 typedef struct blend_data {
 	float sf[3]; // Luminance stretched values
 	float tf[3]; // Independently stretched values
@@ -44,6 +67,16 @@ int soper(fits *a, float scalar, image_operator oper, gboolean conv_to_float);
 int imoper(fits *a, fits *b, image_operator oper, gboolean allow_32bits);
 int addmax(fits *a, fits *b);
 int siril_fdiv(fits *a, fits *b, float scalar, gboolean allow_32bits);
+void arith_chain_init(struct arith_chain *chain);
+int arith_chain_add_scalar(struct arith_chain *chain, image_operator oper, float value, arith_clip clip);
+int arith_chain_add_image(struct arith_chain *chain, image_operator oper, const fits *image,
+		float scale, arith_clip clip);
+int arith_chain_apply(fits *a, const struct arith_chain *chain, data_type out_type,
+		size_t *negatives, int threads);
+int arith_chain_add_calibration(struct arith_chain *chain, float bias_level, const fits *bias,
+		const fits *dark, const fits *flat, float coef);
+int calibrate_fused(fits *raw, float bias_level, const fits *bias, const fits *dark,
+		const fits *flat, float coef, float *dark_neg_ratio, int threads);
 int siril_ndiv(fits *a, fits *b);
 
 int soper_unscaled_div_ushort_to_float(fits *a, int scalar);
@@ -0,0 +1,320 @@
+/*
+ * This file is part of Siril, an astronomy image processor.
+ * Copyright (C) 2005-2011 Francois Meyer (dulle at free.fr)
+ * Copyright (C) 2012-2025 team free-astro (see more in AUTHORS file)
+ * Reference site is https://siril.org
+ *
+ * Siril is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Siril is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Siril. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* The autotune command times, on synthetic data in memory, the parameters
+ * that are otherwise chosen by heuristics, and stores the fastest values in
+ * the tuning group of the settings, the profile of the machine, that the
+ * processing uses from then on:
+ * - the number of blocks per thread of the median and mean stacking, which
+ *   balances the threads when the rejection costs more in some rows, timed on
+ *   the batched sigma clipping of a stack with outliers in a band of rows;
+ * - the tiling of the deconvolution, slices or tiles and their size, timed
+ *   on a few Richardson-Lucy iterations.
+ * The number of images processed in parallel by the sequence operations is
+ * already tuned on the first frames of each run. */
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "core/siril.h"
+#include "core/proto.h"
+#include "core/processing.h"
+#include "core/initfile.h"
+#include "core/siril_log.h"
+#include "gui/progress_and_log.h"
+#include "filters/deconvolution/deconvolution.h"
+#include "stacking/stacking.h"
+
+#include "autotune.h"
+
+#define TUNE_FRAMES 24
+#define TUNE_STACK_WIDTH 1024
+#define TUNE_STACK_HEIGHT 768
+#define TUNE_DECONV_SIZE 2048
+#define TUNE_DECONV_ITERS 4
+#define TUNE_KERNEL_SIZE 15
+#define TUNE_REPEATS 3
+
+static const int blocks_candidates[] = { 1, 2, 4, 8, 16 };
+static const int tile_candidates[] = { 0, 256, 512, 1024 };	// 0 for slices
+
+static guint64 rng_state = 1;
+
+static float uniform() {
+	guint64 z = (rng_state += 0x9e3779b97f4a7c15ULL);
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+	return (float) (((z ^ (z >> 31)) >> 11) * (1.0 / 9007199254740992.0));
+}
+
+/* a noisy background, with outliers in the first quarter of the rows where
+ * the rejection iterates more */
+static float **make_stack_frames() {
+	size_t n = (size_t) TUNE_STACK_WIDTH * TUNE_STACK_HEIGHT;
+	float **frames = calloc(TUNE_FRAMES, sizeof(float *));
+	if (!frames)
+		return NULL;
+	for (int f = 0; f < TUNE_FRAMES; f++) {
+		frames[f] = malloc(n * sizeof(float));
+		if (!frames[f]) {
+			for (int i = 0; i < f; i++)
+				free(frames[i]);
+			free(frames);
+			return NULL;
+		}
+		for (size_t i = 0; i < n; i++) {
+			float v = 0.1f + 0.02f * (uniform() - 0.5f);
+			if (i < n / 4 && uniform() < 0.15f)
+				v += 0.5f * uniform();
+			frames[f][i] = v;
+		}
+	}
+	return frames;
+}
+
+static void free_frames(float **frames) {
+	for (int f = 0; f < TUNE_FRAMES; f++)
+		free(frames[f]);
+	free(frames);
+}
+
+/* the copy of the block from each frame stands for its reading */
+static void stack_block(float **frames, const struct _image_block *block, float *block_data,
+		struct _data_block *data, struct stacking_args *args, float *result) {
+	const long rx = TUNE_STACK_WIDTH;
+	size_t block_pixels = block->height * rx;
+	double results[STACK_BATCH_SIZE];
+	int rej[STACK_BATCH_SIZE][2];
+	for (int f = 0; f < TUNE_FRAMES; f++)
+		memcpy(block_data + f * block_pixels, frames[f] + block->start_row * rx, block_pixels * sizeof(float));
+	for (long y = 0; y < block->height; y++) {
+		for (long x = 0; x < rx; x += STACK_BATCH_SIZE) {
+			int nb_pixels = (int) min(STACK_BATCH_SIZE, rx - x);
+			for (int f = 0; f < TUNE_FRAMES; f++) {
+				float *row = data->batch + f * STACK_BATCH_SIZE;
+				const float *pix = block_data + f * block_pixels + y * rx + x;
+				for (int l = 0; l < STACK_BATCH_SIZE; l++)
+					row[l] = l < nb_pixels ? pix[l] : 0.f;
+			}
+			apply_rejection_float_batch(data, TUNE_FRAMES, args, results, rej);
+			for (int l = 0; l < nb_pixels; l++)
+				result[(block->start_row + y) * rx + x + l] = (float) results[l];
+		}
+	}
+}
+
+/* returns the time of the stacking with blocks_per_thread, or -1 on error */
+static double time_stacking(float **frames, float *result, int blocks_per_thread) {
+	const long naxes[3] = { TUNE_STACK_WIDTH, TUNE_STACK_HEIGHT, 1 };
+	int nb_threads = com.max_thread;
+	struct _image_block *blocks = NULL;
+	long largest_block;
+	int nb_blocks;
+	if (stack_compute_balanced_blocks(&blocks, naxes[1], naxes, nb_threads, blocks_per_thread,
+				&largest_block, &nb_blocks))
+		return -1.0;
+
+	struct stacking_args args = { 0 };
+	args.type_of_rejection = SIGMA;
+	args.sig[0] = args.sig[1] = 3.0f;
+	args.weighting_type = NO_WEIGHT;
+
+	gboolean failed = FALSE;
+	gint64 start = g_get_monotonic_time();
+#ifdef _OPENMP
+#pragma omp parallel num_threads(nb_threads)
+#endif
+	{
+		struct _data_block data = { 0 };
+		data.batch = malloc(TUNE_FRAMES * STACK_BATCH_SIZE * sizeof(float));
+		data.batch_keep = malloc(TUNE_FRAMES * STACK_BATCH_SIZE);
+		data.stack = malloc(TUNE_FRAMES * sizeof(float));
+		float *block_data = malloc(TUNE_FRAMES * largest_block * TUNE_STACK_WIDTH * sizeof(float));
+		if (!data.batch || !data.batch_keep || !data.stack || !block_data) {
+			PRINT_ALLOC_ERR;
+			failed = TRUE;
+		}
+		// the stacking takes the blocks in the same way
+#ifdef _OPENMP
+#pragma omp for schedule(dynamic)
+#endif
+		for (int b = 0; b < nb_blocks; b++) {
+			if (!failed)
+				stack_block(frames, &blocks[b], block_data, &data, &args, result);
+		}
+		free(data.batch);
+		free(data.batch_keep);
+		free(data.stack);
+		free(block_data);
+	}
+	double seconds = (g_get_monotonic_time() - start) * 1e-6;
+	free(blocks);
+	return failed ? -1.0 : seconds;
+}
+
+static int tune_stacking() {
+	float **frames = make_stack_frames();
+	float *result = malloc((size_t) TUNE_STACK_WIDTH * TUNE_STACK_HEIGHT * sizeof(float));
+	if (!frames || !result) {
+		PRINT_ALLOC_ERR;
+		if (frames)
+			free_frames(frames);
+		free(result);
+		return -1;
+	}
+	int best = -1;
+	double best_time = 0.0;
+	for (int c = 0; c < (int) G_N_ELEMENTS(blocks_candidates) && get_thread_run(); c++) {
+		double seconds = -1.0;
+		for (int r = 0; r < TUNE_REPEATS; r++) {
+			double t = time_stacking(frames, result, blocks_candidates[c]);
+			if (t < 0.0) {
+				seconds = -1.0;
+				break;
+			}
+			if (seconds < 0.0 || t < seconds)
+				seconds = t;
+		}
+		if (seconds < 0.0)
+			break;
+		siril_log_message(_("Stacking with %d blocks per thread: %.3f s\n"), blocks_candidates[c], seconds);
+		if (best < 0 || seconds < best_time) {
+			best = blocks_candidates[c];
+			best_time = seconds;
+		}
+	}
+	free_frames(frames);
+	free(result);
+	return get_thread_run() ? best : -1;
+}
+
+/* stars on a background, each channel normalised to its maximum by the
+ * deconvolution */
+static void make_deconv_image(float *image, float *kernel) {
+	const int size = TUNE_DECONV_SIZE;
+	for (size_t i = 0; i < (size_t) size * size; i++)
+		image[i] = 0.05f + 0.005f * uniform();
+	for (int s = 0; s < 2000; s++) {
+		int cx = 8 + (int) (uniform() * (size - 16)), cy = 8 + (int) (uniform() * (size - 16));
+		float amplitude = 0.9f * uniform();
+		for (int y = -6; y <= 6; y++)
+			for (int x = -6; x <= 6; x++)
+				image[(cy + y) * size + cx + x] += amplitude * expf(-(x * x + y * y) / 8.0f);
+	}
+	const int half = TUNE_KERNEL_SIZE / 2;
+	float sum = 0.f;
+	for (int y = -half; y <= half; y++)
+		for (int x = -half; x <= half; x++)
+			sum += kernel[(y + half) * TUNE_KERNEL_SIZE + x + half] = expf(-(x * x + y * y) / 8.0f);
+	for (int i = 0; i < TUNE_KERNEL_SIZE * TUNE_KERNEL_SIZE; i++)
+		kernel[i] /= sum;
+}
+
+static double time_deconvolution(const float *image, float *work, float *kernel) {
+	memcpy(work, image, (size_t) TUNE_DECONV_SIZE * TUNE_DECONV_SIZE * sizeof(float));
+	gint64 start = g_get_monotonic_time();
+	if (fft_richardson_lucy(work, TUNE_DECONV_SIZE, TUNE_DECONV_SIZE, 1, kernel, TUNE_KERNEL_SIZE, 1,
+				0.0f, TUNE_DECONV_ITERS, 0.0f, com.fftw_max_thread, REG_NONE_MULT, 1.0f, 0))
+		return -1.0;
+	return (g_get_monotonic_time() - start) * 1e-6;
+}
+
+/* returns the best tile size, 0 for the slices, or -1 on error */
+static int tune_deconvolution() {
+	size_t n = (size_t) TUNE_DECONV_SIZE * TUNE_DECONV_SIZE;
+	float *image = malloc(n * sizeof(float));
+	float *work = malloc(n * sizeof(float));
+	float kernel[TUNE_KERNEL_SIZE * TUNE_KERNEL_SIZE];
+	if (!image || !work) {
+		PRINT_ALLOC_ERR;
+		free(image);
+		free(work);
+		return -1;
+	}
+	make_deconv_image(image, kernel);
+
+	gboolean saved_tiled = com.pref.fftw_conf.tiled;
+	int saved_tile_size = com.pref.tuning.deconv_tile_size;
+	int best = -1;
+	double best_time = 0.0;
+	for (int c = 0; c < (int) G_N_ELEMENTS(tile_candidates) && get_thread_run(); c++) {
+		com.pref.fftw_conf.tiled = tile_candidates[c] > 0;
+		com.pref.tuning.deconv_tile_size = tile_candidates[c];
+		// the first run includes the planning of the transforms
+		double seconds = time_deconvolution(image, work, kernel);
+		if (seconds >= 0.0)
+			seconds = time_deconvolution(image, work, kernel);
+		if (seconds < 0.0)
+			break;
+		if (tile_candidates[c])
+			siril_log_message(_("Deconvolution in tiles of %d pixels: %.3f s\n"), tile_candidates[c], seconds);
+		else siril_log_message(_("Deconvolution in slices: %.3f s\n"), seconds);
+		if (best < 0 || seconds < best_time) {
+			best = tile_candidates[c];
+			best_time = seconds;
+		}
+	}
+	com.pref.fftw_conf.tiled = saved_tiled;
+	com.pref.tuning.deconv_tile_size = saved_tile_size;
+	free(image);
+	free(work);
+	return get_thread_run() ? best : -1;
+}
+
+gpointer autotune_worker(gpointer p) {
+	int retval = 1;
+	struct timeval t_start, t_end;
+	gettimeofday(&t_start, NULL);
+	siril_log_color_message(_("Tuning the processing parameters for %d threads, this takes a few minutes\n"),
+			"green", com.max_thread);
+	set_progress_bar_data(_("Tuning the stacking blocks"), PROGRESS_PULSATE);
+	int blocks = tune_stacking();
+	int tile = -1;
+	if (blocks > 0) {
+		set_progress_bar_data(_("Tuning the deconvolution tiles"), PROGRESS_PULSATE);
+		tile = tune_deconvolution();
+	}
+	if (blocks > 0 && tile >= 0) {
+		com.pref.tuning.stack_blocks_per_thread = blocks;
+		com.pref.fftw_conf.tiled = tile > 0;
+		if (tile > 0)
+			com.pref.tuning.deconv_tile_size = tile;
+		com.pref.tuning.threads = com.max_thread;
+		writeinitfile();
+		siril_log_color_message(_("Machine profile saved: %d stacking blocks per thread, deconvolution in %s\n"),
+				"green", blocks, tile > 0 ? _("tiles") : _("slices"));
+		retval = 0;
+	}
+	else siril_log_color_message(_("Tuning interrupted, the settings were not changed\n"), "red");
+	gettimeofday(&t_end, NULL);
+	show_time(t_start, t_end);
+	set_progress_bar_data(PROGRESS_TEXT_RESET, PROGRESS_DONE);
+	siril_add_idle(end_generic, NULL);
+	return GINT_TO_POINTER(retval);
+}
+
+void autotune_reset() {
+	com.pref.tuning.stack_blocks_per_thread = 0;
+	com.pref.tuning.deconv_tile_size = 0;
+	com.pref.tuning.threads = 0;
+	writeinitfile();
+	siril_log_message(_("Machine profile cleared, the default heuristics are used\n"));
+}
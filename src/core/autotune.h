@@ -0,0 +1,11 @@
+#ifndef SRC_CORE_AUTOTUNE_H_
+#define SRC_CORE_AUTOTUNE_H_
+
+#include <glib.h>
+
+/* measures the tuning settings on this machine and saves them */
+gpointer autotune_worker(gpointer p);
+/* clears the tuning settings, the heuristics are used again */
+void autotune_reset();
+
+#endif /* SRC_CORE_AUTOTUNE_H_ */
@@ -45,20 +45,27 @@
 #include "core/proto.h"
 #include "core/icc_profile.h"
 #include "core/arithm.h"
+#include "core/autotune.h"
 #include "core/initfile.h"
 #include "core/preprocess.h"
 #include "core/processing.h"
 #include "core/sequence_filtering.h"
 #include "core/OS_utils.h"
+#include "core/cpu_dispatch.h"
 #include "core/siril_log.h"
 #include "core/siril_networking.h"
 #include "core/siril_update.h"
+#include "core/trace.h"
 #include "core/undo.h"
 #include "io/Astro-TIFF.h"
 #include "io/conversion.h"
+#include "io/frame_cache.h"
 #include "io/image_format_fits.h"
+#include "io/image_export.h"
+#include "io/master_cache.h"
 #include "io/path_parse.h"
 #include "io/sequence.h"
+#include "io/raw_sequence.h"
 #include "io/single_image.h"
 #include "io/siril_catalogues.h"
 #include "io/local_catalogues.h"
@@ -94,6 +101,7 @@
 #include "filters/median.h"
 #include "filters/graxpert.h"
 #include "filters/mtf.h"
+#include "filters/point_ops.h"
 #include "filters/fft.h"
 #include "filters/rgradient.h"
 #include "filters/saturation.h"
@@ -761,7 +769,7 @@ int process_savejpg(int nb){
 		retval = 1;
 	} else {
 		set_cursor_waiting(TRUE);
-		retval = savejpg(savename, &gfit, quality, TRUE);
+		retval = savejpg(savename, &gfit, quality, TRUE, com.max_thread);
 		set_cursor_waiting(FALSE);
 	}
 	g_free(filename);
@@ -784,7 +792,7 @@ int process_savejxl(int nb){
 		}
 		else if (g_str_has_prefix(arg, "-quality=")) {
 			arg += 9;
-			double quality = g_ascii_strtod(arg, &end);
+			quality = g_ascii_strtod(arg, &end);
 			if (quality <= 0.0 || quality > 100.0) {
 				siril_log_message(_("Error: quality must be >= 0.0 and <= 100.0.\n"));
 				return CMD_ARG_ERROR;
@@ -807,7 +815,7 @@ int process_savejxl(int nb){
 		retval = CMD_GENERIC_ERROR;
 	} else {
 		set_cursor_waiting(TRUE);
-		retval = savejxl(savename, &gfit, effort, quality, force_8bit);
+		retval = savejxl(savename, &gfit, effort, quality, force_8bit, com.max_thread);
 		set_cursor_waiting(FALSE);
 	}
 	g_free(filename);
@@ -826,7 +834,7 @@ int process_savepng(int nb){
 	} else {
 		set_cursor_waiting(TRUE);
 		uint32_t bytes_per_sample = gfit.orig_bitpix != BYTE_IMG ? 2 : 1;
-		retval = savepng(savename, &gfit, bytes_per_sample, gfit.naxes[2] == 3);
+		retval = savepng(savename, &gfit, bytes_per_sample, gfit.naxes[2] == 3, com.max_thread);
 		set_cursor_waiting(FALSE);
 	}
 	g_free(filename);
@@ -1729,6 +1737,18 @@ int parse_deconvolve(int first_arg, int nb,  estk_data*data, nonblind_t type) {
 				data->stepsize = stepsize;
 			}
 		}
+		else if (g_str_has_prefix(arg, "-psfsamples=")) {
+			arg += 12;
+			int samples = (int) g_ascii_strtoll(arg, &end, 10);
+			if (arg == end) error = TRUE;
+			else if (samples < 2 || samples > 100) {
+				siril_log_message(_("Error in PSF samples parameter: must be between 2 and 100, aborting.\n"));
+				return CMD_ARG_ERROR;
+			}
+			if (!error) {
+				data->psf_samples = samples;
+			}
+		}
 		else if (!g_strcmp0(arg, "-tv")) {
 			 data->regtype = REG_TV_GRAD;
 		}
@@ -3147,6 +3167,136 @@ int process_mtf(int nb) {
 	return CMD_OK | CMD_NOTIFY_GFIT_MODIFIED;
 }
 
+/* parses a list of comma-separated values, returns how many were read or -1 */
+static int parse_float_list(const char *value, float *values, int max) {
+	gchar **tokens = g_strsplit(value, ",", -1);
+	int n = g_strv_length(tokens);
+	if (n > max)
+		n = -1;
+	for (int i = 0; i < n; i++) {
+		gchar *end;
+		values[i] = (float) g_ascii_strtod(tokens[i], &end);
+		if (end == tokens[i] || *end != '\0')
+			n = -1;
+	}
+	g_strfreev(tokens);
+	return n;
+}
+
+static gint file_name_compare(gconstpointer *a, gconstpointer *b) {
+	return g_strcmp0((const gchar *) *a, (const gchar *) *b);
+}
+
+/* adds the files of the working directory matching pattern, or the file */
+static void add_matching_files(GPtrArray *files, const char *pattern) {
+	if (!strchr(pattern, '*') && !strchr(pattern, '?')) {
+		g_ptr_array_add(files, g_strdup(pattern));
+		return;
+	}
+	gchar *dirname = g_path_get_dirname(pattern);
+	gchar *basename = g_path_get_basename(pattern);
+	GPatternSpec *spec = g_pattern_spec_new(basename);
+	GDir *dir = g_dir_open(dirname, 0, NULL);
+	if (dir) {
+		const gchar *name;
+		GPtrArray *matches = g_ptr_array_new();
+		while ((name = g_dir_read_name(dir)))
+			if (g_pattern_match_string(spec, name))
+				g_ptr_array_add(matches, strcmp(dirname, ".") ? g_build_filename(dirname, name, NULL) : g_strdup(name));
+		g_dir_close(dir);
+		g_ptr_array_sort(matches, (GCompareFunc) file_name_compare);
+		for (guint i = 0; i < matches->len; i++)
+			g_ptr_array_add(files, g_ptr_array_index(matches, i));
+		g_ptr_array_free(matches, TRUE);
+	}
+	g_pattern_spec_free(spec);
+	g_free(basename);
+	g_free(dirname);
+}
+
+/* batchstretch [-mtf=low,mid,high] [-asinh=stretch[,offset]] [-ght=D,B,LP,SP,HP] [-prefix=] file [file ...]
+ * the stretches are applied in the order of the options */
+int process_batchstretch(int nb) {
+	struct point_pipeline pipeline;
+	point_pipeline_init(&pipeline);
+	gchar *prefix = NULL;
+	GPtrArray *files = g_ptr_array_new_with_free_func(g_free);
+	int retval = CMD_OK;
+	for (int i = 1; i < nb && !retval; i++) {
+		float v[5];
+		if (g_str_has_prefix(word[i], "-mtf=")) {
+			struct mtf_params params = { .do_red = TRUE, .do_green = TRUE, .do_blue = TRUE };
+			if (parse_float_list(word[i] + 5, v, 3) != 3 || v[0] < 0.f || v[1] <= 0.f ||
+					v[0] >= 1.f || v[1] >= 1.f || v[2] <= 0.f || v[2] > 1.f) {
+				retval = CMD_ARG_ERROR;
+				break;
+			}
+			params.shadows = v[0];
+			params.midtones = v[1];
+			params.highlights = v[2];
+			if (point_pipeline_add_mtf(&pipeline, &params))
+				retval = CMD_ARG_ERROR;
+		} else if (g_str_has_prefix(word[i], "-asinh=")) {
+			int n = parse_float_list(word[i] + 7, v, 2);
+			if (n < 1 || v[0] < 1.f || v[0] > 1000.f || (n == 2 && (v[1] < 0.f || v[1] >= 1.f))) {
+				retval = CMD_ARG_ERROR;
+				break;
+			}
+			if (point_pipeline_add_asinh(&pipeline, v[0], n == 2 ? v[1] : 0.f))
+				retval = CMD_ARG_ERROR;
+		} else if (g_str_has_prefix(word[i], "-ght=")) {
+			if (parse_float_list(word[i] + 5, v, 5) != 5 || v[0] < 0.f || v[0] > 10.f ||
+					v[1] < -5.f || v[1] > 15.f || v[2] < 0.f || v[2] > v[3] || v[3] > v[4] || v[4] > 1.f) {
+				retval = CMD_ARG_ERROR;
+				break;
+			}
+			ght_params params = { .D = v[0], .B = v[1], .LP = v[2], .SP = v[3], .HP = v[4], .BP = 0.f,
+				.stretchtype = STRETCH_PAYNE_NORMAL, .payne_colourstretchmodel = COL_INDEP,
+				.do_red = TRUE, .do_green = TRUE, .do_blue = TRUE, .clip_mode = CLIP };
+			if (point_pipeline_add_ght(&pipeline, &params))
+				retval = CMD_ARG_ERROR;
+		} else if (g_str_has_prefix(word[i], "-prefix=")) {
+			g_free(prefix);
+			prefix = g_strdup(word[i] + 8);
+		} else if (word[i][0] == '-') {
+			retval = CMD_ARG_ERROR;
+		} else {
+			add_matching_files(files, word[i]);
+		}
+	}
+	if (retval)
+		siril_log_message(_("Invalid argument %s, aborting.\n"), word[0]);
+	else if (pipeline.nb_ops == 0) {
+		siril_log_message(_("No stretch to apply was given\n"));
+		retval = CMD_ARG_ERROR;
+	} else if (files->len == 0) {
+		siril_log_message(_("No file to process\n"));
+		retval = CMD_FILE_NOT_FOUND;
+	}
+	if (retval) {
+		g_ptr_array_free(files, TRUE);
+		g_free(prefix);
+		return retval;
+	}
+	g_ptr_array_add(files, NULL);
+	gchar **list = (gchar **) g_ptr_array_free(files, FALSE);
+	point_pipeline_apply_to_files(&pipeline, list, prefix ? prefix : g_strdup("stretch_"));
+	return CMD_OK;
+}
+
+int process_autotune(int nb) {
+	if (nb > 1) {
+		if (strcmp(word[1], "-reset")) {
+			siril_log_message(_("Unknown parameter %s, aborting.\n"), word[1]);
+			return CMD_ARG_ERROR;
+		}
+		autotune_reset();
+		return CMD_OK;
+	}
+	start_in_new_thread(autotune_worker, NULL);
+	return CMD_OK;
+}
+
 int process_autoghs(int nb) {
 	int argidx = 1;
 	gboolean linked = FALSE;
@@ -3611,7 +3761,14 @@ int process_set(int nb) {
 		int filelen = snprintf(fakefile, 1024, "[%s]\n%s\n", input, input+sep+1);
 		GKeyFile *kf = g_key_file_new();
 		g_key_file_load_from_data(kf, fakefile, filelen, G_KEY_FILE_NONE, NULL);
-		return read_keyfile(kf) == 0;
+		int retval = read_keyfile(kf) == 0;
+		// the kernels are selected at startup
+		if (!retval && !strcmp(input, "core") && g_str_has_prefix(input + sep + 1, "simd="))
+			cpu_dispatch_init();
+		// a smaller cache drops its oldest frames now
+		if (!retval && !strcmp(input, "core") && g_str_has_prefix(input + sep + 1, "frame_cache="))
+			frame_cache_trim();
+		return retval;
 	}
 	return 0;
 }
@@ -4052,6 +4209,121 @@ int process_unset_mag_seq(int nb) {
 	return CMD_OK;
 }
 
+/* Lists the images named between the $ tokens of the expression, which is
+ * modified, and loads them as the variables of args. Their common dimensions
+ * are returned, -1 if no image is used */
+static int load_pm_expression_images(gchar *expression, int count, struct pixel_math_data *args,
+		int *width, int *height, int *channel) {
+	args->nb_rows = count / 2; // this is the number of variable
+	args->varname = calloc(args->nb_rows, sizeof(gchar *));
+
+	gchar *cur = expression;
+
+	/* List all variables */
+	char *start = cur;
+	char *end = cur;
+	gboolean first = TRUE;
+	int i = 0;
+	while (*cur) {
+		if (*cur == '$') {
+			if (first) {
+				start = cur;
+				first = FALSE;
+			} else {
+				end = cur;
+				first = TRUE;
+			}
+		}
+		if (start < end && *start) {
+			*end = 0;
+			gboolean found = FALSE;
+			for (int j = 0; j < i; j++) {
+/*				gchar *test = g_strrstr(args->varname[j], start + 1);
+				if (test)*/
+				if (!g_strcmp0(args->varname[j], start + 1))
+					found = TRUE;
+			}
+			if (!found)
+				args->varname[i++] = g_strdup(start + 1);
+			start = cur = end;
+		}
+		cur++;
+	}
+	args->nb_rows = i; // this is the final number of variables
+	args->varname = realloc(args->varname, i * sizeof(gchar *));
+
+	*width = -1;
+	*height = -1;
+	*channel = -1;
+
+	for (int j = 0; j < args->nb_rows; j++) {
+		int w, h, c;
+		if (args->varname && load_pm_var(args->varname[j], j, &w, &h, &c)) {
+			if (j > 0)
+				free_pm_var(j - 1);
+			free(args->varname);
+			return CMD_INVALID_IMAGE;
+		}
+
+		if (*channel == -1) {
+			*width = w;
+			*height = h;
+			*channel = c;
+		} else {
+			if (w != *width || h != *height || c != *channel) {
+				siril_log_message(_("Image must have same dimension\n"));
+				free_pm_var(args->nb_rows);
+				free(args->varname);
+				return CMD_INVALID_IMAGE;
+			}
+		}
+	}
+	return CMD_OK;
+}
+
+/* Returns the expression where the image names between $ tokens are replaced
+ * by the names of the variables loaded in args */
+static gchar *rename_pm_expression_images(const gchar *cleaned_expression, int count, struct pixel_math_data *args) {
+	gchar *expression = g_shell_unquote(cleaned_expression, NULL);
+
+	/* We must now replace the original variable names between the $ signs in the expression with
+	 * the new generic variable names.
+	 * This ensures that the variable names in the expression passed to pm match the variable names
+	 * stored in args->varname
+	 */
+	gchar **chunks = g_strsplit(expression, "$", count + 1);
+	for (int i = 0, j = 1; i < count / 2; i++) {
+		int idx = 0;
+		int k;
+		for (k = 0; k < args->nb_rows; k++) {
+			if (!g_strcmp0(chunks[2 * i + 1], args->varname[k])) {
+				idx = k + 1;
+				break;
+			}
+		}
+		if (idx != k + 1) idx = j;
+		g_free(chunks[2 * i + 1]);
+		chunks[2 * i + 1] = g_strdup_printf("var_%d", idx);
+		j++;
+	}
+	g_free(expression);
+	expression = g_strjoinv(NULL, chunks);
+	g_strfreev(chunks);
+
+	/* Rewrite the variable names to var_1, var_2 etc. now the files are loaded.
+	 * This avoids conflicts where characters are permitted in filenames but cannot
+	 * be used in pixelmath variable names.
+	 * We will amend the expression to match below.
+	 */
+	for (int j = 0; j < args->nb_rows; j++) {
+		g_free(args->varname[j]);
+		args->varname[j] = g_strdup_printf("var_%d", j + 1);
+	}
+
+	remove_spaces_from_str(expression);
+	return expression;
+}
+
 int process_pm(int nb) {
 	/* First we want to replace all variable by filename if exist. Return error if not
 	 * Variables start and end by $ token.
@@ -4133,75 +4405,13 @@ int process_pm(int nb) {
 	}
 
 	struct pixel_math_data *args = malloc(sizeof(struct pixel_math_data));
-	args->nb_rows = count / 2; // this is the number of variable
-	args->varname = calloc(args->nb_rows, sizeof(gchar *));
-
-	cur = expression;
-
-	/* List all variables */
-	char *start = cur;
-	char *end = cur;
-	gboolean first = TRUE;
-	int i = 0;
-	while (*cur) {
-		if (*cur == '$') {
-			if (first) {
-				start = cur;
-				first = FALSE;
-			} else {
-				end = cur;
-				first = TRUE;
-			}
-		}
-		if (start < end && *start) {
-			*end = 0;
-			gboolean found = FALSE;
-			for (int j = 0; j < i; j++) {
-/*				gchar *test = g_strrstr(args->varname[j], start + 1);
-				if (test)*/
-				if (!g_strcmp0(args->varname[j], start + 1))
-					found = TRUE;
-			}
-			if (!found)
-				args->varname[i++] = g_strdup(start + 1);
-			start = cur = end;
-		}
-		cur++;
-	}
-	args->nb_rows = i; // this is the final number of variables
-	args->varname = realloc(args->varname, i * sizeof(gchar *));
-
-	int width = -1;
-	int height = -1;
-	int channel = -1;
-
-	for (int j = 0; j < args->nb_rows; j++) {
-		int w, h, c;
-		if (args->varname && load_pm_var(args->varname[j], j, &w, &h, &c)) {
-			if (j > 0)
-				free_pm_var(j - 1);
-			g_free(expression);
-			g_free(cleaned_expression);
-			free(args->varname);
-			free(args);
-			return CMD_INVALID_IMAGE;
-		}
-
-		if (channel == -1) {
-			width = w;
-			height = h;
-			channel = c;
-		} else {
-			if (w != width || height != h || channel != c) {
-				siril_log_message(_("Image must have same dimension\n"));
-				free_pm_var(args->nb_rows);
-				g_free(expression);
-				g_free(cleaned_expression);
-				free(args->varname);
-				free(args);
-				return CMD_INVALID_IMAGE;
-			}
-		}
+	int width, height, channel;
+	int retval = load_pm_expression_images(expression, count, args, &width, &height, &channel);
+	if (retval) {
+		g_free(expression);
+		g_free(cleaned_expression);
+		free(args);
+		return retval;
 	}
 
 	/* gfit image MUST have same size of the others */
@@ -4221,72 +4431,146 @@ int process_pm(int nb) {
 	 * cleaned_expression can be freed right after its last used
 	 */
 	g_free(expression);
-	expression = g_shell_unquote(cleaned_expression, NULL);
+	expression = rename_pm_expression_images(cleaned_expression, count, args);
 	g_free(cleaned_expression);
 
-	/* We must now replace the original variable names between the $ signs in the expression with
-	 * the new generic variable names.
-	 * This ensures that the variable names in the expression passed to pm match the variable names
-	 * stored in args->varname
-	 */
-	gchar **chunks = g_strsplit(expression, "$", count + 1);
-	for (int i = 0, j = 1; i < count / 2; i++) {
-		int idx = 0;
-		int k;
-		for (k = 0; k < args->nb_rows; k++) {
-			if (!g_strcmp0(chunks[2 * i + 1], args->varname[k])) {
-				idx = k + 1;
-				break;
+	fits *fit = NULL;
+	if (new_fit_image(&fit, width, height, channel, com.pref.force_16bit ? DATA_USHORT : DATA_FLOAT)) {
+		free_pm_var(args->nb_rows);
+		free(args->varname);
+		free(args);
+		return CMD_GENERIC_ERROR;
+	}
+
+	args->expression1 = expression;
+	args->expression2 = NULL;
+	args->expression3 = NULL;
+	args->single_rgb = TRUE;
+	args->fit = fit;
+	args->ret = 0;
+	args->from_ui = FALSE;
+	args->do_sum = do_sum;
+	args->has_gfit = has_gfit;
+	if (min >= 0.f) {
+		args->rescale = TRUE;
+		args->min = min;
+		args->max = max;
+	} else {
+		args->rescale = FALSE;
+	}
+
+	start_in_new_thread(apply_pixel_math_operation, args);
+
+	return CMD_OK;
+}
+
+/* seqpm sequencename "expression" [-prefix=] [-rescale [low] [high]] [-fitseq] [-ser]
+ * the expression is evaluated for each frame of the sequence, $T being the frame */
+int process_seqpm(int nb) {
+	sequence *seq = load_sequence(word[1], NULL);
+	if (!seq)
+		return CMD_SEQUENCE_NOT_FOUND;
+
+	float min = -1.f, max = -1.f;
+	char *prefix = NULL;
+	gboolean force_ser = FALSE, force_fitseq = FALSE;
+	for (int i = 3; i < nb; i++) {
+		if (!g_strcmp0(word[i], "-rescale")) {
+			min = 0.f;
+			max = 1.f;
+			if (i + 2 < nb && word[i + 1][0] != '-') {
+				gchar *end1, *end2;
+				min = g_ascii_strtod(word[i + 1], &end1);
+				max = g_ascii_strtod(word[i + 2], &end2);
+				if (end1 == word[i + 1] || end2 == word[i + 2] || min < 0 || min > 1 || max < 0 || max > 1) {
+					siril_log_message(_("Rescale can only be done in the [0, 1] range.\n"));
+					free(prefix);
+					if (!check_seq_is_comseq(seq))
+						free_sequence(seq, TRUE);
+					return CMD_ARG_ERROR;
+				}
+				i += 2;
+			}
+		} else if (g_str_has_prefix(word[i], "-prefix=")) {
+			char *value = word[i] + 8;
+			if (value[0] == '\0') {
+				siril_log_message(_("Missing argument to %s, aborting.\n"), word[i]);
+				free(prefix);
+				if (!check_seq_is_comseq(seq))
+					free_sequence(seq, TRUE);
+				return CMD_ARG_ERROR;
 			}
+			free(prefix);
+			prefix = strdup(value);
+		} else if (!g_strcmp0(word[i], "-fitseq")) {
+			force_fitseq = TRUE;
+		} else if (!g_strcmp0(word[i], "-ser")) {
+			force_ser = TRUE;
+		} else {
+			siril_log_message(_("Unknown parameter %s, aborting.\n"), word[i]);
+			free(prefix);
+			if (!check_seq_is_comseq(seq))
+				free_sequence(seq, TRUE);
+			return CMD_ARG_ERROR;
 		}
-		if (idx != k + 1) idx = j;
-		g_free(chunks[2 * i + 1]);
-		chunks[2 * i + 1] = g_strdup_printf("var_%d", idx);
-		j++;
 	}
+
+	/* $T is the current frame, named like the loaded image of the pm command */
+	gchar *expression = g_shell_unquote(word[2], NULL);
+	GRegex *regex = g_regex_new("\\$T(?![A-Za-z0-9_])", 0, 0, NULL);
+	gchar *cleaned_expression = g_regex_replace(regex, expression, -1, 0, "gfit", 0, NULL);
+	g_regex_unref(regex);
 	g_free(expression);
-	expression = g_strjoinv(NULL, chunks);
-	g_strfreev(chunks);
+	expression = g_strdup(cleaned_expression);
 
-	/* Rewrite the variable names to var_1, var_2 etc. now the files are loaded.
-	 * This avoids conflicts where characters are permitted in filenames but cannot
-	 * be used in pixelmath variable names.
-	 * We will amend the expression to match below.
-	 */
-	for (int j = 0; j < args->nb_rows; j++) {
-		g_free(args->varname[j]);
-		args->varname[j] = g_strdup_printf("var_%d", j + 1);
+	int count = 0;
+	gchar *next, *cur = expression;
+	while ((next = strchr(cur, '$')) != NULL) {
+		cur = next + 1;
+		count++;
 	}
 
-	remove_spaces_from_str(expression);
-
-	fits *fit = NULL;
-	if (new_fit_image(&fit, width, height, channel, com.pref.force_16bit ? DATA_USHORT : DATA_FLOAT)) {
+	int retval = CMD_OK;
+	struct pixel_math_data *args = malloc(sizeof(struct pixel_math_data));
+	int width, height, channel;
+	if (count % 2 != 0) {
+		siril_log_message(_("There is an unmatched $. Please check the expression.\n"));
+		retval = CMD_ARG_ERROR;
+	} else {
+		retval = load_pm_expression_images(expression, count, args, &width, &height, &channel);
+	}
+	if (!retval && width != -1 && (seq->is_variable || width != seq->rx || height != seq->ry || channel != seq->nb_layers)) {
+		siril_log_message(_("Image must have same dimension\n"));
 		free_pm_var(args->nb_rows);
 		free(args->varname);
+		retval = CMD_INVALID_IMAGE;
+	}
+	g_free(expression);
+	if (retval) {
+		g_free(cleaned_expression);
 		free(args);
-		return CMD_GENERIC_ERROR;
+		free(prefix);
+		if (!check_seq_is_comseq(seq))
+			free_sequence(seq, TRUE);
+		return retval;
 	}
+	expression = rename_pm_expression_images(cleaned_expression, count, args);
+	g_free(cleaned_expression);
 
 	args->expression1 = expression;
 	args->expression2 = NULL;
 	args->expression3 = NULL;
 	args->single_rgb = TRUE;
-	args->fit = fit;
+	args->fit = NULL;
 	args->ret = 0;
 	args->from_ui = FALSE;
-	args->do_sum = do_sum;
-	args->has_gfit = has_gfit;
-	if (min >= 0.f) {
-		args->rescale = TRUE;
-		args->min = min;
-		args->max = max;
-	} else {
-		args->rescale = FALSE;
-	}
-
-	start_in_new_thread(apply_pixel_math_operation, args);
+	args->do_sum = FALSE;
+	args->has_gfit = TRUE;
+	args->rescale = min >= 0.f;
+	args->min = min;
+	args->max = max;
 
+	apply_pixel_math_to_sequence(args, seq, prefix ? prefix : strdup("pm_"), force_ser, force_fitseq);
 	return CMD_OK;
 }
 
@@ -4747,6 +5031,112 @@ int process_seq_crop(int nb) {
 	return CMD_OK;
 }
 
+int process_seq_export(int nb) {
+	image_type type;
+	double quality;
+	if (!g_ascii_strcasecmp(word[2], "jpg")) {
+		type = TYPEJPG;
+		quality = 100.0;
+	} else if (!g_ascii_strcasecmp(word[2], "png")) {
+		type = TYPEPNG;
+		quality = 0.0;
+	} else if (!g_ascii_strcasecmp(word[2], "jxl")) {
+		type = TYPEJXL;
+		quality = 94.0;
+	} else {
+		siril_log_message(_("Unknown export format %s, aborting.\n"), word[2]);
+		return CMD_ARG_ERROR;
+	}
+#ifndef HAVE_LIBJPEG
+	if (type == TYPEJPG) {
+		siril_log_color_message(_("Siril was compiled without JPEG support\n"), "red");
+		return CMD_GENERIC_ERROR;
+	}
+#endif
+#ifndef HAVE_LIBPNG
+	if (type == TYPEPNG) {
+		siril_log_color_message(_("Siril was compiled without PNG support\n"), "red");
+		return CMD_GENERIC_ERROR;
+	}
+#endif
+#ifndef HAVE_LIBJXL
+	if (type == TYPEJXL) {
+		siril_log_color_message(_("Siril was compiled without JPEG XL support\n"), "red");
+		return CMD_GENERIC_ERROR;
+	}
+#endif
+	int effort = 7;
+	gboolean force_8bit = FALSE;
+	gchar *prefix = NULL;
+	for (int i = 3; i < nb; i++) {
+		char *arg = word[i], *end;
+		if (!word[i])
+			break;
+		if (type != TYPEPNG && g_str_has_prefix(arg, "-quality=")) {
+			arg += 9;
+			quality = g_ascii_strtod(arg, &end);
+			if (end == arg || quality <= 0.0 || quality > 100.0 || (type == TYPEJPG && quality < 10.0)) {
+				if (type == TYPEJPG)
+					siril_log_message(_("Error: quality must be an integer between 10 and 100.\n"));
+				else siril_log_message(_("Error: quality must be >= 0.0 and <= 100.0.\n"));
+				g_free(prefix);
+				return CMD_ARG_ERROR;
+			}
+		}
+		else if (type == TYPEJXL && g_str_has_prefix(arg, "-effort=")) {
+			arg += 8;
+			effort = (int) g_ascii_strtod(arg, &end);
+			if (end == arg || effort < 1 || effort > 9) {
+				siril_log_message(_("Error: effort must be an integer between 1 and 9.\n"));
+				g_free(prefix);
+				return CMD_ARG_ERROR;
+			}
+		}
+		else if (type == TYPEJXL && !g_strcmp0(arg, "-8bit")) {
+			force_8bit = TRUE;
+		}
+		else if (g_str_has_prefix(arg, "-prefix=")) {
+			arg += 8;
+			if (arg[0] == '\0') {
+				siril_log_message(_("Missing argument to %s, aborting.\n"), word[i]);
+				g_free(prefix);
+				return CMD_ARG_ERROR;
+			}
+			g_free(prefix);
+			prefix = g_strdup(arg);
+		}
+		else {
+			siril_log_message(_("Unknown parameter %s, aborting.\n"), word[i]);
+			g_free(prefix);
+			return CMD_ARG_ERROR;
+		}
+	}
+
+	sequence *seq = load_sequence(word[1], NULL);
+	if (!seq) {
+		g_free(prefix);
+		return CMD_SEQUENCE_NOT_FOUND;
+	}
+
+	struct image_export_data *args = calloc(1, sizeof(struct image_export_data));
+	if (!args) {
+		PRINT_ALLOC_ERR;
+		g_free(prefix);
+		if (!check_seq_is_comseq(seq))
+			free_sequence(seq, TRUE);
+		return CMD_ALLOC_ERROR;
+	}
+	args->seq = seq;
+	args->type = type;
+	args->quality = quality;
+	args->effort = effort;
+	args->force_8bit = force_8bit;
+	args->prefix = prefix;
+
+	apply_image_export_to_sequence(args);
+	return CMD_OK;
+}
+
 int process_seq_resample(int nb) {
 	sequence *seq = load_sequence(word[1], NULL);
 	if (!seq) {
@@ -4980,6 +5370,19 @@ int process_tilt(int nb) {
 	return CMD_OK;
 }
 
+int process_trace(int nb) {
+	if (!g_ascii_strcasecmp(word[1], "start")) {
+		if (nb < 3) {
+			siril_log_message(_("Missing the trace file name\n"));
+			return CMD_WRONG_N_ARG;
+		}
+		return trace_start(word[2]) ? CMD_GENERIC_ERROR : CMD_OK;
+	}
+	if (!g_ascii_strcasecmp(word[1], "stop"))
+		return trace_stop() ? CMD_GENERIC_ERROR : CMD_OK;
+	return CMD_ARG_ERROR;
+}
+
 int process_inspector(int nb) {
 	compute_aberration_inspector();
 	return CMD_OK;
@@ -5220,6 +5623,12 @@ cmd_errors parse_findstar(struct starfinder_data *args, int start, int nb) {
 				return CMD_ARG_ERROR;
 			}
 			args->max_stars_fitted = max_stars;
+		} else if (!g_strcmp0(word[i], "-track")) {
+			if (start != 2) {
+				siril_log_message(_("Option -track is only available for sequences, ignoring\n"));
+				continue;
+			}
+			args->track_stars = TRUE;
 		} else {
 			siril_log_message(_("Unknown parameter %s, aborting.\n"), current);
 			return CMD_ARG_ERROR;
@@ -5771,7 +6180,7 @@ int process_subsky(int nb) {
 	sequence *seq = NULL;
 	int degree = 0, samples = 20;
 	double tolerance = 1.0, smooth = 0.5;
-	gboolean dithering;
+	gboolean dithering, ref_samples = FALSE;
 	background_interpolation interp;
 	char *prefix = NULL;
 
@@ -5851,6 +6260,9 @@ int process_subsky(int nb) {
 		else if (is_sequence && !g_strcmp0(arg, "-nodither")) {
 			dithering = FALSE;
 		}
+		else if (is_sequence && !g_strcmp0(arg, "-refsamples")) {
+			ref_samples = TRUE;
+		}
 		else if (!is_sequence && !g_strcmp0(arg, "-dither")) {
 			dithering = TRUE;
 		}
@@ -5871,6 +6283,7 @@ int process_subsky(int nb) {
 	args->smoothing = smooth;
 	args->threads = com.max_thread;
 	args->dither = dithering;
+	args->ref_samples = ref_samples;
 	args->from_ui = FALSE;
 	siril_debug_print("dithering: %s\n", dithering ? "enabled" : "disabled");
 
@@ -6783,6 +7196,37 @@ int process_stat(int nb){
 	return CMD_OK;
 }
 
+int process_seq_quality(int nb) {
+	sequence *seq = load_sequence(word[1], NULL);
+	if (!seq) {
+		return CMD_SEQUENCE_NOT_FOUND;
+	}
+	if (check_seq_is_comseq(seq)) {
+		free_sequence(seq, TRUE);
+		seq = &com.seq;
+	}
+
+	int layer = seq->nb_layers == 3 ? 1 : 0;
+	if (nb > 2) {
+		gchar *end;
+		layer = g_ascii_strtoull(word[2], &end, 10);
+		if (end == word[2] || *end != '\0' || layer < 0 || layer >= seq->nb_layers) {
+			siril_log_message(_("Invalid argument: %s, aborting.\n"), word[2]);
+			if (!check_seq_is_comseq(seq))
+				free_sequence(seq, TRUE);
+			return CMD_ARG_ERROR;
+		}
+	}
+
+	struct quality_data *args = calloc(1, sizeof(struct quality_data));
+	args->seq = seq;
+	args->layer = layer;
+
+	apply_quality_to_sequence(args);
+
+	return CMD_OK;
+}
+
 int process_seq_stat(int nb) {
 	sequence *seq = load_sequence(word[1], NULL);
 	if (!seq) {
@@ -7282,12 +7726,19 @@ int process_convert(int nb) {
 	gboolean debayer = FALSE;
 	gboolean make_link = !raw_only;
 	sequence_type output = SEQ_REGULAR;
+#ifdef HAVE_LIBRAW
+	gboolean raw_sequence = FALSE;
+#endif
 
 	for (int i = 2; i < nb; i++) {
 		char *current = word[i], *value;
 		if (!strcmp(current, "-debayer")) {
 			debayer = TRUE;
 			make_link = FALSE;
+#ifdef HAVE_LIBRAW
+		} else if (raw_only && !strcmp(current, "-rawseq")) {
+			raw_sequence = TRUE;
+#endif
 		} else if (!strcmp(current, "-fitseq")) {
 			output = SEQ_FITSEQ;
 			if (!g_str_has_suffix(destroot, com.pref.ext))
@@ -7375,6 +7826,26 @@ int process_convert(int nb) {
 	/* convert the list to an array for parallel processing */
 	gchar **files_to_convert = glist_to_array(list, &count);
 
+#ifdef HAVE_LIBRAW
+	/* the RAW files are linked, not converted */
+	if (raw_sequence) {
+		int retval = CMD_OK;
+		if (debayer || output != SEQ_REGULAR) {
+			siril_log_message(_("The -rawseq option cannot be used with -debayer, -fitseq or -ser\n"));
+			retval = CMD_ARG_ERROR;
+		} else if (raw_sequence_create(destroot, files_to_convert, count, idx)) {
+			retval = CMD_GENERIC_ERROR;
+		} else if (!com.script && !com.headless) {
+			gchar *seqname = normalize_seqname(destroot, TRUE);
+			update_sequences_list(seqname);
+			g_free(seqname);
+		}
+		g_strfreev(files_to_convert);
+		free(destroot);
+		return retval;
+	}
+#endif
+
 	int nb_allowed;
 	if (!allow_to_open_files(count, &nb_allowed) && output == SEQ_REGULAR) {
 		siril_log_message(_("You should pass an extra argument -fitseq to convert your sequence to fitseq format.\n"));
@@ -7538,6 +8009,20 @@ int process_register(int nb) {
 				goto terminate_register_on_error;
 			}
 			regargs->max_stars_candidates = max_stars;
+		} else if (g_str_has_prefix(word[i], "-detectbin=")) {
+			char *current = word[i], *value;
+			value = current + 11;
+			if (value[0] == '\0') {
+				siril_log_message(_("Missing argument to %s, aborting.\n"), current);
+				goto terminate_register_on_error;
+			}
+			gchar *end;
+			int factor = g_ascii_strtoull(value, &end, 10);
+			if (end == value || (factor != 1 && factor != 2 && factor != 4)) {
+				siril_log_message(_("Detection binning factor %s not allowed. Should be 1, 2 or 4.\n"), value);
+				goto terminate_register_on_error;
+			}
+			regargs->detection_binning = factor;
 		} else if (g_str_has_prefix(word[i], "-interp=")) {
 			char *current = word[i], *value;
 			value = current + 8;
@@ -8349,6 +8834,81 @@ static int parse_stack_command_line(struct stacking_configuration *arg, int firs
 			arg->maximize_framing = TRUE;
 		} else if (!strcmp(current, "-upscale")) {
 			arg->upscale_at_stacking = TRUE;
+		} else if (!strcmp(current, "-streaming")) {
+			if (!rej_options_allowed) {
+				siril_log_message(_("Streaming is allowed only with mean stacking, ignoring.\n"));
+			} else {
+				arg->streaming = TRUE;
+			}
+		} else if (!strcmp(current, "-incremental")) {
+			if (!rej_options_allowed) {
+				siril_log_message(_("Incremental stacking is allowed only with mean stacking, ignoring.\n"));
+			} else {
+				arg->incremental = TRUE;
+			}
+		} else if (g_str_has_prefix(current, "-band=")) {
+			if (!med_options_allowed) {
+				siril_log_message(_("Stacking a band of rows is allowed only with median or mean stacking, ignoring.\n"));
+			} else {
+				value = current + 6;
+				gchar *end;
+				gint64 band_first = g_ascii_strtoll(value, &end, 10), band_last = -1;
+				if (end != value && *end == ',') {
+					value = end + 1;
+					band_last = g_ascii_strtoll(value, &end, 10);
+				}
+				if (end == value || *end != '\0' || band_first < 0 || band_last <= band_first || band_last > INT_MAX) {
+					siril_log_message(_("Invalid argument to %s, aborting.\n"), current);
+					return CMD_ARG_ERROR;
+				}
+				arg->band_rows[0] = (int) band_first;
+				arg->band_rows[1] = (int) band_last;
+			}
+		} else if (g_str_has_prefix(current, "-comet=")) {
+			if (!med_options_allowed) {
+				siril_log_message(_("Dual-alignment stacking is allowed only with median or mean stacking, ignoring.\n"));
+			} else {
+				value = current + 7;
+				gchar *end;
+				double vx = g_ascii_strtod(value, &end), vy = 0.0;
+				if (end != value && *end == ',') {
+					value = end + 1;
+					vy = g_ascii_strtod(value, &end);
+				}
+				if (end == value || *end != '\0') {
+					siril_log_message(_("Invalid argument to %s, aborting.\n"), current);
+					return CMD_ARG_ERROR;
+				}
+				/* same as the velocity of the comet registration, the y
+				 * axis of the images being upside down */
+				arg->comet_dual = TRUE;
+				arg->comet_velocity.x = (float) vx;
+				arg->comet_velocity.y = (float) -vy;
+			}
+		} else if (!strcmp(current, "-applyreg")) {
+			if (!med_options_allowed) {
+				siril_log_message(_("Applying registration while stacking is allowed only with median or mean stacking, ignoring.\n"));
+			} else {
+				arg->apply_reg = TRUE;
+			}
+		} else if (g_str_has_prefix(current, "-interp=")) {
+			value = current + 8;
+			if (!g_ascii_strncasecmp(value, "nearest", 7) || !g_ascii_strncasecmp(value, "ne", 2))
+				arg->interpolation = OPENCV_NEAREST;
+			else if (!g_ascii_strncasecmp(value, "cubic", 5) || !g_ascii_strncasecmp(value, "cu", 2))
+				arg->interpolation = OPENCV_CUBIC;
+			else if (!g_ascii_strncasecmp(value, "lanczos4", 8) || !g_ascii_strncasecmp(value, "la", 2))
+				arg->interpolation = OPENCV_LANCZOS4;
+			else if (!g_ascii_strncasecmp(value, "linear", 6) || !g_ascii_strncasecmp(value, "li", 2))
+				arg->interpolation = OPENCV_LINEAR;
+			else if (!g_ascii_strncasecmp(value, "area", 4) || !g_ascii_strncasecmp(value, "ar", 2))
+				arg->interpolation = OPENCV_AREA;
+			else {
+				siril_log_message(_("Unknown transformation type %s, aborting.\n"), value);
+				return CMD_ARG_ERROR;
+			}
+		} else if (!strcmp(current, "-noclamp")) {
+			arg->clamp = FALSE;
 		} else {
 			siril_log_message(_("Unexpected argument to stacking `%s', aborting.\n"), current);
 			return CMD_ARG_ERROR;
@@ -8397,9 +8957,37 @@ static int stack_one_seq(struct stacking_configuration *arg) {
 	args.reglayer = get_registration_layer(args.seq);
 	args.feather_dist = arg->feather_dist;
 	args.overlap_norm = arg->overlap_norm;
+	args.streaming = arg->streaming;
+	args.incremental = arg->incremental;
+	args.apply_reg = arg->apply_reg;
+	args.interpolation = arg->interpolation;
+	args.clamp = arg->clamp;
+	args.band_rows[0] = arg->band_rows[0];
+	args.band_rows[1] = arg->band_rows[1];
+	args.comet_dual = arg->comet_dual;
+	args.comet_velocity = arg->comet_velocity;
 
 	// manage registration data
-	if (!test_regdata_is_valid_and_shift(args.seq, args.reglayer)) {
+	if (args.apply_reg) {
+		if (!layer_has_usable_registration(seq, args.reglayer) || seq->is_variable) {
+			siril_log_color_message(_("Applying registration while stacking requires registration data and images of the same size. Aborting\n"), "red");
+			free_sequence(seq, TRUE);
+			return CMD_GENERIC_ERROR;
+		}
+		if (layer_has_distortion(seq, args.reglayer)) {
+			siril_log_color_message(_("Registration data of layer %d contains distortion correction, use SEQAPPLYREG before stacking. Aborting\n"), "red", args.reglayer);
+			free_sequence(seq, TRUE);
+			return CMD_GENERIC_ERROR;
+		}
+		if (arg->maximize_framing) {
+			siril_log_color_message(_("Cannot maximize framing when applying registration while stacking. Disabling\n"), "red");
+			arg->maximize_framing = FALSE;
+		}
+		if (args.feather_dist > 0) {
+			siril_log_color_message(_("Feathering is not available when applying registration while stacking. Disabling\n"), "red");
+			args.feather_dist = 0;
+		}
+	} else if (!test_regdata_is_valid_and_shift(args.seq, args.reglayer)) {
 		siril_log_color_message(_("Stacking has detected registration data on layer %d with more than simple shifts. You should apply existing registration before stacking\n"), "red", args.reglayer);
 		free_sequence(seq, TRUE);
 		return CMD_GENERIC_ERROR;
@@ -8436,6 +9024,67 @@ static int stack_one_seq(struct stacking_configuration *arg) {
 		siril_log_color_message(_("Cannot compute overlap statistics if -maximize is not enabled. Disabling\n"), "red");
 		args.overlap_norm = FALSE;
 	}
+	if (args.incremental) {
+		if (args.type_of_rejection != NO_REJEC && args.type_of_rejection != SIGMA) {
+			siril_log_color_message(_("Incremental stacking is only available without rejection or with sigma clipping, aborting\n"), "red");
+			free_sequence(seq, TRUE);
+			return CMD_ARG_ERROR;
+		}
+		if (args.maximize_framing) {
+			siril_log_color_message(_("Cannot maximize framing with incremental stacking, the image size would change. Disabling\n"), "red");
+			args.maximize_framing = FALSE;
+			args.overlap_norm = FALSE;
+		}
+		if (args.feather_dist > 0) {
+			siril_log_color_message(_("Feathering is not available with incremental stacking. Disabling\n"), "red");
+			args.feather_dist = 0;
+		}
+		if (args.create_rejmaps) {
+			siril_log_color_message(_("Rejection maps are not available with incremental stacking. Disabling\n"), "red");
+			args.create_rejmaps = FALSE;
+		}
+		if (args.weighting_type != NO_WEIGHT) {
+			siril_log_color_message(_("Weights are relative to the stacked images and cannot be used with incremental stacking. Disabling\n"), "red");
+			args.weighting_type = NO_WEIGHT;
+		}
+	}
+	if (args.comet_dual) {
+		if (!layer_has_usable_registration(seq, args.reglayer) || args.apply_reg) {
+			siril_log_color_message(_("Dual-alignment stacking requires registration data with simple shifts, "
+						"without applying it while stacking. Aborting\n"), "red");
+			free_sequence(seq, TRUE);
+			return CMD_ARG_ERROR;
+		}
+		if (args.incremental) {
+			siril_log_color_message(_("Dual-alignment stacking is not available with incremental stacking, aborting\n"), "red");
+			free_sequence(seq, TRUE);
+			return CMD_ARG_ERROR;
+		}
+		if (args.maximize_framing) {
+			siril_log_color_message(_("Cannot maximize framing with dual-alignment stacking. Disabling\n"), "red");
+			args.maximize_framing = FALSE;
+			args.overlap_norm = FALSE;
+		}
+		if (args.feather_dist > 0) {
+			siril_log_color_message(_("Feathering is not available with dual-alignment stacking. Disabling\n"), "red");
+			args.feather_dist = 0;
+		}
+		if (args.streaming) {
+			siril_log_color_message(_("Streaming is not available with dual-alignment stacking. Disabling\n"), "red");
+			args.streaming = FALSE;
+		}
+	}
+	if (args.band_rows[1] > 0) {
+		if (args.incremental) {
+			siril_log_color_message(_("Incremental stacking cannot be restricted to a band of rows, aborting\n"), "red");
+			free_sequence(seq, TRUE);
+			return CMD_ARG_ERROR;
+		}
+		if (args.output_norm) {
+			siril_log_color_message(_("The output normalization would differ between the bands of a stack. Disabling\n"), "red");
+			args.output_norm = FALSE;
+		}
+	}
 	if (args.normalize == NO_NORM && (args.weighting_type == NOISE_WEIGHT || args.weighting_type == NBSTACK_WEIGHT)) {
 		siril_log_color_message(_("Weighting is allowed only if normalization has been activated, ignoring.\n"), "red");
 		args.weighting_type = NO_WEIGHT;
@@ -8510,6 +9159,18 @@ static int stack_one_seq(struct stacking_configuration *arg) {
 		}
 		else ++arg->number_of_loaded_sequences;
 
+		if (args.comet_dual && args.comet_result.rx) {
+			char new_ext[30];
+			sprintf(new_ext, "_comet%s", com.pref.ext);
+			gchar *comet_filename = replace_ext(arg->result_file, new_ext);
+			if (savefits(comet_filename, &args.comet_result)) {
+				siril_log_color_message(_("Could not save the comet-aligned stacking result %s\n"),
+						"red", comet_filename);
+				retval = CMD_GENERIC_ERROR;
+			}
+			g_free(comet_filename);
+		}
+
 		if (args.create_rejmaps) {
 			siril_log_message(_("Saving rejection maps\n"));
 			if (args.merge_lowhigh_rejmaps) {
@@ -8545,6 +9206,7 @@ static int stack_one_seq(struct stacking_configuration *arg) {
 
 	free_sequence(seq, TRUE);
 	clearfits(&args.result);
+	clearfits(&args.comet_result);
 	if (args.create_rejmaps) {
 		clearfits(args.rejmap_low);
 		free(args.rejmap_low);
@@ -8603,6 +9265,8 @@ int process_stackall(int nb) {
 
 	arg = calloc(1, sizeof(struct stacking_configuration));
 	arg->norm = NO_NORM;
+	arg->interpolation = OPENCV_LANCZOS4;
+	arg->clamp = TRUE;
 
 	// stackall { sum | min | max } [-filter-fwhm=value[%|k]] [-filter-wfwhm=value[%|k]] [-filter-round=value[%|k]] [-filter-quality=value[%|k]] [-filter-bkg=value[%|k]] [-filter-nbstars=value[%|k]] [-filter-incl[uded]]
 	// stackall { med | median } [-nonorm, norm=] [-filter-incl[uded]]
@@ -8714,6 +9378,8 @@ static gpointer stackone_worker(gpointer garg) {
 int process_stackone(int nb) {
 	struct stacking_configuration *arg = calloc(1, sizeof(struct stacking_configuration));
 	arg->norm = NO_NORM;
+	arg->interpolation = OPENCV_LANCZOS4;
+	arg->clamp = TRUE;
 
 	sequence *seq = load_sequence(word[1], &arg->seqfile);
 	if (!seq)
@@ -8812,7 +9478,72 @@ failure:
 	return CMD_ARG_ERROR;
 }
 
-/* calibrate sequencename [-bias=filename|value] [-dark=filename] [-flat=filename] [-cc=dark [siglo sighi] || -cc=bpm bpmfile] [-cfa] [-debayer] [-fix_xtrans] [-equalize_cfa] [-opt[=exp]] [-prefix=] [-fitseq]
+/* stackmerge output partial_stack1 partial_stack2 [partial_stack3 ...]
+ * assembles the partial stacks made by several instances with the -band option
+ * of stack: the rows of each band are copied into the first one */
+int process_stackmerge(int nb) {
+	fits result = { 0 };
+	gboolean *covered = NULL;
+	int retval = CMD_OK;
+	for (int i = 2; i < nb && retval == CMD_OK; i++) {
+		fits band = { 0 };
+		fits *fit = i == 2 ? &result : &band;
+		if (readfits(word[i], fit, NULL, FALSE)) {
+			siril_log_color_message(_("Could not open the partial stack %s\n"), "red", word[i]);
+			retval = CMD_FILE_NOT_FOUND;
+			break;
+		}
+		int first = fit->keywords.stack_band_first, last = fit->keywords.stack_band_last;
+		if (first < 1 || last < first || last > fit->ry) {
+			siril_log_color_message(_("%s is not a partial stack made with the -band option of stack\n"), "red", word[i]);
+			retval = CMD_INVALID_IMAGE;
+		} else if (fit != &result && (fit->rx != result.rx || fit->ry != result.ry ||
+					fit->naxes[2] != result.naxes[2] || fit->type != result.type)) {
+			siril_log_color_message(_("The partial stack %s does not have the size or the bit depth of %s\n"),
+					"red", word[i], word[2]);
+			retval = CMD_INVALID_IMAGE;
+		} else if (!covered && !(covered = calloc(result.ry, sizeof(gboolean)))) {
+			PRINT_ALLOC_ERR;
+			retval = CMD_ALLOC_ERROR;
+		}
+		if (retval != CMD_OK) {
+			clearfits(&band);
+			break;
+		}
+		siril_log_message(_("Rows %d to %d from %s\n"), first, last, word[i]);
+		for (int row = first - 1; row < last; row++)
+			covered[row] = TRUE;
+		if (fit != &result) {
+			/* rows of the band are counted from the top, the data from the bottom */
+			size_t offset = (size_t) (fit->ry - last) * fit->rx;
+			size_t count = (size_t) (last - first + 1) * fit->rx;
+			size_t nbpix = (size_t) fit->rx * fit->ry;
+			for (int c = 0; c < fit->naxes[2]; c++) {
+				if (fit->type == DATA_FLOAT)
+					memcpy(result.fdata + c * nbpix + offset, fit->fdata + c * nbpix + offset, count * sizeof(float));
+				else memcpy(result.data + c * nbpix + offset, fit->data + c * nbpix + offset, count * sizeof(WORD));
+			}
+			clearfits(&band);
+		}
+	}
+	if (retval == CMD_OK) {
+		int missing = 0;
+		for (int row = 0; row < result.ry; row++)
+			missing += !covered[row];
+		if (missing)
+			siril_log_color_message(_("%d rows are not covered by the partial stacks and stay black\n"), "salmon", missing);
+		result.keywords.stack_band_first = DEFAULT_INT_VALUE;
+		result.keywords.stack_band_last = DEFAULT_INT_VALUE;
+		if (savefits(word[1], &result))
+			retval = CMD_GENERIC_ERROR;
+		else siril_log_message(_("%d partial stacks assembled into %s\n"), nb - 2, word[1]);
+	}
+	free(covered);
+	clearfits(&result);
+	return retval;
+}
+
+/* calibrate sequencename [-bias=filename|value] [-dark=filename] [-flat=filename] [-cc=dark [siglo sighi] || -cc=bpm bpmfile] [-cfa] [-debayer] [-fix_xtrans] [-equalize_cfa] [-opt[=exp]] [-prefix=] [-fitseq] [-ser] [-quality] [-extract=ha|green|haoiii [-resample=ha|oiii]]
  * calibrate_single filename [-bias=filename|value] [-dark=filename] [-flat=filename] [-cc=dark [siglo sighi] || -cc=bpm bpmfile] [-cfa] [-debayer] [-fix_xtrans] [-equalize_cfa] [-opt] [-prefix=]
  */
 struct preprocessing_data *parse_calibrate_args(int nb, sequence *seq) {
@@ -8899,7 +9630,7 @@ struct preprocessing_data *parse_calibrate_args(int nb, sequence *seq) {
 					break;
 				}
 				args->bias = calloc(1, sizeof(fits));
-				if (!readfits(expression, args->bias, NULL, !com.pref.force_16bit)) {
+				if (!master_cache_readfits(expression, args->bias, !com.pref.force_16bit)) {
 					args->use_bias = TRUE;
 					// if input is 8b, we assume 32b master needs to be rescaled
 					if ((args->bias->type == DATA_FLOAT) && (bitpix == BYTE_IMG)) {
@@ -8923,7 +9654,7 @@ struct preprocessing_data *parse_calibrate_args(int nb, sequence *seq) {
 				free(args->dark);
 				break;
 			}
-			if (!readfits(expression, args->dark, NULL, !com.pref.force_16bit)) {
+			if (!master_cache_readfits(expression, args->dark, !com.pref.force_16bit)) {
 				args->use_dark = TRUE;
 				// if input is 8b, we assume 32b master needs to be rescaled
 				if ((args->dark->type == DATA_FLOAT) && (bitpix == BYTE_IMG)) {
@@ -8946,7 +9677,7 @@ struct preprocessing_data *parse_calibrate_args(int nb, sequence *seq) {
 				g_free(expression);
 				break;
 			}
-			if (!readfits(expression, args->flat, NULL, !com.pref.force_16bit)) {
+			if (!master_cache_readfits(expression, args->flat, !com.pref.force_16bit)) {
 				args->use_flat = TRUE;
 				// no need to deal with bitdepth conversion as flat is just a division (unlike darks which need to be on same scale)
 			} else {
@@ -8995,6 +9726,34 @@ struct preprocessing_data *parse_calibrate_args(int nb, sequence *seq) {
 			args->equalize_cfa = TRUE;
 		} else if (seq && !strcmp(word[i], "-fitseq")) {
 			args->output_seqtype = SEQ_FITSEQ;
+		} else if (seq && !strcmp(word[i], "-ser")) {
+			args->output_seqtype = SEQ_SER;
+		} else if (seq && !strcmp(word[i], "-quality")) {
+			args->compute_quality = TRUE;
+		} else if (seq && g_str_has_prefix(word[i], "-extract=")) {
+			char *value = word[i] + 9;
+			if (!g_ascii_strcasecmp(value, "ha"))
+				args->extract = PREPRO_EXTRACT_HA;
+			else if (!g_ascii_strcasecmp(value, "green"))
+				args->extract = PREPRO_EXTRACT_GREEN;
+			else if (!g_ascii_strcasecmp(value, "haoiii"))
+				args->extract = PREPRO_EXTRACT_HAOIII;
+			else {
+				siril_log_message(_("Unknown argument to %s, aborting.\n"), word[i]);
+				retvalue = CMD_ARG_ERROR;
+				break;
+			}
+		} else if (seq && g_str_has_prefix(word[i], "-resample=")) {
+			char *value = word[i] + 10;
+			if (!g_ascii_strcasecmp(value, "ha"))
+				args->extract_scaling = SCALING_HA_UP;
+			else if (!g_ascii_strcasecmp(value, "oiii"))
+				args->extract_scaling = SCALING_OIII_DOWN;
+			else {
+				siril_log_message(_("Unknown argument to %s, aborting.\n"), word[i]);
+				retvalue = CMD_ARG_ERROR;
+				break;
+			}
 		} else if (g_str_has_prefix(word[i], "-cc=")) {
 			char *current = word[i], *value;
 			value = current + 4;
@@ -9062,6 +9821,22 @@ struct preprocessing_data *parse_calibrate_args(int nb, sequence *seq) {
 		}
 	}
 
+	if (!retvalue && args->extract != PREPRO_EXTRACT_NONE) {
+		if (args->debayer || args->compute_quality) {
+			siril_log_message(_("The -extract= option cannot be used with -debayer or -quality, aborting.\n"));
+			retvalue = CMD_ARG_ERROR;
+		} else if (args->extract_scaling == SCALING_OIII_DOWN && args->extract != PREPRO_EXTRACT_HAOIII) {
+			siril_log_message(_("-resample=oiii can only be used with -extract=haoiii, aborting.\n"));
+			retvalue = CMD_ARG_ERROR;
+		} else if (args->extract_scaling == SCALING_HA_UP && args->extract == PREPRO_EXTRACT_GREEN) {
+			siril_log_message(_("-resample=ha cannot be used with -extract=green, aborting.\n"));
+			retvalue = CMD_ARG_ERROR;
+		}
+	} else if (!retvalue && args->extract_scaling != SCALING_NONE) {
+		siril_log_message(_("-resample= requires the -extract= option, aborting.\n"));
+		retvalue = CMD_ARG_ERROR;
+	}
+
 prepro_parse_end:
 	clearfits(&reffit);
 	free(realname);
@@ -36,8 +36,10 @@ gboolean image_cfa_warning_check();
 int	process_addmax(int nb);
 int	process_autostretch(int nb);
 int	process_autoghs(int nb);
+int	process_autotune(int nb);
 int	process_asinh(int nb);
 
+int	process_batchstretch(int nb);
 int	process_bg(int nb);
 int	process_bgnoise(int nb);
 int	process_binxy(int nb);
@@ -188,6 +190,7 @@ int	process_seq_applyreg(int nb);
 int	process_seq_clean(int nb);
 int	process_seq_cosme(int nb);
 int	process_seq_crop(int nb);
+int	process_seq_export(int nb);
 int	process_seq_extractHa(int nb);
 int	process_seq_extractGreen(int nb);
 int	process_seq_extractHaOIII(int nb);
@@ -204,8 +207,10 @@ int	process_seq_linstretch(int nb);
 int	process_seq_merge_cfa(int nb);
 int	process_seq_modasinh(int nb);
 int	process_seq_mtf(int nb);
+int	process_seqpm(int nb);
 int	process_seq_profile(int nb);
 int	process_seq_psf(int nb);
+int	process_seq_quality(int nb);
 int	process_seq_resample(int nb);
 int	process_seq_rl(int nb);
 int	process_seq_sb(int nb);
@@ -237,12 +242,14 @@ int	process_split_cfa(int nb);
 int	process_stat(int nb);
 int	process_stackall(int nb);
 int	process_stackone(int nb);
+int	process_stackmerge(int nb);
 int	process_synthstar(int nb);
 
 int	process_thresh(int nb);
 int	process_threshlo(int nb);
 int	process_threshhi(int nb);
 int	process_tilt(int nb);
+int	process_trace(int nb);
 int	process_trixel(int nb);
 
 int	process_unclip(int nb);
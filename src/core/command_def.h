@@ -7,13 +7,15 @@
 #define STR_ASINH N_("Stretches the image to show faint objects using an hyperbolic arcsin transformation. The mandatory argument <b>stretch</b>, typically between 1 and 1000, will give the strength of the stretch. The black point can be offset by providing an optional <b>offset</b> argument in the normalized pixel value of [0, 1]. Finally the option <b>-human</b> enables using human eye luminous efficiency weights to compute the luminance used to compute the stretch value for each pixel, instead of the simple mean of the channels pixel values. This stretch method preserves lightness from the L*a*b* color space. The clip mode can be set using the argument <b>-clipmode=</b>: values <b>clip</b>, <b>rescale</b>, <b>rgbblend</b> or <b>globalrescale</b> are accepted and the default is rgbblend")
 #define STR_AUTOGHS N_("Application of the generalized hyperbolic stretch with a symmetry point SP defined as k.sigma from the median of each channel (the provided <b>shadowsclip</b> value is the k here and can be negative). By default, SP and the stretch are computed per channel; SP can be computed as a mean of image channels by passing <b>-linked</b>. The stretch amount <b>D</b> is provided in the second mandatory argument.\nImplicit values of 13 for <b>B</b>, making it very focused on the SP brightness range, 0.7 for <b>HP</b>, 0 for <b>LP</b> are used but can be changed with the options of the same names. The clip mode can be set using the argument <b>-clipmode=</b>: values <b>clip</b>, <b>rescale</b>, <b>rgbblend</b> or <b>globalrescale</b> are accepted and the default is rgbblend")
 #define STR_AUTOSTRETCH N_("Auto-stretches the currently loaded image, with different parameters for each channel (unlinked) unless <b>-linked</b> is passed. Arguments are optional, <b>shadowclip</b> is the shadows clipping point, measured in sigma units from the main histogram peak (default is -2.8), <b>targetbg</b> is the target background value, giving a final brightness to the image, range [0, 1], default is 0.25. The default values are those used in the Auto-stretch rendering from the GUI.\n\nDo not use the unlinked version after color calibration, it will alter the white balance")
+#define STR_AUTOTUNE N_("Measures on synthetic data in memory the fastest number of blocks per thread for the median and mean stacking and the fastest tiling of the deconvolution on this machine, and saves them in the tuning group of the settings, used by the processing from then on. This takes a few minutes and should be run again after changing the number of threads with <b>setcpu</b>.\n\nThe <b>-reset</b> option clears the measured values, the default heuristics are then used")
 
 #define STR_BG N_("Returns the background level of the loaded image")
 #define STR_BGNOISE N_("Returns the background noise level of the loaded image")
+#define STR_BATCHSTRETCH N_("Applies a chain of stretches to a list of FITS files without loading them as the current image, and saves the results with the prefix given by <b>-prefix=</b> (default is stretch_). The stretches are applied in the order of the options: <b>-mtf=</b> takes the low, midtones and high values, <b>-asinh=</b> the stretch factor and optionally the offset, <b>-ght=</b> the D, B, LP, SP and HP parameters of a generalized hyperbolic stretch on independent channels.\n\nFile names may contain the wildcards * and ?. Several files are processed in parallel and, for 16-bit images, the chain is composed once into a lookup table shared by all of them")
 #define STR_BINXY N_("Computes the numerical binning of the in-memory image (sum of the pixels 2x2, 3x3..., like the analogic binning of CCD camera). If the optional argument <b>-sum</b> is passed, then the sum of pixels is computed, while it is the average when no optional argument is provided")
 #define STR_BOXSELECT N_("Make a selection area in the currently loaded image with the arguments <b>x</b>, <b>y</b>, <b>width</b> and <b>height</b>, with <b>x</b> and <b>y</b> being the coordinates of the top left corner starting at (0, 0), and <b>width</b> and <b>height</b>, the size of the selection. The <b>-clear</b> argument deletes any selection area. If no argument is passed, the current selection is printed")
 
-#define STR_CALIBRATE N_("Calibrates the sequence <b>sequencename</b> using bias, dark and flat given in argument.\n\nFor bias, a uniform level can be specified instead of an image, by entering a quoted expression starting with an = sign, such as -bias=\"=256\" or -bias=\"=64*$OFFSET\".\n\nBy default, cosmetic correction is not activated. If you wish to apply some, you will need to specify it with <b>-cc=</b> option.\nYou can use <b>-cc=dark</b> to detect hot and cold pixels from the masterdark (a masterdark must be given with the <b>-dark=</b> option), optionally followed by <b>siglo</b> and <b>sighi</b> for cold and hot pixels respectively. A value of 0 deactivates the correction. If sigmas are not provided, only hot pixels detection with a sigma of 3 will be applied.\nAlternatively, you can use <b>-cc=bpm</b> followed by the path to your Bad Pixel Map to specify which pixels must be corrected. An example file can be obtained with a <i>find_hot</i> command on a masterdark.\n\nThree options apply to color images (in CFA format): <b>-cfa</b> for cosmetic correction purposes, <b>-debayer</b> to demosaic images before saving them, and <b>-equalize_cfa</b> to equalize the mean intensity of RGB layers of the master flat, to avoid tinting the calibrated image.\nThe <b>-fix_xtrans</b> option is dedicated to X-Trans images by applying a correction on darks and biases to remove a rectangle pattern caused by autofocus.\nIt's also possible to optimize dark subtraction with <b>-opt</b>, which requires the supply of bias and dark masters, and automatically calculates the coefficient to be applied to dark, or calculates the coefficient thanks to the exposure keyword with <b>-opt=exp</b>.\nBy default, frames marked as excluded will not be processed. The argument <b>-all</b> can be used to force processing of all frames even if marked as excluded.\nThe output sequence name starts with the prefix \"pp_\" unless otherwise specified with option <b>-prefix=</b>.\nIf <b>-fitseq</b> is provided, the output sequence will be a FITS sequence (single file)")
+#define STR_CALIBRATE N_("Calibrates the sequence <b>sequencename</b> using bias, dark and flat given in argument.\n\nFor bias, a uniform level can be specified instead of an image, by entering a quoted expression starting with an = sign, such as -bias=\"=256\" or -bias=\"=64*$OFFSET\".\n\nBy default, cosmetic correction is not activated. If you wish to apply some, you will need to specify it with <b>-cc=</b> option.\nYou can use <b>-cc=dark</b> to detect hot and cold pixels from the masterdark (a masterdark must be given with the <b>-dark=</b> option), optionally followed by <b>siglo</b> and <b>sighi</b> for cold and hot pixels respectively. A value of 0 deactivates the correction. If sigmas are not provided, only hot pixels detection with a sigma of 3 will be applied.\nAlternatively, you can use <b>-cc=bpm</b> followed by the path to your Bad Pixel Map to specify which pixels must be corrected. An example file can be obtained with a <i>find_hot</i> command on a masterdark.\n\nThree options apply to color images (in CFA format): <b>-cfa</b> for cosmetic correction purposes, <b>-debayer</b> to demosaic images before saving them, and <b>-equalize_cfa</b> to equalize the mean intensity of RGB layers of the master flat, to avoid tinting the calibrated image.\nThe <b>-fix_xtrans</b> option is dedicated to X-Trans images by applying a correction on darks and biases to remove a rectangle pattern caused by autofocus.\nIt's also possible to optimize dark subtraction with <b>-opt</b>, which requires the supply of bias and dark masters, and automatically calculates the coefficient to be applied to dark, or calculates the coefficient thanks to the exposure keyword with <b>-opt=exp</b>.\nBy default, frames marked as excluded will not be processed. The argument <b>-all</b> can be used to force processing of all frames even if marked as excluded.\nThe output sequence name starts with the prefix \"pp_\" unless otherwise specified with option <b>-prefix=</b>.\nIf <b>-fitseq</b> is provided, the output sequence will be a FITS sequence (single file), and with <b>-ser</b> a SER sequence (single file, 16 bits).\nWith <b>-quality</b>, stars are detected in each calibrated frame and the FWHM, weighted FWHM, roundness, background and number of stars are saved in the output sequence, as a registration would do, so that frames can be filtered without another pass on the data. Frames without stars are excluded.\nWith <b>-extract=</b>, followed by <b>ha</b>, <b>green</b> or <b>haoiii</b>, the channels of the calibrated CFA frames are extracted as EXTRACTHA, EXTRACTGREEN or EXTRACTHAOIII would do, and written instead of the calibrated frames in sequences prefixed with \"Ha_\", \"Green_\" or \"Ha_\" and \"OIII_\" followed by the calibration prefix, without saving the calibrated sequence. The optional argument <b>-resample={ha|oiii}</b> upsamples the Ha image or, with haoiii, downsamples the OIII image. This option cannot be used with -debayer or -quality")
 #define STR_CALIBRATE_SINGLE N_("Calibrates the image <b>imagename</b> using bias, dark and flat given in argument.\n\nFor bias, a uniform level can be specified instead of an image, by entering a quoted expression starting with an = sign, such as -bias=\"=256\" or -bias=\"=64*$OFFSET\".\n\nBy default, cosmetic correction is not activated. If you wish to apply some, you will need to specify it with <b>-cc=</b> option.\nYou can use <b>-cc=dark</b> to detect hot and cold pixels from the masterdark (a masterdark must be given with the <b>-dark=</b> option), optionally followed by <b>siglo</b> and <b>sighi</b> for cold and hot pixels respectively. A value of 0 deactivates the correction. If sigmas are not provided, only hot pixels detection with a sigma of 3 will be applied.\nAlternatively, you can use <b>-cc=bpm</b> followed by the path to your Bad Pixel Map to specify which pixels must be corrected. An example file can be obtained with a <i>find_hot</i> command on a masterdark.\n\nThree options apply to color images (in CFA format): <b>-cfa</b> for cosmetic correction purposes, <b>-debayer</b> to demosaic images before saving them, and <b>-equalize_cfa</b> to equalize the mean intensity of RGB layers of the master flat, to avoid tinting the calibrated image.\nThe <b>-fix_xtrans</b> option is dedicated to X-Trans images by applying a correction on darks and biases to remove a rectangle pattern caused by autofocus.\nIt's also possible to optimize dark subtraction with <b>-opt</b>, which requires the supply of bias and dark masters, and automatically calculates the coefficient to be applied to dark, or calculates the coefficient thanks to the exposure keyword with <b>-opt=exp</b>\nThe output filename starts with the prefix \"pp_\" unless otherwise specified with option <b>-prefix=</b>")
 #define STR_CAPABILITIES N_("Lists Siril capabilities, based on compilation options and runtime")
 #define STR_CATSEARCH N_("Searches an object by <b>name</b> and adds it to the user annotation catalog. The object is first searched in the annotation catalogs, if not found a request is made to SIMBAD.\nThe object can be a solar system object, in which case a prefix, 'a:' for asteroid, 'p:' for planet, 'c:' for comet, 'dp:' for dwarf planet or 's:' for natural satellite, is required before the object name. The search is done for the date, time and observing location found in the image header, using the <a href=\"https://ssp.imcce.fr/webservices/miriade/howto/ephemcc/#howto-sso\">IMCCE Miriade service</a>")
@@ -26,7 +28,7 @@
 #define STR_CLOSE N_("Properly closes the opened image and the opened sequence, if any")
 #define STR_CONESEARCH N_("Displays stars from the local catalog by default for the loaded plate solved image, down to the provided <b>limit_magnitude</b> (13 by default for most catalogues, except 14.5 for aavso_chart, 20 for solsys, and ommitted for pgc).\nAn alternate online catalog can be specified with <b>-cat=</b>, taking values \n- for stars: tycho2, nomad, gaia, ppmxl, bsc, apass, gcvs, vsx, simbad, aavso_chart\n- for exoplanets: exo\n- for deep-sky: pgc\n- for solar system objects: solsys (closest <a href=\"https://vo.imcce.fr/webservices/data/displayIAUObsCodes.php\">IAU observatory code</a> can be passed with the argument <b>-obscode=</b> for better position accuracy)\n\nFor stars catalogues containing photometric data, stars with no B-V information will be kept; they can be excluded by passing <b>-phot</b>\nThe argument <b>-trix=</b> can be passed instead of a catalogue followed by a number between 0 and 511 to plot stars contained in local catalogues trixel of level 3 (for dev usage mainly)\n\nSome catalogs (bsc, gcvs, pgc, exo, aavso_chart, varisum and solsys) will also display, by default, names alongside markers in the display (GUI only) and list them in the log. For others with larger number of objects, namely vsx and simbad, the information can also be shown but, as it may clutter the display, it is not activated by default. This behavior can be toggled on/off with the options <b>-tag=on|off</b> to display names alongside markers and <b>-log=on|off</b> to list the objects in the console log\n\nThe list of items that are present in the image can optionally saved to a csv file by passing the argument <b>-out=</b>")
 #define STR_CONVERT N_("Converts all images of the current working directory that are in a supported format into Siril's sequence of FITS images (several files) or a FITS sequence (single file) if <b>-fitseq</b> is provided or a SER sequence (single file) if <b>-ser</b> is provided. The argument <b>basename</b> is the base name of the new sequence, numbers and the extension will be put behind it.\nFor FITS images, Siril will try to make a symbolic link; if not possible, files will be copied. The option <b>-debayer</b> applies demosaicing to CFA input images; in this case no symbolic link is done.\n<b>-start=index</b> sets the starting index number, useful to continue an existing sequence (not used with -fitseq or <b>-ser</b>; make sure you remove or clear the target .seq if it exists in that case).\nThe <b>-out=</b> option changes the output directory to the provided argument.\n\nSee also CONVERTRAW and LINK")
-#define STR_CONVERTRAW N_("Same as CONVERT but converts only DSLR RAW files found in the current working directory")
+#define STR_CONVERTRAW N_("Same as CONVERT but converts only DSLR RAW files found in the current working directory.\nWith the option <b>-rawseq</b>, the files are not converted: a RAW sequence is created, made of links to the RAW files, that are decoded in CFA mode when the sequence is processed. Stacking the masters from RAW sequences writes no intermediate files. This option cannot be used with <b>-debayer</b>, <b>-fitseq</b> or <b>-ser</b>")
 #define STR_COSME N_("Applies the local mean to a set of pixels on the loaded image (cosmetic correction). The coordinates of these pixels are in a text file [.lst file], the FIND_HOT command can also create it for single hot pixels, but manual operation is needed to remove rows or columns. COSME is adapted to correct residual hot and cold pixels after calibration.\nInstead of providing the list of bad pixels, it's also possible to detect them in the current image using the FIND_COSME command")
 #define STR_COSME_CFA N_("Same function as COSME but applying to RAW CFA images")
 #define STR_CROP N_("Crops to a selected area of the loaded image.\n\nIf a selection is active, no further arguments are required. Otherwise, or in scripts, arguments have to be given, with <b>x</b> and <b>y</b> being the coordinates of the top left corner, and <b>width</b> and <b>height</b> the size of the selection. Alternatively, the selection can be made using the BOXSELECT command")
@@ -63,9 +65,9 @@
 #define STR_GET N_("Gets a value from the settings using its name, or list all with <b>-a</b> (name and value list) or with <b>-A</b> (detailed list)\n\nSee also SET to update values")
 #define STR_GETREF N_("Prints information about the reference image of the sequence given in argument. First image has index 0")
 #define STR_GHT N_("Generalised hyperbolic stretch based on the work of the ghsastro.co.uk team.\n\nThe argument <b>-D=</b> defines the strength of the stretch, between 0 and 10. This is the only mandatory argument. The following optional arguments further tailor the stretch:\n<b>B</b> defines the intensity of the stretch near the focal point, between -5 and 15;\n<b>LP</b> defines a shadow preserving range between 0 and SP where the stretch will be linear, preserving shadow detail;\n<b>SP</b> defines the symmetry point of the stretch, between 0 and 1, which is the point at which the stretch will be most intense;\n<b>HP</b> defines a region between HP and 1 where the stretch is linear, preserving highlight details and preventing star bloat.\nIf omitted B, LP and SP default to 0.0 ad HP defaults to 1.0.\nAn optional argument (either <b>-human</b>, <b>-even</b> or <b>-independent</b>) can be passed to select either human-weighted or even-weighted luminance or independent colour channels for colour stretches. The argument is ignored for mono images. Alternatively, the argument <b>-sat</b> specifies that the stretch is performed on image saturation - the image must be color and all channels must be selected for this to work.\nOptionally the parameter <b>[channels]</b> may be used to specify the channels to apply the stretch to: this may be R, G, B, RG, RB or GB. The default is all channels. The clip mode can be set using the argument <b>-clipmode=</b>: values <b>clip</b>, <b>rescale</b>, <b>rgbblend</b> or <b>globalrescale</b> are accepted and the default is rgbblend")
-#define STR_GRAXPERT_BG N_("Runs the external tool GraXpert in background extraction mode.\n\nThe following optional arguments may be provided:\n\n<b>-algo=</b> sets the background removal algorithm and must be one of <b>ai</b>, <b>rbf</b>, <b>kriging</b> or <b>spline</b>;\n<b>-mode=</b> sets the background extraction mode and must be one of <b>sub</b> or <b>div</b>;\n<b>-kernel=</b> sets the RBF kernel and must be one of <b>thinplate</b>, <b>quintic</b>, <b>cubic</b> or <b>linear</b>;\n<b>-pts_per_row=</b> sets the number of points per row on the background sampling grid (default = 15);\n<b>-samplesize=</b> sets the sampling box size for each sample (default = 25);\n<b>-splineorder=</b> sets the spline order for use with the spline algorithm (default = 3);\n<b>-bgtol=</b> sets the background tolerance between -2.0 and 6.0 (default 2.0);\n<b>-smoothing=</b> sets the amount of background smoothing (default = 0.5);\n<b>-keep_bg</b> sets GraXpert to save the indicative background image;\n<b>-cpu</b> sets GraXpert to use CPU only;\n<b>-gpu</b> sets GraXpert to use a GPU if available (and otherwise fall back to CPU);\n<b>-ai_batch_size=</b> sets the batch size for AI operations (denoising and the background removal AI algorithm) (default = 4: bigger batch sizes may improve performance, especially on CPU, but require more memory). The optional argument <b>-ai_version=</b> forces a specific version of the AI model. Note that GraXpert AI background removal is comparatively fast anyway so at present there is little need to specify an older model for speed reasons even if running in CPU-only mode. If this argument is omitted, the latest available AI model version is used")
-#define STR_GRAXPERT_DECONV N_("Runs the external tool GraXpert in deconvolution mode.\n\nThe following optional arguments may be provided:\n\n<b>-strength=</b> sets the deconvolution strength, between 0.0 and 1.0 (default = 0.5) and <b>-psfsize=</b> the estimate of the FWHM of the image, range between 0.0 and 14.0 pixels (default = 5.0);\n<b>-gpu</b> sets GraXpert to use a GPU if available (and otherwise fall back to CPU);\n<b>-ai_batch_size=</b> sets the batch size for AI operations (denoising and the background removal AI algorithm) (default = 4: bigger batch sizes may improve performance, especially on CPU, but require more memory). The optional argument <b>-ai_version=</b> forces a specific version of the AI model. If this argument is omitted, the latest available AI model version is used")
-#define STR_GRAXPERT_DENOISE N_("Runs the external tool GraXpert in denoising mode.\n\nThe following optional arguments may be provided:\n\n<b>-strength=</b> sets the denoising strength, between 0.0 and 1.0 (default = 0.8);\n<b>-gpu</b> sets GraXpert to use a GPU if available (and otherwise fall back to CPU);\n<b>-ai_batch_size=</b> sets the batch size for AI operations (denoising and the background removal AI algorithm) (default = 4: bigger batch sizes may improve performance, especially on CPU, but require more memory). The optional argument <b>-ai_version=</b> forces a specific version of the AI model. For CPU-only usage the latest models may run very slowly, in which case an older model version such as 2.0.0 may provide a more acceptable balance between performance and runtime. If this argument is omitted, the latest available AI model version is used")
+#define STR_GRAXPERT_BG N_("Runs the external tool GraXpert in background extraction mode.\n\nThe following optional arguments may be provided:\n\n<b>-algo=</b> sets the background removal algorithm and must be one of <b>ai</b>, <b>rbf</b>, <b>kriging</b> or <b>spline</b>;\n<b>-mode=</b> sets the background extraction mode and must be one of <b>sub</b> or <b>div</b>;\n<b>-kernel=</b> sets the RBF kernel and must be one of <b>thinplate</b>, <b>quintic</b>, <b>cubic</b> or <b>linear</b>;\n<b>-pts_per_row=</b> sets the number of points per row on the background sampling grid (default = 15);\n<b>-samplesize=</b> sets the sampling box size for each sample (default = 25);\n<b>-splineorder=</b> sets the spline order for use with the spline algorithm (default = 3);\n<b>-bgtol=</b> sets the background tolerance between -2.0 and 6.0 (default 2.0);\n<b>-smoothing=</b> sets the amount of background smoothing (default = 0.5);\n<b>-keep_bg</b> sets GraXpert to save the indicative background image;\n<b>-cpu</b> sets GraXpert to use CPU only;\n<b>-gpu</b> sets GraXpert to use a GPU if available (and otherwise fall back to CPU);\n<b>-ai_batch_size=</b> sets the number of image tiles the AI model processes at once (denoising, deconvolution and the background removal AI algorithm) (default = 4: bigger batch sizes may improve performance, especially on large GPUs, but require more memory). The optional argument <b>-ai_version=</b> forces a specific version of the AI model. Note that GraXpert AI background removal is comparatively fast anyway so at present there is little need to specify an older model for speed reasons even if running in CPU-only mode. If this argument is omitted, the latest available AI model version is used")
+#define STR_GRAXPERT_DECONV N_("Runs the external tool GraXpert in deconvolution mode.\n\nThe following optional arguments may be provided:\n\n<b>-strength=</b> sets the deconvolution strength, between 0.0 and 1.0 (default = 0.5) and <b>-psfsize=</b> the estimate of the FWHM of the image, range between 0.0 and 14.0 pixels (default = 5.0);\n<b>-gpu</b> sets GraXpert to use a GPU if available (and otherwise fall back to CPU);\n<b>-ai_batch_size=</b> sets the number of image tiles the AI model processes at once (denoising, deconvolution and the background removal AI algorithm) (default = 4: bigger batch sizes may improve performance, especially on large GPUs, but require more memory). The optional argument <b>-ai_version=</b> forces a specific version of the AI model. If this argument is omitted, the latest available AI model version is used")
+#define STR_GRAXPERT_DENOISE N_("Runs the external tool GraXpert in denoising mode.\n\nThe following optional arguments may be provided:\n\n<b>-strength=</b> sets the denoising strength, between 0.0 and 1.0 (default = 0.8);\n<b>-gpu</b> sets GraXpert to use a GPU if available (and otherwise fall back to CPU);\n<b>-ai_batch_size=</b> sets the number of image tiles the AI model processes at once (denoising, deconvolution and the background removal AI algorithm) (default = 4: bigger batch sizes may improve performance, especially on large GPUs, but require more memory). The optional argument <b>-ai_version=</b> forces a specific version of the AI model. For CPU-only usage the latest models may run very slowly, in which case an older model version such as 2.0.0 may provide a more acceptable balance between performance and runtime. If this argument is omitted, the latest available AI model version is used")
 #define STR_GREY_FLAT N_("Equalizes the mean intensity of RGB layers in the loaded CFA image. This is the same process used on flats during calibration when the option equalize CFA is used")
 
 #define STR_HELP N_("Lists the available commands or help for one command")
@@ -120,7 +122,7 @@
 #define STR_PWD N_("Prints the current working directory")
 
 #define STR_REBAYER N_("Builds a Bayer masked color image from 4 separate images containing the data from Bayer subchannels CFA0, CFA1, CFA2 and CFA3. (The corresponding command to split the CFA pattern into subchannels is <b>split_cfa</b>.) This function can be used as part of a workflow applying some processing to the individual Bayer subchannels prior to demosaicing. The fifth parameter <b>bayerpattern</b> specifies the Bayer matrix pattern to recreate: <b>bayerpattern</b> should be one of 'RGGB', 'BGGR', 'GRBG' or 'GBRG'")
-#define STR_REGISTER N_("Finds and optionally performs geometric transforms on images of the sequence given in argument so that they may be superimposed on the reference image. Using stars for registration, this algorithm only works with deep sky images. Star detection options can be changed using <b>SETFINDSTAR</b> or the <i>Dynamic PSF</i> dialog.\n\nAll images of the sequence will be registered unless the option <b>-selected</b> is passed, in that case the excluded images will not be processed.\nThe <b>-2pass</b> option will only compute the transforms but not generate the transformed images, <b>-2pass</b> adds a preliminary pass to the algorithm to find a good reference image before computing the transforms, based on image quality and framing. To generate transformed images after this pass, use SEQAPPLYREG.\nIf created, the output sequence name will start with the prefix \"r_\" unless otherwise specified with <b>-prefix=</b> option. The output images can be rescaled by passing a <b>-scale=</b> argument with a float value between 0.1 and 3.\n\n<b>Image transformation options:</b>\n\nThe detection is done on the green layer for colour images, unless specified by the <b>-layer=</b> option with an argument ranging from 0 to 2 for red to blue.\n<b>-transf=</b> specifies the use of either <b>shift</b>, <b>similarity</b>, <b>affine</b> or <b>homography</b> (default) transformations respectively.\n<b>-minpairs=</b> will specify the minimum number of star pairs a frame must have with the reference frame, otherwise the frame will be dropped and excluded from the sequence.\n<b>-maxstars=</b> will specify the maximum number of stars to find within each frame (must be between 100 and 2000). With more stars, a more accurate registration can be computed, but will take more time to run.\n<b>-nostarlist</b> disables saving the star lists to disk.\n<b>-disto=</b> uses distortion terms from a previous platesolve solution (with a SIP order > 1). It takes as parameter either <b>image</b> to use the solution contained in the currently loaded image, <b>file</b> followed by the path to the image containing the solution or <b>master</b> to load automatically the matching distortion master corresponding to each image. When using this option, the polynomials are used both to correct star positions before computing the transformation and to undistort the images when output images are exported.\n\n<b>Image interpolation options:</b>\n\nBy default, transformations are applied to register the images by using interpolation.\nThe pixel interpolation method can be specified with the <b>-interp=</b> argument followed by one of the methods in the list <b>no</b>[ne], <b>ne</b>[arest], <b>cu</b>[bic], <b>la</b>[nczos4], <b>li</b>[near], <b>ar</b>[ea]}. If <b>none</b> is passed, the transformation is forced to shift and a pixel-wise shift is applied to each image without any interpolation.\nClamping of the bicubic and lanczos4 interpolation methods is the default, to avoid artefacts, but can be disabled with the <b>-noclamp</b> argument.\n\n<b>Image drizzle options:</b>\n\nOtherwise, the images can be exported using HST drizzle algorithm by passing the argument <b>-drizzle</b> which can take the additional options:\n<b>-pixfrac=</b> sets the pixel fraction (default = 1.0).\nThe <b>-kernel=</b> argument sets the drizzle kernel and must be followed by one of <b>point</b>, <b>turbo</b>, <b>square</b>, <b>gaussian</b>, <b>lanczos2</b> or <b>lanczos3</b>. The default is <b>square</b>.\nThe <b>-flat=</b> argument specifies a master flat to weight the drizzled input pixels (default is no flat).\n\nNote: when using <b>-drizzle</b> on images taken with a color camera, the input images must not be debayered. In that case, star detection will always occur on the green pixels")
+#define STR_REGISTER N_("Finds and optionally performs geometric transforms on images of the sequence given in argument so that they may be superimposed on the reference image. Using stars for registration, this algorithm only works with deep sky images. Star detection options can be changed using <b>SETFINDSTAR</b> or the <i>Dynamic PSF</i> dialog.\n\nAll images of the sequence will be registered unless the option <b>-selected</b> is passed, in that case the excluded images will not be processed.\nThe <b>-2pass</b> option will only compute the transforms but not generate the transformed images, <b>-2pass</b> adds a preliminary pass to the algorithm to find a good reference image before computing the transforms, based on image quality and framing. To generate transformed images after this pass, use SEQAPPLYREG.\nIf created, the output sequence name will start with the prefix \"r_\" unless otherwise specified with <b>-prefix=</b> option. The output images can be rescaled by passing a <b>-scale=</b> argument with a float value between 0.1 and 3.\n\n<b>Image transformation options:</b>\n\nThe detection is done on the green layer for colour images, unless specified by the <b>-layer=</b> option with an argument ranging from 0 to 2 for red to blue.\n<b>-transf=</b> specifies the use of either <b>shift</b>, <b>similarity</b>, <b>affine</b> or <b>homography</b> (default) transformations respectively.\n<b>-minpairs=</b> will specify the minimum number of star pairs a frame must have with the reference frame, otherwise the frame will be dropped and excluded from the sequence.\n<b>-maxstars=</b> will specify the maximum number of stars to find within each frame (must be between 100 and 2000). With more stars, a more accurate registration can be computed, but will take more time to run.\n<b>-detectbin=</b> followed by 2 or 4 detects the stars on a copy of each image binned by this factor and refines their positions on the full resolution image, which is faster on large oversampled images (default is 1, no binning).\n<b>-nostarlist</b> disables saving the star lists to disk.\n<b>-disto=</b> uses distortion terms from a previous platesolve solution (with a SIP order > 1). It takes as parameter either <b>image</b> to use the solution contained in the currently loaded image, <b>file</b> followed by the path to the image containing the solution or <b>master</b> to load automatically the matching distortion master corresponding to each image. When using this option, the polynomials are used both to correct star positions before computing the transformation and to undistort the images when output images are exported.\n\n<b>Image interpolation options:</b>\n\nBy default, transformations are applied to register the images by using interpolation.\nThe pixel interpolation method can be specified with the <b>-interp=</b> argument followed by one of the methods in the list <b>no</b>[ne], <b>ne</b>[arest], <b>cu</b>[bic], <b>la</b>[nczos4], <b>li</b>[near], <b>ar</b>[ea]}. If <b>none</b> is passed, the transformation is forced to shift and a pixel-wise shift is applied to each image without any interpolation.\nClamping of the bicubic and lanczos4 interpolation methods is the default, to avoid artefacts, but can be disabled with the <b>-noclamp</b> argument.\n\n<b>Image drizzle options:</b>\n\nOtherwise, the images can be exported using HST drizzle algorithm by passing the argument <b>-drizzle</b> which can take the additional options:\n<b>-pixfrac=</b> sets the pixel fraction (default = 1.0).\nThe <b>-kernel=</b> argument sets the drizzle kernel and must be followed by one of <b>point</b>, <b>turbo</b>, <b>square</b>, <b>gaussian</b>, <b>lanczos2</b> or <b>lanczos3</b>. The default is <b>square</b>.\nThe <b>-flat=</b> argument specifies a master flat to weight the drizzled input pixels (default is no flat).\n\nNote: when using <b>-drizzle</b> on images taken with a color camera, the input images must not be debayered. In that case, star detection will always occur on the green pixels")
 #define STR_RELOADSCRIPTS N_("Rescans the scripts folders and updates the Scripts menu")
 #define STR_REQUIRES N_("Returns an error if the version of Siril is older than the minimum required version passed in the first argument. Optionally, takes a second argument for the Siril version at which the script is obsolete: returns an error if the version of Siril is <b>newer than or equal to</b> the one passed in the second argument.\n\nExample: <i>requires 1.2.0 1.4.0</i> allows the script to run for all of the 1.2.x series and 1.3.x series, but will not run for any versions earlier than 1.2.0 or for version 1.4.0 or any later versions")
 #define STR_RESAMPLE N_("Resamples the loaded image, either with a factor <b>factor</b> or for the target width or height provided by either of <b>-width=</b>, <b>-height=</b> or <b>-maxdim=</b>. This is generally used to resize images: a factor of 0.5 divides size by 2. The <b>-maxdim</b> argument can be used to resize the longest dimension of the image to a set size, which can be useful for optimizing images for certain websites, e.g. social media websites.\nIn the graphical user interface, we can see that several interpolation algorithms are proposed.\n\nThe pixel interpolation method can be specified with the <b>-interp=</b> argument followed by one of the methods in the list <b>no</b>[ne], <b>ne</b>[arest], <b>cu</b>[bic], <b>la</b>[nczos4], <b>li</b>[near], <b>ar</b>[ea]}.\nClamping of the bicubic and lanczos4 interpolation methods is the default, to avoid artefacts, but can be disabled with the <b>-noclamp</b> argument")
@@ -149,10 +151,11 @@
 #define STR_SEQCOSME N_("Same command as COSME but for the the sequence <b>sequencename</b>. Only selected images in the sequence are processed.\n\nThe output sequence name starts with the prefix \"cosme_\" unless otherwise specified with option <b>-prefix=</b>")
 #define STR_SEQCOSME_CFA N_("Same command as COSME_CFA but for the the sequence <b>sequencename</b>. Only selected images in the sequence are processed.\n\nThe output sequence name starts with the prefix \"cosme_\" unless otherwise specified with option <b>-prefix=</b>")
 #define STR_SEQCROP N_("Crops the sequence given in argument <b>sequencename</b>. Only selected images in the sequence are processed.\n\nThe crop selection is specified by the upper left corner position <b>x</b> and <b>y</b> and the selection <b>width</b> and <b>height</b>, like for CROP.\nThe output sequence name starts with the prefix \"cropped_\" unless otherwise specified with <b>-prefix=</b> option")
+#define STR_SEQEXPORT N_("Exports the images of the sequence <b>sequencename</b> to JPEG, PNG or JPEG XL files, in the format given by <b>jpg</b>, <b>png</b> or <b>jxl</b>. Only selected images in the sequence are processed. Several images are encoded at the same time, as many as fit in the memory available, the threads being shared between them.\n\nThe option <b>-quality=</b> sets the quality of the JPEG files, between 10 and 100 (default 100), or of the JPEG XL files, between 0 and 100 (default 94). For JPEG XL, the option <b>-effort=</b> sets the effort of the encoder, between 1 and 9 (default 7), and <b>-8bit</b> forces an 8-bit output. PNG files are 16-bit unless the images are 8-bit.\nThe output files are named after the sequence, prefixed with the <b>-prefix=</b> option if given")
 #define STR_SEQEXTRACTHA N_("Same command as EXTRACT_HA but for the sequence <b>sequencename</b>.\n\nThe output sequence name starts with the prefix \"Ha_\" unless otherwise specified with option <b>-prefix=</b>")
 #define STR_SEQEXTRACTGREEN N_("Same command as EXTRACT_GREEN but for the sequence <b>sequencename</b>.\n\nThe output sequence name starts with the prefix \"Green_\" unless otherwise specified with option <b>-prefix=</b>")
 #define STR_SEQEXTRACTHAOIII N_("Same command as EXTRACT_HAOIII but for the sequence <b>sequencename</b>.\n\nThe output sequences names start with the prefixes \"Ha_\" and \"OIII_\"")
-#define STR_SEQFINDSTAR N_("Same command as FINDSTAR but for the sequence <b>sequencename</b>.\n\nThe option <b>-out=</b> is not available for this process as all the star list files are saved with the default name <i>seqname_seqnb.lst</i>")
+#define STR_SEQFINDSTAR N_("Same command as FINDSTAR but for the sequence <b>sequencename</b>.\n\nThe option <b>-out=</b> is not available for this process as all the star list files are saved with the default name <i>seqname_seqnb.lst</i>.\n\nWith the option <b>-track</b>, images are processed in order and the stars of each image are searched again around their positions in the previous image, shifted by the registration data if available, instead of running the full detection. The full detection is run again when too many stars are lost, for example after a large drift or a passing cloud. New stars entering the field are only found by the full detection")
 #define STR_SEQFIND_COSME N_("Same command as FIND_COSME but for the sequence <b>sequencename</b>.\n\nThe output sequence name starts with the prefix \"cc_\" unless otherwise specified with <b>-prefix=</b> option")
 #define STR_SEQFIND_COSME_CFA N_("Same command as FIND_COSME_CFA but for the sequence <b>sequencename</b>.\n\nThe output sequence name starts with the prefix \"cc_\" unless otherwise specified with <b>-prefix=</b> option")
 #define STR_SEQFIXBANDING N_("Same command as FIXBANDING but for the sequence <b>sequencename</b>.\n\nThe output sequence name starts with the prefix \"unband_\" unless otherwise specified with <b>-prefix=</b> option")
@@ -168,20 +171,22 @@
 #define STR_SEQMODASINH N_("Same command as MODASINH but the sequence must be specified as the first argument. In addition, the optional argument <b>-prefix=</b> can be used to set a custom prefix")
 #define STR_SEQMTF N_("Same command as MTF but for the sequence <b>sequencename</b>.\n\nThe output sequence name starts with the prefix \"mtf_\" unless otherwise specified with <b>-prefix=</b> option")
 #define STR_SEQPLATESOLVE N_("Plate solve a sequence. A new sequence will be created with the prefix \"ps_\" if the input sequence is SER, otherwise, the images headers will be updated. In case of SER, providing the metadata is mandatory and the output sequence will be in the FITS cube format, as SER cannot store WCS data.\nIf WCS or other image metadata are erroneous or missing, arguments must be passed:\n  the approximate image center coordinates can be provided in decimal degrees or degree/hour minute second values (J2000 with colon separators), with right ascension and declination values separated by a comma or a space (not mandatory for astrometry.net).\n focal length and pixel size can be passed with <b>-focal=</b> (in mm) and <b>-pixelsize=</b> (in microns), overriding values from images and settings. See also options to solve blindly with local Astrometry.net\n\nFor faster star detection in big images, downsampling the image is possible with <b>-downscale</b>.\nThe solve can account for distortions using SIP convention with polynomials up to order 5. Default value is taken form the astrometry preferences. This can be changed with the option <b>-order=</b> giving a value between 1 and 5.\nWhen using Siril solver local catalogues or with local Astrometry.net, if the initial solve is not successful, the solver will search for a solution within a cone of radius specified with <b>-radius=</b> option. If no value is passed, the search radius is taken from the astrometry preferences. Siril near search can be disabled by passing a value of 0. (cannot be disabled for Astrometry.net).\nImages already solved will be skipped by default. This can be disabled by passing the option <b>-force</b>.\nUsing this command will update registration data unless the option <b>-noreg</b> is passed.\nYou can save the current solution as a distortion file with the option <b>-disto=</b>.\n\nImages can be either plate solved by Siril using a star catalogue and the global registration algorithm or by astrometry.net's local solve-field command (enabled with <b>-localasnet</b>).\n\n<b>Siril platesolver options: </b>\nThe limit magnitude of stars used for plate solving is automatically computed from the size of the field of view, but can be altered by passing a +offset or -offset value to <b>-limitmag=</b>, or simply an absolute positive value for the limit magnitude.\nThe choice of the star catalog is automatic unless the <b>-catalog=</b> option is passed: if local catalogs are installed, they are used, otherwise the choice is based on the field of view and limit magnitude. If the option is passed, it forces the use of the remote catalog given in argument, with possible values: tycho2, nomad, gaia, ppmxl, brightstars, apass.\nIf the computed field of view is larger than 5 degrees, star detection will be bounded to a cropped area around the center of the image unless <b>-nocrop</b> option is passed.\nWhen using online catalogues, a single catalogue extraction will be done for the entire sequence. If there is a lot of drift or different sampling, that may not succeed for all images. This can be disabled by passing the argument <b>-nocache</b>, in which case metadata from each image will be used (except for the forced values like center coordinates, pixel size and/or focal length).\n\n<b>Astrometry.net solver options:</b>\nPassing options <b>-blindpos</b> and/or <b>-blindres</b> enables to solve blindly for position and for resolution respectively. You can use these when solving an image with a completely unknown location and sampling")
+#define STR_SEQPM N_("Same command as PM but the expression is evaluated for each frame of the sequence <b>sequencename</b>, the token $T being the frame. The variable images are loaded only once and must have the dimensions of the frames, e.g. \"$T - 0.98 * $master$\".\nThe result can be rescaled with the option <b>-rescale</b>, as for PM, for each frame. The output sequence name starts with the prefix \"pm_\" unless otherwise specified with <b>-prefix=</b> option. The output sequence can be forced to FITS sequence with <b>-fitseq</b> or to SER with <b>-ser</b>")
 #define STR_SEQPROFILE N_("Generates an intensity profile plot between 2 points in each image in the sequence. After the mandatory first argument stating the sequence to process, the other arguments are the same as for the <b>profile</b> command. If processing a sequence and it is desired to have the current image number and total number of images displayed in the format \"My Sequence (1 / 5)\", the given title should end with () (e.g. \"My Sequence ()\" and the numbers will be populated automatically)")
 #define STR_SEQPSF N_("Same command as PSF but runs on sequences. This is similar to the one-star registration, except results can be used for photometry analysis rather than aligning images and the coordinates of the star can be provided by options.\nThis command is what is called internally by the menu that appears on right click in the image, with the PSF for the sequence entry. By default, it will run with parallelisation activated; if registration data already exists for the sequence, they will be used to shift the search window in each image. If there is no registration data and if there is significant shift between images in the sequence, the default settings will fail to find stars in the initial position of the search area.\nThe follow star option can then be activated by going in the registration tab, selecting the one-star registration and checking the follow star movement box (default in headless if no registration data is available).\n\nResults will be displayed in the Plot tab, from which they can also be exported to a comma-separated values (CSV) file for external analysis.\n\nWhen creating a light curve, the first star for which seqpsf has been run, marked 'V' in the display, will be considered as the variable star. All others are averaged to create a reference light curve subtracted to the light curve of the variable star.\n\nCurrently, in headless operation, the command prints some analysed data in the console, another command allows several stars to be analysed and plotted as a light curve: LIGHT_CURVE. Arguments are mandatory in headless, with -at= allowing coordinates in pixels to be provided for the target star and -wcs= allowing J2000 equatorial coordinates to be provided")
+#define STR_SEQQUALITY N_("Estimates the sharpness of the selected images of the sequence <b>sequencename</b> with the quality estimate of the DFT registration, on the <b>channel</b> given in argument or on the green channel by default, without registering them. The values are stored as the quality of the registration data of the channel and can then be used to sort the images or to filter them with the <b>-filter-quality=</b> option of the stacking. The quality of CFA images is computed on their green pixels")
 #define STR_SEQRESAMPLE N_("Scales the sequence given in argument <b>sequencename</b>. Only selected images in the sequence are processed.\n\nThe scale factor is specified either by the <b>-scale=</b> argument or by setting the output width, height or maximum dimension using the <b>-width=</b>, <b>-height=</b> or <b>-maxdim=</b> options.\n\nAn interpolation method may be specified using the <b>-interp=</b> argument followed by one of the methods in the list <b>ne</b>[arest], <b>cu</b>[bic], <b>la</b>[nczos4], <b>li</b>[near], <b>ar</b>[ea]}.. Clamping is applied for cubic and lanczos interpolation.\n\nThe output sequence name starts with the prefix \"scaled_\" unless otherwise specified with <b>-prefix=</b> option")
-#define STR_SEQRL N_("The same as the RL command, but applies to a sequence which must be specified as the first argument")
-#define STR_SEQSB N_("The same as the SB command, but applies to a sequence which must be specified as the first argument")
+#define STR_SEQRL N_("The same as the RL command, but applies to a sequence which must be specified as the first argument\n\nWhen the PSF is estimated blindly, <b>-psfsamples=</b> estimates it on this number of frames spread over the sequence instead of the first one only, and each frame is deconvolved with the PSF interpolated between the two closest samples, by FWHM if the sequence is registered or by frame number otherwise")
+#define STR_SEQSB N_("The same as the SB command, but applies to a sequence which must be specified as the first argument\n\nWhen the PSF is estimated blindly, <b>-psfsamples=</b> estimates it on this number of frames spread over the sequence instead of the first one only, and each frame is deconvolved with the PSF interpolated between the two closest samples, by FWHM if the sequence is registered or by frame number otherwise")
 #define STR_SEQSETMAG N_("Same as SETMAG command but for the loaded sequence.\n\nThis command is only valid after having run SEQPSF or its graphical counterpart (select the area around a star and launch the PSF analysis for the sequence, it will appear in the graphs).\nThis command has the same goal as SETMAG but recomputes the reference magnitude for each image of the sequence where the reference star has been found.\nWhen running the command, the last star that has been analysed will be considered as the reference star. Displaying the magnitude plot before typing the command makes it easy to understand.\nTo reset the reference star and magnitude offset, see SEQUNSETMAG")
 #define STR_SEQSPLIT_CFA N_("Same command as SPLIT_CFA but for the sequence <b>sequencename</b>.\n\nThe output sequences names start with the prefix \"CFA_\" and a number unless otherwise specified with <b>-prefix=</b> option.\n<i>Limitation:</i> the sequence always outputs a sequence of FITS files, no matter the type of input sequence")
 #define STR_SEQSTARNET N_("This command calls <a href=\"https://www.starnetastro.com/\">Starnet++</a> to remove stars from the sequence <b>sequencename</b>. See STARNET")
 #define STR_SEQSTAT N_("Same command as STAT for sequence <b>sequencename</b>.\n\nData is saved as a csv file <b>output_file</b>.\nThe optional parameter defines the number of statistical values computed: <b>basic</b>, <b>main</b> (default) or <b>full</b> (more detailed but longer to compute).\n\t<b>basic</b> includes mean, median, sigma, bgnoise, min and max\n\t<b>main</b> includes basic with the addition of avgDev, MAD and the square root of BWMV\n\t<b>full</b> includes main with the addition of location and scale.\n\nIf <b>-cfa</b> is passed and the images are CFA, statistics are made on per-filter extractions")
-#define STR_SEQSUBSKY N_("Same command as SUBSKY but for the sequence <b>sequencename</b>.\nDithering, required for low dynamic gradients, can be disabled with <b>-nodither</b>.\n\nThe output sequence name starts with the prefix \"bkg_\" unless otherwise specified with <b>-prefix=</b> option. Only selected images in the sequence are processed")
+#define STR_SEQSUBSKY N_("Same command as SUBSKY but for the sequence <b>sequencename</b>.\nDithering, required for low dynamic gradients, can be disabled with <b>-nodither</b>.\nWith <b>-refsamples</b>, the samples are placed once on the reference image and used for all images, which is faster but requires a registered sequence, so that the stars stay away from the samples.\n\nThe output sequence name starts with the prefix \"bkg_\" unless otherwise specified with <b>-prefix=</b> option. Only selected images in the sequence are processed")
 #define STR_SEQTILT N_("Same command as TILT but for the sequence <b>sequencename</b>. It generally gives better results")
 #define STR_SEQUNSETMAG N_("Resets the magnitude calibration and reference star for the sequence. See SEQSETMAG")
 #define STR_SEQUPDATE_KEY N_("Same command as UPDATE_KEY but for the sequence <b>sequencename</b>. However, this command won't work on SER sequence")
-#define STR_SEQWIENER N_("The same as the <b>WIENER</b> command, but applies to a sequence which must be specified as the first argument")
+#define STR_SEQWIENER N_("The same as the <b>WIENER</b> command, but applies to a sequence which must be specified as the first argument\n\nWhen the PSF is estimated blindly, <b>-psfsamples=</b> estimates it on this number of frames spread over the sequence instead of the first one only, and each frame is deconvolved with the PSF interpolated between the two closest samples, by FWHM if the sequence is registered or by frame number otherwise")
 #define STR_SET N_("Updates a setting value, using its variable name, with the given value, or a set of values using an existing ini file with <b>-import=</b> option.\nSee GET to get values or the list of variables")
 #define STR_SET16 N_("Forbids images to be saved with 32 bits per channel on processing, use 16 bits instead")
 #define STR_SET32 N_("Allows images to be saved with 32 bits per channel on processing")
@@ -199,7 +204,8 @@
 #define STR_SPLIT N_("Splits the loaded color image into three distinct files (one for each color) and saves them in <b>file1</b>.fit, <b>file2</b>.fit and <b>file3</b>.fit files. A last argument can optionally be supplied, <b>-hsl</b>, <b>-hsv</b> or <b>lab</b> to perform an HSL, HSV or CieLAB extraction. If no option are provided, the extraction is of RGB type, meaning no conversion is done")
 #define STR_SPLIT_CFA N_("Splits the loaded CFA image into four distinct files (one for each channel) and saves them in files")
 #define STR_SSO N_("Searches and displays Solar System objects in the current loaded and plate solved image's field of view, using the online IMCCE SkyBoT cone search tool. Use <b>-mag=</b> to change the limit magnitude, defaults to 20")
-#define STR_STACK N_("Stacks the <b>sequencename</b> sequence, using options.\n\nRejection type:\nThe allowed types are: <b>sum</b>, <b>max</b>, <b>min</b>, <b>med</b> (or <b>median</b>) and <b>rej</b> (or <b>mean</b>). If no argument other than the sequence name is provided, sum stacking is assumed.\n\nStacking with rejection:\nTypes <b>rej</b> or <b>mean</b> require the use of additional arguments for rejection type and values. The rejection type is one of <b>n[one], p[ercentile], s[igma], m[edian], w[insorized], l[inear], g[eneralized], [m]a[d]</b> for Percentile, Sigma, Median, Winsorized, Linear-Fit, Generalized Extreme Studentized Deviate Test or k-MAD clipping. If omitted, the default Winsorized is used.\nThe <b>sigma low</b> and <b>sigma high</b> parameters of rejection are mandatory unless <b>none</b> is selected.\nOptionally, rejection maps can be created, showing where pixels were rejected in one (<b>-rejmap</b>) or two (<b>-rejmaps</b>, for low and high rejections) newly created images.\n\nNormalization of input images:\nFor <b>med</b> (or <b>median</b>) and <b>rej</b> (or <b>mean</b>) stacking types, different types of normalization are allowed: <b>-norm=add</b> for additive, <b>-norm=mul</b> for multiplicative. Options <b>-norm=addscale</b> and <b>-norm=mulscale</b> apply same normalization but with scale operations. <b>-nonorm</b> is the option to disable normalization. Otherwise addtive with scale method is applied by default.\n<b>-fastnorm</b> option specifies to use faster estimators for location and scale than the default IKSS.\n<b>-overlap_norm</b>, if passed, will compute normalization coeffcients on images overlaps instead of whole images (allowed only if <b>-maximize</b> is passed).\n\nOther options for rejection stacking:\nWeighting can be applied to the images of the sequences using the option <b>-weight=</b> followed by:\n<b>noise</b> to add larger weights to frames with lower background noise.\n<b>nbstack</b> to weight input images based on how many images were used to create them, useful for live stacking.\n<b>nbstars</b> or <b>wfwhm</b> to weight input images based on number of stars or wFWHM computed during registration step.\n<b>-feather=</b> option will apply a feathering mask on each image borders over the distance (in pixels) given in argument.\n\nOutputs:\nResult image name can be set with the <b>-out=</b> option. Otherwise, it will be named as <b>sequencename</b>_stacked.fit.\n<b>-output_norm</b> applies a normalization to rescale result in the [0, 1] range (median and mean stacking only).\n<b>-maximize</b> option will use registration data from the sequence to create a stacked image that encompasses all the images of the sequence (applicable to all methods except median stacking).\n<b>-upscale</b> option will upscale the sequence by a factor 2 prior to stacking using the registration data (applicable to all methods except median stacking).\n<b>-rgb_equal</b> will use normalization to equalize color image backgrounds, useful if PCC/SPCC or unlinked AUTOSTRETCH will not be used.\n<b>-32b</b> will override the bitdepth set in Preferences and save the stacked image in 32b.\n\n\nFiltering out images:\nImages to be stacked can be selected based on some filters, like manual selection or best FWHM, with some of the <b>-filter-*</b> options.\nSee the command reference for the complete documentation on this command")
+#define STR_STACK N_("Stacks the <b>sequencename</b> sequence, using options.\n\nRejection type:\nThe allowed types are: <b>sum</b>, <b>max</b>, <b>min</b>, <b>med</b> (or <b>median</b>) and <b>rej</b> (or <b>mean</b>). If no argument other than the sequence name is provided, sum stacking is assumed.\n\nStacking with rejection:\nTypes <b>rej</b> or <b>mean</b> require the use of additional arguments for rejection type and values. The rejection type is one of <b>n[one], p[ercentile], s[igma], m[edian], w[insorized], l[inear], g[eneralized], [m]a[d]</b> for Percentile, Sigma, Median, Winsorized, Linear-Fit, Generalized Extreme Studentized Deviate Test or k-MAD clipping. If omitted, the default Winsorized is used.\nThe <b>sigma low</b> and <b>sigma high</b> parameters of rejection are mandatory unless <b>none</b> is selected.\nOptionally, rejection maps can be created, showing where pixels were rejected in one (<b>-rejmap</b>) or two (<b>-rejmaps</b>, for low and high rejections) newly created images.\n\nNormalization of input images:\nFor <b>med</b> (or <b>median</b>) and <b>rej</b> (or <b>mean</b>) stacking types, different types of normalization are allowed: <b>-norm=add</b> for additive, <b>-norm=mul</b> for multiplicative. Options <b>-norm=addscale</b> and <b>-norm=mulscale</b> apply same normalization but with scale operations. <b>-nonorm</b> is the option to disable normalization. Otherwise addtive with scale method is applied by default.\n<b>-fastnorm</b> option specifies to use faster estimators for location and scale than the default IKSS.\n<b>-overlap_norm</b>, if passed, will compute normalization coeffcients on images overlaps instead of whole images (allowed only if <b>-maximize</b> is passed).\n\nOther options for rejection stacking:\nWeighting can be applied to the images of the sequences using the option <b>-weight=</b> followed by:\n<b>noise</b> to add larger weights to frames with lower background noise.\n<b>nbstack</b> to weight input images based on how many images were used to create them, useful for live stacking.\n<b>nbstars</b> or <b>wfwhm</b> to weight input images based on number of stars or wFWHM computed during registration step.\n<b>-feather=</b> option will apply a feathering mask on each image borders over the distance (in pixels) given in argument.\n<b>-streaming</b> option will stack the images one at a time into per-pixel accumulators, which keeps memory usage low for sequences with many images. It can be used without rejection or with sigma clipping, which is then done in one iteration centred on the mean.\n<b>-incremental</b> option keeps the streaming accumulators in a <b>sequencename</b>.acc file, so that stacking the sequence again only reads the images that were not stacked yet. It can be used without rejection or with sigma clipping, new images being then clipped against the statistics of the previous ones. Weighting, feathering, rejection maps and <b>-maximize</b> are not available in this mode.\n<b>-applyreg</b> option transforms the images with their registration data while they are read for stacking, with the interpolation given by <b>-interp=</b> and the clamping disabled by <b>-noclamp</b> as for SEQAPPLYREG, so that the registered sequence does not need to be written. It is available for median and mean stacking of images of the same size, without distortion correction, <b>-maximize</b> or feathering. With <b>-upscale</b>, the upscaled images are transformed.\n<b>-comet=vx,vy</b> option stacks the images aligned on the stars and aligned on a moving object like a comet in the same read of the images, the object moving by <b>vx</b>, <b>vy</b> pixels per hour as given by the comet registration. The second result is saved with the <b>_comet</b> suffix. It is available for median and mean stacking of sequences registered with simple shifts whose images have an observation date, without <b>-maximize</b>, feathering, <b>-streaming</b>, <b>-incremental</b> or <b>-applyreg</b>.\n\nOutputs:\nResult image name can be set with the <b>-out=</b> option. Otherwise, it will be named as <b>sequencename</b>_stacked.fit.\n<b>-output_norm</b> applies a normalization to rescale result in the [0, 1] range (median and mean stacking only).\n<b>-band=first,last</b> only stacks the rows <b>first</b> to <b>last</b> (excluded) of the result, counted from 0 at the top of the image, the other rows staying black (median and mean stacking only). Several machines can then stack the bands of a large sequence in parallel and STACKMERGE assembles their results. The machines must use the same sequence file, so that they normalize the images with the same coefficients, and <b>-output_norm</b> and <b>-incremental</b> cannot be used.\n<b>-maximize</b> option will use registration data from the sequence to create a stacked image that encompasses all the images of the sequence (applicable to all methods except median stacking).\n<b>-upscale</b> option will upscale the sequence by a factor 2 prior to stacking using the registration data (applicable to all methods except median stacking). With mean stacking, the images are upscaled while they are read, no upscaled sequence is written.\n<b>-rgb_equal</b> will use normalization to equalize color image backgrounds, useful if PCC/SPCC or unlinked AUTOSTRETCH will not be used.\n<b>-32b</b> will override the bitdepth set in Preferences and save the stacked image in 32b.\n\n\nFiltering out images:\nImages to be stacked can be selected based on some filters, like manual selection or best FWHM, with some of the <b>-filter-*</b> options.\nSee the command reference for the complete documentation on this command")
+#define STR_STACKMERGE N_("Assembles the partial stacks <b>partial_stack1</b>, <b>partial_stack2</b>... made with the <b>-band=</b> option of STACK into the image <b>output</b>. The partial stacks must have the same size and bit depth, the rows stacked in each of them being read from their header")
 #define STR_STACKALL N_("Opens all sequences in the current directory and stacks them with the optionally specified stacking type and filtering or with sum stacking. See STACK command for options description")
 #define STR_STARNET N_("Calls <a href=\"https://www.starnetastro.com/\">StarNet</a> to remove stars from the loaded image.\n\n<b>Prerequisite:</b> StarNet is an external program, with no affiliation with Siril, and must be installed correctly prior the first use of this command, with the path to its CLI version installation correctly set in Preferences / Miscellaneous.\n\nThe starless image is loaded on completion, and a star mask image is created in the working directory unless the optional parameter <b>-nostarmask</b> is provided.\n\nOptionally, parameters may be passed to the command:\n- The option <b>-stretch</b> is for use with linear images and will apply a pre-stretch before running StarNet and the inverse stretch to the generated starless and starmask images.\n- To improve star removal on images with very tight stars, the parameter <b>-upscale</b> may be provided. This will upsample the image by a factor of 2 prior to StarNet processing and rescale it to the original size afterwards, at the expense of more processing time.\n- The optional parameter <b>-stride=value</b> may be provided, however the author of StarNet <i>strongly</i> recommends that the default stride of 256 be used")
 #define STR_START_LS N_("Initializes a livestacking session, using the optional calibration files and waits for input files to be provided by the LIVESTACK command until STOP_LS is called. Default processing will use shift-only registration and 16-bit processing because it's faster, it can be changed to rotation with <b>-rotate</b> and <b>-32bits</b>\n\n<i>Note that the live stacking commands put Siril in a state in which it's not able to process other commands. After START_LS, only LIVESTACK, STOP_LS and EXIT can be called until STOP_LS is called to return Siril in its normal, non-live-stacking, state</i>")
@@ -213,6 +219,7 @@
 #define STR_THRESHHI N_("Replaces values above <b>level</b> in the loaded image with <b>level</b>")
 #define STR_THRESH N_("Replaces values below <b>lo</b> with <b>lo</b> and values above <b>hi</b> with <b>hi</b> in the loaded image")
 #define STR_TILT N_("Computes the sensor tilt as the FWHM difference between the best and worst corner truncated mean values. The <b>clear</b> option allows to clear the drawing")
+#define STR_TRACE N_("Records the time spent in the processing stages, per thread, from <b>start</b> to <b>stop</b>, in the trace file <b>filename.json</b>. The spans are the commands, the reading, hook, writing and waits for memory of each frame of the sequence processing, and the reading and stacking of each block. The file is in the Chrome trace event format, it can be opened in ui.perfetto.dev or chrome://tracing. The trace is also written when Siril exits, and can be started at launch with the <b>--trace</b> option")
 #define STR_TRIXEL N_("For developers.\n\nWithout any argument, lists all the trixels of level 3 visible in the plate-solved image. The stars from each trixel can then be shown with command CONESEARCH using <b>-trix=</b> followed by a visible trixel number\n\nWith argument <b>-p</b>, prints out all the valid stars from all the 512 level3 trixels to file \"trixels.csv\"")
 
 #define STR_UNPURPLE N_("Applies a cosmetic filter to reduce effects of purple fringing on stars.\n\nIf the <b>-starmask</b> parameter is given, a star mask will be used to identify areas of the image to affect. If a Dynamic PSF has already been run, this will be used for the starmask, otherwise one will be created automatically. The <b>-mod=</b> parameter should be given a value somewhere around 0.14 to reduce the amount of purple. The <b>-thresh=</b> will specify the size modifier for each star in the starmask and should be large enough to cause the stars to be entirely processed without remaining purple fringing. The value should between 0 and 1, typically around 0.5.\nIf the <b>-starmask</b> parameter is not given, the purple reduction will be applied across the entire image for any purple pixels with a luminance value higher than the given <b>-thresh=</b>. In this case, the <b>-thresh=</b> value should be reasonably low. This mode is useful for starmasks or other images without nebula or galaxy")
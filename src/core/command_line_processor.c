@@ -25,9 +25,11 @@
 #include "core/siril.h"
 #include "algos/statistics.h"
 #include "core/proto.h"
+#include "core/icc_profile.h"
 #include "core/initfile.h"
 #include "core/OS_utils.h"
 #include "core/siril_log.h"
+#include "core/trace.h"
 #include "gui/utils.h"
 #include "gui/progress_and_log.h"
 #include "gui/registration_preview.h"
@@ -42,10 +44,13 @@
 #include "io/sequence.h"
 #include "io/single_image.h"
 #include "io/ser.h"
+#include "io/frame_cache.h"
 #include "livestacking/livestacking.h"
 
 #include "command.h"
 #include "command_line_processor.h"
+#include "script_cache.h"
+#include "script_scheduler.h"
 
 static const char *cmd_err_to_str(cmd_errors err) {
 	switch (err) {
@@ -138,6 +143,19 @@ void remove_trailing_cr(char *str) {
 		str[length - 1] = '\0';
 }
 
+/* commands that only change settings or the state of the program, for which
+ * siril-cli does not need to initialize color management yet */
+static const char *light_commands[] = { "capabilities", "cd", "close", "exit", "get",
+	"help", "offline", "online", "pwd", "requires", "set", "setcompress", "setcpu",
+	"setext", "setfindstar", "setmag", "setmem", "setphot", "unsetmag", NULL };
+
+static gboolean command_needs_color_management(const char *name) {
+	for (int i = 0; light_commands[i]; i++)
+		if (!g_ascii_strcasecmp(light_commands[i], name))
+			return FALSE;
+	return TRUE;
+}
+
 int execute_command(int wordnb) {
 	// search for the command in the list
 	if (word[0] == NULL) return 1;
@@ -199,6 +217,9 @@ int execute_command(int wordnb) {
 		}
 	}
 
+	if (command_needs_color_management(commands[i].name))
+		initialize_profiles_and_transforms();
+
 	// process the command
 	siril_log_color_message(_("Running command: %s\n"), "salmon", word[0]);
 	fprintf(stdout, "%lu: running command %s\n", time(NULL), word[0]);
@@ -328,6 +349,7 @@ gpointer execute_script(gpointer p) {
 	 */
 	gchar *saved_cwd = g_strdup(com.wd);
 	startmem = get_available_memory() / BYTES_IN_A_MB;
+	script_scheduler_begin();
 	gsize length = 0;
 	GDataInputStream *data_input = g_data_input_stream_new(input_stream);
 	while ((buffer = g_data_input_stream_read_line_utf8(data_input, &length,
@@ -364,20 +386,51 @@ gpointer execute_script(gpointer p) {
 			g_free (buffer);
 			continue;
 		};
+		/* waits for the sequence processings run as tasks it depends on */
+		if (script_scheduler_prepare(wordnb)) {
+			siril_log_message(_("Exiting batch processing.\n"));
+			retval = 1;
+			g_free (buffer);
+			break;
+		}
+
+		struct script_cache_entry *cache_entry = script_cache_begin(wordnb);
+		if (script_cache_is_up_to_date(cache_entry)) {
+			siril_log_color_message(_("Skipping command %s, its outputs are up to date\n"), "salmon", word[0]);
+			script_cache_end(cache_entry, FALSE);
+			memset(word, 0, sizeof word);
+			g_free (buffer);
+			continue;
+		}
 
+		/* the span of a command includes its processing thread */
+		gint64 span = trace_begin();
+		const char *command_name = g_intern_string(word[0]);
 		retval = execute_command(wordnb);
 
 		if (retval && retval != CMD_NO_WAIT) {
+			trace_end(span, "command", command_name, line);
 			siril_log_message(_("Error in line %d ('%s'): %s.\n"), line, buffer, cmd_err_to_str(retval));
 			siril_log_message(_("Exiting batch processing.\n"));
+			script_cache_end(cache_entry, FALSE);
 			g_free (buffer);
 			break;
 		}
+		/* the end of a command run as a task is done by the scheduler */
+		if (retval != CMD_NO_WAIT && script_scheduler_take_command(cache_entry, span, command_name, line, buffer)) {
+			memset(word, 0, sizeof word);
+			g_free (buffer);
+			continue;
+		}
 		if (retval != CMD_NO_WAIT && waiting_for_thread()) {
+			trace_end(span, "command", command_name, line);
 			retval = 1;
+			script_cache_end(cache_entry, FALSE);
 			g_free (buffer);
 			break;	// abort script on command failure
 		}
+		trace_end(span, "command", command_name, line);
+		script_cache_end(cache_entry, retval != CMD_NO_WAIT);
 		endmem = get_available_memory() / BYTES_IN_A_MB;
 		siril_debug_print("End of command %s, memory difference: %d MB\n", word[0], startmem - endmem);
 		startmem = endmem;
@@ -386,6 +439,9 @@ gpointer execute_script(gpointer p) {
 	}
 	g_object_unref(data_input);
 	g_object_unref(input_stream);
+	if (script_scheduler_end() && !retval)
+		retval = 1;
+	frame_cache_clear();
 
 	if (!com.headless) {
 		com.script = FALSE;
@@ -600,7 +656,12 @@ int processcommand(const char *line) {
 		if (len > 0)
 			g_print("input command:%s\n", myline);
 		parse_line(myline, len, &wordnb);
+		gint64 span = trace_begin();
+		const char *command_name = word[0] ? g_intern_string(word[0]) : NULL;
 		int ret = execute_command(wordnb);
+		// commands run in a processing thread are only traced until it starts
+		if (command_name)
+			trace_end(span, "command", command_name, -1);
 		if (ret) {
 			siril_log_color_message(_("Command execution failed: %s.\n"), "red", cmd_err_to_str(ret));
 			if (!com.script && !com.headless && (ret == CMD_WRONG_N_ARG || ret == CMD_ARG_ERROR)) {
@@ -0,0 +1,110 @@
+/*
+ * This file is part of Siril, an astronomy image processor.
+ * Copyright (C) 2005-2011 Francois Meyer (dulle at free.fr)
+ * Copyright (C) 2012-2025 team free-astro (see more in AUTHORS file)
+ * Reference site is https://siril.org
+ *
+ * Siril is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Siril is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Siril. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#if defined(__aarch64__) && defined(__linux__)
+#include <sys/auxv.h>
+#endif
+
+#include "core/siril.h"
+#include "core/siril_log.h"
+
+#include "cpu_dispatch.h"
+
+#if defined(__aarch64__) && defined(__linux__) && !defined(HWCAP_SVE)
+#define HWCAP_SVE (1 << 22)
+#endif
+
+simd_level cpu_simd_level = SIMD_BASELINE;
+
+static gboolean detected = FALSE;
+static gboolean supported[SIMD_NB_LEVELS] = { TRUE };
+
+const char *simd_level_name(simd_level level) {
+	switch (level) {
+		case SIMD_BASELINE:
+#if defined(__x86_64__)
+			return "SSE2";
+#elif defined(__aarch64__)
+			return "NEON";
+#else
+			return "baseline";
+#endif
+		case SIMD_AVX2:
+			return "AVX2";
+		case SIMD_AVX512:
+			return "AVX-512";
+		case SIMD_SVE:
+			return "SVE";
+		default:
+			return "unknown";
+	}
+}
+
+/* a level is supported if the kernels were built for it and the processor and
+ * the system can run them */
+static void detect() {
+	if (detected)
+		return;
+#ifdef SIMD_HAVE_AVX2
+	__builtin_cpu_init();
+	// the checks include the saving of the registers by the system
+	supported[SIMD_AVX2] = __builtin_cpu_supports("avx2");
+#endif
+#ifdef SIMD_HAVE_AVX512
+	supported[SIMD_AVX512] = supported[SIMD_AVX2] && __builtin_cpu_supports("avx512f") &&
+		__builtin_cpu_supports("avx512bw") && __builtin_cpu_supports("avx512dq") &&
+		__builtin_cpu_supports("avx512vl");
+#endif
+#if defined(SIMD_HAVE_SVE) && defined(__linux__)
+	supported[SIMD_SVE] = (getauxval(AT_HWCAP) & HWCAP_SVE) != 0;
+#endif
+	detected = TRUE;
+}
+
+gboolean cpu_dispatch_supported(simd_level level) {
+	detect();
+	return (guint) level < SIMD_NB_LEVELS && supported[level];
+}
+
+void cpu_dispatch_set_level(simd_level level) {
+	if (cpu_dispatch_supported(level))
+		cpu_simd_level = level;
+}
+
+void cpu_dispatch_init() {
+	simd_level best = SIMD_BASELINE;
+	for (int level = SIMD_BASELINE + 1; level < SIMD_NB_LEVELS; level++)
+		if (cpu_dispatch_supported(level))
+			best = level;
+
+	if (com.pref.simd > 0) {
+		simd_level wanted = com.pref.simd - 1;
+		if (cpu_dispatch_supported(wanted)) {
+			cpu_simd_level = wanted;
+			siril_log_message(_("SIMD kernels: %s, set by core.simd (%s available)\n"),
+					simd_level_name(wanted), simd_level_name(best));
+			return;
+		}
+		siril_log_color_message(_("SIMD kernels: %s set by core.simd is not available, using %s\n"),
+				"salmon", simd_level_name(wanted), simd_level_name(best));
+	}
+	else siril_log_message(_("SIMD kernels: %s\n"), simd_level_name(best));
+	cpu_simd_level = best;
+}
@@ -0,0 +1,93 @@
+#ifndef SRC_CORE_CPU_DISPATCH_H_
+#define SRC_CORE_CPU_DISPATCH_H_
+
+#include <glib.h>
+
+/* The hot kernels are compiled once per instruction set, from a single body
+ * inlined in one function per instruction set, and the variant used is chosen
+ * at startup from the processor and the core.simd setting. The baseline is the
+ * instruction set the build targets, SSE2 on x86-64 and NEON on AArch64.
+ * With MinGW the stack is not aligned for the AVX registers, only the
+ * baseline is built. */
+typedef enum {
+	SIMD_BASELINE,
+	SIMD_AVX2,
+	SIMD_AVX512,	// F, BW, DQ and VL
+	SIMD_SVE,
+	SIMD_NB_LEVELS
+} simd_level;
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__) && !defined(_WIN32)
+#define SIMD_HAVE_AVX2
+#define SIMD_HAVE_AVX512
+#define SIMD_TARGET_AVX2 __attribute__((target("avx2")))
+#define SIMD_TARGET_AVX512 __attribute__((target("avx2,avx512f,avx512bw,avx512dq,avx512vl")))
+#endif
+#if defined(__aarch64__) && defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 10
+#define SIMD_HAVE_SVE
+#define SIMD_TARGET_SVE __attribute__((target("+sve")))
+#endif
+
+/* the body of a kernel with variants, inlined in each of them */
+#define SIMD_BODY static inline __attribute__((always_inline))
+
+#define SIMD_VARIANT(target, name, suffix, params, args) \
+	target static void name##_##suffix params { name##_body args; }
+
+#ifdef SIMD_HAVE_AVX2
+#define SIMD_VARIANT_AVX2(name, params, args) SIMD_VARIANT(SIMD_TARGET_AVX2, name, avx2, params, args)
+#define SIMD_ENTRY_AVX2(name) [SIMD_AVX2] = name##_avx2,
+#else
+#define SIMD_VARIANT_AVX2(name, params, args)
+#define SIMD_ENTRY_AVX2(name)
+#endif
+#ifdef SIMD_HAVE_AVX512
+#define SIMD_VARIANT_AVX512(name, params, args) SIMD_VARIANT(SIMD_TARGET_AVX512, name, avx512, params, args)
+#define SIMD_ENTRY_AVX512(name) [SIMD_AVX512] = name##_avx512,
+#else
+#define SIMD_VARIANT_AVX512(name, params, args)
+#define SIMD_ENTRY_AVX512(name)
+#endif
+#ifdef SIMD_HAVE_SVE
+#define SIMD_VARIANT_SVE(name, params, args) SIMD_VARIANT(SIMD_TARGET_SVE, name, sve, params, args)
+#define SIMD_ENTRY_SVE(name) [SIMD_SVE] = name##_sve,
+#else
+#define SIMD_VARIANT_SVE(name, params, args)
+#define SIMD_ENTRY_SVE(name)
+#endif
+
+/* Defines the variants of the void kernel name, from its SIMD_BODY function
+ * name_body, and the table name_variants of type fn_type indexed by
+ * simd_level. params is the parenthesized parameter list and args the
+ * parenthesized arguments. The kernel is called with SIMD_CALL(name). */
+#define SIMD_VARIANTS(fn_type, name, params, args) \
+	SIMD_VARIANT(, name, baseline, params, args) \
+	SIMD_VARIANT_AVX2(name, params, args) \
+	SIMD_VARIANT_AVX512(name, params, args) \
+	SIMD_VARIANT_SVE(name, params, args) \
+	static const fn_type name##_variants[SIMD_NB_LEVELS] = { \
+		[SIMD_BASELINE] = name##_baseline, \
+		SIMD_ENTRY_AVX2(name) SIMD_ENTRY_AVX512(name) SIMD_ENTRY_SVE(name) \
+	};
+
+#define SIMD_CALL(name) (name##_variants[cpu_simd_level])
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* the level of the kernels, always one with variants in this build */
+extern simd_level cpu_simd_level;
+
+/* detects the instruction sets and selects the level from com.pref.simd */
+void cpu_dispatch_init();
+gboolean cpu_dispatch_supported(simd_level level);
+/* forces a supported level, for the tests and benchmarks */
+void cpu_dispatch_set_level(simd_level level);
+const char *simd_level_name(simd_level level);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SRC_CORE_CPU_DISPATCH_H_ */
@@ -443,7 +443,9 @@ void validate_custom_profiles() {
 	g_mutex_unlock(&default_profiles_mutex);
 }
 
-void initialize_profiles_and_transforms() {
+static gsize profiles_initialized = 0;
+
+static void create_profiles_and_transforms() {
 	// Enable the fast float plugin (as long as the OS / lcms2 version blacklist isn't triggered)
 #ifndef EXCLUDE_FF
 	com.icc.context_single = cmsCreateContext(cmsFastFloatExtensions(), NULL);
@@ -498,6 +500,16 @@ void initialize_profiles_and_transforms() {
 	}
 }
 
+/* The GUI calls this at startup, siril-cli only before the first command that
+ * may need color management, so that short scripts start faster. Subsequent
+ * calls do nothing. */
+void initialize_profiles_and_transforms() {
+	if (g_once_init_enter(&profiles_initialized)) {
+		create_profiles_and_transforms();
+		g_once_init_leave(&profiles_initialized, 1);
+	}
+}
+
 void cleanup_common_profiles() {
 	if (com.icc.mono_linear)
 		cmsCloseProfile(com.icc.mono_linear);
@@ -520,6 +532,8 @@ void cleanup_common_profiles() {
 	if (gui.icc.proofing_transform)
 		cmsDeleteTransform(gui.icc.proofing_transform);
 	memset(&gui.icc, 0, sizeof(struct gui_icc));
+	// the pooled transforms belong to the contexts
+	siril_transform_pool_clear();
 	if (com.icc.context_single)
 		cmsDeleteContext(com.icc.context_single);
 	if (com.icc.context_threaded)
@@ -1179,7 +1193,7 @@ void siril_colorspace_transform(fits *fit, cmsHPROFILE profile) {
 	gboolean threaded = !get_thread_run();
 	srctype = get_planar_formatter_type(fit_colorspace, fit->type, FALSE);
 	desttype = get_planar_formatter_type(target_colorspace, fit->type, FALSE);
-	cmsHTRANSFORM transform = cmsCreateTransformTHR((threaded ? com.icc.context_threaded : com.icc.context_single), fit->icc_profile, srctype, profile, desttype, com.pref.icc.export_intent, com.icc.rendering_flags);
+	cmsHTRANSFORM transform = siril_transform_acquire((threaded ? com.icc.context_threaded : com.icc.context_single), fit->icc_profile, srctype, profile, desttype, com.pref.icc.export_intent, com.icc.rendering_flags);
 	if (transform) {
 		if (fit_colorspace_channels < target_colorspace_channels)
 			fits_change_depth(fit, target_colorspace_channels);
@@ -1188,7 +1202,7 @@ void siril_colorspace_transform(fits *fit, cmsHPROFILE profile) {
 		cmsUInt32Number bytesperline = fit->rx * datasize;
 		cmsUInt32Number bytesperplane = npixels * datasize;
 		cmsDoTransformLineStride(transform, data, data, fit->rx, fit->ry, bytesperline, bytesperline, bytesperplane, bytesperplane);
-		cmsDeleteTransform(transform);
+		siril_transform_release(transform);
 		cmsCloseProfile(fit->icc_profile);
 		if (fit_colorspace_channels > target_colorspace_channels)
 			fits_change_depth(fit, target_colorspace_channels);
@@ -1351,6 +1365,167 @@ cmsHTRANSFORM sirilCreateTransformTHR(cmsContext Context, cmsHPROFILE Input, cms
 	return transform;
 }
 
+/* Pool of transforms. Creating a transform is expensive, especially with the
+ * fast float plugin, and the same transforms are otherwise created again for
+ * each image of an export or of a sequence. They are identified by the
+ * content of the profiles, so that the copies of a profile embedded in the
+ * images match, and by the other arguments of cmsCreateTransformTHR.
+ * A transform is used by one caller at a time because transforms created
+ * without cmsFLAGS_NOCACHE are not thread-safe: if all matching transforms are
+ * in use, a new one is created. The pool keeps TRANSFORM_POOL_SIZE transforms
+ * that are not in use, the least recently used are deleted first. */
+#define TRANSFORM_POOL_SIZE 16
+
+struct transform_key {
+	cmsContext context;
+	gchar *input_digest, *output_digest;
+	cmsUInt32Number input_format, output_format, intent, flags;
+};
+
+struct pooled_transform {
+	struct transform_key key;
+	cmsHTRANSFORM transform;
+	gboolean in_use;
+};
+
+static GList *transform_pool = NULL;	// most recently used first
+static GMutex transform_pool_mutex;
+
+/* digest of the profile tags and of the header signatures, the rest of the
+ * header contains dates and identifiers that do not change the transform */
+static gchar *get_profile_digest(cmsHPROFILE profile) {
+	cmsUInt32Number length = 0;
+	cmsUInt8Number *block = siril_icc_profile_to_buffer(profile, &length);
+	if (!block || length < sizeof(cmsICCHeader)) {
+		free(block);
+		return NULL;
+	}
+	GChecksum *checksum = g_checksum_new(G_CHECKSUM_MD5);
+	cmsUInt32Number sig[3] = { cmsGetColorSpace(profile), cmsGetPCS(profile), cmsGetDeviceClass(profile) };
+	g_checksum_update(checksum, (const guchar *) sig, sizeof(sig));
+	g_checksum_update(checksum, block + sizeof(cmsICCHeader), length - sizeof(cmsICCHeader));
+	gchar *digest = g_strdup(g_checksum_get_string(checksum));
+	g_checksum_free(checksum);
+	free(block);
+	return digest;
+}
+
+static gboolean same_transform_key(const struct transform_key *a, const struct transform_key *b) {
+	return a->context == b->context && a->input_format == b->input_format &&
+		a->output_format == b->output_format && a->intent == b->intent &&
+		a->flags == b->flags && !g_strcmp0(a->input_digest, b->input_digest) &&
+		!g_strcmp0(a->output_digest, b->output_digest);
+}
+
+static void free_pooled_transform(struct pooled_transform *entry) {
+	cmsDeleteTransform(entry->transform);
+	g_free(entry->key.input_digest);
+	g_free(entry->key.output_digest);
+	free(entry);
+}
+
+/* deletes the least recently used transforms not in use above the pool size,
+ * or all of them if size is 0. Must be called with the pool locked */
+static void trim_transform_pool(guint size) {
+	guint nb_free = 0;
+	for (GList *l = transform_pool; l; l = l->next)
+		if (!((struct pooled_transform *) l->data)->in_use)
+			nb_free++;
+	GList *l = g_list_last(transform_pool);
+	while (l && nb_free > size) {
+		GList *prev = l->prev;
+		struct pooled_transform *entry = l->data;
+		if (!entry->in_use) {
+			free_pooled_transform(entry);
+			transform_pool = g_list_delete_link(transform_pool, l);
+			nb_free--;
+		}
+		l = prev;
+	}
+}
+
+/* Same as sirilCreateTransformTHR, but the transform comes from the pool and
+ * must be given back with siril_transform_release() instead of being deleted */
+cmsHTRANSFORM siril_transform_acquire(cmsContext Context, cmsHPROFILE Input, cmsUInt32Number InputFormat, cmsHPROFILE Output, cmsUInt32Number OutputFormat, cmsUInt32Number Intent, cmsUInt32Number dwFlags) {
+	if (!Input || !Output)
+		return NULL;
+	struct transform_key key = { Context, NULL, NULL, InputFormat, OutputFormat, Intent, dwFlags };
+	g_mutex_lock(&default_profiles_mutex);
+	key.input_digest = get_profile_digest(Input);
+	key.output_digest = get_profile_digest(Output);
+	if (!key.input_digest || !key.output_digest) {
+		// cannot be identified, not pooled
+		cmsHTRANSFORM transform = cmsCreateTransformTHR(Context, Input, InputFormat, Output, OutputFormat, Intent, dwFlags);
+		g_mutex_unlock(&default_profiles_mutex);
+		g_free(key.input_digest);
+		g_free(key.output_digest);
+		return transform;
+	}
+
+	g_mutex_lock(&transform_pool_mutex);
+	for (GList *l = transform_pool; l; l = l->next) {
+		struct pooled_transform *entry = l->data;
+		if (!entry->in_use && same_transform_key(&entry->key, &key)) {
+			entry->in_use = TRUE;
+			transform_pool = g_list_remove_link(transform_pool, l);
+			transform_pool = g_list_concat(l, transform_pool);
+			g_mutex_unlock(&transform_pool_mutex);
+			g_mutex_unlock(&default_profiles_mutex);
+			g_free(key.input_digest);
+			g_free(key.output_digest);
+			return entry->transform;
+		}
+	}
+	g_mutex_unlock(&transform_pool_mutex);
+
+	cmsHTRANSFORM transform = cmsCreateTransformTHR(Context, Input, InputFormat, Output, OutputFormat, Intent, dwFlags);
+	g_mutex_unlock(&default_profiles_mutex);
+	if (!transform) {
+		g_free(key.input_digest);
+		g_free(key.output_digest);
+		return NULL;
+	}
+	struct pooled_transform *entry = malloc(sizeof(struct pooled_transform));
+	if (!entry) {
+		PRINT_ALLOC_ERR;
+		g_free(key.input_digest);
+		g_free(key.output_digest);
+		return transform;	// not pooled, it will be deleted on release
+	}
+	entry->key = key;
+	entry->transform = transform;
+	entry->in_use = TRUE;
+	g_mutex_lock(&transform_pool_mutex);
+	transform_pool = g_list_prepend(transform_pool, entry);
+	g_mutex_unlock(&transform_pool_mutex);
+	siril_debug_print("new transform added to the pool\n");
+	return transform;
+}
+
+void siril_transform_release(cmsHTRANSFORM transform) {
+	if (!transform)
+		return;
+	g_mutex_lock(&transform_pool_mutex);
+	for (GList *l = transform_pool; l; l = l->next) {
+		struct pooled_transform *entry = l->data;
+		if (entry->transform == transform) {
+			entry->in_use = FALSE;
+			trim_transform_pool(TRANSFORM_POOL_SIZE);
+			g_mutex_unlock(&transform_pool_mutex);
+			return;
+		}
+	}
+	g_mutex_unlock(&transform_pool_mutex);
+	cmsDeleteTransform(transform);
+}
+
+/* deletes the transforms of the pool that are not in use */
+void siril_transform_pool_clear() {
+	g_mutex_lock(&transform_pool_mutex);
+	trim_transform_pool(0);
+	g_mutex_unlock(&transform_pool_mutex);
+}
+
 static void reset_working_profile_to_srgb() {
 	if (com.icc.working_standard)
 		cmsCloseProfile(com.icc.working_standard);
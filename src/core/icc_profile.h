@@ -100,6 +100,9 @@ void icc_auto_assign_or_convert(fits *fit, icc_assign_type occasion);
 void icc_auto_assign(fits *fit, icc_assign_type occasion);
 const char* default_system_icc_path();
 cmsHTRANSFORM sirilCreateTransformTHR(cmsContext Context, cmsHPROFILE Input, cmsUInt32Number InputFormat, cmsHPROFILE Output, cmsUInt32Number OutputFormat, cmsUInt32Number Intent, cmsUInt32Number dwFlags);
+cmsHTRANSFORM siril_transform_acquire(cmsContext Context, cmsHPROFILE Input, cmsUInt32Number InputFormat, cmsHPROFILE Output, cmsUInt32Number OutputFormat, cmsUInt32Number Intent, cmsUInt32Number dwFlags);
+void siril_transform_release(cmsHTRANSFORM transform);
+void siril_transform_pool_clear();
 void update_profiles_after_gamut_change();
 void siril_plot_colorspace(cmsHPROFILE profile, gboolean compare_srgb);
 void cleanup_common_profiles();
@@ -0,0 +1,129 @@
+/*
+ * This file is part of Siril, an astronomy image processor.
+ * Copyright (C) 2005-2011 Francois Meyer (dulle at free.fr)
+ * Copyright (C) 2012-2025 team free-astro (see more in AUTHORS file)
+ * Reference site is https://siril.org
+ *
+ * Siril is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Siril is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Siril. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* The memory governor holds the memory budget of a sequence processing, in
+ * MB. The processing threads and the sequence writer queue reserve their image
+ * memory from it, so that the memory not used by one of them can be used by
+ * the other, instead of splitting the budget with fixed counts of images.
+ * A reservation is always granted when nothing else is reserved, so that an
+ * image larger than the budget can still be processed alone.
+ *
+ * Memory kept idle for later reuse, like the buffers of the frame pool, is
+ * reserved without waiting, only if it fits, and is reclaimed with the
+ * reclaim function before a reservation has to wait. */
+
+#include "core/siril_log.h"
+#include "core/trace.h"
+
+#include "memory_governor.h"
+
+static GMutex governor_mutex;
+static GCond governor_cond;
+static guint budget = 0, in_use = 0, peak = 0;
+static guint idle = 0;	// part of in_use that is only kept for reuse
+static void (*reclaim_idle)() = NULL;
+
+/* a zero budget disables the accounting, the reservations are reset */
+void memory_governor_set_budget(guint budget_MB) {
+	g_mutex_lock(&governor_mutex);
+	budget = budget_MB;
+	in_use = 0;
+	idle = 0;
+	peak = 0;
+	g_cond_broadcast(&governor_cond);
+	g_mutex_unlock(&governor_mutex);
+	siril_debug_print("memory governor: budget set to %u MB\n", budget_MB);
+}
+
+guint memory_governor_get_budget() {
+	g_mutex_lock(&governor_mutex);
+	guint retval = budget;
+	g_mutex_unlock(&governor_mutex);
+	return retval;
+}
+
+/* the highest amount reserved since the budget was set */
+guint memory_governor_get_peak() {
+	g_mutex_lock(&governor_mutex);
+	guint retval = peak;
+	g_mutex_unlock(&governor_mutex);
+	return retval;
+}
+
+/* blocks until MB can be reserved within the budget */
+void memory_governor_reserve(guint MB) {
+	g_mutex_lock(&governor_mutex);
+	while (budget && in_use && in_use + MB > budget) {
+		if (idle && reclaim_idle) {
+			/* the idle memory is released by the reclaim function
+			 * with memory_governor_release_idle() */
+			g_mutex_unlock(&governor_mutex);
+			reclaim_idle();
+			g_mutex_lock(&governor_mutex);
+			continue;
+		}
+		siril_debug_print("memory governor: waiting for %u MB (%u/%u used)\n", MB, in_use, budget);
+		g_cond_wait(&governor_cond, &governor_mutex);
+	}
+	in_use += MB;
+	if (in_use > peak)
+		peak = in_use;
+	trace_counter("memory reserved (MB)", in_use);
+	g_mutex_unlock(&governor_mutex);
+}
+
+void memory_governor_release(guint MB) {
+	g_mutex_lock(&governor_mutex);
+	in_use = MB > in_use ? 0 : in_use - MB;
+	trace_counter("memory reserved (MB)", in_use);
+	g_cond_broadcast(&governor_cond);
+	g_mutex_unlock(&governor_mutex);
+}
+
+/* the function releasing all the idle memory, called without lock held */
+void memory_governor_set_reclaim_func(void (*reclaim)()) {
+	g_mutex_lock(&governor_mutex);
+	reclaim_idle = reclaim;
+	g_mutex_unlock(&governor_mutex);
+}
+
+/* reserves MB of idle memory if it fits in the budget, never blocks */
+gboolean memory_governor_try_reserve_idle(guint MB) {
+	g_mutex_lock(&governor_mutex);
+	gboolean granted = !budget || in_use + MB <= budget;
+	if (granted) {
+		in_use += MB;
+		idle += MB;
+		if (in_use > peak)
+			peak = in_use;
+		trace_counter("memory reserved (MB)", in_use);
+	}
+	g_mutex_unlock(&governor_mutex);
+	return granted;
+}
+
+void memory_governor_release_idle(guint MB) {
+	g_mutex_lock(&governor_mutex);
+	idle = MB > idle ? 0 : idle - MB;
+	in_use = MB > in_use ? 0 : in_use - MB;
+	trace_counter("memory reserved (MB)", in_use);
+	g_cond_broadcast(&governor_cond);
+	g_mutex_unlock(&governor_mutex);
+}
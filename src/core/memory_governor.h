@@ -0,0 +1,16 @@
+#ifndef SRC_CORE_MEMORY_GOVERNOR_H_
+#define SRC_CORE_MEMORY_GOVERNOR_H_
+
+#include <glib.h>
+
+void memory_governor_set_budget(guint budget_MB);
+guint memory_governor_get_budget();
+guint memory_governor_get_peak();
+void memory_governor_reserve(guint MB);
+void memory_governor_release(guint MB);
+
+void memory_governor_set_reclaim_func(void (*reclaim)());
+gboolean memory_governor_try_reserve_idle(guint MB);
+void memory_governor_release_idle(guint MB);
+
+#endif /* SRC_CORE_MEMORY_GOVERNOR_H_ */
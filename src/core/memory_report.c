@@ -0,0 +1,147 @@
+/*
+ * This file is part of Siril, an astronomy image processor.
+ * Copyright (C) 2005-2011 Francois Meyer (dulle at free.fr)
+ * Copyright (C) 2012-2025 team free-astro (see more in AUTHORS file)
+ * Reference site is https://siril.org
+ *
+ * Siril is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Siril is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Siril. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* The memory report of an operation compares the memory its limits were
+ * computed with, from com.pref.memory_ratio or amount, to what it really used:
+ * the peak of the resident memory of the process above its value at the start,
+ * sampled by a thread during the operation, and the peaks of the large
+ * buffers accounted with memory_account(). */
+
+#include "core/siril.h"
+#include "core/siril_log.h"
+#include "core/OS_utils.h"
+#include "core/trace.h"
+
+#include "memory_report.h"
+
+#define SAMPLING_PERIOD_US 50000
+
+static const char *category_names[MEM_NB_CATEGORIES] = { N_("stacking blocks"), N_("FFT buffers"), N_("undo"), N_("decoded RAW frames") };
+
+static GMutex report_mutex;
+static GCond sampler_cond;
+static GThread *sampler = NULL;
+static gboolean stop_sampling = FALSE;
+static int depth = 0;
+static gchar *operation_name = NULL;
+static guint64 start_rss = 0, peak_rss = 0;
+static gint64 current[MEM_NB_CATEGORIES] = { 0 }, peak[MEM_NB_CATEGORIES] = { 0 };
+static guint MB_per_image = 0, budget = 0;
+static int parallel_images = 0;
+
+void memory_account(mem_category category, gint64 bytes) {
+	g_mutex_lock(&report_mutex);
+	current[category] += bytes;
+	if (current[category] < 0)
+		current[category] = 0;	// released before the report started
+	if (current[category] > peak[category])
+		peak[category] = current[category];
+	g_mutex_unlock(&report_mutex);
+}
+
+static gpointer sampler_thread(gpointer p) {
+	g_mutex_lock(&report_mutex);
+	while (!stop_sampling) {
+		guint64 rss = get_used_memory();
+		if (rss > peak_rss)
+			peak_rss = rss;
+		trace_counter("resident memory (MB)", (gint64) (rss / BYTES_IN_A_MB));
+		g_cond_wait_until(&sampler_cond, &report_mutex, g_get_monotonic_time() + SAMPLING_PERIOD_US);
+	}
+	g_mutex_unlock(&report_mutex);
+	return NULL;
+}
+
+void memory_report_begin(const char *operation) {
+	g_mutex_lock(&report_mutex);
+	if (depth++) {
+		g_mutex_unlock(&report_mutex);
+		return;
+	}
+	g_free(operation_name);
+	operation_name = g_strdup(operation);
+	start_rss = peak_rss = get_used_memory();
+	for (int i = 0; i < MEM_NB_CATEGORIES; i++)
+		peak[i] = current[i];
+	MB_per_image = budget = 0;
+	parallel_images = 0;
+	stop_sampling = FALSE;
+	g_mutex_unlock(&report_mutex);
+	if (start_rss)	// not available on this system
+		sampler = g_thread_new("memory sampler", sampler_thread, NULL);
+}
+
+void memory_report_set_image_estimate(guint MB, guint budget_MB) {
+	g_mutex_lock(&report_mutex);
+	MB_per_image = MB;
+	budget = budget_MB;
+	g_mutex_unlock(&report_mutex);
+}
+
+void memory_report_set_parallel_images(int nb_images) {
+	g_mutex_lock(&report_mutex);
+	parallel_images = nb_images;
+	g_mutex_unlock(&report_mutex);
+}
+
+void memory_report_set_budget(guint budget_MB) {
+	g_mutex_lock(&report_mutex);
+	budget = budget_MB;
+	g_mutex_unlock(&report_mutex);
+}
+
+void memory_report_end() {
+	g_mutex_lock(&report_mutex);
+	if (depth == 0 || --depth) {
+		g_mutex_unlock(&report_mutex);
+		return;
+	}
+	stop_sampling = TRUE;
+	g_cond_signal(&sampler_cond);
+	g_mutex_unlock(&report_mutex);
+	if (sampler) {
+		g_thread_join(sampler);
+		sampler = NULL;
+	}
+
+	guint64 rss = get_used_memory();
+	if (rss > peak_rss)
+		peak_rss = rss;
+	guint used_MB = peak_rss > start_rss ? (peak_rss - start_rss) / BYTES_IN_A_MB : 0;
+	if (start_rss) {
+		siril_log_message(_("%s: peak memory use %u MB above the %u MB used at start\n"),
+				operation_name, used_MB, (guint) (start_rss / BYTES_IN_A_MB));
+	}
+	if (MB_per_image && parallel_images > 0) {
+		guint estimate = MB_per_image * parallel_images;
+		siril_log_message(_("%s: estimated %u MB per image, %u MB for the %d images processed in parallel%s\n"),
+				operation_name, MB_per_image, estimate, parallel_images,
+				start_rss && used_MB > estimate ? _(", exceeded") : "");
+	}
+	if (budget && start_rss) {
+		siril_log_message(_("%s: %u MB were allowed, %.0f%% of them were used\n"),
+				operation_name, budget, 100.0 * used_MB / budget);
+	}
+	for (int i = 0; i < MEM_NB_CATEGORIES; i++) {
+		if (peak[i] >= BYTES_IN_A_MB)
+			siril_log_message(_("%s: peak of the %s: %u MB\n"), operation_name,
+					_(category_names[i]), (guint) (peak[i] / BYTES_IN_A_MB));
+	}
+}
@@ -0,0 +1,37 @@
+#ifndef SRC_CORE_MEMORY_REPORT_H_
+#define SRC_CORE_MEMORY_REPORT_H_
+
+#include <glib.h>
+
+/* the large buffers accounted explicitly, the others are only seen in the
+ * resident memory of the process */
+typedef enum {
+	MEM_STACKING,	// stacking blocks
+	MEM_FFT,	// FFT buffers of the filters and deconvolution
+	MEM_UNDO,	// undo states kept in memory while they are written
+	MEM_RAW_CACHE,	// decoded frames of RAW sequences
+	MEM_NB_CATEGORIES
+} mem_category;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* bytes is negative for a release */
+void memory_account(mem_category category, gint64 bytes);
+
+/* the reports can be nested, only the outermost is logged */
+void memory_report_begin(const char *operation);
+/* records the memory the limits of the operation were computed with: the
+ * estimate of one image, the number of images processed in parallel and the
+ * memory considered usable */
+void memory_report_set_image_estimate(guint MB_per_image, guint budget_MB);
+void memory_report_set_parallel_images(int nb_images);
+void memory_report_set_budget(guint budget_MB);
+void memory_report_end();
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SRC_CORE_MEMORY_REPORT_H_ */
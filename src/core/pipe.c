@@ -51,6 +51,7 @@
 #include "core/siril.h"
 #include "core/siril_log.h"
 #include "pipe.h"
+#include "pipe_image.h"
 #include "command_line_processor.h"
 //#include "processing.h"
 	void stop_processing_thread();	// avoid including everything
@@ -240,6 +241,10 @@ int pipe_send_message(pipe_message msgtype, pipe_verb verb, const char *arg) {
 		case PIPE_READY:
 			msg = strdup("ready\n");
 			break;
+		case PIPE_STATS:
+			msg = malloc(strlen(arg) + 8);
+			sprintf(msg, "stats: %s", arg);
+			break;
 	}
 
 	if (msg) {
@@ -491,7 +496,9 @@ void *process_commands(void *p) {
 
 		pipe_send_message(PIPE_STATUS, PIPE_STARTING, command_name);
 
-		int retval = execute_command(wordnb);
+		int retval;
+		if (!execute_pipe_image_command(wordnb, &retval))
+			retval = execute_command(wordnb);
 
 		if (retval != CMD_NO_WAIT && waiting_for_thread()) {
 			empty_command_queue();
@@ -4,7 +4,7 @@
 /* These named pipe functions are not reentrant */
 
 typedef enum {
-	PIPE_LOG, PIPE_STATUS, PIPE_PROGRESS, PIPE_READY
+	PIPE_LOG, PIPE_STATUS, PIPE_PROGRESS, PIPE_READY, PIPE_STATS
 } pipe_message;
 
 typedef enum {
@@ -0,0 +1,115 @@
+/*
+ * This file is part of Siril, an astronomy image processor.
+ * Copyright (C) 2005-2011 Francois Meyer (dulle at free.fr)
+ * Copyright (C) 2012-2025 team free-astro (see more in AUTHORS file)
+ * Reference site is https://siril.org
+ *
+ * Siril is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Siril is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Siril. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* putimage path: replaces the loaded image by the content of the buffer
+ * getimage path: writes the loaded image to the buffer
+ * They are run by the pipe worker in the order of the other commands, the
+ * file is owned by the client */
+
+#include <string.h>
+#include <glib/gstdio.h>
+
+#include "core/siril.h"
+#include "core/proto.h"
+#include "core/command.h"
+#include "core/command_line_processor.h"
+#include "core/processing.h"
+#include "core/siril_log.h"
+#include "io/image_format_fits.h"
+#include "io/single_image.h"
+#include "pipe_image.h"
+
+static int put_image(const char *path) {
+	FILE *f = g_fopen(path, "rb");
+	if (!f) {
+		siril_log_message(_("Could not open the image buffer %s\n"), path);
+		return CMD_FILE_NOT_FOUND;
+	}
+	struct pipe_image_header header;
+	if (fread(&header, sizeof(header), 1, f) != 1 ||
+			memcmp(header.magic, PIPE_IMAGE_MAGIC, sizeof(header.magic)) ||
+			header.width == 0 || header.height == 0 ||
+			(header.channels != 1 && header.channels != 3) ||
+			(header.bytes_per_sample != sizeof(WORD) && header.bytes_per_sample != sizeof(float))) {
+		siril_log_message(_("The image buffer %s has an invalid header\n"), path);
+		fclose(f);
+		return CMD_INVALID_IMAGE;
+	}
+	data_type type = header.bytes_per_sample == sizeof(WORD) ? DATA_USHORT : DATA_FLOAT;
+	fits *fit = NULL;
+	if (new_fit_image(&fit, header.width, header.height, header.channels, type)) {
+		fclose(f);
+		return CMD_ALLOC_ERROR;
+	}
+	size_t nbdata = (size_t) header.width * header.height * header.channels;
+	void *data = type == DATA_USHORT ? (void *) fit->data : (void *) fit->fdata;
+	size_t read = fread(data, header.bytes_per_sample, nbdata, f);
+	fclose(f);
+	if (read != nbdata) {
+		siril_log_message(_("The image buffer %s is truncated\n"), path);
+		clearfits(fit);
+		free(fit);
+		return CMD_INVALID_IMAGE;
+	}
+	int retval = open_single_image_from_fit(fit, g_path_get_basename(path));
+	free(fit);
+	return retval ? CMD_GENERIC_ERROR : CMD_OK;
+}
+
+static int get_image(const char *path) {
+	if (!single_image_is_loaded() && !sequence_is_loaded())
+		return CMD_LOAD_IMAGE_FIRST;
+	if (get_thread_run())
+		return CMD_THREAD_RUNNING;
+	struct pipe_image_header header = { 0 };
+	memcpy(header.magic, PIPE_IMAGE_MAGIC, sizeof(header.magic));
+	header.width = gfit.rx;
+	header.height = gfit.ry;
+	header.channels = gfit.naxes[2];
+	header.bytes_per_sample = gfit.type == DATA_USHORT ? sizeof(WORD) : sizeof(float);
+	const void *data = gfit.type == DATA_USHORT ? (void *) gfit.data : (void *) gfit.fdata;
+	size_t nbdata = (size_t) gfit.rx * gfit.ry * gfit.naxes[2];
+
+	FILE *f = g_fopen(path, "wb");
+	if (!f) {
+		siril_log_message(_("Could not create the image buffer %s\n"), path);
+		return CMD_GENERIC_ERROR;
+	}
+	gboolean failed = fwrite(&header, sizeof(header), 1, f) != 1 ||
+		fwrite(data, header.bytes_per_sample, nbdata, f) != nbdata;
+	if (fclose(f) || failed) {
+		siril_log_message(_("Could not write the image buffer %s\n"), path);
+		g_unlink(path);
+		return CMD_GENERIC_ERROR;
+	}
+	return CMD_OK;
+}
+
+gboolean execute_pipe_image_command(int wordnb, int *retval) {
+	gboolean put = !g_strcmp0(word[0], "putimage");
+	if (!put && g_strcmp0(word[0], "getimage"))
+		return FALSE;
+	if (wordnb != 2)
+		*retval = CMD_WRONG_N_ARG;
+	else if (put)
+		*retval = put_image(word[1]);
+	else *retval = get_image(word[1]);
+	return TRUE;
+}
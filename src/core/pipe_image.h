@@ -0,0 +1,24 @@
+#ifndef _PIPE_IMAGE_H_
+#define _PIPE_IMAGE_H_
+
+#include <glib.h>
+
+/* Commands of the named pipe that exchange the loaded image as a raw buffer
+ * instead of a FITS file. The buffer starts with a pipe_image_header and the
+ * pixel data follows, one channel after the other, in native byte order.
+ * Clients can put it on a memory filesystem such as /dev/shm. */
+
+#define PIPE_IMAGE_MAGIC "SIRILBUF"
+
+struct pipe_image_header {
+	char magic[8];
+	guint32 width;
+	guint32 height;
+	guint32 channels;
+	guint32 bytes_per_sample;	// 2 for unsigned 16-bit, 4 for float in [0, 1]
+};
+
+/* returns FALSE if the parsed command is not one of these */
+gboolean execute_pipe_image_command(int wordnb, int *retval);
+
+#endif
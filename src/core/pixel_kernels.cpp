@@ -0,0 +1,100 @@
+/*
+ * This file is part of Siril, an astronomy image processor.
+ * Copyright (C) 2005-2011 Francois Meyer (dulle at free.fr)
+ * Copyright (C) 2012-2025 team free-astro (see more in AUTHORS file)
+ * Reference site is https://siril.org
+ *
+ * Siril is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Siril is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Siril. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <climits>
+
+#include "core/siril.h"
+#undef TBYTE
+#include "pixel_kernels.h"
+
+using namespace pixel_kernels;
+
+void kernel_soper_to_float(const fits *a, float *result, image_operator oper, float scalar) {
+	const size_t n = a->naxes[0] * a->naxes[1] * a->naxes[2];
+	if (oper == OPER_DIV) {
+		scalar = 1.0f / scalar;
+		oper = OPER_MUL;
+	}
+	const float inv = inv_norm(a);
+	with_pixels(a, [&](const auto *in) {
+		with_operator(oper, [&](auto op) {
+			constexpr image_operator OPER = decltype(op)::value;
+#ifdef _OPENMP
+#pragma omp simd
+#endif
+			for (size_t i = 0; i < n; i++)
+				result[i] = apply<OPER>(pixel_to_float(in[i], inv), scalar);
+		});
+	});
+}
+
+size_t kernel_imoper_to_float(const fits *a, const fits *b, float *result, image_operator oper, float factor) {
+	const size_t n = a->naxes[0] * a->naxes[1] * a->naxes[2];
+	const float inv_a = inv_norm(a), inv_b = inv_norm(b);
+	size_t nb_negative = 0;
+	with_pixels(a, [&](const auto *abuf) {
+		with_pixels(b, [&](const auto *bbuf) {
+			with_operator(oper, [&](auto op) {
+				constexpr image_operator OPER = decltype(op)::value;
+#ifdef _OPENMP
+#pragma omp simd reduction(+:nb_negative)
+#endif
+				for (size_t i = 0; i < n; i++) {
+					float r = factor * apply<OPER>(pixel_to_float(abuf[i], inv_a), pixel_to_float(bbuf[i], inv_b));
+					r = r > 1.0f ? 1.0f : r;	// should we truncate by default?
+					r = r < -1.0f ? 0.0f : r;	// Here we want to clip all garbages pixels.
+					nb_negative += r < 0.0f;
+					result[i] = r;
+				}
+			});
+		});
+	});
+	return nb_negative;
+}
+
+/* b in the integer range of a */
+static inline float word_range(WORD value, float) { return (float) value; }
+static inline float word_range(float value, float norm) { return value * norm; }
+static inline int word_range_int(WORD value, float) { return (int) value; }
+static inline int word_range_int(float value, float norm) { return round_to_int(value * norm); }
+
+void kernel_imoper_to_ushort(fits *a, const fits *b, image_operator oper, float factor) {
+	const size_t n = a->naxes[0] * a->naxes[1] * a->naxes[2];
+	const float norm = a->bitpix == BYTE_IMG ? UCHAR_MAX_SINGLE : USHRT_MAX_SINGLE;
+	WORD *abuf = a->data;
+	with_pixels(b, [&](const auto *bbuf) {
+		with_operator(oper, [&](auto op) {
+			constexpr image_operator OPER = decltype(op)::value;
+#ifdef _OPENMP
+#pragma omp simd
+#endif
+			for (size_t i = 0; i < n; i++) {
+				if constexpr (OPER == OPER_MUL || OPER == OPER_DIV) {
+					/* a null b gives 0 for both operators */
+					abuf[i] = round_to_word(factor * apply<OPER>((float) abuf[i], word_range(bbuf[i], norm)));
+				} else {
+					int aval = (int) abuf[i], bval = word_range_int(bbuf[i], norm);
+					int sum = OPER == OPER_ADD ? aval + bval : aval - bval;
+					abuf[i] = round_to_word(factor * (float) clamp_to_word(sum));
+				}
+			}
+		});
+	});
+}
@@ -0,0 +1,121 @@
+/*
+ * This file is part of Siril, an astronomy image processor.
+ * Copyright (C) 2005-2011 Francois Meyer (dulle at free.fr)
+ * Copyright (C) 2012-2025 team free-astro (see more in AUTHORS file)
+ * Reference site is https://siril.org
+ *
+ * Siril is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Siril is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Siril. If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef SRC_CORE_PIXEL_KERNELS_H_
+#define SRC_CORE_PIXEL_KERNELS_H_
+
+/* Pixel loops instantiated for each pixel type and operator, so that the type
+ * of the images and the operator are resolved once per image instead of once
+ * per pixel and the loops can be vectorised.
+ * The C functions below check nothing, the caller validates the images. */
+
+#include "core/siril.h"
+#include "core/arithm.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* result = a oper scalar, a being read in [0, 1] */
+void kernel_soper_to_float(const fits *a, float *result, image_operator oper, float scalar);
+
+/* result = factor * (a oper b), clipped to [-1, 1] with the values below -1
+ * set to 0, like imoper_to_float does. Returns the number of negative values */
+size_t kernel_imoper_to_float(const fits *a, const fits *b, float *result, image_operator oper, float factor);
+
+/* a = factor * (a oper b) for a 16-bit a, b being scaled to the range of a when
+ * it is a float image */
+void kernel_imoper_to_ushort(fits *a, const fits *b, image_operator oper, float factor);
+
+#ifdef __cplusplus
+}
+
+#include <cstddef>
+#include <utility>
+
+/* The template layer, for C++ code that wants to add its own operations:
+ * with_pixels() calls a generic lambda with the typed buffer of an image and
+ * pixel_to_float() reads a pixel of either type in [0, 1]. */
+namespace pixel_kernels {
+
+inline float inv_norm(const fits *fit) {
+	return fit->orig_bitpix == BYTE_IMG ? INV_UCHAR_MAX_SINGLE : INV_USHRT_MAX_SINGLE;
+}
+
+/* same as ushort_to_float_bitpix(), with the normalization given once */
+inline float pixel_to_float(WORD value, float inv) { return (float) value * inv; }
+inline float pixel_to_float(float value, float) { return value; }
+
+/* same as roundf_to_WORD() and roundf_to_int(), inlined */
+inline WORD round_to_word(float f) {
+	return f < 0.5f ? 0 : (f >= USHRT_MAX - 0.5f ? USHRT_MAX : (WORD) (f + 0.5f));
+}
+inline int round_to_int(float x) {
+	if (x <= (float) INT_MIN + 0.5f) return INT_MIN;
+	if (x >= (float) INT_MAX - 0.5f) return INT_MAX;
+	return x >= 0.0f ? (int) (x + 0.5f) : (int) (x - 0.5f);
+}
+inline WORD clamp_to_word(int x) {
+	return x < 0 ? 0 : (x > USHRT_MAX ? USHRT_MAX : (WORD) x);
+}
+
+template <typename F>
+decltype(auto) with_pixels(const fits *fit, F &&f) {
+	if (fit->type == DATA_USHORT)
+		return std::forward<F>(f)(static_cast<const WORD *>(fit->data));
+	return std::forward<F>(f)(static_cast<const float *>(fit->fdata));
+}
+
+/* calls f with std::integral_constant<image_operator, oper>, which makes the
+ * operator a compile-time constant in the instantiated loop */
+template <typename F>
+decltype(auto) with_operator(image_operator oper, F &&f) {
+	switch (oper) {
+		case OPER_ADD:
+			return std::forward<F>(f)(std::integral_constant<image_operator, OPER_ADD>());
+		case OPER_SUB:
+			return std::forward<F>(f)(std::integral_constant<image_operator, OPER_SUB>());
+		case OPER_MUL:
+			return std::forward<F>(f)(std::integral_constant<image_operator, OPER_MUL>());
+		case OPER_DIV:
+		default:
+			return std::forward<F>(f)(std::integral_constant<image_operator, OPER_DIV>());
+	}
+}
+
+/* a oper b, with the division by zero giving 0 */
+template <image_operator OPER>
+inline float apply(float a, float b) {
+	if constexpr (OPER == OPER_ADD)
+		return a + b;
+	else if constexpr (OPER == OPER_SUB)
+		return a - b;
+	else if constexpr (OPER == OPER_MUL)
+		return a * b;
+	else {
+		float q = a / b;
+		return b == 0.0f ? 0.0f : q;
+	}
+}
+
+}
+
+#endif
+
+#endif /* SRC_CORE_PIXEL_KERNELS_H_ */
@@ -28,7 +28,9 @@
 #include "core/processing.h"
 #include "core/OS_utils.h"
 #include "core/siril_log.h"
+#include "core/command_line_processor.h"
 #include "algos/statistics.h"
+#include "algos/star_finder.h"
 #include "algos/fix_xtrans_af.h"
 #include "filters/cosmetic_correction.h"
 #include "gui/utils.h"
@@ -37,7 +39,9 @@
 #include "io/single_image.h"
 #include "io/sequence.h"
 #include "algos/demosaicing.h"
+#include "algos/extraction.h"
 #include "io/image_format_fits.h"
+#include "io/master_cache.h"
 #include "io/path_parse.h"
 #include "io/ser.h"
 
@@ -45,44 +49,92 @@
 
 #define SQUARE_SIZE 512
 
-static float evaluateNoiseOfCalibratedImage(fits *fit, fits *dark,
-		float k, gboolean allow_32bit_output) {
-	long chan;
-	int ret = 0;
-	float noise = 0.f;
-	fits dark_tmp = { 0 }, fit_tmp = { 0 };
-	rectangle area = { 0 };
-
-	/* square of 512x512 in the center of the image */
-	int size = SQUARE_SIZE;
-	area.x = (fit->rx - size) / 2;
-	area.y = (fit->ry - size) / 2;
-	area.w = size;
-	area.h = size;
+/* the pixels of the light and of the master-dark used to evaluate the noise
+ * of the calibrated image: the square of SQUARE_SIZE in the center of the
+ * image, normalized to [0, 1] whatever the data type */
+struct dark_optim_sample {
+	int nb_layers;
+	size_t n;		// number of pixels per layer
+	float *raw, *dark;	// raw[layer * n + i]
+	gboolean ushort_output;	// calibrated values are clipped to [0, 1]
+};
+
+static float sample_value(const fits *fit, int layer, size_t index) {
+	if (fit->type == DATA_FLOAT)
+		return fit->fpdata[layer][index];
+	float norm = fit->bitpix == BYTE_IMG ? INV_UCHAR_MAX_SINGLE : INV_USHRT_MAX_SINGLE;
+	return (float)fit->pdata[layer][index] * norm;
+}
 
-	ret = copyfits(dark, &dark_tmp, CP_ALLOC | CP_COPYA | CP_FORMAT, -1);
-	if (!ret) ret = copyfits(fit, &fit_tmp, CP_ALLOC | CP_COPYA | CP_FORMAT, -1);
+static int init_dark_optim_sample(struct dark_optim_sample *sample, fits *fit,
+		fits *dark, gboolean allow_32bit_output) {
+	int w = min(SQUARE_SIZE, fit->rx), h = min(SQUARE_SIZE, fit->ry);
+	int x0 = (fit->rx - w) / 2, y0 = (fit->ry - h) / 2;
+
+	sample->nb_layers = fit->naxes[2];
+	sample->n = (size_t)w * h;
+	sample->ushort_output = fit->type == DATA_USHORT && dark->type == DATA_USHORT &&
+		(!allow_32bit_output || com.pref.force_16bit);
+	sample->raw = malloc(sample->nb_layers * sample->n * sizeof(float));
+	sample->dark = malloc(sample->nb_layers * sample->n * sizeof(float));
+	if (!sample->raw || !sample->dark) {
+		PRINT_ALLOC_ERR;
+		free(sample->raw);
+		free(sample->dark);
+		return 1;
+	}
 
-	if (!ret) ret = soper(&dark_tmp, k, OPER_MUL, allow_32bit_output);
-	if (!ret) ret = imoper(&fit_tmp, &dark_tmp, OPER_SUB, allow_32bit_output);
-	if (ret) {
-		clearfits(&dark_tmp);
-		clearfits(&fit_tmp);
-		return -1.0;
+	size_t k = 0;
+	for (int layer = 0; layer < sample->nb_layers; layer++) {
+		for (int y = y0; y < y0 + h; y++) {
+			for (int x = x0; x < x0 + w; x++, k++) {
+				size_t index = (size_t)y * fit->rx + x;
+				sample->raw[k] = sample_value(fit, layer, index);
+				sample->dark[k] = sample_value(dark, layer, index);
+			}
+		}
 	}
+	return 0;
+}
+
+static void clear_dark_optim_sample(struct dark_optim_sample *sample) {
+	free(sample->raw);
+	free(sample->dark);
+}
+
+/* noise of the calibrated image for a dark scaled by k, computed on the
+ * sample only: sigma of the non-null pixels, summed over the layers. Values
+ * are clipped the way imoper() clips them */
+static float evaluateNoiseOfCalibratedImage(const struct dark_optim_sample *sample, float k) {
+	float noise = 0.f;
 
-	for (chan = 0; chan < fit->naxes[2]; chan++) {
-		/* STATS_SIGMEAN computes mean and normvalue */
-		imstats *stat = statistics(NULL, -1, &fit_tmp, chan, &area, STATS_SIGMEAN, SINGLE_THREADED);
-		if (!stat) {
-			siril_log_message(_("Error: statistics computation failed.\n"));
-			return -1.0;
+	for (int layer = 0; layer < sample->nb_layers; layer++) {
+		const float *raw = sample->raw + layer * sample->n;
+		const float *dark = sample->dark + layer * sample->n;
+		double sum = 0.0, sum2 = 0.0;
+		size_t ngoodpix = 0;
+
+		for (size_t i = 0; i < sample->n; i++) {
+			float val = raw[i] - k * dark[i];
+			if (sample->ushort_output) {
+				if (val < 0.f) val = 0.f;
+				else if (val > 1.f) val = 1.f;
+			} else {
+				if (val > 1.f) val = 1.f;
+				else if (val < -1.f) val = 0.f;
+			}
+			if (val == 0.f)
+				continue;
+			sum += val;
+			sum2 += (double)val * val;
+			ngoodpix++;
 		}
-		noise += stat->sigma / stat->normValue;
-		free_stats(stat);
+		if (ngoodpix < 2)
+			return -1.f;
+		double mean = sum / ngoodpix;
+		double var = (sum2 - sum * mean) / (ngoodpix - 1);
+		noise += (float)sqrt(max(var, 0.0));
 	}
-	clearfits(&dark_tmp);
-	clearfits(&fit_tmp);
 
 	return noise;
 }
@@ -90,16 +142,16 @@ static float evaluateNoiseOfCalibratedImage(fits *fit, fits *dark,
 #undef GR
 #define GR ((sqrtf(5.f) - 1.f) / 2.f)
 
-static float goldenSectionSearch(fits *raw, fits *dark, float a, float b,
-		float tol, gboolean allow_32bits) {
+static float goldenSectionSearch(const struct dark_optim_sample *sample, float a, float b,
+		float tol) {
 	float c, d;
 	float fc, fd;
 	int iter = 0;
 
 	c = b - GR * (b - a);
 	d = a + GR * (b - a);
-	fc = evaluateNoiseOfCalibratedImage(raw, dark, c, allow_32bits);
-	fd = evaluateNoiseOfCalibratedImage(raw, dark, d, allow_32bits);
+	fc = evaluateNoiseOfCalibratedImage(sample, c);
+	fd = evaluateNoiseOfCalibratedImage(sample, d);
 	if (fc == fd) return 1.f;
 	do {
 		siril_debug_print("Iter: %d (%1.2f, %1.2f)\n", ++iter, c, d);
@@ -110,23 +162,67 @@ static float goldenSectionSearch(fits *raw, fits *dark, float a, float b,
 			d = c;
 			fd = fc;
 			c = b - GR * (b - a);
-			fc = evaluateNoiseOfCalibratedImage(raw, dark, c, allow_32bits);
+			fc = evaluateNoiseOfCalibratedImage(sample, c);
 		} else {
 			a = c;
 			c = d;
 			fc = fd;
 			d = a + GR * (b - a);
-			fd = evaluateNoiseOfCalibratedImage(raw, dark, d, allow_32bits);
+			fd = evaluateNoiseOfCalibratedImage(sample, d);
 
 		}
 	} while (fabsf(c - d) > tol);
 	return ((b + a) * 0.5f);
 }
 
-static int preprocess(fits *raw, struct preprocessing_data *args) {
+/* raw = raw - k * dark, in the data type of the output */
+static int subtract_scaled_dark(fits *raw, struct preprocessing_data *args, float k) {
+	fits dark_tmp = { 0 };
+	if (copyfits(args->dark, &dark_tmp, CP_ALLOC | CP_COPYA | CP_FORMAT, 0))
+		return 1;
+	int ret = soper(&dark_tmp, k, OPER_MUL, args->allow_32bit_output);
+	if (!ret)
+		ret = imoper(raw, &dark_tmp, OPER_SUB, args->allow_32bit_output);
+	clearfits(&dark_tmp);
+	return ret;
+}
+
+/* dark_k is the coefficient of the optimized master-dark, negative if it is
+ * not used */
+static int preprocess(fits *raw, struct preprocessing_data *args, float dark_k, int threads) {
 	int ret = 0;
 
-	if (args->use_bias) {
+	/* with a float output, all masters are applied in a single pass */
+	if (args->allow_32bit_output && !com.pref.force_16bit) {
+		const fits *bias = (args->use_bias && args->bias_level >= FLT_MAX) ? args->bias : NULL;
+		float bias_level = (args->use_bias && !bias) ? args->bias_level : FLT_MAX;
+		const fits *dark = (args->use_dark && !args->use_dark_optim) ? args->dark : NULL;
+		const fits *flat = args->use_flat ? args->flat : NULL;
+		if (dark_k < 0.f && !bias && bias_level >= FLT_MAX && !dark && !flat)
+			return 0;
+
+		struct arith_chain chain;
+		size_t negatives[ARITH_CHAIN_MAX_STEPS];
+		arith_chain_init(&chain);
+		/* the optimized master-dark is applied first, as imoper() would */
+		if (dark_k >= 0.f)
+			arith_chain_add_image(&chain, OPER_SUB, args->dark, dark_k, ARITH_CLIP_IMOPER);
+		int dark_step = arith_chain_add_calibration(&chain, bias_level, bias, dark, flat, args->normalisation);
+		if (!arith_chain_apply(raw, &chain, DATA_FLOAT, negatives, threads)) {
+			size_t n = raw->naxes[0] * raw->naxes[1] * raw->naxes[2];
+			raw->neg_ratio = (float)((double)negatives[chain.nb_steps - 1] / n);
+			float dark_neg_ratio = dark_step >= 0 ? (float)((double)negatives[dark_step] / n) : 0.f;
+			if (dark_neg_ratio > 0.2f)
+				siril_log_message(_("After dark subtraction, the image contains many negative pixels (%d%%), calibration frames are probably incorrect\n"), (int)(100.f*dark_neg_ratio));
+			return 0;
+		}
+		// sizes or types not handled, the steps below report the error
+	}
+
+	if (dark_k >= 0.f)
+		ret = subtract_scaled_dark(raw, args, dark_k);
+
+	if (!ret && args->use_bias) {
 		if (args->bias_level < FLT_MAX) {
 			// an offset level has been defined
 			ret = soper(raw, args->bias_level, OPER_SUB, args->allow_32bit_output);
@@ -160,32 +256,25 @@ static int preprocess(fits *raw, struct preprocessing_data *args) {
 	return ret;
 }
 
-static int darkOptimization(fits *raw, struct preprocessing_data *args, int in_index, GSList *hist) {
+/* computes the coefficient of the master-dark for the light, it is applied
+ * with the other masters by preprocess() */
+static int darkOptimization(fits *raw, struct preprocessing_data *args, int in_index, GSList *hist, float *dark_k) {
 	float k0;
 	float lo = 0.f, up = 2.f;
-	int ret = 0;
 	fits *dark = args->dark;
-	fits dark_tmp = { 0 };
 
 	if (memcmp(raw->naxes, dark->naxes, sizeof raw->naxes)) {
 		siril_log_color_message(_("Images must have same dimensions\n"), "red");
 		return 1;
 	}
 
-	// TODO: avoid duplicating with soper+imoper together
-	// https://gitlab.com/free-astro/siril/-/issues/671
-	if (copyfits(dark, &dark_tmp, CP_ALLOC | CP_COPYA | CP_FORMAT, 0))
-		return 1;
-
 	if (args->use_exposure) {
 		if (dark->keywords.exposure <= 0.0) {
 			siril_log_color_message(_("The dark frame contains no exposure data or incorrect exposure data.\n"), "red");
-			clearfits(&dark_tmp);
 			return 1;
 		}
 		if (raw->keywords.exposure <= 0.0) {
 			siril_log_color_message(_("The light frame (%d) contains no exposure data or incorrect exposure data.\n"), "red", in_index);
-			clearfits(&dark_tmp);
 			return 1;
 		}
 		/* linear scale with time */
@@ -195,33 +284,61 @@ static int darkOptimization(fits *raw, struct preprocessing_data *args, int in_i
 						"recommended that the master dark be at least as long as the lights.\n"), "salmon");
 		}
 	} else {
-		/* Minimization of background noise to find better k */
-		k0 = goldenSectionSearch(raw, &dark_tmp, lo, up, 0.001f, args->allow_32bit_output);
+		/* Minimization of background noise to find better k, on a
+		 * sample of the pixels extracted once for all iterations */
+		struct dark_optim_sample sample;
+		if (init_dark_optim_sample(&sample, raw, dark, args->allow_32bit_output))
+			k0 = -1.f;
+		else {
+			k0 = goldenSectionSearch(&sample, lo, up, 0.001f);
+			clear_dark_optim_sample(&sample);
+		}
 	}
 	if (k0 < 0.f) {
 		siril_log_message(_("Dark optimization of image %d failed\n"), in_index);
-		ret = -1;
-	} else {
-		/* Multiply coefficient to master-dark */
-		ret = soper(&dark_tmp, k0, OPER_MUL, args->allow_32bit_output);
-		if (!ret)
-			ret = imoper(raw, &dark_tmp, OPER_SUB, args->allow_32bit_output);
-		if (!ret) {
-			siril_log_message(_("Dark optimization of image %d: k0=%.3f\n"), in_index, k0);
-			if (hist)
-				hist = g_slist_append(hist, g_strdup_printf("Calibrated with an optimized master dark (factor: %.3f)", k0));
-		}
-		else siril_log_message(_("Dark optimization of image %d failed\n"), in_index);
+		return -1;
+	}
+	siril_log_message(_("Dark optimization of image %d: k0=%.3f\n"), in_index, k0);
+	if (hist)
+		hist = g_slist_append(hist, g_strdup_printf("Calibrated with an optimized master dark (factor: %.3f)", k0));
+	*dark_k = k0;
+	return 0;
+}
+
+/* With the Ha and OIII extraction, the frames are written in two sequences by
+ * multi_save() and the generic arguments hold the multiple output data, the
+ * preprocessing data being their user data */
+static struct preprocessing_data *get_prepro_data(struct generic_seq_args *args) {
+	if (args->save_hook == multi_save)
+		return ((struct multi_output_data *) args->user)->user_data;
+	return args->user;
+}
+
+/* size of the extracted images, relative to the CFA frame */
+static double extraction_size_ratio(const struct preprocessing_data *prepro) {
+	switch (prepro->extract) {
+		case PREPRO_EXTRACT_HA:
+			return prepro->extract_scaling == SCALING_HA_UP ? 1.0 : 0.25;
+		case PREPRO_EXTRACT_GREEN:
+			return 0.25;
+		case PREPRO_EXTRACT_HAOIII:
+			if (prepro->extract_scaling == SCALING_HA_UP)
+				return 2.0;
+			if (prepro->extract_scaling == SCALING_OIII_DOWN)
+				return 0.5;
+			return 1.25;
+		default:
+			return 1.0;
 	}
-	clearfits(&dark_tmp);
-	return ret;
 }
 
 static gint64 prepro_compute_size_hook(struct generic_seq_args *args, int nb_images) {
-	struct preprocessing_data *prepro = args->user;
+	struct preprocessing_data *prepro = get_prepro_data(args);
 	gint64 size = seq_compute_size(args->seq, nb_images, args->output_type);
 	if (prepro->debayer)
 		size *= 3;
+	else if (prepro->extract != PREPRO_EXTRACT_NONE)
+		size = (gint64)(size * extraction_size_ratio(prepro));
 	return size;
 }
 
@@ -229,7 +346,7 @@ static gint64 prepro_compute_size_hook(struct generic_seq_args *args, int nb_ima
  * the memory it takes to calibrate the images */
 static int prepro_compute_mem_hook(struct generic_seq_args *args, gboolean for_writer) {
 	int nb_masters = 0;
-	struct preprocessing_data *prepro = args->user;
+	struct preprocessing_data *prepro = get_prepro_data(args);
 	if (prepro->use_flat && prepro->flat) nb_masters++;
 	if (prepro->use_dark && prepro->dark) nb_masters++;
 	if (prepro->use_bias && prepro->bias) nb_masters++;
@@ -259,6 +376,12 @@ static int prepro_compute_mem_hook(struct generic_seq_args *args, gboolean for_w
 		else MB_per_output_image *= 9;
 		required = MB_per_input_image + MB_per_output_image;
 	}
+	else if (prepro->extract != PREPRO_EXTRACT_NONE) {
+		MB_per_output_image = max(1, (unsigned int)(MB_per_input_image * extraction_size_ratio(prepro)));
+		required = MB_per_input_image + MB_per_output_image;
+		if (prepro->use_dark_optim && prepro->use_dark)
+			required = max(required, 4 * MB_per_input_image);
+	}
 	else if (prepro->use_dark_optim && prepro->use_dark) {
 		required = 4 * MB_per_input_image;
 	}
@@ -305,12 +428,16 @@ static int prepro_compute_mem_hook(struct generic_seq_args *args, gboolean for_w
 }
 
 int prepro_prepare_hook(struct generic_seq_args *args) {
-	struct preprocessing_data *prepro = args->user;
+	struct preprocessing_data *prepro = get_prepro_data(args);
 	gboolean set_hist = prepro->output_seqtype != SEQ_SER;
 
 	if (prepro->seq) {
 		// handling SER and FITSEQ
-		if (seq_prepare_hook(args))
+		if (args->save_hook == multi_save) {
+			if (multi_prepare(args))
+				return 1;
+		}
+		else if (seq_prepare_hook(args))
 			return 1;
 	}
 
@@ -395,6 +522,9 @@ int prepro_prepare_hook(struct generic_seq_args *args) {
 			if (prepro->dark->naxes[2] == 1) {
 				prepro->dev = find_deviant_pixels(prepro->dark, prepro->sigma,
 						&(prepro->icold), &(prepro->ihot), FALSE);
+				if (prepro->dev)
+					prepro->cc_plan = cosmetic_plan_new(prepro->dev, prepro->icold + prepro->ihot,
+							prepro->dark->rx, prepro->dark->ry, prepro->is_cfa);
 				gchar *str = ngettext("%ld corrected pixel (%ld + %ld)\n", "%ld corrected pixels (%ld + %ld)\n", prepro->icold + prepro->ihot);
 				str = g_strdup_printf(str, prepro->icold + prepro->ihot, prepro->icold, prepro->ihot);
 				siril_log_message(str);
@@ -409,25 +539,130 @@ int prepro_prepare_hook(struct generic_seq_args *args) {
 	return 0;
 }
 
+/* detects the stars of a calibrated frame and stores the same quality data
+ * as a registration pass would; a frame without stars is not an error */
+static void compute_frame_quality(struct preprocessing_data *prepro, fits *fit, int in_index, int out_index, int threads) {
+	struct starfinder_data sf = { 0 };
+	psf_star **stars = NULL;
+	int nb_stars = 0;
+	sf.im.fit = fit;
+	sf.im.from_seq = NULL;
+	sf.im.index_in_seq = -1;
+	sf.layer = (fit->naxes[2] == 3) ? GLAYER : RLAYER;
+	sf.stars = &stars;
+	sf.nb_stars = &nb_stars;
+	sf.threading = threads;
+	sf.already_in_thread = TRUE;
+	findstar_worker(&sf);
+
+	regdata *reg = &prepro->quality[in_index];
+	if (stars && nb_stars > 0) {
+		float FWHMx, FWHMy, B;
+		char *units;
+		FWHM_stats(stars, nb_stars, fit->bitpix, &FWHMx, &FWHMy, &units, &B, NULL, 0.);
+		reg->fwhm = FWHMx;
+		reg->roundness = FWHMy / FWHMx;
+		reg->background_lvl = B;
+		reg->number_of_stars = nb_stars;
+	}
+	free_fitted_stars(stars);
+	prepro->quality_out[in_index] = out_index;
+	prepro->quality_layer = sf.layer;
+}
+
+/* extracts the channels of the calibrated CFA frame, Ha or green replacing it,
+ * Ha and OIII being added to the list of images written by multi_save() */
+static int extract_calibrated_channels(struct generic_seq_args *args, struct preprocessing_data *prepro,
+		fits *fit, int out_index, int threads) {
+	sensor_pattern pattern = get_bayer_pattern(fit);
+	fits extracted = { 0 };
+	int ret = 1;
+	switch (prepro->extract) {
+		case PREPRO_EXTRACT_HA:
+			if (fit->type == DATA_USHORT)
+				ret = extractHa_ushort(fit, &extracted, pattern, prepro->extract_scaling);
+			else ret = extractHa_float(fit, &extracted, pattern, prepro->extract_scaling);
+			break;
+		case PREPRO_EXTRACT_GREEN:
+			if (fit->type == DATA_USHORT)
+				ret = extractGreen_ushort(fit, &extracted, pattern);
+			else ret = extractGreen_float(fit, &extracted, pattern);
+			break;
+		case PREPRO_EXTRACT_HAOIII:
+			break;
+		default:
+			return 0;
+	}
+	if (prepro->extract != PREPRO_EXTRACT_HAOIII) {
+		if (!ret) {
+			clearfits(fit);
+			memcpy(fit, &extracted, sizeof(fits));
+		}
+		return ret;
+	}
+
+	struct multi_output_data *multi_args = (struct multi_output_data *) args->user;
+	struct _multi_split *multi_data = malloc(sizeof(struct _multi_split));
+	if (!multi_data) {
+		PRINT_ALLOC_ERR;
+		return 1;
+	}
+	multi_data->index = out_index;
+	multi_data->images = malloc(2 * sizeof(fits *));
+	fits *Ha = calloc(1, sizeof(fits));
+	fits *OIII = calloc(1, sizeof(fits));
+	if (!multi_data->images || !Ha || !OIII) {
+		PRINT_ALLOC_ERR;
+		ret = 1;
+	}
+	else if (fit->type == DATA_USHORT)
+		ret = extractHaOIII_ushort(fit, Ha, OIII, pattern, prepro->extract_scaling, threads);
+	else ret = extractHaOIII_float(fit, Ha, OIII, pattern, prepro->extract_scaling, threads);
+	if (ret) {
+		if (Ha)
+			clearfits(Ha);
+		if (OIII)
+			clearfits(OIII);
+		free(Ha);
+		free(OIII);
+		free(multi_data->images);
+		free(multi_data);
+		return 1;
+	}
+	multi_data->images[0] = Ha;
+	multi_data->images[1] = OIII;
+#ifdef _OPENMP
+	omp_set_lock(&args->lock);
+#endif
+	multi_args->processed_images = g_list_append(multi_args->processed_images, multi_data);
+#ifdef _OPENMP
+	omp_unset_lock(&args->lock);
+#endif
+	return 0;
+}
+
 int prepro_image_hook(struct generic_seq_args *args, int out_index, int in_index, fits *fit, rectangle *_, int threads) {
-	struct preprocessing_data *prepro = args->user;
+	struct preprocessing_data *prepro = get_prepro_data(args);
 	GSList *history = g_slist_copy_deep(prepro->history, (GCopyFunc)g_strdup, NULL);
 
+	float dark_k = -1.f;
 	if (prepro->use_dark_optim && prepro->use_dark) {
-		if (darkOptimization(fit, prepro, in_index, history)) {
+		if (darkOptimization(fit, prepro, in_index, history, &dark_k)) {
 			g_slist_free_full(history, g_free);
 			return 1;
 		}
 	}
 
-	if (preprocess(fit, prepro)) {
+	if (preprocess(fit, prepro, dark_k, threads)) {
 		g_slist_free_full(history, g_free);
 		return 1;
 	}
 
 	if (prepro->use_cosmetic_correction && prepro->use_dark
 			&& prepro->dark->naxes[2] == 1 && prepro->cc_from_dark) {
-		cosmeticCorrection(fit, prepro->dev, prepro->icold + prepro->ihot, prepro->is_cfa);
+		if (prepro->cc_plan && prepro->cc_plan->rx == fit->rx && prepro->cc_plan->ry == fit->ry)
+			cosmetic_plan_apply(prepro->cc_plan, fit);
+		else cosmeticCorrection(fit, prepro->dev, prepro->icold + prepro->ihot, prepro->is_cfa);
 #ifdef SIRIL_OUTPUT_DEBUG
 		image_find_minmax(fit);
 		fprintf(stdout, "after cosmetic correction: min=%f, max=%f\n",
@@ -453,6 +688,9 @@ int prepro_image_hook(struct generic_seq_args *args, int out_index, int in_index
 #endif
 	}
 
+	if (prepro->quality)
+		compute_frame_quality(prepro, fit, in_index, out_index, threads);
+
 	/* we need to do something special here because it's a 1-channel sequence and
 	 * image that will become 3-channel after this call, so stats caching will
 	 * not be correct. Preprocessing does not compute new stats so we don't need
@@ -463,6 +701,9 @@ int prepro_image_hook(struct generic_seq_args *args, int out_index, int in_index
 	full_stats_invalidation_from_fit(fit);
 	fit->history = g_slist_concat(fit->history, history);
 	fit->keywords.lo = 0;
+
+	if (prepro->extract != PREPRO_EXTRACT_NONE && prepro->seq)
+		return extract_calibrated_channels(args, prepro, fit, out_index, threads);
 	return 0;
 }
 
@@ -477,11 +718,94 @@ void clear_preprocessing_data(struct preprocessing_data *prepro) {
 		clearfits(prepro->flat);
 	if (prepro->dev)
 		free(prepro->dev);
+	cosmetic_plan_free(prepro->cc_plan);
+	prepro->cc_plan = NULL;
+	free(prepro->quality);
+	prepro->quality = NULL;
+	free(prepro->quality_out);
+	prepro->quality_out = NULL;
+}
+
+/* writes the quality computed for each frame in the registration data of the
+ * output sequence. The weighted FWHM uses the frame with the most stars as
+ * reference, like the image ranking of the two-pass registration */
+static void save_output_quality(struct generic_seq_args *args, struct preprocessing_data *prepro) {
+	sequence *seq = args->seq;
+	int maxstars = 0;
+	for (int i = 0; i < seq->number; i++) {
+		if (prepro->quality_out[i] >= 0 && prepro->quality[i].number_of_stars > maxstars)
+			maxstars = prepro->quality[i].number_of_stars;
+	}
+
+	gchar *basename = g_path_get_basename(seq->seqname);
+	gchar *seqname = g_strdup_printf("%s%s", prepro->ppprefix, basename);
+	sequence *new_seq = load_sequence(seqname, NULL);
+	g_free(basename);
+	if (!new_seq) {
+		siril_log_color_message(_("Could not open the sequence %s to save the frame quality\n"), "salmon", seqname);
+		g_free(seqname);
+		return;
+	}
+	g_free(seqname);
+
+	/* FITS images keep the file number of their input, the frames of single
+	 * file sequences are written in processing order */
+	GHashTable *by_filenum = NULL;
+	if (new_seq->type == SEQ_REGULAR) {
+		by_filenum = g_hash_table_new(g_direct_hash, g_direct_equal);
+		for (int j = 0; j < new_seq->number; j++)
+			g_hash_table_insert(by_filenum, GINT_TO_POINTER(new_seq->imgparam[j].filenum), GINT_TO_POINTER(j + 1));
+	}
+	int layer = prepro->quality_layer;
+	check_or_allocate_regparam(new_seq, layer);
+	int nb_saved = 0, nb_excluded = 0;
+	for (int i = 0; i < seq->number; i++) {
+		if (prepro->quality_out[i] < 0)
+			continue;
+		int j;
+		if (by_filenum)
+			j = GPOINTER_TO_INT(g_hash_table_lookup(by_filenum, GINT_TO_POINTER(seq->imgparam[i].filenum))) - 1;
+		else j = prepro->quality_out[i];
+		if (j < 0 || j >= new_seq->number)
+			continue;
+		const regdata *q = &prepro->quality[i];
+		regdata *reg = &new_seq->regparam[layer][j];
+		reg->fwhm = q->fwhm;
+		reg->roundness = q->roundness;
+		reg->background_lvl = q->background_lvl;
+		reg->number_of_stars = q->number_of_stars;
+		if (q->number_of_stars > 0)
+			reg->weighted_fwhm = 2.f * q->fwhm * (float)(maxstars - q->number_of_stars) / (float)maxstars + q->fwhm;
+		else {
+			// same as a registration failure
+			new_seq->imgparam[j].incl = FALSE;
+			nb_excluded++;
+		}
+		nb_saved++;
+	}
+	if (by_filenum)
+		g_hash_table_destroy(by_filenum);
+	if (nb_excluded) {
+		siril_log_message(_("%d images without stars were excluded\n"), nb_excluded);
+		fix_selnum(new_seq, FALSE);
+	}
+	new_seq->needs_saving = TRUE;
+	writeseqfile(new_seq);
+	siril_log_message(_("Frame quality saved for %d images of the sequence %s\n"), nb_saved, new_seq->seqname);
+	free_sequence(new_seq, TRUE);
 }
 
 static int prepro_finalize_hook(struct generic_seq_args *args) {
+	struct preprocessing_data *prepro = get_prepro_data(args);
+	if (args->save_hook == multi_save) {
+		clear_preprocessing_data(prepro);
+		// frees the preprocessing data with the multiple output data
+		return multi_finalize(args);
+	}
 	int retval = seq_finalize_hook(args);
-	clear_preprocessing_data((struct preprocessing_data *)args->user);
+	if (!retval && !args->retval && prepro->quality)
+		save_output_quality(args, prepro);
+	clear_preprocessing_data(prepro);
 	free(args->user);
 	return retval;
 }
@@ -506,6 +830,46 @@ void start_sequence_preprocessing(struct preprocessing_data *prepro) {
 	args->force_ser_output = prepro->seq->type != SEQ_SER && prepro->output_seqtype == SEQ_SER;
 	args->force_fitseq_output = prepro->seq->type != SEQ_FITSEQ && prepro->output_seqtype == SEQ_FITSEQ;
 	args->user = prepro;
+	if (prepro->extract == PREPRO_EXTRACT_HA || prepro->extract == PREPRO_EXTRACT_GREEN) {
+		free(args->new_seq_prefix);
+		args->new_seq_prefix = g_strdup_printf("%s%s",
+				prepro->extract == PREPRO_EXTRACT_HA ? "Ha_" : "Green_", prepro->ppprefix);
+	}
+	else if (prepro->extract == PREPRO_EXTRACT_HAOIII) {
+		struct multi_output_data *multi_args = calloc(1, sizeof(struct multi_output_data));
+		if (!multi_args) {
+			PRINT_ALLOC_ERR;
+			clear_preprocessing_data(prepro);
+			free(prepro);
+			free(args->new_seq_prefix);
+			free(args);
+			return;
+		}
+		multi_args->seq = prepro->seq;
+		multi_args->n = 2;
+		multi_args->prefixes = calloc(3, sizeof(const char*));
+		multi_args->prefixes[0] = g_strdup_printf("Ha_%s", prepro->ppprefix);
+		multi_args->prefixes[1] = g_strdup_printf("OIII_%s", prepro->ppprefix);
+		multi_args->user_data = prepro;
+		free(args->new_seq_prefix);
+		args->new_seq_prefix = NULL;
+		args->save_hook = multi_save;
+		args->user = multi_args;
+	}
+	if (prepro->compute_quality) {
+		prepro->quality = calloc(prepro->seq->number, sizeof(regdata));
+		prepro->quality_out = malloc(prepro->seq->number * sizeof(int));
+		if (!prepro->quality || !prepro->quality_out) {
+			PRINT_ALLOC_ERR;
+			free(prepro->quality);
+			prepro->quality = NULL;
+			free(prepro->quality_out);
+			prepro->quality_out = NULL;
+		} else {
+			for (int i = 0; i < prepro->seq->number; i++)
+				prepro->quality_out[i] = -1;
+		}
+	}
 	// float output is always used in case of FITS sequence
 	args->output_type = (args->force_ser_output || com.pref.force_16bit ||
 			(args->seq->type == SEQ_SER && !args->force_fitseq_output)) ?
@@ -722,7 +1086,7 @@ static gboolean test_for_master_files(struct preprocessing_data *args) {
 				} else {
 					args->bias = calloc(1, sizeof(fits));
 					set_progress_bar_data(_("Opening offset image..."), PROGRESS_NONE);
-					if (!readfits(expression, args->bias, NULL, !com.pref.force_16bit)) {
+					if (!master_cache_readfits(expression, args->bias, !com.pref.force_16bit)) {
 						if (args->bias->naxes[2] != gfit.naxes[2]) {
 							error = _("NOT USING OFFSET: number of channels is different");
 						} else if (args->bias->naxes[0] != gfit.naxes[0] ||
@@ -768,7 +1132,7 @@ static gboolean test_for_master_files(struct preprocessing_data *args) {
 			} else {
 				set_progress_bar_data(_("Opening dark image..."), PROGRESS_NONE);
 				args->dark = calloc(1, sizeof(fits));
-				if (!readfits(expression, args->dark, NULL, !com.pref.force_16bit)) {
+				if (!master_cache_readfits(expression, args->dark, !com.pref.force_16bit)) {
 					if (args->dark->naxes[2] != gfit.naxes[2]) {
 						error = _("NOT USING DARK: number of channels is different");
 					} else if (args->dark->naxes[0] != gfit.naxes[0] ||
@@ -878,7 +1242,7 @@ static gboolean test_for_master_files(struct preprocessing_data *args) {
 			} else {
 				set_progress_bar_data(_("Opening flat image..."), PROGRESS_NONE);
 				args->flat = calloc(1, sizeof(fits));
-				if (!readfits(expression, args->flat, NULL, !com.pref.force_16bit)) {
+				if (!master_cache_readfits(expression, args->flat, !com.pref.force_16bit)) {
 					if (args->flat->naxes[2] != gfit.naxes[2]) {
 						error = _("NOT USING FLAT: number of channels is different");
 					} else if (args->flat->naxes[0] != gfit.naxes[0] ||
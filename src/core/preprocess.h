@@ -6,6 +6,14 @@
 #include "core/processing.h"
 
 /* preprocessing data from GUI */
+
+/* channels extracted from the calibrated CFA frames instead of saving them */
+typedef enum {
+	PREPRO_EXTRACT_NONE,
+	PREPRO_EXTRACT_HA,
+	PREPRO_EXTRACT_GREEN,
+	PREPRO_EXTRACT_HAOIII
+} prepro_extraction;
 struct preprocessing_data {
 	gboolean use_bias, use_dark, use_flat;
 	fits *bias, *dark, *flat;
@@ -24,6 +32,8 @@ struct preprocessing_data {
 	gboolean allow_32bit_output;
 	char *ppprefix;	// prefix for output files
 	gboolean debayer;	// debayer at the end
+	prepro_extraction extract;	// or extract channels at the end, sequences only
+	extraction_scaling extract_scaling;
 	GSList *history;	// generic history to add to the FITS output
 
 	/* cosmetic correction */
@@ -32,10 +42,18 @@ struct preprocessing_data {
 	double sigma[2];
 	long icold, ihot;	// number of cold and hot pixels to correct
 	deviant_pixel *dev;	// the runtime list of deviant pixels (icold + ihot long)
+	struct cosmetic_plan *cc_plan;	// their neighbours, for the size of the master dark
 	gboolean is_cfa;	// when replacing pixels, don't use direct neighbours
 
 	gboolean ignore_exclusion; // if true, images marked as excluded will not
 							// be preprocessed
+
+	/* star-based quality of the output frames, saved as registration data
+	 * of the output sequence for frame selection without another pass */
+	gboolean compute_quality;
+	regdata *quality;	// per input image
+	int *quality_out;	// output index of each input image, -1 if not processed
+	int quality_layer;
 	int retval;
 };
 
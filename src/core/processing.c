@@ -29,7 +29,12 @@
 #include "core/siril.h"
 #include "core/proto.h"
 #include "core/processing.h"
+#include "core/processing_tasks.h"
+#include "core/script_scheduler.h"
 #include "core/siril_log.h"
+#include "core/memory_governor.h"
+#include "core/memory_report.h"
+#include "core/trace.h"
 #include "core/sequence_filtering.h"
 #include "core/OS_utils.h"
 #include "filters/graxpert.h" // for set_graxpert_aborted()
@@ -40,28 +45,328 @@
 #include "io/ser.h"
 #include "io/seqwriter.h"
 #include "io/fits_sequence.h"
+#include "io/frame_pool.h"
+#include "io/io_stats.h"
 #include "io/image_format_fits.h"
 #include "algos/statistics.h"
 #include "registration/registration.h"
 
 // called in start_in_new_thread only
 // works in parallel if the arg->parallel is TRUE for FITS or SER sequences
+#ifdef _OPENMP
+/* Staged processing: reader threads read the frames ahead in the order of the
+ * sequence into a bounded queue, the OpenMP threads only take the frames from
+ * the queue and process them, and the seqwriter, when there is one, writes
+ * them. Reading and computing this way overlap instead of competing in the
+ * same thread. The queue is bounded by the number of slots, a reader takes a
+ * slot before reading a frame and the worker gives it back when it takes the
+ * frame out of the queue, so the frames in memory stay within the limit
+ * computed for the parallel processing. With a seqwriter, the reader also
+ * waits for the memory of the frame before reading it, the reservation being
+ * then given to the worker with the frame. */
+struct read_ahead_frame {
+	int frame;	// output frame index
+	int input_idx;
+	fits *fit;
+	rectangle area;	// read with input_area_hook
+	int retval;	// of the read
+	gboolean memory_reserved;	// seqwriter_wait_for_memory() was called
+};
+
+struct read_ahead {
+	struct generic_seq_args *args;
+	const int *index_mapping;
+	int nb_frames;
+	const int *abort;	// of the worker
+	GAsyncQueue *ready;
+	GMutex lock;
+	GCond cond;
+	int free_slots;
+	gboolean reserve_memory;	// there is a seqwriter
+	gboolean stop;
+	gint next_frame;
+	GThread **readers;
+	int nb_readers;
+	processing_task *task;	// of the worker, NULL if none
+};
+
+struct read_ahead_reader {
+	struct read_ahead *ra;
+	int thread_id;	// for the per-thread file handles of FITS sequences
+};
+
+/* reads a frame for full-frame processing, only its area given by the
+ * input_area_hook if any, area being left unchanged without it */
+static int read_input_frame(struct generic_seq_args *args, int input_idx, fits *fit,
+		rectangle *area, int thread_id) {
+	if (args->input_area_hook) {
+		if (args->seq->type == SEQ_REGULAR && args->input_area_hook(args, input_idx, area))
+			return seq_read_frame_area(args->seq, input_idx, fit, area, args->force_float);
+		memset(area, 0, sizeof(rectangle));
+	}
+	return seq_read_frame_cached(args->seq, input_idx, fit, args->force_float, thread_id);
+}
+
+static gpointer read_ahead_reader_thread(gpointer p) {
+	struct read_ahead_reader *reader = (struct read_ahead_reader *) p;
+	struct read_ahead *ra = reader->ra;
+	struct generic_seq_args *args = ra->args;
+	processing_task_attach(ra->task);
+	while (TRUE) {
+		g_mutex_lock(&ra->lock);
+		while (ra->free_slots == 0 && !ra->stop)
+			g_cond_wait(&ra->cond, &ra->lock);
+		if (ra->stop) {
+			g_mutex_unlock(&ra->lock);
+			break;
+		}
+		ra->free_slots--;
+		g_mutex_unlock(&ra->lock);
+
+		int frame = g_atomic_int_add(&ra->next_frame, 1);
+		if (frame >= ra->nb_frames)
+			break;
+
+		struct read_ahead_frame *item = g_new(struct read_ahead_frame, 1);
+		item->frame = frame;
+		item->input_idx = ra->index_mapping ? ra->index_mapping[frame] : frame;
+		item->area = args->area;
+		item->memory_reserved = FALSE;
+		item->fit = NULL;
+		if (ra->reserve_memory && !*ra->abort && get_thread_run()) {
+			gint64 span = trace_begin();
+			seqwriter_wait_for_memory();
+			trace_end(span, "sequence", "wait for memory", item->input_idx);
+			item->memory_reserved = TRUE;
+		}
+		if (!*ra->abort && get_thread_run())
+			item->fit = calloc(1, sizeof(fits));
+		if (*ra->abort || !get_thread_run()) {
+			/* not read, the processing is stopping */
+			if (item->memory_reserved) {
+				seqwriter_release_memory();
+				item->memory_reserved = FALSE;
+			}
+			if (item->fit) {
+				free(item->fit);
+				item->fit = NULL;
+			}
+			item->retval = 1;
+		}
+		else if (!item->fit) {
+			PRINT_ALLOC_ERR;
+			item->retval = 1;
+		}
+		else {
+			gint64 span = trace_begin();
+			item->retval = read_input_frame(args, item->input_idx, item->fit,
+					&item->area, reader->thread_id);
+			trace_end(span, "sequence", "read", item->input_idx);
+		}
+		g_async_queue_push(ra->ready, item);
+	}
+	processing_task_attach(NULL);
+	g_free(reader);
+	return NULL;
+}
+
+static gboolean can_read_ahead(struct generic_seq_args *args, gboolean batch) {
+	return args->parallel && !batch && !args->partial_image && !args->image_read_hook &&
+		args->max_parallel_images >= 3 && args->nb_filtered_images >= 3 &&
+		(args->seq->type == SEQ_SER || args->seq->type == SEQ_FITSEQ ||
+		 (args->seq->type == SEQ_REGULAR && fits_is_reentrant()));
+}
+
+static struct read_ahead *read_ahead_start(struct generic_seq_args *args, const int *index_mapping,
+		int nb_frames, int nb_slots, gboolean reserve_memory, const int *abort_flag) {
+	struct read_ahead *ra = calloc(1, sizeof(struct read_ahead));
+	if (!ra) {
+		PRINT_ALLOC_ERR;
+		return NULL;
+	}
+	ra->args = args;
+	ra->index_mapping = index_mapping;
+	ra->nb_frames = nb_frames;
+	ra->abort = abort_flag;
+	ra->ready = g_async_queue_new();
+	g_mutex_init(&ra->lock);
+	g_cond_init(&ra->cond);
+	ra->free_slots = nb_slots;
+	ra->reserve_memory = reserve_memory;
+	ra->task = processing_task_current();
+	/* SER reads are serialized by the file lock */
+	ra->nb_readers = args->seq->type == SEQ_SER ? 1 : min(nb_slots, 2);
+	ra->readers = malloc(ra->nb_readers * sizeof(GThread *));
+	for (int i = 0; i < ra->nb_readers; i++) {
+		struct read_ahead_reader *reader = g_new(struct read_ahead_reader, 1);
+		reader->ra = ra;
+		reader->thread_id = i;
+		ra->readers[i] = g_thread_new("read-ahead", read_ahead_reader_thread, reader);
+	}
+	siril_debug_print("read-ahead: %d reader(s), %d frames ahead\n", ra->nb_readers, nb_slots);
+	return ra;
+}
+
+/* blocks until the next frame read is available */
+static struct read_ahead_frame *read_ahead_pop(struct read_ahead *ra) {
+	struct read_ahead_frame *item = g_async_queue_pop(ra->ready);
+	g_mutex_lock(&ra->lock);
+	ra->free_slots++;
+	g_cond_signal(&ra->cond);
+	g_mutex_unlock(&ra->lock);
+	return item;
+}
+
+static void read_ahead_drain(struct read_ahead *ra) {
+	struct read_ahead_frame *item;
+	while ((item = g_async_queue_try_pop(ra->ready))) {
+		if (item->memory_reserved)
+			seqwriter_release_memory();
+		if (item->fit) {
+			clearfits(item->fit);
+			free(item->fit);
+		}
+		g_free(item);
+	}
+}
+
+/* stops the readers and frees the frames that were read but not processed.
+ * Their memory is released before joining the readers, which may be waiting
+ * for it in seqwriter_wait_for_memory() */
+static void read_ahead_stop(struct read_ahead *ra) {
+	g_mutex_lock(&ra->lock);
+	ra->stop = TRUE;
+	g_cond_broadcast(&ra->cond);
+	g_mutex_unlock(&ra->lock);
+	read_ahead_drain(ra);
+	for (int i = 0; i < ra->nb_readers; i++)
+		g_thread_join(ra->readers[i]);
+	read_ahead_drain(ra);
+	g_async_queue_unref(ra->ready);
+	g_mutex_clear(&ra->lock);
+	g_cond_clear(&ra->cond);
+	free(ra->readers);
+	free(ra);
+}
+#endif
+
+#ifdef _OPENMP
+/* Split of the threads between images processed in parallel and threads used
+ * for each image. Some image hooks scale well with the number of threads and
+ * others do not, so the best split is measured on the first frames of the
+ * sequence: after a warm-up phase, the frames are processed in phases of a
+ * few frames each, starting with the largest number of images allowed by the
+ * memory limits and halving it while the throughput improves. The rest of the
+ * sequence is processed with the best split found. */
+#define SPLIT_TUNER_FRAMES_PER_WORKER 3	// length of a trial phase
+#define SPLIT_TUNER_MIN_GAIN 1.1	// a split with less images must be this much faster
+
+struct split_tuner {
+	const char *description;
+	int max_workers;	// from the memory limits
+	int current;		// images in parallel of the phase being run
+	int best;
+	double best_rate;	// frames per second of the best split
+	gboolean warmed_up;
+	gboolean done;
+};
+
+static gboolean can_tune_split(struct generic_seq_args *args, int nb_workers, int nb_frames) {
+	return args->parallel && nb_workers >= 2 && nb_workers <= processing_task_max_thread() &&
+		nb_frames >= 16 * nb_workers &&
+		args->seq->type != SEQ_AVI && (args->seq->type == SEQ_SER || fits_is_reentrant());
+}
+
+static struct split_tuner *split_tuner_new(struct generic_seq_args *args, int nb_workers) {
+	struct split_tuner *tuner = calloc(1, sizeof(struct split_tuner));
+	if (!tuner)
+		return NULL;
+	tuner->description = args->description;
+	tuner->max_workers = nb_workers;
+	tuner->current = nb_workers;
+	tuner->best = nb_workers;
+	return tuner;
+}
+
+/* gives the number of images and the threads for each of the next phase and
+ * returns the index of its last frame + 1, or -1 on allocation error */
+static int split_tuner_next_phase(struct split_tuner *tuner, int first, int *nb_workers, int **threads_per_image) {
+	int workers, last;
+	if (tuner->done) {
+		workers = tuner->best;
+		last = INT_MAX;
+	} else if (!tuner->warmed_up) {
+		workers = tuner->current;
+		last = first + workers;
+	} else {
+		workers = tuner->current;
+		last = first + SPLIT_TUNER_FRAMES_PER_WORKER * workers;
+	}
+	if (workers != *nb_workers) {
+		int *distribution = compute_thread_distribution(workers, processing_task_max_thread());
+		if (!distribution)
+			return -1;
+		free(*threads_per_image);
+		*threads_per_image = distribution;
+		*nb_workers = workers;
+	}
+	return last;
+}
+
+static void split_tuner_end_phase(struct split_tuner *tuner, int nb_frames, gint64 duration_us) {
+	if (tuner->done)
+		return;
+	if (!tuner->warmed_up) {
+		tuner->warmed_up = TRUE;
+		return;
+	}
+	double rate = nb_frames * 1.0e6 / max(duration_us, 1);
+	siril_debug_print("split tuner: %d image(s) in parallel, %.2f frames/s\n", tuner->current, rate);
+	if (tuner->best_rate == 0.0 || rate > tuner->best_rate * SPLIT_TUNER_MIN_GAIN) {
+		tuner->best = tuner->current;
+		tuner->best_rate = rate;
+		if (tuner->current > 1) {
+			tuner->current /= 2;
+			return;
+		}
+	}
+	tuner->done = TRUE;
+	if (tuner->best != tuner->max_workers && tuner->description)
+		siril_log_message(_("%s: processing %d images in parallel with %d threads each is faster, using it for the rest of the sequence\n"),
+				tuner->description, tuner->best, max(processing_task_max_thread() / tuner->best, 1));
+}
+#endif
+
 gpointer generic_sequence_worker(gpointer p) {
 	struct generic_seq_args *args = (struct generic_seq_args *)p;
 	struct timeval t_start, t_end;
-	int frame;	// output frame index
 	int input_idx;	// index of the frame being processed in the sequence
 	int *index_mapping = NULL;
 	int nb_frames, excluded_frames = 0, progress = 0;
 	int abort = 0;	// variable for breaking out of loop
 #ifdef _OPENMP
 	int* threads_per_image = NULL;
+	struct read_ahead *read_ahead = NULL;
+	struct split_tuner *tuner = NULL;
+	int nb_workers = 1;	// images processed in parallel
 #endif
 	gboolean have_seqwriter = FALSE;
+	gboolean batch = FALSE;
+	gboolean pooled = FALSE;	// frame buffers recycled through the frame pool
+	fits *batch_fits = NULL;	// one per thread in batch mode
+	int progress_step = 1;
+	/* the threads processing the frames are attached to the task of the
+	 * worker, if it runs as one */
+	processing_task *task = processing_task_current();
 
 	assert(args);
 	assert(args->seq);
 	assert(args->image_hook);
+	gint64 worker_span = trace_begin();
+	/* the I/O counters are global, they are not kept for concurrent tasks */
+	if (!task)
+		io_stats_reset();
+	memory_report_begin(args->description ? args->description : _("Sequence processing"));
 	set_progress_bar_data(NULL, PROGRESS_RESET);
 	gettimeofday(&t_start, NULL);
 
@@ -94,12 +399,16 @@ gpointer generic_sequence_worker(gpointer p) {
 	 * distribute them */
 	if (args->max_parallel_images > nb_frames)
 		args->max_parallel_images = nb_frames;
+	/* the memory limits hooks allow up to com.max_thread images */
+	if (task && args->max_parallel_images > processing_task_max_thread())
+		args->max_parallel_images = processing_task_max_thread();
 
 	siril_log_message(_("%s: with the current memory and thread limits, up to %d thread(s) can be used\n"),
 			args->description, args->max_parallel_images);
+	memory_report_set_parallel_images(args->max_parallel_images);
 
 	// remaining threads distribution per image thread
-	threads_per_image = compute_thread_distribution(args->max_parallel_images, com.max_thread);
+	threads_per_image = compute_thread_distribution(args->max_parallel_images, processing_task_max_thread());
 #endif
 
 	if (args->prepare_hook && args->prepare_hook(args)) {
@@ -123,14 +432,15 @@ gpointer generic_sequence_worker(gpointer p) {
 			args->retval = 1;
 			goto the_end;
 		}
-		for (input_idx = 0, frame = 0; input_idx < args->seq->number; input_idx++) {
+		int nb_mapped = 0;
+		for (input_idx = 0; input_idx < args->seq->number; input_idx++) {
 			if (!args->filtering_criterion(args->seq, input_idx, args->filtering_parameter)) {
 				continue;
 			}
-			index_mapping[frame++] = input_idx;
+			index_mapping[nb_mapped++] = input_idx;
 		}
-		if (frame != nb_frames) {
-			siril_log_message(_("Output index mapping failed (%d/%d).\n"), frame, nb_frames);
+		if (nb_mapped != nb_frames) {
+			siril_log_message(_("Output index mapping failed (%d/%d).\n"), nb_mapped, nb_frames);
 			args->retval = 1;
 			goto the_end;
 		}
@@ -158,178 +468,307 @@ gpointer generic_sequence_worker(gpointer p) {
 	have_seqwriter = args->has_output &&
 		((args->force_fitseq_output || args->seq->type == SEQ_FITSEQ) ||
 		 (args->force_ser_output || args->seq->type == SEQ_SER));
+
+	batch = args->partial_batch && args->partial_image && !args->has_output &&
+		args->seq->type != SEQ_INTERNAL;
+	if (batch) {
+		batch_fits = calloc(max(args->max_parallel_images, 1), sizeof(fits));
+		if (!batch_fits) {
+			PRINT_ALLOC_ERR;
+			args->retval = 1;
+			goto the_end;
+		}
+		// about a hundred progress updates for the whole sequence
+		progress_step = max(1, nb_frames / 100);
+	}
+	/* batch mode keeps its own buffers and internal sequences do not own
+	 * the data of their frames */
+	pooled = !batch && args->seq->type != SEQ_INTERNAL;
+	if (pooled)
+		frame_pool_enable(max(args->max_parallel_images, 1));
 #ifdef _OPENMP
+	nb_workers = args->max_parallel_images;
+	if (can_read_ahead(args, batch)) {
+		/* a third of the frames allowed in memory are read ahead, the
+		 * threads of the images not processed are given to the others */
+		int nb_ahead = max(args->max_parallel_images / 3, 1);
+		int *distribution = compute_thread_distribution(nb_workers - nb_ahead, processing_task_max_thread());
+		if (distribution) {
+			read_ahead = read_ahead_start(args, index_mapping, nb_frames, nb_ahead,
+					have_seqwriter, &abort);
+			if (read_ahead) {
+				nb_workers -= nb_ahead;
+				free(threads_per_image);
+				threads_per_image = distribution;
+			} else free(distribution);
+		}
+	}
+	if (can_tune_split(args, nb_workers, nb_frames))
+		tuner = split_tuner_new(args, nb_workers);
 	omp_init_lock(&args->lock);
 	if (have_seqwriter)
 		omp_set_schedule(omp_sched_dynamic, 1);
 	else omp_set_schedule(omp_sched_guided, 0);
+#endif
+	int phase_first = 0;
+	while (phase_first < nb_frames && !abort) {
+		int phase_last = nb_frames;
+#ifdef _OPENMP
+		if (tuner) {
+			phase_last = split_tuner_next_phase(tuner, phase_first, &nb_workers, &threads_per_image);
+			if (phase_last < 0) {
+				abort = 1;
+				break;
+			}
+			phase_last = min(phase_last, nb_frames);
+		}
+		gint64 phase_start = g_get_monotonic_time();
 #ifdef HAVE_FFMS2
-	// we don't want to enable parallel processing for films, as ffms2 is not thread-safe
-#pragma omp parallel for num_threads(args->max_parallel_images) private(input_idx) schedule(runtime) \
-	if(args->max_parallel_images > 1 && args->seq->type != SEQ_AVI && args->parallel && (args->seq->type == SEQ_SER || fits_is_reentrant()))
+		// we don't want to enable parallel processing for films, as ffms2 is not thread-safe
+#pragma omp parallel for num_threads(nb_workers) private(input_idx) schedule(runtime) \
+		if(nb_workers > 1 && args->seq->type != SEQ_AVI && args->parallel && (args->seq->type == SEQ_SER || fits_is_reentrant()))
 #else
-#pragma omp parallel for num_threads(args->max_parallel_images) private(input_idx) schedule(runtime) \
-	if(args->max_parallel_images > 1 && args->parallel && (args->seq->type == SEQ_SER || fits_is_reentrant()))
+#pragma omp parallel for num_threads(nb_workers) private(input_idx) schedule(runtime) \
+		if(nb_workers > 1 && args->parallel && (args->seq->type == SEQ_SER || fits_is_reentrant()))
 #endif // HAVE_FFMS2
 #endif // _OPENMP
-	for (frame = 0; frame < nb_frames; frame++) {
-		if (abort) continue;
-
-		char filename[256];
-		rectangle area = { .x = args->area.x, .y = args->area.y,
-			.w = args->area.w, .h = args->area.h };
-
-		if (!get_thread_run()) {
-			abort = 1;
-			continue;
-		}
-		if (index_mapping)
-			input_idx = index_mapping[frame];
-		else input_idx = frame;
+		for (int iter = phase_first; iter < phase_last; iter++) {
+			if (abort) continue;
+
+			char filename[256];
+			rectangle area = { .x = args->area.x, .y = args->area.y,
+				.w = args->area.w, .h = args->area.h };
+			int frame = iter;	// output frame index
+			fits *fit_read = NULL;	// already read by the read-ahead stage
+			int read_retval = 0;
+			gboolean memory_reserved = FALSE;	// by the read-ahead stage
+
+			processing_task_attach(task);
+			if (!get_thread_run()) {
+				abort = 1;
+				continue;
+			}
+#ifdef _OPENMP
+			if (read_ahead) {
+				gint64 span = trace_begin();
+				struct read_ahead_frame *item = read_ahead_pop(read_ahead);
+				trace_end(span, "sequence", "wait for frame", item->input_idx);
+				frame = item->frame;
+				input_idx = item->input_idx;
+				fit_read = item->fit;
+				area = item->area;
+				read_retval = item->retval;
+				memory_reserved = item->memory_reserved;
+				g_free(item);
+			}
+			else
+#endif
+			if (index_mapping)
+				input_idx = index_mapping[frame];
+			else input_idx = frame;
 
-		if (!seq_get_image_filename(args->seq, input_idx, filename)) {
-			abort = 1;
-			continue;
-		}
+			if (!seq_get_image_filename(args->seq, input_idx, filename)) {
+				abort = 1;
+				if (memory_reserved)
+					seqwriter_release_memory();
+				if (fit_read) {
+					clearfits(fit_read);
+					free(fit_read);
+				}
+				continue;
+			}
 
-		int thread_id = -1;
-		int nb_subthreads = 1;
+			int thread_id = -1;
+			int nb_subthreads = 1;
 #ifdef _OPENMP
-		thread_id = omp_get_thread_num();
-		if (have_seqwriter) {
-			seqwriter_wait_for_memory();
-			if (abort) {
-				seqwriter_release_memory();
-				continue;
+			thread_id = omp_get_thread_num();
+			if (have_seqwriter) {
+				if (!memory_reserved) {
+					gint64 span = trace_begin();
+					seqwriter_wait_for_memory();
+					trace_end(span, "sequence", "wait for memory", input_idx);
+				}
+				if (abort) {
+					seqwriter_release_memory();
+					if (fit_read) {
+						clearfits(fit_read);
+						free(fit_read);
+					}
+					continue;
+				}
 			}
-		}
-		nb_subthreads = threads_per_image[thread_id];
+			nb_subthreads = threads_per_image[thread_id];
 #endif
 
-		gboolean read_image = args->image_read_hook ? args->image_read_hook(args, input_idx) : TRUE;
-
-		fits *fit = calloc(1, sizeof(fits));
-		if (!fit) {
-			PRINT_ALLOC_ERR;
-			abort = 1;
-			continue;
-		}
+			gboolean read_image = args->image_read_hook ? args->image_read_hook(args, input_idx) : TRUE;
 
-		if (args->partial_image) {
-			regdata *regparam = NULL;
-			if (args->regdata_for_partial)
-				regparam = args->seq->regparam[args->layer_for_partial];
-			if (regparam &&
-					guess_transform_from_H(regparam[input_idx].H) > NULL_TRANSFORMATION &&
-					guess_transform_from_H(regparam[args->seq->reference_image].H) > NULL_TRANSFORMATION) {
-				// do not try to transform area if img matrix is null
-				selection_H_transform(&area,
-						regparam[args->seq->reference_image].H,
-						regparam[input_idx].H);
+			fits *fit = fit_read ? fit_read : batch ? &batch_fits[max(thread_id, 0)] : calloc(1, sizeof(fits));
+			if (!fit) {
+				PRINT_ALLOC_ERR;
+				abort = 1;
+				continue;
 			}
-			// args->area may be modified in hooks
 
-			/* We need to detect if the box has crossed the borders to invalidate
-			 * the current frame in case the box position was computed from reg data.
-			 */
-			gboolean has_crossed = enforce_area_in_image(&area, args->seq, input_idx) && args->regdata_for_partial;
+			gint64 span = trace_begin();
+			if (args->partial_image) {
+				gboolean has_crossed;
+				if (args->partial_area_hook) {
+					has_crossed = args->partial_area_hook(args, input_idx, &area) != 0;
+				} else {
+					regdata *regparam = NULL;
+					if (args->regdata_for_partial)
+						regparam = args->seq->regparam[args->layer_for_partial];
+					if (regparam &&
+							guess_transform_from_H(regparam[input_idx].H) > NULL_TRANSFORMATION &&
+							guess_transform_from_H(regparam[args->seq->reference_image].H) > NULL_TRANSFORMATION) {
+						// do not try to transform area if img matrix is null
+						selection_H_transform(&area,
+								regparam[args->seq->reference_image].H,
+								regparam[input_idx].H);
+					}
+					// args->area may be modified in hooks
+
+					/* We need to detect if the box has crossed the borders to invalidate
+					 * the current frame in case the box position was computed from reg data.
+					 */
+					has_crossed = enforce_area_in_image(&area, args->seq, input_idx) && args->regdata_for_partial;
+				}
 
-			if (has_crossed || (read_image && seq_read_frame_part(args->seq, args->layer_for_partial,
-						input_idx, fit, &area,
-						args->get_photometry_data_for_partial, thread_id)))
-			{
-				if (args->stop_on_error)
+				if (has_crossed || (read_image && seq_read_frame_part(args->seq, args->layer_for_partial,
+							input_idx, fit, &area,
+							args->get_photometry_data_for_partial, thread_id)))
+				{
+					if (args->stop_on_error)
+						abort = 1;
+					else {
+						g_atomic_int_inc(&excluded_frames);
+					}
+					clearfits(fit);
+					if (!batch)
+						g_free(fit);
+					// TODO: for seqwriter, we need to notify the failed frame
+					continue;
+				}
+				/*char tmpfn[100];	// this is for debug purposes
+				  sprintf(tmpfn, "/tmp/partial_%d.fit", input_idx);
+				  savefits(tmpfn, fit);*/
+				if (read_image)
+					trace_end(span, "sequence", "read", input_idx);
+			} else {
+				// image is read bottom-up here, while it's top-down for partial images
+				if (read_image && (fit_read ? read_retval :
+							read_input_frame(args, input_idx, fit, &area, thread_id))) {
 					abort = 1;
-				else {
-					g_atomic_int_inc(&excluded_frames);
+					clearfits(fit);
+					free(fit);
+					continue;
 				}
-				clearfits(fit);
-				g_free(fit);
+				// the frames read ahead are traced by the reader
+				if (read_image && !fit_read)
+					trace_end(span, "sequence", "read", input_idx);
 				// TODO: for seqwriter, we need to notify the failed frame
-				continue;
+#ifdef _OPENMP
+				if (have_seqwriter && read_image && args->seq->rx > 0 && args->seq->ry > 0)
+					seqwriter_set_block_usage(frame, ((double) fit->rx * fit->ry) / ((double) args->seq->rx * args->seq->ry));
+#endif
 			}
-			/*char tmpfn[100];	// this is for debug purposes
-			  sprintf(tmpfn, "/tmp/partial_%d.fit", input_idx);
-			  savefits(tmpfn, fit);*/
-		} else {
-			// image is read bottom-up here, while it's top-down for partial images
-			if (read_image && seq_read_frame(args->seq, input_idx, fit, args->force_float, thread_id)) {
+			// checking nb layers consistency, not for partial image
+			if (read_image && !args->partial_image && (fit->naxes[2] != args->seq->nb_layers)) {
+				siril_log_color_message(_("Image #%d: number of layers (%d) is not consistent with sequence (%d), aborting\n"),
+							"red", input_idx + 1, fit->naxes[2], args->seq->nb_layers);
 				abort = 1;
 				clearfits(fit);
 				free(fit);
 				continue;
 			}
-			// TODO: for seqwriter, we need to notify the failed frame
-		}
-		// checking nb layers consistency, not for partial image
-		if (read_image && !args->partial_image && (fit->naxes[2] != args->seq->nb_layers)) {
-			siril_log_color_message(_("Image #%d: number of layers (%d) is not consistent with sequence (%d), aborting\n"),
-						"red", input_idx + 1, fit->naxes[2], args->seq->nb_layers);
-			abort = 1;
-			clearfits(fit);
-			free(fit);
-			continue;
-		}
-		if (read_image && args->image_hook(args, frame, input_idx, fit, &area, nb_subthreads)) {
-			if (args->stop_on_error)
-				abort = 1;
-			else {
-				g_atomic_int_inc(&excluded_frames);
-				g_atomic_int_inc(&progress);
-				set_progress_bar_data(NULL, (float)progress / nb_framesf);
-			}
-			if (args->seq->type == SEQ_INTERNAL) {
-				fit->data = NULL;
-				fit->fdata = NULL;
+			span = trace_begin();
+			int hook_retval = read_image && args->image_hook(args, frame, input_idx, fit, &area, nb_subthreads);
+			if (read_image)
+				trace_end(span, "sequence", "hook", input_idx);
+			if (hook_retval) {
+				if (args->stop_on_error)
+					abort = 1;
+				else {
+					g_atomic_int_inc(&excluded_frames);
+					g_atomic_int_inc(&progress);
+					set_progress_bar_data(NULL, (float)progress / nb_framesf);
+				}
+				if (args->seq->type == SEQ_INTERNAL) {
+					fit->data = NULL;
+					fit->fdata = NULL;
+				}
+				clearfits(fit);
+				if (!batch)
+					free(fit);
+				// for seqwriter, we need to notify the failed frame
+				if (have_seqwriter) {
+					int retval;
+					if (args->save_hook)
+						retval = args->save_hook(args, frame, input_idx, NULL);
+					else retval = generic_save(args, frame, input_idx, NULL);
+					if (retval)
+						abort = 1;
+				}
+				continue;
 			}
-			clearfits(fit);
-			free(fit);
-			// for seqwriter, we need to notify the failed frame
-			if (have_seqwriter) {
+
+			if (args->has_output) {
 				int retval;
+				span = trace_begin();
 				if (args->save_hook)
-					retval = args->save_hook(args, frame, input_idx, NULL);
-				else retval = generic_save(args, frame, input_idx, NULL);
-				if (retval)
+					retval = args->save_hook(args, frame, input_idx, fit);
+				else retval = generic_save(args, frame, input_idx, fit);
+				trace_end(span, "sequence", "write", input_idx);
+				if (retval) {
 					abort = 1;
+					clearfits(fit);
+					free(fit);
+					continue;
+				}
+			} else if (!batch) {
+				/* save stats that may have been computed for the first
+				 * time, but if fit has been modified for the new
+				 * sequence, we shouldn't save it for the old one.
+				 */
+				save_stats_from_fit(fit, args->seq, input_idx);
 			}
-			continue;
-		}
 
-		if (args->has_output) {
-			int retval;
-			if (args->save_hook)
-				retval = args->save_hook(args, frame, input_idx, fit);
-			else retval = generic_save(args, frame, input_idx, fit);
-			if (retval) {
-				abort = 1;
-				clearfits(fit);
-				free(fit);
+			if (batch) {
+				// the buffers are kept for the next frame of this thread
+				int done = g_atomic_int_add(&progress, 1) + 1;
+				if (done % progress_step == 0)
+					set_progress_bar_data(NULL, (float)done / nb_framesf);
 				continue;
 			}
-		} else {
-			/* save stats that may have been computed for the first
-			 * time, but if fit has been modified for the new
-			 * sequence, we shouldn't save it for the old one.
-			 */
-			save_stats_from_fit(fit, args->seq, input_idx);
-		}
-
-		if (!have_seqwriter) {
-			if (!(args->seq->type == SEQ_INTERNAL)) {
-				clearfits(fit);
-				free(fit);
-			} else {
-				clearfits_header(fit);
-				free(fit);
+			if (!have_seqwriter) {
+				if (!(args->seq->type == SEQ_INTERNAL)) {
+					clearfits_to_pool(fit);
+					free(fit);
+				} else {
+					clearfits_header(fit);
+					free(fit);
+				}
 			}
+
+			g_atomic_int_inc(&progress);
+			gchar *msg = g_strdup_printf(_("%s. Processing image %d (%s)"), args->description, input_idx + 1, filename);
+			set_progress_bar_data(msg, (float)progress / nb_framesf);
+			g_free(msg);
 		}
+#ifdef _OPENMP
+		if (tuner)
+			split_tuner_end_phase(tuner, phase_last - phase_first, g_get_monotonic_time() - phase_start);
+#endif
+		phase_first = phase_last;
+	}
 
-		g_atomic_int_inc(&progress);
-		gchar *msg = g_strdup_printf(_("%s. Processing image %d (%s)"), args->description, input_idx + 1, filename);
-		set_progress_bar_data(msg, (float)progress / nb_framesf);
-		g_free(msg);
+#ifdef _OPENMP
+	if (read_ahead) {
+		read_ahead_stop(read_ahead);
+		read_ahead = NULL;
 	}
+	free(tuner);
+#endif
 
 	/* the finalize hook contains the sequence writer synchronization, it
 	 * should be called before outputing the logs */
@@ -337,6 +776,13 @@ gpointer generic_sequence_worker(gpointer p) {
 		siril_log_message(_("Finalizing sequence processing failed.\n"));
 		abort = 1;
 	}
+	if (have_seqwriter && memory_governor_get_budget()) {
+		siril_debug_print("%s: peak memory reserved %u MB of %u MB\n", args->description,
+				memory_governor_get_peak(), memory_governor_get_budget());
+		memory_governor_set_budget(0);
+	}
+	if (!task)
+		io_stats_report(args->description ? args->description : _("Sequence processing"));
 	if (abort || excluded_frames == nb_frames) {
 		set_progress_bar_data(_("Sequence processing failed. Check the log."), PROGRESS_RESET);
 		siril_log_color_message(_("Sequence processing failed.\n"), "red");
@@ -355,14 +801,23 @@ gpointer generic_sequence_worker(gpointer p) {
 		gettimeofday(&t_end, NULL);
 		show_time(t_start, t_end);
 	}
+	trace_end(worker_span, "sequence", g_intern_string(args->description ? args->description : "sequence processing"), -1);
 
 #ifdef _OPENMP
 	omp_destroy_lock(&args->lock);
 #endif
 the_end:
+	memory_report_end();
 #ifdef _OPENMP
 	free(threads_per_image);
 #endif
+	if (pooled)
+		frame_pool_disable();
+	if (batch_fits) {
+		for (int i = 0; i < max(args->max_parallel_images, 1); i++)
+			clearfits(&batch_fits[i]);
+		free(batch_fits);
+	}
 
 	if (index_mapping) free(index_mapping);
 	if (!have_seqwriter && args->finalize_hook && args->finalize_hook(args)) {
@@ -414,9 +869,9 @@ gboolean end_generic_sequence(gpointer p) {
 
 /* If for_writer is false, it computes how many images can be processed in
  * parallel, with regard to how many of them can fit in memory. It returns at
- * most com.max_thread.
+ * most the threads of the processing, com.max_thread or those of its task.
  * If for_writer is true, it computes how many images can be stored in the
- * queue. It returns at most 3 times com.max_thread.
+ * queue. It returns at most 3 times the threads of the processing.
  */
 int seq_compute_mem_limits(struct generic_seq_args *args, gboolean for_writer) {
 	unsigned int MB_per_image, MB_avail;
@@ -434,11 +889,12 @@ int seq_compute_mem_limits(struct generic_seq_args *args, gboolean for_writer) {
 	} else {
 #ifdef _OPENMP
 		/* number of threads for the main computation */
-		if (limit > com.max_thread)
-			limit = com.max_thread;
+		int max_thread = processing_task_max_thread();
+		if (limit > max_thread)
+			limit = max_thread;
 		if (for_writer) {
 			/* we take the remainder for the writer */
-			int max_queue_size = com.max_thread * 3;
+			int max_queue_size = max_thread * 3;
 			if (thread_limit - limit > max_queue_size)
 				limit = max_queue_size;
 			else limit = thread_limit - limit;
@@ -479,6 +935,9 @@ int seq_prepare_hook(struct generic_seq_args *args) {
 			args->new_ser = NULL;
 			retval = 1;
 		}
+		// the number of output frames is known, let the threads write them
+		else if (args->nb_filtered_images > 0)
+			ser_set_direct_write(args->new_ser, args->nb_filtered_images);
 		g_free(dest);
 	}
 	else if (args->force_fitseq_output || (args->seq->type == SEQ_FITSEQ && !args->force_ser_output)) {
@@ -522,7 +981,22 @@ int seq_prepare_writer(struct generic_seq_args *args) {
 		}
 		return 1;
 	}
+#ifdef _OPENMP
+	/* The estimates give how many images the threads and the queue can hold
+	 * together. Instead of splitting them with fixed counts, each image
+	 * reserves its share of the memory from the governor from the time it is
+	 * read until it is written, and the number of images in the queue is
+	 * only capped. Frames smaller than the estimate give back what they do
+	 * not use, so more images can be processed while the writer is busy. */
+	int nb_threads = max(args->max_parallel_images, 1);
+	guint MB_avail = (guint) max(get_max_memory_in_MB(), 1);
+	guint block_MB = max(1, MB_avail / (guint) (nb_threads + limit));
+	memory_governor_set_budget(MB_avail);
+	seqwriter_set_max_active_blocks(nb_threads + max(limit, processing_task_max_thread() * 3));
+	seqwriter_share_memory_budget(block_MB);
+#else
 	seqwriter_set_max_active_blocks(limit);
+#endif
 	return 0;
 }
 
@@ -592,7 +1066,10 @@ int generic_save(struct generic_seq_args *args, int out_index, int in_index, fit
 			char *dest = fit_sequence_get_image_filename_prefixed(args->seq,
 					args->new_seq_prefix, in_index);
 			fit->bitpix = fit->orig_bitpix;
+			gint64 start = g_get_monotonic_time();
 			int retval = savefits(dest, fit);
+			if (!retval)
+				io_stats_add_write(SEQ_REGULAR, io_stats_image_bytes(fit), g_get_monotonic_time() - start);
 			free(dest);
 			return retval;
 		}
@@ -738,6 +1215,9 @@ static gboolean thread_being_waited = FALSE;
 // This function is reentrant. The pointer will be freed in the idle function,
 // so it must be a proper pointer to an allocated memory chunk.
 void start_in_new_thread(gpointer (*f)(gpointer), gpointer p) {
+	/* the sequence processings of scripts may run as concurrent tasks */
+	if (script_scheduler_submit(f, p))
+		return;
 	g_mutex_lock(&com.mutex);
 
 	if (com.run_thread || com.thread) {
@@ -778,7 +1258,9 @@ gpointer waiting_for_thread() {
 	}
 	com.thread = NULL;
 	thread_being_waited = FALSE;
-	set_thread_run(FALSE);	// do it anyway in case of wait without stop
+	// do it anyway in case of wait without stop, the tasks still need it
+	if (!processing_tasks_running())
+		set_thread_run(FALSE);
 	return retval;
 }
 
@@ -796,11 +1278,15 @@ void stop_processing_thread() {
 static void set_thread_run(gboolean b) {
 	siril_debug_print("setting run %d to the processing thread\n", b);
 	g_mutex_lock(&com.mutex);
-	com.run_thread = b;
+	g_atomic_int_set(&com.run_thread, b);
 	g_mutex_unlock(&com.mutex);
 }
 
+/* the threads working for a processing task also stop when it is cancelled */
 gboolean get_thread_run() {
+	processing_task *task = processing_task_current();
+	if (task && processing_task_is_cancelled(task))
+		return FALSE;
 	gboolean retval;
 	g_mutex_lock(&com.mutex);
 	retval = com.run_thread;
@@ -888,12 +1374,13 @@ void kill_child_process(gboolean onexit) {
 }
 
 void on_processes_button_cancel_clicked(GtkButton *button, gpointer user_data) {
-	if (com.thread != NULL)
+	if (com.thread != NULL || processing_tasks_running())
 		siril_log_color_message(_("Process aborted by user\n"), "red");
 	if (com.child_is_running == EXT_GRAXPERT)
 		set_graxpert_aborted(TRUE);
 	kill_child_process(FALSE);
 	com.stop_script = TRUE;
+	processing_tasks_cancel_all();
 	stop_processing_thread();
 	wait_for_script_thread();
 	if (!com.headless)
@@ -989,7 +1476,7 @@ cleanup:
  */
 int check_threading(threading_type *threads) {
 	if (*threads == MULTI_THREADED)
-		*threads = com.max_thread;
+		*threads = processing_task_max_thread();
 	return *threads;
 }
 
@@ -997,7 +1484,7 @@ int check_threading(threading_type *threads) {
  * set size */
 int limit_threading(threading_type *threads, int min_iterations_per_thread, size_t total_iterations) {
 	if (*threads == MULTI_THREADED)
-		*threads = com.max_thread;
+		*threads = processing_task_max_thread();
 	int max_chunks = total_iterations / min_iterations_per_thread;
 	if (max_chunks < 1)
 		max_chunks = 1;
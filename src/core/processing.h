@@ -61,6 +61,15 @@ struct generic_seq_args {
 	gboolean regdata_for_partial;
 	/** flag to get photometry data */
 	gboolean get_photometry_data_for_partial;
+	/** in case of partial, computes the area to read for each image,
+	 *  replacing args->area and the registration data move. A non-zero
+	 *  return excludes the image */
+	int (*partial_area_hook)(struct generic_seq_args *, int, rectangle *);
+	/** in case of partial without output, the image structures and buffers
+	 *  are kept from a frame to the next in each thread and the progress is
+	 *  updated less often, for small per-frame work on long sequences. The
+	 *  image_hook must not keep or free the image */
+	gboolean partial_batch;
 
 	/** filtering the images from the sequence, maybe we don't want them all */
 	seq_image_filter filtering_criterion;
@@ -78,6 +87,12 @@ struct generic_seq_args {
 	int (*prepare_hook)(struct generic_seq_args *);
 	/** function called before reading an image to check that it needs to be loaded */
 	gboolean (*image_read_hook)(struct generic_seq_args *, int);
+	/** for full-frame processing, function giving the area of an image that
+	 *  the image_hook uses, for all layers. If it returns TRUE, only this
+	 *  area is read when the sequence and the area allow it, and the image
+	 *  passed to the image_hook is the area, given as its rectangle argument,
+	 *  which is empty when the whole image was read */
+	gboolean (*input_area_hook)(struct generic_seq_args *, int, rectangle *);
 	/** function called for each image with image index in sequence, number
 	 *  of image currently processed and the image, area if partial */
 	int (*image_hook)(struct generic_seq_args *, int, int, fits *, rectangle *, int);
@@ -180,6 +195,13 @@ gpointer waiting_for_thread();
 void stop_processing_thread();
 gboolean get_thread_run();
 
+/* Lock-free version of get_thread_run(), cheap enough to be called in the inner
+ * loops of the long computations, per row or per iteration, so that a stop
+ * request ends them quickly. It reads the same flag as get_thread_run() */
+static inline gboolean processing_cancelled(void) {
+	return !g_atomic_int_get(&com.run_thread);
+}
+
 void start_in_reserved_thread(gpointer (*f)(gpointer), gpointer p);
 gboolean reserve_thread();
 void unreserve_thread();
@@ -0,0 +1,314 @@
+/*
+ * This file is part of Siril, an astronomy image processor.
+ * Copyright (C) 2005-2011 Francois Meyer (dulle at free.fr)
+ * Copyright (C) 2012-2025 team free-astro (see more in AUTHORS file)
+ * Reference site is https://siril.org
+ *
+ * Siril is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Siril is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Siril. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Processing tasks run several generic sequence processings at the same time,
+ * up to the core.max_tasks setting, outside of the processing thread. Each
+ * task has its own arguments, cancellation flag and progress, and the threads
+ * working for it are attached to it, so that get_thread_run(), the thread and
+ * memory limits and the progress bar apply to the task of the calling thread.
+ * The tasks run in a shared thread pool and the threads and memory of the
+ * machine are split evenly between them: the memory available is evaluated
+ * when the first task starts, the tasks started later would otherwise see it
+ * reduced by the ones already running.
+ *
+ * The threads of the parallel regions nested in the processing of a frame are
+ * not attached by the sequence worker. Inside OpenMP, a thread that is not
+ * attached is taken as working for the running task when there is only one,
+ * and it gets the share of a task otherwise, which is the same for all tasks.
+ * The tasks are only cancelled all together, with com.run_thread, which these
+ * threads also check. The threads of OpenMP are kept by its runtime between
+ * parallel regions, their attachment is dropped when its task is done.
+ *
+ * com.run_thread stays set while tasks are running, for the threads that are
+ * not attached to a task, so a processing cannot be started in the processing
+ * thread at the same time. Only the processings that do not use the sequence
+ * writer, the loaded sequence or a non-reentrant cfitsio can run as tasks.
+ * Their log messages are written in the order the tasks were started. */
+
+#include <string.h>
+#include <glib.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "core/siril.h"
+#include "core/proto.h"
+#include "core/siril_log.h"
+#include "core/OS_utils.h"
+#include "io/sequence.h"
+
+#include "processing_tasks.h"
+
+struct processing_task {
+	gint refcount;
+	guint id;
+	struct generic_seq_args *args;	// owned by the task while it runs
+	gint cancelled;
+	gboolean done;
+	int retval;
+	double progress;
+	int nb_threads, memory_MB;	// share of the machine
+};
+
+static void unref_notify(gpointer p) {
+	if (p)
+		processing_task_unref((processing_task *) p);
+}
+
+static GPrivate current_task = G_PRIVATE_INIT(unref_notify);
+
+static GMutex tasks_mutex;
+static GCond tasks_cond;
+static GThreadPool *pool = NULL;
+static GList *running = NULL;	// tasks not done, in the order they were started
+static gint nb_running = 0;	// length of running, read without the lock
+static guint last_id = 0;
+static int budget_MB = 0;	// memory shared by the running tasks
+
+gboolean processing_task_can_run(const struct generic_seq_args *args) {
+	if (com.pref.max_tasks < 2 || !args->seq || args->seq == &com.seq)
+		return FALSE;
+	/* the sequence writer is shared by all processings */
+	if (args->has_output && (args->force_ser_output || args->force_fitseq_output ||
+				args->seq->type == SEQ_SER || args->seq->type == SEQ_FITSEQ))
+		return FALSE;
+	return args->seq->type == SEQ_SER || (args->seq->type == SEQ_REGULAR && fits_is_reentrant());
+}
+
+processing_task *processing_task_ref(processing_task *task) {
+	g_atomic_int_inc(&task->refcount);
+	return task;
+}
+
+void processing_task_unref(processing_task *task) {
+	if (task && g_atomic_int_dec_and_test(&task->refcount))
+		g_free(task);
+}
+
+static void task_run(gpointer data, gpointer user_data) {
+	processing_task *task = (processing_task *) data;
+	struct generic_seq_args *args = task->args;
+	processing_task_attach(task);
+	int retval = GPOINTER_TO_INT(generic_sequence_worker(args));
+	processing_task_attach(NULL);
+	/* the clean-up of the scripts, the idle functions are not run */
+	free(args->new_seq_prefix);
+	free_sequence(args->seq, TRUE);
+	free(args);
+	siril_log_close_segment(task->id);
+
+	g_mutex_lock(&tasks_mutex);
+	task->args = NULL;
+	task->retval = retval;
+	g_atomic_int_set(&task->done, TRUE);	// read without the lock by processing_task_current()
+	running = g_list_remove(running, task);
+	g_atomic_int_add(&nb_running, -1);
+	if (!running) {
+		budget_MB = 0;
+		g_mutex_lock(&com.mutex);
+		g_atomic_int_set(&com.run_thread, FALSE);
+		g_mutex_unlock(&com.mutex);
+	}
+	g_cond_broadcast(&tasks_cond);
+	g_mutex_unlock(&tasks_mutex);
+	siril_debug_print("processing task %u: done (%d)\n", task->id, retval);
+	processing_task_unref(task);	// the reference of the pool
+}
+
+processing_task *processing_task_start(struct generic_seq_args *args) {
+	int max_tasks = max(com.pref.max_tasks, 1);
+	g_mutex_lock(&tasks_mutex);
+	if (!running) {
+		g_mutex_lock(&com.mutex);
+		if (com.run_thread || com.thread) {
+			fprintf(stderr, "The processing thread is busy, stop it first.\n");
+			g_mutex_unlock(&com.mutex);
+			g_mutex_unlock(&tasks_mutex);
+			return NULL;
+		}
+		g_atomic_int_set(&com.run_thread, TRUE);
+		g_mutex_unlock(&com.mutex);
+		budget_MB = get_max_memory_in_MB();
+	}
+	if (!pool)
+		pool = g_thread_pool_new(task_run, NULL, max_tasks, FALSE, NULL);
+	else g_thread_pool_set_max_threads(pool, max_tasks, NULL);
+
+	processing_task *task = g_new0(processing_task, 1);
+	task->refcount = 2;	// the caller and the pool
+	task->id = ++last_id;
+	task->args = args;
+	task->nb_threads = max(com.max_thread / max_tasks, 1);
+	task->memory_MB = max(budget_MB / max_tasks, 1);
+	args->already_in_a_thread = TRUE;
+	running = g_list_append(running, task);
+	g_atomic_int_inc(&nb_running);
+	g_mutex_unlock(&tasks_mutex);
+
+	siril_debug_print("processing task %u: %s, %d threads and %d MB\n", task->id,
+			args->description ? args->description : "sequence processing",
+			task->nb_threads, task->memory_MB);
+	siril_log_open_segment(task->id);
+	g_thread_pool_push(pool, task, NULL);
+	return task;
+}
+
+int processing_task_wait(processing_task *task) {
+	g_mutex_lock(&tasks_mutex);
+	while (!task->done)
+		g_cond_wait(&tasks_cond, &tasks_mutex);
+	int retval = task->retval;
+	g_mutex_unlock(&tasks_mutex);
+	return retval;
+}
+
+gboolean processing_task_is_done(processing_task *task) {
+	g_mutex_lock(&tasks_mutex);
+	gboolean retval = task->done;
+	g_mutex_unlock(&tasks_mutex);
+	return retval;
+}
+
+void processing_task_cancel(processing_task *task) {
+	g_atomic_int_set(&task->cancelled, TRUE);
+}
+
+gboolean processing_task_is_cancelled(processing_task *task) {
+	return g_atomic_int_get(&task->cancelled);
+}
+
+guint processing_task_get_id(processing_task *task) {
+	return task->id;
+}
+
+double processing_task_get_progress(processing_task *task) {
+	g_mutex_lock(&tasks_mutex);
+	double retval = task->done ? 1.0 : task->progress;
+	g_mutex_unlock(&tasks_mutex);
+	return retval;
+}
+
+gboolean processing_tasks_running() {
+	g_mutex_lock(&tasks_mutex);
+	gboolean retval = running != NULL;
+	g_mutex_unlock(&tasks_mutex);
+	return retval;
+}
+
+void processing_tasks_wait_all() {
+	g_mutex_lock(&tasks_mutex);
+	while (running)
+		g_cond_wait(&tasks_cond, &tasks_mutex);
+	g_mutex_unlock(&tasks_mutex);
+}
+
+/* the threads that are not attached to a task are stopped too */
+void processing_tasks_cancel_all() {
+	g_mutex_lock(&tasks_mutex);
+	if (running) {
+		for (GList *l = running; l; l = l->next)
+			processing_task_cancel((processing_task *) l->data);
+		g_mutex_lock(&com.mutex);
+		g_atomic_int_set(&com.run_thread, FALSE);
+		g_mutex_unlock(&com.mutex);
+	}
+	g_mutex_unlock(&tasks_mutex);
+}
+
+/* the running task if there is only one, for the threads of OpenMP that are
+ * not attached, the first running task in any case with any_task */
+static processing_task *get_unattached_task(gboolean any_task) {
+#ifdef _OPENMP
+	int nb = g_atomic_int_get(&nb_running);
+	if (!nb || (nb > 1 && !any_task) || omp_get_level() == 0)
+		return NULL;
+	processing_task *task = NULL;
+	g_mutex_lock(&tasks_mutex);
+	if (running && (any_task || !running->next))
+		task = processing_task_ref((processing_task *) running->data);
+	g_mutex_unlock(&tasks_mutex);
+	return task;
+#else
+	return NULL;
+#endif
+}
+
+static processing_task *get_attached_task() {
+	processing_task *task = (processing_task *) g_private_get(&current_task);
+	if (task && g_atomic_int_get(&task->done)) {
+		/* a thread of OpenMP still attached to a previous task */
+		g_private_replace(&current_task, NULL);
+		task = NULL;
+	}
+	return task;
+}
+
+processing_task *processing_task_current() {
+	processing_task *task = get_attached_task();
+	if (!task && (task = get_unattached_task(FALSE)))
+		g_private_replace(&current_task, task);	// the thread takes the reference
+	return task;
+}
+
+/* the thread keeps a reference, the threads of OpenMP are not stopped at the
+ * end of the task and it may still be attached when they are reused */
+void processing_task_attach(processing_task *task) {
+	if (g_private_get(&current_task) == task)
+		return;
+	g_private_replace(&current_task, task ? processing_task_ref(task) : NULL);
+}
+
+int processing_task_max_thread() {
+	processing_task *task = processing_task_current();
+	if (task)
+		return task->nb_threads;
+	if ((task = get_unattached_task(TRUE))) {
+		int retval = task->nb_threads;
+		processing_task_unref(task);
+		return retval;
+	}
+	return com.max_thread;
+}
+
+int processing_task_max_memory_in_MB() {
+	processing_task *task = processing_task_current();
+	if (task)
+		return task->memory_MB;
+	if ((task = get_unattached_task(TRUE))) {
+		int retval = task->memory_MB;
+		processing_task_unref(task);
+		return retval;
+	}
+	return 0;
+}
+
+double processing_task_report_progress(double percent) {
+	processing_task *task = processing_task_current();
+	if (!task || percent < 0.0)
+		return percent;
+	g_mutex_lock(&tasks_mutex);
+	task->progress = percent;
+	double sum = 0.0;
+	int nb = 0;
+	for (GList *l = running; l; l = l->next, nb++)
+		sum += ((processing_task *) l->data)->progress;
+	g_mutex_unlock(&tasks_mutex);
+	return nb ? sum / nb : percent;
+}
@@ -0,0 +1,46 @@
+#ifndef SRC_CORE_PROCESSING_TASKS_H_
+#define SRC_CORE_PROCESSING_TASKS_H_
+
+#include "core/processing.h"
+
+typedef struct processing_task processing_task;
+
+/* TRUE if the sequence processing of args can run as a task, concurrently with
+ * other tasks */
+gboolean processing_task_can_run(const struct generic_seq_args *args);
+
+/* runs generic_sequence_worker(args) as a task. The task owns args and frees
+ * them with their sequence at the end, like a script does. The returned task
+ * must be released with processing_task_unref(), NULL is returned if it could
+ * not be started, args being then still owned by the caller */
+processing_task *processing_task_start(struct generic_seq_args *args);
+
+processing_task *processing_task_ref(processing_task *task);
+void processing_task_unref(processing_task *task);
+
+/* waits for the end of the task and returns the retval of its processing */
+int processing_task_wait(processing_task *task);
+gboolean processing_task_is_done(processing_task *task);
+void processing_task_cancel(processing_task *task);
+gboolean processing_task_is_cancelled(processing_task *task);
+guint processing_task_get_id(processing_task *task);
+double processing_task_get_progress(processing_task *task);
+
+gboolean processing_tasks_running();
+void processing_tasks_wait_all();
+void processing_tasks_cancel_all();
+
+/* the task the calling thread works for, NULL if none */
+processing_task *processing_task_current();
+/* makes the calling thread work for task, NULL to detach it */
+void processing_task_attach(processing_task *task);
+
+/* the resources of the current task, com.max_thread and 0 without task */
+int processing_task_max_thread();
+int processing_task_max_memory_in_MB();
+
+/* records the progress of the current task and returns the progress to
+ * display, combined for all running tasks */
+double processing_task_report_progress(double percent);
+
+#endif /* SRC_CORE_PROCESSING_TASKS_H_ */
@@ -57,17 +57,19 @@ int readxisf(const char *name, fits *fit, gboolean force_float);
 
 #ifdef HAVE_LIBJPEG
 int readjpg(const char*, fits*);
-int savejpg(const char*, fits*, int quality, gboolean verbose);
+int savejpg(const char*, fits*, int quality, gboolean verbose, int threads);
 #endif
 
 #ifdef HAVE_LIBPNG
 int readpng(const char*, fits*);
 int savepng(const char *filename, fits *fit, uint32_t bytes_per_sample,
-		gboolean is_colour);
+		gboolean is_colour, int threads);
 #endif
 
 #ifdef HAVE_LIBRAW
 int open_raw_files(const char*, fits*, gboolean);
+/* reads the CFA data without log, only the size and metadata with header_only */
+int open_raw_file_silent(const char *name, fits *fit, gboolean header_only);
 #endif
 
 #ifdef HAVE_LIBHEIF
@@ -77,7 +79,7 @@ int saveheifavif(const char* name, fits *fit, int quality, gboolean lossless, gb
 
 #ifdef HAVE_LIBJXL
 int readjxl(const char* name, fits *fit);
-int savejxl(const char* name, fits* fit, int effort, double quality, gboolean force_8bit);
+int savejxl(const char* name, fits* fit, int effort, double quality, gboolean force_8bit, int threads);
 #endif
 /****************** utils.h ******************/
 int round_to_int(double x);
@@ -193,6 +195,12 @@ int siril_fits_img_stats_float(float *array, long nx, long ny, int nullcheck,
 		double *mean, double *sigma, double *noise1, double *noise2,
 		double *noise3, double *noise5, threading_type threads, int *status);
 
+int siril_fits_img_noise1_ushort(WORD *array, long nx, long ny, long row_step,
+		int nullcheck, WORD nullvalue, double *noise1, threading_type threads, int *status);
+
+int siril_fits_img_noise1_float(float *array, long nx, long ny, long row_step,
+		int nullcheck, float nullvalue, double *noise1, threading_type threads, int *status);
+
 /****************** siril.h ******************/
 
 int threshlo(fits *fit, WORD level);
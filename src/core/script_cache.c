@@ -0,0 +1,327 @@
+/*
+ * This file is part of Siril, an astronomy image processor.
+ * Copyright (C) 2005-2011 Francois Meyer (dulle at free.fr)
+ * Copyright (C) 2012-2025 team free-astro (see more in AUTHORS file)
+ * Reference site is https://siril.org
+ *
+ * Siril is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Siril is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Siril. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Opt-in memoisation of the sequence commands of scripts, enabled with the
+ * core.script_cache setting. A command is identified by its words and by the
+ * values of the settings that are not for the GUI. Its inputs are the files
+ * named by its arguments, with the frames of the sequences, and its outputs
+ * are the files of the working directory that it created or modified. The
+ * command is skipped when it is run again while its inputs and outputs are
+ * still in the state recorded in its manifest, in the .siril_cache directory
+ * of the working directory. File states are their size and modification time.
+ */
+
+#include <string.h>
+#include <glib/gstdio.h>
+
+#include "core/siril.h"
+#include "core/proto.h"
+#include "core/command.h"
+#include "core/OS_utils.h"
+#include "core/settings.h"
+#include "core/siril_log.h"
+#include "io/sequence.h"
+#include "script_cache.h"
+
+#define CACHE_DIR ".siril_cache"
+
+static const char *cacheable_commands[] = {
+	"calibrate", "register", "seqapplyreg", "seqsubsky", "stack",
+	"seqcosme", "seqcosme_cfa", "seqcrop", "seqresample", "seqfixbanding",
+	"seqextract_Green", "seqextract_Ha", "seqextract_HaOIII", "seqsplit_cfa"
+};
+
+struct script_cache_entry {
+	gchar *manifest;
+	gchar **words;	// of the command, it may end after the next ones start
+	GHashTable *before;	// state of the files of the working directory
+	GHashTable *inputs;	// current state of the inputs
+	GHashTable *recorded_inputs, *recorded_outputs;	// from the manifest
+};
+
+/* the modification time is in nanoseconds, to see the files rewritten in the
+ * same second, see get_file_state() */
+static gchar *file_state(const gchar *path) {
+	gint64 mtime, size;
+	if (!g_file_test(path, G_FILE_TEST_IS_REGULAR) || get_file_state(path, &mtime, &size))
+		return NULL;
+	return g_strdup_printf("%" G_GINT64_FORMAT ":%" G_GINT64_FORMAT, size, mtime);
+}
+
+/* Images are often given without their extension in scripts, like the masters
+ * of the calibrate options. Such names are resolved like the commands do, with
+ * the FITS extension of the preferences first and the supported extensions
+ * after. Returns NULL if no file is found. */
+static gchar *resolve_file(const gchar *path) {
+	if (g_file_test(path, G_FILE_TEST_IS_REGULAR))
+		return g_strdup(path);
+	if (get_filename_ext(path))
+		return NULL;
+	gchar *name = g_strdup_printf("%s%s", path, com.pref.ext);
+	if (g_file_test(name, G_FILE_TEST_IS_REGULAR))
+		return name;
+	g_free(name);
+	name = g_strdup_printf("%s%s.fz", path, com.pref.ext);
+	if (g_file_test(name, G_FILE_TEST_IS_REGULAR))
+		return name;
+	g_free(name);
+	image_type type;
+	char *realname = NULL;
+	if (stat_file(path, &type, &realname))
+		return NULL;
+	name = g_strdup(realname);
+	free(realname);
+	return name;
+}
+
+static GHashTable *new_state_table() {
+	return g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+}
+
+static GHashTable *list_working_directory() {
+	GHashTable *files = new_state_table();
+	GDir *dir = g_dir_open(com.wd, 0, NULL);
+	if (!dir)
+		return files;
+	const gchar *name;
+	while ((name = g_dir_read_name(dir))) {
+		gchar *state = file_state(name);
+		if (state)
+			g_hash_table_insert(files, g_strdup(name), state);
+	}
+	g_dir_close(dir);
+	return files;
+}
+
+static void add_input(GHashTable *inputs, const gchar *path) {
+	gchar *name = resolve_file(path);
+	if (!name)
+		return;
+	gchar *state = file_state(name);
+	if (state)
+		g_hash_table_insert(inputs, name, state);
+	else g_free(name);
+}
+
+/* an argument is an input if it names a file or a sequence, for options
+ * the value after = is checked. The frames of a sequence of the working
+ * directory are the files that start with its name */
+static void add_inputs_of_argument(GHashTable *inputs, GHashTable *wd_files, const gchar *arg) {
+	const gchar *value = arg;
+	if (arg[0] == '-') {
+		value = strchr(arg, '=');
+		if (!value)
+			return;
+		value++;
+	}
+	if (value[0] == '\0')
+		return;
+	if (!strcmp(value, ".") && sequence_is_loaded())
+		value = com.seq.seqname;
+	add_input(inputs, value);
+
+	gchar *seqfiles[3] = { NULL };
+	if (g_str_has_suffix(value, ".seq"))
+		seqfiles[0] = g_strdup(value);
+	else {
+		seqfiles[0] = g_strdup_printf("%s.seq", value);
+		seqfiles[1] = g_strdup_printf("%s_.seq", value);
+	}
+	for (int i = 0; i < 2 && seqfiles[i]; i++) {
+		if (!g_file_test(seqfiles[i], G_FILE_TEST_IS_REGULAR))
+			continue;
+		add_input(inputs, seqfiles[i]);
+		gchar *dir = g_path_get_dirname(seqfiles[i]);
+		if (!strcmp(dir, ".")) {
+			gchar *base = g_strndup(seqfiles[i], strlen(seqfiles[i]) - 4);
+			GHashTableIter iter;
+			gpointer name, state;
+			g_hash_table_iter_init(&iter, wd_files);
+			while (g_hash_table_iter_next(&iter, &name, &state))
+				if (g_str_has_prefix(name, base))
+					g_hash_table_insert(inputs, g_strdup(name), g_strdup(state));
+			g_free(base);
+		}
+		g_free(dir);
+	}
+	g_free(seqfiles[0]);
+	g_free(seqfiles[1]);
+}
+
+static gchar *compute_key(int wordnb) {
+	GChecksum *checksum = g_checksum_new(G_CHECKSUM_SHA256);
+	for (int i = 0; i < wordnb; i++)
+		g_checksum_update(checksum, (const guchar *) word[i], strlen(word[i]) + 1);
+	GString *settings = g_string_sized_new(4096);
+	append_settings_values(settings, FALSE);
+	g_checksum_update(checksum, (const guchar *) settings->str, settings->len);
+	g_string_free(settings, TRUE);
+	gchar *key = g_strdup(g_checksum_get_string(checksum));
+	g_checksum_free(checksum);
+	return key;
+}
+
+/* manifest lines are "input <state> <name>" or "output <state> <name>" */
+static void read_manifest(struct script_cache_entry *entry) {
+	gchar *contents = NULL;
+	if (!g_file_get_contents(entry->manifest, &contents, NULL, NULL))
+		return;
+	entry->recorded_inputs = new_state_table();
+	entry->recorded_outputs = new_state_table();
+	gchar **lines = g_strsplit(contents, "\n", -1);
+	for (int i = 0; lines[i]; i++) {
+		gchar **fields = g_strsplit(lines[i], " ", 3);
+		if (g_strv_length(fields) == 3) {
+			if (!strcmp(fields[0], "input"))
+				g_hash_table_insert(entry->recorded_inputs, g_strdup(fields[2]), g_strdup(fields[1]));
+			else if (!strcmp(fields[0], "output"))
+				g_hash_table_insert(entry->recorded_outputs, g_strdup(fields[2]), g_strdup(fields[1]));
+		}
+		g_strfreev(fields);
+	}
+	g_strfreev(lines);
+	g_free(contents);
+}
+
+/* returns NULL if caching is disabled or if the command is not cached */
+struct script_cache_entry *script_cache_begin(int wordnb) {
+	if (!com.pref.script_cache || !com.script || wordnb < 2)
+		return NULL;
+	gboolean cacheable = FALSE;
+	for (int i = 0; i < G_N_ELEMENTS(cacheable_commands); i++)
+		if (!g_ascii_strcasecmp(word[0], cacheable_commands[i]))
+			cacheable = TRUE;
+	if (!cacheable)
+		return NULL;
+
+	struct script_cache_entry *entry = calloc(1, sizeof(struct script_cache_entry));
+	gchar *key = compute_key(wordnb);
+	gchar *name = g_strdup_printf("%s.manifest", key);
+	entry->manifest = g_build_filename(com.wd, CACHE_DIR, name, NULL);
+	g_free(name);
+	g_free(key);
+
+	entry->words = g_new0(gchar *, wordnb + 1);
+	for (int i = 0; i < wordnb; i++)
+		entry->words[i] = g_strdup(word[i]);
+	entry->before = list_working_directory();
+	entry->inputs = new_state_table();
+	for (int i = 1; i < wordnb; i++)
+		add_inputs_of_argument(entry->inputs, entry->before, word[i]);
+	read_manifest(entry);
+	return entry;
+}
+
+static gboolean state_is_recorded(const struct script_cache_entry *entry, const gchar *name, const gchar *state) {
+	const gchar *input = g_hash_table_lookup(entry->recorded_inputs, name);
+	const gchar *output = g_hash_table_lookup(entry->recorded_outputs, name);
+	return (input && !strcmp(input, state)) || (output && !strcmp(output, state));
+}
+
+/* Inputs modified by the command, like a sequence file getting registration
+ * data, are found in the state of its outputs */
+gboolean script_cache_is_up_to_date(const struct script_cache_entry *entry) {
+	if (!entry || !entry->recorded_inputs || g_hash_table_size(entry->recorded_outputs) == 0)
+		return FALSE;
+	GHashTableIter iter;
+	gpointer name, state;
+	g_hash_table_iter_init(&iter, entry->inputs);
+	while (g_hash_table_iter_next(&iter, &name, &state))
+		if (!state_is_recorded(entry, name, state))
+			return FALSE;
+	g_hash_table_iter_init(&iter, entry->recorded_inputs);
+	while (g_hash_table_iter_next(&iter, &name, &state))
+		if (!g_hash_table_contains(entry->inputs, name))
+			return FALSE;
+	g_hash_table_iter_init(&iter, entry->recorded_outputs);
+	while (g_hash_table_iter_next(&iter, &name, &state)) {
+		gchar *current = file_state(name);
+		gboolean same = current && !strcmp(current, state);
+		g_free(current);
+		if (!same)
+			return FALSE;
+	}
+	return TRUE;
+}
+
+static void write_manifest(struct script_cache_entry *entry) {
+	GString *str = g_string_sized_new(4096);
+	GHashTableIter iter;
+	gpointer name, state;
+	g_hash_table_iter_init(&iter, entry->inputs);
+	while (g_hash_table_iter_next(&iter, &name, &state))
+		g_string_append_printf(str, "input %s %s\n", (gchar *) state, (gchar *) name);
+
+	/* outputs are the new or modified files and the files named by options */
+	GHashTable *after = list_working_directory();
+	int nb_outputs = 0;
+	g_hash_table_iter_init(&iter, after);
+	while (g_hash_table_iter_next(&iter, &name, &state)) {
+		const gchar *previous = g_hash_table_lookup(entry->before, name);
+		if (!previous || strcmp(previous, state)) {
+			g_string_append_printf(str, "output %s %s\n", (gchar *) state, (gchar *) name);
+			nb_outputs++;
+		}
+	}
+	g_hash_table_destroy(after);
+	for (int i = 1; entry->words[i]; i++) {
+		const gchar *value = entry->words[i][0] == '-' ? strchr(entry->words[i], '=') : NULL;
+		gchar *file = value ? resolve_file(value + 1) : NULL;
+		if (!file)
+			continue;
+		gchar *current = NULL;
+		if (!g_hash_table_contains(entry->inputs, file) && !g_hash_table_contains(entry->before, file)
+				&& (current = file_state(file))) {
+			g_string_append_printf(str, "output %s %s\n", current, file);
+			nb_outputs++;
+		}
+		g_free(current);
+		g_free(file);
+	}
+
+	if (nb_outputs > 0) {
+		gchar *dir = g_path_get_dirname(entry->manifest);
+		GError *error = NULL;
+		if (g_mkdir_with_parents(dir, 0755) ||
+				!g_file_set_contents(entry->manifest, str->str, str->len, &error)) {
+			siril_debug_print("could not save the script cache manifest: %s\n", error ? error->message : dir);
+			g_clear_error(&error);
+		}
+		g_free(dir);
+	}
+	g_string_free(str, TRUE);
+}
+
+/* records the manifest of a command that succeeded and frees the entry */
+void script_cache_end(struct script_cache_entry *entry, gboolean succeeded) {
+	if (!entry)
+		return;
+	if (succeeded)
+		write_manifest(entry);
+	g_free(entry->manifest);
+	g_strfreev(entry->words);
+	g_hash_table_destroy(entry->before);
+	g_hash_table_destroy(entry->inputs);
+	if (entry->recorded_inputs) {
+		g_hash_table_destroy(entry->recorded_inputs);
+		g_hash_table_destroy(entry->recorded_outputs);
+	}
+	free(entry);
+}
@@ -0,0 +1,12 @@
+#ifndef SRC_CORE_SCRIPT_CACHE_H_
+#define SRC_CORE_SCRIPT_CACHE_H_
+
+#include <glib.h>
+
+struct script_cache_entry;
+
+struct script_cache_entry *script_cache_begin(int wordnb);
+gboolean script_cache_is_up_to_date(const struct script_cache_entry *entry);
+void script_cache_end(struct script_cache_entry *entry, gboolean succeeded);
+
+#endif /* SRC_CORE_SCRIPT_CACHE_H_ */
@@ -0,0 +1,274 @@
+/*
+ * This file is part of Siril, an astronomy image processor.
+ * Copyright (C) 2005-2011 Francois Meyer (dulle at free.fr)
+ * Copyright (C) 2012-2025 team free-astro (see more in AUTHORS file)
+ * Reference site is https://siril.org
+ *
+ * Siril is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Siril is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Siril. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* When the core.max_tasks setting is more than 1, the sequence commands of
+ * scripts that only read their input sequence and write a new one are run as
+ * processing tasks, see processing_tasks.c, and the script continues with the
+ * next command without waiting for them. A command waits for the tasks it
+ * depends on, found from the sequence names: the names given in its
+ * arguments, its inputs, and the names of the sequences it creates, which are
+ * its input sequence with a prefix, compared with the inputs and outputs of
+ * the running tasks. The other commands, which may use the loaded image, the
+ * working directory or any file, wait for all the tasks.
+ * The threads and memory are shared by the tasks, and the log messages of the
+ * tasks are written in the order of the script. A task that fails stops the
+ * script at the next command, the commands started before it are completed.
+ */
+
+#include <string.h>
+#include <glib.h>
+
+#include "core/siril.h"
+#include "core/proto.h"
+#include "core/command.h"
+#include "core/processing_tasks.h"
+#include "core/siril_log.h"
+#include "core/trace.h"
+
+#include "script_scheduler.h"
+
+/* the commands that start a sequence processing from their arguments only */
+static const char *task_commands[] = {
+	"calibrate", "seqcosme", "seqcosme_cfa", "seqcrop", "seqresample",
+	"seqfixbanding", "seqsubsky", "seqextract_Green", "seqextract_Ha",
+	"seqextract_HaOIII", "seqsplit_cfa"
+};
+
+struct seq_name {
+	gchar *name;	// base name, without .seq and the trailing _
+	gboolean derived;	// stands for all the names ending with it, made with a prefix
+};
+
+struct scheduled_command {
+	processing_task *task;
+	GPtrArray *inputs, *outputs;
+	struct script_cache_entry *cache_entry;
+	gint64 span;
+	const char *command_name;
+	int line;
+	gchar *text;
+};
+
+enum completion { COMPLETE_ALL, COMPLETE_CONFLICTING };
+
+static GThread *script_thread = NULL;	// running the script, NULL if not scheduling
+static int depth = 0;	// of the scripts calling scripts
+static GQueue scheduled = G_QUEUE_INIT;	// submitted commands, in the order of the script
+static gboolean command_can_be_task = FALSE;	// for the command being run
+static GPtrArray *command_inputs = NULL, *command_outputs = NULL;
+static struct scheduled_command *submitted = NULL;	// by the command being run
+
+static void free_seq_name(gpointer p) {
+	struct seq_name *name = (struct seq_name *) p;
+	g_free(name->name);
+	g_free(name);
+}
+
+static GPtrArray *new_names() {
+	return g_ptr_array_new_with_free_func(free_seq_name);
+}
+
+/* returns FALSE for the values that cannot be sequence names, like numbers */
+static gboolean add_name(GPtrArray *names, const gchar *value, gboolean derived) {
+	gchar *end;
+	g_ascii_strtod(value, &end);
+	if (value[0] == '\0' || (end != value && *end == '\0'))
+		return FALSE;
+	gchar *name = g_path_get_basename(value);
+	size_t len = strlen(name);
+	if (g_str_has_suffix(name, ".seq"))
+		len -= 4;
+	while (len > 0 && name[len - 1] == '_')
+		len--;
+	name[len] = '\0';
+	if (len == 0 || !strcmp(name, ".")) {
+		g_free(name);
+		return FALSE;
+	}
+	struct seq_name *seq_name = g_new(struct seq_name, 1);
+	seq_name->name = name;
+	seq_name->derived = derived;
+	g_ptr_array_add(names, seq_name);
+	return TRUE;
+}
+
+static gboolean names_match(const struct seq_name *a, const struct seq_name *b) {
+	if (a->derived && g_str_has_suffix(b->name, a->name))
+		return TRUE;
+	if (b->derived && g_str_has_suffix(a->name, b->name))
+		return TRUE;
+	return !strcmp(a->name, b->name);
+}
+
+static gboolean any_name_matches(GPtrArray *a, GPtrArray *b) {
+	for (guint i = 0; i < a->len; i++)
+		for (guint j = 0; j < b->len; j++)
+			if (names_match(g_ptr_array_index(a, i), g_ptr_array_index(b, j)))
+				return TRUE;
+	return FALSE;
+}
+
+/* the inputs of both can be read at the same time */
+static gboolean depends_on(const struct scheduled_command *cmd, GPtrArray *inputs, GPtrArray *outputs) {
+	return any_name_matches(cmd->outputs, inputs) || any_name_matches(cmd->inputs, outputs) ||
+		any_name_matches(cmd->outputs, outputs);
+}
+
+static int complete_command(struct scheduled_command *cmd) {
+	int retval = processing_task_wait(cmd->task);
+	if (cmd->command_name)
+		trace_end(cmd->span, "command", cmd->command_name, cmd->line);
+	script_cache_end(cmd->cache_entry, !retval);
+	if (retval && cmd->text)
+		siril_log_message(_("Error in line %d ('%s'): the sequence processing failed.\n"),
+				cmd->line, cmd->text);
+	processing_task_unref(cmd->task);
+	g_ptr_array_unref(cmd->inputs);
+	g_ptr_array_unref(cmd->outputs);
+	g_free(cmd->text);
+	g_free(cmd);
+	return retval;
+}
+
+/* the tasks that are done are always completed, returns non-zero if one of
+ * the completed tasks failed */
+static int complete_commands(enum completion which) {
+	int retval = 0;
+	GList *l = scheduled.head;
+	while (l) {
+		GList *next = l->next;
+		struct scheduled_command *cmd = (struct scheduled_command *) l->data;
+		if (which == COMPLETE_ALL || processing_task_is_done(cmd->task) ||
+				depends_on(cmd, command_inputs, command_outputs)) {
+			g_queue_delete_link(&scheduled, l);
+			if (cmd == submitted)
+				submitted = NULL;
+			if (complete_command(cmd))
+				retval = 1;
+		}
+		l = next;
+	}
+	return retval;
+}
+
+static void clear_command() {
+	command_can_be_task = FALSE;
+	submitted = NULL;
+	g_clear_pointer(&command_inputs, g_ptr_array_unref);
+	g_clear_pointer(&command_outputs, g_ptr_array_unref);
+}
+
+void script_scheduler_begin() {
+	if (depth++ == 0 && com.pref.max_tasks > 1)
+		script_thread = g_thread_self();
+}
+
+/* waits for all the tasks, returns non-zero if one of them failed */
+int script_scheduler_end() {
+	if (depth == 0 || --depth > 0 || !script_thread)
+		return 0;
+	int retval = complete_commands(COMPLETE_ALL);
+	clear_command();
+	script_thread = NULL;
+	return retval;
+}
+
+/* Called before a command of the script is run, waits for the tasks it
+ * depends on. Returns non-zero if one of the tasks completed failed */
+int script_scheduler_prepare(int wordnb) {
+	if (!script_thread)
+		return 0;
+	clear_command();
+	command_inputs = new_names();
+	command_outputs = new_names();
+	for (int i = 0; i < G_N_ELEMENTS(task_commands); i++)
+		if (!g_ascii_strcasecmp(word[0], task_commands[i]))
+			command_can_be_task = TRUE;
+	if (!command_can_be_task)
+		return complete_commands(COMPLETE_ALL);
+
+	for (int i = 1; i < wordnb; i++) {
+		const gchar *value = word[i];
+		if (value[0] == '-') {
+			if (g_str_has_prefix(value, "-prefix="))
+				continue;
+			value = strchr(value, '=');
+			if (!value)
+				continue;
+			value++;
+		}
+		if (add_name(command_inputs, value, FALSE) && i == 1)
+			add_name(command_outputs, value, TRUE);
+	}
+	return complete_commands(COMPLETE_CONFLICTING);
+}
+
+/* Called by start_in_new_thread(): runs the processing as a task if it is
+ * started by a command of the script that can be a task, and returns TRUE.
+ * The other processings of the script wait for the tasks to end */
+gboolean script_scheduler_submit(gpointer (*f)(gpointer), gpointer p) {
+	if (!script_thread || g_thread_self() != script_thread)
+		return FALSE;
+	if (command_can_be_task && !submitted && f == generic_sequence_worker &&
+			processing_task_can_run((struct generic_seq_args *) p)) {
+		struct generic_seq_args *args = (struct generic_seq_args *) p;
+		GPtrArray *outputs = new_names();
+		if (args->has_output && args->new_seq_prefix && args->seq->seqname) {
+			gchar *output = g_strdup_printf("%s%s", args->new_seq_prefix, args->seq->seqname);
+			add_name(outputs, output, FALSE);
+			g_free(output);
+		}
+		processing_task *task = processing_task_start(args);
+		if (task) {
+			struct scheduled_command *cmd = g_new0(struct scheduled_command, 1);
+			cmd->task = task;
+			cmd->inputs = g_ptr_array_ref(command_inputs);
+			/* the outputs of multiple sequences are only known by their input */
+			if (outputs->len > 0)
+				cmd->outputs = outputs;
+			else {
+				g_ptr_array_unref(outputs);
+				cmd->outputs = g_ptr_array_ref(command_outputs);
+			}
+			g_queue_push_tail(&scheduled, cmd);
+			submitted = cmd;
+			return TRUE;
+		}
+		g_ptr_array_unref(outputs);
+	}
+	processing_tasks_wait_all();
+	return FALSE;
+}
+
+/* Called after a command of the script was run. If it started a task, the
+ * task takes the end of the command, completed when it is waited for, and
+ * TRUE is returned */
+gboolean script_scheduler_take_command(struct script_cache_entry *cache_entry,
+		gint64 span, const char *command_name, int line, const char *text) {
+	if (!submitted)
+		return FALSE;
+	submitted->cache_entry = cache_entry;
+	submitted->span = span;
+	submitted->command_name = command_name;
+	submitted->line = line;
+	submitted->text = g_strdup(text);
+	submitted = NULL;
+	return TRUE;
+}
@@ -0,0 +1,15 @@
+#ifndef SRC_CORE_SCRIPT_SCHEDULER_H_
+#define SRC_CORE_SCRIPT_SCHEDULER_H_
+
+#include <glib.h>
+#include "core/script_cache.h"
+
+void script_scheduler_begin();
+int script_scheduler_end();
+
+int script_scheduler_prepare(int wordnb);
+gboolean script_scheduler_submit(gpointer (*f)(gpointer), gpointer p);
+gboolean script_scheduler_take_command(struct script_cache_entry *cache_entry,
+		gint64 span, const char *command_name, int line, const char *text);
+
+#endif /* SRC_CORE_SCRIPT_SCHEDULER_H_ */
@@ -23,6 +23,8 @@
 #else
 #define SIRIL_UNSTABLE 1
 #endif
+#include <fftw3.h>
+
 #include "core/settings.h"
 #include "core/siril.h"
 #include "core/siril_log.h"
@@ -41,9 +43,18 @@ preferences pref_init = {
 	.mem_mode = RATIO,
 	.memory_ratio = 0.9,
 	.memory_amount = 10,
+	.frame_cache_amount = 0.0,
+	.master_cache = TRUE,
+	.use_opencl = FALSE,
+	.opencl_stacking = FALSE,
+	.stack_half_float = FALSE,
+	.video_hw_encoder = FALSE,
+	.simd = 0,
+	.max_tasks = 1,
 	.hd_bitdepth = 20,
 	.script_check_requires = TRUE,
 	.pipe_check_requires = FALSE,
+	.script_cache = FALSE,
  #ifdef SIRIL_UNSTABLE
 	.check_update = FALSE,
  #else
@@ -192,6 +203,7 @@ preferences pref_init = {
 		.keep_wcs_files = FALSE,
 		.max_seconds_run = 30,
 		.show_asnet_output = FALSE,
+		.max_asnet_processes = 0,
 		.default_obscode = NULL,
 	},
 	.analysis = {
@@ -213,12 +225,18 @@ preferences pref_init = {
 		.fits_quantization = 16.0,
 		.fits_hcompress_scale = 4.0,
 	},
+	.tuning = {
+		.stack_blocks_per_thread = 0,
+		.deconv_tile_size = 0,
+		.threads = 0,
+	},
 	.fftw_conf = {
 		.timelimit = 60,
 		.strategy = 0,
 		.multithreaded = TRUE,
 		.wisdom_file = NULL,
 		.fft_cutoff = 15,
+		.tiled = FALSE,
 	},
 	.max_slice_size = 32769,
 	.fits_save_icc = TRUE,
@@ -299,6 +317,26 @@ void set_wisdom_file() {
 		com.pref.fftw_conf.wisdom_file = g_build_filename(g_get_user_cache_dir(), "siril_fftw.wisdom", NULL);
 }
 
+/* The wisdom of FFTW is kept for the process, so importing it once makes the
+ * plans measured in previous sessions by any of the FFT users available to
+ * all of them. Returns TRUE if the siril or the system wisdom was imported */
+gboolean import_fftw_wisdom() {
+	static gboolean imported = FALSE;
+	set_wisdom_file();
+	if (imported)
+		return TRUE;
+	imported = fftwf_import_wisdom_from_filename(com.pref.fftw_conf.wisdom_file) == 1 ||
+		fftwf_import_system_wisdom() == 1;
+	return imported;
+}
+
+/* saves the wisdom with the plans made in this session */
+gboolean export_fftw_wisdom() {
+	if (!com.pref.fftw_conf.wisdom_file)
+		set_wisdom_file();
+	return fftwf_export_wisdom_to_filename(com.pref.fftw_conf.wisdom_file) == 1;
+}
+
 static void initialize_configurable_colors() {
 	com.pref.gui.config_colors.color_bkg_samples = g_strdup("rgba(255, 51, 26, 1.0)");
 	com.pref.gui.config_colors.color_std_annotations = g_strdup("rgba(128, 255, 77, 0.9)");
@@ -332,9 +370,18 @@ struct settings_access all_settings[] = {
 	{ "core", "mem_mode", STYPE_INT, N_("memory mode (0 ratio, 1 amount)"), &com.pref.mem_mode, { .range_int = { 0, 1 } } },
 	{ "core", "mem_ratio", STYPE_DOUBLE, N_("memory ratio of available"), &com.pref.memory_ratio, { .range_double = { 0.05, 4.0 } } },
 	{ "core", "mem_amount", STYPE_DOUBLE, N_("amount of memory in GB"), &com.pref.memory_amount, { .range_double = { 0.1, 1000000. } } },
+	{ "core", "frame_cache", STYPE_DOUBLE, N_("memory in GB for caching sequence frames, 0 to disable"), &com.pref.frame_cache_amount, { .range_double = { 0.0, 1000000. } } },
+	{ "core", "master_cache", STYPE_BOOL, N_("keep the master calibration frames in memory between runs"), &com.pref.master_cache },
+	{ "core", "opencl", STYPE_BOOL, N_("run image transformations on an OpenCL device when possible"), &com.pref.use_opencl },
+	{ "core", "opencl_stacking", STYPE_BOOL, N_("run the median and rejection stacking of 32-bit images on an OpenCL device when possible"), &com.pref.opencl_stacking },
+	{ "core", "stack_half_float", STYPE_BOOL, N_("store the stacking blocks of 32-bit images in half precision, halving their memory"), &com.pref.stack_half_float },
+	{ "core", "video_hw_encoder", STYPE_BOOL, N_("use a hardware video encoder (NVENC, VideoToolbox) for film exports when available"), &com.pref.video_hw_encoder },
+	{ "core", "simd", STYPE_INT, N_("instruction set of the kernels (0 best available, 1 baseline, 2 AVX2, 3 AVX-512, 4 SVE)"), &com.pref.simd, { .range_int = { 0, 4 } } },
+	{ "core", "max_tasks", STYPE_INT, N_("number of sequence processings that can run at the same time, sharing the threads and memory"), &com.pref.max_tasks, { .range_int = { 1, 16 } } },
 	{ "core", "hd_bitdepth", STYPE_INT, N_("HD AutoStretch bit depth"), &com.pref.hd_bitdepth, { .range_int = { 17, 24 } } },
 	{ "core", "script_check_requires", STYPE_BOOL, N_("need requires cmd in script"), &com.pref.script_check_requires },
 	{ "core", "pipe_check_requires", STYPE_BOOL, N_("need requires cmd in pipe"), &com.pref.pipe_check_requires },
+	{ "core", "script_cache", STYPE_BOOL, N_("skip the sequence commands of scripts whose outputs are up to date"), &com.pref.script_cache },
 	{ "core", "check_updates", STYPE_BOOL, N_("check update at start-up"), &com.pref.check_update },
 	{ "core", "lang", STYPE_STR, N_("active siril language"), &com.pref.lang },
 	{ "core", "swap_dir", STYPE_STRDIR, N_("swap directory"), &com.pref.swap_dir },
@@ -359,6 +406,7 @@ struct settings_access all_settings[] = {
 	{ "core", "fftw_conv_fft_cutoff", STYPE_INT, N_("Convolution minimum kernel size to use FFTW"), &com.pref.fftw_conf.fft_cutoff },
 	{ "core", "fftwf_strategy", STYPE_INT, N_("FFTW planning strategy"), &com.pref.fftw_conf.strategy },
 	{ "core", "fftw_multithreaded", STYPE_BOOL, N_("multithreaded FFTW"), &com.pref.fftw_conf.multithreaded },
+	{ "core", "fftw_tiled", STYPE_BOOL, N_("deconvolve in small tiles processed in parallel"), &com.pref.fftw_conf.tiled },
 	{ "core", "max_slice_size", STYPE_INT, N_("Maximum slice size for automated slice processing"), &com.pref.max_slice_size, { .range_int = { 512, 32769 } } },
 
 	{ "starfinder", "focal_length", STYPE_DOUBLE, N_("focal length in mm for radius adjustment"), &com.pref.starfinder_conf.focal_length, { .range_double = { 0., 999999. } } },
@@ -403,6 +451,7 @@ struct settings_access all_settings[] = {
 	{ "astrometry", "asnet_keep_xyls", STYPE_BOOL, N_("do not delete .xyls FITS tables"), &com.pref.astrometry.keep_xyls_files },
 	{ "astrometry", "asnet_keep_wcs", STYPE_BOOL, N_("do not delete .wcs result files"), &com.pref.astrometry.keep_wcs_files },
 	{ "astrometry", "asnet_show_output", STYPE_BOOL, N_("show solve-field output in main log"), &com.pref.astrometry.show_asnet_output },
+	{ "astrometry", "asnet_max_processes", STYPE_INT, N_("maximum concurrent solve-field runs in sequences, 0 for no limit"), &com.pref.astrometry.max_asnet_processes, { .range_int = { 0, 256 } } },
 
 	{ "astrometry", "sip_order", STYPE_INT, N_("degrees of the polynomial correction"), &com.pref.astrometry.sip_correction_order, { .range_int = { 1, 5 } } },
 	{ "astrometry", "radius", STYPE_DOUBLE, N_("radius around the target coordinates (degrees)"), &com.pref.astrometry.radius_degrees, { .range_double = { 0.01, 30.0 } } },
@@ -419,6 +468,10 @@ struct settings_access all_settings[] = {
 	{ "compression", "quantization", STYPE_DOUBLE, N_("quantization factor for 32-bit float"), &com.pref.comp.fits_quantization, { .range_double = { 8., 256. } }  },
 	{ "compression", "hcompress_scale", STYPE_DOUBLE, N_("Hcompress scale factor"), &com.pref.comp.fits_hcompress_scale, { .range_double = { 0., 256. } }  },
 
+	{ "tuning", "stack_blocks_per_thread", STYPE_INT, N_("blocks of median and mean stacking per thread, 0 for the default"), &com.pref.tuning.stack_blocks_per_thread, { .range_int = { 0, 64 } } },
+	{ "tuning", "deconv_tile_size", STYPE_INT, N_("size of the tiles of the tiled deconvolution, 0 for the default"), &com.pref.tuning.deconv_tile_size, { .range_int = { 0, 8192 } } },
+	{ "tuning", "threads", STYPE_INT, N_("number of threads the tuning was measured with"), &com.pref.tuning.threads, { .range_int = { 0, 4096 } } },
+
 	/* the GUI part, not as useful but still required to be listed in order to be saved in the ini file */
 	{ "gui_prepro", "cfa", STYPE_BOOL, N_("type of sensor for cosmetic correction"), &com.pref.prepro.cfa },
 	{ "gui_prepro", "equalize_cfa", STYPE_BOOL, N_("equalize flat channels"), &com.pref.prepro.equalize_cfa },
@@ -558,14 +611,7 @@ static const char *settings_type_to_string(enum settings_type type) {
 	}
 }
 
-int print_settings_key(const char *group, const char *key, gboolean with_details) {
-	struct settings_access *desc = get_key_settings(group, key);
-	if (!desc) {
-		siril_log_message(_("Unknown settings variable %s.%s\n"), group, key);
-		return 1;
-	}
-	GString *str = g_string_sized_new(120);
-	g_string_printf(str, "%s.%s = ", desc->group, desc->key);
+static void append_settings_value(GString *str, const struct settings_access *desc) {
 	GSList *list;
 	switch (desc->type) {
 		case STYPE_BOOL:
@@ -591,6 +637,30 @@ int print_settings_key(const char *group, const char *key, gboolean with_details
 			}
 			break;
 	}
+}
+
+/* appends one line group.key=value per setting, the groups of the GUI
+ * settings are skipped unless with_gui is set */
+void append_settings_values(GString *str, gboolean with_gui) {
+	int nb_settings = sizeof(all_settings) / sizeof(struct settings_access) - 1;
+	for (int i = 0; i < nb_settings; i++) {
+		if (!with_gui && g_str_has_prefix(all_settings[i].group, "gui"))
+			continue;
+		g_string_append_printf(str, "%s.%s=", all_settings[i].group, all_settings[i].key);
+		append_settings_value(str, all_settings + i);
+		g_string_append_c(str, '\n');
+	}
+}
+
+int print_settings_key(const char *group, const char *key, gboolean with_details) {
+	struct settings_access *desc = get_key_settings(group, key);
+	if (!desc) {
+		siril_log_message(_("Unknown settings variable %s.%s\n"), group, key);
+		return 1;
+	}
+	GString *str = g_string_sized_new(120);
+	g_string_printf(str, "%s.%s = ", desc->group, desc->key);
+	append_settings_value(str, desc);
 	if (with_details) {
 		if (desc->type == STYPE_INT && (desc->range_int.min != 0 || desc->range_int.max != 0))
 			g_string_append_printf(str, " [%d, %d]",
@@ -123,6 +123,7 @@ struct astrometry_config {
 	gboolean keep_xyls_files;	// do not delete .xyls FITS tables
 	gboolean keep_wcs_files;	// do not delete .wcs result files
 	gboolean show_asnet_output;	// show solve-field output in main log
+	int max_asnet_processes;	// maximum concurrent solve-field runs, 0 for no limit
 	gchar* default_obscode;	// default observatory code
 };
 
@@ -173,6 +174,13 @@ struct stack_config {
 	double percentile_low, percentile_high;
 };
 
+/* the machine profile measured by the autotune command, 0 for the heuristics */
+struct tuning_config {
+	int stack_blocks_per_thread;	// blocks of median and mean stacking per thread
+	int deconv_tile_size;		// size of the tiles of the tiled deconvolution
+	int threads;			// number of threads the profile was measured with
+};
+
 struct comp_config {
 	gboolean fits_enabled;
 	int fits_method;		// 0=Rice, 1=GZIP1, 2=GZIP2, 3=Hcompress
@@ -281,6 +289,7 @@ typedef struct fftw_params {
 	gboolean multithreaded;
 	gchar* wisdom_file;
 	int fft_cutoff;
+	gboolean tiled; // deconvolve small tiles in parallel instead of large slices
 } fftw_params;
 
 typedef enum {
@@ -370,11 +379,20 @@ struct pref_struct {
 	enum { RATIO, AMOUNT } mem_mode; // mode of memory management
 	double memory_ratio;		// ratio of available memory to use for stacking (and others)
 	double memory_amount;		// amount of memory in GB to use for stacking (and others)
+	double frame_cache_amount;	// amount of memory in GB for the frame cache of sequences, 0 to disable
+	gboolean master_cache;		// keep the master calibration frames in memory between runs
+	gboolean use_opencl;		// run the image transformations on an OpenCL device when possible
+	gboolean opencl_stacking;	// run the median and rejection stacking on an OpenCL device when possible
+	gboolean stack_half_float;	// store the stacking blocks of 32-bit images in half precision
+	gboolean video_hw_encoder;	// use a hardware video encoder for the film exports when available
+	int simd;			// instruction set of the kernels, 0 for the best available, else 1 + simd_level
+	int max_tasks;			// sequence processings that can run at the same time
 
 	int hd_bitdepth; // Default bit depth for HD AutoStretch
 
 	gboolean script_check_requires;	// check the requires command in scripts
 	gboolean pipe_check_requires;	// check the requires command in pipes
+	gboolean script_cache;		// skip the script commands whose outputs are up to date
 
 	gboolean check_update;	// check update at startup
 
@@ -405,6 +423,7 @@ struct pref_struct {
 	struct analysis_config analysis;
 	struct stack_config stack;
 	struct comp_config comp;
+	struct tuning_config tuning;
 	struct spcc_favourites spcc;
 	fftw_params fftw_conf;
 	int max_slice_size; // Used when processing img_t in slices to limit the wisdom required
@@ -454,10 +473,13 @@ struct settings_access *get_key_settings(const char *group, const char *key);
 
 int print_settings_key(const char *group, const char *key, gboolean with_details);
 int print_all_settings(gboolean with_details);
+void append_settings_values(GString *str, gboolean with_gui);
 
 void free_preferences(preferences *pref);	// TODO check if they're used
 void initialize_default_settings();
 void set_wisdom_file();
+gboolean import_fftw_wisdom();
+gboolean export_fftw_wisdom();
 
 void update_gain_from_gfit();
 
@@ -276,6 +276,9 @@ typedef enum {
 	SEQ_REGULAR, SEQ_SER, SEQ_FITSEQ,
 #ifdef HAVE_FFMS2
 	SEQ_AVI,
+#endif
+#ifdef HAVE_LIBRAW
+	SEQ_RAW,	// links to RAW files, decoded in CFA mode when read
 #endif
 	SEQ_INTERNAL
 } sequence_type;
@@ -406,9 +409,13 @@ struct sequ {
 #ifdef HAVE_FFMS2
 	struct film_struct *film_file;
 	const char *ext;	// extension of video, NULL if not video
+#endif
+#ifdef HAVE_LIBRAW
+	struct raw_sequence *raw_file;	// RAW sequence data structure
 #endif
 	fits **internal_fits;	// for INTERNAL sequences: images references. Length: number
 	fitsfile **fptr;	// file descriptors for open-mode operations
+	struct fits_handle_pool *fd_pool;	// or pooled per-thread descriptors, can be NULL
 #ifdef _OPENMP
 	omp_lock_t *fd_lock;	// locks for open-mode threaded operations
 #endif
@@ -493,6 +500,7 @@ typedef struct {
 	double focal_length, flength, iso_speed, exposure, aperture, ccd_temp, set_temp;
 	double livetime;		// sum of exposures (s)
 	guint stackcnt;			// number of stacked frame
+	int stack_band_first, stack_band_last;	// rows from the top of a partial stack, 1-based
 	double cvf;			// Conversion factor (e-/adu)
 	int key_gain, key_offset;	// Gain, Offset values read in camera headers.
 	char focname[FLEN_VALUE]; // focuser name
@@ -584,6 +592,7 @@ typedef struct _spcc_object {
 	double *x;  // Wavelength array
 	double *y;  // Quantity array
 	int n; // Number of points in x and y
+	const void *db_record; // record in the binary SPCC database, NULL if read from JSON
 } spcc_object;
 
 typedef struct _osc_sensor {
@@ -643,7 +652,7 @@ typedef struct cut_struct {
 } cut_struct;
 
 struct historic_struct {
-	char *filename;
+	struct undo_swap *swap;	// image data of the state, see undo.c
 	char history[FLEN_VALUE];
 	int rx, ry, nchans;
 	data_type type;
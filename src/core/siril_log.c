@@ -24,8 +24,109 @@
 #include "core/command.h" // for process_clear()
 #include "core/OS_utils.h"
 #include "core/pipe.h"
+#include "core/processing_tasks.h"
 #include "gui/progress_and_log.h"
 
+/* The messages of the concurrent processing tasks are written in the order the
+ * tasks were started, as if they had been run one after the other. A segment
+ * is opened for each task when it starts, the messages of the threads working
+ * for it are kept in it and the segments are written in order, each one once
+ * it is closed at the end of its task and all the previous ones have been
+ * written. The other messages are written after the open segments.
+ * The segments are protected by com.mutex, like the log. */
+struct log_line {
+	gchar *text;
+	gchar *color;
+};
+
+struct log_segment {
+	guint owner;	// task id, 0 for the messages of the other threads
+	gboolean closed;
+	GQueue lines;
+};
+
+static GQueue segments = G_QUEUE_INIT;
+
+static void emit_message(const char *msg, const char *color) {
+	if (msg[0] == '\n' && msg[1] == '\0') {
+		fputc('\n', stdout);
+		gui_log_message("\n", NULL);
+		return;
+	}
+	g_print("log: %s", msg);
+	pipe_send_message(PIPE_LOG, PIPE_NA, msg);
+	gui_log_message(msg, color);
+}
+
+static void free_log_line(gpointer p) {
+	struct log_line *line = (struct log_line *) p;
+	g_free(line->text);
+	g_free(line->color);
+	g_free(line);
+}
+
+static void flush_segments() {
+	struct log_segment *segment;
+	while ((segment = g_queue_peek_head(&segments)) && segment->closed) {
+		g_queue_pop_head(&segments);
+		for (GList *l = segment->lines.head; l; l = l->next) {
+			struct log_line *line = (struct log_line *) l->data;
+			emit_message(line->text, line->color);
+		}
+		g_queue_clear_full(&segment->lines, free_log_line);
+		g_free(segment);
+	}
+}
+
+/* returns FALSE if the message can be written now */
+static gboolean keep_in_segment(const char *msg, const char *color) {
+	if (g_queue_is_empty(&segments))
+		return FALSE;
+	processing_task *task = processing_task_current();
+	guint owner = task ? processing_task_get_id(task) : 0;
+	struct log_segment *segment = NULL;
+	for (GList *l = segments.tail; l && owner && !segment; l = l->prev) {
+		struct log_segment *candidate = (struct log_segment *) l->data;
+		if (candidate->owner == owner && !candidate->closed)
+			segment = candidate;
+	}
+	if (!segment) {
+		segment = g_queue_peek_tail(&segments);
+		if (segment->owner) {
+			/* always closed, it waits only for the segments before it */
+			segment = g_new0(struct log_segment, 1);
+			segment->closed = TRUE;
+			g_queue_push_tail(&segments, segment);
+		}
+	}
+	struct log_line *line = g_new(struct log_line, 1);
+	line->text = g_strdup(msg);
+	line->color = g_strdup(color);
+	g_queue_push_tail(&segment->lines, line);
+	return TRUE;
+}
+
+void siril_log_open_segment(guint owner) {
+	g_mutex_lock(&com.mutex);
+	struct log_segment *segment = g_new0(struct log_segment, 1);
+	segment->owner = owner;
+	g_queue_push_tail(&segments, segment);
+	g_mutex_unlock(&com.mutex);
+}
+
+void siril_log_close_segment(guint owner) {
+	g_mutex_lock(&com.mutex);
+	for (GList *l = segments.head; l; l = l->next) {
+		struct log_segment *segment = (struct log_segment *) l->data;
+		if (segment->owner == owner && !segment->closed) {
+			segment->closed = TRUE;
+			break;
+		}
+	}
+	flush_segments();
+	g_mutex_unlock(&com.mutex);
+}
+
 /* This function writes a message on Siril's console/log. It is not thread safe.
  * There is a limit in number of characters that it is able to write in one call: 1023.
  * Return value is the string printed from arguments, or NULL if argument was empty or
@@ -45,16 +146,10 @@ static char* siril_log_internal(const char* format, const char* color, va_list a
 	if (msg == NULL || msg[0] == '\0')
 		return NULL;
 
-	if (msg[0] == '\n' && msg[1] == '\0') {
-		fputc('\n', stdout);
-		gui_log_message("\n", NULL);
+	if (!keep_in_segment(msg, color))
+		emit_message(msg, color);
+	if (msg[0] == '\n' && msg[1] == '\0')
 		return NULL;
-	}
-
-	g_print("log: %s", msg);
-	pipe_send_message(PIPE_LOG, PIPE_NA, msg);
-	gui_log_message(msg, color);
-
 	return msg;
 }
 
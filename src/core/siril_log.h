@@ -22,6 +22,7 @@
 #define _SIRIL_LOG_H
 
 #include <sys/time.h>
+#include <glib.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -30,6 +31,10 @@ extern "C" {
 char* siril_log_message(const char* format, ...);
 char* siril_log_color_message(const char* format, const char* color, ...);
 
+/* keeps the messages of the threads of a processing task, see siril_log.c */
+void siril_log_open_segment(guint owner);
+void siril_log_close_segment(guint owner);
+
 void show_time(struct timeval, struct timeval);
 void show_time_msg(struct timeval t_start, struct timeval t_end, const char *msg);
 const char *format_time_diff(struct timeval t_start, struct timeval t_end);
@@ -51,9 +51,86 @@ typedef enum {
 	HTTP_POST
 } HttpRequestType;
 
+/* The requests share the DNS cache, the TLS sessions and, with libcurl 7.57
+ * and later, the connections, so that successive requests to the same server,
+ * like the tiles of a catalogue or the polling of a job, reuse the keep-alive
+ * connection instead of connecting and negotiating TLS again. The easy handles
+ * are kept in a small pool for the same reason with older versions, and the
+ * number of requests made at the same time is bounded. */
+#define MAX_POOLED_HANDLES 4
+#define MAX_CONCURRENT_REQUESTS 6
+
+static CURLSH *curl_share = NULL;
+static GMutex share_locks[CURL_LOCK_DATA_LAST];
+
+static GMutex pool_mutex;
+static GCond pool_cond;
+static GQueue idle_handles = G_QUEUE_INIT;
+static int active_requests = 0;
+
+static void share_lock(CURL *handle, curl_lock_data data, curl_lock_access access, void *userptr) {
+	g_mutex_lock(&share_locks[data]);
+}
+
+static void share_unlock(CURL *handle, curl_lock_data data, void *userptr) {
+	g_mutex_unlock(&share_locks[data]);
+}
+
+/* libcurl is only initialized when the first request is made */
+static gpointer curl_global_init_once(gpointer data) {
+	curl_global_init(CURL_GLOBAL_ALL);
+	curl_share = curl_share_init();
+	if (curl_share) {
+		CURLSHcode retval = curl_share_setopt(curl_share, CURLSHOPT_LOCKFUNC, share_lock);
+		retval |= curl_share_setopt(curl_share, CURLSHOPT_UNLOCKFUNC, share_unlock);
+		retval |= curl_share_setopt(curl_share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+		retval |= curl_share_setopt(curl_share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+#if LIBCURL_VERSION_NUM >= 0x073900
+		retval |= curl_share_setopt(curl_share, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT);
+#endif
+		if (retval) {
+			siril_debug_print("Error in curl_share_setopt(), requests will not share their connections\n");
+			curl_share_cleanup(curl_share);
+			curl_share = NULL;
+		}
+	}
+	return NULL;
+}
+
+/* waits for a request slot and returns an easy handle, reset if it was used */
+static CURL *acquire_curl_handle() {
+	g_mutex_lock(&pool_mutex);
+	while (active_requests >= MAX_CONCURRENT_REQUESTS)
+		g_cond_wait(&pool_cond, &pool_mutex);
+	active_requests++;
+	CURL *curl = g_queue_pop_head(&idle_handles);
+	g_mutex_unlock(&pool_mutex);
+	if (curl)
+		curl_easy_reset(curl);	// keeps the connections and caches
+	else curl = curl_easy_init();
+	return curl;
+}
+
+/* gives back the handle of a request, and its slot */
+static void release_curl_handle(CURL *curl) {
+	g_mutex_lock(&pool_mutex);
+	active_requests--;
+	if (curl && g_queue_get_length(&idle_handles) < MAX_POOLED_HANDLES) {
+		g_queue_push_head(&idle_handles, curl);
+		curl = NULL;
+	}
+	g_cond_signal(&pool_cond);
+	g_mutex_unlock(&pool_mutex);
+	if (curl)
+		curl_easy_cleanup(curl);
+}
+
 static CURL* initialize_curl(const gchar *url, struct ucontent *content, HttpRequestType request_type, const gchar *post_data) {
-	CURL *curl = curl_easy_init();
+	static GOnce curl_once = G_ONCE_INIT;
+	g_once(&curl_once, curl_global_init_once, NULL);
+	CURL *curl = acquire_curl_handle();
 	if (!curl) {
+		release_curl_handle(NULL);
 		siril_log_color_message(_("Error initialising CURL handle, URL functionality unavailable.\n"), "red");
 		return NULL;
 	}
@@ -68,11 +145,21 @@ static CURL* initialize_curl(const gchar *url, struct ucontent *content, HttpReq
 		retval |= curl_easy_setopt(curl, CURLOPT_POSTFIELDS, post_data);
 		retval |= curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE, (long)strlen(post_data));
 	}
+	retval |= curl_easy_setopt(curl, CURLOPT_TCP_KEEPALIVE, 1L);
+	retval |= curl_easy_setopt(curl, CURLOPT_ACCEPT_ENCODING, "");
+	if (curl_share)
+		retval |= curl_easy_setopt(curl, CURLOPT_SHARE, curl_share);
 	if (retval) {
 		siril_debug_print("Error in curl_easy_setopt()\n");
-		curl_easy_cleanup(curl);
+		release_curl_handle(curl);
 		return NULL;
 	}
+	/* HTTP/2 over TLS when the server and libcurl support it, which
+	 * multiplexes the requests to a server on one connection */
+#if LIBCURL_VERSION_NUM >= 0x072f00
+	curl_easy_setopt(curl, CURLOPT_HTTP_VERSION, (long) CURL_HTTP_VERSION_2TLS);
+	curl_easy_setopt(curl, CURLOPT_PIPEWAIT, 1L);
+#endif
 	if (g_getenv("CURL_CA_BUNDLE")) {
 		if (curl_easy_setopt(curl, CURLOPT_CAINFO, g_getenv("CURL_CA_BUNDLE"))) {
 			siril_log_color_message(_("Error configuring CURL with CA bundle. https functionality unavailable.\n"), "red");
@@ -137,7 +224,7 @@ gpointer fetch_url_async(gpointer p) {
 		return NULL;
 	}
 	char *result = handle_curl_response(curl, &content, args->url, &args->code, args->verbose);
-	curl_easy_cleanup(curl);
+	release_curl_handle(curl);
 	g_free(args->url);
 	args->url = NULL;
 	args->length = content.len;
@@ -159,7 +246,7 @@ char* fetch_url(const gchar *url, gsize *length, int *error, gboolean quiet) {
 	}
 	long code;
 	char *result = handle_curl_response(curl, &content, url, &code, (!quiet));
-	curl_easy_cleanup(curl);
+	release_curl_handle(curl);
 	set_progress_bar_data(NULL, PROGRESS_DONE);
 	*length = content.len;
 	if (!result || content.len == 0 || code != 200) {
@@ -184,7 +271,7 @@ int submit_post_request(const char *url, const char *post_data, char **post_resp
 		*post_response = g_strdup(chunk.data);
 	}
 	free(chunk.data);
-	curl_easy_cleanup(curl);
+	release_curl_handle(curl);
 	return (res != CURLE_OK ? 1 : 0);
 }
 
@@ -23,6 +23,8 @@
 #include <config.h>
 #endif
 
+#include "core/siril.h"
+#include "core/siril_log.h"
 #include "core/siril_spawn.h"
 
 /*
@@ -127,3 +129,72 @@ siril_spawn_host_async_with_pipes(
 		error
 	);
 }
+
+/* external_program has few values, EXT_NONE being 0 */
+#define MAX_TOOLS 8
+
+struct tool_runs {
+	int running;		// number of runs in progress
+	int max_concurrent;	// 0 for no limit
+	guint nb_runs;		// statistics of the ended runs
+	gint64 total_time, max_time;	// in microseconds
+};
+
+static struct tool_runs tools[MAX_TOOLS] = { 0 };
+static GMutex tools_mutex;
+static GCond tools_cond;
+
+static gboolean valid_tool(int tool) {
+	return tool > 0 && tool < MAX_TOOLS;
+}
+
+void siril_tool_set_max_concurrent(int tool, int max) {
+	if (!valid_tool(tool))
+		return;
+	g_mutex_lock(&tools_mutex);
+	tools[tool].max_concurrent = max > 0 ? max : 0;
+	g_cond_broadcast(&tools_cond);
+	g_mutex_unlock(&tools_mutex);
+}
+
+/* returns the start time of the run, to be given to siril_tool_end() */
+gint64 siril_tool_begin(int tool) {
+	if (!valid_tool(tool))
+		return g_get_monotonic_time();
+	g_mutex_lock(&tools_mutex);
+	while (tools[tool].max_concurrent > 0 && tools[tool].running >= tools[tool].max_concurrent)
+		g_cond_wait(&tools_cond, &tools_mutex);
+	tools[tool].running++;
+	g_mutex_unlock(&tools_mutex);
+	return g_get_monotonic_time();
+}
+
+void siril_tool_end(int tool, gint64 start) {
+	gint64 duration = g_get_monotonic_time() - start;
+	if (!valid_tool(tool))
+		return;
+	g_mutex_lock(&tools_mutex);
+	tools[tool].running--;
+	tools[tool].nb_runs++;
+	tools[tool].total_time += duration;
+	if (duration > tools[tool].max_time)
+		tools[tool].max_time = duration;
+	g_cond_signal(&tools_cond);
+	g_mutex_unlock(&tools_mutex);
+	siril_debug_print("external program %d ran for %.3f s\n", tool, duration / 1.e6);
+}
+
+/* prints the statistics of the runs since the previous call and resets them */
+void siril_tool_log_stats(int tool, const gchar *name) {
+	if (!valid_tool(tool))
+		return;
+	g_mutex_lock(&tools_mutex);
+	struct tool_runs runs = tools[tool];
+	tools[tool].nb_runs = 0;
+	tools[tool].total_time = 0;
+	tools[tool].max_time = 0;
+	g_mutex_unlock(&tools_mutex);
+	if (runs.nb_runs > 1)
+		siril_log_message(_("%s: %u runs, %.2f s on average, %.2f s at most\n"), name,
+				runs.nb_runs, runs.total_time / 1.e6 / runs.nb_runs, runs.max_time / 1.e6);
+}
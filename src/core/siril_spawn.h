@@ -112,4 +112,22 @@ siril_spawn_host_async_with_pipes(
 #define siril_spawn_check_wait_status g_spawn_check_exit_status
 #endif
 
+/**
+ * @brief Bookkeeping of the runs of the external programs
+ *
+ * Each run of an external program is enclosed by siril_tool_begin() and
+ * siril_tool_end(). The number of concurrent runs of a program can be
+ * limited with siril_tool_set_max_concurrent(), for example to avoid
+ * starting as many solve-field processes as there are threads when a
+ * sequence is plate solved in parallel: siril_tool_begin() waits until
+ * a run ends. The duration of the runs is accumulated in statistics that
+ * siril_tool_log_stats() prints.
+ *
+ * @param tool one of the external_program values, EXT_NONE is ignored
+ */
+void siril_tool_set_max_concurrent(int tool, int max);
+gint64 siril_tool_begin(int tool);
+void siril_tool_end(int tool, gint64 start);
+void siril_tool_log_stats(int tool, const gchar *name);
+
 #endif /* SRC_CORE_SIRIL_SPAWN_H_ */
@@ -0,0 +1,203 @@
+/*
+ * This file is part of Siril, an astronomy image processor.
+ * Copyright (C) 2005-2011 Francois Meyer (dulle at free.fr)
+ * Copyright (C) 2012-2025 team free-astro (see more in AUTHORS file)
+ * Reference site is https://siril.org
+ *
+ * Siril is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Siril is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Siril. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* The trace records the time spans of the processing stages, per thread,
+ * between trace_start() and trace_stop(), and writes them in the Chrome trace
+ * event JSON format, that chrome://tracing and ui.perfetto.dev display as a
+ * timeline. Each thread appends to its own buffer, the lock of a buffer is
+ * only contended when the trace is written. */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <glib/gstdio.h>
+
+#include "core/siril.h"
+#include "core/siril_log.h"
+
+#include "trace.h"
+
+struct trace_event {
+	const char *category, *name;
+	gint64 ts, dur, value;
+	int frame;
+	char phase;	// 'X' for a span, 'C' for a counter
+};
+
+struct trace_thread {
+	GMutex lock;
+	GArray *events;
+	int tid;
+};
+
+static gint enabled = 0;
+static GMutex trace_mutex;
+static GPtrArray *threads = NULL;	// all trace_thread, kept until exit
+static gchar *trace_filename = NULL;
+static gint64 trace_origin = 0;
+static GPrivate current_thread = G_PRIVATE_INIT(NULL);
+
+static struct trace_thread *get_thread_buffer() {
+	struct trace_thread *thread = g_private_get(&current_thread);
+	if (!thread) {
+		thread = g_new0(struct trace_thread, 1);
+		g_mutex_init(&thread->lock);
+		thread->events = g_array_new(FALSE, FALSE, sizeof(struct trace_event));
+		g_mutex_lock(&trace_mutex);
+		if (!threads)
+			threads = g_ptr_array_new();
+		g_ptr_array_add(threads, thread);
+		thread->tid = threads->len;
+		g_mutex_unlock(&trace_mutex);
+		g_private_set(&current_thread, thread);
+	}
+	return thread;
+}
+
+static void record(const struct trace_event *event) {
+	struct trace_thread *thread = get_thread_buffer();
+	g_mutex_lock(&thread->lock);
+	g_array_append_vals(thread->events, event, 1);
+	g_mutex_unlock(&thread->lock);
+}
+
+gboolean trace_is_enabled() {
+	return g_atomic_int_get(&enabled);
+}
+
+gint64 trace_begin() {
+	if (!g_atomic_int_get(&enabled))
+		return 0;
+	return g_get_monotonic_time();
+}
+
+void trace_end(gint64 start, const char *category, const char *name, int frame) {
+	// spans started before the trace are dropped
+	if (!start || !g_atomic_int_get(&enabled) || start < trace_origin)
+		return;
+	struct trace_event event = { category, name, start, g_get_monotonic_time() - start, 0, frame, 'X' };
+	record(&event);
+}
+
+void trace_counter(const char *name, gint64 value) {
+	if (!g_atomic_int_get(&enabled))
+		return;
+	struct trace_event event = { "counter", name, g_get_monotonic_time(), 0, value, -1, 'C' };
+	record(&event);
+}
+
+static void write_json_string(FILE *f, const char *str) {
+	fputc('"', f);
+	for (const char *c = str; *c; c++) {
+		if (*c == '"' || *c == '\\')
+			fputc('\\', f);
+		if ((unsigned char) *c >= 0x20)
+			fputc(*c, f);
+	}
+	fputc('"', f);
+}
+
+static void stop_at_exit() {
+	if (trace_is_enabled())
+		trace_stop();
+}
+
+/* starts recording, the spans recorded by a previous trace not written are
+ * discarded */
+int trace_start(const char *filename) {
+	static gboolean atexit_registered = FALSE;
+	g_mutex_lock(&trace_mutex);
+	if (g_atomic_int_get(&enabled)) {
+		g_mutex_unlock(&trace_mutex);
+		siril_log_message(_("A trace is already recorded to %s\n"), trace_filename);
+		return 1;
+	}
+	g_free(trace_filename);
+	// the working directory can change before the trace is written
+	if (!g_path_is_absolute(filename)) {
+		gchar *cwd = g_get_current_dir();
+		trace_filename = g_build_filename(cwd, filename, NULL);
+		g_free(cwd);
+	}
+	else trace_filename = g_strdup(filename);
+	for (guint i = 0; threads && i < threads->len; i++) {
+		struct trace_thread *thread = g_ptr_array_index(threads, i);
+		g_mutex_lock(&thread->lock);
+		g_array_set_size(thread->events, 0);
+		g_mutex_unlock(&thread->lock);
+	}
+	trace_origin = g_get_monotonic_time();
+	g_atomic_int_set(&enabled, 1);
+	if (!atexit_registered) {
+		// the scripts of siril-cli end with exit()
+		atexit(stop_at_exit);
+		atexit_registered = TRUE;
+	}
+	g_mutex_unlock(&trace_mutex);
+	siril_log_message(_("Recording the processing trace to %s\n"), trace_filename);
+	return 0;
+}
+
+/* stops recording and writes the trace file */
+int trace_stop() {
+	g_mutex_lock(&trace_mutex);
+	if (!g_atomic_int_get(&enabled)) {
+		g_mutex_unlock(&trace_mutex);
+		siril_log_message(_("No trace is being recorded\n"));
+		return 1;
+	}
+	g_atomic_int_set(&enabled, 0);
+
+	FILE *f = g_fopen(trace_filename, "w");
+	if (!f) {
+		g_mutex_unlock(&trace_mutex);
+		siril_log_color_message(_("Could not write the trace file %s\n"), "red", trace_filename);
+		return 1;
+	}
+	fprintf(f, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n"
+			"{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": 1, \"args\": {\"name\": \"%s\"}}",
+			PACKAGE);
+	size_t nb_events = 0;
+	for (guint i = 0; threads && i < threads->len; i++) {
+		struct trace_thread *thread = g_ptr_array_index(threads, i);
+		g_mutex_lock(&thread->lock);
+		for (guint j = 0; j < thread->events->len; j++) {
+			struct trace_event *event = &g_array_index(thread->events, struct trace_event, j);
+			fprintf(f, ",\n{\"name\": ");
+			write_json_string(f, event->name);
+			fprintf(f, ", \"cat\": \"%s\", \"ph\": \"%c\", \"pid\": 1, \"tid\": %d, \"ts\": %" G_GINT64_FORMAT,
+					event->category, event->phase, thread->tid, event->ts - trace_origin);
+			if (event->phase == 'C')
+				fprintf(f, ", \"args\": {\"value\": %" G_GINT64_FORMAT "}}", event->value);
+			else if (event->frame >= 0)
+				fprintf(f, ", \"dur\": %" G_GINT64_FORMAT ", \"args\": {\"frame\": %d}}", event->dur, event->frame);
+			else fprintf(f, ", \"dur\": %" G_GINT64_FORMAT "}", event->dur);
+		}
+		nb_events += thread->events->len;
+		g_array_set_size(thread->events, 0);
+		g_mutex_unlock(&thread->lock);
+	}
+	fprintf(f, "\n]}\n");
+	int retval = fclose(f) != 0;
+	g_mutex_unlock(&trace_mutex);
+	if (retval)
+		siril_log_color_message(_("Could not write the trace file %s\n"), "red", trace_filename);
+	else siril_log_message(_("Trace of %zu events written to %s\n"), nb_events, trace_filename);
+	return retval;
+}
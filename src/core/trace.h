@@ -0,0 +1,18 @@
+#ifndef SRC_CORE_TRACE_H_
+#define SRC_CORE_TRACE_H_
+
+#include <glib.h>
+
+int trace_start(const char *filename);
+int trace_stop();
+gboolean trace_is_enabled();
+
+/* returns the start time of a span, 0 when tracing is disabled */
+gint64 trace_begin();
+/* records a span started by trace_begin(). category and name are kept as
+ * pointers, they must be static or interned strings. frame is added to the
+ * span arguments when it is not negative */
+void trace_end(gint64 start, const char *category, const char *name, int frame);
+void trace_counter(const char *name, gint64 value);
+
+#endif /* SRC_CORE_TRACE_H_ */
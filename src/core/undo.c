@@ -23,6 +23,9 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <string.h>
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
 
 #include "core/siril.h"
 #include "core/siril_log.h"
@@ -41,13 +44,189 @@
 #include "core/proto.h"
 #include "algos/statistics.h"
 #include "algos/siril_wcs.h"
+#include "core/OS_utils.h"
+#include "core/memory_report.h"
 
 #ifndef O_BINARY
 #define O_BINARY 0
 #endif
 
-/* *filename must be freed */
-static int undo_build_swapfile(fits *fit, char **filename) {
+/* The state is copied in memory and written to the swap file by a background
+ * thread, so the operation that follows does not wait for the disk. With zlib,
+ * the data is split in chunks whose bytes are shuffled in planes, the high
+ * bytes of neighbouring pixels being much alike, and deflated at the fastest
+ * level. Reading a state uses the copy if it is not written yet, or waits for
+ * the end of its write */
+#define UNDO_CHUNK_SIZE (4 * BYTES_IN_A_MB)
+#define UNDO_CHUNK_STORED 0x80000000u	// flag of the chunks that did not deflate
+
+struct undo_swap {
+	gchar *filename;
+	int fd;
+	size_t nbytes;		// size of the image data
+	size_t elem_size;	// size of a pixel value
+	gboolean compressed;
+
+	GMutex mutex;
+	GCond cond;
+	gboolean done;
+	int retval;
+	void *data;		// copy of the image data until it is written
+};
+
+static GThreadPool *undo_pool = NULL;
+
+static int write_all(int fd, const void *buf, size_t size) {
+	const guint8 *ptr = (const guint8 *) buf;
+	while (size > 0) {
+		ssize_t ret = write(fd, ptr, size);
+		if (ret <= 0)
+			return 1;
+		ptr += ret;
+		size -= ret;
+	}
+	return 0;
+}
+
+static int read_all(int fd, void *buf, size_t size) {
+	guint8 *ptr = (guint8 *) buf;
+	while (size > 0) {
+		ssize_t ret = read(fd, ptr, size);
+		if (ret <= 0)
+			return 1;
+		ptr += ret;
+		size -= ret;
+	}
+	return 0;
+}
+
+#ifdef HAVE_ZLIB
+static void shuffle_bytes(const guint8 *src, guint8 *dst, size_t nelem, size_t elem_size) {
+	for (size_t b = 0; b < elem_size; b++)
+		for (size_t i = 0; i < nelem; i++)
+			dst[b * nelem + i] = src[i * elem_size + b];
+}
+
+static void unshuffle_bytes(const guint8 *src, guint8 *dst, size_t nelem, size_t elem_size) {
+	for (size_t b = 0; b < elem_size; b++)
+		for (size_t i = 0; i < nelem; i++)
+			dst[i * elem_size + b] = src[b * nelem + i];
+}
+
+static int write_compressed(struct undo_swap *swap, const guint8 *data) {
+	uLongf bound = compressBound(UNDO_CHUNK_SIZE);
+	guint8 *shuffled = malloc(UNDO_CHUNK_SIZE + bound);
+	if (!shuffled) {
+		PRINT_ALLOC_ERR;
+		return 1;
+	}
+	guint8 *deflated = shuffled + UNDO_CHUNK_SIZE;
+	int retval = 0;
+	for (size_t offset = 0; offset < swap->nbytes && !retval; offset += UNDO_CHUNK_SIZE) {
+		size_t len = min(UNDO_CHUNK_SIZE, swap->nbytes - offset);
+		shuffle_bytes(data + offset, shuffled, len / swap->elem_size, swap->elem_size);
+		uLongf dest_len = bound;
+		guint32 header;
+		const guint8 *payload;
+		if (compress2(deflated, &dest_len, shuffled, len, Z_BEST_SPEED) == Z_OK && dest_len < len) {
+			header = (guint32) dest_len;
+			payload = deflated;
+		} else {
+			header = (guint32) len | UNDO_CHUNK_STORED;
+			payload = shuffled;
+			dest_len = len;
+		}
+		retval = write_all(swap->fd, &header, sizeof(header)) || write_all(swap->fd, payload, dest_len);
+	}
+	free(shuffled);
+	return retval;
+}
+
+static int read_compressed(struct undo_swap *swap, int fd, guint8 *dest) {
+	guint8 *shuffled = malloc(2 * UNDO_CHUNK_SIZE);
+	if (!shuffled) {
+		PRINT_ALLOC_ERR;
+		return 1;
+	}
+	guint8 *deflated = shuffled + UNDO_CHUNK_SIZE;
+	int retval = 0;
+	for (size_t offset = 0; offset < swap->nbytes && !retval; offset += UNDO_CHUNK_SIZE) {
+		size_t len = min(UNDO_CHUNK_SIZE, swap->nbytes - offset);
+		guint32 header;
+		if (read_all(fd, &header, sizeof(header))) {
+			retval = 1;
+			break;
+		}
+		size_t stored_len = header & ~UNDO_CHUNK_STORED;
+		if (stored_len > UNDO_CHUNK_SIZE || read_all(fd, deflated, stored_len)) {
+			retval = 1;
+			break;
+		}
+		if (header & UNDO_CHUNK_STORED) {
+			if (stored_len != len)
+				retval = 1;
+			else unshuffle_bytes(deflated, dest + offset, len / swap->elem_size, swap->elem_size);
+		} else {
+			uLongf dest_len = len;
+			if (uncompress(shuffled, &dest_len, deflated, stored_len) != Z_OK || dest_len != len)
+				retval = 1;
+			else unshuffle_bytes(shuffled, dest + offset, len / swap->elem_size, swap->elem_size);
+		}
+	}
+	free(shuffled);
+	return retval;
+}
+#endif
+
+static int undo_write_swapfile(struct undo_swap *swap, const void *data) {
+	errno = 0;
+	int retval;
+#ifdef HAVE_ZLIB
+	if (swap->compressed)
+		retval = write_compressed(swap, data);
+	else
+#endif
+		retval = write_all(swap->fd, data, swap->nbytes);
+	if (retval)
+		siril_log_message(_("File I/O Error: Unable to write swap file in %s: [%s]\n"),
+				com.pref.swap_dir, strerror(errno));
+	g_close(swap->fd, NULL);
+	swap->fd = -1;
+	return retval;
+}
+
+static void undo_write_worker(gpointer job, gpointer user_data) {
+	struct undo_swap *swap = (struct undo_swap *) job;
+	int retval = undo_write_swapfile(swap, swap->data);
+	g_mutex_lock(&swap->mutex);
+	swap->retval = retval;
+	swap->done = TRUE;
+	free(swap->data);
+	swap->data = NULL;
+	memory_account(MEM_UNDO, -(gint64) swap->nbytes);
+	g_cond_broadcast(&swap->cond);
+	g_mutex_unlock(&swap->mutex);
+}
+
+static void undo_wait_swap(struct undo_swap *swap) {
+	g_mutex_lock(&swap->mutex);
+	while (!swap->done)
+		g_cond_wait(&swap->cond, &swap->mutex);
+	g_mutex_unlock(&swap->mutex);
+}
+
+static void undo_free_swap(struct undo_swap *swap) {
+	undo_wait_swap(swap);
+	if (g_unlink(swap->filename))
+		siril_debug_print("g_unlink() failed\n");
+	g_free(swap->filename);
+	g_mutex_clear(&swap->mutex);
+	g_cond_clear(&swap->cond);
+	free(swap);
+}
+
+/* the state is written in the background if there is enough memory to copy it */
+static struct undo_swap *undo_build_swapfile(fits *fit) {
 	gchar *nameBuff;
 	char name[] = "siril_swp-XXXXXX";
 	gchar *tmpdir;
@@ -60,51 +239,87 @@ static int undo_build_swapfile(fits *fit, char **filename) {
 		siril_log_message(_("File I/O Error: Unable to create swap file in %s: [%s]\n"),
 				tmpdir, strerror(errno));
 		g_free(nameBuff);
-		return 1;
+		return NULL;
 	}
 
 	size_t size = fit->naxes[0] * fit->naxes[1] * fit->naxes[2];
-
-	errno = 0;
-	// Write some data to the temporary file
-	if (fit->type == DATA_USHORT) {
-		if (-1 == write(fd, fit->data, size * sizeof(WORD))) {
-			siril_log_message(_("File I/O Error: Unable to write swap file in %s: [%s]\n"),
-					tmpdir, strerror(errno));
-			g_free(nameBuff);
-			g_close(fd, NULL);
-			return 1;
-		}
-	} else if (fit->type == DATA_FLOAT) {
-		if (-1 == write(fd, fit->fdata, size * sizeof(float))) {
-			siril_log_message(_("File I/O Error: Unable to write swap file in %s: [%s]\n"),
-					tmpdir, strerror(errno));
-			g_free(nameBuff);
-			g_close(fd, NULL);
-			return 1;
+	struct undo_swap *swap = calloc(1, sizeof(struct undo_swap));
+	swap->filename = nameBuff;
+	swap->fd = fd;
+	swap->elem_size = fit->type == DATA_USHORT ? sizeof(WORD) : sizeof(float);
+	swap->nbytes = size * swap->elem_size;
+#ifdef HAVE_ZLIB
+	swap->compressed = TRUE;
+#endif
+	g_mutex_init(&swap->mutex);
+	g_cond_init(&swap->cond);
+	const void *data = fit->type == DATA_USHORT ? (const void *) fit->data : (const void *) fit->fdata;
+
+	if (!undo_pool)
+		undo_pool = g_thread_pool_new(undo_write_worker, NULL, 1, FALSE, NULL);
+	if (undo_pool && swap->nbytes < get_available_memory() / 2)
+		swap->data = malloc(swap->nbytes);
+	if (swap->data) {
+		memory_account(MEM_UNDO, swap->nbytes);
+		memcpy(swap->data, data, swap->nbytes);
+		g_thread_pool_push(undo_pool, swap, NULL);
+	} else {
+		swap->retval = undo_write_swapfile(swap, data);
+		swap->done = TRUE;
+		if (swap->retval) {
+			undo_free_swap(swap);
+			return NULL;
 		}
 	}
-	*filename = nameBuff;
-	g_close(fd, NULL);
+	return swap;
+}
 
-	return 0;
+/* reads the data of a state in dest, of the size of the image data */
+static int undo_read_swapfile(struct undo_swap *swap, void *dest) {
+	g_mutex_lock(&swap->mutex);
+	if (!swap->done && swap->data) {
+		memcpy(dest, swap->data, swap->nbytes);
+		g_mutex_unlock(&swap->mutex);
+		return 0;
+	}
+	while (!swap->done)
+		g_cond_wait(&swap->cond, &swap->mutex);
+	g_mutex_unlock(&swap->mutex);
+	if (swap->retval)
+		return 1;
+
+	int fd;
+	if ((fd = g_open(swap->filename, O_RDONLY | O_BINARY, 0)) == -1) {
+		printf("Error opening swap file : %s\n", swap->filename);
+		return 1;
+	}
+	errno = 0;
+	int retval;
+#ifdef HAVE_ZLIB
+	if (swap->compressed)
+		retval = read_compressed(swap, fd, dest);
+	else
+#endif
+		retval = read_all(fd, dest, swap->nbytes);
+	if (retval)
+		printf("Undo Read of [%s], failed with error [%s]\n", swap->filename, strerror(errno));
+	g_close(fd, NULL);
+	return retval;
 }
 
 static int undo_remove_item(historic *histo, int index) {
-	if (histo[index].filename) {
-		if (g_unlink(histo[index].filename))
-			siril_debug_print("g_unlink() failed\n");
+	if (histo[index].swap) {
+		undo_free_swap(histo[index].swap);
 		if (histo[index].icc_profile)
 			cmsCloseProfile(histo[index].icc_profile);
-		g_free(histo[index].filename);
-		histo[index].filename = NULL;
+		histo[index].swap = NULL;
 		memset(&histo[index].wcsdata, 0, sizeof(wcs_info));
 	}
 	memset(histo[index].history, 0, FLEN_VALUE);
 	return 0;
 }
 
-static void undo_add_item(fits *fit, char *filename, const char *histo) {
+static void undo_add_item(fits *fit, struct undo_swap *swap, const char *histo) {
 
 	if (!com.history) {
 		com.hist_size = HISTORY_SIZE;
@@ -118,7 +333,7 @@ static void undo_add_item(fits *fit, char *filename, const char *histo) {
 		undo_remove_item(com.history, com.hist_current);
 	}
 	int status = -1;
-	com.history[com.hist_current].filename = filename;
+	com.history[com.hist_current].swap = swap;
 	com.history[com.hist_current].rx = fit->rx;
 	com.history[com.hist_current].ry = fit->ry;
 	com.history[com.hist_current].nchans = fit->naxes[2];
@@ -146,46 +361,7 @@ static void undo_add_item(fits *fit, char *filename, const char *histo) {
 	com.hist_display = com.hist_current;
 }
 
-static int undo_get_data_ushort(fits *fit, historic *hist) {
-	int fd;
-
-	if ((fd = g_open(hist->filename, O_RDONLY | O_BINARY, 0)) == -1) {
-		printf("Error opening swap file : %s\n", hist->filename);
-		return 1;
-	}
-
-	errno = 0;
-	fit->rx = fit->naxes[0] = hist->rx;
-	fit->ry = fit->naxes[1] = hist->ry;
-
-	size_t n = fit->naxes[0] * fit->naxes[1];
-	size_t size = n * fit->naxes[2] * sizeof(WORD);
-	WORD *buf = calloc(1, size);
-	// read the data from temporary file
-	if ((read(fd, buf, size)) < size) {
-		printf("Undo Read of [%s], failed with error [%s]\n", hist->filename, strerror(errno));
-		free(buf);
-		g_close(fd, NULL);
-		return 1;
-	}
-	/* need to reallocate data as size may have changed */
-	WORD *newdata = (WORD*) realloc(fit->data, size);
-	if (!newdata) {
-		PRINT_ALLOC_ERR;
-		free(newdata);
-		free(buf);
-		g_close(fd, NULL);
-		return 1;
-	}
-	fit->data = newdata;
-	memcpy(fit->data, buf, size);
-	fit->pdata[RLAYER] = fit->data;
-	if (fit->naxes[2] > 1) {
-		fit->pdata[GLAYER] = fit->data + n;
-		fit->pdata[BLAYER] = fit->data + n * 2;
-	} else {
-		fit->pdata[GLAYER] = fit->pdata[BLAYER] = fit->pdata[RLAYER];
-	}
+static void undo_restore_metadata(fits *fit, historic *hist) {
 	memcpy(&fit->keywords.wcsdata, &hist->wcsdata, sizeof(wcs_info));
 	if (hist->wcslib) {
 		int status = -1;
@@ -199,92 +375,57 @@ static int undo_get_data_ushort(fits *fit, historic *hist) {
 	fit->keywords.focal_length = hist->focal_length;
 
 	full_stats_invalidation_from_fit(fit);
-	free(buf);
-	g_close(fd, NULL);
-	return 0;
 }
 
-static int undo_get_data_float(fits *fit, historic *hist) {
-	int fd;
-
-	if ((fd = g_open(hist->filename, O_RDONLY | O_BINARY, 0)) == -1) {
-		printf("Error opening swap file : %s\n", hist->filename);
+/* the state is read in a new buffer first, the image is only changed once it
+ * has been read successfully */
+static int undo_get_data(fits *fit, historic *hist) {
+	size_t pixel_size;
+	if (hist->type == DATA_USHORT)
+		pixel_size = sizeof(WORD);
+	else if (hist->type == DATA_FLOAT)
+		pixel_size = sizeof(float);
+	else return 1;
+
+	void *newbuf = malloc((size_t) hist->rx * hist->ry * hist->nchans * pixel_size);
+	if (!newbuf) {
+		PRINT_ALLOC_ERR;
 		return 1;
 	}
-
-	errno = 0;
-	fit->rx = fit->naxes[0] = hist->rx;
-	fit->ry = fit->naxes[1] = hist->ry;
-
-	size_t n = fit->naxes[0] * fit->naxes[1];
-	size_t size = n * fit->naxes[2] * sizeof(float);
-	float *buf = calloc(1, size);
 	// read the data from temporary file
-	if ((read(fd, buf, size) < size)) {
-		printf("Undo Read of [%s], failed with error [%s]\n", hist->filename, strerror(errno));
-		free(buf);
-		g_close(fd, NULL);
+	if (undo_read_swapfile(hist->swap, newbuf)) {
+		siril_log_color_message(_("The saved state could not be read, the image was not changed\n"), "red");
+		free(newbuf);
 		return 1;
 	}
-	/* need to reallocate data as size may have changed */
-	float *newdata = (float*) realloc(fit->fdata, size);
-	if (!newdata) {
-		PRINT_ALLOC_ERR;
-		free(newdata);
-		free(buf);
-		g_close(fd, NULL);
-		return 1;
-	}
-	fit->fdata = newdata;
-	memcpy(fit->fdata, buf, size);
-	fit->fpdata[RLAYER] = fit->fdata;
-	if (fit->naxes[2] > 1) {
-		fit->fpdata[GLAYER] = fit->fdata + n;
-		fit->fpdata[BLAYER] = fit->fdata + n * 2;
-	} else {
-		fit->fpdata[GLAYER] = fit->fpdata[BLAYER] = fit->fpdata[RLAYER];
-	}
-	memcpy(&fit->keywords.wcsdata, &hist->wcsdata, sizeof(wcs_info));
-	if (hist->wcslib) {
-		int status = -1;
-		fit->keywords.wcslib = wcs_deepcopy(hist->wcslib, &status);
-		if (status)
-			siril_debug_print("could not copy wcslib struct\n");
-	} else {
-		free_wcs(fit);
-		reset_wcsdata(fit);
-	}
-	fit->keywords.focal_length = hist->focal_length;
 
-	full_stats_invalidation_from_fit(fit);
-	free(buf);
-	g_close(fd, NULL);
-	return 0;
-}
-
-static int undo_get_data(fits *fit, historic *hist) {
 	if (fit->icc_profile)
 		cmsCloseProfile(fit->icc_profile);
 	fit->icc_profile = copyICCProfile(hist->icc_profile);
 	color_manage(fit, (fit->icc_profile != NULL));
-	fits_change_depth(fit, hist->nchans);
 
+	gboolean type_changed = fit->type != hist->type;
+	int bitpix = fit->bitpix, orig_bitpix = fit->orig_bitpix;
 	if (hist->type == DATA_USHORT) {
-		if (gfit.type != DATA_USHORT) {
-			size_t ndata = fit->naxes[0] * fit->naxes[1] * fit->naxes[2];
-			fit_replace_buffer(fit, float_buffer_to_ushort(fit->fdata, ndata), DATA_USHORT);
-			set_precision_switch();
-		}
-		return undo_get_data_ushort(fit, hist);
-	} else if (hist->type == DATA_FLOAT) {
-		if (gfit.type != DATA_FLOAT) {
-			size_t ndata = fit->naxes[0] * fit->naxes[1] * fit->naxes[2];
-			fit_replace_buffer(fit, ushort_buffer_to_float(fit->data, ndata), DATA_FLOAT);
-			set_precision_switch();
-		}
-		return undo_get_data_float(fit, hist);
+		free(fit->data);
+		fit->data = NULL;
+	} else {
+		free(fit->fdata);
+		fit->fdata = NULL;
 	}
-	return 1;
+	fit->rx = fit->naxes[0] = hist->rx;
+	fit->ry = fit->naxes[1] = hist->ry;
+	fit->naxes[2] = hist->nchans;
+	fit->naxis = hist->nchans == 1 ? 2 : 3;
+	fit_replace_buffer(fit, newbuf, hist->type);
+	if (type_changed) {
+		set_precision_switch();
+	} else {
+		fit->bitpix = bitpix;
+		fit->orig_bitpix = orig_bitpix;
+	}
+	undo_restore_metadata(fit, hist);
+	return 0;
 }
 
 gboolean is_undo_available() {
@@ -296,7 +437,7 @@ gboolean is_redo_available() {
 }
 
 int undo_save_state(fits *fit, const char *message, ...) {
-	gchar *filename;
+	struct undo_swap *swap;
 	va_list args;
 	va_start(args, message);
 
@@ -307,12 +448,12 @@ int undo_save_state(fits *fit, const char *message, ...) {
 			vsnprintf(histo, FLEN_VALUE, message, args);
 		}
 
-		if (undo_build_swapfile(fit, &filename)) {
+		if (!(swap = undo_build_swapfile(fit))) {
 			va_end(args);
 			return 1;
 		}
 
-		undo_add_item(fit, filename, histo);
+		undo_add_item(fit, swap, histo);
 
 		/* update menus */
 		update_MenuItem();
@@ -40,6 +40,7 @@ OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "cdrizzlemap.h"
 #include "cdrizzlebox.h"
 #include "cdrizzleutil.h"
+#include "core/processing.h"
 
 #include <assert.h>
 #define _USE_MATH_DEFINES       /* needed for MS Windows to define M_PI */
@@ -100,6 +101,30 @@ update_data(struct driz_param_t* p, const integer_t ii, const integer_t jj,
   return 0;
 }
 
+/** --------------------------------------------------------------------------------------------------
+ * Helpers for drizzling in bands of output rows. Each band only writes the output rows it owns, so
+ * several bands can be drizzled in parallel without locking, and each output pixel still receives
+ * its contributions in the same order as in a single pass. The statistics of skipped lines are
+ * counted by the first band only and a missed pixel is counted by the band containing its center.
+ */
+
+static inline_macro int
+first_band(const struct driz_param_t* p) {
+  return p->band_ymin == 0;
+}
+
+static inline_macro int
+counts_miss_at(const struct driz_param_t* p, integer_t jj) {
+  if (jj < 0) jj = 0;
+  if (jj >= p->output_data->ry) jj = p->output_data->ry - 1;
+  return jj >= p->band_ymin && jj <= p->band_ymax;
+}
+
+static inline_macro int
+row_outside_band(const struct driz_param_t* p, integer_t j) {
+  return p->row_ymin && (p->row_ymax[j] < p->band_ymin || p->row_ymin[j] > p->band_ymax);
+}
+
 /** --------------------------------------------------------------------------------------------------
  * Compute area of box overlap. Calculate the area common to input clockwise polygon x(n), y(n) with
  * square (is, js) to (is+1, js+1). This version is for a quadrilateral. Used by do_square_kernel.
@@ -278,8 +303,10 @@ do_kernel_point(struct driz_param_t* p) {
 
     if (init_image_scanner(p, &s, &ymin, &ymax)) return 1;
 
-    p->nskip = (p->ymax - p->ymin) - (ymax - ymin);
-    p->nmiss = p->nskip * (p->xmax - p->xmin);
+    if (first_band(p)) {
+        p->nskip = (p->ymax - p->ymin) - (ymax - ymin);
+        p->nmiss = p->nskip * (p->xmax - p->xmin);
+    }
 
     /* This is the outer loop over all the lines in the input image */
     get_dimensions(p->output_data, osize);
@@ -288,25 +315,35 @@ do_kernel_point(struct driz_param_t* p) {
         n = get_scanline_limits(&s, j, &xmin, &xmax);
         if (n == 1) {
             // scan ended (y reached the top vertex/edge)
-            p->nskip += (ymax + 1 - j);
-            p->nmiss += (ymax + 1 - j) * (p->xmax - p->xmin);
+            if (first_band(p)) {
+                p->nskip += (ymax + 1 - j);
+                p->nmiss += (ymax + 1 - j) * (p->xmax - p->xmin);
+            }
             break;
         } else if (n == 2 || n == 3) {
             // pixel centered on y is outside of scanner's limits or image [0, height - 1]
             // OR: limits (x1, x2) are equal (line width is 0)
-            p->nmiss += (p->xmax - p->xmin);
-            ++p->nskip;
+            if (first_band(p)) {
+                p->nmiss += (p->xmax - p->xmin);
+                ++p->nskip;
+            }
             continue;
-        } else {
+        } else if (first_band(p)) {
             // limits (x1, x2) are equal (line width is 0)
             p->nmiss += (p->xmax - p->xmin) - (xmax + 1 - xmin);
         }
 
+        if (processing_cancelled()) {
+            driz_error_set_message(p->error, _("Drizzle cancelled"));
+            return 1;
+        }
+        if (row_outside_band(p, j)) continue;
+
         for (i = xmin; i <= xmax; ++i) {
             float ox, oy;
             int chan = FC(j, i, cfadim, cfa);
             if (map_pixel(p->pixmap, i, j, &ox, &oy)) {
-              ++ p->nmiss;
+              if (first_band(p)) ++ p->nmiss;
 
             } else {
                 ii = fortran_round(ox);
@@ -314,9 +351,9 @@ do_kernel_point(struct driz_param_t* p) {
 
                 /* Check it is on the output image */
                 if (ii < 0 || ii >= osize[0] || jj < 0 || jj >= osize[1]) {
-                    ++ p->nmiss;
+                    if (counts_miss_at(p, jj)) ++ p->nmiss;
 
-                } else {
+                } else if (jj >= p->band_ymin && jj <= p->band_ymax) {
                     vc[chan] = get_pixel(p->output_counts, ii, jj, chan);
 
                     /* Allow for stretching because of scale change */
@@ -351,6 +388,7 @@ static int
 do_kernel_gaussian(struct driz_param_t* p) {
     struct scanner s;
     integer_t i, j, ii, jj, nxi, nxa, nyi, nya, nhit;
+    int own;
     integer_t /*ybounds[2],*/ osize[2];
     float vc[3], d, dow;
     float gaussian_efac, gaussian_es;
@@ -375,8 +413,10 @@ do_kernel_gaussian(struct driz_param_t* p) {
 
     if (init_image_scanner(p, &s, &ymin, &ymax)) return 1;
 
-    p->nskip = (p->ymax - p->ymin) - (ymax - ymin);
-    p->nmiss = p->nskip * (p->xmax - p->xmin);
+    if (first_band(p)) {
+        p->nskip = (p->ymax - p->ymin) - (ymax - ymin);
+        p->nmiss = p->nskip * (p->xmax - p->xmin);
+    }
 
     /* This is the outer loop over all the lines in the input image */
 
@@ -386,28 +426,40 @@ do_kernel_gaussian(struct driz_param_t* p) {
         n = get_scanline_limits(&s, j, &xmin, &xmax);
         if (n == 1) {
             // scan ended (y reached the top vertex/edge)
-            p->nskip += (ymax + 1 - j);
-            p->nmiss += (ymax + 1 - j) * (p->xmax - p->xmin);
+            if (first_band(p)) {
+                p->nskip += (ymax + 1 - j);
+                p->nmiss += (ymax + 1 - j) * (p->xmax - p->xmin);
+            }
             break;
         } else if (n == 2 || n == 3) {
             // pixel centered on y is outside of scanner's limits or image [0, height - 1]
             // OR: limits (x1, x2) are equal (line width is 0)
-            p->nmiss += (p->xmax - p->xmin);
-            ++p->nskip;
+            if (first_band(p)) {
+                p->nmiss += (p->xmax - p->xmin);
+                ++p->nskip;
+            }
             continue;
-        } else {
+        } else if (first_band(p)) {
             // limits (x1, x2) are equal (line width is 0)
             p->nmiss += (p->xmax - p->xmin) - (xmax + 1 - xmin);
         }
 
+        if (processing_cancelled()) {
+            driz_error_set_message(p->error, _("Drizzle cancelled"));
+            return 1;
+        }
+        if (row_outside_band(p, j)) continue;
+
         for (i = xmin; i <= xmax; ++i) {
             float ox, oy;
             int chan = FC(j, i, cfadim, cfa);
 
             if (map_pixel(p->pixmap, i, j, &ox, &oy)) {
                 nhit = 0;
+                own = first_band(p);
 
             } else {
+                own = counts_miss_at(p, fortran_round(oy));
                 /* Offset within the subset */
                 xxi = ox - pfo;
                 xxa = ox + pfo;
@@ -416,8 +468,8 @@ do_kernel_gaussian(struct driz_param_t* p) {
 
                 nxi = MAX(fortran_round(xxi), 0);
                 nxa = MIN(fortran_round(xxa), osize[0]-1);
-                nyi = MAX(fortran_round(yyi), 0);
-                nya = MIN(fortran_round(yya), osize[1]-1);
+                nyi = MAX(fortran_round(yyi), p->band_ymin);
+                nya = MIN(MIN(fortran_round(yya), osize[1]-1), p->band_ymax);
 
                 nhit = 0;
 
@@ -458,7 +510,7 @@ do_kernel_gaussian(struct driz_param_t* p) {
             }
 
             /* Count cases where the pixel is off the output image */
-            if (nhit == 0) ++ p->nmiss;
+            if (nhit == 0 && own) ++ p->nmiss;
         }
     }
 
@@ -475,6 +527,7 @@ static int
 do_kernel_lanczos(struct driz_param_t* p) {
     struct scanner s;
     integer_t i, j, ii, jj, nxi, nxa, nyi, nya, nhit, ix, iy;
+    int own;
     integer_t /*ybounds[2],*/ osize[2];
     float scale2, vc[3], d, dow;
     float pfo, xx, yy, xxi, xxa, yyi, yya, w, dx, dy, dover;
@@ -506,8 +559,10 @@ do_kernel_lanczos(struct driz_param_t* p) {
 
     if (init_image_scanner(p, &s, &ymin, &ymax)) return 1;
 
-    p->nskip = (p->ymax - p->ymin) - (ymax - ymin);
-    p->nmiss = p->nskip * (p->xmax - p->xmin);
+    if (first_band(p)) {
+        p->nskip = (p->ymax - p->ymin) - (ymax - ymin);
+        p->nmiss = p->nskip * (p->xmax - p->xmin);
+    }
 
     /* This is the outer loop over all the lines in the input image */
 
@@ -517,26 +572,39 @@ do_kernel_lanczos(struct driz_param_t* p) {
         n = get_scanline_limits(&s, j, &xmin, &xmax);
         if (n == 1) {
             // scan ended (y reached the top vertex/edge)
-            p->nskip += (ymax + 1 - j);
-            p->nmiss += (ymax + 1 - j) * (p->xmax - p->xmin);
+            if (first_band(p)) {
+                p->nskip += (ymax + 1 - j);
+                p->nmiss += (ymax + 1 - j) * (p->xmax - p->xmin);
+            }
             break;
         } else if (n == 2 || n == 3) {
             // pixel centered on y is outside of scanner's limits or image [0, height - 1]
             // OR: limits (x1, x2) are equal (line width is 0)
-            p->nmiss += (p->xmax - p->xmin);
-            ++p->nskip;
+            if (first_band(p)) {
+                p->nmiss += (p->xmax - p->xmin);
+                ++p->nskip;
+            }
             continue;
-        } else {
+        } else if (first_band(p)) {
             // limits (x1, x2) are equal (line width is 0)
             p->nmiss += (p->xmax - p->xmin) - (xmax + 1 - xmin);
         }
 
+        if (processing_cancelled()) {
+            driz_error_set_message(p->error, _("Drizzle cancelled"));
+            free(lanczos.lut);
+            return 1;
+        }
+        if (row_outside_band(p, j)) continue;
+
         for (i = xmin; i <= xmax; ++i) {
             int chan = FC(j, i, cfadim, cfa);
             if (map_pixel(p->pixmap, i, j, &xx, &yy)) {
                 nhit = 0;
+                own = first_band(p);
 
             } else {
+                own = counts_miss_at(p, fortran_round(yy));
                 xxi = xx - dx - pfo;
                 xxa = xx - dx + pfo;
                 yyi = yy - dy - pfo;
@@ -544,8 +612,8 @@ do_kernel_lanczos(struct driz_param_t* p) {
 
                 nxi = MAX(fortran_round(xxi), 0);
                 nxa = MIN(fortran_round(xxa), osize[0]-1);
-                nyi = MAX(fortran_round(yyi), 0);
-                nya = MIN(fortran_round(yya), osize[1]-1);
+                nyi = MAX(fortran_round(yyi), p->band_ymin);
+                nya = MIN(MIN(fortran_round(yya), osize[1]-1), p->band_ymax);
 
                 nhit = 0;
 
@@ -584,7 +652,7 @@ do_kernel_lanczos(struct driz_param_t* p) {
             }
 
             /* Count cases where the pixel is off the output image */
-            if (nhit == 0) ++ p->nmiss;
+            if (nhit == 0 && own) ++ p->nmiss;
         }
     }
 
@@ -605,6 +673,7 @@ static int
 do_kernel_turbo(struct driz_param_t* p) {
     struct scanner s;
     integer_t i, j, ii, jj, nxi, nxa, nyi, nya, nhit, iis, iie, jjs, jje;
+    int own;
     integer_t osize[2];
     float vc[3], d, dow;
     float pfo, scale2, ac;
@@ -620,8 +689,10 @@ do_kernel_turbo(struct driz_param_t* p) {
 
     if (init_image_scanner(p, &s, &ymin, &ymax)) return 1;
 
-    p->nskip = (p->ymax - p->ymin) - (ymax - ymin);
-    p->nmiss = p->nskip * (p->xmax - p->xmin);
+    if (first_band(p)) {
+        p->nskip = (p->ymax - p->ymin) - (ymax - ymin);
+        p->nmiss = p->nskip * (p->xmax - p->xmin);
+    }
 
     /* This is the outer loop over all the lines in the input image */
 
@@ -632,28 +703,40 @@ do_kernel_turbo(struct driz_param_t* p) {
 
         if (n == 1) {
             // scan ended (y reached the top vertex/edge)
-            p->nskip += (ymax + 1 - j);
-            p->nmiss += (ymax + 1 - j) * (p->xmax - p->xmin);
+            if (first_band(p)) {
+                p->nskip += (ymax + 1 - j);
+                p->nmiss += (ymax + 1 - j) * (p->xmax - p->xmin);
+            }
             break;
         } else if (n == 2 || n == 3) {
             // pixel centered on y is outside of scanner's limits or image [0, height - 1]
             // OR: limits (x1, x2) are equal (line width is 0)
-            p->nmiss += (p->xmax - p->xmin);
-            ++p->nskip;
+            if (first_band(p)) {
+                p->nmiss += (p->xmax - p->xmin);
+                ++p->nskip;
+            }
             continue;
-        } else {
+        } else if (first_band(p)) {
             // limits (x1, x2) are equal (line width is 0)
             p->nmiss += (p->xmax - p->xmin) - (xmax + 1 - xmin);
         }
 
+        if (processing_cancelled()) {
+            driz_error_set_message(p->error, _("Drizzle cancelled"));
+            return 1;
+        }
+        if (row_outside_band(p, j)) continue;
+
         for (i = xmin; i <= xmax; ++i) {
             float ox, oy;
             int chan = FC(j, i, cfadim, cfa);
 
             if (map_pixel(p->pixmap, i, j, &ox, &oy)) {
                 nhit = 0;
+                own = first_band(p);
 
             } else {
+                own = counts_miss_at(p, fortran_round(oy));
                 /* Offset within the subset */
                 xxi = ox - pfo;
                 xxa = ox + pfo;
@@ -666,8 +749,8 @@ do_kernel_turbo(struct driz_param_t* p) {
                 nya = fortran_round(yya);
                 iis = MAX(nxi, 0);  /* Needed to be set to 0 to avoid edge effects */
                 iie = MIN(nxa, osize[0]-1);
-                jjs = MAX(nyi, 0);  /* Needed to be set to 0 to avoid edge effects */
-                jje = MIN(nya, osize[1]-1);
+                jjs = MAX(nyi, p->band_ymin);  /* Needed to be set to 0 to avoid edge effects */
+                jje = MIN(MIN(nya, osize[1]-1), p->band_ymax);
 
                 nhit = 0;
 
@@ -708,7 +791,7 @@ do_kernel_turbo(struct driz_param_t* p) {
             }
 
             /* Count cases where the pixel is off the output image */
-            if (nhit == 0) ++ p->nmiss;
+            if (nhit == 0 && own) ++ p->nmiss;
         }
     }
 
@@ -727,6 +810,7 @@ do_kernel_turbo(struct driz_param_t* p) {
 int
 do_kernel_square(struct driz_param_t* p) {
     integer_t i, j, ii, jj, min_ii, max_ii, min_jj, max_jj, nhit;
+    int own;
     integer_t osize[2];
     float scale2, vc[3], d, dow;
     float dh, jaco, tem, dover, w;
@@ -746,8 +830,10 @@ do_kernel_square(struct driz_param_t* p) {
        pixel */
     if (init_image_scanner(p, &s, &ymin, &ymax)) return 1;
 
-    p->nskip = (p->ymax - p->ymin) - (ymax - ymin);
-    p->nmiss = p->nskip * (p->xmax - p->xmin);
+    if (first_band(p)) {
+        p->nskip = (p->ymax - p->ymin) - (ymax - ymin);
+        p->nmiss = p->nskip * (p->xmax - p->xmin);
+    }
 
     /* This is the outer loop over all the lines in the input image */
     get_dimensions(p->output_data, osize);
@@ -756,20 +842,30 @@ do_kernel_square(struct driz_param_t* p) {
         n = get_scanline_limits(&s, j, &xmin, &xmax);
         if (n == 1) {
             // scan ended (y reached the top vertex/edge)
-            p->nskip += (ymax + 1 - j);
-            p->nmiss += (ymax + 1 - j) * (p->xmax - p->xmin);
+            if (first_band(p)) {
+                p->nskip += (ymax + 1 - j);
+                p->nmiss += (ymax + 1 - j) * (p->xmax - p->xmin);
+            }
             break;
         } else if (n == 2 || n == 3) {
             // pixel centered on y is outside of scanner's limits or image [0, height - 1]
             // OR: limits (x1, x2) are equal (line width is 0)
-            p->nmiss += (p->xmax - p->xmin);
-            ++p->nskip;
+            if (first_band(p)) {
+                p->nmiss += (p->xmax - p->xmin);
+                ++p->nskip;
+            }
             continue;
-        } else {
+        } else if (first_band(p)) {
             // limits (x1, x2) are equal (line width is 0)
             p->nmiss += (p->xmax - p->xmin) - (xmax + 1 - xmin);
         }
 
+        if (processing_cancelled()) {
+            driz_error_set_message(p->error, _("Drizzle cancelled"));
+            return 1;
+        }
+        if (row_outside_band(p, j)) continue;
+
         /* Set the input corner positions */
 
         yin[1] = yin[0] = (float) j + dh;
@@ -777,6 +873,7 @@ do_kernel_square(struct driz_param_t* p) {
 
         for (i = xmin; i <= xmax; ++i) {
             nhit = 0;
+            own = first_band(p);
             int chan = FC(j, i, cfadim, cfa);
 
             xin[3] = xin[0] = (float) i - dh;
@@ -814,8 +911,9 @@ do_kernel_square(struct driz_param_t* p) {
             }
 
             /* Loop over output pixels which could be affected */
-            min_jj = MAX(fortran_round(min_floats(yout, 4)), 0);
-            max_jj = MIN(fortran_round(max_floats(yout, 4)), osize[1]-1);
+            own = counts_miss_at(p, fortran_round(min_floats(yout, 4)));
+            min_jj = MAX(fortran_round(min_floats(yout, 4)), p->band_ymin);
+            max_jj = MIN(MIN(fortran_round(max_floats(yout, 4)), osize[1]-1), p->band_ymax);
             min_ii = MAX(fortran_round(min_floats(xout, 4)), 0);
             max_ii = MIN(fortran_round(max_floats(xout, 4)), osize[0]-1);
 			int area = (max_jj - min_jj) - (max_ii - min_ii);
@@ -851,13 +949,13 @@ do_kernel_square(struct driz_param_t* p) {
 
             /* Count cases where the pixel is off the output image */
             _miss:
-            if (nhit == 0) {
+            if (nhit == 0 && own) {
                 ++ p->nmiss;
             }
         }
     }
 
-    printf("do_square max area: %d. (%d, %d) to (%d, %d)\n", maxarea, mnii, mnjj, mxii, mxjj);
+    siril_debug_print("do_square max area: %d. (%d, %d) to (%d, %d)\n", maxarea, mnii, mnjj, mxii, mxjj);
     siril_debug_print("ending do_kernel_square\n");
     return 0;
 }
@@ -878,6 +976,74 @@ kernel_handler_map[] = {
     do_kernel_lanczos
 };
 
+/** --------------------------------------------------------------------------------------------------
+ * Reach of the kernels around the mapped pixel centers, in output pixels. It only needs to be an
+ * upper bound: it is used to find which bands of output rows an input row can contribute to.
+ */
+
+static float
+kernel_reach(const struct driz_param_t* p) {
+  return 2.f + 3.f * MAX(p->pixel_fraction, 1.2f) / p->scale;
+}
+
+/* output rows per band, below that the bookkeeping costs more than it saves */
+#define DRIZ_MIN_BAND_ROWS 16
+
+/** --------------------------------------------------------------------------------------------------
+ * Run the kernel on bands of output rows in parallel. There are more bands than threads so that
+ * the work stays balanced when the input image only covers a part of the output.
+ */
+
+static int
+dobox_banded(struct driz_param_t* p, kernel_handler_t kernel_handler, int nbands) {
+  integer_t ry = p->output_data->ry;
+  integer_t *row_ymin = malloc(p->pixmap->ry * 2 * sizeof(integer_t));
+  if (!row_ymin) {
+    return kernel_handler(p);
+  }
+  integer_t *row_ymax = row_ymin + p->pixmap->ry;
+  map_rows_output_extent(p->pixmap, ry, kernel_reach(p), row_ymin, row_ymax, p->threads);
+
+  integer_t nmiss = 0, nskip = 0;
+  int failed = 0;
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(p->threads) schedule(dynamic) reduction(+:nmiss,nskip)
+#endif
+  for (int b = 0; b < nbands; b++) {
+    struct driz_param_t band = *p;
+    struct driz_error_t error;
+    if (failed) continue;
+    driz_error_init(&error);
+    band.error = &error;
+    band.band_ymin = (integer_t)((size_t)ry * b / nbands);
+    band.band_ymax = (integer_t)((size_t)ry * (b + 1) / nbands) - 1;
+    band.row_ymin = row_ymin;
+    band.row_ymax = row_ymax;
+    band.nmiss = 0;
+    band.nskip = 0;
+
+    kernel_handler(&band);
+
+    nmiss += band.nmiss;
+    nskip += band.nskip;
+    if (driz_error_is_set(&error)) {
+#ifdef _OPENMP
+#pragma omp critical
+#endif
+      {
+        if (!driz_error_is_set(p->error))
+          driz_error_set_message(p->error, driz_error_get_message(&error));
+        failed = 1;
+      }
+    }
+  }
+
+  p->nmiss = nmiss;
+  p->nskip = nskip;
+  free(row_ymin);
+  return driz_error_is_set(p->error);
+}
+
 /** --------------------------------------------------------------------------------------------------
  * The executive function which calls the kernel which does the actual drizzling
  *
@@ -894,7 +1060,12 @@ dobox(struct driz_param_t* p) {
         kernel_handler = kernel_handler_map[p->kernel];
 
         if (kernel_handler != NULL) {
-            kernel_handler(p);
+            int nbands = MIN(p->threads * 4, p->output_data->ry / DRIZ_MIN_BAND_ROWS);
+            if (p->threads > 1 && nbands > 1) {
+                dobox_banded(p, kernel_handler, nbands);
+            } else {
+                kernel_handler(p);
+            }
         }
     }
 
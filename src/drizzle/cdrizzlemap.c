@@ -206,7 +206,6 @@ interpolate_point(struct driz_param_t *par, float xin, float yin,
 
 int map_image_coordinates_h(fits *fit, Homography H, imgmap_t *p, int target_rx, int target_ry, float scale, disto_data *disto, int threads) {
 	int source_rx, source_ry;
-	int index = 0;
 	source_rx = fit->rx;
 	source_ry = fit->ry;
 	/* Doing the calculations manually rather than using
@@ -223,10 +222,11 @@ int map_image_coordinates_h(fits *fit, Homography H, imgmap_t *p, int target_rx,
 	p->ymap = p->xmap + (source_rx * source_ry);
 
 	if (disto && (disto->dtype != DISTO_NONE)) {
-		if (disto->dtype == DISTO_S2D) { // no mapping, we need to create the distortion map
+		if (disto->dtype == DISTO_S2D) { // no mapping, we need to create the distortion map,
+			// interpolated on a grid when the error stays small enough
 			disto->xmap = p->xmap;
 			disto->ymap = p->ymap;
-			init_disto_map(source_rx, source_ry, disto);
+			init_disto_map(source_rx, source_ry, disto, threads);
 		} else if (disto->dtype == DISTO_MAP_S2D) { // mapping exists, we just copy
 			size_t sz = source_rx * source_ry;
 			memcpy(p->xmap, disto->xmap, sz * sizeof(float));
@@ -235,13 +235,17 @@ int map_image_coordinates_h(fits *fit, Homography H, imgmap_t *p, int target_rx,
 			siril_debug_print("trying to pass an invalid disto type for drizzle, aborting\n");
 			return 1;
 		}
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(threads) schedule(static) if (threads > 1)
+#endif
 		for (int y = 0; y < source_ry; y++) {
+			size_t idx = (size_t)y * source_rx;
 			for (int x = 0; x < source_rx; x++) {
-				float x0 = p->xmap[index];
-				float y0 = p->ymap[index];
+				float x0 = p->xmap[idx];
+				float y0 = p->ymap[idx];
 				float z = 1. / (x0 * Harr[6] + y0 * Harr[7] + Harr[8]);
-				p->xmap[index] = (x0 * Harr[0] + y0 * Harr[1] + Harr[2]) * z;
-				p->ymap[index++] = (x0 * Harr[3] + y0 * Harr[4] + Harr[5]) * z;
+				p->xmap[idx] = (x0 * Harr[0] + y0 * Harr[1] + Harr[2]) * z;
+				p->ymap[idx++] = (x0 * Harr[3] + y0 * Harr[4] + Harr[5]) * z;
 			}
 		}
 		return 0;
@@ -254,16 +258,83 @@ int map_image_coordinates_h(fits *fit, Homography H, imgmap_t *p, int target_rx,
 		float y1 = y0 * Harr[7] + Harr[8];
 		float y2 = y0 * Harr[1] + Harr[2];
 		float y3 = y0 * Harr[4] + Harr[5];
+		size_t idx = (size_t)y * source_rx;
 		for (int x = 0; x < source_rx; x++) {
 			float x0 = (float) x;
 			float z = 1. / (x0 * Harr[6] + y1);
-			p->xmap[index] = (x0 * Harr[0] + y2) * z;
-			p->ymap[index++] = (x0 * Harr[3] + y3) * z;
+			p->xmap[idx] = (x0 * Harr[0] + y2) * z;
+			p->ymap[idx++] = (x0 * Harr[3] + y3) * z;
 		}
 	}
 	return 0;
 }
 
+/** ---------------------------------------------------------------------------
+ * Compute, for each line of the input image, the range of output lines that
+ * its pixels can reach when drizzled.
+ *
+ * p: The mapping of the pixel centers from input to output image
+ * out_ry: height of the output image
+ * pad: reach of the kernel around the mapped centers, in output pixels
+ * rmin, rmax: arrays of p->ry elements receiving the first and last output
+ *             lines, clamped to [0, out_ry - 1] (output)
+ *
+ * The pixel centers of the neighbouring lines are included because the
+ * square kernel interpolates the pixel corners between them. Lines that
+ * don't map at all are assigned to output line 0.
+ */
+void
+map_rows_output_extent(imgmap_t *p, integer_t out_ry, float pad,
+                       integer_t *rmin, integer_t *rmax, int threads) {
+	float *lo = malloc(p->ry * 2 * sizeof(float));
+	if (!lo) {
+		for (int y = 0; y < p->ry; y++) {
+			rmin[y] = 0;
+			rmax[y] = out_ry - 1;
+		}
+		return;
+	}
+	float *hi = lo + p->ry;
+
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(threads) schedule(static) if (threads > 1)
+#endif
+	for (int y = 0; y < p->ry; y++) {
+		const float *ymap = p->ymap + (size_t)y * p->rx;
+		float l = MAX_SINGLE, h = -MAX_SINGLE;
+		for (int x = 0; x < p->rx; x++) {
+			float v = ymap[x];
+			if (npy_isnan(v))
+				continue;
+			if (v < l) l = v;
+			if (v > h) h = v;
+		}
+		lo[y] = l;
+		hi[y] = h;
+	}
+
+	for (int y = 0; y < p->ry; y++) {
+		float l = lo[y], h = hi[y];
+		if (y > 0) {
+			l = MIN(l, lo[y - 1]);
+			h = MAX(h, hi[y - 1]);
+		}
+		if (y < p->ry - 1) {
+			l = MIN(l, lo[y + 1]);
+			h = MAX(h, hi[y + 1]);
+		}
+		if (l > h) {
+			rmin[y] = rmax[y] = 0;
+			continue;
+		}
+		l = floorf(l - pad);
+		h = ceilf(h + pad);
+		rmin[y] = l <= 0.f ? 0 : l >= (float)(out_ry - 1) ? out_ry - 1 : (integer_t)l;
+		rmax[y] = h <= 0.f ? 0 : h >= (float)(out_ry - 1) ? out_ry - 1 : (integer_t)h;
+	}
+	free(lo);
+}
+
 /** ---------------------------------------------------------------------------
  * Map an integer pixel position from the input to the output image.
  * Fall back on interpolation if the value at the point is undefined
@@ -140,6 +140,10 @@ map_point(struct driz_param_t *par, float xin, float yin,
 int
 map_pixel(imgmap_t *pixmap, int i, int j, float *x, float *y);
 
+void
+map_rows_output_extent(imgmap_t *p, integer_t out_ry, float pad,
+                       integer_t *rmin, integer_t *rmax, int threads);
+
 int
 shrink_image_section(fits *pixmap, int *xmin, int *xmax,
                      int *ymin, int *ymax);
@@ -42,6 +42,7 @@ OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "core/siril_log.h"
 
 #include <assert.h>
+#include <limits.h>
 #define _USE_MATH_DEFINES       /* needed for MS Windows to define M_PI */
 #include <math.h>
 #include <stdarg.h>
@@ -156,6 +157,12 @@ driz_param_init(struct driz_param_t* p) {
   p->output_data = NULL;
   p->output_counts = NULL;
 
+  /* Output bands */
+  p->band_ymin = 0;
+  p->band_ymax = INT_MAX;
+  p->row_ymin = NULL;
+  p->row_ymax = NULL;
+
   p->nmiss = 0;
   p->nskip = 0;
   p->error = NULL;
@@ -208,6 +208,14 @@ struct driz_param_t {
   fits *output_data;
   fits *output_counts;  /* was: COU */
 
+  /* Output rows [band_ymin, band_ymax] the kernel is allowed to write, and
+     for each input row the range of output rows it can reach, NULL when not
+     computed. Used by dobox() to drizzle in parallel bands of output rows */
+  integer_t band_ymin;
+  integer_t band_ymax;
+  const integer_t *row_ymin;
+  const integer_t *row_ymax;
+
   /* Other output */
   integer_t nmiss;
   integer_t nskip;
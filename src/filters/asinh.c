@@ -36,6 +36,7 @@
 #include "core/undo.h"
 
 #include "asinh.h"
+#include "point_ops.h"
 
 static gboolean asinh_rgb_space = FALSE;
 static float asinh_stretch_value = 0.0f, asinh_black_value = 0.0f;
@@ -180,15 +181,10 @@ int asinhlut_ushort(fits *fit, float beta, float offset, gboolean human_luminanc
 			}
 		}
 	} else {
-#ifdef _OPENMP
-#pragma omp parallel for num_threads(com.max_thread) schedule(dynamic, fit->rx * 16)
-#endif
-		for (i = 0; i < n; i++) {
-			float x = buf[RLAYER][i] * invnorm;
-			float xprime = max(0, (x - offset) / (1.0f - offset));
-			float k = (xprime == 0.0f) ? 0.0f : (beta == 0.0f) ? 1.0f : asinhf(beta * xprime) / (xprime * asinh_beta);
-			buf[RLAYER][i] = roundf_to_WORD(norm * min(1.0f, max(0.0f,(xprime) * k)));
-		}
+		struct point_pipeline pipeline;
+		point_pipeline_init(&pipeline);
+		point_pipeline_add_asinh(&pipeline, beta, offset);
+		point_pipeline_apply(&pipeline, fit, fit, TRUE);
 	}
 	invalidate_stats_from_fit(fit);
 	return 0;
@@ -276,16 +272,10 @@ static int asinhlut_float(fits *fit, float beta, float offset, gboolean human_lu
 			}
 		}
 	} else {
-#ifdef _OPENMP
-#pragma omp parallel for num_threads(com.max_thread) schedule(static)
-#endif
-		for (i = 0; i < n; i++) {
-			float x, k;
-			x = buf[RLAYER][i];
-			float xprime = max(0.0f, (x - offset) / (1.0f - offset));
-			k = (xprime == 0.0f) ? 0.0f : (beta == 0.0f) ? 1.0f : asinhf(beta * xprime) / (xprime * asinh_beta);
-			buf[RLAYER][i] = min(1.0f, max(0.0f,(xprime * k)));
-		}
+		struct point_pipeline pipeline;
+		point_pipeline_init(&pipeline);
+		point_pipeline_add_asinh(&pipeline, beta, offset);
+		point_pipeline_apply(&pipeline, fit, fit, TRUE);
 	}
 	invalidate_stats_from_fit(fit);
 	return 0;
@@ -19,11 +19,9 @@
 */
 #include <float.h>
 #include <string.h>
-#include <gsl/gsl_statistics.h>
 
 #include "core/siril.h"
 #include "core/proto.h"
-#include "core/arithm.h"
 #include "core/undo.h"
 #include "core/processing.h"
 #include "core/OS_utils.h"
@@ -38,7 +36,6 @@
 #include "io/single_image.h"
 #include "io/image_format_fits.h"
 #include "io/sequence.h"
-#include "opencv/opencv.h"
 
 #include "banding.h"
 static int BandingEngine(fits *fit, double sigma, double amount, gboolean protect_highlights, gboolean applyRotation, threading_type threading);
@@ -50,14 +47,12 @@ static int BandingEngine(fits *fit, double sigma, double amount, gboolean protec
 int banding_image_hook(struct generic_seq_args *args, int o, int i, fits *fit, rectangle *_, int threads) {
 	struct banding_data *banding_args = (struct banding_data *)args->user;
 	return BandingEngine(fit, banding_args->sigma, banding_args->amount,
-			banding_args->protect_highlights, banding_args->applyRotation, SINGLE_THREADED);
+			banding_args->protect_highlights, banding_args->applyRotation, threads);
 }
 
 static int banding_mem_limits_hook(struct generic_seq_args *args, gboolean for_writer) {
-	/* [rotation => O(2n)]
-	 * new image -> O(2n)
+	/* the image is corrected in place
 	 * + stats MAD per channel -> O(1m)
-	 * [rotation => O(2n)]
 	 */
 	unsigned int MB_per_image, MB_avail;
 	int limit = compute_nb_images_fit_memory(args->seq, 1.0, FALSE, &MB_per_image, NULL, &MB_avail);
@@ -65,7 +60,7 @@ static int banding_mem_limits_hook(struct generic_seq_args *args, gboolean for_w
 	if (limit > 0) {
 		int is_color = args->seq->nb_layers == 3;
 		unsigned int MB_per_channel = is_color ? MB_per_image / 3 : MB_per_image;
-		required = 2 * MB_per_image + MB_per_channel;
+		required = MB_per_image + MB_per_channel;
 		int thread_limit = MB_avail / required;
 		if (thread_limit > com.max_thread)
                         thread_limit = com.max_thread;
@@ -147,34 +142,6 @@ gboolean end_BandingEngine(gpointer p) {
 	return FALSE;
 }
 
-static int fmul_layer_ushort(fits *a, int layer, float coeff) {
-	WORD *buf;
-	size_t i, n = a->naxes[0] * a->naxes[1];
-
-	if (coeff < 0.0)
-		return 1;
-	buf = a->pdata[layer];
-	for (i = 0; i < n; ++i) {
-		buf[i] = round_to_WORD(buf[i] * coeff);
-	}
-	invalidate_stats_from_fit(a);
-	return 0;
-}
-
-static int fmul_layer_float(fits *a, int layer, float coeff) {
-	float *buf;
-	size_t i, n = a->naxes[0] * a->naxes[1];
-
-	if (coeff < 0.0)
-		return 1;
-	buf = a->fpdata[layer];
-	for (i = 0; i < n; ++i) {
-		buf[i] = buf[i] * coeff;
-	}
-	invalidate_stats_from_fit(a);
-	return 0;
-}
-
 /*** Reduces Banding in Canon DSLR images.
  * This code come from CanonBandingReduction.js v0.9.1, a script of
  * PixInsight, originally written by Georg Viehoever and
@@ -195,177 +162,204 @@ gpointer BandingEngineThreaded(gpointer p) {
 	return GINT_TO_POINTER(retval);
 }
 
-static int BandingEngine_ushort(fits *fit, double sigma, double amount, gboolean protect_highlights, gboolean applyRotation, threading_type threads) {
-	int chan, row, i, ret = 0;
-	WORD *line, *fixline;
-	double minimum = DBL_MAX, globalsigma = 0.0;
-	fits *fiximage = NULL;
-	double invsigma = 1.0 / sigma;
+/* The banding is measured on the lines of the image, the rows, or the columns
+ * for vertical banding, as the difference between the median of the channel
+ * and the median of each line. With protect_highlights, the pixels above the
+ * background by more than invsigma times the noise are excluded from the line
+ * medians. The lines are measured in parallel, then all pixels are corrected
+ * in place, in parallel over the rows. */
+
+/* median of the pixels of a line below reject, with a histogram of the high
+ * bytes of the values and one of the low bytes of the values having the high
+ * byte of the median; h has 256 bins. Returns -1 if no pixel is below reject */
+static int ushort_line_rank(const WORD *line, size_t stride, int n, int reject, size_t rank, unsigned int *h) {
+	memset(h, 0, 256 * sizeof(unsigned int));
+	for (int i = 0; i < n; i++) {
+		int v = line[i * stride];
+		if (v < reject)
+			h[v >> 8]++;
+	}
+	int hi = 0;
+	size_t below = 0;
+	while (hi < 256 && below + h[hi] <= rank)
+		below += h[hi++];
+	if (hi == 256)
+		return -1;
+	memset(h, 0, 256 * sizeof(unsigned int));
+	for (int i = 0; i < n; i++) {
+		int v = line[i * stride];
+		if (v < reject && (v >> 8) == hi)
+			h[v & 0xff]++;
+	}
+	int lo = 0;
+	while (below + h[lo] <= rank)
+		below += h[lo++];
+	return (hi << 8) | lo;
+}
 
-	if (applyRotation) {
-		if (cvRotateImage(fit, 90)) return 1;
+static gboolean ushort_line_median(const WORD *line, size_t stride, int n, int reject, unsigned int *h, double *median) {
+	size_t count = 0;
+	for (int i = 0; i < n; i++)
+		count += line[i * stride] < reject;
+	if (!count)
+		return FALSE;
+	int a = ushort_line_rank(line, stride, n, reject, (count - 1) / 2, h);
+	int b = count % 2 ? a : ushort_line_rank(line, stride, n, reject, count / 2, h);
+	*median = (a + b) / 2.0;
+	return TRUE;
+}
+
+/* buf has room for a line */
+static gboolean float_line_median(const float *line, size_t stride, int n, float reject, float *buf, double *median) {
+	size_t count = 0;
+	for (int i = 0; i < n; i++) {
+		float v = line[i * stride];
+		if (v < reject)
+			buf[count++] = v;
 	}
+	if (!count)
+		return FALSE;
+	*median = quickmedian_float(buf, count);
+	return TRUE;
+}
 
-	if (new_fit_image(&fiximage, fit->rx, fit->ry, fit->naxes[2], DATA_USHORT))
-		return 1;
+/* corrections of the lines of all channels, in the data range of the image */
+static float *banding_corrections(fits *fit, double sigma, double amount,
+		gboolean protect_highlights, gboolean vertical, int threads) {
+	const size_t rx = fit->rx, ry = fit->ry;
+	const int nlines = vertical ? rx : ry;
+	const int length = vertical ? ry : rx;
+	const size_t step = vertical ? rx : 1;		// between the pixels of a line
+	const size_t line_step = vertical ? 1 : rx;	// between the lines
+	const double invsigma = 1.0 / sigma;
+	double minimum = DBL_MAX;
+
+	float *fix = malloc(fit->naxes[2] * nlines * sizeof(float));
+	double *rowvalue = malloc(nlines * sizeof(double));
+	if (!fix || !rowvalue) {
+		PRINT_ALLOC_ERR;
+		free(fix);
+		free(rowvalue);
+		return NULL;
+	}
 
-	for (chan = 0; chan < fit->naxes[2]; chan++) {
+	for (int chan = 0; chan < fit->naxes[2]; chan++) {
 		imstats *stat = statistics(NULL, -1, fit, chan, NULL, STATS_BASIC | STATS_MAD, threads);
 		if (!stat) {
 			siril_log_message(_("Error: statistics computation failed.\n"));
-			clearfits(fiximage);
-			return 1;
-		}
-		double background = stat->median;
-		double *rowvalue = calloc(fit->ry, sizeof(double));
-		if (rowvalue == NULL) {
-			PRINT_ALLOC_ERR;
-			clearfits(fiximage);
-			free_stats(stat);
-			return 1;
-		}
-		if (protect_highlights) {
-			globalsigma = stat->mad * MAD_NORM;
+			free(fix);
+			free(rowvalue);
+			return NULL;
 		}
+		const double background = stat->median;
+		const double globalsigma = protect_highlights ? stat->mad * MAD_NORM : 0.0;
 		free_stats(stat);
-		for (row = 0; row < fit->ry; row++) {
-			line = fit->pdata[chan] + row * fit->rx;
-			WORD *cpyline = calloc(fit->rx, sizeof(WORD));
-			if (cpyline == NULL) {
+
+		int retval = 0;
+#ifdef _OPENMP
+#pragma omp parallel num_threads(threads) if (threads > 1)
+#endif
+		{
+			void *buf = fit->type == DATA_USHORT ? malloc(256 * sizeof(unsigned int)) : malloc(length * sizeof(float));
+			if (!buf) {
 				PRINT_ALLOC_ERR;
-				free(rowvalue);
-				clearfits(fiximage);
-				return 1;
-			}
-			memcpy(cpyline, line, fit->rx * sizeof(WORD));
-			int n = fit->rx;
-			double median;
-			if (protect_highlights) {
-				quicksort_s(cpyline, n);
-				WORD reject = round_to_WORD(
-						background + invsigma * globalsigma);
-				for (i = fit->rx - 1; i >= 0; i--) {
-					if (cpyline[i] < reject)
-						break;
-					n--;
-				}
-				median = gsl_stats_ushort_median_from_sorted_data(cpyline, 1, n);
+#ifdef _OPENMP
+#pragma omp atomic write
+#endif
+				retval = 1;
 			} else {
-				median = round_to_WORD(quickmedian(cpyline, n));
+#ifdef _OPENMP
+#pragma omp for schedule(static)
+#endif
+				for (int l = 0; l < nlines; l++) {
+					double median = background;
+					if (fit->type == DATA_USHORT) {
+						int reject = protect_highlights ? round_to_WORD(background + invsigma * globalsigma) : USHRT_MAX + 1;
+						if (ushort_line_median(fit->pdata[chan] + l * line_step, step, length, reject, buf, &median) && !protect_highlights)
+							median = round_to_WORD(median);
+					} else {
+						float reject = protect_highlights ? (float) (background + invsigma * globalsigma) : FLT_MAX;
+						float_line_median(fit->fpdata[chan] + l * line_step, step, length, reject, buf, &median);
+					}
+					rowvalue[l] = background - median;
+				}
+				free(buf);
 			}
-
-			rowvalue[row] = background - median;
-			minimum = min(minimum, rowvalue[row]);
-			free(cpyline);
 		}
-		for (row = 0; row < fit->ry; row++) {
-			fixline = fiximage->pdata[chan] + row * fiximage->rx;
-			for (i = 0; i < fit->rx; i++)
-				fixline[i] = round_to_WORD(rowvalue[row] - minimum);
+		if (retval) {
+			free(fix);
+			free(rowvalue);
+			return NULL;
 		}
-		free(rowvalue);
-	}
-	for (chan = 0; chan < fit->naxes[2]; chan++)
-		fmul_layer_ushort(fiximage, chan, amount);
-	ret = imoper(fit, fiximage, OPER_ADD, FALSE);
 
-	invalidate_stats_from_fit(fit);
-	clearfits(fiximage);
-	if ((!ret) && applyRotation) {
-		if (cvRotateImage(fit, -90)) return 1;
+		/* the minimum is kept from the previous channels */
+		for (int l = 0; l < nlines; l++)
+			minimum = min(minimum, rowvalue[l]);
+		float *chanfix = fix + chan * nlines;
+		for (int l = 0; l < nlines; l++) {
+			if (fit->type == DATA_USHORT)
+				chanfix[l] = round_to_WORD(round_to_WORD(rowvalue[l] - minimum) * (float) amount);
+			else chanfix[l] = (float) (rowvalue[l] - minimum) * (float) amount;
+		}
 	}
-
-	return ret;
+	free(rowvalue);
+	return fix;
 }
 
-static int BandingEngine_float(fits *fit, double sigma, double amount, gboolean protect_highlights, gboolean applyRotation, threading_type threads) {
-	int chan, row, i, ret = 0;
-	float *line, *fixline;
-	double minimum = DBL_MAX, globalsigma = 0.0;
-	fits *fiximage = NULL;
-	double invsigma = 1.0 / sigma;
-
-	if (applyRotation) {
-		if (cvRotateImage(fit, 90)) return 1;
-	}
+static int BandingEngine(fits *fit, double sigma, double amount, gboolean protect_highlights, gboolean applyRotation, threading_type threading) {
+	int threads = check_threading(&threading);
+	if (fit->type != DATA_USHORT && fit->type != DATA_FLOAT)
+		return -1;
 
-	if (new_fit_image(&fiximage, fit->rx, fit->ry, fit->naxes[2], DATA_FLOAT))
+	float *fix = banding_corrections(fit, sigma, amount, protect_highlights, applyRotation, threads);
+	if (!fix)
 		return 1;
 
-	for (chan = 0; chan < fit->naxes[2]; chan++) {
-		imstats *stat = statistics(NULL, -1, fit, chan, NULL, STATS_BASIC | STATS_MAD, threads);
-		if (!stat) {
-			siril_log_message(_("Error: statistics computation failed.\n"));
-			return 1;
-		}
-		double background = stat->median;
-		double *rowvalue = calloc(fit->ry, sizeof(double));
-		if (rowvalue == NULL) {
-			PRINT_ALLOC_ERR;
-			free_stats(stat);
-			return 1;
-		}
-		if (protect_highlights) {
-			globalsigma = stat->mad * MAD_NORM;
-		}
-		free_stats(stat);
-		for (row = 0; row < fit->ry; row++) {
-			line = fit->fpdata[chan] + row * fit->rx;
-			float *cpyline = calloc(fit->rx, sizeof(float));
-			if (cpyline == NULL) {
-				PRINT_ALLOC_ERR;
-				free(rowvalue);
-				return 1;
-			}
-			memcpy(cpyline, line, fit->rx * sizeof(float));
-			int n = fit->rx;
-			double median;
-			if (protect_highlights) {
-				quicksort_f(cpyline, n);
-				float reject = background + invsigma * globalsigma;
-				for (i = fit->rx - 1; i >= 0; i--) {
-					if (cpyline[i] < reject)
-						break;
-					n--;
+	const size_t rx = fit->rx, ry = fit->ry;
+	const int nlines = applyRotation ? rx : ry;
+	for (int chan = 0; chan < fit->naxes[2]; chan++) {
+		const float *chanfix = fix + chan * nlines;
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(threads) schedule(static) if (threads > 1)
+#endif
+		for (size_t y = 0; y < ry; y++) {
+			if (fit->type == DATA_USHORT) {
+				WORD *line = fit->pdata[chan] + y * rx;
+				if (applyRotation) {
+#ifdef _OPENMP
+#pragma omp simd
+#endif
+					for (size_t x = 0; x < rx; x++) {
+						int v = (int) line[x] + (int) chanfix[x];
+						line[x] = v > USHRT_MAX ? USHRT_MAX : (WORD) v;
+					}
+				} else {
+					const int f = (int) chanfix[y];
+#ifdef _OPENMP
+#pragma omp simd
+#endif
+					for (size_t x = 0; x < rx; x++) {
+						int v = (int) line[x] + f;
+						line[x] = v > USHRT_MAX ? USHRT_MAX : (WORD) v;
+					}
 				}
-				median = gsl_stats_float_median_from_sorted_data(cpyline, 1, n);
 			} else {
-				median = quickmedian_float(cpyline, n);
+				float *line = fit->fpdata[chan] + y * rx;
+				/* clipped like imoper_to_float() */
+#ifdef _OPENMP
+#pragma omp simd
+#endif
+				for (size_t x = 0; x < rx; x++) {
+					float v = line[x] + (applyRotation ? chanfix[x] : chanfix[y]);
+					v = v > 1.0f ? 1.0f : v;
+					line[x] = v < -1.0f ? 0.0f : v;
+				}
 			}
-
-			rowvalue[row] = background - median;
-			minimum = min(minimum, rowvalue[row]);
-			free(cpyline);
 		}
-		for (row = 0; row < fit->ry; row++) {
-			fixline = fiximage->fpdata[chan] + row * fiximage->rx;
-			for (i = 0; i < fit->rx; i++)
-				fixline[i] = rowvalue[row] - minimum;
-		}
-		free(rowvalue);
 	}
-	for (chan = 0; chan < fit->naxes[2]; chan++)
-		fmul_layer_float(fiximage, chan, amount);
-	ret = imoper(fit, fiximage, OPER_ADD, TRUE);
-
+	free(fix);
 	invalidate_stats_from_fit(fit);
-	clearfits(fiximage);
-	free(fiximage);
-	if ((!ret) && applyRotation) {
-		if (cvRotateImage(fit, -90)) return 1;
-	}
-
-	return ret;
-}
-
-static int BandingEngine(fits *fit, double sigma, double amount, gboolean protect_highlights, gboolean applyRotation, threading_type threading) {
-	int threads = check_threading(&threading);
-
-	if (fit->type == DATA_FLOAT)
-		return BandingEngine_float(fit, sigma, amount, protect_highlights, applyRotation, threads);
-	if (fit->type == DATA_USHORT)
-		return BandingEngine_ushort(fit, sigma, amount, protect_highlights, applyRotation, threads);
-	return -1;
+	return 0;
 }
 
 /***************** GUI for Canon Banding Reduction ********************/
@@ -19,7 +19,7 @@
  */
 
 #include <string.h>
-#include <opencv2/core/version.hpp>
+#include <math.h>
 
 #include "core/siril.h"
 #include "core/proto.h"
@@ -27,7 +27,7 @@
 #include "core/processing.h"
 #include "core/undo.h"
 #include "algos/colors.h"
-#include "opencv/opencv.h"
+#include "gui/callbacks.h"
 #include "gui/image_display.h"
 #include "gui/dialogs.h"
 #include "gui/progress_and_log.h"
@@ -43,7 +43,20 @@ static double clahe_limit_value;
 static int clahe_tile_size;
 static gboolean clahe_show_preview;
 
+static int clahe_update_preview();
+
+void clahe_change_between_roi_and_image() {
+	gui.roi.operation_supports_roi = TRUE;
+	// If we are showing the preview, update it after the ROI change.
+	update_image *param = malloc(sizeof(update_image));
+	param->update_preview_fn = clahe_update_preview;
+	param->show_preview = clahe_show_preview;
+	notify_update((gpointer) param);
+}
+
 static void clahe_startup() {
+	add_roi_callback(clahe_change_between_roi_and_image);
+	roi_supported(TRUE);
 	copy_gfit_to_backup();
 	clahe_limit_value = 2.0;
 	clahe_tile_size = 8;
@@ -58,6 +71,8 @@ static void clahe_close(gboolean revert) {
 		undo_save_state(get_preview_gfit_backup(),
 				_("CLAHE (size=%d, clip=%.2f)"), clahe_tile_size, clahe_limit_value);
 	}
+	roi_supported(FALSE);
+	remove_roi_callback(clahe_change_between_roi_and_image);
 	clear_backup();
 	set_cursor_waiting(FALSE);
 }
@@ -69,7 +84,7 @@ static int clahe_update_preview() {
 
 	set_cursor_waiting(TRUE);
 
-	args->fit = &gfit;
+	args->fit = gui.roi.active ? &gui.roi.fit : &gfit;
 	args->clip = clahe_limit_value;
 	args->tileSize = clahe_tile_size;
 
@@ -90,10 +105,294 @@ static gboolean end_clahe(gpointer p) {
 	return FALSE;
 }
 
+/* Native CLAHE engine, working on a plane of float values in [0, 1].
+ * It follows what OpenCV does on 16-bit data: the contrast limit is given
+ * relative to the height of a uniform histogram, the excess of the clipped
+ * bins is redistributed to all bins, and the mapping of each pixel is a
+ * bilinear interpolation of the mappings of the four nearest tiles. The
+ * mappings are interpolated between the bins, so float data keeps its
+ * precision. */
+
+#define CLAHE_MAX_BINS 65536
+#define CLAHE_MIN_BINS 1024
+#define CLAHE_MAX_LUT_MB 256
+
+/* position of a pixel along an axis between the centres of two tiles */
+struct clahe_axis {
+	int t0, t1;
+	float w;	// weight of t1
+};
+
+static struct clahe_axis *clahe_axis_weights(int length, int ntiles) {
+	struct clahe_axis *axis = malloc(length * sizeof(struct clahe_axis));
+	if (!axis)
+		return NULL;
+	float tile = (float) length / ntiles;
+	for (int x = 0; x < length; x++) {
+		float t = (x + 0.5f) / tile - 0.5f;
+		int t0 = (int) floorf(t);
+		float w = t - t0;
+		if (t0 < 0) {
+			t0 = 0;
+			w = 0.f;
+		} else if (t0 >= ntiles - 1) {
+			t0 = ntiles - 1;
+			w = 0.f;
+		}
+		axis[x].t0 = t0;
+		axis[x].t1 = min(t0 + 1, ntiles - 1);
+		axis[x].w = w;
+	}
+	return axis;
+}
+
+static inline int clahe_bin(float v, int nbins) {
+	if (v <= 0.f)
+		return 0;
+	if (v >= 1.f)
+		return nbins - 1;
+	return (int) (v * (nbins - 1) + 0.5f);
+}
+
+static inline float clahe_lut_value(const float *lut, float v, int nbins) {
+	if (v <= 0.f)
+		return lut[0];
+	if (v >= 1.f)
+		return lut[nbins - 1];
+	float p = v * (nbins - 1);
+	int k = (int) p;
+	if (k >= nbins - 1)
+		return lut[nbins - 1];
+	float f = p - k;
+	return lut[k] + f * (lut[k + 1] - lut[k]);
+}
+
+/* clips the histogram and makes the cumulative mapping of a tile */
+static void clahe_tile_lut(unsigned int *hist, float *lut, int nbins, size_t area, double clip) {
+	if (clip > 0.0) {
+		unsigned int limit = max((unsigned int) (clip * area / nbins), 1u);
+		size_t excess = 0;
+#ifdef _OPENMP
+#pragma omp simd reduction(+:excess)
+#endif
+		for (int k = 0; k < nbins; k++) {
+			unsigned int over = hist[k] > limit ? hist[k] - limit : 0u;
+			excess += over;
+			hist[k] -= over;
+		}
+		unsigned int batch = excess / nbins;
+		size_t residual = excess - (size_t) batch * nbins;
+#ifdef _OPENMP
+#pragma omp simd
+#endif
+		for (int k = 0; k < nbins; k++)
+			hist[k] += batch;
+		if (residual) {
+			size_t step = max((size_t) nbins / residual, (size_t) 1);
+			for (size_t k = 0; k < (size_t) nbins && residual > 0; k += step, residual--)
+				hist[k]++;
+		}
+	}
+	float scale = 1.f / area;
+	size_t sum = 0;
+	for (int k = 0; k < nbins; k++) {
+		sum += hist[k];
+		lut[k] = sum * scale;
+	}
+}
+
+static int clahe_plane(float *plane, int rx, int ry, double clip, int size, int threads) {
+	int ntx = min(size, rx), nty = min(size, ry);
+	size_t ntiles = (size_t) ntx * nty;
+	int nbins = CLAHE_MAX_BINS;
+	while (nbins > CLAHE_MIN_BINS && ntiles * nbins * sizeof(float) > (size_t) CLAHE_MAX_LUT_MB * BYTES_IN_A_MB)
+		nbins >>= 1;
+
+	float *luts = malloc(ntiles * nbins * sizeof(float));
+	struct clahe_axis *ax = clahe_axis_weights(rx, ntx);
+	struct clahe_axis *ay = clahe_axis_weights(ry, nty);
+	if (!luts || !ax || !ay) {
+		PRINT_ALLOC_ERR;
+		free(luts);
+		free(ax);
+		free(ay);
+		return 1;
+	}
+
+	int retval = 0;
+#ifdef _OPENMP
+#pragma omp parallel num_threads(threads) if (threads > 1)
+#endif
+	{
+		unsigned int *hist = malloc(nbins * sizeof(unsigned int));
+		if (!hist) {
+			PRINT_ALLOC_ERR;
+#ifdef _OPENMP
+#pragma omp atomic write
+#endif
+			retval = 1;
+		} else {
+#ifdef _OPENMP
+#pragma omp for schedule(dynamic)
+#endif
+			for (size_t t = 0; t < ntiles; t++) {
+				int tx = t % ntx, ty = t / ntx;
+				int x0 = (int) ((size_t) tx * rx / ntx), x1 = (int) ((size_t) (tx + 1) * rx / ntx);
+				int y0 = (int) ((size_t) ty * ry / nty), y1 = (int) ((size_t) (ty + 1) * ry / nty);
+				memset(hist, 0, nbins * sizeof(unsigned int));
+				for (int y = y0; y < y1; y++) {
+					const float *row = plane + (size_t) y * rx;
+					for (int x = x0; x < x1; x++)
+						hist[clahe_bin(row[x], nbins)]++;
+				}
+				clahe_tile_lut(hist, luts + t * nbins, nbins, (size_t) (x1 - x0) * (y1 - y0), clip);
+			}
+			free(hist);
+		}
+	}
+
+	if (!retval) {
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(threads) schedule(static) if (threads > 1)
+#endif
+		for (int y = 0; y < ry; y++) {
+			float *row = plane + (size_t) y * rx;
+			const float *lut_row0 = luts + (size_t) ay[y].t0 * ntx * nbins;
+			const float *lut_row1 = luts + (size_t) ay[y].t1 * ntx * nbins;
+			float wy = ay[y].w;
+			for (int x = 0; x < rx; x++) {
+				float v = row[x];
+				size_t o0 = (size_t) ax[x].t0 * nbins, o1 = (size_t) ax[x].t1 * nbins;
+				float wx = ax[x].w;
+				float top = (1.f - wx) * clahe_lut_value(lut_row0 + o0, v, nbins) +
+					wx * clahe_lut_value(lut_row0 + o1, v, nbins);
+				float bottom = (1.f - wx) * clahe_lut_value(lut_row1 + o0, v, nbins) +
+					wx * clahe_lut_value(lut_row1 + o1, v, nbins);
+				row[x] = (1.f - wy) * top + wy * bottom;
+			}
+		}
+	}
+
+	free(luts);
+	free(ax);
+	free(ay);
+	return retval;
+}
+
+/* Works on grey images. Colour images are converted to CIE L*a*b* and only
+ * the lightness is equalized */
+static int clahe_image(fits *fit, double clip, int size, int threads) {
+	size_t n = fit->naxes[0] * fit->naxes[1];
+	int rx = fit->rx, ry = fit->ry;
+	float norm = fit->bitpix == BYTE_IMG ? UCHAR_MAX_SINGLE : USHRT_MAX_SINGLE;
+
+	if (fit->naxes[2] == 1 && fit->type == DATA_FLOAT) {
+		int retval = clahe_plane(fit->fdata, rx, ry, clip, size, threads);
+		invalidate_stats_from_fit(fit);
+		return retval;
+	}
+
+	float *plane = malloc(n * sizeof(float));
+	if (!plane) {
+		PRINT_ALLOC_ERR;
+		return 1;
+	}
+
+	if (fit->naxes[2] == 1) {
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(threads) schedule(static) if (threads > 1)
+#endif
+		for (size_t i = 0; i < n; i++)
+			plane[i] = fit->data[i] / norm;
+		if (clahe_plane(plane, rx, ry, clip, size, threads)) {
+			free(plane);
+			return 1;
+		}
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(threads) schedule(static) if (threads > 1)
+#endif
+		for (size_t i = 0; i < n; i++)
+			fit->data[i] = roundf_to_WORD(plane[i] * norm);
+		free(plane);
+		invalidate_stats_from_fit(fit);
+		return 0;
+	}
+
+	/* the lightness is equalized in place, a* and b* are computed again
+	 * from the pixels that are still unchanged when converting back */
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(threads) schedule(static) if (threads > 1)
+#endif
+	for (size_t i = 0; i < n; i++) {
+		float r, g, b, x, y, z, L, A, B;
+		if (fit->type == DATA_FLOAT) {
+			r = fit->fpdata[RLAYER][i];
+			g = fit->fpdata[GLAYER][i];
+			b = fit->fpdata[BLAYER][i];
+		} else {
+			r = fit->pdata[RLAYER][i] / norm;
+			g = fit->pdata[GLAYER][i] / norm;
+			b = fit->pdata[BLAYER][i] / norm;
+		}
+		rgb_to_xyzf(r, g, b, &x, &y, &z);
+		xyz_to_LABf(x, y, z, &L, &A, &B);
+		plane[i] = L / 100.f;
+	}
+
+	if (clahe_plane(plane, rx, ry, clip, size, threads)) {
+		free(plane);
+		return 1;
+	}
+
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(threads) schedule(static) if (threads > 1)
+#endif
+	for (size_t i = 0; i < n; i++) {
+		float r, g, b, x, y, z, L, A, B;
+		if (fit->type == DATA_FLOAT) {
+			r = fit->fpdata[RLAYER][i];
+			g = fit->fpdata[GLAYER][i];
+			b = fit->fpdata[BLAYER][i];
+		} else {
+			r = fit->pdata[RLAYER][i] / norm;
+			g = fit->pdata[GLAYER][i] / norm;
+			b = fit->pdata[BLAYER][i] / norm;
+		}
+		rgb_to_xyzf(r, g, b, &x, &y, &z);
+		xyz_to_LABf(x, y, z, &L, &A, &B);
+		LAB_to_xyzf(plane[i] * 100.f, A, B, &x, &y, &z);
+		xyz_to_rgbf(x, y, z, &r, &g, &b);
+		if (fit->type == DATA_FLOAT) {
+			fit->fpdata[RLAYER][i] = set_float_in_interval(r, 0.f, 1.f);
+			fit->fpdata[GLAYER][i] = set_float_in_interval(g, 0.f, 1.f);
+			fit->fpdata[BLAYER][i] = set_float_in_interval(b, 0.f, 1.f);
+		} else {
+			fit->pdata[RLAYER][i] = roundf_to_WORD(set_float_in_interval(r, 0.f, 1.f) * norm);
+			fit->pdata[GLAYER][i] = roundf_to_WORD(set_float_in_interval(g, 0.f, 1.f) * norm);
+			fit->pdata[BLAYER][i] = roundf_to_WORD(set_float_in_interval(b, 0.f, 1.f) * norm);
+		}
+	}
+	free(plane);
+	invalidate_stats_from_fit(fit);
+	return 0;
+}
+
+/* processes the whole image when the preview was made on the ROI or not made */
+static void clahe_process_all() {
+	waiting_for_thread();
+	if (clahe_show_preview)
+		copy_backup_to_gfit();
+	set_cursor_waiting(TRUE);
+	clahe_image(&gfit, clahe_limit_value, clahe_tile_size, com.max_thread);
+	populate_roi();
+	notify_gfit_modified();
+	set_cursor_waiting(FALSE);
+}
+
 gpointer clahe(gpointer p) {
 	struct CLAHE_data *args = (struct CLAHE_data*) p;
 
-	cvClahe(args->fit, args->clip, args->tileSize);
+	clahe_image(args->fit, args->clip, args->tileSize, com.max_thread);
 
 	siril_add_idle(end_clahe, args);
 	return GINT_TO_POINTER(0);
@@ -134,12 +433,8 @@ void on_clahe_undo_clicked(GtkButton *button, gpointer user_data) {
 void on_clahe_Apply_clicked(GtkButton *button, gpointer user_data) {
 	if (!check_ok_if_cfa())
 		return;
-	if (clahe_show_preview == FALSE) {
-		update_image *param = malloc(sizeof(update_image));
-		param->update_preview_fn = clahe_update_preview;
-		param->show_preview = TRUE;
-		notify_update((gpointer) param);
-	}
+	if (!clahe_show_preview || gui.roi.active)
+		clahe_process_all();
 
 	clahe_close(FALSE);
 	siril_close_dialog("CLAHE_dialog");
@@ -8,6 +8,7 @@ struct CLAHE_data {
 	int tileSize;
 };
 
+void clahe_change_between_roi_and_image();
 gpointer clahe(gpointer p);
 void apply_clahe_cancel();
 
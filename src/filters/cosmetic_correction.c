@@ -342,6 +342,111 @@ int cosmeticCorrection(fits *fit, deviant_pixel *dev, int size, gboolean is_cfa)
 	return 0;
 }
 
+/* The windows are the ones of cosmeticCorrOnePoint(): the median of the 5x5
+ * window for cold pixels and the mean of the 3x3 window for hot pixels, both
+ * without the centre, with a step of 2 for CFA images. Pixels are corrected in
+ * the same order and read the values already corrected, so the result is the
+ * same, only the bounds checks and allocations are done once. */
+struct cosmetic_plan *cosmetic_plan_new(const deviant_pixel *dev, size_t size, int rx, int ry, gboolean is_cfa) {
+	const int step = is_cfa ? 2 : 1;
+	struct cosmetic_plan *plan = calloc(1, sizeof(struct cosmetic_plan));
+	if (!plan) {
+		PRINT_ALLOC_ERR;
+		return NULL;
+	}
+	plan->rx = rx;
+	plan->ry = ry;
+	plan->nb_pixels = size;
+	plan->pixel = malloc(size * sizeof(size_t));
+	plan->type = malloc(size * sizeof(typeOfDeviant));
+	plan->first = malloc((size + 1) * sizeof(size_t));
+	plan->neighbours = malloc(size * 24 * sizeof(size_t));
+	plan->centre = malloc(size * sizeof(int));
+	if (!plan->pixel || !plan->type || !plan->first || !plan->neighbours || !plan->centre) {
+		PRINT_ALLOC_ERR;
+		cosmetic_plan_free(plan);
+		return NULL;
+	}
+
+	size_t n = 0;
+	for (size_t i = 0; i < size; i++) {
+		int xx = (int) dev[i].p.x, yy = (int) dev[i].p.y;
+		int radius = dev[i].type == COLD_PIXEL ? 2 * step : step;
+		plan->pixel[i] = (size_t) yy * rx + xx;
+		plan->type[i] = dev[i].type;
+		plan->first[i] = n;
+		plan->centre[i] = -1;
+		int k = 0;
+		for (int y = yy - radius; y <= yy + radius; y += step) {
+			for (int x = xx - radius; x <= xx + radius; x += step) {
+				if (y < 0 || y >= ry || x < 0 || x >= rx)
+					continue;
+				if (x == xx && y == yy)
+					plan->centre[i] = k;
+				else {
+					plan->neighbours[n++] = (size_t) y * rx + x;
+					k++;
+				}
+			}
+		}
+	}
+	plan->first[size] = n;
+	return plan;
+}
+
+void cosmetic_plan_apply(const struct cosmetic_plan *plan, fits *fit) {
+	WORD values[24];
+	float fvalues[24];
+	for (size_t i = 0; i < plan->nb_pixels; i++) {
+		const size_t *nb = plan->neighbours + plan->first[i];
+		int n = (int) (plan->first[i + 1] - plan->first[i]);
+		if (fit->type == DATA_USHORT) {
+			WORD *buf = fit->pdata[RLAYER];
+			if (plan->type[i] == COLD_PIXEL) {
+				for (int k = 0; k < n; k++)
+					values[k] = buf[nb[k]];
+				buf[plan->pixel[i]] = quickmedian(values, n);
+			} else {
+				float value = 0.f;
+				for (int k = 0; k < n; k++)
+					value += (float) buf[nb[k]];
+				buf[plan->pixel[i]] = round_to_WORD(n == 0 ? 0 : value / n);
+			}
+		} else if (fit->type == DATA_FLOAT) {
+			float *buf = fit->fpdata[RLAYER];
+			if (plan->type[i] == COLD_PIXEL) {
+				for (int k = 0; k < n; k++)
+					fvalues[k] = buf[nb[k]];
+				buf[plan->pixel[i]] = quickmedian_float(fvalues, n);
+			} else {
+				/* same order of the sums as getAverage3x3_float() */
+				float centre = buf[plan->pixel[i]];
+				float value = -centre;
+				for (int k = 0; k < n; k++) {
+					if (k == plan->centre[i])
+						value += centre;
+					value += buf[nb[k]];
+				}
+				if (plan->centre[i] == n)
+					value += centre;
+				buf[plan->pixel[i]] = n == 0 ? 0.f : value / n;
+			}
+		}
+	}
+	invalidate_stats_from_fit(fit);
+}
+
+void cosmetic_plan_free(struct cosmetic_plan *plan) {
+	if (!plan)
+		return;
+	free(plan->pixel);
+	free(plan->type);
+	free(plan->first);
+	free(plan->neighbours);
+	free(plan->centre);
+	free(plan);
+}
+
 /**** Autodetect *****/
 static int cosmetic_finalize_hook(struct generic_seq_args *args) {
 	int retval = seq_finalize_hook(args);
@@ -40,6 +40,23 @@ int apply_cosme_to_image(fits *fit, GFile *file, int is_cfa);
 void apply_cosme_to_sequence(struct cosme_data *cosme_args);
 gpointer autoDetectThreaded(gpointer p);
 int cosmeticCorrection(fits *fit, deviant_pixel *dev, int size, gboolean is_CFA);
+
+/* the neighbours used to correct a list of deviant pixels, computed once for
+ * a size of image and applied to many images with the same result as
+ * cosmeticCorrection() */
+struct cosmetic_plan {
+	int rx, ry;
+	size_t nb_pixels;
+	size_t *pixel;		// index of the deviant pixels in the image
+	typeOfDeviant *type;
+	size_t *first;		// neighbours of pixel i are neighbours[first[i]] to neighbours[first[i + 1] - 1]
+	size_t *neighbours;	// index in the image, in the scan order of the window
+	int *centre;		// for hot pixels, position of the centre in the scan order
+};
+
+struct cosmetic_plan *cosmetic_plan_new(const deviant_pixel *dev, size_t size, int rx, int ry, gboolean is_cfa);
+void cosmetic_plan_apply(const struct cosmetic_plan *plan, fits *fit);
+void cosmetic_plan_free(struct cosmetic_plan *plan);
 int cosmeticCorrOneLine(fits *fit, deviant_pixel dev, gboolean is_cfa);
 int cosmeticCorrOnePoint(fits *fit, deviant_pixel dev, gboolean is_cfa);
 
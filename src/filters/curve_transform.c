@@ -20,62 +20,17 @@
 
 #include <glib.h>
 #include "curve_transform.h"
+#include "point_ops.h"
 #include "gui/curves.h"
 #include "core/proto.h"
 #include "core/siril_log.h"
 #include <math.h>
 
 void apply_curve(fits *from, fits *to, struct curve_params params, gboolean multithreaded) {
-	g_assert(from->naxes[2] == 1 || from->naxes[2] == 3);
-	g_assert(from->type == to->type);
-	const size_t layersize = from->naxes[0] * from->naxes[1];
-
-	cubic_spline_data cspline_data;
-	// Linear data
-	double slopes[MAX_POINTS - 1];
-
-	if (params.algorithm == CUBIC_SPLINE)
-		cubic_spline_fit(params.points, &cspline_data);
-	else if (params.algorithm == LINEAR)
-		linear_fit(params.points, slopes);
-
-
-	if (from->type == DATA_USHORT) {
-		float norm = (float) get_normalized_value(from);
-		float inv_norm = 1.f / norm;
-#ifdef _OPENMP
-#pragma omp parallel for num_threads(com.max_thread) schedule(static) if(multithreaded)
-#endif
-		for (size_t i = 0; i < from->naxes[2]; i++) {
-			if (params.do_channel[i]) {
-				for (size_t j = 0; j < layersize; j++) {
-					float pixel_value = from->pdata[i][j] * inv_norm;
-					if (params.algorithm == LINEAR)
-						to->pdata[i][j] = roundf_to_WORD(linear_interpolate(pixel_value, params.points, slopes) * norm);
-					else if (params.algorithm == CUBIC_SPLINE)
-						to->pdata[i][j] = roundf_to_WORD(cubic_spline_interpolate(pixel_value, &cspline_data) * norm);
-				}
-			} else
-				memcpy(to->pdata[i], from->pdata[i], layersize * sizeof(WORD));
-		}
-	} else if (from->type == DATA_FLOAT) {
-#ifdef _OPENMP
-#pragma omp parallel for num_threads(com.max_thread) schedule(static) if(multithreaded)
-#endif
-		for (size_t i = 0; i < from->naxes[2]; i++) {
-			if (params.do_channel[i]) {
-				for (size_t j = 0; j < layersize; j++) {
-					float pixel_value = from->fpdata[i][j];
-					if (params.algorithm == LINEAR)
-						to->fpdata[i][j] = linear_interpolate(pixel_value, params.points, slopes);
-					else if (params.algorithm == CUBIC_SPLINE)
-						to->fpdata[i][j] = cubic_spline_interpolate(pixel_value, &cspline_data);
-				}
-			} else
-				memcpy(to->fpdata[i], from->fpdata[i], layersize * sizeof(float));
-		}
-	}
-	return;
+	struct point_pipeline pipeline;
+	point_pipeline_init(&pipeline);
+	point_pipeline_add_curve(&pipeline, &params);
+	point_pipeline_apply(&pipeline, from, to, multithreaded);
 }
 
 void linear_fit(GList *points, double *slopes) {
@@ -47,6 +47,11 @@ namespace da3d {
 
 namespace {
 
+// number of tiles of the work queue per thread
+constexpr int DA3D_TILES_PER_THREAD = 4;
+// minimum area of a tile, in patches
+constexpr int DA3D_MIN_TILE_PATCHES = 64;
+
 Image ColorTransform(Image&& src) {
   Image img = std::move(src);
   if (img.channels() == 3) {
@@ -221,19 +226,24 @@ void ModifyPatch(const Image &patch, const Image &k, DftPatch *modified,
   }
 }
 
+// Work estimate for progress bar. Empirical based on a sample of images, may need tuning
+unsigned PredictedLoops(const Image &tile) {
+  return tile.pixels() * 5 / 1000;
+}
+
 pair<Image, Image> DA3D_block(int &retval, const Image &noisy, const Image &guide,
                               float sigma, int r, float sigma_s,
-                              float gamma_r, float threshold, unsigned nThreads, unsigned thread) {
+                              float gamma_r, float threshold, const DftPatch &plans,
+                              unsigned *done_loops, unsigned total_loops) {
   // useful values
   const int s = utils::NextPowerOf2(2 * r + 1);
   const float sigma2 = sigma * sigma;
   const float gamma_r_sigma2 = gamma_r * sigma2;
   const float sigma_s2 = sigma_s * sigma_s;
 
-  // Work estimate for progress bar. Empirical based on a sample of images, may need tuning
-  const unsigned predicted_loops = noisy.pixels() * 5 / 1000;
+  // loops are added to the shared count by batches
+  const unsigned progress_batch = max(1u, total_loops >> 7);
   unsigned loop = 0;
-  unsigned lastupdate = 0;
 
   // regression parameters
   const float gamma_rr_sigma2 = gamma_r_sigma2 * 10.f;
@@ -244,8 +254,8 @@ pair<Image, Image> DA3D_block(int &retval, const Image &noisy, const Image &guid
   Image g(s, s, guide.channels());
   Image k_reg(s, s);
   Image k(s, s);
-  DftPatch y_m(s, s, guide.channels());
-  DftPatch g_m(s, s, guide.channels());
+  DftPatch y_m(s, s, guide.channels(), &plans);
+  DftPatch g_m(s, s, guide.channels(), &plans);
   int pr, pc;  // coordinates of the central pixel
   vector<pair<float, float>> reg_plane(guide.channels());  // parameters of the regression plane
   vector<float> ytv(guide.channels());
@@ -262,16 +272,22 @@ pair<Image, Image> DA3D_block(int &retval, const Image &noisy, const Image &guid
       retval++;
       break;
     }
-    if (thread == 0) {
-      loop++;
-      if (loop - lastupdate > (predicted_loops >> 3)) {
-        lastupdate = loop;
-        if ((double) loop / (nThreads * predicted_loops) < 1.0)
-          set_progress_bar_data("DA3D denoising...", (double) loop / (nThreads * predicted_loops));
+    if (++loop == progress_batch) {
+      unsigned done;
+      loop = 0;
+#ifdef _OPENMP
+#pragma omp atomic capture
+#endif
+      done = *done_loops += progress_batch;
+#ifdef _OPENMP
+      if (omp_get_thread_num() == 0)
+#endif
+      {
+        if ((double) done / total_loops < 1.0)
+          set_progress_bar_data("DA3D denoising...", (double) done / total_loops);
         else
           set_progress_bar_data("DA3D denoising...", PROGRESS_PULSATE);
       }
-
     }
 
 
@@ -358,27 +374,37 @@ Image DA3D(int &retval, const Image &noisy, const Image &guide, float sigma,
   nthreads = 1;
 #endif  // _OPENMP
 
+  // The time spent on a tile depends on its content, so the image is split
+  // in more tiles than threads, processed from a queue. Tiles are kept large
+  // enough for their padding to stay a small part of the work
+  int ntiles = nthreads;
+  if (nthreads > 1) {
+    const int max_tiles = guide.pixels() / (DA3D_MIN_TILE_PATCHES * s * s);
+    ntiles = max(nthreads, min(nthreads * DA3D_TILES_PER_THREAD, max_tiles));
+  }
   pair<int, int> tiling = ComputeTiling(guide.rows(), guide.columns(),
-                                        nthreads);
+                                        ntiles);
+  ntiles = tiling.first * tiling.second;
   vector<Image> noisy_tiles = SplitTiles(ColorTransform(noisy.copy()), r,
                                          s - r - 1, tiling);
   vector<Image> guide_tiles = SplitTiles(ColorTransform(guide.copy()), r,
                                          s - r - 1, tiling);
-  vector<pair<Image, Image>> result_tiles(nthreads);
+  vector<pair<Image, Image>> result_tiles(ntiles);
+
+  // the FFTW plans are computed once and shared by the patches of all threads
+  DftPatch plans(s, s, guide.channels());
+  unsigned done_loops = 0, total_loops = 0;
+  for (const Image &tile : guide_tiles)
+    total_loops += PredictedLoops(tile);
+  total_loops = max(1u, total_loops);
 
-  unsigned thread;
 #ifdef _OPENMP
-#pragma omp parallel for num_threads(nthreads)
+#pragma omp parallel for num_threads(nthreads) schedule(dynamic, 1)
 #endif  // _OPENMP
-  for (int i = 0; i < nthreads; ++i) {
-#ifdef _OPENMP
-    thread = omp_get_thread_num();
-#else
-    thread = 0;
-#endif
-
+  for (int i = 0; i < ntiles; ++i) {
     result_tiles[i] = DA3D_block(retval, noisy_tiles[i], guide_tiles[i], sigma,
-                                 r, sigma_s, gamma_r, threshold, nthreads, thread);
+                                 r, sigma_s, gamma_r, threshold, plans,
+                                 &done_loops, total_loops);
   }
   return ColorTransformInverse(MergeTiles(result_tiles, guide.shape(), r,
                                           s - r - 1, tiling));
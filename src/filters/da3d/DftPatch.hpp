@@ -16,8 +16,14 @@ namespace da3d {
 
 class DftPatch {
  public:
-  DftPatch(int rows, int columns, int channels = 1);
+  // When plans_from is given, its FFTW plans are executed on the buffers of
+  // this patch instead of planning again: fftwf_malloc gives them the same
+  // alignment, as required by the new-array execute functions
+  DftPatch(int rows, int columns, int channels = 1,
+           const DftPatch *plans_from = nullptr);
   ~DftPatch();
+  DftPatch(const DftPatch&) = delete;
+  DftPatch& operator=(const DftPatch&) = delete;
   void ToFreq();
   void ToSpace();
   int rows() const { return rows_; }
@@ -33,6 +39,7 @@ class DftPatch {
   std::complex<float> *freq_;
   fftwf_plan plan_forward_;
   fftwf_plan plan_backward_;
+  bool owns_plans_;
   int rows_, columns_, fcolumns_, channels_;
 };
 
@@ -50,13 +57,22 @@ inline std::complex<float>& DftPatch::freq(int col, int row, int chan) {
   return freq_[row * fcolumns_ * channels_ + col * channels_ + chan];
 }
 
-inline DftPatch::DftPatch(int rows, int columns, int channels)
-    : rows_(rows), columns_(columns), fcolumns_(columns / 2 + 1), channels_(channels) {
+inline DftPatch::DftPatch(int rows, int columns, int channels,
+                          const DftPatch *plans_from)
+    : owns_plans_(plans_from == nullptr), rows_(rows), columns_(columns),
+      fcolumns_(columns / 2 + 1), channels_(channels) {
   int N = rows * columns * channels;
   int N_half = rows * fcolumns_ * channels;
   space_ = reinterpret_cast<float *>(fftwf_malloc(sizeof(float) * N));
   freq_ = reinterpret_cast<std::complex<float> *>(fftwf_malloc(
       sizeof(fftwf_complex) * N_half));
+  if (plans_from) {
+    assert(plans_from->rows_ == rows && plans_from->columns_ == columns &&
+           plans_from->channels_ == channels);
+    plan_forward_ = plans_from->plan_forward_;
+    plan_backward_ = plans_from->plan_backward_;
+    return;
+  }
   int n[] = {rows, columns};
 #ifdef _OPENMP
 #pragma omp critical
@@ -76,18 +92,32 @@ inline DftPatch::DftPatch(int rows, int columns, int channels)
 inline DftPatch::~DftPatch() {
   fftwf_free(space_);
   fftwf_free(freq_);
-  fftwf_destroy_plan(plan_forward_);
-  fftwf_destroy_plan(plan_backward_);
+  if (owns_plans_) {
+#ifdef _OPENMP
+#pragma omp critical
+#endif
+    {
+      fftwf_destroy_plan(plan_forward_);
+      fftwf_destroy_plan(plan_backward_);
+    }
+  }
 }
 
 inline void DftPatch::ToFreq() {
-  fftwf_execute(plan_forward_);
+  fftwf_execute_dft_r2c(plan_forward_, space_,
+                        reinterpret_cast<fftwf_complex *>(freq_));
 }
 
 inline void DftPatch::ToSpace() {
-  fftwf_execute(plan_backward_);
-  for (int i = 0; i < rows_ * columns_ * channels_; ++i) {
-    space_[i] /= rows_ * columns_;
+  fftwf_execute_dft_c2r(plan_backward_,
+                        reinterpret_cast<fftwf_complex *>(freq_), space_);
+  const float inv = 1.f / (rows_ * columns_);
+  const int N = rows_ * columns_ * channels_;
+#ifdef _OPENMP
+#pragma omp simd
+#endif
+  for (int i = 0; i < N; ++i) {
+    space_[i] *= inv;
   }
 }
 
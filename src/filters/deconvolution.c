@@ -49,6 +49,7 @@
 #include "algos/statistics.h"
 #include "algos/PSF.h"
 #include "io/sequence.h"
+#include "registration/registration.h"
 #include "io/ser.h"
 
 gboolean aperture_warning_given = FALSE;
@@ -89,6 +90,7 @@ void reset_conv_args(estk_data* args) {
 	args->stars_need_clearing = FALSE;
 	args->recalc_ks = FALSE;
 	args->psftype = PSF_BLIND;
+	args->psf_samples = 0;
 	the_fit = (!com.headless && gui.roi.active) ? &gui.roi.fit : &gfit;
 	imageorientation = get_imageorientation();
 	args->fdata = NULL;
@@ -785,13 +787,147 @@ static int deconvolution_compute_mem_limits(struct generic_seq_args *seqargs, gb
 	return limit;
 }
 
+/* PSF sampling: instead of using the PSF of the first frame for the whole
+ * sequence, the blind PSF is estimated on args.psf_samples frames spread over
+ * the sequence and each frame is deconvolved with the PSF interpolated between
+ * the two samples closest to it, by FWHM if the sequence is registered, by
+ * frame index otherwise. */
+
+static void free_psf_samples(deconvolution_sequence_data *data) {
+	for (int i = 0; i < data->nb_psf_samples; i++)
+		free(data->psf_samples[i].kernel);
+	free(data->psf_samples);
+	data->psf_samples = NULL;
+	data->nb_psf_samples = 0;
+}
+
+static int compare_psf_samples(const void *a, const void *b) {
+	const struct psf_sample *sa = (const struct psf_sample *) a;
+	const struct psf_sample *sb = (const struct psf_sample *) b;
+	return (sa->pos > sb->pos) - (sa->pos < sb->pos);
+}
+
+static double psf_sample_position(deconvolution_sequence_data *data, int layer, int index) {
+	return data->psf_by_fwhm ? data->seq->regparam[layer][index].fwhm : (double) index;
+}
+
+static int estimate_psf_samples(struct generic_seq_args *seqargs, deconvolution_sequence_data *data) {
+	sequence *seq = seqargs->seq;
+	int *included = malloc(seq->number * sizeof(int));
+	if (!included) {
+		PRINT_ALLOC_ERR;
+		return 1;
+	}
+	int nb_included = 0;
+	for (int i = 0; i < seq->number; i++)
+		if (!seqargs->filtering_criterion || seqargs->filtering_criterion(seq, i, seqargs->filtering_parameter))
+			included[nb_included++] = i;
+	int nb = min(args.psf_samples, nb_included);
+	if (nb < 2) {
+		free(included);
+		return 0;
+	}
+
+	int layer = get_registration_layer(seq);
+	data->psf_by_fwhm = layer >= 0 && seq->regparam[layer];
+	for (int i = 0; data->psf_by_fwhm && i < nb_included; i++)
+		if (seq->regparam[layer][included[i]].fwhm <= 0.f)
+			data->psf_by_fwhm = FALSE;
+
+	data->psf_samples = calloc(nb, sizeof(struct psf_sample));
+	if (!data->psf_samples) {
+		PRINT_ALLOC_ERR;
+		free(included);
+		return 1;
+	}
+	siril_log_message(_("Estimating the PSF on %d frames, interpolated by %s\n"), nb,
+			data->psf_by_fwhm ? _("FWHM") : _("frame number"));
+	int retval = 0;
+	size_t kernel_size = args.ks * args.ks * sizeof(float);
+	for (int s = 0; s < nb && !retval; s++) {
+		int index = included[(int) round((double) s * (nb_included - 1) / (nb - 1))];
+		fits fit = { 0 };
+		if (seq_read_frame(seq, index, &fit, FALSE, -1)) {
+			siril_log_color_message(_("Could not read frame %d to estimate the PSF\n"), "red", index + 1);
+			retval = 1;
+			break;
+		}
+		the_fit = &fit;
+		args.ndata = fit.rx * fit.ry * fit.naxes[2];
+		args.fdata = malloc(args.ndata * sizeof(float));
+		if (!args.fdata) {
+			PRINT_ALLOC_ERR;
+			retval = 1;
+		} else {
+			if (fit.type == DATA_FLOAT)
+				memcpy(args.fdata, fit.fdata, args.ndata * sizeof(float));
+			else {
+				float invnorm = 1.f / USHRT_MAX_SINGLE;
+				for (size_t i = 0 ; i < args.ndata ; i++)
+					args.fdata[i] = (float) fit.data[i] * invnorm;
+			}
+			set_progress_bar_data(_("Estimating the PSF of sample frames..."), (double) s / nb);
+			if (get_kernel() || !com.kernel || com.kernelsize != args.ks || !get_thread_run())
+				retval = 1;
+			else {
+				struct psf_sample *sample = &data->psf_samples[data->nb_psf_samples++];
+				sample->index = index;
+				sample->pos = psf_sample_position(data, layer, index);
+				sample->kernel = malloc(kernel_size);
+				if (!sample->kernel) {
+					PRINT_ALLOC_ERR;
+					retval = 1;
+				}
+				else memcpy(sample->kernel, com.kernel, kernel_size);
+			}
+			free(args.fdata);
+			args.fdata = NULL;
+		}
+		clearfits(&fit);
+		the_fit = &gfit;
+	}
+	free(included);
+	if (retval) {
+		free_psf_samples(data);
+		return 1;
+	}
+	qsort(data->psf_samples, data->nb_psf_samples, sizeof(struct psf_sample), compare_psf_samples);
+	return 0;
+}
+
+/* makes com.kernel the PSF interpolated for the frame of the given index */
+static void interpolate_psf(deconvolution_sequence_data *data, int index) {
+	int nb = data->nb_psf_samples;
+	double pos = psf_sample_position(data, get_registration_layer(data->seq), index);
+	int j = 0;
+	while (j < nb - 2 && data->psf_samples[j + 1].pos < pos)
+		j++;
+	const struct psf_sample *a = &data->psf_samples[j], *b = &data->psf_samples[j + 1];
+	double t = b->pos > a->pos ? (pos - a->pos) / (b->pos - a->pos) : 0.0;
+	t = max(0.0, min(1.0, t));
+
+	int n = args.ks * args.ks;
+	float sum = 0.f;
+	for (int k = 0; k < n; k++) {
+		com.kernel[k] = (float) ((1.0 - t) * a->kernel[k] + t * b->kernel[k]);
+		sum += com.kernel[k];
+	}
+	if (sum > 0.f)
+		for (int k = 0; k < n; k++)
+			com.kernel[k] /= sum;
+	siril_debug_print("PSF of frame %d interpolated between frames %d and %d (t = %.2f)\n",
+			index + 1, a->index + 1, b->index + 1, t);
+}
+
 int deconvolution_finalize_hook(struct generic_seq_args *seqargs) {
 	deconvolution_sequence_data *data = (deconvolution_sequence_data *) seqargs->user;
 	int retval = seq_finalize_hook(seqargs);
 	if (data && data->from_command && data->deconv_data)
 		free(data->deconv_data);
-	if (data)
+	if (data) {
+		free_psf_samples(data);
 		free(data);
+	}
 	set_progress_bar_data(PROGRESS_TEXT_RESET, PROGRESS_RESET);
 
 	args.psftype = args.oldpsftype; // Restore consistency
@@ -801,10 +937,15 @@ int deconvolution_finalize_hook(struct generic_seq_args *seqargs) {
 
 
 int deconvolution_image_hook(struct generic_seq_args *seqargs, int o, int i, fits *fit, rectangle *_, int threads) {
+	deconvolution_sequence_data *data = (deconvolution_sequence_data *) seqargs->user;
 	int ret = 0;
 	the_fit = fit;
+	if (data->nb_psf_samples > 0)
+		interpolate_psf(data, i); // args.psftype is already PSF_PREVIOUS
 	ret = GPOINTER_TO_INT(deconvolve(NULL));
 	the_fit = &gfit; // Prevent bad things happening if fit is freed and we then try to do things with the_fit
+	if (data->nb_psf_samples > 0)
+		return ret;
 	args.oldpsftype = args.psftype; // Need to store the previous psf type so we can restore
 	// it later and avoid inconsistency between the GTK widget and the parameter.
 	args.psftype = PSF_PREVIOUS; // For all but the first image in the sequence we will reuse the kernel calculated for the first image.
@@ -821,6 +962,17 @@ int deconvolution_prepare_hook(struct generic_seq_args *seqargs) {
 		siril_log_color_message(_("Error: trying to use previous PSF but no PSF has been generated. Aborting...\n"),"red");
 		return 1;
 	}
+	if (args.psf_samples > 1) {
+		deconvolution_sequence_data *data = (deconvolution_sequence_data *) seqargs->user;
+		if (args.psftype != PSF_BLIND)
+			siril_log_message(_("PSF sampling is only available for blind PSF estimation, the PSF of the first frame will be used\n"));
+		else if (estimate_psf_samples(seqargs, data))
+			return 1;
+		else if (data->nb_psf_samples > 0) {
+			args.oldpsftype = args.psftype;
+			args.psftype = PSF_PREVIOUS;
+		}
+	}
 	int retval = 0;
 	g_assert(seqargs->has_output); // don't call this hook otherwise
 	if (seqargs->force_ser_output || (seqargs->seq->type == SEQ_SER && !seqargs->force_fitseq_output)) {
@@ -44,7 +44,7 @@ static void computeProjectionHalfAngleSet(std::vector<angle_t>& angles, int kern
     localAngles.reserve((kernelSize + 1) * (kernelSize + 1) / 2);
 
 #ifdef _OPENMP
-    int available_threads = com.max_thread - omp_get_num_threads();
+    int available_threads = std::max(com.max_thread - omp_get_num_threads(), 1);
 #pragma omp parallel num_threads(available_threads) if (available_threads > 1)
     {
 #endif
@@ -95,7 +95,7 @@ void computeProjectionAngleSet(std::vector<angle_t>& angles, int kernelSize)
     std::vector<angle_t> mirroredAngles(s - 2);
 
 #ifdef _OPENMP
-    int available_threads = com.max_thread - omp_get_num_threads();
+    int available_threads = std::max(com.max_thread - omp_get_num_threads(), 1);
 #pragma omp parallel for schedule(static) num_threads(available_threads) if (available_threads > 1)
 #endif
     for (int i = 1; i < s - 1; ++i) { // Start from 1 to skip theta = pi/2 and go to s-1 to skip theta = 0
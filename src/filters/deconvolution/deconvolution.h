@@ -98,6 +98,7 @@ EXTERNC typedef struct estk_data {
 	gboolean recalc_ks; // for the makepsf stars option
 	gboolean stars_need_clearing; // for the makepsf stars option
 	gboolean previewing;
+	int psf_samples; // for sequences: number of frames the blind PSF is estimated on
 } estk_data;
 
 EXTERNC float *estimate_kernel(estk_data *args, int max_threads);
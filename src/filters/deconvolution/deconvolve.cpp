@@ -26,6 +26,16 @@
 #include "edgetaper.hpp"
 #include "core/OS_utils.h"
 
+// Runs process_func on the image cut in slices sized for the available
+// memory, or in small tiles processed in parallel if the preference is set
+template<typename F>
+static void process_image(img_t<float>& f, int num_copies_required, img_t<float>& u, int overlap, const F& process_func) {
+    if (com.pref.fftw_conf.tiled)
+        f.process_in_tiles(get_available_memory(), num_copies_required, u, overlap, process_func);
+    else
+        f.process_in_slices(get_available_memory(), num_copies_required, u, overlap, process_func);
+}
+
 extern "C" int wienerdec(float *fdata, unsigned rx, unsigned ry, unsigned nchans, float *kernel, int kernelsize, unsigned kchans, float sigma, int max_threads) {
     const int num_copies_required = 8;
     img_t<float>::use_threading(max_threads);
@@ -39,7 +49,7 @@ extern "C" int wienerdec(float *fdata, unsigned rx, unsigned ry, unsigned nchans
         if (max != 0.0f && max != 1.0f)
             f.map(f / max);
         f = utils::add_padding(f, K);
-        f.process_in_slices(get_available_memory(), num_copies_required, u, kernelsize / 2, [&K, sigma](img_t<float>& slice) {
+        process_image(f, num_copies_required, u, kernelsize / 2, [&K, sigma](img_t<float>& slice) {
             edgetaper(slice, slice, K, 3);
             deconvolve::wiener_deconvolve(slice, slice, K, sigma);
         });
@@ -68,7 +78,7 @@ extern "C" int fft_richardson_lucy(float *fdata, unsigned rx, unsigned ry, unsig
         if (max != 1.0f)
             f.map(f / max);
         f = utils::add_padding(f, K);
-        f.process_in_slices(get_available_memory(), num_copies_required, u, kernelsize / 2, [&K, lambda, maxiter, stopcriterion, regtype, stepsize, stopcriterion_active](img_t<float>& slice) {
+        process_image(f, num_copies_required, u, kernelsize / 2, [&K, lambda, maxiter, stopcriterion, regtype, stepsize, stopcriterion_active](img_t<float>& slice) {
             edgetaper(slice, slice, K, 3);
             deconvolve::rl_deconvolve_fft(slice, slice, K, 2.f / lambda, maxiter, stopcriterion, regtype, stepsize, stopcriterion_active);
         });
@@ -128,7 +138,7 @@ extern "C" int split_bregman(float *fdata, unsigned rx, unsigned ry, unsigned nc
         if (max != 1.0f)
             f.map(f / max);
         f = utils::add_padding(f, K);
-        f.process_in_slices(get_available_memory(), num_copies_required, u, kernelsize / 2, [&K, lambda, iters](img_t<float>& slice) {
+        process_image(f, num_copies_required, u, kernelsize / 2, [&K, lambda, iters](img_t<float>& slice) {
             edgetaper(slice, slice, K, 3);
             deconvolve::sb_deconvolve(slice, slice, K, 2.f / lambda, 1.f, 2.f * std::sqrt(2.f), 256.f, iters);
         });
@@ -75,7 +75,7 @@ namespace deconvolve {
     }
 
     template <typename T>
-    void rl_deconvolve_fft(img_t<T>& x, const img_t<T>& f, img_t<T>& K, T lambda, int maxiter, T stopcriterion, regtype_t regtype, float stepsize, int stopcriterion_active) {
+    void rl_deconvolve_fft(img_t<T>& x, const img_t<T>& f, const img_t<T>& K, T lambda, int maxiter, T stopcriterion, regtype_t regtype, float stepsize, int stopcriterion_active) {
         assert(K.w % 2);
         assert(K.h % 2);
         double sliceprogress = (double) f.slices_complete / f.total_slices;
@@ -90,18 +90,26 @@ namespace deconvolve {
         // Flip K and generate OTF
         img_t<std::complex<T>> Kflip_otf(f.w, f.h, f.d);
         {
-            K.flip();
-            Kflip_otf.padcirc(K);
-            Kflip_otf.map(Kflip_otf * std::complex<T>(K.d) / K.sum());
+            // K is shared by the slices or tiles processed in parallel: flip a copy
+            img_t<T> Kf(K.w, K.h, K.d);
+            Kf.flip(K);
+            Kflip_otf.padcirc(Kf);
+            Kflip_otf.map(Kflip_otf * std::complex<T>(Kf.d) / Kf.sum());
             Kflip_otf.fft(Kflip_otf);
         }
         img_t<std::complex<T>> est(f.w, f.h, f.d);
         est.map(f);
         float reallambda = 1.f / lambda; // For consistency with other algorithms
+        // Allocated once so that their FFTW plans are made on the first
+        // iteration and reused by all the following ones
+        img_t<T> w(f.w, f.h, f.d);
+        img_t<std::complex<T>> ratio(f.w, f.h, f.d);
+        img_t<T> stopcrit;
+        if (stopcriterion_active == 1)
+            stopcrit.resize(f.w, f.h, f.d);
         for (int iter = 0 ; iter < maxiter ; iter++) {
-            if (!get_thread_run())
-                continue;
-            img_t<T> w(f.w, f.h, f.d);
+            if (processing_cancelled())
+                break;
             w.map(img::real(est));
             if (regtype == 0 || regtype == 3) {
                 // Calculate TV weighting
@@ -124,21 +132,23 @@ namespace deconvolve {
                 w.map(weight);
                 w.sanitize();
             }
+            // the estimate is only updated at the end of the iteration, it
+            // can be left between the steps
+            if (processing_cancelled())
+                break;
             // Richardson-Lucy iteration
-            img_t<std::complex<T>> ratio(f.w, f.h, f.d);
             ratio.fft(est);
             ratio.map(ratio * K_otf); // convolve
             ratio.ifft(ratio); // denominator
             ratio.sanitize();
             ratio.map(f / ratio); // divide
+            if (processing_cancelled())
+                break;
             ratio.fft(ratio);
             ratio.map(ratio * Kflip_otf); // correlate (convolve with flip)
             ratio.ifft(ratio);
-            img_t<T> stopcrit;
-            if(stopcriterion_active == 1) {
-                stopcrit.resize(f.w, f.h, f.d);
-                stopcrit = to_img(img::real(est));
-            }
+            if (stopcriterion_active == 1)
+                stopcrit.map(img::real(est));
             T dt = T(stepsize);
             switch (regtype) {
                 case REG_NONE_MULT:
@@ -194,8 +204,8 @@ namespace deconvolve {
         img_t<T> gxy(f.w, f.h, f.d);
         img_t<T> gyy(f.w, f.h, f.d);
         for (int iter = 0 ; iter < maxiter ; iter++) {
-            if (!get_thread_run())
-                continue;
+            if (processing_cancelled())
+                break;
             // Regularization calcs
             w.map(x);
             if (regtype == 0 || regtype == 3) {
@@ -221,11 +231,19 @@ namespace deconvolve {
                 w.map(img::pow(sumgrads, T(0.5)));
             }
 
+            // the estimate is only updated at the end of the iteration, it
+            // can be left between the steps
+            if (processing_cancelled())
+                break;
             // Richardson-Lucy iteration
             ratio.conv2(x, K); // convolve with kernel to get denominator
+            if (processing_cancelled())
+                break;
             ratio.map(f / ratio); // divide f by denominator
             ratio.map(img::max(T(1.e-9), ratio));
             ratio.conv2(ratio, Kf); // convolve by flipped kernel
+            if (processing_cancelled())
+                break;
             T dt = T(stepsize);
             switch (regtype) {
                 case REG_NONE_MULT: // 5 and 4 are multiplicative RL with FH and TV reg
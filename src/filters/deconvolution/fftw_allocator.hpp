@@ -24,6 +24,7 @@ SOFTWARE.
 #pragma once
 #include <limits>
 #include <fftw3.h>
+#include "core/memory_report.h"
 
 template <class T>
 class fftw_alloc {
@@ -77,6 +78,8 @@ class fftw_alloc {
 // Also requires linking against libfftw_3 as well as libfftw_3f
 //            ptr = fftw_malloc(num*sizeof(T));
             ptr = fftwf_malloc(num*sizeof(T));
+            if (ptr)
+                memory_account(MEM_FFT, num * sizeof(T));
             return (pointer) ptr;
         }
 
@@ -93,6 +96,7 @@ class fftw_alloc {
 #pragma omp critical (fftw)
 #endif
             fftwf_free(p);
+            memory_account(MEM_FFT, -(gint64) (num * sizeof(T)));
         }
 };
 
@@ -42,6 +42,7 @@ free-astro 2022-2023.
 
 #include <unordered_map>
 
+#include <algorithm>
 #include <cassert>
 #include <complex>
 #include <limits>
@@ -50,6 +51,7 @@ free-astro 2022-2023.
 #include <numeric>
 #include <memory>
 #include "core/siril.h"
+#include "core/processing.h" // for processing_cancelled()
 #include <fftw3.h>
 #include "fftw_allocator.hpp"
 
@@ -278,7 +280,7 @@ public:
         assert(o.similar(*this));
         int n = w * h * d;
 #ifdef _OPENMP
-        int available_threads = com.max_thread - omp_get_num_threads();
+        int available_threads = std::max(com.max_thread - omp_get_num_threads(), 1);
 #pragma omp parallel for simd schedule(static) num_threads(available_threads) if (available_threads > 1)
 #endif
         for (int i = 0; i < n; i++)
@@ -419,6 +421,67 @@ public:
         process_in_slices(output, slice_size.width - adjustment, slice_size.height - adjustment, overlap, process_func);
     }
 
+    // Copies the slice starting at (start_x, start_y) with its overlap on each
+    // side into padded_slice, mirroring the image at its borders
+    void extract_slice(img_t<T>& padded_slice, int start_x, int start_y, int slice_width, int slice_height, int overlap) const {
+        int end_x = std::min(start_x + slice_width, w);
+        int end_y = std::min(start_y + slice_height, h);
+        int actual_width = end_x - start_x;
+        int actual_height = end_y - start_y;
+
+        // Calculate padding
+        int pad_left = std::min(overlap, start_x);
+        int pad_right = std::min(overlap, w - end_x);
+        int pad_top = std::min(overlap, start_y);
+        int pad_bottom = std::min(overlap, h - end_y);
+
+        // Create padded slice
+        padded_slice.resize(actual_width + pad_left + pad_right,
+                            actual_height + pad_top + pad_bottom, d);
+
+        // Copy data to padded slice
+#ifdef _OPENMP
+        int available_threads = std::max(com.max_thread - omp_get_num_threads(), 1);
+#pragma omp parallel for simd schedule(static) num_threads(available_threads) if (available_threads > 1) collapse(2)
+#endif
+        for (int y = -pad_top; y < actual_height + pad_bottom; ++y) {
+            for (int x = -pad_left; x < actual_width + pad_right; ++x) {
+                int src_x = start_x + x;
+                int src_y = start_y + y;
+
+                // Handle padding at image borders
+                if (src_x < 0) src_x = -src_x;
+                else if (src_x >= w) src_x = 2*w - src_x - 2;
+                if (src_y < 0) src_y = -src_y;
+                else if (src_y >= h) src_y = 2*h - src_y - 2;
+
+                for (int z = 0; z < d; ++z) {
+                    padded_slice(x + pad_left, y + pad_top, z) = (*this)(src_x, src_y, z);
+                }
+            }
+        }
+    }
+
+    // Copies the processed data of padded_slice to the output image (only the
+    // non-overlapping part)
+    void store_slice(img_t<T>& output, const img_t<T>& padded_slice, int start_x, int start_y, int slice_width, int slice_height, int overlap) const {
+        int actual_width = std::min(start_x + slice_width, w) - start_x;
+        int actual_height = std::min(start_y + slice_height, h) - start_y;
+        int pad_left = std::min(overlap, start_x);
+        int pad_top = std::min(overlap, start_y);
+#ifdef _OPENMP
+        int available_threads = std::max(com.max_thread - omp_get_num_threads(), 1);
+#pragma omp parallel for simd schedule(static) num_threads(available_threads) if (available_threads > 1) collapse(3)
+#endif
+        for (int y = 0; y < actual_height; ++y) {
+            for (int x = 0; x < actual_width; ++x) {
+                for (int z = 0; z < d; ++z) {
+                    output(start_x + x, start_y + y, z) = padded_slice(x + pad_left, y + pad_top, z);
+                }
+            }
+        }
+    }
+
     template<typename F>
     void process_in_slices(img_t<T>& output, int slice_width, int slice_height, int overlap, const F& process_func) {
         // Ensure the output image has the same dimensions as the input
@@ -435,63 +498,70 @@ public:
 
         for (int sy = 0; sy < num_slices_y; ++sy) {
             for (int sx = 0; sx < num_slices_x; ++sx) {
-                // Calculate slice boundaries
                 int start_x = sx * slice_width;
                 int start_y = sy * slice_height;
-                int end_x = std::min(start_x + slice_width, w);
-                int end_y = std::min(start_y + slice_height, h);
-                int actual_width = end_x - start_x;
-                int actual_height = end_y - start_y;
+                extract_slice(padded_slice, start_x, start_y, slice_width, slice_height, overlap);
 
-                // Calculate padding
-                int pad_left = std::min(overlap, start_x);
-                int pad_right = std::min(overlap, w - end_x);
-                int pad_top = std::min(overlap, start_y);
-                int pad_bottom = std::min(overlap, h - end_y);
-
-                // Create padded slice
-                padded_slice.resize(actual_width + pad_left + pad_right,
-                                    actual_height + pad_top + pad_bottom, d);
-
-                // Copy data to padded slice
-#ifdef _OPENMP
-                int available_threads = com.max_thread - omp_get_num_threads();
-#pragma omp parallel for simd schedule(static) num_threads(available_threads) if (available_threads > 1) collapse(2)
-#endif
-                for (int y = -pad_top; y < actual_height + pad_bottom; ++y) {
-                    for (int x = -pad_left; x < actual_width + pad_right; ++x) {
-                        int src_x = start_x + x;
-                        int src_y = start_y + y;
+                // Process the padded slice
+                process_func(padded_slice);
 
-                        // Handle padding at image borders
-                        if (src_x < 0) src_x = -src_x;
-                        else if (src_x >= w) src_x = 2*w - src_x - 2;
-                        if (src_y < 0) src_y = -src_y;
-                        else if (src_y >= h) src_y = 2*h - src_y - 2;
+                store_slice(output, padded_slice, start_x, start_y, slice_width, slice_height, overlap);
+                g_atomic_int_add(&padded_slice.slices_complete, 1);
+            }
+        }
+    }
 
-                        for (int z = 0; z < d; ++z) {
-                            padded_slice(x + pad_left, y + pad_top, z) = (*this)(src_x, src_y, z);
-                        }
-                    }
-                }
+    // Tiled overlap-save processing: the image is cut in small tiles of a
+    // good FFT size, at least 512 pixels wide, and several tiles are processed
+    // at the same time, each with single-threaded FFTs. For small kernels this
+    // keeps the working set of a tile in cache and the memory used is bounded
+    // by the tiles in flight instead of growing with the image size.
+    // Falls back to the slice processing when the image is not larger than a
+    // few tiles.
+    template<typename F>
+    void process_in_tiles(size_t M, int N_copies, img_t<T>& output, int overlap, const F& process_func) {
+        // the autotune command measures the best size for this machine
+        int min_size = com.pref.tuning.deconv_tile_size > 0 ? com.pref.tuning.deconv_tile_size : 512;
+        int tile_size = next_good_size(std::max(min_size, 8 * overlap));
+        int core_size = tile_size - 2 * overlap;
+        size_t tile_memory = calculate_slice_memory(core_size, core_size, overlap, N_copies);
+        int num_tiles_x = (w + core_size - 1) / core_size;
+        int num_tiles_y = (h + core_size - 1) / core_size;
+        int num_tiles = num_tiles_x * num_tiles_y;
+        int nb_parallel = std::min(com.max_thread, num_tiles);
+        if (tile_memory > 0 && static_cast<size_t>(nb_parallel) * tile_memory > M)
+            nb_parallel = static_cast<int>(M / tile_memory);
+        if (num_tiles < 4 || nb_parallel < 2) {
+            process_in_slices(M, N_copies, output, overlap, process_func);
+            return;
+        }
+        siril_debug_print("Processing in tiles (%d x %d), %d in parallel\n", tile_size, tile_size, nb_parallel);
 
-                // Process the padded slice
-                process_func(padded_slice);
+        if (output.w != w || output.h != h || output.d != d)
+            output.resize(w, h, d);
 
-                // Copy processed data to the output image (only the non-overlapping part)
+        gint tiles_complete = 0;
+#ifdef HAVE_FFTW3F_MULTITHREAD
+        fftwf_plan_with_nthreads(1);
+#endif
 #ifdef _OPENMP
-#pragma omp parallel for simd schedule(static) num_threads(available_threads) if (available_threads > 1) collapse(3)
+#pragma omp parallel for schedule(dynamic) num_threads(nb_parallel)
 #endif
-                for (int y = 0; y < actual_height; ++y) {
-                    for (int x = 0; x < actual_width; ++x) {
-                        for (int z = 0; z < d; ++z) {
-                            output(start_x + x, start_y + y, z) = padded_slice(x + pad_left, y + pad_top, z);
-                        }
-                    }
-                }
-                g_atomic_int_add(&padded_slice.slices_complete, 1);
-            }
+        for (int t = 0; t < num_tiles; t++) {
+            int start_x = (t % num_tiles_x) * core_size;
+            int start_y = (t / num_tiles_x) * core_size;
+            img_t<T> padded_tile;
+            padded_tile.total_slices = num_tiles;
+            padded_tile.slices_complete = g_atomic_int_get(&tiles_complete);
+            extract_slice(padded_tile, start_x, start_y, core_size, core_size, overlap);
+            process_func(padded_tile);
+            store_slice(output, padded_tile, start_x, start_y, core_size, core_size, overlap);
+            g_atomic_int_inc(&tiles_complete);
         }
+#ifdef HAVE_FFTW3F_MULTITHREAD
+        if (com.fftw_max_thread > 1)
+            fftwf_plan_with_nthreads(com.fftw_max_thread);
+#endif
     }
 
 // ********************************************************
@@ -509,7 +579,7 @@ public:
 
         // Main convolution (excluding borders)
 #ifdef _OPENMP
-        int available_threads = com.max_thread - omp_get_num_threads();
+        int available_threads = std::max(com.max_thread - omp_get_num_threads(), 1);
         #pragma omp parallel num_threads(available_threads) if (available_threads > 1)
         {
             #pragma omp for collapse(3) schedule(guided)
@@ -517,6 +587,9 @@ public:
             for (int c = 0; c < d; c++) {
                 for (int i = ix; i < x.w-ix; i++) {
                     for (int j = ix; j < x.h-ix; j++) {
+                        // large kernels make each pixel long, stop early on cancel
+                        if (processing_cancelled())
+                            continue;
                         T val = T(0);
 #ifdef _OPENMP
                         #pragma omp simd reduction(+:val)
@@ -637,7 +710,7 @@ public:
     template <typename F>
     void mapf(F&& f) {
 #ifdef _OPENMP
-        int available_threads = com.max_thread - omp_get_num_threads();
+        int available_threads = std::max(com.max_thread - omp_get_num_threads(), 1);
         #pragma omp parallel for simd schedule(static) num_threads(available_threads) if (available_threads > 1)
 #endif
         for (int i = 0; i < size; i++) {
@@ -650,7 +723,7 @@ public:
     std::enable_if_t<!std::is_same_v<R, T>, img_t<R>> mapf(F&& f) const {
         img_t<R> result(w, h, d);
 #ifdef _OPENMP
-        int available_threads = com.max_thread - omp_get_num_threads();
+        int available_threads = std::max(com.max_thread - omp_get_num_threads(), 1);
         #pragma omp parallel for schedule(static) num_threads(available_threads) if (available_threads > 1)
 #endif
         for (int i = 0; i < size; i++) {
@@ -724,7 +797,7 @@ public:
     void map(const img_t<T2>& o, const F& f) {
         assert(o.similar(*this));
 #ifdef _OPENMP
-        int available_threads = com.max_thread - omp_get_num_threads();
+        int available_threads = std::max(com.max_thread - omp_get_num_threads(), 1);
         #pragma omp parallel for schedule(static) num_threads(available_threads) if (available_threads > 1)
 #endif
         for (int i = 0; i < size; i++) {
@@ -734,7 +807,7 @@ public:
 
     void flip() {
 #ifdef _OPENMP
-        int available_threads = com.max_thread - omp_get_num_threads();
+        int available_threads = std::max(com.max_thread - omp_get_num_threads(), 1);
 #pragma omp parallel for schedule(static) collapse(3) num_threads(available_threads) if (available_threads > 1)
 #endif
         for (int y = 0; y < h; y++) {
@@ -752,7 +825,7 @@ public:
         assert(o.similar(*this));
 
 #ifdef _OPENMP
-        int available_threads = com.max_thread - omp_get_num_threads();
+        int available_threads = std::max(com.max_thread - omp_get_num_threads(), 1);
         #pragma omp parallel for schedule(static) collapse(3) num_threads(available_threads) if (available_threads > 1)
 #endif
        for (int y = 0; y < o.h; y++) {
@@ -784,7 +857,7 @@ public:
     void gradients(const img_t<T2>& u_) {
         const img_t<typename T::value_type>& u = *static_cast<const img_t<typename T::value_type>*>(&u_);
 #ifdef _OPENMP
-        int available_threads = com.max_thread - omp_get_num_threads();
+        int available_threads = std::max(com.max_thread - omp_get_num_threads(), 1);
         #pragma omp parallel for schedule(static) collapse(3) num_threads(available_threads) if (available_threads > 1)
 #endif
         for (int l = 0; l < d; l++) {
@@ -801,7 +874,7 @@ public:
     void circular_gradients(const img_t<T2>& u_) {
         const img_t<typename T::value_type>& u = *static_cast<const img_t<typename T::value_type>*>(&u_);
 #ifdef _OPENMP
-        int available_threads = com.max_thread - omp_get_num_threads();
+        int available_threads = std::max(com.max_thread - omp_get_num_threads(), 1);
         #pragma omp parallel num_threads(available_threads) if (available_threads > 1)
         {
             #pragma omp for collapse(3) schedule(guided)
@@ -821,7 +894,7 @@ public:
 
     void gradientx(const img_t<T>& u) {
 #ifdef _OPENMP
-        int available_threads = com.max_thread - omp_get_num_threads();
+        int available_threads = std::max(com.max_thread - omp_get_num_threads(), 1);
         #pragma omp parallel num_threads(available_threads) if (available_threads > 1)
         {
             #pragma omp for collapse(2) schedule(guided)
@@ -844,7 +917,7 @@ public:
 
     void gradienty(const img_t<T>& u) {
 #ifdef _OPENMP
-        int available_threads = com.max_thread - omp_get_num_threads();
+        int available_threads = std::max(com.max_thread - omp_get_num_threads(), 1);
         #pragma omp parallel for schedule(static) collapse(3) num_threads(available_threads) if (available_threads > 1)
 #endif
         for (int l = 0; l < d; l++) {
@@ -858,7 +931,7 @@ public:
 
     void gradientxx(const img_t<T>& u) {
 #ifdef _OPENMP
-        int available_threads = com.max_thread - omp_get_num_threads();
+        int available_threads = std::max(com.max_thread - omp_get_num_threads(), 1);
         #pragma omp parallel num_threads(available_threads) if (available_threads > 1)
         {
             #pragma omp for collapse(2) schedule(guided)
@@ -882,7 +955,7 @@ public:
 
     void gradientyy(const img_t<T>& u) {
 #ifdef _OPENMP
-        int available_threads = com.max_thread - omp_get_num_threads();
+        int available_threads = std::max(com.max_thread - omp_get_num_threads(), 1);
         #pragma omp parallel num_threads(available_threads) if (available_threads > 1)
         {
             #pragma omp for collapse(2) schedule(guided)
@@ -906,7 +979,7 @@ public:
 
     void gradientxy(const img_t<T>& u) {
 #ifdef _OPENMP
-        int available_threads = com.max_thread - omp_get_num_threads();
+        int available_threads = std::max(com.max_thread - omp_get_num_threads(), 1);
         #pragma omp parallel for schedule(static) collapse(3) num_threads(available_threads) if (available_threads > 1)
 #endif
         for (int l = 0; l < d; l++) {
@@ -922,7 +995,7 @@ public:
     template <typename T2>
     void divergence(const img_t<T2>& g) {
 #ifdef _OPENMP
-        int available_threads = com.max_thread - omp_get_num_threads();
+        int available_threads = std::max(com.max_thread - omp_get_num_threads(), 1);
         #pragma omp parallel num_threads(available_threads) if (available_threads > 1)
         {
 #endif
@@ -995,7 +1068,7 @@ public:
     template <typename T2>
     void circular_divergence(const img_t<T2>& g) {
 #ifdef _OPENMP
-        int available_threads = com.max_thread - omp_get_num_threads();
+        int available_threads = std::max(com.max_thread - omp_get_num_threads(), 1);
         #pragma omp parallel for schedule(static) collapse(3) num_threads(available_threads) if (available_threads > 1)
 #endif
         for (int l = 0; l < d; l++) {
@@ -1009,7 +1082,7 @@ public:
 
     void divergence(const img_t<T>& gx, const img_t<T>& gy) {
 #ifdef _OPENMP
-        int available_threads = com.max_thread - omp_get_num_threads();
+        int available_threads = std::max(com.max_thread - omp_get_num_threads(), 1);
         #pragma omp parallel num_threads(available_threads) if (available_threads > 1)
         {
 #endif
@@ -1122,9 +1195,13 @@ public:
         }
         float norm = w * h;
         if (this == &o) {
-            for (auto& x : data) {
-                x /= norm;
-            }
+            int n = w * h * d;
+#ifdef _OPENMP
+            int available_threads = std::max(com.max_thread - omp_get_num_threads(), 1);
+#pragma omp parallel for simd schedule(static) num_threads(available_threads) if (available_threads > 1)
+#endif
+            for (int i = 0; i < n; i++)
+                data[i] /= norm;
         } else {
             this->map(o, [norm](T x){ return x / norm; });
         }
@@ -1141,7 +1218,7 @@ public:
         int ohalfh = this->h - halfh;
 
 #ifdef _OPENMP
-        int available_threads = com.max_thread - omp_get_num_threads();
+        int available_threads = std::max(com.max_thread - omp_get_num_threads(), 1);
         #pragma omp parallel num_threads(available_threads) if (available_threads > 1)
         {
 #endif
@@ -1199,7 +1276,7 @@ public:
         int ohalfh = this->h - halfh;
 
 #ifdef _OPENMP
-        int available_threads = com.max_thread - omp_get_num_threads();
+        int available_threads = std::max(com.max_thread - omp_get_num_threads(), 1);
         #pragma omp parallel num_threads(available_threads) if (available_threads > 1)
         {
 #endif
@@ -1254,7 +1331,7 @@ public:
         int hh = o.h / 2;
 
 #ifdef _OPENMP
-        int available_threads = com.max_thread - omp_get_num_threads();
+        int available_threads = std::max(com.max_thread - omp_get_num_threads(), 1);
         #pragma omp parallel num_threads(available_threads) if (available_threads > 1)
         {
 #endif
@@ -1354,7 +1431,7 @@ public:
 
     void sanitize() {
 #ifdef _OPENMP
-        int available_threads = com.max_thread - omp_get_num_threads();
+        int available_threads = std::max(com.max_thread - omp_get_num_threads(), 1);
         #pragma omp parallel for schedule(static) num_threads(available_threads) if (available_threads > 1)
 #endif
         for (int i = 0; i < size; i++) {
@@ -1368,7 +1445,7 @@ public:
         assert(w == color.w);
         assert(h == color.h);
 #ifdef _OPENMP
-        int available_threads = com.max_thread - omp_get_num_threads();
+        int available_threads = std::max(com.max_thread - omp_get_num_threads(), 1);
         #pragma omp parallel for schedule(static) num_threads(available_threads) if (available_threads > 1)
 #endif
         for (int i = 0; i < size; i++) {
@@ -1382,7 +1459,7 @@ public:
 
     void desaturate() {
 #ifdef _OPENMP
-        int available_threads = com.max_thread - omp_get_num_threads();
+        int available_threads = std::max(com.max_thread - omp_get_num_threads(), 1);
         #pragma omp parallel for collapse(2) schedule(static) num_threads(available_threads) if (available_threads > 1)
 #endif
         for (int i = 0; i < w; i++) {
@@ -1403,7 +1480,7 @@ public:
         this->w = o.h;
         this->h = o.w;
 #ifdef _OPENMP
-        int available_threads = com.max_thread - omp_get_num_threads();
+        int available_threads = std::max(com.max_thread - omp_get_num_threads(), 1);
         #pragma omp parallel for collapse(3) schedule(static) num_threads(available_threads) if (available_threads > 1)
 #endif
         for (int y = 0; y < o.h; y++) {
@@ -1418,7 +1495,7 @@ public:
     void transposeToMatlab() {
         img_t<T> o(*this);
 #ifdef _OPENMP
-        int available_threads = com.max_thread - omp_get_num_threads();
+        int available_threads = std::max(com.max_thread - omp_get_num_threads(), 1);
         #pragma omp parallel for collapse(3) schedule(static) num_threads(available_threads) if (available_threads > 1)
 #endif
         for (int y = 0; y < h; y++) {
@@ -1433,7 +1510,7 @@ public:
     void transposeFromMatlab() {
         img_t<T> o(*this);
 #ifdef _OPENMP
-        int available_threads = com.max_thread - omp_get_num_threads();
+        int available_threads = std::max(com.max_thread - omp_get_num_threads(), 1);
         #pragma omp parallel for collapse(3) schedule(static) num_threads(available_threads) if (available_threads > 1)
 #endif
         for (int y = 0; y < h; y++) {
@@ -1451,7 +1528,7 @@ namespace img {
     T sum(const E& img) {
         T a(0);
 #ifdef _OPENMP
-        int available_threads = com.max_thread - omp_get_num_threads();
+        int available_threads = std::max(com.max_thread - omp_get_num_threads(), 1);
         #pragma omp parallel for reduction(+:a) schedule(static) num_threads(available_threads) if (available_threads > 1)
 #endif
         for (int i = 0; i < img.size; i++) {
@@ -1479,7 +1556,7 @@ namespace img {
         out.ensure_size(in.w, in.h, in.d);
 
 #ifdef _OPENMP
-        int available_threads = com.max_thread - omp_get_num_threads();
+        int available_threads = std::max(com.max_thread - omp_get_num_threads(), 1);
         #pragma omp parallel for schedule(static) num_threads(available_threads) if (available_threads > 1)
 #endif
         for (int i = 0; i < out.w*out.h; i++) {
@@ -1500,7 +1577,7 @@ namespace img {
         out.ensure_size(in.w, in.h, in.d);
 
 #ifdef _OPENMP
-        int available_threads = com.max_thread - omp_get_num_threads();
+        int available_threads = std::max(com.max_thread - omp_get_num_threads(), 1);
         #pragma omp parallel for schedule(static) num_threads(available_threads) if (available_threads > 1)
 #endif
         for (int i = 0; i < out.w*out.h; i++) {
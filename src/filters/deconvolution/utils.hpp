@@ -55,7 +55,7 @@ namespace utils {
 
         out.resize(in.h, in.w, in.d);
 #ifdef _OPENMP
-        int available_threads = com.max_thread - omp_get_num_threads();
+        int available_threads = std::max(com.max_thread - omp_get_num_threads(), 1);
         #pragma omp parallel for collapse(3) schedule(static) num_threads(available_threads) if (available_threads > 1)
 #endif
         for (int d = 0; d < in.d; d++) {
@@ -75,7 +75,7 @@ namespace utils {
         slice(f, _sl(hw, -hw-1), _sl(hh, -hh-1)).map(_f);
         // replicate borders
 #ifdef _OPENMP
-        int available_threads = com.max_thread - omp_get_num_threads();
+        int available_threads = std::max(com.max_thread - omp_get_num_threads(), 1);
         #pragma omp parallel num_threads(available_threads) if (available_threads > 1)
 {
         #pragma omp for collapse(3) schedule(static)
@@ -129,7 +129,7 @@ namespace utils {
         T dy = 0.f;
         T sum = kernel.sum();
     #ifdef _OPENMP
-        int available_threads = com.max_thread - omp_get_num_threads();
+        int available_threads = std::max(com.max_thread - omp_get_num_threads(), 1);
         #pragma omp parallel num_threads(available_threads) if (available_threads > 1)
         {
             T local_dx = 0.f;
@@ -204,7 +204,7 @@ namespace utils {
         int h = in.h;
         int d = in.d;
 #ifdef _OPENMP
-        int available_threads = com.max_thread - omp_get_num_threads();
+        int available_threads = std::max(com.max_thread - omp_get_num_threads(), 1);
         #pragma omp parallel for collapse(3) schedule(static) num_threads(available_threads) if (available_threads > 1)
 #endif
         for (int l = 0; l < d; l++) {
@@ -225,7 +225,7 @@ namespace utils {
         int h = out.h;
         int d = out.d;
 #ifdef _OPENMP
-        int available_threads = com.max_thread - omp_get_num_threads();
+        int available_threads = std::max(com.max_thread - omp_get_num_threads(), 1);
         #pragma omp parallel for collapse(3) schedule(static) num_threads(available_threads) if (available_threads > 1)
 #endif
         for (int l = 0; l < d; l++) {
@@ -243,7 +243,7 @@ namespace utils {
         if (out.size == 0)
             out.resize(in.w/2, in.h/2, in.d);
 #ifdef _OPENMP
-        int available_threads = com.max_thread - omp_get_num_threads();
+        int available_threads = std::max(com.max_thread - omp_get_num_threads(), 1);
         #pragma omp parallel for collapse(3) schedule(static) num_threads(available_threads) if (available_threads > 1)
 #endif
         for (int d = 0; d < out.d; d++) {
@@ -264,7 +264,7 @@ namespace utils {
         if (out.size == 0)
             out.resize(in.w*2, in.h*2, in.d);
 #ifdef _OPENMP
-        int available_threads = com.max_thread - omp_get_num_threads();
+        int available_threads = std::max(com.max_thread - omp_get_num_threads(), 1);
         #pragma omp parallel for collapse(3) schedule(static) num_threads(available_threads) if (available_threads > 1)
 #endif
         for (int d = 0; d < out.d; d++) {
@@ -284,7 +284,7 @@ namespace utils {
         img_t<int> lab;
         std::vector<T> sums;
 #ifdef _OPENMP
-        int available_threads = com.max_thread - omp_get_num_threads();
+        int available_threads = std::max(com.max_thread - omp_get_num_threads(), 1);
         #pragma omp parallel num_threads(available_threads) if (available_threads > 1)
         {
             #pragma omp for schedule(static)
@@ -28,6 +28,7 @@
 #include "io/single_image.h"
 #include "io/image_format_fits.h"
 #include "opencv/opencv.h"
+#include "algos/bilateral_grid.h"
 #include "gui/callbacks.h"
 #include "gui/siril_preview.h"
 
@@ -158,7 +159,10 @@ int edge_preserving_filter(struct epfargs *args) {
 	gboolean roi_fitting_needed;
 	switch (filter_type) {
 		case EP_BILATERAL:
-			cvBilateralFilter(fit, d, eps, sigma_space);
+			// large windows are approximated on a bilateral grid, whose
+			// cost does not depend on the radius
+			if (bilateral_grid_filter(fit, d, eps, sigma_space))
+				cvBilateralFilter(fit, d, eps, sigma_space);
 			break;
 		case EP_GUIDED:
 			guide_roi = calloc(1, sizeof(fits));
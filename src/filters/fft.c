@@ -36,6 +36,8 @@
 #include "gui/registration_preview.h"
 #include "core/processing.h"
 #include "core/OS_utils.h"
+#include "core/settings.h"
+#include "core/memory_report.h"
 #include "io/single_image.h"
 #include "io/image_format_fits.h"
 #include "io/sequence.h"
@@ -50,96 +52,136 @@ enum {
 
 static unsigned strategy = 0;
 
-static void fft_to_spectra(fftwf_complex *frequency_repr, float *as, float *ps,
-		float *maxi, size_t nbdata) {
-	*maxi = 0.0;
-
-	for (size_t i = 0; i < nbdata; i++) {
-		float r = crealf(frequency_repr[i]);
-		float im = cimagf(frequency_repr[i]);
-		as[i] = hypotf(r, im);
-		ps[i] = atan2f(im, r);
-		*maxi = max(as[i], *maxi);
-	}
-}
+/* The transforms of the real images are computed with real-to-complex and
+ * complex-to-real transforms on the half of the spectrum that is not given by
+ * the hermitian symmetry, F(-u, -v) = conj(F(u, v)). The centring of the
+ * spectra, which swaps the quadrants, is done when they are written or read.
+ */
 
-static void fft_to_freq(fftwf_complex *frequency_repr, const float *as, const float *ps,
-		size_t nbdata) {
-	for (size_t i = 0; i < nbdata; i++) {
-		frequency_repr[i] = as[i] * (cosf(ps[i]) + I * sinf(ps[i]));
+/* index in the stored spectrum of the frequency (u, v), the stored spectrum
+ * being centred or not */
+static inline size_t stored_index(unsigned int width, unsigned int height,
+		unsigned int u, unsigned int v, gboolean centered) {
+	if (centered) {
+		u = (u + width - width / 2) % width;
+		v = (v + height - height / 2) % height;
 	}
+	return (size_t) v * width + u;
 }
 
-static void change_symmetry_forward(unsigned int width, unsigned int height,
-		unsigned int i, unsigned int j, unsigned int *x, unsigned int *y) {
+/* computes the spectrum of a layer, as modulus and phase of the same size as
+ * the image, centred if requested */
+static int compute_spectra(const fits *fit, int layer, gboolean centered,
+		float *modul, float *phase, float *maxi) {
+	unsigned int width = fit->rx, height = fit->ry;
+	unsigned int hwidth = width / 2 + 1;
+	size_t nbdata = (size_t) width * height;
+	size_t nbfreq = (size_t) hwidth * height;
 
-	*x = i + width / 2;
-	if (*x >= width) {
-		*x = *x - width;
-	}
-	*y = j + height / 2;
-	if (*y >= height) {
-		*y = *y - height;
+	float *spatial_repr = fftwf_malloc(sizeof(float) * nbdata);
+	fftwf_complex *frequency_repr = fftwf_malloc(sizeof(fftwf_complex) * nbfreq);
+	if (!spatial_repr || !frequency_repr) {
+		PRINT_ALLOC_ERR;
+		fftwf_free(spatial_repr);
+		fftwf_free(frequency_repr);
+		return 1;
 	}
-}
-
-static void change_symmetry_backward(unsigned int width, unsigned int height,
-		unsigned int i, unsigned int j, unsigned int *x, unsigned int *y) {
+	memory_account(MEM_FFT, sizeof(float) * nbdata + sizeof(fftwf_complex) * nbfreq);
 
-	*x = i + width - width / 2;
-	if (*x >= width) {
-		*x = *x - width;
-	}
-	*y = j + height - height / 2;
-	if (*y >= height) {
-		*y = *y - height;
+	/* we plan before filling the input, which is used by the measures */
+	fftwf_plan p = fftwf_plan_dft_r2c_2d(height, width, spatial_repr, frequency_repr, strategy);
+	if (fit->type == DATA_USHORT) {
+		const WORD *gbuf = fit->pdata[layer];
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(com.max_thread) schedule(static) if(nbdata > 15000)
+#endif
+		for (size_t i = 0; i < nbdata; i++)
+			spatial_repr[i] = (float) gbuf[i];
+	} else {
+		memcpy(spatial_repr, fit->fpdata[layer], nbdata * sizeof(float));
 	}
-}
+	fftwf_execute(p);
 
-static void centered_ushort(WORD *buf, unsigned int width, unsigned int height,
-		int type) {
-	unsigned int i, j;
-
-	WORD *temp = malloc(width * height * sizeof(WORD));
-	for (j = 0; j < height; j++) {
-		for (i = 0; i < width; i++) {
-			unsigned int x = i;
-			unsigned int y = j;
-			if (type == FFTW_FORWARD) {
-				change_symmetry_forward(width, height, i, j, &x, &y);
+	float max_modul = 0.f;
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(com.max_thread) schedule(static) reduction(max:max_modul) if(nbdata > 15000)
+#endif
+	for (unsigned int v = 0; v < height; v++) {
+		for (unsigned int u = 0; u < width; u++) {
+			float r, im;
+			if (u < hwidth) {
+				size_t f = (size_t) v * hwidth + u;
+				r = crealf(frequency_repr[f]);
+				im = cimagf(frequency_repr[f]);
 			} else {
-				change_symmetry_backward(width, height, i, j, &x, &y);
+				// conjugate of the symmetric frequency
+				size_t f = (size_t) ((height - v) % height) * hwidth + (width - u);
+				r = crealf(frequency_repr[f]);
+				im = -cimagf(frequency_repr[f]);
 			}
-
-			temp[j * width + i] = buf[y * width + x];
+			size_t index = stored_index(width, height, u, v, centered);
+			modul[index] = hypotf(r, im);
+			phase[index] = atan2f(im, r);
+			max_modul = max(modul[index], max_modul);
 		}
 	}
+	*maxi = max_modul;
 
-	memcpy(buf, temp, sizeof(WORD) * width * height);
-	free(temp);
+	fftwf_destroy_plan(p);
+	memory_account(MEM_FFT, -(gint64) (sizeof(float) * nbdata + sizeof(fftwf_complex) * nbfreq));
+	fftwf_free(spatial_repr);
+	fftwf_free(frequency_repr);
+	return 0;
 }
 
-static void centered_float(float *buf, unsigned int width, unsigned int height,
-		int type) {
-	unsigned int i, j;
-
-	float *temp = malloc(width * height * sizeof(float));
-	for (j = 0; j < height; j++) {
-		for (i = 0; i < width; i++) {
-			unsigned int x = i;
-			unsigned int y = j;
-			if (type == FFTW_FORWARD) {
-				change_symmetry_forward(width, height, i, j, &x, &y);
-			} else {
-				change_symmetry_backward(width, height, i, j, &x, &y);
-			}
+/* computes the real image of a spectrum given by its modulus and phase, stored
+ * centred or not. The spectrum of a real image is hermitian, if it was edited
+ * without keeping the symmetry, its hermitian part is used, which gives the
+ * real part of its complex inverse transform. The result is in out, of
+ * the size of the spectrum */
+static int compute_image_from_spectra(unsigned int width, unsigned int height,
+		const float *modul, const float *phase, gboolean centered, float *out) {
+	unsigned int hwidth = width / 2 + 1;
+	size_t nbdata = (size_t) width * height;
+	size_t nbfreq = (size_t) hwidth * height;
+
+	float *spatial_repr = fftwf_malloc(sizeof(float) * nbdata);
+	fftwf_complex *frequency_repr = fftwf_malloc(sizeof(fftwf_complex) * nbfreq);
+	if (!spatial_repr || !frequency_repr) {
+		PRINT_ALLOC_ERR;
+		fftwf_free(spatial_repr);
+		fftwf_free(frequency_repr);
+		return 1;
+	}
+	memory_account(MEM_FFT, sizeof(float) * nbdata + sizeof(fftwf_complex) * nbfreq);
 
-			temp[j * width + i] = buf[y * width + x];
+	fftwf_plan p = fftwf_plan_dft_c2r_2d(height, width, frequency_repr, spatial_repr, strategy);
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(com.max_thread) schedule(static) if(nbdata > 15000)
+#endif
+	for (unsigned int v = 0; v < height; v++) {
+		for (unsigned int u = 0; u < hwidth; u++) {
+			size_t index = stored_index(width, height, u, v, centered);
+			size_t sym = stored_index(width, height, (width - u) % width, (height - v) % height, centered);
+			float r = 0.5f * (modul[index] * cosf(phase[index]) + modul[sym] * cosf(phase[sym]));
+			float im = 0.5f * (modul[index] * sinf(phase[index]) - modul[sym] * sinf(phase[sym]));
+			frequency_repr[(size_t) v * hwidth + u] = r + I * im;
 		}
 	}
+	fftwf_execute(p);
 
-	memcpy(buf, temp, sizeof(float) * width * height);
-	free(temp);
+	float norm = 1.f / (float) nbdata;
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(com.max_thread) schedule(static) if(nbdata > 15000)
+#endif
+	for (size_t i = 0; i < nbdata; i++)
+		out[i] = spatial_repr[i] * norm;
+
+	fftwf_destroy_plan(p);
+	memory_account(MEM_FFT, -(gint64) (sizeof(float) * nbdata + sizeof(fftwf_complex) * nbfreq));
+	fftwf_free(spatial_repr);
+	fftwf_free(frequency_repr);
+	return 0;
 }
 
 static void normalisation_spectra_ushort(unsigned int w, unsigned int h, const float *modul, const float *phase,
@@ -171,117 +213,65 @@ static void save_dft_information_in_gfit(fits *fit) {
 static void FFTD_ushort(fits *fit, fits *x, fits *y, int type_order, int layer) {
 	WORD *xbuf = x->pdata[layer];
 	WORD *ybuf = y->pdata[layer];
-	WORD *gbuf = fit->pdata[layer];
 	unsigned int width = fit->rx, height = fit->ry;
+	size_t nbdata = (size_t) width * height;
 	float maxi;
-	size_t i, nbdata = width * height;
 
-	fftwf_complex *spatial_repr = fftwf_malloc(sizeof(fftwf_complex) * nbdata);
-	if (!spatial_repr) {
+	/* we compute modulus and phase */
+	float *modul = malloc(nbdata * sizeof(float));
+	float *phase = malloc(nbdata * sizeof(float));
+	if (!modul || !phase) {
 		PRINT_ALLOC_ERR;
+		free(modul);
+		free(phase);
 		return;
 	}
-	fftwf_complex *frequency_repr = fftwf_malloc(sizeof(fftwf_complex) * nbdata);
-	if (!frequency_repr) {
-		PRINT_ALLOC_ERR;
-		fftwf_free(spatial_repr);
+	if (compute_spectra(fit, layer, type_order == TYPE_CENTERED, modul, phase, &maxi)) {
+		free(modul);
+		free(phase);
 		return;
 	}
 
-
-	/* we run the Fourier Transform */
-	fftwf_plan p = fftwf_plan_dft_2d(height, width, spatial_repr, frequency_repr,
-			FFTW_FORWARD, strategy);
-	/* copying image selection into the fftw data */
-#ifdef _OPENMP
-#pragma omp parallel for num_threads(com.max_thread) private(i) schedule(static) if(nbdata > 15000)
-#endif
-	for (i = 0; i < nbdata; i++) {
-		spatial_repr[i] = (float) gbuf[i];
-	}
-	fftwf_execute(p);
-
-	/* we compute modulus and phase */
-	float *modul = malloc(nbdata * sizeof(float));
-	float *phase = malloc(nbdata * sizeof(float));
-
-	fft_to_spectra(frequency_repr, modul, phase, &maxi, nbdata);
-
 	//We normalize the modulus and the phase
 	normalisation_spectra_ushort(width, height, modul, phase, xbuf, ybuf, maxi);
-	if (type_order == TYPE_CENTERED) {
-		strcpy(x->keywords.dft.ord, "CENTERED");
-		centered_ushort(xbuf, width, height, FFTW_FORWARD);
-		centered_ushort(ybuf, width, height, FFTW_FORWARD);
-	} else {
-		strcpy(x->keywords.dft.ord, "REGULAR");
-	}
+	strcpy(x->keywords.dft.ord, type_order == TYPE_CENTERED ? "CENTERED" : "REGULAR");
 	strcpy(y->keywords.dft.ord, x->keywords.dft.ord);
 	x->keywords.dft.norm[layer] = maxi / USHRT_MAX_SINGLE;
 
 	free(modul);
 	free(phase);
-	fftwf_destroy_plan(p);
-	fftwf_free(spatial_repr);
-	fftwf_free(frequency_repr);
 }
 
 static void FFTD_float(fits *fit, fits *x, fits *y, int type_order, int layer) {
 	float *xbuf = x->fpdata[layer];
 	float *ybuf = y->fpdata[layer];
-	float *gbuf = fit->fpdata[layer];
 	unsigned int width = fit->rx, height = fit->ry;
+	size_t nbdata = (size_t) width * height;
 	float maxi;
-	size_t i, nbdata = width * height;
 
-	fftwf_complex *spatial_repr = fftwf_malloc(sizeof(fftwf_complex) * nbdata);
-	if (!spatial_repr) {
+	/* we compute modulus and phase */
+	float *modul = malloc(nbdata * sizeof(float));
+	float *phase = malloc(nbdata * sizeof(float));
+	if (!modul || !phase) {
 		PRINT_ALLOC_ERR;
+		free(modul);
+		free(phase);
 		return;
 	}
-	fftwf_complex *frequency_repr = fftwf_malloc(sizeof(fftwf_complex) * nbdata);
-	if (!frequency_repr) {
-		PRINT_ALLOC_ERR;
-		fftwf_free(spatial_repr);
+	if (compute_spectra(fit, layer, type_order == TYPE_CENTERED, modul, phase, &maxi)) {
+		free(modul);
+		free(phase);
 		return;
 	}
 
-
-	/* we run the Fourier Transform */
-	fftwf_plan p = fftwf_plan_dft_2d(height, width, spatial_repr, frequency_repr,
-			FFTW_FORWARD, strategy);
-	/* copying image selection into the fftw data */
-#ifdef _OPENMP
-#pragma omp parallel for num_threads(com.max_thread) private(i) schedule(static) if(nbdata > 15000)
-#endif
-	for (i = 0; i < nbdata; i++) {
-		spatial_repr[i] = (float) gbuf[i];
-	}
-	fftwf_execute(p);
-
-	/* we compute modulus and phase */
-	float *modul = malloc(nbdata * sizeof(float));
-	float *phase = malloc(nbdata * sizeof(float));
-
-	fft_to_spectra(frequency_repr, modul, phase, &maxi, nbdata);
-
 	//We normalize the modulus and the phase
 	normalisation_spectra_float(width, height, modul, phase, xbuf, ybuf, maxi);
-	if (type_order == TYPE_CENTERED) {
-		strcpy(x->keywords.dft.ord, "CENTERED");
-		centered_float(xbuf, width, height, FFTW_FORWARD);
-		centered_float(ybuf, width, height, FFTW_FORWARD);
-	} else {
-		strcpy(x->keywords.dft.ord, "REGULAR");
-	}
+	strcpy(x->keywords.dft.ord, type_order == TYPE_CENTERED ? "CENTERED" : "REGULAR");
 	strcpy(y->keywords.dft.ord, x->keywords.dft.ord);
 	x->keywords.dft.norm[layer] = maxi;
 
 	free(modul);
 	free(phase);
-	fftwf_destroy_plan(p);
-	fftwf_free(spatial_repr);
-	fftwf_free(frequency_repr);
 }
 
 static void FFTD(fits *fit, fits *xfit, fits *yfit, int type_order, int layer) {
@@ -298,57 +288,35 @@ static void FFTI_ushort(fits *fit, fits *xfit, fits *yfit, int type_order, int l
 	WORD *gbuf = fit->pdata[layer];
 	unsigned int width = xfit->rx;
 	unsigned int height = xfit->ry;
-	size_t i, nbdata = width * height;
+	size_t i, nbdata = (size_t) width * height;
 
-	float *modul = calloc(1, nbdata * sizeof(float));
-	float *phase = calloc(1, nbdata * sizeof(float));
-
-	if (type_order == TYPE_CENTERED) {
-		centered_ushort(xbuf, width, height, FFTW_BACKWARD);
-		centered_ushort(ybuf, width, height, FFTW_BACKWARD);
-	}
-
-	for (i = 0; i < height * width; i++) {
-		modul[i] = (float) xbuf[i] * (xfit->keywords.dft.norm[layer]);
-		phase[i] = (float) ybuf[i] * (2.f * (float)M_PI / USHRT_MAX_SINGLE);
-		phase[i] -= (float)M_PI;
-	}
-
-	fftwf_complex* spatial_repr = fftwf_malloc(sizeof(fftwf_complex) * nbdata);
-	if (!spatial_repr) {
+	float *modul = malloc(nbdata * sizeof(float));
+	float *phase = malloc(nbdata * sizeof(float));
+	float *result = malloc(nbdata * sizeof(float));
+	if (!modul || !phase || !result) {
 		PRINT_ALLOC_ERR;
 		free(modul);
 		free(phase);
+		free(result);
 		return;
 	}
 
-	fftwf_complex* frequency_repr = fftwf_malloc(sizeof(fftwf_complex) * nbdata);
-	if (!frequency_repr) {
-		PRINT_ALLOC_ERR;
-		fftwf_free(spatial_repr);
-		free(modul);
-		free(phase);
-		return;
+	for (i = 0; i < nbdata; i++) {
+		modul[i] = (float) xbuf[i] * (xfit->keywords.dft.norm[layer]);
+		phase[i] = (float) ybuf[i] * (2.f * (float)M_PI / USHRT_MAX_SINGLE);
+		phase[i] -= (float)M_PI;
 	}
 
-
-	fftwf_plan p = fftwf_plan_dft_2d(height, width, frequency_repr, spatial_repr,
-			FFTW_BACKWARD, strategy);
-	fft_to_freq(frequency_repr, modul, phase, nbdata);
-	fftwf_execute(p);
-
-	for (i = 0; i < nbdata; i++) {
-		float pxl = crealf(spatial_repr[i]) / nbdata;
-		gbuf[i] = roundf_to_WORD(pxl);
+	if (!compute_image_from_spectra(width, height, modul, phase, type_order == TYPE_CENTERED, result)) {
+		for (i = 0; i < nbdata; i++)
+			gbuf[i] = roundf_to_WORD(result[i]);
+		delete_selected_area();
+		invalidate_stats_from_fit(fit);
 	}
-	delete_selected_area();
-	invalidate_stats_from_fit(fit);
 
 	free(modul);
 	free(phase);
-	fftwf_destroy_plan(p);
-	fftwf_free(spatial_repr);
-	fftwf_free(frequency_repr);
+	free(result);
 }
 
 static void FFTI_float(fits *fit, fits *xfit, fits *yfit, int type_order, int layer) {
@@ -357,57 +325,30 @@ static void FFTI_float(fits *fit, fits *xfit, fits *yfit, int type_order, int la
 	float *gbuf = fit->fpdata[layer];
 	unsigned int width = xfit->rx;
 	unsigned int height = xfit->ry;
-	size_t i, nbdata = width * height;
-
-	float *modul = calloc(1, nbdata * sizeof(float));
-	float *phase = calloc(1, nbdata * sizeof(float));
-
-	if (type_order == TYPE_CENTERED) {
-		centered_float(xbuf, width, height, FFTW_BACKWARD);
-		centered_float(ybuf, width, height, FFTW_BACKWARD);
-	}
+	size_t i, nbdata = (size_t) width * height;
 
-	for (i = 0; i < height * width; i++) {
-		modul[i] = xbuf[i] * (xfit->keywords.dft.norm[layer]);
-		phase[i] = ybuf[i] * (2.f * (float)M_PI);
-		phase[i] -= (float)M_PI;
-	}
-
-	fftwf_complex* spatial_repr = fftwf_malloc(sizeof(fftwf_complex) * nbdata);
-	if (!spatial_repr) {
+	float *modul = malloc(nbdata * sizeof(float));
+	float *phase = malloc(nbdata * sizeof(float));
+	if (!modul || !phase) {
 		PRINT_ALLOC_ERR;
 		free(modul);
 		free(phase);
 		return;
 	}
 
-	fftwf_complex* frequency_repr = fftwf_malloc(sizeof(fftwf_complex) * nbdata);
-	if (!frequency_repr) {
-		PRINT_ALLOC_ERR;
-		fftwf_free(spatial_repr);
-		free(modul);
-		free(phase);
-		return;
+	for (i = 0; i < nbdata; i++) {
+		modul[i] = xbuf[i] * (xfit->keywords.dft.norm[layer]);
+		phase[i] = ybuf[i] * (2.f * (float)M_PI);
+		phase[i] -= (float)M_PI;
 	}
 
-
-	fftwf_plan p = fftwf_plan_dft_2d(height, width, frequency_repr, spatial_repr,
-			FFTW_BACKWARD, strategy);
-	fft_to_freq(frequency_repr, modul, phase, nbdata);
-	fftwf_execute(p);
-
-	for (i = 0; i < nbdata; i++) {
-		float pxl = crealf(spatial_repr[i]) / nbdata;
-		gbuf[i] = pxl;
+	if (!compute_image_from_spectra(width, height, modul, phase, type_order == TYPE_CENTERED, gbuf)) {
+		delete_selected_area();
+		invalidate_stats_from_fit(fit);
 	}
-	delete_selected_area();
-	invalidate_stats_from_fit(fit);
 
 	free(modul);
 	free(phase);
-	fftwf_destroy_plan(p);
-	fftwf_free(spatial_repr);
-	fftwf_free(frequency_repr);
 }
 
 static void FFTI(fits *fit, fits *xfit, fits *yfit, int type_order, int layer) {
@@ -448,10 +389,10 @@ gpointer fourier_transform(gpointer p) {
 	fprintf(stdout, "fftwf initialized with %d threads\n", n);
 #endif
 
-// The following switch is no longer used: the overhead generated by expensive
-// planning strategies is not worth it for one-off FFTs
-
-/*	switch (com.pref.fftw_conf.strategy) {
+	/* the plans are kept in the wisdom file shared with the other FFT users,
+	 * so the planning strategy of the preferences is only paid once for each
+	 * image size */
+	switch (com.pref.fftw_conf.strategy) {
 		case 1:
 			strategy = FFTW_MEASURE;
 			break;
@@ -463,16 +404,10 @@ gpointer fourier_transform(gpointer p) {
 			break;
 		default:
 			strategy = FFTW_ESTIMATE;
-	}*/
-	strategy = FFTW_ESTIMATE;
-	set_wisdom_file();
-    if (fftwf_import_wisdom_from_filename(com.pref.fftw_conf.wisdom_file) == 1) {
-        siril_log_message(_("Siril FFT wisdom imported successfully...\n"));
-	} else if (fftwf_import_system_wisdom() == 1) {
-        siril_log_message(_("System FFT wisdom imported successfully...\n"));
-	} else {
-        siril_log_message(_("No FFT wisdom found to import...\n"));
 	}
+	if (import_fftw_wisdom())
+		siril_log_message(_("FFT wisdom imported successfully...\n"));
+	else siril_log_message(_("No FFT wisdom found to import...\n"));
 	data_type type = args->fit->type;
 
 	siril_log_color_message(_("Fourier Transform: processing...\n"), "green");
@@ -551,11 +486,9 @@ gpointer fourier_transform(gpointer p) {
 	}
 
 end:
-	if (fftwf_export_wisdom_to_filename(com.pref.fftw_conf.wisdom_file) == 1) {
-        siril_log_message(_("Siril FFT wisdom updated successfully...\n"));
-	} else {
-        siril_log_message(_("Siril FFT wisdom update failed...\n"));
-	}
+	if (export_fftw_wisdom())
+		siril_log_message(_("Siril FFT wisdom updated successfully...\n"));
+	else siril_log_message(_("Siril FFT wisdom update failed...\n"));
 
 	invalidate_stats_from_fit(args->fit);
 	if (tmp)  { clearfits(tmp);  free(tmp);  }
@@ -665,6 +665,12 @@ void apply_linked_ght_to_fits(fits *from, fits *to, ght_params *params, gboolean
 	return;
 }
 
+/* GHT stretches that do not mix the channels are pixel-wise operations and can
+ * be composed with other ones in a point_pipeline */
+gboolean ght_is_point_op(const fits *fit, const ght_params *params) {
+	return fit->naxes[2] == 1 || params->stretchtype == STRETCH_LINEAR || params->payne_colourstretchmodel == COL_INDEP;
+}
+
 void apply_ght_to_fits_channel(fits *from, fits *to, int channel, ght_params *params, gboolean multithreaded) {
 	g_assert(from);
 	g_assert(from->naxes[2] <= 3 && from->naxes[2] > channel);
@@ -33,5 +33,6 @@ void apply_linked_ght_to_fits(fits *from, fits *to, ght_params *params, gboolean
 void apply_sat_ght_to_fits(fits *fit, ght_params *params, gboolean multithreaded);
 void apply_linked_ght_to_fbuf_indep(float* in, float* out, size_t layersize, size_t nchans, ght_params *params, gboolean multithreaded);
 void apply_linked_ght_to_Wbuf_indep(WORD* in, WORD* out, size_t layersize, size_t nchans, ght_params *params, gboolean multithreaded);
+gboolean ght_is_point_op(const fits *fit, const ght_params *params);
 void apply_ght_to_fits_channel(fits *from, fits *to, int channel, ght_params *params, gboolean multithreaded);
 #endif
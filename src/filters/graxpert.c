@@ -146,6 +146,7 @@ static int exec_prog_graxpert(char **argv, gboolean graxpert_no_exit_report, gbo
 	fprintf(stdout, "\n");
 	// g_spawn handles wchar so not need to convert
 	if (!is_sequence) set_progress_bar_data(_("Starting GraXpert..."), 0.0);
+	gint64 start = siril_tool_begin(EXT_GRAXPERT);
 	error = spawn_graxpert(argv, 200, &child_pid, NULL, NULL, &child_stderr);
 
 	int i = 0;
@@ -154,6 +155,7 @@ static int exec_prog_graxpert(char **argv, gboolean graxpert_no_exit_report, gbo
 
 	if (error != NULL) {
 		siril_log_color_message(_("Spawning GraXpert failed: %s\n"), "red", error->message);
+		siril_tool_end(EXT_GRAXPERT, start);
 		return retval;
 	}
 	g_child_watch_add(child_pid, child_watch_cb, NULL);
@@ -241,6 +243,7 @@ static int exec_prog_graxpert(char **argv, gboolean graxpert_no_exit_report, gbo
 	g_object_unref(stream);
 	if (!g_close(child_stderr, &error))
 		siril_debug_print("%s\n", error->message);
+	siril_tool_end(EXT_GRAXPERT, start);
 	return retval;
 }
 
@@ -670,6 +673,7 @@ graxpert_data *new_graxpert_data() {
 
 void free_graxpert_data(graxpert_data *args) {
 	g_free(args->path);
+	g_free(args->session_dir);
 	g_free(args->configfile);
 	g_free(args->ai_version);
 	free_background_sample_list(args->bg_samples);
@@ -700,7 +704,8 @@ static void open_graxpert_result(graxpert_data *args) {
 			}
 		} else {
 			fits *result = calloc(1, sizeof(fits));
-			siril_log_message(_("Reading result from the temporary working file...\n"));
+			if (verbose)
+				siril_log_message(_("Reading result from the temporary working file...\n"));
 			if (readfits(args->path, result, NULL, !com.pref.force_16bit)) {
 				siril_log_color_message(_("Error opening GraXpert result. Check the file %s\n"), "red", args->path);
 				enable_profile_check_verbose();
@@ -739,7 +744,8 @@ static void open_graxpert_result(graxpert_data *args) {
 				populate_roi();
 			}
 		}
-		siril_log_message(_("Removing the temporary working file...\n"));
+		if (verbose)
+			siril_log_message(_("Removing the temporary working file...\n"));
 		if (g_unlink(args->path))
 			siril_debug_print("Failed to unlink GraXpert working file\n");
 		enable_profile_check_verbose();
@@ -811,13 +817,16 @@ gpointer do_graxpert (gpointer p) {
 	g_free(com.pref.ext);
 	com.pref.ext = backup_ext;
 
-	path = g_build_filename(com.wd, filename, NULL);
+	if (args->session_dir)
+		path = g_build_filename(args->session_dir, filename, NULL);
+	else path = g_build_filename(com.wd, filename, NULL);
 	temp = g_strdup(path);
 	outpath = remove_ext_from_filename(temp);
 	g_free(temp);
 	g_free(filename);
 	// Save current image as input filename
-	siril_log_message(_("Saving temporary working file...\n"));
+	if (verbose)
+		siril_log_message(_("Saving temporary working file...\n"));
 	if (savefits(path, args->fit)) {
 		siril_log_color_message(_("Error: failed to save temporary FITS\n"), "red");
 		goto ERROR_OR_FINISHED;
@@ -851,7 +860,8 @@ gpointer do_graxpert (gpointer p) {
 				goto ERROR_OR_FINISHED;
 			}
 			my_argv[nb++] = g_strdup("-preferences_file");
-			args->configfile = g_build_filename(com.wd, "siril-graxpert.pref", NULL);
+			g_free(args->configfile);
+			args->configfile = g_build_filename(args->session_dir ? args->session_dir : com.wd, "siril-graxpert.pref", NULL);
 			my_argv[nb++] = g_strdup(args->configfile);
 			save_graxpert_config(args);
 		}
@@ -870,6 +880,11 @@ gpointer do_graxpert (gpointer p) {
 		my_argv[nb++] = g_strdup(args->use_gpu ? "true" : "false");
 		my_argv[nb++] = g_strdup("-strength");
 		my_argv[nb++] = g_strdup_printf("%.2f", args->denoise_strength);
+		if (args->ai_batch_size > 0) {
+			/* number of tiles GraXpert sends to the model at once */
+			my_argv[nb++] = g_strdup("-batch_size");
+			my_argv[nb++] = g_strdup_printf("%d", args->ai_batch_size);
+		}
 		if (args->ai_version != NULL) {
 			my_argv[nb++] = g_strdup("-ai_version");
 			my_argv[nb++] = g_strdup(args->ai_version);
@@ -886,6 +901,10 @@ gpointer do_graxpert (gpointer p) {
 		my_argv[nb++] = g_strdup_printf("%.2f", args->deconv_strength);
 		my_argv[nb++] = g_strdup("-psfsize");
 		my_argv[nb++] = g_strdup_printf("%.2f", args->deconv_blur_psf_size);
+		if (args->ai_batch_size > 0) {
+			my_argv[nb++] = g_strdup("-batch_size");
+			my_argv[nb++] = g_strdup_printf("%d", args->ai_batch_size);
+		}
 		if (args->ai_version != NULL) {
 			my_argv[nb++] = g_strdup("-ai_version");
 			my_argv[nb++] = g_strdup(args->ai_version);
@@ -930,10 +949,9 @@ gpointer do_graxpert (gpointer p) {
 ERROR_OR_FINISHED:
 	g_free(outpath);
 	set_progress_bar_data(PROGRESS_TEXT_RESET, PROGRESS_RESET);
-	if (!retval && text) {
+	if (!retval && text && !args->seq)
 		undo_save_state(&gfit, text);
-		g_free(text);
-	}
+	g_free(text);
 	if (!args->seq && !com.script)
 		siril_add_idle(end_graxpert, args); // this loads the result
 	else
@@ -943,6 +961,24 @@ ERROR_OR_FINISHED:
 
 /******** SEQUENCE FUNCTIONS *********/
 
+/* The frames are exchanged with GraXpert through a directory of the user runtime
+ * directory when it is in memory, see siril_create_exchange_dir(), instead of
+ * being written to the working directory and read back from it for each frame. */
+static int graxpert_prepare_hook(struct generic_seq_args *args) {
+	graxpert_data *data = (graxpert_data *) args->user;
+	data->session_dir = siril_create_exchange_dir("graxpert");
+	return seq_prepare_hook(args);
+}
+
+static int graxpert_finalize_hook(struct generic_seq_args *args) {
+	graxpert_data *data = (graxpert_data *) args->user;
+	int retval = seq_finalize_hook(args);
+	siril_tool_log_stats(EXT_GRAXPERT, "GraXpert");
+	siril_remove_exchange_dir(data->session_dir);
+	data->session_dir = NULL;
+	return retval;
+}
+
 static int graxpert_compute_mem_limits(struct generic_seq_args *args, gboolean for_writer) {
 //	GraXpert cannot run in parallel as it fully utilizes the GPU / CPU. This function therefore
 //	returns a maximum of 1 and all images will be processed in series.
@@ -987,7 +1023,8 @@ void apply_graxpert_to_sequence(graxpert_data *args) {
 	seqargs->filtering_criterion = seq_filter_included;
 	seqargs->nb_filtered_images = args->seq->selnum;
 	seqargs->compute_mem_limits_hook = graxpert_compute_mem_limits;
-	seqargs->prepare_hook = seq_prepare_hook;
+	seqargs->prepare_hook = graxpert_prepare_hook;
+	seqargs->finalize_hook = graxpert_finalize_hook;
 	seqargs->image_hook = graxpert_image_hook;
 	seqargs->description = _("GraXpert");
 	seqargs->has_output = TRUE;
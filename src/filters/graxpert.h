@@ -61,6 +61,7 @@ typedef struct _graxpert_data {
 	gchar *ai_version;
 	cmsHPROFILE backup_icc;
 	gboolean previewing;
+	gchar *session_dir; // exchange directory of the frames of a sequence
 } graxpert_data;
 
 void set_graxpert_aborted(gboolean state);
@@ -254,6 +254,262 @@ double get_median_gsl(gsl_matrix *mat, const int xx, const int yy, const int w,
 }
 
 
+/* Sliding window median for large kernels (Huang's algorithm): the
+ * histogram of the window is updated with one column in and one column out
+ * when moving along a row, and the median is tracked from one pixel to the
+ * next instead of being searched from scratch. Keys are 16 bits, with a
+ * coarse histogram of their high byte to skip empty ranges quickly. */
+struct median_hist {
+	guint16 *fine;		// 65536 bins
+	guint16 coarse[256];
+	int m;			// current median key
+	int below;		// number of keys of the window lower than m
+};
+
+static int median_hist_init(struct median_hist *h) {
+	memset(h, 0, sizeof(struct median_hist));
+	h->fine = calloc(65536, sizeof(guint16));
+	if (!h->fine) {
+		PRINT_ALLOC_ERR;
+		return 1;
+	}
+	return 0;
+}
+
+static inline void median_hist_add(struct median_hist *h, guint16 key) {
+	h->fine[key]++;
+	h->coarse[key >> 8]++;
+	if (key < h->m)
+		h->below++;
+}
+
+static inline void median_hist_remove(struct median_hist *h, guint16 key) {
+	h->fine[key]--;
+	h->coarse[key >> 8]--;
+	if (key < h->m)
+		h->below--;
+}
+
+/* returns the key of rank r (starting at 0) in the window; h->below is then
+ * the number of keys lower than it */
+static inline int median_hist_rank(struct median_hist *h, int r) {
+	int m = h->m, below = h->below;
+	while (below > r) {
+		if (!(m & 0xff) && m >= 256 && below - h->coarse[(m >> 8) - 1] > r) {
+			below -= h->coarse[(m >> 8) - 1];
+			m -= 256;
+		} else {
+			m--;
+			below -= h->fine[m];
+		}
+	}
+	while (below + h->fine[m] <= r) {
+		if (!(m & 0xff) && below + h->coarse[m >> 8] <= r) {
+			below += h->coarse[m >> 8];
+			m += 256;
+		} else {
+			below += h->fine[m];
+			m++;
+		}
+	}
+	h->m = m;
+	h->below = below;
+	return m;
+}
+
+/* order-preserving 16-bit key of a float: its sign, exponent and 7 bits of
+ * mantissa */
+static inline guint16 float_key16(float v) {
+	guint32 u;
+	memcpy(&u, &v, sizeof(guint32));
+	u ^= (u & 0x80000000u) ? 0xffffffffu : 0x80000000u;
+	return (guint16) (u >> 16);
+}
+
+/* fills the histogram with the window of the pixel (radius, y) */
+static void median_hist_fill(struct median_hist *h, const guint16 *keys, int nx, int y, int radius) {
+	for (int i = -radius; i <= radius; i++) {
+		const guint16 *row = keys + (size_t) (y + i) * nx;
+		for (int j = 0; j <= 2 * radius; j++)
+			median_hist_add(h, row[j]);
+	}
+}
+
+/* moves the window from pixel (x, y) to (x + 1, y) */
+static inline void median_hist_slide(struct median_hist *h, const guint16 *keys, int nx, int x, int y, int radius) {
+	for (int i = -radius; i <= radius; i++) {
+		const guint16 *row = keys + (size_t) (y + i) * nx;
+		median_hist_remove(h, row[x - radius]);
+		median_hist_add(h, row[x + radius + 1]);
+	}
+}
+
+/* empties the histogram holding the window of the pixel (nx - radius - 1, y) */
+static void median_hist_empty(struct median_hist *h, const guint16 *keys, int nx, int y, int radius) {
+	for (int i = -radius; i <= radius; i++) {
+		const guint16 *row = keys + (size_t) (y + i) * nx;
+		for (int j = nx - 2 * radius - 1; j < nx; j++)
+			median_hist_remove(h, row[j]);
+	}
+}
+
+/* median filter with a large kernel of the interior of the image, borders of
+ * width radius are left untouched */
+static int median_hist_ushort(const WORD *src, WORD *dst, int nx, int ny, int radius,
+		float amountf, int *progress, double total) {
+	int r = (2 * radius + 1) * (2 * radius + 1) / 2;
+	int retval = 0;
+#ifdef _OPENMP
+#pragma omp parallel num_threads(com.max_thread)
+#endif
+	{
+		struct median_hist hist;
+		if (median_hist_init(&hist)) {
+#ifdef _OPENMP
+#pragma omp atomic write
+#endif
+			retval = 1;
+		} else {
+#ifdef _OPENMP
+#pragma omp for schedule(dynamic,16)
+#endif
+			for (int y = radius; y < ny - radius; y++) {
+				median_hist_fill(&hist, src, nx, y, radius);
+				for (int x = radius; x < nx - radius; x++) {
+					if (x > radius)
+						median_hist_slide(&hist, src, nx, x - 1, y, radius);
+					float median = (float) median_hist_rank(&hist, r);
+					dst[y * nx + x] = roundf_to_WORD(intpf(amountf, median, (float) src[y * nx + x]));
+				}
+				median_hist_empty(&hist, src, nx, y, radius);
+#ifdef _OPENMP
+#pragma omp critical
+#endif
+				{
+					++(*progress);
+					if (!(*progress % 32)) {
+						set_progress_bar_data(NULL, (double)*progress / total);
+					}
+				}
+			}
+			free(hist.fine);
+		}
+	}
+	return retval;
+}
+
+/* same for float: the histogram of the 16-bit keys gives the bucket of the
+ * median and its rank in the bucket, which is then selected exactly among the
+ * values of the window falling in this bucket */
+static int median_hist_float(const float *src, float *dst, int nx, int ny, int radius,
+		float amountf, int *progress, double total) {
+	int ksize = 2 * radius + 1;
+	int r = ksize * ksize / 2;
+	size_t npix = (size_t) nx * ny;
+	guint16 *keys = malloc(npix * sizeof(guint16));
+	if (!keys) {
+		PRINT_ALLOC_ERR;
+		return 1;
+	}
+#ifdef _OPENMP
+#pragma omp parallel for simd num_threads(com.max_thread) schedule(static)
+#endif
+	for (size_t i = 0; i < npix; i++)
+		keys[i] = float_key16(src[i]);
+
+	int retval = 0;
+#ifdef _OPENMP
+#pragma omp parallel num_threads(com.max_thread)
+#endif
+	{
+		struct median_hist hist;
+		float *bucket = malloc(ksize * ksize * sizeof(float));
+		if (!bucket || median_hist_init(&hist)) {
+			if (!bucket)
+				PRINT_ALLOC_ERR;
+			else free(bucket);
+#ifdef _OPENMP
+#pragma omp atomic write
+#endif
+			retval = 1;
+		} else {
+#ifdef _OPENMP
+#pragma omp for schedule(dynamic,16)
+#endif
+			for (int y = radius; y < ny - radius; y++) {
+				median_hist_fill(&hist, keys, nx, y, radius);
+				for (int x = radius; x < nx - radius; x++) {
+					if (x > radius)
+						median_hist_slide(&hist, keys, nx, x - 1, y, radius);
+					guint16 key = (guint16) median_hist_rank(&hist, r);
+					int rank = r - hist.below;
+					int n = 0;
+					for (int i = -radius; i <= radius; i++) {
+						const guint16 *krow = keys + (size_t) (y + i) * nx + x - radius;
+						const float *vrow = src + (size_t) (y + i) * nx + x - radius;
+						for (int j = 0; j < ksize; j++)
+							if (krow[j] == key)
+								bucket[n++] = vrow[j];
+					}
+					float median = bucket[0];
+					if (n > 1) {
+						quicksort_f(bucket, n);
+						median = bucket[rank];
+					}
+					dst[y * nx + x] = intpf(amountf, median, src[y * nx + x]);
+				}
+				median_hist_empty(&hist, keys, nx, y, radius);
+#ifdef _OPENMP
+#pragma omp critical
+#endif
+				{
+					++(*progress);
+					if (!(*progress % 32)) {
+						set_progress_bar_data(NULL, (double)*progress / total);
+					}
+				}
+			}
+			free(hist.fine);
+			free(bucket);
+		}
+	}
+	free(keys);
+	return retval;
+}
+
+/* borders of width radius for the large kernels */
+static void median_borders_ushort(const WORD *src, WORD *dst, int nx, int ny, int radius, float amountf) {
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(com.max_thread) schedule(dynamic, 16)
+#endif
+	for (int y = 0; y < ny; y++) {
+		gboolean border_row = y < radius || y >= ny - radius;
+		for (int x = 0; x < nx; x++) {
+			if (!border_row && x == radius)
+				x = max(radius, nx - radius);
+			int pix_idx = y * nx + x;
+			float median = get_median_ushort_fast(src, x, y, nx, ny, radius);
+			dst[pix_idx] = roundf_to_WORD(intpf(amountf, median, (float) src[pix_idx]));
+		}
+	}
+}
+
+static void median_borders_float(const float *src, float *dst, int nx, int ny, int radius, float amountf) {
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(com.max_thread) schedule(dynamic, 16)
+#endif
+	for (int y = 0; y < ny; y++) {
+		gboolean border_row = y < radius || y >= ny - radius;
+		for (int x = 0; x < nx; x++) {
+			if (!border_row && x == radius)
+				x = max(radius, nx - radius);
+			int pix_idx = y * nx + x;
+			float median = get_median_float_fast(src, x, y, nx, ny, radius);
+			dst[pix_idx] = intpf(amountf, median, src[pix_idx]);
+		}
+	}
+}
+
 /*****************************************************************************
  *                      M E D I A N     F I L T E R                          *
  ****************************************************************************/
@@ -450,6 +706,9 @@ static gpointer median_filter_ushort(gpointer p) {
 						}
 					}
 				}
+			} else if (nx > 2 * radius && ny > 2 * radius &&
+					!median_hist_ushort(src, dst, nx, ny, radius, amountf, &progress, total)) {
+				median_borders_ushort(src, dst, nx, ny, radius, amountf);
 			} else {
 #ifdef _OPENMP
 #pragma omp parallel for num_threads(com.max_thread) schedule(dynamic, 16)
@@ -741,6 +1000,9 @@ static gpointer median_filter_float(gpointer p) {
 						}
 					}
 				}
+			} else if (nx > 2 * radius && ny > 2 * radius &&
+					!median_hist_float(src, dst, nx, ny, radius, amountf, &progress, total)) {
+				median_borders_float(src, dst, nx, ny, radius, amountf);
 			} else {
 #ifdef _OPENMP
 #pragma omp parallel for num_threads(com.max_thread) schedule(dynamic, 16)
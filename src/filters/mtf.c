@@ -20,66 +20,16 @@
 
 #include <glib.h>
 #include "mtf.h"
+#include "point_ops.h"
 #include "core/proto.h"
 #include "core/siril_log.h"
 #include "algos/statistics.h"
 
 void apply_linked_mtf_to_fits(fits *from, fits *to, struct mtf_params params, gboolean multithreaded) {
-
-	const gboolean do_channel[3] = { params.do_red, params.do_green, params.do_blue };
-
-	g_assert(from->naxes[2] == 1 || from->naxes[2] == 3);
-	const size_t layersize = from->naxes[0] * from->naxes[1];
-	g_assert(from->type == to->type);
-#ifdef _OPENMP
-	int threads = min(com.max_thread, 2); // not worth using many threads here
-#endif
-	if (from->type == DATA_USHORT) {
-		float norm = (float)get_normalized_value(from);
-		float invnorm = 1.0f / norm;
-		// Set up a LUT
-		WORD *lut = malloc((USHRT_MAX + 1) * sizeof(WORD));
-
-		// This is only a small loop: 8 threads seems to be about as many as is worthwhile
-		// because of the thread startup cost
-#ifdef _OPENMP
-#pragma omp parallel for simd num_threads(threads) schedule(static) if (threads > 1)
-#endif
-		for (int i = 0 ; i <= USHRT_MAX ; i++) { // Fill LUT
-			lut[i] = roundf_to_WORD(USHRT_MAX_SINGLE * MTFp(i * invnorm, params));
-		}
-
-#ifdef _OPENMP
-#pragma omp parallel for num_threads(com.max_thread) schedule(static) if(multithreaded)
-#endif
-		for (size_t j = 0; j < from->naxes[2] ; j++) {
-			if (do_channel[j]) {
-				WORD *tolayer = to->pdata[j], *fromlayer = from->pdata[j];
-				for (size_t i = 0; i < layersize; i++) {
-					tolayer[i] = lut[fromlayer[i]];
-				}
-			} else
-				memcpy(to->pdata[j], from->pdata[j], layersize * sizeof(WORD));
-		}
-		free(lut);
-	}
-	else if (from->type == DATA_FLOAT) {
-#ifdef _OPENMP
-#pragma omp parallel for num_threads(com.max_thread) schedule(static) if(multithreaded)
-#endif
-		for (size_t j = 0; j < from->naxes[2] ; j++) {
-			if (do_channel[j]) {
-				float *tolayer = to->fpdata[j], *fromlayer = from->fpdata[j];
-				for (size_t i = 0; i < layersize; i++) {
-					tolayer[i] = MTFp(fromlayer[i], params);
-				}
-			} else
-				memcpy(to->fpdata[j], from->fpdata[j], layersize * sizeof(float));
-		}
-	}
-	else return;
-
-	invalidate_stats_from_fit(to);
+	struct point_pipeline pipeline;
+	point_pipeline_init(&pipeline);
+	point_pipeline_add_mtf(&pipeline, &params);
+	point_pipeline_apply(&pipeline, from, to, multithreaded);
 }
 
 // In the general case this cannot return the inverse of MTF() because MTF() may clip.
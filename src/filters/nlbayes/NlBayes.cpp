@@ -22,6 +22,7 @@
 #include <algorithm>
 #include <functional>
 #include <math.h>
+#include <float.h>
 
 #include "NlBayes.h"
 #include "LibMatrix.h"
@@ -41,6 +42,12 @@ namespace NlBayes {
 
 using namespace std;
 
+//! Sub-images smaller than this area are dominated by their boundaries
+#define NLB_MIN_PART_AREA (256 * 256)
+
+//! Part of the progress bar used by the current tile
+static float progressOffset = 0.f, progressScale = 1.f;
+
 /**
  * @brief Initialize Parameters of the NL-Bayes algorithm.
  *
@@ -219,6 +226,8 @@ int runNlBayes(
 #ifdef _OPENMP
 //    nbThreads = omp_get_max_threads();
     nbThreads = com.max_thread;
+    //! Small images or tiles do not have enough work for all threads
+    nbThreads = max(1u, min(nbThreads, p_imSize.wh / (2 * NLB_MIN_PART_AREA)));
     if (p_verbose) {
         cout << "Open MP is used" << endl;
     }
@@ -344,6 +353,80 @@ int runNlBayes(
 	return EXIT_SUCCESS;
 }
 
+unsigned nlBayesTileMargin(
+	const float p_sigma
+,	const ImageSize &p_imSize
+){
+	nlbParams paramStep1, paramStep2;
+	initializeNlbParameters(paramStep1, paramStep2, p_sigma, p_imSize, true, true, false);
+	//! the basic estimate is needed up to the second step boundary, which
+	//! itself needs the first step boundary around it
+	return paramStep1.boundary + paramStep2.boundary;
+}
+
+int runNlBayesTiled(
+	std::vector<float> const& i_imNoisy
+,	std::vector<float> &o_imFinal
+,	const ImageSize &p_imSize
+,	const bool p_useArea1
+,	const bool p_useArea2
+,	const float p_sigma
+,	const bool p_verbose
+,	const unsigned p_tileSize
+){
+	const unsigned margin = nlBayesTileMargin(p_sigma, p_imSize);
+	const unsigned nTilesX = (p_imSize.width + p_tileSize - 1) / p_tileSize;
+	const unsigned nTilesY = (p_imSize.height + p_tileSize - 1) / p_tileSize;
+	const unsigned nTiles = nTilesX * nTilesY;
+	o_imFinal.resize(i_imNoisy.size());
+
+	int retval = EXIT_SUCCESS;
+	for (unsigned t = 0; t < nTiles && retval == EXIT_SUCCESS; t++) {
+		//! processed part of the tile, and the tile with its margin
+		const unsigned x0 = (t % nTilesX) * p_tileSize, y0 = (t / nTilesX) * p_tileSize;
+		const unsigned x1 = min(p_imSize.width, x0 + p_tileSize);
+		const unsigned y1 = min(p_imSize.height, y0 + p_tileSize);
+		const unsigned ex0 = x0 > margin ? x0 - margin : 0;
+		const unsigned ey0 = y0 > margin ? y0 - margin : 0;
+		const unsigned ex1 = min(p_imSize.width, x1 + margin);
+		const unsigned ey1 = min(p_imSize.height, y1 + margin);
+
+		ImageSize tileSize;
+		tileSize.width = ex1 - ex0;
+		tileSize.height = ey1 - ey0;
+		tileSize.nChannels = p_imSize.nChannels;
+		tileSize.wh = tileSize.width * tileSize.height;
+		tileSize.whc = tileSize.wh * tileSize.nChannels;
+
+		vector<float> tileNoisy(tileSize.whc), tileBasic, tileFinal;
+		for (unsigned c = 0, k = 0; c < p_imSize.nChannels; c++) {
+			for (unsigned i = ey0; i < ey1; i++) {
+				const float *src = &i_imNoisy[c * p_imSize.wh + i * p_imSize.width + ex0];
+				copy(src, src + tileSize.width, tileNoisy.begin() + k);
+				k += tileSize.width;
+			}
+		}
+
+		progressOffset = float(t) / float(nTiles);
+		progressScale = 1.f / float(nTiles);
+		siril_debug_print("NL-Bayes tile %u of %u (%ux%u)\n", t + 1, nTiles, tileSize.width, tileSize.height);
+		retval = runNlBayes(tileNoisy, tileBasic, tileFinal, tileSize, p_useArea1, p_useArea2,
+				p_sigma, p_verbose);
+		if (retval != EXIT_SUCCESS)
+			break;
+
+		for (unsigned c = 0; c < p_imSize.nChannels; c++) {
+			for (unsigned i = y0; i < y1; i++) {
+				const float *src = &tileFinal[c * tileSize.wh + (i - ey0) * tileSize.width + (x0 - ex0)];
+				copy(src, src + (x1 - x0), o_imFinal.begin() + c * p_imSize.wh + i * p_imSize.width + x0);
+			}
+		}
+	}
+	progressOffset = 0.f;
+	progressScale = 1.f;
+	return retval;
+}
+
 /**
  * @brief Generic step of the NL-Bayes denoising (could be the first or the second).
  *
@@ -463,7 +546,7 @@ int processNlBayes(
 				float second;
 				second = (p_params.isFirstStep ? 0.f : 2.f);
 				offset = (pass + second) / 4.f;
-				set_progress_bar_data("NL-Bayes denoising...", offset + ((double)ij / (4.f * p_imSize.wh)));
+				set_progress_bar_data("NL-Bayes denoising...", progressOffset + progressScale * (offset + ((double)ij / (4.f * p_imSize.wh))));
 			}
 		}
 	}
@@ -505,27 +588,37 @@ void estimateSimilarPatchesStep1(
 	const unsigned wh		= width * p_imSize.height;
 	const unsigned ind		= p_ij - (sW - 1) * (width + 1) / 2;
 	const unsigned nSimP	= p_params.nSimilarPatches;
-	vector<pair<float, unsigned> > distance(sW * sW);
+	vector<pair<float, unsigned> > distance;
+	distance.reserve(nSimP);
 
-	//! Compute distance between patches
+	//! Compute distance between patches, keeping the N2 best similar patches
+	//! in a max-heap: the distance of a patch is not computed further once it
+	//! exceeds the worst of them
 	for (unsigned i = 0; i < sW; i++) {
 		for (unsigned j = 0; j < sW; j++) {
 			const unsigned k = i * width + j + ind;
+			const bool full = distance.size() == nSimP;
+			const float bound = full ? distance.front().first : FLT_MAX;
 			float diff = 0.f;
-			for (unsigned p = 0; p < sP; p++) {
+			for (unsigned p = 0; p < sP && diff <= bound; p++) {
 				for (unsigned q = 0; q < sP; q++) {
 					const float tmpValue = i_im[p_ij + p * width + q] - i_im[k + p * width + q];
 					diff += tmpValue * tmpValue;
 				}
 			}
 
-			//! Save all distances
-			distance[i * sW + j] = make_pair(diff, k);
+			if (!full) {
+				distance.push_back(make_pair(diff, k));
+				push_heap(distance.begin(), distance.end(), comparaisonFirst);
+			}
+			else if (diff < bound) {
+				pop_heap(distance.begin(), distance.end(), comparaisonFirst);
+				distance.back() = make_pair(diff, k);
+				push_heap(distance.begin(), distance.end(), comparaisonFirst);
+			}
 		}
 	}
-
-	//! Keep only the N2 best similar patches
-	partial_sort(distance.begin(), distance.begin() + nSimP, distance.end(), comparaisonFirst);
+	sort_heap(distance.begin(), distance.end(), comparaisonFirst);
 
 	//! Register position of patches
 	for (unsigned n = 0; n < nSimP; n++) {
@@ -575,17 +668,24 @@ unsigned estimateSimilarPatchesStep2(
 	const unsigned sP		= p_params.sizePatch;
 	const unsigned sW		= p_params.sizeSearchWindow;
 	const unsigned ind		= p_ij - (sW - 1) * (width + 1) / 2;
-	vector<pair<float, unsigned> > distance(sW * sW);
-
-	//! Compute distance between patches
+	const unsigned nBest	= p_params.nSimilarPatches;
+	vector<pair<float, unsigned> > best, distance;
+	best.reserve(nBest);
+	distance.reserve(sW * sW);
+
+	//! Compute distance between patches. The nSimilarPatches best ones are kept
+	//! in a max-heap and patches further than both them and tau cannot be
+	//! kept, so their distance is not computed further
 	for (unsigned i = 0; i < sW; i++) {
 		for (unsigned j = 0; j < sW; j++) {
 			const unsigned k = i * width + j + ind;
+			const bool full = best.size() == nBest;
+			const float bound = full ? max(p_params.tau, best.front().first) : FLT_MAX;
 			float diff = 0.0f;
 
-			for (unsigned c = 0; c < chnls; c++) {
+			for (unsigned c = 0; c < chnls && diff < bound; c++) {
 				const unsigned dc = c * wh;
-				for (unsigned p = 0; p < sP; p++) {
+				for (unsigned p = 0; p < sP && diff < bound; p++) {
 					for (unsigned q = 0; q < sP; q++) {
 						const float tmpValue = i_imBasic[dc + p_ij + p * width + q]
 											- i_imBasic[dc + k + p * width + q];
@@ -593,19 +693,25 @@ unsigned estimateSimilarPatchesStep2(
 					}
 				}
 			}
+			if (diff >= bound)
+				continue;
 
-			//! Save all distances
-			distance[i * sW + j] = make_pair(diff, k);
+			distance.push_back(make_pair(diff, k));
+			if (!full) {
+				best.push_back(distance.back());
+				push_heap(best.begin(), best.end(), comparaisonFirst);
+			}
+			else if (diff < best.front().first) {
+				pop_heap(best.begin(), best.end(), comparaisonFirst);
+				best.back() = distance.back();
+				push_heap(best.begin(), best.end(), comparaisonFirst);
+			}
 		}
 	}
 
-	//! Keep only the nSimilarPatches best similar patches
-	partial_sort(distance.begin(), distance.begin() + p_params.nSimilarPatches, distance.end(),
-		comparaisonFirst);
-
 	//! Save index of similar patches
-	const float threshold = (p_params.tau > distance[p_params.nSimilarPatches - 1].first ?
-							p_params.tau : distance[p_params.nSimilarPatches - 1].first);
+	const float threshold = (p_params.tau > best.front().first ?
+							p_params.tau : best.front().first);
 	unsigned nSimP = 0;
 
 	//! Register position of similar patches
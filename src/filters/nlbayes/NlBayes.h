@@ -119,6 +119,46 @@ int runNlBayes(
 ,	const bool p_verbose
 );
 
+/**
+ * @brief Size in pixels of the margin needed around a tile so that its
+ * centre is processed as it would be in the whole image.
+ *
+ * @param p_sigma : standard deviation of the noise;
+ * @param p_imSize: size of the image.
+ *
+ * @return the margin.
+ **/
+unsigned nlBayesTileMargin(
+	const float p_sigma
+,	const ImageSize &p_imSize
+);
+
+/**
+ * @brief Process the whole NL-Bayes algorithm tile by tile, to bound the
+ * memory used on large images. Each tile is processed with all threads.
+ *
+ * @param i_imNoisy: contains the noisy image;
+ * @param o_imFinal: will contain the final denoised image after the second step;
+ * @param p_imSize: size of the image;
+ * @param p_useArea1 : if true, use the homogeneous area trick for the first step;
+ * @param p_useArea2 : if true, use the homogeneous area trick for the second step;
+ * @param p_sigma : standard deviation of the noise, measured on the whole image;
+ * @param p_verbose : if true, print some informations;
+ * @param p_tileSize : size of the processed part of the tiles.
+ *
+ * @return EXIT_FAILURE if something wrong happens during the whole process.
+ **/
+int runNlBayesTiled(
+	std::vector<float> const& i_imNoisy
+,	std::vector<float> &o_imFinal
+,	const ImageSize &p_imSize
+,	const bool p_useArea1
+,	const bool p_useArea2
+,	const float p_sigma
+,	const bool p_verbose
+,	const unsigned p_tileSize
+);
+
 /**
  * @brief Generic step of the NL-Bayes denoising (could be the first or the second).
  *
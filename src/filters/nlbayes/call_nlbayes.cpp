@@ -49,6 +49,7 @@ extern "C" {
 #include "algos/statistics.h"
 #include "algos/anscombe.h"
 #include "core/processing.h"
+#include "core/settings.h"
 #include "filters/cosmetic_correction.h"
 }
 
@@ -63,9 +64,31 @@ using std::divides;
 using utils::isMonochrome;
 using utils::makeMonochrome;
 using NlBayes::runNlBayes;
+using NlBayes::runNlBayesTiled;
+using NlBayes::nlBayesTileMargin;
 using da3d::Image;
 using da3d::DA3D;
 
+#define NLB_MEM_COPIES 10
+#define NLB_MIN_TILE 512
+
+/* Returns the size of the tiles to process the image with, or 0 if it fits in
+ * memory. Four copies of the image are kept by do_nlbayes() */
+static unsigned nlbayes_tile_size(const ImageSize &imSize, float fSigma) {
+    const size_t image_bytes = (size_t) imSize.whc * sizeof(float);
+    const size_t max_mem = (size_t) get_max_memory_in_MB() * BYTES_IN_A_MB;
+    const size_t budget = max_mem > 4 * image_bytes ? max_mem - 4 * image_bytes : 0;
+    if (NLB_MEM_COPIES * image_bytes <= budget)
+      return 0;
+    const unsigned margin = nlBayesTileMargin(fSigma, imSize);
+    const double side = sqrt((double) budget / (NLB_MEM_COPIES * imSize.nChannels * sizeof(float)));
+    unsigned tileSize = side > 2.0 * margin + NLB_MIN_TILE ? (unsigned) side - 2 * margin : NLB_MIN_TILE;
+    if (tileSize >= imSize.width && tileSize >= imSize.height)
+      return 0;
+    siril_debug_print("NL-Bayes: %zu MB available, tiles of %u + 2 x %u pixels\n", budget / BYTES_IN_A_MB, tileSize, margin);
+    return tileSize;
+}
+
 extern "C" int do_nlbayes(fits *fit, const float modulation, unsigned sos, int da3d, const float rho, const gboolean do_anscombe) {
     // Parameters
     const unsigned width = fit->naxes[0];
@@ -155,8 +178,15 @@ extern "C" int do_nlbayes(fits *fit, const float modulation, unsigned sos, int d
         sos_update_noise_float(bgr_v.data(), width, height, nchans, &intermediate_bgnoise);
         fSigma = (float) intermediate_bgnoise;
       }
-      // Operate the NL-Bayes algorithm
-      if (runNlBayes(bgr_v, basic, bgr_vout, imSize, useArea1, useArea2, fSigma, verbose) != EXIT_SUCCESS)
+      // Operate the NL-Bayes algorithm. It makes around NLB_MEM_COPIES copies of the
+      // image, so large images are processed in tiles that fit in the memory left
+      const unsigned tileSize = nlbayes_tile_size(imSize, fSigma);
+      if (tileSize) {
+        if (iter == 0)
+          siril_log_message(_("NL-Bayes: processing the image in tiles of %u pixels to fit in memory\n"), tileSize);
+        if (runNlBayesTiled(bgr_v, bgr_vout, imSize, useArea1, useArea2, fSigma, verbose, tileSize) != EXIT_SUCCESS)
+          return EXIT_FAILURE;
+      } else if (runNlBayes(bgr_v, basic, bgr_vout, imSize, useArea1, useArea2, fSigma, verbose) != EXIT_SUCCESS)
         return EXIT_FAILURE;
 
       if (do_anscombe && iter == 0) {
@@ -201,7 +231,10 @@ extern "C" int do_nlbayes(fits *fit, const float modulation, unsigned sos, int d
         guide = makeMonochrome(guide);
       }
       int retval = 0;
+      // the patch transforms are measured by FFTW, keep their plans
+      import_fftw_wisdom();
       Image output = DA3D(retval, input, guide, lastfSigma);
+      export_fftw_wisdom();
       if (retval != 0)
         return EXIT_FAILURE;
       bgr_da3dout = output.data();
@@ -0,0 +1,395 @@
+/*
+ * This file is part of Siril, an astronomy image processor.
+ * Copyright (C) 2005-2011 Francois Meyer (dulle at free.fr)
+ * Copyright (C) 2012-2025 team free-astro (see more in AUTHORS file)
+ * Reference site is https://siril.org
+ *
+ * Siril is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Siril is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Siril. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+#include <math.h>
+#include <glib.h>
+#include "point_ops.h"
+#include "core/proto.h"
+#include "core/siril_log.h"
+#include "algos/statistics.h"
+#include "core/processing.h"
+#include "core/OS_utils.h"
+#include "io/image_format_fits.h"
+#include "io/tiled_image.h"
+#include "gui/progress_and_log.h"
+
+void point_pipeline_init(struct point_pipeline *pipeline) {
+	memset(pipeline, 0, sizeof(struct point_pipeline));
+}
+
+static struct point_op *new_op(struct point_pipeline *pipeline, point_op_type type) {
+	if (pipeline->nb_ops >= POINT_PIPELINE_MAX_OPS) {
+		siril_debug_print("point pipeline is full\n");
+		return NULL;
+	}
+	struct point_op *op = &pipeline->ops[pipeline->nb_ops++];
+	memset(op, 0, sizeof(struct point_op));
+	op->type = type;
+	return op;
+}
+
+int point_pipeline_add_mtf(struct point_pipeline *pipeline, const struct mtf_params *params) {
+	struct point_op *op = new_op(pipeline, POINT_OP_MTF);
+	if (!op)
+		return 1;
+	op->mtf = *params;
+	op->do_channel[0] = params->do_red;
+	op->do_channel[1] = params->do_green;
+	op->do_channel[2] = params->do_blue;
+	return 0;
+}
+
+int point_pipeline_add_ght(struct point_pipeline *pipeline, const ght_params *params) {
+	struct point_op *op = new_op(pipeline, POINT_OP_GHT);
+	if (!op)
+		return 1;
+	op->ght.params = *params;
+	GHTsetup(&op->ght.compute, params->B, params->D, params->LP, params->SP, params->HP, params->stretchtype);
+	op->do_channel[0] = params->do_red;
+	op->do_channel[1] = params->do_green;
+	op->do_channel[2] = params->do_blue;
+	return 0;
+}
+
+int point_pipeline_add_asinh(struct point_pipeline *pipeline, float beta, float offset) {
+	struct point_op *op = new_op(pipeline, POINT_OP_ASINH);
+	if (!op)
+		return 1;
+	op->asinh.beta = beta;
+	op->asinh.offset = offset;
+	op->asinh.asinh_beta = asinhf(beta);
+	op->do_channel[0] = op->do_channel[1] = op->do_channel[2] = TRUE;
+	return 0;
+}
+
+int point_pipeline_add_curve(struct point_pipeline *pipeline, const struct curve_params *params) {
+	struct point_op *op = new_op(pipeline, POINT_OP_CURVE);
+	if (!op)
+		return 1;
+	op->curve.algorithm = params->algorithm;
+	op->curve.points = params->points;
+	if (params->algorithm == CUBIC_SPLINE)
+		cubic_spline_fit(params->points, &op->curve.spline);
+	else linear_fit(params->points, op->curve.slopes);
+	memcpy(op->do_channel, params->do_channel, sizeof(op->do_channel));
+	return 0;
+}
+
+/* value of the operation for a normalized pixel value, same as what the
+ * single operation functions compute on float images */
+float point_op_eval(const struct point_op *op, float x) {
+	switch (op->type) {
+		case POINT_OP_MTF:
+			return MTFp(x, op->mtf);
+		case POINT_OP_GHT:
+			// GHT is intended to operate on values in [0.f, 1.f]
+			x = fminf(1.f, fmaxf(0.f, x));
+			return x == 0.f ? 0.f : GHTp(x, &op->ght.params, &op->ght.compute);
+		case POINT_OP_ASINH:;
+			float beta = op->asinh.beta;
+			float xprime = max(0.0f, (x - op->asinh.offset) / (1.0f - op->asinh.offset));
+			float k = (xprime == 0.0f) ? 0.0f : (beta == 0.0f) ? 1.0f : asinhf(beta * xprime) / (xprime * op->asinh.asinh_beta);
+			return min(1.0f, max(0.0f, xprime * k));
+		case POINT_OP_CURVE:
+			if (op->curve.algorithm == CUBIC_SPLINE)
+				return cubic_spline_interpolate(x, (cubic_spline_data *) &op->curve.spline);
+			return linear_interpolate(x, op->curve.points, (double *) op->curve.slopes);
+	}
+	return x;
+}
+
+/* the 16-bit LUTs of GHT have always been computed without the 0 shortcut */
+static float point_op_eval_word(const struct point_op *op, float x) {
+	if (op->type == POINT_OP_GHT)
+		return GHTp(x, &op->ght.params, &op->ght.compute);
+	return point_op_eval(op, x);
+}
+
+static gboolean channel_is_modified(const struct point_pipeline *pipeline, int chan) {
+	for (int i = 0; i < pipeline->nb_ops; i++)
+		if (pipeline->ops[i].do_channel[chan])
+			return TRUE;
+	return FALSE;
+}
+
+/* two channels that are modified by the same operations share their LUT */
+static gboolean same_operations(const struct point_pipeline *pipeline, int chan1, int chan2) {
+	for (int i = 0; i < pipeline->nb_ops; i++)
+		if (!pipeline->ops[i].do_channel[chan1] != !pipeline->ops[i].do_channel[chan2])
+			return FALSE;
+	return TRUE;
+}
+
+/* Composes the operations applied to a channel in a 16-bit LUT. The result of
+ * each operation is rounded as it would be if it was applied on its own, so
+ * the composed LUT is exact */
+static void compose_lut(const struct point_pipeline *pipeline, int chan, float norm, WORD *lut, gboolean multithreaded) {
+	const float invnorm = 1.0f / norm;
+#ifdef _OPENMP
+	// This is only a small loop: 8 threads seems to be about as many as is worthwhile
+	// because of the thread startup cost
+	int threads = min(com.max_thread, 8);
+#pragma omp parallel for num_threads(threads) schedule(static) if (multithreaded)
+#endif
+	for (int i = 0; i <= USHRT_MAX; i++) {
+		WORD v = (WORD) i;
+		for (int j = 0; j < pipeline->nb_ops; j++) {
+			const struct point_op *op = &pipeline->ops[j];
+			if (op->do_channel[chan])
+				v = roundf_to_WORD(norm * point_op_eval_word(op, v * invnorm));
+		}
+		lut[i] = v;
+	}
+}
+
+/* composes the LUTs of the modified channels, channels that are modified by
+ * the same operations share their LUT */
+int point_pipeline_build_luts(const struct point_pipeline *pipeline, float norm, int nchans,
+		struct point_luts *luts, gboolean multithreaded) {
+	memset(luts, 0, sizeof(struct point_luts));
+	luts->norm = norm;
+	for (int chan = 0; chan < nchans; chan++) {
+		if (!channel_is_modified(pipeline, chan))
+			continue;
+		for (int prev = 0; prev < chan; prev++) {
+			if (luts->lut[prev] && same_operations(pipeline, prev, chan)) {
+				luts->lut[chan] = luts->lut[prev];
+				break;
+			}
+		}
+		if (luts->lut[chan])
+			continue;
+		luts->lut[chan] = malloc((USHRT_MAX + 1) * sizeof(WORD));
+		if (!luts->lut[chan]) {
+			PRINT_ALLOC_ERR;
+			point_luts_free(luts);
+			return 1;
+		}
+		compose_lut(pipeline, chan, norm, luts->lut[chan], multithreaded);
+	}
+	return 0;
+}
+
+void point_luts_apply(const struct point_luts *luts, fits *from, fits *to, gboolean multithreaded) {
+	const size_t layersize = from->naxes[0] * from->naxes[1];
+	const int nchans = (int) from->naxes[2];
+	g_assert(from->type == DATA_USHORT && to->type == DATA_USHORT);
+
+	for (int chan = 0; chan < nchans; chan++) {
+		const WORD *lut = luts->lut[chan];
+		WORD *in = from->pdata[chan], *out = to->pdata[chan];
+		if (!lut) {
+			if (in != out)
+				memcpy(out, in, layersize * sizeof(WORD));
+			continue;
+		}
+#ifdef _OPENMP
+#pragma omp parallel for simd num_threads(com.max_thread) schedule(static) if (multithreaded)
+#endif
+		for (size_t i = 0; i < layersize; i++)
+			out[i] = lut[in[i]];
+	}
+	invalidate_stats_from_fit(to);
+}
+
+void point_luts_free(struct point_luts *luts) {
+	for (int chan = 0; chan < 3; chan++) {
+		gboolean shared = FALSE;
+		for (int prev = 0; prev < chan; prev++)
+			if (luts->lut[prev] == luts->lut[chan])
+				shared = TRUE;
+		if (!shared)
+			free(luts->lut[chan]);
+	}
+	memset(luts->lut, 0, sizeof(luts->lut));
+}
+
+static void apply_to_ushort(const struct point_pipeline *pipeline, fits *from, fits *to, gboolean multithreaded) {
+	struct point_luts luts;
+	if (point_pipeline_build_luts(pipeline, (float) get_normalized_value(from), (int) from->naxes[2], &luts, multithreaded))
+		return;
+	point_luts_apply(&luts, from, to, multithreaded);
+	point_luts_free(&luts);
+}
+
+static void apply_to_float(const struct point_pipeline *pipeline, fits *from, fits *to, gboolean multithreaded) {
+	const size_t layersize = from->naxes[0] * from->naxes[1];
+	const int nchans = (int) from->naxes[2];
+
+	for (int chan = 0; chan < nchans; chan++) {
+		float *in = from->fpdata[chan], *out = to->fpdata[chan];
+		const struct point_op *ops[POINT_PIPELINE_MAX_OPS];
+		int nb_ops = 0;
+		for (int j = 0; j < pipeline->nb_ops; j++)
+			if (pipeline->ops[j].do_channel[chan])
+				ops[nb_ops++] = &pipeline->ops[j];
+		if (!nb_ops) {
+			if (in != out)
+				memcpy(out, in, layersize * sizeof(float));
+			continue;
+		}
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(com.max_thread) schedule(static) if (multithreaded)
+#endif
+		for (size_t i = 0; i < layersize; i++) {
+			float x = in[i];
+			for (int j = 0; j < nb_ops; j++)
+				x = point_op_eval(ops[j], x);
+			out[i] = x;
+		}
+	}
+}
+
+/* applies all operations of the pipeline in a single pass on the image */
+void point_pipeline_apply(const struct point_pipeline *pipeline, fits *from, fits *to, gboolean multithreaded) {
+	g_assert(from->naxes[2] == 1 || from->naxes[2] == 3);
+	g_assert(from->type == to->type);
+	if (from->type == DATA_USHORT)
+		apply_to_ushort(pipeline, from, to, multithreaded);
+	else if (from->type == DATA_FLOAT)
+		apply_to_float(pipeline, from, to, multithreaded);
+	else return;
+	invalidate_stats_from_fit(to);
+}
+
+struct batch_args {
+	struct point_pipeline pipeline;
+	gchar **files;
+	gchar *prefix;
+};
+
+static int stretch_tile(struct image_tile *tile, void *user) {
+	const struct point_pipeline *pipeline = (const struct point_pipeline *) user;
+	const size_t n = (size_t) tile->w * tile->h;
+	for (int j = 0; j < pipeline->nb_ops; j++) {
+		const struct point_op *op = &pipeline->ops[j];
+		if (!op->do_channel[tile->channel])
+			continue;
+		for (size_t i = 0; i < n; i++)
+			tile->data[i] = point_op_eval(op, tile->data[i]);
+	}
+	return 0;
+}
+
+/* for the files too large for the memory: the image is processed by tiles
+ * kept in a disk-backed store, with all threads */
+static int apply_to_tiled_file(const struct point_pipeline *pipeline, const gchar *src, const gchar *dest) {
+	siril_log_message(_("%s is too large for the memory, processing it by tiles\n"), src);
+	tiled_image *img = tiled_image_open(src, get_available_memory() / 4);
+	if (!img)
+		return 1;
+	int retval = tiled_image_foreach(img, stretch_tile, (void *) pipeline, TRUE, com.max_thread);
+	if (!retval)
+		retval = tiled_image_save(img, dest);
+	tiled_image_free(img);
+	return retval;
+}
+
+static gchar *get_output_name(const gchar *file, const gchar *prefix) {
+	gchar *dir = g_path_get_dirname(file);
+	gchar *base = g_path_get_basename(file);
+	gchar *name = g_strdup_printf("%s%s", prefix, base);
+	gchar *dest = g_build_filename(dir, name, NULL);
+	g_free(name);
+	g_free(base);
+	g_free(dir);
+	return dest;
+}
+
+/* applies the pipeline to FITS files, one image per thread and without the
+ * global image. The 16-bit LUTs are composed once for all images. The images
+ * that do not fit in memory are done first, one after the other */
+static gpointer apply_to_files_worker(gpointer p) {
+	struct batch_args *args = (struct batch_args *) p;
+	const int nb_files = g_strv_length(args->files);
+	struct point_luts luts = { 0 };
+	gboolean has_luts = !point_pipeline_build_luts(&args->pipeline, USHRT_MAX_SINGLE, 3, &luts, TRUE);
+	int failed = 0, done = 0;
+
+	set_progress_bar_data(_("Applying stretches to files"), PROGRESS_RESET);
+	gboolean *tiled = calloc(nb_files, sizeof(gboolean));
+	for (int i = 0; i < nb_files && tiled && get_thread_run(); i++) {
+		if (!fits_file_exceeds_memory(args->files[i]))
+			continue;
+		tiled[i] = TRUE;
+		gchar *dest = get_output_name(args->files[i], args->prefix);
+		if (apply_to_tiled_file(&args->pipeline, args->files[i], dest))
+			failed++;
+		g_free(dest);
+		done++;
+		set_progress_bar_data(NULL, (double) done / nb_files);
+	}
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(com.max_thread) schedule(dynamic) reduction(+:failed)
+#endif
+	for (int i = 0; i < nb_files; i++) {
+		if (!get_thread_run() || (tiled && tiled[i]))
+			continue;
+		fits fit = { 0 };
+		if (readfits(args->files[i], &fit, NULL, FALSE)) {
+			failed++;
+			continue;
+		}
+		if (fit.naxes[2] != 1 && fit.naxes[2] != 3) {
+			siril_log_message(_("%s: unsupported number of channels\n"), args->files[i]);
+			clearfits(&fit);
+			failed++;
+			continue;
+		}
+		if (fit.type == DATA_USHORT && has_luts && get_normalized_value(&fit) == luts.norm)
+			point_luts_apply(&luts, &fit, &fit, FALSE);
+		else point_pipeline_apply(&args->pipeline, &fit, &fit, FALSE);
+
+		gchar *dest = get_output_name(args->files[i], args->prefix);
+		if (savefits(dest, &fit))
+			failed++;
+		g_free(dest);
+		clearfits(&fit);
+#ifdef _OPENMP
+#pragma omp atomic
+#endif
+		done++;
+		set_progress_bar_data(NULL, (double) done / nb_files);
+	}
+	if (has_luts)
+		point_luts_free(&luts);
+	free(tiled);
+
+	if (failed)
+		siril_log_color_message(_("%d of %d files could not be processed\n"), "red", failed, nb_files);
+	else siril_log_message(_("%d files processed\n"), nb_files);
+	set_progress_bar_data(NULL, PROGRESS_DONE);
+	g_strfreev(args->files);
+	g_free(args->prefix);
+	free(args);
+	siril_add_idle(end_generic, NULL);
+	return GINT_TO_POINTER(failed ? 1 : 0);
+}
+
+/* Applies the pipeline to each FITS file, in parallel, and saves the results
+ * next to them with a prefix. files and prefix are owned by the operation */
+void point_pipeline_apply_to_files(const struct point_pipeline *pipeline, gchar **files, gchar *prefix) {
+	struct batch_args *args = malloc(sizeof(struct batch_args));
+	args->pipeline = *pipeline;
+	args->files = files;
+	args->prefix = prefix;
+	start_in_new_thread(apply_to_files_worker, args);
+}
@@ -0,0 +1,73 @@
+#ifndef _POINT_OPS_H_
+#define _POINT_OPS_H_
+
+#include "core/siril.h"
+#include "filters/mtf.h"
+#include "filters/ght.h"
+#include "filters/curve_transform.h"
+
+/* Pixel-wise stretches that can be chained and applied in a single pass.
+ * For 16-bit images the chain is composed into one LUT per channel that gives
+ * exactly the same result as applying the operations one after the other, for
+ * 32-bit images the operations are evaluated one after the other on each pixel
+ * while it is in registers. Only the operations that do not mix the channels
+ * can be added: GHT with independent channels, MTF, mono asinh and curves */
+
+#define POINT_PIPELINE_MAX_OPS 8
+
+typedef enum {
+	POINT_OP_MTF,
+	POINT_OP_GHT,
+	POINT_OP_ASINH,
+	POINT_OP_CURVE
+} point_op_type;
+
+struct point_op {
+	point_op_type type;
+	gboolean do_channel[3];
+	union {
+		struct mtf_params mtf;
+		struct {
+			ght_params params;
+			ght_compute_params compute;
+		} ght;
+		struct {
+			float beta, offset, asinh_beta;
+		} asinh;
+		struct {
+			enum curve_algorithm algorithm;
+			GList *points;	// not owned, must be kept until the pipeline is applied
+			cubic_spline_data spline;
+			double slopes[MAX_POINTS - 1];
+		} curve;
+	};
+};
+
+struct point_pipeline {
+	struct point_op ops[POINT_PIPELINE_MAX_OPS];
+	int nb_ops;
+};
+
+void point_pipeline_init(struct point_pipeline *pipeline);
+int point_pipeline_add_mtf(struct point_pipeline *pipeline, const struct mtf_params *params);
+int point_pipeline_add_ght(struct point_pipeline *pipeline, const ght_params *params);
+int point_pipeline_add_asinh(struct point_pipeline *pipeline, float beta, float offset);
+int point_pipeline_add_curve(struct point_pipeline *pipeline, const struct curve_params *params);
+float point_op_eval(const struct point_op *op, float x);
+void point_pipeline_apply(const struct point_pipeline *pipeline, fits *from, fits *to, gboolean multithreaded);
+
+/* the 16-bit LUTs of a pipeline for a normalization value, which can be
+ * composed once and applied to several images */
+struct point_luts {
+	WORD *lut[3];	// NULL for the channels that are not modified
+	float norm;
+};
+
+int point_pipeline_build_luts(const struct point_pipeline *pipeline, float norm, int nchans,
+		struct point_luts *luts, gboolean multithreaded);
+void point_luts_apply(const struct point_luts *luts, fits *from, fits *to, gboolean multithreaded);
+void point_luts_free(struct point_luts *luts);
+
+void point_pipeline_apply_to_files(const struct point_pipeline *pipeline, gchar **files, gchar *prefix);
+
+#endif
@@ -40,16 +40,44 @@
 
 #include "rgradient.h"
 
-static void to_polar(int x, int y, point center, double *r, double *theta) {
-	double dx = x - center.x;
-	double dy = y - center.y;
-	*r = sqrt(dx * dx + dy * dy);
-	*theta = atan2(dy, dx);
+/* same as bilinear() with the coordinates of the pixel already split */
+static inline float rgradient_sample(const float *buf, int w, int h, float fx, float fy) {
+	int ii = (int) fx;
+	int jj = (int) fy;
+	float xoff = fx - ii;
+	float yoff = fy - jj;
+	int x0 = min(max(ii, 0), w - 1), x1 = min(max(ii + 1, 0), w - 1);
+	int y0 = min(max(jj, 0), h - 1), y1 = min(max(jj + 1, 0), h - 1);
+	const float *row0 = buf + (size_t) y0 * w, *row1 = buf + (size_t) y1 * w;
+	return (row0[x0] * (1 - xoff) * (1 - yoff)) + (row1[x0] * (1 - xoff) * yoff) +
+		(row0[x1] * xoff * (1 - yoff)) + (row1[x1] * xoff * yoff);
 }
 
-static void to_cartesian(double r, double theta, point center, point *p) {
-	p->x = center.x + r * cos(theta);
-	p->y = center.y + r * sin(theta);
+/* Computes the positions of the row y rotated by +da and -da around the
+ * centre with the radius decreased by dR. Instead of converting each pixel to
+ * polar coordinates and back, its offset from the centre is scaled by
+ * (r - dR) / r and rotated with the cosine and sine of the angle, computed
+ * once. The pixel at the centre has an angle of 0, as atan2(0, 0). */
+static void rgradient_row_positions(int y, int rx, point center, double dR, double cosa, double sina,
+		float *x1, float *y1, float *x2, float *y2) {
+	const double dy = y - center.y;
+#ifdef _OPENMP
+#pragma omp simd
+#endif
+	for (int x = 0; x < rx; x++) {
+		double dx = x - center.x;
+		double r = sqrt(dx * dx + dy * dy);
+		double ux = 1.0, uy = 0.0;
+		if (r > 0.0) {
+			ux = dx / r;
+			uy = dy / r;
+		}
+		double s = r - dR;
+		x1[x] = (float) (center.x + s * (cosa * ux - sina * uy));
+		y1[x] = (float) (center.y + s * (sina * ux + cosa * uy));
+		x2[x] = (float) (center.x + s * (cosa * ux + sina * uy));
+		y2[x] = (float) (center.y + s * (cosa * uy - sina * ux));
+	}
 }
 
 static gboolean end_rgradient_filter(gpointer p) {
@@ -72,13 +100,13 @@ gpointer rgradient_filter(gpointer p) {
 	struct rgradient_filter_data *args = (struct rgradient_filter_data *) p;
 
 	gboolean was_ushort;
-	fits imA = { 0 }, imB = { 0 };
+	fits imA = { 0 };
 	int retval = 0;
 	const point center = {args->xc, args->yc};
 	const double dAlpha = M_PI / 180.0 * args->da;
 
 	int cur_nb = 0; // only used for progress bar
-	const double total = args->fit->ry * args->fit->naxes[2];	// only used for progress bar
+	const double total = args->fit->ry;	// only used for progress bar
 	set_progress_bar_data(_("Rotational gradient in progress..."), PROGRESS_RESET);
 
 	was_ushort = args->fit->type == DATA_USHORT;
@@ -93,60 +121,55 @@ gpointer rgradient_filter(gpointer p) {
 		fit_replace_buffer(args->fit, newbuf, DATA_FLOAT);
 	}
 
+	/* the differentials are computed from a copy of the image */
 	retval = copyfits(args->fit, &imA, CP_ALLOC | CP_COPYA | CP_FORMAT, -1);
 	if (retval) { retval = 1; goto end_rgradient; }
 
-	retval = copyfits(&imA, &imB, CP_ALLOC | CP_COPYA | CP_FORMAT, -1);
-	if (retval) { retval = 1; goto end_rgradient; }
-
-	int layer, y;
+	const int rx = args->fit->rx, ry = args->fit->ry;
+	const int nb_layers = args->fit->naxes[2];
+	const double cosa = cos(dAlpha), sina = sin(dAlpha);
 	float global_min = FLT_MAX;
+	gboolean alloc_failed = FALSE;
 
-	// Processing the image layers
-	for (layer = 0; layer < args->fit->naxes[2]; layer++) {
-		float *gbuf = args->fit->fpdata[layer];
-		float *Abuf = imA.fpdata[layer];
-		float *Bbuf = imB.fpdata[layer];
-
+	/* the positions of the differentials are computed once per row for all
+	 * layers */
 #ifdef _OPENMP
-#pragma omp parallel for num_threads(com.max_thread) schedule(static) reduction(min:global_min)
+#pragma omp parallel num_threads(com.max_thread) reduction(min:global_min)
 #endif
-		for (y = 0; y < args->fit->ry; y++) {
-			size_t i = y * args->fit->rx;
+	{
+		float *pos = malloc(4 * rx * sizeof(float));
+		if (!pos)
+			alloc_failed = TRUE;
 #ifdef _OPENMP
-			#pragma omp critical
-			#endif
-			{
+#pragma omp for schedule(static)
+#endif
+		for (int y = 0; y < ry; y++) {
+			if (!pos)
+				continue;
+			if (!(g_atomic_int_add(&cur_nb, 1) % 16))
 				set_progress_bar_data(NULL, cur_nb / total);
-				cur_nb++;
-			}
-
-			for (int x = 0; x < args->fit->rx; x++) {
-				float buf = gbuf[i] + gbuf[i];
-
-				double r, theta;
-				point delta1, delta2;
-
-				to_polar(x, y, center, &r, &theta);
-
-				// Positive differential
-				to_cartesian(r - args->dR, theta + dAlpha, center, &delta1);
-				buf -= bilinear(Abuf, args->fit->rx, args->fit->ry, delta1.x, delta1.y);
-
-				// Negative differential
-				to_cartesian(r - args->dR, theta - dAlpha, center, &delta2);
-				buf -= bilinear(Bbuf, args->fit->rx, args->fit->ry, delta2.x, delta2.y);
-
-				gbuf[i] = buf > 1.f ? 1.f : buf;
-
-				// Update global minimum value
-				if (gbuf[i] < global_min) {
-					global_min = gbuf[i];
+			float *x1 = pos, *y1 = pos + rx, *x2 = pos + 2 * rx, *y2 = pos + 3 * rx;
+			rgradient_row_positions(y, rx, center, args->dR, cosa, sina, x1, y1, x2, y2);
+			for (int layer = 0; layer < nb_layers; layer++) {
+				float *gbuf = args->fit->fpdata[layer] + (size_t) y * rx;
+				const float *Abuf = imA.fpdata[layer];
+				for (int x = 0; x < rx; x++) {
+					float buf = gbuf[x] + gbuf[x];
+					// Positive and negative differentials
+					buf -= rgradient_sample(Abuf, rx, ry, x1[x], y1[x]);
+					buf -= rgradient_sample(Abuf, rx, ry, x2[x], y2[x]);
+					gbuf[x] = buf > 1.f ? 1.f : buf;
+					if (gbuf[x] < global_min)
+						global_min = gbuf[x];
 				}
-
-				i++;
 			}
 		}
+		free(pos);
+	}
+	if (alloc_failed) {
+		PRINT_ALLOC_ERR;
+		retval = 1;
+		goto end_rgradient;
 	}
 
 	retval = soper(args->fit, global_min, OPER_SUB, TRUE);
@@ -157,7 +180,6 @@ end_rgradient:
 	set_progress_bar_data(_("Rotational gradient complete."), PROGRESS_DONE);
 
 	clearfits(&imA);
-	clearfits(&imB);
 	if (!retval) {
 		if (was_ushort) {
 			const long n = args->fit->naxes[0] * args->fit->naxes[1] * args->fit->naxes[2];
@@ -40,6 +40,8 @@
 
 #include "saturation.h"
 
+#define SATU_BLOCK_SIZE ((size_t) 512)
+
 static double satu_amount, background_factor;
 static int satu_hue_type;
 static gboolean satu_show_preview;
@@ -275,32 +277,31 @@ static int enhance_saturation_float(gpointer p) {
 	float h_min = args->h_min;
 	float h_max = args->h_max;
 
-	size_t i, n = args->input->naxes[0] * args->input->naxes[1];
+	size_t n = args->input->naxes[0] * args->input->naxes[1];
+	size_t nb_blocks = (n + SATU_BLOCK_SIZE - 1) / SATU_BLOCK_SIZE;
+	/* pixels are converted by blocks, with branch-free kernels */
 #ifdef _OPENMP
-#pragma omp parallel for num_threads(com.max_thread) private(i) schedule(dynamic, args->input->rx * 16)
+#pragma omp parallel for num_threads(com.max_thread) schedule(dynamic, 16)
 #endif
-	for (i = 0; i < n; i++) {
-		float h, s, l;
-		float r = in[RLAYER][i];
-		float g = in[GLAYER][i];
-		float b = in[BLAYER][i];
-		rgb_to_hsl_float_sat(r, g, b, bg, &h, &s, &l);
-		if (l > bg) {
-			if (loop_range) {
-				if (h >= h_min || h <= h_max)
-					s *= s_mult;
-			} else {
-				if (h >= h_min && h <= h_max)
-					s *= s_mult;
-			}
-			if (s < 0.f) s = 0.f;
-			else if (s > 1.f) s = 1.f;
-
-			hsl_to_rgb_float_sat(h, s, l, &r, &g, &b);
+	for (size_t block = 0; block < nb_blocks; block++) {
+		float h[SATU_BLOCK_SIZE], s[SATU_BLOCK_SIZE], l[SATU_BLOCK_SIZE];
+		float r[SATU_BLOCK_SIZE], g[SATU_BLOCK_SIZE], b[SATU_BLOCK_SIZE];
+		size_t start = block * SATU_BLOCK_SIZE;
+		size_t nb = min(SATU_BLOCK_SIZE, n - start);
+		rgb_to_hsl_float_sat_batch(in[RLAYER] + start, in[GLAYER] + start, in[BLAYER] + start,
+				bg, h, s, l, nb);
+		for (size_t k = 0; k < nb; k++) {
+			gboolean in_range = loop_range ? (h[k] >= h_min || h[k] <= h_max) : (h[k] >= h_min && h[k] <= h_max);
+			float sat = in_range ? s[k] * s_mult : s[k];
+			s[k] = min(max(sat, 0.f), 1.f);
+		}
+		hsl_to_rgb_float_sat_batch(h, s, l, r, g, b, nb);
+		for (size_t k = 0; k < nb; k++) {
+			gboolean modified = l[k] > bg;
+			out[RLAYER][start + k] = modified ? r[k] : in[RLAYER][start + k];
+			out[GLAYER][start + k] = modified ? g[k] : in[GLAYER][start + k];
+			out[BLAYER][start + k] = modified ? b[k] : in[BLAYER][start + k];
 		}
-		out[RLAYER][i] = r;
-		out[GLAYER][i] = g;
-		out[BLAYER][i] = b;
 	}
 	return 0;
 }
@@ -90,6 +90,7 @@ static int exec_prog_starnet(char **argv, starnet_version version) {
 		fprintf(stdout, "%s ", argv[index++]);
 	}
 	fprintf(stdout, "\n");
+	gint64 start = siril_tool_begin(EXT_STARNET);
 	// g_spawn handles wchar so not need to convert
 	siril_spawn_host_async_with_pipes(NULL, argv, NULL,
 			G_SPAWN_SEARCH_PATH |
@@ -99,6 +100,7 @@ static int exec_prog_starnet(char **argv, starnet_version version) {
 
 	if (error != NULL) {
 		siril_log_color_message(_("Spawning starnet failed: %s\n"), "red", error->message);
+		siril_tool_end(EXT_STARNET, start);
 		return retval;
 	}
 	g_child_watch_add(child_pid, child_watch_cb, NULL);
@@ -164,6 +166,7 @@ static int exec_prog_starnet(char **argv, starnet_version version) {
 	g_object_unref(stream);
 	if (!g_close(child_stdout, &error))
 		siril_debug_print("%s\n", error->message);
+	siril_tool_end(EXT_STARNET, start);
 	return retval;
 }
 
@@ -282,6 +285,7 @@ END:
 void free_starnet_args(starnet_data *args) {
 	// do not free multi_args, it is only a reference
 	g_free(args->stride);
+	g_free(args->session_dir);
 	free(args);
 	siril_debug_print("starnet_args freed\n");
 }
@@ -346,8 +350,8 @@ gpointer do_starnet(gpointer p) {
 	gchar starlessprefix[10] = "starless_";
 	gchar starmaskprefix[10] = "starmask_";
 
-	// Check StarNet version
-	version = starnet_executablecheck(com.pref.starnet_exe);
+	// Check StarNet version, it runs the executable so it's done once for sequences
+	version = args->version != NIL ? args->version : starnet_executablecheck(com.pref.starnet_exe);
 
 	// Check image size is sufficient
 	unsigned int minsize = 512;
@@ -413,7 +417,10 @@ gpointer do_starnet(gpointer p) {
 	starlessnoext = g_strdup_printf("%s%s", starlessprefix, imagenoextorig);
 	starmasknoext = g_strdup_printf("%s%s", starmaskprefix, imagenoextorig);
 	imagenoext = g_strdup_printf("%s%s", starnetprefix, imagenoextorig);
-	temp = g_build_filename(com.wd, imagenoext, NULL);
+	/* for sequences, the TIFF files exchanged with StarNet go to the session
+	 * directory, the starless and star mask FITS are not written */
+	const gchar *exchange_dir = args->session_dir ? args->session_dir : com.wd;
+	temp = g_build_filename(exchange_dir, imagenoext, NULL);
 	g_free(imagenoext);
 	imagenoext = remove_ext_from_filename(temp);
 	g_free(temp);
@@ -424,7 +431,7 @@ gpointer do_starnet(gpointer p) {
 		siril_log_color_message(_("Error: file path too long!\n"), "red");
 		goto CLEANUP3;
 	}
-	starlesstif = g_build_filename(com.wd, starlessnoext, NULL);
+	starlesstif = g_build_filename(exchange_dir, starlessnoext, NULL);
 	temp = remove_ext_from_filename(starlesstif);
 	g_free(starlesstif);
 	starlesstif = g_strdup(temp);
@@ -435,7 +442,7 @@ gpointer do_starnet(gpointer p) {
 	starlesstif = g_strdup(temp);
 	g_free(temp);
 
-	starmasktif = g_build_filename(com.wd, starmasknoext, NULL);
+	starmasktif = g_build_filename(exchange_dir, starmasknoext, NULL);
 	temp = remove_ext_from_filename(starmasktif);
 	g_free(starmasktif);
 	starmasktif = g_strdup(temp);
@@ -750,21 +757,26 @@ gpointer do_starnet(gpointer p) {
 					goto CLEANUP;
 				}
 			} else {
-				if (args->starmask_fit)
-					clearfits(args->starmask_fit);
-				retval = copyfits(&fit, args->starmask_fit, (CP_ALLOC | CP_FORMAT | CP_COPYA), 0);
+				// the mask is not used after this, its data is moved instead of copied
+				retval = copyfits(&fit, args->starmask_fit, CP_FORMAT, 0);
 				if (retval) {
 					siril_log_color_message(_("Error: image copy failed...\n"), "red");
 					goto CLEANUP;
 				}
+				fits_swap_image_data(&fit, args->starmask_fit);
 				copy_fits_metadata(&fit, args->starmask_fit);
 			}
 		}
 	}
 
-	// All done, now copy the working image back into gfit
+	// All done, now copy the working image back into gfit. For sequences
+	// workingfit is not used after this, so its data is moved
 	clearfits(current_fit);
-	retval = copyfits(&workingfit, current_fit, (CP_ALLOC | CP_FORMAT | CP_COPYA), 0);
+	if (args->multi_args) {
+		retval = copyfits(&workingfit, current_fit, CP_FORMAT, 0);
+		if (!retval)
+			fits_swap_image_data(&workingfit, current_fit);
+	} else retval = copyfits(&workingfit, current_fit, (CP_ALLOC | CP_FORMAT | CP_COPYA), 0);
 	if (retval) {
 		siril_log_color_message(_("Error: image copy failed...\n"), "red");
 		goto CLEANUP;
@@ -880,6 +892,26 @@ static int starnet_compute_mem_limits(struct generic_seq_args *args, gboolean fo
 	return limit;
 }
 
+/* StarNet is probed once for the sequence instead of being run for it at each
+ * frame, and the frames are exchanged through a directory of the user runtime
+ * directory when it is in memory, see siril_create_exchange_dir() */
+static int starnet_prepare_hook(struct generic_seq_args *args) {
+	struct multi_output_data *multi_args = (struct multi_output_data*) args->user;
+	starnet_data *seqdata = (starnet_data *) multi_args->user_data;
+	seqdata->version = starnet_executablecheck(com.pref.starnet_exe);
+	seqdata->session_dir = siril_create_exchange_dir("starnet");
+	return multi_prepare(args);
+}
+
+static int starnet_finalize_hook(struct generic_seq_args *args) {
+	struct multi_output_data *multi_args = (struct multi_output_data*) args->user;
+	starnet_data *seqdata = (starnet_data *) multi_args->user_data;
+	siril_remove_exchange_dir(seqdata->session_dir);
+	seqdata->session_dir = NULL;
+	siril_tool_log_stats(EXT_STARNET, "StarNet");
+	return multi_finalize(args); // frees seqdata
+}
+
 int starnet_image_hook(struct generic_seq_args *args, int o, int i, fits *fit, rectangle *_, int threads) {
 	struct multi_output_data *multi_args = (struct multi_output_data*) args->user;
 	starnet_data *seqdata = (starnet_data *) multi_args->user_data;
@@ -928,13 +960,13 @@ void apply_starnet_to_sequence(struct multi_output_data *multi_args) {
 	seqargs->parallel = FALSE;
 	seqargs->max_parallel_images = 1;
 	seqargs->compute_mem_limits_hook = starnet_compute_mem_limits;
-	seqargs->prepare_hook = multi_prepare;
+	seqargs->prepare_hook = starnet_prepare_hook;
 	seqargs->image_hook = starnet_image_hook;
 	seqargs->has_output = TRUE;
 	seqargs->output_type = get_data_type(seqargs->seq->bitpix);
 	seqargs->save_hook = multi_save;
 	seqargs->new_seq_prefix = multi_args->seqEntry;
-	seqargs->finalize_hook = multi_finalize;
+	seqargs->finalize_hook = starnet_finalize_hook;
 	seqargs->load_new_sequence = (multi_args->new_seq_index < 2);
 	seqargs->user = multi_args;
 	set_progress_bar_data(_("StarNet: Processing..."), 0.);
@@ -18,6 +18,8 @@ typedef struct starnet_data {
 	gboolean too_small;
 	int imgnumber;
 	struct multi_output_data *multi_args;
+	starnet_version version; // probed once for a sequence, NIL otherwise
+	gchar *session_dir; // exchange directory of the frames of a sequence
 } starnet_data;
 
 typedef struct remixargs {
@@ -83,9 +83,6 @@ void makeairy(float *psf, const int size, const float lum, const float xoff, con
 			}
 		}
 	}
-#ifdef _OPENMP
-#pragma omp barrier
-#endif
 	return;
 }
 
@@ -111,9 +108,6 @@ void makemoffat(float *psf, const int size, const float fwhm, const float lum, c
 							-beta);
 		}
 	}
-#ifdef _OPENMP
-#pragma omp barrier
-#endif
 	return;
 }
 
@@ -138,9 +132,6 @@ void makegaussian(float *psf, int size, float fwhm, float lum, float xoffset, fl
 					* expf(-(a * xf * xf + 2 * b * xf * yf + c * yf * yf));
 		}
 	}
-#ifdef _OPENMP
-#pragma omp barrier
-#endif
 	return;
 }
 
@@ -177,58 +168,211 @@ void makedisc(float *psf, int size, float width, float lum, float xoffset, float
 			}
 		}
 	}
-#ifdef _OPENMP
-#pragma omp barrier
-#endif
 	return;
 }
 
-static void add_star_to_rgb_buffer(const float *H, const float *S, const float *psfL, int size, float *Hsynth, float *Ssynth, float *Lsynth, int x, int y, int dimx, int dimy) {
-	int halfpsfdim = (size - 1) / 2;
-	int xx, yy;
-#define EPSILON 1e-30
+/* Stars with the same profile parameters, within the bin precision, share a
+ * stamp computed at unit luminance. The subpixel offsets are binned too, at a
+ * precision well below what the fitted positions are accurate to */
+#define STAMP_SUBPIXEL_BINS 16
+#define STAMP_PARAM_STEP 0.02f
+#define STAMP_ATLAS_MAX_MB 256
+#define SPLAT_BAND_ROWS 32
+
+struct star_stamp {
+	guint64 key;
+	gboolean gaussian;
+	int size;
+	float fwhm, beta, xoff, yoff;
+	float *psf;
+	gboolean queued;
+};
+
+struct star_splat {
+	int x, y;
+	float lum;
+	struct star_stamp *stamp;
+};
+
+static guint64 stamp_key(gboolean gaussian, int size, float fwhm, float beta, int xbin, int ybin) {
+	guint64 fbin = min(lroundf(fwhm / STAMP_PARAM_STEP), 0xFFFF);
+	guint64 bbin = gaussian ? 0 : min(lroundf(beta / STAMP_PARAM_STEP), 0xFFFF);
+	return (guint64) !!gaussian | (guint64) size << 1 | fbin << 12 | bbin << 28 |
+		(guint64) xbin << 44 | (guint64) ybin << 49;
+}
+
+static void free_stamp(gpointer data) {
+	struct star_stamp *stamp = (struct star_stamp *) data;
+	free(stamp->psf);
+	free(stamp);
+}
+
+static void compute_stamp(struct star_stamp *stamp) {
+	stamp->psf = (float*) malloc(stamp->size * stamp->size * sizeof(float));
+	if (!stamp->psf) // May happen if size is excessively large because of a bad fwhm value
+		return;
+	if (stamp->gaussian)
+		makegaussian(stamp->psf, stamp->size, stamp->fwhm, 1.f, stamp->xoff, stamp->yoff, 1.f, 0.f);
+	else
+		makemoffat(stamp->psf, stamp->size, stamp->fwhm, 1.f, stamp->xoff, stamp->yoff, stamp->beta, 1.f, 0.f);
+}
+
+/* Adds the stars to the synthetic buffers. Each thread owns a band of rows of
+ * the buffers and adds the stars overlapping it in the order of the list, so
+ * no atomics are needed and the sums do not depend on the thread count */
+static void splat_stars(const struct star_splat *splats, int nb_splats, const float *H, const float *S,
+		float *Hsynth, float *Ssynth, float *Lsynth, int dimx, int dimy) {
+	const int nb_bands = (dimy + SPLAT_BAND_ROWS - 1) / SPLAT_BAND_ROWS;
 #ifdef _OPENMP
-#pragma omp parallel for simd schedule(static) collapse(2) num_threads(com.max_thread) private(xx, yy) if(com.max_thread > 1)
+#pragma omp parallel for num_threads(com.max_thread) schedule(dynamic) if(com.max_thread > 1)
 #endif
-	for (int psfx = 0; psfx < size; psfx++) {
-		for (int psfy = 0; psfy < size; psfy++) {
-			xx = x + psfx - halfpsfdim;
-			yy = y + psfy - halfpsfdim;
-			if (xx > 0 && xx < dimx && yy > 0 && yy < dimy) {
-				Hsynth[xx + ((dimy - yy) * dimx)] =
-						H[xx + ((dimy - yy) * dimx)];
-				Ssynth[xx + ((dimy - yy) * dimx)] =
-						S[xx + ((dimy - yy) * dimx)];
-				Lsynth[xx + ((dimy - yy) * dimx)] += psfL[psfx + (psfy * size)];
+	for (int band = 0; band < nb_bands; band++) {
+		// rows of the buffers, which are flipped with regard to the star coordinates
+		const int band_start = max(1, band * SPLAT_BAND_ROWS);
+		const int band_end = min(dimy - 1, (band + 1) * SPLAT_BAND_ROWS - 1);
+		for (int n = 0; n < nb_splats; n++) {
+			const struct star_splat *splat = &splats[n];
+			const float *psf = splat->stamp->psf;
+			if (!psf)
+				continue;
+			const int size = splat->stamp->size;
+			const int halfpsfdim = (size - 1) / 2;
+			const int top = dimy - splat->y + halfpsfdim;	// row of psfy = 0
+			const int row_start = max(band_start, top - size + 1);
+			const int row_end = min(band_end, top);
+			const int psfx_start = max(0, halfpsfdim - splat->x + 1);
+			const int psfx_end = min(size - 1, dimx - 1 - splat->x + halfpsfdim);
+			for (int row = row_start; row <= row_end; row++) {
+				const float *psfrow = psf + (top - row) * size;
+				const size_t offset = (size_t) row * dimx + splat->x - halfpsfdim;
+				for (int psfx = psfx_start; psfx <= psfx_end; psfx++)
+					Lsynth[offset + psfx] += splat->lum * psfrow[psfx];
+				if (H) {
+					for (int psfx = psfx_start; psfx <= psfx_end; psfx++) {
+						Hsynth[offset + psfx] = H[offset + psfx];
+						Ssynth[offset + psfx] = S[offset + psfx];
+					}
+				}
 			}
 		}
 	}
-#ifdef _OPENMP
-#pragma omp barrier
-#endif
-	return;
 }
 
-static void add_star_to_mono_buffer(const float *psfL, int size, float *Lsynth, int x, int y, int dimx, int dimy) {
-	const int halfpsfdim = (size - 1) / 2;
-	int xx, yy;
+/* Synthesizes the stars in the buffers, H and S are NULL for mono images.
+ * Returns TRUE if the processing was stopped */
+static gboolean synthesize_stars(psf_star **stars, int nb_stars, gboolean gaussian, float avg_moffat_beta,
+		gboolean is_32bit, float invnorm, const float *H, const float *S, float *Hsynth, float *Ssynth,
+		float *Lsynth, int dimx, int dimy) {
+	struct star_splat *splats = malloc(nb_stars * sizeof(struct star_splat));
+	struct star_stamp **new_stamps = malloc(nb_stars * sizeof(struct star_stamp *));
+	if (!splats || !new_stamps) {
+		PRINT_ALLOC_ERR;
+		free(splats);
+		free(new_stamps);
+		return TRUE;
+	}
+	GHashTable *atlas = g_hash_table_new_full(g_int64_hash, g_int64_equal, NULL, free_stamp);
+
+	int nb_splats = 0;
+	for (int n = 0; n < nb_stars; n++) {
+		float lum = (float) stars[n]->A;
+		if (lum < 0.0f)
+			lum = 0.0f;
+		if (!is_32bit)
+			lum *= invnorm;
+		assert(lum >= 0.0f);
+		int size = (int) 5 * max(stars[n]->fwhmx, stars[n]->fwhmy); // This is big enough that even under extreme stretching the synthesized psf tails off smoothly
+		if (!gaussian)
+			size *= 10 / stars[n]->beta; // Increase the PSF size markedly for low beta stars
+		if (!(size % 2))
+			size++;
+		if (size > 1024 || size < 1) // protect against excessive memory allocations due to bad parameters;
+						 // 100px should be more than enough for the fwhm of even a very saturated star
+			continue;
+		float minfwhm = min(stars[n]->fwhmx, stars[n]->fwhmy);
+		float beta = 8.f;
+		if (!gaussian) {
+			if (stars[n]->beta > 0.0)
+				beta = stars[n]->beta;
+			else if (avg_moffat_beta > 0.0)
+				beta = avg_moffat_beta;
+		}
+		gboolean star_gaussian = stars[n]->has_saturated || gaussian;
+		int xbin = lroundf(((float) stars[n]->xpos - (int) stars[n]->xpos) * STAMP_SUBPIXEL_BINS);
+		int ybin = lroundf(((float) stars[n]->ypos - (int) stars[n]->ypos) * STAMP_SUBPIXEL_BINS);
+
+		guint64 key = stamp_key(star_gaussian, size, minfwhm, beta, xbin, ybin);
+		splats[nb_splats].x = (int) stars[n]->xpos;
+		splats[nb_splats].y = (int) stars[n]->ypos;
+		splats[nb_splats].lum = lum;
+		splats[nb_splats].stamp = g_hash_table_lookup(atlas, &key);
+		if (!splats[nb_splats].stamp) {
+			struct star_stamp *stamp = calloc(1, sizeof(struct star_stamp));
+			stamp->key = key;
+			stamp->gaussian = star_gaussian;
+			stamp->size = size;
+			stamp->fwhm = lroundf(minfwhm / STAMP_PARAM_STEP) * STAMP_PARAM_STEP;
+			stamp->beta = star_gaussian ? 0.f : lroundf(beta / STAMP_PARAM_STEP) * STAMP_PARAM_STEP;
+			stamp->xoff = (float) xbin / STAMP_SUBPIXEL_BINS;
+			stamp->yoff = (float) ybin / STAMP_SUBPIXEL_BINS;
+			g_hash_table_insert(atlas, &stamp->key, stamp);
+			splats[nb_splats].stamp = stamp;
+		}
+		nb_splats++;
+	}
+	siril_debug_print("star synthesis: %d stars, %u distinct stamps\n", nb_splats, g_hash_table_size(atlas));
+
+	/* The stamps are computed in parallel and the stars splatted in batches
+	 * whose stamps fit in the memory limit */
+	const size_t max_bytes = (size_t) min(STAMP_ATLAS_MAX_MB, max(1, get_max_memory_in_MB() / 4)) * BYTES_IN_A_MB;
+	gboolean stopcalled = FALSE;
+	int batch_start = 0;
+	while (batch_start < nb_splats) {
+		if (!get_thread_run()) {
+			stopcalled = TRUE;
+			break;
+		}
+		size_t bytes = 0;
+		int nb_new = 0, batch_end = batch_start;
+		for (; batch_end < nb_splats; batch_end++) {
+			struct star_stamp *stamp = splats[batch_end].stamp;
+			if (stamp->psf)
+				continue;
+			size_t stamp_bytes = (size_t) stamp->size * stamp->size * sizeof(float);
+			if (nb_new > 0 && bytes + stamp_bytes > max_bytes)
+				break;
+			if (!stamp->queued) {
+				stamp->queued = TRUE;
+				new_stamps[nb_new++] = stamp;
+				bytes += stamp_bytes;
+			}
+		}
 #ifdef _OPENMP
-#pragma omp parallel for simd schedule(static) collapse(2) num_threads(com.max_thread) private(xx, yy) if(com.max_thread > 1)
+#pragma omp parallel for num_threads(com.max_thread) schedule(dynamic) if(com.max_thread > 1)
 #endif
-	for (int psfx = 0; psfx < size; psfx++) {
-		for (int psfy = 0; psfy < size; psfy++) {
-			xx = x + psfx - halfpsfdim;
-			yy = y + psfy - halfpsfdim;
-			if (xx > 0 && xx < dimx && yy > 0 && yy < dimy) {
-				Lsynth[xx + ((dimy - yy) * dimx)] += psfL[psfx + (psfy * size)];
+		for (int i = 0; i < nb_new; i++) {
+			compute_stamp(new_stamps[i]);
+			new_stamps[i]->queued = FALSE;
+		}
+
+		splat_stars(splats + batch_start, batch_end - batch_start, H, S, Hsynth, Ssynth, Lsynth, dimx, dimy);
+		// stamps of a full batch are released, they may be needed again
+		// by later stars but this is limited to the images with many
+		// distinct large stars
+		if (batch_end < nb_splats) {
+			for (int i = 0; i < nb_new; i++) {
+				free(new_stamps[i]->psf);
+				new_stamps[i]->psf = NULL;
 			}
 		}
+		batch_start = batch_end;
+		set_progress_bar_data(NULL, (double) batch_end / (double) nb_splats);
 	}
-#ifdef _OPENMP
-#pragma omp barrier
-#endif
 
-	return;
+	g_hash_table_destroy(atlas);
+	free(new_stamps);
+	free(splats);
+	return stopcalled;
 }
 
 static void replace_sat_star_in_buffer(const float *psfL, int size, float *Lsynth, int x, int y, int dimx, int dimy, float sat, float bg, float noise) {
@@ -476,55 +620,8 @@ int generate_synthstars(fits *fit) {
 			avg_moffat_beta = -1;
 		siril_debug_print("# Moffat profile stars: %zd, average beta = %.3f\n", moffat_count, avg_moffat_beta);
 	}
-	for (int n = 0; n < nb_stars; n++) {
-		// Check if stop has been pressed
-		if (!get_thread_run())
-			stopcalled = TRUE;
-		set_progress_bar_data(NULL,	(double) n / (double) nb_stars);
-		if (!stopcalled) {
-			float lum = (float) stars[n]->A;
-			if (lum < 0.0f)
-				lum = 0.0f;
-			if (!is_32bit)
-				lum *= invnorm;
-			assert(lum >= 0.0f);
-			float xoff = (float) stars[n]->xpos - (int) stars[n]->xpos;
-			float yoff = (float) stars[n]->ypos - (int) stars[n]->ypos;
-			int size = (int) 5 * max(stars[n]->fwhmx, stars[n]->fwhmy); // This is big enough that even under extreme stretching the synthesized psf tails off smoothly
-			if (!gaussian)
-				size *= 10 / stars[n]->beta; // Increase the PSF size markedly for low beta stars
-			if (!(size % 2))
-				size++;
-			if (size > 1024) // protect against excessive memory allocations due to bad parameters;
-							 // 100px should be more than enough for the fwhm of even a very saturated star
-				continue;
-			float minfwhm = min(stars[n]->fwhmx, stars[n]->fwhmy);
-
-			// Synthesize the luminance profile and add to the star mask in HSL colourspace
-			float *psfL = (float*) calloc(size * size, sizeof(float));
-			if (!psfL) // May happen if size is excessively large because of a bad fwhm value
-				continue;
-			float beta = 8.f;
-			if (!gaussian) {
-				if (stars[n]->beta > 0.0) {
-					beta=stars[n]->beta;
-					minfwhm = min(stars[n]->fwhmx, stars[n]->fwhmy);
-				} else if (moffat_count > 0)
-					beta = avg_moffat_beta;
-			}
-			if (stars[n]->has_saturated || gaussian)
-				makegaussian(psfL, size, minfwhm, lum, xoff, yoff, 1.f, 0.f);
-			else
-				makemoffat(psfL, size, minfwhm, lum, xoff, yoff, beta, 1.f, 0.f);
-			if (is_RGB)
-				add_star_to_rgb_buffer(H, S, psfL, size, Hsynth, Ssynth, Lsynth,
-						(float) stars[n]->xpos, (float) stars[n]->ypos, dimx, dimy);
-			else
-				add_star_to_mono_buffer(psfL, size, Lsynth, (float) stars[n]->xpos,
-						(float) stars[n]->ypos, dimx, dimy);
-			free(psfL);
-		}
-	}
+	stopcalled = synthesize_stars(stars, nb_stars, gaussian, moffat_count > 0 ? (float) avg_moffat_beta : -1.f,
+			is_32bit, invnorm, H, S, Hsynth, Ssynth, Lsynth, dimx, dimy);
 	// Stars are only freed if they were *not* taken from com.stars: if the
 	// user has made a specific selection of stars, we want to leave that
 	// selection intact.
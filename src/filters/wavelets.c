@@ -92,7 +92,6 @@ static void wavelets_startup() {
 
 int get_wavelet_layers(fits *fit, int Nbr_Plan, int Plan, int Type, int reqlayer) {
 	int chan, start, end, retval = 0;
-	wave_transf_des wavelet[3] = { 0 };
 
 	g_assert(fit->naxes[2] <= 3);
 
@@ -116,34 +115,24 @@ int get_wavelet_layers(fits *fit, int Nbr_Plan, int Plan, int Type, int reqlayer
 	}
 
 	for (chan = start; chan < end; chan++) {
-		int Nl, Nc;
-
 		if (fit->type == DATA_USHORT) {
 			/* float wavelet of data [0, 65535] */
-			if (wavelet_transform(Imag, fit->ry, fit->rx, &wavelet[chan],
-						Type, Nbr_Plan, fit->pdata[chan])) {
-				retval = 1;
-				break;
-			}
+			prepare_rawdata(Imag, fit->ry, fit->rx, fit->pdata[chan]);
 		}
 		else if (fit->type == DATA_FLOAT) {
 			/* float wavelet of data [0, 1] */
 			Imag = fit->fpdata[chan];
-			if (wavelet_transform_float(Imag, fit->ry, fit->rx, &wavelet[chan],
-						Type, Nbr_Plan)) {
-				retval = 1;
-				break;
-			}
 		} else { // Unknown fit->type
 			retval = 1;
 			break;
 		}
-		Nl = wavelet[chan].Nbr_Ligne;
-		Nc = wavelet[chan].Nbr_Col;
-		pave_2d_extract_plan(wavelet[chan].Pave.Data, Imag, Nl, Nc, Plan);
+		/* only the requested plan is computed, in place */
+		if (wavelet_extract_plan(Imag, fit->ry, fit->rx, Type, Nbr_Plan, Plan)) {
+			retval = 1;
+			break;
+		}
 		if (fit->type == DATA_USHORT)
-			reget_rawdata(Imag, Nl, Nc, fit->pdata[chan]);
-		wave_io_free(&wavelet[chan]);
+			reget_rawdata(Imag, fit->ry, fit->rx, fit->pdata[chan]);
 	}
 
 	/* Free */
@@ -198,6 +187,8 @@ void on_wavelets_dialog_hide(GtkWidget *widget, gpointer user_data) {
 	gtk_widget_set_sensitive(lookup_widget("frame_wavelets"), FALSE);
 	gtk_widget_set_sensitive(lookup_widget("button_reset_w"), FALSE);
 	clear_backup();
+	/* the transforms of the previewed image are no longer needed */
+	wave_io_store_clear();
 }
 
 void on_button_reset_w_clicked(GtkButton *button, gpointer user_data) {
@@ -374,6 +374,39 @@ static double nointerp(fits *fit, int x, int y, int chan, int num, int dx, int d
 	return val;
 }
 
+/* pixel (x, y) of the CFA sub-pattern starting at (ox, oy), as extracted by
+ * split_cfa_ushort() and split_cfa_float() */
+static float cfa_pixel(fits *fit, int ox, int oy, int x, int y) {
+	size_t i = (size_t) (2 * y + oy) * fit->rx + 2 * x + ox;
+	if (fit->type == DATA_FLOAT)
+		return fit->fdata[i];
+	WORD v = fit->data[i];
+	return (float) ((fit->bitpix == BYTE_IMG) ? truncate_to_BYTE(v) : v);
+}
+
+/* same as bilinear() or nointerp() with a width of 1 on the extracted
+ * sub-pattern, without extracting it */
+static double cfa_sample(fits *fit, int ox, int oy, double x, double y, gboolean interpolate) {
+	int w = fit->rx / 2, h = fit->ry / 2;
+	if (!interpolate) {
+		int ix = (int) x, iy = (int) y;
+		if (ix < 0 || ix > w - 1 || iy < 0 || iy > h - 1)
+			return NAN;
+		return (double) cfa_pixel(fit, ox, oy, ix, iy);
+	}
+	float i = (float) x, j = (float) y;
+	int ii = (int) i, jj = (int) j;
+	int x0 = min(max(ii, 0), w - 1), x1 = min(max(ii + 1, 0), w - 1);
+	int y0 = min(max(jj, 0), h - 1), y1 = min(max(jj + 1, 0), h - 1);
+	float a = cfa_pixel(fit, ox, oy, x0, y0);
+	float b = cfa_pixel(fit, ox, oy, x0, y1);
+	float c = cfa_pixel(fit, ox, oy, x1, y0);
+	float d = cfa_pixel(fit, ox, oy, x1, y1);
+	float xoff = i - ii;
+	float yoff = j - jj;
+	return (double) ((a * (1 - xoff) * (1 - yoff)) + (b * (1 - xoff) * yoff) + (c * xoff * (1 - yoff)) + (d * xoff * yoff));
+}
+
 static void calc_zero_and_spacing(cut_struct *arg, double *zero, double *spectro_spacing) {
 	point wndelta = { (double) arg->cut_wn2.x - arg->cut_wn1.x , (double) arg->cut_wn2.y - arg->cut_wn1.y };
 	double wndiff_dist = sqrt(wndelta.x * wndelta.x + wndelta.y * wndelta.y);
@@ -468,6 +501,10 @@ gpointer cut_profile(gpointer p) {
 	double zero = 0.0, spectro_spacing = 1.0;
 	if (xscale)
 		calc_zero_and_spacing(arg, &zero, &spectro_spacing);
+	// sequences are already processed in parallel, one image per thread
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(com.max_thread) schedule(static) if (!arg->seq)
+#endif
 	for (int i = 0 ; i < nbr_points ; i++) {
 		if (xscale) {
 			x[i] = arg->plot_as_wavenumber ? 10000000. / (zero + i * spectro_spacing) : zero + i * spectro_spacing;
@@ -637,6 +674,9 @@ gpointer tri_cut(gpointer p) {
 		double offstarty = starty + (offset * point_spacing_x * arg->step);
 		gboolean single_channel = (arg->vport == 0 || arg->vport == 1 || arg->vport == 2);
 		gboolean redvport = arg->vport < 3 ? arg->vport : 0;
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(com.max_thread) schedule(static) if (!arg->seq)
+#endif
 		for (int i = 0 ; i < nbr_points ; i++) {
 			if (hv) {
 				// Horizontal / vertical, no interpolation
@@ -789,28 +829,21 @@ END:
 
 gpointer cfa_cut(gpointer p) {
 	cut_struct* arg = (cut_struct*) p;
-	int retval = 0, ret = 0;
+	int retval = 0;
 	double *x = NULL, *r[4] = { 0 };
 	char *filename = NULL,*imagefilename = NULL;
-	fits cfa[4];
-	memset(cfa, 0, 4 * sizeof(fits));
 	siril_plot_data *spl_data = NULL;
+	/* origins of the sub-patterns CFA0 to CFA3 in the Bayer matrix, the
+	 * profile is sampled in place instead of splitting the whole image */
+	const int cfa_origin[4][2] = { { 0, 1 }, { 0, 0 }, { 1, 1 }, { 1, 0 } };
 
 	build_profile_filenames(arg, &filename, &imagefilename);
 
-	// Split arg->fit into 4 x Bayer sub-patterns cfa[0123]
-	if (arg->fit->type == DATA_USHORT) {
-		if ((ret = split_cfa_ushort(arg->fit, &cfa[0], &cfa[1], &cfa[2], &cfa[3]))) {
-			siril_log_color_message(_("Error: failed to split FITS into CFA sub-patterns.\n"), "red");
-			retval = 1;
-			goto END;
-		}
-	} else {
-		if ((ret = split_cfa_float(arg->fit, &cfa[0], &cfa[1], &cfa[2], &cfa[3]))) {
-			siril_log_color_message(_("Error: failed to split FITS into CFA sub-patterns.\n"), "red");
-			retval = 1;
-			goto END;
-		}
+	if (strlen(arg->fit->keywords.bayer_pattern) > 4) {
+		siril_log_message(_("Split CFA does not work on non-Bayer filter camera images!\n"));
+		siril_log_color_message(_("Error: failed to split FITS into CFA sub-patterns.\n"), "red");
+		retval = 1;
+		goto END;
 	}
 
 	// Coordinates of profile start and endpoints in CFA space
@@ -840,18 +873,16 @@ gpointer cfa_cut(gpointer p) {
 	for (int i = 0 ; i < 4 ; i++)
 		r[i] = malloc(nbr_points * sizeof(double));
 	x = malloc(nbr_points * sizeof(double));
+	for (int i = 0 ; i < nbr_points ; i++)
+		x[i] = i * point_spacing;
 	for (int j = 0 ; j < 4 ; j++) {
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(com.max_thread) schedule(static) if (!arg->seq)
+#endif
 		for (int i = 0 ; i < nbr_points ; i++) {
-			x[i] = i * point_spacing;
-			if (hv) {
-				// Horizontal / vertical, no interpolation
-				r[j][i] = nointerp(&cfa[j], cut_start_cfa.x + point_spacing_x * i, starty + point_spacing_y * i,
-								   0, 1, (int) point_spacing_x, (int) point_spacing_y);
-			} else {
-				// Neither horizontal nor vertical: interpolate
-				r[j][i] = interp(&cfa[j], (double) (cut_start_cfa.x + point_spacing_x * i), (double) (starty + point_spacing_y * i),
-								 0, 1, point_spacing_x, point_spacing_y);
-			}
+			// Horizontal / vertical, no interpolation, otherwise interpolate
+			r[j][i] = cfa_sample(arg->fit, cfa_origin[j][0], cfa_origin[j][1],
+					cut_start_cfa.x + point_spacing_x * i, starty + point_spacing_y * i, !hv);
 		}
 	}
 	/* Plotting cut profile */
@@ -891,10 +922,8 @@ END:
 	g_free(arg->title);
 	arg->title = NULL;
 	free(x);
-	for (int i = 0 ; i < 4 ; i++) {
+	for (int i = 0 ; i < 4 ; i++)
 		free(r[i]);
-		clearfits(&cfa[i]);
-	}
 	gboolean in_sequence = (arg->seq != NULL);
 	if (!in_sequence) {
 		if (arg->display_graph)
@@ -448,97 +448,120 @@ size_t get_histo_size(fits *fit) {
 	return (size_t)USHRT_MAX;
 }
 
-// create a new histogram object for the passed fit and layer
-gsl_histogram* computeHisto(fits *fit, int layer) {
-	g_assert(layer < 3);
-	size_t i, ndata, size;
-
-	size = get_histo_size(fit);
-	gsl_histogram *histo = gsl_histogram_alloc(size + 1);
-	gsl_histogram_set_ranges_uniform(histo, 0, fit->type == DATA_FLOAT ? 1.0 + 1.0 / size : size + 1);
-	ndata = fit->naxes[0] * fit->naxes[1];
-
+/* Bin of x in a histogram with uniform ranges, the same as the one found by
+ * gsl_histogram_increment(): the linear guess is corrected against the ranges
+ * so that values at the bin boundaries are not counted in a different bin.
+ * Returns FALSE if x is out of the ranges or NaN */
+static inline gboolean find_uniform_bin(const double *range, size_t n, double x, size_t *bin) {
+	if (!(x >= range[0] && x < range[n]))
+		return FALSE;
+	size_t i = (size_t) ((x - range[0]) / (range[n] - range[0]) * n);
+	if (i >= n)
+		i = n - 1;
+	while (i > 0 && x < range[i])
+		i--;
+	while (i < n - 1 && x >= range[i + 1])
+		i++;
+	*bin = i;
+	return TRUE;
+}
+
+/* The histograms of the images are computed by counting in per-thread bins
+ * that are added to the gsl histogram at the end, instead of calling
+ * gsl_histogram_increment() for each pixel. Integer values are used directly
+ * as the bin index when the bins have a unit width */
+typedef enum { HISTO_WORD, HISTO_FLOAT } histo_data;
+
+static void fill_histogram(gsl_histogram *histo, const void *buf, histo_data type, size_t ndata,
+		size_t width, size_t stride, double scale, gboolean skip_zero) {
+	const size_t n = histo->n;
+	const double *range = histo->range;
+	// with n a power of 2, the ranges of unit bins are exact integers
+	const gboolean direct = type == HISTO_WORD && scale == 1.0 && range[0] == 0.0 &&
+		range[n] == (double) n && (n & (n - 1)) == 0;
+	const size_t nrows = ndata / width;
 #ifdef _OPENMP
 #pragma omp parallel num_threads(com.max_thread)
 #endif
 	{
-		gsl_histogram *histo_thr = gsl_histogram_alloc(size + 1);
-		gsl_histogram_set_ranges_uniform(histo_thr, 0, fit->type == DATA_FLOAT ? 1.0 + 1.0 / size : size + 1);
-
-		if (fit->type == DATA_USHORT) {
-			WORD *buf = fit->pdata[layer];
-#ifdef _OPENMP
-#pragma omp for private(i) schedule(static)
-#endif
-			for (i = 0; i < ndata; i++) {
-				if (buf[i] == 0)
-					continue;
-				gsl_histogram_increment(histo_thr, (double) buf[i]);
-			}
-		} else if (fit->type == DATA_FLOAT) {
-			float *buf = fit->fpdata[layer];
+		size_t *counts = calloc(n, sizeof(size_t));
+		if (!counts)
+			PRINT_ALLOC_ERR;
 #ifdef _OPENMP
-#pragma omp for private(i) schedule(static)
+#pragma omp for schedule(static)
 #endif
-			for (i = 0; i < ndata; i++) {
-				if (buf[i] == 0.f)
-					continue;
-				gsl_histogram_increment(histo_thr, (double) buf[i]);
+		for (size_t row = 0; row < nrows; row++) {
+			if (!counts)
+				continue;
+			if (type == HISTO_WORD) {
+				const WORD *line = (const WORD *) buf + row * stride;
+				for (size_t i = 0; i < width; i++) {
+					WORD v = line[i];
+					if (skip_zero && v == 0)
+						continue;
+					size_t bin;
+					if (direct) {
+						if (v < n)
+							counts[v]++;
+					} else if (find_uniform_bin(range, n, v * scale, &bin))
+						counts[bin]++;
+				}
+			} else {
+				const float *line = (const float *) buf + row * stride;
+				for (size_t i = 0; i < width; i++) {
+					float v = line[i];
+					if (skip_zero && v == 0.f)
+						continue;
+					size_t bin;
+					if (find_uniform_bin(range, n, (double) v, &bin))
+						counts[bin]++;
+				}
 			}
 		}
+		if (counts) {
 #ifdef _OPENMP
 #pragma omp critical
 #endif
-		{
-			gsl_histogram_add(histo, histo_thr);
+			{
+				for (size_t i = 0; i < n; i++)
+					histo->bin[i] += (double) counts[i];
+			}
+			free(counts);
 		}
-		gsl_histogram_free(histo_thr);
 	}
+}
+
+// create a new histogram object for the passed fit and layer
+gsl_histogram* computeHisto(fits *fit, int layer) {
+	g_assert(layer < 3);
+	size_t ndata, size;
+
+	size = get_histo_size(fit);
+	gsl_histogram *histo = gsl_histogram_alloc(size + 1);
+	gsl_histogram_set_ranges_uniform(histo, 0, fit->type == DATA_FLOAT ? 1.0 + 1.0 / size : size + 1);
+	ndata = fit->naxes[0] * fit->naxes[1];
+
+	// rows are only used to share the work, a whole layer is contiguous
+	if (fit->type == DATA_USHORT)
+		fill_histogram(histo, fit->pdata[layer], HISTO_WORD, ndata, fit->rx, fit->rx, 1.0, TRUE);
+	else if (fit->type == DATA_FLOAT)
+		fill_histogram(histo, fit->fpdata[layer], HISTO_FLOAT, ndata, fit->rx, fit->rx, 1.0, TRUE);
 
 	return histo;
 }
 
 // create a new histogram object for the passed float buffer (used for sat)
 gsl_histogram* computeHistoSat(void* buf) {
-	size_t i, ndata, size;
+	size_t ndata, size;
 
 	size = get_histo_size(&gfit);
 	gsl_histogram *histo = gsl_histogram_alloc(size + 1);
 	gsl_histogram_set_ranges_uniform(histo, 0, 1.0 + 1.0 / size);
 	ndata = fit->naxes[0] * fit->naxes[1];
 
-#ifdef _OPENMP
-#pragma omp parallel num_threads(com.max_thread)
-#endif
-	{
-		gsl_histogram *histo_thr = gsl_histogram_alloc(size + 1);
-		gsl_histogram_set_ranges_uniform(histo_thr, 0, 1.0 + 1.0 / size);
-		if (fit->type == DATA_FLOAT) {
-			float *fbuf = (float*) buf;
-#ifdef _OPENMP
-#pragma omp for private(i) schedule(static)
-#endif
-			for (i = 0; i < ndata; i++) {
-				gsl_histogram_increment(histo_thr, (double) fbuf[i]);
-			}
-		} else {
-			double invnorm = 1.0 / USHRT_MAX_DOUBLE;
-			WORD * Wbuf = (WORD*) buf;
-#ifdef _OPENMP
-#pragma omp for private(i) schedule(static)
-#endif
-			for (i = 0; i < ndata; i++) {
-				gsl_histogram_increment(histo_thr, Wbuf[i] * invnorm);
-			}
-		}
-#ifdef _OPENMP
-#pragma omp critical
-#endif
-		{
-			gsl_histogram_add(histo, histo_thr);
-		}
-		gsl_histogram_free(histo_thr);
-	}
+	if (fit->type == DATA_FLOAT)
+		fill_histogram(histo, buf, HISTO_FLOAT, ndata, fit->rx, fit->rx, 1.0, FALSE);
+	else fill_histogram(histo, buf, HISTO_WORD, ndata, fit->rx, fit->rx, 1.0 / USHRT_MAX_DOUBLE, FALSE);
 	return histo;
 }
 
@@ -965,30 +988,15 @@ gsl_histogram* computeHisto_Selection(fits* fit, int layer,
 	size_t size = get_histo_size(fit);
 	gsl_histogram* histo = gsl_histogram_alloc(size + 1);
 	gsl_histogram_set_ranges_uniform(histo, 0, fit->type == DATA_FLOAT ? 1.0 : size);
-	size_t stridefrom = fit->rx - selection->w;
-
-	if (fit->type == DATA_USHORT) {
-		WORD *from = fit->pdata[layer] + (fit->ry - selection->y - selection->h) * fit->rx
-			+ selection->x;
-		for (size_t i = 0; i < selection->h; i++) {
-			for (size_t j = 0; j < selection->w; j++) {
-				gsl_histogram_increment(histo, (double)*from);
-				from++;
-			}
-			from += stridefrom;
-		}
-	}
-	else if (fit->type == DATA_FLOAT) {
-		float *from = fit->fpdata[layer] + (fit->ry - selection->y - selection->h) * fit->rx
-			+ selection->x;
-		for (size_t i = 0; i < selection->h; i++) {
-			for (size_t j = 0; j < selection->w; j++) {
-				gsl_histogram_increment(histo, (double)*from);
-				from++;
-			}
-			from += stridefrom;
-		}
-	}
+	size_t ndata = (size_t) selection->w * selection->h;
+	if (ndata == 0)
+		return histo;
+	size_t offset = (fit->ry - selection->y - selection->h) * fit->rx + selection->x;
+
+	if (fit->type == DATA_USHORT)
+		fill_histogram(histo, fit->pdata[layer] + offset, HISTO_WORD, ndata, selection->w, fit->rx, 1.0, FALSE);
+	else if (fit->type == DATA_FLOAT)
+		fill_histogram(histo, fit->fpdata[layer] + offset, HISTO_FLOAT, ndata, selection->w, fit->rx, 1.0, FALSE);
 	return histo;
 }
 
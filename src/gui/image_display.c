@@ -62,6 +62,10 @@ static cmsBool identical = FALSE;
 
 #define ANGLE_TOP 315. * DEGTORAD
 #define ANGLE_BOT 45. * DEGTORAD
+/* above this number of annotations in view, the objects of the large
+ * catalogues smaller than this radius on screen are not drawn */
+#define ANNOTATION_LOD_MAX_OBJECTS 300
+#define ANNOTATION_LOD_MIN_RADIUS 4.0
 
 /* remap index data, an index for each layer */
 static float last_pente;
@@ -121,42 +125,257 @@ void check_gfit_profile_identical_to_monitor() {
 	siril_debug_print("gfit profile identical to monitor profile: %d\n", identical);
 }
 
-static void remaprgb(void) {
-	guint32 *dst;
-	const guint32 *bufr, *bufg, *bufb;
-	gint i;
-	int nbdata;
+/* The display buffers are mapped in bands of rows, when they are needed: a
+ * remap only sets the parameters and the bands visible in the drawing area
+ * are mapped when it is drawn. The others are mapped from an idle callback,
+ * or at once when the full buffer is required, so changing the display
+ * settings of a large image does not wait for its invisible parts */
+#define REMAP_BAND_ROWS 64
+#define REMAP_IDLE_BANDS 8
+
+static struct {
+	/* parameters of the last remap */
+	gboolean joint;		// the gray vports are mapped together by remap_all_vports()
+	gboolean inverted;
+	color_map color;
+	BYTE rainbow_index[UCHAR_MAX + 1][3];
+	BYTE *index[3];
+	gboolean hd_mode[3];
+	gboolean cms_transform;
+	int norm;
+	/* image the bands are mapped from */
+	data_type type;
+	guint rx, ry;
+	const void *data[3];
+	/* bands of the display buffers not mapped yet */
+	int nb_bands;
+	gboolean *pending[MAXVPORT];
+	guint idle_id;
+} remap_state = { 0 };
+
+static void remap_gray_rows(int vport, guint row_start, guint row_end);
+static void remap_joint_rows(guint row_start, guint row_end, guint32 *rgb);
+static void remaprgb_rows(guint row_start, guint row_end);
+
+static const void *gfit_layer(int layer) {
+	return gfit.type == DATA_FLOAT ? (const void *) gfit.fpdata[layer] : (const void *) gfit.pdata[layer];
+}
 
-	siril_debug_print("remaprgb\n");
-	if (!isrgb(&gfit))
-		return;
+/* the pending bands can only be mapped from the image they were set for */
+static gboolean remap_state_is_valid() {
+	if (gfit.type != remap_state.type || gfit.rx != remap_state.rx || gfit.ry != remap_state.ry)
+		return FALSE;
+	for (int i = 0; i < 3; i++)
+		if (gfit_layer(i) != remap_state.data[i])
+			return FALSE;
+	return TRUE;
+}
+
+static void clear_pending_bands() {
+	for (int i = 0; i < MAXVPORT; i++) {
+		free(remap_state.pending[i]);
+		remap_state.pending[i] = NULL;
+	}
+}
 
+/* maps the pending bands in [first, last[ of a vport */
+static void render_bands(int vport, int first, int last) {
+	gboolean *pending = remap_state.pending[vport];
+	if (!pending)
+		return;
+	struct image_view *view = &gui.view[vport];
+	if (!remap_state_is_valid() || !view->buf || view->full_surface_height != gfit.ry) {
+		clear_pending_bands();
+		return;
+	}
+	if (vport == RGB_VPORT) {
+		for (int i = 0; i < 3; i++)
+			render_bands(i, first, last);
+		if (!remap_state.pending[vport])
+			return;
+	}
+	gboolean joint = vport != RGB_VPORT && remap_state.joint;
+	// the RGB vport is composed in the same pass as the gray ones
 	struct image_view *rgbview = &gui.view[RGB_VPORT];
-	if (allocate_full_surface(rgbview))
+	gboolean *rgb_pending = joint && isrgb(&gfit) && rgbview->buf && rgbview->full_surface_height == gfit.ry ?
+		remap_state.pending[RGB_VPORT] : NULL;
+	if (joint && remap_state.cms_transform)
+		lock_display_transform();
+	gboolean rendered = FALSE;
+	for (int b = first; b < last; b++) {
+		if (!pending[b])
+			continue;
+		int end = b;
+		while (end < last && pending[end])
+			end++;
+		guint row_start = b * REMAP_BAND_ROWS;
+		guint row_end = min(gfit.ry, end * REMAP_BAND_ROWS);
+		if (vport == RGB_VPORT)
+			remaprgb_rows(row_start, row_end);
+		else if (joint)
+			remap_joint_rows(row_start, row_end, rgb_pending ? (guint32*) rgbview->buf : NULL);
+		else remap_gray_rows(vport, row_start, row_end);
+		for (int i = 0; i < 3; i++) {
+			if (joint && remap_state.pending[i]) {
+				for (int k = b; k < end; k++)
+					remap_state.pending[i][k] = FALSE;
+			}
+		}
+		for (int k = b; k < end; k++) {
+			pending[k] = FALSE;
+			if (rgb_pending)
+				rgb_pending[k] = FALSE;
+		}
+		rendered = TRUE;
+		b = end;
+	}
+	if (joint && remap_state.cms_transform)
+		unlock_display_transform();
+	if (!rendered)
 		return;
+	// flush to ensure all writing to the image was done and redraw the surface
+	for (int i = 0; i < MAXVPORT; i++) {
+		if (i == vport || (joint && (i != RGB_VPORT || rgb_pending) && gui.view[i].full_surface)) {
+			cairo_surface_flush(gui.view[i].full_surface);
+			cairo_surface_mark_dirty(gui.view[i].full_surface);
+		}
+	}
+}
 
-	// WARNING : this assumes that R, G and B buffers are already allocated and mapped
-	// it seems ok, but one can probably imagine situations where it segfaults
-	bufr = (const guint32*) gui.view[RED_VPORT].buf;
-	bufg = (const guint32*) gui.view[GREEN_VPORT].buf;
-	bufb = (const guint32*) gui.view[BLUE_VPORT].buf;
-	if (bufr == NULL || bufg == NULL || bufb == NULL) {
-		siril_debug_print("remaprgb: gray buffers not allocated for display\n");
+static gboolean remap_idle(gpointer p) {
+	// the current vport first
+	for (int k = 0; k < MAXVPORT; k++) {
+		int vport = (gui.cvport + k) % MAXVPORT;
+		gboolean *pending = remap_state.pending[vport];
+		if (!pending)
+			continue;
+		int first = 0;
+		while (first < remap_state.nb_bands && !pending[first])
+			first++;
+		if (first == remap_state.nb_bands)
+			continue;
+		render_bands(vport, first, min(remap_state.nb_bands, first + REMAP_IDLE_BANDS));
+		return G_SOURCE_CONTINUE;
+	}
+	remap_state.idle_id = 0;
+	return G_SOURCE_REMOVE;
+}
+
+/* marks all bands of a vport as needing to be mapped with the parameters
+ * that have just been set */
+static void set_pending_bands(int vport) {
+	int nb_bands = (gfit.ry + REMAP_BAND_ROWS - 1) / REMAP_BAND_ROWS;
+	if (nb_bands != remap_state.nb_bands || !remap_state_is_valid()) {
+		clear_pending_bands();
+		remap_state.nb_bands = nb_bands;
+		remap_state.type = gfit.type;
+		remap_state.rx = gfit.rx;
+		remap_state.ry = gfit.ry;
+		for (int i = 0; i < 3; i++)
+			remap_state.data[i] = gfit_layer(i);
+	}
+	if (!remap_state.pending[vport]) {
+		remap_state.pending[vport] = malloc(nb_bands * sizeof(gboolean));
+		if (!remap_state.pending[vport]) {
+			PRINT_ALLOC_ERR;
+			return;
+		}
+	}
+	for (int b = 0; b < nb_bands; b++)
+		remap_state.pending[vport][b] = TRUE;
+	if (!remap_state.idle_id)
+		remap_state.idle_id = g_idle_add_full(G_PRIORITY_LOW, remap_idle, NULL, NULL);
+}
+
+/* maps the bands of a vport visible in a drawing area of the given size */
+static void render_visible_bands(int vport, int width, int height) {
+	if (!remap_state.pending[vport])
 		return;
+	double ymin = G_MAXDOUBLE, ymax = -G_MAXDOUBLE;
+	for (int i = 0; i < 4; i++) {
+		double x = (i & 1) ? width : 0.0, y = (i & 2) ? height : 0.0;
+		cairo_matrix_transform_point(&gui.image_matrix, &x, &y);
+		ymin = min(ymin, y);
+		ymax = max(ymax, y);
 	}
-	dst = (guint32*) rgbview->buf;	// index is j
-	nbdata = gfit.rx * gfit.ry;	// source images are 32-bit RGBA
+	if (livestacking_is_started() && !g_strcmp0(gfit.keywords.row_order, "TOP-DOWN")) {
+		double tmp = ymin;
+		ymin = gfit.ry - ymax;
+		ymax = gfit.ry - tmp;
+	}
+	// the filter of the rendering may use pixels around the visible area
+	int first = (int) max(0.0, floor(ymin) - 2.0) / REMAP_BAND_ROWS;
+	int last = (int) min((double) gfit.ry, ceil(ymax) + 2.0) / REMAP_BAND_ROWS + 1;
+	render_bands(vport, first, min(last, remap_state.nb_bands));
+}
+
+void complete_display_remap(int vport) {
+	for (int i = 0; i < MAXVPORT; i++) {
+		if (vport >= 0 && i != vport)
+			continue;
+		render_bands(i, 0, remap_state.nb_bands);
+	}
+}
+
+/* part of the image shown in the viewport, in the coordinates of the selection.
+ * Returns FALSE if the image is not displayed */
+gboolean get_visible_image_area(int vport, rectangle *area) {
+	GtkWidget *widget = gui.view[vport].drawarea;
+	int width = gtk_widget_get_allocated_width(widget);
+	int height = gtk_widget_get_allocated_height(widget);
+	if (!gtk_widget_get_realized(widget) || width <= 1 || height <= 1 || !gfit.rx || !gfit.ry)
+		return FALSE;
+	double xmin = G_MAXDOUBLE, xmax = -G_MAXDOUBLE, ymin = G_MAXDOUBLE, ymax = -G_MAXDOUBLE;
+	for (int i = 0; i < 4; i++) {
+		double x = (i & 1) ? width : 0.0, y = (i & 2) ? height : 0.0;
+		cairo_matrix_transform_point(&gui.image_matrix, &x, &y);
+		xmin = min(xmin, x);
+		xmax = max(xmax, x);
+		ymin = min(ymin, y);
+		ymax = max(ymax, y);
+	}
+	int x0 = (int) max(0.0, floor(xmin)), y0 = (int) max(0.0, floor(ymin));
+	int x1 = (int) min((double) gfit.rx, ceil(xmax)), y1 = (int) min((double) gfit.ry, ceil(ymax));
+	if (x1 <= x0 || y1 <= y0)
+		return FALSE;
+	area->x = x0;
+	area->y = y0;
+	area->w = x1 - x0;
+	area->h = y1 - y0;
+	return TRUE;
+}
+
+static void remaprgb_rows(guint row_start, guint row_end) {
+	// WARNING : this assumes that R, G and B buffers are already allocated and mapped
+	// it seems ok, but one can probably imagine situations where it segfaults
+	const guint32 *bufr = (const guint32*) gui.view[RED_VPORT].buf;
+	const guint32 *bufg = (const guint32*) gui.view[GREEN_VPORT].buf;
+	const guint32 *bufb = (const guint32*) gui.view[BLUE_VPORT].buf;
+	guint32 *dst = (guint32*) gui.view[RGB_VPORT].buf;	// source images are 32-bit RGBA
+	const gint end = row_end * gfit.rx;
 
 #ifdef _OPENMP
 #pragma omp parallel for num_threads(com.max_thread) schedule(static)
 #endif
-	for (i = 0; i < nbdata; ++i) {
+	for (gint i = row_start * gfit.rx; i < end; ++i) {
 		dst[i] = (bufr[i] & 0xFF0000) | (bufg[i] & 0xFF00) | (bufb[i] & 0xFF);
 	}
+}
+
+static void remaprgb(void) {
+	siril_debug_print("remaprgb\n");
+	if (!isrgb(&gfit))
+		return;
+
+	struct image_view *rgbview = &gui.view[RGB_VPORT];
+	if (allocate_full_surface(rgbview))
+		return;
 
-// flush to ensure all writing to the image was done and redraw the surface
-	cairo_surface_flush(rgbview->full_surface);
-	cairo_surface_mark_dirty(rgbview->full_surface);
+	if (gui.view[RED_VPORT].buf == NULL || gui.view[GREEN_VPORT].buf == NULL || gui.view[BLUE_VPORT].buf == NULL) {
+		siril_debug_print("remaprgb: gray buffers not allocated for display\n");
+		return;
+	}
+	set_pending_bands(RGB_VPORT);
 	invalidate_image_render_cache(RGB_VPORT);
 }
 
@@ -195,9 +414,7 @@ static int make_index_for_rainbow(BYTE index[][3]);
 static void remap(int vport) {
 	// This function maps fit data with a linear LUT between lo and hi levels
 	// to the buffer to be displayed; display only is modified
-	BYTE *dst, *index, rainbow_index[UCHAR_MAX + 1][3];
-	WORD *src;
-	float *fsrc;
+	BYTE *index;
 	gboolean inverted;
 	siril_debug_print("HISTEQ / STF remap %d\n", vport);
 	if (vport == RGB_VPORT) {
@@ -258,18 +475,14 @@ static void remap(int vport) {
 		set_viewer_mode_widgets_sensitive(gui.rendering_mode != STF_DISPLAY);
 	}
 
-	src = gfit.pdata[vport];
-	fsrc = gfit.fpdata[vport];
-	dst = view->buf;
-
 	GAction *action_color = g_action_map_lookup_action(G_ACTION_MAP(app_win), "color-map");
 	GVariant *rainbow_state = g_action_get_state(action_color);
-	color_map color = g_variant_get_boolean(rainbow_state);
+	remap_state.color = g_variant_get_boolean(rainbow_state);
 	g_variant_unref(rainbow_state);
 	rainbow_state = NULL;
 
-	if (color == RAINBOW_COLOR)
-		make_index_for_rainbow(rainbow_index);
+	if (remap_state.color == RAINBOW_COLOR)
+		make_index_for_rainbow(remap_state.rainbow_index);
 	int target_index = gui.rendering_mode == STF_DISPLAY && gui.unlink_channels ? vport : 0;
 
 	gboolean hd_mode = (gui.rendering_mode == STF_DISPLAY && gui.use_hd_remap && gfit.type == DATA_FLOAT);
@@ -279,45 +492,75 @@ static void remap(int vport) {
 	else
 		index = gui.remap_index[target_index];
 
+	remap_state.joint = FALSE;
+	remap_state.inverted = inverted;
+	remap_state.index[vport] = index;
+	remap_state.hd_mode[vport] = hd_mode;
+	set_pending_bands(vport);
+	invalidate_image_render_cache(vport);
+	test_and_allocate_reference_image(vport);
+}
+
+static void remap_gray_rows(int vport, guint row_start, guint row_end) {
+	const WORD *src = gfit.pdata[vport];
+	const float *fsrc = gfit.fpdata[vport];
+	BYTE *dst = gui.view[vport].buf;
+	const BYTE *index = remap_state.index[vport];
+	const gboolean hd_mode = remap_state.hd_mode[vport];
+	const gboolean inverted = remap_state.inverted;
+	const color_map color = remap_state.color;
+	const BYTE (*rainbow_index)[3] = (const BYTE (*)[3]) remap_state.rainbow_index;
+
 #ifdef _OPENMP
-#pragma omp parallel for simd num_threads(com.max_thread) schedule(static)
+#pragma omp parallel for num_threads(com.max_thread) schedule(static)
 #endif
-	for (guint y = 0; y < gfit.ry; y++) {
-		guint src_i = y * gfit.rx;
-		guint dst_i = ((gfit.ry - 1 - y) * gfit.rx) * 4;
-		for (guint x = 0; x < gfit.rx; ++x, ++src_i, dst_i += 2) {
-			BYTE dst_pixel_value = 0;
-			if (gfit.type == DATA_USHORT) {
-				if (hd_mode) {
-					dst_pixel_value = index[src[src_i] * gui.hd_remap_max / USHRT_MAX]; // Works as long as hd_remap_max is power of 2
-				} else {
-					dst_pixel_value = index[src[src_i]];
-				}
-			} else if (gfit.type == DATA_FLOAT) {
-				if (hd_mode)
-					dst_pixel_value = index[float_to_max_range(fsrc[src_i], gui.hd_remap_max)];
-				else
-					dst_pixel_value = index[roundf_to_WORD(fsrc[src_i] * USHRT_MAX_SINGLE)];
+	for (guint row = row_start; row < row_end; row++) {
+		// Siril's FITS are stored bottom to top, so mapping needs to revert data order
+		const guint src_i = (gfit.ry - 1 - row) * gfit.rx;
+		guint32 *out = (guint32*) dst + row * gfit.rx;
+		// the type and LUT tests are done once per row, leaving plain gathers in the loops
+		if (gfit.type == DATA_USHORT) {
+			const WORD *line = src + src_i;
+			if (hd_mode) {
+				const guint hd_max = gui.hd_remap_max;
+#pragma omp simd
+				for (guint x = 0; x < gfit.rx; ++x)
+					out[x] = index[line[x] * hd_max / USHRT_MAX]; // Works as long as hd_remap_max is power of 2
+			} else {
+#pragma omp simd
+				for (guint x = 0; x < gfit.rx; ++x)
+					out[x] = index[line[x]];
 			}
-			dst_pixel_value = inverted ? UCHAR_MAX - dst_pixel_value : dst_pixel_value;
-
-			// Siril's FITS are stored bottom to top, so mapping needs to revert data order
-			guint dst_index = ((gfit.ry - 1 - y) * gfit.rx + x) * 4;
-			switch (color) {
-				default:
-				case NORMAL_COLOR:
-					*(guint32*)(dst + dst_index) = dst_pixel_value << 16 | dst_pixel_value << 8 | dst_pixel_value;
-					break;
-				case RAINBOW_COLOR:
-					*(guint32*)(dst + dst_index) = rainbow_index[dst_pixel_value][0] << 16 | rainbow_index[dst_pixel_value][1] << 8 | rainbow_index[dst_pixel_value][2];
+		} else if (gfit.type == DATA_FLOAT) {
+			const float *line = fsrc + src_i;
+			if (hd_mode) {
+				const guint hd_max = gui.hd_remap_max;
+#pragma omp simd
+				for (guint x = 0; x < gfit.rx; ++x)
+					out[x] = index[float_to_max_range(line[x], hd_max)];
+			} else {
+#pragma omp simd
+				for (guint x = 0; x < gfit.rx; ++x)
+					out[x] = index[roundf_to_WORD(line[x] * USHRT_MAX_SINGLE)];
 			}
 		}
+		// out holds the mapped values, expanded to the pixel format in place
+		switch (color) {
+			default:
+			case NORMAL_COLOR:
+#pragma omp simd
+				for (guint x = 0; x < gfit.rx; ++x) {
+					guint32 value = inverted ? UCHAR_MAX - out[x] : out[x];
+					out[x] = value << 16 | value << 8 | value;
+				}
+				break;
+			case RAINBOW_COLOR:
+				for (guint x = 0; x < gfit.rx; ++x) {
+					BYTE value = inverted ? UCHAR_MAX - out[x] : out[x];
+					out[x] = rainbow_index[value][0] << 16 | rainbow_index[value][1] << 8 | rainbow_index[value][2];
+				}
+		}
 	}
-	// flush to ensure all writing to the image was done and redraw the surface
-	cairo_surface_flush(view->full_surface);
-	cairo_surface_mark_dirty(view->full_surface);
-	invalidate_image_render_cache(vport);
-	test_and_allocate_reference_image(vport);
 }
 
 static void remap_all_vports() {
@@ -335,21 +578,17 @@ static void remap_all_vports() {
 	// We are now dealing with a 3-channel image
 
 	// Check if we need a rainbow color map
-	BYTE rainbow_index[UCHAR_MAX + 1][3];
 	GAction *action_color = g_action_map_lookup_action(G_ACTION_MAP(app_win), "color-map");
 	GVariant* rainbow_state = g_action_get_state(action_color);
 	color_map color = g_variant_get_boolean(rainbow_state);
 	g_variant_unref(rainbow_state);
 	rainbow_state = NULL;
 	if (color == RAINBOW_COLOR)
-		make_index_for_rainbow(rainbow_index);
+		make_index_for_rainbow(remap_state.rainbow_index);
 
 	// This function maps fit data with a linear LUT between lo and hi levels
 	// to the buffer to be displayed; display only is modified
-	guint y;
-	BYTE *dst[3], *index[3];
-	WORD *src[3];
-	float *fsrc[3];
+	BYTE *index[3];
 
 	if (gfit.type == DATA_UNSUPPORTED) {
 		siril_debug_print("data is not loaded yet\n");
@@ -375,7 +614,7 @@ static void remap_all_vports() {
 	}
 
 	make_index_for_current_display(0);
-	index[0] = gui.remap_index[0];
+	index[0] = index[1] = index[2] = gui.remap_index[0];
 	if (gfit.color_managed) {
 		for (int i = 1 ; i < 3 ; i++) {
 			make_index_for_current_display(i);
@@ -390,114 +629,128 @@ static void remap_all_vports() {
 	last_mode = gui.rendering_mode;
 
 	for (int i = 0 ; i < 3 ; i++) {
-		src[i] = gfit.pdata[i];
-		fsrc[i] = gfit.fpdata[i];
 		if (allocate_full_surface(view[i]))
 			return;
-		dst[i] = view[i]->buf;
 	}
 
-	int norm = (int) get_normalized_value(&gfit);
+	remap_state.joint = TRUE;
+	remap_state.inverted = inverted;
+	remap_state.color = color;
+	remap_state.norm = (int) get_normalized_value(&gfit);
+	remap_state.cms_transform = gui.icc.proofing_transform && !identical && !gui.icc.same_primaries;
+	siril_debug_print(remap_state.cms_transform ? "Non-identical primaries: doing expensive color transform\n" : "");
+	for (int vport = 0 ; vport < 3 ; vport++) {
+		remap_state.index[vport] = index[vport];
+		set_pending_bands(vport);
+		invalidate_image_render_cache(vport);
+	}
+	for (int vport = 0 ; vport < 3 ; vport++)
+		test_and_allocate_reference_image(vport);
+}
+
+static inline BYTE display_lut_value(const BYTE *index, WORD val, WORD lo, WORD hi, gboolean cut_over, gboolean inverted) {
+	BYTE value = (cut_over && val > hi) ? 0 : index[val < lo ? 0 : val - lo];	// cut
+	return inverted ? UCHAR_MAX - value : value;
+}
+
+/* Maps the rows of the three gray vports and, if rgb is not NULL, of the RGB
+ * vport in the same pass: the conversion to 16 bits, the LUT and the display
+ * transform are applied on each row while it is in cache.
+ * The display transform must be locked by the caller if
+ * remap_state.cms_transform is set */
+static void remap_joint_rows(guint row_start, guint row_end, guint32 *rgb) {
+	BYTE *dst[3];
+	const WORD *src[3];
+	const float *fsrc[3];
+	const BYTE *index[3];
+	for (int i = 0 ; i < 3 ; i++) {
+		src[i] = gfit.pdata[i];
+		fsrc[i] = gfit.fpdata[i];
+		dst[i] = gui.view[i].buf;
+		index[i] = remap_state.index[gfit.color_managed ? i : 0];
+	}
+	const guint rx = gfit.rx;
+	const int norm = remap_state.norm;
+	const gboolean inverted = remap_state.inverted;
+	const gboolean cms_transform = remap_state.cms_transform;
+	const color_map color = remap_state.color;
+	const BYTE (*rainbow_index)[3] = (const BYTE (*)[3]) remap_state.rainbow_index;
+	const WORD lo = gui.lo, hi = gui.hi;
+	const gboolean cut_over = gui.cut_over;
+
+#ifdef _OPENMP
+#pragma omp parallel num_threads(com.max_thread)
+#endif
 	{
-		siril_debug_print((gui.icc.proofing_transform && !identical && (!gui.icc.same_primaries || gui.icc.profile_changed)) ? "Non-identical primaries: doing expensive color transform\n" : "");
-		if (gui.icc.proofing_transform && !identical && (!gui.icc.same_primaries || gui.icc.profile_changed))
-			lock_display_transform();
+		// Set up a buffer so that the color space transform can be carried out on
+		// a whole row at a time using OpenMP to parallelize rows and the single
+		// threaded lcms2 context to give SIMD parallelisation within the rows
+		BYTE *pixelbuf_byte = malloc(rx * 3);
+		BYTE *linebuf_byte[3] = { pixelbuf_byte, (pixelbuf_byte + rx) , (pixelbuf_byte + 2 * rx) };
+		if (!pixelbuf_byte)
+			PRINT_ALLOC_ERR;
 #ifdef _OPENMP
-#pragma omp parallel for num_threads(com.max_thread) private(y) schedule(static)
+#pragma omp for schedule(static)
 #endif
-		for (y = 0; y < gfit.ry; y++) {
-			guint x;
-			guint src_i = y * gfit.rx;
-
-			// Set up a buffer so that the color space transform can be carried out on
-			//a whole row at a time using OpenMP to parallelize rows and the single
-			// threaded lcms2 context to give SIMD parallelisation within the rows
-			WORD *pixelbuf = malloc(gfit.rx * 3 * sizeof(WORD));
-			WORD *linebuf[3] = { pixelbuf, (pixelbuf + gfit.rx) , (pixelbuf + 2 * gfit.rx) };
-			BYTE *pixelbuf_byte = malloc(gfit.rx * 3);
-			BYTE *linebuf_byte[3] = { pixelbuf_byte, (pixelbuf_byte + gfit.rx) , (pixelbuf_byte + 2 * gfit.rx) };
-			if (gfit.type == DATA_FLOAT) {
-				for (int c = 0 ; c < 3 ; c++) {
-					WORD *line = linebuf[c];
-					float *source = fsrc[c];
+		for (guint row = row_start; row < row_end; row++) {
+			if (!pixelbuf_byte)
+				continue;
+			// Siril's FITS are stored bottom to top, so mapping needs to revert data order
+			const guint src_i = (gfit.ry - 1 - row) * rx;
+			for (int c = 0 ; c < 3 ; c++) {
+				BYTE *line = linebuf_byte[c];
+				const BYTE *lut = index[c];
+				if (gfit.type == DATA_FLOAT) {
+					const float *source = fsrc[c] + src_i;
 #pragma omp simd
-					for (x = 0 ; x < gfit.rx ; x++)
-						line[x] = roundf_to_WORD(source[src_i + x] * USHRT_MAX_SINGLE);
-				}
-			} else if (norm == UCHAR_MAX) {
-				for (int c = 0 ; c < 3 ; c++) {
-					WORD *line = linebuf[c];
-					const WORD *source = src[c];
+					for (guint x = 0 ; x < rx ; x++)
+						line[x] = display_lut_value(lut, roundf_to_WORD(source[x] * USHRT_MAX_SINGLE), lo, hi, cut_over, inverted);
+				} else if (norm == UCHAR_MAX) {
+					const WORD *source = src[c] + src_i;
 #pragma omp simd
-					for (x = 0 ; x < gfit.rx ; x++)
-						line[x] = source[src_i + x] << 8;
-				}
-			} else {
-				for (int c = 0 ; c < 3 ; c++)
-// No omp simd here as memcpy should already be highly optimized
-					memcpy(linebuf[c], src[c] + src_i, gfit.rx * sizeof(WORD));
-			}
-			if (gfit.type == DATA_USHORT && norm == UCHAR_MAX) {
-				for (int c = 0 ; c < 3 ; c++) {
-					WORD *line = linebuf[c];
-#pragma omp simd
-					for (x = 0 ; x < gfit.rx ; x++)
-						line[x] = line[x] >> 8;
-				}
-			}
-			for (int c = 0 ; c < 3 ; c++) {
-				const int cc = gfit.color_managed ? c : 0;
+					for (guint x = 0 ; x < rx ; x++)
+						line[x] = display_lut_value(lut, source[x] & 0xFF, lo, hi, cut_over, inverted);
+				} else {
+					const WORD *source = src[c] + src_i;
 #pragma omp simd
-				for (x = 0; x < gfit.rx; ++x) {
-					WORD val = linebuf[c][x];
-					if (gui.cut_over && val > gui.hi) {	// cut
-						linebuf_byte[c][x] = 0;
-					} else {
-						linebuf_byte[c][x] = index[cc][val - gui.lo < 0 ? 0 : val - gui.lo];
-					}
-					if (inverted)
-						linebuf_byte[c][x] = UCHAR_MAX - linebuf_byte[c][x];
+					for (guint x = 0 ; x < rx ; x++)
+						line[x] = display_lut_value(lut, source[x], lo, hi, cut_over, inverted);
 				}
 			}
-			if (gui.icc.proofing_transform && !identical && (!gui.icc.same_primaries || gui.icc.profile_changed)) {
-				cmsDoTransformLineStride(gui.icc.proofing_transform, pixelbuf_byte, pixelbuf_byte, gfit.rx, 1, gfit.rx * 3, gfit.rx * 3, gfit.rx, gfit.rx);
+			if (cms_transform) {
+				cmsDoTransformLineStride(gui.icc.proofing_transform, pixelbuf_byte, pixelbuf_byte, rx, 1, rx * 3, rx * 3, rx, rx);
 			}
+			guint32 *out[3] = { (guint32*) dst[0] + row * rx, (guint32*) dst[1] + row * rx, (guint32*) dst[2] + row * rx };
 			switch (color) {
 				case NORMAL_COLOR:
-#pragma omp simd collapse(2)
 					for (int c = 0 ; c < 3 ; c++) {
-						for (x = 0 ; x < gfit.rx ; x++) {
-							// Siril's FITS are stored bottom to top, so mapping needs to revert data order
-							guint dst_index = ((gfit.ry - 1 - y) * gfit.rx + x) * 4;
-							BYTE dst_pixel_value = linebuf_byte[c][x];
-							*(guint32*)(dst[c] + dst_index) = dst_pixel_value << 16 | dst_pixel_value << 8 | dst_pixel_value;
-						}
+						const BYTE *line = linebuf_byte[c];
+#pragma omp simd
+						for (guint x = 0 ; x < rx ; x++)
+							out[c][x] = line[x] << 16 | line[x] << 8 | line[x];
+					}
+					if (rgb) {
+						guint32 *rgbout = rgb + row * rx;
+#pragma omp simd
+						for (guint x = 0 ; x < rx ; x++)
+							rgbout[x] = linebuf_byte[0][x] << 16 | linebuf_byte[1][x] << 8 | linebuf_byte[2][x];
 					}
 					break;
 				case RAINBOW_COLOR:
-#pragma omp simd collapse(2)
 					for (int c = 0 ; c < 3 ; c++) {
-						for (x = 0 ; x < gfit.rx ; x++) {
-							// Siril's FITS are stored bottom to top, so mapping needs to revert data order
-							guint dst_index = ((gfit.ry - 1 - y) * gfit.rx + x) * 4;
-							BYTE dst_pixel_value = linebuf_byte[c][x];
-							*(guint32*)(dst[c] + dst_index) = rainbow_index[dst_pixel_value][0] << 16 | rainbow_index[dst_pixel_value][1] << 8 | rainbow_index[dst_pixel_value][2];
-						}
+						const BYTE *line = linebuf_byte[c];
+						for (guint x = 0 ; x < rx ; x++)
+							out[c][x] = rainbow_index[line[x]][0] << 16 | rainbow_index[line[x]][1] << 8 | rainbow_index[line[x]][2];
+					}
+					if (rgb) {
+						guint32 *rgbout = rgb + row * rx;
+						for (guint x = 0 ; x < rx ; x++)
+							rgbout[x] = (out[0][x] & 0xFF0000) | (out[1][x] & 0xFF00) | (out[2][x] & 0xFF);
 					}
 					break;
 			}
-			free(pixelbuf);
-			free(pixelbuf_byte);
 		}
-		if (gui.icc.proofing_transform && !identical && (!gui.icc.same_primaries || gui.icc.profile_changed))
-			unlock_display_transform();
-	}
-	// flush to ensure all writing to the image was done and redraw the surface
-	for (int vport = 0 ; vport < 3 ; vport++) {
-		cairo_surface_flush(view[vport]->full_surface);
-		cairo_surface_mark_dirty(view[vport]->full_surface);
-		invalidate_image_render_cache(vport);
-		test_and_allocate_reference_image(vport);
+		free(pixelbuf_byte);
 	}
 }
 
@@ -767,6 +1020,7 @@ static void draw_empty_image(const draw_data_t* dd) {
 static void draw_vport(const draw_data_t* dd) {
 	struct image_view *view = &gui.view[dd->vport];
 	if (!view->disp_surface) {
+		render_visible_bands(dd->vport, dd->window_width, dd->window_height);
 		cairo_surface_t *target = cairo_get_target(dd->cr);
 		view->disp_surface = cairo_surface_create_similar_image(target, CAIRO_FORMAT_ARGB32,
 					dd->window_width, dd->window_height);
@@ -1011,57 +1265,173 @@ static void draw_measurement_line(const draw_data_t* dd) {
 	cairo_restore(cr);
 }
 
+/* Grid index of com.stars, so that only the stars in the visible part of the
+ * image are drawn. It is rebuilt when the star list changes */
+#define STAR_GRID_CELL 128.0
+
+static struct {
+	psf_star **stars;	// the indexed list, not owned
+	int nb_stars;
+	psf_star *first, *last;
+	int width, height;
+	int cols, rows;
+	int *cell_start;	// cols * rows + 1 offsets in indices
+	int *indices;
+	double max_size;	// largest drawn radius, for culling
+} star_grid = { 0 };
+
+static double star_draw_size(const psf_star *star) {
+	double size = star->fwhmx * 2.0;
+	if (size <= 0.0) size = com.pref.phot_set.aperture;
+	return size;
+}
+
+static void clear_star_grid() {
+	free(star_grid.cell_start);
+	free(star_grid.indices);
+	memset(&star_grid, 0, sizeof(star_grid));
+}
+
+static gboolean update_star_grid(int width, int height) {
+	int nb = 0;
+	while (com.stars[nb])
+		nb++;
+	if (star_grid.indices && star_grid.stars == com.stars && star_grid.nb_stars == nb &&
+			star_grid.first == com.stars[0] && star_grid.last == (nb ? com.stars[nb - 1] : NULL) &&
+			star_grid.width == width && star_grid.height == height)
+		return TRUE;
+	clear_star_grid();
+	if (nb == 0)
+		return FALSE;
+	int cols = (int) ceil(max(width, 1) / STAR_GRID_CELL);
+	int rows = (int) ceil(max(height, 1) / STAR_GRID_CELL);
+	star_grid.cell_start = calloc((size_t) cols * rows + 1, sizeof(int));
+	star_grid.indices = malloc(nb * sizeof(int));
+	int *cell_of = malloc(nb * sizeof(int));
+	if (!star_grid.cell_start || !star_grid.indices || !cell_of) {
+		PRINT_ALLOC_ERR;
+		free(cell_of);
+		clear_star_grid();
+		return FALSE;
+	}
+	double max_size = 0.0;
+	for (int i = 0; i < nb; i++) {
+		const psf_star *star = com.stars[i];
+		int cx = (int) (star->xpos / STAR_GRID_CELL), cy = (int) (star->ypos / STAR_GRID_CELL);
+		cx = max(0, min(cols - 1, cx));
+		cy = max(0, min(rows - 1, cy));
+		cell_of[i] = cy * cols + cx;
+		star_grid.cell_start[cell_of[i] + 1]++;
+		double r = star->fwhmx > 0.0 ? star->fwhmy / star->fwhmx : 1.0;
+		max_size = max(max_size, star_draw_size(star) * max(1.0, r));
+	}
+	for (int c = 0; c < cols * rows; c++)
+		star_grid.cell_start[c + 1] += star_grid.cell_start[c];
+	int *fill = malloc((size_t) cols * rows * sizeof(int));
+	if (!fill) {
+		PRINT_ALLOC_ERR;
+		free(cell_of);
+		clear_star_grid();
+		return FALSE;
+	}
+	memcpy(fill, star_grid.cell_start, (size_t) cols * rows * sizeof(int));
+	for (int i = 0; i < nb; i++)
+		star_grid.indices[fill[cell_of[i]]++] = i;
+	free(fill);
+	free(cell_of);
+	star_grid.stars = com.stars;
+	star_grid.nb_stars = nb;
+	star_grid.first = com.stars[0];
+	star_grid.last = com.stars[nb - 1];
+	star_grid.width = width;
+	star_grid.height = height;
+	star_grid.cols = cols;
+	star_grid.rows = rows;
+	star_grid.max_size = max_size;
+	return TRUE;
+}
+
+static void add_star_path(cairo_t *cr, const psf_star *star) {
+	cairo_save(cr); // save the original transform
+	cairo_translate(cr, star->xpos, star->ypos);
+	cairo_rotate(cr, M_PI * 0.5 + star->angle * M_PI / 180.);
+	double r = star->fwhmx > 0.0 ? star->fwhmy / star->fwhmx : 1.0;
+	cairo_scale(cr, r, 1);
+	cairo_new_sub_path(cr);
+	cairo_arc(cr, 0., 0., star_draw_size(star), 0., 2 * M_PI);
+	cairo_restore(cr); // restore the original transform
+}
+
 static void draw_stars(const draw_data_t* dd) {
 	cairo_t *cr = dd->cr;
 	int i = 0;
 
-	if (com.stars && !com.script && (single_image_is_loaded() || sequence_is_loaded())) {
+	if (com.stars && !com.script && (single_image_is_loaded() || sequence_is_loaded()) &&
+			update_star_grid(dd->image_width, dd->image_height)) {
 		/* com.stars is a NULL-terminated array */
 		cairo_set_dash(cr, NULL, 0, 0);
-		cairo_set_source_rgba(cr, 1.0, 0.4, 0.0, 0.9);
-		cairo_set_line_width(cr, 1.5 / dd->zoom);
 
-		while (com.stars[i]) {
-			double size = com.stars[i]->fwhmx * 2.0;
-			if (size <= 0.0) size = com.pref.phot_set.aperture;
-			if (i == gui.selected_star) {
-				// We draw horizontal and vertical lines to show the star
-				cairo_set_line_width(cr, 2.0 / dd->zoom);
-				cairo_set_source_rgba(cr, 0.0, 0.4, 1.0, 0.6);
-
-				cairo_move_to(cr, com.stars[i]->xpos, 0);
-				cairo_line_to(cr, com.stars[i]->xpos, dd->image_height);
-				cairo_stroke(cr);
-				cairo_move_to(cr, 0, com.stars[i]->ypos);
-				cairo_line_to(cr, dd->image_width, com.stars[i]->ypos);
-				cairo_stroke(cr);
+		if (gui.selected_star >= 0 && gui.selected_star < star_grid.nb_stars) {
+			// We draw horizontal and vertical lines to show the star
+			const psf_star *star = com.stars[gui.selected_star];
+			cairo_set_line_width(cr, 2.0 / dd->zoom);
+			cairo_set_source_rgba(cr, 0.0, 0.4, 1.0, 0.6);
+			cairo_move_to(cr, star->xpos, 0);
+			cairo_line_to(cr, star->xpos, dd->image_height);
+			cairo_stroke(cr);
+			cairo_move_to(cr, 0, star->ypos);
+			cairo_line_to(cr, dd->image_width, star->ypos);
+			cairo_stroke(cr);
+		}
 
-				cairo_set_source_rgba(cr, 1.0, 0.4, 0.0, 0.9);
-				cairo_set_line_width(cr, 1.5 / dd->zoom);
+		/* only the cells that intersect the visible area are walked, and
+		 * the ellipses are stroked in two batches, normal and saturated */
+		double x1, y1, x2, y2;
+		cairo_clip_extents(cr, &x1, &y1, &x2, &y2);
+		x1 -= star_grid.max_size;
+		y1 -= star_grid.max_size;
+		x2 += star_grid.max_size;
+		y2 += star_grid.max_size;
+		int cx1 = max(0, (int) floor(x1 / STAR_GRID_CELL)), cy1 = max(0, (int) floor(y1 / STAR_GRID_CELL));
+		int cx2 = min(star_grid.cols - 1, (int) floor(x2 / STAR_GRID_CELL));
+		int cy2 = min(star_grid.rows - 1, (int) floor(y2 / STAR_GRID_CELL));
+		// stars outside the image are indexed in the border cells
+		if (x2 >= dd->image_width) cx2 = star_grid.cols - 1;
+		if (y2 >= dd->image_height) cy2 = star_grid.rows - 1;
+		if (x1 < 0.0) cx1 = 0;
+		if (y1 < 0.0) cy1 = 0;
+
+		for (int saturated = 0; saturated <= 1; saturated++) {
+			int drawn = 0;
+			for (int cy = cy1; cy <= cy2; cy++) {
+				for (int cx = cx1; cx <= cx2; cx++) {
+					int c = cy * star_grid.cols + cx;
+					for (int k = star_grid.cell_start[c]; k < star_grid.cell_start[c + 1]; k++) {
+						const psf_star *star = com.stars[star_grid.indices[k]];
+						if (!star->has_saturated != !saturated)
+							continue;
+						if (star->xpos < x1 || star->xpos > x2 || star->ypos < y1 || star->ypos > y2)
+							continue;
+						add_star_path(cr, star);
+						drawn++;
+					}
+				}
 			}
-			if (com.stars[i]->has_saturated) {
+			if (!drawn)
+				continue;
+			if (saturated) {
 				cairo_set_source_rgba(cr, 0.75, 0.22, 1.0, 0.9);
 				cairo_set_line_width(cr, 3.0 / dd->zoom);
-			}
-			cairo_save(cr); // save the original transform
-			cairo_translate(cr, com.stars[i]->xpos, com.stars[i]->ypos);
-			cairo_rotate(cr, M_PI * 0.5 + com.stars[i]->angle * M_PI / 180.);
-			double r = com.stars[i]->fwhmx > 0.0 ? com.stars[i]->fwhmy / com.stars[i]->fwhmx : 1.0;
-			cairo_scale(cr, r, 1);
-			cairo_arc(cr, 0., 0., size, 0., 2 * M_PI);
-			cairo_restore(cr); // restore the original transform
-			cairo_stroke(cr);
-			/* to keep  for debugging boxes adjustements */
-			// if (com.stars[i]->R > 0)
-			// 	cairo_rectangle(cr, com.stars[i]->xpos - (double)com.stars[i]->R, com.stars[i]->ypos - (double)com.stars[i]->R, (double)com.stars[i]->R * 2 + 1, (double)com.stars[i]->R * 2 + 1);
-			// cairo_stroke(cr);
-			if (com.stars[i]->has_saturated) {
+			} else {
 				cairo_set_source_rgba(cr, 1.0, 0.4, 0.0, 0.9);
 				cairo_set_line_width(cr, 1.5 / dd->zoom);
 			}
-
-			i++;
+			cairo_stroke(cr);
 		}
+		/* to keep  for debugging boxes adjustements */
+		// if (com.stars[i]->R > 0)
+		// 	cairo_rectangle(cr, com.stars[i]->xpos - (double)com.stars[i]->R, com.stars[i]->ypos - (double)com.stars[i]->R, (double)com.stars[i]->R * 2 + 1, (double)com.stars[i]->R * 2 + 1);
+		// cairo_stroke(cr);
 	}
 
 	/* quick photometry */
@@ -1316,27 +1686,65 @@ static double ra_values[] = { 45, 30, 15, 10, 7.5, 5, 3.75, 2.5, 1.5, 1.25, 1, 3
 		/ 2., 1. / 4., 1. / 6., 1. / 8., 1. / 12., 1. / 16., 1. / 24., 1. / 40., 1. / 48. };
 
 
-static void draw_wcs_grid(const draw_data_t* dd) {
-	if (!gui.show_wcs_grid) return;
-	fits *fit = &gfit;
-	if (!has_wcs(fit)) return;
-	cairo_t *cr = dd->cr;
-	cairo_set_dash(cr, NULL, 0, 0);
-	cairo_set_line_width(cr, 1. / dd->zoom);
-	cairo_set_font_size(cr, 12.0 / dd->zoom);
+/* The grid lines and labels only depend on the WCS and on the image size, they
+ * are computed once and kept until one of them changes */
+typedef struct {
+	double x1, y1, x2, y2;
+} grid_segment;
+
+static struct {
+	struct wcsprm *wcslib;
+	double crval[2], crpix[2], cdelt[2], pc[4];
+	gpointer dispre;
+	int rx, ry;
+	GArray *lines[2];	// DEC lines, RA lines
+	GList *labels;	// border crossings, sorted by border
+	double stepRA;
+	gboolean valid;
+} wcs_grid = { 0 };
+
+static void clear_wcs_grid() {
+	for (int i = 0; i < 2; i++)
+		if (wcs_grid.lines[i])
+			g_array_free(wcs_grid.lines[i], TRUE);
+	g_list_free_full(wcs_grid.labels, (GDestroyNotify) g_free);
+	memset(&wcs_grid, 0, sizeof(wcs_grid));
+}
+
+static gboolean wcs_grid_is_valid(const fits *fit) {
+	const struct wcsprm *wcs = fit->keywords.wcslib;
+	return wcs_grid.valid && wcs_grid.wcslib == wcs && wcs_grid.rx == fit->rx && wcs_grid.ry == fit->ry &&
+		wcs_grid.dispre == (gpointer) wcs->lin.dispre &&
+		!memcmp(wcs_grid.crval, wcs->crval, sizeof(wcs_grid.crval)) &&
+		!memcmp(wcs_grid.crpix, wcs->crpix, sizeof(wcs_grid.crpix)) &&
+		!memcmp(wcs_grid.cdelt, wcs->cdelt, sizeof(wcs_grid.cdelt)) &&
+		!memcmp(wcs_grid.pc, wcs->pc, sizeof(wcs_grid.pc));
+}
+
+static gboolean compute_wcs_grid(fits *fit) {
+	clear_wcs_grid();
+	const struct wcsprm *wcs = fit->keywords.wcslib;
+	wcs_grid.wcslib = fit->keywords.wcslib;
+	memcpy(wcs_grid.crval, wcs->crval, sizeof(wcs_grid.crval));
+	memcpy(wcs_grid.crpix, wcs->crpix, sizeof(wcs_grid.crpix));
+	memcpy(wcs_grid.cdelt, wcs->cdelt, sizeof(wcs_grid.cdelt));
+	memcpy(wcs_grid.pc, wcs->pc, sizeof(wcs_grid.pc));
+	wcs_grid.dispre = (gpointer) wcs->lin.dispre;
+	wcs_grid.rx = fit->rx;
+	wcs_grid.ry = fit->ry;
+	wcs_grid.lines[0] = g_array_new(FALSE, FALSE, sizeof(grid_segment));
+	wcs_grid.lines[1] = g_array_new(FALSE, FALSE, sizeof(grid_segment));
+
 	double ra0, dec0;
-	GList *ptlist = NULL;
 	double world[2], pix[2], pix2[2], img[2];
 	double phi, theta;
 	int status;
 
 	double width = (double) fit->rx;
 	double height = (double) fit->ry;
-	cairo_rectangle(cr, 0., 0., width, height); // to clip the grid
-	cairo_clip(cr);
 	/* get ra and dec of center of the image */
 	center2wcs(fit, &ra0, &dec0);
-	if (ra0 == -1.) return;
+	if (ra0 == -1.) return FALSE;
 	dec0 *= (M_PI / 180.0);
 	ra0  *= (M_PI / 180.0);
 	double range = get_wcs_image_resolution(fit) * sqrt(pow((width / 2.0), 2) + pow((height / 2.0), 2)); // range in degrees, FROM CENTER
@@ -1382,7 +1790,6 @@ static void draw_wcs_grid(const draw_data_t* dd) {
 	double centdec = step * round(dec0 * 180 / (M_PI * step));
 
 	// plot DEC grid
-	cairo_set_source_rgb(cr, 0.8, 0.0, 0.0);
 	double di = (polesign) ? 0. : centra - 6 * stepRA;
 	do { // dec lines
 		double dj = max(centdec - 6 * step, -90);
@@ -1399,9 +1806,8 @@ static void draw_wcs_grid(const draw_data_t* dd) {
 
 			if (((x1 >= 0) && (y1 >= 0) && (x1 < width) && (y1 < height))
 					|| ((x2 >= 0) && (y2 >= 0) && (x2 < width) && (y2 < height))) {
-				cairo_move_to(cr, x1, y1);
-				cairo_line_to(cr, x2, y2);
-				cairo_stroke(cr);
+				grid_segment seg = { x1, y1, x2, y2 };
+				g_array_append_val(wcs_grid.lines[0], seg);
 			}
 			// check crossing
 			if (!(((xa >= 0) && (ya >= 0) && (xa < width) && (ya < height))
@@ -1414,7 +1820,7 @@ static void draw_wcs_grid(const draw_data_t* dd) {
 						status = wcsmix(fit->keywords.wcslib, pixtype[k], 1, latspan, 1.0, 0, world, &phi, &theta, img, pix);
 						if(!status) {
 							wcs2pix(fit, world[0], world[1] + 0.1, &pix2[0], &pix2[1]);
-							ptlist = g_list_append(ptlist, new_label_point(height, pix, pix2, world, TRUE, k));
+							wcs_grid.labels = g_list_prepend(wcs_grid.labels, new_label_point(height, pix, pix2, world, TRUE, k));
 						}
 						break;
 					}
@@ -1426,7 +1832,6 @@ static void draw_wcs_grid(const draw_data_t* dd) {
 	} while (di <= ((polesign) ? 360. : centra + 6 * stepRA));
 
 	// plot RA grid
-	cairo_set_source_rgb(cr, 0.0, 0.5, 1.0);
 	double dj = max(centdec - step * 6, -90);
 	do { // ra lines
 		di = (polesign) ? 0. : centra - 6 * stepRA;
@@ -1443,9 +1848,8 @@ static void draw_wcs_grid(const draw_data_t* dd) {
 
 			if (((x1 >= 0) && (y1 >= 0) && (x1 < width) && (y1 < height))
 					|| ((x2 >= 0) && (y2 >= 0) && (x2 < width) && (y2 < height))) {
-				cairo_move_to(cr, x1, y1);
-				cairo_line_to(cr, x2, y2);
-				cairo_stroke(cr);
+				grid_segment seg = { x1, y1, x2, y2 };
+				g_array_append_val(wcs_grid.lines[1], seg);
 			}
 				// check crossing
 			if (!(((xa >= 0) && (ya >= 0) && (xa < width) && (ya < height))
@@ -1458,7 +1862,7 @@ static void draw_wcs_grid(const draw_data_t* dd) {
 						status = wcsmix(fit->keywords.wcslib, pixtype[k], 2, lngspan, 1.0, 0, world, &phi, &theta, img, pix);
 						if(!status) {
 							wcs2pix(fit, world[0] + 0.1, world[1], &pix2[0], &pix2[1]);
-							ptlist = g_list_append(ptlist, new_label_point(height, pix, pix2, world, FALSE, k));
+							wcs_grid.labels = g_list_prepend(wcs_grid.labels, new_label_point(height, pix, pix2, world, FALSE, k));
 						}
 						break;
 					}
@@ -1469,19 +1873,49 @@ static void draw_wcs_grid(const draw_data_t* dd) {
 		dj = dj + step;
 	} while (dj <= min(centdec + step * 6, 90));
 
+	wcs_grid.labels = g_list_reverse(wcs_grid.labels);
+	wcs_grid.labels = g_list_sort(wcs_grid.labels, (GCompareFunc) border_compare); // sort potential tags by increasing border number
+	wcs_grid.stepRA = stepRA;
+	wcs_grid.valid = TRUE;
+	return TRUE;
+}
+
+static void draw_wcs_grid(const draw_data_t* dd) {
+	if (!gui.show_wcs_grid) return;
+	fits *fit = &gfit;
+	if (!has_wcs(fit)) return;
+	cairo_t *cr = dd->cr;
+	cairo_set_dash(cr, NULL, 0, 0);
+	cairo_set_line_width(cr, 1. / dd->zoom);
+	cairo_set_font_size(cr, 12.0 / dd->zoom);
+	cairo_rectangle(cr, 0., 0., (double) fit->rx, (double) fit->ry); // to clip the grid
+	cairo_clip(cr);
+	if (!wcs_grid_is_valid(fit) && !compute_wcs_grid(fit))
+		return;
+
+	const double colors[2][3] = { { 0.8, 0.0, 0.0 }, { 0.0, 0.5, 1.0 } };
+	for (int i = 0; i < 2; i++) {
+		cairo_set_source_rgb(cr, colors[i][0], colors[i][1], colors[i][2]);
+		for (guint k = 0; k < wcs_grid.lines[i]->len; k++) {
+			const grid_segment *seg = &g_array_index(wcs_grid.lines[i], grid_segment, k);
+			cairo_move_to(cr, seg->x1, seg->y1);
+			cairo_line_to(cr, seg->x2, seg->y2);
+		}
+		cairo_stroke(cr);
+	}
+
 	// Add crossings labels
-	ptlist = g_list_sort(ptlist, (GCompareFunc) border_compare); // sort potential tags by increasing border number
 	if (dd->neg_view) {
 		cairo_set_source_rgb(cr, 0.2, 0.2, 0.2);
 	} else {
 		cairo_set_source_rgb(cr, 0.8, 0.8, 0.8);
 	}
 	GSList *existingtags = NULL;
-	gchar *RAfmt = (stepRA < 1./4.) ? "%02dh%02dm%02ds" : "%02dh%02dm";
-	for (GList *l = ptlist; l != NULL; l = l->next) {
+	gchar *RAfmt = (wcs_grid.stepRA < 1./4.) ? "%02dh%02dm%02ds" : "%02dh%02dm";
+	for (GList *l = wcs_grid.labels; l != NULL; l = l->next) {
 		// getting the label
 		SirilWorldCS *world_cs;
-		label_point *pt = (label_point*) l->data;
+		label_point label = *(label_point*) l->data, *pt = &label;
 		world_cs = siril_world_cs_new_from_a_d(pt->ra, pt->dec);
 		if (world_cs) {
 			gchar *tag = (pt->isRA) ? siril_world_cs_alpha_format(world_cs, RAfmt) : siril_world_cs_delta_format(world_cs, "%c%02d°%02d\'");
@@ -1531,7 +1965,6 @@ static void draw_wcs_grid(const draw_data_t* dd) {
 			}
 		}
 	}
-	g_list_free_full(ptlist, (GDestroyNotify) g_free);
 	g_slist_free_full(existingtags, (GDestroyNotify) g_free);
 
 	draw_compass(dd);
@@ -1597,48 +2030,74 @@ static void draw_annotates(const draw_data_t* dd) {
 	cairo_set_line_width(cr, 1.0 / dd->zoom);
 	cairo_rectangle(cr, 0., 0., width, height); // to clip the grid
 	cairo_clip(cr);
+	double cx1, cy1, cx2, cy2;
+	cairo_clip_extents(cr, &cx1, &cy1, &cx2, &cy2);
+	// room for the names, which are not clipped by the position test
+	double margin = 400.0 * (com.pref.gui.font_scale / 100.0) / dd->zoom;
+
+	GdkRGBA dso_color, sso_color, tmp_color, std_color;
+	gdk_rgba_parse(&dso_color, com.pref.gui.config_colors.color_dso_annotations);
+	gdk_rgba_parse(&sso_color, com.pref.gui.config_colors.color_sso_annotations);
+	gdk_rgba_parse(&tmp_color, com.pref.gui.config_colors.color_tmp_annotations);
+	gdk_rgba_parse(&std_color, com.pref.gui.config_colors.color_std_annotations);
+
+	/* level of detail: when too many objects are in view, the small objects of
+	 * the large catalogues are not drawn until the user zooms in */
+	int nb_visible = 0;
+	for (GSList *list = com.found_object; list; list = list->next) {
+		CatalogObjects *object = (CatalogObjects *)list->data;
+		double radius = get_catalogue_object_radius(object) / resolution / 60.0;
+		double x = get_catalogue_object_x(object);
+		double y = get_catalogue_object_y(object);
+		double extent = max(radius * 1.3, 15.0) + margin;
+		if (x >= cx1 - extent && x <= cx2 + extent && y >= cy1 - extent && y <= cy2 + extent)
+			nb_visible++;
+	}
+	gboolean crowded = nb_visible > ANNOTATION_LOD_MAX_OBJECTS;
+	if (crowded)
+		siril_debug_print("%d annotations in view, hiding the small objects\n", nb_visible);
 
 	for (GSList *list = com.found_object; list; list = list->next) {
 		CatalogObjects *object = (CatalogObjects *)list->data;
 		gdouble radius = get_catalogue_object_radius(object);
 		gdouble x = get_catalogue_object_x(object);
 		gdouble y = get_catalogue_object_y(object);
-		gchar *code = get_catalogue_object_code_pretty(object);
+		radius = radius / resolution / 60.0;
+		// radius now in pixels
+		double extent = max(radius * 1.3, 15.0) + margin;
+		if (x < cx1 - extent || x > cx2 + extent || y < cy1 - extent || y > cy2 + extent)
+			continue;
 		guint catalog = get_catalogue_object_cat(object);
+		if (crowded && catalog != CAT_AN_MESSIER && catalog < CAT_AN_USER_DSO &&
+				radius * dd->zoom < ANNOTATION_LOD_MIN_RADIUS)
+			continue;
+		gchar *code = get_catalogue_object_code_pretty(object);
 		gboolean revert = FALSE;
 		double angle = ANGLE_TOP;
 		double addoffset = 0.;
-		GdkRGBA gdk_color;
 
 		switch (catalog) {
 		case CAT_AN_USER_DSO:
-			gdk_rgba_parse(&gdk_color, com.pref.gui.config_colors.color_dso_annotations);
-			cairo_set_source_rgba(cr, gdk_color.red, gdk_color.green, gdk_color.blue, gdk_color.alpha);
+			cairo_set_source_rgba(cr, dso_color.red, dso_color.green, dso_color.blue, dso_color.alpha);
 			break;
 		case CAT_AN_USER_SSO:
-			gdk_rgba_parse(&gdk_color, com.pref.gui.config_colors.color_sso_annotations);
-			cairo_set_source_rgba(cr, gdk_color.red, gdk_color.green, gdk_color.blue, gdk_color.alpha);
+			cairo_set_source_rgba(cr, sso_color.red, sso_color.green, sso_color.blue, sso_color.alpha);
 			break;
 		case CAT_AN_USER_TEMP:
-			gdk_rgba_parse(&gdk_color, com.pref.gui.config_colors.color_tmp_annotations);
-			cairo_set_source_rgba(cr, gdk_color.red, gdk_color.green, gdk_color.blue, gdk_color.alpha);
+			cairo_set_source_rgba(cr, tmp_color.red, tmp_color.green, tmp_color.blue, tmp_color.alpha);
 			revert = TRUE;
 			angle = ANGLE_BOT;
 			break;
 		default:
 		case 0:
-			gdk_rgba_parse(&gdk_color, com.pref.gui.config_colors.color_std_annotations);
 			if (dd->neg_view) {
-				cairo_set_source_rgba(cr, 1.0 - gdk_color.red, 1.0 - gdk_color.green, 1.0 - gdk_color.blue, gdk_color.alpha);
+				cairo_set_source_rgba(cr, 1.0 - std_color.red, 1.0 - std_color.green, 1.0 - std_color.blue, std_color.alpha);
 			} else {
-				cairo_set_source_rgba(cr, gdk_color.red, gdk_color.green, gdk_color.blue, gdk_color.alpha);
+				cairo_set_source_rgba(cr, std_color.red, std_color.green, std_color.blue, std_color.alpha);
 			}
 			break;
 		}
 
-		radius = radius / resolution / 60.0;
-		// radius now in pixels
-
 		point offset = {5., revert ? 5. : -5.};
 		if (radius < 0) {
 			// objects we don't have an accurate location (LdN, Sh2)
@@ -19,6 +19,8 @@ void initialize_image_display();
 void copy_roi_into_gfit();
 
 void redraw(remap_type doremap);	// redraw the image, possibly with a remap
+void complete_display_remap(int vport);	// map the whole display buffer, -1 for all vports
+gboolean get_visible_image_area(int vport, rectangle *area);
 void queue_redraw(remap_type doremap); // call redraw from another thread
 
 double get_zoom_val();	// for image_interactions
@@ -4,11 +4,21 @@
 #include "filters/deconvolution/deconvolution.h"
 #include "core/siril.h"
 
+/* PSF estimated on one frame of a sequence */
+struct psf_sample {
+	int index;	// index of the frame in the sequence
+	double pos;	// FWHM or index of the frame, the interpolation variable
+	float *kernel;
+};
+
 typedef struct deconvolution_sequence_data {
 	sequence *seq;
 	char* seqEntry;
 	estk_data *deconv_data;
 	gboolean from_command;
+	struct psf_sample *psf_samples;	// sorted by pos, NULL if not sampling the PSF
+	int nb_psf_samples;
+	gboolean psf_by_fwhm;	// interpolate with the registration FWHM
 } deconvolution_sequence_data;
 
 void reset_conv_args(estk_data* args);
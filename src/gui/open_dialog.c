@@ -29,7 +29,6 @@
 #include "core/proto.h"
 #include "core/OS_utils.h"
 #include "core/initfile.h"
-#include "core/icc_profile.h"
 #include "algos/sorting.h"
 #include "io/conversion.h"
 #include "io/films.h"
@@ -380,10 +379,7 @@ static void opendial(int whichdial) {
 			break;
 
 		case OD_OPEN:
-			set_cursor_waiting(TRUE);
-			retval = open_single_image(filename);
-			icc_auto_assign_or_convert(&gfit, ICC_ASSIGN_ON_LOAD);
-			set_cursor_waiting(FALSE);
+			retval = open_single_image_async(filename);
 			if (retval == OPEN_IMAGE_CANCEL) goto wait;
 			break;
 
@@ -469,8 +465,7 @@ void on_open_recent_action_item_activated(GtkRecentChooser *chooser,
 		return;
 	}
 
-	open_single_image(path);
-	icc_auto_assign_or_convert(&gfit, ICC_ASSIGN_ON_LOAD);
+	open_single_image_async(path);
 
 	g_free(uri);
 	g_free(path);
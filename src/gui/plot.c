@@ -285,10 +285,83 @@ static void update_slider(enum slider_type slider_t, double valmin, double valma
 	drawPlot();
 }
 
+/* Index of the plotted points in cells of the picking distance, in
+ * coordinates normalized by the plotted range, so that hovering only compares
+ * the cursor to the points around it. Points outside the range are kept in
+ * the border cells */
+#define PICK_DISTANCE 0.02	// 2% of the scales
+#define PICK_CELLS 50		// 1 / PICK_DISTANCE
+
+struct pick_point {
+	double x, y, frame;
+	int order;
+};
+
+static struct {
+	gboolean valid;
+	point min, max;
+	int cell_start[PICK_CELLS * PICK_CELLS + 1];
+	struct pick_point *points;
+} pick_index = { 0 };
+
+static int pick_cell(double u) {
+	double c = floor(u / PICK_DISTANCE);
+	return (int) max(0.0, min((double) (PICK_CELLS - 1), c));
+}
+
+static void invalidate_pick_index() {
+	free(pick_index.points);
+	pick_index.points = NULL;
+	pick_index.valid = FALSE;
+}
+
+static gboolean update_pick_index(double invrangex, double invrangey) {
+	if (pick_index.valid && pick_index.min.x == pdd.pdatamin.x && pick_index.min.y == pdd.pdatamin.y &&
+			pick_index.max.x == pdd.pdatamax.x && pick_index.max.y == pdd.pdatamax.y)
+		return TRUE;
+	invalidate_pick_index();
+	int n = 0;
+	for (pldata *plot = plot_data; plot; plot = plot->next)
+		n += plot->nb;
+	int *cells = malloc(max(n, 1) * sizeof(int));
+	pick_index.points = malloc(max(n, 1) * sizeof(struct pick_point));
+	if (!cells || !pick_index.points) {
+		PRINT_ALLOC_ERR;
+		free(cells);
+		invalidate_pick_index();
+		return FALSE;
+	}
+	memset(pick_index.cell_start, 0, sizeof(pick_index.cell_start));
+	int k = 0;
+	for (pldata *plot = plot_data; plot; plot = plot->next) {
+		for (int j = 0; j < plot->nb; j++, k++) {
+			int cx = pick_cell((plot->data[j].x - pdd.pdatamin.x) * invrangex);
+			int cy = pick_cell((plot->data[j].y - pdd.pdatamin.y) * invrangey);
+			cells[k] = cy * PICK_CELLS + cx;
+			pick_index.cell_start[cells[k] + 1]++;
+		}
+	}
+	for (int c = 0; c < PICK_CELLS * PICK_CELLS; c++)
+		pick_index.cell_start[c + 1] += pick_index.cell_start[c];
+	int fill[PICK_CELLS * PICK_CELLS];
+	memcpy(fill, pick_index.cell_start, sizeof(fill));
+	k = 0;
+	for (pldata *plot = plot_data; plot; plot = plot->next) {
+		for (int j = 0; j < plot->nb; j++, k++) {
+			pick_index.points[fill[cells[k]]++] = (struct pick_point) {
+				plot->data[j].x, plot->data[j].y, plot->frame[j], k };
+		}
+	}
+	free(cells);
+	pick_index.min = pdd.pdatamin;
+	pick_index.max = pdd.pdatamax;
+	pick_index.valid = TRUE;
+	return TRUE;
+}
+
 static gboolean get_index_of_frame(double x, double y, gboolean check_index_incl, double *index, double *xpos, double *ypos) {
-	int closestframe = -1;
+	int closestframe = -1, closestorder = INT_MAX;
 	double mindist = DBL_MAX;
-	pldata *plot = plot_data;
 	convert_surface_to_plot_coords(x, y, xpos, ypos);
 	// double testx, testy;
 	// convert_plot_to_surface_coords(pdd.datamin.x, pdd.datamin.y, &testx, &testy);
@@ -297,17 +370,27 @@ static gboolean get_index_of_frame(double x, double y, gboolean check_index_incl
 	double invrangey = 1./(pdd.pdatamax.y - pdd.pdatamin.y);
 	*index = *xpos;
 
-	while (plot) {
-		for (int j = 0; j < plot->nb; j++) {
-			double dist = pow((*index - plot->data[j].x) * invrangex, 2) + pow((*ypos - plot->data[j].y) * invrangey, 2);
-			if (dist < mindist) {
-				mindist = dist;
-				closestframe = plot->frame[j];
+	if (plot_data && update_pick_index(invrangex, invrangey)) {
+		// the closest point in range can only be in the neighbouring cells
+		int cx = pick_cell((*index - pdd.pdatamin.x) * invrangex);
+		int cy = pick_cell((*ypos - pdd.pdatamin.y) * invrangey);
+		for (int j = max(0, cy - 1); j <= min(PICK_CELLS - 1, cy + 1); j++) {
+			for (int i = max(0, cx - 1); i <= min(PICK_CELLS - 1, cx + 1); i++) {
+				int c = j * PICK_CELLS + i;
+				for (int k = pick_index.cell_start[c]; k < pick_index.cell_start[c + 1]; k++) {
+					const struct pick_point *pt = &pick_index.points[k];
+					double dx = (*index - pt->x) * invrangex, dy = (*ypos - pt->y) * invrangey;
+					double dist = dx * dx + dy * dy;
+					if (dist < mindist || (dist == mindist && pt->order < closestorder)) {
+						mindist = dist;
+						closestframe = pt->frame;
+						closestorder = pt->order;
+					}
+				}
 			}
 		}
-		plot = plot->next;
 	}
-	*index = (mindist < 0.0004) ? closestframe : -1; // only set index if distance between cursor and a point is small enough (2% of scales)
+	*index = (mindist < PICK_DISTANCE * PICK_DISTANCE) ? closestframe : -1; // only set index if distance between cursor and a point is small enough (2% of scales)
 
 	if (check_index_incl && (*index >= 0 && *index <= pdd.pdatamax.x)) return com.seq.imgparam[(int)*index - 1].incl;
 	return TRUE;
@@ -987,6 +1070,7 @@ void free_plot_data() {
 	julian0 = 0;
 	xlabel = NULL;
 	plot_data = NULL;
+	invalidate_pick_index();
 	free(pdd.selected);
 	pdd.selected = NULL;
 }
@@ -1401,6 +1485,74 @@ void on_clearAllPhotometry_clicked(GtkButton *button, gpointer user_data) {
 	clear_all_photometry_and_plot();
 }
 
+/* Reduction of the plotted data to what can be seen at the size of the
+ * widget. A line sorted by x keeps the first, last, lowest and highest points
+ * of each pixel column, which draws the same line. A scatter plot keeps the
+ * first point of each pixel. NULL is returned when it is not worth it */
+#define DECIMATION_MIN_POINTS 2000
+
+static struct kpair *decimate_line(const struct kpair *data, int nb, int columns, int *nb_out) {
+	if (nb < DECIMATION_MIN_POINTS || nb <= 4 * columns || columns <= 0)
+		return NULL;
+	for (int i = 1; i < nb; i++)
+		if (data[i].x < data[i - 1].x)
+			return NULL;
+	struct kpair *out = malloc(4 * (columns + 2) * sizeof(struct kpair));
+	if (!out)
+		return NULL;
+	double scale = columns / (pdd.pdatamax.x - pdd.pdatamin.x);
+	int n = 0;
+	for (int i = 0; i < nb; ) {
+		// points out of the plotted range fall in the border columns
+		double c = floor((data[i].x - pdd.pdatamin.x) * scale);
+		int col = (int) max(-1.0, min((double) columns, c));
+		int first = i, imin = i, imax = i;
+		for (i++; i < nb; i++) {
+			double ci = floor((data[i].x - pdd.pdatamin.x) * scale);
+			if ((int) max(-1.0, min((double) columns, ci)) != col)
+				break;
+			if (data[i].y < data[imin].y) imin = i;
+			if (data[i].y > data[imax].y) imax = i;
+		}
+		int last = i - 1;
+		int keep[4] = { first, min(imin, imax), max(imin, imax), last };
+		for (int k = 0; k < 4; k++)
+			if (!k || keep[k] != keep[k - 1])
+				out[n++] = data[keep[k]];
+	}
+	*nb_out = n;
+	return out;
+}
+
+static struct kpair *decimate_points(const struct kpair *data, int nb, int width, int height, int *nb_out) {
+	if (nb < DECIMATION_MIN_POINTS || width <= 0 || height <= 0)
+		return NULL;
+	guint8 *drawn = calloc((size_t) width * height, 1);
+	struct kpair *out = malloc(nb * sizeof(struct kpair));
+	if (!drawn || !out) {
+		free(drawn);
+		free(out);
+		return NULL;
+	}
+	double sx = width / (pdd.pdatamax.x - pdd.pdatamin.x);
+	double sy = height / (pdd.pdatamax.y - pdd.pdatamin.y);
+	int n = 0;
+	for (int i = 0; i < nb; i++) {
+		double px = floor((data[i].x - pdd.pdatamin.x) * sx);
+		double py = floor((data[i].y - pdd.pdatamin.y) * sy);
+		if (px >= 0.0 && px < width && py >= 0.0 && py < height) {
+			size_t cell = (size_t) py * width + (size_t) px;
+			if (drawn[cell])
+				continue;
+			drawn[cell] = 1;
+		}
+		out[n++] = data[i];
+	}
+	free(drawn);
+	*nb_out = n;
+	return out;
+}
+
 void drawing_the_graph(GtkWidget *widget, cairo_t *cr) {
 	guint width, height;
 	struct kplotcfg cfgplot;
@@ -1447,15 +1599,30 @@ void drawing_the_graph(GtkWidget *widget, cairo_t *cr) {
 	double mean = 0.;
 	int min_data = 0, max_data = 0;
 
+	width =  gtk_widget_get_allocated_width(widget);
+	height = gtk_widget_get_allocated_height(widget);
+
 	while (plot) {
 		if (!use_mag_plot) {
 			d1 = kdata_array_alloc(plot->data, plot->nb);
+			struct kpair *reduced;
+			int nb_reduced = 0;
 			if (X_selected_source == r_FRAME) {
-				kplot_attach_data(p, d1,
+				reduced = decimate_line(plot->data, plot->nb, width, &nb_reduced);
+			} else {
+				reduced = decimate_points(plot->data, plot->nb, width, height, &nb_reduced);
+			}
+			struct kdata *drawn = reduced ? kdata_array_alloc(reduced, nb_reduced) : d1;
+			if (X_selected_source == r_FRAME) {
+				kplot_attach_data(p, drawn,
 						plot_data->nb <= 100 ? KPLOT_LINESPOINTS : KPLOT_LINES,
 						NULL);
 			} else {
-				kplot_attach_data(p, d1, KPLOT_POINTS, NULL);
+				kplot_attach_data(p, drawn, KPLOT_POINTS, NULL);
+			}
+			if (reduced) {
+				kdata_destroy(drawn);
+				free(reduced);
 			}
 			/* mean and min/max */
 			mean = kdata_ymean(d1);
@@ -1504,8 +1671,11 @@ void drawing_the_graph(GtkWidget *widget, cairo_t *cr) {
 				for (int i = 0; i < plot_data->nb; i++) {
 					sorted_data[i].x = imin + (double)i * pace;
 				}
-				d1 = kdata_array_alloc(sorted_data, plot_data->nb);
+				int nb_reduced = 0;
+				struct kpair *reduced = decimate_line(sorted_data, plot_data->nb, width, &nb_reduced);
+				d1 = reduced ? kdata_array_alloc(reduced, nb_reduced) : kdata_array_alloc(sorted_data, plot_data->nb);
 				kplot_attach_data(p, d1, KPLOT_LINES, NULL);
+				free(reduced);
 				free(sorted_data);
 				kdata_destroy(d1);
 			}
@@ -1534,8 +1704,6 @@ void drawing_the_graph(GtkWidget *widget, cairo_t *cr) {
 		}
 	}
 
-	width =  gtk_widget_get_allocated_width(widget);
-	height = gtk_widget_get_allocated_height(widget);
 	pdd.surf_w = (double)width;
 	pdd.surf_h = (double)height;
 
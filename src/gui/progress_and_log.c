@@ -28,6 +28,7 @@
 #include "gui/message_dialog.h"
 #include "core/proto.h"
 #include "core/pipe.h"
+#include "core/processing_tasks.h"
 #include "core/siril_log.h"
 #include "core/siril_date.h"
 #include "core/command.h"
@@ -81,6 +82,8 @@ static gboolean progress_bar_idle_callback(gpointer p) {
 // Thread-safe progress bar update.
 // text can be NULL, percent can be -1 for pulsating, -2 for nothing, or between 0 and 1 for percent
 void set_progress_bar_data(const char *text, double percent) {
+	/* the progress of concurrent processing tasks is displayed combined */
+	percent = processing_task_report_progress(percent);
 	if (com.headless) {
 		if (percent < 0.0) percent = 1.0;
 		if (text)
@@ -24,6 +24,7 @@
 #include "gui/utils.h"
 #include "gui/callbacks.h"
 #include "gui/progress_and_log.h"
+#include "gui/image_display.h"
 #include "gui/image_interactions.h"
 #include "gui/registration_preview.h"
 #include "gui/sequence_list.h"
@@ -142,6 +143,7 @@ void test_and_allocate_reference_image(int vport) {
 		/* this is the registration layer and the reference frame,
 		 * save the buffer for alignment preview */
 		struct image_view *view = &gui.view[vport];
+		complete_display_remap(vport);
 		if (!gui.refimage_regbuffer || !gui.refimage_surface) {
 			guchar *oldbuf = gui.refimage_regbuffer;
 			gui.refimage_regbuffer = realloc(gui.refimage_regbuffer,
@@ -212,6 +214,7 @@ void set_preview_area(int preview_area, int centerX, int centerY) {
 	com.seq.previewH[preview_area] = area_height;
 
 	struct image_view *view = &gui.view[gui.cvport];
+	complete_display_remap(gui.cvport);
 	if (cairo_format_stride_for_width(CAIRO_FORMAT_RGB24, gfit.rx) !=
 			view->full_surface_stride ||
 			gfit.ry != view->full_surface_height ||
@@ -44,12 +44,18 @@
 #include "core/siril_app_dirs.h"
 #include "core/siril_log.h"
 #include "filters/ght.h"
+#include "filters/point_ops.h"
 
 #include "gui/histogram.h"
 #include <gsl/gsl_histogram.h>
 
 // Invocation: 1 if called directly from starnet GUI,
 // 2 if called from Siril menu
+/* below this size, the full image is rendered directly */
+#define REMIX_PROXY_MIN_PIXELS (8 << 20)
+/* delay of the full resolution render after the last change, in ms */
+#define REMIX_FULL_RENDER_DELAY 500
+
 static int invocation = 0;
 
 static clip_mode_t clip_mode = RGBBLEND;
@@ -65,6 +71,11 @@ static fits fit_left;
 static fits fit_right;
 static fits fit_left_calc;
 static fits fit_right_calc;
+/* downscaled images used while the parameters change */
+static fits proxy_left, proxy_right, proxy_left_calc, proxy_right_calc, proxy_out;
+static int proxy_step = 0;	// 0 when the proxies are not built
+static gboolean full_render_pending = FALSE;
+static guint full_render_id = 0;
 
 static ght_params params_left, params_right, params_histo_left, params_histo_right;
 static ght_compute_params cp_histo_left = { 0.0f };
@@ -454,71 +465,51 @@ int imoper_scaled(fits *a, fits *b, image_operator oper, float factor) {
 	return 0;
 }
 
-int remixer() {
-	// Processing chain
-	// (applies to each side)
-	// * Apply GHT stretch according to chosen parameters
-	// * Apply linear stretch according to chosen blackpoint
-	// (combining)
-	// Combine in CIE LCh colorspace
-	// Renormalize to [0,1]
-
-	// Are we allowed to proceed?
-	if(!permit_calculation)
-		return 1;
-
-	params_left = (ght_params) { leftB, leftD, leftLP, leftSP, leftHP, leftBP, type_left, colour_left, TRUE, TRUE, TRUE, clip_mode };
-	params_right = (ght_params) { rightB, rightD, rightLP, rightSP, rightHP, rightBP, type_right, colour_right, TRUE, TRUE, TRUE, clip_mode };
-
-	// Process left image
-	if (left_loaded && (left_changed || leftBP_changed)) {
-		apply_linked_ght_to_fits(&fit_left, &fit_left_calc, &params_left, TRUE);
-	}
-		// Now do the linear BP shift, if needed. The only parameter that matters is BP so
-		// we just need to change the stretch type, no need to recompute params.
-	if (left_loaded && (leftBP_changed || (left_changed && leftBP != 0.0f))) {
-		params_left.stretchtype = STRETCH_LINEAR;
-		apply_linked_ght_to_fits(&fit_left_calc, &fit_left_calc, &params_left, TRUE);
-		leftBP_changed = FALSE;
-	}
-	left_changed = FALSE;
-
-	// Process right image
-	if (right_loaded && (right_changed || rightBP_changed)) {
-		apply_linked_ght_to_fits(&fit_right, &fit_right_calc, &params_right, TRUE);
-	}
-		// As above, BP shift if required.
-	if (right_loaded && (rightBP_changed || (right_changed && rightBP != 0.0f))) {
-		params_right.stretchtype = STRETCH_LINEAR;
-		apply_linked_ght_to_fits(&fit_right_calc, &fit_right_calc, &params_right, TRUE);
-		rightBP_changed = FALSE;
+/* GHT stretch followed by the linear BP shift, if needed. The only parameter
+ * that matters for the shift is BP so we just need to change the stretch type,
+ * no need to recompute params. When the stretch does not mix the channels both
+ * are composed and applied in a single pass */
+static void remixer_stretch(fits *from, fits *to, ght_params *params, gboolean bp_shift) {
+	ght_params linear = *params;
+	linear.stretchtype = STRETCH_LINEAR;
+	if (ght_is_point_op(from, params)) {
+		struct point_pipeline pipeline;
+		point_pipeline_init(&pipeline);
+		point_pipeline_add_ght(&pipeline, params);
+		if (bp_shift)
+			point_pipeline_add_ght(&pipeline, &linear);
+		point_pipeline_apply(&pipeline, from, to, TRUE);
+	} else {
+		apply_linked_ght_to_fits(from, to, params, TRUE);
+		if (bp_shift)
+			apply_linked_ght_to_fits(to, to, &linear, TRUE);
 	}
-	right_changed = FALSE;
-
-	// Combine images together
+}
 
-	const size_t ndata = gfit.naxes[0] * gfit.naxes[1] * gfit.naxes[2];
-	if (gfit.data)
-		memset(gfit.data, 0, ndata * sizeof(WORD));
-	if (gfit.fdata)
-		memset(gfit.fdata, 0, ndata * sizeof(float));
+/* blends the stretched images in out, which has their size and type */
+static void remix_blend(fits *left, fits *right, fits *out) {
+	const size_t ndata = out->naxes[0] * out->naxes[1] * out->naxes[2];
+	if (out->data)
+		memset(out->data, 0, ndata * sizeof(WORD));
+	if (out->fdata)
+		memset(out->fdata, 0, ndata * sizeof(float));
 
-	size_t npixels = gfit.naxes[0] * gfit.naxes[1];
+	size_t npixels = out->naxes[0] * out->naxes[1];
 	const float norm = USHRT_MAX_SINGLE;
 	const float invnorm = 1.f / norm;
-	if (gfit.naxes[2] == 1) {
-		switch (gfit.type) {
+	if (out->naxes[2] == 1) {
+		switch (out->type) {
 			case DATA_FLOAT:
-				if (gfit.fdata) {
+				if (out->fdata) {
 					for (size_t i = 0 ; i < npixels ; i++) {
-						gfit.fdata[i] = fit_left_calc.fdata[i] + fit_right_calc.fdata[i] - fit_left_calc.fdata[i] * fit_right_calc.fdata[i];
+						out->fdata[i] = left->fdata[i] + right->fdata[i] - left->fdata[i] * right->fdata[i];
 					}
 				}
 				break;
 			case DATA_USHORT:
-				if (gfit.data) {
+				if (out->data) {
 					for (size_t i = 0 ; i < npixels ; i++) {
-						gfit.data[i] = roundf_to_WORD(norm * (1.f - (1.f - (fit_left_calc.data[i]*invnorm))*(1.f - (fit_right_calc.data[i]*invnorm))));
+						out->data[i] = roundf_to_WORD(norm * (1.f - (1.f - (left->data[i]*invnorm))*(1.f - (right->data[i]*invnorm))));
 					}
 				}
 				break;
@@ -526,12 +517,12 @@ int remixer() {
 				break;
 		}
 	} else {
-		switch (gfit.type) {
+		switch (out->type) {
 			case DATA_FLOAT:
 				if (left_loaded && !right_loaded) {
-					memcpy(gfit.fdata, fit_left_calc.fdata, npixels * 3 * sizeof(float));
+					memcpy(out->fdata, left->fdata, npixels * 3 * sizeof(float));
 				} else if (right_loaded && !left_loaded) {
-					memcpy(gfit.fdata, fit_right_calc.fdata, npixels * 3 * sizeof(float));
+					memcpy(out->fdata, right->fdata, npixels * 3 * sizeof(float));
 				} else {
 #ifdef _OPENMP
 #pragma omp parallel for num_threads(com.max_thread) schedule(static)
@@ -540,18 +531,18 @@ int remixer() {
 						float rinl, ginl, binl, rinr, ginr, binr, xl, yl, zl, xr, yr, zr;
 						float Ll, Al, Bl, Lr, Ar, Br, xo, yo, zo, rout, gout, bout;
 						if (left_loaded) {
-							rinl = fit_left_calc.fpdata[0][i];
-							ginl = fit_left_calc.fpdata[1][i];
-							binl = fit_left_calc.fpdata[2][i];
+							rinl = left->fpdata[0][i];
+							ginl = left->fpdata[1][i];
+							binl = left->fpdata[2][i];
 						} else {
 							rinl = 0.f;
 							ginl = 0.f;
 							binl = 0.f;
 						}
 						if (right_loaded) {
-							rinr = fit_right_calc.fpdata[0][i];
-							ginr = fit_right_calc.fpdata[1][i];
-							binr = fit_right_calc.fpdata[2][i];
+							rinr = right->fpdata[0][i];
+							ginr = right->fpdata[1][i];
+							binr = right->fpdata[2][i];
 						} else {
 							rinr = 0.f;
 							ginr = 0.f;
@@ -567,17 +558,17 @@ int remixer() {
 						float Lo = Ll + Lr - Ll * Lr * 0.01f;
 						LAB_to_xyzf(Lo, ao, bo, &xo, &yo, &zo);
 						xyz_to_linrgbf(xo, yo, zo, &rout, &gout, &bout, TRUE);
-						gfit.fpdata[0][i] = rout;
-						gfit.fpdata[1][i] = gout;
-						gfit.fpdata[2][i] = bout;
+						out->fpdata[0][i] = rout;
+						out->fpdata[1][i] = gout;
+						out->fpdata[2][i] = bout;
 					}
 				}
 				break;
 			case DATA_USHORT:
 				if (left_loaded && !right_loaded) {
-					memcpy(gfit.data, fit_left_calc.data, npixels * 3 * sizeof(WORD));
+					memcpy(out->data, left->data, npixels * 3 * sizeof(WORD));
 				} else if (right_loaded && !left_loaded) {
-					memcpy(gfit.data, fit_right_calc.data, npixels * 3 * sizeof(WORD));
+					memcpy(out->data, right->data, npixels * 3 * sizeof(WORD));
 				} else {
 #ifdef _OPENMP
 #pragma omp parallel for num_threads(com.max_thread) schedule(static)
@@ -586,18 +577,18 @@ int remixer() {
 						float rinl, ginl, binl, rinr, ginr, binr, xl, yl, zl, xr, yr, zr;
 						float Ll, Al, Bl, Lr, Ar, Br, xo, yo, zo, rout, gout, bout;
 						if (left_loaded) {
-							rinl = fit_left_calc.pdata[0][i] * invnorm;
-							ginl = fit_left_calc.pdata[1][i] * invnorm;
-							binl = fit_left_calc.pdata[2][i] * invnorm;
+							rinl = left->pdata[0][i] * invnorm;
+							ginl = left->pdata[1][i] * invnorm;
+							binl = left->pdata[2][i] * invnorm;
 						} else {
 							rinl = 0.f;
 							ginl = 0.f;
 							binl = 0.f;
 						}
 						if (right_loaded) {
-							rinr = fit_right_calc.pdata[0][i] * invnorm;
-							ginr = fit_right_calc.pdata[1][i] * invnorm;
-							binr = fit_right_calc.pdata[2][i] * invnorm;
+							rinr = right->pdata[0][i] * invnorm;
+							ginr = right->pdata[1][i] * invnorm;
+							binr = right->pdata[2][i] * invnorm;
 						} else {
 							rinr = 0.f;
 							ginr = 0.f;
@@ -613,9 +604,9 @@ int remixer() {
 						float Lo = Ll + Lr - Ll * Lr * 0.01f;
 						LAB_to_xyzf(Lo, ao, bo, &xo, &yo, &zo);
 						xyz_to_linrgbf(xo, yo, zo, &rout, &gout, &bout, TRUE);
-						gfit.pdata[0][i] = roundf_to_WORD(rout * norm);
-						gfit.pdata[1][i] = roundf_to_WORD(gout * norm);
-						gfit.pdata[2][i] = roundf_to_WORD(bout * norm);
+						out->pdata[0][i] = roundf_to_WORD(rout * norm);
+						out->pdata[1][i] = roundf_to_WORD(gout * norm);
+						out->pdata[2][i] = roundf_to_WORD(bout * norm);
 					}
 				}
 				break;
@@ -623,11 +614,206 @@ int remixer() {
 				break;
 		}
 	}
+}
+
+/* box average of step x step pixels of from in to, which is allocated */
+static int downsample_remix_image(fits *from, fits *to, int step) {
+	const int rx = (from->rx + step - 1) / step;
+	const int ry = (from->ry + step - 1) / step;
+	const int nch = (int) from->naxes[2];
+	if (new_fit_image(&to, rx, ry, nch, from->type))
+		return 1;
+	for (int c = 0; c < nch; c++) {
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(com.max_thread) schedule(static)
+#endif
+		for (int y = 0; y < ry; y++) {
+			int y1 = min((y + 1) * step, (int) from->ry);
+			for (int x = 0; x < rx; x++) {
+				int x1 = min((x + 1) * step, (int) from->rx);
+				double sum = 0.0;
+				for (int yy = y * step; yy < y1; yy++) {
+					size_t index = (size_t) yy * from->rx;
+					for (int xx = x * step; xx < x1; xx++)
+						sum += from->type == DATA_FLOAT ? from->fpdata[c][index + xx] : from->pdata[c][index + xx];
+				}
+				sum /= (double) (y1 - y * step) * (x1 - x * step);
+				size_t dst = (size_t) y * rx + x;
+				if (from->type == DATA_FLOAT)
+					to->fpdata[c][dst] = (float) sum;
+				else to->pdata[c][dst] = round_to_WORD(sum);
+			}
+		}
+	}
+	return 0;
+}
+
+/* nearest neighbour upscaling of the proxy result to the full image */
+static void expand_remix_proxy(fits *proxy, fits *to, int step) {
+	const size_t elem = proxy->type == DATA_FLOAT ? sizeof(float) : sizeof(WORD);
+	for (int c = 0; c < (int) to->naxes[2]; c++) {
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(com.max_thread) schedule(static)
+#endif
+		for (int y = 0; y < (int) to->ry; y++) {
+			size_t src = (size_t) (y / step) * proxy->rx;
+			size_t dst = (size_t) y * to->rx;
+			if (y % step) {
+				// same proxy row as the row above
+				char *plane = to->type == DATA_FLOAT ? (char *) to->fpdata[c] : (char *) to->pdata[c];
+				memcpy(plane + dst * elem, plane + (dst - to->rx) * elem, to->rx * elem);
+				continue;
+			}
+			if (to->type == DATA_FLOAT) {
+				for (int x = 0; x < (int) to->rx; x++)
+					to->fpdata[c][dst + x] = proxy->fpdata[c][src + x / step];
+			} else {
+				for (int x = 0; x < (int) to->rx; x++)
+					to->pdata[c][dst + x] = proxy->pdata[c][src + x / step];
+			}
+		}
+	}
+}
+
+static void clear_remix_proxies() {
+	clearfits(&proxy_left);
+	clearfits(&proxy_right);
+	clearfits(&proxy_left_calc);
+	clearfits(&proxy_right_calc);
+	clearfits(&proxy_out);
+	proxy_step = 0;
+}
+
+/* the proxy is used during the interaction when the image is displayed
+ * downscaled, its pixels have about the size of the screen pixels */
+static int get_remix_proxy_step() {
+	if ((size_t) gfit.rx * gfit.ry < REMIX_PROXY_MIN_PIXELS)
+		return 1;
+	double zoom = get_zoom_val();
+	if (zoom <= 0.0 || zoom > 0.5)
+		return 1;
+	return (int) (1.0 / zoom);
+}
+
+static int build_remix_proxy_side(gboolean loaded, fits *fit, fits *calc, fits *proxy, fits *proxy_calc, int step) {
+	if (loaded) {
+		if (downsample_remix_image(fit, proxy, step))
+			return 1;
+		return copyfits(proxy, proxy_calc, (CP_ALLOC | CP_INIT | CP_FORMAT), 0);
+	}
+	// the unloaded side is blended from its initialised calc image
+	return downsample_remix_image(calc, proxy_calc, step);
+}
+
+static int build_remix_proxies(int step) {
+	clear_remix_proxies();
+	if (fit_left_calc.type != gfit.type || fit_right_calc.type != gfit.type ||
+			build_remix_proxy_side(left_loaded, &fit_left, &fit_left_calc, &proxy_left, &proxy_left_calc, step) ||
+			build_remix_proxy_side(right_loaded, &fit_right, &fit_right_calc, &proxy_right, &proxy_right_calc, step) ||
+			copyfits(&proxy_left_calc, &proxy_out, (CP_ALLOC | CP_INIT | CP_FORMAT), 0)) {
+		clear_remix_proxies();
+		return 1;
+	}
+	proxy_step = step;
+	siril_debug_print("remixer proxy: %u x %u\n", proxy_out.rx, proxy_out.ry);
+	return 0;
+}
+
+/* stretches and blends the proxies, the changed flags are kept for the full
+ * resolution render */
+static int remix_render_proxy(int step) {
+	if (proxy_step != step && build_remix_proxies(step))
+		return 1;
+	if (left_loaded)
+		remixer_stretch(&proxy_left, &proxy_left_calc, &params_left, leftBP != 0.0f);
+	if (right_loaded)
+		remixer_stretch(&proxy_right, &proxy_right_calc, &params_right, rightBP != 0.0f);
+	remix_blend(&proxy_left_calc, &proxy_right_calc, &proxy_out);
+	expand_remix_proxy(&proxy_out, &gfit, step);
+	full_render_pending = TRUE;
+	return 0;
+}
+
+static void remix_render_full() {
+	if (full_render_id) {
+		g_source_remove(full_render_id);
+		full_render_id = 0;
+	}
+	// Process left image
+	if (left_loaded && (left_changed || leftBP_changed)) {
+		remixer_stretch(&fit_left, &fit_left_calc, &params_left, leftBP != 0.0f);
+		leftBP_changed = FALSE;
+	}
+	left_changed = FALSE;
+
+	// Process right image
+	if (right_loaded && (right_changed || rightBP_changed)) {
+		remixer_stretch(&fit_right, &fit_right_calc, &params_right, rightBP != 0.0f);
+		rightBP_changed = FALSE;
+	}
+	right_changed = FALSE;
+
+	// Combine images together
+	remix_blend(&fit_left_calc, &fit_right_calc, &gfit);
+	full_render_pending = FALSE;
+}
+
+static void remix_finish() {
 	// If 16bit preference is set, check the images are 16bit
 	if (com.pref.force_16bit && gfit.type == DATA_FLOAT)
-		fit_replace_buffer(&gfit, float_buffer_to_ushort(gfit.fdata, ndata), DATA_USHORT);
+		fit_replace_buffer(&gfit, float_buffer_to_ushort(gfit.fdata, gfit.naxes[0] * gfit.naxes[1] * gfit.naxes[2]), DATA_USHORT);
 
 	notify_gfit_modified();
+}
+
+static gboolean remix_full_render_idle(gpointer user_data) {
+	full_render_id = 0;
+	if (permit_calculation && full_render_pending) {
+		set_cursor_waiting(TRUE);
+		remix_render_full();
+		remix_finish();
+		set_cursor_waiting(FALSE);
+	}
+	return FALSE;
+}
+
+/* renders the full resolution image if only the proxy was rendered, needed
+ * before the result or the stretched images are used */
+static void remix_ensure_full_render() {
+	if (permit_calculation && full_render_pending) {
+		remix_render_full();
+		remix_finish();
+	}
+}
+
+int remixer() {
+	// Processing chain
+	// (applies to each side)
+	// * Apply GHT stretch according to chosen parameters
+	// * Apply linear stretch according to chosen blackpoint
+	// (combining)
+	// Combine in CIE LCh colorspace
+	// Renormalize to [0,1]
+	// While the parameters are changed on a large image displayed downscaled,
+	// the chain is run on a proxy and the full image is rendered when the
+	// parameters stop changing.
+
+	// Are we allowed to proceed?
+	if(!permit_calculation)
+		return 1;
+
+	params_left = (ght_params) { leftB, leftD, leftLP, leftSP, leftHP, leftBP, type_left, colour_left, TRUE, TRUE, TRUE, clip_mode };
+	params_right = (ght_params) { rightB, rightD, rightLP, rightSP, rightHP, rightBP, type_right, colour_right, TRUE, TRUE, TRUE, clip_mode };
+
+	int step = get_remix_proxy_step();
+	if (step > 1 && !remix_render_proxy(step)) {
+		if (full_render_id)
+			g_source_remove(full_render_id);
+		full_render_id = g_timeout_add(REMIX_FULL_RENDER_DELAY, remix_full_render_idle, NULL);
+	} else {
+		remix_render_full();
+	}
+	remix_finish();
 
 	return 0;
 }
@@ -707,6 +893,12 @@ void reset_controls_and_values() {
 }
 
 static void remixer_close() {
+	if (full_render_id) {
+		g_source_remove(full_render_id);
+		full_render_id = 0;
+	}
+	full_render_pending = FALSE;
+	clear_remix_proxies();
 	close_histograms(TRUE, TRUE);
 	invalidate_stats_from_fit(&gfit);
 	clearfits(&fit_left);
@@ -836,6 +1028,7 @@ int toggle_remixer_window_visibility(int _invocation, fits* _fit_left, fits* _fi
 }
 
 void on_remix_close_clicked(GtkButton *button, gpointer user_data) {
+	remix_ensure_full_render();
 	close_histograms(TRUE, TRUE);
 	remixer_close();
 	set_cursor_waiting(FALSE);
@@ -858,6 +1051,7 @@ void on_remix_reset_right_clicked(GtkButton *button, gpointer user_data) {
 }
 
 void on_remix_apply_left_clicked(GtkButton *button, gpointer user_data) {
+	remix_ensure_full_render();
 	switch (fit_left.type) {
 		case DATA_FLOAT:
 			memcpy(fit_left.fdata, fit_left_calc.fdata, fit_left.rx * fit_left.ry * fit_left.naxes[2] * sizeof(float));
@@ -868,6 +1062,7 @@ void on_remix_apply_left_clicked(GtkButton *button, gpointer user_data) {
 		default:
 			break;
 	}
+	clear_remix_proxies();
 	reset_left();
 	close_histograms(TRUE, FALSE);
 	remix_histo_startup_left();
@@ -879,6 +1074,7 @@ void on_remix_apply_left_clicked(GtkButton *button, gpointer user_data) {
 }
 
 void on_remix_apply_right_clicked(GtkButton *button, gpointer user_data) {
+	remix_ensure_full_render();
 	switch (fit_right.type) {
 		case DATA_FLOAT:
 			memcpy(fit_right.fdata, fit_right_calc.fdata, fit_right.rx * fit_right.ry * fit_right.naxes[2] * sizeof(float));
@@ -889,6 +1085,7 @@ void on_remix_apply_right_clicked(GtkButton *button, gpointer user_data) {
 		default:
 			break;
 	}
+	clear_remix_proxies();
 	reset_right();
 	close_histograms(FALSE, TRUE);
 	remix_histo_startup_right();
@@ -1124,6 +1321,7 @@ void on_remix_filechooser_left_file_set(GtkFileChooser *filechooser, gpointer us
 		clearfits(&fit_left_calc);
 		left_loaded = FALSE;
 	}
+	clear_remix_proxies();
 	filename_left = siril_file_chooser_get_filename(filechooser);
 	if (readfits(filename_left, &fit_left, NULL, FALSE)) {
 		siril_message_dialog( GTK_MESSAGE_ERROR, _("Error: image could not be loaded"),
@@ -1213,6 +1411,7 @@ void on_remix_filechooser_right_file_set(GtkFileChooser *filechooser, gpointer u
 		clearfits(&fit_right_calc);
 		right_loaded = FALSE;
 	}
+	clear_remix_proxies();
 	filename_right = siril_file_chooser_get_filename(filechooser);
 	if (readfits(filename_right, &fit_right, NULL, FALSE)) {
 		siril_message_dialog( GTK_MESSAGE_ERROR, _("Error: image could not be loaded"),
@@ -559,7 +559,7 @@ static long calculate_jpeg_size(struct savedial_data *args) {
 		}
 	}
 	// Save JPEG to temporary file
-	if (savejpg(tmp_filename, &gfit, args->quality, FALSE)) {
+	if (savejpg(tmp_filename, &gfit, args->quality, FALSE, com.max_thread)) {
 		siril_debug_print("Failed to save JPEG to temporary file");
 		g_free(tmp_filename);
 		return -1;
@@ -610,12 +610,12 @@ static gpointer mini_save_dialog(gpointer p) {
 			break;
 #ifdef HAVE_LIBJPEG
 		case TYPEJPG:;
-			args->retval = savejpg(args->filename, &gfit, args->quality, TRUE);
+			args->retval = savejpg(args->filename, &gfit, args->quality, TRUE, com.max_thread);
 			break;
 #endif
 #ifdef HAVE_LIBJXL
 		case TYPEJXL:
-			args->retval = savejxl(args->filename, &gfit, args->jxl_effort, args->jxl_quality, args->jxl_force_8bit);
+			args->retval = savejxl(args->filename, &gfit, args->jxl_effort, args->jxl_quality, args->jxl_force_8bit, com.max_thread);
 			break;
 #endif
 #ifdef HAVE_LIBTIFF
@@ -626,7 +626,7 @@ static gpointer mini_save_dialog(gpointer p) {
 #ifdef HAVE_LIBPNG
 		case TYPEPNG:
 			bytes_per_sample = gfit.orig_bitpix != BYTE_IMG ? 2 : 1;
-			args->retval = savepng(args->filename, &gfit, bytes_per_sample, gfit.naxes[2] == 3);
+			args->retval = savepng(args->filename, &gfit, bytes_per_sample, gfit.naxes[2] == 3, com.max_thread);
 			break;
 #endif
 		default:
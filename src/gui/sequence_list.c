@@ -410,6 +410,28 @@ static void sequence_setselect_all(gboolean include_all) {
 
 /**** Callbacks *****/
 
+/* Frames selected in the list are loaded from an idle callback, which has a
+ * lower priority than the input events: when the user scrolls through the
+ * list with the keyboard, only the last selected frame is read */
+static guint load_frame_idle_id = 0;
+static int frame_to_load = -1;
+
+static gboolean load_selected_frame_idle(gpointer user_data) {
+	load_frame_idle_id = 0;
+	int idx = frame_to_load;
+	frame_to_load = -1;
+	if (!sequence_is_loaded() || idx < 0 || idx >= com.seq.number)
+		return FALSE;
+	if (idx != com.seq.current) {
+		fprintf(stdout, "loading image %d\n", idx);
+		if (seq_load_image(&com.seq, idx, TRUE)) // if loading fails, we fall back reloading the reference image
+			seq_load_image(&com.seq, com.seq.reference_image, TRUE);
+	}
+	display_status();
+	update_reg_interface(TRUE);
+	return FALSE;
+}
+
 void on_treeview1_cursor_changed(GtkTreeView *tree_view, gpointer user_data) {
 	GtkTreeModel *tree_model;
 	GtkTreeSelection *selection;
@@ -427,14 +449,16 @@ void on_treeview1_cursor_changed(GtkTreeView *tree_view, gpointer user_data) {
 
 		gtk_tree_model_get_value(tree_model, &iter, COLUMN_INDEX, &value);
 		idx = g_value_get_int(&value) - 1;
-		if (idx != com.seq.current) {
-			fprintf(stdout, "loading image %d\n", idx);
-			if (seq_load_image(&com.seq, idx, TRUE)) // if loading fails, we fall back reloading the reference image
-				seq_load_image(&com.seq, com.seq.reference_image, TRUE);
+		if (idx != com.seq.current || load_frame_idle_id) {
+			frame_to_load = idx;
+			if (!load_frame_idle_id)
+				load_frame_idle_id = g_idle_add(load_selected_frame_idle, NULL);
 		}
 		g_value_unset(&value);
 	}
 	g_list_free_full(list, (GDestroyNotify) gtk_tree_path_free);
+	if (load_frame_idle_id)
+		return;
 	display_status();
 	update_reg_interface(TRUE);
 }
@@ -851,6 +875,10 @@ void sequence_list_select_row_from_index(int index, gboolean do_load_image) {
 	gtk_tree_path_free(path);
 
 	if (do_load_image) {
+		if (load_frame_idle_id) {
+			g_source_remove(load_frame_idle_id);
+			load_frame_idle_id = 0;
+		}
 		if (seq_load_image(&com.seq, index, TRUE)) // if loading fails, we fall back reloading the reference image
 			seq_load_image(&com.seq, com.seq.reference_image, TRUE);
 		update_reg_interface(FALSE);
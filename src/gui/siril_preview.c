@@ -36,31 +36,97 @@
 
 
 #define PREVIEW_DELAY 200
+/* below this size the whole image is always previewed directly */
+#define PREVIEW_VIEWPORT_MIN_PIXELS (8 << 20)
 
 static guint timer_id = 0;
+static guint refine_id = 0;
 static gboolean notify_is_blocked;
 static gboolean preview_is_active;
 static cmsHPROFILE preview_icc_backup = NULL;
 static fits preview_roi_backup;
 static fits preview_gfit_backup = { 0 };
 
-static gboolean update_preview(gpointer user_data) {
-	lock_roi_mutex();
-	if (notify_is_blocked)
+/* On large images, the preview of an operation that supports ROI is first
+ * computed on the part of the image visible in the viewport, through a
+ * temporary ROI of the displayed area. The whole image is processed later,
+ * if the parameters did not change in the meantime */
+static gboolean start_viewport_preview() {
+	if (com.script || gui.roi.active || !gui.roi.operation_supports_roi || !preview_is_active)
 		return FALSE;
-	update_image *im = (update_image*) user_data;
+	size_t npixels = (size_t) gfit.rx * gfit.ry;
+	rectangle area;
+	if (npixels < PREVIEW_VIEWPORT_MIN_PIXELS || !get_visible_image_area(gui.cvport, &area))
+		return FALSE;
+	// not worth it if most of the image is visible
+	if ((size_t) area.w * area.h * 2 > npixels)
+		return FALSE;
+	if (copy_backup_to_gfit())
+		return FALSE;
+	gui.roi.selection = area;
+	if (populate_roi()) {
+		clearfits(&gui.roi.fit);
+		memset(&gui.roi.selection, 0, sizeof(rectangle));
+		gui.roi.active = FALSE;
+		return FALSE;
+	}
+	siril_debug_print("preview on the visible area %dx%d+%d+%d\n", area.w, area.h, area.x, area.y);
+	return TRUE;
+}
+
+static void end_viewport_preview() {
+	copy_roi_into_gfit();
+	clearfits(&gui.roi.fit);
+	clearfits(&preview_roi_backup);
+	memset(&gui.roi.selection, 0, sizeof(rectangle));
+	gui.roi.active = FALSE;
+}
 
+static void run_preview(update_image *im, gboolean viewport_first);
+
+static gboolean refine_preview(gpointer user_data) {
+	run_preview((update_image*) user_data, FALSE);
+	return FALSE;
+}
+
+static void free_refine(gpointer user_data) {
+	refine_id = 0;
+	free(user_data);
+}
+
+static void run_preview(update_image *im, gboolean viewport_first) {
+	lock_roi_mutex();
+	if (notify_is_blocked) {
+		unlock_roi_mutex();
+		return;
+	}
+	gboolean viewport = FALSE;
 	if (im->show_preview) {
 		siril_debug_print("update preview\n");
 		set_cursor_waiting(TRUE);
+		viewport = viewport_first && start_viewport_preview();
 		im->update_preview_fn();
 	}
 
 	waiting_for_thread(); // in case function is run in another thread
+	if (viewport) {
+		end_viewport_preview();
+		update_image *refine = malloc(sizeof(update_image));
+		if (refine) {
+			*refine = *im;
+			refine_id = g_timeout_add_full(G_PRIORITY_DEFAULT_IDLE,
+					PREVIEW_DELAY, (GSourceFunc) refine_preview, refine,
+					(GDestroyNotify) free_refine);
+		}
+	}
 	set_progress_bar_data(NULL, PROGRESS_DONE);
 	set_cursor_waiting(FALSE);
 	// Don't notify_gfit_modified() here, it must be done by the callers
 	unlock_roi_mutex();
+}
+
+static gboolean update_preview(gpointer user_data) {
+	run_preview((update_image*) user_data, TRUE);
 	return FALSE;
 }
 
@@ -152,6 +218,9 @@ gboolean is_preview_active() {
 }
 
 void clear_backup() {
+	// the whole image preview has no reference anymore
+	if (refine_id != 0)
+		g_source_remove(refine_id);
 	clearfits(&preview_gfit_backup);
 	preview_is_active = FALSE;
 }
@@ -165,6 +234,10 @@ void cancel_pending_update() {
         g_source_remove(timer_id);
         timer_id = 0;
     }
+    if (refine_id != 0) {
+        g_source_remove(refine_id);
+        refine_id = 0;
+    }
 }
 
 void siril_preview_hide() {
@@ -177,6 +250,9 @@ void notify_update(gpointer user_data) {
 	if (timer_id != 0) {
 		g_source_remove(timer_id);
 	}
+	if (refine_id != 0) {
+		g_source_remove(refine_id);
+	}
 	timer_id = g_timeout_add_full(G_PRIORITY_DEFAULT_IDLE,
 			PREVIEW_DELAY, (GSourceFunc) update_preview, user_data,
 			(GDestroyNotify) free_struct);
@@ -25,8 +25,22 @@
 #else
 #include <string.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+#ifdef __linux__
+#include <sys/ioctl.h>
+#include <linux/fs.h>
+#ifndef FICLONE
+#define FICLONE _IOW(0x94, 9, int)
+#endif
+#endif
+#ifdef __APPLE__
+#include <sys/clonefile.h>
 #endif
 #include <stdio.h>
+#include <gio/gio.h>
+#include <glib/gstdio.h>
 
 #ifndef S_ISLNK
 #define S_ISLNK(x) 0
@@ -76,7 +90,7 @@ gboolean test_if_symlink_is_ok(gboolean verbose) {
 	if (cr != 1 ) {
 		if (verbose)
 			siril_log_color_message(_("You should enable the Developer Mode in order to create symbolic "
-						"links instead of simply copying files.\n"), "salmon");
+						"links instead of hard links or copies of the files.\n"), "salmon");
 		return FALSE;
 	}
 	return TRUE;
@@ -85,6 +99,80 @@ gboolean test_if_symlink_is_ok(gboolean verbose) {
 #endif
 }
 
+/* Copy-on-write clone of a file, the data being shared until one of the files
+ * is modified, on file systems supporting it (Btrfs, XFS, APFS...) */
+static int reflink_file(const gchar *src_filename, const gchar *dest_filename) {
+#if defined(__linux__)
+	int in = g_open(src_filename, O_RDONLY, 0);
+	if (in < 0)
+		return 1;
+	int out = g_open(dest_filename, O_WRONLY | O_CREAT | O_EXCL, 0644);
+	if (out < 0) {
+		close(in);
+		return 1;
+	}
+	int retval = ioctl(out, FICLONE, in) ? 1 : 0;
+	close(out);
+	close(in);
+	if (retval)
+		g_unlink(dest_filename);
+	return retval;
+#elif defined(__APPLE__)
+	return clonefile(src_filename, dest_filename, 0) ? 1 : 0;
+#else
+	return 1;
+#endif
+}
+
+static int hardlink_file(const gchar *src_filename, const gchar *dest_filename) {
+#ifdef _WIN32
+	wchar_t *wsrc = g_utf8_to_utf16(src_filename, -1, NULL, NULL, NULL);
+	wchar_t *wdst = g_utf8_to_utf16(dest_filename, -1, NULL, NULL, NULL);
+	int retval = CreateHardLinkW(wdst, wsrc, NULL) ? 0 : 1;
+	g_free(wsrc);
+	g_free(wdst);
+	return retval;
+#else
+	return link(src_filename, dest_filename) ? 1 : 0;
+#endif
+}
+
+static int copy_whole_file(const gchar *src_filename, const gchar *dest_filename) {
+	GFile *src = g_file_new_for_path(src_filename);
+	GFile *dest = g_file_new_for_path(dest_filename);
+	GError *error = NULL;
+	int retval = 0;
+	if (!g_file_copy(src, dest, G_FILE_COPY_OVERWRITE, NULL, NULL, NULL, &error)) {
+		siril_log_color_message(_("Could not copy %s: %s\n"), "red", src_filename, error->message);
+		g_clear_error(&error);
+		retval = 1;
+	}
+	g_object_unref(src);
+	g_object_unref(dest);
+	return retval;
+}
+
+/* Gives dest_filename the content of src_filename without duplicating its
+ * data when possible: with a copy-on-write clone, or with a hard link if
+ * allow_link is set, the files then being the same as with a symbolic link.
+ * The file is copied otherwise. dest_filename must not exist. */
+int share_file_data(const gchar *src_filename, const gchar *dest_filename, gboolean allow_link) {
+	static gboolean warned = FALSE;
+	if (!reflink_file(src_filename, dest_filename)) {
+		siril_debug_print("cloned %s to %s\n", src_filename, dest_filename);
+		return 0;
+	}
+	if (allow_link && !hardlink_file(src_filename, dest_filename)) {
+		siril_debug_print("hard linked %s to %s\n", src_filename, dest_filename);
+		return 0;
+	}
+	if (!warned) {
+		siril_log_color_message(_("Files could not be cloned or linked on this file system, copying them\n"), "salmon");
+		warned = TRUE;
+	}
+	return copy_whole_file(src_filename, dest_filename);
+}
+
 int symlink_uniq_file(gchar *src_filename, gchar *dest_filename, gboolean allow_symlink) {
 	int retval = 0;
 
@@ -102,14 +190,14 @@ int symlink_uniq_file(gchar *src_filename, gchar *dest_filename, gboolean allow_
 		wsrc = g_utf8_to_utf16(src_filename, -1, NULL, NULL, NULL);
 		wdst = g_utf8_to_utf16(dest_filename, -1, NULL, NULL, NULL);
 
-		if (CreateSymbolicLinkW(wdst, wsrc, SYMBOLIC_LINK_FLAG_ALLOW_UNPRIVILEGED_CREATE) == 0) {
-			retval = copy_fits_from_file(src_filename, dest_filename);
-		}
+		gboolean linked = CreateSymbolicLinkW(wdst, wsrc, SYMBOLIC_LINK_FLAG_ALLOW_UNPRIVILEGED_CREATE) != 0;
 
 		g_free(wsrc);
 		g_free(wdst);
+		if (!linked)
+			retval = share_file_data(src_filename, dest_filename, TRUE);
 	} else {
-		retval = copy_fits_from_file(src_filename, dest_filename);
+		retval = share_file_data(src_filename, dest_filename, FALSE);
 	}
 #else
 	static gboolean warned = FALSE;
@@ -118,10 +206,10 @@ int symlink_uniq_file(gchar *src_filename, gchar *dest_filename, gboolean allow_
 		char err[150];
 		strerror_r(errno, err, 150);
 		if (!warned) {
-			siril_log_color_message(_("Symbolic link could not be made, copying the file. Error: %s\n"), "salmon", err);
+			siril_log_color_message(_("Symbolic link could not be made, sharing or copying the file. Error: %s\n"), "salmon", err);
 			warned = TRUE;
 		}
-		retval = copy_fits_from_file(src_filename, dest_filename);
+		retval = share_file_data(src_filename, dest_filename, allow_symlink);
 	}
 #endif
 	return retval;
@@ -29,6 +29,7 @@
 gboolean test_if_symlink_is_ok(gboolean verbose);
 gpointer symlink_thread_worker(gpointer p);
 int symlink_uniq_file(gchar *src_filename, gchar *dest_filename, gboolean allow_symlink);
+int share_file_data(const gchar *src_filename, const gchar *dest_filename, gboolean allow_link);
 
 #ifdef _WIN32
 DWORD read_registre_value(LPTSTR lpKeyName, LPTSTR lpPolicyPath);
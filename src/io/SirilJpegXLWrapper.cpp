@@ -211,9 +211,11 @@ bool DecodeJpegXlOneShot(const uint8_t* jxl, size_t size,
  * Compresses the provided pixels.
  *
  * @param pixels input pixels
+ * @param pixels_size size of the input pixels in bytes
  * @param xsize width of the input image
  * @param ysize height of the input image
  * @param compressed will be populated with the compressed bytes
+ * @param threads number of worker threads of the encoder, the default if 0
  */
 
 // This is exactly the same as JxlEncoderDistanceFromQuality
@@ -229,15 +231,17 @@ float sirilEncoderDistanceFromQuality(float quality) {
   return distance;
 }
 
-bool EncodeJxlOneshot(const std::vector<uint8_t>& pixels, const uint32_t xsize,
+bool EncodeJxlOneshot(const uint8_t* pixels, const size_t pixels_size, const uint32_t xsize,
                       const uint32_t ysize, const uint32_t zsize, const uint8_t bitdepth,
-                      std::vector<uint8_t>* compressed, const uint32_t effort, const float quality, std::vector<uint8_t>* icc_profile) {
+                      std::vector<uint8_t>* compressed, const uint32_t effort, const float quality, std::vector<uint8_t>* icc_profile,
+                      const int threads) {
   const float distance = sirilEncoderDistanceFromQuality(quality);
   auto enc = JxlEncoderMake(/*memory_manager=*/nullptr);
 #ifdef HAVE_LIBJXL_THREADS
+  // threads is shared with the other images encoded at the same time
   auto runner = JxlThreadParallelRunnerMake(
       /*memory_manager=*/nullptr,
-      JxlThreadParallelRunnerDefaultNumWorkerThreads());
+      threads > 0 ? (size_t) threads : JxlThreadParallelRunnerDefaultNumWorkerThreads());
   if (JXL_ENC_SUCCESS != JxlEncoderSetParallelRunner(enc.get(),
                                                      JxlThreadParallelRunner,
                                                      runner.get())) {
@@ -309,8 +313,8 @@ bool EncodeJxlOneshot(const std::vector<uint8_t>& pixels, const uint32_t xsize,
 
   if (JXL_ENC_SUCCESS !=
       JxlEncoderAddImageFrame(frame_settings, &pixel_format,
-                              static_cast<const void*>(pixels.data()),
-                              pixels.size())) {
+                              static_cast<const void*>(pixels),
+                              pixels_size)) {
     fprintf(stderr, "JxlEncoderAddImageFrame failed\n");
     return false;
   }
@@ -375,16 +379,16 @@ extern "C" int DecodeJpegXlOneShotWrapper(const uint8_t* jxl, size_t size,
 extern "C" int EncodeJpegXlOneshotWrapper(const uint8_t* pixels, const uint32_t xsize,
                       const uint32_t ysize, const uint32_t zsize, const uint8_t bitdepth,
                       void** compressed, size_t* compressed_length, uint32_t effort,
-                      const double quality, uint8_t* icc_profile, uint32_t icc_profile_length) {
+                      const double quality, uint8_t* icc_profile, uint32_t icc_profile_length, int threads) {
     std::vector<uint8_t> vec_icc_profile(icc_profile, icc_profile + icc_profile_length);
-    int datasize = bitdepth / 8;
-    std::vector<uint8_t> vec_pixels(pixels, pixels + xsize * ysize * zsize * datasize);
+    size_t datasize = bitdepth / 8;
     std::vector<uint8_t> vec_compressed;
 
-    int retval = (!EncodeJxlOneshot(vec_pixels, xsize,
+    // the pixels are given to the encoder without a copy
+    int retval = (!EncodeJxlOneshot(pixels, (size_t) xsize * ysize * zsize * datasize, xsize,
                       ysize, zsize, bitdepth,
-                      &vec_compressed, effort, quality, &vec_icc_profile)) ? 1 : 0;
-    void* array = (void*) malloc(vec_compressed.size() * datasize);
+                      &vec_compressed, effort, quality, &vec_icc_profile, threads)) ? 1 : 0;
+    void* array = (void*) malloc(vec_compressed.size());
     *compressed = array;
     memcpy(*compressed, vec_compressed.data(), vec_compressed.size() * sizeof(uint8_t));
     *compressed_length = vec_compressed.size();
@@ -42,7 +42,76 @@ extern "C" {
 #include "libxisf.h"
 
 
-int siril_get_xisf_buffer(const char *filename, struct xisf_data *xdata) {
+/* Copies the decoded samples of each channel to their plane of the output
+ * buffer, converting them on the fly, rows being distributed to the threads.
+ * This replaces the copy of the whole image libxisf makes to change the pixel
+ * storage, and the conversion pass that was done afterwards. */
+template<typename S, typename D, typename F>
+static void place_planar(const void *data, void *out, uint64_t width, uint64_t height,
+		uint64_t channels, bool interleaved, F convert, int max_threads) {
+	const S *src = (const S *) data;
+	D *dst = (D *) out;
+	const uint64_t npixels = width * height;
+	const int64_t nrows = (int64_t) (height * channels);
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(max_threads) schedule(static)
+#endif
+	for (int64_t row = 0; row < nrows; row++) {
+		uint64_t c = row / height, y = row % height;
+		D *d = dst + c * npixels + y * width;
+		if (interleaved) {
+			const S *s = src + y * width * channels + c;
+			for (uint64_t x = 0; x < width; x++)
+				d[x] = convert(s[x * channels]);
+		} else {
+			const S *s = src + c * npixels + y * width;
+			for (uint64_t x = 0; x < width; x++)
+				d[x] = convert(s[x]);
+		}
+	}
+}
+
+/* 8 and 16-bit images are given as 16-bit, others as 32-bit float */
+static int place_xisf_pixels(const LibXISF::Image &image, struct xisf_data *xdata, int max_threads) {
+	const uint64_t nsamples = image.width() * image.height() * image.channelCount();
+	const bool interleaved = image.pixelStorage() == LibXISF::Image::Normal;
+	const bool to_ushort = image.sampleFormat() == LibXISF::Image::UInt8 ||
+		image.sampleFormat() == LibXISF::Image::UInt16;
+	xdata->data = (uint8_t*) malloc(nsamples * (to_ushort ? sizeof(uint16_t) : sizeof(float)));
+	if (!xdata->data)
+		return -1;
+
+	const void *src = image.imageData();
+	switch (image.sampleFormat()) {
+	case LibXISF::Image::UInt8:
+		place_planar<uint8_t, uint16_t>(src, xdata->data, image.width(), image.height(),
+				image.channelCount(), interleaved, [](uint8_t v) { return (uint16_t) v; }, max_threads);
+		break;
+	case LibXISF::Image::UInt16:
+		place_planar<uint16_t, uint16_t>(src, xdata->data, image.width(), image.height(),
+				image.channelCount(), interleaved, [](uint16_t v) { return v; }, max_threads);
+		break;
+	case LibXISF::Image::UInt32:
+		place_planar<uint32_t, float>(src, xdata->data, image.width(), image.height(),
+				image.channelCount(), interleaved, [](uint32_t v) { return (float) v / 4294967295.f; }, max_threads);
+		break;
+	case LibXISF::Image::Float32:
+		place_planar<float, float>(src, xdata->data, image.width(), image.height(),
+				image.channelCount(), interleaved, [](float v) { return v; }, max_threads);
+		break;
+	case LibXISF::Image::Float64:
+		place_planar<double, float>(src, xdata->data, image.width(), image.height(),
+				image.channelCount(), interleaved, [](double v) { return (float) v; }, max_threads);
+		break;
+	default:
+		free(xdata->data);
+		xdata->data = nullptr;
+		return -1;
+	}
+	return 0;
+}
+
+int siril_get_xisf_buffer(const char *filename, struct xisf_data *xdata, int max_threads) {
 	try {
 		LibXISF::XISFReader xisfReader;
 		xisfReader.open(filename);
@@ -84,6 +153,8 @@ int siril_get_xisf_buffer(const char *filename, struct xisf_data *xdata) {
 			break;
 		default:
 			xdata->sampleFormat = 0;
+			free(xdata->icc_buffer);
+			xdata->icc_buffer = nullptr;
 			xisfReader.close();
 			return -1;
 		}
@@ -111,22 +182,15 @@ int siril_get_xisf_buffer(const char *filename, struct xisf_data *xdata) {
 		xdata->height = image.height();
 		xdata->channelCount = image.channelCount();
 
-		xdata->data = (uint8_t*) malloc(image.imageDataSize());
-		if (!xdata->data) {
+		if (place_xisf_pixels(image, xdata, max_threads)) {
+			free(xdata->icc_buffer);
+			xdata->icc_buffer = nullptr;
+			free(xdata->fitsHeader);
+			xdata->fitsHeader = nullptr;
 			xisfReader.close();
 			return -1;
 		}
 
-		if (image.pixelStorage() == LibXISF::Image::Normal) {
-			LibXISF::Image normalImage = image;
-			normalImage.convertPixelStorageTo(LibXISF::Image::Planar);
-			memcpy(xdata->data, normalImage.imageData(),
-					normalImage.imageDataSize());
-
-		} else {
-			memcpy(xdata->data, image.imageData(), image.imageDataSize());
-		}
-
 		xisfReader.close();
 
 	} catch (const LibXISF::Error &error) {
@@ -31,7 +31,7 @@ extern "C" {
 #ifdef HAVE_LIBXISF
 
 struct xisf_data {
-	uint8_t *data;
+	uint8_t *data;		// planar, 16-bit for 8 and 16-bit images, float otherwise
     uint64_t width;
     uint64_t height;
     uint64_t channelCount;
@@ -42,7 +42,7 @@ struct xisf_data {
 	uint32_t icc_length;
 };
 
-int siril_get_xisf_buffer(const char *filename, struct xisf_data *xdata);
+int siril_get_xisf_buffer(const char *filename, struct xisf_data *xdata, int max_threads);
 GdkPixbuf* get_thumbnail_from_xisf(char *filename, gchar **descr);
 
 #ifdef __cplusplus
@@ -33,10 +33,14 @@
 #include "gui/image_display.h"
 #include "io/siril_catalogues.h"
 #include "algos/search_objects.h"
+#include "io/kstars/htmesh_wrapper.h"
 
 #include "annotation_catalogues.h"
 
 #define CATALOG_DIST_EPSILON (1/3600.0)	// 1 arcsec or 1s in hrs
+#define ANNOTATION_HTM_LEVEL 6		// trixels of about 1.4 degrees
+#define ANNOTATION_HTM_MARGIN 0.5	// degrees
+#define ANNOTATION_HTM_MAX_RADIUS 30.	// degrees, wider fields project everything
 
 static GSList *siril_annot_catalogue_list = NULL; // loaded data from all annotation catalogues
 static gboolean get_annotation_visibility(siril_cat_index cat_index);
@@ -95,29 +99,6 @@ static int compare_names(gchar *s1, gchar *s2) {
 	return g_ascii_strcasecmp(s1, s2);
 }
 
-/* compare two objects, looking for duplicates based on the alias names against the name of the object to search */
-static gint object_compare(gconstpointer *a, gconstpointer *b) {
-	const CatalogObjects *s1 = (const CatalogObjects *) a;
-	const CatalogObjects *s2 = (const CatalogObjects *) b;
-
-	if (!s1->alias) return 1;
-
-	if (!strchr(s1->alias, '/'))
-		return g_strcmp0(s1->alias, s2->code);
-
-	gchar **token = g_strsplit(s1->alias, "/", -1);
-	guint i = 0;
-	while (token[i]) {
-		if (!g_strcmp0(token[i], s2->code)) {
-			g_strfreev(token);
-			return 0;
-		}
-		i++;
-	}
-	g_strfreev(token);
-	return 1;
-}
-
 // returns true if it was added
 static gboolean add_alias_to_item(cat_item *item, gchar *name) {
 	if (!compare_names(item->name, name))
@@ -195,7 +176,7 @@ static annotations_catalogue_t *load_catalog(siril_cat_index cat_index, const gc
 		return NULL;
 	}
 	siril_debug_print("loaded %d objects from annotations catalogue %s\n", siril_cat->nbitems, filename);
-	annotations_catalogue_t *annot_cat = g_new(annotations_catalogue_t, 1);
+	annotations_catalogue_t *annot_cat = g_new0(annotations_catalogue_t, 1);
 	annot_cat->cat = siril_cat;
 	annot_cat->show = get_annotation_visibility(cat_index);
 	return annot_cat;
@@ -263,7 +244,7 @@ int load_siril_cat_to_temp(siril_catalogue *siril_cat) {
 		return 1;
 	if (!is_catalogue_loaded())
 		load_all_catalogues();
-	annotations_catalogue_t *annot_cat = g_new(annotations_catalogue_t, 1);
+	annotations_catalogue_t *annot_cat = g_new0(annotations_catalogue_t, 1);
 	annot_cat->cat = siril_cat;
 	annot_cat->show = TRUE;
 	annot_cat->cat->cat_index = CAT_AN_USER_TEMP;
@@ -399,6 +380,99 @@ gboolean is_inside(fits *fit, double ra, double dec) {
 	return wcs2pix(fit, ra, dec, NULL, NULL) == 0;
 }
 
+struct htm_entry {
+	int trixel;
+	int item;
+};
+
+static int compare_htm_entries(const void *a, const void *b) {
+	const struct htm_entry *e1 = a, *e2 = b;
+	if (e1->trixel != e2->trixel)
+		return e1->trixel < e2->trixel ? -1 : 1;
+	return e1->item - e2->item;
+}
+
+static void free_htm_index(annotations_catalogue_t *annot_cat) {
+	free(annot_cat->htm_items);
+	free(annot_cat->htm_trixels);
+	annot_cat->htm_items = NULL;
+	annot_cat->htm_trixels = NULL;
+	annot_cat->htm_nbitems = 0;
+}
+
+/* the static catalogues are not modified once loaded, except for aliases, so
+ * their items can be sorted once by trixel of the hierarchical triangular mesh */
+static gboolean build_htm_index(annotations_catalogue_t *annot_cat) {
+	siril_catalogue *siril_cat = annot_cat->cat;
+	if (annot_cat->htm_items && annot_cat->htm_nbitems == siril_cat->nbitems)
+		return TRUE;
+	free_htm_index(annot_cat);
+	if (siril_cat->nbitems <= 0)
+		return FALSE;
+	struct htm_entry *entries = malloc(siril_cat->nbitems * sizeof(struct htm_entry));
+	annot_cat->htm_items = malloc(siril_cat->nbitems * sizeof(int));
+	annot_cat->htm_trixels = malloc(siril_cat->nbitems * sizeof(int));
+	if (!entries || !annot_cat->htm_items || !annot_cat->htm_trixels) {
+		PRINT_ALLOC_ERR;
+		free(entries);
+		free_htm_index(annot_cat);
+		return FALSE;
+	}
+	for (int i = 0; i < siril_cat->nbitems; i++) {
+		entries[i].trixel = get_htm_index_for_coords(siril_cat->cat_items[i].ra, siril_cat->cat_items[i].dec, ANNOTATION_HTM_LEVEL);
+		entries[i].item = i;
+	}
+	qsort(entries, siril_cat->nbitems, sizeof(struct htm_entry), compare_htm_entries);
+	for (int i = 0; i < siril_cat->nbitems; i++) {
+		annot_cat->htm_trixels[i] = entries[i].trixel;
+		annot_cat->htm_items[i] = entries[i].item;
+	}
+	free(entries);
+	annot_cat->htm_nbitems = siril_cat->nbitems;
+	siril_debug_print("built the spatial index of annotation catalogue %s\n", catalog_to_str(siril_cat->cat_index));
+	return TRUE;
+}
+
+/* returns the indices of the items of the catalogue located in the trixels
+ * covering the cone, or NULL if the whole catalogue must be projected */
+static int *get_items_around_target(annotations_catalogue_t *annot_cat, double ra, double dec, double radius, int *nb) {
+	int *trixels = NULL, nb_trixels = 0;
+	*nb = 0;
+	if (!build_htm_index(annot_cat))
+		return NULL;
+	if (get_htm_indices_around_target(ra, dec, radius, ANNOTATION_HTM_LEVEL, &trixels, &nb_trixels) || !trixels)
+		return NULL;
+	int *items = malloc(annot_cat->htm_nbitems * sizeof(int));
+	if (!items) {
+		PRINT_ALLOC_ERR;
+		free(trixels);
+		return NULL;
+	}
+	for (int t = 0; t < nb_trixels; t++) {
+		// lower bound of the trixel in the sorted table
+		int lo = 0, hi = annot_cat->htm_nbitems;
+		while (lo < hi) {
+			int mid = (lo + hi) / 2;
+			if (annot_cat->htm_trixels[mid] < trixels[t])
+				lo = mid + 1;
+			else hi = mid;
+		}
+		for (int i = lo; i < annot_cat->htm_nbitems && annot_cat->htm_trixels[i] == trixels[t]; i++)
+			items[(*nb)++] = annot_cat->htm_items[i];
+	}
+	free(trixels);
+	return items;
+}
+
+static void add_alias_tokens(GHashTable *names, const CatalogObjects *object) {
+	if (!object->alias)
+		return;
+	gchar **token = g_strsplit(object->alias, "/", -1);
+	for (guint i = 0; token[i]; i++)
+		g_hash_table_add(names, token[i]);
+	g_free(token);	// the strings are now owned by the table
+}
+
 /* get a list of objects from all catalogues (= from siril_annot_catalogue_list) that
  * are framed in the passed plate solved image */
 GSList *find_objects_in_field(fits *fit) {
@@ -410,6 +484,13 @@ GSList *find_objects_in_field(fits *fit) {
 	gdouble starradius = get_wcs_image_resolution(fit) * 6. * 60.0;
 	GSList *list = get_siril_annot_catalogue_list();
 	double tref = date_time_to_Julian(fit->keywords.date_obs);
+	// cone enclosing the image, with some margin for the proper motions
+	double ra0, dec0;
+	center2wcs(fit, &ra0, &dec0);
+	double field_radius = 0.5 * get_wcs_image_resolution(fit) * hypot(fit->rx, fit->ry) + ANNOTATION_HTM_MARGIN;
+	gboolean use_index = field_radius < ANNOTATION_HTM_MAX_RADIUS && ra0 != -1. && dec0 != -1.;
+	// alias names of the objects already found, for the duplicate check
+	GHashTable *names = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
 	for (GSList *l = list; l; l = l->next) {
 		annotations_catalogue_t *curcat = l->data;
 		if (!curcat->show) // the catalog show member is set at read-out
@@ -417,7 +498,16 @@ GSList *find_objects_in_field(fits *fit) {
 		siril_catalogue *siril_cat = curcat->cat;
 		gboolean is_star_cat = is_star_catalogue(siril_cat->cat_index);
 		if (siril_cat->projected != CAT_PROJ_WCS) {
-			siril_catalog_project_with_WCS(siril_cat,fit, TRUE, TRUE); // sanity check will be done during the projection
+			// only the large static catalogues are indexed, the user ones are small and can change
+			int nb = 0, *items = NULL;
+			if (use_index && siril_cat->cat_index < CAT_AN_USER_DSO)
+				items = get_items_around_target(curcat, ra0, dec0, field_radius, &nb);
+			if (items) {
+				siril_catalog_project_subset_with_WCS(siril_cat, fit, items, nb, TRUE, TRUE);
+				free(items);
+			} else {
+				siril_catalog_project_with_WCS(siril_cat,fit, TRUE, TRUE); // sanity check will be done during the projection
+			}
 		}
 		for (int i = 0; i < siril_cat->nbitems; i++) {
 			if (siril_cat->cat_index == CAT_AN_USER_SSO) { // we need to check the record is from the same night and same location
@@ -439,13 +529,16 @@ GSList *find_objects_in_field(fits *fit) {
 					siril_cat->cat_items[i].alias,
 					siril_cat->cat_index
 				);
-				if (!g_slist_find_custom(targets, cur, (GCompareFunc)object_compare))
+				if (!cur->code || !g_hash_table_contains(names, cur->code)) {
 					targets = g_slist_prepend(targets, cur);
-				else
+					add_alias_tokens(names, cur);
+				} else {
 					free_catalogue_object(cur);
+				}
 			}
 		}
 	}
+	g_hash_table_destroy(names);
 	if (targets) {
 		targets = g_slist_reverse(targets);
 	}
@@ -28,6 +28,11 @@ typedef struct _CatalogObjects CatalogObjects;
 typedef struct annotations_catalogue {
 	siril_catalogue *cat;
 	gboolean show;
+	/* spatial index of the static catalogues, built on first use: item
+	 * indices sorted by HTM trixel */
+	int *htm_items;
+	int *htm_trixels;
+	int htm_nbitems;
 } annotations_catalogue_t;
 
 GSList *find_objects_in_field(fits *fit);
@@ -573,7 +573,7 @@ static seqwrite_status get_next_write_details(struct _convert_data *args, conver
 		struct writer_data *writer, gboolean end_of_input_seq, gboolean last_file_and_image);
 static gchar *create_sequence_filename(sequence_type output_type, const char *destroot, int index);
 static seqwrite_status write_image(fits *fit, struct writer_data *writer);
-static void compute_nb_images_fit_mem(fits *fit, gboolean debayer, int *nb_threads, int *nb_images);
+static void compute_nb_images_fit_mem(fits *fit, gboolean debayer, gboolean raw_input, int *nb_threads, int *nb_images);
 static void print_reader(struct reader_data *reader);
 static void print_writer(struct writer_data *writer);
 
@@ -632,8 +632,10 @@ gpointer convert_thread_worker(gpointer p) {
 	struct writer_data *writer = NULL;
 	args->nb_converted_files = 0;
 	args->retval = 0;
-	gboolean allow_symlink = args->output_type == SEQ_REGULAR && test_if_symlink_is_ok(TRUE);
-	args->make_link &= allow_symlink;
+	/* without symbolic links, the files are shared by other means if possible */
+	args->make_link &= args->output_type == SEQ_REGULAR;
+	if (args->make_link)
+		test_if_symlink_is_ok(TRUE);
 	if (args->multiple_output && args->output_type != SEQ_SER && args->output_type != SEQ_FITSEQ) {
 		siril_log_message(_("disabling incompatible multiple output option in conversion\n"));
 		args->multiple_output = FALSE;
@@ -1036,13 +1038,13 @@ static void signal_memory_limit(convert_status *conv) {
 }
 
 // see the memory and threads notes higher in the file
-static void readjust_memory_limits(convert_status *conv, fits *fit) {
+static void readjust_memory_limits(convert_status *conv, fits *fit, gboolean raw_input) {
 	if (g_atomic_int_add(&conv->first, 1))
 		return;
 	if (conv->args->input_has_a_film)
 		goto unlock_end;
 	int nb_threads, nb_images;
-	compute_nb_images_fit_mem(fit, conv->args->debayer, &nb_threads, &nb_images);
+	compute_nb_images_fit_mem(fit, conv->args->debayer, raw_input, &nb_threads, &nb_images);
 	if (nb_threads <= 0)
 		goto unlock_end;
 	siril_log_message("%d image(s) can be processed in parallel\n", nb_threads);
@@ -1080,6 +1082,9 @@ static void pool_worker(gpointer data, gpointer user_data) {
 		return;
 	}
 
+	// the reader is freed by read_fit()
+	gboolean raw_input = rwdata->reader->filename &&
+		get_type_for_extension(get_filename_ext(rwdata->reader->filename)) == TYPERAW;
 	fits *fit = read_fit(rwdata->reader, &read_status);
 	if (read_status == CAN_BE_LINKED) {
 		if (make_link(rwdata)) {
@@ -1112,7 +1117,7 @@ static void pool_worker(gpointer data, gpointer user_data) {
 		signal_memory_limit(conv);
 		return;
 	}
-	readjust_memory_limits(conv, fit);
+	readjust_memory_limits(conv, fit, raw_input);
 
 	if (!get_thread_run() || g_atomic_int_get(&conv->fatal_error)) {
 		rwdata->reader = NULL;
@@ -1407,7 +1412,7 @@ static seqwrite_status write_image(fits *fit, struct writer_data *writer) {
 /* similar to compute_nb_images_fit_memory from sequence.c, but uses a FITS as input (same size as the
  * output files), not a sequence. It computes how many threads can be created and how many images fit in
  * memory with those threads, for the writer */
-static void compute_nb_images_fit_mem(fits *fit, gboolean debayer, int *nb_threads, int *nb_images) {
+static void compute_nb_images_fit_mem(fits *fit, gboolean debayer, gboolean raw_input, int *nb_threads, int *nb_images) {
 	int max_memory_MB = get_max_memory_in_MB();
 	/* image size only changes in case of debayer and in this case, it also needs
 	 * more memory to do the debayer:
@@ -1427,6 +1432,10 @@ static void compute_nb_images_fit_mem(fits *fit, gboolean debayer, int *nb_threa
 		if (debayer)
 			memory_per_processed_image *= 3;
 	}
+	/* RAW files are decoded from memory: the file and libraw's unpacked
+	 * buffer of the raw frame are needed while the output image is filled */
+	if (raw_input)
+		memory_per_processed_image += 2 * fit->naxes[0] * fit->naxes[1] * sizeof(WORD);
 	unsigned int memory_per_image_MB = memory_per_output_image / BYTES_IN_A_MB;
 	if (memory_per_image_MB == 0)
 		memory_per_image_MB = 1;
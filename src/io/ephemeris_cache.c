@@ -0,0 +1,316 @@
+/*
+ * This file is part of Siril, an astronomy image processor.
+ * Copyright (C) 2005-2011 Francois Meyer (dulle at free.fr)
+ * Copyright (C) 2012-2025 team free-astro (see more in AUTHORS file)
+ * Reference site is https://siril.org
+ *
+ * Siril is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Siril is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Siril. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Ephemerides of solar system objects, so that the images of a night only
+ * need one Miriade query per object. Instead of the position at the date of
+ * one image, a series of positions every EPHEM_STEP_MIN minutes around it is
+ * requested and the positions at the dates of the images are interpolated
+ * from it. A series is identified by the object and the observer site, it is
+ * kept in memory for the session and its response is saved in the user cache
+ * directory, where it is used for EPHEM_MAX_AGE_DAYS days.
+ */
+
+#include <string.h>
+#include <math.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "core/siril.h"
+#include "core/proto.h"
+#include "core/siril_log.h"
+#include "core/siril_networking.h"
+#include "algos/search_objects.h"
+#include "ephemeris_cache.h"
+
+#define EPHEM_STEP_MIN 10
+#define EPHEM_HALF_WINDOW_DAYS 1.0
+#define EPHEM_MAX_AGE_DAYS 30
+
+struct ephem_sample {
+	double jd, ra, dec, vra, vdec, mag;
+};
+
+struct ephem_series {
+	gchar *name, *type;
+	struct ephem_sample *samples;
+	int nb;
+};
+
+static GMutex cache_mutex;
+static GHashTable *cache = NULL;	// key -> struct ephem_entry
+
+struct ephem_entry {
+	GSList *series;	// of struct ephem_series
+	gboolean failed;	// a query failed, the single date queries are used instead
+};
+
+static void free_series(struct ephem_series *series) {
+	g_free(series->name);
+	g_free(series->type);
+	free(series->samples);
+	free(series);
+}
+
+static void free_entry(gpointer p) {
+	struct ephem_entry *entry = (struct ephem_entry *) p;
+	g_slist_free_full(entry->series, (GDestroyNotify) free_series);
+	free(entry);
+}
+
+static gchar *get_cache_directory() {
+	return g_build_filename(g_get_user_cache_dir(), "siril_ephemerides", NULL);
+}
+
+/* same format as the single date responses read by parse_catalog_buffer() */
+static struct ephem_series *parse_series(const gchar *buffer) {
+	if (!buffer || !g_str_has_prefix(buffer, "# Flag: 1"))
+		return NULL;
+	gchar **lines = g_strsplit(buffer, "\n", -1);
+	if (g_strv_length(lines) < 5) {
+		g_strfreev(lines);
+		return NULL;
+	}
+	struct ephem_series *series = calloc(1, sizeof(struct ephem_series));
+	gchar **parts = g_regex_split_simple("#(.+?):(.+?)\\|", lines[2], 0, 0);
+	if (g_strv_length(parts) == 4) {
+		series->type = g_strdup(g_strstrip(parts[1]));
+		series->name = g_strdup(g_strstrip(parts[2]));
+	}
+	g_strfreev(parts);
+	int nblines = g_strv_length(lines);
+	series->samples = malloc(nblines * sizeof(struct ephem_sample));
+	if (!series->name || !series->samples) {
+		free_series(series);
+		g_strfreev(lines);
+		return NULL;
+	}
+	for (int i = 3; i < nblines; i++) {
+		if (lines[i][0] == '#' || lines[i][0] == '\0')
+			continue;
+		gchar **fields = g_strsplit(lines[i], ",", -1);
+		guint n = g_strv_length(fields);
+		struct ephem_sample *s = &series->samples[series->nb];
+		if (n == 16) { // with site coordinates passed
+			s->ra = parse_hms(fields[2]);
+			s->dec = parse_dms(fields[3]);
+			s->vra = g_strtod(fields[13], NULL) * 60.; // vra stored in arcsec/hr but given in arcsec/min
+			s->vdec = g_strtod(fields[14], NULL) * 60.;
+			s->mag = g_strtod(fields[9], NULL);
+		} else if (n == 11) { // with @500 passed
+			s->ra = parse_hms(fields[1]);
+			s->dec = parse_dms(fields[2]);
+			s->vra = g_strtod(fields[8], NULL) * 60.;
+			s->vdec = g_strtod(fields[9], NULL) * 60.;
+			s->mag = g_strtod(fields[5], NULL);
+		}
+		if (n == 16 || n == 11) {
+			s->jd = g_strtod(fields[0], NULL);
+			// samples are in increasing dates
+			if (s->jd > 0.0 && (series->nb == 0 || s->jd > series->samples[series->nb - 1].jd))
+				series->nb++;
+		}
+		g_strfreev(fields);
+	}
+	g_strfreev(lines);
+	if (series->nb < 2) {
+		free_series(series);
+		return NULL;
+	}
+	return series;
+}
+
+static gboolean series_covers(const struct ephem_series *series, double jd) {
+	return jd >= series->samples[0].jd && jd <= series->samples[series->nb - 1].jd;
+}
+
+static double wrap_ra_difference(double d) {
+	while (d > 180.0) d -= 360.0;
+	while (d < -180.0) d += 360.0;
+	return d;
+}
+
+/* cubic Lagrange interpolation on the four samples around the date, linear
+ * at the ends of the series. RA is unwrapped around the first sample */
+static void interpolate(const struct ephem_series *series, double jd, struct ephem_sample *out) {
+	int i = 0;
+	while (i < series->nb - 2 && series->samples[i + 1].jd <= jd)
+		i++;
+	int first = i - 1, last = i + 2;
+	if (first < 0 || last >= series->nb) {
+		first = i;
+		last = i + 1;
+	}
+	const double ra0 = series->samples[first].ra;
+	double ra = 0.0;
+	out->jd = jd;
+	out->dec = out->vra = out->vdec = out->mag = 0.0;
+	for (int k = first; k <= last; k++) {
+		double w = 1.0;
+		for (int j = first; j <= last; j++) {
+			if (j != k)
+				w *= (jd - series->samples[j].jd) / (series->samples[k].jd - series->samples[j].jd);
+		}
+		const struct ephem_sample *s = &series->samples[k];
+		ra += w * wrap_ra_difference(s->ra - ra0);
+		out->dec += w * s->dec;
+		out->vra += w * s->vra;
+		out->vdec += w * s->vdec;
+		out->mag += w * s->mag;
+	}
+	out->ra = fmod(ra0 + ra + 360.0, 360.0);
+}
+
+static gchar *get_key(const gchar *prefix, const gchar *name, const gchar *site) {
+	gchar *key = g_strdup_printf("%s:%s@%s", prefix, name, site);
+	gchar *hash = g_compute_checksum_for_string(G_CHECKSUM_SHA1, key, -1);
+	g_free(key);
+	return hash;
+}
+
+/* series saved by previous sessions, named <key>_<first date>.csv */
+static GSList *load_saved_series(const gchar *key) {
+	gchar *dirname = get_cache_directory();
+	GDir *dir = g_dir_open(dirname, 0, NULL);
+	GSList *list = NULL;
+	if (dir) {
+		gchar *prefix = g_strdup_printf("%s_", key);
+		gint64 now = g_get_real_time() / G_USEC_PER_SEC;
+		const gchar *filename;
+		while ((filename = g_dir_read_name(dir))) {
+			if (!g_str_has_prefix(filename, prefix) || !g_str_has_suffix(filename, ".csv"))
+				continue;
+			gchar *path = g_build_filename(dirname, filename, NULL);
+			GStatBuf st;
+			if (!g_stat(path, &st) && now - (gint64) st.st_mtime > EPHEM_MAX_AGE_DAYS * 86400) {
+				// orbits are refined, old series are fetched again
+				g_unlink(path);
+			} else {
+				gchar *contents = NULL;
+				if (g_file_get_contents(path, &contents, NULL, NULL)) {
+					struct ephem_series *series = parse_series(contents);
+					if (series)
+						list = g_slist_prepend(list, series);
+					g_free(contents);
+				}
+			}
+			g_free(path);
+		}
+		g_free(prefix);
+		g_dir_close(dir);
+	}
+	g_free(dirname);
+	return list;
+}
+
+static void save_series(const gchar *key, double start, const gchar *buffer) {
+	gchar *dirname = get_cache_directory();
+	if (g_mkdir_with_parents(dirname, 0755)) {
+		g_free(dirname);
+		return;
+	}
+	gchar *filename = g_strdup_printf("%s_%.5f.csv", key, start);
+	gchar *path = g_build_filename(dirname, filename, NULL);
+	if (!g_file_set_contents(path, buffer, -1, NULL))
+		siril_debug_print("could not save the ephemerides in %s\n", path);
+	g_free(path);
+	g_free(filename);
+	g_free(dirname);
+}
+
+static struct ephem_series *fetch_series(const gchar *key, const gchar *prefix, const gchar *name, const gchar *site, double jd) {
+#ifndef HAVE_LIBCURL
+	return NULL;
+#else
+	const double start = jd - EPHEM_HALF_WINDOW_DAYS;
+	const int nbd = (int) (2.0 * EPHEM_HALF_WINDOW_DAYS * 1440.0 / EPHEM_STEP_MIN) + 1;
+	GString *string_url = g_string_new(EPHEMCC);
+	g_string_append_printf(string_url, "&-name=%s:%s", prefix, name);
+	g_string_append_printf(string_url, "&-ep=%.6f&-nbd=%d&-step=%dm", start, nbd, EPHEM_STEP_MIN);
+	g_string_append_printf(string_url, "&-observer=%s", site);
+	gchar *url = g_string_free(string_url, FALSE);
+	gchar *cleaned_url = url_cleanup(url);
+	g_free(url);
+	siril_debug_print("URL: %s\n", cleaned_url);
+	siril_log_message(_("Fetching the ephemerides of %s for %d dates\n"), name, nbd);
+	gsize length;
+	int error;
+	char *result = fetch_url(cleaned_url, &length, &error, FALSE);
+	g_free(cleaned_url);
+	struct ephem_series *series = parse_series(result);
+	if (series)
+		save_series(key, start, result);
+	free(result);
+	return series;
+#endif
+}
+
+cat_item *ephemeris_cache_lookup(const gchar *prefix, const gchar *name, const gchar *site, double jd) {
+	if (!prefix || !name || !site || jd <= 0.0)
+		return NULL;
+	gchar *key = get_key(prefix, name, site);
+	g_mutex_lock(&cache_mutex);
+	if (!cache)
+		cache = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, free_entry);
+	struct ephem_entry *entry = g_hash_table_lookup(cache, key);
+	if (!entry) {
+		entry = calloc(1, sizeof(struct ephem_entry));
+		entry->series = load_saved_series(key);
+		g_hash_table_insert(cache, g_strdup(key), entry);
+	}
+	struct ephem_series *found = NULL;
+	for (GSList *iter = entry->series; iter && !found; iter = iter->next) {
+		if (series_covers(iter->data, jd))
+			found = iter->data;
+	}
+	if (!found && !entry->failed) {
+		/* the lock is kept so that the frames of a sequence, processed
+		 * by several threads, wait for the same query */
+		found = fetch_series(key, prefix, name, site, jd);
+		if (found)
+			entry->series = g_slist_prepend(entry->series, found);
+		else entry->failed = TRUE;
+	}
+	cat_item *item = NULL;
+	if (found) {
+		struct ephem_sample s;
+		interpolate(found, jd, &s);
+		item = calloc(1, sizeof(cat_item));
+		item->ra = s.ra;
+		item->dec = s.dec;
+		item->vra = s.vra;
+		item->vdec = s.vdec;
+		item->mag = (float) s.mag;
+		item->dateobs = jd;
+		item->name = g_strdup(found->name);
+		item->type = g_strdup(found->type);
+	}
+	g_mutex_unlock(&cache_mutex);
+	g_free(key);
+	return item;
+}
+
+void ephemeris_cache_clear() {
+	g_mutex_lock(&cache_mutex);
+	if (cache) {
+		g_hash_table_destroy(cache);
+		cache = NULL;
+	}
+	g_mutex_unlock(&cache_mutex);
+}
@@ -0,0 +1,13 @@
+#ifndef EPHEMERIS_CACHE_H
+#define EPHEMERIS_CACHE_H
+
+#include "io/siril_catalogues.h"
+
+/* returns the position of a solar system object at a date (JD) for an observer
+ * site formatted for the Miriade queries, interpolated from a cached series,
+ * or NULL. The returned item has to be freed with siril_catalog_free_item()
+ * and free() */
+cat_item *ephemeris_cache_lookup(const gchar *prefix, const gchar *name, const gchar *site, double jd);
+void ephemeris_cache_clear();
+
+#endif
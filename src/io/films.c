@@ -53,6 +53,7 @@ int get_nb_film_ext_supported() {
 
 static void film_init_struct(struct film_struct *film) {
 	memset(film, 0, sizeof(struct film_struct));
+	g_mutex_init(&film->decoder_lock);
 }
 
 /* Check different film extensions supported in supported_film[].
@@ -67,6 +68,70 @@ int check_for_film_extensions(const char *extension) {
 	return 1;
 }
 
+static int randPixel(int nb_pixels) {
+	return siril_random_uint() % nb_pixels;
+}
+
+static int *randomIndex(int n) {
+	srand(time(NULL));
+	int *index;
+	int i, x, tmp;
+
+	index = calloc(n, sizeof (int));
+	if (index == NULL) {
+		PRINT_ALLOC_ERR;
+		return NULL;
+	}
+
+	/* make index */
+	for (i = 0; i < n; i++) {
+		index[i] = i;
+	}
+
+	/* mix index */
+	for (i = 0; i < n; i++) {
+		x = randPixel(n);
+		tmp = index[i];
+		index[i] = index[x];
+		index[x] = tmp;
+	}	return index;
+}
+
+/* A film containing gray images can be encoded as RGB, browse random pixels
+ * of the first frame (100 pixels) and check the values in the three layers */
+static gboolean rgb_frame_is_gray(const FFMS_Frame *frame, int nb_pixels) {
+	gboolean is_gray = FALSE;
+	int pixel_tested = 0, n = 0;
+	int *randIndex = randomIndex(nb_pixels * 3);
+	if (randIndex == NULL)
+		return FALSE;
+	do {
+		int px = randIndex[n];
+		px = px - (px % 3);
+		++n;
+		WORD r, g, b;
+
+		r = frame->Data[0][px + 0];
+		g = frame->Data[0][px + 1];
+		b = frame->Data[0][px + 2];
+
+		if (r == g && r == b && g == b) {
+			is_gray = TRUE;
+		} else {
+			/* no gray image, we can go out of the loop */
+			is_gray = FALSE;
+			break;
+		}
+		// we reject pure black and pure white in the comparison
+		if (r != 0 && r != 255)
+			++pixel_tested;
+
+	} while (pixel_tested < 100 && n < nb_pixels * 3);
+	free(randIndex);
+	siril_debug_print("total n = %d et k = %d et npixel = %d\n", n, pixel_tested, nb_pixels);
+	return is_gray;
+}
+
 int film_open_file(const char *sourcefile, struct film_struct *film) {
 	film_init_struct(film);
 	/* Initialize the library itself. */
@@ -90,6 +155,12 @@ int film_open_file(const char *sourcefile, struct film_struct *film) {
 	idxfilename = malloc(strlen(sourcefile) + 5);
 	sprintf(idxfilename, "%s.idx", sourcefile);
 	index = FFMS_ReadIndex(idxfilename, &film->errinfo);
+	if (index && FFMS_IndexBelongsToFile(index, sourcefile, &film->errinfo)) {
+		/* the film was replaced since the index was written */
+		fprintf(stdout, "FILM: index file '%s' is outdated, indexing again\n", idxfilename);
+		FFMS_DestroyIndex(index);
+		index = NULL;
+	}
 	if (index == NULL) {
 #if (FFMS_VERSION > ((2 << 24) | (20 << 16) | (0 << 8) | 0))
 		/* we need to create the indexer */
@@ -135,7 +206,9 @@ int film_open_file(const char *sourcefile, struct film_struct *film) {
 	}
 
 	/* We now have enough information to create the video source object */
-	film->videosource = FFMS_CreateVideoSource(sourcefile, trackno, index, 1, FFMS_SEEK_NORMAL, &film->errinfo);
+	/* The decoder uses frame threads, decoding the next frames ahead while
+	 * the sequence is read in order. The seeking is exact with the index. */
+	film->videosource = FFMS_CreateVideoSource(sourcefile, trackno, index, com.max_thread, FFMS_SEEK_NORMAL, &film->errinfo);
 	if (film->videosource == NULL) {
 		/* handle error (you should know what to do by now) */
 		fprintf(stderr, "FILM error: %s\n", film->errmsg);
@@ -210,97 +283,42 @@ int film_open_file(const char *sourcefile, struct film_struct *film) {
 		return FILM_ERROR;
 	}
 
+	/* detected once here, so that the frames can be read in any order */
+	if (film->pixfmt == pixfmt_rgb) {
+		const FFMS_Frame *first = FFMS_GetFrame(film->videosource, 0, &film->errinfo);
+		if (first && rgb_frame_is_gray(first, film->width * film->height)) {
+			film->rgb_is_gray = TRUE;
+			film->nb_layers = 1;
+		}
+	}
+
 	film->filename = strdup(sourcefile);
 	fprintf(stdout, "FILM: successfully opened the video file %s, %d frames\n",
 			film->filename, film->frame_count);
 	return FILM_SUCCESS;
 }
 
-static int randPixel(int nb_pixels) {
-	return siril_random_uint() % nb_pixels;
-}
-
-static int *randomIndex(int n) {
-	srand(time(NULL));
-	int *index;
-	int i, x, tmp;
-
-	index = calloc(n, sizeof (int));
-	if (index == NULL) {
-		PRINT_ALLOC_ERR;
-		return NULL;
-	}
-
-	/* make index */
-	for (i = 0; i < n; i++) {
-		index[i] = i;
-	}
-
-	/* mix index */
-	for (i = 0; i < n; i++) {
-		x = randPixel(n);
-		tmp = index[i];
-		index[i] = index[x];
-		index[x] = tmp;
-	}	return index;
-}
-
 int film_read_frame(struct film_struct *film, int frame_no, fits *fit) {
 	/* now we're ready to actually retrieve the video frames */
-	int nb_pixels, convert_rgb_to_gray = 0;
+	int nb_pixels;
 
 	if (film->videosource == NULL) {
 		siril_log_message(_("FILM ERROR: incompatible format\n"));
 		return FILM_ERROR;
 	}
+	/* the frame returned by ffms2 is valid until the next call, it is copied
+	 * with the decoder locked */
+	g_mutex_lock(&film->decoder_lock);
 	const FFMS_Frame *frame = FFMS_GetFrame(film->videosource, frame_no, &film->errinfo);
 	if (frame == NULL) {
 		/* handle error */
 		fprintf(stderr, "FILM error: %s\n", film->errmsg);
+		g_mutex_unlock(&film->decoder_lock);
 		return FILM_ERROR;
 	}
 
 	nb_pixels = film->width * film->height;
-
-	/* detect gray images encoded in RGB24 movies */
-	if (frame->ConvertedPixelFormat == pixfmt_rgb) {
-		// browse random pixels in the first frame (100 pixels) and check
-		// value in two or three layers
-		// convert_rgb_to_gray = 1;
-		if (frame_no == 0) {
-			int pixel_tested = 0, n = 0;
-			int *randIndex = randomIndex(nb_pixels * 3);
-			if (randIndex == NULL) {
-				return FILM_ERROR;
-			}
-			do {
-				int px = randIndex[n];
-				px = px - (px % 3);
-				++n;
-				WORD r, g, b;
-
-				r = frame->Data[0][px + 0];
-				g = frame->Data[0][px + 1];
-				b = frame->Data[0][px + 2];
-
-				if (r == g && r == b && g == b) {
-					convert_rgb_to_gray = 1;
-				} else {
-					/* no gray image, we can go out of the loop */
-					convert_rgb_to_gray = 0;
-					break;
-				}
-				// we reject pure black and pure white in the comparison
-				if (r != 0 && r != 255)
-					++pixel_tested;
-
-			} while (pixel_tested < 100 && n < nb_pixels * 3);
-			free(randIndex);
-			printf("total n = %d et k = %d et npixel = %d\n", n, pixel_tested, nb_pixels);
-		}
-	}
-	if (convert_rgb_to_gray)
-		film->nb_layers = 1;
+	gboolean convert_rgb_to_gray = film->rgb_is_gray && frame->ConvertedPixelFormat == pixfmt_rgb;
 
 	/* do something with frame */
 	WORD *ptr;
@@ -309,6 +327,7 @@ int film_read_frame(struct film_struct *film, int frame_no, fits *fit) {
 			== NULL) {
 		PRINT_ALLOC_ERR;
 		free(fit->data);
+		g_mutex_unlock(&film->decoder_lock);
 		return -1;
 	}
 	memset(fit, 0, sizeof(fits));
@@ -355,8 +374,10 @@ int film_read_frame(struct film_struct *film, int frame_no, fits *fit) {
 		// format is not one we set, should happen only if return value of the file
 		// opening was not used to discard the file
 		fprintf(stderr, "FILM: format not understood\n");
+		g_mutex_unlock(&film->decoder_lock);
 		return FILM_ERROR;
 	}
+	g_mutex_unlock(&film->decoder_lock);
 	fits_flip_top_to_bottom(fit);
 
 /* Film sequences are not color managed. Any sequence operations that rely on
@@ -373,6 +394,7 @@ void film_close_file(struct film_struct *film) {
 	free(film->errmsg);
 	free(film->filename);
 	FFMS_DestroyVideoSource(film->videosource);
+	g_mutex_clear(&film->decoder_lock);
 }
 
 void film_display_info(struct film_struct *film) {
@@ -27,6 +27,9 @@ struct film_struct {
 	int width, height;
 	int nb_layers;		// 1 for gray, 3 for rgb, 0 for uninit
 	int frame_count;
+	gboolean rgb_is_gray;	// gray images encoded in an RGB film
+
+	GMutex decoder_lock;	// ffms2 video sources are not thread-safe
 
 	char *filename;
 };
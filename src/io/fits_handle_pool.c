@@ -0,0 +1,215 @@
+/*
+ * This file is part of Siril, an astronomy image processor.
+ * Copyright (C) 2005-2011 Francois Meyer (dulle at free.fr)
+ * Copyright (C) 2012-2025 team free-astro (see more in AUTHORS file)
+ * Reference site is https://siril.org
+ *
+ * Siril is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Siril is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Siril. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Pool of cfitsio handles for the images of a regular FITS sequence
+ * With one handle per opened image, threads reading the same image wait for
+ * each other on the lock of the handle, and the number of images that can be
+ * opened is limited by the number of files the system allows. Here, a handle
+ * is used by a single thread at a time, so several handles can exist for the
+ * same image, and the number of open handles is bounded: when the limit is
+ * reached, the least recently used handle that is not in use is closed and
+ * reopened on the requested image.
+ */
+
+#include "core/siril_log.h"
+#include "io/image_format_fits.h"
+#include "io/sequence.h"
+#include "fits_handle_pool.h"
+
+struct fits_handle_pool {
+	sequence *seq;
+	int capacity;		// maximum number of open handles
+	int max_files;		// number of files the pool user may open in total
+	int nb_open;		// number of handles currently open
+	GHashTable *free_handles;	// image index -> GSList of unused handles
+	GQueue lru;		// unused handles, most recently released first
+	GMutex mutex;
+	GCond cond;
+	guint nb_misses;	// number of handles opened, for statistics
+};
+
+struct fits_handle_pool *fits_handle_pool_new(sequence *seq, int capacity, int max_files) {
+	if (capacity < 1)
+		return NULL;
+	struct fits_handle_pool *pool = calloc(1, sizeof(struct fits_handle_pool));
+	if (!pool) {
+		PRINT_ALLOC_ERR;
+		return NULL;
+	}
+	pool->seq = seq;
+	pool->capacity = capacity;
+	pool->max_files = max_files;
+	pool->free_handles = g_hash_table_new(g_direct_hash, g_direct_equal);
+	g_queue_init(&pool->lru);
+	g_mutex_init(&pool->mutex);
+	g_cond_init(&pool->cond);
+	siril_debug_print("FITS handle pool created with %d handles\n", capacity);
+	return pool;
+}
+
+// to be called with the mutex held
+static void put_free_handle(struct fits_handle_pool *pool, struct fits_handle *handle) {
+	gpointer key = GINT_TO_POINTER(handle->index);
+	GSList *list = g_hash_table_lookup(pool->free_handles, key);
+	g_hash_table_insert(pool->free_handles, key, g_slist_prepend(list, handle));
+	g_queue_push_head(&pool->lru, handle);
+	handle->lru_link = pool->lru.head;
+}
+
+// to be called with the mutex held
+static void take_free_handle(struct fits_handle_pool *pool, struct fits_handle *handle) {
+	gpointer key = GINT_TO_POINTER(handle->index);
+	GSList *list = g_hash_table_lookup(pool->free_handles, key);
+	list = g_slist_remove(list, handle);
+	if (list)
+		g_hash_table_insert(pool->free_handles, key, list);
+	else g_hash_table_remove(pool->free_handles, key);
+	g_queue_delete_link(&pool->lru, handle->lru_link);
+	handle->lru_link = NULL;
+}
+
+static int open_handle(struct fits_handle_pool *pool, struct fits_handle *handle) {
+	char filename[256];
+	int status = 0;
+	handle->fptr = NULL;
+	if (!fit_sequence_get_image_filename(pool->seq, handle->index, filename, TRUE))
+		return 1;
+	siril_fits_open_diskfile_img(&handle->fptr, filename, READONLY, &status);
+	if (status) {
+		fits_report_error(stderr, status);
+		handle->fptr = NULL;
+		return 1;
+	}
+	return 0;
+}
+
+/* gives an already opened handle to the pool, used to keep the handles
+ * opened when checking the images */
+int fits_handle_pool_adopt(struct fits_handle_pool *pool, int index, fitsfile *fptr) {
+	g_mutex_lock(&pool->mutex);
+	if (pool->nb_open >= pool->capacity) {
+		g_mutex_unlock(&pool->mutex);
+		return 1;
+	}
+	struct fits_handle *handle = malloc(sizeof(struct fits_handle));
+	if (!handle) {
+		g_mutex_unlock(&pool->mutex);
+		PRINT_ALLOC_ERR;
+		return 1;
+	}
+	handle->index = index;
+	handle->fptr = fptr;
+	pool->nb_open++;
+	put_free_handle(pool, handle);
+	g_mutex_unlock(&pool->mutex);
+	return 0;
+}
+
+/* returns a handle opened on the image index for the exclusive use of the
+ * calling thread, NULL on error. It must be given back with
+ * fits_handle_pool_release() */
+struct fits_handle *fits_handle_pool_acquire(struct fits_handle_pool *pool, int index) {
+	struct fits_handle *handle = NULL;
+	fitsfile *to_close = NULL;
+	g_mutex_lock(&pool->mutex);
+	while (!handle) {
+		GSList *list = g_hash_table_lookup(pool->free_handles, GINT_TO_POINTER(index));
+		if (list) {
+			handle = (struct fits_handle *)list->data;
+			take_free_handle(pool, handle);
+			g_mutex_unlock(&pool->mutex);
+			return handle;
+		}
+		if (pool->nb_open < pool->capacity) {
+			handle = malloc(sizeof(struct fits_handle));
+			if (!handle) {
+				g_mutex_unlock(&pool->mutex);
+				PRINT_ALLOC_ERR;
+				return NULL;
+			}
+			pool->nb_open++;
+		} else if (!g_queue_is_empty(&pool->lru)) {
+			// recycle the least recently used handle
+			handle = (struct fits_handle *)g_queue_peek_tail(&pool->lru);
+			take_free_handle(pool, handle);
+			to_close = handle->fptr;
+		} else {
+			// all handles are in use by other threads
+			g_cond_wait(&pool->cond, &pool->mutex);
+		}
+	}
+	pool->nb_misses++;
+	g_mutex_unlock(&pool->mutex);
+
+	// opening and closing files is done outside the lock
+	if (to_close) {
+		int status = 0;
+		fits_close_file(to_close, &status);
+	}
+	handle->index = index;
+	handle->lru_link = NULL;
+	if (open_handle(pool, handle)) {
+		g_mutex_lock(&pool->mutex);
+		pool->nb_open--;
+		g_cond_signal(&pool->cond);
+		g_mutex_unlock(&pool->mutex);
+		free(handle);
+		return NULL;
+	}
+	return handle;
+}
+
+void fits_handle_pool_release(struct fits_handle_pool *pool, struct fits_handle *handle) {
+	if (!handle)
+		return;
+	g_mutex_lock(&pool->mutex);
+	put_free_handle(pool, handle);
+	g_cond_signal(&pool->cond);
+	g_mutex_unlock(&pool->mutex);
+}
+
+/* TRUE if nb_files more files can be opened by the pool user while the pool
+ * is full */
+gboolean fits_handle_pool_has_room(const struct fits_handle_pool *pool, int nb_files) {
+	return pool->capacity + nb_files <= pool->max_files;
+}
+
+static void free_handle_list(gpointer key, gpointer value, gpointer data) {
+	g_slist_free((GSList *)value);
+}
+
+/* closes all handles, none must be in use */
+void fits_handle_pool_free(struct fits_handle_pool *pool) {
+	if (!pool)
+		return;
+	siril_debug_print("FITS handle pool: %u files opened for %d handles\n",
+			pool->nb_misses, pool->capacity);
+	struct fits_handle *handle;
+	while ((handle = g_queue_pop_head(&pool->lru))) {
+		int status = 0;
+		fits_close_file(handle->fptr, &status);
+		free(handle);
+	}
+	g_hash_table_foreach(pool->free_handles, free_handle_list, NULL);
+	g_hash_table_destroy(pool->free_handles);
+	g_mutex_clear(&pool->mutex);
+	g_cond_clear(&pool->cond);
+	free(pool);
+}
@@ -0,0 +1,23 @@
+#ifndef _FITS_HANDLE_POOL_H
+#define _FITS_HANDLE_POOL_H
+
+#include <fitsio.h>
+#include "core/siril.h"
+
+struct fits_handle_pool;
+
+/* a cfitsio handle on an image, used by one thread at a time */
+struct fits_handle {
+	int index;		// image index in the sequence
+	fitsfile *fptr;
+	GList *lru_link;	// link in the LRU queue of the pool, when not in use
+};
+
+struct fits_handle_pool *fits_handle_pool_new(sequence *seq, int capacity, int max_files);
+int fits_handle_pool_adopt(struct fits_handle_pool *pool, int index, fitsfile *fptr);
+struct fits_handle *fits_handle_pool_acquire(struct fits_handle_pool *pool, int index);
+void fits_handle_pool_release(struct fits_handle_pool *pool, struct fits_handle *handle);
+gboolean fits_handle_pool_has_room(const struct fits_handle_pool *pool, int nb_files);
+void fits_handle_pool_free(struct fits_handle_pool *pool);
+
+#endif
@@ -160,6 +160,7 @@ void fitseq_init_struct(fitseq *fitseq) {
 	fitseq->thread_fptr = NULL;
 	fitseq->num_threads = 0;
 	fitseq->writer = NULL;
+	fitseq->precompressed = NULL;
 }
 
 // opens a fitseq with iomode set to 0 (READONLY in most cases) or
@@ -350,6 +351,10 @@ int fitseq_create_file(const char *filename, fitseq *fitseq, int frame_count) {
 	fitseq->writer->write_image_hook = fitseq_write_image_for_writer;
 	fitseq->writer->sequence = fitseq;
 	fitseq->writer->output_type = SEQ_FITSEQ;
+	if (com.pref.comp.fits_enabled && fits_is_reentrant()) {
+		fitseq->precompressed = g_hash_table_new(g_direct_hash, g_direct_equal);
+		g_mutex_init(&fitseq->precompressed_mutex);
+	}
 	siril_debug_print("Successfully created the FITS sequence file %s, for %d images, waiting for data\n",
 			fitseq->filename, fitseq->frame_count);
 
@@ -358,9 +363,42 @@ int fitseq_create_file(const char *filename, fitseq *fitseq, int frame_count) {
 	return 0;
 }
 
+/* takes the in-memory compressed file of image if it was compressed by
+ * fitseq_write_image(), NULL otherwise */
+static fitsfile *fitseq_steal_precompressed(fitseq *fitseq, fits *image) {
+	if (!fitseq->precompressed)
+		return NULL;
+	g_mutex_lock(&fitseq->precompressed_mutex);
+	fitsfile *memfptr = g_hash_table_lookup(fitseq->precompressed, image);
+	if (memfptr)
+		g_hash_table_remove(fitseq->precompressed, image);
+	g_mutex_unlock(&fitseq->precompressed_mutex);
+	return memfptr;
+}
+
+static int fitseq_copy_precompressed(fitseq *fitseq, fitsfile *memfptr) {
+	int status = 0, nb_hdus = 0;
+	/* the compressed HDU is a binary table extension, cfitsio creates an
+	 * empty primary HDU for it on first compressed image creation */
+	fits_get_num_hdus(fitseq->fptr, &nb_hdus, &status);
+	if (!status && nb_hdus == 0)
+		fits_create_img(fitseq->fptr, BYTE_IMG, 0, NULL, &status);
+	if (!status)
+		fits_copy_hdu(memfptr, fitseq->fptr, 0, &status);
+	if (status)
+		report_fits_error(status);
+	int close_status = 0;
+	fits_close_file(memfptr, &close_status);
+	return status ? 1 : 0;
+}
+
 static int fitseq_write_image_for_writer(struct seqwriter_data *writer, fits *image, int index) {
 	fitseq *fitseq = (struct fits_sequence *)writer->sequence;
 	int status = 0;
+	fitsfile *memfptr = fitseq_steal_precompressed(fitseq, image);
+	if (memfptr)
+		return fitseq_copy_precompressed(fitseq, memfptr);
+
 	if (fits_create_img(fitseq->fptr, image->bitpix,
 				image->naxis, image->naxes, &status)) {
 		report_fits_error(status);
@@ -390,6 +428,24 @@ int fitseq_write_image(fitseq *fitseq, fits *image, int index) {
 		return 1;
 	}
 	siril_debug_print("FITS sequence %s pending image save %d\n", fitseq->filename, index);
+	if (image && fitseq->precompressed) {
+		/* compression is the slow part of the write and the writer
+		 * thread is alone, so it is done here by the processing
+		 * threads and the writer only copies the compressed HDU */
+		fitsfile *memfptr;
+		if (!siril_fits_compress_to_memory(image, &memfptr)) {
+			g_mutex_lock(&fitseq->precompressed_mutex);
+			g_hash_table_insert(fitseq->precompressed, image, memfptr);
+			g_mutex_unlock(&fitseq->precompressed_mutex);
+			// pixel data is not needed anymore, only the metadata
+			free(image->data);
+			free(image->fdata);
+			image->data = NULL;
+			image->fdata = NULL;
+			memset(image->pdata, 0, sizeof image->pdata);
+			memset(image->fpdata, 0, sizeof image->fpdata);
+		}
+	}
 	return seqwriter_append_write(fitseq->writer, image, index);
 }
 
@@ -405,6 +461,19 @@ static int fitseq_destroy(fitseq *fitseq, gboolean abort) {
 	if (frame_count == -1)
 		frame_count = fitseq->frame_count;
 	retval |= fitseq_multiple_close(fitseq);
+	if (fitseq->precompressed) {
+		// images not written because of an abort
+		GHashTableIter iter;
+		gpointer memfptr;
+		g_hash_table_iter_init(&iter, fitseq->precompressed);
+		while (g_hash_table_iter_next(&iter, NULL, &memfptr)) {
+			int status = 0;
+			fits_close_file((fitsfile *)memfptr, &status);
+		}
+		g_hash_table_destroy(fitseq->precompressed);
+		g_mutex_clear(&fitseq->precompressed_mutex);
+		fitseq->precompressed = NULL;
+	}
 	int status = 0;
 	fits_close_file(fitseq->fptr, &status);
 	if ((retval || !frame_count) && fitseq->filename) {
@@ -22,6 +22,8 @@ struct fits_sequence {
 	guint num_threads;	// size of thread_fptr
 
 	struct seqwriter_data *writer;
+	GHashTable *precompressed;	// images compressed by the processing threads
+	GMutex precompressed_mutex;	// and the in-memory files holding them
 };
 
 typedef struct fits_sequence fitseq;
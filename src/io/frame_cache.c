@@ -0,0 +1,274 @@
+/*
+ * This file is part of Siril, an astronomy image processor.
+ * Copyright (C) 2005-2011 Francois Meyer (dulle at free.fr)
+ * Copyright (C) 2012-2025 team free-astro (see more in AUTHORS file)
+ * Reference site is https://siril.org
+ *
+ * Siril is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Siril is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Siril. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* The frame cache keeps copies of the sequence frames read by the generic
+ * sequence processing, so that the commands of a script working on the same
+ * sequence one after the other, like seqstat, register and seqapplyreg, read
+ * each frame from the disk only once.
+ *
+ * It is disabled by default, and enabled by giving it an amount of memory with
+ * the core.frame_cache setting. When the budget is exceeded, the least recently
+ * used frames are dropped. A cached frame is identified by the absolute path of
+ * its file, its index in the file and its data type. It is only used if the
+ * file has the same modification time and size as when it was read, the time
+ * being compared with the resolution of the file system, nanoseconds on most,
+ * so that frames rewritten in the same second by a script are not reused.
+ *
+ * Entries are reference counted so that copying a frame out of the cache is
+ * done without holding the lock.
+ *
+ * Outside of scripts, the cache is cleared when a sequence is freed. The
+ * commands of a script free their sequence when they end, the cache is kept
+ * for the next commands and cleared at the end of the script.
+ */
+
+#include <string.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "core/siril.h"
+#include "core/proto.h"
+#include "core/OS_utils.h"
+#include "io/image_format_fits.h"
+#include "io/sequence.h"
+#include "io/ser.h"
+#include "io/fits_sequence.h"
+#include "frame_cache.h"
+
+struct cache_entry {
+	gchar *key;
+	gint64 mtime;		// of the file when the frame was read, in ns
+	gint64 size;		// same
+	fits *fit;
+	size_t cost;		// memory used by the frame
+	GList *link;		// position in the LRU list, NULL when removed
+	gint refcount;
+};
+
+struct frame_cache_slot {
+	gchar *key;
+	gint64 mtime;
+	gint64 size;
+};
+
+static GMutex cache_mutex;
+static GHashTable *cache_table = NULL;	// key -> entry
+static GQueue cache_lru = G_QUEUE_INIT;	// most recently used first
+static size_t cache_used = 0;
+
+static size_t get_cache_budget() {
+	if (com.pref.frame_cache_amount <= 0.0)
+		return 0;
+	return (size_t) (com.pref.frame_cache_amount * BYTES_IN_A_MB * 1024.0);
+}
+
+static void entry_unref(struct cache_entry *entry) {
+	if (g_atomic_int_dec_and_test(&entry->refcount)) {
+		clearfits(entry->fit);
+		free(entry->fit);
+		g_free(entry->key);
+		g_free(entry);
+	}
+}
+
+/* must be called with the lock held */
+static void remove_entry(struct cache_entry *entry) {
+	g_hash_table_remove(cache_table, entry->key);
+	g_queue_delete_link(&cache_lru, entry->link);
+	entry->link = NULL;
+	cache_used -= entry->cost;
+	entry_unref(entry);
+}
+
+/* must be called with the lock held */
+static void evict_to(size_t budget) {
+	while (cache_used > budget && cache_lru.tail)
+		remove_entry((struct cache_entry *) cache_lru.tail->data);
+}
+
+/* returns the key of the frame and the state of its file, NULL if the frame
+ * cannot be cached */
+static gchar *get_frame_key(sequence *seq, int index, gboolean force_float,
+		gint64 *mtime, gint64 *size) {
+	char filename[256];
+	const char *path;
+	int frame = 0, flags = force_float ? 1 : 0;
+	switch (seq->type) {
+		case SEQ_REGULAR:
+			if (!fit_sequence_get_image_filename(seq, index, filename, TRUE))
+				return NULL;
+			path = filename;
+			break;
+		case SEQ_SER:
+			if (!seq->ser_file)
+				return NULL;
+			path = seq->ser_file->filename;
+			frame = index;
+			if (com.pref.debayer.open_debayer)
+				flags |= 2;
+			break;
+		case SEQ_FITSEQ:
+			if (!seq->fitseq_file)
+				return NULL;
+			path = seq->fitseq_file->filename;
+			frame = index;
+			break;
+		default:
+			return NULL;
+	}
+	if (!path || get_file_state(path, mtime, size))
+		return NULL;
+	gchar *abspath = g_canonicalize_filename(path, NULL);
+	gchar *key = g_strdup_printf("%s|%d|%d", abspath, frame, flags);
+	g_free(abspath);
+	return key;
+}
+
+gchar *frame_cache_get_file_id(sequence *seq, int index) {
+	gint64 mtime, size;
+	gchar *key = get_frame_key(seq, index, FALSE, &mtime, &size);
+	if (!key)
+		return NULL;
+	gchar *id = g_strdup_printf("%s|%" G_GINT64_FORMAT "|%" G_GINT64_FORMAT, key, mtime, size);
+	g_free(key);
+	return id;
+}
+
+static int duplicate_frame(fits *from, fits *to) {
+	if (copyfits(from, to, CP_ALLOC | CP_COPYA | CP_FORMAT, -1))
+		return 1;
+	copy_fits_metadata(from, to);
+	if (from->header)
+		to->header = strdup(from->header);
+	if (from->history)
+		to->history = g_slist_copy_deep(from->history, (GCopyFunc) g_strdup, NULL);
+	return 0;
+}
+
+gboolean frame_cache_get(sequence *seq, int index, fits *dest, gboolean force_float,
+		frame_cache_slot **slot) {
+	*slot = NULL;
+	if (!get_cache_budget())
+		return FALSE;
+	gint64 mtime;
+	gint64 size;
+	gchar *key = get_frame_key(seq, index, force_float, &mtime, &size);
+	if (!key)
+		return FALSE;
+
+	struct cache_entry *entry = NULL;
+	g_mutex_lock(&cache_mutex);
+	if (cache_table)
+		entry = g_hash_table_lookup(cache_table, key);
+	if (entry && (entry->mtime != mtime || entry->size != size)) {
+		siril_debug_print("frame cache: file of frame %d has changed\n", index);
+		remove_entry(entry);
+		entry = NULL;
+	}
+	if (entry) {
+		g_queue_unlink(&cache_lru, entry->link);
+		g_queue_push_head_link(&cache_lru, entry->link);
+		g_atomic_int_inc(&entry->refcount);
+	}
+	g_mutex_unlock(&cache_mutex);
+	if (entry) {
+		g_free(key);
+		int retval = duplicate_frame(entry->fit, dest);
+		entry_unref(entry);
+		if (!retval)
+			return TRUE;
+		clearfits(dest);
+		return FALSE;
+	}
+
+	/* the state is taken before the frame is read: if the file is modified
+	 * during the read, the entry will not match the file */
+	*slot = g_new(frame_cache_slot, 1);
+	(*slot)->key = key;
+	(*slot)->mtime = mtime;
+	(*slot)->size = size;
+	return FALSE;
+}
+
+void frame_cache_put(frame_cache_slot *slot, fits *fit) {
+	if (!slot)
+		return;
+	gchar *key = slot->key;
+	gint64 mtime = slot->mtime, size = slot->size;
+	g_free(slot);
+	size_t budget = get_cache_budget();
+	if (!fit || !budget) {
+		g_free(key);
+		return;
+	}
+	size_t cost = fit->rx * fit->ry * fit->naxes[2] *
+		(fit->type == DATA_FLOAT ? sizeof(float) : sizeof(WORD));
+	if (cost > budget) {
+		g_free(key);
+		return;
+	}
+
+	struct cache_entry *entry = g_new0(struct cache_entry, 1);
+	entry->fit = calloc(1, sizeof(fits));
+	if (!entry->fit || duplicate_frame(fit, entry->fit)) {
+		free(entry->fit);
+		g_free(entry);
+		g_free(key);
+		return;
+	}
+	entry->key = key;
+	entry->mtime = mtime;
+	entry->size = size;
+	entry->cost = cost;
+	entry->refcount = 1;
+
+	g_mutex_lock(&cache_mutex);
+	if (!cache_table)
+		cache_table = g_hash_table_new(g_str_hash, g_str_equal);
+	struct cache_entry *old = g_hash_table_lookup(cache_table, key);
+	if (old)
+		remove_entry(old);
+	evict_to(budget - cost);
+	g_hash_table_insert(cache_table, entry->key, entry);
+	g_queue_push_head(&cache_lru, entry);
+	entry->link = cache_lru.head;
+	cache_used += cost;
+	g_mutex_unlock(&cache_mutex);
+}
+
+void frame_cache_clear() {
+	g_mutex_lock(&cache_mutex);
+	evict_to(0);
+	g_mutex_unlock(&cache_mutex);
+}
+
+void frame_cache_trim() {
+	size_t budget = get_cache_budget();
+	g_mutex_lock(&cache_mutex);
+	evict_to(budget);
+	g_mutex_unlock(&cache_mutex);
+}
+
+size_t frame_cache_get_used() {
+	g_mutex_lock(&cache_mutex);
+	size_t used = cache_used;
+	g_mutex_unlock(&cache_mutex);
+	return used;
+}
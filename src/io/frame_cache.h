@@ -0,0 +1,24 @@
+#ifndef FRAME_CACHE_H
+#define FRAME_CACHE_H
+
+#include "core/siril.h"
+
+typedef struct frame_cache_slot frame_cache_slot;
+
+/* copies the cached frame in dest, returning TRUE, if it is cached and its
+ * file has not changed. Otherwise, if the cache is enabled, slot is set to the
+ * state of the file before the frame is read, to be passed to frame_cache_put() */
+gboolean frame_cache_get(sequence *seq, int index, fits *dest, gboolean force_float,
+		frame_cache_slot **slot);
+/* adds a copy of the frame read for slot and frees slot, fit is NULL if the
+ * frame could not be read */
+void frame_cache_put(frame_cache_slot *slot, fits *fit);
+/* returns a string identifying the file of a frame and its state on disk, to
+ * key data derived from the frame in other caches, NULL if it is not a file */
+gchar *frame_cache_get_file_id(sequence *seq, int index);
+void frame_cache_clear();
+/* evicts frames until the cache fits in the core.frame_cache setting */
+void frame_cache_trim();
+size_t frame_cache_get_used();
+
+#endif
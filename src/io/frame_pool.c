@@ -0,0 +1,161 @@
+/*
+ * This file is part of Siril, an astronomy image processor.
+ * Copyright (C) 2005-2011 Francois Meyer (dulle at free.fr)
+ * Copyright (C) 2012-2025 team free-astro (see more in AUTHORS file)
+ * Reference site is https://siril.org
+ *
+ * Siril is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Siril is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Siril. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* The frame pool recycles the pixel buffers of the frames of a sequence
+ * processing: when a frame has been processed or written, its buffer is kept
+ * and given to a frame read later instead of being freed, which avoids a large
+ * allocation, its page faults and the zeroing of the memory by the system for
+ * each frame.
+ *
+ * Buffers are plain malloc'ed blocks, so a buffer from the pool can always be
+ * freed with free() and any buffer can be given to the pool. A buffer is
+ * reused for a request of the same size or slightly smaller, so that the
+ * frames of variable-size sequences can still use it. The pool only keeps as
+ * many buffers as the number of frames processed in parallel.
+ *
+ * The idle buffers are not part of the frames in the memory limits of the
+ * processing, so they are reserved from the memory governor while they are in
+ * the pool: a buffer that does not fit in the budget is freed instead of being
+ * kept, and the pool is emptied when a frame has to wait for memory. A buffer
+ * taken from the pool becomes part of the memory reserved for its frame. The
+ * buffers are released when the last user disables the pool, at the end of
+ * the processing.
+ */
+
+#include <string.h>
+#include <glib.h>
+
+#include "core/siril.h"
+#include "core/proto.h"
+#include "core/memory_governor.h"
+#include "io/image_format_fits.h"
+#include "frame_pool.h"
+
+/* a buffer is reused for requests down to 7/8 of its size */
+#define FRAME_POOL_SLACK 8
+
+struct pooled_buffer {
+	void *data;
+	size_t size;
+	guint MB;	// reserved from the memory governor
+};
+
+static GMutex pool_mutex;
+static GQueue pool_buffers = G_QUEUE_INIT;	// most recently released first
+static int pool_users = 0;
+static int pool_max_buffers = 0;
+
+static void free_pooled_buffer(gpointer data) {
+	struct pooled_buffer *buf = (struct pooled_buffer *) data;
+	memory_governor_release_idle(buf->MB);
+	free(buf->data);
+	g_free(buf);
+}
+
+/* called by the memory governor when a reservation has to wait */
+static void frame_pool_reclaim() {
+	g_mutex_lock(&pool_mutex);
+	if (!g_queue_is_empty(&pool_buffers))
+		siril_debug_print("frame pool: releasing %u buffers for memory\n", g_queue_get_length(&pool_buffers));
+	g_queue_clear_full(&pool_buffers, free_pooled_buffer);
+	g_mutex_unlock(&pool_mutex);
+}
+
+void frame_pool_enable(int max_buffers) {
+	g_mutex_lock(&pool_mutex);
+	if (pool_users == 0)
+		memory_governor_set_reclaim_func(frame_pool_reclaim);
+	pool_users++;
+	pool_max_buffers = max(pool_max_buffers, max_buffers);
+	g_mutex_unlock(&pool_mutex);
+}
+
+void frame_pool_disable() {
+	g_mutex_lock(&pool_mutex);
+	if (pool_users > 0 && --pool_users == 0) {
+		siril_debug_print("frame pool: releasing %u buffers\n", g_queue_get_length(&pool_buffers));
+		g_queue_clear_full(&pool_buffers, free_pooled_buffer);
+		pool_max_buffers = 0;
+		memory_governor_set_reclaim_func(NULL);
+	}
+	g_mutex_unlock(&pool_mutex);
+}
+
+void *frame_pool_alloc(size_t size) {
+	void *data = NULL;
+	g_mutex_lock(&pool_mutex);
+	GList *best = NULL;
+	for (GList *l = pool_buffers.head; l; l = l->next) {
+		struct pooled_buffer *buf = (struct pooled_buffer *) l->data;
+		if (buf->size < size || buf->size - buf->size / FRAME_POOL_SLACK > size)
+			continue;
+		if (!best || buf->size < ((struct pooled_buffer *) best->data)->size)
+			best = l;
+		if (buf->size == size)
+			break;
+	}
+	if (best) {
+		struct pooled_buffer *buf = (struct pooled_buffer *) best->data;
+		data = buf->data;
+		memory_governor_release_idle(buf->MB);
+		g_free(buf);
+		g_queue_delete_link(&pool_buffers, best);
+	}
+	g_mutex_unlock(&pool_mutex);
+	return data ? data : malloc(size);
+}
+
+void frame_pool_free(void *buffer, size_t size) {
+	if (!buffer)
+		return;
+	g_mutex_lock(&pool_mutex);
+	guint MB = (guint) ((size + BYTES_IN_A_MB - 1) / BYTES_IN_A_MB);
+	if (pool_users > 0 && size > 0 && memory_governor_try_reserve_idle(MB)) {
+		struct pooled_buffer *buf = g_new(struct pooled_buffer, 1);
+		buf->data = buffer;
+		buf->size = size;
+		buf->MB = MB;
+		g_queue_push_head(&pool_buffers, buf);
+		buffer = NULL;
+		/* drop the buffers least recently released */
+		while (g_queue_get_length(&pool_buffers) > (guint) pool_max_buffers)
+			free_pooled_buffer(g_queue_pop_tail(&pool_buffers));
+	}
+	g_mutex_unlock(&pool_mutex);
+	free(buffer);
+}
+
+void clearfits_to_pool(fits *fit) {
+	if (fit == NULL)
+		return;
+	/* the size from the dimensions can be smaller than the allocation, after
+	 * a crop for example, but never larger */
+	size_t nbdata = min((size_t) fit->rx * fit->ry, (size_t) fit->naxes[0] * fit->naxes[1]);
+	nbdata *= max(fit->naxes[2], 0L);
+	if (fit->data) {
+		frame_pool_free(fit->data, nbdata * sizeof(WORD));
+		fit->data = NULL;
+	}
+	if (fit->fdata) {
+		frame_pool_free(fit->fdata, nbdata * sizeof(float));
+		fit->fdata = NULL;
+	}
+	clearfits(fit);
+}
@@ -0,0 +1,21 @@
+#ifndef FRAME_POOL_H
+#define FRAME_POOL_H
+
+#include "core/siril.h"
+
+/* keeps the pixel buffers of the frames released by the sequence processing,
+ * to give them to the next frames read instead of allocating new ones, while
+ * at least one user has enabled it. max_buffers is the number of buffers that
+ * can be kept, usually the number of frames processed in parallel */
+void frame_pool_enable(int max_buffers);
+void frame_pool_disable();
+
+/* a buffer of at least size bytes, not initialized, to be freed with free()
+ * or given back with frame_pool_free() */
+void *frame_pool_alloc(size_t size);
+/* gives back a buffer allocated with malloc, of at least size bytes */
+void frame_pool_free(void *buffer, size_t size);
+/* same as clearfits(), giving the pixel buffers back to the pool */
+void clearfits_to_pool(fits *fit);
+
+#endif
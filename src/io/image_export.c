@@ -0,0 +1,152 @@
+/*
+ * This file is part of Siril, an astronomy image processor.
+ * Copyright (C) 2005-2011 Francois Meyer (dulle at free.fr)
+ * Copyright (C) 2012-2025 team free-astro (see more in AUTHORS file)
+ * Reference site is https://siril.org
+ *
+ * Siril is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Siril is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Siril. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* The images of the sequence are read and encoded by the generic sequence
+ * worker, as many at the same time as their encoding fits in memory. The
+ * threads not used by the images processed in parallel are given to their
+ * encoders, by the worker. */
+
+#include <glib.h>
+
+#include "core/siril.h"
+#include "core/proto.h"
+#include "core/processing.h"
+#include "core/siril_log.h"
+#include "io/sequence.h"
+#include "image_export.h"
+
+static const char *export_extension(image_type type) {
+	switch (type) {
+		case TYPEJPG:
+			return "jpg";
+		case TYPEPNG:
+			return "png";
+		case TYPEJXL:
+			return "jxl";
+		default:
+			return NULL;
+	}
+}
+
+/* the memory used to encode an image, in addition to the image itself:
+ * - JPEG: a colour managed copy of the image and the 8-bit buffer,
+ * - PNG: the interleaved buffer,
+ * - JPEG XL: the interleaved buffer and the working planes of the encoder, in
+ *   single precision, estimated to be 4 copies of the image */
+static int image_export_compute_mem_limits(struct generic_seq_args *args, gboolean for_writer) {
+	struct image_export_data *data = (struct image_export_data *) args->user;
+	unsigned int MB_per_image, MB_per_float_image, MB_avail;
+	int limit = compute_nb_images_fit_memory(args->seq, 1.0, FALSE, &MB_per_image, NULL, &MB_avail);
+	compute_nb_images_fit_memory(args->seq, 1.0, TRUE, &MB_per_float_image, NULL, NULL);
+	unsigned int required = MB_per_image;
+	if (limit > 0) {
+		switch (data->type) {
+			case TYPEJPG:
+				required = 3 * MB_per_image;
+				break;
+			case TYPEPNG:
+				required = 2 * MB_per_image;
+				break;
+			default:
+				required = 2 * MB_per_image + 4 * MB_per_float_image;
+		}
+		limit = MB_avail / required;
+	}
+	if (limit == 0) {
+		gchar *mem_per_image = g_format_size_full(required * BYTES_IN_A_MB, G_FORMAT_SIZE_IEC_UNITS);
+		gchar *mem_available = g_format_size_full(MB_avail * BYTES_IN_A_MB, G_FORMAT_SIZE_IEC_UNITS);
+
+		siril_log_color_message(_("%s: not enough memory to do this operation (%s required per image, %s considered available)\n"),
+				"red", args->description, mem_per_image, mem_available);
+
+		g_free(mem_per_image);
+		g_free(mem_available);
+	} else {
+#ifdef _OPENMP
+		if (limit > com.max_thread)
+			limit = com.max_thread;
+		siril_debug_print("Memory required per image: %u MB, limiting to %d images encoded at the same time\n",
+				required, limit);
+#else
+		limit = 1;
+#endif
+	}
+	return limit;
+}
+
+static int image_export_image_hook(struct generic_seq_args *args, int o, int i, fits *fit,
+		rectangle *_, int threads) {
+	struct image_export_data *data = (struct image_export_data *) args->user;
+	gchar *basename = g_path_get_basename(args->seq->seqname);
+	gchar *filename = g_strdup_printf("%s%s%0*d.%s", data->prefix ? data->prefix : "",
+			basename, args->seq->fixed, args->seq->imgparam[i].filenum,
+			export_extension(data->type));
+	g_free(basename);
+
+	int retval = 1;
+	switch (data->type) {
+#ifdef HAVE_LIBJPEG
+		case TYPEJPG:
+			retval = savejpg(filename, fit, (int) data->quality, FALSE, threads);
+			break;
+#endif
+#ifdef HAVE_LIBPNG
+		case TYPEPNG:
+			retval = savepng(filename, fit, fit->orig_bitpix != BYTE_IMG ? 2 : 1,
+					fit->naxes[2] == 3, threads);
+			break;
+#endif
+#ifdef HAVE_LIBJXL
+		case TYPEJXL:
+			retval = savejxl(filename, fit, data->effort, data->quality, data->force_8bit, threads);
+			break;
+#endif
+		default:
+			break;
+	}
+	if (retval)
+		siril_log_color_message(_("Image %d could not be exported to %s\n"), "red", i + 1, filename);
+	g_free(filename);
+	return retval;
+}
+
+static int image_export_finalize_hook(struct generic_seq_args *args) {
+	struct image_export_data *data = (struct image_export_data *) args->user;
+	g_free(data->prefix);
+	free(data);
+	args->user = NULL;
+	return 0;
+}
+
+void apply_image_export_to_sequence(struct image_export_data *data) {
+	struct generic_seq_args *args = create_default_seqargs(data->seq);
+	args->filtering_criterion = seq_filter_included;
+	args->nb_filtered_images = data->seq->selnum;
+	args->compute_mem_limits_hook = image_export_compute_mem_limits;
+	args->image_hook = image_export_image_hook;
+	args->finalize_hook = image_export_finalize_hook;
+	args->stop_on_error = FALSE;
+	args->description = _("Image export");
+	args->has_output = FALSE;
+	args->load_new_sequence = FALSE;
+	args->user = data;
+
+	start_in_new_thread(generic_sequence_worker, args);
+}
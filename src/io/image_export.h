@@ -0,0 +1,21 @@
+#ifndef IMAGE_EXPORT_H
+#define IMAGE_EXPORT_H
+
+#include "core/siril.h"
+
+/* Export of the images of a sequence to JPEG, PNG or JPEG XL files, several
+ * images being encoded at the same time, as many as fit in memory, and the
+ * threads shared between their encoders */
+struct image_export_data {
+	sequence *seq;
+	image_type type;	// TYPEJPG, TYPEPNG or TYPEJXL
+	double quality;		// JPEG and JPEG XL
+	int effort;		// JPEG XL
+	gboolean force_8bit;	// JPEG XL
+	gchar *prefix;
+};
+
+/* frees data when done */
+void apply_image_export_to_sequence(struct image_export_data *data);
+
+#endif
@@ -39,6 +39,8 @@
 #include "core/icc_profile.h"
 #include "io/sequence.h"
 #include "io/fits_sequence.h"
+#include "io/fits_handle_pool.h"
+#include "io/frame_pool.h"
 #include "gui/utils.h"
 #include "gui/progress_and_log.h"
 #include "gui/siril_preview.h"
@@ -599,6 +601,76 @@ static int siril_fits_move_first_image(fitsfile* fp) {
 	return status;
 }
 
+/* minimum number of rows decompressed by each thread */
+#define DECOMPRESSION_MIN_ROWS 64
+
+/* Reads a tile-compressed image with several threads when the read is not
+ * already done in a parallel region, each thread opening the file for itself
+ * and decompressing whole rows of tiles. nb_rows is the number of rows of all
+ * the planes, datatype and elem_size are those of dest. Returns -1 if the
+ * image cannot be read this way, the status of cfitsio otherwise. */
+static int read_compressed_image_parallel(fitsfile *fptr, int datatype, size_t elem_size,
+		long rx, long nb_rows, void *dest) {
+	int status = 0;
+#ifdef _OPENMP
+	if (!fits_is_compressed_image(fptr, &status) || !fits_is_reentrant() || omp_in_parallel())
+		return -1;
+	long tile_rows = 1;
+	if (fits_read_key(fptr, TLONG, "ZTILE2", &tile_rows, NULL, &status) || tile_rows < 1)
+		tile_rows = 1;
+	status = 0;
+	long nb_tiles = (nb_rows + tile_rows - 1) / tile_rows;
+	int nb_threads = (int) min(com.max_thread, nb_tiles * tile_rows / DECOMPRESSION_MIN_ROWS);
+	if (nb_threads < 2)
+		return -1;
+
+	char filename[FLEN_FILENAME];
+	int hdunum;
+	fits_file_name(fptr, filename, &status);
+	fits_get_hdu_num(fptr, &hdunum);
+	if (status || filename[0] == '\0' || !g_strcmp0(filename, "mem://"))
+		return -1;
+
+	int retval = 0;
+	gboolean failed_open = FALSE;
+#pragma omp parallel num_threads(nb_threads)
+	{
+		int thread = omp_get_thread_num();
+		int nb = omp_get_num_threads();
+		// rows of tiles of this thread, whole tiles are read
+		long first_tile = nb_tiles * thread / nb;
+		long end_tile = nb_tiles * (thread + 1) / nb;
+		long first_row = first_tile * tile_rows;
+		long end_row = min(end_tile * tile_rows, nb_rows);
+		int st = 0, zero = 0;
+		fitsfile *fp = NULL;
+		if (first_row < end_row) {
+			if (fits_open_diskfile(&fp, filename, READONLY, &st) ||
+					fits_movabs_hdu(fp, hdunum, NULL, &st)) {
+#pragma omp atomic write
+				failed_open = TRUE;
+			} else {
+				fits_read_img(fp, datatype, first_row * rx + 1, (end_row - first_row) * rx,
+						&zero, (char *) dest + (size_t) first_row * rx * elem_size, &zero, &st);
+				if (st) {
+#pragma omp atomic write
+					retval = st;
+				}
+			}
+			if (fp) {
+				int close_status = 0;
+				fits_close_file(fp, &close_status);
+			}
+		}
+	}
+	if (failed_open)
+		return -1;	// read it with the handle of the caller
+	return retval;
+#else
+	return -1;
+#endif
+}
+
 /* read buffer from an already open FITS file, fit should have all metadata
  * correct, and convert the buffer to fit->data with the given type, which
  * currently should be TBYTE or TUSHORT because fit doesn't contain other data.
@@ -620,7 +692,7 @@ int read_fits_with_convert(fits* fit, const char* filename, gboolean force_float
 		case SHORT_IMG:
 		case USHORT_IMG:
 			/* we store these types as unsigned short */
-			if ((fit->data = malloc(nbdata * sizeof(WORD))) == NULL) {
+			if ((fit->data = frame_pool_alloc(nbdata * sizeof(WORD))) == NULL) {
 				PRINT_ALLOC_ERR;
 				return -1;
 			}
@@ -640,7 +712,7 @@ int read_fits_with_convert(fits* fit, const char* filename, gboolean force_float
 		case DOUBLE_IMG:	// 64-bit floating point pixels
 		case FLOAT_IMG:		// 32-bit floating point pixels
 			/* we store these types as float */
-			if ((fit->fdata = malloc(nbdata * sizeof(float))) == NULL) {
+			if ((fit->fdata = frame_pool_alloc(nbdata * sizeof(float))) == NULL) {
 				PRINT_ALLOC_ERR;
 				return -1;
 			}
@@ -672,14 +744,24 @@ int read_fits_with_convert(fits* fit, const char* filename, gboolean force_float
 		free(data8);
 		break;
 	case SHORT_IMG:
-		fits_read_img(fit->fptr, TSHORT, 1, nbdata, &zero, fit->data, &zero, &status);
+		status = read_compressed_image_parallel(fit->fptr, TSHORT, sizeof(WORD),
+				fit->naxes[0], fit->naxes[1] * fit->naxes[2], fit->data);
+		if (status < 0) {
+			status = 0;
+			fits_read_img(fit->fptr, TSHORT, 1, nbdata, &zero, fit->data, &zero, &status);
+		}
 		if (status) break;
 		convert_data_ushort(fit->bitpix, fit->data, fit->data, nbdata, FALSE);
 		fit->bitpix = USHORT_IMG;
 		break;
 	case USHORT_IMG:
 		// siril 0.9 native, no conversion required
-		fits_read_img(fit->fptr, TUSHORT, 1, nbdata, &zero, fit->data, &zero, &status);
+		status = read_compressed_image_parallel(fit->fptr, TUSHORT, sizeof(WORD),
+				fit->naxes[0], fit->naxes[1] * fit->naxes[2], fit->data);
+		if (status < 0) {
+			status = 0;
+			fits_read_img(fit->fptr, TUSHORT, 1, nbdata, &zero, fit->data, &zero, &status);
+		}
 		if (status == NUM_OVERFLOW) {
 			// in case there are errors, we try short data
 			status = 0;
@@ -718,7 +800,12 @@ int read_fits_with_convert(fits* fit, const char* filename, gboolean force_float
 		/* we assume we are in the range [0, 1]. But, for some images
 		 * some values can be negative
 		 */
-		fits_read_img(fit->fptr, TFLOAT, 1, nbdata, &zero, fit->fdata, &zero, &status);
+		status = read_compressed_image_parallel(fit->fptr, TFLOAT, sizeof(float),
+				fit->naxes[0], fit->naxes[1] * fit->naxes[2], fit->fdata);
+		if (status < 0) {
+			status = 0;
+			fits_read_img(fit->fptr, TFLOAT, 1, nbdata, &zero, fit->fdata, &zero, &status);
+		}
 		if ((fit->bitpix == USHORT_IMG || fit->bitpix == SHORT_IMG
 				// needed for some FLOAT_IMG. 10.0 is probably a good number to represent the limit at which we judge that these are not clip-on pixels.
 				|| fit->bitpix == BYTE_IMG) || fit->keywords.data_max > 10.0) {
@@ -1599,6 +1686,76 @@ int readfits_partial_all_layers(const char *filename, fits *fit, const rectangle
 	return 0;
 }
 
+/* Reads the metadata of a FITS image and the rectangular area of all its
+ * layers, as readfits() would do followed by a crop to the area, area->y
+ * being counted from the top of the image. The area must be in the image. */
+int readfits_area(const char *filename, fits *fit, const rectangle *area, gboolean force_float) {
+	int status = 0;
+	siril_fits_open_diskfile_img(&(fit->fptr), filename, READONLY, &status);
+	if (status) {
+		report_fits_error(status);
+		return status;
+	}
+	if (read_fits_metadata(fit))
+		return 1;	// file closed by read_fits_metadata
+
+	int retval = 0;
+	long ry = fit->naxes[1];
+	if (area->x < 0 || area->y < 0 || area->w <= 0 || area->h <= 0 ||
+			area->x + area->w > fit->naxes[0] || area->y + area->h > ry) {
+		siril_debug_print("area %d,%d %dx%d is not in the image %s\n", area->x, area->y, area->w, area->h, filename);
+		retval = 1;
+		goto close_readfits_area;
+	}
+	fit->type = get_data_type(fit->bitpix);
+	if (fit->type == DATA_UNSUPPORTED) {
+		siril_log_message(_("Unknown FITS data format in internal conversion\n"));
+		retval = -1;
+		goto close_readfits_area;
+	}
+	size_t nbdata = (size_t) area->w * area->h;
+	int nblayer = fit->naxes[2];
+	size_t elem_size = fit->type == DATA_USHORT ? sizeof(WORD) : sizeof(float);
+	void *buffer = malloc(nblayer * nbdata * elem_size);
+	if (!buffer) {
+		PRINT_ALLOC_ERR;
+		retval = -1;
+		goto close_readfits_area;
+	}
+	for (int layer = 0; layer < nblayer; layer++) {
+		status = internal_read_partial_fits(fit->fptr, ry, fit->bitpix,
+				(char *) buffer + layer * nbdata * elem_size, layer, area);
+		if (status) {
+			report_fits_error(status);
+			free(buffer);
+			retval = status;
+			goto close_readfits_area;
+		}
+	}
+	fit->rx = fit->naxes[0] = area->w;
+	fit->ry = fit->naxes[1] = area->h;
+	fit->top_down = FALSE;
+	if (fit->type == DATA_USHORT) {
+		fit->data = buffer;
+		fit->pdata[RLAYER] = fit->data;
+		fit->pdata[GLAYER] = fit->data + (nblayer == 3 ? nbdata : 0);
+		fit->pdata[BLAYER] = fit->data + (nblayer == 3 ? nbdata * 2 : 0);
+		if (force_float)
+			fit_replace_buffer(fit, ushort_buffer_to_float(fit->data, nblayer * nbdata), DATA_FLOAT);
+	} else {
+		fit->fdata = buffer;
+		fit->fpdata[RLAYER] = fit->fdata;
+		fit->fpdata[GLAYER] = fit->fdata + (nblayer == 3 ? nbdata : 0);
+		fit->fpdata[BLAYER] = fit->fdata + (nblayer == 3 ? nbdata * 2 : 0);
+	}
+	check_profile_correct(fit);
+
+close_readfits_area:
+	status = 0;
+	fits_close_file(fit->fptr, &status);
+	return retval;
+}
+
 int read_fits_metadata(fits *fit) {
 	int status = 0;
 	fit->naxes[2] = 1;
@@ -1671,6 +1828,160 @@ int read_fits_metadata_from_path_first_HDU(const char *filename, fits *fit) {
 	return read_fits_metadata_from_path_internal(filename, fit, FALSE);
 }
 
+/* Header-only scan of FITS images
+ *
+ * For the first loading of sequences of thousands of images, opening each of
+ * them with cfitsio, which reads and parses the whole header, is too slow,
+ * on network storage in particular. Only the size and data type are needed,
+ * which are in the first cards of the header of the image HDU, so the header
+ * blocks are read directly until the END card. */
+#define FITS_HEADER_BLOCK 2880
+#define FITS_CARD 80
+#define MAX_SCANNED_BLOCKS 100
+
+struct fits_basic_header {
+	gboolean simple, image_extension, compressed, has_bzero;
+	int bitpix, naxis, zbitpix, znaxis;
+	long naxes[3], znaxes[3];
+	double bzero;
+};
+
+static gboolean card_is(const char *card, const char *keyword) {
+	size_t len = strlen(keyword);
+	if (strncmp(card, keyword, len))
+		return FALSE;
+	for (size_t i = len; i < 8; i++)
+		if (card[i] != ' ')
+			return FALSE;
+	return len == 8 || card[8] == '=' || !strcmp(keyword, "END");
+}
+
+static gboolean card_logical(const char *card) {
+	char value[FITS_CARD - 9];
+	memcpy(value, card + 10, FITS_CARD - 10);
+	value[FITS_CARD - 10] = '\0';
+	g_strchug(value);
+	return value[0] == 'T';
+}
+
+static long card_long(const char *card) {
+	char value[FITS_CARD - 9];
+	memcpy(value, card + 10, FITS_CARD - 10);
+	value[FITS_CARD - 10] = '\0';
+	return (long)g_ascii_strtoll(value, NULL, 10);
+}
+
+static double card_double(const char *card) {
+	char value[FITS_CARD - 9];
+	memcpy(value, card + 10, FITS_CARD - 10);
+	value[FITS_CARD - 10] = '\0';
+	return g_ascii_strtod(value, NULL);
+}
+
+/* reads the header at the current position of the file, until its END card */
+static int read_basic_header(FILE *f, struct fits_basic_header *hdr) {
+	static const char *naxes[] = { "NAXIS1", "NAXIS2", "NAXIS3" };
+	static const char *znaxes[] = { "ZNAXIS1", "ZNAXIS2", "ZNAXIS3" };
+	char block[FITS_HEADER_BLOCK];
+	memset(hdr, 0, sizeof(struct fits_basic_header));
+	for (int b = 0; b < MAX_SCANNED_BLOCKS; b++) {
+		if (fread(block, 1, FITS_HEADER_BLOCK, f) != FITS_HEADER_BLOCK)
+			return 1;
+		for (int c = 0; c < FITS_HEADER_BLOCK / FITS_CARD; c++) {
+			const char *card = block + c * FITS_CARD;
+			if (card_is(card, "END"))
+				return 0;
+			if (card_is(card, "SIMPLE"))
+				hdr->simple = card_logical(card);
+			else if (card_is(card, "XTENSION"))
+				hdr->image_extension = !strncmp(card + 10, "'IMAGE", 6);
+			else if (card_is(card, "BITPIX"))
+				hdr->bitpix = (int)card_long(card);
+			else if (card_is(card, "NAXIS"))
+				hdr->naxis = (int)card_long(card);
+			else if (card_is(card, "ZIMAGE"))
+				hdr->compressed = card_logical(card);
+			else if (card_is(card, "ZBITPIX"))
+				hdr->zbitpix = (int)card_long(card);
+			else if (card_is(card, "ZNAXIS"))
+				hdr->znaxis = (int)card_long(card);
+			else if (card_is(card, "BZERO")) {
+				hdr->has_bzero = TRUE;
+				hdr->bzero = card_double(card);
+			}
+			else {
+				for (int i = 0; i < 3; i++) {
+					if (card_is(card, naxes[i]))
+						hdr->naxes[i] = card_long(card);
+					else if (card_is(card, znaxes[i]))
+						hdr->znaxes[i] = card_long(card);
+				}
+			}
+		}
+	}
+	return 1;
+}
+
+/* reads the size and data type of a FITS image from its header only, setting
+ * rx, ry, naxis, naxes, bitpix and orig_bitpix of fit like
+ * read_fits_metadata_from_path() does, but nothing else.
+ * Returns 0 on success, non-zero if the image could not be identified that
+ * way, in which case it should be opened with cfitsio. */
+int read_fits_basic_info_from_path(const char *filename, fits *fit) {
+	struct fits_basic_header hdr;
+	int bitpix, naxis;
+	long *naxes;
+	FILE *f = g_fopen(filename, "rb");
+	if (!f)
+		return 1;
+	if (read_basic_header(f, &hdr) || !hdr.simple) {
+		fclose(f);
+		return 1;
+	}
+	if (hdr.naxis == 0) {
+		/* empty primary HDU, the image is in the first extension,
+		 * compressed or not, following immediately */
+		if (read_basic_header(f, &hdr) ||
+				(!hdr.image_extension && !hdr.compressed)) {
+			fclose(f);
+			return 1;
+		}
+	}
+	fclose(f);
+
+	if (hdr.compressed) {
+		bitpix = hdr.zbitpix;
+		naxis = hdr.znaxis;
+		naxes = hdr.znaxes;
+	} else {
+		bitpix = hdr.bitpix;
+		naxis = hdr.naxis;
+		naxes = hdr.naxes;
+	}
+	if ((naxis != 2 && naxis != 3) || naxes[0] <= 0 || naxes[1] <= 0 ||
+			bitpix == 0 || bitpix == LONGLONG_IMG)
+		return 1;
+
+	/* same as manage_bitpix() */
+	if (hdr.has_bzero) {
+		if (bitpix == SHORT_IMG && hdr.bzero != 0.0)
+			bitpix = USHORT_IMG;
+		else if (bitpix == LONG_IMG && hdr.bzero != 0.0)
+			bitpix = ULONG_IMG;
+	} else if (bitpix == SHORT_IMG)
+		bitpix = USHORT_IMG;
+
+	fit->bitpix = fit->orig_bitpix = bitpix;
+	fit->naxis = naxis;
+	fit->naxes[0] = naxes[0];
+	fit->naxes[1] = naxes[1];
+	/* same as read_fits_metadata() */
+	fit->naxes[2] = naxis == 3 ? 3 : 1;
+	fit->rx = fit->naxes[0];
+	fit->ry = fit->naxes[1];
+	return 0;
+}
+
 void flip_buffer(int bitpix, void *buffer, const rectangle *area) {
 	/* reverse the read data, because it's stored upside-down */
 	if (get_data_type(bitpix) == DATA_FLOAT) {
@@ -1708,7 +2019,7 @@ int read_opened_fits_partial(sequence *seq, int layer, int index, void *buffer,
 		const rectangle *area) {
 	int status;
 
-	if (!seq || !seq->fptr || !seq->fptr[index]) {
+	if (!seq || (!seq->fd_pool && (!seq->fptr || !seq->fptr[index]))) {
 		printf("data initialization error in read fits partial\n");
 		return 1;
 	}
@@ -1722,16 +2033,25 @@ int read_opened_fits_partial(sequence *seq, int layer, int index, void *buffer,
 		return 1;
 	}
 
+	if (seq->fd_pool) {
+		// the handle is for this thread only, no lock needed
+		struct fits_handle *handle = fits_handle_pool_acquire(seq->fd_pool, index);
+		if (!handle)
+			return 1;
+		status = internal_read_partial_fits(handle->fptr, ry, seq->bitpix, buffer, layer, area);
+		fits_handle_pool_release(seq->fd_pool, handle);
+	} else {
 #ifdef _OPENMP
-	g_assert(seq->fd_lock);
-	omp_set_lock(&seq->fd_lock[index]);
+		g_assert(seq->fd_lock);
+		omp_set_lock(&seq->fd_lock[index]);
 #endif
 
-	status = internal_read_partial_fits(seq->fptr[index], ry, seq->bitpix, buffer, layer, area);
+		status = internal_read_partial_fits(seq->fptr[index], ry, seq->bitpix, buffer, layer, area);
 
 #ifdef _OPENMP
-	omp_unset_lock(&seq->fd_lock[index]);
+		omp_unset_lock(&seq->fd_lock[index]);
 #endif
+	}
 	if (status)
 		return 1;
 
@@ -1793,6 +2113,42 @@ int siril_fits_compress(fits *f) {
 	return status;
 }
 
+/* Compresses f into a new in-memory FITS file, left opened on the compressed
+ * HDU. This allows the compression to run in the thread that produced the
+ * image, the HDU being then only copied to its final file. cfitsio must be
+ * reentrant for this to be used from several threads. */
+int siril_fits_compress_to_memory(fits *f, fitsfile **memfptr) {
+	int status = 0;
+	fitsfile *fptr = NULL;
+	if (fits_create_file(&fptr, "mem://", &status)) {
+		report_fits_error(status);
+		return 1;
+	}
+	f->fptr = fptr;
+	if (siril_fits_compress(f)) {
+		status = 0;
+		fits_close_file(fptr, &status);
+		f->fptr = NULL;
+		return 1;
+	}
+	if (fits_create_img(fptr, f->bitpix, f->naxis, f->naxes, &status)) {
+		report_fits_error(status);
+		status = 0;
+		fits_close_file(fptr, &status);
+		f->fptr = NULL;
+		return 1;
+	}
+	if (save_opened_fits(f)) {
+		status = 0;
+		fits_close_file(fptr, &status);
+		f->fptr = NULL;
+		return 1;
+	}
+	f->fptr = NULL;
+	*memfptr = fptr;
+	return 0;
+}
+
 gchar *set_right_extension(const char *name) {
 	gchar *filename = NULL;
 
@@ -3540,6 +3896,10 @@ int save_wcs_fits(fits *f, const gchar *name) {
 	return status;
 }
 
+/* version of the distance masks, increased when their computation changes so
+ * that the masks in the cache are computed again */
+#define MASK_VERSION 2
+
 // writes an 32b bit distance mask to disk
 int save_mask_fits(int rx, int ry, float *buffer, const gchar *name) {
 	int status;
@@ -3564,6 +3924,9 @@ int save_mask_fits(int rx, int ry, float *buffer, const gchar *name) {
 		return 1;
 	}
 
+	int version = MASK_VERSION;
+	fits_write_key(fptr, TINT, "MSKVERS", &version, "Version of the distance mask", &status);
+
 	if (fits_write_pix(fptr, TFLOAT, orig, (size_t)(rx * ry), buffer, &status)) {
 		report_fits_error(status);
 		return 1;
@@ -3578,6 +3941,21 @@ int save_mask_fits(int rx, int ry, float *buffer, const gchar *name) {
 	return status;
 }
 
+// checks that a cached mask has the given size and was computed by this version
+gboolean check_mask_fits(const gchar *name, int rx, int ry) {
+	int status = 0, version = 0;
+	fitsfile *fptr;
+	long naxes[2] = { 0L, 0L };
+
+	if (!name || siril_fits_open_diskfile_img(&fptr, name, READONLY, &status))
+		return FALSE;
+	fits_get_img_size(fptr, 2, naxes, &status);
+	fits_read_key(fptr, TINT, "MSKVERS", &version, NULL, &status);
+	int close_status = 0;
+	fits_close_file(fptr, &close_status);
+	return !status && naxes[0] == rx && naxes[1] == ry && version == MASK_VERSION;
+}
+
 // read an area form a 32b mask
 // we have this dedicated function to avoid the automatic rescaling
 // and dealing with all the types and headers
@@ -30,13 +30,16 @@ void clearfits_header(fits*);
 int readfits_partial(const char *filename, int layer, fits *fit,
 		const rectangle *area, gboolean read_date);
 int readfits_partial_all_layers(const char *filename, fits *fit, const rectangle *area);
+int readfits_area(const char *filename, fits *fit, const rectangle *area, gboolean force_float);
 int read_fits_metadata(fits *fit);
 int read_fits_metadata_from_path(const char *filename, fits *fit);
 int read_fits_metadata_from_path_first_HDU(const char *filename, fits *fit);
+int read_fits_basic_info_from_path(const char *filename, fits *fit);
 void flip_buffer(int bitpix, void *buffer, const rectangle *area);
 int read_opened_fits_partial(sequence *seq, int layer, int index, void *buffer,
 		const rectangle *area);
 int siril_fits_compress(fits *f);
+int siril_fits_compress_to_memory(fits *f, fitsfile **memfptr);
 int save_opened_fits(fits *f);
 gchar *set_right_extension(const char *name);
 int savefits(const char *name, fits *f);
@@ -92,5 +95,6 @@ int fits_swap_image_data(fits *a, fits *b);
 int save_wcs_fits(fits *f, const gchar *filename);
 int save_mask_fits(int rx, int ry, float *buffer, const gchar *name);
 int read_mask_fits_area(const gchar *name, rectangle *area, int ry, float *mask);
+gboolean check_mask_fits(const gchar *name, int rx, int ry);
 
 #endif
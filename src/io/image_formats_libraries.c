@@ -32,6 +32,9 @@
 #include <tiffio.h>
 #undef uint64
 #undef int64
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
 #endif
 #ifdef HAVE_LIBJPEG
 #include <jpeglib.h>
@@ -92,255 +95,6 @@ static void fill_date_obs_if_any(fits *fit, const char *file) {
 
 #ifdef HAVE_LIBTIFF
 
-static int readtifstrip(TIFF* tif, uint32_t width, uint32_t height, uint16_t nsamples, uint16_t color, WORD **data) {
-	uint32_t rowsperstrip;
-	uint16_t config;
-	int retval = nsamples;
-
-	TIFFGetFieldDefaulted(tif, TIFFTAG_PLANARCONFIG, &config);
-	TIFFGetFieldDefaulted(tif, TIFFTAG_ROWSPERSTRIP, &rowsperstrip);
-
-	size_t npixels = width * height;
-	*data = malloc(npixels * sizeof(WORD) * nsamples);
-	if (!*data) {
-		PRINT_ALLOC_ERR;
-		return OPEN_IMAGE_ERROR;
-	}
-	WORD *gbuf[3] = {*data, *data, *data};
-	if (nsamples == 4) {
-		siril_log_message(_("Alpha channel is ignored.\n"));
-	}
-	if ((nsamples == 3) || (nsamples == 4)) {
-		gbuf[GLAYER] = *data + npixels;
-		gbuf[BLAYER] = *data + npixels * 2;
-	}
-
-	const tmsize_t scanline = TIFFScanlineSize(tif);
-	WORD *buf = (WORD *)_TIFFmalloc(TIFFStripSize(tif));
-	if (!buf) {
-		PRINT_ALLOC_ERR;
-		return OPEN_IMAGE_ERROR;
-	}
-	for (uint32_t row = 0; row < height; row += rowsperstrip){
-		uint32_t nrow = (row + rowsperstrip > height ? height - row : rowsperstrip);
-		switch (config) {
-		case PLANARCONFIG_CONTIG:
-			if (TIFFReadEncodedStrip(tif, TIFFComputeStrip(tif, row, 0), buf, nrow * scanline) < 0) {
-				siril_log_color_message(_("An unexpected error was encountered while trying to read the file.\n"), "red");
-				retval = OPEN_IMAGE_ERROR;
-				break;
-			}
-			for (size_t i = 0; i < width * nrow; i++) {
-				if (color == PHOTOMETRIC_MINISWHITE) {
-					*gbuf[RLAYER]++ = USHRT_MAX - buf[i * nsamples + 0];
-				} else {
-					*gbuf[RLAYER]++ = buf[i * nsamples + 0];
-				}
-
-				if ((nsamples == 3) || (nsamples == 4)) {
-					if (color == PHOTOMETRIC_MINISWHITE) {
-						*gbuf[GLAYER]++ = USHRT_MAX - buf[i * nsamples + 1];
-						*gbuf[BLAYER]++ = USHRT_MAX - buf[i * nsamples + 2];
-					} else {
-						*gbuf[GLAYER]++ = buf[i * nsamples + 1];
-						*gbuf[BLAYER]++ = buf[i * nsamples + 2];
-					}
-				}
-			}
-			break;
-		case PLANARCONFIG_SEPARATE:
-			if (nsamples >= 3)		//don't need to read the alpha
-				nsamples = 3;
-			for (int j = 0; j < nsamples; j++) {	//loop on the layer
-				if (TIFFReadEncodedStrip(tif, TIFFComputeStrip(tif, row, j), buf, nrow * scanline) < 0) {
-					siril_log_color_message(_("An unexpected error was encountered while trying to read the file.\n"), "red");
-					retval = OPEN_IMAGE_ERROR;
-					break;
-				}
-				for (size_t i = 0; i < width * nrow; i++) {
-					if (color == PHOTOMETRIC_MINISWHITE) {
-						*gbuf[j]++ = USHRT_MAX - buf[i];
-					} else {
-						*gbuf[j]++ = buf[i];
-					}
-				}
-			}
-			break;
-		default:
-			siril_log_color_message(_("Unknown TIFF file.\n"), "red");
-			retval = OPEN_IMAGE_ERROR;
-		}
-	}
-	_TIFFfree(buf);
-	return retval;
-}
-
-static int readtifstrip32(TIFF* tif, uint32_t width, uint32_t height, uint16_t nsamples, uint16_t color, float **data) {
-	uint32_t rowsperstrip;
-	uint16_t config;
-	int retval = nsamples;
-
-	TIFFGetFieldDefaulted(tif, TIFFTAG_PLANARCONFIG, &config);
-	TIFFGetFieldDefaulted(tif, TIFFTAG_ROWSPERSTRIP, &rowsperstrip);
-
-	size_t npixels = width * height;
-	*data = malloc(npixels * sizeof(float) * nsamples);
-	if (!*data) {
-		PRINT_ALLOC_ERR;
-		return OPEN_IMAGE_ERROR;
-	}
-	float *gbuf[3] = { *data, *data, *data };
-	if (nsamples == 4) {
-		siril_log_message(_("Alpha channel is ignored.\n"));
-	}
-	if ((nsamples == 3) || (nsamples == 4)) {
-		gbuf[1] = *data + npixels;
-		gbuf[2] = *data + npixels * 2;
-	}
-
-	const tmsize_t scanline = TIFFScanlineSize(tif);
-	float *buf = (float *)_TIFFmalloc(TIFFStripSize(tif));
-	if (!buf) {
-		PRINT_ALLOC_ERR;
-		return OPEN_IMAGE_ERROR;
-	}
-	for (uint32_t row = 0; row < height; row += rowsperstrip) {
-		uint32_t nrow = (row + rowsperstrip > height ? height - row : rowsperstrip);
-		switch (config) {
-		case PLANARCONFIG_CONTIG:
-			if (TIFFReadEncodedStrip(tif, TIFFComputeStrip(tif, row, 0), buf, nrow * scanline) < 0) {
-				siril_log_color_message(_("An unexpected error was encountered while trying to read the file.\n"), "red");
-				retval = OPEN_IMAGE_ERROR;
-				break;
-			}
-			for (size_t i = 0; i < width * nrow; i++) {
-				if (color == PHOTOMETRIC_MINISWHITE) {
-					*gbuf[RLAYER]++ = USHRT_MAX_SINGLE - buf[i * nsamples + 0];
-				} else {
-					*gbuf[RLAYER]++ = buf[i * nsamples + 0];
-				}
-				if ((nsamples == 3) || (nsamples == 4)) {
-					if (color == PHOTOMETRIC_MINISWHITE) {
-						*gbuf[GLAYER]++ = USHRT_MAX_SINGLE - buf[i * nsamples + 1];
-						*gbuf[BLAYER]++ = USHRT_MAX_SINGLE - buf[i * nsamples + 2];
-					} else {
-						*gbuf[GLAYER]++ = buf[i * nsamples + 1];
-						*gbuf[BLAYER]++ = buf[i * nsamples + 2];
-					}
-				}
-			}
-			break;
-		case PLANARCONFIG_SEPARATE:
-			if (nsamples >= 3)		//don't need to read the alpha
-				nsamples = 3;
-			for (int j = 0; j < nsamples; j++) {	//loop on the layer
-				if (TIFFReadEncodedStrip(tif, TIFFComputeStrip(tif, row, j),
-						buf, nrow * scanline) < 0) {
-					siril_log_color_message(_("An unexpected error was encountered while trying to read the file.\n"), "red");
-					retval = OPEN_IMAGE_ERROR;
-					break;
-				}
-				for (size_t i = 0; i < width * nrow; i++) {
-					if (color == PHOTOMETRIC_MINISWHITE) {
-						*gbuf[j]++ = USHRT_MAX_SINGLE - buf[i];
-					} else {
-						*gbuf[j]++ = buf[i];
-					}
-				}
-			}
-			break;
-		default:
-			siril_log_color_message(_("Unknown TIFF file.\n"), "red");
-			retval = OPEN_IMAGE_ERROR;
-		}
-	}
-	_TIFFfree(buf);
-	return retval;
-}
-
-static int readtifstrip32uint(TIFF* tif, uint32_t width, uint32_t height, uint16_t nsamples, uint16_t color, float **data) {
-	uint32_t rowsperstrip;
-	uint16_t config;
-	int retval = nsamples;
-
-	TIFFGetFieldDefaulted(tif, TIFFTAG_PLANARCONFIG, &config);
-	TIFFGetFieldDefaulted(tif, TIFFTAG_ROWSPERSTRIP, &rowsperstrip);
-
-	size_t npixels = width * height;
-	*data = malloc(npixels * sizeof(float) * nsamples);
-	if (!*data) {
-		PRINT_ALLOC_ERR;
-		return OPEN_IMAGE_ERROR;
-	}
-	float *gbuf[3] = { *data, *data, *data };
-	if (nsamples == 4) {
-		siril_log_message(_("Alpha channel is ignored.\n"));
-	}
-	if ((nsamples == 3) || (nsamples == 4)) {
-		gbuf[1] = *data + npixels;
-		gbuf[2] = *data + npixels * 2;
-	}
-
-	const tmsize_t scanline = TIFFScanlineSize(tif);
-	uint32_t *buf = (uint32_t *)_TIFFmalloc(TIFFStripSize(tif));
-	if (!buf) {
-		PRINT_ALLOC_ERR;
-		return OPEN_IMAGE_ERROR;
-	}
-	for (uint32_t row = 0; row < height; row += rowsperstrip) {
-		uint32_t nrow = (row + rowsperstrip > height ? height - row : rowsperstrip);
-		switch (config) {
-		case PLANARCONFIG_CONTIG:
-			if (TIFFReadEncodedStrip(tif, TIFFComputeStrip(tif, row, 0), buf, nrow * scanline) < 0) {
-				siril_log_color_message(_("An unexpected error was encountered while trying to read the file.\n"), "red");
-				retval = OPEN_IMAGE_ERROR;
-				break;
-			}
-			for (size_t i = 0; i < width * nrow; i++) {
-				if (color == PHOTOMETRIC_MINISWHITE) {
-					*gbuf[RLAYER]++ = USHRT_MAX_SINGLE - (buf[i * nsamples + 0] / (float) UINT32_MAX);
-				} else {
-					*gbuf[RLAYER]++ = buf[i * nsamples + 0] / (float) UINT32_MAX;
-				}
-				if ((nsamples == 3) || (nsamples == 4)) {
-					if (color == PHOTOMETRIC_MINISWHITE) {
-						*gbuf[GLAYER]++ = USHRT_MAX_SINGLE - (buf[i * nsamples + 1] / (float) UINT32_MAX);
-						*gbuf[BLAYER]++ = USHRT_MAX_SINGLE - (buf[i * nsamples + 2] / (float) UINT32_MAX);
-					} else {
-						*gbuf[GLAYER]++ = buf[i * nsamples + 1] / (float) UINT32_MAX;
-						*gbuf[BLAYER]++ = buf[i * nsamples + 2] / (float) UINT32_MAX;
-					}
-				}
-			}
-			break;
-		case PLANARCONFIG_SEPARATE:
-			if (nsamples >= 3)		//don't need to read the alpha
-				nsamples = 3;
-			for (int j = 0; j < nsamples; j++) {	//loop on the layer
-				if (TIFFReadEncodedStrip(tif, TIFFComputeStrip(tif, row, j),
-						buf, nrow * scanline) < 0) {
-					siril_log_color_message(_("An unexpected error was encountered while trying to read the file.\n"), "red");
-					retval = OPEN_IMAGE_ERROR;
-					break;
-				}
-				for (size_t i = 0; i < width * nrow; i++) {
-					if (color == PHOTOMETRIC_MINISWHITE) {
-						*gbuf[j]++ = USHRT_MAX_SINGLE - (buf[i] / (float) UINT32_MAX);
-					} else {
-						*gbuf[j]++ = buf[i] / (float) UINT32_MAX;
-					}
-				}
-			}
-			break;
-		default:
-			siril_log_color_message(_("Unknown TIFF file.\n"), "red");
-			retval = OPEN_IMAGE_ERROR;
-		}
-	}
-	_TIFFfree(buf);
-	return retval;
-}
-
 static int readtif8bits(TIFF* tif, uint32_t width, uint32_t height, uint16_t nsamples, uint16_t color, WORD **data) {
 	int retval = nsamples;
 
@@ -419,6 +173,156 @@ static TIFF* Siril_TIFFOpen(const char *name, const char *mode) {
 #endif
 }
 
+typedef enum {
+	TIFF_SAMPLE_UINT16,
+	TIFF_SAMPLE_UINT32,
+	TIFF_SAMPLE_FLOAT
+} tiff_sample_type;
+
+/* converts n samples, separated by stride samples in src, to the output type */
+static void convert_tif_samples(const void *src, int stride, uint32_t n,
+		tiff_sample_type type, gboolean miniswhite, void *dst) {
+	switch (type) {
+		case TIFF_SAMPLE_UINT16:
+			{
+				const uint16_t *in = (const uint16_t *)src;
+				WORD *out = (WORD *)dst;
+				for (uint32_t i = 0; i < n; i++)
+					out[i] = miniswhite ? USHRT_MAX - in[i * stride] : in[i * stride];
+			}
+			break;
+		case TIFF_SAMPLE_UINT32:
+			{
+				const uint32_t *in = (const uint32_t *)src;
+				float *out = (float *)dst;
+				for (uint32_t i = 0; i < n; i++) {
+					float value = in[i * stride] / (float) UINT32_MAX;
+					out[i] = miniswhite ? USHRT_MAX_SINGLE - value : value;
+				}
+			}
+			break;
+		case TIFF_SAMPLE_FLOAT:
+			{
+				const float *in = (const float *)src;
+				float *out = (float *)dst;
+				for (uint32_t i = 0; i < n; i++)
+					out[i] = miniswhite ? USHRT_MAX_SINGLE - in[i * stride] : in[i * stride];
+			}
+			break;
+	}
+}
+
+/* Reads the strips or tiles of a 16 or 32-bit TIFF image into a planar
+ * buffer. They are independent, so they are decoded in parallel, each thread
+ * having its own handle on the file since a TIFF handle cannot be shared. */
+static int readtif_blocks(TIFF* tif, const char *name, uint32_t width, uint32_t height,
+		uint16_t nsamples, uint16_t color, tiff_sample_type type, void **data) {
+	uint16_t config;
+	uint32_t block_w, block_h;
+	int retval = nsamples;
+
+	TIFFGetFieldDefaulted(tif, TIFFTAG_PLANARCONFIG, &config);
+	if (config != PLANARCONFIG_CONTIG && config != PLANARCONFIG_SEPARATE) {
+		siril_log_color_message(_("Unknown TIFF file.\n"), "red");
+		return OPEN_IMAGE_ERROR;
+	}
+	gboolean tiled = TIFFIsTiled(tif);
+	if (tiled) {
+		TIFFGetField(tif, TIFFTAG_TILEWIDTH, &block_w);
+		TIFFGetField(tif, TIFFTAG_TILELENGTH, &block_h);
+	} else {
+		block_w = width;
+		TIFFGetFieldDefaulted(tif, TIFFTAG_ROWSPERSTRIP, &block_h);
+		if (block_h > height)
+			block_h = height;
+	}
+	tmsize_t block_size = tiled ? TIFFTileSize(tif) : TIFFStripSize(tif);
+	if (block_w == 0 || block_h == 0 || block_size <= 0) {
+		siril_log_color_message(_("Unknown TIFF file.\n"), "red");
+		return OPEN_IMAGE_ERROR;
+	}
+
+	if (nsamples == 4) {
+		siril_log_message(_("Alpha channel is ignored.\n"));
+	}
+	// the alpha channel, if any, is not read
+	int nb_layers = nsamples >= 3 ? 3 : 1;
+	size_t out_size = type == TIFF_SAMPLE_UINT16 ? sizeof(WORD) : sizeof(float);
+	size_t sample_size = type == TIFF_SAMPLE_UINT16 ? sizeof(uint16_t) : sizeof(uint32_t);
+	size_t npixels = (size_t) width * height;
+	*data = malloc(npixels * out_size * nb_layers);
+	if (!*data) {
+		PRINT_ALLOC_ERR;
+		return OPEN_IMAGE_ERROR;
+	}
+
+	int planes = config == PLANARCONFIG_SEPARATE ? nb_layers : 1;
+	int stride = config == PLANARCONFIG_CONTIG ? nsamples : 1;
+	uint32_t blocks_across = (width + block_w - 1) / block_w;
+	uint32_t blocks_down = (height + block_h - 1) / block_h;
+	size_t blocks_per_plane = (size_t) blocks_across * blocks_down;
+	size_t nb_blocks = blocks_per_plane * planes;
+	gboolean miniswhite = color == PHOTOMETRIC_MINISWHITE;
+	gint error = 0;
+#ifdef _OPENMP
+	int nb_threads = nb_blocks < (size_t) com.max_thread ? (int) nb_blocks : com.max_thread;
+#pragma omp parallel num_threads(nb_threads) if (nb_threads > 1)
+#endif
+	{
+		TIFF *thread_tif = tif;
+#ifdef _OPENMP
+		if (omp_get_thread_num() > 0)
+			thread_tif = Siril_TIFFOpen(name, "r");
+#endif
+		void *buf = thread_tif ? _TIFFmalloc(block_size) : NULL;
+		if (!buf)
+			g_atomic_int_set(&error, 1);
+#ifdef _OPENMP
+#pragma omp for schedule(dynamic)
+#endif
+		for (size_t b = 0; b < nb_blocks; b++) {
+			if (!buf || g_atomic_int_get(&error))
+				continue;
+			uint32_t plane = b / blocks_per_plane;
+			size_t index = b % blocks_per_plane;
+			uint32_t x0 = (index % blocks_across) * block_w;
+			uint32_t y0 = (index / blocks_across) * block_h;
+			uint32_t w = min(block_w, width - x0);
+			uint32_t h = min(block_h, height - y0);
+			tmsize_t ret = tiled ?
+				TIFFReadEncodedTile(thread_tif, TIFFComputeTile(thread_tif, x0, y0, 0, plane), buf, (tmsize_t) -1) :
+				TIFFReadEncodedStrip(thread_tif, TIFFComputeStrip(thread_tif, y0, plane), buf, (tmsize_t) -1);
+			if (ret < 0) {
+				g_atomic_int_set(&error, 1);
+				continue;
+			}
+			int first_layer = config == PLANARCONFIG_SEPARATE ? plane : 0;
+			int last_layer = config == PLANARCONFIG_SEPARATE ? plane : nb_layers - 1;
+			for (int layer = first_layer; layer <= last_layer; layer++) {
+				int sample = config == PLANARCONFIG_SEPARATE ? 0 : layer;
+				for (uint32_t r = 0; r < h; r++) {
+					const guint8 *src = (const guint8 *) buf +
+						(((size_t) r * block_w) * stride + sample) * sample_size;
+					guint8 *dst = (guint8 *) *data +
+						(layer * npixels + (size_t)(y0 + r) * width + x0) * out_size;
+					convert_tif_samples(src, stride, w, type, miniswhite, dst);
+				}
+			}
+		}
+		if (buf)
+			_TIFFfree(buf);
+		if (thread_tif && thread_tif != tif)
+			TIFFClose(thread_tif);
+	}
+	if (error) {
+		siril_log_color_message(_("An unexpected error was encountered while trying to read the file.\n"), "red");
+		free(*data);
+		*data = NULL;
+		retval = OPEN_IMAGE_ERROR;
+	}
+	return retval;
+}
+
 /* reads a TIFF file and stores it in the fits argument.
  * If file loading fails, the argument is untouched.
  */
@@ -492,14 +396,17 @@ int readtif(const char *name, fits *fit, gboolean force_float, gboolean verbose)
 			break;
 
 		case 16:
-			retval = readtifstrip(tif, width, height, nsamples, color, &data);
+			retval = readtif_blocks(tif, name, width, height, nsamples, color,
+					TIFF_SAMPLE_UINT16, (void **) &data);
 			break;
 
 		case 32:
 			if (sampleformat == SAMPLEFORMAT_IEEEFP) {
-				retval = readtifstrip32(tif, width, height, nsamples, color, &fdata);
+				retval = readtif_blocks(tif, name, width, height, nsamples, color,
+						TIFF_SAMPLE_FLOAT, (void **) &fdata);
 			} else if (sampleformat == SAMPLEFORMAT_UINT) {
-				retval = readtifstrip32uint(tif, width, height, nsamples, color, &fdata);
+				retval = readtif_blocks(tif, name, width, height, nsamples, color,
+						TIFF_SAMPLE_UINT32, (void **) &fdata);
 			} else {
 				siril_log_color_message(_("Siril cannot read this TIFF format.\n"), "red");
 				retval = OPEN_IMAGE_ERROR;
@@ -684,11 +591,137 @@ void get_tif_data_from_ui(fits *fit, gchar **description, gchar **copyright) {
 }
 
 /*** This function save the current image into a uncompressed 8- or 16-bit file *************/
+#define TIFF_WRITE_STRIP_SIZE (256 * 1024)
+
+/* fills the TIFF rows [first_row, first_row + nrows[ of the image, rows of the
+ * file being stored from the top while siril's are from the bottom */
+static void fill_tif_rows(fits *fit, WORD **gbuf, float **gbuff, uint16_t bitspersample,
+		uint16_t nsamples, uint32_t first_row, uint32_t nrows, void *strip) {
+	const uint32_t width = (uint32_t) fit->rx;
+	const uint32_t height = (uint32_t) fit->ry;
+	for (uint32_t r = 0; r < nrows; r++) {
+		size_t row = height - 1 - (first_row + r);
+		size_t out = (size_t) r * width * nsamples;
+		switch (bitspersample) {
+			case 8:
+				{
+					BYTE *buf8 = (BYTE *) strip + out;
+					float norm = fit->orig_bitpix != BYTE_IMG ? UCHAR_MAX_SINGLE / USHRT_MAX_SINGLE : 1.f;
+					for (uint32_t col = 0; col < width; col++) {
+						for (uint16_t n = 0; n < nsamples; n++) {
+							buf8[col * nsamples + n] =
+								(fit->type == DATA_USHORT) ?
+								gbuf[n][col + row * width] * norm :
+								float_to_uchar_range(gbuff[n][col + row * width]);
+						}
+					}
+				}
+				break;
+			case 16:
+				{
+					WORD *buf16 = (WORD *) strip + out;
+					float norm = fit->orig_bitpix == BYTE_IMG ? USHRT_MAX_SINGLE / UCHAR_MAX_SINGLE : 1.f;
+					for (uint32_t col = 0; col < width; col++) {
+						for (uint16_t n = 0; n < nsamples; n++) {
+							buf16[col * nsamples + n] =
+								(fit->type == DATA_USHORT) ?
+								gbuf[n][col + row * width] * norm :
+								float_to_ushort_range(gbuff[n][col + row * width]);
+						}
+					}
+				}
+				break;
+			case 32:
+				{
+					float *buf32 = (float *) strip + out;
+					for (uint32_t col = 0; col < width; col++) {
+						for (uint16_t n = 0; n < nsamples; n++) {
+							buf32[col * nsamples + n] =
+								(fit->type == DATA_USHORT) ?
+								(fit->orig_bitpix == BYTE_IMG ?
+								 gbuf[n][col + row * width] / UCHAR_MAX_SINGLE :
+								 gbuf[n][col + row * width] / USHRT_MAX_SINGLE) : gbuff[n][col + row * width];
+						}
+					}
+				}
+				break;
+		}
+	}
+}
+
+/* Writes the pixel data in strips of about TIFF_WRITE_STRIP_SIZE bytes. Strips
+ * are filled, and deflated when zlib is available, in parallel by batches of
+ * com.max_thread, then written in order by the calling thread. */
+static int write_tif_strips(TIFF *tif, fits *fit, WORD **gbuf, float **gbuff,
+		uint16_t bitspersample, uint16_t nsamples, uint32_t rowsperstrip, gboolean compress) {
+	const uint32_t height = (uint32_t) fit->ry;
+	const size_t row_size = (size_t) fit->rx * nsamples * (bitspersample / 8);
+	const size_t strip_size = row_size * rowsperstrip;
+	const uint32_t nb_strips = (height + rowsperstrip - 1) / rowsperstrip;
+	int batch = max(1, min(com.max_thread, (int) nb_strips));
+	size_t dest_size = 0;
+	gboolean deflate = FALSE;
+#ifdef HAVE_ZLIB
+	deflate = compress;
+	if (deflate)
+		dest_size = compressBound(strip_size);
+#endif
+	guint8 *strips = malloc((strip_size + dest_size) * batch);
+	size_t *lengths = malloc(batch * sizeof(size_t));
+	if (!strips || !lengths) {
+		PRINT_ALLOC_ERR;
+		free(strips);
+		free(lengths);
+		return 1;
+	}
+	guint8 *compressed = strips + strip_size * batch;
+
+	int retval = 0;
+	for (uint32_t first = 0; first < nb_strips && !retval; first += batch) {
+		int nb = min(batch, (int) (nb_strips - first));
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(nb) schedule(static) if (nb > 1)
+#endif
+		for (int i = 0; i < nb; i++) {
+			uint32_t row = (first + i) * rowsperstrip;
+			uint32_t nrows = min(rowsperstrip, height - row);
+			guint8 *strip = strips + strip_size * i;
+			fill_tif_rows(fit, gbuf, gbuff, bitspersample, nsamples, row, nrows, strip);
+			lengths[i] = 0;
+#ifdef HAVE_ZLIB
+			if (deflate) {
+				uLongf dest_len = dest_size;
+				if (compress2(compressed + dest_size * i, &dest_len, strip,
+							row_size * nrows, Z_DEFAULT_COMPRESSION) == Z_OK)
+					lengths[i] = dest_len;
+			}
+#endif
+		}
+		for (int i = 0; i < nb; i++) {
+			uint32_t row = (first + i) * rowsperstrip;
+			uint32_t nrows = min(rowsperstrip, height - row);
+			tmsize_t ret;
+			/* a strip that failed to deflate is given to libtiff
+			 * which compresses it itself */
+			if (lengths[i])
+				ret = TIFFWriteRawStrip(tif, first + i, compressed + dest_size * i, lengths[i]);
+			else ret = TIFFWriteEncodedStrip(tif, first + i, strips + strip_size * i, row_size * nrows);
+			if (ret < 0) {
+				siril_debug_print("Error while writing in TIFF File.\n");
+				retval = 1;
+				break;
+			}
+		}
+	}
+	free(lengths);
+	free(strips);
+	return retval;
+}
+
 int savetif(const char *name, fits *fit, uint16_t bitspersample,
 		const gchar *description, const gchar *copyright,
 		gboolean tiff_compression, gboolean embeded_icc, gboolean verbose) {
 	int retval = 0;
-	float norm;
 	gchar *filename = g_strdup(name);
 	uint32_t profile_len = 0;
 	unsigned char *profile = NULL;
@@ -698,6 +731,12 @@ int savetif(const char *name, fits *fit, uint16_t bitspersample,
 		filename = str_append(&filename, ".tif");
 	}
 
+	if (bitspersample != 8 && bitspersample != 16 && bitspersample != 32) {
+		siril_log_color_message(_("Saving TIFF: Cannot write TIFF file.\n"), "red");
+		g_free(filename);
+		return OPEN_IMAGE_ERROR;
+	}
+
 	TIFF* tif = Siril_TIFFOpen(filename, "w");
 	if (!tif) {
 		siril_log_color_message(_("Siril cannot create TIFF file.\n"), "red");
@@ -717,7 +756,10 @@ int savetif(const char *name, fits *fit, uint16_t bitspersample,
 	TIFFSetField(tif, TIFFTAG_IMAGEWIDTH, width);
 	TIFFSetField(tif, TIFFTAG_IMAGELENGTH, height);
 	TIFFSetField(tif, TIFFTAG_ORIENTATION, ORIENTATION_TOPLEFT);
-	TIFFSetField(tif, TIFFTAG_ROWSPERSTRIP, TIFFDefaultStripSize(tif, -1));
+	/* large strips, so that they can be encoded in parallel */
+	uint32_t rowsperstrip = TIFF_WRITE_STRIP_SIZE / ((size_t) width * nsamples * (bitspersample / 8));
+	rowsperstrip = max(1, min(rowsperstrip, height));
+	TIFFSetField(tif, TIFFTAG_ROWSPERSTRIP, rowsperstrip);
 	TIFFSetField(tif, TIFFTAG_PLANARCONFIG, PLANARCONFIG_CONTIG);
 	TIFFSetField(tif, TIFFTAG_SAMPLESPERPIXEL, nsamples);
 	TIFFSetField(tif, TIFFTAG_COMPRESSION, tiff_compression ? COMPRESSION_ADOBE_DEFLATE : COMPRESSION_NONE);
@@ -775,12 +817,12 @@ int savetif(const char *name, fits *fit, uint16_t bitspersample,
 				switch (com.pref.icc.export_8bit_method) {
 					case EXPORT_SRGB:
 						srgb_mono_out = gray_srgbtrc();
-						save_transform = sirilCreateTransformTHR((threaded ? com.icc.context_threaded : com.icc.context_single), fit->icc_profile, trans_type, srgb_mono_out, trans_type, com.pref.icc.export_intent, 0);
+						save_transform = siril_transform_acquire((threaded ? com.icc.context_threaded : com.icc.context_single), fit->icc_profile, trans_type, srgb_mono_out, trans_type, com.pref.icc.export_intent, 0);
 						profile = get_icc_profile_data(srgb_mono_out, &profile_len);
 						cmsCloseProfile(srgb_mono_out);
 						break;
 					case EXPORT_WORKING:
-						save_transform = sirilCreateTransformTHR((threaded ? com.icc.context_threaded : com.icc.context_single), fit->icc_profile, trans_type, com.icc.mono_out, trans_type, com.pref.icc.export_intent, 0);
+						save_transform = siril_transform_acquire((threaded ? com.icc.context_threaded : com.icc.context_single), fit->icc_profile, trans_type, com.icc.mono_out, trans_type, com.pref.icc.export_intent, 0);
 						profile = get_icc_profile_data(com.icc.mono_out, &profile_len);
 						break;
 					case EXPORT_IMAGE_ICC:
@@ -794,11 +836,11 @@ int savetif(const char *name, fits *fit, uint16_t bitspersample,
 			} else { // rgb
 				switch (com.pref.icc.export_8bit_method) {
 					case EXPORT_SRGB:
-						save_transform = sirilCreateTransformTHR((threaded ? com.icc.context_threaded : com.icc.context_single), fit->icc_profile, trans_type, com.icc.srgb_out, trans_type, com.pref.icc.export_intent, 0);
+						save_transform = siril_transform_acquire((threaded ? com.icc.context_threaded : com.icc.context_single), fit->icc_profile, trans_type, com.icc.srgb_out, trans_type, com.pref.icc.export_intent, 0);
 						profile = get_icc_profile_data(com.icc.srgb_out, &profile_len);
 						break;
 					case EXPORT_WORKING:
-						save_transform = sirilCreateTransformTHR((threaded ? com.icc.context_threaded : com.icc.context_single), fit->icc_profile, trans_type, com.icc.working_out, trans_type, com.pref.icc.export_intent, 0);
+						save_transform = siril_transform_acquire((threaded ? com.icc.context_threaded : com.icc.context_single), fit->icc_profile, trans_type, com.icc.working_out, trans_type, com.pref.icc.export_intent, 0);
 						profile = get_icc_profile_data(com.icc.working_out, &profile_len);
 						break;
 					case EXPORT_IMAGE_ICC:
@@ -816,12 +858,12 @@ int savetif(const char *name, fits *fit, uint16_t bitspersample,
 				switch (com.pref.icc.export_16bit_method) {
 					case EXPORT_SRGB:
 						srgb_mono_out = gray_srgbtrc();
-						save_transform = sirilCreateTransformTHR((threaded ? com.icc.context_threaded : com.icc.context_single), fit->icc_profile, trans_type, srgb_mono_out, trans_type, com.pref.icc.export_intent, 0);
+						save_transform = siril_transform_acquire((threaded ? com.icc.context_threaded : com.icc.context_single), fit->icc_profile, trans_type, srgb_mono_out, trans_type, com.pref.icc.export_intent, 0);
 						profile = get_icc_profile_data(srgb_mono_out, &profile_len);
 						cmsCloseProfile(srgb_mono_out);
 						break;
 					case EXPORT_WORKING:
-						save_transform = sirilCreateTransformTHR((threaded ? com.icc.context_threaded : com.icc.context_single), fit->icc_profile, trans_type, com.icc.mono_out, trans_type, com.pref.icc.export_intent, 0);
+						save_transform = siril_transform_acquire((threaded ? com.icc.context_threaded : com.icc.context_single), fit->icc_profile, trans_type, com.icc.mono_out, trans_type, com.pref.icc.export_intent, 0);
 						profile = get_icc_profile_data(com.icc.mono_out, &profile_len);
 						break;
 					case EXPORT_IMAGE_ICC:
@@ -835,11 +877,11 @@ int savetif(const char *name, fits *fit, uint16_t bitspersample,
 			} else { // rgb
 				switch (com.pref.icc.export_16bit_method) {
 					case EXPORT_SRGB:
-						save_transform = sirilCreateTransformTHR((threaded ? com.icc.context_threaded : com.icc.context_single), fit->icc_profile, trans_type, com.icc.srgb_out, trans_type, com.pref.icc.export_intent, 0);
+						save_transform = siril_transform_acquire((threaded ? com.icc.context_threaded : com.icc.context_single), fit->icc_profile, trans_type, com.icc.srgb_out, trans_type, com.pref.icc.export_intent, 0);
 						profile = get_icc_profile_data(com.icc.srgb_out, &profile_len);
 						break;
 					case EXPORT_WORKING:
-						save_transform = sirilCreateTransformTHR((threaded ? com.icc.context_threaded : com.icc.context_single), fit->icc_profile, trans_type, com.icc.working_out, trans_type, com.pref.icc.export_intent, 0);
+						save_transform = siril_transform_acquire((threaded ? com.icc.context_threaded : com.icc.context_single), fit->icc_profile, trans_type, com.icc.working_out, trans_type, com.pref.icc.export_intent, 0);
 						profile = get_icc_profile_data(com.icc.working_out, &profile_len);
 						break;
 					case EXPORT_IMAGE_ICC:
@@ -857,7 +899,7 @@ int savetif(const char *name, fits *fit, uint16_t bitspersample,
 		cmsUInt32Number bytesperplane = npixels * datasize;
 		if (save_transform) { // For "use image ICC profile" save_transform will be NULL, no need to transform the data
 			cmsDoTransformLineStride(save_transform, buf, dest, width, height, bytesperline, bytesperline, bytesperplane, bytesperplane);
-			cmsDeleteTransform(save_transform);
+			siril_transform_release(save_transform);
 		} else {
 			memcpy(dest, buf, bytesperplane * nsamples);
 		}
@@ -876,97 +918,9 @@ int savetif(const char *name, fits *fit, uint16_t bitspersample,
 		TIFFSetField(tif, TIFFTAG_ICCPROFILE, profile_len, profile);
 	}
 
-	switch (bitspersample) {
-	case 8:
-		siril_debug_print("Saving 8-bit TIFF file.\n");
-		BYTE *buf8 = _TIFFmalloc(width * sizeof(unsigned char) * nsamples);
-		if (!buf8) {
-			PRINT_ALLOC_ERR;
-			retval = OPEN_IMAGE_ERROR;
-			write_ok = FALSE;
-			break;
-		}
-
-		norm = fit->orig_bitpix != BYTE_IMG ? UCHAR_MAX_SINGLE / USHRT_MAX_SINGLE : 1.f;
-
-		for (uint32_t row = height; row-- > 0;) {
-			for (uint32_t col = 0; col < width; col++) {
-				for (uint16_t n = 0; n < nsamples; n++) {
-					buf8[col * nsamples + n] =
-							(fit->type == DATA_USHORT) ?
-									gbuf[n][col + row * width] * norm :
-									float_to_uchar_range(gbuff[n][col + row * width]);
-				}
-			}
-			if (TIFFWriteScanline(tif, buf8, height - 1 - row, 0) < 0) {
-				siril_debug_print("Error while writing in TIFF File.\n");
-				retval = OPEN_IMAGE_ERROR;
-				write_ok = FALSE;
-				break;
-			}
-		}
-		_TIFFfree(buf8);
-		break;
-	case 16:
-		siril_debug_print("Saving 16-bit TIFF file.\n");
-		WORD *buf16 = _TIFFmalloc(width * sizeof(WORD) * nsamples);
-		if (!buf16) {
-			PRINT_ALLOC_ERR;
-			retval = OPEN_IMAGE_ERROR;
-			write_ok = FALSE;
-			break;
-		}
-
-		norm = fit->orig_bitpix == BYTE_IMG ? USHRT_MAX_SINGLE / UCHAR_MAX_SINGLE : 1.f;
-
-		for (uint32_t row = height; row-- > 0;) {
-			for (uint32_t col = 0; col < width; col++) {
-				for (uint16_t n = 0; n < nsamples; n++) {
-					buf16[col * nsamples + n] =
-							(fit->type == DATA_USHORT) ?
-									gbuf[n][(col + row * width)] * norm :
-									float_to_ushort_range(gbuff[n][col + row * width]);
-				}
-			}
-			if (TIFFWriteScanline(tif, buf16, height - 1 - row, 0) < 0) {
-				siril_debug_print("Error while writing in TIFF File.\n");
-				retval = OPEN_IMAGE_ERROR;
-				write_ok = FALSE;
-				break;
-			}
-		}
-		_TIFFfree(buf16);
-		break;
-	case 32:
-		siril_debug_print("Saving 32-bit TIFF file.\n");
-		float *buf32 = _TIFFmalloc(width * sizeof(float) * nsamples);
-		if (!buf32) {
-			PRINT_ALLOC_ERR;
-			retval = OPEN_IMAGE_ERROR;
-			write_ok = FALSE;
-			break;
-		}
-
-		for (uint32_t row = height; row-- > 0;) {
-			for (uint32_t col = 0; col < width; col++) {
-				for (uint16_t n = 0; n < nsamples; n++) {
-					buf32[col * nsamples + n] =
-							(fit->type == DATA_USHORT) ?
-									(fit->orig_bitpix == BYTE_IMG ?
-											gbuf[n][col + row * width] / UCHAR_MAX_SINGLE :
-											gbuf[n][col + row * width] / USHRT_MAX_SINGLE) : gbuff[n][col + row * width];
-				}
-			}
-			if (TIFFWriteScanline(tif, buf32, height - 1 - row, 0) < 0) {
-				siril_debug_print("Error while writing in TIFF File.\n");
-				retval = OPEN_IMAGE_ERROR;
-				write_ok = FALSE;
-				break;
-			}
-		}
-		_TIFFfree(buf32);
-		break;
-	default:		// Should not happen
+	siril_debug_print("Saving %d-bit TIFF file.\n", bitspersample);
+	if (write_tif_strips(tif, fit, gbuf, gbuff, bitspersample, nsamples,
+				rowsperstrip, tiff_compression)) {
 		retval = OPEN_IMAGE_ERROR;
 		write_ok = FALSE;
 	}
@@ -1001,7 +955,11 @@ int savetif(const char *name, fits *fit, uint16_t bitspersample,
 int readxisf(const char* name, fits *fit, gboolean force_float) {
 	struct xisf_data *xdata = (struct xisf_data *) calloc(1, sizeof(struct xisf_data));
 
-	siril_get_xisf_buffer(name, xdata);
+	if (siril_get_xisf_buffer(name, xdata, com.max_thread)) {
+		siril_log_color_message(_("Cannot read the XISF file %s\n"), "red", name);
+		free(xdata);
+		return OPEN_IMAGE_ERROR;
+	}
 	size_t npixels = xdata->width * xdata->height;
 
 	clearfits(fit);
@@ -1018,9 +976,6 @@ int readxisf(const char* name, fits *fit, gboolean force_float) {
 	fit->naxes[1] = xdata->height;
 	fit->naxes[2] = xdata->channelCount;
 
-	uint32_t *buffer32;
-	double *buffer64;
-
 	switch (xdata->sampleFormat) {
 	case BYTE_IMG:
 		fit->data = (WORD *)xdata->data;
@@ -1045,31 +1000,10 @@ int readxisf(const char* name, fits *fit, gboolean force_float) {
 		}
 		break;
 	case LONG_IMG:
-		buffer32 = (uint32_t *)xdata->data;
-		fit->fdata = (float *)xdata->data;
-		for (int i = 0; i < npixels * fit->naxes[2]; i++)
-			fit->fdata[i] = (float)buffer32[i] / 4294967295.f;
-
-		fit->fpdata[RLAYER] = fit->fdata;
-		fit->fpdata[GLAYER] = fit->naxes[2] == 3 ? fit->fdata + npixels : fit->fdata;
-		fit->fpdata[BLAYER] = fit->naxes[2] == 3 ? fit->fdata + npixels * 2 : fit->fdata;
-		fit->bitpix = fit->orig_bitpix = FLOAT_IMG;
-		fit->type = DATA_FLOAT;
-		break;
 	case FLOAT_IMG:
-		fit->fdata = (float *)xdata->data;
-		fit->fpdata[RLAYER] = fit->fdata;
-		fit->fpdata[GLAYER] = fit->naxes[2] == 3 ? fit->fdata + npixels : fit->fdata;
-		fit->fpdata[BLAYER] = fit->naxes[2] == 3 ? fit->fdata + npixels * 2 : fit->fdata;
-		fit->bitpix = fit->orig_bitpix = FLOAT_IMG;
-		fit->type = DATA_FLOAT;
-		break;
 	case DOUBLE_IMG:
-		buffer64 = (double *)xdata->data;
+		/* already converted to float by the reader */
 		fit->fdata = (float *)xdata->data;
-		for (int i = 0; i < npixels * fit->naxes[2]; i++)
-			fit->fdata[i] = (float)buffer64[i];
-
 		fit->fpdata[RLAYER] = fit->fdata;
 		fit->fpdata[GLAYER] = fit->naxes[2] == 3 ? fit->fdata + npixels : fit->fdata;
 		fit->fpdata[BLAYER] = fit->naxes[2] == 3 ? fit->fdata + npixels * 2 : fit->fdata;
@@ -1078,6 +1012,9 @@ int readxisf(const char* name, fits *fit, gboolean force_float) {
 		break;
 	default:
 		siril_log_message(_("This image type is not handled.\n"));
+		free(xdata->data);
+		free(xdata->icc_buffer);
+		free(xdata->fitsHeader);
 		free(xdata);
 		return -1;
 	}
@@ -1213,7 +1150,7 @@ int readjpg(const char* name, fits *fit){
 	return cinfo.output_components;
 }
 
-int savejpg(const char *name, fits *fit, int quality, gboolean verbose) {
+int savejpg(const char *name, fits *fit, int quality, gboolean verbose, int threads) {
 	struct jpeg_compress_struct cinfo;    // Basic info for JPEG properties.
 	struct jpeg_error_mgr jerr;           // In case of error.
 
@@ -1270,12 +1207,12 @@ int savejpg(const char *name, fits *fit, int quality, gboolean verbose) {
 			switch (com.pref.icc.export_8bit_method) {
 				case EXPORT_SRGB:
 					srgb_mono_out = gray_srgbtrc();
-					save_transform = sirilCreateTransformTHR((threaded ? com.icc.context_threaded : com.icc.context_single), fit->icc_profile, trans_type, srgb_mono_out, trans_type, com.pref.icc.export_intent, 0);
+					save_transform = siril_transform_acquire((threaded ? com.icc.context_threaded : com.icc.context_single), fit->icc_profile, trans_type, srgb_mono_out, trans_type, com.pref.icc.export_intent, 0);
 					profile = get_icc_profile_data(srgb_mono_out, &profile_len);
 					cmsCloseProfile(srgb_mono_out);
 					break;
 				case EXPORT_WORKING:
-					save_transform = sirilCreateTransformTHR((threaded ? com.icc.context_threaded : com.icc.context_single), fit->icc_profile, trans_type, com.icc.mono_out, trans_type, com.pref.icc.export_intent, 0);
+					save_transform = siril_transform_acquire((threaded ? com.icc.context_threaded : com.icc.context_single), fit->icc_profile, trans_type, com.icc.mono_out, trans_type, com.pref.icc.export_intent, 0);
 					profile = get_icc_profile_data(com.icc.mono_out, &profile_len);
 					break;
 				case EXPORT_IMAGE_ICC:
@@ -1289,11 +1226,11 @@ int savejpg(const char *name, fits *fit, int quality, gboolean verbose) {
 		} else { // rgb
 			switch (com.pref.icc.export_8bit_method) {
 				case EXPORT_SRGB:
-					save_transform = sirilCreateTransformTHR((threaded ? com.icc.context_threaded : com.icc.context_single), fit->icc_profile, trans_type, com.icc.srgb_out, trans_type, com.pref.icc.export_intent, 0);
+					save_transform = siril_transform_acquire((threaded ? com.icc.context_threaded : com.icc.context_single), fit->icc_profile, trans_type, com.icc.srgb_out, trans_type, com.pref.icc.export_intent, 0);
 					profile = get_icc_profile_data(com.icc.srgb_out, &profile_len);
 					break;
 				case EXPORT_WORKING:
-					save_transform = sirilCreateTransformTHR((threaded ? com.icc.context_threaded : com.icc.context_single), fit->icc_profile, trans_type, com.icc.working_out, trans_type, com.pref.icc.export_intent, 0);
+					save_transform = siril_transform_acquire((threaded ? com.icc.context_threaded : com.icc.context_single), fit->icc_profile, trans_type, com.icc.working_out, trans_type, com.pref.icc.export_intent, 0);
 					profile = get_icc_profile_data(com.icc.working_out, &profile_len);
 					break;
 				case EXPORT_IMAGE_ICC:
@@ -1308,10 +1245,10 @@ int savejpg(const char *name, fits *fit, int quality, gboolean verbose) {
 #else
 		if (nchans == 1) {
 			cmsHPROFILE srgb_mono_out = gray_srgbtrc();
-			save_transform = sirilCreateTransformTHR((threaded ? com.icc.context_threaded : com.icc.context_single), fit->icc_profile, trans_type, srgb_mono_out, trans_type, com.pref.icc.export_intent, 0);
+			save_transform = siril_transform_acquire((threaded ? com.icc.context_threaded : com.icc.context_single), fit->icc_profile, trans_type, srgb_mono_out, trans_type, com.pref.icc.export_intent, 0);
 			cmsCloseProfile(srgb_mono_out);
 		} else {
-			save_transform = sirilCreateTransformTHR((threaded ? com.icc.context_threaded : com.icc.context_single), fit->icc_profile, trans_type, com.icc.srgb_out, trans_type, com.pref.icc.export_intent, 0);
+			save_transform = siril_transform_acquire((threaded ? com.icc.context_threaded : com.icc.context_single), fit->icc_profile, trans_type, com.icc.srgb_out, trans_type, com.pref.icc.export_intent, 0);
 		}
 #endif
 		cmsUInt32Number datasize = fit->type == DATA_FLOAT ? sizeof(float) : sizeof(WORD);
@@ -1319,7 +1256,7 @@ int savejpg(const char *name, fits *fit, int quality, gboolean verbose) {
 		cmsUInt32Number bytesperplane = npixels * datasize;
 		if (save_transform) { // save_transform will be NULL if saving in the current image colorspace
 			cmsDoTransformLineStride(save_transform, buf, dest, fit->rx, fit->ry, bytesperline, bytesperline, bytesperplane, bytesperplane);
-			cmsDeleteTransform(save_transform);
+			siril_transform_release(save_transform);
 		}
 		gbuf[0] = (WORD*) dest;
 		gbuf[1] = (WORD*) dest + npixels;
@@ -1347,26 +1284,29 @@ int savejpg(const char *name, fits *fit, int quality, gboolean verbose) {
 	float norm = (fit->orig_bitpix != BYTE_IMG ?
 			UCHAR_MAX_SINGLE / USHRT_MAX_SINGLE : 1.f);
 
-	for (int i = (cinfo.image_height - 1); i >= 0; i--) {
-		for (int j = 0; j < cinfo.image_width; j++) {
-			int pixelIdx = ((i * cinfo.image_width) + j) * cinfo.input_components;
+	/* the image is stored bottom-up, the first row of the buffer is the last
+	 * one of the image */
+	const int width = cinfo.image_width, height = cinfo.image_height;
+	const int nb_comp = cinfo.input_components;
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(threads) schedule(static) if(threads > 1)
+#endif
+	for (int i = 0; i < height; i++) {
+		size_t src = (size_t) (height - 1 - i) * width;
+		unsigned char *row = image_buffer + (size_t) i * width * nb_comp;
+		for (int j = 0; j < width; j++, src++) {
+			unsigned char *pixel = row + (size_t) j * nb_comp;
 			if (fit->type == DATA_USHORT) {
-				WORD red = *gbuf[RLAYER]++;
-				image_buffer[pixelIdx + 0] = round_to_BYTE(red * norm); // r |-- Set r,g,b components to
-				if (cinfo.input_components == 3) {
-					WORD green = *gbuf[GLAYER]++;
-					WORD blue = *gbuf[BLAYER]++;
-					image_buffer[pixelIdx + 1] = round_to_BYTE(green * norm); // g |   make this pixel
-					image_buffer[pixelIdx + 2] = round_to_BYTE(blue * norm); // b |
+				pixel[0] = round_to_BYTE(gbuf[RLAYER][src] * norm);
+				if (nb_comp == 3) {
+					pixel[1] = round_to_BYTE(gbuf[GLAYER][src] * norm);
+					pixel[2] = round_to_BYTE(gbuf[BLAYER][src] * norm);
 				}
 			} else {
-				float red = *gbuff[RLAYER]++;
-				image_buffer[pixelIdx + 0] = float_to_uchar_range(red); // r |-- Set r,g,b components to
-				if (cinfo.input_components == 3) {
-					float green = *gbuff[GLAYER]++;
-					float blue = *gbuff[BLAYER]++;
-					image_buffer[pixelIdx + 1] = float_to_uchar_range(green); // g |   make this pixel
-					image_buffer[pixelIdx + 2] = float_to_uchar_range(blue); // b |
+				pixel[0] = float_to_uchar_range(gbuff[RLAYER][src]);
+				if (nb_comp == 3) {
+					pixel[1] = float_to_uchar_range(gbuff[GLAYER][src]);
+					pixel[2] = float_to_uchar_range(gbuff[BLAYER][src]);
 				}
 			}
 		}
@@ -1584,70 +1524,88 @@ int readpng(const char *name, fits* fit) {
 	return nbplanes;
 }
 
-static WORD *convert_data(fits *image) {
+/* interleaves the layers of the image in a new buffer, in parallel on the
+ * pixels */
+static WORD *convert_data(fits *image, int threads) {
 	size_t ndata = image->rx * image->ry;
 	int ch = image->naxes[2];
 
+	if (image->type != DATA_USHORT && image->type != DATA_FLOAT)
+		return NULL;
 	WORD *buffer = malloc(ndata * ch * sizeof(WORD));
 	if (!buffer) {
 		PRINT_ALLOC_ERR;
 		return NULL;
 	}
-	for (size_t i = 0, j = 0; i < ndata * ch; i += ch, j++) {
-		if (image->type == DATA_USHORT) {
-			buffer[i + 0] = image->pdata[RLAYER][j];
+	if (image->type == DATA_USHORT) {
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(threads) schedule(static) if(threads > 1)
+#endif
+		for (size_t j = 0; j < ndata; j++) {
+			WORD *pixel = buffer + j * ch;
+			pixel[0] = image->pdata[RLAYER][j];
 			if (ch > 1) {
-				buffer[i + 1] = image->pdata[GLAYER][j];
-				buffer[i + 2] = image->pdata[BLAYER][j];
+				pixel[1] = image->pdata[GLAYER][j];
+				pixel[2] = image->pdata[BLAYER][j];
 			}
-		} else if (image->type == DATA_FLOAT) {
-			buffer[i + 0] = float_to_ushort_range(image->fpdata[RLAYER][j]);
+		}
+	} else {
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(threads) schedule(static) if(threads > 1)
+#endif
+		for (size_t j = 0; j < ndata; j++) {
+			WORD *pixel = buffer + j * ch;
+			pixel[0] = float_to_ushort_range(image->fpdata[RLAYER][j]);
 			if (ch > 1) {
-				buffer[i + 1] = float_to_ushort_range(image->fpdata[GLAYER][j]);
-				buffer[i + 2] = float_to_ushort_range(image->fpdata[BLAYER][j]);
+				pixel[1] = float_to_ushort_range(image->fpdata[GLAYER][j]);
+				pixel[2] = float_to_ushort_range(image->fpdata[BLAYER][j]);
 			}
 		}
-		else {
-			free(buffer);
-			return NULL;
-		}
 	}
 	return buffer;
 }
 
-static uint8_t *convert_data8(fits *image) {
+static uint8_t *convert_data8(fits *image, int threads) {
 	size_t ndata = image->rx * image->ry;
 	const long ch = image->naxes[2];
 
+	if (image->type != DATA_USHORT && image->type != DATA_FLOAT)
+		return NULL;
 	uint8_t *buffer = malloc(ndata * ch * sizeof(uint8_t));
 	if (!buffer) {
 		PRINT_ALLOC_ERR;
 		return NULL;
 	}
-	for (size_t i = 0, j = 0; i < ndata * ch; i += ch, j++) {
-		if (image->type == DATA_USHORT) {
-			buffer[i + 0] = (uint8_t) image->pdata[RLAYER][j];
+	if (image->type == DATA_USHORT) {
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(threads) schedule(static) if(threads > 1)
+#endif
+		for (size_t j = 0; j < ndata; j++) {
+			uint8_t *pixel = buffer + j * ch;
+			pixel[0] = (uint8_t) image->pdata[RLAYER][j];
 			if (ch > 1) {
-				buffer[i + 1] = (uint8_t) image->pdata[GLAYER][j];
-				buffer[i + 2] = (uint8_t) image->pdata[BLAYER][j];
+				pixel[1] = (uint8_t) image->pdata[GLAYER][j];
+				pixel[2] = (uint8_t) image->pdata[BLAYER][j];
 			}
-		} else if (image->type == DATA_FLOAT) {
-			buffer[i + 0] = float_to_uchar_range(image->fpdata[RLAYER][j]);
+		}
+	} else {
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(threads) schedule(static) if(threads > 1)
+#endif
+		for (size_t j = 0; j < ndata; j++) {
+			uint8_t *pixel = buffer + j * ch;
+			pixel[0] = float_to_uchar_range(image->fpdata[RLAYER][j]);
 			if (ch > 1) {
-				buffer[i + 1] = float_to_uchar_range(image->fpdata[GLAYER][j]);
-				buffer[i + 2] = float_to_uchar_range(image->fpdata[BLAYER][j]);
+				pixel[1] = float_to_uchar_range(image->fpdata[GLAYER][j]);
+				pixel[2] = float_to_uchar_range(image->fpdata[BLAYER][j]);
 			}
 		}
-		else {
-			free(buffer);
-			return NULL;
-		}
 	}
 	return buffer;
 }
 
 int savepng(const char *name, fits *fit, uint32_t bytes_per_sample,
-		gboolean is_colour) {
+		gboolean is_colour, int threads) {
 	int32_t ret = -1;
 	png_structp png_ptr;
 	png_infop info_ptr;
@@ -1744,12 +1702,12 @@ int savepng(const char *name, fits *fit, uint32_t bytes_per_sample,
 				switch (com.pref.icc.export_8bit_method) {
 					case EXPORT_SRGB:
 						srgb_mono_out = gray_srgbtrc();
-						save_transform = sirilCreateTransformTHR((threaded ? com.icc.context_threaded : com.icc.context_single), fit->icc_profile, trans_type, srgb_mono_out, trans_type, com.pref.icc.export_intent, 0);
+						save_transform = siril_transform_acquire((threaded ? com.icc.context_threaded : com.icc.context_single), fit->icc_profile, trans_type, srgb_mono_out, trans_type, com.pref.icc.export_intent, 0);
 						profile = get_icc_profile_data(srgb_mono_out, &profile_len);
 						cmsCloseProfile(srgb_mono_out);
 						break;
 					case EXPORT_WORKING:
-						save_transform = sirilCreateTransformTHR((threaded ? com.icc.context_threaded : com.icc.context_single), fit->icc_profile, trans_type, com.icc.mono_out, trans_type, com.pref.icc.export_intent, 0);
+						save_transform = siril_transform_acquire((threaded ? com.icc.context_threaded : com.icc.context_single), fit->icc_profile, trans_type, com.icc.mono_out, trans_type, com.pref.icc.export_intent, 0);
 						profile = get_icc_profile_data(com.icc.mono_out, &profile_len);
 						break;
 					case EXPORT_IMAGE_ICC:
@@ -1762,11 +1720,11 @@ int savepng(const char *name, fits *fit, uint32_t bytes_per_sample,
 			} else { // rgb
 				switch (com.pref.icc.export_8bit_method) {
 					case EXPORT_SRGB:
-						save_transform = sirilCreateTransformTHR((threaded ? com.icc.context_threaded : com.icc.context_single), fit->icc_profile, trans_type, com.icc.srgb_out, trans_type, com.pref.icc.export_intent, 0);
+						save_transform = siril_transform_acquire((threaded ? com.icc.context_threaded : com.icc.context_single), fit->icc_profile, trans_type, com.icc.srgb_out, trans_type, com.pref.icc.export_intent, 0);
 						profile = get_icc_profile_data(com.icc.srgb_out, &profile_len);
 						break;
 					case EXPORT_WORKING:
-						save_transform = sirilCreateTransformTHR((threaded ? com.icc.context_threaded : com.icc.context_single), fit->icc_profile, trans_type, com.icc.working_out, trans_type, com.pref.icc.export_intent, 0);
+						save_transform = siril_transform_acquire((threaded ? com.icc.context_threaded : com.icc.context_single), fit->icc_profile, trans_type, com.icc.working_out, trans_type, com.pref.icc.export_intent, 0);
 						profile = get_icc_profile_data(com.icc.working_out, &profile_len);
 						break;
 					case EXPORT_IMAGE_ICC:
@@ -1784,12 +1742,12 @@ int savepng(const char *name, fits *fit, uint32_t bytes_per_sample,
 				switch (com.pref.icc.export_16bit_method) {
 					case EXPORT_SRGB:
 						srgb_mono_out = gray_srgbtrc();
-						save_transform = sirilCreateTransformTHR((threaded ? com.icc.context_threaded : com.icc.context_single), fit->icc_profile, trans_type, srgb_mono_out, trans_type, com.pref.icc.export_intent, 0);
+						save_transform = siril_transform_acquire((threaded ? com.icc.context_threaded : com.icc.context_single), fit->icc_profile, trans_type, srgb_mono_out, trans_type, com.pref.icc.export_intent, 0);
 						profile = get_icc_profile_data(srgb_mono_out, &profile_len);
 						cmsCloseProfile(srgb_mono_out);
 						break;
 					case EXPORT_WORKING:
-						save_transform = sirilCreateTransformTHR((threaded ? com.icc.context_threaded : com.icc.context_single), fit->icc_profile, trans_type, com.icc.mono_out, trans_type, com.pref.icc.export_intent, 0);
+						save_transform = siril_transform_acquire((threaded ? com.icc.context_threaded : com.icc.context_single), fit->icc_profile, trans_type, com.icc.mono_out, trans_type, com.pref.icc.export_intent, 0);
 						profile = get_icc_profile_data(com.icc.mono_out, &profile_len);
 						break;
 					case EXPORT_IMAGE_ICC:
@@ -1802,11 +1760,11 @@ int savepng(const char *name, fits *fit, uint32_t bytes_per_sample,
 			} else { // rgb
 				switch (com.pref.icc.export_16bit_method) {
 					case EXPORT_SRGB:
-						save_transform = sirilCreateTransformTHR((threaded ? com.icc.context_threaded : com.icc.context_single), fit->icc_profile, trans_type, com.icc.srgb_out, trans_type, com.pref.icc.export_intent, 0);
+						save_transform = siril_transform_acquire((threaded ? com.icc.context_threaded : com.icc.context_single), fit->icc_profile, trans_type, com.icc.srgb_out, trans_type, com.pref.icc.export_intent, 0);
 						profile = get_icc_profile_data(com.icc.srgb_out, &profile_len);
 						break;
 					case EXPORT_WORKING:
-						save_transform = sirilCreateTransformTHR((threaded ? com.icc.context_threaded : com.icc.context_single), fit->icc_profile, trans_type, com.icc.working_out, trans_type, com.pref.icc.export_intent, 0);
+						save_transform = siril_transform_acquire((threaded ? com.icc.context_threaded : com.icc.context_single), fit->icc_profile, trans_type, com.icc.working_out, trans_type, com.pref.icc.export_intent, 0);
 						profile = get_icc_profile_data(com.icc.working_out, &profile_len);
 						break;
 					case EXPORT_IMAGE_ICC:
@@ -1836,26 +1794,26 @@ int savepng(const char *name, fits *fit, uint32_t bytes_per_sample,
 	if (bytes_per_sample == 2) {
 		/* swap bytes of 16 bit files to most significant bit first */
 		png_set_swap(png_ptr);
-		data = convert_data(fit);
+		data = convert_data(fit, threads);
 		// Apply ICC transform (only for color managed images)
 		if (fit->color_managed && fit->icc_profile) {
 			cmsUInt32Number datasize = sizeof(WORD);
 			cmsUInt32Number bytesperline = fit->rx * datasize * fit->naxes[2];
 			cmsUInt32Number bytesperplane = fit->rx * fit->ry * datasize;
 			cmsDoTransformLineStride(save_transform, data, data, fit->rx, fit->ry, bytesperline, bytesperline, bytesperplane, bytesperplane);
-			cmsDeleteTransform(save_transform);
+			siril_transform_release(save_transform);
 		}
 		for (unsigned i = 0, j = height - 1; i < height; i++)
 			row_pointers[j--] = (png_bytep) ((uint16_t*) data + (size_t) samples_per_pixel * i * width);
 	} else {
-		data8 = convert_data8(fit);
+		data8 = convert_data8(fit, threads);
 		// Apply ICC transform
 		if (fit->color_managed && fit->icc_profile) {
 			cmsUInt32Number datasize = sizeof(BYTE);
 			cmsUInt32Number bytesperline = fit->rx * datasize;
 			cmsUInt32Number bytesperplane = fit->rx * fit->ry * datasize;
 			cmsDoTransformLineStride(save_transform, data8, data8, fit->rx, fit->ry, bytesperline, bytesperline, bytesperplane, bytesperplane);
-			cmsDeleteTransform(save_transform);
+			siril_transform_release(save_transform);
 		}
 		for (unsigned i = 0, j = height - 1; i < height; i++)
 			row_pointers[j--] = (uint8_t*) data8 + (size_t) samples_per_pixel * i * width;
@@ -1982,28 +1940,50 @@ static int fcol(libraw_data_t *raw, int row, int col) {
 	return FC(raw->idata.filters, row, col);
 }
 
-static int readraw_in_cfa(const char *name, fits *fit) {
+static void siril_libraw_close(libraw_data_t *raw, gchar *file_data) {
+	libraw_recycle(raw);
+	libraw_close(raw);
+	g_free(file_data);
+}
+
+/* With header_only, only the size and the metadata are read, the data of fit
+ * is not allocated. The messages describing the file are logged if verbose */
+static int readraw_in_cfa(const char *name, fits *fit, gboolean header_only, gboolean verbose) {
 	libraw_data_t *raw = libraw_init(0);
 	char pattern[FLEN_VALUE];
-
-	int ret = siril_libraw_open_file(raw, name);
+	gchar *file_data = NULL;
+	gsize file_size;
+	int ret;
+
+	/* The file is read at once and decoded from memory: libraw otherwise
+	 * reads it by small chunks while decoding, which keeps the conversion
+	 * threads waiting for the disk, in particular on network storage. */
+	if (!header_only && g_file_get_contents(name, &file_data, &file_size, NULL))
+		ret = libraw_open_buffer(raw, file_data, file_size);
+	else ret = siril_libraw_open_file(raw, name);
 	if (ret) {
 		siril_log_color_message("Error in libraw %s\n", "red", libraw_strerror(ret));
+		siril_libraw_close(raw, file_data);
 		return OPEN_IMAGE_ERROR;
 	}
 
-	ret = libraw_unpack(raw);
-	if (ret) {
-		siril_log_color_message("Error in libraw %s\n", "red", libraw_strerror(ret));
-		return OPEN_IMAGE_ERROR;
+	/* the width of the Fuji SuperCCD sensors is only known once unpacked */
+	if (!header_only || !g_ascii_strncasecmp(raw->idata.make, "Fuji", 4)) {
+		ret = libraw_unpack(raw);
+		if (ret) {
+			siril_log_color_message("Error in libraw %s\n", "red", libraw_strerror(ret));
+			siril_libraw_close(raw, file_data);
+			return OPEN_IMAGE_ERROR;
+		}
 	}
 
 	/* This test checks if raw data exist. Sometimes it doesn't. This is
 	 * the case for DNG built from lightroom for example */
-	if (raw->rawdata.raw_image == NULL
+	if (!header_only && raw->rawdata.raw_image == NULL
 			&& (raw->rawdata.color3_image || raw->rawdata.color4_image)) {
 		siril_log_color_message(_("Siril cannot open this file in CFA mode: "
 				"no RAW data available.\n"), "red");
+		siril_libraw_close(raw, file_data);
 		return OPEN_IMAGE_ERROR;
 	}
 
@@ -2030,12 +2010,14 @@ static int readraw_in_cfa(const char *name, fits *fit) {
 	float pitch = estimate_pixel_pitch(raw);
 	size_t npixels = (size_t) width * (size_t) height;
 
-	if (raw->other.shutter > 0 && raw->other.shutter < 1)
-		siril_log_message(_("Decoding %s %s file (ISO=%g, Exposure=1/%0.1f sec)\n"),
-						raw->idata.make, raw->idata.model, raw->other.iso_speed, 1/raw->other.shutter);
-	else
-		siril_log_message(_("Decoding %s %s file (ISO=%g, Exposure=%0.1f sec)\n"),
-						raw->idata.make, raw->idata.model, raw->other.iso_speed, raw->other.shutter);
+	if (verbose) {
+		if (raw->other.shutter > 0 && raw->other.shutter < 1)
+			siril_log_message(_("Decoding %s %s file (ISO=%g, Exposure=1/%0.1f sec)\n"),
+							raw->idata.make, raw->idata.model, raw->other.iso_speed, 1/raw->other.shutter);
+		else
+			siril_log_message(_("Decoding %s %s file (ISO=%g, Exposure=%0.1f sec)\n"),
+							raw->idata.make, raw->idata.model, raw->other.iso_speed, raw->other.shutter);
+	}
 
 	unsigned filters = raw->idata.filters;
 
@@ -2057,31 +2039,33 @@ static int readraw_in_cfa(const char *name, fits *fit) {
 			}
 		}
 		pattern[j++] = '\0';
-		siril_log_message(_("Filter pattern: %s\n"), pattern);
+		if (verbose)
+			siril_log_message(_("Filter pattern: %s\n"), pattern);
 	}
 
-	WORD *data = (WORD*) calloc(1, npixels * sizeof(WORD));
-	if (!data) {
-		PRINT_ALLOC_ERR;
-		libraw_recycle(raw);
-		libraw_close(raw);
-		return OPEN_IMAGE_ERROR;
-	}
+	WORD *data = NULL;
+	if (!header_only) {
+		data = (WORD*) calloc(1, npixels * sizeof(WORD));
+		if (!data) {
+			PRINT_ALLOC_ERR;
+			siril_libraw_close(raw, file_data);
+			return OPEN_IMAGE_ERROR;
+		}
 
-	WORD *buf = data;
+		WORD *buf = data;
 
-	int offset = raw_width * top_margin + left_margin;
+		int offset = raw_width * top_margin + left_margin;
 
-	if (!raw->rawdata.raw_image) {
-		libraw_recycle(raw);
-		libraw_close(raw);
-		free(buf);
-		return OPEN_IMAGE_ERROR;
-	}
-	int i = 0;
-	for (int row = height - 1; row > -1; row--) {
-		for (int col = 0; col < width; col++) {
-			buf[i++] = raw->rawdata.raw_image[offset + col + (raw_width * row)];
+		if (!raw->rawdata.raw_image) {
+			siril_libraw_close(raw, file_data);
+			free(buf);
+			return OPEN_IMAGE_ERROR;
+		}
+		int i = 0;
+		for (int row = height - 1; row > -1; row--) {
+			for (int col = 0; col < width; col++) {
+				buf[i++] = raw->rawdata.raw_image[offset + col + (raw_width * row)];
+			}
 		}
 	}
 
@@ -2130,13 +2114,12 @@ static int readraw_in_cfa(const char *name, fits *fit) {
 
 	g_snprintf(fit->keywords.row_order, FLEN_VALUE, "%s", "BOTTOM-UP");
 
-	libraw_recycle(raw);
-	libraw_close(raw);
+	siril_libraw_close(raw, file_data);
 	return 1;
 }
 
 int open_raw_files(const char *name, fits *fit, gboolean debayer) {
-	int retval = readraw_in_cfa(name, fit);
+	int retval = readraw_in_cfa(name, fit, FALSE, TRUE);
 
 	if (retval >= 0) {
 		if (debayer) {
@@ -2150,6 +2133,10 @@ int open_raw_files(const char *name, fits *fit, gboolean debayer) {
 	}
 	return retval;
 }
+
+int open_raw_file_silent(const char *name, fits *fit, gboolean header_only) {
+	return readraw_in_cfa(name, fit, header_only, FALSE);
+}
 #endif
 
 #ifdef HAVE_LIBHEIF
@@ -2953,7 +2940,7 @@ int readjxl(const char* name, fits *fit) {
 	return zsize;
 }
 
-int savejxl(const char *name, fits *fit, int effort, double quality, gboolean force_8bit) {
+int savejxl(const char *name, fits *fit, int effort, double quality, gboolean force_8bit, int threads) {
 	gboolean threaded = !get_thread_run();
 
 	char *filename = strdup(name);
@@ -2984,12 +2971,12 @@ int savejxl(const char *name, fits *fit, int effort, double quality, gboolean fo
 				switch (com.pref.icc.export_8bit_method) {
 					case EXPORT_SRGB:
 						srgb_mono_out = gray_srgbtrc();
-						save_transform = sirilCreateTransformTHR((threaded ? com.icc.context_threaded : com.icc.context_single), fit->icc_profile, trans_type, srgb_mono_out, trans_type, com.pref.icc.export_intent, 0);
+						save_transform = siril_transform_acquire((threaded ? com.icc.context_threaded : com.icc.context_single), fit->icc_profile, trans_type, srgb_mono_out, trans_type, com.pref.icc.export_intent, 0);
 						profile = get_icc_profile_data(srgb_mono_out, &profile_len);
 						cmsCloseProfile(srgb_mono_out);
 						break;
 					case EXPORT_WORKING:
-						save_transform = sirilCreateTransformTHR((threaded ? com.icc.context_threaded : com.icc.context_single), fit->icc_profile, trans_type, com.icc.mono_standard, trans_type, com.pref.icc.export_intent, 0);
+						save_transform = siril_transform_acquire((threaded ? com.icc.context_threaded : com.icc.context_single), fit->icc_profile, trans_type, com.icc.mono_standard, trans_type, com.pref.icc.export_intent, 0);
 						profile = get_icc_profile_data(com.icc.mono_standard, &profile_len);
 						break;
 					case EXPORT_IMAGE_ICC:
@@ -3002,11 +2989,11 @@ int savejxl(const char *name, fits *fit, int effort, double quality, gboolean fo
 			} else { // rgb
 				switch (com.pref.icc.export_8bit_method) {
 					case EXPORT_SRGB:
-						save_transform = sirilCreateTransformTHR((threaded ? com.icc.context_threaded : com.icc.context_single), fit->icc_profile, trans_type, com.icc.srgb_profile, trans_type, com.pref.icc.export_intent, 0);
+						save_transform = siril_transform_acquire((threaded ? com.icc.context_threaded : com.icc.context_single), fit->icc_profile, trans_type, com.icc.srgb_profile, trans_type, com.pref.icc.export_intent, 0);
 						profile = get_icc_profile_data(com.icc.srgb_profile, &profile_len);
 						break;
 					case EXPORT_WORKING:
-						save_transform = sirilCreateTransformTHR((threaded ? com.icc.context_threaded : com.icc.context_single), fit->icc_profile, trans_type, com.icc.working_standard, trans_type, com.pref.icc.export_intent, 0);
+						save_transform = siril_transform_acquire((threaded ? com.icc.context_threaded : com.icc.context_single), fit->icc_profile, trans_type, com.icc.working_standard, trans_type, com.pref.icc.export_intent, 0);
 						profile = get_icc_profile_data(com.icc.working_standard, &profile_len);
 						break;
 					case EXPORT_IMAGE_ICC:
@@ -3027,12 +3014,12 @@ int savejxl(const char *name, fits *fit, int effort, double quality, gboolean fo
 				switch (com.pref.icc.export_16bit_method) {
 					case EXPORT_SRGB:
 						srgb_mono_out = gray_srgbtrc();
-						save_transform = sirilCreateTransformTHR((threaded ? com.icc.context_threaded : com.icc.context_single), fit->icc_profile, trans_type, srgb_mono_out, trans_type, com.pref.icc.export_intent, 0);
+						save_transform = siril_transform_acquire((threaded ? com.icc.context_threaded : com.icc.context_single), fit->icc_profile, trans_type, srgb_mono_out, trans_type, com.pref.icc.export_intent, 0);
 						profile = get_icc_profile_data(srgb_mono_out, &profile_len);
 						cmsCloseProfile(srgb_mono_out);
 						break;
 					case EXPORT_WORKING:
-						save_transform = sirilCreateTransformTHR((threaded ? com.icc.context_threaded : com.icc.context_single), fit->icc_profile, trans_type, com.icc.mono_standard, trans_type, com.pref.icc.export_intent, 0);
+						save_transform = siril_transform_acquire((threaded ? com.icc.context_threaded : com.icc.context_single), fit->icc_profile, trans_type, com.icc.mono_standard, trans_type, com.pref.icc.export_intent, 0);
 						profile = get_icc_profile_data(com.icc.mono_standard, &profile_len);
 						break;
 					case EXPORT_IMAGE_ICC:
@@ -3045,11 +3032,11 @@ int savejxl(const char *name, fits *fit, int effort, double quality, gboolean fo
 			} else { // rgb
 				switch (com.pref.icc.export_16bit_method) {
 					case EXPORT_SRGB:
-						save_transform = sirilCreateTransformTHR((threaded ? com.icc.context_threaded : com.icc.context_single), fit->icc_profile, trans_type, com.icc.srgb_profile, trans_type, com.pref.icc.export_intent, 0);
+						save_transform = siril_transform_acquire((threaded ? com.icc.context_threaded : com.icc.context_single), fit->icc_profile, trans_type, com.icc.srgb_profile, trans_type, com.pref.icc.export_intent, 0);
 						profile = get_icc_profile_data(com.icc.srgb_profile, &profile_len);
 						break;
 					case EXPORT_WORKING:
-						save_transform = sirilCreateTransformTHR((threaded ? com.icc.context_threaded : com.icc.context_single), fit->icc_profile, trans_type, com.icc.working_standard, trans_type, com.pref.icc.export_intent, 0);
+						save_transform = siril_transform_acquire((threaded ? com.icc.context_threaded : com.icc.context_single), fit->icc_profile, trans_type, com.icc.working_standard, trans_type, com.pref.icc.export_intent, 0);
 						profile = get_icc_profile_data(com.icc.working_standard, &profile_len);
 						break;
 					case EXPORT_IMAGE_ICC:
@@ -3070,7 +3057,7 @@ int savejxl(const char *name, fits *fit, int effort, double quality, gboolean fo
 	cmsUInt32Number bytesperplane = fit->rx * fit->ry * datasize * fit->naxes[2];
 	if (save_transform) { // For "use image ICC profile" save_transform will be NULL, no need to transform the data
 		cmsDoTransformLineStride(save_transform, buffer, buffer, fit->rx, fit->ry, bytesperline, bytesperline, bytesperplane, bytesperplane);
-		cmsDeleteTransform(save_transform);
+		siril_transform_release(save_transform);
 	}
 	uint8_t *compressed = NULL;
 	size_t compressed_length;
@@ -3082,19 +3069,27 @@ int savejxl(const char *name, fits *fit, int effort, double quality, gboolean fo
 		siril_log_message(_("Saving JPEG XL: file %s, quality=%.3f, effort=%d %ld layer(s), %ux%u pixels, bit depth: %d\n"),
 						filename, quality, effort, fit->naxes[2], fit->rx, fit->ry, bitdepth);
 
-	EncodeJpegXlOneshotWrapper(buffer, fit->rx,
+	int retval = OPEN_IMAGE_OK;
+	if (EncodeJpegXlOneshotWrapper(buffer, fit->rx,
 					fit->ry, fit->naxes[2], bitdepth,
 					&compressed, &compressed_length, effort,
-					quality, profile, profile_len);
-
-	siril_log_color_message(_("Save complete.\n"), "green");
-	GError *error = NULL;
-	g_file_set_contents(name, (const gchar *) compressed, compressed_length, &error);
+					quality, profile, profile_len, threads)) {
+		siril_log_color_message(_("Error encoding JPEG XL image %s\n"), "red", filename);
+		retval = OPEN_IMAGE_ERROR;
+	} else {
+		GError *error = NULL;
+		if (!g_file_set_contents(filename, (const gchar *) compressed, compressed_length, &error)) {
+			siril_log_color_message(_("Cannot write %s: %s\n"), "red", filename, error->message);
+			g_error_free(error);
+			retval = OPEN_IMAGE_ERROR;
+		}
+		else siril_log_color_message(_("Save complete.\n"), "green");
+	}
 	free(buffer);
 	free(compressed);
+	free(profile);
 	free(filename);
-	g_error_free(error);
-	return OPEN_IMAGE_OK;
+	return retval;
 }
 
 #endif
@@ -0,0 +1,162 @@
+/*
+ * This file is part of Siril, an astronomy image processor.
+ * Copyright (C) 2005-2011 Francois Meyer (dulle at free.fr)
+ * Copyright (C) 2012-2025 team free-astro (see more in AUTHORS file)
+ * Reference site is https://siril.org
+ *
+ * Siril is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Siril is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Siril. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* The I/O statistics tell if a sequence operation was limited by the disk,
+ * the processing or the sequence writer: the read and write rates are given
+ * for the time the threads spent reading or writing, which includes the
+ * decoding and encoding, and for the duration of the operation. The bytes are
+ * those of the pixel data in memory, not of the files, which can be
+ * compressed. */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "core/siril.h"
+#include "core/siril_log.h"
+#include "core/pipe.h"
+#include "core/trace.h"
+
+#include "io_stats.h"
+
+#define NB_SEQ_TYPES (SEQ_INTERNAL + 1)
+
+struct io_counts {
+	int frames;
+	guint64 bytes;
+	gint64 time_us;	// summed over the threads
+};
+
+static GMutex stats_mutex;
+static struct io_counts reads[NB_SEQ_TYPES], writes[NB_SEQ_TYPES];
+static gint64 memory_wait_us = 0, start_time = 0;
+static int max_queue_depth = 0;
+
+static const char *seq_type_name(int type) {
+	switch (type) {
+		case SEQ_REGULAR:
+			return "FITS";
+		case SEQ_SER:
+			return "SER";
+		case SEQ_FITSEQ:
+			return "FITS sequence";
+#ifdef HAVE_FFMS2
+		case SEQ_AVI:
+			return "film";
+#endif
+#ifdef HAVE_LIBRAW
+		case SEQ_RAW:
+			return "RAW";
+#endif
+		default:
+			return "internal";
+	}
+}
+
+void io_stats_reset() {
+	g_mutex_lock(&stats_mutex);
+	memset(reads, 0, sizeof reads);
+	memset(writes, 0, sizeof writes);
+	memory_wait_us = 0;
+	max_queue_depth = 0;
+	start_time = g_get_monotonic_time();
+	g_mutex_unlock(&stats_mutex);
+}
+
+static void add_counts(struct io_counts *counts, sequence_type type, const char *counter,
+		size_t bytes, gint64 duration_us) {
+	g_mutex_lock(&stats_mutex);
+	counts[type].frames++;
+	counts[type].bytes += bytes;
+	counts[type].time_us += duration_us;
+	guint64 total = 0;
+	for (int i = 0; i < NB_SEQ_TYPES; i++)
+		total += counts[i].bytes;
+	g_mutex_unlock(&stats_mutex);
+	trace_counter(counter, (gint64) (total / BYTES_IN_A_MB));
+}
+
+void io_stats_add_read(sequence_type type, size_t bytes, gint64 duration_us) {
+	add_counts(reads, type, "read (MB)", bytes, duration_us);
+}
+
+void io_stats_add_write(sequence_type type, size_t bytes, gint64 duration_us) {
+	add_counts(writes, type, "written (MB)", bytes, duration_us);
+}
+
+void io_stats_add_memory_wait(gint64 duration_us) {
+	g_mutex_lock(&stats_mutex);
+	memory_wait_us += duration_us;
+	g_mutex_unlock(&stats_mutex);
+}
+
+void io_stats_set_queue_depth(int depth) {
+	g_mutex_lock(&stats_mutex);
+	if (depth > max_queue_depth)
+		max_queue_depth = depth;
+	g_mutex_unlock(&stats_mutex);
+	trace_counter("writer queue", depth);
+}
+
+size_t io_stats_image_bytes(const fits *fit) {
+	return (size_t) fit->rx * fit->ry * fit->naxes[2] *
+		(fit->type == DATA_FLOAT ? sizeof(float) : sizeof(WORD));
+}
+
+static void report_counts(const char *operation, gboolean is_read,
+		const struct io_counts *counts, int type, double elapsed) {
+	if (!counts->frames)
+		return;
+	double MB = counts->bytes / (double) BYTES_IN_A_MB;
+	double seconds = counts->time_us * 1e-6;
+	siril_log_message(_("%s: %s %d %s frames, %.1f MB, in %.2f s of thread time: "
+				"%.1f MB/s per thread, %.1f MB/s overall, %.1f ms per frame\n"),
+			operation, is_read ? _("read") : _("wrote"), counts->frames, seq_type_name(type), MB, seconds,
+			seconds > 0.0 ? MB / seconds : 0.0, elapsed > 0.0 ? MB / elapsed : 0.0,
+			counts->time_us * 1e-3 / counts->frames);
+	gchar *msg = g_strdup_printf("io %s type=\"%s\" frames=%d bytes=%" G_GUINT64_FORMAT
+			" thread_seconds=%.3f seconds=%.3f operation=\"%s\"\n", is_read ? "read" : "write",
+			seq_type_name(type), counts->frames, counts->bytes, seconds, elapsed, operation);
+	pipe_send_message(PIPE_STATS, PIPE_NA, msg);
+	g_free(msg);
+}
+
+void io_stats_report(const char *operation) {
+	struct io_counts r[NB_SEQ_TYPES], w[NB_SEQ_TYPES];
+	g_mutex_lock(&stats_mutex);
+	memcpy(r, reads, sizeof r);
+	memcpy(w, writes, sizeof w);
+	gint64 wait_us = memory_wait_us;
+	int depth = max_queue_depth;
+	double elapsed = (g_get_monotonic_time() - start_time) * 1e-6;
+	g_mutex_unlock(&stats_mutex);
+
+	for (int i = 0; i < NB_SEQ_TYPES; i++) {
+		report_counts(operation, TRUE, &r[i], i, elapsed);
+		report_counts(operation, FALSE, &w[i], i, elapsed);
+	}
+	if (depth || wait_us) {
+		siril_log_message(_("%s: up to %d images queued for writing, processing blocked %.2f s waiting for memory\n"),
+				operation, depth, wait_us * 1e-6);
+		gchar *msg = g_strdup_printf("io writer max_queue=%d blocked_seconds=%.3f operation=\"%s\"\n",
+				depth, wait_us * 1e-6, operation);
+		pipe_send_message(PIPE_STATS, PIPE_NA, msg);
+		g_free(msg);
+	}
+}
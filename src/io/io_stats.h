@@ -0,0 +1,20 @@
+#ifndef IO_STATS_H
+#define IO_STATS_H
+
+#include "core/siril.h"
+
+/* counts the frames read and written by a sequence operation, their bytes and
+ * the time spent doing it, by sequence type, and the time the processing
+ * threads were blocked by the sequence writer. The counts are global, they
+ * are reset at the start of an operation and reported at its end */
+void io_stats_reset();
+void io_stats_add_read(sequence_type type, size_t bytes, gint64 duration_us);
+void io_stats_add_write(sequence_type type, size_t bytes, gint64 duration_us);
+void io_stats_add_memory_wait(gint64 duration_us);
+void io_stats_set_queue_depth(int depth);
+/* the size of the pixel data of an image in memory */
+size_t io_stats_image_bytes(const fits *fit);
+/* logs the counts and sends them on the pipe, if anything was read or written */
+void io_stats_report(const char *operation);
+
+#endif
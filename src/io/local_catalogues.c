@@ -79,6 +79,11 @@ struct catalogue_index {
 
 struct catalogue_file {
 	FILE *f;
+	gchar *path;
+	int number;		// index in com.pref.catalogue_paths
+	GMappedFile *mapped;	// NULL if the mapping failed, the file is read instead
+	const char *data;
+	gsize size;
 	dataElement *de;
 	uint16_t nfields;
 	long index_offset, data_offset;
@@ -136,6 +141,7 @@ struct top_header {
 };
 
 static struct catalogue_file *catalogue_read_header(FILE *f);
+static struct catalogue_file *get_catalogue(int number);
 static int read_trixels_of_target(double ra, double dec, double radius, struct catalogue_file *cat, deepStarData **stars, uint32_t *nb_stars);
 static int read_trixels_by_ID(int ID, struct catalogue_file *cat, deepStarData **stars, uint32_t *nb_stars);
 static int read_trixel(int trixel, struct catalogue_file *cat, deepStarData **stars, uint32_t *nb_stars);
@@ -149,65 +155,166 @@ static void bswap_stardata(deepStarData *stardata) {
     stardata->V = bswap_16(stardata->V);
 }
 
-/* returns the complete list of stars for a catalogue's list of trixels */
-static int read_trixels_from_catalogue(const char *path, double ra, double dec, double radius, deepStarData **trixel_stars, uint32_t *trixel_nb_stars) {
-	cat_debug_print("reading data from catalogue %s\n", path);
-	FILE *f = g_fopen(path, "rb");
-	if (!f) {
-		siril_log_message(_("Could not open local NOMAD catalogue\n"));
-		return 1;
-	}
+/* The catalogue files are opened and mapped in memory on first use and stay
+ * open with their parsed index, and the recently decoded trixels are kept in a
+ * cache, so that repeated queries in the same region of the sky, like when
+ * plate solving the images of a sequence, do not need to access the disk.
+ * All accesses are serialized by catalogues_mutex. */
+#define NB_LOCAL_CATALOGUES G_N_ELEMENTS(default_catalogues_paths)
+#define TRIXEL_CACHE_MAX_BYTES (64 * BYTES_IN_A_MB)
 
-	struct catalogue_file *cat = catalogue_read_header(f);
-	if (!cat) {
-		siril_log_message(_("Failed to read the local NOMAD catalogue\n"));
-		fclose(f);
-		return 1;
+static GMutex catalogues_mutex;
+static struct catalogue_file *open_catalogues[NB_LOCAL_CATALOGUES];
+
+struct cached_trixel {
+	int key;
+	deepStarData *stars;	// native endian, 16-byte format
+	uint32_t nb_stars;
+};
+static GHashTable *trixel_cache = NULL;	// key -> link in trixel_lru
+static GQueue trixel_lru = G_QUEUE_INIT;	// most recently used first
+static size_t trixel_cache_bytes = 0;
+
+static int trixel_key(int catalogue, int trixel) {
+	return (catalogue << 20) | trixel;	// trixel < MAX_NUM_TRIXELS
+}
+
+static void free_cached_trixel(struct cached_trixel *entry) {
+	free(entry->stars);
+	free(entry);
+}
+
+static void trixel_cache_clear() {
+	if (trixel_cache)
+		g_hash_table_remove_all(trixel_cache);
+	g_queue_clear_full(&trixel_lru, (GDestroyNotify) free_cached_trixel);
+	trixel_cache_bytes = 0;
+}
+
+/* returns TRUE and a copy of the stars if the trixel is in the cache */
+static gboolean trixel_cache_get(int catalogue, int trixel, deepStarData **stars, uint32_t *nb_stars) {
+	if (!trixel_cache)
+		return FALSE;
+	GList *link = g_hash_table_lookup(trixel_cache, GINT_TO_POINTER(trixel_key(catalogue, trixel)));
+	if (!link)
+		return FALSE;
+	struct cached_trixel *entry = (struct cached_trixel *) link->data;
+	deepStarData *copy = malloc(max(entry->nb_stars, 1) * sizeof(deepStarData));
+	if (!copy) {
+		PRINT_ALLOC_ERR;
+		return FALSE;
 	}
+	memcpy(copy, entry->stars, entry->nb_stars * sizeof(deepStarData));
+	g_queue_unlink(&trixel_lru, link);
+	g_queue_push_head_link(&trixel_lru, link);
+	*stars = copy;
+	*nb_stars = entry->nb_stars;
+	return TRUE;
+}
 
-	//if (read_trixel_of_target(ra, dec, cat, &trixel_stars, &trixel_nb_stars)) {
-	if (read_trixels_of_target(ra, dec, radius, cat, trixel_stars, trixel_nb_stars)) {
-		free(cat);
-		fclose(f);
-		return 1;
+static void trixel_cache_put(int catalogue, int trixel, const deepStarData *stars, uint32_t nb_stars) {
+	size_t bytes = nb_stars * sizeof(deepStarData);
+	if (bytes > TRIXEL_CACHE_MAX_BYTES)
+		return;
+	struct cached_trixel *entry = malloc(sizeof(struct cached_trixel));
+	if (!entry)
+		return;
+	entry->stars = malloc(max(nb_stars, 1) * sizeof(deepStarData));
+	if (!entry->stars) {
+		free(entry);
+		return;
+	}
+	memcpy(entry->stars, stars, bytes);
+	entry->nb_stars = nb_stars;
+	entry->key = trixel_key(catalogue, trixel);
+	if (!trixel_cache)
+		trixel_cache = g_hash_table_new(g_direct_hash, g_direct_equal);
+	g_queue_push_head(&trixel_lru, entry);
+	g_hash_table_insert(trixel_cache, GINT_TO_POINTER(entry->key), trixel_lru.head);
+	trixel_cache_bytes += bytes;
+
+	while (trixel_cache_bytes > TRIXEL_CACHE_MAX_BYTES && trixel_lru.length > 1) {
+		struct cached_trixel *oldest = g_queue_pop_tail(&trixel_lru);
+		g_hash_table_remove(trixel_cache, GINT_TO_POINTER(oldest->key));
+		trixel_cache_bytes -= oldest->nb_stars * sizeof(deepStarData);
+		free_cached_trixel(oldest);
 	}
-	fclose(f);
+}
+
+static void close_catalogue(struct catalogue_file *cat) {
+	if (cat->mapped)
+		g_mapped_file_unref(cat->mapped);
+	if (cat->f)
+		fclose(cat->f);
+	g_free(cat->path);
 	free(cat->indices);
 	free(cat->de);
 	free(cat);
-	return 0;
 }
 
-/* returns the complete list of stars for a catalogue's list of trixels */
-static int read_trixelID_from_catalogue(const char *path, int ID, deepStarData **trixel_stars, uint32_t *trixel_nb_stars) {
-	cat_debug_print("reading data from catalogue %s\n", path);
-	if (ID < 0 || ID > 512) {
-		siril_log_message(_("Wrong trixel ID\n"));
-		return 1;
+/* returns the open catalogue for the current path of the preferences, opening
+ * it if needed. Must be called with catalogues_mutex locked */
+static struct catalogue_file *get_catalogue(int number) {
+	const gchar *path = com.pref.catalogue_paths[number];
+	struct catalogue_file *cat = open_catalogues[number];
+	if (cat && !g_strcmp0(cat->path, path))
+		return cat;
+	if (cat) {
+		// the path changed in the preferences
+		close_catalogue(cat);
+		open_catalogues[number] = NULL;
+		trixel_cache_clear();
 	}
+
+	cat_debug_print("reading data from catalogue %s\n", path);
 	FILE *f = g_fopen(path, "rb");
 	if (!f) {
 		siril_log_message(_("Could not open local NOMAD catalogue\n"));
-		return 1;
+		return NULL;
 	}
 
-	struct catalogue_file *cat = catalogue_read_header(f);
+	cat = catalogue_read_header(f);
 	if (!cat) {
 		siril_log_message(_("Failed to read the local NOMAD catalogue\n"));
 		fclose(f);
-		return 1;
+		return NULL;
 	}
+	cat->number = number;
+	cat->path = g_strdup(path);
 
-	if (read_trixels_by_ID(ID, cat, trixel_stars, trixel_nb_stars)) {
-		free(cat);
-		fclose(f);
+	GError *error = NULL;
+	cat->mapped = g_mapped_file_new(path, FALSE, &error);
+	if (cat->mapped) {
+		cat->data = g_mapped_file_get_contents(cat->mapped);
+		cat->size = g_mapped_file_get_length(cat->mapped);
+	} else {
+		siril_debug_print("could not map the catalogue %s, reading it instead: %s\n", path, error->message);
+		g_clear_error(&error);
+	}
+	open_catalogues[number] = cat;
+	return cat;
+}
+
+/* returns the complete list of stars for a catalogue's list of trixels */
+static int read_trixels_from_catalogue(int number, double ra, double dec, double radius, deepStarData **trixel_stars, uint32_t *trixel_nb_stars) {
+	g_mutex_lock(&catalogues_mutex);
+	struct catalogue_file *cat = get_catalogue(number);
+	int retval = !cat || read_trixels_of_target(ra, dec, radius, cat, trixel_stars, trixel_nb_stars);
+	g_mutex_unlock(&catalogues_mutex);
+	return retval;
+}
+
+/* returns the complete list of stars for a catalogue's list of trixels */
+static int read_trixelID_from_catalogue(int number, int ID, deepStarData **trixel_stars, uint32_t *trixel_nb_stars) {
+	if (ID < 0 || ID > 512) {
+		siril_log_message(_("Wrong trixel ID\n"));
 		return 1;
 	}
-	fclose(f);
-	free(cat->indices);
-	free(cat->de);
-	free(cat);
-	return 0;
+	g_mutex_lock(&catalogues_mutex);
+	struct catalogue_file *cat = get_catalogue(number);
+	int retval = !cat || read_trixels_by_ID(ID, cat, trixel_stars, trixel_nb_stars);
+	g_mutex_unlock(&catalogues_mutex);
+	return retval;
 }
 
 static struct catalogue_file *catalogue_read_header(FILE *f) {
@@ -479,60 +586,77 @@ static int read_trixels_by_ID(int ID, struct catalogue_file *cat, deepStarData *
 /* this function reads all stars of a trixel and returns them as deep star data
  * (the 16-byte struct) even if this is a 32-byte catalog */
 static int read_trixel(int trixel, struct catalogue_file *cat, deepStarData **stars, uint32_t *nb_stars) {
+	if (trixel < 0 || trixel >= (int) cat->ntrixels) {
+		siril_debug_print("trixel %d out of the catalogue index\n", trixel);
+		return 1;
+	}
+	if (trixel_cache_get(cat->number, trixel, stars, nb_stars))
+		return 0;
+
 	struct catalogue_index *index = cat->indices + trixel;
 	if (index->trixelID != trixel) {
 		siril_debug_print("INDEX IS WRONG, trixel ID did not match\n");
 		return 1;
 	}
 
-	//siril_debug_print("offset for trixel %u: %u\n", trixel, index->offset);
-	if (fseek64(cat->f, index->offset, SEEK_SET)) {
-		siril_debug_print("failed to seek to the trixel offset %u\n", index->offset);
-		return 1;
+	size_t record_size = cat->nfields == 6 ? sizeof(deepStarData) : sizeof(shallowStarData);
+	size_t data_size = (size_t) index->nrecs * record_size;
+	const char *records;
+	char *buffer = NULL;
+	if (cat->data) {
+		if ((gsize) index->offset + data_size > cat->size) {
+			siril_debug_print("trixel %d data is past the end of the catalogue file\n", trixel);
+			return 1;
+		}
+		records = cat->data + index->offset;
+	} else {
+		//siril_debug_print("offset for trixel %u: %u\n", trixel, index->offset);
+		if (fseek64(cat->f, index->offset, SEEK_SET)) {
+			siril_debug_print("failed to seek to the trixel offset %u\n", index->offset);
+			return 1;
+		}
+		buffer = malloc(max(data_size, 1));
+		if (!buffer) {
+			PRINT_ALLOC_ERR;
+			return 1;
+		}
+		if (fread(buffer, record_size, index->nrecs, cat->f) < index->nrecs) {
+			siril_debug_print("error reading trixel data\n");
+			free(buffer);
+			return 1;
+		}
+		records = buffer;
 	}
 
 	deepStarData *trix_stars = malloc(index->nrecs * sizeof(deepStarData));
 	if (!trix_stars) {
 		PRINT_ALLOC_ERR;
+		free(buffer);
 		return 1;
 	}
 	*stars = trix_stars;
 	*nb_stars = index->nrecs;
 
 	if (cat->nfields == 6) {
-		if (fread(trix_stars, sizeof(deepStarData), index->nrecs, cat->f) < index->nrecs) {
-			siril_debug_print("error reading trixel data\n");
-			free(trix_stars);
-			return 1;
-		}
+		memcpy(trix_stars, records, data_size);
 	} else {
-		shallowStarData *read_stars = malloc(index->nrecs * sizeof(shallowStarData));
-		if (!read_stars) {
-			PRINT_ALLOC_ERR;
-			free(trix_stars);
-			return 1;
-		}
-		if (fread(read_stars, sizeof(shallowStarData), index->nrecs, cat->f) < index->nrecs) {
-			siril_debug_print("error reading trixel data\n");
-			free(read_stars);
-			free(trix_stars);
-			return 1;
-		}
 		for (uint32_t i = 0; i < index->nrecs; ++i) {
-			trix_stars[i].RA = read_stars[i].RA;
-			trix_stars[i].Dec = read_stars[i].Dec;
-			trix_stars[i].dRA = read_stars[i].dRA / 10;
-			trix_stars[i].dDec = read_stars[i].dDec / 10;
-			trix_stars[i].V = read_stars[i].mag * 10;
-			trix_stars[i].B = (read_stars[i].bv_index + read_stars[i].mag) * 10;
+			shallowStarData read_star;	// the mapped data may not be aligned
+			memcpy(&read_star, records + i * record_size, record_size);
+			trix_stars[i].RA = read_star.RA;
+			trix_stars[i].Dec = read_star.Dec;
+			trix_stars[i].dRA = read_star.dRA / 10;
+			trix_stars[i].dDec = read_star.dDec / 10;
+			trix_stars[i].V = read_star.mag * 10;
+			trix_stars[i].B = (read_star.bv_index + read_star.mag) * 10;
 			/* the BV - mag trick may not be correct, but we only use the V and
 			 * B fields to compute B-V anyway */
 			/* the * 10 trick is because the scaling is 100 for this catalogue,
 			 * while it is 1000 for the deep star catalogue, but we don't know
 			 * where they come from after it has returned */
 		}
-		free(read_stars);
 	}
+	free(buffer);
 
 	if (cat->byteswap) {
 		for (uint32_t i = 0; i < index->nrecs; ++i) {
@@ -540,6 +664,7 @@ static int read_trixel(int trixel, struct catalogue_file *cat, deepStarData **st
 		}
 	}
 
+	trixel_cache_put(cat->number, trixel, trix_stars, index->nrecs);
 	return 0;
 }
 
@@ -566,7 +691,7 @@ static int get_raw_stars_from_local_catalogues(double target_ra, double target_d
 			continue;
 		}
 
-		retval = read_trixels_from_catalogue(com.pref.catalogue_paths[catalogue],
+		retval = read_trixels_from_catalogue(catalogue,
 				target_ra, target_dec, radius,
 				catalogue_stars + catalogue, catalogue_nb_stars + catalogue);
 		if (retval)
@@ -625,7 +750,7 @@ static int get_raw_stars_from_local_catalogues_byID(int ID, float max_mag, gbool
 
 	siril_debug_print("looking for stars in local catalogues for trixel %4d\n", ID);
 	for (; catalogue < nb_catalogues; catalogue++) {
-		retval = read_trixelID_from_catalogue(com.pref.catalogue_paths[catalogue],
+		retval = read_trixelID_from_catalogue(catalogue,
 				ID,
 				catalogue_stars + catalogue, catalogue_nb_stars + catalogue);
 		if (retval)
@@ -0,0 +1,175 @@
+/*
+ * This file is part of Siril, an astronomy image processor.
+ * Copyright (C) 2005-2011 Francois Meyer (dulle at free.fr)
+ * Copyright (C) 2012-2025 team free-astro (see more in AUTHORS file)
+ * Reference site is https://siril.org
+ *
+ * Siril is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Siril is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Siril. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* The master cache keeps the last master calibration frames read by the
+ * calibration commands and live stacking, so that consecutive scripts or
+ * sessions using the same masters don't read and convert them again.
+ *
+ * A master is identified by the absolute path of its file and the requested
+ * data type, and is only used if the file has the same modification time and
+ * size as when it was read. Only a few masters are kept, the least recently
+ * used is dropped first, and a master is not kept if it takes more than a
+ * quarter of the available memory. It is enabled by the core.master_cache
+ * setting.
+ *
+ * The cached copy is the frame as read from the file: the changes made by the
+ * callers, like the rescaling of 32-bit masters for 8-bit images or the
+ * equalization of flats, are made on their own copy.
+ */
+
+#include <string.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "core/siril.h"
+#include "core/proto.h"
+#include "core/OS_utils.h"
+#include "io/image_format_fits.h"
+#include "master_cache.h"
+
+#define MASTER_CACHE_ENTRIES 4
+
+struct master_entry {
+	gchar *key;
+	gint64 mtime;		// of the file when the master was read
+	gint64 size;		// same
+	fits *fit;
+};
+
+static GMutex cache_mutex;
+static GQueue cache_lru = G_QUEUE_INIT;	// of struct master_entry, most recently used first
+
+static void free_entry(struct master_entry *entry) {
+	clearfits(entry->fit);
+	free(entry->fit);
+	g_free(entry->key);
+	g_free(entry);
+}
+
+static gchar *get_master_key(const char *filename, gboolean force_float, gint64 *mtime, gint64 *size) {
+	GStatBuf st;
+	if (!filename || g_stat(filename, &st))
+		return NULL;
+	*mtime = (gint64) st.st_mtime;
+	*size = (gint64) st.st_size;
+	gchar *abspath = g_canonicalize_filename(filename, NULL);
+	gchar *key = g_strdup_printf("%s|%d", abspath, force_float ? 1 : 0);
+	g_free(abspath);
+	return key;
+}
+
+static int duplicate_master(fits *from, fits *to) {
+	if (copyfits(from, to, CP_ALLOC | CP_COPYA | CP_FORMAT, -1))
+		return 1;
+	copy_fits_metadata(from, to);
+	if (from->header)
+		to->header = strdup(from->header);
+	if (from->history)
+		to->history = g_slist_copy_deep(from->history, (GCopyFunc) g_strdup, NULL);
+	return 0;
+}
+
+/* must be called with the lock held, returns the entry moved at the head of
+ * the list if it is valid */
+static struct master_entry *lookup_entry(const gchar *key, gint64 mtime, gint64 size) {
+	for (GList *l = cache_lru.head; l; l = l->next) {
+		struct master_entry *entry = (struct master_entry *) l->data;
+		if (strcmp(entry->key, key))
+			continue;
+		g_queue_unlink(&cache_lru, l);
+		if (entry->mtime != mtime || entry->size != size) {
+			siril_debug_print("master cache: %s has changed\n", key);
+			g_list_free(l);
+			free_entry(entry);
+			return NULL;
+		}
+		g_queue_push_head_link(&cache_lru, l);
+		return entry;
+	}
+	return NULL;
+}
+
+int master_cache_readfits(const char *filename, fits *fit, gboolean force_float) {
+	if (!com.pref.master_cache) {
+		master_cache_clear();
+		return readfits(filename, fit, NULL, force_float);
+	}
+
+	gint64 mtime, size;
+	gchar *key = get_master_key(filename, force_float, &mtime, &size);
+	if (!key)
+		return readfits(filename, fit, NULL, force_float);
+
+	/* the copy is made with the lock held, masters are read by one thread
+	 * at a time and it keeps the entry from being freed */
+	g_mutex_lock(&cache_mutex);
+	struct master_entry *entry = lookup_entry(key, mtime, size);
+	if (entry && !duplicate_master(entry->fit, fit)) {
+		g_mutex_unlock(&cache_mutex);
+		siril_debug_print("master cache: using %s from memory\n", key);
+		g_free(key);
+		return 0;
+	}
+	g_mutex_unlock(&cache_mutex);
+
+	int retval = readfits(filename, fit, NULL, force_float);
+	if (retval) {
+		g_free(key);
+		return retval;
+	}
+
+	guint64 cost = (guint64) fit->rx * fit->ry * fit->naxes[2] *
+		(fit->type == DATA_FLOAT ? sizeof(float) : sizeof(WORD));
+	if (cost > get_available_memory() / 4) {
+		g_free(key);
+		return 0;
+	}
+	entry = g_new0(struct master_entry, 1);
+	entry->fit = calloc(1, sizeof(fits));
+	if (!entry->fit || duplicate_master(fit, entry->fit)) {
+		free(entry->fit);
+		g_free(entry);
+		g_free(key);
+		return 0;	// the master was read, only caching failed
+	}
+	entry->key = key;
+	entry->mtime = mtime;
+	entry->size = size;
+
+	g_mutex_lock(&cache_mutex);
+	struct master_entry *old = lookup_entry(key, mtime, size);
+	if (old) {
+		g_queue_pop_head(&cache_lru);
+		free_entry(old);
+	}
+	while (cache_lru.length >= MASTER_CACHE_ENTRIES)
+		free_entry((struct master_entry *) g_queue_pop_tail(&cache_lru));
+	g_queue_push_head(&cache_lru, entry);
+	g_mutex_unlock(&cache_mutex);
+	return 0;
+}
+
+void master_cache_clear() {
+	g_mutex_lock(&cache_mutex);
+	struct master_entry *entry;
+	while ((entry = (struct master_entry *) g_queue_pop_head(&cache_lru)))
+		free_entry(entry);
+	g_mutex_unlock(&cache_mutex);
+}
@@ -0,0 +1,11 @@
+#ifndef MASTER_CACHE_H
+#define MASTER_CACHE_H
+
+#include "core/siril.h"
+
+/* reads a master calibration frame like readfits(), from memory if it was
+ * already read and its file has not changed */
+int master_cache_readfits(const char *filename, fits *fit, gboolean force_float);
+void master_cache_clear();
+
+#endif
@@ -80,13 +80,75 @@ static int write_frame(AVFormatContext *fmt_ctx, const AVRational *time_base, AV
 }
 
 /* Add an output stream. */
+/* Hardware encoders that accept frames in system memory, so that they can
+ * replace the software ones without any other change. VAAPI is not in the
+ * list, it needs the frames to be uploaded to a hardware frames context. */
+static const char *hw_encoders_h264[] = { "h264_nvenc", "h264_videotoolbox", NULL };
+static const char *hw_encoders_h265[] = { "hevc_nvenc", "hevc_videotoolbox", NULL };
+
+static gboolean try_open_encoder(const AVCodec *codec, int w, int h, int fps) {
+	AVCodecContext *c = avcodec_alloc_context3(codec);
+	if (!c)
+		return FALSE;
+	c->width = w;
+	c->height = h;
+	c->time_base = (AVRational){ 1, fps };
+	c->pix_fmt = STREAM_PIX_FMT;
+	gboolean ok = avcodec_open2(c, codec, NULL) >= 0;
+	avcodec_free_context(&c);
+	return ok;
+}
+
+/* returns the first hardware encoder of the codec that can be opened on this
+ * machine, NULL if there is none */
+static const AVCodec *find_hw_encoder(enum AVCodecID codec_id, int w, int h, int fps) {
+	const char **names = codec_id == AV_CODEC_ID_H264 ? hw_encoders_h264 :
+		(codec_id == AV_CODEC_ID_H265 ? hw_encoders_h265 : NULL);
+	if (!names)
+		return NULL;
+	for (int i = 0; names[i]; i++) {
+		const AVCodec *codec = avcodec_find_encoder_by_name(names[i]);
+		if (codec && try_open_encoder(codec, w, h, fps))
+			return codec;
+		siril_debug_print("hardware encoder %s is not available\n", names[i]);
+	}
+	return NULL;
+}
+
+static int set_hw_encoder_quality(AVCodecContext *c, const AVCodec *codec, int crf) {
+	int retval = 0;
+	if (g_str_has_suffix(codec->name, "_nvenc")) {
+		retval = av_opt_set(c->priv_data, "rc", "vbr", 0);
+		CHECK_OPT_SET_RETVAL;
+		retval = av_opt_set_int(c->priv_data, "cq", crf, 0);
+		CHECK_OPT_SET_RETVAL;
+		retval = av_opt_set(c->priv_data, "preset", "p5", 0);
+		CHECK_OPT_SET_RETVAL;
+		c->bit_rate = 0;
+	} else {
+		/* VideoToolbox: constant quality in [1, 100] instead of a CRF */
+		c->flags |= AV_CODEC_FLAG_QSCALE;
+		c->global_quality = FF_QP2LAMBDA * av_clip(100 - 2 * crf, 1, 100);
+	}
+	return retval;
+}
+
 static int add_stream(struct mp4_struct *ost, const AVCodec **codec,
 		enum AVCodecID codec_id, int w, int h, int fps)
 {
 	AVCodecContext *c;
 
-	/* find the encoder */
-	*codec = avcodec_find_encoder(codec_id);
+	/* find the encoder, a hardware one if requested and available */
+	*codec = NULL;
+	if (com.pref.video_hw_encoder) {
+		*codec = find_hw_encoder(codec_id, w, h, fps);
+		if (*codec)
+			siril_log_message(_("Using the hardware video encoder %s\n"), (*codec)->name);
+		else siril_log_message(_("No hardware video encoder available, using the software encoder\n"));
+	}
+	ost->hardware = *codec != NULL;
+	if (!(*codec))
+		*codec = avcodec_find_encoder(codec_id);
 	if (!(*codec)) {
 		siril_log_message("Could not find encoder for '%s'\n", avcodec_get_name(codec_id));
 		return 1;
@@ -114,7 +176,12 @@ static int add_stream(struct mp4_struct *ost, const AVCodec **codec,
 	c->codec_id = codec_id;
 	int retval;
 	int crf;
-	switch (codec_id) {
+	if (ost->hardware) {
+		crf = codec_id == AV_CODEC_ID_H264 ? x264_quality_to_crf[ost->quality - 1] :
+			x265_quality_to_crf[ost->quality - 1];
+		set_hw_encoder_quality(c, *codec, crf);
+	}
+	else switch (codec_id) {
 		case AV_CODEC_ID_VP9:
 			c->bit_rate = 0;
 			/* for this codec, quality depends on image size (like bit rate) */
@@ -262,15 +329,16 @@ static int open_video(const AVCodec *codec, struct mp4_struct *ost, AVDictionary
 	*u = round_to_WORD(-(0.148 * R) - (0.291 * G) + (0.439 * B) + 128.0);
 }*/
 
-static int fill_rgb_image(AVFrame *pict, int frame_index,
-		int width, int height, fits *fit)
-{
-	/* when we pass a frame to the encoder, it may keep a reference to it
-	 * internally; make sure we do not overwrite it here */
-	if (av_frame_make_writable(pict) < 0)
-		return 1;
-
-	BYTE map[USHRT_MAX + 1];
+/* the 16-bit to 8-bit table of the frames, computed once for the film */
+static BYTE *get_byte_map(struct mp4_struct *ost, fits *fit) {
+	if (ost->map)
+		return ost->map;
+	ost->map = malloc((USHRT_MAX + 1) * sizeof(BYTE));
+	if (!ost->map) {
+		PRINT_ALLOC_ERR;
+		return NULL;
+	}
+	BYTE *map = ost->map;
 	int i;
 
 	float slope = (fit->orig_bitpix == BYTE_IMG) ? 1.0f : UCHAR_MAX_SINGLE / USHRT_MAX_SINGLE;
@@ -285,34 +353,93 @@ static int fill_rgb_image(AVFrame *pict, int frame_index,
 		for (++i; i <= USHRT_MAX; i++)
 			map[i] = UCHAR_MAX;
 	}
+	return map;
+}
+
+static int fill_rgb_image(struct mp4_struct *ost, AVFrame *pict, fits *fit)
+{
+	/* when we pass a frame to the encoder, it may keep a reference to it
+	 * internally; make sure we do not overwrite it here */
+	if (av_frame_make_writable(pict) < 0)
+		return 1;
+
+	const BYTE *map = get_byte_map(ost, fit);
+	if (!map)
+		return 1;
 
 	/* doing the WORD to BYTE conversion, bottom-up */
-	if (fit->naxes[2] == 1) {
-		int x, y;
-		WORD *src = fit->pdata[RLAYER];
-		BYTE *dst = pict->data[0];
-		for (y = 0; y < fit->ry; y++) {
-			int desty = fit->ry - y - 1;
-			int srcpixel = y * fit->rx;
-			int dstpixel = desty * fit->rx;
-			for (x = 0; x < fit->rx; x++, srcpixel++, dstpixel++) {
-				dst[dstpixel] = map[src[srcpixel]];
-			}
+	int nb_layers = fit->naxes[2] == 1 ? 1 : 3;
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(com.max_thread) schedule(static)
+#endif
+	for (int y = 0; y < fit->ry; y++) {
+		BYTE *dst = pict->data[0] + (size_t) (fit->ry - y - 1) * pict->linesize[0];
+		for (int channel = 0; channel < nb_layers; channel++) {
+			const WORD *src = fit->pdata[channel] + (size_t) y * fit->rx;
+			for (int x = 0; x < fit->rx; x++)
+				dst[x * nb_layers + channel] = map[src[x]];
 		}
-	} else {
-		int channel;
-		for (channel = 0; channel < 3; channel++) {
-			int x, y;
-			WORD *src = fit->pdata[channel];
-			BYTE *dst = pict->data[0];
-			for (y = 0; y < fit->ry; y++) {
-				int desty = fit->ry - y - 1;
-				int srcpixel = y * fit->rx;
-				int dstpixel = (desty * fit->rx * 3) + channel;
-				for (x = 0; x < fit->rx; x++, srcpixel++, dstpixel+=3) {
-					dst[dstpixel] = map[src[srcpixel]];
+	}
+	return 0;
+}
+
+/* BT.601 limited range, as swscale does it */
+static inline BYTE rgb_to_y(int r, int g, int b) {
+	return (BYTE) (((66 * r + 129 * g + 25 * b + 128) >> 8) + 16);
+}
+static inline BYTE rgb_to_u(int r, int g, int b) {
+	return (BYTE) (((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128);
+}
+static inline BYTE rgb_to_v(int r, int g, int b) {
+	return (BYTE) (((112 * r - 94 * g - 18 * b + 128) >> 8) + 128);
+}
+
+/* Converts the image directly to the YUV420P frame, without the intermediate
+ * RGB picture and swscale, for the films that are not resized. The dimensions
+ * are even, each 2x2 block gives one chroma sample. */
+static int fill_yuv_image(struct mp4_struct *ost, AVFrame *pict, fits *fit)
+{
+	if (av_frame_make_writable(pict) < 0)
+		return 1;
+
+	const BYTE *map = get_byte_map(ost, fit);
+	if (!map)
+		return 1;
+
+	gboolean mono = fit->naxes[2] == 1;
+	const WORD *rp = fit->pdata[RLAYER];
+	const WORD *gp = mono ? rp : fit->pdata[GLAYER];
+	const WORD *bp = mono ? rp : fit->pdata[BLAYER];
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(com.max_thread) schedule(static)
+#endif
+	for (int cy = 0; cy < fit->ry / 2; cy++) {
+		/* the frame rows 2cy and 2cy+1 are the image rows ry-1-2cy and ry-2-2cy */
+		BYTE *dsty[2] = { pict->data[0] + (size_t) (2 * cy) * pict->linesize[0],
+			pict->data[0] + (size_t) (2 * cy + 1) * pict->linesize[0] };
+		BYTE *dstu = pict->data[1] + (size_t) cy * pict->linesize[1];
+		BYTE *dstv = pict->data[2] + (size_t) cy * pict->linesize[2];
+		size_t srcrow[2] = { (size_t) (fit->ry - 1 - 2 * cy) * fit->rx,
+			(size_t) (fit->ry - 2 - 2 * cy) * fit->rx };
+		for (int cx = 0; cx < fit->rx / 2; cx++) {
+			int rsum = 0, gsum = 0, bsum = 0;
+			for (int k = 0; k < 2; k++) {
+				for (int l = 0; l < 2; l++) {
+					size_t i = srcrow[k] + 2 * cx + l;
+					int r = map[rp[i]], g = map[gp[i]], b = map[bp[i]];
+					dsty[k][2 * cx + l] = rgb_to_y(r, g, b);
+					rsum += r;
+					gsum += g;
+					bsum += b;
 				}
 			}
+			if (mono) {
+				dstu[cx] = dstv[cx] = 128;
+			} else {
+				int r = (rsum + 2) >> 2, g = (gsum + 2) >> 2, b = (bsum + 2) >> 2;
+				dstu[cx] = rgb_to_u(r, g, b);
+				dstv[cx] = rgb_to_v(r, g, b);
+			}
 		}
 	}
 	return 0;
@@ -333,7 +460,11 @@ static AVFrame *get_video_frame(struct mp4_struct *ost, fits *input_image)
 		(input_image->naxes[2] == 1) ? AV_PIX_FMT_GRAY8 : AV_PIX_FMT_RGB24;
 
 	/* if (target != input_image format) */
-	if (c->pix_fmt != AV_PIX_FMT_RGB24) {
+	if (c->pix_fmt == AV_PIX_FMT_YUV420P && ost->src_w == c->width && ost->src_h == c->height
+			&& input_image->rx == ost->src_w && input_image->ry == ost->src_h) {
+		if (fill_yuv_image(ost, ost->frame, input_image))
+			return NULL;
+	} else if (c->pix_fmt != AV_PIX_FMT_RGB24) {
 		if (!ost->sws_ctx) {
 			ost->sws_ctx = sws_getContext(ost->src_w, ost->src_h, src_format,
 					c->width, c->height, c->pix_fmt,
@@ -343,12 +474,13 @@ static AVFrame *get_video_frame(struct mp4_struct *ost, fits *input_image)
 				return NULL;
 			}
 		}
-		fill_rgb_image(ost->tmp_frame, ost->next_pts, c->width, c->height, input_image);
+		if (fill_rgb_image(ost, ost->tmp_frame, input_image))
+			return NULL;
 		sws_scale(ost->sws_ctx,
 				(const uint8_t * const *)ost->tmp_frame->data, ost->tmp_frame->linesize,
 				0, ost->src_h, ost->frame->data, ost->frame->linesize);
-	} else {
-		fill_rgb_image(ost->frame, ost->next_pts, c->width, c->height, input_image);
+	} else if (fill_rgb_image(ost, ost->frame, input_image)) {
+		return NULL;
 	}
 
 	ost->frame->pts = ost->next_pts++;
@@ -367,39 +499,44 @@ static int write_video_frame(struct mp4_struct *ost, fits *input_image)
 
 	siril_debug_print("writing video frame\n");
 
-	ost->frame = get_video_frame(ost, input_image);
+	AVFrame *frame = get_video_frame(ost, input_image);
+	if (!frame)
+		return 1;
 
 	/* encode the image */
-	int ret = avcodec_send_frame(c, ost->frame);
+	int ret = avcodec_send_frame(c, frame);
 	if (ret < 0) {
 		av_packet_unref(ost->pkt);
 		siril_log_message("Error encoding video frame: %s\n", av_err2str(ret));
 		return 1;
 	}
 
-	ret = avcodec_receive_packet(c, ost->pkt);
-	if (ret == AVERROR(EAGAIN))
-		return 0;
-	else if (ret == AVERROR(EINVAL)) {
-		siril_log_message("Error while getting video packet: %s\n", av_err2str(ret));
-		return 1;
-	}
-	else if (ret == AVERROR_EOF) {
-		siril_log_message("End of stream met while adding a frame\n");
-		return 1;
-	}
-	else if (ret < 0) {
-		siril_log_message("Error while getting video packat %s\n", av_err2str(ret));
-		return 1;
-	}
+	/* an encoder with a delay, like the hardware ones, can return several
+	 * packets for one frame, take all the ones that are ready */
+	while (1) {
+		ret = avcodec_receive_packet(c, ost->pkt);
+		if (ret == AVERROR(EAGAIN))
+			return 0;
+		else if (ret == AVERROR(EINVAL)) {
+			siril_log_message("Error while getting video packet: %s\n", av_err2str(ret));
+			return 1;
+		}
+		else if (ret == AVERROR_EOF) {
+			siril_log_message("End of stream met while adding a frame\n");
+			return 1;
+		}
+		else if (ret < 0) {
+			siril_log_message("Error while getting video packat %s\n", av_err2str(ret));
+			return 1;
+		}
 
-	ret = write_frame(ost->oc, &c->time_base, ost->st, ost->pkt);
-	av_packet_unref(ost->pkt);
-	if (ret < 0) {
-		siril_log_message("Error while writing video frame: %s\n", av_err2str(ret));
-		return 1;
+		ret = write_frame(ost->oc, &c->time_base, ost->st, ost->pkt);
+		av_packet_unref(ost->pkt);
+		if (ret < 0) {
+			siril_log_message("Error while writing video frame: %s\n", av_err2str(ret));
+			return 1;
+		}
 	}
-	return 0;
 }
 
 static void flush_stream(struct mp4_struct *ost)
@@ -436,6 +573,8 @@ static void close_stream(struct mp4_struct *ost)
 	av_frame_free(&ost->tmp_frame);
 	sws_freeContext(ost->sws_ctx);
 	swr_free(&ost->swr_ctx);
+	free(ost->map);
+	ost->map = NULL;
 }
 
 /**************************************************************/
@@ -26,6 +26,8 @@ struct mp4_struct {
 
 	int quality;	// 1 to 5
 	int src_w, src_h;
+	BYTE *map;	// 16-bit to 8-bit conversion table
+	gboolean hardware;	// the encoder is a hardware one
 
 };
 
@@ -0,0 +1,331 @@
+/*
+ * This file is part of Siril, an astronomy image processor.
+ * Copyright (C) 2005-2011 Francois Meyer (dulle at free.fr)
+ * Copyright (C) 2012-2025 team free-astro (see more in AUTHORS file)
+ * Reference site is https://siril.org
+ *
+ * Siril is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Siril is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Siril. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* RAW sequences are sequences of DSLR RAW files read directly with libraw, in
+ * CFA mode, instead of being converted to FITS first. They are made of links
+ * to the RAW files, named like the images of FITS sequences but with the
+ * extension of the RAW files, created by convertraw -rawseq, and are mostly
+ * used to stack masters without writing an intermediate sequence.
+ *
+ * libraw can only decode whole files, while the median and rejection stacking
+ * read the frames by blocks of rows. To avoid decoding each file once per
+ * block, the decoded frames are kept in a cache as long as it has room, its
+ * size being given by the operation for its duration. Frames are not evicted
+ * once cached: the blocks read all frames in the same order each time, which
+ * would make a least recently used cache drop every frame before its next use.
+ * The frames that don't fit are decoded again for each read.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+#ifdef HAVE_LIBRAW
+
+#include <string.h>
+#include <glib.h>
+
+#include "core/siril.h"
+#include "core/proto.h"
+#include "core/siril_log.h"
+#include "core/memory_report.h"
+#include "io/image_format_fits.h"
+#include "io/FITS_symlink.h"
+#include "io/sequence.h"
+#include "raw_sequence.h"
+
+static int decode_frame(sequence *seq, int index, fits *fit, gboolean header_only, gboolean verbose);
+
+struct raw_sequence *raw_sequence_new(const char *ext, int number) {
+	struct raw_sequence *raw = calloc(1, sizeof(struct raw_sequence));
+	if (!raw) {
+		PRINT_ALLOC_ERR;
+		return NULL;
+	}
+	raw->frames = calloc(number, sizeof(fits *));
+	raw->decoding = calloc(number, sizeof(gboolean));
+	if (!raw->frames || !raw->decoding) {
+		PRINT_ALLOC_ERR;
+		free(raw->frames);
+		free(raw->decoding);
+		free(raw);
+		return NULL;
+	}
+	raw->ext = g_strdup(ext);
+	raw->number = number;
+	raw->decode = decode_frame;
+	g_mutex_init(&raw->lock);
+	g_cond_init(&raw->decoded);
+	return raw;
+}
+
+static size_t frame_cost(const fits *fit) {
+	return fit->rx * fit->ry * fit->naxes[2] * sizeof(WORD);
+}
+
+/* must not be called while frames are read */
+void raw_sequence_set_cache_size(struct raw_sequence *raw, gint64 bytes) {
+	if (!raw)
+		return;
+	g_mutex_lock(&raw->lock);
+	if (bytes <= 0) {
+		for (int i = 0; i < raw->number; i++) {
+			if (raw->frames[i]) {
+				memory_account(MEM_RAW_CACHE, -(gint64) frame_cost(raw->frames[i]));
+				clearfits(raw->frames[i]);
+				free(raw->frames[i]);
+				raw->frames[i] = NULL;
+			}
+		}
+		raw->used_bytes = 0;
+		bytes = 0;
+	}
+	raw->max_bytes = bytes;
+	raw->warned = FALSE;
+	g_mutex_unlock(&raw->lock);
+}
+
+void raw_sequence_free(struct raw_sequence *raw) {
+	if (!raw)
+		return;
+	raw_sequence_set_cache_size(raw, 0);
+	g_mutex_clear(&raw->lock);
+	g_cond_clear(&raw->decoded);
+	free(raw->frames);
+	free(raw->decoding);
+	g_free(raw->ext);
+	free(raw);
+}
+
+char *raw_sequence_get_image_filename(sequence *seq, int index, char *name_buffer) {
+	if (index < 0 || index >= seq->number || !name_buffer || !seq->raw_file)
+		return NULL;
+	if (seq->fixed <= 1)
+		snprintf(name_buffer, 256, "%s%d.%s", seq->seqname,
+				seq->imgparam[index].filenum, seq->raw_file->ext);
+	else snprintf(name_buffer, 256, "%s%.*d.%s", seq->seqname, seq->fixed,
+			seq->imgparam[index].filenum, seq->raw_file->ext);
+	return name_buffer;
+}
+
+static int decode_frame(sequence *seq, int index, fits *fit, gboolean header_only, gboolean verbose) {
+	char filename[256];
+	if (!raw_sequence_get_image_filename(seq, index, filename))
+		return 1;
+	int retval = verbose ? open_raw_files(filename, fit, FALSE) :
+		open_raw_file_silent(filename, fit, header_only);
+	if (retval < 0) {
+		siril_log_message(_("Could not load frame %d from RAW sequence %s\n"),
+				index, seq->seqname);
+		return 1;
+	}
+	return 0;
+}
+
+/* Gets the decoded frame index: from the cache, decoded in the cache if it
+ * has room, or in tmp otherwise. A frame being decoded for the cache by
+ * another thread is waited for instead of being decoded twice. */
+static int acquire_frame(sequence *seq, int index, fits *tmp, fits **frame) {
+	struct raw_sequence *raw = seq->raw_file;
+	*frame = NULL;
+	g_mutex_lock(&raw->lock);
+	while (raw->decoding[index])
+		g_cond_wait(&raw->decoded, &raw->lock);
+	if (raw->frames[index]) {
+		*frame = raw->frames[index];
+		g_mutex_unlock(&raw->lock);
+		return 0;
+	}
+	/* the memory is reserved before decoding, for the size of the sequence */
+	gint64 expected = (gint64) seq->rx * seq->ry * sizeof(WORD);
+	gboolean for_cache = expected > 0 && raw->used_bytes + expected <= raw->max_bytes;
+	if (for_cache) {
+		raw->decoding[index] = TRUE;
+		raw->used_bytes += expected;
+	}
+	g_mutex_unlock(&raw->lock);
+
+	/* the frames that are not cached are decoded for each read, they are
+	 * decoded silently not to flood the log */
+	memset(tmp, 0, sizeof(fits));
+	int retval = raw->decode(seq, index, tmp, FALSE, for_cache);
+	if (!for_cache) {
+		if (!retval)
+			*frame = tmp;
+		return retval;
+	}
+
+	fits *cached = NULL;
+	if (!retval && !(cached = malloc(sizeof(fits)))) {
+		PRINT_ALLOC_ERR;
+		clearfits(tmp);
+		retval = 1;
+	}
+	g_mutex_lock(&raw->lock);
+	raw->decoding[index] = FALSE;
+	if (retval) {
+		raw->used_bytes -= expected;
+	} else {
+		memcpy(cached, tmp, sizeof(fits));
+		memset(tmp, 0, sizeof(fits));
+		raw->used_bytes += (gint64) frame_cost(cached) - expected;
+		raw->frames[index] = cached;
+		*frame = cached;
+		memory_account(MEM_RAW_CACHE, frame_cost(cached));
+	}
+	g_cond_broadcast(&raw->decoded);
+	g_mutex_unlock(&raw->lock);
+	return retval;
+}
+
+int raw_sequence_read_frame(sequence *seq, int index, fits *dest, gboolean force_float) {
+	fits tmp, *frame;
+	if (acquire_frame(seq, index, &tmp, &frame))
+		return 1;
+	if (frame == &tmp) {
+		clearfits(dest);
+		memcpy(dest, &tmp, sizeof(fits));
+	} else {
+		if (copyfits(frame, dest, CP_ALLOC | CP_COPYA | CP_FORMAT, -1))
+			return 1;
+		copy_fits_metadata(frame, dest);
+	}
+	if (force_float) {
+		size_t pixel_count = dest->naxes[0] * dest->naxes[1] * dest->naxes[2];
+		float *newbuf = ushort_buffer_to_float(dest->data, pixel_count);
+		if (!newbuf) {
+			clearfits(dest);
+			return 1;
+		}
+		fit_replace_buffer(dest, newbuf, DATA_FLOAT);
+	}
+	return 0;
+}
+
+/* same as raw_sequence_read_frame() for the metadata and size only, read from
+ * the cached frame or from the header of the file, which is not decoded */
+int raw_sequence_read_metadata(sequence *seq, int index, fits *dest) {
+	struct raw_sequence *raw = seq->raw_file;
+	fits tmp = { 0 }, *frame = NULL;
+	g_mutex_lock(&raw->lock);
+	if (!raw->decoding[index] && raw->frames[index])
+		frame = raw->frames[index];
+	g_mutex_unlock(&raw->lock);
+	if (!frame) {
+		if (raw->decode(seq, index, &tmp, TRUE, FALSE))
+			return 1;
+		frame = &tmp;
+	}
+	copyfits(frame, dest, CP_FORMAT, -1);
+	copy_fits_metadata(frame, dest);
+	if (frame == &tmp)
+		clearfits(&tmp);
+	return 0;
+}
+
+/* reads area of a frame in buffer, in the same order as the partial reads of
+ * FITS files, see read_opened_fits_partial() */
+int raw_sequence_read_partial(sequence *seq, int layer, int index, void *buffer, const rectangle *area) {
+	fits tmp, *frame;
+	if (acquire_frame(seq, index, &tmp, &frame))
+		return 1;
+	if (frame == &tmp) {
+		struct raw_sequence *raw = seq->raw_file;
+		g_mutex_lock(&raw->lock);
+		gboolean warn = !raw->warned;
+		raw->warned = TRUE;
+		g_mutex_unlock(&raw->lock);
+		if (warn)
+			siril_log_color_message(_("The decoded RAW frames do not fit in memory, "
+						"they will be decoded for each block of rows\n"), "salmon");
+	}
+	int retval = 0;
+	if (layer >= frame->naxes[2] || area->x < 0 || area->y < 0 ||
+			area->x + area->w > frame->rx || area->y + area->h > frame->ry) {
+		fprintf(stderr, "partial read from RAW file has been requested outside image bounds or with invalid size (%d: %d %d %d %d)\n",
+				index + 1, area->x, area->y, area->w, area->h);
+		retval = 1;
+	} else {
+		/* rows are stored bottom-up, the area is given from the top */
+		WORD *buf = (WORD *) buffer;
+		for (int i = 0; i < area->h; i++) {
+			const WORD *row = frame->pdata[layer] +
+				(size_t) (frame->ry - area->y - 1 - i) * frame->rx + area->x;
+			memcpy(buf + (size_t) i * area->w, row, area->w * sizeof(WORD));
+		}
+	}
+	if (frame == &tmp)
+		clearfits(&tmp);
+	return retval;
+}
+
+int raw_sequence_create(const char *destroot, gchar **files, int nb_files, int start) {
+	if (nb_files <= 0)
+		return 1;
+	const char *ext = get_filename_ext(files[0]);
+	for (int i = 1; i < nb_files; i++) {
+		const char *file_ext = get_filename_ext(files[i]);
+		if (!file_ext || g_ascii_strcasecmp(file_ext, ext)) {
+			siril_log_color_message(_("All the RAW files of a RAW sequence must have the same extension, "
+						"%s differs from %s\n"), "red", files[i], files[0]);
+			return 1;
+		}
+	}
+
+	gchar *root = g_strdup(destroot);
+	gchar *lower_ext = g_ascii_strdown(ext, -1);
+	sequence *seq = calloc(1, sizeof(sequence));
+	initialize_sequence(seq, TRUE);
+	seq->seqname = normalize_seqname(root, TRUE);
+	seq->type = SEQ_RAW;
+	seq->beg = start;
+	seq->end = start + nb_files - 1;
+	seq->number = nb_files;
+	seq->selnum = nb_files;
+	seq->fixed = 5;
+	seq->imgparam = calloc(nb_files, sizeof(imgdata));
+	seq->raw_file = raw_sequence_new(lower_ext, nb_files);
+	g_free(lower_ext);
+	g_free(root);
+	if (!seq->imgparam || !seq->raw_file) {
+		PRINT_ALLOC_ERR;
+		free_sequence(seq, TRUE);
+		return 1;
+	}
+
+	gboolean allow_symlink = test_if_symlink_is_ok(TRUE);
+	int retval = 0;
+	for (int i = 0; i < nb_files && !retval; i++) {
+		char filename[256];
+		seq->imgparam[i].filenum = start + i;
+		seq->imgparam[i].incl = SEQUENCE_DEFAULT_INCLUDE;
+		raw_sequence_get_image_filename(seq, i, filename);
+		if (symlink_uniq_file(files[i], filename, allow_symlink)) {
+			siril_log_color_message(_("Could not link %s to %s\n"), "red", filename, files[i]);
+			retval = 1;
+		}
+	}
+	if (!retval && !(retval = writeseqfile(seq)))
+		siril_log_message(_("RAW sequence %s created with %d images, they will be decoded when processed\n"),
+				seq->seqname, nb_files);
+	free_sequence(seq, TRUE);
+	return retval;
+}
+
+#endif
@@ -0,0 +1,44 @@
+#ifndef _RAW_SEQUENCE_H_
+#define _RAW_SEQUENCE_H_
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+#ifdef HAVE_LIBRAW
+
+#include "core/siril.h"
+
+/* a sequence of RAW files read directly, with a cache of the decoded frames */
+struct raw_sequence {
+	gchar *ext;		// extension of the files of the sequence
+	int number;		// number of frames
+
+	GMutex lock;		// protects the cache
+	GCond decoded;		// signalled when a frame has been decoded
+	fits **frames;		// decoded frames in the cache, by index, NULL if not cached
+	gboolean *decoding;	// frame being decoded for the cache
+	gint64 max_bytes, used_bytes;	// memory of the cache
+	gboolean warned;	// the frames being decoded several times was logged
+
+	/* reads frame index of seq, its data only if !header_only, returns
+	 * non-zero on error. Replaced by the tests */
+	int (*decode)(sequence *seq, int index, fits *fit, gboolean header_only, gboolean verbose);
+};
+
+struct raw_sequence *raw_sequence_new(const char *ext, int number);
+void raw_sequence_free(struct raw_sequence *raw);
+
+/* the decoded frames are kept while the cache has room, up to bytes, 0 to
+ * release them and disable the cache */
+void raw_sequence_set_cache_size(struct raw_sequence *raw, gint64 bytes);
+
+char *raw_sequence_get_image_filename(sequence *seq, int index, char *name_buffer);
+int raw_sequence_read_frame(sequence *seq, int index, fits *dest, gboolean force_float);
+int raw_sequence_read_metadata(sequence *seq, int index, fits *dest);
+int raw_sequence_read_partial(sequence *seq, int layer, int index, void *buffer, const rectangle *area);
+
+/* creates a sequence of links to the RAW files, named after destroot and
+ * numbered from start, and its sequence file */
+int raw_sequence_create(const char *destroot, gchar **files, int nb_files, int start);
+
+#endif
+#endif
@@ -573,11 +573,74 @@ static gchar *get_remote_catalogue_cached_path(siril_catalogue *siril_cat, gbool
 	return filepath;
 }
 
+/* Looks in the download cache for a query of the same TAP catalogue whose cone
+ * contains the requested one, with a limit magnitude at least as deep.
+ * Returns the path of the smallest such file, NULL if none was found */
+static gchar *find_covering_cached_catalogue(siril_catalogue *siril_cat) {
+	if (siril_cat->cat_index < CAT_TYCHO2 || siril_cat->cat_index > CAT_EXOPLANETARCHIVE)
+		return NULL;
+	gchar *root = g_build_filename(siril_get_config_dir(), PACKAGE, "download_cache", NULL);
+	GDir *dir = g_dir_open(root, 0, NULL);
+	if (!dir) {
+		g_free(root);
+		return NULL;
+	}
+	gboolean check_mag = siril_cat->limitmag > 0 && (siril_catalog_columns(siril_cat->cat_index) & (1 << CAT_FIELD_MAG));
+	gchar *best = NULL;
+	double best_radius = DBL_MAX;
+	const gchar *name;
+	while ((name = g_dir_read_name(dir))) {
+		int code;
+		double ra, dec, radius, mag;
+		if (!g_str_has_suffix(name, ".csv") ||
+				sscanf(name, "cat_%d_%lf_%lf_%lf_%lf", &code, &ra, &dec, &radius, &mag) != 5 ||
+				code != (int) siril_cat->cat_index)
+			continue;
+		// the file names are rounded to 0.01 arcmin
+		double dist = compute_coords_distance(ra, dec, siril_cat->center_ra, siril_cat->center_dec) * 60.;
+		if (dist + siril_cat->radius > radius + 0.01 || radius >= best_radius)
+			continue;
+		if (check_mag && mag > 0. && mag < siril_cat->limitmag - 0.05)
+			continue;
+		if (!check_mag && siril_cat->limitmag <= 0. && mag > 0. &&
+				(siril_catalog_columns(siril_cat->cat_index) & (1 << CAT_FIELD_MAG)))
+			continue;	// the cached query was limited in magnitude
+		g_free(best);
+		best = g_build_filename(root, name, NULL);
+		best_radius = radius;
+	}
+	g_dir_close(dir);
+	g_free(root);
+	return best;
+}
+
+/* Removes the items of a catalogue loaded from a larger cached query that are
+ * outside the requested cone or fainter than the limit magnitude */
+static void restrict_catalogue_to_query(siril_catalogue *siril_cat) {
+	gboolean check_mag = siril_cat->limitmag > 0 && (siril_catalog_columns(siril_cat->cat_index) & (1 << CAT_FIELD_MAG));
+	double radius = siril_cat->radius / 60.;
+	int j = 0;
+	for (int i = 0; i < siril_cat->nbitems; i++) {
+		cat_item *item = siril_cat->cat_items + i;
+		if (compute_coords_distance(siril_cat->center_ra, siril_cat->center_dec, item->ra, item->dec) > radius ||
+				(check_mag && item->mag > siril_cat->limitmag)) {
+			siril_catalog_free_item(item);
+			continue;
+		}
+		if (j != i)
+			siril_cat->cat_items[j] = *item;
+		j++;
+	}
+	siril_debug_print("%d of %d items of the cached catalogue are in the query\n", j, siril_cat->nbitems);
+	siril_cat->nbitems = j;
+	siril_cat->nbincluded = j;
+}
+
 /* Downloads and writes to download_cache (if required) the online catalogue
    as per given catalogue type, center, radius, limit mag (optionnaly obscode and date obs for sso)
    Returns the path to the file (whether already cached or downloaded)
 */
-static gchar *download_catalog(siril_catalogue *siril_cat) {
+static gchar *download_catalog(siril_catalogue *siril_cat, gboolean *superset) {
 	gchar *str = NULL, *filepath = NULL, *url = NULL, *buffer = NULL;
 	GError *error = NULL;
 	GOutputStream *output_stream = NULL;
@@ -588,10 +651,19 @@ static gchar *download_catalog(siril_catalogue *siril_cat) {
 	filepath = get_remote_catalogue_cached_path(siril_cat, &catalog_is_in_cache, NO_DATALINK_RETRIEVAL);
 	g_free(str);
 
+	*superset = FALSE;
 	if (catalog_is_in_cache) {
 		siril_log_message(_("Using already downloaded catalogue %s\n"), catalog_to_str(siril_cat->cat_index));
 		return filepath;
 	}
+	gchar *covering = filepath ? find_covering_cached_catalogue(siril_cat) : NULL;
+	if (covering) {
+		siril_log_message(_("Using already downloaded catalogue %s from a larger query\n"), catalog_to_str(siril_cat->cat_index));
+		siril_debug_print("covering catalogue file: %s\n", covering);
+		g_free(filepath);
+		*superset = TRUE;
+		return covering;
+	}
 	if (!filepath) { // if the path is NULL, an error was caught earlier, just free and abort
 		g_free(str);
 		return NULL;
@@ -690,10 +762,17 @@ int siril_catalog_get_stars_from_online_catalogues(siril_catalogue *siril_cat) {
 		siril_debug_print("Online cat query - Should not happen\n");
 		return 0;
 	}
-	gchar *catfile = download_catalog(siril_cat);
+	gboolean superset;
+	gchar *catfile = download_catalog(siril_cat, &superset);
 	if (!catfile)
 		return 0;
 	int retval = siril_catalog_load_from_file(siril_cat, catfile);
+	g_free(catfile);
+	if (!retval && superset) {
+		restrict_catalogue_to_query(siril_cat);
+		if (!siril_cat->nbitems)
+			return -1;
+	}
 	if (!retval)
 		return siril_cat->nbitems;
 	if (retval == -1)
@@ -0,0 +1,382 @@
+/*
+ * This file is part of Siril, an astronomy image processor.
+ * Copyright (C) 2005-2011 Francois Meyer (dulle at free.fr)
+ * Copyright (C) 2012-2025 team free-astro (see more in AUTHORS file)
+ * Reference site is https://siril.org
+ *
+ * Siril is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Siril is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Siril. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Remote files are read by blocks of REMOTE_BLOCK_SIZE bytes, a read fetching
+ * the consecutive missing blocks it covers with one range request. The blocks
+ * are kept in a LRU cache, so that the next reads of the same area, like the
+ * row blocks of the stacking, do not download them again. The libcurl handles
+ * are kept between the requests to reuse their connections, each thread
+ * taking its own so that the workers of a sequence processing download their
+ * frames in parallel.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+#ifdef HAVE_LIBCURL
+#include <curl/curl.h>
+#endif
+
+#include "core/siril.h"
+#include "core/proto.h"
+#include "core/siril_log.h"
+#include "core/siril_networking.h"
+#include "io/remote_file.h"
+
+#define REMOTE_BLOCK_SIZE (4 << 20)
+#define REMOTE_CACHE_BLOCKS 64	// 256 MiB of cache for each file
+
+gboolean remote_file_is_url(const char *name) {
+	return name && (g_str_has_prefix(name, "http://") || g_str_has_prefix(name, "https://"));
+}
+
+gchar *remote_file_resolve(const char *name) {
+	if (!name)
+		return NULL;
+	if (remote_file_is_url(name))
+		return g_strdup(name);
+	if (g_file_test(name, G_FILE_TEST_EXISTS))
+		return NULL;
+	gchar *link = g_strdup_printf("%s.url", name);
+	gchar *contents = NULL;
+	gchar *url = NULL;
+	if (g_file_get_contents(link, &contents, NULL, NULL)) {
+		g_strstrip(contents);
+		if (remote_file_is_url(contents))
+			url = g_strdup(contents);
+		else siril_debug_print("%s does not contain a URL\n", link);
+	}
+	g_free(contents);
+	g_free(link);
+	return url;
+}
+
+#ifdef HAVE_LIBCURL
+
+struct remote_block {
+	gint64 index;
+	gchar *data;
+	gsize len;	// smaller than REMOTE_BLOCK_SIZE for the last block
+	GList *link;	// in the LRU list
+};
+
+struct remote_file {
+	gchar *url;
+	gint64 size;
+	GMutex lock;		// protects the cache
+	GHashTable *blocks;	// block index to struct remote_block
+	GQueue lru;		// most recently used first
+	GAsyncQueue *handles;	// idle libcurl handles
+	guint64 downloaded;
+};
+
+struct range_buffer {
+	gchar *data;
+	size_t len, capacity;
+};
+
+static size_t range_write_cb(void *buffer, size_t size, size_t nmemb, void *userp) {
+	struct range_buffer *rb = (struct range_buffer *) userp;
+	size_t realsize = size * nmemb;
+	if (rb->len + realsize > rb->capacity)
+		return 0;	// more than requested, the server ignored the range
+	memcpy(rb->data + rb->len, buffer, realsize);
+	rb->len += realsize;
+	return realsize;
+}
+
+/* the sizes given in the headers of the last response, after redirections */
+struct size_headers {
+	gint64 total;	// of Content-Range, for a partial response
+	gint64 content_length;
+};
+
+static size_t size_header_cb(char *buffer, size_t size, size_t nitems, void *userp) {
+	struct size_headers *sh = (struct size_headers *) userp;
+	size_t len = size * nitems;
+	gchar *line = g_strndup(buffer, len);
+	if (g_str_has_prefix(line, "HTTP/")) {
+		sh->total = -1;
+		sh->content_length = -1;
+	} else if (!g_ascii_strncasecmp(line, "Content-Range:", 14)) {
+		/* Content-Range: bytes 0-0/total, total being * if unknown */
+		const gchar *slash = strchr(line, '/');
+		if (slash && g_ascii_isdigit(slash[1]))
+			sh->total = g_ascii_strtoll(slash + 1, NULL, 10);
+	} else if (!g_ascii_strncasecmp(line, "Content-Length:", 15)) {
+		sh->content_length = g_ascii_strtoll(line + 15, NULL, 10);
+	}
+	g_free(line);
+	return len;
+}
+
+static gpointer curl_init_once(gpointer data) {
+	curl_global_init(CURL_GLOBAL_ALL);
+	return NULL;
+}
+
+static CURL *get_handle(remote_file *rf) {
+	CURL *curl = g_async_queue_try_pop(rf->handles);
+	if (curl) {
+		curl_easy_reset(curl);
+	} else {
+		static GOnce curl_once = G_ONCE_INIT;
+		g_once(&curl_once, curl_init_once, NULL);
+		curl = curl_easy_init();
+		if (!curl)
+			return NULL;
+	}
+	curl_easy_setopt(curl, CURLOPT_URL, rf->url);
+	curl_easy_setopt(curl, CURLOPT_USERAGENT, "siril/" PACKAGE_VERSION);
+	curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
+	curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
+	curl_easy_setopt(curl, CURLOPT_FAILONERROR, 1L);
+	if (g_getenv("CURL_CA_BUNDLE"))
+		curl_easy_setopt(curl, CURLOPT_CAINFO, g_getenv("CURL_CA_BUNDLE"));
+	return curl;
+}
+
+static void release_handle(remote_file *rf, CURL *curl) {
+	g_async_queue_push(rf->handles, curl);
+}
+
+/* downloads size bytes at offset in data */
+static int fetch_range(remote_file *rf, gint64 offset, gchar *data, size_t size) {
+	CURL *curl = get_handle(rf);
+	if (!curl)
+		return 1;
+	gchar *range = g_strdup_printf("%" G_GINT64_FORMAT "-%" G_GINT64_FORMAT,
+			offset, offset + (gint64) size - 1);
+	struct range_buffer rb = { data, 0, size };
+	curl_easy_setopt(curl, CURLOPT_RANGE, range);
+	curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, range_write_cb);
+	curl_easy_setopt(curl, CURLOPT_WRITEDATA, &rb);
+	CURLcode res = curl_easy_perform(curl);
+	long code = 0;
+	curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &code);
+	g_free(range);
+	release_handle(rf, curl);
+	/* 200 is accepted only if the whole file was requested */
+	if (res != CURLE_OK || rb.len != size || (code != 206 && !(code == 200 && size == rf->size))) {
+		siril_log_color_message(_("Reading %s failed (%s, HTTP code %ld)\n"), "red",
+				rf->url, curl_easy_strerror(res), code);
+		return 1;
+	}
+	g_mutex_lock(&rf->lock);
+	rf->downloaded += size;
+	g_mutex_unlock(&rf->lock);
+	return 0;
+}
+
+remote_file *remote_file_open(const char *url) {
+	if (!is_online()) {
+		siril_log_color_message(_("Siril is offline, %s cannot be read\n"), "red", url);
+		return NULL;
+	}
+	remote_file *rf = calloc(1, sizeof(remote_file));
+	if (!rf) {
+		PRINT_ALLOC_ERR;
+		return NULL;
+	}
+	rf->url = g_strdup(url);
+	rf->handles = g_async_queue_new_full((GDestroyNotify) curl_easy_cleanup);
+
+	/* the size is given by a request of the first byte, HEAD requests being
+	 * refused by some servers like the presigned URLs of S3 */
+	CURL *curl = get_handle(rf);
+	if (!curl) {
+		remote_file_close(rf);
+		return NULL;
+	}
+	gchar first_byte;
+	struct range_buffer rb = { &first_byte, 0, 1 };
+	struct size_headers sh = { -1, -1 };
+	curl_easy_setopt(curl, CURLOPT_RANGE, "0-0");
+	curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, range_write_cb);
+	curl_easy_setopt(curl, CURLOPT_WRITEDATA, &rb);
+	curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, size_header_cb);
+	curl_easy_setopt(curl, CURLOPT_HEADERDATA, &sh);
+	CURLcode res = curl_easy_perform(curl);
+	long code = 0;
+	curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &code);
+	release_handle(rf, curl);
+	gint64 length = -1;
+	if (code == 206 && res == CURLE_OK)
+		length = sh.total;
+	/* a server ignoring the range sends the whole file, the transfer is
+	 * stopped by the write callback */
+	else if (code == 200 && (res == CURLE_OK || res == CURLE_WRITE_ERROR))
+		length = sh.content_length;
+	if (length <= 0) {
+		siril_log_color_message(_("Cannot open %s: %s\n"), "red", url,
+				res != CURLE_OK && res != CURLE_WRITE_ERROR ? curl_easy_strerror(res) : _("unknown size"));
+		remote_file_close(rf);
+		return NULL;
+	}
+	rf->size = length;
+
+	g_mutex_init(&rf->lock);
+	rf->blocks = g_hash_table_new_full(g_int64_hash, g_int64_equal, NULL, NULL);
+	g_queue_init(&rf->lru);
+	siril_log_message(_("Opened remote file %s (%.1f MiB)\n"), url, rf->size / 1048576.0);
+	return rf;
+}
+
+gint64 remote_file_get_size(const remote_file *rf) {
+	return rf->size;
+}
+
+static void free_block(struct remote_block *block) {
+	g_free(block->data);
+	g_free(block);
+}
+
+/* copies the part of a cached block, returns FALSE if it is not in the cache */
+static gboolean copy_from_cache(remote_file *rf, gint64 index, gint64 offset, gchar *dst, size_t size) {
+	g_mutex_lock(&rf->lock);
+	struct remote_block *block = g_hash_table_lookup(rf->blocks, &index);
+	if (block) {
+		memcpy(dst, block->data + (offset - index * REMOTE_BLOCK_SIZE), size);
+		g_queue_unlink(&rf->lru, block->link);
+		g_queue_push_head_link(&rf->lru, block->link);
+	}
+	g_mutex_unlock(&rf->lock);
+	return block != NULL;
+}
+
+static gboolean is_cached(remote_file *rf, gint64 index) {
+	g_mutex_lock(&rf->lock);
+	gboolean cached = g_hash_table_contains(rf->blocks, &index);
+	g_mutex_unlock(&rf->lock);
+	return cached;
+}
+
+/* the cache takes ownership of data */
+static void add_to_cache(remote_file *rf, gint64 index, gchar *data, gsize len) {
+	g_mutex_lock(&rf->lock);
+	if (g_hash_table_contains(rf->blocks, &index)) {
+		/* downloaded by another thread meanwhile */
+		g_mutex_unlock(&rf->lock);
+		g_free(data);
+		return;
+	}
+	while (g_queue_get_length(&rf->lru) >= REMOTE_CACHE_BLOCKS) {
+		struct remote_block *old = g_queue_pop_tail(&rf->lru);
+		g_hash_table_remove(rf->blocks, &old->index);
+		free_block(old);
+	}
+	struct remote_block *block = g_new(struct remote_block, 1);
+	block->index = index;
+	block->data = data;
+	block->len = len;
+	g_queue_push_head(&rf->lru, block);
+	block->link = g_queue_peek_head_link(&rf->lru);
+	g_hash_table_insert(rf->blocks, &block->index, block);
+	g_mutex_unlock(&rf->lock);
+}
+
+int remote_file_read(remote_file *rf, gint64 offset, void *buf, size_t size) {
+	if (offset < 0 || offset + (gint64) size > rf->size)
+		return 1;
+	gchar *dst = (gchar *) buf;
+	gint64 end = offset + (gint64) size;
+	gint64 index = offset / REMOTE_BLOCK_SIZE;
+	while (offset < end) {
+		gint64 block_start = index * REMOTE_BLOCK_SIZE;
+		size_t part = (size_t) (MIN(end, block_start + REMOTE_BLOCK_SIZE) - offset);
+		if (copy_from_cache(rf, index, offset, dst, part)) {
+			offset += part;
+			dst += part;
+			index++;
+			continue;
+		}
+
+		/* downloads this block and the next missing ones of the read at once */
+		gint64 last = index;
+		while ((last + 1) * REMOTE_BLOCK_SIZE < end && !is_cached(rf, last + 1))
+			last++;
+		gint64 run_start = block_start;
+		gint64 run_end = MIN(rf->size, (last + 1) * REMOTE_BLOCK_SIZE);
+		gchar *run = g_try_malloc(run_end - run_start);
+		if (!run) {
+			PRINT_ALLOC_ERR;
+			return 1;
+		}
+		if (fetch_range(rf, run_start, run, run_end - run_start)) {
+			g_free(run);
+			return 1;
+		}
+		gint64 copy_end = MIN(end, run_end);
+		memcpy(dst, run + (offset - run_start), copy_end - offset);
+		dst += copy_end - offset;
+		offset = copy_end;
+		for (gint64 i = index; i <= last; i++) {
+			gint64 bstart = i * REMOTE_BLOCK_SIZE;
+			gsize blen = MIN(run_end, bstart + REMOTE_BLOCK_SIZE) - bstart;
+			gchar *data = g_try_malloc(blen);
+			if (!data)
+				break;	// the read is complete, the cache is not
+			memcpy(data, run + (bstart - run_start), blen);
+			add_to_cache(rf, i, data, blen);
+		}
+		g_free(run);
+		index = last + 1;
+	}
+	return 0;
+}
+
+void remote_file_close(remote_file *rf) {
+	if (!rf)
+		return;
+	if (rf->blocks) {
+		siril_debug_print("remote file %s: %" G_GUINT64_FORMAT " bytes downloaded\n",
+				rf->url, rf->downloaded);
+		g_queue_clear_full(&rf->lru, (GDestroyNotify) free_block);
+		g_hash_table_destroy(rf->blocks);
+		g_mutex_clear(&rf->lock);
+	}
+	g_async_queue_unref(rf->handles);
+	g_free(rf->url);
+	free(rf);
+}
+
+#else
+
+remote_file *remote_file_open(const char *url) {
+	siril_log_color_message(_("Siril was compiled without networking support, %s cannot be read\n"), "red", url);
+	return NULL;
+}
+
+gint64 remote_file_get_size(const remote_file *rf) {
+	return -1;
+}
+
+int remote_file_read(remote_file *rf, gint64 offset, void *buf, size_t size) {
+	return 1;
+}
+
+void remote_file_close(remote_file *rf) {
+}
+
+#endif
@@ -0,0 +1,24 @@
+#ifndef REMOTE_FILE_H
+#define REMOTE_FILE_H
+
+#include "core/siril.h"
+
+/* read-only access to a file served over HTTP(S), an object storage bucket
+ * for example, with range requests for the parts that are read and a cache of
+ * the downloaded blocks. Reads are thread-safe and run in parallel.
+ * Without libcurl, remote_file_open() always fails */
+typedef struct remote_file remote_file;
+
+gboolean remote_file_is_url(const char *name);
+/* returns the URL a local name designates: the name itself if it is a URL, or
+ * the content of the <name>.url link file when name does not exist. NULL if
+ * it is a regular local file */
+gchar *remote_file_resolve(const char *name);
+
+remote_file *remote_file_open(const char *url);
+gint64 remote_file_get_size(const remote_file *rf);
+/* returns 0 if size bytes were read at offset */
+int remote_file_read(remote_file *rf, gint64 offset, void *buf, size_t size);
+void remote_file_close(remote_file *rf);
+
+#endif
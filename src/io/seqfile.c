@@ -45,6 +45,9 @@
 #ifdef HAVE_FFMS2
 #include "io/films.h"
 #endif
+#ifdef HAVE_LIBRAW
+#include "io/raw_sequence.h"
+#endif
 
 /* seqfile version history *
  * no version up to 0.9.9
@@ -68,11 +71,644 @@
  * L nb_layers
  * (for all images) I filenum incl [width,height] [stats+] <- stats added at some point, removed in 0.9.9
  * (for all layers (x)) Rx regparam+
- * TS | TA | TF (type for ser or film (avi) or fits)
+ * TS | TA | TF | TR ext (type for ser or film (avi) or fits or RAW files with extension ext)
  * U up-scale_ratio -> discarded in v5
  * (for all images (y) and layers (x)) Mx-y stats+
  */
 
+/* Binary index of the sequence file (.seqb)
+ *
+ * Parsing the text cards takes seconds for sequences of tens of thousands of
+ * images, so writeseqfile() also saves what follows the S, T and L cards in a
+ * binary file next to the .seq, for sequences of at least SEQB_MIN_IMAGES
+ * images. It stores the size and modification time of the .seq it was
+ * written with and is ignored if they don't match anymore, the .seq always
+ * remains the reference. Values are rounded like they are printed in the
+ * text, so loading either gives the same sequence. The file is in the native
+ * byte order, an index written on another architecture is just ignored.
+ *
+ * Layout: header (magic, byte order mark, version, .seq size and mtime),
+ * number of images and variable flag, the I cards as 4 ints for each image,
+ * then cards starting with their type and layer characters as written in the
+ * text (D, R, M and O), terminated by an E card.
+ */
+#define SEQB_MAGIC "SIRILSQB"
+#define SEQB_VERSION 1
+#define SEQB_BYTE_ORDER 0x01020304u
+#define SEQB_MIN_IMAGES 1000
+
+struct seqb_reader {
+	const guint8 *ptr, *end;
+	gboolean error;
+};
+
+static gchar *get_seqb_filename(const char *seqfilename) {
+	return g_strdup_printf("%sb", seqfilename);
+}
+
+static float printed_float(float v) {
+	char buf[32];
+	float r = v;
+	g_snprintf(buf, sizeof buf, "%g", v);
+	sscanf(buf, "%g", &r);
+	return r;
+}
+
+static double printed_double(double v) {
+	char buf[32];
+	double r = v;
+	g_snprintf(buf, sizeof buf, "%lg", v);
+	sscanf(buf, "%lg", &r);
+	return r;
+}
+
+static void seqb_put_int(GByteArray *b, gint32 v) {
+	g_byte_array_append(b, (const guint8 *)&v, sizeof v);
+}
+
+static void seqb_put_int64(GByteArray *b, gint64 v) {
+	g_byte_array_append(b, (const guint8 *)&v, sizeof v);
+}
+
+static void seqb_put_float(GByteArray *b, float v) {
+	v = printed_float(v);
+	g_byte_array_append(b, (const guint8 *)&v, sizeof v);
+}
+
+static void seqb_put_double(GByteArray *b, double v) {
+	v = printed_double(v);
+	g_byte_array_append(b, (const guint8 *)&v, sizeof v);
+}
+
+static void seqb_put_card(GByteArray *b, char type, char layer) {
+	guint8 card[2] = { (guint8)type, (guint8)layer };
+	g_byte_array_append(b, card, 2);
+}
+
+static gboolean seqb_get(struct seqb_reader *r, void *dst, size_t size) {
+	if (r->error || (size_t)(r->end - r->ptr) < size) {
+		r->error = TRUE;
+		return FALSE;
+	}
+	if (dst)
+		memcpy(dst, r->ptr, size);
+	r->ptr += size;
+	return TRUE;
+}
+
+static gint32 seqb_get_int(struct seqb_reader *r) {
+	gint32 v = 0;
+	seqb_get(r, &v, sizeof v);
+	return v;
+}
+
+static gint64 seqb_get_int64(struct seqb_reader *r) {
+	gint64 v = 0;
+	seqb_get(r, &v, sizeof v);
+	return v;
+}
+
+static float seqb_get_float(struct seqb_reader *r) {
+	float v = 0.f;
+	seqb_get(r, &v, sizeof v);
+	return v;
+}
+
+static double seqb_get_double(struct seqb_reader *r) {
+	double v = 0.0;
+	seqb_get(r, &v, sizeof v);
+	return v;
+}
+
+static void seqb_put_regdata(GByteArray *b, const regdata *reg) {
+	seqb_put_float(b, reg->fwhm);
+	seqb_put_float(b, reg->weighted_fwhm);
+	seqb_put_float(b, reg->roundness);
+	seqb_put_double(b, reg->quality);
+	seqb_put_float(b, reg->background_lvl);
+	seqb_put_int(b, reg->number_of_stars);
+	seqb_put_double(b, reg->H.h00);
+	seqb_put_double(b, reg->H.h01);
+	seqb_put_double(b, reg->H.h02);
+	seqb_put_double(b, reg->H.h10);
+	seqb_put_double(b, reg->H.h11);
+	seqb_put_double(b, reg->H.h12);
+	seqb_put_double(b, reg->H.h20);
+	seqb_put_double(b, reg->H.h21);
+	seqb_put_double(b, reg->H.h22);
+}
+
+static void seqb_get_regdata(struct seqb_reader *r, regdata *reg) {
+	reg->fwhm = seqb_get_float(r);
+	reg->weighted_fwhm = seqb_get_float(r);
+	reg->roundness = seqb_get_float(r);
+	reg->quality = seqb_get_double(r);
+	reg->background_lvl = seqb_get_float(r);
+	reg->number_of_stars = seqb_get_int(r);
+	reg->H.h00 = seqb_get_double(r);
+	reg->H.h01 = seqb_get_double(r);
+	reg->H.h02 = seqb_get_double(r);
+	reg->H.h10 = seqb_get_double(r);
+	reg->H.h11 = seqb_get_double(r);
+	reg->H.h12 = seqb_get_double(r);
+	reg->H.h20 = seqb_get_double(r);
+	reg->H.h21 = seqb_get_double(r);
+	reg->H.h22 = seqb_get_double(r);
+}
+
+static void seqb_put_stats(GByteArray *b, const imstats *stats) {
+	seqb_put_int64(b, stats->total);
+	seqb_put_int64(b, stats->ngoodpix);
+	seqb_put_double(b, stats->mean);
+	seqb_put_double(b, stats->median);
+	seqb_put_double(b, stats->sigma);
+	seqb_put_double(b, stats->avgDev);
+	seqb_put_double(b, stats->mad);
+	seqb_put_double(b, stats->sqrtbwmv);
+	seqb_put_double(b, stats->location);
+	seqb_put_double(b, stats->scale);
+	seqb_put_double(b, stats->min);
+	seqb_put_double(b, stats->max);
+	seqb_put_double(b, stats->normValue);
+	seqb_put_double(b, stats->bgnoise);
+}
+
+static void seqb_get_stats(struct seqb_reader *r, imstats *stats) {
+	stats->total = (long)seqb_get_int64(r);
+	stats->ngoodpix = (long)seqb_get_int64(r);
+	stats->mean = seqb_get_double(r);
+	stats->median = seqb_get_double(r);
+	stats->sigma = seqb_get_double(r);
+	stats->avgDev = seqb_get_double(r);
+	stats->mad = seqb_get_double(r);
+	stats->sqrtbwmv = seqb_get_double(r);
+	stats->location = seqb_get_double(r);
+	stats->scale = seqb_get_double(r);
+	stats->min = seqb_get_double(r);
+	stats->max = seqb_get_double(r);
+	stats->normValue = seqb_get_double(r);
+	stats->bgnoise = seqb_get_double(r);
+}
+
+static void seqb_put_ostat(GByteArray *b, const overlap_stats_t *ostat) {
+	seqb_put_int(b, ostat->i);
+	seqb_put_int(b, ostat->j);
+	seqb_put_int(b, ostat->areai.x);
+	seqb_put_int(b, ostat->areai.y);
+	seqb_put_int(b, ostat->areaj.x);
+	seqb_put_int(b, ostat->areaj.y);
+	seqb_put_int(b, ostat->areai.w);
+	seqb_put_int(b, ostat->areai.h);
+	seqb_put_int64(b, (gint64)ostat->Nij);
+	seqb_put_float(b, ostat->medij);
+	seqb_put_float(b, ostat->medji);
+	seqb_put_float(b, ostat->madij);
+	seqb_put_float(b, ostat->madji);
+	seqb_put_float(b, ostat->locij);
+	seqb_put_float(b, ostat->locji);
+	seqb_put_float(b, ostat->scaij);
+	seqb_put_float(b, ostat->scaji);
+}
+
+static void seqb_get_ostat(struct seqb_reader *r, overlap_stats_t *ostat) {
+	ostat->i = seqb_get_int(r);
+	ostat->j = seqb_get_int(r);
+	ostat->areai.x = seqb_get_int(r);
+	ostat->areai.y = seqb_get_int(r);
+	ostat->areaj.x = seqb_get_int(r);
+	ostat->areaj.y = seqb_get_int(r);
+	ostat->areai.w = seqb_get_int(r);
+	ostat->areai.h = seqb_get_int(r);
+	ostat->Nij = (size_t)seqb_get_int64(r);
+	ostat->medij = seqb_get_float(r);
+	ostat->medji = seqb_get_float(r);
+	ostat->madij = seqb_get_float(r);
+	ostat->madji = seqb_get_float(r);
+	ostat->locij = seqb_get_float(r);
+	ostat->locji = seqb_get_float(r);
+	ostat->scaij = seqb_get_float(r);
+	ostat->scaji = seqb_get_float(r);
+	ostat->areaj.w = ostat->areai.w;
+	ostat->areaj.h = ostat->areai.h;
+}
+
+/* arguments of the D card of a layer, NULL if none is written */
+static gchar *get_distortion_card(const sequence *seq, int layer) {
+	const disto_params *disto = &seq->distoparam[layer];
+	switch (disto->index) {
+		case DISTO_FILE:
+		case DISTO_MASTER:
+			return g_strdup_printf("%d %s", disto->index, disto->filename);
+		case DISTO_FILES:
+			return g_strdup_printf("%d", DISTO_FILES);
+		case DISTO_FILE_COMET:
+			return g_strdup_printf("%d %.3f %.3f %s", DISTO_FILE_COMET,
+					disto->velocity.x, disto->velocity.y,
+					disto->filename ? disto->filename : "");
+		default:
+			return NULL;
+	}
+}
+
+/* parses the arguments of a D card for the layer character of the card */
+static int read_distortion_card(sequence *seq, char layer, const char *args) {
+	int current_layer = layer - '0';
+	if (current_layer < 0 || current_layer > seq->nb_layers) {
+		fprintf(stderr, "readseqfile: sequence file bad distortion layer: D%c %s\n", layer, args);
+		return 1;
+	}
+	int index, nb_tokens;
+	char buf0[256], buf1[256], buf2[256];
+	nb_tokens = sscanf(args, "%d %s %s %s\n",
+			&index,
+			buf0, buf1, buf2);
+	if (nb_tokens < 1 || nb_tokens > 4) {
+		fprintf(stderr, "readseqfile: sequence file bad distortion param: D%c %s\n", layer, args);
+		return 1;
+	}
+	if (!seq->distoparam)
+		seq->distoparam = calloc(seq->nb_layers, sizeof(disto_params));
+	seq->distoparam[current_layer].index = index;
+	if (index == DISTO_FILE || index == DISTO_MASTER) {
+		if (nb_tokens == 1) {
+			fprintf(stderr, "readseqfile: sequence file bad distortion param: D%c %s\n", layer, args);
+			return 1;
+		}
+		seq->distoparam[current_layer].filename = g_strdup(buf0);
+	}
+	if (index == DISTO_FILE_COMET) {
+		if (nb_tokens < 3) {
+			fprintf(stderr, "readseqfile: sequence file bad distortion param: D%c %s\n", layer, args);
+			return 1;
+		}
+		seq->distoparam[current_layer].velocity.x = (float)g_strtod(buf0, NULL);
+		seq->distoparam[current_layer].velocity.y = (float)g_strtod(buf1, NULL);
+		if (nb_tokens > 3) {
+			seq->distoparam[current_layer].filename = g_strdup(buf2);
+		}
+	}
+	return 0;
+}
+
+/* returns the registration data a R card with the given layer character is
+ * read into, allocating it if needed, or NULL on error. new_array is set to
+ * TRUE if it was allocated by this call */
+static regdata *get_card_regparam(sequence *seq, char layer, gboolean *new_array) {
+	int current_layer, to_backup;
+	regdata *regparam;
+	if (layer == '*') {
+		/* these are registration data for the CFA channel, the
+		 * star is a way to differentiate stats belonging to
+		 * CFA and those belonging to the demosaiced red
+		 * channel, both would have layer number 0 otherwise */
+		if (seq->type == SEQ_SER && ser_is_cfa(seq->ser_file) &&
+				!com.pref.debayer.open_debayer) {
+			siril_debug_print("- using CFA registration info\n");
+			to_backup = 0;
+		} else {
+			siril_debug_print("- backing up CFA registration info\n");
+			to_backup = 1;
+		}
+		current_layer = 0;
+	}
+	else {
+		to_backup = 0;
+		if (seq->type == SEQ_SER && ser_is_cfa(seq->ser_file) &&
+				!com.pref.debayer.open_debayer) {
+			to_backup = 1;
+			siril_debug_print("- stats: backing up demosaiced registration info\n");
+		}
+		current_layer = layer - '0';
+	}
+
+	if (current_layer < 0 || current_layer > 9 ||
+			(!seq->cfa_opened_monochrome && current_layer >= seq->nb_layers) ||
+			(seq->cfa_opened_monochrome && current_layer >= 3)) {
+		fprintf(stderr, "readseqfile: sequence file format error: bad layer in R%c card\n", layer);
+		return NULL;
+	}
+
+	if (to_backup) {
+		if (!seq->regparam_bkp) {
+			fprintf(stderr, "readseqfile: sequence type probably changed from CFA to MONO, invalid file\n");
+			return NULL;
+		}
+		regparam = seq->regparam_bkp[current_layer];
+	} else {
+		if (!seq->regparam) {
+			fprintf(stderr, "readseqfile: file contains registration data but not the basic information\n");
+			return NULL;
+		}
+		regparam = seq->regparam[current_layer];
+	}
+
+	*new_array = FALSE;
+	if (!regparam) {
+		regparam = calloc(seq->number, sizeof(regdata));
+		if (!regparam) {
+			PRINT_ALLOC_ERR;
+			return NULL;
+		}
+		*new_array = TRUE;
+		// reassign, because we didn't use a pointer
+		if (to_backup)
+			seq->regparam_bkp[current_layer] = regparam;
+		else seq->regparam[current_layer] = regparam;
+	}
+	if (!seq->distoparam)
+		seq->distoparam = calloc(seq->nb_layers, sizeof(disto_params));
+	return regparam;
+}
+
+/* returns the layer of the stats of a M card with the given layer character,
+ * -1 on error, and if they go to the backup stats in to_backup */
+static int get_card_stats_layer(const sequence *seq, char layer, gboolean *to_backup) {
+	int current_layer;
+	if (layer == '*') {
+		/* these are stats for the CFA channel, the star is a
+		 * way to differentiate stats belonging to CFA and
+		 * those belonging to the demosaiced red channel, both
+		 * would have layer number 0 otherwise */
+		if (seq->type == SEQ_SER && ser_is_cfa(seq->ser_file) &&
+				!com.pref.debayer.open_debayer) {
+			siril_debug_print("- stats: using CFA stats\n");
+			*to_backup = FALSE;
+		} else {
+			siril_debug_print("- stats: backing up CFA stats\n");
+			*to_backup = TRUE;
+		}
+		current_layer = 0;
+	}
+	else {
+		*to_backup = FALSE;
+		if (seq->type == SEQ_SER && ser_is_cfa(seq->ser_file) &&
+				!com.pref.debayer.open_debayer) {
+			*to_backup = TRUE;
+			siril_debug_print("- stats: backing up demosaiced stats\n");
+		}
+		current_layer = layer - '0';
+	}
+	if (current_layer < 0 || current_layer > 9)
+		return -1;
+	return current_layer;
+}
+
+/* reads the cards of the binary index. When apply is FALSE, only the
+ * structure is checked and the sequence is not modified.
+ * Returns 0 on success */
+static int walk_seqb(sequence *seq, struct seqb_reader *r, gboolean apply) {
+	int Npairs = seq->number * (seq->number - 1) / 2;
+	for (int i = 0; i < seq->number; i++) {
+		gint32 img[4];
+		if (!seqb_get(r, img, sizeof img))
+			return 1;
+		if (apply) {
+			seq->imgparam[i].filenum = img[0];
+			seq->imgparam[i].incl = img[1];
+			if (seq->is_variable) {
+				seq->imgparam[i].rx = img[2];
+				seq->imgparam[i].ry = img[3];
+			}
+		}
+	}
+
+	guint8 card[2];
+	while (seqb_get(r, card, 2)) {
+		switch (card[0]) {
+			case 'E':
+				return r->ptr != r->end;
+			case 'D':
+				{
+					gint32 len = seqb_get_int(r);
+					const char *args = (const char *)r->ptr;
+					if (len < 0 || len > 500 || !seqb_get(r, NULL, len))
+						return 1;
+					if (apply) {
+						gchar *card_args = g_strndup(args, len);
+						int retval = read_distortion_card(seq, card[1], card_args);
+						g_free(card_args);
+						if (retval)
+							return 1;
+					}
+				}
+				break;
+			case 'R':
+				{
+					regdata *regparam = NULL, dummy = { 0 };
+					if (apply) {
+						gboolean new_array;
+						regparam = get_card_regparam(seq, card[1], &new_array);
+						if (!regparam)
+							return 1;
+						if (!new_array) {
+							fprintf(stderr, "\nreadseqfile: out of array bounds in reg info!\n\n");
+							return 1;
+						}
+					}
+					for (int i = 0; i < seq->number; i++)
+						seqb_get_regdata(r, regparam ? &regparam[i] : &dummy);
+				}
+				break;
+			case 'M':
+				{
+					gboolean to_backup = FALSE;
+					int layer = 0;
+					if (apply && (layer = get_card_stats_layer(seq, card[1], &to_backup)) < 0)
+						return 1;
+					gint32 count = seqb_get_int(r);
+					if (count < 0 || count > seq->number)
+						return 1;
+					for (int k = 0; k < count; k++) {
+						imstats dummy = { 0 }, *stats = NULL;
+						gint32 image = seqb_get_int(r);
+						if (r->error || image < 0 || image >= seq->number)
+							return 1;
+						if (apply) {
+							allocate_stats(&stats);
+							if (!stats)
+								return 1;
+						}
+						else stats = &dummy;
+						seqb_get_stats(r, stats);
+						if (apply) {
+							if (to_backup)
+								add_stats_to_seq_backup(seq, image, layer, stats);
+							else add_stats_to_seq(seq, image, layer, stats);
+							free_stats(stats);	// we unreference it here
+						}
+					}
+				}
+				break;
+			case 'O':
+				{
+					int layer = card[1] - '0';
+					gint32 count = seqb_get_int(r);
+					if (layer < 0 || layer >= seq->nb_layers || count < 0 || count > Npairs)
+						return 1;
+					if (apply && !seq->ostats) {
+						seq->ostats = alloc_ostats(seq->nb_layers, seq->number);
+						if (!seq->ostats) {
+							PRINT_ALLOC_ERR;
+							return 1;
+						}
+					}
+					for (int k = 0; k < count; k++) {
+						overlap_stats_t ostat = { 0 };
+						seqb_get_ostat(r, &ostat);
+						if (r->error || ostat.i < 0 || ostat.i >= ostat.j || ostat.j >= seq->number)
+							return 1;
+						if (apply)
+							seq->ostats[layer][get_ijth_pair_index(seq->number, ostat.i, ostat.j)] = ostat;
+					}
+				}
+				break;
+			default:
+				return 1;
+		}
+	}
+	return 1;
+}
+
+/* loads what follows the L card from the binary index of the sequence file,
+ * if it is up to date.
+ * Returns 0 on success, 1 if the index cannot be used and the text has to be
+ * parsed and -1 if its data does not apply to the sequence */
+static int read_seqb(sequence *seq, const char *seqfilename) {
+	GStatBuf sts;
+	GMappedFile *map = NULL;
+	int retval = 1;
+	gchar *seqbname = get_seqb_filename(seqfilename);
+	if (!g_stat(seqfilename, &sts))
+		map = g_mapped_file_new(seqbname, FALSE, NULL);
+	g_free(seqbname);
+	if (!map)
+		return 1;
+
+	const guint8 *data = (const guint8 *)g_mapped_file_get_contents(map);
+	struct seqb_reader r = { data, data + g_mapped_file_get_length(map), FALSE };
+	char magic[8];
+	if (data && seqb_get(&r, magic, sizeof magic) &&
+			!memcmp(magic, SEQB_MAGIC, sizeof magic) &&
+			(guint32)seqb_get_int(&r) == SEQB_BYTE_ORDER &&
+			seqb_get_int(&r) == SEQB_VERSION &&
+			seqb_get_int64(&r) == (gint64)sts.st_size &&
+			seqb_get_int64(&r) == (gint64)sts.st_mtime &&
+			seqb_get_int(&r) == seq->number &&
+			seqb_get_int(&r) == seq->is_variable && !r.error) {
+		struct seqb_reader check = r;
+		if (!walk_seqb(seq, &check, FALSE))
+			retval = walk_seqb(seq, &r, TRUE) ? -1 : 0;
+		else siril_debug_print("binary index of %s is corrupted, ignoring it\n", seqfilename);
+	}
+	g_mapped_file_unref(map);
+	return retval;
+}
+
+/* writes the binary index of the sequence file that has just been written, or
+ * removes it for small sequences */
+static void write_seqb(const sequence *seq, const char *seqfilename) {
+	GStatBuf sts;
+	int i, layer;
+	gchar *seqbname = get_seqb_filename(seqfilename);
+	if (seq->number < SEQB_MIN_IMAGES || g_stat(seqfilename, &sts)) {
+		if (g_file_test(seqbname, G_FILE_TEST_EXISTS) && g_unlink(seqbname))
+			siril_debug_print("g_unlink() failed\n");
+		g_free(seqbname);
+		return;
+	}
+
+	GByteArray *b = g_byte_array_new();
+	g_byte_array_append(b, (const guint8 *)SEQB_MAGIC, 8);
+	seqb_put_int(b, (gint32)SEQB_BYTE_ORDER);
+	seqb_put_int(b, SEQB_VERSION);
+	seqb_put_int64(b, (gint64)sts.st_size);
+	seqb_put_int64(b, (gint64)sts.st_mtime);
+	seqb_put_int(b, seq->number);
+	seqb_put_int(b, seq->is_variable);
+	for (i = 0; i < seq->number; i++) {
+		seqb_put_int(b, seq->imgparam[i].filenum);
+		seqb_put_int(b, seq->imgparam[i].incl);
+		seqb_put_int(b, seq->imgparam[i].rx);
+		seqb_put_int(b, seq->imgparam[i].ry);
+	}
+
+	/* same cards and order as in the text */
+	for (layer = 0; layer < seq->nb_layers; layer++) {
+		char layer_char = seq->cfa_opened_monochrome ? '*' : '0' + layer;
+		if (seq->regparam && seq->regparam[layer]) {
+			if (layer_has_distortion(seq, layer)) {
+				gchar *disto = get_distortion_card(seq, layer);
+				if (disto) {
+					seqb_put_card(b, 'D', layer_char);
+					seqb_put_int(b, strlen(disto));
+					g_byte_array_append(b, (const guint8 *)disto, strlen(disto));
+					g_free(disto);
+				}
+			}
+			seqb_put_card(b, 'R', layer_char);
+			for (i = 0; i < seq->number; i++)
+				seqb_put_regdata(b, &seq->regparam[layer][i]);
+		}
+		if (seq->stats && seq->stats[layer]) {
+			int count = 0;
+			for (i = 0; i < seq->number; i++)
+				if (seq->stats[layer][i]) count++;
+			seqb_put_card(b, 'M', layer_char);
+			seqb_put_int(b, count);
+			for (i = 0; i < seq->number; i++) {
+				if (!seq->stats[layer][i]) continue;
+				seqb_put_int(b, i);
+				seqb_put_stats(b, seq->stats[layer][i]);
+			}
+		}
+	}
+	for (layer = 0; layer < 3; layer++) {
+		char layer_char = seq->cfa_opened_monochrome ? '0' + layer : '*';
+		if (seq->regparam_bkp && seq->regparam_bkp[layer]) {
+			seqb_put_card(b, 'R', layer_char);
+			for (i = 0; i < seq->number; i++)
+				seqb_put_regdata(b, &seq->regparam_bkp[layer][i]);
+		}
+		if (seq->stats_bkp && seq->stats_bkp[layer]) {
+			int count = 0;
+			for (i = 0; i < seq->number; i++)
+				if (seq->stats_bkp[layer][i]) count++;
+			seqb_put_card(b, 'M', layer_char);
+			seqb_put_int(b, count);
+			for (i = 0; i < seq->number; i++) {
+				if (!seq->stats_bkp[layer][i]) continue;
+				seqb_put_int(b, i);
+				seqb_put_stats(b, seq->stats_bkp[layer][i]);
+			}
+		}
+	}
+	if (seq->ostats) {
+		int Npairs = seq->number * (seq->number - 1) / 2;
+		for (layer = 0; layer < seq->nb_layers; layer++) {
+			int count = 0;
+			for (i = 0; i < Npairs; i++)
+				if (seq->ostats[layer][i].i != -1) count++;
+			if (!count) continue;
+			seqb_put_card(b, 'O', '0' + layer);
+			seqb_put_int(b, count);
+			for (i = 0; i < Npairs; i++) {
+				if (seq->ostats[layer][i].i == -1)
+					continue;
+				seqb_put_ostat(b, &seq->ostats[layer][i]);
+			}
+		}
+	}
+	seqb_put_card(b, 'E', '\0');
+
+	GError *error = NULL;
+	if (!g_file_set_contents(seqbname, (const gchar *)b->data, b->len, &error)) {
+		siril_debug_print("Writing binary index of the sequence failed: %s\n", error->message);
+		g_clear_error(&error);
+	}
+	g_byte_array_free(b, TRUE);
+	g_free(seqbname);
+}
+
 /* name is sequence filename, with or without .seq extension
  * It should always be used with seq_check_basic_data() because on first loading
  * of a .seq that was created from scan of the filesystem, number of layers and
@@ -83,7 +719,9 @@ sequence * readseqfile(const char *name){
 	char line[512], *scanformat;
 	char filename[512], *seqfilename;
 	int i, nb_tokens, allocated = 0, current_layer = -1, image;
-	int to_backup = 0, version = -1;
+	int version = -1;
+	gboolean to_backup = FALSE, from_index = FALSE;
+	gchar *seqfile_path;	// seqfilename is changed for SER
 	FILE *seqfile;
 	sequence *seq;
 	imstats *stats;
@@ -104,11 +742,12 @@ sequence * readseqfile(const char *name){
 		free(seqfilename);
 		return NULL;
 	}
+	seqfile_path = g_strdup(seqfilename);
 
 	seq = calloc(1, sizeof(sequence));
 	initialize_sequence(seq, TRUE);
 	i = 0;
-	while (fgets(line, 511, seqfile)) {
+	while (!from_index && fgets(line, 511, seqfile)) {
 		switch (line[0]) {
 			case '#':
 				continue;
@@ -186,6 +825,17 @@ sequence * readseqfile(const char *name){
 					fprintf(stderr, "readseqfile: sequence file format error, missing S line\n");
 					goto error;
 				}
+				if (i == 0 && version == CURRENT_SEQFILE_VERSION &&
+						seq->number >= SEQB_MIN_IMAGES) {
+					int retval = read_seqb(seq, seqfile_path);
+					if (retval < 0)
+						goto error;
+					if (!retval) {
+						siril_debug_print("- loaded from the binary index\n");
+						from_index = TRUE;
+						break;
+					}
+				}
 
 				if (version <= 3) {
 					allocate_stats(&stats);
@@ -229,105 +879,21 @@ sequence * readseqfile(const char *name){
 				++i;
 				break;
 			case 'D': // Distortion data - from version 5 onwards
-				current_layer = line[1] - '0';
-				if (current_layer < 0 || current_layer > seq->nb_layers) {
-					fprintf(stderr, "readseqfile: sequence file bad distortion layer: %s\n", line);
+				line[strcspn(line, "\r\n")] = '\0';
+				if (read_distortion_card(seq, line[1], line + 3))
 					goto error;
-				}
-				int index;
-				char buf0[256], buf1[256], buf2[256];
-				nb_tokens = sscanf(line + 3, "%d %s %s %s\n",
-							&index,
-							buf0, buf1, buf2);
-				if (nb_tokens < 1 || nb_tokens > 4) {
-					fprintf(stderr, "readseqfile: sequence file bad distortion param: %s\n", line);
-					goto error;
-				}
-				if (!seq->distoparam)
-					seq->distoparam = calloc(seq->nb_layers, sizeof(disto_params));
-				seq->distoparam[current_layer].index = index;
-				if (index == DISTO_FILE || index == DISTO_MASTER) {
-					if (nb_tokens == 1) {
-						fprintf(stderr, "readseqfile: sequence file bad distortion param: %s\n", line);
-						goto error;
-					}
-					seq->distoparam[current_layer].filename = g_strdup(buf0);
-				}
-				if (index == DISTO_FILE_COMET) {
-					if (nb_tokens < 3) {
-						fprintf(stderr, "readseqfile: sequence file bad distortion param: %s\n", line);
-						goto error;
-					}
-					seq->distoparam[current_layer].velocity.x = (float)g_strtod(buf0, NULL);
-					seq->distoparam[current_layer].velocity.y = (float)g_strtod(buf1, NULL);
-					if (nb_tokens > 3) {
-						seq->distoparam[current_layer].filename = g_strdup(buf2);
-					}
-				}
 				++i;
 				break;
 			case 'R':
 				/* registration info */
-				if (line[1] == '*') {
-					/* these are registration data for the CFA channel, the
-					 * star is a way to differentiate stats belonging to
-					 * CFA and those belonging to the demosaiced red
-					 * channel, both would have layer number 0 otherwise */
-					if (seq->type == SEQ_SER && ser_is_cfa(seq->ser_file) &&
-							!com.pref.debayer.open_debayer) {
-						siril_debug_print("- using CFA registration info\n");
-						to_backup = 0;
-					} else {
-						siril_debug_print("- backing up CFA registration info\n");
-						to_backup = 1;
-					}
-					current_layer = 0;
-				}
-				else {
-					to_backup = 0;
-					if (seq->type == SEQ_SER && ser_is_cfa(seq->ser_file) &&
-							!com.pref.debayer.open_debayer) {
-						to_backup = 1;
-						siril_debug_print("- stats: backing up demosaiced registration info\n");
-					}
-					current_layer = line[1] - '0';
-				}
-
-				if (current_layer < 0 || current_layer > 9 ||
-						(!seq->cfa_opened_monochrome && current_layer >= seq->nb_layers) ||
-						(seq->cfa_opened_monochrome && current_layer >= 3)) {
-					fprintf(stderr,"readseqfile: sequence file format error: %s\n",line);
-					goto error;
-				}
-
-				if (to_backup) {
-					if (!seq->regparam_bkp) {
-						fprintf(stderr, "readseqfile: sequence type probably changed from CFA to MONO, invalid file\n");
+				{
+					gboolean new_array;
+					regparam = get_card_regparam(seq, line[1], &new_array);
+					if (!regparam)
 						goto error;
-					}
-					regparam = seq->regparam_bkp[current_layer];
-				} else {
-					if (!seq->regparam) {
-						fprintf(stderr, "readseqfile: file contains registration data but not the basic information\n");
-						goto error;
-					}
-					regparam = seq->regparam[current_layer];
+					if (new_array)
+						i = 0;	// one line per image, starting with 0
 				}
-
-				if (!regparam) {
-					regparam = calloc(seq->number, sizeof(regdata));
-					if (!regparam) {
-						PRINT_ALLOC_ERR;
-						goto error;
-					}
-					i = 0;	// one line per image, starting with 0
-					// reassign, because we didn't use a pointer
-					if (to_backup)
-						seq->regparam_bkp[current_layer] = regparam;
-					else seq->regparam[current_layer] = regparam;
-				}
-				if (!seq->distoparam)
-					seq->distoparam = calloc(seq->nb_layers, sizeof(disto_params));
 				if (i >= seq->number) {
 					fprintf(stderr, "\nreadseqfile: out of array bounds in reg info!\n\n");
 					goto error;
@@ -454,6 +1020,21 @@ sequence * readseqfile(const char *name){
 						goto error;
 					}
 				}
+#ifdef HAVE_LIBRAW
+				else if (line[1] == 'R') {
+					/* followed by the extension of the RAW files */
+					seq->type = SEQ_RAW;
+					if (seq->raw_file) break;
+					gchar *ext = g_strstrip(g_strdup(line + 2));
+					if (ext[0] != '\0')
+						seq->raw_file = raw_sequence_new(ext, seq->number);
+					g_free(ext);
+					if (!seq->raw_file) {
+						fprintf(stderr, "readseqfile: sequence file format error: %s\n", line);
+						goto error;
+					}
+				}
+#endif
 #ifdef HAVE_FFMS2
 				else if (line[1] == 'A') {
 					seq->type = SEQ_AVI;
@@ -518,32 +1099,8 @@ sequence * readseqfile(const char *name){
 				 * indices for them, the line is Mx-y with x the layer number
 				 * and y the image index */
 
-				if (line[1] == '*') {
-					/* these are stats for the CFA channel, the star is a
-					 * way to differentiate stats belonging to CFA and
-					 * those belonging to the demosaiced red channel, both
-					 * would have layer number 0 otherwise */
-					if (seq->type == SEQ_SER && ser_is_cfa(seq->ser_file) &&
-							!com.pref.debayer.open_debayer) {
-						siril_debug_print("- stats: using CFA stats\n");
-						to_backup = 0;
-					} else {
-						siril_debug_print("- stats: backing up CFA stats\n");
-						to_backup = 1;
-					}
-					current_layer = 0;
-				}
-				else {
-					to_backup = 0;
-					if (seq->type == SEQ_SER && ser_is_cfa(seq->ser_file) &&
-							!com.pref.debayer.open_debayer) {
-						to_backup = 1;
-						siril_debug_print("- stats: backing up demosaiced stats\n");
-					}
-					current_layer = line[1] - '0';
-				}
-
-				if (current_layer < 0 || current_layer > 9 || line[2] != '-') {
+				current_layer = get_card_stats_layer(seq, line[1], &to_backup);
+				if (current_layer < 0 || line[2] != '-') {
 					fprintf(stderr, "readseqfile: sequence file format error: %s\n",line);
 					goto error;
 				}
@@ -644,6 +1201,7 @@ sequence * readseqfile(const char *name){
 
 
 	free(seqfilename);
+	g_free(seqfile_path);
 	return seq;
 error:
 	fclose(seqfile);
@@ -653,6 +1211,7 @@ error:
 	siril_log_message(_("Could not load sequence %s\n"), name);
 
 	free(seqfilename);
+	g_free(seqfile_path);
 	return NULL;
 }
 
@@ -674,7 +1233,6 @@ int writeseqfile(sequence *seq){
 		return 1;
 	}
 	fprintf(stdout, "Writing sequence file %s\n", filename);
-	free(filename);
 
 	fprintf(seqfile,"#Siril sequence file. Contains list of images, selection, registration data and statistics\n");
 	fprintf(seqfile,"#S 'sequence_name' start_index nb_images nb_selected fixed_len reference_image version variable_size fz_flag\n");
@@ -688,10 +1246,19 @@ int writeseqfile(sequence *seq){
 			case SEQ_SER: type = 'S'; break;
 #ifdef HAVE_FFMS2
 			case SEQ_AVI: type = 'A'; break;
+#endif
+#ifdef HAVE_LIBRAW
+			case SEQ_RAW: type = 'R'; break;
 #endif
 			case SEQ_FITSEQ: type = 'F'; break;
 		}
-		/* sequence type, not needed for regular, S for ser, A for avi */
+		/* sequence type, not needed for regular, S for ser, A for avi,
+		 * R for RAW followed by the extension of the files */
+#ifdef HAVE_LIBRAW
+		if (seq->type == SEQ_RAW)
+			fprintf(seqfile, "T%c %s\n", type, seq->raw_file->ext);
+		else
+#endif
 		fprintf(seqfile, "T%c\n", type);
 	}
 
@@ -714,29 +1281,12 @@ int writeseqfile(sequence *seq){
 	for (layer = 0; layer < seq->nb_layers; layer++) {
 		if (seq->regparam && seq->regparam[layer]) {
 			if (layer_has_distortion(seq, layer)) {
-				if (seq->distoparam[layer].index == DISTO_FILE)
-					fprintf(seqfile, "D%c %d %s\n",
-					seq->cfa_opened_monochrome ? '*' : '0' + layer,
-					DISTO_FILE,
-					seq->distoparam[layer].filename);
-				else if (seq->distoparam[layer].index == DISTO_FILES)
-					fprintf(seqfile, "D%c %d\n",
-					seq->cfa_opened_monochrome ? '*' : '0' + layer,
-					DISTO_FILES);
-				else if (seq->distoparam[layer].index == DISTO_MASTER) {
-					fprintf(seqfile, "D%c %d %s\n",
-					seq->cfa_opened_monochrome ? '*' : '0' + layer,
-					DISTO_MASTER,
-					seq->distoparam[layer].filename);
-				}
-				else if (seq->distoparam[layer].index == DISTO_FILE_COMET) {
-					fprintf(seqfile, "D%c %d %.3f %.3f %s\n",
-					seq->cfa_opened_monochrome ? '*' : '0' + layer,
-					DISTO_FILE_COMET,
-					seq->distoparam[layer].velocity.x,
-					seq->distoparam[layer].velocity.y,
-					seq->distoparam[layer].filename ? seq->distoparam[layer].filename : "");
-				}
+				gchar *disto = get_distortion_card(seq, layer);
+				if (disto)
+					fprintf(seqfile, "D%c %s\n",
+							seq->cfa_opened_monochrome ? '*' : '0' + layer,
+							disto);
+				g_free(disto);
 			}
 			for (i = 0; i < seq->number; ++i) {
 				fprintf(seqfile, "R%c %g %g %g %g %g %d H %g %g %g %g %g %g %g %g %g\n",
@@ -859,6 +1409,8 @@ int writeseqfile(sequence *seq){
 	}
 
 	fclose(seqfile);
+	write_seqb(seq, filename);
+	free(filename);
 	seq->needs_saving = FALSE;
 	return 0;
 }
@@ -957,6 +1509,8 @@ int buildseqfile(sequence *seq, int force_recompute) {
 #else
 	seq->selnum = 0;
 #endif
+	if (seq->type == SEQ_REGULAR)
+		seq_scan_image_sizes(seq);
 	writeseqfile(seq);
 
 	fprintf(stdout, "Sequence found: %s %d->%d\n", seq->seqname, seq->beg, seq->end);
@@ -56,6 +56,9 @@
 #ifdef HAVE_FFMS2
 #include "films.h"
 #endif
+#ifdef HAVE_LIBRAW
+#include "raw_sequence.h"
+#endif
 #include "avi_pipp/avi_writer.h"
 #include "single_image.h"
 #include "image_format_fits.h"
@@ -77,6 +80,9 @@
 #include "registration/registration.h"
 #include "stacking/stacking.h"	// for update_stack_interface
 #include "opencv/opencv.h"
+#include "io/frame_cache.h"
+#include "io/io_stats.h"
+#include "core/memory_report.h"
 
 #include "sequence.h"
 
@@ -367,17 +373,23 @@ static sequence *check_seq_one_file(const char* name, gboolean check_for_fitseq)
 	const char *ext = get_filename_ext(name);
 	sequence *new_seq = NULL;
 
-	if (!strcasecmp(ext, "ser")) {
+	/* name.ser.url is a link to a SER file read over HTTP */
+	gboolean ser_link = !strcasecmp(ext, "url") && fnlen > 8 &&
+		!g_ascii_strcasecmp(name + fnlen - 8, ".ser.url");
+	if (!strcasecmp(ext, "ser") || ser_link) {
 		struct ser_struct *ser_file = malloc(sizeof(struct ser_struct));
 		ser_init_struct(ser_file);
-		int ret = ser_open_file(name, ser_file);
+		gchar *ser_name = g_strndup(name, ser_link ? fnlen - 4 : fnlen);
+		int ret = ser_open_file(ser_name, ser_file);
+		g_free(ser_name);
 		if (ret) {
+			free(ser_file);
 			return NULL;
 		}
 
 		new_seq = calloc(1, sizeof(sequence));
 		initialize_sequence(new_seq, TRUE);
-		new_seq->seqname = g_strndup(name, fnlen - 4);
+		new_seq->seqname = g_strndup(name, fnlen - (ser_link ? 8 : 4));
 		new_seq->beg = 0;
 		new_seq->end = ser_file->frame_count - 1;
 		new_seq->number = ser_file->frame_count;
@@ -468,7 +480,7 @@ int seq_check_basic_data(sequence *seq, gboolean load_ref_into_gfit) {
 				fprintf(stderr, "could not load first image from sequence\n");
 				return -1;
 			}
-		} else {
+		} else if (seq->type != SEQ_REGULAR || seq_read_frame_basic_info(seq, image_to_load, fit)) {
 			if (seq_read_frame_metadata(seq, image_to_load, fit)) {
 				fprintf(stderr, "could not load first image from sequence\n");
 				return -1;
@@ -685,6 +697,9 @@ int64_t seq_compute_size(sequence *seq, int nb_frames, data_type depth) {
 		break;
 	case SEQ_REGULAR:
 	case SEQ_FITSEQ:
+#ifdef HAVE_LIBRAW
+	case SEQ_RAW:	// as the decoded frames
+#endif
 		frame_size = (int64_t) seq->rx * seq->ry * seq->nb_layers;
 		if (depth == DATA_USHORT)
 			frame_size *= sizeof(WORD);
@@ -772,6 +787,10 @@ char *seq_get_image_filename(sequence *seq, int index, char *name_buf) {
 			}
 			snprintf(name_buf, 255, "%s_%d", seq->seqname, index);
 			return name_buf;
+#endif
+#ifdef HAVE_LIBRAW
+		case SEQ_RAW:
+			return raw_sequence_get_image_filename(seq, index, name_buf);
 #endif
 		case SEQ_INTERNAL:
 			snprintf(name_buf, 255, "%s_%d", seq->seqname, index);
@@ -780,10 +799,27 @@ char *seq_get_image_filename(sequence *seq, int index, char *name_buf) {
 	return NULL;
 }
 
-/* Read an entire image from a sequence, inside a pre-allocated fits.
- * Opens the file, reads data, closes the file.
- */
-int seq_read_frame(sequence *seq, int index, fits *dest, gboolean force_float, int thread_id) {
+/* checks a frame just loaded against the sequence and updates its stats and
+ * the image parameters of the sequence */
+static int seq_frame_loaded(sequence *seq, int index, fits *dest) {
+	if (seq->nb_layers > 0 &&  seq->nb_layers != dest->naxes[2]) {
+		siril_log_color_message(_("Image #%d: number of layers (%d) is not consistent with sequence (%d), aborting\n"), "red",
+			index, dest->naxes[2], seq->nb_layers);
+		return 1;
+	}
+
+	full_stats_invalidation_from_fit(dest);
+	copy_seq_stats_to_fit(seq, index, dest);
+	seq->imgparam[index].rx = dest->rx;
+	seq->imgparam[index].ry = dest->ry;
+	if (seq->rx != 0 && seq->ry != 0 && (dest->rx != seq->rx || dest->ry != seq->ry)) {
+		siril_debug_print("sequence detected as containing images of different sizes\n");
+		seq->is_variable = TRUE;
+	}
+	return 0;
+}
+
+static int read_frame(sequence *seq, int index, fits *dest, gboolean force_float, int thread_id) {
 	char filename[256];
 	assert(index < seq->number);
 	switch (seq->type) {
@@ -822,6 +858,13 @@ int seq_read_frame(sequence *seq, int index, fits *dest, gboolean force_float, i
 			}
 			// should dest->maxi be set to 255 here?
 			break;
+#endif
+#ifdef HAVE_LIBRAW
+		case SEQ_RAW:
+			assert(seq->raw_file);
+			if (raw_sequence_read_frame(seq, index, dest, force_float))
+				return 1;
+			break;
 #endif
 		case SEQ_INTERNAL:
 			assert(seq->internal_fits);
@@ -843,30 +886,61 @@ int seq_read_frame(sequence *seq, int index, fits *dest, gboolean force_float, i
 			else return 1;
 			break;
 	}
-	if (seq->nb_layers > 0 &&  seq->nb_layers != dest->naxes[2]) {
+	return seq_frame_loaded(seq, index, dest);
+}
+
+/* Read an entire image from a sequence, inside a pre-allocated fits.
+ * Opens the file, reads data, closes the file.
+ */
+int seq_read_frame(sequence *seq, int index, fits *dest, gboolean force_float, int thread_id) {
+	gint64 start = g_get_monotonic_time();
+	int retval = read_frame(seq, index, dest, force_float, thread_id);
+	if (!retval)
+		io_stats_add_read(seq->type, io_stats_image_bytes(dest), g_get_monotonic_time() - start);
+	return retval;
+}
+
+/* same as seq_read_frame above, but first looks for the frame in the frame
+ * cache, and adds it to the cache when it was read from the file */
+int seq_read_frame_cached(sequence *seq, int index, fits *dest, gboolean force_float, int thread_id) {
+	frame_cache_slot *slot;
+	if (frame_cache_get(seq, index, dest, force_float, &slot))
+		return seq_frame_loaded(seq, index, dest);
+	if (seq_read_frame(seq, index, dest, force_float, thread_id)) {
+		frame_cache_put(slot, NULL);
+		return 1;
+	}
+	frame_cache_put(slot, dest);
+	return 0;
+}
+
+/* reads the area of all layers of a frame with its metadata, as seq_read_frame()
+ * followed by a crop to area would do. Only available for sequences of FITS
+ * images, returns 1 for the other types. */
+int seq_read_frame_area(sequence *seq, int index, fits *dest, const rectangle *area, gboolean force_float) {
+	char filename[256];
+	if (seq->type != SEQ_REGULAR)
+		return 1;
+	gint64 start = g_get_monotonic_time();
+	fit_sequence_get_image_filename(seq, index, filename, TRUE);
+	if (readfits_area(filename, dest, area, force_float)) {
+		siril_log_message(_("Could not load partial image %d from sequence %s\n"),
+				index, seq->seqname);
+		return 1;
+	}
+	if (seq->nb_layers > 0 && seq->nb_layers != dest->naxes[2]) {
 		siril_log_color_message(_("Image #%d: number of layers (%d) is not consistent with sequence (%d), aborting\n"), "red",
 			index, dest->naxes[2], seq->nb_layers);
 		return 1;
 	}
-
 	full_stats_invalidation_from_fit(dest);
-	copy_seq_stats_to_fit(seq, index, dest);
-	seq->imgparam[index].rx = dest->rx;
-	seq->imgparam[index].ry = dest->ry;
-	if (seq->rx != 0 && seq->ry != 0 && (dest->rx != seq->rx || dest->ry != seq->ry)) {
-		siril_debug_print("sequence detected as containing images of different sizes\n");
-		seq->is_variable = TRUE;
-	}
+	io_stats_add_read(seq->type, io_stats_image_bytes(dest), g_get_monotonic_time() - start);
 	return 0;
 }
 
-/* same as seq_read_frame above, but creates an image the size of the selection
- * rectangle only. layer is set to the layer number in the read partial frame.
- * The partial image result is only one-channel deep, so it cannot be used to
- * have a partial RGB image. */
-int seq_read_frame_part(sequence *seq, int layer, int index, fits *dest, const rectangle *area, gboolean do_photometry, int thread_id) {
+static int read_frame_part(sequence *seq, int layer, int index, fits *dest, const rectangle *area, gboolean do_photometry, int thread_id) {
 	char filename[256];
-#ifdef HAVE_FFMS2
+#if defined(HAVE_FFMS2) || defined(HAVE_LIBRAW)
 	fits tmp_fit;
 #endif
 	switch (seq->type) {
@@ -907,6 +981,16 @@ int seq_read_frame_part(sequence *seq, int layer, int index, fits *dest, const r
 			extract_region_from_fits(&tmp_fit, layer, dest, area);
 			clearfits(&tmp_fit);
 			break;
+#endif
+#ifdef HAVE_LIBRAW
+		case SEQ_RAW:
+			assert(seq->raw_file);
+			memset(&tmp_fit, 0, sizeof(fits));
+			if (raw_sequence_read_frame(seq, index, &tmp_fit, FALSE))
+				return 1;
+			extract_region_from_fits(&tmp_fit, layer, dest, area);
+			clearfits(&tmp_fit);
+			break;
 #endif
 		case SEQ_INTERNAL:
 			assert(seq->internal_fits);
@@ -917,6 +1001,18 @@ int seq_read_frame_part(sequence *seq, int layer, int index, fits *dest, const r
 	return 0;
 }
 
+/* same as seq_read_frame above, but creates an image the size of the selection
+ * rectangle only. layer is set to the layer number in the read partial frame.
+ * The partial image result is only one-channel deep, so it cannot be used to
+ * have a partial RGB image. */
+int seq_read_frame_part(sequence *seq, int layer, int index, fits *dest, const rectangle *area, gboolean do_photometry, int thread_id) {
+	gint64 start = g_get_monotonic_time();
+	int retval = read_frame_part(seq, layer, index, dest, area, do_photometry, thread_id);
+	if (!retval)
+		io_stats_add_read(seq->type, io_stats_image_bytes(dest), g_get_monotonic_time() - start);
+	return retval;
+}
+
 // not thread-safe
 // gets image naxes and bitpix
 int seq_read_frame_metadata(sequence *seq, int index, fits *dest) {
@@ -961,6 +1057,13 @@ int seq_read_frame_metadata(sequence *seq, int index, fits *dest) {
 			}
 			// should dest->maxi be set to 255 here?
 			break;
+#endif
+#ifdef HAVE_LIBRAW
+		case SEQ_RAW:
+			assert(seq->raw_file);
+			if (raw_sequence_read_metadata(seq, index, dest))
+				return 1;
+			break;
 #endif
 		case SEQ_INTERNAL:
 			assert(seq->internal_fits);
@@ -970,6 +1073,73 @@ int seq_read_frame_metadata(sequence *seq, int index, fits *dest) {
 	return 0;
 }
 
+// gets image naxes and bitpix of an image of a regular sequence from the
+// first blocks of its header only, see read_fits_basic_info_from_path()
+int seq_read_frame_basic_info(sequence *seq, int index, fits *dest) {
+	char filename[256];
+	if (seq->type != SEQ_REGULAR || !fit_sequence_get_image_filename(seq, index, filename, TRUE))
+		return 1;
+	return read_fits_basic_info_from_path(filename, dest);
+}
+
+/* Reads the size of all images of a regular sequence from their headers, in
+ * parallel, and stores it in imgparam, which is the cache of the image sizes
+ * of the sequence, saved in the seqfile for variable sequences. The variable
+ * size flag and the number of layers are updated accordingly. Images that
+ * cannot be scanned get a null size and are checked when they are read.
+ * Returns the number of scanned images. */
+int seq_scan_image_sizes(sequence *seq) {
+	if (seq->type != SEQ_REGULAR || !seq->imgparam || seq->number <= 0)
+		return 0;
+	int *layers = malloc(seq->number * sizeof(int));
+	if (!layers) {
+		PRINT_ALLOC_ERR;
+		return 0;
+	}
+	int nb_scanned = 0;
+	gint64 t_start = g_get_monotonic_time();
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(com.max_thread) schedule(dynamic, 8) reduction(+:nb_scanned)
+#endif
+	for (int i = 0; i < seq->number; i++) {
+		fits fit = { 0 };
+		if (seq_read_frame_basic_info(seq, i, &fit)) {
+			seq->imgparam[i].rx = 0;
+			seq->imgparam[i].ry = 0;
+			layers[i] = -1;
+			continue;
+		}
+		seq->imgparam[i].rx = fit.rx;
+		seq->imgparam[i].ry = fit.ry;
+		layers[i] = fit.naxes[2];
+		nb_scanned++;
+	}
+
+	int first = -1;
+	gboolean same_layers = TRUE;
+	for (int i = 0; i < seq->number; i++) {
+		if (layers[i] < 0)
+			continue;
+		if (first < 0) {
+			first = i;
+			continue;
+		}
+		if (seq->imgparam[i].rx != seq->imgparam[first].rx ||
+				seq->imgparam[i].ry != seq->imgparam[first].ry)
+			seq->is_variable = TRUE;
+		if (layers[i] != layers[first])
+			same_layers = FALSE;
+	}
+	if (first >= 0 && same_layers && seq->nb_layers == -1)
+		seq->nb_layers = layers[first];
+	free(layers);
+	siril_debug_print("scanned the headers of %d/%d images of %s in %.3f s%s\n",
+			nb_scanned, seq->number, seq->seqname,
+			(g_get_monotonic_time() - t_start) / 1.e6,
+			seq->is_variable ? ", the sequence has variable image sizes" : "");
+	return nb_scanned;
+}
+
 /*****************************************************************************
  *                 SEQUENCE FUNCTIONS FOR OPENED SEQUENCES                   *
  * **************************************************************************/
@@ -1027,6 +1197,11 @@ int seq_open_image(sequence *seq, int index) {
 		case SEQ_AVI:
 			siril_log_message(_("This operation is not supported on AVI sequences (seq_open_image)\n"));
 			return 1;
+#endif
+#ifdef HAVE_LIBRAW
+		case SEQ_RAW:
+			assert(seq->raw_file);	// the files are decoded when read
+			break;
 #endif
 		case SEQ_INTERNAL:
 			siril_log_message(_("This operation is not supported on internal sequences (seq_open_image)\n"));
@@ -1063,6 +1238,10 @@ int seq_opened_read_region(sequence *seq, int layer, int index, void *buffer, co
 			return ser_read_opened_partial(seq->ser_file, layer, index, buffer, area);
 		case SEQ_FITSEQ:
 			return fitseq_read_partial(seq->fitseq_file, layer, index, buffer, area, thread_id);
+#ifdef HAVE_LIBRAW
+		case SEQ_RAW:
+			return raw_sequence_read_partial(seq, layer, index, buffer, area);
+#endif
 		default:
 			break;
 	}
@@ -1212,6 +1391,10 @@ void remove_prefixed_sequence_files(sequence *seq, const char *prefix) {
 	siril_debug_print("Removing %s\n", seqname);
 	if (g_unlink(seqname))
 		siril_debug_print("g_unlink() failed\n"); // removing the seqfile
+	gchar *seqbname = g_strdup_printf("%sb", seqname);	// and its binary index
+	if (g_file_test(seqbname, G_FILE_TEST_EXISTS) && g_unlink(seqbname))
+		siril_debug_print("g_unlink() failed\n");
+	g_free(seqbname);
 	free(seqname);
 	g_free(basename);
 
@@ -1259,6 +1442,10 @@ void remove_prefixed_star_files(sequence *seq, const char *prefix) {
 		siril_debug_print("Removing %s\n", star_filename);
 		if (g_unlink(star_filename))
 			siril_debug_print("g_unlink() failed\n");
+		gchar *cache_filename = get_star_cache_filename(star_filename);
+		if (g_unlink(cache_filename))
+			siril_debug_print("g_unlink() failed\n");
+		g_free(cache_filename);
 		g_free(star_filename);
 	}
 }
@@ -1286,6 +1473,9 @@ void initialize_sequence(sequence *seq, gboolean is_zeroed) {
 void free_sequence(sequence *seq, gboolean free_seq_too) {
 	if (seq == NULL) return;
 	siril_debug_print("free_sequence(%s)\n", seq->seqname ? seq->seqname : "null name");
+	/* the frames are kept for the next commands of the script */
+	if (!com.script)
+		frame_cache_clear();
 	int layer, j;
 
 	// free regparam
@@ -1386,6 +1576,9 @@ void free_sequence(sequence *seq, gboolean free_seq_too) {
 		fitseq_close_file(seq->fitseq_file);
 		free(seq->fitseq_file);
 	}
+#ifdef HAVE_LIBRAW
+	raw_sequence_free(seq->raw_file);	// frees the cached frames too
+#endif
 
 	if (seq->internal_fits) {
 		// Compositing still uses references to the images in the sequence
@@ -1651,6 +1844,10 @@ gboolean sequence_is_rgb(sequence *seq) {
 				seq->ser_file->color_id == SER_BGR;
 		case SEQ_FITSEQ:
 			return seq->fitseq_file->naxes[2] == 3;
+#ifdef HAVE_LIBRAW
+		case SEQ_RAW:
+			return FALSE;	// always read in CFA mode
+#endif
 		default:
 			return TRUE;
 	}
@@ -1769,6 +1966,11 @@ int seqpsf_image_hook(struct generic_seq_args *args, int out_index, int index, f
 		free(fit);
 		fit = orig_fit;
 	}
+	if (spsfargs->results) {
+		// each image has its own slot
+		spsfargs->results[index] = data;
+		return !data->psf;
+	}
 #ifdef _OPENMP
 	omp_set_lock(&args->lock);
 #endif
@@ -1779,6 +1981,19 @@ int seqpsf_image_hook(struct generic_seq_args *args, int out_index, int index, f
 	return !data->psf;
 }
 
+/* moves the results stored by image index to the list, in the order the
+ * list would have had from the hook */
+static void seqpsf_collect_results(sequence *seq, struct seqpsf_args *spsfargs) {
+	if (!spsfargs->results)
+		return;
+	for (int i = 0; i < seq->number; i++) {
+		if (spsfargs->results[i])
+			spsfargs->list = g_slist_prepend(spsfargs->list, spsfargs->results[i]);
+	}
+	free(spsfargs->results);
+	spsfargs->results = NULL;
+}
+
 static void write_regdata(sequence *seq, int layer, GSList *list, gboolean duplicate_for_regdata) {
 	check_or_allocate_regparam(seq, layer);
 	GSList *iterator;
@@ -1800,12 +2015,26 @@ static void write_regdata(sequence *seq, int layer, GSList *list, gboolean dupli
 	seq->needs_saving = TRUE;
 }
 
+/* stores a new photometry set in the sequence, returns its index */
+static int add_photometry_set(sequence *seq, psf_star **set) {
+	int i;
+	for (i = 0; i < MAX_SEQPSF && seq->photometry[i]; i++);
+	if (i == MAX_SEQPSF) {
+		free_photometry_set(seq, 1);
+		i = 1;
+	}
+	else seq->photometry[i+1] = NULL;
+	seq->photometry[i] = set;
+	return i;
+}
+
 int seqpsf_finalize_hook(struct generic_seq_args *args) {
 	struct seqpsf_args *spsfargs = (struct seqpsf_args *)args->user;
 	sequence *seq = args->seq;
 	int photometry_index = 0;
 	gboolean displayed_warning = FALSE;
 
+	seqpsf_collect_results(seq, spsfargs);
 	if (args->retval)
 		return 0;
 
@@ -1816,15 +2045,7 @@ int seqpsf_finalize_hook(struct generic_seq_args *args) {
 		return 0;
 	}
 
-	int i;
-	for (i = 0; i < MAX_SEQPSF && seq->photometry[i]; i++);
-	if (i == MAX_SEQPSF) {
-		free_photometry_set(seq, 1);
-		i = 1;
-	}
-	else seq->photometry[i+1] = NULL;
-	seq->photometry[i] = calloc(seq->number, sizeof(psf_star *));
-	photometry_index = i;
+	photometry_index = add_photometry_set(seq, calloc(seq->number, sizeof(psf_star *)));
 
 	for (GSList *iterator = spsfargs->list; iterator; iterator = iterator->next) {
 		struct seqpsf_data *data = iterator->data;
@@ -2016,6 +2237,13 @@ int seqpsf(sequence *seq, int layer, gboolean for_registration, gboolean regall,
 		args->filtering_criterion = seq_filter_included;
 		args->nb_filtered_images = seq->selnum;
 	}
+	spsfargs->results = calloc(seq->number, sizeof(struct seqpsf_data *));
+	if (!spsfargs->results) {
+		PRINT_ALLOC_ERR;
+		free(args);
+		free(spsfargs);
+		return -1;
+	}
 	args->image_hook = seqpsf_image_hook;
 	args->finalize_hook = seqpsf_finalize_hook;
 	args->idle_function = end_seqpsf;
@@ -2024,6 +2252,7 @@ int seqpsf(sequence *seq, int layer, gboolean for_registration, gboolean regall,
 	args->user = spsfargs;
 	args->already_in_a_thread = !run_in_thread;
 	args->parallel = framing != FOLLOW_STAR_FRAME;
+	args->partial_batch = TRUE;
 
 	if (run_in_thread) {
 		start_in_new_thread(generic_sequence_worker, args);
@@ -2035,6 +2264,275 @@ int seqpsf(sequence *seq, int layer, gboolean for_registration, gboolean regall,
 	}
 }
 
+/* multi-star seqpsf: all the stars are analysed from a single read of each
+ * image, the part of the image containing all their areas */
+struct multi_seqpsf_args {
+	int nb;			// number of stars
+	rectangle *areas;	// their areas in the reference image, or in the
+				// previous image when following stars
+	int layer;
+	framing_mode framing;
+	char bayer_pattern[FLEN_VALUE];
+	psf_star ***psfs;	// the results, psfs[star][image index]
+	double *exposures;	// exposure of each image, negative if not analysed
+};
+
+/* area of each star in the image, w is set to 0 for stars that cannot be
+ * analysed in it. Returns the number of valid areas */
+static int multi_seqpsf_star_areas(struct generic_seq_args *args, int index, rectangle *areas) {
+	struct multi_seqpsf_args *margs = (struct multi_seqpsf_args *)args->user;
+	sequence *seq = args->seq;
+	regdata *regparam = NULL;
+	if (margs->framing == REGISTERED_FRAME)
+		regparam = seq->regparam[margs->layer];
+	gboolean use_H = regparam &&
+		guess_transform_from_H(regparam[index].H) > NULL_TRANSFORMATION &&
+		guess_transform_from_H(regparam[seq->reference_image].H) > NULL_TRANSFORMATION;
+	int nb_valid = 0;
+	for (int s = 0; s < margs->nb; s++) {
+		areas[s] = margs->areas[s];
+		if (use_H)
+			selection_H_transform(&areas[s], regparam[seq->reference_image].H, regparam[index].H);
+		// as for seqpsf, a box moved out of the image by registration data is invalid
+		if (enforce_area_in_image(&areas[s], seq, index) && regparam)
+			areas[s].w = 0;
+		else nb_valid++;
+	}
+	return nb_valid;
+}
+
+static int multi_seqpsf_area_hook(struct generic_seq_args *args, int index, rectangle *area) {
+	struct multi_seqpsf_args *margs = (struct multi_seqpsf_args *)args->user;
+	rectangle *areas = malloc(margs->nb * sizeof(rectangle));
+	if (!areas) {
+		PRINT_ALLOC_ERR;
+		return 1;
+	}
+	if (!multi_seqpsf_star_areas(args, index, areas)) {
+		free(areas);
+		return 1;
+	}
+	int x1 = INT_MAX, y1 = INT_MAX, x2 = 0, y2 = 0;
+	for (int s = 0; s < margs->nb; s++) {
+		if (!areas[s].w)
+			continue;
+		x1 = min(x1, areas[s].x);
+		y1 = min(y1, areas[s].y);
+		x2 = max(x2, areas[s].x + areas[s].w);
+		y2 = max(y2, areas[s].y + areas[s].h);
+	}
+	free(areas);
+	area->x = x1;
+	area->y = y1;
+	area->w = x2 - x1;
+	area->h = y2 - y1;
+	return 0;
+}
+
+/* area is the union of the star areas that was read from the image */
+static int multi_seqpsf_image_hook(struct generic_seq_args *args, int out_index, int index, fits *fit, rectangle *area, int threads) {
+	struct multi_seqpsf_args *margs = (struct multi_seqpsf_args *)args->user;
+	rectangle *areas = malloc(margs->nb * sizeof(rectangle));
+	if (!areas) {
+		PRINT_ALLOC_ERR;
+		return -1;
+	}
+	multi_seqpsf_star_areas(args, index, areas);
+
+	fits *orig_fit = fit;
+	const char t = margs->bayer_pattern[0];
+	gboolean handle_cfa = (t == 'R' || t == 'G' || t == 'B');
+	if (handle_cfa) {
+		fit = calloc(1, sizeof(fits));
+		copyfits(orig_fit, fit, CP_ALLOC | CP_COPYA | CP_FORMAT, -1);
+		memcpy(fit->keywords.bayer_pattern, margs->bayer_pattern, FLEN_VALUE);
+		interpolate_nongreen(fit);
+	}
+
+	struct phot_config *ps = phot_set_adjusted_for_image(fit);
+	int nb_found = 0;
+	for (int s = 0; s < margs->nb; s++) {
+		if (!areas[s].w)
+			continue;
+		// star area in display coordinates of the part that was read
+		rectangle psfarea = { .x = areas[s].x - area->x, .y = areas[s].y - area->y,
+			.w = areas[s].w, .h = areas[s].h };
+		if (fit->top_down)
+			psfarea.y = fit->ry - psfarea.y - psfarea.h;
+		psf_error error;
+		psf_star *psf = psf_get_minimisation(fit, 0, &psfarea, TRUE, ps, FALSE,
+				com.pref.starfinder_conf.profile, &error);
+		if (!psf) {
+			siril_log_color_message(_("No star found in the area image %d around %d,%d:"
+						" error %s\n"), "red", index, areas[s].x, areas[s].y,
+					psf_error_to_string(error));
+			continue;
+		}
+		if (psf->s_mag > 9.0 || !psf->phot_is_valid) {
+			siril_log_color_message(_("Photometry analysis failed for star %d in image %d (%s)\n"),
+					"salmon", s, index, psf_error_to_string(error));
+		}
+		psf->xpos = psf->x0 + areas[s].x;
+		if (fit->top_down)
+			psf->ypos = psf->y0 + areas[s].y;
+		else psf->ypos = areas[s].y + areas[s].h - psf->y0;
+		margs->psfs[s][index] = psf;
+		nb_found++;
+
+		if (margs->framing == FOLLOW_STAR_FRAME) {
+			margs->areas[s].x = round_to_int(psf->xpos - areas[s].w * 0.5);
+			margs->areas[s].y = round_to_int(psf->ypos - areas[s].h * 0.5);
+		}
+	}
+	free(ps);
+	free(areas);
+
+	if (nb_found) {
+		if (!args->seq->imgparam[index].date_obs && fit->keywords.date_obs)
+			args->seq->imgparam[index].date_obs = g_date_time_ref(fit->keywords.date_obs);
+		margs->exposures[index] = fit->keywords.exposure;
+		args->seq->imgparam[index].airmass = fit->keywords.airmass;
+	}
+	if (handle_cfa) {
+		clearfits(fit);
+		free(fit);
+	}
+	return !nb_found;
+}
+
+static int multi_seqpsf_finalize_hook(struct generic_seq_args *args) {
+	struct multi_seqpsf_args *margs = (struct multi_seqpsf_args *)args->user;
+	sequence *seq = args->seq;
+	if (args->retval)
+		return 0;
+
+	gboolean displayed_warning = FALSE;
+	for (int i = 0; i < seq->number; i++) {
+		if (margs->exposures[i] < 0.0)
+			continue;
+		if (seq->exposure > 0.0 && seq->exposure != margs->exposures[i] && !displayed_warning) {
+			siril_log_color_message(_("Star analysis does not give consistent results when exposure changes across the sequence.\n"), "red");
+			displayed_warning = TRUE;
+		}
+		seq->exposure = margs->exposures[i];
+	}
+
+	// the sets are given to the sequence, in the order of the stars
+	for (int s = 0; s < margs->nb; s++) {
+		add_photometry_set(seq, margs->psfs[s]);
+		margs->psfs[s] = NULL;
+	}
+	return 0;
+}
+
+/* runs the PSF and photometry analysis of several stars on the sequence in a
+ * single pass, storing a new photometry set for each star in the order of
+ * areas. It is not threaded and does not update the GUI. */
+int seqpsf_multi(sequence *seq, int layer, const rectangle *areas, int nb, framing_mode framing) {
+	if (framing == REGISTERED_FRAME && !layer_has_usable_registration(seq, layer))
+		framing = ORIGINAL_FRAME;
+	if (nb <= 0)
+		return 1;
+
+	if (framing == REGISTERED_FRAME) {
+		if (seq->reference_image < 0) seq->reference_image = sequence_find_refimage(seq);
+		if (guess_transform_from_H(seq->regparam[layer][seq->reference_image].H) == NULL_TRANSFORMATION) {
+			siril_log_color_message(_("The reference image has a null matrix and was not previously registered. Please select another one.\n"), "red");
+			return 1;
+		}
+	}
+
+	struct multi_seqpsf_args *margs = calloc(1, sizeof(struct multi_seqpsf_args));
+	if (!margs) {
+		PRINT_ALLOC_ERR;
+		return 1;
+	}
+	fits fit = { 0 };
+	margs->nb = nb;
+	margs->layer = layer;
+	margs->framing = framing;
+	margs->areas = malloc(nb * sizeof(rectangle));
+	margs->psfs = calloc(nb, sizeof(psf_star **));
+	margs->exposures = malloc(seq->number * sizeof(double));
+	gboolean alloc_ok = margs->areas && margs->psfs && margs->exposures;
+	for (int s = 0; alloc_ok && s < nb; s++) {
+		margs->psfs[s] = calloc(seq->number, sizeof(psf_star *));
+		alloc_ok = margs->psfs[s] != NULL;
+	}
+	int retval = 1;
+	struct generic_seq_args *args = NULL;
+	if (!alloc_ok) {
+		PRINT_ALLOC_ERR;
+		goto cleanup;
+	}
+	memcpy(margs->areas, areas, nb * sizeof(rectangle));
+	for (int i = 0; i < seq->number; i++)
+		margs->exposures[i] = -1.0;
+
+	if (framing == REGISTERED_FRAME && seq->current != seq->reference_image) {
+		// transform the areas back from current to ref frame coordinates
+		if (guess_transform_from_H(seq->regparam[layer][seq->current].H) == NULL_TRANSFORMATION) {
+			siril_log_color_message(_("The current image has a null matrix and was not previously registered. Please load another one to select the star.\n"), "red");
+			goto cleanup;
+		}
+		for (int s = 0; s < nb; s++) {
+			rectangle *a = &margs->areas[s];
+			selection_H_transform(a, seq->regparam[layer][seq->current].H, seq->regparam[layer][seq->reference_image].H);
+			if (a->x < 0 || a->x > seq->rx - a->w || a->y < 0 || a->y > seq->ry - a->h) {
+				siril_log_color_message(_("This area is outside of the reference image. Please select the reference image to select another star.\n"), "red");
+				goto cleanup;
+			}
+		}
+	}
+
+	if (seq_read_frame_metadata(seq, seq->reference_image, &fit)) {
+		siril_log_color_message(_("Could not load metadata"), "red");
+		goto cleanup;
+	}
+	memcpy(margs->bayer_pattern, fit.keywords.bayer_pattern, FLEN_VALUE);
+	clearfits(&fit);
+
+	if (framing == FOLLOW_STAR_FRAME)
+		siril_log_color_message(_("The sequence analysis of the PSF will use a sliding selection area centred on the previous found star; this disables parallel processing.\n"), "salmon");
+	else if (framing == REGISTERED_FRAME)
+		siril_log_color_message(_("The sequence analysis of the PSF will use registration data to move the selection area for each image; this is compatible with parallel processing.\n"), "salmon");
+
+	args = create_default_seqargs(seq);
+	args->partial_image = TRUE;
+	args->partial_area_hook = multi_seqpsf_area_hook;
+	args->layer_for_partial = layer;
+	args->get_photometry_data_for_partial = TRUE;
+	args->filtering_criterion = seq_filter_included;
+	args->nb_filtered_images = seq->selnum;
+	args->image_hook = multi_seqpsf_image_hook;
+	args->finalize_hook = multi_seqpsf_finalize_hook;
+	args->stop_on_error = FALSE;
+	args->description = _("PSF on areas");
+	args->user = margs;
+	args->already_in_a_thread = TRUE;
+	args->parallel = framing != FOLLOW_STAR_FRAME;
+	args->partial_batch = TRUE;
+	retval = GPOINTER_TO_INT(generic_sequence_worker(args));
+
+cleanup:
+	if (margs->psfs) {
+		for (int s = 0; s < nb; s++) {
+			if (!margs->psfs[s])
+				continue;
+			for (int i = 0; i < seq->number; i++)
+				if (margs->psfs[s][i])
+					free_psf(margs->psfs[s][i]);
+			free(margs->psfs[s]);
+		}
+		free(margs->psfs);
+	}
+	free(margs->areas);
+	free(margs->exposures);
+	free(margs);
+	free(args);
+	return retval;
+}
+
 void free_reference_image() {
 	fprintf(stdout, "Purging previously saved reference frame data.\n");
 	if (gui.refimage_regbuffer) {
@@ -2081,6 +2579,7 @@ static int compute_nb_images_fit_memory_from_dimensions(int rx, int ry, int nb_l
 		*MB_per_scaled_image = memory_per_scaled_image_MB;
 	if (max_mem_MB)
 		*max_mem_MB = max_memory_MB;
+	memory_report_set_image_estimate(memory_per_scaled_image_MB, max_memory_MB);
 	return max_memory_MB / memory_per_scaled_image_MB;
 }
 
@@ -2236,10 +2735,14 @@ gboolean check_cachefile_date(sequence *seq, int index, const gchar *cache_filen
 		return FALSE;
 
 	struct stat imgfileInfo, cachefileInfo;
-	// if sequence is FITS, we check individual img file date vs cachefile date
-	if (seq->type == SEQ_REGULAR) {
+	// if sequence is FITS or RAW, we check individual img file date vs cachefile date
+	gboolean file_per_image = seq->type == SEQ_REGULAR;
+#ifdef HAVE_LIBRAW
+	file_per_image |= seq->type == SEQ_RAW;
+#endif
+	if (file_per_image) {
 		char img_filename[256];
-		if (!fit_sequence_get_image_filename(seq, index, img_filename, TRUE) ||
+		if (!seq_get_image_filename(seq, index, img_filename) ||
 				!g_file_test(img_filename, G_FILE_TEST_EXISTS) ||
 				stat(img_filename, &imgfileInfo) ||
 				stat(cache_filename, &cachefileInfo))
@@ -14,8 +14,12 @@ int	seq_check_basic_data(sequence *seq, gboolean load_ref_into_gfit);
 int	set_seq(const char *);
 char *	seq_get_image_filename(sequence *seq, int index, char *name_buf);
 int	seq_read_frame(sequence *seq, int index, fits *dest, gboolean force_float, int thread_id);
+int	seq_read_frame_cached(sequence *seq, int index, fits *dest, gboolean force_float, int thread_id);
 int seq_read_frame_metadata(sequence *seq, int index, fits *dest);
+int seq_read_frame_basic_info(sequence *seq, int index, fits *dest);
+int seq_scan_image_sizes(sequence *seq);
 int	seq_read_frame_part(sequence *seq, int layer, int index, fits *dest, const rectangle *area, gboolean do_photometry, int thread_id);
+int	seq_read_frame_area(sequence *seq, int index, fits *dest, const rectangle *area, gboolean force_float);
 int	seq_load_image(sequence *seq, int index, gboolean load_it);
 int64_t seq_compute_size(sequence *seq, int nb_frames, data_type type);
 gboolean check_if_seq_exist(gchar *name, gboolean name_is_base);
@@ -52,6 +56,9 @@ struct seqpsf_args {
 
 	/* The seqpsf result for each image, list of seqpsf_data */
 	GSList *list;
+	/* if not NULL, results are stored by image index without locking and
+	 * moved to list in the finalize hook */
+	struct seqpsf_data **results;
 };
 
 struct seqpsf_data {
@@ -75,6 +82,7 @@ gboolean	enforce_area_in_image(rectangle *area, sequence *seq, int index);
 int seqpsf(sequence *seq, int layer, gboolean for_registration, gboolean regall,
 		framing_mode framing, gboolean run_in_thread, gboolean no_GUI);
 int seqpsf_image_hook(struct generic_seq_args *args, int out_index, int index, fits *fit, rectangle *area, int threads);
+int seqpsf_multi(sequence *seq, int layer, const rectangle *areas, int nb, framing_mode framing);
 void free_reference_image();
 
 /* in export.c now */
@@ -75,39 +75,78 @@ struct exportseq_args {
 };
 
 
-/* Used for avi exporter, creates buffer as BGRBGR from ushort FITS */
-static uint8_t *fits_to_uint8(fits *fit) {
-	size_t i, j;
-	size_t n = fit->naxes[0] * fit->naxes[1] * fit->naxes[2];
+/* Used for avi exporter, fills the buffer as BGRBGR from ushort FITS. The
+ * conversion table depends only on the original depth of the frames, it is
+ * built once for the film */
+static BYTE *build_uint8_map(const fits *fit) {
+	BYTE *map = malloc((USHRT_MAX + 1) * sizeof(BYTE));
+	if (!map) {
+		PRINT_ALLOC_ERR;
+		return NULL;
+	}
+	gboolean is_8bit = fit->orig_bitpix == BYTE_IMG;
+	for (int i = 0; i <= USHRT_MAX; i++)
+		map[i] = is_8bit ? (BYTE) i : (BYTE) (i >> 8);
+	return map;
+}
+
+static void fits_to_uint8(const fits *fit, const BYTE *map, uint8_t *data) {
+	size_t npixels = fit->naxes[0] * fit->naxes[1];
 	int channel = fit->naxes[2];
 	int step = (channel == 3 ? 2 : 0);
 
-	uint8_t *data = malloc(n);
-	if (fit->orig_bitpix == BYTE_IMG) {
-		for (i = 0, j = 0; i < n; i += channel, j++) {
-			data[i + step] = (BYTE)fit->pdata[RLAYER][j];
-			if (channel > 1) {
-				data[i + 1] = (BYTE)fit->pdata[GLAYER][j];
-				data[i + 2 - step] = (BYTE)fit->pdata[BLAYER][j];
-			}
-		}
-	} else {
-		siril_debug_print("converting from ushort\n");
-		for (i = 0, j = 0; i < n; i += channel, j++) {
-			data[i + step] = (BYTE)(fit->pdata[RLAYER][j] >> 8);
-			if (channel > 1) {
-				data[i + 1] = (BYTE)(fit->pdata[GLAYER][j] >> 8);
-				data[i + 2 - step] = (BYTE)(fit->pdata[BLAYER][j] >> 8);
-			}
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(com.max_thread) schedule(static)
+#endif
+	for (size_t j = 0; j < npixels; j++) {
+		size_t i = j * channel;
+		data[i + step] = map[fit->pdata[RLAYER][j]];
+		if (channel > 1) {
+			data[i + 1] = map[fit->pdata[GLAYER][j]];
+			data[i + 2 - step] = map[fit->pdata[BLAYER][j]];
 		}
 	}
-	return data;
+}
+
+/* The next exported frame is read by another thread while the current one is
+ * processed and written, the writing order being unchanged */
+struct frame_prefetch {
+	sequence *seq;
+	int index;
+	fits fit;
+	int retval;
+	GThread *thread;
+};
+
+static gpointer prefetch_worker(gpointer p) {
+	struct frame_prefetch *pf = (struct frame_prefetch *) p;
+	pf->retval = seq_read_frame(pf->seq, pf->index, &pf->fit, FALSE, -1);
+	return NULL;
+}
+
+static void prefetch_start(struct frame_prefetch *pf, sequence *seq, int index) {
+	memset(&pf->fit, 0, sizeof(fits));
+	pf->seq = seq;
+	pf->index = index;
+	pf->retval = 0;
+	pf->thread = g_thread_new("export-read", prefetch_worker, pf);
+}
+
+/* returns the read status of the prefetched frame */
+static int prefetch_wait(struct frame_prefetch *pf) {
+	if (!pf->thread)
+		return -1;
+	g_thread_join(pf->thread);
+	pf->thread = NULL;
+	return pf->retval;
 }
 
 static gpointer export_sequence(gpointer ptr) {
 	int retval = 0, cur_nb = 0, j = 0;
 	unsigned int out_width, out_height, in_width, in_height;
-	uint8_t *data;
+	uint8_t *data = NULL;
+	BYTE *avi_map = NULL;
+	struct frame_prefetch prefetch = { 0 };
 	fits *destfit = NULL;	// must be declared before any goto!
 	char filename[256], dest[256];
 	struct ser_struct *ser_file = NULL;
@@ -339,9 +378,23 @@ static gpointer export_sequence(gpointer ptr) {
 		set_progress_bar_data(tmpmsg, (double)cur_nb / (nb_frames == 0 ? 1 : (double)nb_frames));
 		g_free(tmpmsg);
 
-		/* we read the full frame */
+		/* we read the full frame, or take the one read in the background */
 		fits fit = { 0 };
-		if (seq_read_frame(args->seq, i, &fit, FALSE, -1)) {
+		int read_status;
+		if (prefetch.thread && prefetch.index == i) {
+			read_status = prefetch_wait(&prefetch);
+			fit = prefetch.fit;
+		} else {
+			read_status = seq_read_frame(args->seq, i, &fit, FALSE, -1);
+		}
+		if (!read_status) {
+			int next = i + 1;
+			while (next < args->seq->number && !args->filtering_criterion(args->seq, next, args->filtering_parameter))
+				next++;
+			if (next < args->seq->number)
+				prefetch_start(&prefetch, args->seq, next);
+		}
+		if (read_status) {
 			seqwriter_release_memory();
 			siril_log_message(_("Export: could not read frame, aborting\n"));
 			retval = -3;
@@ -432,8 +485,18 @@ static gpointer export_sequence(gpointer ptr) {
 			shifty = 0;
 		}
 
+		if (fit.type != DATA_USHORT && fit.type != DATA_FLOAT) {
+			retval = -1;
+			clearfits(&fit);
+			seqwriter_release_memory();
+			goto free_and_reset_progress_bar;
+		}
+
 		/* fill the image with shifted data and normalization */
 		for (int layer = 0; layer < fit.naxes[2]; ++layer) {
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(com.max_thread) schedule(static)
+#endif
 			for (int y = 0; y < fit.ry; ++y) {
 				for (int x = 0; x < fit.rx; ++x) {
 					int nx = x + shiftx;
@@ -451,7 +514,7 @@ static gpointer export_sequence(gpointer ptr) {
 							}
 							destfit->pdata[layer][nx + ny * fit.rx] = pixel;
 						}
-						else if (fit.type == DATA_FLOAT) {
+						else {
 							float pixel = fit.fpdata[layer][x + y * fit.rx];
 							if (args->normalize) {
 								if (pixel != 0.f) { // do not offset null pixels
@@ -464,11 +527,6 @@ static gpointer export_sequence(gpointer ptr) {
 							} else {
 								destfit->pdata[layer][nx + ny * fit.rx] = roundf_to_WORD(pixel * USHRT_MAX_SINGLE);
 							}
-						} else {
-							retval = -1;
-							clearfits(&fit);
-							seqwriter_release_memory();
-							goto free_and_reset_progress_bar;
 						}
 						// for 8 bit output, destfit will be transformed later with a linear scale
 					}
@@ -513,7 +571,16 @@ static gpointer export_sequence(gpointer ptr) {
 				retval = ser_write_frame_from_fit(ser_file, destfit, i - skipped);
 				break;
 			case EXPORT_AVI:
-				data = fits_to_uint8(destfit);
+				if (!data) {
+					avi_map = build_uint8_map(destfit);
+					data = malloc(destfit->naxes[0] * destfit->naxes[1] * destfit->naxes[2]);
+					if (!avi_map || !data) {
+						PRINT_ALLOC_ERR;
+						retval = -1;
+						break;
+					}
+				}
+				fits_to_uint8(destfit, avi_map, data);
 				retval = avi_file_write_frame(0, data);
 				break;
 #ifdef HAVE_FFMPEG
@@ -537,6 +604,12 @@ static gpointer export_sequence(gpointer ptr) {
 	}
 
 free_and_reset_progress_bar:
+	if (prefetch.thread) {
+		prefetch_wait(&prefetch);
+		clearfits(&prefetch.fit);
+	}
+	free(data);
+	free(avi_map);
 	cmsCloseProfile(ref_icc);
 	ref_icc = NULL;
 	if (destfit && !have_seqwriter)
@@ -18,8 +18,13 @@
  * along with Siril. If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <math.h>
+
 #include "seqwriter.h"
 #include "core/siril_log.h"
+#include "core/memory_governor.h"
+#include "io/io_stats.h"
+#include "io/frame_pool.h"
 #include "io/image_format_fits.h"
 
 typedef enum {
@@ -69,6 +74,7 @@ int seqwriter_append_write(struct seqwriter_data *writer, fits *image, int index
 	newtask->index = index;
 
 	g_async_queue_push(writer->writes_queue, newtask);
+	io_stats_set_queue_depth(g_async_queue_length(writer->writes_queue));
 	return 0;
 }
 
@@ -159,8 +165,13 @@ static void *write_worker(void *a) {
 				task->image->rx, task->image->ry,
 				task->image->type == DATA_FLOAT ? 32 : 16);
 
+		gint64 start = g_get_monotonic_time();
+		size_t bytes = io_stats_image_bytes(task->image);
 		retval = writer->write_image_hook(writer, task->image, nb_frames_written);
-		clearfits(task->image);
+		if (retval != SEQ_WRITE_ERROR)
+			io_stats_add_write(writer->output_type, bytes, g_get_monotonic_time() - start);
+		io_stats_set_queue_depth(g_async_queue_length(writer->writes_queue));
+		clearfits_to_pool(task->image);
 
 		if (retval != SEQ_WRITE_ERROR) {
 			notify_data_freed(writer, task->index);
@@ -181,7 +192,8 @@ static void *write_worker(void *a) {
 		else if (writer->frame_count <= 0) {
 			writer->frame_count = nb_frames_written;
 			retval = SEQ_OK;
-			siril_log_message(ngettext("Saved %d image in the sequence\n", "Saved %d images in the sequence\n", nb_frames_written), nb_frames_written);
+			if (nb_frames_written)	// not for writers stopped before use
+				siril_log_message(ngettext("Saved %d image in the sequence\n", "Saved %d images in the sequence\n", nb_frames_written), nb_frames_written);
 		} else {
 			siril_debug_print("writer: write aborted, expected %d images, got %d.\n",
 					writer->frame_count, nb_frames_written);
@@ -247,9 +259,16 @@ int stop_writer(struct seqwriter_data *writer, gboolean aborting) {
  * write.
  * The code below counts the number of active memory blocks and provides a
  * waiting function.
+ * When the blocks are given a size with seqwriter_share_memory_budget(), they
+ * are also reserved from the memory governor, and the number of blocks is only
+ * a cap on the length of the queue: the images of a sequence processing are
+ * then limited by the memory they really use, shared between the processing
+ * threads and the queue.
  */
 
 static int nb_blocks_active, configured_max_active_blocks;
+static guint MB_per_block = 0;
+static GHashTable *block_memory = NULL;	// index -> MB, for blocks smaller than MB_per_block
 static int nb_outputs = 1;
 static GCond pool_cond;
 static GMutex pool_mutex;
@@ -274,20 +293,55 @@ void seqwriter_set_max_active_blocks(int max) {
 	}
 	configured_max_active_blocks = max;
 	nb_blocks_active = 0;
+	MB_per_block = 0;
+	if (block_memory)
+		g_hash_table_remove_all(block_memory);
+}
+
+/* must be called after seqwriter_set_max_active_blocks(), with the memory
+ * governor budget already set */
+void seqwriter_share_memory_budget(guint block_MB) {
+	siril_debug_print("seqwriter: %u MB reserved per image\n", block_MB);
+	g_mutex_lock(&pool_mutex);
+	MB_per_block = block_MB;
+	if (!block_memory)
+		block_memory = g_hash_table_new(g_direct_hash, g_direct_equal);
+	g_mutex_unlock(&pool_mutex);
+}
+
+/* when the image of index only needs a part of its block, ratio being the
+ * part it really uses, the rest is given back to the memory governor */
+void seqwriter_set_block_usage(int index, double ratio) {
+	g_mutex_lock(&pool_mutex);
+	if (!MB_per_block || ratio >= 1.0 || ratio <= 0.0) {
+		g_mutex_unlock(&pool_mutex);
+		return;
+	}
+	guint used = max(1, (guint) ceil(MB_per_block * ratio));
+	g_hash_table_insert(block_memory, GINT_TO_POINTER(index), GUINT_TO_POINTER(used));
+	guint unused = MB_per_block - used;
+	g_mutex_unlock(&pool_mutex);
+	if (unused)
+		memory_governor_release(unused);
 }
 
 void seqwriter_wait_for_memory() {
 	if (configured_max_active_blocks <= 0)
 		return;
 	siril_debug_print("entering the wait function\n");
+	gint64 start = g_get_monotonic_time();
 	g_mutex_lock(&pool_mutex);
 	while (nb_blocks_active >= configured_max_active_blocks) {
 		siril_debug_print("  waiting for free memory slot (%d active)\n", nb_blocks_active);
 		g_cond_wait(&pool_cond, &pool_mutex);
 	}
 	nb_blocks_active++;
+	guint block_MB = MB_per_block;
 	siril_debug_print("got the slot!\n");
 	g_mutex_unlock(&pool_mutex);
+	if (block_MB)
+		memory_governor_reserve(block_MB);
+	io_stats_add_memory_wait(g_get_monotonic_time() - start);
 }
 
 static int get_output_for_seq(void *seq) {
@@ -319,8 +373,11 @@ static gboolean all_outputs_to_index(int index) {
 void seqwriter_release_memory() {
 	g_mutex_lock(&pool_mutex);
 	nb_blocks_active--;
+	guint block_MB = MB_per_block;
 	g_cond_signal(&pool_cond);
 	g_mutex_unlock(&pool_mutex);
+	if (block_MB)
+		memory_governor_release(block_MB);
 }
 
 // same as seqwriter_release_memory() but handles the multiple output
@@ -340,8 +397,18 @@ static void notify_data_freed(struct seqwriter_data *writer, int index) {
 	}
 
 	nb_blocks_active--;
+	guint block_MB = MB_per_block;
+	if (block_MB) {
+		gpointer used = g_hash_table_lookup(block_memory, GINT_TO_POINTER(index));
+		if (used) {
+			block_MB = GPOINTER_TO_UINT(used);
+			g_hash_table_remove(block_memory, GINT_TO_POINTER(index));
+		}
+	}
 	g_cond_signal(&pool_cond);
 	g_mutex_unlock(&pool_mutex);
+	if (block_MB)
+		memory_governor_release(block_MB);
 }
 
 void seqwriter_set_number_of_outputs(int number_of_outputs) {
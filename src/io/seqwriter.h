@@ -23,6 +23,8 @@ int stop_writer(struct seqwriter_data *writer, gboolean aborting);
 int seqwriter_append_write(struct seqwriter_data *writer, fits *image, int index);
 
 void seqwriter_set_max_active_blocks(int max);
+void seqwriter_share_memory_budget(guint block_MB);
+void seqwriter_set_block_usage(int index, double ratio);
 void seqwriter_wait_for_memory();
 void seqwriter_release_memory();
 void seqwriter_set_number_of_outputs(int number_of_outputs);
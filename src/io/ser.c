@@ -28,6 +28,8 @@
 #include <math.h>
 #ifdef _WIN32
 #include <io.h>
+#else
+#include <unistd.h>
 #endif
 #include "core/siril.h"
 #include "core/proto.h"
@@ -37,8 +39,11 @@
 #include "gui/utils.h"
 #include "gui/progress_and_log.h"
 #include "algos/demosaicing.h"
+#include "algos/statistics.h"
 #include "io/conversion.h"
+#include "io/frame_pool.h"
 #include "io/image_format_fits.h"
+#include "io/remote_file.h"
 #include "ser.h"
 
 static gboolean user_warned = FALSE;
@@ -46,6 +51,7 @@ static gboolean user_warned = FALSE;
 static int ser_write_header(struct ser_struct *ser_file);
 static int ser_write_image_for_writer(struct seqwriter_data *writer, fits *image, int index);
 static int ser_write_frame_from_fit_internal(struct ser_struct *ser_file, fits *fit, int frame_no);
+static void ser_preallocate(struct ser_struct *ser_file);
 
 
 /* Output SER timestamp */
@@ -93,6 +99,26 @@ static const char *convert_color_id_to_char(ser_color color_id) {
 }
 
 /* reads timestamps from the trailer of the file and stores them in ser_file->ts */
+/* reads size bytes at offset, from the file or from its remote source */
+static int ser_read_data(struct ser_struct *ser_file, gint64 offset, void *buf, size_t size) {
+	if (ser_file->remote)
+		return remote_file_read(ser_file->remote, offset, buf, size) ? SER_GENERIC_ERROR : SER_OK;
+	int retval = SER_OK;
+#ifdef _OPENMP
+	omp_set_lock(&ser_file->fd_lock);
+#endif
+	if ((gint64)-1 == fseek64(ser_file->file, offset, SEEK_SET)) {
+		perror("fseek in SER");
+		retval = SER_GENERIC_ERROR;
+	} else if (fread(buf, 1, size, ser_file->file) != size) {
+		retval = SER_GENERIC_ERROR;
+	}
+#ifdef _OPENMP
+	omp_unset_lock(&ser_file->fd_lock);
+#endif
+	return retval;
+}
+
 static int ser_read_timestamp(struct ser_struct *ser_file) {
 	gboolean timestamps_in_order = TRUE;
 	guint64 previous_ts = 0L;
@@ -117,16 +143,11 @@ static int ser_read_timestamp(struct ser_struct *ser_file) {
 		}
 		ser_file->ts_alloc = ser_file->frame_count;
 
-		// Seek to start of timestamps
-		for (int i = 0; i < ser_file->frame_count; i++) {
-			if ((gint64) -1 == fseek64(ser_file->file, offset + (i * 8), SEEK_SET))
-				return SER_GENERIC_ERROR;
-
-			if (8 != fread(&ser_file->ts[i], 1, 8, ser_file->file))
-				return SER_OK;
-
+		// the timestamps are contiguous in the trailer, read in one go
+		if (ser_read_data(ser_file, offset, ser_file->ts, 8 * (size_t) ser_file->frame_count))
+			return SER_OK;
+		for (int i = 0; i < ser_file->frame_count; i++)
 			ser_file->ts[i] = le64_to_cpu(ser_file->ts[i]);
-		}
 
 		/* Check order of Timestamps */
 		guint64 *ts_ptr = ser_file->ts;
@@ -191,21 +212,25 @@ static int ser_recompute_frame_count(struct ser_struct *ser_file) {
 
 static int ser_read_header(struct ser_struct *ser_file) {
 	char header[SER_HEADER_LEN];
-	int ret;
-	if (!ser_file || ser_file->file == NULL)
+	int ret = 0;
+	if (!ser_file || (ser_file->file == NULL && !ser_file->remote))
 		return SER_GENERIC_ERROR;
 
 	/* Get file size */
-	ret = fseek64(ser_file->file, 0, SEEK_END);
-	ser_file->filesize = ftell64(ser_file->file);
-	ret |= fseek64(ser_file->file, 0, SEEK_SET);
+	if (ser_file->remote) {
+		ser_file->filesize = remote_file_get_size(ser_file->remote);
+	} else {
+		ret = fseek64(ser_file->file, 0, SEEK_END);
+		ser_file->filesize = ftell64(ser_file->file);
+		ret |= fseek64(ser_file->file, 0, SEEK_SET);
+	}
 	if (ser_file->filesize == -1 || ret == -1) {
 		perror("seek");
 		return SER_GENERIC_ERROR;
 	}
 
 	/* Read header (size of 178) */
-	if (SER_HEADER_LEN != fread(header, 1, sizeof header, ser_file->file)) {
+	if (ser_read_data(ser_file, 0, header, sizeof header)) {
 		perror("fread");
 		return SER_GENERIC_ERROR;
 	}
@@ -254,7 +279,7 @@ static int ser_read_header(struct ser_struct *ser_file) {
 	if (ser_file->frame_count == 0) {
 		ser_file->frame_count = ser_recompute_frame_count(ser_file);
 
-		if (ser_file->frame_count > 0) {
+		if (ser_file->frame_count > 0 && !ser_file->remote) {
 			if (ser_write_header(ser_file) == 0)
 				siril_log_message(_("SER file has been fixed...\n"));
 		}
@@ -523,8 +548,12 @@ void ser_display_info(struct ser_struct *ser_file) {
 	siril_log_message("========================================\n");
 }
 
+static int ser_end_direct_write(struct ser_struct *ser_file, gboolean abort);
+
 static int ser_end_write(struct ser_struct *ser_file, gboolean abort) {
 	int retval = SER_OK;
+	if (ser_file->direct_write)
+		return ser_end_direct_write(ser_file, abort);
 	if (ser_file->writer) {
 		retval = stop_writer(ser_file->writer, abort);
 		ser_file->frame_count = ser_file->writer->frame_count;
@@ -581,6 +610,10 @@ int ser_create_file(const char *filename, struct ser_struct *ser_file,
 	}
 
 	ser_file->filename = strdup(filename);
+	ser_file->mapped = NULL;
+	ser_file->direct_write = FALSE;
+	ser_file->direct_max_frames = 0;
+	ser_file->direct_written = NULL;
 	ser_file->ts = NULL;
 	ser_file->ts_alloc = 0;
 	ser_file->fps = -1.0;
@@ -649,15 +682,53 @@ static int ser_write_image_for_writer(struct seqwriter_data *writer, fits *image
 	return ser_write_frame_from_fit_internal(ser_file, image, index);
 }
 
+/* Frames of opened SER files are read from a read-only mapping of the file
+ * when possible: it avoids the lock on the file descriptor, the seek and the
+ * read syscalls and, for partial reads, the intermediate buffer. The mapping
+ * is only used on 64-bit systems, SER files being often larger than what a
+ * 32-bit address space can hold. */
+static void ser_map_file(struct ser_struct *ser_file, const char *filename) {
+#if GLIB_SIZEOF_VOID_P == 8
+	GError *error = NULL;
+	ser_file->mapped = g_mapped_file_new(filename, FALSE, &error);
+	if (!ser_file->mapped) {
+		siril_debug_print("SER: cannot map %s (%s), using regular reads\n",
+				filename, error->message);
+		g_clear_error(&error);
+	}
+#endif
+}
+
+/* returns a pointer to the data of the file at offset, if it is mapped and
+ * size bytes are available, NULL otherwise */
+static const gchar *ser_mapped_data(const struct ser_struct *ser_file,
+		gint64 offset, size_t size) {
+	if (!ser_file->mapped || offset < 0)
+		return NULL;
+	gsize length = g_mapped_file_get_length(ser_file->mapped);
+	if ((guint64)offset + size > length)
+		return NULL;
+	return g_mapped_file_get_contents(ser_file->mapped) + offset;
+}
+
 int ser_open_file(const char *filename, struct ser_struct *ser_file) {
 	if (ser_file->file) {
 		fprintf(stderr, "SER: file already opened, or badly closed\n");
 		return SER_GENERIC_ERROR;
 	}
-	ser_file->file = g_fopen(filename, "r+b"); // now we can fix broken file, so not O_RDONLY anymore
-	if (ser_file->file == NULL) {
-		perror("SER file open");
-		return SER_GENERIC_ERROR;
+	/* a URL, or a <name>.url link to it, is read with range requests */
+	gchar *url = remote_file_resolve(filename);
+	if (url) {
+		ser_file->remote = remote_file_open(url);
+		g_free(url);
+		if (!ser_file->remote)
+			return SER_GENERIC_ERROR;
+	} else {
+		ser_file->file = g_fopen(filename, "r+b"); // now we can fix broken file, so not O_RDONLY anymore
+		if (ser_file->file == NULL) {
+			perror("SER file open");
+			return SER_GENERIC_ERROR;
+		}
 	}
 #ifdef _OPENMP
 	omp_init_lock(&ser_file->fd_lock);
@@ -671,6 +742,8 @@ int ser_open_file(const char *filename, struct ser_struct *ser_file) {
 	}
 
 	ser_file->filename = strdup(filename);
+	if (!ser_file->remote)
+		ser_map_file(ser_file, filename);
 	return SER_OK;
 }
 
@@ -679,16 +752,25 @@ int ser_close_file(struct ser_struct *ser_file) {
 	user_warned = FALSE;
 	if (!ser_file)
 		return SER_GENERIC_ERROR;
+	if (ser_file->mapped) {
+		g_mapped_file_unref(ser_file->mapped);
+		ser_file->mapped = NULL;
+	}
 	if (ser_file->file) {
 		retval = fclose(ser_file->file);
 		ser_file->file = NULL;
 	}
+	if (ser_file->remote) {
+		remote_file_close(ser_file->remote);
+		ser_file->remote = NULL;
+	}
 	if (ser_file->file_id)
 		free(ser_file->file_id);
 	if (ser_file->ts)
 		free(ser_file->ts);
 	if (ser_file->filename)
 		free(ser_file->filename);
+	free(ser_file->direct_written);
 #ifdef _OPENMP
 	omp_destroy_lock(&ser_file->fd_lock);
 	omp_destroy_lock(&ser_file->ts_lock);
@@ -752,7 +834,7 @@ int ser_read_frame(struct ser_struct *ser_file, int frame_no, fits *fit, gboolea
 	gint64 offset, frame_size;
 	size_t read_size;
 	WORD *olddata, *tmp;
-	if (!ser_file || ser_file->file == NULL || !ser_file->number_of_planes ||
+	if (!ser_file || (ser_file->file == NULL && !ser_file->remote) || !ser_file->number_of_planes ||
 			!fit || frame_no < 0 || frame_no >= ser_file->frame_count)
 		return SER_GENERIC_ERROR;
 
@@ -761,7 +843,10 @@ int ser_read_frame(struct ser_struct *ser_file, int frame_no, fits *fit, gboolea
 	read_size = frame_size * ser_file->byte_pixel_depth;
 
 	olddata = fit->data;
-	if ((fit->data = realloc(fit->data, frame_size * sizeof(WORD))) == NULL) {
+	if (olddata)
+		fit->data = realloc(olddata, frame_size * sizeof(WORD));
+	else fit->data = frame_pool_alloc(frame_size * sizeof(WORD));
+	if (fit->data == NULL) {
 		PRINT_ALLOC_ERR;
 		if (olddata)
 			free(olddata);
@@ -772,19 +857,12 @@ int ser_read_frame(struct ser_struct *ser_file, int frame_no, fits *fit, gboolea
 		(gint64)ser_file->byte_pixel_depth * (gint64)frame_no;
 	/*fprintf(stdout, "offset is %lu (frame %d, %d pixels, %d-byte)\n", offset,
 	 frame_no, frame_size, ser_file->pixel_bytedepth);*/
-#ifdef _OPENMP
-	omp_set_lock(&ser_file->fd_lock);
-#endif
-	if ((gint64)-1 == fseek64(ser_file->file, offset, SEEK_SET)) {
-		perror("fseek in SER");
-		retval = SER_GENERIC_ERROR;
+	const gchar *mapped = ser_mapped_data(ser_file, offset, read_size);
+	if (mapped) {
+		memcpy(fit->data, mapped, read_size);
 	} else {
-		if (fread(fit->data, 1, read_size, ser_file->file) != read_size)
-			retval = SER_GENERIC_ERROR;
+		retval = ser_read_data(ser_file, offset, fit->data, read_size);
 	}
-#ifdef _OPENMP
-	omp_unset_lock(&ser_file->fd_lock);
-#endif
 	if (retval)
 		return SER_GENERIC_ERROR;
 
@@ -984,42 +1062,39 @@ static int read_area_from_image(struct ser_struct *ser_file, const int frame_no,
 		WORD *outbuf, const rectangle *area, const int layer) {
 	gint64 offset, frame_size;
 	int retval = SER_OK;
-	WORD *read_buffer;
+	WORD *read_buffer = outbuf;
+	gboolean needs_buffer = layer != -1 || area->w != ser_file->image_width;
 	size_t read_size = ser_file->image_width * area->h * ser_file->byte_pixel_depth;
 	if (layer != -1) read_size *= 3;
-	if (layer != -1 || area->w != ser_file->image_width) {
-		// allocated space is probably not enough to
-		// store whole lines or RGB data
-		read_buffer = malloc(read_size);
-		if (!read_buffer) {
-			PRINT_ALLOC_ERR;
-			return SER_GENERIC_ERROR;
-		}
-	}
-	else read_buffer = outbuf;
 
 	frame_size = (gint64) ser_file->image_width * ser_file->image_height *
 		ser_file->number_of_planes * ser_file->byte_pixel_depth;
 
-#ifdef _OPENMP
-	omp_set_lock(&ser_file->fd_lock);
-#endif
 	// we read the full-stride rectangle that contains the requested area
 	offset = SER_HEADER_LEN + frame_size * frame_no +	// requested frame
-		area->y * ser_file->image_width *
+		(gint64) area->y * ser_file->image_width *
 		ser_file->byte_pixel_depth * (layer != -1 ? 3 : 1);	// requested area
 
-	if ((gint64)-1 == fseek64(ser_file->file, offset, SEEK_SET)) {
-		perror("fseek in SER");
-		retval = SER_GENERIC_ERROR;
+	const gchar *mapped = ser_mapped_data(ser_file, offset, read_size);
+	if (mapped) {
+		// the mapping is used as read buffer, cropping reads from it directly
+		if (needs_buffer)
+			read_buffer = (WORD *) mapped;
+		else memcpy(outbuf, mapped, read_size);
+		needs_buffer = FALSE;
 	} else {
-		if (fread(read_buffer, 1, read_size, ser_file->file) != read_size) {
-			retval = SER_GENERIC_ERROR;
+		if (needs_buffer) {
+			// allocated space is probably not enough to
+			// store whole lines or RGB data
+			read_buffer = malloc(read_size);
+			if (!read_buffer) {
+				PRINT_ALLOC_ERR;
+				return SER_GENERIC_ERROR;
+			}
 		}
+
+		retval = ser_read_data(ser_file, offset, read_buffer, read_size);
 	}
-#ifdef _OPENMP
-	omp_unset_lock(&ser_file->fd_lock);
-#endif
 	if (!retval) {
 		if (area->w != ser_file->image_width) {
 			// here we crop x-wise our area
@@ -1047,7 +1122,7 @@ static int read_area_from_image(struct ser_struct *ser_file, const int frame_no,
 			}
 		}
 	}
-	if (layer != -1 || area->w != ser_file->image_width)
+	if (needs_buffer)
 		free(read_buffer);
 	return retval;
 }
@@ -1055,13 +1130,12 @@ static int read_area_from_image(struct ser_struct *ser_file, const int frame_no,
 /* read an area of an image in an opened SER sequence */
 int ser_read_opened_partial(struct ser_struct *ser_file, int layer,
 		int frame_no, WORD *buffer, const rectangle *area) {
-	int xoffset, yoffset, x, y;
 	ser_color type_ser;
-	WORD *rawbuf, *demosaiced_buf;
+	WORD *rawbuf;
 	rectangle debayer_area, image_area;
 	sensor_pattern sensortmp;
 
-	if (!ser_file || ser_file->file == NULL || frame_no < 0
+	if (!ser_file || (ser_file->file == NULL && !ser_file->remote) || frame_no < 0
 			|| frame_no >= ser_file->frame_count)
 		return SER_GENERIC_ERROR;
 
@@ -1082,9 +1156,9 @@ int ser_read_opened_partial(struct ser_struct *ser_file, int layer,
 	case SER_BAYER_GBRG:
 	case SER_BAYER_GRBG:
 		/* SER v2: RGB images obtained from demosaicing.
-		 * Original is monochrome, we demosaic it in an area slightly larger than the
-		 * requested area, giving 3 channels in form of RGBRGBRGB buffers, and finally
-		 * we extract one of the three channels and crop it to the requested area. */
+		 * Original is monochrome, we read an area slightly larger than the requested
+		 * area and interpolate only the requested channel, so that sequences can be
+		 * read band by band without demosaicing full frames. */
 
 		/* Get Bayer informations from header if available */
 		sensortmp = com.pref.debayer.bayer_pattern;
@@ -1113,9 +1187,8 @@ int ser_read_opened_partial(struct ser_struct *ser_file, int layer,
 
 		image_area = (rectangle) { .x = 0, .y = 0,
 			.w = ser_file->image_width, .h = ser_file->image_height };
-		get_debayer_area(area, &debayer_area, &image_area, &xoffset, &yoffset);
+		get_debayer_layer_area(area, &debayer_area, &image_area);
 
-		// allocating a buffer for WORD because it's going to be converted in-place
 		rawbuf = malloc(debayer_area.w * debayer_area.h * sizeof(WORD));
 		if (!rawbuf) {
 			PRINT_ALLOC_ERR;
@@ -1128,27 +1201,15 @@ int ser_read_opened_partial(struct ser_struct *ser_file, int layer,
 		ser_manage_endianess_and_depth(ser_file, rawbuf, (gint64) debayer_area.w * debayer_area.h);
 
 		/* for performance consideration (and many others) we force the interpolation algorithm
-		 * to be BAYER_BILINEAR
+		 * to be bilinear, and only the requested layer is interpolated, directly in the
+		 * destination buffer. debayer_area is the CFA area needed for it.
 		 */
-		demosaiced_buf = debayer_buffer(rawbuf, &debayer_area.w,
-				&debayer_area.h, BAYER_BILINEAR, com.pref.debayer.bayer_pattern, ser_file->bit_pixel_depth);
+		int retval = debayer_area_layer_ushort(rawbuf, &debayer_area, area,
+				com.pref.debayer.bayer_pattern, layer, buffer);
 		free(rawbuf);
-		if (!demosaiced_buf)
-			return SER_GENERIC_ERROR;
-
-		/* area is the destination area.
-		 * debayer_area is the demosaiced buf area.
-		 * xoffset and yoffset are the x,y offsets of area in the debayer area.
-		 */
-        const int nbpixels = debayer_area.w * debayer_area.h;
-		for (y = 0; y < area->h; y++) {
-			for (x = 0; x < area->w; x++) {
-				buffer[y*area->w + x] = demosaiced_buf[layer * nbpixels + (yoffset+y)*debayer_area.w + xoffset+x];
-			}
-		}
-
-		free(demosaiced_buf);
 		com.pref.debayer.bayer_pattern = sensortmp;
+		if (retval)
+			return SER_GENERIC_ERROR;
 		break;
 
 	case SER_BGR:
@@ -1167,10 +1228,17 @@ int ser_read_opened_partial(struct ser_struct *ser_file, int layer,
 
 int ser_read_opened_partial_fits(struct ser_struct *ser_file, int layer,
 		int frame_no, fits *fit, const rectangle *area) {
-	if (new_fit_image(&fit, area->w, area->h, 1, DATA_USHORT))
-		return SER_GENERIC_ERROR;
-	fit->icc_profile = NULL;
-	color_manage(fit, FALSE);
+	/* the buffer of a previous frame of the same size is reused, for batch
+	 * processing of small areas */
+	if (fit->data && fit->type == DATA_USHORT && fit->naxes[2] == 1 &&
+			fit->rx == area->w && fit->ry == area->h) {
+		invalidate_stats_from_fit(fit);
+	} else {
+		if (new_fit_image(&fit, area->w, area->h, 1, DATA_USHORT))
+			return SER_GENERIC_ERROR;
+		fit->icc_profile = NULL;
+		color_manage(fit, FALSE);
+	}
 
 	fit->top_down = TRUE;
 	if (ser_file->ts) {
@@ -1185,8 +1253,167 @@ int ser_read_opened_partial_fits(struct ser_struct *ser_file, int layer,
 	return ser_read_opened_partial(ser_file, layer, frame_no, fit->pdata[0], area);
 }
 
+/* writes frame data at its offset in the file. In direct write mode, it uses
+ * pwrite(2) where available so that threads don't wait for each other */
+static int ser_write_frame_data(struct ser_struct *ser_file, const void *data,
+		size_t size, gint64 offset) {
+#ifdef HAVE_PWRITE
+	if (ser_file->direct_write) {
+		int fd = fileno(ser_file->file);
+		const char *ptr = (const char *) data;
+		while (size > 0) {
+			ssize_t ret = pwrite(fd, ptr, size, (off_t) offset);
+			if (ret < 0) {
+				perror("write image in SER");
+				return SER_GENERIC_ERROR;
+			}
+			ptr += ret;
+			offset += ret;
+			size -= ret;
+		}
+		return SER_OK;
+	}
+#endif
+	int retval = SER_OK;
+#ifdef _OPENMP
+	omp_set_lock(&ser_file->fd_lock);
+#endif
+	if ((gint64)-1 == fseek64(ser_file->file, offset, SEEK_SET)) {
+		perror("seek");
+		retval = SER_GENERIC_ERROR;
+	}
+	else if (fwrite(data, 1, size, ser_file->file) != size) {
+		perror("write image in SER");
+		retval = SER_GENERIC_ERROR;
+	}
+#ifdef _OPENMP
+	omp_unset_lock(&ser_file->fd_lock);
+#endif
+	return retval;
+}
+
+/* Direct write mode: when the number of frames is known in advance, frames
+ * are written by the processing threads themselves at their final offset,
+ * in any order, instead of being queued to the writer thread that writes them
+ * in order. SER frames having all the same size, the file is preallocated on
+ * first frame and the holes left by failed frames are removed on closing.
+ * Must be called just after ser_create_file(), with no frame written yet. */
+int ser_set_direct_write(struct ser_struct *ser_file, int nb_frames) {
+	if (!ser_file || !ser_file->writer || nb_frames <= 0)
+		return SER_GENERIC_ERROR;
+	ser_file->direct_written = calloc(nb_frames, sizeof(guint8));
+	if (!ser_file->direct_written || ser_alloc_ts(ser_file, nb_frames - 1)) {
+		PRINT_ALLOC_ERR;
+		free(ser_file->direct_written);
+		ser_file->direct_written = NULL;
+		return SER_GENERIC_ERROR;
+	}
+	// the writer thread was started with no frame, nothing to write
+	stop_writer(ser_file->writer, TRUE);
+	free(ser_file->writer);
+	ser_file->writer = NULL;
+	// the header may have been written through the stdio buffer
+	fflush(ser_file->file);
+	ser_file->direct_write = TRUE;
+	ser_file->direct_max_frames = nb_frames;
+	siril_debug_print("SER: direct write mode for %d frames\n", nb_frames);
+	return SER_OK;
+}
+
+// called with the file lock held, when the frame size has just been set
+static void ser_preallocate(struct ser_struct *ser_file) {
+#ifdef HAVE_POSIX_FALLOCATE
+	gint64 frame_size = (gint64) ser_file->image_width * ser_file->image_height *
+		ser_file->number_of_planes * ser_file->byte_pixel_depth;
+	gint64 size = SER_HEADER_LEN + frame_size * ser_file->direct_max_frames;
+	int err = posix_fallocate(fileno(ser_file->file), 0, (off_t) size);
+	if (err)	// not supported by all file systems, not an error
+		siril_debug_print("SER: preallocation failed (%s)\n", strerror(err));
+#endif
+}
+
+/* removes the holes left by the failed frames in direct write mode, moving
+ * the next frames and their timestamps down, and truncates the file to the
+ * frames actually written */
+static int ser_end_direct_write(struct ser_struct *ser_file, gboolean abort) {
+	int retval = SER_OK, dst = 0;
+	gint64 frame_size = (gint64) ser_file->image_width * ser_file->image_height *
+		ser_file->number_of_planes * ser_file->byte_pixel_depth;
+	char *buffer = NULL;
+	if (abort || !ser_file->number_of_planes)
+		goto end;
+	for (int src = 0; src < ser_file->direct_max_frames; src++) {
+		if (!ser_file->direct_written[src])
+			continue;
+		if (src != dst) {
+			if (!buffer && !(buffer = malloc(frame_size))) {
+				PRINT_ALLOC_ERR;
+				retval = SER_GENERIC_ERROR;
+				break;
+			}
+			if ((gint64)-1 == fseek64(ser_file->file, SER_HEADER_LEN + frame_size * src, SEEK_SET) ||
+					fread(buffer, 1, frame_size, ser_file->file) != frame_size ||
+					(gint64)-1 == fseek64(ser_file->file, SER_HEADER_LEN + frame_size * dst, SEEK_SET) ||
+					fwrite(buffer, 1, frame_size, ser_file->file) != frame_size) {
+				perror("moving frame in SER");
+				retval = SER_GENERIC_ERROR;
+				break;
+			}
+			if (ser_file->ts && src < ser_file->ts_alloc)
+				ser_file->ts[dst] = ser_file->ts[src];
+		}
+		dst++;
+	}
+	free(buffer);
+	if (!retval && dst != ser_file->frame_count) {
+		siril_debug_print("SER: inconsistent number of frames in direct write (%d for %d)\n",
+				dst, ser_file->frame_count);
+		ser_file->frame_count = dst;
+	}
+	if (!retval) {
+		// drop the preallocated space of the failed frames, the
+		// timestamps are written after the last frame on closing
+		fflush(ser_file->file);
+		gint64 size = SER_HEADER_LEN + frame_size * dst;
+#ifdef _WIN32
+		if (_chsize_s(_fileno(ser_file->file), size))
+#else
+		if (ftruncate(fileno(ser_file->file), (off_t) size))
+#endif
+			siril_debug_print("SER: truncating the file failed\n");
+		siril_log_message(ngettext("Saved %d image in the sequence\n", "Saved %d images in the sequence\n", dst), dst);
+	}
+end:
+	free(ser_file->direct_written);
+	ser_file->direct_written = NULL;
+	ser_file->direct_write = FALSE;
+	return retval;
+}
+
+/* in direct write mode, the image is written from the calling thread and freed
+ * if successful, the memory slot of the seqwriter is released in all cases */
+static int ser_write_frame_direct(struct ser_struct *ser_file, fits *fit, int frame_no) {
+	int retval = SER_OK;
+	if (frame_no < 0 || frame_no >= ser_file->direct_max_frames) {
+		siril_log_color_message(_("Invalid image index requested for write, aborting file creation\n"), "red");
+		retval = SER_GENERIC_ERROR;
+	}
+	else if (fit) {
+		retval = ser_write_frame_from_fit_internal(ser_file, fit, frame_no);
+		if (!retval) {
+			ser_file->direct_written[frame_no] = 1;
+			clearfits(fit);
+			free(fit);
+		}
+	}
+	seqwriter_release_memory();
+	return retval;
+}
+
 // public function for writing an image to the file, calls the writer
 int ser_write_frame_from_fit(struct ser_struct *ser_file, fits *fit, int frame_no) {
+	if (ser_file->direct_write)
+		return ser_write_frame_direct(ser_file, fit, frame_no);
 	return seqwriter_append_write(ser_file->writer, fit, frame_no);
 }
 
@@ -1194,7 +1421,7 @@ int ser_write_frame_from_fit(struct ser_struct *ser_file, fits *fit, int frame_n
 // frame_no should always be the next image, or frame_count
 static int ser_write_frame_from_fit_internal(struct ser_struct *ser_file, fits *fit, int frame_no) {
 	int pixel, plane, dest;
-	int ret, retval = SER_OK;
+	int retval = SER_OK;
 	gint64 offset, frame_size;
 	BYTE *data8 = NULL;	// for 8-bit files
 	WORD *data16 = NULL;	// for 16-bit files
@@ -1210,12 +1437,24 @@ static int ser_write_frame_from_fit_internal(struct ser_struct *ser_file, fits *
 
 	if (!ser_file || ser_file->file == NULL)
 		return SER_GENERIC_ERROR;
+#ifdef _OPENMP
+	// in direct write mode, frames come from several threads
+	omp_set_lock(&ser_file->fd_lock);
+#endif
 	if (ser_file->number_of_planes == 0) {
 		// adding first frame of a new sequence, use it to populate the header
 		if (ser_write_header_from_fit(ser_file, fit)) {
+#ifdef _OPENMP
+			omp_unset_lock(&ser_file->fd_lock);
+#endif
 			return SER_GENERIC_ERROR;
 		}
+		if (ser_file->direct_write)
+			ser_preallocate(ser_file);
 	}
+#ifdef _OPENMP
+	omp_unset_lock(&ser_file->fd_lock);
+#endif
 	if (fit->rx != ser_file->image_width || fit->ry != ser_file->image_height) {
 		siril_log_message(_("Trying to add an image of different size in a SER\n"));
 		return SER_GENERIC_ERROR;
@@ -1257,40 +1496,12 @@ static int ser_write_frame_from_fit_internal(struct ser_struct *ser_file, fits *
 		}
 	}
 
-#ifdef _OPENMP
-	omp_set_lock(&ser_file->fd_lock);
-#endif
-	if ((gint64)-1 == fseek64(ser_file->file, offset, SEEK_SET)) {
-#ifdef _OPENMP
-		omp_unset_lock(&ser_file->fd_lock);
-#endif
-		perror("seek");
+	if (ser_write_frame_data(ser_file, data8 ? (void *)data8 : (void *)data16,
+				frame_size * ser_file->byte_pixel_depth, offset)) {
 		retval = SER_GENERIC_ERROR;
 		goto free_and_quit;
 	}
 
-	if (ser_file->byte_pixel_depth == SER_PIXEL_DEPTH_8) {
-		ret = fwrite(data8, 1, frame_size * ser_file->byte_pixel_depth, ser_file->file);
-#ifdef _OPENMP
-		omp_unset_lock(&ser_file->fd_lock);
-#endif
-		if (ret != frame_size * ser_file->byte_pixel_depth) {
-			perror("write image in SER");
-			retval = 1;
-			goto free_and_quit;
-		}
-	} else {
-		ret = fwrite(data16, 1, frame_size * ser_file->byte_pixel_depth, ser_file->file);
-#ifdef _OPENMP
-		omp_unset_lock(&ser_file->fd_lock);
-#endif
-		if (ret != frame_size * ser_file->byte_pixel_depth) {
-			perror("write image in SER");
-			retval = 1;
-			goto free_and_quit;
-		}
-	}
-
 	g_atomic_int_inc(&ser_file->frame_count);
 
 	if (fit->keywords.date_obs && !ser_alloc_ts(ser_file, frame_no)) {
@@ -120,11 +120,16 @@ struct ser_struct {			// size and offset from header
 	unsigned int number_of_planes;	// derived from the color_id
 	FILE *file;
 	char *filename;
+	GMappedFile *mapped;		// read-only mapping of the file, can be NULL
+	struct remote_file *remote;	// the file is read over HTTP instead, can be NULL
 #ifdef _OPENMP
 	omp_lock_t fd_lock, ts_lock;
 #endif
 
 	struct seqwriter_data *writer;
+	gboolean direct_write;		// frames written by the callers, see ser_set_direct_write()
+	int direct_max_frames;		// number of frames expected in direct write mode
+	guint8 *direct_written;		// 1 for each frame already written in direct write mode
 };
 
 gboolean ser_is_cfa(const struct ser_struct *ser_file);
@@ -138,6 +143,7 @@ int ser_close_and_delete_file(struct ser_struct *ser_file);
 int ser_write_and_close(struct ser_struct *ser_file);
 int ser_create_file(const char *filename, struct ser_struct *ser_file, gboolean overwrite, const struct ser_struct *copy_from);
 int ser_close_file(struct ser_struct *ser_file);
+int ser_set_direct_write(struct ser_struct *ser_file, int nb_frames);
 int ser_metadata_as_fits(const struct ser_struct *ser_file, fits *fit);
 
 int ser_read_frame(struct ser_struct *ser_file, int frame_no, fits *fit, gboolean force_float, gboolean open_debayer);
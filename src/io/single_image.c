@@ -325,6 +325,146 @@ int open_single_image(const char* filename) {
 	return retval;
 }
 
+/* Asynchronous opening of single images from the GUI: the file is read, and
+ * the minimum and maximum of the image computed, in the processing thread,
+ * the current image staying displayed and the GUI responsive meanwhile. The
+ * image replaces the current one when it is ready. */
+struct open_image_data {
+	char *realname;
+	image_type imagetype;
+	fits fit;
+	int retval;
+};
+
+static gboolean end_open_single_image_async(gpointer p) {
+	struct open_image_data *args = (struct open_image_data *) p;
+	stop_processing_thread();
+	set_progress_bar_data(PROGRESS_TEXT_RESET, PROGRESS_DONE);
+
+	if (args->retval) {
+		if (args->retval != OPEN_IMAGE_CANCEL) {
+			siril_log_color_message(_("Opening %s failed.\n"), "red", args->realname);
+			siril_message_dialog(GTK_MESSAGE_ERROR, _("Error opening file"),
+					_("There was an error when opening this image. "
+						"See the log for more information."));
+		}
+		clearfits(&args->fit);
+		free(args->realname);
+	} else {
+		close_sequence(FALSE);
+		close_single_image();
+		memcpy(&gfit, &args->fit, sizeof(fits));
+		gui.file_ext_filter = (int) args->imagetype;
+		update_gain_from_gfit();
+		set_GUI_CAMERA();
+
+		com.seq.current = UNRELATED_IMAGE;
+		create_uniq_from_gfit(args->realname, args->imagetype == TYPEFITS);
+		end_open_single_image(NULL);
+		reset_cut_gui_filedependent();
+		check_gfit_profile_identical_to_monitor();
+		icc_auto_assign_or_convert(&gfit, ICC_ASSIGN_ON_LOAD);
+	}
+	free(args);
+	set_cursor_waiting(FALSE);
+	return FALSE;
+}
+
+static gpointer open_single_image_worker(gpointer p) {
+	struct open_image_data *args = (struct open_image_data *) p;
+	args->retval = any_to_fits(args->imagetype, args->realname, &args->fit, FALSE, FALSE,
+			com.pref.debayer.open_debayer);
+	if (!args->retval) {
+		debayer_if_needed(args->imagetype, &args->fit, FALSE);
+		if (com.pref.debayer.open_debayer || args->imagetype != TYPEFITS)
+			update_fits_header(&args->fit);
+		/* what init_layers_hi_and_lo_values() would compute in the GUI
+		 * thread, with all threads here */
+		args->fit.mini = DBL_MAX;
+		args->fit.maxi = -DBL_MAX;
+		for (int layer = 0; layer < args->fit.naxes[2]; layer++) {
+			free_stats(statistics(NULL, -1, &args->fit, layer, NULL, STATS_MINMAX, MULTI_THREADED));
+			if (!args->fit.stats || !args->fit.stats[layer]) {
+				args->fit.maxi = 0.0;
+				break;
+			}
+			args->fit.maxi = max(args->fit.maxi, args->fit.stats[layer]->max);
+			args->fit.mini = min(args->fit.mini, args->fit.stats[layer]->min);
+		}
+	}
+	siril_add_idle(end_open_single_image_async, args);
+	return GINT_TO_POINTER(args->retval);
+}
+
+/* Opens an image from the GUI like open_single_image(), in the background for
+ * FITS, TIFF and XISF images, whose reading can be long and never asks
+ * anything to the user. Other files are opened directly, including the FITS
+ * sequences, and their ICC profile is managed like when opening from the
+ * background. */
+int open_single_image_async(const char *filename) {
+	image_type imagetype;
+	char *realname = NULL;
+
+	if (get_thread_run()) {
+		siril_log_message(_("Cannot open another file while the processing thread is still operating on the current one!\n"));
+		return 1;
+	}
+	if (stat_file(filename, &imagetype, &realname)) {
+		siril_log_color_message(_("Error opening image %s: file not found or not supported.\n"), "red", filename);
+		siril_message_dialog(GTK_MESSAGE_ERROR, _("Error opening file"),
+				_("There was an error when opening this image. "
+					"See the log for more information."));
+		free(realname);
+		return 1;
+	}
+	if ((imagetype != TYPEFITS && imagetype != TYPETIFF && imagetype != TYPEXISF) ||
+			(imagetype == TYPEFITS && fitseq_is_fitseq(realname, NULL))) {
+		free(realname);
+		set_cursor_waiting(TRUE);
+		int retval = open_single_image(filename);
+		icc_auto_assign_or_convert(&gfit, ICC_ASSIGN_ON_LOAD);
+		set_cursor_waiting(FALSE);
+		return retval;
+	}
+
+	struct open_image_data *args = calloc(1, sizeof(struct open_image_data));
+	if (!args) {
+		PRINT_ALLOC_ERR;
+		free(realname);
+		return 1;
+	}
+	args->realname = realname;
+	args->imagetype = imagetype;
+	set_cursor_waiting(TRUE);
+	set_progress_bar_data(_("Opening image..."), PROGRESS_PULSATE);
+	start_in_new_thread(open_single_image_worker, args);
+	return 0;
+}
+
+/* Same as open_single_image() for an image already in memory: the content of
+ * fit is moved to gfit and fit is cleared. filename is the name given to the
+ * image, it is freed when the image is closed */
+int open_single_image_from_fit(fits *fit, char *filename) {
+	if (get_thread_run()) {
+		siril_log_message(_("Cannot open another file while the processing thread is still operating on the current one!\n"));
+		free(filename);
+		return 1;
+	}
+	close_sequence(FALSE);
+	close_single_image();
+	memcpy(&gfit, fit, sizeof(fits));
+	memset(fit, 0, sizeof(fits));
+
+	com.seq.current = UNRELATED_IMAGE;
+	create_uniq_from_gfit(filename, FALSE);
+	if (!com.headless) {
+		if (com.script)
+			execute_idle_and_wait_for_it(end_open_single_image, NULL);
+		else end_open_single_image(NULL);
+	}
+	return 0;
+}
+
 /* updates the GUI to reflect the opening of a single image, found in gfit and com.uniq */
 void open_single_image_from_gfit() {
 	siril_debug_print("open_single_image_from_gfit()\n");
@@ -6,6 +6,8 @@ void free_image_data();
 int create_uniq_from_gfit(char *filename, gboolean exists);
 int read_single_image(const char* filename, fits *dest, char **realname_out, gboolean allow_sequences, gboolean *is_sequence, gboolean allow_dialogs, gboolean force_float);
 int open_single_image(const char* filename);
+int open_single_image_async(const char *filename);
+int open_single_image_from_fit(fits *fit, char *filename);
 void open_single_image_from_gfit();
 
 int image_find_minmax(fits *fit);
@@ -871,6 +871,13 @@ static gboolean can_use_velocity(fits *fit, siril_catalogue *siril_cat) {
 // corrects for object velocity if the flag is true and if necessary data is included
 // in the catalogue (vra and vdec fields)
 int siril_catalog_project_with_WCS(siril_catalogue *siril_cat, fits *fit, gboolean use_proper_motion, gboolean use_velocity) {
+	return siril_catalog_project_subset_with_WCS(siril_cat, fit, NULL, siril_cat->nbitems, use_proper_motion, use_velocity);
+}
+
+// same as above, but only the nb items whose indices are given in subset are
+// projected, the others are marked as not included. subset may be NULL to
+// project the nb first items
+int siril_catalog_project_subset_with_WCS(siril_catalogue *siril_cat, fits *fit, const int *subset, int nb, gboolean use_proper_motion, gboolean use_velocity) {
 	if (!has_field(siril_cat, RA) || !has_field(siril_cat, DEC)) {
 		siril_debug_print("catalogue %s does not have the necessary columns\n", catalog_to_str(siril_cat->cat_index));
 		return 1;
@@ -907,15 +914,22 @@ int siril_catalog_project_with_WCS(siril_catalogue *siril_cat, fits *fit, gboole
 			}
 		}
 	}
-	world = malloc(2 * siril_cat->nbitems * sizeof(double));
-	x = malloc(siril_cat->nbitems * sizeof(double));
-	y = malloc(siril_cat->nbitems * sizeof(double));
+	if (subset) {
+		for (int i = 0; i < siril_cat->nbitems; i++)
+			siril_cat->cat_items[i].included = FALSE;
+	}
+	if (nb <= 0)
+		goto clean_and_exit;
+	world = malloc(2 * nb * sizeof(double));
+	x = malloc(nb * sizeof(double));
+	y = malloc(nb * sizeof(double));
 	if (!world || !x || !y) {
 		PRINT_ALLOC_ERR;
 		goto clean_and_exit;
 	}
 	int ind = 0;
-	for (int i = 0; i < siril_cat->nbitems; i++) {
+	for (int k = 0; k < nb; k++) {
+		int i = subset ? subset[k] : k;
 		double ra = siril_cat->cat_items[i].ra;
 		double dec = siril_cat->cat_items[i].dec;
 		double decrad = dec * DEGTORAD;
@@ -932,13 +946,14 @@ int siril_catalog_project_with_WCS(siril_catalogue *siril_cat, fits *fit, gboole
 		world[ind++] = ra;
 		world[ind++] = dec;
 	}
-	status = wcs2pix_array(fit, siril_cat->nbitems, world, x, y);
+	status = wcs2pix_array(fit, nb, world, x, y);
 	if (!status)
 		goto clean_and_exit;
-	for (int i = 0; i < siril_cat->nbitems; i++) {
-		if (!status[i]) {
-			siril_cat->cat_items[i].x = x[i];
-			siril_cat->cat_items[i].y = y[i];
+	for (int k = 0; k < nb; k++) {
+		int i = subset ? subset[k] : k;
+		if (!status[k]) {
+			siril_cat->cat_items[i].x = x[k];
+			siril_cat->cat_items[i].y = y[k];
 			siril_cat->cat_items[i].included = TRUE;
 			nbincluded++;
 		} else {
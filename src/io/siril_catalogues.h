@@ -218,6 +218,7 @@ int siril_catalog_load_from_file(siril_catalogue *siril_cat, const gchar *filena
 gboolean siril_catalog_write_to_output_stream(siril_catalogue *siril_cat, GOutputStream *output_stream);
 gboolean siril_catalog_write_to_file(siril_catalogue *siril_cat, const gchar *filename);
 int siril_catalog_project_with_WCS(siril_catalogue *siril_cat, fits *fit, gboolean use_proper_motion, gboolean use_velocity);
+int siril_catalog_project_subset_with_WCS(siril_catalogue *siril_cat, fits *fit, const int *subset, int nb, gboolean use_proper_motion, gboolean use_velocity);
 int siril_catalog_project_gnomonic(siril_catalogue *siril_cat, double ra0, double dec0, gboolean use_proper_motion, GDateTime *date_obs);
 
 int siril_catalog_inner_conesearch(siril_catalogue *siril_cat_in, siril_catalogue *siril_cat_out);
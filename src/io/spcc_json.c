@@ -24,7 +24,11 @@
  * image. Given its use of the third dimension, it's sometimes called FITS cube.
  */
 
+#include <string.h>
+#include <glib/gstdio.h>
+
 #include "core/siril.h"
+#include "core/proto.h"
 #include "core/siril_app_dirs.h"
 #include "core/siril_log.h"
 #include "algos/photometric_cc.h"
@@ -455,6 +459,290 @@ int remove_duplicate_x(point *points, int n, const gchar *filename) {
 	return write_index + 1;
 }
 
+/* Binary database of the SPCC library
+ * ===================================
+ * Parsing the JSON files of the library takes most of the time of opening
+ * the SPCC dialog or of a headless SPCC run, so once they have been parsed
+ * the metadata and the processed arrays of all objects are written in one
+ * file of the user cache directory. It is identified by a fingerprint of the
+ * names, sizes and dates of the JSON files and is kept mapped while the
+ * objects are in use, the arrays being copied only when they are needed. */
+
+#define SPCC_DB_MAGIC "SIRIL SPCC DB 1"
+#define SPCC_DB_NB_STRINGS 6
+
+enum {
+	SPCC_DB_MONO_SENSORS,
+	SPCC_DB_OSC_SENSORS,	// three consecutive records per sensor
+	SPCC_DB_MONO_FILTERS,	// one list per channel
+	SPCC_DB_OSC_FILTERS = SPCC_DB_MONO_FILTERS + 3,
+	SPCC_DB_OSC_LPFS,
+	SPCC_DB_WB_REFS
+};
+
+struct spcc_db_header {
+	char magic[16];
+	char fingerprint[72];
+	guint32 nb_records;
+	guint32 record_size;
+};
+
+struct spcc_db_record {
+	gint32 list, type, quality, channel, is_dslr, index, version, n;
+	guint64 strings[SPCC_DB_NB_STRINGS];	// offsets, 0 for NULL
+	guint64 x, y;
+};
+
+static GMappedFile *spcc_db = NULL;
+
+static gchar *get_spcc_db_filename() {
+	return g_build_filename(g_get_user_cache_dir(), "siril_spcc_database.bin", NULL);
+}
+
+static void list_json_files(const gchar *directory_path, GPtrArray *files) {
+	GDir *dir = g_dir_open(directory_path, 0, NULL);
+	if (!dir)
+		return;
+	const gchar *filename;
+	while ((filename = g_dir_read_name(dir)) != NULL) {
+		gchar *file_path = g_build_filename(directory_path, filename, NULL);
+		if (g_file_test(file_path, G_FILE_TEST_IS_DIR)) {
+			if (g_strcmp0(filename, ".") && g_strcmp0(filename, "..") && g_strcmp0(filename, ".git"))
+				list_json_files(file_path, files);
+		} else if (g_str_has_suffix(filename, ".json") && !g_strrstr(filename, "schema")) {
+			g_ptr_array_add(files, file_path);
+			continue;
+		}
+		g_free(file_path);
+	}
+	g_dir_close(dir);
+}
+
+static gint compare_paths(gconstpointer a, gconstpointer b) {
+	return g_strcmp0(*(const gchar **) a, *(const gchar **) b);
+}
+
+/* only stats the files, which is much faster than parsing them */
+static gchar *spcc_repo_fingerprint(const gchar *path) {
+	if (!path)
+		return NULL;
+	GPtrArray *files = g_ptr_array_new_with_free_func(g_free);
+	list_json_files(path, files);
+	if (files->len == 0) {
+		g_ptr_array_free(files, TRUE);
+		return NULL;
+	}
+	g_ptr_array_sort(files, compare_paths);
+	GChecksum *checksum = g_checksum_new(G_CHECKSUM_SHA256);
+	for (guint i = 0; i < files->len; i++) {
+		const gchar *file = g_ptr_array_index(files, i);
+		GStatBuf st;
+		if (g_stat(file, &st))
+			continue;
+		gchar *state = g_strdup_printf("%s:%" G_GINT64_FORMAT ":%" G_GINT64_FORMAT "\n", file, (gint64) st.st_size, (gint64) st.st_mtime);
+		g_checksum_update(checksum, (const guchar *) state, strlen(state));
+		g_free(state);
+	}
+	gchar *fingerprint = g_strdup(g_checksum_get_string(checksum));
+	g_checksum_free(checksum);
+	g_ptr_array_free(files, TRUE);
+	return fingerprint;
+}
+
+static guint64 db_append(GByteArray *blob, const void *data, gsize size) {
+	static const guint8 padding[8] = { 0 };
+	if (blob->len % 8)
+		g_byte_array_append(blob, padding, 8 - blob->len % 8);
+	guint64 offset = blob->len;
+	g_byte_array_append(blob, data, size);
+	return offset;
+}
+
+static gboolean db_add_object(GByteArray *blob, GArray *records, spcc_object *object, int list) {
+	gboolean loaded = object->arrays_loaded;
+	if (!load_spcc_object_arrays(object))
+		return FALSE;
+	struct spcc_db_record rec = { list, object->type, object->quality, object->channel,
+		object->is_dslr, object->index, object->version, object->n, { 0 }, 0, 0 };
+	const gchar *strings[SPCC_DB_NB_STRINGS] = { object->model, object->name, object->filepath,
+		object->comment, object->manufacturer, object->source };
+	for (int i = 0; i < SPCC_DB_NB_STRINGS; i++) {
+		if (strings[i])
+			rec.strings[i] = db_append(blob, strings[i], strlen(strings[i]) + 1);
+	}
+	rec.x = db_append(blob, object->x, object->n * sizeof(double));
+	rec.y = db_append(blob, object->y, object->n * sizeof(double));
+	g_array_append_val(records, rec);
+	if (!loaded)
+		spcc_object_free_arrays(object);
+	return TRUE;
+}
+
+static gboolean db_add_list(GByteArray *blob, GArray *records, GList *list, int type) {
+	for (GList *iter = list; iter; iter = iter->next) {
+		if (!db_add_object(blob, records, (spcc_object *) iter->data, type))
+			return FALSE;
+	}
+	return TRUE;
+}
+
+static void save_spcc_database(const gchar *fingerprint) {
+	GByteArray *blob = g_byte_array_new();
+	// so that no string is at offset 0, which stands for NULL
+	static const guint8 reserved[8] = { 0 };
+	g_byte_array_append(blob, reserved, sizeof(reserved));
+	GArray *records = g_array_new(FALSE, FALSE, sizeof(struct spcc_db_record));
+	gboolean ok = db_add_list(blob, records, com.spcc_data.mono_sensors, SPCC_DB_MONO_SENSORS);
+	for (GList *iter = com.spcc_data.osc_sensors; iter && ok; iter = iter->next) {
+		osc_sensor *osc = (osc_sensor *) iter->data;
+		for (int i = 0; i < 3 && ok; i++)
+			ok = db_add_object(blob, records, &osc->channel[i], SPCC_DB_OSC_SENSORS);
+	}
+	for (int i = 0; i < 3 && ok; i++)
+		ok = db_add_list(blob, records, com.spcc_data.mono_filters[i], SPCC_DB_MONO_FILTERS + i);
+	ok = ok && db_add_list(blob, records, com.spcc_data.osc_filters, SPCC_DB_OSC_FILTERS);
+	ok = ok && db_add_list(blob, records, com.spcc_data.osc_lpf, SPCC_DB_OSC_LPFS);
+	ok = ok && db_add_list(blob, records, com.spcc_data.wb_ref, SPCC_DB_WB_REFS);
+	if (ok) {
+		struct spcc_db_header header = { { 0 }, { 0 }, records->len, sizeof(struct spcc_db_record) };
+		g_strlcpy(header.magic, SPCC_DB_MAGIC, sizeof(header.magic));
+		g_strlcpy(header.fingerprint, fingerprint, sizeof(header.fingerprint));
+		/* offsets in the blob are made relative to the file */
+		guint64 start = sizeof(header) + (guint64) records->len * sizeof(struct spcc_db_record);
+		for (guint i = 0; i < records->len; i++) {
+			struct spcc_db_record *rec = &g_array_index(records, struct spcc_db_record, i);
+			for (int j = 0; j < SPCC_DB_NB_STRINGS; j++)
+				if (rec->strings[j])
+					rec->strings[j] += start;
+			rec->x += start;
+			rec->y += start;
+		}
+		GByteArray *file = g_byte_array_sized_new(start + blob->len);
+		g_byte_array_append(file, (guint8 *) &header, sizeof(header));
+		g_byte_array_append(file, (guint8 *) records->data, records->len * sizeof(struct spcc_db_record));
+		g_byte_array_append(file, blob->data, blob->len);
+		gchar *filename = get_spcc_db_filename();
+		GError *error = NULL;
+		if (!g_file_set_contents(filename, (gchar *) file->data, file->len, &error)) {
+			siril_debug_print("Unable to write the SPCC database: %s\n", error->message);
+			g_error_free(error);
+		} else {
+			siril_debug_print("SPCC database with %u objects written to %s\n", records->len, filename);
+		}
+		g_free(filename);
+		g_byte_array_free(file, TRUE);
+	}
+	g_array_free(records, TRUE);
+	g_byte_array_free(blob, TRUE);
+}
+
+static gboolean db_record_is_valid(const struct spcc_db_record *rec, const gchar *contents, gsize size) {
+	if (rec->list < SPCC_DB_MONO_SENSORS || rec->list > SPCC_DB_WB_REFS || rec->n <= 0)
+		return FALSE;
+	for (int i = 0; i < SPCC_DB_NB_STRINGS; i++) {
+		if (rec->strings[i] && (rec->strings[i] >= size || !memchr(contents + rec->strings[i], '\0', size - rec->strings[i])))
+			return FALSE;
+	}
+	guint64 length = (guint64) rec->n * sizeof(double);
+	return rec->x % 8 == 0 && rec->y % 8 == 0 && rec->x + length <= size && rec->y + length <= size;
+}
+
+static const gchar *db_string(const gchar *contents, guint64 offset) {
+	return offset ? contents + offset : NULL;
+}
+
+static void db_fill_object(spcc_object *object, const struct spcc_db_record *rec, const gchar *contents) {
+	memset(object, 0, sizeof(spcc_object));
+	object->type = rec->type;
+	object->quality = rec->quality;
+	object->channel = rec->channel;
+	object->is_dslr = rec->is_dslr;
+	object->index = rec->index;
+	object->version = rec->version;
+	object->n = rec->n;
+	object->model = g_strdup(db_string(contents, rec->strings[0]));
+	object->name = g_strdup(db_string(contents, rec->strings[1]));
+	object->filepath = g_strdup(db_string(contents, rec->strings[2]));
+	object->comment = g_strdup(db_string(contents, rec->strings[3]));
+	object->manufacturer = g_strdup(db_string(contents, rec->strings[4]));
+	object->source = g_strdup(db_string(contents, rec->strings[5]));
+	object->db_record = rec;
+}
+
+/* the records are in the order of the sorted lists */
+static gboolean load_spcc_database(const gchar *fingerprint) {
+	gchar *filename = get_spcc_db_filename();
+	GMappedFile *mapped = g_mapped_file_new(filename, FALSE, NULL);
+	g_free(filename);
+	if (!mapped)
+		return FALSE;
+	const gchar *contents = g_mapped_file_get_contents(mapped);
+	gsize size = g_mapped_file_get_length(mapped);
+	const struct spcc_db_header *header = (const struct spcc_db_header *) contents;
+	if (size < sizeof(struct spcc_db_header) || strncmp(header->magic, SPCC_DB_MAGIC, sizeof(header->magic))
+			|| strncmp(header->fingerprint, fingerprint, sizeof(header->fingerprint))
+			|| header->record_size != sizeof(struct spcc_db_record)
+			|| sizeof(struct spcc_db_header) + (guint64) header->nb_records * sizeof(struct spcc_db_record) > size) {
+		siril_debug_print("SPCC database is outdated\n");
+		g_mapped_file_unref(mapped);
+		return FALSE;
+	}
+	const struct spcc_db_record *records = (const struct spcc_db_record *) (contents + sizeof(struct spcc_db_header));
+	for (guint i = 0; i < header->nb_records; i++) {
+		if (!db_record_is_valid(&records[i], contents, size) ||
+				(records[i].list == SPCC_DB_OSC_SENSORS && (i + 2 >= header->nb_records || records[i + 2].list != SPCC_DB_OSC_SENSORS))) {
+			siril_debug_print("SPCC database is corrupted\n");
+			g_mapped_file_unref(mapped);
+			return FALSE;
+		}
+		if (records[i].list == SPCC_DB_OSC_SENSORS)
+			i += 2;
+	}
+
+	GList *lists[SPCC_DB_WB_REFS + 1] = { NULL };
+	for (guint i = 0; i < header->nb_records; i++) {
+		const struct spcc_db_record *rec = &records[i];
+		if (rec->list == SPCC_DB_OSC_SENSORS) {
+			osc_sensor *osc = g_new0(osc_sensor, 1);
+			for (int j = 0; j < 3; j++)
+				db_fill_object(&osc->channel[j], &records[i + j], contents);
+			lists[rec->list] = g_list_prepend(lists[rec->list], osc);
+			i += 2;
+		} else {
+			spcc_object *object = g_new0(spcc_object, 1);
+			db_fill_object(object, rec, contents);
+			lists[rec->list] = g_list_prepend(lists[rec->list], object);
+		}
+	}
+	com.spcc_data.mono_sensors = g_list_reverse(lists[SPCC_DB_MONO_SENSORS]);
+	com.spcc_data.osc_sensors = g_list_reverse(lists[SPCC_DB_OSC_SENSORS]);
+	for (int i = 0; i < 3; i++)
+		com.spcc_data.mono_filters[i] = g_list_reverse(lists[SPCC_DB_MONO_FILTERS + i]);
+	com.spcc_data.osc_filters = g_list_reverse(lists[SPCC_DB_OSC_FILTERS]);
+	com.spcc_data.osc_lpf = g_list_reverse(lists[SPCC_DB_OSC_LPFS]);
+	com.spcc_data.wb_ref = g_list_reverse(lists[SPCC_DB_WB_REFS]);
+	spcc_db = mapped;
+	siril_debug_print("SPCC metadata loaded from the database (%u objects)\n", header->nb_records);
+	return TRUE;
+}
+
+static gboolean load_spcc_object_arrays_from_database(spcc_object *data) {
+	const struct spcc_db_record *rec = data->db_record;
+	const gchar *contents = g_mapped_file_get_contents(spcc_db);
+	data->n = rec->n;
+	data->x = malloc(data->n * sizeof(double));
+	data->y = malloc(data->n * sizeof(double));
+	if (!data->x || !data->y) {
+		PRINT_ALLOC_ERR;
+		spcc_object_free_arrays(data);
+		return FALSE;
+	}
+	memcpy(data->x, contents + rec->x, data->n * sizeof(double));
+	memcpy(data->y, contents + rec->y, data->n * sizeof(double));
+	data->arrays_loaded = TRUE;
+	return TRUE;
+}
+
 // Call to populate the arrays of a specific spcc_object
 gboolean load_spcc_object_arrays(spcc_object *data) {
 	if (!data || !data->filepath) // Avoid dereferencing null pointers, if the spcc_object isn't prepopulated we can't load the arrays
@@ -463,6 +751,9 @@ gboolean load_spcc_object_arrays(spcc_object *data) {
 	if (data->arrays_loaded)
 		return TRUE;
 
+	if (data->db_record && spcc_db)
+		return load_spcc_object_arrays_from_database(data);
+
 	GError *error = NULL;
 	JsonParser *parser;
 	JsonObject *object;
@@ -649,17 +940,29 @@ void load_all_spcc_metadata() {
 		com.spcc_data.mono_filters[i] = NULL;
 	}
 
+	// no object refers to the previous database anymore
+	if (spcc_db) {
+		g_mapped_file_unref(spcc_db);
+		spcc_db = NULL;
+	}
+
 	const gchar *path = siril_get_spcc_repo_path();
-	processDirectory(path);
-	siril_debug_print("SPCC JSON metadata loaded\n");
-
-	com.spcc_data.wb_ref = g_list_sort(com.spcc_data.wb_ref, compare_spcc_object_names);
-	com.spcc_data.osc_sensors = g_list_sort(com.spcc_data.osc_sensors, compare_osc_object_models);
-	com.spcc_data.osc_lpf = g_list_sort(com.spcc_data.osc_lpf, compare_spcc_object_names);
-	com.spcc_data.osc_filters = g_list_sort(com.spcc_data.osc_filters, compare_spcc_object_names);
-	com.spcc_data.mono_sensors = g_list_sort(com.spcc_data.mono_sensors, compare_spcc_object_names);
-	for (int i = 0 ; i < 3 ; i++)
-		com.spcc_data.mono_filters[i] = g_list_sort(com.spcc_data.mono_filters[i], compare_spcc_object_names);
+	gchar *fingerprint = spcc_repo_fingerprint(path);
+	if (!fingerprint || !load_spcc_database(fingerprint)) {
+		processDirectory(path);
+		siril_debug_print("SPCC JSON metadata loaded\n");
+
+		com.spcc_data.wb_ref = g_list_sort(com.spcc_data.wb_ref, compare_spcc_object_names);
+		com.spcc_data.osc_sensors = g_list_sort(com.spcc_data.osc_sensors, compare_osc_object_models);
+		com.spcc_data.osc_lpf = g_list_sort(com.spcc_data.osc_lpf, compare_spcc_object_names);
+		com.spcc_data.osc_filters = g_list_sort(com.spcc_data.osc_filters, compare_spcc_object_names);
+		com.spcc_data.mono_sensors = g_list_sort(com.spcc_data.mono_sensors, compare_spcc_object_names);
+		for (int i = 0 ; i < 3 ; i++)
+			com.spcc_data.mono_filters[i] = g_list_sort(com.spcc_data.mono_filters[i], compare_spcc_object_names);
+		if (fingerprint)
+			save_spcc_database(fingerprint);
+	}
+	g_free(fingerprint);
 	spcc_metadata_loaded = TRUE;
 }
 
@@ -0,0 +1,495 @@
+/*
+ * This file is part of Siril, an astronomy image processor.
+ * Copyright (C) 2005-2011 Francois Meyer (dulle at free.fr)
+ * Copyright (C) 2012-2025 team free-astro (see more in AUTHORS file)
+ * Reference site is https://siril.org
+ *
+ * Siril is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Siril is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Siril. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <fitsio.h>
+
+#include "core/siril.h"
+#include "core/proto.h"
+#include "core/OS_utils.h"
+#include "core/processing.h"
+#include "core/siril_log.h"
+#include "io/image_format_fits.h"
+
+#include "tiled_image.h"
+
+#define TILE_PIXELS ((size_t) TILED_IMAGE_TILE_SIZE * TILED_IMAGE_TILE_SIZE)
+#define TILE_BYTES (TILE_PIXELS * sizeof(float))
+
+struct cached_tile {
+	float *data;		// NULL when not in memory
+	gboolean dirty;		// modified since it was read from the store
+	gboolean stored;	// has a copy in the store
+	int refs;		// number of users, it cannot be evicted when not 0
+	gboolean busy;		// being read from or written to the store
+	GList *lru_link;	// in tiled_image.lru when in memory
+};
+
+struct tiled_image {
+	int rx, ry, nchans;
+	int tiles_x, tiles_y;
+	int bitpix;		// of the source, after manage_bitpix()
+	int orig_bitpix;
+	fitsfile *fptr;		// the source, kept open for its header
+	gchar *store_path;
+	FILE *store;
+	GMutex store_lock;	// for the position of the store
+	struct cached_tile *tiles;
+	GQueue lru;		// indices of the tiles in memory, most recent first
+	int nb_cached, max_cached;	// nb_cached includes the tiles being read
+	GMutex lock;		// for the tiles and the cache, not held during I/O
+	GCond tile_ready;	// signalled when a tile is no longer busy
+};
+
+static int store_seek(FILE *f, guint64 offset) {
+#ifdef _WIN32
+	return _fseeki64(f, (__int64) offset, SEEK_SET);
+#else
+	return fseeko(f, (off_t) offset, SEEK_SET);
+#endif
+}
+
+/* the store I/O is done without the lock of the tiles, so that the threads
+ * working on tiles in memory are not blocked by the disk */
+static int store_write(tiled_image *img, int index, const float *data) {
+	g_mutex_lock(&img->store_lock);
+	int retval = store_seek(img->store, (guint64) index * TILE_BYTES) ||
+		fwrite(data, TILE_BYTES, 1, img->store) != 1;
+	g_mutex_unlock(&img->store_lock);
+	if (retval)
+		siril_log_color_message(_("Cannot write to the tile store %s\n"), "red", img->store_path);
+	return retval;
+}
+
+static int store_read(tiled_image *img, int index, float *data) {
+	g_mutex_lock(&img->store_lock);
+	int retval = store_seek(img->store, (guint64) index * TILE_BYTES) ||
+		fread(data, TILE_BYTES, 1, img->store) != 1;
+	g_mutex_unlock(&img->store_lock);
+	if (retval)
+		siril_log_color_message(_("Cannot read from the tile store %s\n"), "red", img->store_path);
+	return retval;
+}
+
+/* frees the memory of the least recently used tile that is not in use, with
+ * the lock held. A modified tile is written to the store first, with the tile
+ * marked busy and the lock released during the write, unlocked being then set
+ * to TRUE. If all tiles are in use, the cache grows above its size */
+static int evict_tile(tiled_image *img, gboolean *unlocked) {
+	for (GList *link = img->lru.tail; link; link = link->prev) {
+		int index = GPOINTER_TO_INT(link->data);
+		struct cached_tile *tile = &img->tiles[index];
+		if (tile->refs || tile->busy)
+			continue;
+		if (tile->dirty) {
+			/* a busy tile is not acquired, so its data and its
+			 * place in the LRU are unchanged when the lock is back */
+			tile->busy = TRUE;
+			*unlocked = TRUE;
+			g_mutex_unlock(&img->lock);
+			int retval = store_write(img, index, tile->data);
+			g_mutex_lock(&img->lock);
+			tile->busy = FALSE;
+			g_cond_broadcast(&img->tile_ready);
+			if (retval)
+				return 1;
+			tile->stored = TRUE;
+			tile->dirty = FALSE;
+		}
+		free(tile->data);
+		tile->data = NULL;
+		g_queue_delete_link(&img->lru, tile->lru_link);
+		tile->lru_link = NULL;
+		img->nb_cached--;
+		return 0;
+	}
+	return 0;
+}
+
+/* returns the data of the tile, read from the store if needed. The tile is
+ * marked busy while it is read, the other threads needing it wait for it */
+static float *tile_acquire(tiled_image *img, int index) {
+	struct cached_tile *tile = &img->tiles[index];
+	float *data = NULL;
+	g_mutex_lock(&img->lock);
+	while (TRUE) {
+		while (tile->busy)
+			g_cond_wait(&img->tile_ready, &img->lock);
+		if (tile->data) {
+			g_queue_unlink(&img->lru, tile->lru_link);
+			g_queue_push_head_link(&img->lru, tile->lru_link);
+			tile->refs++;
+			data = tile->data;
+			goto out;
+		}
+		if (img->nb_cached < img->max_cached)
+			break;
+		gboolean unlocked = FALSE;
+		if (evict_tile(img, &unlocked))
+			goto out;
+		/* with the lock released, the tile may have been read by
+		 * another thread and the room taken */
+		if (!unlocked)
+			break;
+	}
+	tile->busy = TRUE;
+	img->nb_cached++;
+	gboolean stored = tile->stored;
+	g_mutex_unlock(&img->lock);
+
+	float *loaded = malloc(TILE_BYTES);
+	if (!loaded)
+		PRINT_ALLOC_ERR;
+	else if (!stored)
+		memset(loaded, 0, TILE_BYTES);
+	else if (store_read(img, index, loaded)) {
+		free(loaded);
+		loaded = NULL;
+	}
+
+	g_mutex_lock(&img->lock);
+	tile->busy = FALSE;
+	if (loaded) {
+		tile->data = loaded;
+		g_queue_push_head(&img->lru, GINT_TO_POINTER(index));
+		tile->lru_link = img->lru.head;
+		tile->refs++;
+		data = loaded;
+	} else {
+		img->nb_cached--;
+	}
+	g_cond_broadcast(&img->tile_ready);
+out:
+	g_mutex_unlock(&img->lock);
+	return data;
+}
+
+static void tile_release(tiled_image *img, int index, gboolean modified) {
+	g_mutex_lock(&img->lock);
+	img->tiles[index].refs--;
+	if (modified)
+		img->tiles[index].dirty = TRUE;
+	g_mutex_unlock(&img->lock);
+}
+
+static void tile_describe(const tiled_image *img, int index, struct image_tile *tile) {
+	int tx = index % img->tiles_x;
+	int ty = (index / img->tiles_x) % img->tiles_y;
+	tile->channel = index / (img->tiles_x * img->tiles_y);
+	tile->x = tx * TILED_IMAGE_TILE_SIZE;
+	tile->y = ty * TILED_IMAGE_TILE_SIZE;
+	tile->w = min(TILED_IMAGE_TILE_SIZE, img->rx - tile->x);
+	tile->h = min(TILED_IMAGE_TILE_SIZE, img->ry - tile->y);
+	tile->data = NULL;
+}
+
+static int tile_index(const tiled_image *img, int tx, int ty, int channel) {
+	return (channel * img->tiles_y + ty) * img->tiles_x + tx;
+}
+
+static float pixel_norm(int bitpix, int orig_bitpix) {
+	if (bitpix == USHORT_IMG)
+		return orig_bitpix == BYTE_IMG ? INV_UCHAR_MAX_SINGLE : INV_USHRT_MAX_SINGLE;
+	if (bitpix == BYTE_IMG)
+		return INV_UCHAR_MAX_SINGLE;
+	return 1.f;
+}
+
+static int open_store(tiled_image *img) {
+	const gchar *dir = com.pref.swap_dir && com.pref.swap_dir[0] != '\0' ? com.pref.swap_dir : g_get_tmp_dir();
+	img->store_path = g_build_filename(dir, "siril_tiles_XXXXXX", NULL);
+	int fd = g_mkstemp(img->store_path);
+	if (fd < 0 || !(img->store = fdopen(fd, "w+b"))) {
+		siril_log_color_message(_("Cannot create the tile store in %s\n"), "red", dir);
+		if (fd >= 0)
+			g_close(fd, NULL);
+		g_free(img->store_path);
+		img->store_path = NULL;
+		return 1;
+	}
+	return 0;
+}
+
+/* returns TRUE if loading the FITS file and a copy of it would not fit in the
+ * available memory */
+gboolean fits_file_exceeds_memory(const char *filename) {
+	fitsfile *fptr = NULL;
+	int status = 0, naxis = 0;
+	long naxes[3] = { 1, 1, 1 };
+	if (siril_fits_open_diskfile_img(&fptr, filename, READONLY, &status))
+		return FALSE;
+	fits_get_img_size(fptr, 3, naxes, &status);
+	fits_get_img_dim(fptr, &naxis, &status);
+	int close_status = 0;
+	fits_close_file(fptr, &close_status);
+	if (status || naxis < 2)
+		return FALSE;
+	guint64 size = (guint64) naxes[0] * naxes[1] * (naxis > 2 ? naxes[2] : 1) * sizeof(float);
+	return 2 * size > get_available_memory();
+}
+
+/* opens a FITS image as a tiled image, keeping at most max_memory bytes of
+ * tiles in memory. The tiles are read band by band, so the whole image is
+ * never loaded */
+tiled_image *tiled_image_open(const char *filename, guint64 max_memory) {
+	int status = 0, naxis = 0, bitpix = 0;
+	long naxes[3] = { 1, 1, 1 };
+	fitsfile *fptr = NULL;
+	if (siril_fits_open_diskfile_img(&fptr, filename, READONLY, &status)) {
+		report_fits_error(status);
+		return NULL;
+	}
+	fits_get_img_param(fptr, 3, &bitpix, &naxis, naxes, &status);
+	if (status || naxis < 2 || (naxis == 3 && naxes[2] != 3)) {
+		siril_log_message(_("Unsupported FITS image format (%d axes).\n"), naxis);
+		status = 0;
+		fits_close_file(fptr, &status);
+		return NULL;
+	}
+
+	tiled_image *img = calloc(1, sizeof(tiled_image));
+	if (!img) {
+		PRINT_ALLOC_ERR;
+		fits_close_file(fptr, &status);
+		return NULL;
+	}
+	manage_bitpix(fptr, &bitpix, &img->orig_bitpix);
+	if (bitpix != BYTE_IMG && bitpix != USHORT_IMG && bitpix != FLOAT_IMG && bitpix != DOUBLE_IMG) {
+		siril_log_message(_("FITS image format %d is not supported by Siril.\n"), bitpix);
+		fits_close_file(fptr, &status);
+		free(img);
+		return NULL;
+	}
+	img->fptr = fptr;
+	img->bitpix = bitpix;
+	img->rx = (int) naxes[0];
+	img->ry = (int) naxes[1];
+	img->nchans = naxis == 3 ? 3 : 1;
+	img->tiles_x = (img->rx + TILED_IMAGE_TILE_SIZE - 1) / TILED_IMAGE_TILE_SIZE;
+	img->tiles_y = (img->ry + TILED_IMAGE_TILE_SIZE - 1) / TILED_IMAGE_TILE_SIZE;
+	/* at least two tiles per thread and a full row of tiles for the bands */
+	img->max_cached = max((int) (max_memory / TILE_BYTES), max(2 * com.max_thread, img->tiles_x));
+	g_queue_init(&img->lru);
+	g_mutex_init(&img->lock);
+	g_mutex_init(&img->store_lock);
+	g_cond_init(&img->tile_ready);
+	img->tiles = calloc((size_t) img->tiles_x * img->tiles_y * img->nchans, sizeof(struct cached_tile));
+	if (!img->tiles) {
+		PRINT_ALLOC_ERR;
+		tiled_image_free(img);
+		return NULL;
+	}
+	if (open_store(img)) {
+		tiled_image_free(img);
+		return NULL;
+	}
+	siril_debug_print("tiled image %dx%dx%d, %d tiles in memory\n", img->rx, img->ry,
+			img->nchans, img->max_cached);
+
+	const float norm = pixel_norm(img->bitpix, img->orig_bitpix);
+	float *band = malloc((size_t) img->rx * TILED_IMAGE_TILE_SIZE * sizeof(float));
+	if (!band) {
+		PRINT_ALLOC_ERR;
+		tiled_image_free(img);
+		return NULL;
+	}
+	for (int c = 0; c < img->nchans && !status; c++) {
+		for (int ty = 0; ty < img->tiles_y && !status; ty++) {
+			int y0 = ty * TILED_IMAGE_TILE_SIZE;
+			int h = min(TILED_IMAGE_TILE_SIZE, img->ry - y0);
+			long fpixel[3] = { 1, y0 + 1, c + 1 };
+			if (fits_read_pix(fptr, TFLOAT, fpixel, (LONGLONG) img->rx * h, NULL, band, NULL, &status)) {
+				report_fits_error(status);
+				break;
+			}
+			for (int tx = 0; tx < img->tiles_x; tx++) {
+				int index = tile_index(img, tx, ty, c);
+				struct image_tile tile;
+				tile_describe(img, index, &tile);
+				float *data = tile_acquire(img, index);
+				if (!data) {
+					status = 1;
+					break;
+				}
+				for (int y = 0; y < tile.h; y++) {
+					const float *src = band + (size_t) y * img->rx + tile.x;
+					float *dst = data + (size_t) y * tile.w;
+					for (int x = 0; x < tile.w; x++)
+						dst[x] = src[x] * norm;
+				}
+				tile_release(img, index, TRUE);
+			}
+		}
+	}
+	free(band);
+	if (status) {
+		tiled_image_free(img);
+		return NULL;
+	}
+	return img;
+}
+
+void tiled_image_get_size(const tiled_image *img, int *rx, int *ry, int *nchans) {
+	*rx = img->rx;
+	*ry = img->ry;
+	*nchans = img->nchans;
+}
+
+/* calls func on each tile, in parallel on threads. If write is TRUE, the data
+ * modified by func is kept. Returns 0 if func succeeded on all tiles */
+int tiled_image_foreach(tiled_image *img, tile_func func, void *user, gboolean write, int threads) {
+	const int nb_tiles = img->tiles_x * img->tiles_y * img->nchans;
+	int retval = 0;
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(threads) schedule(dynamic) reduction(|:retval) if(threads > 1)
+#endif
+	for (int index = 0; index < nb_tiles; index++) {
+		if (!get_thread_run())
+			continue;
+		struct image_tile tile;
+		tile_describe(img, index, &tile);
+		tile.data = tile_acquire(img, index);
+		if (!tile.data) {
+			retval |= 1;
+			continue;
+		}
+		int ret = func(&tile, user);
+		tile_release(img, index, write && !ret);
+		retval |= ret;
+	}
+	if (!get_thread_run())
+		retval = 1;
+	return retval;
+}
+
+/* saves the image in a FITS file with the header of the source, band by band.
+ * 8-bit and 16-bit images keep their bit depth, others are saved as float */
+int tiled_image_save(tiled_image *img, const char *filename) {
+	int status = 0;
+	fitsfile *fptr = NULL;
+	int out_bitpix = img->orig_bitpix == BYTE_IMG ? BYTE_IMG :
+		(img->bitpix == USHORT_IMG ? USHORT_IMG : FLOAT_IMG);
+	long naxes[3] = { img->rx, img->ry, img->nchans };
+
+	if (g_unlink(filename))
+		siril_debug_print("g_unlink() failed\n"); /* Delete old file if it already exists */
+	if (siril_fits_create_diskfile(&fptr, filename, &status)) {
+		report_fits_error(status);
+		return 1;
+	}
+	fits_create_img(fptr, out_bitpix, img->nchans == 3 ? 3 : 2, naxes, &status);
+	int nkeys = 0;
+	fits_get_hdrspace(img->fptr, &nkeys, NULL, &status);
+	for (int k = 1; k <= nkeys && !status; k++) {
+		char card[FLEN_CARD];
+		if (fits_read_record(img->fptr, k, card, &status))
+			break;
+		if (!keyword_is_protected(card))
+			fits_write_record(fptr, card, &status);
+	}
+	if (status) {
+		report_fits_error(status);
+		status = 0;
+		fits_close_file(fptr, &status);
+		return 1;
+	}
+
+	size_t band_size = (size_t) img->rx * TILED_IMAGE_TILE_SIZE;
+	float *band = malloc(band_size * sizeof(float));
+	WORD *band16 = out_bitpix == FLOAT_IMG ? NULL : malloc(band_size * sizeof(WORD));
+	if (!band || (out_bitpix != FLOAT_IMG && !band16)) {
+		PRINT_ALLOC_ERR;
+		free(band);
+		free(band16);
+		fits_close_file(fptr, &status);
+		return 1;
+	}
+	const float out_norm = out_bitpix == BYTE_IMG ? UCHAR_MAX_SINGLE : USHRT_MAX_SINGLE;
+	int retval = 0;
+	for (int c = 0; c < img->nchans && !retval; c++) {
+		for (int ty = 0; ty < img->tiles_y && !retval; ty++) {
+			int y0 = ty * TILED_IMAGE_TILE_SIZE;
+			int h = min(TILED_IMAGE_TILE_SIZE, img->ry - y0);
+			for (int tx = 0; tx < img->tiles_x; tx++) {
+				int index = tile_index(img, tx, ty, c);
+				struct image_tile tile;
+				tile_describe(img, index, &tile);
+				float *data = tile_acquire(img, index);
+				if (!data) {
+					retval = 1;
+					break;
+				}
+				for (int y = 0; y < tile.h; y++)
+					memcpy(band + (size_t) y * img->rx + tile.x, data + (size_t) y * tile.w, tile.w * sizeof(float));
+				tile_release(img, index, FALSE);
+			}
+			if (retval)
+				break;
+			size_t n = (size_t) img->rx * h;
+			long fpixel[3] = { 1, y0 + 1, c + 1 };
+			if (out_bitpix == FLOAT_IMG)
+				fits_write_pix(fptr, TFLOAT, fpixel, n, band, &status);
+			else {
+				const WORD out_max = out_bitpix == BYTE_IMG ? UCHAR_MAX : USHRT_MAX;
+				for (size_t i = 0; i < n; i++)
+					band16[i] = min(roundf_to_WORD(band[i] * out_norm), out_max);
+				fits_write_pix(fptr, TUSHORT, fpixel, n, band16, &status);
+			}
+			if (status) {
+				report_fits_error(status);
+				retval = 1;
+			}
+		}
+	}
+	free(band);
+	free(band16);
+	status = 0;
+	fits_close_file(fptr, &status);
+	if (retval)
+		g_unlink(filename);
+	return retval;
+}
+
+void tiled_image_free(tiled_image *img) {
+	if (!img)
+		return;
+	if (img->tiles) {
+		for (int i = 0; i < img->tiles_x * img->tiles_y * img->nchans; i++)
+			free(img->tiles[i].data);
+		free(img->tiles);
+	}
+	g_queue_clear(&img->lru);
+	g_mutex_clear(&img->lock);
+	g_mutex_clear(&img->store_lock);
+	g_cond_clear(&img->tile_ready);
+	if (img->store) {
+		fclose(img->store);
+		g_unlink(img->store_path);
+	}
+	g_free(img->store_path);
+	if (img->fptr) {
+		int status = 0;
+		fits_close_file(img->fptr, &status);
+	}
+	free(img);
+}
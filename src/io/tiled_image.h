@@ -0,0 +1,36 @@
+#ifndef SRC_IO_TILED_IMAGE_H_
+#define SRC_IO_TILED_IMAGE_H_
+
+#include "core/siril.h"
+
+/* Disk-backed images, for the images larger than the memory like the giant
+ * drizzled mosaics. The pixels are converted to float in [0, 1] and stored by
+ * square tiles in a temporary file of the swap directory. Only a bounded number
+ * of tiles is kept in memory, the least recently used one being written back
+ * to the file when another is needed. Rows are in the FITS order, like the
+ * data of a fits */
+
+#define TILED_IMAGE_TILE_SIZE 512
+
+typedef struct tiled_image tiled_image;
+
+/* a tile given to the callbacks of tiled_image_foreach() */
+struct image_tile {
+	int x, y;	// position of the first pixel of the tile in the image
+	int w, h;	// size of the tile, smaller on the last column and row
+	int channel;
+	float *data;	// h rows of w pixels
+};
+
+/* returns 0 on success */
+typedef int (*tile_func)(struct image_tile *tile, void *user);
+
+gboolean fits_file_exceeds_memory(const char *filename);
+
+tiled_image *tiled_image_open(const char *filename, guint64 max_memory);
+void tiled_image_get_size(const tiled_image *img, int *rx, int *ry, int *nchans);
+int tiled_image_foreach(tiled_image *img, tile_func func, void *user, gboolean write, int threads);
+int tiled_image_save(tiled_image *img, const char *filename);
+void tiled_image_free(tiled_image *img);
+
+#endif /* SRC_IO_TILED_IMAGE_H_ */
@@ -0,0 +1,265 @@
+/*
+ * This file is part of Siril, an astronomy image processor.
+ * Copyright (C) 2005-2011 Francois Meyer (dulle at free.fr)
+ * Copyright (C) 2012-2025 team free-astro (see more in AUTHORS file)
+ * Reference site is https://siril.org
+ *
+ * Siril is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Siril is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Siril. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* The WCS cache of a sequence is a text file of the cache directory, named
+ * after the sequence, keeping for each frame the modification time and size
+ * of its file when it was read and the header cards that define its WCS, the
+ * other cards of the header being dropped. The WCS is parsed from these few
+ * cards instead of opening the file and reading its whole header, as long as
+ * the file has the same modification time and size. Frames that are not
+ * plate-solved are kept with no cards.
+ *
+ * The cards are only cached if the WCS parsed from them is the same as the one
+ * read from the file, otherwise the frame is read from its file each time.
+ */
+
+#include <string.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "core/siril.h"
+#include "core/proto.h"
+#include "core/siril_log.h"
+#include "io/sequence.h"
+#include "io/fits_sequence.h"
+#include "wcs_cache.h"
+
+#define WCS_CACHE_VERSION 1
+#define CARD_LENGTH 80
+
+struct wcs_cache_entry {
+	gint64 mtime;		// of the file when the cards were read
+	gint64 size;		// same
+	int nkeyrec;		// 0 if the frame is not plate-solved
+	gchar *cards;		// nkeyrec cards of CARD_LENGTH characters, NULL if not cached
+};
+
+struct wcs_cache {
+	sequence *seq;
+	gchar *filename;
+	struct wcs_cache_entry *entries;	// seq->number
+	gboolean modified;
+};
+
+/* keywords of the cards kept, compared on their start */
+static const char *wcs_keywords[] = { "WCSAXES", "CTYPE", "CUNIT", "CRVAL", "CRPIX",
+	"CDELT", "CROTA", "CD1_", "CD2_", "PC1_", "PC2_", "PV1_", "PV2_", "PS1_", "PS2_",
+	"LONPOLE", "LATPOLE", "RADESYS", "RADECSYS", "EQUINOX", "EPOCH", "MJD-OBS",
+	"DATE-OBS", "A_", "B_", "AP_", "BP_", "DP1", "DP2", "DQ1", "DQ2", "CPDIS",
+	"CQDIS", "WCSNAME" };
+
+static int get_frame_file_info(sequence *seq, int index, gint64 *mtime, gint64 *size) {
+	char filename[256];
+	const char *path;
+	if (seq->type == SEQ_REGULAR) {
+		if (!fit_sequence_get_image_filename(seq, index, filename, TRUE))
+			return 1;
+		path = filename;
+	}
+	else if (seq->type == SEQ_FITSEQ && seq->fitseq_file)
+		path = seq->fitseq_file->filename;
+	else return 1;
+	GStatBuf st;
+	if (g_stat(path, &st))
+		return 1;
+	*mtime = (gint64) st.st_mtime;
+	*size = (gint64) st.st_size;
+	return 0;
+}
+
+static gboolean is_wcs_card(const char *card) {
+	for (int i = 0; i < G_N_ELEMENTS(wcs_keywords); i++)
+		if (g_str_has_prefix(card, wcs_keywords[i]))
+			return TRUE;
+	return FALSE;
+}
+
+/* the WCS cards of a header where cards are separated by new lines */
+static gchar *extract_wcs_cards(const char *header, int *nkeyrec) {
+	GString *cards = g_string_new(NULL);
+	*nkeyrec = 0;
+	gchar **lines = g_strsplit(header, "\n", -1);
+	for (int i = 0; lines[i]; i++) {
+		if (!is_wcs_card(lines[i]))
+			continue;
+		size_t len = strlen(lines[i]);
+		if (len > CARD_LENGTH)
+			len = CARD_LENGTH;
+		g_string_append_len(cards, lines[i], len);
+		for (size_t j = len; j < CARD_LENGTH; j++)
+			g_string_append_c(cards, ' ');
+		(*nkeyrec)++;
+	}
+	g_strfreev(lines);
+	return g_string_free(cards, FALSE);
+}
+
+static gboolean same_wcs(const wcsprm_t *a, const wcsprm_t *b) {
+	for (int i = 0; i < NAXIS; i++) {
+		if (a->crval[i] != b->crval[i] || a->crpix[i] != b->crpix[i])
+			return FALSE;
+	}
+	for (int i = 0; i < NAXIS * NAXIS; i++) {
+		if (a->cd[i] != b->cd[i])
+			return FALSE;
+	}
+	if (strcmp(a->ctype[0], b->ctype[0]) || strcmp(a->ctype[1], b->ctype[1]))
+		return FALSE;
+	return (a->lin.dispre == NULL) == (b->lin.dispre == NULL);
+}
+
+static void free_wcsprm(wcsprm_t *wcs) {
+	if (wcs) {
+		wcsfree(wcs);
+		free(wcs);
+	}
+}
+
+static void read_cache_file(struct wcs_cache *cache) {
+	gchar *contents = NULL;
+	if (!g_file_get_contents(cache->filename, &contents, NULL, NULL))
+		return;
+	gchar **lines = g_strsplit(contents, "\n", -1);
+	g_free(contents);
+	int version = 0;
+	if (!lines[0] || sscanf(lines[0], "SIRIL_WCS_CACHE %d", &version) != 1 || version != WCS_CACHE_VERSION) {
+		siril_debug_print("WCS cache %s has an unknown format, ignored\n", cache->filename);
+		g_strfreev(lines);
+		return;
+	}
+	for (int i = 1; lines[i] && lines[i + 1]; i += 2) {
+		int index, nkeyrec;
+		gint64 mtime, size;
+		if (sscanf(lines[i], "%d %" G_GINT64_FORMAT " %" G_GINT64_FORMAT " %d", &index, &mtime, &size, &nkeyrec) != 4)
+			break;
+		if (index < 0 || index >= cache->seq->number || nkeyrec < 0 ||
+				strlen(lines[i + 1]) != (size_t) nkeyrec * CARD_LENGTH)
+			continue;
+		struct wcs_cache_entry *entry = &cache->entries[index];
+		g_free(entry->cards);
+		entry->mtime = mtime;
+		entry->size = size;
+		entry->nkeyrec = nkeyrec;
+		entry->cards = g_strdup(lines[i + 1]);
+	}
+	g_strfreev(lines);
+}
+
+struct wcs_cache *wcs_cache_load(sequence *seq) {
+	if (!seq || seq->number <= 0 || (seq->type != SEQ_REGULAR && seq->type != SEQ_FITSEQ))
+		return NULL;
+	struct wcs_cache *cache = calloc(1, sizeof(struct wcs_cache));
+	if (!cache) {
+		PRINT_ALLOC_ERR;
+		return NULL;
+	}
+	cache->entries = calloc(seq->number, sizeof(struct wcs_cache_entry));
+	if (!cache->entries) {
+		PRINT_ALLOC_ERR;
+		free(cache);
+		return NULL;
+	}
+	cache->seq = seq;
+	gchar *basename = g_path_get_basename(seq->seqname);
+	gchar *name = g_strdup_printf("%s.wcs", basename);
+	cache->filename = g_build_filename(com.wd, "cache", name, NULL);
+	g_free(name);
+	g_free(basename);
+	read_cache_file(cache);
+	return cache;
+}
+
+gboolean wcs_cache_get(struct wcs_cache *cache, int index, wcsprm_t **wcs) {
+	*wcs = NULL;
+	if (!cache || index < 0 || index >= cache->seq->number)
+		return FALSE;
+	struct wcs_cache_entry *entry = &cache->entries[index];
+	gint64 mtime, size;
+	if (!entry->cards || get_frame_file_info(cache->seq, index, &mtime, &size) ||
+			entry->mtime != mtime || entry->size != size)
+		return FALSE;
+	if (entry->nkeyrec == 0)
+		return TRUE;
+	*wcs = load_WCS_from_hdr(entry->cards, entry->nkeyrec);
+	return *wcs != NULL;
+}
+
+void wcs_cache_put(struct wcs_cache *cache, int index, fits *fit) {
+	if (!cache || index < 0 || index >= cache->seq->number)
+		return;
+	struct wcs_cache_entry *entry = &cache->entries[index];
+	gint64 mtime, size;
+	if (get_frame_file_info(cache->seq, index, &mtime, &size))
+		return;
+	int nkeyrec = 0;
+	gchar *cards = NULL;
+	if (fit->keywords.wcslib) {
+		if (!fit->header)
+			return;
+		cards = extract_wcs_cards(fit->header, &nkeyrec);
+		wcsprm_t *wcs = nkeyrec ? load_WCS_from_hdr(cards, nkeyrec) : NULL;
+		gboolean usable = wcs && same_wcs(wcs, fit->keywords.wcslib);
+		free_wcsprm(wcs);
+		if (!usable) {
+			siril_debug_print("WCS of image %d could not be cached\n", index + 1);
+			g_free(cards);
+			return;
+		}
+	}
+	else cards = g_strdup("");
+	g_free(entry->cards);
+	entry->cards = cards;
+	entry->nkeyrec = nkeyrec;
+	entry->mtime = mtime;
+	entry->size = size;
+	cache->modified = TRUE;
+}
+
+void wcs_cache_close(struct wcs_cache *cache) {
+	if (!cache)
+		return;
+	if (cache->modified) {
+		GString *contents = g_string_new(NULL);
+		g_string_append_printf(contents, "SIRIL_WCS_CACHE %d\n", WCS_CACHE_VERSION);
+		for (int i = 0; i < cache->seq->number; i++) {
+			const struct wcs_cache_entry *entry = &cache->entries[i];
+			if (!entry->cards)
+				continue;
+			g_string_append_printf(contents, "%d %" G_GINT64_FORMAT " %" G_GINT64_FORMAT " %d\n%s\n",
+					i, entry->mtime, entry->size, entry->nkeyrec, entry->cards);
+		}
+		gchar *dir = g_path_get_dirname(cache->filename);
+		GError *error = NULL;
+		if (g_mkdir_with_parents(dir, 0755) ||
+				!g_file_set_contents(cache->filename, contents->str, contents->len, &error)) {
+			siril_debug_print("could not write the WCS cache %s: %s\n", cache->filename,
+					error ? error->message : "cannot create the directory");
+			if (error)
+				g_error_free(error);
+		}
+		g_free(dir);
+		g_string_free(contents, TRUE);
+	}
+	for (int i = 0; i < cache->seq->number; i++)
+		g_free(cache->entries[i].cards);
+	free(cache->entries);
+	g_free(cache->filename);
+	free(cache);
+}
@@ -0,0 +1,21 @@
+#ifndef WCS_CACHE_H
+#define WCS_CACHE_H
+
+#include "core/siril.h"
+#include "algos/siril_wcs.h"
+
+/* Cache of the WCS header cards of the frames of a sequence, so that the
+ * frames of a plate-solved sequence don't have to be opened and their headers
+ * parsed again at each astrometric registration */
+struct wcs_cache;
+
+struct wcs_cache *wcs_cache_load(sequence *seq);
+/* returns TRUE if the frame is in the cache and its file has not changed,
+ * with its WCS in wcs, NULL if the frame is not plate-solved */
+gboolean wcs_cache_get(struct wcs_cache *cache, int index, wcsprm_t **wcs);
+/* stores the WCS of the frame, read from fit */
+void wcs_cache_put(struct wcs_cache *cache, int index, fits *fit);
+/* writes the cache if it was changed and frees it */
+void wcs_cache_close(struct wcs_cache *cache);
+
+#endif
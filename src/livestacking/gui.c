@@ -2,6 +2,7 @@
 #include "livestacking.h"
 #include <gtk/gtk.h>
 #include "io/image_format_fits.h"
+#include "io/master_cache.h"
 #include "gui/utils.h"
 #include "gui/callbacks.h"
 #include "gui/image_display.h"
@@ -209,7 +210,7 @@ void init_preprocessing_from_GUI() {
 		} else {
 			set_progress_bar_data(_("Opening dark image..."), PROGRESS_NONE);
 			prepro->dark = calloc(1, sizeof(fits));
-			if (!readfits(filename, prepro->dark, NULL, FALSE)) {
+			if (!master_cache_readfits(filename, prepro->dark, FALSE)) {
 				prepro->use_dark = TRUE;
 			} else {
 				livestacking_display(_("NOT USING DARK: cannot open the file"), FALSE);
@@ -280,7 +281,7 @@ void init_preprocessing_from_GUI() {
 		} else {
 			set_progress_bar_data(_("Opening flat image..."), PROGRESS_NONE);
 			prepro->flat = calloc(1, sizeof(fits));
-			if (!readfits(filename, prepro->flat, NULL, !com.pref.force_16bit)) {
+			if (!master_cache_readfits(filename, prepro->flat, !com.pref.force_16bit)) {
 				prepro->use_flat = TRUE;
 			} else {
 				livestacking_display(_("NOT USING FLAT: cannot open the file"), FALSE);
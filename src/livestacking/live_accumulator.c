@@ -0,0 +1,201 @@
+/*
+ * This file is part of Siril, an astronomy image processor.
+ * Copyright (C) 2005-2011 Francois Meyer (dulle at free.fr)
+ * Copyright (C) 2012-2025 team free-astro (see more in AUTHORS file)
+ * Reference site is https://siril.org
+ *
+ * Siril is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Siril is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Siril. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Live stacking accumulator
+ * The stack is a per-pixel running mean of the registered frames, kept in
+ * memory and updated in place for each new frame instead of stacking the
+ * previous result with the new frame from files. Frames are normalized to the
+ * first one with the additive with scaling normalization, using the median and
+ * MAD like the lite normalization of the stacking. Null pixels, outside the
+ * registered area of a frame, are not accumulated so each pixel is the mean of
+ * the frames that cover it. The running variance is kept to reject the values
+ * that are too far from the mean, like satellite trails, once enough frames
+ * have been stacked; since rejected values are not accounted in the mean and
+ * the variance, it is an approximate sigma clipping.
+ */
+
+#include <string.h>
+#include <math.h>
+
+#include "core/siril.h"
+#include "core/proto.h"
+#include "algos/statistics.h"
+#include "io/image_format_fits.h"
+#include "live_accumulator.h"
+
+#define LIVE_REJECTION_MIN_FRAMES 5	// frames before the rejection starts
+#define LIVE_REJECTION_SIGMA 3.f
+
+struct live_accumulator {
+	int rx, ry, nb_layers;
+	float *mean;		// running mean of the accepted values
+	float *m2;		// running sum of their squared deviations
+	guint16 *count;		// number of accepted values
+	double ref_median[3];	// normalization of the first frame
+	double ref_scale[3];
+	fits metadata;		// of the first frame, without data
+	int nb_frames;
+	double livetime;
+};
+
+/* frames are accumulated in the [0, 1] range */
+static int to_float(fits *fit) {
+	if (fit->type == DATA_FLOAT)
+		return 0;
+	size_t n = fit->naxes[0] * fit->naxes[1] * fit->naxes[2];
+	float *newbuf = fit->bitpix == BYTE_IMG ?
+		ushort8_buffer_to_float(fit->data, n) : ushort_buffer_to_float(fit->data, n);
+	if (!newbuf)
+		return 1;
+	fit_replace_buffer(fit, newbuf, DATA_FLOAT);
+	return 0;
+}
+
+static int get_normalization(fits *fit, int layer, double *median, double *scale, int threads) {
+	imstats *stat = statistics(NULL, -1, fit, layer, NULL, STATS_LITENORM, threads);
+	if (!stat) {
+		siril_log_message(_("Error: statistics computation failed.\n"));
+		return 1;
+	}
+	*median = stat->median;
+	*scale = 1.5 * stat->mad;
+	free_stats(stat);
+	return 0;
+}
+
+struct live_accumulator *live_accumulator_new(fits *ref, int threads) {
+	if (to_float(ref))
+		return NULL;
+	struct live_accumulator *acc = calloc(1, sizeof(struct live_accumulator));
+	if (!acc) {
+		PRINT_ALLOC_ERR;
+		return NULL;
+	}
+	size_t n = ref->rx * ref->ry * ref->naxes[2];
+	acc->rx = ref->rx;
+	acc->ry = ref->ry;
+	acc->nb_layers = ref->naxes[2];
+	acc->mean = calloc(n, sizeof(float));
+	acc->m2 = calloc(n, sizeof(float));
+	acc->count = calloc(n, sizeof(guint16));
+	if (!acc->mean || !acc->m2 || !acc->count) {
+		PRINT_ALLOC_ERR;
+		live_accumulator_free(acc);
+		return NULL;
+	}
+	for (int layer = 0; layer < acc->nb_layers; layer++) {
+		if (get_normalization(ref, layer, acc->ref_median + layer, acc->ref_scale + layer, threads)) {
+			live_accumulator_free(acc);
+			return NULL;
+		}
+	}
+	if (copyfits(ref, &acc->metadata, CP_FORMAT, -1)) {
+		live_accumulator_free(acc);
+		return NULL;
+	}
+	copy_fits_metadata(ref, &acc->metadata);
+	if (live_accumulator_add(acc, ref, threads)) {
+		live_accumulator_free(acc);
+		return NULL;
+	}
+	return acc;
+}
+
+int live_accumulator_add(struct live_accumulator *acc, fits *fit, int threads) {
+	if (fit->rx != acc->rx || fit->ry != acc->ry || fit->naxes[2] != acc->nb_layers) {
+		siril_log_color_message(_("Images must have same dimensions.\n"), "red");
+		return 1;
+	}
+	if (to_float(fit))
+		return 1;
+	size_t nbdata = (size_t)acc->rx * acc->ry;
+	gboolean reject = acc->nb_frames >= LIVE_REJECTION_MIN_FRAMES;
+
+	for (int layer = 0; layer < acc->nb_layers; layer++) {
+		double median, scale;
+		if (get_normalization(fit, layer, &median, &scale, threads))
+			return 1;
+		float pscale = scale == 0.0 ? 1.f : (float)(acc->ref_scale[layer] / scale);
+		float poffset = (float)(acc->ref_median[layer] - median * pscale);
+
+		const float *data = fit->fpdata[layer];
+		float *mean = acc->mean + layer * nbdata;
+		float *m2 = acc->m2 + layer * nbdata;
+		guint16 *count = acc->count + layer * nbdata;
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(threads) if(threads > 1) schedule(static)
+#endif
+		for (size_t i = 0; i < nbdata; i++) {
+			if (data[i] == 0.f || count[i] == G_MAXUINT16)
+				continue;
+			float val = data[i] * pscale + poffset;
+			float delta = val - mean[i];
+			if (reject && count[i] > 1) {
+				float sigma = sqrtf(m2[i] / (count[i] - 1));
+				if (fabsf(delta) > LIVE_REJECTION_SIGMA * sigma)
+					continue;
+			}
+			count[i]++;
+			mean[i] += delta / count[i];
+			m2[i] += delta * (val - mean[i]);
+		}
+	}
+	acc->nb_frames++;
+	acc->livetime += fit->keywords.exposure;
+	return 0;
+}
+
+/* creates the image of the current stack in result */
+int live_accumulator_get_result(struct live_accumulator *acc, fits *result, gboolean use_32bit_output) {
+	if (copyfits(&acc->metadata, result, CP_FORMAT, -1))
+		return 1;
+	copy_fits_metadata(&acc->metadata, result);
+	size_t n = (size_t)acc->rx * acc->ry * acc->nb_layers;
+	float *data = malloc(n * sizeof(float));
+	if (!data) {
+		PRINT_ALLOC_ERR;
+		return 1;
+	}
+	memcpy(data, acc->mean, n * sizeof(float));
+	fit_replace_buffer(result, data, DATA_FLOAT);
+	if (!use_32bit_output) {
+		WORD *newbuf = float_buffer_to_ushort(data, n);
+		if (!newbuf)
+			return 1;
+		fit_replace_buffer(result, newbuf, DATA_USHORT);
+	}
+	result->keywords.stackcnt = acc->nb_frames;
+	result->keywords.livetime = acc->livetime;
+	return 0;
+}
+
+int live_accumulator_get_nb_frames(struct live_accumulator *acc) {
+	return acc->nb_frames;
+}
+
+void live_accumulator_free(struct live_accumulator *acc) {
+	if (!acc)
+		return;
+	free(acc->mean);
+	free(acc->m2);
+	free(acc->count);
+	clearfits(&acc->metadata);
+	free(acc);
+}
@@ -0,0 +1,15 @@
+#ifndef _LIVE_ACCUMULATOR_H
+#define _LIVE_ACCUMULATOR_H
+
+#include "core/siril.h"
+
+/* the in-memory stack of live stacking, updated in place for each new frame */
+struct live_accumulator;
+
+struct live_accumulator *live_accumulator_new(fits *ref, int threads);
+int live_accumulator_add(struct live_accumulator *acc, fits *fit, int threads);
+int live_accumulator_get_result(struct live_accumulator *acc, fits *result, gboolean use_32bit_output);
+int live_accumulator_get_nb_frames(struct live_accumulator *acc);
+void live_accumulator_free(struct live_accumulator *acc);
+
+#endif
@@ -34,6 +34,7 @@
 #include "io/conversion.h"
 #include "io/FITS_symlink.h"
 #include "io/image_format_fits.h"
+#include "io/master_cache.h"
 #include "io/sequence.h"
 #include "io/single_image.h"
 /* global registration */
@@ -51,6 +52,7 @@
 #include "gui/image_display.h"
 #include "gui/callbacks.h"
 #include "livestacking.h"
+#include "live_accumulator.h"
 #include "gui.h"
 
 /* hard-coded configuration */
@@ -59,13 +61,22 @@
 
 
 #define WAIT_FILE_WRITTEN_US 80000	// check file size or readbility every 80 ms
-#define WAIT_FILE_WRITTEN_ITERS 15	// .080*15 = 1.2s, after that it's a failure
+#define WAIT_FILE_WRITTEN_ITERS 15	// .080*15 = 1.2s without change event, after that it's a failure
 #define EXIT_TOKEN ":EXIT:"
 
 static GFileMonitor *dirmon = NULL;
 static gboolean do_links = FALSE;
-static GThread *live_stacker_thread = NULL;
-static GAsyncQueue *new_files_queue = NULL;
+static GThread *live_stacker_thread = NULL, *live_calibrator_thread = NULL;
+static GAsyncQueue *new_files_queue = NULL;	// of file names, to the calibration stage
+static GAsyncQueue *calibrated_queue = NULL;	// of struct livestack_frame, to the stacking stage
+static gint stacker_failed = 0;	// the stacking stage has stopped, new files are ignored
+
+/* an image of the live_stack_ sequence, calibrated and ready to be stacked */
+struct livestack_frame {
+	int index;
+	struct timeval tv_start;	// when its file was taken from the queue
+};
+static struct livestack_frame exit_frame;
 
 static gboolean paused = FALSE;
 
@@ -73,13 +84,13 @@ static gboolean paused = FALSE;
 //static fitted_PSF **ref_stars = NULL;
 //static int nb_ref_stars = 0;
 //static sequence *registered_seq = NULL;
-static int seq_rx = -1, seq_ry = -1;
+static int seq_rx = -1, seq_ry = -1, seq_bitpix = 0;
 static struct star_align_data *sadata = NULL;
 static regdata *regparam_bkp = NULL;
 
 static struct preprocessing_data *prepro = NULL;
 static gboolean first_stacking_result = TRUE;
-static imstats *refimage_stats[3] = { NULL };
+static struct live_accumulator *accumulator = NULL;
 
 /* config */
 static gboolean use_32bits = FALSE;
@@ -87,27 +98,11 @@ static super_bool use_demosaicing = BOOL_NOT_SET;
 static transformation_type reg_type = HOMOGRAPHY_TRANSFORMATION;
 static gboolean reg_rotates = TRUE;
 
+static void clear_pending_files();
+static gpointer live_calibrator(gpointer arg);
 static gpointer live_stacker(gpointer arg);
 int star_align_prepare_hook(struct generic_seq_args *args);
 
-static void create_seq_of_2(sequence *seq, char *name, int index) {
-	seq->seqname = strdup(name);
-	seq->beg = 0;
-	seq->end = index;
-	seq->fixed = 5;
-	seq->reference_image = 0;
-	seq->number = 2;
-	seq->selnum = 2;
-	seq->imgparam = malloc(2 * sizeof(imgdata));
-	seq->imgparam[0].filenum = 1;
-	seq->imgparam[0].incl = TRUE;
-	seq->imgparam[0].date_obs = NULL;
-	seq->imgparam[1].filenum = index;
-	seq->imgparam[1].incl = TRUE;
-	seq->imgparam[1].date_obs = NULL;
-	seq->fz = com.pref.comp.fits_enabled;
-}
-
 void pause_live_stacking_engine() {
 	paused = !paused;
 }
@@ -118,15 +113,30 @@ void stop_live_stacking_engine() {
 		g_object_unref(dirmon);
 		dirmon = NULL;
 	}
+	clear_pending_files();
 	if (new_files_queue) {
 		g_async_queue_push(new_files_queue, EXIT_TOKEN);
 		g_async_queue_unref(new_files_queue);
 	}
+	if (live_calibrator_thread) {
+		g_thread_join(live_calibrator_thread);
+		live_calibrator_thread = NULL;
+		new_files_queue = NULL;
+	}
 	if (live_stacker_thread) {
 		g_thread_join(live_stacker_thread);
 		live_stacker_thread = NULL;
-		new_files_queue = NULL;
 	}
+	if (calibrated_queue) {
+		/* frames left if the stacking stage stopped on an error */
+		struct livestack_frame *frame;
+		while ((frame = g_async_queue_try_pop(calibrated_queue)))
+			if (frame != &exit_frame)
+				g_free(frame);
+		g_async_queue_unref(calibrated_queue);
+		calibrated_queue = NULL;
+	}
+	g_atomic_int_set(&stacker_failed, 0);
 	if (prepro) {
 		clear_preprocessing_data(prepro);
 		free(prepro);
@@ -142,12 +152,8 @@ void stop_live_stacking_engine() {
 		regparam_bkp = NULL;
 	}
 
-	for (int i = 0; i < 3; i++) {
-		if (refimage_stats[i]) {
-			free_stats(refimage_stats[i]);
-			refimage_stats[i] = NULL;
-		}
-	}
+	live_accumulator_free(accumulator);
+	accumulator = NULL;
 	seq_rx = -1; seq_ry = -1;
 	use_demosaicing = BOOL_NOT_SET;
 	paused = FALSE;
@@ -161,82 +167,155 @@ void stop_live_stacking_engine() {
 	}
 }
 
-static int wait_for_file_to_be_written(const gchar *filename) {
+/* Files are taken when they are completely written. Renamed or moved in files
+ * are complete when they appear, as written by capture software that writes
+ * files atomically. Created files are complete on the changes done event, sent
+ * when the file is closed with inotify, or when their size has not changed for
+ * WAIT_FILE_WRITTEN_US, for the monitor backends that don't report it */
+struct pending_file {
+	gchar *filename;
+	guint64 last_size;
 	int iter;
-#ifndef _WIN32
-	guint64 last_size = 0;
-#endif
-	GFile *fd = g_file_new_for_path(filename);
-	for (iter = 1; iter < WAIT_FILE_WRITTEN_ITERS; iter++) {
-		g_usleep(WAIT_FILE_WRITTEN_US);
+	guint timeout_id;
+};
+
+static GHashTable *pending_files = NULL;	// file name -> struct pending_file
+
+static void free_pending_file(gpointer data) {
+	struct pending_file *pending = (struct pending_file *) data;
+	if (pending->timeout_id)
+		g_source_remove(pending->timeout_id);
+	g_free(pending->filename);
+	g_free(pending);
+}
+
+/* returns 1 if the file is complete, 0 if it is not yet, -1 on error */
+static int file_is_written(struct pending_file *pending) {
+	GFile *fd = g_file_new_for_path(pending->filename);
+	int retval = 0;
 #ifdef _WIN32
-		GFileInputStream *stream;
-		if ((stream = g_file_read(fd, NULL, NULL))) {
-			g_object_unref(stream);
-			break;
-		}
+	GFileInputStream *stream;
+	if ((stream = g_file_read(fd, NULL, NULL))) {
+		g_object_unref(stream);
+		retval = 1;
+	}
 #else
-		guint64 size;
-		if (!g_file_measure_disk_usage(fd, G_FILE_MEASURE_NONE, NULL, NULL, NULL, &size, NULL, NULL, NULL)) {
-			g_object_unref(fd);
-			return 1;
-		}
+	guint64 size;
+	if (!g_file_measure_disk_usage(fd, G_FILE_MEASURE_NONE, NULL, NULL, NULL, &size, NULL, NULL, NULL))
+		retval = -1;
+	else {
 		siril_debug_print("image size: %d MB\n", (int )(size / 1000000));
-		if (last_size == 0 || size != last_size)
-			last_size = size;
-		else break;
-#endif
+		if (pending->last_size == 0 || size != pending->last_size)
+			pending->last_size = size;
+		else retval = 1;
 	}
+#endif
 	g_object_unref(fd);
-	return iter >= WAIT_FILE_WRITTEN_ITERS;
+	return retval;
 }
 
-static void file_changed(GFileMonitor *monitor, GFile *file, GFile *other,
-		GFileMonitorEvent evtype, gpointer user_data) {
-	if (evtype != G_FILE_MONITOR_EVENT_CREATED && evtype != G_FILE_MONITOR_EVENT_MOVED_IN) {
-		return;
-	}
-	gchar *filename = g_file_get_basename(file);
-	siril_debug_print("File %s added\n", filename);
-	if (filename[0] == '.' || // hidden files
-			paused)	{ // manage in https://gitlab.com/free-astro/siril/-/issues/786
-		g_free(filename);
-		return;
-	}
-
+static void file_ready(const gchar *filename) {
 	image_type type;
 	if (stat_file(filename, &type, NULL)) {
 		siril_debug_print("Filename is not canonical\n");
 	}
 	if (type != TYPEFITS) {
 		if (type == TYPERAW) {
-			if (!wait_for_file_to_be_written(filename)) {
-				fits dest = { 0 };
-				gchar *new = replace_ext(filename, com.pref.ext);
-				any_to_fits(TYPERAW, filename, &dest, FALSE, !com.pref.force_16bit, FALSE);
-				savefits(new, &dest);
-				clearfits(&dest);
-			}
+			fits dest = { 0 };
+			gchar *new = replace_ext(filename, com.pref.ext);
+			any_to_fits(TYPERAW, filename, &dest, FALSE, !com.pref.force_16bit, FALSE);
+			savefits(new, &dest);
+			clearfits(&dest);
 		}  else {
 			siril_log_message(_("File not supported for live stacking: %s\n"), filename);
 		}
-		g_free(filename);
 	} else {
 		if (strncmp(filename, "live_stack", 10) &&
 				strncmp(filename, "r_live_stack", 12) &&
 				strncmp(filename, "result_live_stack", 17)) {
-			if (wait_for_file_to_be_written(filename)) {
-				gchar *str = g_strdup_printf(_("Could not open file: %s"), filename);
-				livestacking_display(str, TRUE);
-				g_free(filename);
-				return;
-			}
-			g_async_queue_push(new_files_queue, filename);
+			g_async_queue_push(new_files_queue, g_strdup(filename));
 		}
-		else g_free(filename);
 	}
 }
 
+static gboolean poll_pending_file(gpointer data) {
+	struct pending_file *pending = (struct pending_file *) data;
+	int written = file_is_written(pending);
+	if (!written && ++pending->iter < WAIT_FILE_WRITTEN_ITERS)
+		return G_SOURCE_CONTINUE;
+	pending->timeout_id = 0;
+	gchar *filename = g_strdup(pending->filename);
+	g_hash_table_remove(pending_files, filename);
+	if (written == 1)
+		file_ready(filename);
+	else {
+		gchar *str = g_strdup_printf(_("Could not open file: %s"), filename);
+		livestacking_display(str, TRUE);
+	}
+	g_free(filename);
+	return G_SOURCE_REMOVE;
+}
+
+static void add_pending_file(const gchar *filename) {
+	if (!pending_files)
+		pending_files = g_hash_table_new_full(g_str_hash, g_str_equal, NULL, free_pending_file);
+	if (g_hash_table_contains(pending_files, filename))
+		return;
+	struct pending_file *pending = g_new0(struct pending_file, 1);
+	pending->filename = g_strdup(filename);
+	pending->timeout_id = g_timeout_add(WAIT_FILE_WRITTEN_US / 1000, poll_pending_file, pending);
+	g_hash_table_insert(pending_files, pending->filename, pending);
+}
+
+/* returns TRUE if the file was waited for */
+static gboolean remove_pending_file(const gchar *filename) {
+	return pending_files && g_hash_table_remove(pending_files, filename);
+}
+
+static void clear_pending_files() {
+	if (pending_files) {
+		g_hash_table_destroy(pending_files);
+		pending_files = NULL;
+	}
+}
+
+static void file_changed(GFileMonitor *monitor, GFile *file, GFile *other,
+		GFileMonitorEvent evtype, gpointer user_data) {
+	if (evtype != G_FILE_MONITOR_EVENT_CREATED && evtype != G_FILE_MONITOR_EVENT_MOVED_IN &&
+			evtype != G_FILE_MONITOR_EVENT_RENAMED && evtype != G_FILE_MONITOR_EVENT_CHANGES_DONE_HINT) {
+		return;
+	}
+	if (evtype == G_FILE_MONITOR_EVENT_RENAMED) {
+		/* the new name is the complete file */
+		gchar *old_name = g_file_get_basename(file);
+		remove_pending_file(old_name);
+		g_free(old_name);
+		if (!other)
+			return;
+		file = other;
+	}
+	gchar *filename = g_file_get_basename(file);
+	if (evtype == G_FILE_MONITOR_EVENT_CHANGES_DONE_HINT) {
+		if (remove_pending_file(filename)) {
+			siril_debug_print("File %s written\n", filename);
+			file_ready(filename);
+		}
+		g_free(filename);
+		return;
+	}
+	siril_debug_print("File %s added\n", filename);
+	if (filename[0] == '.' || // hidden files
+			paused)	{ // manage in https://gitlab.com/free-astro/siril/-/issues/786
+		g_free(filename);
+		return;
+	}
+
+	if (evtype == G_FILE_MONITOR_EVENT_CREATED)
+		add_pending_file(filename);
+	else file_ready(filename);
+	g_free(filename);
+}
+
 void livestacking_queue_file(char *file) {
 	g_async_queue_push(new_files_queue, file);
 }
@@ -285,6 +364,8 @@ int start_livestacking(gboolean with_filewatcher) {
 		siril_debug_print("file watcher active for CWD (%s)\n", com.wd);
 	}
 
+	calibrated_queue = g_async_queue_new();
+	live_calibrator_thread = g_thread_new("live calibrator", live_calibrator, NULL);
 	live_stacker_thread = g_thread_new("live stacker", live_stacker, NULL);
 	return 0;
 }
@@ -293,7 +374,7 @@ static void init_preprocessing_from_command(char *dark, char *flat, gboolean use
 	prepro = calloc(1, sizeof(struct preprocessing_data));
 	if (dark) {
 		prepro->dark = calloc(1, sizeof(fits));
-		if (readfits(dark, prepro->dark, NULL, FALSE)) {
+		if (master_cache_readfits(dark, prepro->dark, FALSE)) {
 			siril_log_message(_("NOT USING DARK: cannot open file '%s'\n"), dark);
 			free(prepro->dark);
 			prepro->use_dark = FALSE;
@@ -322,7 +403,7 @@ static void init_preprocessing_from_command(char *dark, char *flat, gboolean use
 	}
 	if (flat) {
 		prepro->flat = calloc(1, sizeof(fits));
-		if (readfits(flat, prepro->flat, NULL, FALSE)) {
+		if (master_cache_readfits(flat, prepro->flat, FALSE)) {
 			siril_log_message(_("NOT USING FLAT: cannot open file '%s'\n"), flat);
 			free(prepro->flat);
 			prepro->use_flat = FALSE;
@@ -558,19 +639,48 @@ static int preprocess_image(char *filename, char *target) {
 	return ret;
 }
 
-static gpointer live_stacker(gpointer arg) {
+/* drops the masters that don't have the size of the images, must be called
+ * before any image is calibrated */
+static void check_masters_size(int rx, int ry) {
+	if (prepro && prepro->dark && (prepro->dark->rx != rx || prepro->dark->ry != ry)) {
+		char *msg = siril_log_color_message(_("Dark image is not the same size, not using (%dx%d)\n"), "salmon", prepro->dark->rx, prepro->dark->ry);
+		msg[strlen(msg) - 1] = '\0';
+		livestacking_display(msg, FALSE);
+		clearfits(prepro->dark);
+		prepro->use_dark = FALSE;
+	}
+	if (prepro && prepro->flat && (prepro->flat->rx != rx || prepro->flat->ry != ry)) {
+		char *msg = siril_log_color_message(_("Flat image is not the same size, not using (%dx%d)\n"), "salmon", prepro->flat->rx, prepro->flat->ry);
+		msg[strlen(msg) - 1] = '\0';
+		livestacking_display(msg, FALSE);
+		clearfits(prepro->flat);
+		prepro->use_flat = FALSE;
+	}
+	if (prepro && !prepro->dark && !prepro->flat) {
+		free(prepro);
+		prepro = NULL;
+	}
+}
+
+/* First stage of the live stacking pipeline: calibrates and demosaics the new
+ * files into the live_stack_ sequence and passes them to the second stage,
+ * which registers and stacks them. The two stages run in their own thread so
+ * that the next image is calibrated while the previous one is stacked. */
+static gpointer live_calibrator(gpointer arg) {
 	g_async_queue_ref(new_files_queue);
-	int index = 1, number_of_images_stacked = 1;
-	livestacking_display(_("Live stacking waiting for files"), FALSE);
-	gboolean first_loop = TRUE;	// only original images in the sequence
+	int index = 1;
 	do {
 		gchar *filename = g_async_queue_pop(new_files_queue); // blocking
 		if (!strcmp(filename, EXIT_TOKEN)) {
-			siril_debug_print("Exiting thread\n");
+			siril_debug_print("Exiting calibration thread\n");
 			break;
 		}
-		struct timeval tv_start, tv_tmp, tv_end;
-		gettimeofday(&tv_start, NULL);
+		if (g_atomic_int_get(&stacker_failed)) {
+			g_free(filename);
+			continue;
+		}
+		struct livestack_frame *frame = g_new(struct livestack_frame, 1);
+		gettimeofday(&frame->tv_start, NULL);
 
 		/* init demosaicing (check if the incoming file is CFA) */
 		if (use_demosaicing == BOOL_NOT_SET) {	// another kind of first_loop
@@ -578,12 +688,15 @@ static gpointer live_stacker(gpointer arg) {
 			if (read_fits_metadata_from_path(filename, &fit)) {
 				livestacking_display(_("Failed to open the first image"), FALSE);
 				clearfits(&fit);
+				g_free(frame);
+				g_free(filename);
 				break;
 			}
 			gboolean is_CFA = fit.keywords.bayer_pattern[0] != '\0';
 			use_demosaicing = is_CFA ? BOOL_TRUE : BOOL_FALSE;
 			if (prepro)
 				prepro->debayer = is_CFA;
+			check_masters_size(fit.rx, fit.ry);
 
 			enable_debayer(is_CFA);
 			clearfits(&fit);
@@ -628,18 +741,45 @@ static gpointer live_stacker(gpointer arg) {
 			}
 			clearfits(&fit);
 		}
+		struct timeval tv_end;
 		gettimeofday(&tv_end, NULL);
-		show_time_msg(tv_start, tv_end, "calibration and demosaicing");
-		tv_tmp = tv_end;
+		show_time_msg(frame->tv_start, tv_end, "calibration and demosaicing");
 
 		if (target && symlink_uniq_file(filename, target, do_links)) {
 			g_free(target);
+			g_free(filename);
+			g_free(frame);
 			livestacking_display(_("Failed to rename or make a symbolic link to the input file"), FALSE);
 			break;
 		}
 		g_free(filename);
 		g_free(target);
 
+		frame->index = index++;
+		g_async_queue_push(calibrated_queue, frame);
+	} while (1);
+
+	g_async_queue_push(calibrated_queue, &exit_frame);
+	g_async_queue_unref(new_files_queue);
+	return NULL;
+}
+
+static gpointer live_stacker(gpointer arg) {
+	g_async_queue_ref(calibrated_queue);
+	int number_of_images_stacked = 1;
+	livestacking_display(_("Live stacking waiting for files"), FALSE);
+	gboolean first_loop = TRUE;	// only original images in the sequence
+	do {
+		struct livestack_frame *frame = g_async_queue_pop(calibrated_queue); // blocking
+		if (frame == &exit_frame) {
+			siril_debug_print("Exiting thread\n");
+			break;
+		}
+		int index = frame->index;
+		struct timeval tv_start = frame->tv_start, tv_tmp, tv_end;
+		g_free(frame);
+		gettimeofday(&tv_tmp, NULL);
+
 		/* Create the sequence */
 		siril_debug_print("Creating sequence %d\n", index);
 		sequence seq;
@@ -653,7 +793,6 @@ static gpointer live_stacker(gpointer arg) {
 		seq.fz = com.pref.comp.fits_enabled;
 		if (first_loop) {
 			if (buildseqfile(&seq, 1) || seq.number == 1) {
-				index++;
 				livestacking_display(_("Waiting for second image"), FALSE);
 				livestacking_update_number_of_images(1, gfit.keywords.exposure, -1.0, NULL);
 				continue;
@@ -679,24 +818,7 @@ static gpointer live_stacker(gpointer arg) {
 		if (seq_rx <= 0) {
 			seq_rx = seq.rx;
 			seq_ry = seq.ry;
-			if (prepro && prepro->dark && (prepro->dark->rx != seq_rx || prepro->dark->ry != seq_ry)) {
-				char *msg = siril_log_color_message(_("Dark image is not the same size, not using (%dx%d)\n"), "salmon", prepro->dark->rx, prepro->dark->ry);
-				msg[strlen(msg) - 1] = '\0';
-				livestacking_display(msg, FALSE);
-				clearfits(prepro->dark);
-				prepro->use_dark = FALSE;
-			}
-			if (prepro && prepro->flat && (prepro->flat->rx != seq_rx || prepro->flat->ry != seq_ry)) {
-				char *msg = siril_log_color_message(_("Flat image is not the same size, not using (%dx%d)\n"), "salmon", prepro->flat->rx, prepro->flat->ry);
-				msg[strlen(msg) - 1] = '\0';
-				livestacking_display(msg, FALSE);
-				clearfits(prepro->flat);
-				prepro->use_flat = FALSE;
-			}
-			if (prepro && !prepro->dark && !prepro->flat) {
-				free(prepro);
-				prepro = NULL;
-			}
+			seq_bitpix = seq.bitpix;
 		} else {
 			if (seq_rx != seq.rx || seq_ry != seq.ry) {
 				char *msg = siril_log_color_message(_("Images must have same dimensions.\n"), "red");
@@ -715,78 +837,53 @@ static gpointer live_stacker(gpointer arg) {
 
 		gchar *result_filename = g_strdup_printf("live_stack_00001%s", get_com_ext(com.pref.comp.fits_enabled));
 
-		/* Stack the sequence */
+		/* Stack the image */
 		siril_debug_print("Stacking image %d\n", index);
-
-		/*sequence *r_seq = readseqfile("r_live_stack_.seq");
-		if (!r_seq || seq_check_basic_data(r_seq, FALSE) < 0) {
-			free(r_seq);
-			return FALSE;
-		}*/
-		sequence r_seq;	// registered sequence
-		initialize_sequence(&r_seq, FALSE);
-		create_seq_of_2(&r_seq, reg_rotates ? "r_live_stack_" : "live_stack_", index);
-		if (seq_check_basic_data(&r_seq, FALSE) < 0) {
-			continue;
+		const char *reg_prefix = reg_rotates ? "r_live_stack_" : "live_stack_";
+		const char *ext = get_com_ext(com.pref.comp.fits_enabled);
+		int retval = 0;
+		if (!accumulator) {
+			/* the first frame is the reference of the normalization */
+			fits ref = { 0 };
+			gchar *ref_filename = g_strdup_printf("%s%05d%s", reg_prefix, 1, ext);
+			retval = readfits(ref_filename, &ref, NULL, TRUE);
+			g_free(ref_filename);
+			if (!retval) {
+				accumulator = live_accumulator_new(&ref, com.max_thread);
+				retval = !accumulator;
+			}
+			clearfits(&ref);
 		}
-		if (refimage_stats[0])
-			for (int i = 0; i < r_seq.nb_layers; i++)
-				add_stats_to_seq(&r_seq, 0, i, refimage_stats[i]);
-
-		struct stacking_args stackparam = { 0 };
-		stackparam.method = stack_mean_with_rejection;
-		stackparam.seq = &r_seq;
-		stackparam.ref_image = 0;
-		// TODO Apply some filter on quality?
-		stackparam.filtering_criterion = seq_filter_all;
-		stackparam.filtering_parameter = 0.0;
-		stackparam.nb_images_to_stack = 2;
-		stack_fill_list_of_unfiltered_images(&stackparam);
-		stackparam.description = describe_filter(&r_seq, stackparam.filtering_criterion, stackparam.filtering_parameter);
-		stackparam.output_filename = result_filename; // not used with main_stack()
-		stackparam.output_overwrite = TRUE;
-		gettimeofday(&stackparam.t_start, NULL);
-
-		stackparam.normalize = ADDITIVE_SCALING;	// TODO: toggle switch
-		stackparam.force_norm = FALSE;
-		stackparam.output_norm = FALSE;
-		stackparam.equalizeRGB = FALSE;		// not possible currently
-		stackparam.lite_norm = TRUE;
+		if (!retval) {
+			fits fit = { 0 };
+			gchar *filename = g_strdup_printf("%s%05d%s", reg_prefix, index, ext);
+			retval = readfits(filename, &fit, NULL, TRUE);
+			g_free(filename);
+			if (!retval)
+				retval = live_accumulator_add(accumulator, &fit, com.max_thread);
+			clearfits(&fit);
+		}
+
+		fits result = { 0 };
 		/* we should not use 32 bits for stack results if input files are 16 bits,
 		 * otherwise we end up with a mixed sequence to process;
 		 * inputs to stack are 16 bits when no preprocessing or debayer occur */
-		stackparam.use_32bit_output = get_data_type(r_seq.bitpix) == DATA_FLOAT ||
+		gboolean use_32bit_output = get_data_type(seq_bitpix) == DATA_FLOAT ||
 			(use_32bits && (prepro || use_demosaicing == BOOL_TRUE));
-		stackparam.reglayer = (r_seq.nb_layers == 3) ? 1 : 0;
-		stackparam.weighting_type = NBSTACK_WEIGHT;
-
-		reserve_thread(); // hack: generic function fails otherwise
-		main_stack(&stackparam);
-
-		/* doing things similar to end_stacking */
-		int retval = stackparam.retval;
-		/* and hacking the stats for good normalization: the reference is the first image stacked */
-		if (!retval && !refimage_stats[0]) {
-			if (copy_cached_stats_for_image(&r_seq, 0, refimage_stats)) {
-				siril_log_color_message(_("Reference image statistics not found\n"), "red");
-				stackparam.normalize = NO_NORM;
-			}
-			else siril_debug_print("saved statistics of reference image, using normalization\n");
-		}
-		clean_end_stacking(&stackparam);
-		free_sequence(&r_seq, FALSE);
-		free(stackparam.image_indices);
-		g_free(stackparam.description);
+		if (!retval)
+			retval = live_accumulator_get_result(accumulator, &result, use_32bit_output);
 
 		if (retval) {
+			clearfits(&result);
+			g_free(result_filename);
 			gchar *str = g_strdup_printf(_("Stacking failed for image %d"), index);
 			livestacking_display(str, TRUE);
 			break;
 		}
 		clear_stars_list(FALSE);
-		bgnoise_async(&stackparam.result, TRUE);
+		bgnoise_async(&result, TRUE);
 
-		if (savefits(result_filename, &stackparam.result)) {
+		if (savefits(result_filename, &result)) {
 			char *msg = siril_log_color_message(_("Could not save the stacking result %s, aborting\n"),
 					"red", result_filename);
 			msg[strlen(msg) - 1] = '\0';
@@ -798,7 +895,7 @@ static gpointer live_stacker(gpointer arg) {
 		if (!com.headless) {
 			/* Update display */
 			clearfits(&gfit);
-			memcpy(&gfit, &stackparam.result, sizeof(fits));
+			memcpy(&gfit, &result, sizeof(fits));
 			if (first_stacking_result) {
 				/* number of channels may have changed */
 				com.seq.current = RESULT_IMAGE;
@@ -814,11 +911,10 @@ static gpointer live_stacker(gpointer arg) {
 		gchar *str = g_strdup_printf(_("Stacked image %d"), index);
 		livestacking_display(str, TRUE);
 
-		index++;
 		number_of_images_stacked++;
 		double noise = bgnoise_await();
 		if (com.headless)
-			clearfits(&stackparam.result);
+			clearfits(&result);
 		gettimeofday(&tv_end, NULL);
 		show_time_msg(tv_tmp, tv_end, "stacking");
 		const char *total_time = format_time_diff(tv_start, tv_end);
@@ -830,7 +926,8 @@ static gpointer live_stacker(gpointer arg) {
 	siril_debug_print("===== exiting live stacking thread =====\n");
 
 	// TODO: clean exit
-	g_async_queue_unref(new_files_queue);
+	g_atomic_int_set(&stacker_failed, 1);
+	g_async_queue_unref(calibrated_queue);
 	return NULL;
 }
 
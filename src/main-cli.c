@@ -59,11 +59,13 @@
 #include "core/command.h"
 #include "core/pipe.h"
 #include "core/signals.h"
+#include "core/trace.h"
 #include "core/siril_app_dirs.h"
 #include "core/siril_language.h"
 #include "core/siril_log.h"
 #include "core/siril_networking.h"
 #include "core/OS_utils.h"
+#include "core/cpu_dispatch.h"
 #include "algos/siril_random.h"
 #include "algos/star_finder.h"
 #include "io/sequence.h"
@@ -85,6 +87,8 @@ static gchar *main_option_initfile = NULL;
 static gchar *main_option_rpipe_path = NULL;
 static gchar *main_option_wpipe_path = NULL;
 static gboolean main_option_pipe = FALSE;
+static gchar *main_option_trace = NULL;
+static gint64 start_time = 0;
 
 static gboolean _print_version_and_exit(const gchar *option_name,
 		const gchar *value, gpointer data, GError **error) {
@@ -124,6 +128,7 @@ static GOptionEntry main_option[] = {
 	{ "pipe", 'p', 0, G_OPTION_ARG_NONE, &main_option_pipe, N_("run in console mode with command and log stream through named pipes"), NULL },
 	{ "inpipe", 'r', 0, G_OPTION_ARG_FILENAME, &main_option_rpipe_path, N_("specify the path for the read pipe, the one receiving commands"), NULL },
 	{ "outpipe", 'w', 0, G_OPTION_ARG_FILENAME, &main_option_wpipe_path, N_("specify the path for the write pipe, the one outputing messages"), NULL },
+	{ "trace", 't', 0, G_OPTION_ARG_FILENAME, &main_option_trace, N_("record the time spent in the processing stages to a Chrome trace JSON file, written on exit"), NULL },
 	{ "format", 'f', G_OPTION_FLAG_NO_ARG, G_OPTION_ARG_CALLBACK, _print_list_of_formats_and_exit, N_("print all supported image file formats (depending on installed libraries)" ), NULL },
 	{ "offline", 'o', G_OPTION_FLAG_NO_ARG, G_OPTION_ARG_CALLBACK, _set_offline, N_("start in offline mode"), NULL },
 	{ "version", 'v', G_OPTION_FLAG_NO_ARG, G_OPTION_ARG_CALLBACK, _print_version_and_exit, N_("print the application’s version"), NULL},
@@ -188,6 +193,9 @@ static void siril_app_activate(GApplication *application) {
 		exit(EXIT_FAILURE);
 	}
 
+	if (main_option_trace)
+		trace_start(main_option_trace);
+
 	if (com.pref.lang)
 		language_init(com.pref.lang);
 
@@ -214,11 +222,9 @@ static void siril_app_activate(GApplication *application) {
 	}
 
 	init_num_procs();
-	initialize_profiles_and_transforms(); // color management
-
-#if defined(HAVE_LIBCURL)
-	curl_global_init(CURL_GLOBAL_ALL);
-#endif
+	cpu_dispatch_init();
+	/* color management and libcurl are initialized on first use */
+	siril_debug_print("siril-cli ready after %.1f ms\n", (g_get_monotonic_time() - start_time) / 1000.0);
 
 	if (main_option_script) {
 		GInputStream *input_stream = NULL;
@@ -327,6 +333,8 @@ int main(int argc, char *argv[]) {
 	const gchar *dir;
 	gint status;
 
+	start_time = g_get_monotonic_time();
+
 #if defined(ENABLE_RELOCATABLE_RESOURCES) && defined(OS_OSX)
 	// Remove macOS session identifier from command line arguments.
 	// Code adopted from GIMP's app/main.c
@@ -61,12 +61,14 @@
 #include "core/command.h"
 #include "core/pipe.h"
 #include "core/signals.h"
+#include "core/trace.h"
 #include "core/siril_app_dirs.h"
 #include "core/siril_language.h"
 #include "core/siril_networking.h"
 #include "core/siril_update.h"
 #include "core/siril_log.h"
 #include "core/OS_utils.h"
+#include "core/cpu_dispatch.h"
 #include "algos/star_finder.h"
 #include "io/sequence.h"
 #include "io/siril_git.h"
@@ -90,6 +92,7 @@ static gchar *main_option_initfile = NULL;
 static gchar *main_option_rpipe_path = NULL;
 static gchar *main_option_wpipe_path = NULL;
 static gboolean main_option_pipe = FALSE;
+static gchar *main_option_trace = NULL;
 
 static gboolean _print_version_and_exit(const gchar *option_name,
 		const gchar *value, gpointer data, GError **error) {
@@ -129,6 +132,7 @@ static GOptionEntry main_option[] = {
 	{ "pipe", 'p', 0, G_OPTION_ARG_NONE, &main_option_pipe, N_("run in console mode with command and log stream through named pipes"), NULL },
 	{ "inpipe", 'r', 0, G_OPTION_ARG_FILENAME, &main_option_rpipe_path, N_("specify the path for the read pipe, the one receiving commands"), NULL },
 	{ "outpipe", 'w', 0, G_OPTION_ARG_FILENAME, &main_option_wpipe_path, N_("specify the path for the write pipe, the one outputing messages"), NULL },
+	{ "trace", 't', 0, G_OPTION_ARG_FILENAME, &main_option_trace, N_("record the time spent in the processing stages to a Chrome trace JSON file, written on exit"), NULL },
 	{ "format", 'f', G_OPTION_FLAG_NO_ARG, G_OPTION_ARG_CALLBACK, _print_list_of_formats_and_exit, N_("print all supported image file formats (depending on installed libraries)" ), NULL },
 	{ "offline", 'o', G_OPTION_FLAG_NO_ARG, G_OPTION_ARG_CALLBACK, _set_offline, N_("start in offline mode"), NULL },
 	{ "version", 'v', G_OPTION_FLAG_NO_ARG, G_OPTION_ARG_CALLBACK, _print_version_and_exit, N_("print the application’s version"), NULL},
@@ -283,6 +287,9 @@ static void siril_app_activate(GApplication *application) {
 		exit(EXIT_FAILURE);
 	}
 
+	if (main_option_trace)
+		trace_start(main_option_trace);
+
 	// After this point com.pref is populated
 	siril_language_parser_init();
 	if (com.pref.lang)
@@ -311,6 +318,7 @@ static void siril_app_activate(GApplication *application) {
 	}
 
 	init_num_procs();
+	cpu_dispatch_init();
 	initialize_profiles_and_transforms(); // color management
 
 #ifdef HAVE_LIBGIT2
@@ -12,6 +12,7 @@
 #include <fitsio.h>
 #include <opencv2/core/core.hpp>
 #include <opencv2/imgproc/imgproc.hpp>
+#include <vector>
 
 using namespace cv;
 /****************************************************************************************\
@@ -77,14 +78,75 @@ void image_crop_params(reg_kombat *templ_in_ref, int sel_w, int sel_h, int full_
 	if (roi.height+roi.y>=full_h) roi.height = full_h - roi.y - 1;
 }
 
+/* For large search areas, the template is first searched on downsampled
+ * images, then the match is refined at each level of the pyramid only around
+ * the position found at the level below. A level is added while the template
+ * keeps at least KOMBAT_MIN_TEMPLATE pixels and the search area at the
+ * coarsest level has more than KOMBAT_MIN_SEARCH positions */
+#define KOMBAT_MAX_LEVELS 4
+#define KOMBAT_MIN_TEMPLATE 16
+#define KOMBAT_MIN_SEARCH (64 * 64)
+/* margin of the search around the position found at the coarser level, in
+ * pixels of the finer level */
+#define KOMBAT_REFINE_RADIUS 3
+#define KOMBAT_MIN_SCORE 0.70
+
 typedef struct {
 	Mat ref_mat;
 	Mat ref_mat_t;
 	Mat result;
 	Rect crop_rect;
+	int levels;
+	std::vector<Mat> templ_pyr;	// templ_pyr[0] is ref_mat_t
 	int ready;
 } kombat_cache;
 
+static int get_pyramid_levels(int templ_w, int templ_h, int results_w, int results_h) {
+	int levels = 0;
+	double search = (double) results_w * results_h;
+	while (levels < KOMBAT_MAX_LEVELS && search > KOMBAT_MIN_SEARCH &&
+			(templ_w >> (levels + 1)) >= KOMBAT_MIN_TEMPLATE &&
+			(templ_h >> (levels + 1)) >= KOMBAT_MIN_TEMPLATE) {
+		levels++;
+		search /= 4.0;
+	}
+	return levels;
+}
+
+/* match the template with its top-left corner in the positions of the search
+ * rectangle, returns the score and the best position in img */
+static double match_in_positions(const Mat &img, const Mat &templ, Rect search, Mat &result, Point &loc) {
+	Rect valid(0, 0, img.cols - templ.cols + 1, img.rows - templ.rows + 1);
+	search &= valid;
+	if (search.width <= 0 || search.height <= 0)
+		return -1.0;
+	Rect roi(search.x, search.y, search.width + templ.cols - 1, search.height + templ.rows - 1);
+	matchTemplate(img(roi), templ, result, TM_CCORR_NORMED);
+	double ignored1, score;
+	Point ignored2;
+	minMaxLoc(result, &ignored1, &score, &ignored2, &loc, Mat());
+	loc += roi.tl();
+	return score;
+}
+
+static double match_with_pyramid(const Mat &im_t, kombat_cache *cache, Point &loc) {
+	std::vector<Mat> im_pyr(cache->levels + 1);
+	im_pyr[0] = im_t;
+	for (int l = 1; l <= cache->levels; l++)
+		pyrDown(im_pyr[l - 1], im_pyr[l]);
+
+	Mat result;
+	const Mat &coarse = im_pyr[cache->levels];
+	double score = match_in_positions(coarse, cache->templ_pyr[cache->levels],
+			Rect(0, 0, coarse.cols, coarse.rows), result, loc);
+	for (int l = cache->levels - 1; l >= 0 && score >= 0.0; l--) {
+		Rect search(loc.x * 2 - KOMBAT_REFINE_RADIUS, loc.y * 2 - KOMBAT_REFINE_RADIUS,
+				2 * KOMBAT_REFINE_RADIUS + 1, 2 * KOMBAT_REFINE_RADIUS + 1);
+		score = match_in_positions(im_pyr[l], cache->templ_pyr[l], search, result, loc);
+	}
+	return score;
+}
+
 int kombat_find_template(int idx, struct registration_args *args, fits *templ, fits *image,  reg_kombat *reg_param, reg_kombat *ref_align, void **vcache)
 {
 	kombat_cache *cache;
@@ -124,6 +186,12 @@ int kombat_find_template(int idx, struct registration_args *args, fits *templ, f
 			results_h =  image->ry - cache->ref_mat_t.rows + 1;
 		}
 		cache->result.create( results_h, results_w, CV_8UC1 );
+		cache->levels = get_pyramid_levels(cache->ref_mat_t.cols,
+				cache->ref_mat_t.rows, results_w, results_h);
+		cache->templ_pyr.resize(cache->levels + 1);
+		cache->templ_pyr[0] = cache->ref_mat_t;
+		for (int l = 1; l <= cache->levels; l++)
+			pyrDown(cache->templ_pyr[l - 1], cache->templ_pyr[l]);
 		cache->ready = 1;
 	}
 
@@ -146,17 +214,21 @@ int kombat_find_template(int idx, struct registration_args *args, fits *templ, f
 	// TODO: image_to_Mat should produce expected result...
 	im.convertTo(im_t, CV_8U);
 
-	matchTemplate( im_t,  cache->ref_mat_t, cache->result, TM_CCORR_NORMED );
-
-    /* few variables to analyse result just computed */
-    double ignored1;
-    double score;
-    Point ignored2;
-    Point matchLoc;
-
     /* score would be the matching score [0 .. 1.0] of pattern in img
          matchLoc.x and matchLoc.y store coordinates of pattern within img. */
-    minMaxLoc( cache->result, &ignored1, &score, &ignored2, &matchLoc, Mat() );
+    double score = -1.0;
+    Point matchLoc;
+
+    if (cache->levels > 0)
+        score = match_with_pyramid(im_t, cache, matchLoc);
+
+    /* full resolution search, also used if the coarse search failed */
+    if (score < KOMBAT_MIN_SCORE) {
+        double ignored1;
+        Point ignored2;
+        matchTemplate( im_t,  cache->ref_mat_t, cache->result, TM_CCORR_NORMED );
+        minMaxLoc( cache->result, &ignored1, &score, &ignored2, &matchLoc, Mat() );
+    }
 
 	reg_param->dx = matchLoc.x;
 	reg_param->dy = matchLoc.y;
@@ -166,7 +238,7 @@ int kombat_find_template(int idx, struct registration_args *args, fits *templ, f
 		reg_param->dy += cache->crop_rect.y;
 	}
 
-	ret = (score<0.70);
+	ret = (score < KOMBAT_MIN_SCORE);
 
 	if (!vcache) delete(cache);
 	return(ret);
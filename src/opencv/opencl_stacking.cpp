@@ -0,0 +1,363 @@
+/*
+ * This file is part of Siril, an astronomy image processor.
+ * Copyright (C) 2005-2011 Francois Meyer (dulle at free.fr)
+ * Copyright (C) 2012-2025 team free-astro (see more in AUTHORS file)
+ * Reference site is https://siril.org
+ *
+ * Siril is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Siril is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Siril. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Stacking of blocks on an OpenCL device, through the OpenCL API of OpenCV.
+ * One work item computes the stack of one pixel of the block, the same way as
+ * the batched rejection of rejection_float.c: the median, or the mean of the
+ * pixels kept by the percentile, sigma or MAD clipping, weighted or not. The
+ * stacks are stored frame-major on the device so that the reads of the work
+ * items are coalesced, and the medians are computed by selection in a copy.
+ * The computations are done in single precision, devices not having to
+ * support double, and the MAD is an exact median instead of the histogram
+ * approximation of the CPU, so the results are not bit-exact with the CPU.
+ *
+ * Only one block is on the device at a time, the other threads keep reading
+ * the next blocks meanwhile. */
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include <climits>
+#include <mutex>
+#include <opencv2/core/core.hpp>
+#include <opencv2/core/ocl.hpp>
+
+#include "core/siril.h"
+#include "core/siril_log.h"
+#include "opencl_stacking.h"
+
+/* rejection codes of the kernel */
+enum {
+	KERNEL_NO_REJEC,
+	KERNEL_PERCENTILE,
+	KERNEL_SIGMA,
+	KERNEL_MAD
+};
+
+static const char *stack_block_source = R"CLC(
+#define KERNEL_NO_REJEC 0
+#define KERNEL_PERCENTILE 1
+#define KERNEL_SIGMA 2
+#define KERNEL_MAD 3
+
+#define AT(f) ((size_t)(f) * npix + p)
+
+/* k-th smallest of the n first values of the stack, which are reordered */
+static float kth_smallest(__global float *w, size_t p, size_t npix, int n, int k) {
+	int l = 0, m = n - 1;
+	while (l < m) {
+		float x = w[AT(k)];
+		int i = l, j = m;
+		do {
+			while (w[AT(i)] < x) i++;
+			while (x < w[AT(j)]) j--;
+			if (i <= j) {
+				float t = w[AT(i)];
+				w[AT(i)] = w[AT(j)];
+				w[AT(j)] = t;
+				i++;
+				j--;
+			}
+		} while (i <= j);
+		if (j < k) l = i;
+		if (k < i) m = j;
+	}
+	return w[AT(k)];
+}
+
+/* median of the n first values of the stack, average of the middle two for
+ * an even n, as quickmedian_float() */
+static float stack_median(__global float *w, size_t p, size_t npix, int n) {
+	if (n == 0)
+		return 0.f;
+	int k = n / 2;
+	float m = kth_smallest(w, p, npix, n, k);
+	if (n & 1)
+		return m;
+	float low = w[AT(0)];
+	for (int i = 1; i < k; i++)
+		low = fmax(low, w[AT(i)]);
+	return 0.5f * (low + m);
+}
+
+static int gather_kept(__global const float *vals, __global const uchar *keep,
+		__global float *w, size_t p, size_t npix, int nb_frames) {
+	int n = 0;
+	for (int f = 0; f < nb_frames; f++) {
+		if (keep[AT(f)]) {
+			w[AT(n)] = vals[AT(f)];
+			n++;
+		}
+	}
+	return n;
+}
+
+__kernel void stack_block(__global const float *pix, int rx, int npix_i, int nb_frames,
+		__global const int *shiftx, __global const float *scale, __global const float *offset,
+		__global const float *weights, int weighted, int rejection, float siglow, float sighigh,
+		int is_mean, __global float *vals, __global float *work, __global uchar *keep,
+		__global float *results, __global int *rej) {
+	size_t npix = npix_i;
+	size_t p = get_global_id(0);
+	if (p >= npix)
+		return;
+	int x = p % rx;
+	size_t line = p - x;
+
+	/* normalized stack, null pixels are not part of it */
+	int N = 0;
+	for (int f = 0; f < nb_frames; f++) {
+		int xx = x - shiftx[f];
+		float v = 0.f;
+		if (xx >= 0 && xx < rx) {
+			v = pix[(size_t) f * npix + line + xx];
+			if (v != 0.f)
+				v = v * scale[f] - offset[f];
+		}
+		vals[AT(f)] = v;
+		keep[AT(f)] = v != 0.f;
+		N += v != 0.f;
+	}
+	rej[2 * p] = rej[2 * p + 1] = 0;
+
+	if (!is_mean) {
+		for (int f = 0; f < nb_frames; f++)
+			work[AT(f)] = vals[AT(f)];
+		results[p] = stack_median(work, p, npix, nb_frames);
+		return;
+	}
+
+	int rlow = 0, rhigh = 0;
+	if (N > 1 && rejection != KERNEL_NO_REJEC) {
+		float median = stack_median(work, p, npix, gather_kept(vals, keep, work, p, npix, nb_frames));
+		if (median == 0.f) {
+			/* stack mostly zero, same as the CPU */
+			for (int f = 0; f < nb_frames; f++)
+				work[AT(f)] = vals[AT(f)];
+			results[p] = stack_median(work, p, npix, nb_frames);
+			return;
+		}
+		if (rejection == KERNEL_PERCENTILE) {
+			for (int f = 0; f < nb_frames; f++) {
+				if (!keep[AT(f)]) continue;
+				float v = vals[AT(f)];
+				if (median - v > median * siglow) {
+					rlow++;
+					keep[AT(f)] = 0;
+				} else if (v - median > median * sighigh) {
+					rhigh++;
+					keep[AT(f)] = 0;
+				}
+			}
+			N -= rlow + rhigh;
+		} else {
+			int firstloop = 1, r = 0, removed;
+			do {
+				float var;
+				if (rejection == KERNEL_SIGMA) {
+					float sum = 0.f, acc = 0.f;
+					for (int f = 0; f < nb_frames; f++)
+						if (keep[AT(f)])
+							sum += vals[AT(f)];
+					float mean = sum / N;
+					for (int f = 0; f < nb_frames; f++) {
+						if (keep[AT(f)]) {
+							float d = vals[AT(f)] - mean;
+							acc += d * d;
+						}
+					}
+					var = sqrt(acc / (N - 1));
+				} else {
+					int n = 0;
+					for (int f = 0; f < nb_frames; f++) {
+						if (keep[AT(f)]) {
+							work[AT(n)] = fabs(vals[AT(f)] - median);
+							n++;
+						}
+					}
+					var = stack_median(work, p, npix, n);
+				}
+
+				if (!firstloop)
+					median = stack_median(work, p, npix, gather_kept(vals, keep, work, p, npix, nb_frames));
+				else firstloop = 0;
+
+				removed = 0;
+				for (int f = 0; f < nb_frames; f++) {
+					if (!keep[AT(f)] || N - r <= 4)
+						continue;	// no more rejections
+					float v = vals[AT(f)];
+					if (median - v > var * siglow) {
+						rlow++;
+						keep[AT(f)] = 0;
+						r++;
+						removed++;
+					} else if (v - median > var * sighigh) {
+						rhigh++;
+						keep[AT(f)] = 0;
+						r++;
+						removed++;
+					}
+				}
+				N -= removed;
+			} while (removed > 0 && N > 3);
+		}
+	}
+
+	/* weighted or plain mean of the kept pixels */
+	float sum = 0.f, norm = 0.f, plain = 0.f;
+	for (int f = 0; f < nb_frames; f++) {
+		if (!keep[AT(f)]) continue;
+		float v = vals[AT(f)];
+		float w = weighted ? weights[f] : 1.f;
+		sum += v * w;
+		norm += w;
+		plain += v;
+	}
+	float result = 0.f;	// only null pixels
+	if (N > 0)
+		result = norm == 0.f ? plain / N : sum / norm;
+	results[p] = result;
+	rej[2 * p] = rlow;
+	rej[2 * p + 1] = rhigh;
+}
+)CLC";
+
+static std::mutex device_mutex;
+
+static const cv::ocl::ProgramSource &stack_block_program() {
+	static const cv::ocl::ProgramSource source(stack_block_source);
+	return source;
+}
+
+gboolean opencl_stacking_rejection_supported(rejection type) {
+	switch (type) {
+	case NO_REJEC:
+	case PERCENTILE:
+	case SIGMA:
+	case MAD:
+		return TRUE;
+	default:
+		return FALSE;
+	}
+}
+
+static int kernel_rejection(rejection type) {
+	switch (type) {
+	case PERCENTILE:
+		return KERNEL_PERCENTILE;
+	case SIGMA:
+		return KERNEL_SIGMA;
+	case MAD:
+		return KERNEL_MAD;
+	default:
+		return KERNEL_NO_REJEC;
+	}
+}
+
+gboolean opencl_stacking_available() {
+	if (!com.pref.opencl_stacking)
+		return FALSE;
+	static gsize checked = 0;
+	static gboolean available = FALSE;
+	if (g_once_init_enter(&checked)) {
+		try {
+			if (cv::ocl::useOpenCL()) {
+				cv::ocl::Kernel kernel("stack_block", stack_block_program());
+				available = !kernel.empty();
+			}
+		} catch (const cv::Exception &e) {
+			siril_debug_print("OpenCL stacking kernel not available: %s\n", e.what());
+		}
+		if (available)
+			siril_log_message(_("Stacking uses the OpenCL device %s\n"),
+					cv::ocl::Device::getDefault().name().c_str());
+		else siril_log_message(_("No OpenCL device can stack, stacking runs on the CPU\n"));
+		g_once_init_leave(&checked, 1);
+	}
+	return available;
+}
+
+int opencl_stack_block(const struct opencl_stack_block *block, float *results, int *rej) {
+	size_t npix = (size_t) block->rx * block->height;
+	int nb_frames = block->nb_frames;
+	if (npix == 0 || nb_frames <= 0 || 2 * npix > INT_MAX ||
+			!opencl_stacking_rejection_supported(block->type_of_rejection))
+		return 1;
+	try {
+		/* the block, the normalized stacks and their copy for the selections,
+		 * the masks of the kept pixels, the results and rejection counts */
+		size_t stack_bytes = npix * nb_frames * sizeof(float);
+		size_t needed = 3 * stack_bytes + npix * nb_frames + npix * (sizeof(float) + 2 * sizeof(int));
+		cv::ocl::Device device = cv::ocl::Device::getDefault();
+		if (stack_bytes > device.maxMemAllocSize() || needed > device.globalMemSize()) {
+			siril_debug_print("block of %zu MB too large for the OpenCL device\n", needed / BYTES_IN_A_MB);
+			return 1;
+		}
+
+		std::lock_guard<std::mutex> lock(device_mutex);
+		cv::ocl::Kernel kernel("stack_block", stack_block_program());
+		if (kernel.empty())
+			return 1;
+
+		cv::Mat frames(nb_frames, (int) npix, CV_32F, (void *) block->pix, block->frame_stride * sizeof(float));
+		float no_weight = 1.f;
+		cv::UMat upix, ushift, uscale, uoffset, uweights;
+		frames.copyTo(upix);
+		cv::Mat(1, nb_frames, CV_32S, (void *) block->shiftx).copyTo(ushift);
+		cv::Mat(1, nb_frames, CV_32F, (void *) block->scale).copyTo(uscale);
+		cv::Mat(1, nb_frames, CV_32F, (void *) block->offset).copyTo(uoffset);
+		if (block->weights)
+			cv::Mat(1, nb_frames, CV_32F, (void *) block->weights).copyTo(uweights);
+		else cv::Mat(1, 1, CV_32F, &no_weight).copyTo(uweights);
+
+		cv::UMat uvals(nb_frames, (int) npix, CV_32F);
+		cv::UMat uwork(nb_frames, (int) npix, CV_32F);
+		cv::UMat ukeep(nb_frames, (int) npix, CV_8U);
+		cv::UMat uresults(1, (int) npix, CV_32F);
+		cv::UMat urej(1, (int) (2 * npix), CV_32S);
+
+		kernel.args(cv::ocl::KernelArg::PtrReadOnly(upix), block->rx, (int) npix, nb_frames,
+				cv::ocl::KernelArg::PtrReadOnly(ushift), cv::ocl::KernelArg::PtrReadOnly(uscale),
+				cv::ocl::KernelArg::PtrReadOnly(uoffset), cv::ocl::KernelArg::PtrReadOnly(uweights),
+				(int) (block->weights != NULL), kernel_rejection(block->type_of_rejection),
+				block->sig[0], block->sig[1], (int) block->is_mean,
+				cv::ocl::KernelArg::PtrWriteOnly(uvals), cv::ocl::KernelArg::PtrReadWrite(uwork),
+				cv::ocl::KernelArg::PtrReadWrite(ukeep), cv::ocl::KernelArg::PtrWriteOnly(uresults),
+				cv::ocl::KernelArg::PtrWriteOnly(urej));
+		size_t global_size = npix;
+		if (!kernel.run(1, &global_size, NULL, true)) {
+			siril_debug_print("OpenCL stacking kernel failed to run\n");
+			return 1;
+		}
+
+		cv::Mat out(1, (int) npix, CV_32F, results);
+		uresults.copyTo(out);
+		if (rej) {
+			cv::Mat out_rej(1, (int) (2 * npix), CV_32S, rej);
+			urej.copyTo(out_rej);
+		}
+	} catch (const cv::Exception &e) {
+		siril_debug_print("OpenCL stacking failed: %s\n", e.what());
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,43 @@
+#ifndef SIRIL_OPENCL_STACKING_H_
+#define SIRIL_OPENCL_STACKING_H_
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "core/siril.h"
+
+/* a block of rows of all frames to stack on the OpenCL device */
+struct opencl_stack_block {
+	const float *pix;	// the rows of the frames, frame_stride pixels apart
+	size_t frame_stride;
+	int nb_frames, rx, height;
+	const int *shiftx;	// horizontal shift of each frame, rx if the frame is not read
+	const float *scale, *offset;	// normalization: a non-null pixel becomes pixel * scale - offset
+	const float *weights;	// weight of each frame, NULL for no weighting
+	rejection type_of_rejection;
+	float sig[2];
+	gboolean is_mean;	// mean with rejection, or median
+};
+
+/* TRUE if the core.opencl_stacking setting is enabled and an OpenCL device can
+ * run the stacking kernel, logged once */
+gboolean opencl_stacking_available();
+
+/* TRUE if the rejection can be run by the kernel */
+gboolean opencl_stacking_rejection_supported(rejection type);
+
+/* stacks the block in results, rx * height pixels, and the low and high
+ * rejection counts of each pixel in rej if not NULL. Returns non-zero if the
+ * block could not be stacked on the device and must be on the CPU */
+int opencl_stack_block(const struct opencl_stack_block *block, float *results, int *rej);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
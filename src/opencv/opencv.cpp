@@ -24,12 +24,14 @@
 #  include <config.h>
 #endif
 #include <assert.h>
+#include <float.h>
 #include <iostream>
 #include <iomanip>
 #include <opencv2/core/core.hpp>
 #include <opencv2/imgproc/imgproc.hpp>
 #include <opencv2/core/version.hpp>
 #include <opencv2/core/matx.hpp>
+#include <opencv2/core/ocl.hpp>
 #define CV_RANSAC FM_RANSAC
 #include <opencv2/calib3d.hpp>
 
@@ -95,18 +97,6 @@ float *fits_to_bgrbgr_float(fits *image) {
 	return bgrbgr;
 }
 
-static BYTE *fits8_to_bgrbgr(fits *image) {
-	size_t ndata = image->rx * image->ry * 3;
-	BYTE *bgrbgr = (BYTE *)malloc(ndata * sizeof(BYTE));
-	if (!bgrbgr) { PRINT_ALLOC_ERR; return NULL; }
-	for (size_t i = 0, j = 0; i < ndata; i += 3, j++) {
-		bgrbgr[i + 0] = (BYTE)image->pdata[BLAYER][j];
-		bgrbgr[i + 1] = (BYTE)image->pdata[GLAYER][j];
-		bgrbgr[i + 2] = (BYTE)image->pdata[RLAYER][j];
-	}
-	return bgrbgr;
-}
-
 /* this prepares input and output images, but lets the input in a non-usable state, beware!
  * the memory consumption of the combination of this and Mat_to_image is O(n) */
 static int image_to_Mat(fits *image, Mat *in, Mat *out, void **bgr, int target_rx, int target_ry) {
@@ -252,36 +242,79 @@ static void init_guide(fits *image, unsigned int target_rx, unsigned int target_
 	}
 }
 
-/* resizes image to the sizes toX * toY, and stores it back in image */
+/* replaces the data of image by the planes in data, of size rx * ry */
+static void set_image_planes(fits *image, void *data, int rx, int ry) {
+	size_t plane = (size_t)rx * ry;
+	int nb_planes = image->naxes[2];
+	if (image->type == DATA_FLOAT) {
+		free(image->fdata);
+		image->fdata = (float *)data;
+		image->fpdata[RLAYER] = image->fdata;
+		image->fpdata[GLAYER] = nb_planes == 3 ? image->fdata + plane : image->fdata;
+		image->fpdata[BLAYER] = nb_planes == 3 ? image->fdata + 2 * plane : image->fdata;
+	} else {
+		free(image->data);
+		image->data = (WORD *)data;
+		image->pdata[RLAYER] = image->data;
+		image->pdata[GLAYER] = nb_planes == 3 ? image->data + plane : image->data;
+		image->pdata[BLAYER] = nb_planes == 3 ? image->data + 2 * plane : image->data;
+	}
+	image->rx = rx;
+	image->ry = ry;
+	image->naxes[0] = image->rx;
+	image->naxes[1] = image->ry;
+	invalidate_stats_from_fit(image);
+}
+
+/* resizes image to the sizes toX * toY, and stores it back in image. The
+ * planes are resized one after the other from the data of the image, OpenCV
+ * resizes each channel alike, so that the colour images do not need to be
+ * converted to interleaved BGR and back */
 int cvResizeGaussian(fits *image, int toX, int toY, int interpolation, gboolean clamp) {
-	Mat in, out;
-	void *bgr = NULL;
-	if (image_to_Mat(image, &in, &out, &bgr, toX, toY))
+	if (image->naxes[2] != 1 && image->naxes[2] != 3) {
+		siril_log_message(_("Images with %ld channels are not supported\n"), image->naxes[2]);
+		return 1;
+	}
+	if (image->type != DATA_USHORT && image->type != DATA_FLOAT)
+		return 1;
+	int nb_planes = image->naxes[2];
+	gboolean is_float = image->type == DATA_FLOAT;
+	int cvtype = is_float ? CV_32FC1 : CV_16UC1;
+	size_t elem_size = is_float ? sizeof(float) : sizeof(WORD);
+	size_t src_plane = (size_t)image->rx * image->ry;
+	size_t dst_plane = (size_t)toX * toY;
+	char *src_data = is_float ? (char *)image->fdata : (char *)image->data;
+	char *dst_data = (char *)calloc(dst_plane * nb_planes, elem_size);
+	if (!dst_data) {
+		PRINT_ALLOC_ERR;
 		return 1;
+	}
 
-	// OpenCV function
-	resize(in, out, out.size(), 0, 0, interpolation);
+	for (int c = 0; c < nb_planes; c++) {
+		Mat in = Mat(image->ry, image->rx, cvtype, src_data + c * src_plane * elem_size);
+		Mat out = Mat(toY, toX, cvtype, dst_data + c * dst_plane * elem_size);
+		// OpenCV function
+		resize(in, out, out.size(), 0, 0, interpolation);
 
-	if ((interpolation == OPENCV_LANCZOS4 || interpolation == OPENCV_CUBIC) && clamp) {
-		Mat guide, tmp1;
-		init_guide(image, toX, toY, &guide);
-		// Create guide image
-		resize(in, guide, out.size(), 0, 0, OPENCV_AREA);
-		tmp1 = (out < CLAMPING_FACTOR * guide);
-		Mat element = getStructuringElement(MORPH_ELLIPSE, Size(3, 3), Point(1,1));
-		dilate(tmp1, tmp1, element);
+		if ((interpolation == OPENCV_LANCZOS4 || interpolation == OPENCV_CUBIC) && clamp) {
+			Mat guide, tmp1;
+			// Create guide image
+			resize(in, guide, out.size(), 0, 0, OPENCV_AREA);
+			tmp1 = (out < CLAMPING_FACTOR * guide);
+			Mat element = getStructuringElement(MORPH_ELLIPSE, Size(3, 3), Point(1,1));
+			dilate(tmp1, tmp1, element);
 
-		copyTo(guide, out, tmp1); // Guide copied to the clamped pixels
-		guide.release();
-		tmp1.release();
+			copyTo(guide, out, tmp1); // Guide copied to the clamped pixels
+		}
 	}
-	return Mat_to_image(image, &in, &out, bgr, toX, toY);
+	set_image_planes(image, dst_data, toX, toY);
+	return 0;
 }
 
 void cvResizeArray(double *in, double *out, int inX, int inY, int outX, int outY) {
 	Mat in_mat(inX, inY, CV_64F, in);
 	Mat out_mat(outX, outY, CV_64F, out);
-	resize(in_mat, out_mat, out_mat.size(), 0, 0);
+	resize(in_mat, out_mat, out_mat.size(), 0, 0, INTER_CUBIC);
 }
 
 // This function is now used only for mod90 rotations w/o interp
@@ -515,40 +548,204 @@ void cvPrepareDrizzleH(Homography *Hom, double scale, int source_rx, int source_
 	convert_MatH_to_H(std::move(H), Hom);
 }
 
+/* The transformations without distortion are computed plane by plane and by
+ * bands of rows, directly on the planar data of the images: no interleaved
+ * copy of the channels is made and the clamping guide and mask of a band stay
+ * in the cache. Interpolation is done by warpPerspective() on each band, with
+ * the homography translated to the rows of the band. The rows of the source a
+ * band needs are given by its corners, as the image of a rectangle is the
+ * quadrilateral of its corners, plus the margin of the interpolation window.
+ * When clamping is enabled, one more row is computed on each side of a band
+ * so that the dilation of the clamping mask is the same as on the whole plane. */
+#define WARP_BAND_HEIGHT 64
+
+/* number of rows around the source position used by the interpolation */
+static int get_interpolation_margin(int interpolation) {
+	switch (interpolation) {
+		case OPENCV_CUBIC:
+			return 2;
+		case OPENCV_LANCZOS4:
+			return 4;
+		default:
+			return 1;
+	}
+}
+
+static gboolean interpolation_is_clamped(int interpolation, gboolean clamp) {
+	return clamp && (interpolation == OPENCV_LANCZOS4 || interpolation == OPENCV_CUBIC);
+}
+
+/* rows of the output actually computed for the rows out_y to out_y + out_h - 1 */
+static void get_band_computed_rows(int target_ry, int out_y, int out_h, gboolean clamped,
+		int *first, int *end) {
+	int extra = clamped ? 1 : 0;
+	*first = std::max(out_y - extra, 0);
+	*end = std::min(out_y + out_h + extra, target_ry);
+}
+
+/* Hinv is the inverse transformation, from the output to the source */
+static void get_band_source_rows(const Mat &Hinv, int target_rx, int source_ry, int first, int end,
+		int interpolation, int *src_y, int *src_h) {
+	const double *h = Hinv.ptr<double>(0);
+	double xs[2] = { 0., target_rx - 1. }, ys[2] = { (double)first, end - 1. };
+	double ymin = DBL_MAX, ymax = -DBL_MAX;
+	for (int i = 0; i < 2; i++) {
+		for (int j = 0; j < 2; j++) {
+			double w = h[6] * xs[i] + h[7] * ys[j] + h[8];
+			double y = (h[3] * xs[i] + h[4] * ys[j] + h[5]) / w;
+			ymin = std::min(ymin, y);
+			ymax = std::max(ymax, y);
+		}
+	}
+	int margin = get_interpolation_margin(interpolation);
+	// bounded before the conversion, for transformations with a large perspective
+	ymin = std::min(std::max(ymin, -1.), (double)source_ry);
+	ymax = std::min(std::max(ymax, -1.), (double)source_ry);
+	int start = std::max((int)floor(ymin) - margin, 0);
+	int stop = std::min((int)floor(ymax) + margin + 1, source_ry);
+	*src_y = start;
+	*src_h = std::max(stop - start, 0);
+}
+
+/* computes the out_h rows from out_y of the output plane in dst, which holds
+ * only these rows, src being the rows of the source plane from src_y and H the
+ * transformation of the whole planes */
+static void warp_band(const Mat &src, int src_y, const Mat &H, Mat &dst, int out_y, int out_h,
+		int target_ry, int interpolation, gboolean clamp) {
+	gboolean clamped = interpolation_is_clamped(interpolation, clamp);
+	int first, end;
+	get_band_computed_rows(target_ry, out_y, out_h, clamped, &first, &end);
+
+	// H expressed in the rows of the source and output bands
+	Mat Tsrc = Mat::eye(3, 3, CV_64FC1);
+	Tsrc.at<double>(1,2) = src_y;
+	Mat Tdst = Mat::eye(3, 3, CV_64FC1);
+	Tdst.at<double>(1,2) = -first;
+	Mat Hband = Tdst * H * Tsrc;
+
+	Mat out = Mat(end - first, dst.cols, dst.type(), Scalar(0));
+	warpPerspective(src, out, Hband, out.size(), interpolation, BORDER_TRANSPARENT);
+	if (clamped) {
+		Mat guide = Mat(out.rows, out.cols, out.type(), Scalar(0));
+		warpPerspective(src, guide, Hband, guide.size(), OPENCV_AREA, BORDER_TRANSPARENT);
+		Mat tmp1 = (out < guide * CLAMPING_FACTOR);
+		Mat element = getStructuringElement( MORPH_ELLIPSE,
+					Size(3, 3), Point(-1,-1));
+		dilate(tmp1, tmp1, element);
+
+		copyTo(guide, out, tmp1); // Guide copied to the clamped pixels
+	}
+	out.rowRange(out_y - first, out_y - first + out_h).copyTo(dst);
+}
+
+/* With the core.opencl setting, the transformations with the interpolations
+ * that OpenCV can run on an OpenCL device are done there, through its
+ * transparent API: each plane is uploaded once, warped and clamped as a whole
+ * on the device, and downloaded in the output. The OpenCL kernels of OpenCV
+ * only handle a constant border, so the pixels whose interpolation window
+ * crosses the border of the source are darkened instead of being computed
+ * from the inner pixels, on the width of the window. Lanczos4 has no OpenCL
+ * kernel and always runs on the CPU. */
+static gboolean transform_on_opencl_device(int interpolation) {
+	if (!com.pref.use_opencl || interpolation == OPENCV_LANCZOS4)
+		return FALSE;
+	static gsize logged = 0;
+	gboolean available = cv::ocl::useOpenCL();
+	if (g_once_init_enter(&logged)) {
+		if (available)
+			siril_log_message(_("Image transformations use the OpenCL device %s\n"),
+					cv::ocl::Device::getDefault().name().c_str());
+		else siril_log_message(_("No OpenCL device available, image transformations run on the CPU\n"));
+		g_once_init_leave(&logged, 1);
+	}
+	return available;
+}
+
+static void warp_plane_opencl(const Mat &src, const Mat &H, Mat &dst, int interpolation, gboolean clamp) {
+	UMat usrc = src.getUMat(ACCESS_READ);
+	UMat out = UMat(dst.rows, dst.cols, dst.type(), Scalar(0));
+	// as on the CPU, area is computed as linear by warpPerspective()
+	int interp = (interpolation == OPENCV_AREA) ? OPENCV_LINEAR : interpolation;
+	warpPerspective(usrc, out, H, out.size(), interp, BORDER_CONSTANT, Scalar(0));
+	if (interpolation_is_clamped(interpolation, clamp)) {
+		UMat guide, scaled, tmp1;
+		warpPerspective(usrc, guide, H, out.size(), OPENCV_LINEAR, BORDER_CONSTANT, Scalar(0));
+		multiply(guide, Scalar(CLAMPING_FACTOR), scaled);
+		compare(out, scaled, tmp1, CMP_LT);
+		Mat element = getStructuringElement( MORPH_ELLIPSE,
+					Size(3, 3), Point(-1,-1));
+		dilate(tmp1, tmp1, element);
+		guide.copyTo(out, tmp1); // Guide copied to the clamped pixels
+	}
+	out.copyTo(dst);
+}
+
+/* transforms all planes of image with H, expressed in the data rows order */
+static int transform_image_planar(fits *image, int target_rx, int target_ry, const Mat &H,
+		int interpolation, gboolean clamp) {
+	int nb_planes = image->naxes[2];
+	gboolean is_float = image->type == DATA_FLOAT;
+	int cvtype = is_float ? CV_32FC1 : CV_16UC1;
+	size_t elem_size = is_float ? sizeof(float) : sizeof(WORD);
+	size_t src_plane = (size_t)image->rx * image->ry;
+	size_t dst_plane = (size_t)target_rx * target_ry;
+	char *src_data = is_float ? (char *)image->fdata : (char *)image->data;
+	char *dst_data = (char *)calloc(dst_plane * nb_planes, elem_size);
+	if (!dst_data) {
+		PRINT_ALLOC_ERR;
+		return 1;
+	}
+	gboolean clamped = interpolation_is_clamped(interpolation, clamp);
+	gboolean on_device = transform_on_opencl_device(interpolation);
+	Mat Hinv = H.inv();  // dst->src
+
+	for (int c = 0; c < nb_planes; c++) {
+		if (on_device) {
+			Mat src = Mat(image->ry, image->rx, cvtype, src_data + c * src_plane * elem_size);
+			Mat dst = Mat(target_ry, target_rx, cvtype, dst_data + c * dst_plane * elem_size);
+			warp_plane_opencl(src, H, dst, interpolation, clamp);
+			continue;
+		}
+		for (int out_y = 0; out_y < target_ry; out_y += WARP_BAND_HEIGHT) {
+			int out_h = std::min(WARP_BAND_HEIGHT, target_ry - out_y);
+			int first, end, src_y, src_h;
+			get_band_computed_rows(target_ry, out_y, out_h, clamped, &first, &end);
+			get_band_source_rows(Hinv, target_rx, image->ry, first, end, interpolation, &src_y, &src_h);
+			if (src_h <= 0)
+				continue;	// outside of the source, left black
+			Mat src = Mat(src_h, image->rx, cvtype,
+					src_data + (c * src_plane + (size_t)src_y * image->rx) * elem_size);
+			Mat dst = Mat(out_h, target_rx, cvtype,
+					dst_data + (c * dst_plane + (size_t)out_y * target_rx) * elem_size);
+			warp_band(src, src_y, H, dst, out_y, out_h, target_ry, interpolation, clamp);
+		}
+	}
+
+	set_image_planes(image, dst_data, target_rx, target_ry);
+	return 0;
+}
+
 // transform an image using the homography.
 int cvTransformImage(fits *image, unsigned int width, unsigned int height, Homography Hom, float scale, int interpolation, gboolean clamp, disto_data *disto) {
 	Mat in, out;
 	void *bgr = NULL;
 	int target_rx = width, target_ry = height;
 
-	if (image_to_Mat(image, &in, &out, &bgr, target_rx, target_ry))
-		return 1;
-
 	Mat H = Mat(3, 3, CV_64FC1);
 	convert_H_to_MatH(&Hom, H);
 	cvPrepareH(H, scale, image->rx, image->ry, target_rx, target_ry);
 
 	// no distortion case
 	if (!disto || (disto->dtype != DISTO_MAP_D2S && disto->dtype != DISTO_D2S)) {
-		// OpenCV function
-		warpPerspective(in, out, H, Size(target_rx, target_ry), interpolation, BORDER_TRANSPARENT);
-		if ((interpolation == OPENCV_LANCZOS4 || interpolation == OPENCV_CUBIC) && clamp) {
-			Mat guide, tmp1;
-			init_guide(image, target_rx, target_ry, &guide);
-			// Create guide image
-			warpPerspective(in, guide, H, Size(target_rx, target_ry), OPENCV_AREA, BORDER_TRANSPARENT);
-			tmp1 = (out < guide * CLAMPING_FACTOR);
-			Mat element = getStructuringElement( MORPH_ELLIPSE,
-						Size(3, 3), Point(-1,-1));
-			dilate(tmp1, tmp1, element);
-
-			copyTo(guide, out, tmp1); // Guide copied to the clamped pixels
-			guide.release();
-			tmp1.release();
-		}
-		return Mat_to_image(image, &in, &out, bgr, target_rx, target_ry);
+		if ((image->naxes[2] != 1 && image->naxes[2] != 3) ||
+				(image->type != DATA_USHORT && image->type != DATA_FLOAT))
+			return 1;
+		return transform_image_planar(image, target_rx, target_ry, H, interpolation, clamp);
 	}
 
+	if (image_to_Mat(image, &in, &out, &bgr, target_rx, target_ry))
+		return 1;
+
 	// distortion case - we need to compute maps to pass to remapping to avoid double interpolation
 	float *xmap, *ymap;
 	Mat Hinv = H.inv();  // dst->src
@@ -583,6 +780,31 @@ int cvTransformImage(fits *image, unsigned int width, unsigned int height, Homog
 	return Mat_to_image(image, &in, &out, bgr, width, height);
 }
 
+/* Transformation of one channel of an image by blocks of rows, used to stack
+ * registered frames without writing them. The rows are counted from the top of
+ * the image, as they are read from the sequences, which is the convention of
+ * the registration homographies, so unlike cvTransformImage() no flip is
+ * needed. */
+void cvTransformBlockSourceRows(Homography Hom, int rx, int ry, int out_y, int out_h,
+		int interpolation, int *src_y, int *src_h) {
+	Mat H = Mat(3, 3, CV_64FC1);
+	convert_H_to_MatH(&Hom, H);
+	int first, end;
+	get_band_computed_rows(ry, out_y, out_h, TRUE, &first, &end);
+	get_band_source_rows(H.inv(), rx, ry, first, end, interpolation, src_y, src_h);
+}
+
+int cvTransformBlock(const void *src, int src_y, int src_h, void *out, int out_y, int out_h,
+		int rx, int ry, data_type type, Homography Hom, int interpolation, gboolean clamp) {
+	int cvtype = (type == DATA_FLOAT) ? CV_32FC1 : CV_16UC1;
+	Mat H = Mat(3, 3, CV_64FC1);
+	convert_H_to_MatH(&Hom, H);
+	Mat in = Mat(src_h, rx, cvtype, (void *) src);
+	Mat dst = Mat(out_h, rx, cvtype, out);
+	warp_band(in, src_y, H, dst, out_y, out_h, ry, interpolation, clamp);
+	return 0;
+}
+
 void cvDownscaleBlendMask(int rx, int ry, int out_rx, int out_ry, uint8_t *maskin, float *maskout) {
 	Mat _maskin = Mat(ry, rx, CV_8U, maskin);
 	Mat _maskindown = Mat(out_ry + 2, out_rx + 2, CV_8U, Scalar(0));
@@ -601,8 +823,8 @@ void cvDownscaleBlendMask(int rx, int ry, int out_rx, int out_ry, uint8_t *maski
 	Mat _maskindownroi = _maskindown(Rect(1, 1, out_rx, out_ry));
 	// we resize
 	resize(_maskin, _maskindownroi, _maskindownroi.size(), 0, 0, INTER_LINEAR);
-	// we compute the distances, it returns a 32b array
-	distanceTransform(_maskindown, _maskoutdown32, DIST_L2, 3, CV_32F);
+	// we compute the exact euclidean distances in linear time, it returns a 32b array
+	distanceTransform(_maskindown, _maskoutdown32, DIST_L2, DIST_MASK_PRECISE, CV_32F);
 	Mat _maskoutdownroi = _maskoutdown32(Rect(1, 1, out_rx, out_ry));
 	_maskoutdownroi.copyTo(_maskout);
 }
@@ -689,210 +911,6 @@ int cvGuidedFilter(fits* image, fits *guide, double r, double eps) {
 	return Mat_to_image(image, &in, &out, bgr, image->rx, image->ry);
 }
 
-/* Work on grey images. If image is in RGB it must be first converted
- * in CieLAB. Then, only the first channel is applied
- */
-static int cvClahe_ushort(fits *image, double clip_limit, int size) {
-	assert(image->data);
-	assert(image->rx);
-	assert(image->ry);
-
-	// preparing data
-	Mat in, out;
-
-	Ptr<CLAHE> clahe = createCLAHE();
-	clahe->setClipLimit(clip_limit);
-	clahe->setTilesGridSize(Size(size, size));
-
-	if (image->naxes[2] == 3) {
-		Mat lab_image;
-		std::vector<Mat> lab_planes(3);
-		BYTE *bgrbgr8;
-		WORD *bgrbgr;
-
-		switch (image->bitpix) {
-			case BYTE_IMG:
-				bgrbgr8 = fits8_to_bgrbgr(image);
-				in = Mat(image->ry, image->rx, CV_8UC3, bgrbgr8);
-				out = Mat();
-				// convert the RGB color image to Lab
-				cvtColor(in, lab_image, COLOR_BGR2Lab);
-
-				// Extract the L channel
-				split(lab_image, lab_planes); // now we have the L image in lab_planes[0]
-
-				// apply the CLAHE algorithm to the L channel
-				clahe->apply(lab_planes[0], lab_planes[0]);
-
-				// Merge the color planes back into an Lab image
-				merge(lab_planes, lab_image);
-
-				// convert back to RGB
-				cvtColor(lab_image, out, COLOR_Lab2BGR);
-				out.convertTo(out, CV_16UC3, 1.0);
-
-				free(bgrbgr8);
-				break;
-			default:
-			case USHORT_IMG:
-				bgrbgr = fits_to_bgrbgr_ushort(image);
-				in = Mat(image->ry, image->rx, CV_16UC3, bgrbgr);
-				in.convertTo(in, CV_32F, 1.0 / USHRT_MAX_DOUBLE);
-				out = Mat();
-
-				// convert the RGB color image to Lab
-				cvtColor(in, lab_image, COLOR_BGR2Lab);
-
-				// Extract the L channel
-				split(lab_image, lab_planes); // now we have the L image in lab_planes[0]
-
-				// apply the CLAHE algorithm to the L channel (does not work with 32F images)
-				lab_planes[0].convertTo(lab_planes[0], CV_16U,	USHRT_MAX_DOUBLE / 100.0);
-				clahe->apply(lab_planes[0], lab_planes[0]);
-				lab_planes[0].convertTo(lab_planes[0], CV_32F, 100.0 / USHRT_MAX_DOUBLE);
-
-				// Merge the color planes back into an Lab image
-				merge(lab_planes, lab_image);
-
-				// convert back to RGB
-				cvtColor(lab_image, out, COLOR_Lab2BGR);
-				out.convertTo(out, CV_16UC3, USHRT_MAX_DOUBLE);
-
-				free(bgrbgr);
-		}
-
-	} else {
-		in = Mat(image->ry, image->rx, CV_16UC1, image->data);
-		out = Mat();
-		switch (image->bitpix) {
-			case BYTE_IMG:
-				in.convertTo(in, CV_8U, 1.0);
-				clahe->apply(in, out);
-				out.convertTo(out, CV_16UC1, 1.0);
-				// dynamic range is important with CLAHE, use 16 bits output
-				break;
-			default:
-			case USHORT_IMG:
-				clahe->apply(in, out);
-		}
-	}
-
-	std::vector<Mat> channel(3);
-	split(out, channel);
-
-	size_t nbpixels = image->naxes[0] * image->naxes[1];
-	size_t ndata = nbpixels * sizeof(WORD);
-	if (image->naxes[2] == 3) {
-		memcpy(image->data, channel[2].data, ndata);
-		memcpy(image->data + nbpixels, channel[1].data, ndata);
-		memcpy(image->data + nbpixels * 2, channel[0].data, ndata);
-		image->pdata[RLAYER] = image->data;
-		image->pdata[GLAYER] = image->data + nbpixels;
-		image->pdata[BLAYER] = image->data + nbpixels * 2;
-	} else {
-		memcpy(image->data, channel[0].data, ndata);
-		image->pdata[RLAYER] = image->data;
-		image->pdata[GLAYER] = image->data;
-		image->pdata[BLAYER] = image->data;
-	}
-
-	image->rx = out.cols;
-	image->ry = out.rows;
-	image->naxes[0] = image->rx;
-	image->naxes[1] = image->ry;
-
-	invalidate_stats_from_fit(image);
-
-	return 0;
-}
-
-static int cvClahe_float(fits *image, double clip_limit, int size) {
-	assert(image->fdata);
-	assert(image->rx);
-	assert(image->ry);
-
-	// preparing data
-	Mat in, out;
-
-	Ptr<CLAHE> clahe = createCLAHE();
-	clahe->setClipLimit(clip_limit);
-	clahe->setTilesGridSize(Size(size, size));
-
-	if (image->naxes[2] == 3) {
-		Mat lab_image;
-		std::vector<Mat> lab_planes(3);
-		float *bgrbgr;
-
-		bgrbgr = fits_to_bgrbgr_float(image);
-		in = Mat(image->ry, image->rx, CV_32FC3, bgrbgr);
-		out = Mat();
-
-		// convert the RGB color image to Lab
-		cvtColor(in, lab_image, COLOR_BGR2Lab);
-
-		// Extract the L channel
-		split(lab_image, lab_planes); // now we have the L image in lab_planes[0]
-
-		// apply the CLAHE algorithm to the L channel (does not work with 32F images)
-		lab_planes[0].convertTo(lab_planes[0], CV_16U, USHRT_MAX_DOUBLE / 100.0);
-		clahe->apply(lab_planes[0], lab_planes[0]);
-		lab_planes[0].convertTo(lab_planes[0], CV_32F, 100.0 / USHRT_MAX_DOUBLE);
-
-		// Merge the color planes back into an Lab image
-		merge(lab_planes, lab_image);
-
-		// convert back to RGB
-		cvtColor(lab_image, out, COLOR_Lab2BGR);
-		out.convertTo(out, CV_32FC3, 1.0);
-
-		free(bgrbgr);
-
-	} else {
-		in = Mat(image->ry, image->rx, CV_32FC1, image->fdata);
-		out = Mat();
-
-		in.convertTo(in, CV_16U, USHRT_MAX_DOUBLE);
-		clahe->apply(in, out);
-		out.convertTo(out, CV_32F, 1.0 / USHRT_MAX_DOUBLE);
-	}
-
-	std::vector<Mat> channel(3);
-	split(out, channel);
-
-	size_t nbpixels = image->naxes[0] * image->naxes[1];
-	size_t ndata = nbpixels * sizeof(float);
-	if (image->naxes[2] == 3) {
-		memcpy(image->fdata, channel[2].data, ndata);
-		memcpy(image->fdata + nbpixels, channel[1].data, ndata);
-		memcpy(image->fdata + nbpixels * 2, channel[0].data, ndata);
-		image->fpdata[RLAYER] = image->fdata;
-		image->fpdata[GLAYER] = image->fdata + nbpixels;
-		image->fpdata[BLAYER] = image->fdata + nbpixels * 2;
-	} else {
-		memcpy(image->fdata, channel[0].data, ndata);
-		image->fpdata[RLAYER] = image->fdata;
-		image->fpdata[GLAYER] = image->fdata;
-		image->fpdata[BLAYER] = image->fdata;
-	}
-
-	image->rx = out.cols;
-	image->ry = out.rows;
-	image->naxes[0] = image->rx;
-	image->naxes[1] = image->ry;
-
-	invalidate_stats_from_fit(image);
-
-	return 0;
-}
-
-int cvClahe(fits *image, double clip_limit, int size) {
-	if (image->type == DATA_USHORT)
-		return cvClahe_ushort(image, clip_limit, size);
-	if (image->type == DATA_FLOAT)
-		return cvClahe_float(image, clip_limit, size);
-	return -1;
-}
-
 // https://igl.ethz.ch/projects/ARAP/svd_rot.pdf
 double cvCalculRigidTransform(s_star *star_array_in,
 		struct s_star *star_array_out, int n, Homography *Hom) {
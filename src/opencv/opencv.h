@@ -32,6 +32,13 @@ unsigned char *cvCalculH(s_star *star_array_img,
 
 
 int cvTransformImage(fits *image, unsigned int width, unsigned int height, Homography Hom, float scale, int interpolation, gboolean clamp, disto_data *disto);
+/* transformation by blocks of rows counted from the top of the image: the
+ * first gives the rows of the source needed for the output rows, the second
+ * computes the output rows from them as cvTransformImage() would */
+void cvTransformBlockSourceRows(Homography Hom, int rx, int ry, int out_y, int out_h,
+		int interpolation, int *src_y, int *src_h);
+int cvTransformBlock(const void *src, int src_y, int src_h, void *out, int out_y, int out_h,
+		int rx, int ry, data_type type, Homography Hom, int interpolation, gboolean clamp);
 
 void cvDownscaleBlendMask(int rx, int ry, int out_rx, int out_ry, uint8_t *maskin, float *maskout);
 void cvUpscaleBlendMask(int rx, int ry, int out_rx, int out_ry, float *maskin, float *maskout);
@@ -42,7 +49,6 @@ int cvBilateralFilter(fits* image, double d, double sigma_col, double sigma_spat
 
 int cvGuidedFilter(fits* image, fits *guide, double r, double eps);
 
-int cvClahe(fits *image, double clip_limit, int size);
 
 void cvTransformImageRefPoint(Homography Hom, point refpointin, point *refpointout);
 
@@ -489,7 +489,115 @@ static void update_metadata(fits *fit, gboolean do_sum) {
 	free(f);
 }
 
-static gchar* parse_image_functions(gpointer p, int idx, int c) {
+/* statistics of the images used by the image functions, computed once for
+ * all the expressions. Index nb_rows is the current image */
+struct image_stats_cache {
+	imstats *stats[MAX_IMAGES + 1][3];
+	gboolean failed;
+};
+
+struct image_function_context {
+	struct pixel_math_data *args;
+	struct image_stats_cache *cache;
+	fits *current;	// the image of $T, its functions are left unchanged if NULL
+	int channel;
+	threading_type threads;
+};
+
+static void free_image_stats_cache(struct image_stats_cache *cache) {
+	for (int i = 0; i < MAX_IMAGES + 1; i++)
+		for (int c = 0; c < 3; c++)
+			free_stats(cache->stats[i][c]);
+	memset(cache, 0, sizeof(struct image_stats_cache));
+}
+
+static gboolean replace_image_function(const GMatchInfo *match_info, GString *result, gpointer user_data) {
+	struct image_function_context *ctx = (struct image_function_context *) user_data;
+	struct pixel_math_data *args = ctx->args;
+	gchar *match = g_match_info_fetch(match_info, 0);
+	gchar *function = g_match_info_fetch(match_info, 1);
+	gchar *param = g_match_info_fetch(match_info, 2);
+
+	int image = -1;
+	fits *fit = NULL;
+	if (g_strcmp0(param, T_CURRENT) == 0) {
+		image = args->nb_rows;
+		fit = ctx->current;
+	} else {
+		for (int j = 0; j < args->nb_rows; j++) {
+			if (g_strcmp0(param, args->varname[j]) == 0) {
+				image = j;
+				fit = &var_fit[j];
+			}
+		}
+	}
+
+	gchar *replace = NULL;
+	if (fit) {
+		if (!g_strcmp0(function, "width") || !g_strcmp0(function, "w")) {
+			replace = g_strdup_printf("%g", (double) fit->rx);
+		} else if (!g_strcmp0(function, "height") || !g_strcmp0(function, "h")) {
+			replace = g_strdup_printf("%g", (double) fit->ry);
+		} else if (!ctx->cache->failed) {
+			const char *names[] = { "mean", "med", "median", "min", "max", "noise", "adev", "bwmv", "mad", "mdev", "sdev" };
+			gboolean is_stat = FALSE;
+			for (int i = 0; i < G_N_ELEMENTS(names); i++)
+				if (!g_strcmp0(function, names[i]))
+					is_stat = TRUE;
+			imstats **stats = &ctx->cache->stats[image][ctx->channel];
+			if (is_stat && !*stats) {
+				*stats = statistics(NULL, -1, fit, ctx->channel, NULL, STATS_MAIN, ctx->threads);
+				if (!*stats)
+					ctx->cache->failed = TRUE;
+			}
+			if (is_stat && *stats) {
+				double value = 0.0;
+				if (!g_strcmp0(function, "mean")) {
+					value = (*stats)->mean;
+				} else if (!g_strcmp0(function, "med") || !g_strcmp0(function, "median")) {
+					value = (*stats)->median;
+				} else if (!g_strcmp0(function, "min")) {
+					value = (*stats)->min;
+				} else if (!g_strcmp0(function, "max")) {
+					value = (*stats)->max;
+				} else if (!g_strcmp0(function, "noise")) {
+					value = (*stats)->bgnoise;
+				} else if (!g_strcmp0(function, "adev")) {
+					value = (*stats)->avgDev;
+				} else if (!g_strcmp0(function, "bwmv")) {
+					value = (*stats)->sqrtbwmv * (*stats)->sqrtbwmv;
+				} else if (!g_strcmp0(function, "mad") || !g_strcmp0(function, "mdev")) {
+					value = (*stats)->mad;
+				} else if (!g_strcmp0(function, "sdev")) {
+					value = (*stats)->sigma;
+				}
+				replace = g_strdup_printf("%g", value);
+			}
+		}
+	}
+
+	// other functions, such as sqrt(x), are left unchanged
+	g_string_append(result, replace ? replace : match);
+	g_free(replace);
+	g_free(match);
+	g_free(function);
+	g_free(param);
+	return FALSE;
+}
+
+/* Returns a copy of the expression where the image functions are replaced by
+ * their values for the channel c. Each match is replaced by its own value and
+ * the statistics of an image are computed only once while the cache is kept */
+static gchar *replace_image_functions(const gchar *expression, struct pixel_math_data *args, fits *current,
+		int c, struct image_stats_cache *cache, threading_type threads) {
+	GRegex *regex = g_regex_new("(\\w+)\\((\\w+)\\)", 0, 0, NULL);
+	struct image_function_context ctx = { args, cache, current, c, threads };
+	gchar *replaced = g_regex_replace_eval(regex, expression, -1, 0, 0, replace_image_function, &ctx, NULL);
+	g_regex_unref(regex);
+	return replaced;
+}
+
+static gchar* parse_image_functions(gpointer p, int idx, int c, struct image_stats_cache *cache) {
 	struct pixel_math_data *args = (struct pixel_math_data*) p;
 
 	gchar *expression;
@@ -512,104 +620,14 @@ static gchar* parse_image_functions(gpointer p, int idx, int c) {
 	if (!expression)
 		return expression;
 
-	GRegex *regex = g_regex_new("(\\w+)\\((\\w+)\\)", 0, 0, NULL);
-	GMatchInfo *match_info;
-
-	g_regex_match(regex, expression, 0, &match_info);
-	while (g_match_info_matches(match_info)) {
-		gchar *function = g_match_info_fetch(match_info, 1);
-		gchar *param = g_match_info_fetch(match_info, 2);
-
-		double median = 0.0, mean = 0.0, min = 0.0, max = 0.0, noise = 0.0, adev = 0.0, bwmv = 0.0, mad = 0.0, sdev = 0.0;
-		double w = 0.0, h = 0.0;
-		imstats *stats = NULL;
-
-		if (g_strcmp0(param, T_CURRENT) == 0) {
-			stats = statistics(NULL, -1, &gfit, c, NULL, STATS_MAIN, MULTI_THREADED);
-			if (!stats) return expression;
-
-			median = stats->median;
-			mean = stats->mean;
-			min = stats->min;
-			max = stats->max;
-			noise = stats->bgnoise;
-			adev = stats->avgDev;
-			bwmv = stats->sqrtbwmv * stats->sqrtbwmv;
-			mad = stats->mad;
-			sdev = stats->sigma;
-
-			w = (double) gfit.rx;
-			h = (double) gfit.ry;
-
-			free_stats(stats);
-		} else {
-			for (int j = 0; j < nb_images; j++) {
-				if (g_strcmp0(param, image[j]) == 0) {
-					stats = statistics(NULL, -1, &var_fit[j], c, NULL, STATS_MAIN, MULTI_THREADED);
-					if (!stats) return expression;
-
-					median = stats->median;
-					mean = stats->mean;
-					min = stats->min;
-					max = stats->max;
-					noise = stats->bgnoise;
-					adev = stats->avgDev;
-					bwmv = stats->sqrtbwmv * stats->sqrtbwmv;
-					mad = stats->mad;
-					sdev = stats->sigma;
-
-					w = (double) var_fit[j].rx;
-					h = (double) var_fit[j].ry;
-
-					free_stats(stats);
-				}
-			}
-		}
-
-		gchar *replace = NULL;
-		if (!g_strcmp0(function, "mean")) {
-			replace = g_strdup_printf("%g", mean);
-		} else if (!g_strcmp0(function, "med") || !g_strcmp0(function, "median")) {
-			replace = g_strdup_printf("%g", median);
-		} else if (!g_strcmp0(function, "min")) {
-			replace = g_strdup_printf("%g", min);
-		} else if (!g_strcmp0(function, "max")) {
-			replace = g_strdup_printf("%g", max);
-		} else if (!g_strcmp0(function, "noise")) {
-			replace = g_strdup_printf("%g", noise);
-		} else if (!g_strcmp0(function, "adev")) {
-			replace = g_strdup_printf("%g", adev);
-		} else if (!g_strcmp0(function, "bwmv")) {
-			replace = g_strdup_printf("%g", bwmv);
-		} else if (!g_strcmp0(function, "mad") || !g_strcmp0(function, "mdev")) {
-			replace = g_strdup_printf("%g", mad);
-		} else if (!g_strcmp0(function, "sdev")) {
-			replace = g_strdup_printf("%g", sdev);
-		} else if (!g_strcmp0(function, "width") || !g_strcmp0(function, "w")) {
-			replace = g_strdup_printf("%g", w);
-		} else if (!g_strcmp0(function, "height") || !g_strcmp0(function, "h")) {
-			replace = g_strdup_printf("%g", h);
-		}
-
-		if (replace) {
-#if GLIB_CHECK_VERSION(2, 74, 0)
-			expression = g_regex_replace_literal(regex, expression, -1, 0, replace, G_REGEX_MATCH_DEFAULT, NULL);
-#else
-			// Use an alternative flag or no flag if G_REGEX_MATCH_DEFAULT is not available
-			expression = g_regex_replace_literal(regex, expression, -1, 0, replace, 0, NULL);
-#endif
-			g_free(replace);
-			siril_debug_print("Expression%d: %s\n", c, expression);
-		}
-
-		g_free(function);
-		g_free(param);
-		g_match_info_next(match_info, NULL);
+	gchar *replaced = replace_image_functions(expression, args, &gfit, c, cache, MULTI_THREADED);
+	if (replaced) {
+		if (g_strcmp0(replaced, expression))
+			siril_debug_print("Expression%d: %s\n", c, replaced);
+		g_free(expression);
+		expression = replaced;
 	}
 
-	g_match_info_free(match_info);
-	g_regex_unref(regex);
-
 	for (int j = 0; j < nb_images; j++) {
 		const gchar *test = g_strrstr(expression, image[j]);
 		if (test) {
@@ -621,6 +639,50 @@ static gchar* parse_image_functions(gpointer p, int idx, int c) {
 	return expression;
 }
 
+/* stores the n values of a block in the 16-bit or in the 32-bit result and
+ * updates its range, used if the result is rescaled */
+static void store_block(const float *values, int n, WORD *wdst, float *fdst, float *minimum, float *maximum) {
+	float lo = *minimum, hi = *maximum;
+	if (wdst) {
+		for (int i = 0; i < n; i++) {
+			wdst[i] = roundf_to_WORD(values[i] * USHRT_MAX_SINGLE);
+			hi = max(hi, wdst[i]);
+			lo = min(lo, wdst[i]);
+		}
+	} else {
+		for (int i = 0; i < n; i++) {
+			fdst[i] = values[i];
+			hi = max(hi, fdst[i]);
+			lo = min(lo, fdst[i]);
+		}
+	}
+	*minimum = lo;
+	*maximum = hi;
+}
+
+/* rescales the result from [minimum, maximum] to [low, high], low and high
+ * being normalized values */
+static void rescale_result(fits *fit, float low, float high, float minimum, float maximum, gboolean multithreaded) {
+	const size_t n = fit->naxes[0] * fit->naxes[1] * fit->naxes[2];
+	if (fit->type == DATA_USHORT) {
+		low *= USHRT_MAX_SINGLE;
+		high *= USHRT_MAX_SINGLE;
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(com.max_thread) schedule(static) if (multithreaded)
+#endif
+		for (size_t i = 0; i < n; i++) {
+			fit->data[i] = roundf_to_WORD((float)(high - low) * (float)(fit->data[i] - minimum) / (float)(maximum - minimum) + low);
+		}
+	} else {
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(com.max_thread) schedule(static) if (multithreaded)
+#endif
+		for (size_t i = 0; i < n; i++) {
+			fit->fdata[i] = (((high - low) * (fit->fdata[i] - minimum)) / (maximum - minimum)) + low;
+		}
+	}
+}
+
 gpointer apply_pixel_math_operation(gpointer p) {
 	struct pixel_math_data *args = (struct pixel_math_data *)p;
 
@@ -632,19 +694,21 @@ gpointer apply_pixel_math_operation(gpointer p) {
 	float maximum = -FLT_MAX;
 	float minimum = +FLT_MAX;
 
+	struct image_stats_cache stats_cache = { 0 };
 	if (args->single_rgb && args->fit->naxes[2] > 1) {
 		// No need to null check these two as they will be NULL if args->single_rgb is TRUE
 		args->expression2 = g_strdup(args->expression1);
 		args->expression3 = g_strdup(args->expression1);
 
-		args->expression1 = parse_image_functions(args, 1, RLAYER);
-		args->expression2 = parse_image_functions(args, 2, GLAYER);
-		args->expression3 = parse_image_functions(args, 3, BLAYER);
+		args->expression1 = parse_image_functions(args, 1, RLAYER, &stats_cache);
+		args->expression2 = parse_image_functions(args, 2, GLAYER, &stats_cache);
+		args->expression3 = parse_image_functions(args, 3, BLAYER, &stats_cache);
 	} else {
-		args->expression1 = parse_image_functions(args, 1, RLAYER);
-		args->expression2 = parse_image_functions(args, 2, RLAYER);
-		args->expression3 = parse_image_functions(args, 3, RLAYER);
+		args->expression1 = parse_image_functions(args, 1, RLAYER, &stats_cache);
+		args->expression2 = parse_image_functions(args, 2, RLAYER, &stats_cache);
+		args->expression3 = parse_image_functions(args, 3, RLAYER, &stats_cache);
 	}
+	free_image_stats_cache(&stats_cache);
 
 #ifdef _OPENMP
 #pragma omp parallel num_threads(com.max_thread) firstprivate(n1,n2,n3)
@@ -653,6 +717,7 @@ gpointer apply_pixel_math_operation(gpointer p) {
 		// we build the expressions in parallel because tr_eval() is not thread-safe
 		int k = 0;
 		if (args->has_gfit) k = 1;
+		te_program *p1 = NULL, *p2 = NULL, *p3 = NULL;
 		te_variable *vars = malloc((nb_rows + k) * sizeof(te_variable));
 		double *x = malloc((nb_rows + k) * sizeof(double));
 		if (!vars || !x) {
@@ -703,84 +768,56 @@ gpointer apply_pixel_math_operation(gpointer p) {
 				goto failure;
 			}
 		}
-		if (com.pref.force_16bit) {
+		/* the expressions are evaluated on blocks of pixels of a layer */
+		p1 = te_program_new(n1, vars, nb_rows + k);
+		if (args->expression2) {
+			p2 = te_program_new(n2, vars, nb_rows + k);
+			p3 = te_program_new(n3, vars, nb_rows + k);
+		}
+		if (!p1 || (args->expression2 && (!p2 || !p3))) {
+			PRINT_ALLOC_ERR;
+			failed = TRUE;
+			goto failure;
+		}
+		const size_t layersize = var_fit[0].naxes[0] * var_fit[0].naxes[1];
+		const size_t nb_blocks = (layersize + TE_BLOCK - 1) / TE_BLOCK;
+		const float *in[MAX_IMAGES + 1];
+		float out[3][TE_BLOCK];
 #ifdef _OPENMP
 #pragma omp for schedule(static) reduction(max:maximum) reduction(min:minimum)
 #endif
-			for (size_t px = 0; px < var_fit[0].naxes[0] * var_fit[0].naxes[1] * var_fit[0].naxes[2]; px++) {
-				/* The variables can be changed here, and eval can be called as many
-				 * times as you like. This is fairly efficient because the parsing has
-				 * already been done. */
-				for (int i = 0; i < nb_rows; i++) {
-					x[i] = (double) var_fit[i].fdata[px];
-				}
-				if (args->has_gfit) {
-					x[nb_rows] = (double) gfit.fdata[px];
-				}
-
-				if (!args->single_rgb) { // in that case var_fit[0].naxes[2] == 1, but we built RGB
-					fit->pdata[RLAYER][px] =  roundf_to_WORD((float) te_eval(n1) * USHRT_MAX_SINGLE);
-					fit->pdata[GLAYER][px] =  roundf_to_WORD((float) te_eval(n2) * USHRT_MAX_SINGLE);
-					fit->pdata[BLAYER][px] =  roundf_to_WORD((float) te_eval(n3) * USHRT_MAX_SINGLE);
-
-					/* may not be used but (only if rescale) at least it is computed */
-					maximum = max(maximum, max(fit->pdata[RLAYER][px], max(fit->pdata[GLAYER][px], fit->pdata[BLAYER][px])));
-					minimum = min(minimum, min(fit->pdata[RLAYER][px], min(fit->pdata[GLAYER][px], fit->pdata[BLAYER][px])));
-				} else {
-					if (px < (var_fit[0].naxes[0] * var_fit[0].naxes[1])) {
-						fit->data[px] =  roundf_to_WORD((float) te_eval(n1) * USHRT_MAX_SINGLE);
-					} else if (px < 2 * (var_fit[0].naxes[0] * var_fit[0].naxes[1])) {
-						fit->data[px] =  roundf_to_WORD((float) te_eval(n2) * USHRT_MAX_SINGLE);
-					} else {
-						fit->data[px] =  roundf_to_WORD((float) te_eval(n3) * USHRT_MAX_SINGLE);
-					}
-
-					/* may not be used but (only if rescale) at least it is computed */
-					maximum = max(maximum, fit->data[px]);
-					minimum = min(minimum, fit->data[px]);
-				}
+		for (size_t blk = 0; blk < nb_blocks * var_fit[0].naxes[2]; blk++) {
+			const size_t layer = blk / nb_blocks;
+			const size_t px = layer * layersize + (blk % nb_blocks) * TE_BLOCK;
+			const int n = (int) min((size_t) TE_BLOCK, (layer + 1) * layersize - px);
+			for (int i = 0; i < nb_rows; i++) {
+				in[i] = var_fit[i].fdata + px;
+			}
+			if (args->has_gfit) {
+				in[nb_rows] = gfit.fdata + px;
 			}
 
-		} else {
-#ifdef _OPENMP
-#pragma omp for schedule(static) reduction(max:maximum) reduction(min:minimum)
-#endif
-			for (size_t px = 0; px < var_fit[0].naxes[0] * var_fit[0].naxes[1] * var_fit[0].naxes[2]; px++) {
-				/* The variables can be changed here, and eval can be called as many
-				 * times as you like. This is fairly efficient because the parsing has
-				 * already been done. */
-				for (int i = 0; i < nb_rows; i++) {
-					x[i] = var_fit[i].fdata[px];
-				}
-				if (args->has_gfit) {
-					x[nb_rows] = gfit.fdata[px];
-				}
-
-				if (!args->single_rgb) { // in that case var_fit[0].naxes[2] == 1, but we built RGB
-					fit->fpdata[RLAYER][px] = (float) te_eval(n1);
-					fit->fpdata[GLAYER][px] = (float) te_eval(n2);
-					fit->fpdata[BLAYER][px] = (float) te_eval(n3);
-
-					/* may not be used but (only if rescale) at least it is computed */
-					maximum = max(maximum, max(fit->fpdata[RLAYER][px], max(fit->fpdata[GLAYER][px], fit->fpdata[BLAYER][px])));
-					minimum = min(minimum, min(fit->fpdata[RLAYER][px], min(fit->fpdata[GLAYER][px], fit->fpdata[BLAYER][px])));
-				} else {
-					if (px < (var_fit[0].naxes[0] * var_fit[0].naxes[1])) {
-						fit->fdata[px] = (float) te_eval(n1);
-					} else if (px < 2 * (var_fit[0].naxes[0] * var_fit[0].naxes[1])) {
-						fit->fdata[px] = (float) te_eval(n2);
-					} else {
-						fit->fdata[px] = (float) te_eval(n3);
-					}
-
-					/* may not be used but (only if rescale) at least it is computed */
-					maximum = max(maximum, fit->fdata[px]);
-					minimum = min(minimum, fit->fdata[px]);
+			if (!args->single_rgb) { // in that case var_fit[0].naxes[2] == 1, but we built RGB
+				te_program_eval(p1, in, n, out[RLAYER]);
+				te_program_eval(p2, in, n, out[GLAYER]);
+				te_program_eval(p3, in, n, out[BLAYER]);
+				for (int c = 0; c < 3; c++) {
+					if (com.pref.force_16bit)
+						store_block(out[c], n, fit->pdata[c] + px, NULL, &minimum, &maximum);
+					else store_block(out[c], n, NULL, fit->fpdata[c] + px, &minimum, &maximum);
 				}
+			} else {
+				te_program_eval(layer == 0 ? p1 : layer == 1 ? p2 : p3, in, n, out[0]);
+				if (com.pref.force_16bit)
+					store_block(out[0], n, fit->data + px, NULL, &minimum, &maximum);
+				else store_block(out[0], n, NULL, fit->fdata + px, &minimum, &maximum);
 			}
 		}
 
 failure: // failure before the eval loop
+		te_program_free(p1);
+		te_program_free(p2);
+		te_program_free(p3);
 		te_free(n1);
 		if (args->expression2) {
 			te_free(n2);
@@ -790,25 +827,8 @@ failure: // failure before the eval loop
 		free(x);
 	} // end of parallel block
 
-	if (args->rescale) {
-		if (com.pref.force_16bit) {
-			args->min *= USHRT_MAX_SINGLE;
-			args->max *= USHRT_MAX_SINGLE;
-#ifdef _OPENMP
-#pragma omp parallel for num_threads(com.max_thread) schedule(static)
-#endif
-			for (int i = 0; i < fit->rx * fit->ry * fit->naxes[2]; i++) {
-				fit->data[i] = roundf_to_WORD((float)(args->max - args->min) * (float)(fit->data[i] - minimum) / (float)(maximum - minimum) + args->min);
-			}
-		} else {
-#ifdef _OPENMP
-#pragma omp parallel for num_threads(com.max_thread) schedule(static)
-#endif
-			for (int i = 0; i < fit->rx * fit->ry * fit->naxes[2]; i++) {
-				fit->fdata[i] = (((args->max - args->min) * (fit->fdata[i] - minimum)) / (maximum - minimum)) + args->min;
-			}
-		}
-	}
+	if (args->rescale)
+		rescale_result(fit, args->min, args->max, minimum, maximum, TRUE);
 
 	if (failed)
 		args->ret = 1;
@@ -845,6 +865,157 @@ failure: // failure before the eval loop
 	return GINT_TO_POINTER((gint)failed);
 }
 
+/* PixelMath on the frames of a sequence. The variable images are loaded once
+ * and only read by the threads, $T is the frame being processed */
+struct pixel_math_seq_data {
+	struct pixel_math_data *pm;
+	gchar *expression[3];	// with the functions of the variable images replaced
+};
+
+static void init_variables(struct pixel_math_data *pm, te_variable *vars, double *x) {
+	for (int i = 0; i < pm->nb_rows; i++) {
+		vars[i].name = pm->varname[i];
+		vars[i].address = &x[i];
+		vars[i].context = NULL;
+		vars[i].type = 0;
+	}
+	vars[pm->nb_rows].name = T_CURRENT;
+	vars[pm->nb_rows].address = &x[pm->nb_rows];
+	vars[pm->nb_rows].context = NULL;
+	vars[pm->nb_rows].type = 0;
+}
+
+static int pixel_math_seq_prepare_hook(struct generic_seq_args *args) {
+	struct pixel_math_seq_data *data = (struct pixel_math_seq_data *) args->user;
+	struct pixel_math_data *pm = data->pm;
+	struct image_stats_cache cache = { 0 };
+	for (int c = 0; c < args->seq->nb_layers; c++)
+		data->expression[c] = replace_image_functions(pm->expression1, pm, NULL, c, &cache, MULTI_THREADED);
+	free_image_stats_cache(&cache);
+	if (cache.failed || !data->expression[0])
+		return 1;
+
+	/* checking the syntax once, before the frames are read */
+	te_variable vars[MAX_IMAGES + 1];
+	double x[MAX_IMAGES + 1];
+	init_variables(pm, vars, x);
+	int err = 0;
+	te_expr *n = te_compile(data->expression[0], vars, pm->nb_rows + 1, &err);
+	if (!n) {
+		siril_log_color_message(_("Error in pixel math expression '%s' at character %d\n"), "red", data->expression[0], err);
+		return 1;
+	}
+	te_free(n);
+	return seq_prepare_hook(args);
+}
+
+static int pixel_math_seq_image_hook(struct generic_seq_args *args, int o, int i, fits *fit, rectangle *_, int threads) {
+	struct pixel_math_seq_data *data = (struct pixel_math_seq_data *) args->user;
+	struct pixel_math_data *pm = data->pm;
+	const int nb_vars = pm->nb_rows + 1;
+	const int nb_layers = (int) fit->naxes[2];
+	const size_t layersize = fit->naxes[0] * fit->naxes[1];
+	const gboolean to_ushort = args->output_type == DATA_USHORT;
+	te_variable vars[MAX_IMAGES + 1];
+	double x[MAX_IMAGES + 1];
+	te_program *programs[3] = { NULL };
+	struct image_stats_cache cache = { 0 };
+	int retval = 0;
+
+	/* the functions of $T have a value for each frame */
+	init_variables(pm, vars, x);
+	for (int c = 0; c < nb_layers && !retval; c++) {
+		gchar *expression = replace_image_functions(data->expression[c], pm, fit, c, &cache, SINGLE_THREADED);
+		int err = 0;
+		te_expr *n = expression ? te_compile(expression, vars, nb_vars, &err) : NULL;
+		programs[c] = te_program_new(n, vars, nb_vars);
+		if (!programs[c])
+			retval = 1;
+		te_free(n);
+		g_free(expression);
+	}
+	free_image_stats_cache(&cache);
+
+	void *result = NULL;
+	if (!retval) {
+		result = malloc(layersize * nb_layers * (to_ushort ? sizeof(WORD) : sizeof(float)));
+		if (!result) {
+			PRINT_ALLOC_ERR;
+			retval = 1;
+		}
+	}
+	if (!retval) {
+		float minimum = +FLT_MAX, maximum = -FLT_MAX;
+		const float *in[MAX_IMAGES + 1];
+		float out[TE_BLOCK];
+		for (int c = 0; c < nb_layers; c++) {
+			for (size_t px = c * layersize; px < (c + 1) * layersize; px += TE_BLOCK) {
+				const int n = (int) min((size_t) TE_BLOCK, (c + 1) * layersize - px);
+				for (int j = 0; j < pm->nb_rows; j++)
+					in[j] = var_fit[j].fdata + px;
+				in[pm->nb_rows] = fit->fdata + px;
+				te_program_eval(programs[c], in, n, out);
+				if (to_ushort)
+					store_block(out, n, (WORD *) result + px, NULL, &minimum, &maximum);
+				else store_block(out, n, NULL, (float *) result + px, &minimum, &maximum);
+			}
+		}
+		fit_replace_buffer(fit, result, args->output_type);
+		if (pm->rescale)
+			rescale_result(fit, pm->min, pm->max, minimum, maximum, FALSE);
+	}
+
+	for (int c = 0; c < 3; c++)
+		te_program_free(programs[c]);
+	return retval;
+}
+
+static int pixel_math_seq_finalize_hook(struct generic_seq_args *args) {
+	struct pixel_math_seq_data *data = (struct pixel_math_seq_data *) args->user;
+	struct pixel_math_data *pm = data->pm;
+	int retval = seq_finalize_hook(args);
+	for (int c = 0; c < 3; c++)
+		g_free(data->expression[c]);
+	g_free(pm->expression1);
+	for (int i = 0; i < pm->nb_rows; i++)
+		g_free(pm->varname[i]);
+	free(pm->varname);
+	free_pm_var(pm->nb_rows);
+	free(pm);
+	free(data);
+	args->user = NULL;
+	return retval;
+}
+
+/* Applies the expression of args to each frame of the sequence. The variable
+ * images must have been loaded with load_pm_var() and the expression is
+ * evaluated by blocks of pixels, so that only the frame and its result are
+ * added to the memory used for each thread. args is freed at the end */
+void apply_pixel_math_to_sequence(struct pixel_math_data *args, sequence *seq, char *prefix,
+		gboolean force_ser_output, gboolean force_fitseq_output) {
+	struct pixel_math_seq_data *data = calloc(1, sizeof(struct pixel_math_seq_data));
+	data->pm = args;
+
+	struct generic_seq_args *seqargs = create_default_seqargs(seq);
+	seqargs->filtering_criterion = seq_filter_included;
+	seqargs->nb_filtered_images = seq->selnum;
+	seqargs->force_float = TRUE;
+	seqargs->upscale_ratio = 1.42;	// sqrt(2), the result is computed in a second buffer
+	seqargs->prepare_hook = pixel_math_seq_prepare_hook;
+	seqargs->image_hook = pixel_math_seq_image_hook;
+	seqargs->finalize_hook = pixel_math_seq_finalize_hook;
+	seqargs->description = _("Pixel Math");
+	seqargs->has_output = TRUE;
+	seqargs->output_type = com.pref.force_16bit ? DATA_USHORT : DATA_FLOAT;
+	seqargs->new_seq_prefix = prefix;
+	seqargs->load_new_sequence = TRUE;
+	seqargs->force_ser_output = force_ser_output;
+	seqargs->force_fitseq_output = force_fitseq_output;
+	seqargs->user = data;
+
+	start_in_new_thread(generic_sequence_worker, seqargs);
+}
+
 static gboolean is_op_or_null(const gchar c) {
 	if (c == '\0') return TRUE;
 	if (c == '(') return TRUE;
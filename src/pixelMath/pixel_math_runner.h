@@ -41,5 +41,7 @@ struct pixel_math_data {
 int load_pm_var(const gchar *var, int index, int *w, int *h, int *c);
 void free_pm_var(int nb);
 gpointer apply_pixel_math_operation(gpointer p);
+void apply_pixel_math_to_sequence(struct pixel_math_data *args, sequence *seq, char *prefix,
+		gboolean force_ser_output, gboolean force_fitseq_output);
 
 #endif /* SRC_PIXELMATH_PIXEL_MATH_RUNNER_H_ */
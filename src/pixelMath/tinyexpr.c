@@ -33,6 +33,8 @@
  * 2022/10/07: add mtf function
  *
  * 2022/10/25: add of acosh, asinh, atanh and sign
+ *
+ * 2025/06/02: add te_program, evaluation of compiled expressions on blocks of values
  */
 
 /* COMPILE TIME OPTIONS */
@@ -787,6 +789,169 @@ te_expr *te_compile(const char *expression, const te_variable *variables, int va
 }
 
 
+/* Programs: the tree is flattened in post-order, each node writing TE_BLOCK
+ * values in its own register. The usual operators are computed in loops that
+ * the compiler can vectorise, the other functions are called for each value.
+ * The results are the same as te_eval() since the same double operations are
+ * done for each value. */
+
+enum {
+    OP_VARIABLE, OP_ADD, OP_SUB, OP_MUL, OP_DIVIDE, OP_NEGATE, OP_INVERSE,
+    OP_MAXIMUM, OP_MINIMUM, OP_FUNCTION, OP_CLOSURE
+};
+
+typedef struct te_instruction {
+    int op;
+    int arity;
+    int var;            /* OP_VARIABLE: index of the input */
+    const void *function;
+    void *context;
+    double *dst;
+    const double *args[7];
+} te_instruction;
+
+struct te_program {
+    te_instruction *code;
+    int nb_code;
+    int nb_regs;
+    double *regs;
+    const double *result;
+};
+
+static int count_nodes(const te_expr *n) {
+    int count = 1;
+    if (IS_FUNCTION(n->type) || IS_CLOSURE(n->type))
+        for (int i = 0; i < ARITY(n->type); i++)
+            count += count_nodes(n->parameters[i]);
+    return count;
+}
+
+static const double *flatten(te_program *p, const te_expr *n, const te_variable *variables, int var_count) {
+    double *dst = p->regs + (size_t) p->nb_regs++ * TE_BLOCK;
+    te_instruction ins = { 0 };
+    ins.dst = dst;
+
+    switch (TYPE_MASK(n->type)) {
+        case TE_CONSTANT:
+            /* written once, no instruction writes this register */
+            for (int i = 0; i < TE_BLOCK; i++)
+                dst[i] = n->value;
+            return dst;
+        case TE_VARIABLE:
+            ins.op = OP_VARIABLE;
+            ins.var = -1;
+            for (int i = 0; i < var_count; i++)
+                if (variables[i].address == n->bound)
+                    ins.var = i;
+            if (ins.var < 0) return NULL;
+            p->code[p->nb_code++] = ins;
+            return dst;
+        default:
+            break;
+    }
+
+    if (!IS_FUNCTION(n->type) && !IS_CLOSURE(n->type)) return NULL;
+    ins.arity = ARITY(n->type);
+    for (int i = 0; i < ins.arity; i++) {
+        ins.args[i] = flatten(p, n->parameters[i], variables, var_count);
+        if (!ins.args[i]) return NULL;
+    }
+    ins.function = n->function;
+    if (IS_CLOSURE(n->type)) {
+        ins.op = OP_CLOSURE;
+        ins.context = n->parameters[ins.arity];
+    } else if (n->function == (const void *) add) ins.op = OP_ADD;
+    else if (n->function == (const void *) sub) ins.op = OP_SUB;
+    else if (n->function == (const void *) mul) ins.op = OP_MUL;
+    else if (n->function == (const void *) divide) ins.op = OP_DIVIDE;
+    else if (n->function == (const void *) negate) ins.op = OP_NEGATE;
+    else if (n->function == (const void *) inverse) ins.op = OP_INVERSE;
+    else if (n->function == (const void *) maximum) ins.op = OP_MAXIMUM;
+    else if (n->function == (const void *) minimum) ins.op = OP_MINIMUM;
+    else ins.op = OP_FUNCTION;
+    p->code[p->nb_code++] = ins;
+    return dst;
+}
+
+te_program *te_program_new(const te_expr *n, const te_variable *variables, int var_count) {
+    if (!n) return NULL;
+    te_program *p = calloc(1, sizeof(te_program));
+    if (!p) return NULL;
+    const int nb_nodes = count_nodes(n);
+    p->code = malloc(nb_nodes * sizeof(te_instruction));
+    p->regs = malloc((size_t) nb_nodes * TE_BLOCK * sizeof(double));
+    if (!p->code || !p->regs || !(p->result = flatten(p, n, variables, var_count))) {
+        te_program_free(p);
+        return NULL;
+    }
+    return p;
+}
+
+void te_program_free(te_program *p) {
+    if (!p) return;
+    free(p->code);
+    free(p->regs);
+    free(p);
+}
+
+#define TE_FUN(...) ((double(*)(__VA_ARGS__))ins->function)
+#define A(e) ins->args[e][i]
+
+void te_program_eval(te_program *p, const float *const *vars, int n, float *out) {
+    for (int k = 0; k < p->nb_code; k++) {
+        const te_instruction *ins = &p->code[k];
+        double *restrict d = ins->dst;
+        const double *a = ins->args[0], *b = ins->args[1];
+        switch (ins->op) {
+            case OP_VARIABLE: {
+                const float *v = vars[ins->var];
+                for (int i = 0; i < n; i++) d[i] = (double) v[i];
+                break;
+            }
+            case OP_ADD: for (int i = 0; i < n; i++) d[i] = a[i] + b[i]; break;
+            case OP_SUB: for (int i = 0; i < n; i++) d[i] = a[i] - b[i]; break;
+            case OP_MUL: for (int i = 0; i < n; i++) d[i] = a[i] * b[i]; break;
+            case OP_DIVIDE: for (int i = 0; i < n; i++) d[i] = (b[i] == 0.0) ? 1.0 : a[i] / b[i]; break;
+            case OP_NEGATE: for (int i = 0; i < n; i++) d[i] = -a[i]; break;
+            case OP_INVERSE: for (int i = 0; i < n; i++) d[i] = 1 - a[i]; break;
+            case OP_MAXIMUM: for (int i = 0; i < n; i++) d[i] = max(a[i], b[i]); break;
+            case OP_MINIMUM: for (int i = 0; i < n; i++) d[i] = min(a[i], b[i]); break;
+            case OP_FUNCTION:
+                switch (ins->arity) {
+                    case 0: for (int i = 0; i < n; i++) d[i] = TE_FUN(void)(); break;
+                    case 1: for (int i = 0; i < n; i++) d[i] = TE_FUN(double)(A(0)); break;
+                    case 2: for (int i = 0; i < n; i++) d[i] = TE_FUN(double, double)(A(0), A(1)); break;
+                    case 3: for (int i = 0; i < n; i++) d[i] = TE_FUN(double, double, double)(A(0), A(1), A(2)); break;
+                    case 4: for (int i = 0; i < n; i++) d[i] = TE_FUN(double, double, double, double)(A(0), A(1), A(2), A(3)); break;
+                    case 5: for (int i = 0; i < n; i++) d[i] = TE_FUN(double, double, double, double, double)(A(0), A(1), A(2), A(3), A(4)); break;
+                    case 6: for (int i = 0; i < n; i++) d[i] = TE_FUN(double, double, double, double, double, double)(A(0), A(1), A(2), A(3), A(4), A(5)); break;
+                    case 7: for (int i = 0; i < n; i++) d[i] = TE_FUN(double, double, double, double, double, double, double)(A(0), A(1), A(2), A(3), A(4), A(5), A(6)); break;
+                }
+                break;
+            case OP_CLOSURE: {
+                void *c = ins->context;
+                switch (ins->arity) {
+                    case 0: for (int i = 0; i < n; i++) d[i] = TE_FUN(void*)(c); break;
+                    case 1: for (int i = 0; i < n; i++) d[i] = TE_FUN(void*, double)(c, A(0)); break;
+                    case 2: for (int i = 0; i < n; i++) d[i] = TE_FUN(void*, double, double)(c, A(0), A(1)); break;
+                    case 3: for (int i = 0; i < n; i++) d[i] = TE_FUN(void*, double, double, double)(c, A(0), A(1), A(2)); break;
+                    case 4: for (int i = 0; i < n; i++) d[i] = TE_FUN(void*, double, double, double, double)(c, A(0), A(1), A(2), A(3)); break;
+                    case 5: for (int i = 0; i < n; i++) d[i] = TE_FUN(void*, double, double, double, double, double)(c, A(0), A(1), A(2), A(3), A(4)); break;
+                    case 6: for (int i = 0; i < n; i++) d[i] = TE_FUN(void*, double, double, double, double, double, double)(c, A(0), A(1), A(2), A(3), A(4), A(5)); break;
+                    case 7: for (int i = 0; i < n; i++) d[i] = TE_FUN(void*, double, double, double, double, double, double, double)(c, A(0), A(1), A(2), A(3), A(4), A(5), A(6)); break;
+                }
+                break;
+            }
+        }
+    }
+    for (int i = 0; i < n; i++)
+        out[i] = (float) p->result[i];
+}
+
+#undef TE_FUN
+#undef A
+
+
 double te_interp(const char *expression, int *error) {
     te_expr *n = te_compile(expression, 0, 0, error);
     double ret;
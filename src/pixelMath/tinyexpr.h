@@ -79,6 +79,19 @@ void te_print(const te_expr *n);
 /* This is safe to call on NULL pointers. */
 void te_free(te_expr *n);
 
+/* Evaluation of a compiled expression on blocks of values, each variable of
+ * the list given to te_compile() being read from an array of floats.
+ * A program must not be used by several threads at the same time. */
+#define TE_BLOCK 256
+typedef struct te_program te_program;
+
+te_program *te_program_new(const te_expr *n, const te_variable *variables, int var_count);
+
+/* Computes n <= TE_BLOCK values, vars[i] holding the n values of variable i. */
+void te_program_eval(te_program *p, const float *const *vars, int n, float *out);
+
+void te_program_free(te_program *p);
+
 
 #ifdef __cplusplus
 }
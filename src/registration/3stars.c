@@ -263,6 +263,7 @@ static int _3stars_seqpsf(struct registration_args *regargs) {
 	clearfits(&fit);
 	spsfargs->allow_use_as_regdata = BOOL_FALSE;
 	spsfargs->list = NULL;	// GSList init is NULL
+	spsfargs->results = NULL;
 	spsfargs->framing = (regargs->follow_star) ? FOLLOW_STAR_FRAME : REGISTERED_FRAME;
 	memcpy(&args->area, &com.selection, sizeof(rectangle));
 	// making sure we can use registration data - maybe we could have done that beforehand...
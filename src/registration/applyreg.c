@@ -337,7 +337,7 @@ int apply_reg_prepare_hook(struct generic_seq_args *args) {
 	}
 
 		// We prepare the distortion structure maps if required
-	if (regargs->undistort && init_disto_map(fit.rx, fit.ry, regargs->disto)) {
+	if (regargs->undistort && init_disto_map(fit.rx, fit.ry, regargs->disto, com.max_thread)) {
 		siril_log_color_message(
 				_("Could not init distortion mapping\n"), "red");
 		args->seq->regparam[regargs->layer] = NULL;
@@ -345,6 +345,8 @@ int apply_reg_prepare_hook(struct generic_seq_args *args) {
 		clearfits(&fit);
 		return 1;
 	}
+	if (regargs->undistort && !regargs->driz)
+		init_disto_grids(regargs->disto, regargs->seq->number, fit.rx, fit.ry);
 	clearfits(&fit);
 	return registration_prepare_results(args);
 }
@@ -495,7 +497,7 @@ int apply_reg_image_hook(struct generic_seq_args *args, int out_index, int in_in
 		p->weights = driz->flat;
 
 		if (dobox(p)) { // Do the drizzle
-			siril_log_color_message("s\n", p->error->last_message);
+			siril_log_color_message("%s\n", "red", p->error->last_message);
 			return 1;
 		}
 		clearfits(fit);
@@ -42,6 +42,7 @@
 #include "io/sequence.h"
 #include "io/siril_catalogues.h"
 #include "io/image_format_fits.h"
+#include "io/wcs_cache.h"
 #include "opencv/opencv.h"
 #include "registration/registration.h"
 #include "registration/matching/degtorad.h"
@@ -396,30 +397,48 @@ free_all:
 
 int collect_sequence_astrometry(struct registration_args *regargs) {
 	int n = regargs->seq->number;
-	int retval = 0;
+	int retval = 0, nb_cached = 0;
 	fits fit = { 0 };
+	struct wcs_cache *cache = wcs_cache_load(regargs->seq);
 	for (int i = 0; i < n; i++) {
 		if (regargs->filtering_criterion && !regargs->filtering_criterion(regargs->seq, i, regargs->filtering_parameter))
 			continue;
-		if (seq_read_frame_metadata(regargs->seq, i, &fit)) {
-			siril_log_message(_("Could not load image %d from sequence %s\n"),
-			i + 1, regargs->seq->seqname);
-			retval = 1;
-			break;
+		wcsprm_t *wcs = NULL;
+		gboolean cached = wcs_cache_get(cache, i, &wcs);
+		if (cached)
+			nb_cached++;
+		else {
+			if (seq_read_frame_metadata(regargs->seq, i, &fit)) {
+				siril_log_message(_("Could not load image %d from sequence %s\n"),
+				i + 1, regargs->seq->seqname);
+				retval = 1;
+				break;
+			}
+			wcs_cache_put(cache, i, &fit);
+			wcs = fit.keywords.wcslib;
 		}
-		if (!has_wcs(&fit)) {
+		if (!wcs) {
 			siril_log_message(_("Image %d has not been plate-solved, unselecting\n"), i + 1);
 			regargs->seq->imgparam[i].incl = FALSE;
 			regargs->filters.filter_included = TRUE;
 			convert_parsed_filter_to_filter(&regargs->filters,
 				regargs->seq, &regargs->filtering_criterion,
 				&regargs->filtering_parameter);
+			if (!cached)
+				clearfits(&fit);
 			continue;
 		}
 		regargs->WCSDATA[i].flag = -1;
-		wcssub(1, fit.keywords.wcslib, NULL, NULL, regargs->WCSDATA + i); // copying wcsprm structure for each fit to avoid reopening
-		clearfits(&fit);
+		wcssub(1, wcs, NULL, NULL, regargs->WCSDATA + i); // copying wcsprm structure for each fit to avoid reopening
+		if (cached) {
+			wcsfree(wcs);
+			free(wcs);
+		}
+		else clearfits(&fit);
 	}
+	wcs_cache_close(cache);
+	if (nb_cached)
+		siril_debug_print("WCS of %d images read from the cache\n", nb_cached);
 	return retval;
 }
 
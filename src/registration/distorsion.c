@@ -89,68 +89,258 @@ int disto_correct_stars(psf_star **stars, disto_data *disto) {
 	return 0;
 }
 
+// evaluates the SIP polynomials A and B of a single point
+static inline void sip_point(const disto_data *disto, const double A[MAX_DISTO_SIZE][MAX_DISTO_SIZE],
+		const double B[MAX_DISTO_SIZE][MAX_DISTO_SIZE], double X, double Y, double *xout, double *yout) {
+	double U, V, x, y;
+	double U2, V2, U3, V3, U4, V4, U5, V5;
+	U = X - disto->xref;
+	V = Y - disto->yref;
+	x = U + A[0][0] + A[1][0] * U + A[0][1] * V;
+	y = V + B[0][0] + B[1][0] * U + B[0][1] * V;
+	if (disto->order >= 2) {
+		U2 = U * U;
+		V2 = V * V;
+		double UV = U * V;
+		x += A[2][0] * U2 + A[1][1] * UV + A[0][2] * V2;
+		y += B[2][0] * U2 + B[1][1] * UV + B[0][2] * V2;
+		if (disto->order >= 3) {
+			U3 = U2 * U;
+			V3 = V2 * V;
+			double U2V = U2 * V;
+			double UV2 = U * V2;
+			x += A[3][0] * U3 + A[2][1] * U2V + A[1][2] * UV2 + A[0][3] * V3;
+			y += B[3][0] * U3 + B[2][1] * U2V + B[1][2] * UV2 + B[0][3] * V3;
+			if (disto->order >= 4) {
+				U4 = U3 * U;
+				V4 = V3 * V;
+				double U3V = U3 * V;
+				double U2V2 = U2 * V2;
+				double UV3 = U * V3;
+				x += A[4][0] * U4 + A[3][1] * U3V + A[2][2] * U2V2 + A[1][3] * UV3 + A[0][4] * V4;
+				y += B[4][0] * U4 + B[3][1] * U3V + B[2][2] * U2V2 + B[1][3] * UV3 + B[0][4] * V4;
+				if (disto->order >= 5) {
+					U5 = U4 * U;
+					V5 = V4 * V;
+					double U4V = U4 * V;
+					double U3V2 = U3 * V2;
+					double U2V3 = U2 * V3;
+					double UV4 = U * V4;
+					x += A[5][0] * U5 + A[4][1] * U4V + A[3][2] * U3V2 + A[2][3] * U2V3 + A[1][4] * UV4 + A[0][5] * V5;
+					y += B[5][0] * U5 + B[4][1] * U4V + B[3][2] * U3V2 + B[2][3] * U2V3 + B[1][4] * UV4 + B[0][5] * V5;
+				}
+			}
+		}
+	}
+	*xout = x + disto->xref;
+	*yout = y + disto->yref;
+}
+
+// undistortion dst to src of a single point
+static inline void undistort_point_D2S(const disto_data *disto, double X, double Y, double *xout, double *yout) {
+	sip_point(disto, disto->AP, disto->BP, X, Y, xout, yout);
+}
+
+// undistortion src to dst of a single point (for drizzle)
+static inline void undistort_point_S2D(const disto_data *disto, double X, double Y, double *xout, double *yout) {
+	sip_point(disto, disto->A, disto->B, X, Y, xout, yout);
+}
+
 // maps undistortion dst to src (for interpolation)
 void map_undistortion_D2S(disto_data *disto, int rx, int ry, float *xmap, float *ymap) {
 	g_assert(disto != NULL);
 	g_assert(xmap != NULL);
 	g_assert(ymap != NULL);
-	double U, V, x, y;
-	double U2, V2, U3, V3, U4, V4, U5, V5;
+	double x, y;
 	int r = 0;
 	for (int v = 0; v < ry; ++v) {
 		float *rxptr = xmap + r;
 		float *ryptr = ymap + r;
 		for (int u = 0; u < rx; ++u) {
-			U = (double)rxptr[u] - disto->xref;
-			V = (double)ryptr[u] - disto->yref;
-			x = U + disto->AP[0][0] + disto->AP[1][0] * U + disto->AP[0][1] * V;
-			y = V + disto->BP[0][0] + disto->BP[1][0] * U + disto->BP[0][1] * V;
-			if (disto->order >= 2) {
-				U2 = U * U;
-				V2 = V * V;
-				double UV = U * V;
-				x += disto->AP[2][0] * U2 + disto->AP[1][1] * UV + disto->AP[0][2] * V2;
-				y += disto->BP[2][0] * U2 + disto->BP[1][1] * UV + disto->BP[0][2] * V2;
-				if (disto->order >= 3) {
-					U3 = U2 * U;
-					V3 = V2 * V;
-					double U2V = U2 * V;
-					double UV2 = U * V2;
-					x += disto->AP[3][0] * U3 + disto->AP[2][1] * U2V + disto->AP[1][2] * UV2 + disto->AP[0][3] * V3;
-					y += disto->BP[3][0] * U3 + disto->BP[2][1] * U2V + disto->BP[1][2] * UV2 + disto->BP[0][3] * V3;
-					if (disto->order >= 4) {
-						U4 = U3 * U;
-						V4 = V3 * V;
-						double U3V = U3 * V;
-						double U2V2 = U2 * V2;
-						double UV3 = U * V3;
-						x += disto->AP[4][0] * U4 + disto->AP[3][1] * U3V + disto->AP[2][2] * U2V2 + disto->AP[1][3] * UV3 + disto->AP[0][4] * V4;
-						y += disto->BP[4][0] * U4 + disto->BP[3][1] * U3V + disto->BP[2][2] * U2V2 + disto->BP[1][3] * UV3 + disto->BP[0][4] * V4;
-						if (disto->order >= 5) {
-							U5 = U4 * U;
-							V5 = V4 * V;
-							double U4V = U4 * V;
-							double U3V2 = U3 * V2;
-							double U2V3 = U2 * V3;
-							double UV4 = U * V4;
-							x += disto->AP[5][0] * U5 + disto->AP[4][1] * U4V + disto->AP[3][2] * U3V2 + disto->AP[2][3] * U2V3 + disto->AP[1][4] * UV4 + disto->AP[0][5] * V5;
-							y += disto->BP[5][0] * U5 + disto->BP[4][1] * U4V + disto->BP[3][2] * U3V2 + disto->BP[2][3] * U2V3 + disto->BP[1][4] * UV4 + disto->BP[0][5] * V5;
-						}
-					}
-				}
-			}
-			rxptr[u] = (float)(x + disto->xref);
-			ryptr[u] = (float)(y + disto->yref);
+			undistort_point_D2S(disto, (double)rxptr[u], (double)ryptr[u], &x, &y);
+			rxptr[u] = (float)x;
+			ryptr[u] = (float)y;
  		}
 		r += rx;
  	}
 }
 
+/* The SIP polynomials are smooth over the image, so evaluating them for each
+ * output pixel is not needed: the displacement is sampled on a grid covering
+ * the source image and interpolated bilinearly. The step of the grid is the
+ * largest for which the interpolation error at the centers of the cells stays
+ * below DISTO_GRID_TOLERANCE. Points outside of the grid are computed exactly.
+ * The grids of the DISTO_D2S frames sample the AP and BP polynomials, those
+ * built for the drizzle maps the A and B polynomials. */
+#define DISTO_GRID_MAX_STEP 32
+#define DISTO_GRID_MIN_STEP 4
+#define DISTO_GRID_MARGIN 64	// pixels around the image
+#define DISTO_GRID_TOLERANCE 0.01	// pixels
+
+struct disto_grid_struct {
+	int step;
+	int nx, ny;		// number of nodes
+	float x0, y0;		// position of the first node
+	float *dx, *dy;		// displacements at the nodes
+	gint refcount;
+};
+
+static void free_disto_grid(disto_grid *grid) {
+	if (!grid || !g_atomic_int_dec_and_test(&grid->refcount))
+		return;
+	free(grid->dx);
+	free(grid);
+}
+
+static inline gboolean disto_grid_displacement(const disto_grid *grid, float x, float y, float *dx, float *dy) {
+	float gx = (x - grid->x0) / grid->step;
+	float gy = (y - grid->y0) / grid->step;
+	// also false for NaN
+	if (!(gx >= 0.f && gy >= 0.f && gx < (float)(grid->nx - 1) && gy < (float)(grid->ny - 1)))
+		return FALSE;
+	int i = (int)gx, j = (int)gy;
+	float c1 = gx - (float)i;
+	float c2 = gy - (float)j;
+	float w11 = (1.f - c1) * (1.f - c2);
+	float w12 = c1 * (1.f - c2);
+	float w21 = (1.f - c1) * c2;
+	float w22 = c1 * c2;
+	size_t s = (size_t)j * grid->nx + i;
+	*dx = w11 * grid->dx[s] + w12 * grid->dx[s + 1] + w21 * grid->dx[s + grid->nx] + w22 * grid->dx[s + grid->nx + 1];
+	*dy = w11 * grid->dy[s] + w12 * grid->dy[s + 1] + w21 * grid->dy[s + grid->nx] + w22 * grid->dy[s + grid->nx + 1];
+	return TRUE;
+}
+
+static disto_grid *build_disto_grid(const disto_data *disto, int rx, int ry, int step, gboolean src_to_dst, int threads) {
+	disto_grid *grid = calloc(1, sizeof(disto_grid));
+	if (!grid)
+		return NULL;
+	grid->step = step;
+	grid->x0 = grid->y0 = -DISTO_GRID_MARGIN;
+	grid->nx = (rx + 2 * DISTO_GRID_MARGIN + step - 1) / step + 1;
+	grid->ny = (ry + 2 * DISTO_GRID_MARGIN + step - 1) / step + 1;
+	size_t nb = (size_t)grid->nx * grid->ny;
+	grid->dx = malloc(2 * nb * sizeof(float));
+	if (!grid->dx) {
+		free(grid);
+		return NULL;
+	}
+	grid->dy = grid->dx + nb;
+	grid->refcount = 1;
+
+	double maxerr = 0.0;
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(threads) schedule(static) if (threads > 1)
+#endif
+	for (int j = 0; j < grid->ny; j++) {
+		double y0 = grid->y0 + (double)j * step;
+		for (int i = 0; i < grid->nx; i++) {
+			double x0 = grid->x0 + (double)i * step, x, y;
+			if (src_to_dst)
+				undistort_point_S2D(disto, x0, y0, &x, &y);
+			else undistort_point_D2S(disto, x0, y0, &x, &y);
+			grid->dx[(size_t)j * grid->nx + i] = (float)(x - x0);
+			grid->dy[(size_t)j * grid->nx + i] = (float)(y - y0);
+		}
+	}
+	// checking the error at the centers of the cells, where it is the largest
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(threads) schedule(static) reduction(max:maxerr) if (threads > 1)
+#endif
+	for (int j = 0; j < grid->ny - 1; j++) {
+		float y0 = grid->y0 + ((float)j + 0.5f) * step;
+		for (int i = 0; i < grid->nx - 1; i++) {
+			float x0 = grid->x0 + ((float)i + 0.5f) * step, dx, dy;
+			double x, y;
+			if (src_to_dst)
+				undistort_point_S2D(disto, x0, y0, &x, &y);
+			else undistort_point_D2S(disto, x0, y0, &x, &y);
+			if (disto_grid_displacement(grid, x0, y0, &dx, &dy)) {
+				double err = fmax(fabs(x0 + dx - x), fabs(y0 + dy - y));
+				if (err > maxerr)
+					maxerr = err;
+			}
+		}
+	}
+	if (maxerr > DISTO_GRID_TOLERANCE) {
+		free_disto_grid(grid);
+		return NULL;
+	}
+	siril_debug_print("distortion grid: step %d, max error %g pixels\n", step, maxerr);
+	return grid;
+}
+
+static gboolean same_disto_coefficients(const disto_data *a, const disto_data *b) {
+	return a->order == b->order && a->xref == b->xref && a->yref == b->yref &&
+		!memcmp(a->AP, b->AP, sizeof(a->AP)) && !memcmp(a->BP, b->BP, sizeof(a->BP));
+}
+
+// prepares the displacement grids of the DISTO_D2S elements of a disto array,
+// consecutive frames with the same distortion, like a master file, share it
+void init_disto_grids(disto_data *disto, int nb, int rx, int ry) {
+	if (!disto || disto->dtype == DISTO_MAP_D2S || disto->dtype == DISTO_MAP_S2D)
+		return;
+	disto_data *prev = NULL;
+	int nbgrids = 0;
+	for (int i = 0; i < nb; i++) {
+		if (disto[i].dtype != DISTO_D2S || disto[i].grid)
+			continue;
+		if (prev && prev->grid && same_disto_coefficients(prev, disto + i)) {
+			g_atomic_int_inc(&prev->grid->refcount);
+			disto[i].grid = prev->grid;
+			continue;
+		}
+		for (int step = DISTO_GRID_MAX_STEP; step >= DISTO_GRID_MIN_STEP && !disto[i].grid; step /= 2)
+			disto[i].grid = build_disto_grid(disto + i, rx, ry, step, FALSE, com.max_thread);
+		if (disto[i].grid)
+			nbgrids++;
+		prev = disto + i;
+	}
+	siril_debug_print("%d distortion grids computed\n", nbgrids);
+}
+
+// maps undistortion dst to src with the displacement grid
+static void map_undistortion_D2S_grid(disto_data *disto, int rx, int ry, float *xmap, float *ymap) {
+	size_t n = (size_t)rx * ry;
+	for (size_t k = 0; k < n; k++) {
+		float dx, dy;
+		if (disto_grid_displacement(disto->grid, xmap[k], ymap[k], &dx, &dy)) {
+			xmap[k] += dx;
+			ymap[k] += dy;
+		} else {
+			double x, y;
+			undistort_point_D2S(disto, (double)xmap[k], (double)ymap[k], &x, &y);
+			xmap[k] = (float)x;
+			ymap[k] = (float)y;
+		}
+	}
+}
+
 // maps undistortion src to dst (for drizzle)
-void map_undistortion_S2D(disto_data *disto, int rx, int ry, float *xmap, float *ymap) {
+void map_undistortion_S2D(disto_data *disto, int rx, int ry, float *xmap, float *ymap, int threads) {
 	g_assert(disto != NULL);
 	g_assert(xmap != NULL);
 	g_assert(ymap != NULL);
+	disto_grid *grid = NULL;
+	for (int step = DISTO_GRID_MAX_STEP; step >= DISTO_GRID_MIN_STEP && !grid; step /= 2)
+		grid = build_disto_grid(disto, rx, ry, step, TRUE, threads);
+	if (grid) {
+		// the margin of the grid covers all the pixels of the image
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(threads) schedule(static) if (threads > 1)
+#endif
+		for (int v = 0; v < ry; ++v) {
+			size_t r = (size_t)v * rx;
+			for (int u = 0; u < rx; ++u) {
+				float dx, dy;
+				disto_grid_displacement(grid, (float)u, (float)v, &dx, &dy);
+				xmap[r + u] = (float)u + dx;
+				ymap[r + u] = (float)v + dy;
+			}
+		}
+		free_disto_grid(grid);
+		return;
+	}
 	double x, y;
 	double *U = malloc(rx * sizeof(double));
 	double *V = malloc(ry * sizeof(double));
@@ -253,7 +443,7 @@ void map_undistortion_S2D(disto_data *disto, int rx, int ry, float *xmap, float
 
 
 // Computes the distortion map and stores it in the disto structure
-int init_disto_map(int rx, int ry, disto_data *disto) {
+int init_disto_map(int rx, int ry, disto_data *disto, int threads) {
 	if (disto == NULL ||(disto->dtype != DISTO_MAP_D2S && disto->dtype != DISTO_MAP_S2D && disto->dtype != DISTO_S2D)) //nothing to do
 		return 0;
 
@@ -282,7 +472,7 @@ int init_disto_map(int rx, int ry, disto_data *disto) {
 	if (disto->dtype == DISTO_MAP_D2S) {
 		map_undistortion_D2S(disto, rx, ry, disto->xmap, disto->ymap);
 	} else
-		map_undistortion_S2D(disto, rx, ry, disto->xmap, disto->ymap);
+		map_undistortion_S2D(disto, rx, ry, disto->xmap, disto->ymap, threads);
 	return 0;
 }
 
@@ -329,7 +519,9 @@ void prepare_H_with_disto_4remap(double *H, int rx_in, int ry_in, int rx_out, in
 			ymap[index++] = (x0 * H[3] + y0 * H[4] + H[5]) * z;
 		}
 	}
-	if (disto->dtype == DISTO_D2S) {
+	if (disto->dtype == DISTO_D2S && disto->grid) {
+		map_undistortion_D2S_grid(disto, rx_out, ry_out, xmap, ymap);
+	} else if (disto->dtype == DISTO_D2S) {
 		map_undistortion_D2S(disto, rx_out, ry_out, xmap, ymap);
 	} else if (disto->dtype == DISTO_MAP_D2S){
 		map_undistortion_interp(disto, rx_in, ry_in, rx_out, ry_out, xmap, ymap);
@@ -419,6 +611,8 @@ disto_data *init_disto_data(disto_params *distoparam, sequence *seq, struct wcsp
 		fits fit  = { 0 };
 		disto = calloc(seq->number, sizeof(disto_data));
 		gboolean found = FALSE;
+		gchar *prev_wcsname = NULL;
+		int prev = -1;
 		for (int i = 0;  i < seq->number; i++) {
 			if (!seq->imgparam[i].incl)
 				continue;
@@ -426,28 +620,42 @@ disto_data *init_disto_data(disto_params *distoparam, sequence *seq, struct wcsp
 				siril_log_color_message(_("Could not load image# %d, deselecting\n"), "red", i + 1);
 				seq->imgparam[i].incl = FALSE;
 				clearfits(&fit);
-				free_disto_args(disto);
+				free_disto_args(disto, seq->number);
 			}
 			int statusread = 0;
 			gchar *wcsname = path_parse(&fit, com.pref.prepro.disto_lib, PATHPARSE_MODE_READ, &statusread);
 			clearfits(&fit);
 			if (statusread) {
 				siril_log_color_message(_("Could not parse master file name for distortion, aborting\n"), "red");
-				free_disto_args(disto);
+				free_disto_args(disto, seq->number);
+				g_free(wcsname);
+				g_free(prev_wcsname);
 				return NULL;
 			}
+			// frames using the same master file as the previous one share its data
+			if (prev_wcsname && !g_strcmp0(wcsname, prev_wcsname)) {
+				disto[i] = disto[prev];
+				g_free(wcsname);
+				prev = i;
+				continue;
+			}
+			g_free(prev_wcsname);
+			prev_wcsname = wcsname;
+			prev = i;
 			statusread = read_fits_metadata_from_path_first_HDU(wcsname, &fit);
 			if (statusread) {
 				siril_log_color_message(_("Could not load master file for distortion, aborting\n"), "red");
 				clearfits(&fit);
-				free_disto_args(disto);
+				free_disto_args(disto, seq->number);
+				g_free(prev_wcsname);
 				return NULL;
 			}
 			wcs = wcs_deepcopy(fit.keywords.wcslib, &statusread);
 			clearfits(&fit);
 			if (statusread) {
 				siril_log_color_message(_("Could not copy WCS information for distortion, aborting\n"), "red");
-				free_disto_args(disto);
+				free_disto_args(disto, seq->number);
+				g_free(prev_wcsname);
 				return NULL;
 			}
 			if (wcs->lin.dispre) {
@@ -462,6 +670,7 @@ disto_data *init_disto_data(disto_params *distoparam, sequence *seq, struct wcsp
 			wcsfree(wcs);
 			wcs = NULL;
 		}
+		g_free(prev_wcsname);
 		if (!found) {
 			free(disto);
 			distoparam->index = DISTO_UNDEF;
@@ -604,12 +813,18 @@ gboolean validate_disto_params(fits *reffit, const gchar *text, disto_source ind
 	return TRUE;
 }
 
-void free_disto_args(disto_data *disto) {
+void free_disto_args(disto_data *disto, int nb) {
 	if (!disto)
 		return;
 	// we only need to free the maps for the 2 types which store them (disto has only one element in that case)
 	if (disto->dtype == DISTO_MAP_D2S || disto->dtype == DISTO_MAP_S2D) {
 		free(disto->xmap);
 		free(disto->ymap);
+		return;
+	}
+	// otherwise there is one element per frame, which may have a grid
+	for (int i = 0; i < nb; i++) {
+		free_disto_grid(disto[i].grid);
+		disto[i].grid = NULL;
 	}
 }
\ No newline at end of file
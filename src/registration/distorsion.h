@@ -14,6 +14,9 @@ typedef enum {
 	DISTO_MAP_S2D  // computed from the ref image dst->src (drizzle interpolation)
 } disto_type;
 
+/* undistortion displacements sampled on a coarse grid, see init_disto_grids() */
+typedef struct disto_grid_struct disto_grid;
+
 typedef struct {
 	disto_type dtype;
 	double A[MAX_DISTO_SIZE][MAX_DISTO_SIZE];
@@ -23,17 +26,19 @@ typedef struct {
 	int order;
 	double xref, yref;
 	float *xmap, *ymap;
+	disto_grid *grid; // for DISTO_D2S, can be shared by several frames
 } disto_data;
 
 int disto_correct_stars(psf_star **stars, disto_data *disto);
-int init_disto_map(int rx, int ry, disto_data *disto);
+int init_disto_map(int rx, int ry, disto_data *disto, int threads);
+void init_disto_grids(disto_data *disto, int nb, int rx, int ry);
 void map_undistortion_D2S(disto_data *disto, int rx, int ry, float *xmap, float *ymap);
-void map_undistortion_S2D(disto_data *disto, int rx, int ry, float *xmap, float *ymap);
+void map_undistortion_S2D(disto_data *disto, int rx, int ry, float *xmap, float *ymap, int threads);
 
 gboolean validate_disto_params(fits *reffit, const gchar *text, disto_source index, gchar **msg1, gchar **msg2);
 disto_data *init_disto_data(disto_params *distoparam, sequence *seq, struct wcsprm *WCSDATA, gboolean drizzle, int *status);
 gchar *get_wcs_filename(pathparse_mode mode, sequence *seq);
-void free_disto_args(disto_data *disto);
+void free_disto_args(disto_data *disto, int nb);
 
 #ifdef __cplusplus
 extern "C" {
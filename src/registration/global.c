@@ -39,6 +39,7 @@
 #include "io/sequence.h"
 #include "io/ser.h"
 #include "io/image_format_fits.h"
+#include "io/frame_cache.h"
 #include "drizzle/cdrizzleutil.h"
 #include "registration/registration.h"
 #include "registration/distorsion.h"
@@ -106,35 +107,140 @@ int registration_prepare_results(struct generic_seq_args *args) {
 	return 0;
 }
 
+/* The stars of the last reference image are kept in memory with its size, so
+ * that registering the same sequence again, with other transformation or
+ * filtering parameters for example, or restarting a processing on it, neither
+ * reads the reference image nor detects its stars again. The key identifies
+ * the file and its state on disk, and everything that changes the detection. */
+static struct {
+	gchar *key;
+	psf_star **stars;
+	int nb_stars;
+	int rx, ry;
+} refstars_cache = { NULL, NULL, 0, 0, 0 };
+static GMutex refstars_cache_mutex;
+
+static gchar *get_refstars_key(sequence *seq, struct registration_args *regargs) {
+	if (seq->type == SEQ_INTERNAL)
+		return NULL;
+	gchar *file_id = frame_cache_get_file_id(seq, regargs->reference_image);
+	if (!file_id)
+		return NULL;
+	const star_finder_params *sf = &com.pref.starfinder_conf;
+	rectangle area = { 0 };
+	if (com.selection.w != 0 && com.selection.h != 0)
+		area = com.selection;
+	gchar *key = g_strdup_printf("%s|%d|%d|%d|%d|%g|%g|%g|%g|%d|%d|%d|%g|%g|%g|%g|%d,%d,%d,%d",
+			file_id, regargs->layer, regargs->sfargs->max_stars_fitted, regargs->detection_binning,
+			sf->radius, sf->sigma, sf->roundness, sf->focal_length, sf->pixel_size_x,
+			sf->convergence, sf->relax_checks, sf->profile, sf->min_beta,
+			sf->min_A, sf->max_A, sf->max_r, area.x, area.y, area.w, area.h);
+	g_free(file_id);
+	return key;
+}
+
+static psf_star **duplicate_star_list(psf_star **stars, int nb_stars) {
+	psf_star **copy = new_fitted_stars(nb_stars);
+	if (!copy)
+		return NULL;
+	for (int i = 0; i < nb_stars; i++) {
+		copy[i] = duplicate_psf(stars[i]);
+		if (!copy[i]) {
+			free_fitted_stars(copy);
+			return NULL;
+		}
+		copy[i + 1] = NULL;
+	}
+	return copy;
+}
+
+static gboolean refstars_cache_get(const gchar *key, psf_star ***stars, int *nb_stars, int *rx, int *ry) {
+	if (!key)
+		return FALSE;
+	gboolean found = FALSE;
+	g_mutex_lock(&refstars_cache_mutex);
+	if (refstars_cache.key && !strcmp(refstars_cache.key, key)) {
+		*stars = duplicate_star_list(refstars_cache.stars, refstars_cache.nb_stars);
+		if (*stars) {
+			*nb_stars = refstars_cache.nb_stars;
+			*rx = refstars_cache.rx;
+			*ry = refstars_cache.ry;
+			found = TRUE;
+		}
+	}
+	g_mutex_unlock(&refstars_cache_mutex);
+	return found;
+}
+
+static void refstars_cache_put(const gchar *key, psf_star **stars, int nb_stars, int rx, int ry) {
+	if (!key)
+		return;
+	psf_star **copy = duplicate_star_list(stars, nb_stars);
+	if (!copy)
+		return;
+	g_mutex_lock(&refstars_cache_mutex);
+	g_free(refstars_cache.key);
+	if (refstars_cache.stars)
+		free_fitted_stars(refstars_cache.stars);
+	refstars_cache.key = g_strdup(key);
+	refstars_cache.stars = copy;
+	refstars_cache.nb_stars = nb_stars;
+	refstars_cache.rx = rx;
+	refstars_cache.ry = ry;
+	g_mutex_unlock(&refstars_cache_mutex);
+}
+
 int star_align_prepare_hook(struct generic_seq_args *args) {
 	struct star_align_data *sadata = args->user;
 	struct registration_args *regargs = sadata->regargs;
 	float FWHMx, FWHMy, B;
 	char *units;
 	fits fit = { 0 };
-	int nb_stars = 0;
+	int nb_stars = 0, rx, ry;
 
 	sadata->current_regdata = registration_get_current_regdata(regargs);
 	if (!sadata->current_regdata) return -2;
 
-	/* first we're looking for stars in reference image */
-	if (seq_read_frame(args->seq, regargs->reference_image, &fit, FALSE, -1)) {
-		siril_log_color_message(_("Could not load reference image\n"), "red");
-		args->seq->regparam[regargs->layer] = NULL;
-		free(sadata->current_regdata);
-		return 1;
-	}
+	gchar *cache_key = get_refstars_key(args->seq, regargs);
+	if (refstars_cache_get(cache_key, &sadata->refstars, &nb_stars, &rx, &ry)) {
+		siril_log_color_message(_("Reference Image:\n"), "green");
+		siril_log_message(_("Reusing the stars detected in the previous run\n"));
+	} else {
+		/* first we're looking for stars in reference image */
+		if (seq_read_frame(args->seq, regargs->reference_image, &fit, FALSE, -1)) {
+			siril_log_color_message(_("Could not load reference image\n"), "red");
+			args->seq->regparam[regargs->layer] = NULL;
+			free(sadata->current_regdata);
+			g_free(cache_key);
+			return 1;
+		}
 
-	siril_log_color_message(_("Reference Image:\n"), "green");
+		siril_log_color_message(_("Reference Image:\n"), "green");
 
-	// peaking or using cached list in lst(if no selection is made)
-	// For now selection is using com.selection
-	struct starfinder_data *sf_data = findstar_image_worker(regargs->sfargs, -1, regargs->reference_image, &fit, NULL, com.max_thread);
-	if (sf_data) {
-		sadata->refstars = *sf_data->stars;
-		nb_stars = *sf_data->nb_stars;
-		free(sf_data);
+		// peaking or using cached list in lst(if no selection is made)
+		// For now selection is using com.selection
+		struct starfinder_data *sf_data = findstar_image_worker(regargs->sfargs, -1, regargs->reference_image, &fit, NULL, com.max_thread);
+		if (sf_data) {
+			sadata->refstars = *sf_data->stars;
+			nb_stars = *sf_data->nb_stars;
+			free(sf_data);
+		}
+		rx = fit.rx;
+		ry = fit.ry;
+		if (sadata->refstars && nb_stars > 0)
+			refstars_cache_put(cache_key, sadata->refstars, nb_stars, rx, ry);
+
+		// For internal sequences the data / fdata pointer still
+		// points to the original memory in seq->internal_fits.
+		// It must not be freed by clearfits here so we set the
+		// pointers in fit to NULL
+		if (args->seq->type == SEQ_INTERNAL) {
+			fit.data = NULL;
+			fit.fdata = NULL;
+		}
+		clearfits(&fit);
 	}
+	g_free(cache_key);
 
 	siril_log_message(_("Found %d stars in reference, channel #%d\n"), nb_stars, regargs->layer);
 
@@ -143,7 +249,6 @@ int star_align_prepare_hook(struct generic_seq_args *args) {
 				_("There are not enough stars in reference image to perform alignment\n"), "red");
 		args->seq->regparam[regargs->layer] = NULL;
 		free(sadata->current_regdata);
-		clearfits(&fit);
 		return 1;
 	}
 
@@ -168,12 +273,11 @@ int star_align_prepare_hook(struct generic_seq_args *args) {
 	}
 
 	// We prepare the distortion structure maps if required
-	if (regargs->undistort && init_disto_map(fit.rx, fit.ry, regargs->disto)) {
+	if (regargs->undistort && init_disto_map(rx, ry, regargs->disto, com.max_thread)) {
 		siril_log_color_message(
 				_("Could not init distortion mapping\n"), "red");
 		args->seq->regparam[regargs->layer] = NULL;
 		free(sadata->current_regdata);
-		clearfits(&fit);
 		return 1;
 	}
 
@@ -190,22 +294,11 @@ int star_align_prepare_hook(struct generic_seq_args *args) {
 			_("Could not correct the stars position with SIP coeffients\n"), "red");
 		args->seq->regparam[regargs->layer] = NULL;
 		free(sadata->current_regdata);
-		clearfits(&fit);
 		return 1;
 	}
 
-	sadata->ref.x = fit.rx;
-	sadata->ref.y = fit.ry;
-
-	// For internal sequences the data / fdata pointer still
-	// points to the original memory in seq->internal_fits.
-	// It must not be freed by clearfits here so we set the
-	// pointers in fit to NULL
-	if (args->seq->type == SEQ_INTERNAL) {
-		fit.data = NULL;
-		fit.fdata = NULL;
-	}
-	clearfits(&fit);
+	sadata->ref.x = rx;
+	sadata->ref.y = ry;
 
 	if (!regargs->no_output) {
 		sadata->ref.x *= regargs->output_scale;
@@ -230,11 +323,12 @@ int star_align_prepare_hook(struct generic_seq_args *args) {
 	sadata->current_regdata[regargs->reference_image].weighted_fwhm = FWHMx;
 	sadata->current_regdata[regargs->reference_image].background_lvl = B;
 	sadata->current_regdata[regargs->reference_image].number_of_stars = sadata->fitted_stars;
+	sadata->ref_index = atRefIndexNew();
 
 	return registration_prepare_results(args);
 }
 
-static int star_match_and_checks(psf_star **ref_stars, psf_star **stars, int nb_ref_stars, int nb_stars, struct registration_args *regargs, int filenum, Homography *H) {
+static int star_match_and_checks(psf_star **ref_stars, psf_star **stars, int nb_ref_stars, int nb_stars, at_ref_index *ref_index, struct registration_args *regargs, int filenum, Homography *H) {
 	double scale_min = 0.9;
 	double scale_max = 1.1;
 	int attempt = 1;
@@ -242,9 +336,9 @@ static int star_match_and_checks(psf_star **ref_stars, psf_star **stars, int nb_
 	int failure = 1;
 	/* make a loop with different tries in order to align the two sets of data */
 	while (failure && attempt < NB_OF_MATCHING_TRY) {
-		failure = new_star_match(stars, ref_stars, nb_stars, nb_ref_stars, nobj,
+		failure = new_star_match_indexed(stars, ref_stars, nb_stars, nb_ref_stars, nobj,
 				scale_min, scale_max, H, NULL, FALSE, regargs->type, AT_TRANS_UNDEFINED,
-				NULL, NULL);
+				NULL, NULL, ref_index);
 		if (attempt == 1) {
 			scale_min = -1.0;
 			scale_max = -1.0;
@@ -348,7 +442,7 @@ int star_align_image_hook(struct generic_seq_args *args, int out_index, int in_i
 			return 1;
 		}
 
-		int not_matched = star_match_and_checks(sadata->refstars, stars, sadata->fitted_stars, nb_stars, regargs, filenum, &H);
+		int not_matched = star_match_and_checks(sadata->refstars, stars, sadata->fitted_stars, nb_stars, sadata->ref_index, regargs, filenum, &H);
 		if (!not_matched)
 			FWHM_stats(stars, nb_stars, args->seq->bitpix, &FWHMx, &FWHMy, &units, &B, NULL, 0.);
 		free_fitted_stars(stars);
@@ -432,6 +526,8 @@ static int star_align_finalize_hook(struct generic_seq_args *args) {
 	fix_selnum(args->seq, FALSE);
 
 	free_fitted_stars(sadata->refstars);
+	atRefIndexFree(sadata->ref_index);
+	sadata->ref_index = NULL;
 
 	if (!args->retval) {
 		for (int i = 0; i < args->nb_filtered_images; i++)
@@ -646,6 +742,7 @@ int register_star_alignment(struct registration_args *regargs) {
 	regargs->sfargs->keep_stars = TRUE;
 	regargs->sfargs->save_to_file = !regargs->matchSelection && !regargs->no_starlist;
 	regargs->sfargs->max_stars_fitted = regargs->max_stars_candidates;
+	regargs->sfargs->detection_binning = regargs->detection_binning;
 
 	args->prepare_hook = star_align_prepare_hook;
 	args->image_hook = star_align_image_hook;
@@ -719,6 +816,7 @@ static int compute_transform(struct registration_args *regargs, struct starfinde
 	int nb_ref_stars = sfargs->nb_stars[regargs->seq->reference_image];
 	int nb_aligned = 0;
 	int nbfail = *failed;
+	at_ref_index *ref_index = atRefIndexNew();
 #ifdef _OPENMP
 #pragma omp parallel for num_threads(com.max_thread) schedule(static) shared(nbfail, nb_aligned)
 #endif
@@ -731,7 +829,7 @@ static int compute_transform(struct registration_args *regargs, struct starfinde
 		} else {
 			int filenum = regargs->seq->imgparam[i].filenum;	// for display purposes
 			int not_matched = star_match_and_checks(sfargs->stars[regargs->seq->reference_image], sfargs->stars[i],
-					sfargs->nb_stars[regargs->seq->reference_image], sfargs->nb_stars[i], regargs, filenum, &H);
+					sfargs->nb_stars[regargs->seq->reference_image], sfargs->nb_stars[i], ref_index, regargs, filenum, &H);
 			if (not_matched) {
 				g_atomic_int_inc(&nbfail);
 				included[i] = FALSE;
@@ -753,10 +851,48 @@ static int compute_transform(struct registration_args *regargs, struct starfinde
 		current_regdata[i].number_of_stars = sfargs->nb_stars[i];
 		current_regdata[i].H = H;
 	}
+	atRefIndexFree(ref_index);
 	*failed = nbfail;
 	return nb_aligned;
 }
 
+/* prints the transforms computed by compute_transform() */
+static void print_transforms(struct registration_args *regargs, const gboolean *included, const float *fwhm, const float *roundness) {
+	regdata *current_regdata = regargs->seq->regparam[regargs->layer];
+	for (int i = 0; i < regargs->seq->number; i++) {
+		if (!included[i] || i == regargs->seq->reference_image)
+			continue;
+		print_alignment_results(current_regdata[i].H, regargs->seq->imgparam[i].filenum, fwhm[i], roundness[i], "px");
+	}
+}
+
+/* changes the reference of the transforms computed by compute_transform() to
+ * the image new_ref, aligned with the others, by composing them with the
+ * inverse of its transform instead of matching the stars again */
+static void rebase_transforms(struct registration_args *regargs, struct starfinder_data *sfargs, const gboolean *included, int new_ref) {
+	regdata *current_regdata = regargs->seq->regparam[regargs->layer];
+	Homography Href = current_regdata[new_ref].H;
+	int nb_ref_stars = sfargs->nb_stars[new_ref];
+	for (int i = 0; i < regargs->seq->number; i++) {
+		if (!included[i])
+			continue;
+		if (i == new_ref) {
+			Homography H = { 0 };
+			cvGetEye(&H);
+			current_regdata[i].H = H;
+		} else {
+			// the pairs matched and inliers are kept from the match to the previous reference
+			Homography H = current_regdata[i].H;
+			cvTransfH(&current_regdata[i].H, &Href, &H);
+			current_regdata[i].H = H;
+		}
+		current_regdata[i].weighted_fwhm = 2 * current_regdata[i].fwhm
+			* ((double)nb_ref_stars - sfargs->nb_stars[i])
+			/ (double)nb_ref_stars + current_regdata[i].fwhm;
+	}
+	regargs->seq->reference_image = new_ref;
+}
+
 static void compute_dist(struct registration_args *regargs, float *dist, const gboolean *included) {
 	Homography Href = regargs->seq->regparam[regargs->layer][regargs->seq->reference_image].H;
 	Homography Hshift = {0};
@@ -831,6 +967,9 @@ int minidx(const float *arr, const gboolean *mask, int nb, float *val) {
 * 1. finding stars
 * 2. searching for the best image and set it as reference
 * 3. compute the transforms and store them in regparams
+* The stars are only detected once, and the transforms computed for a trial
+* reference are kept, so that choosing another reference among the aligned
+* images only composes them with its transform.
 */
 
 int register_multi_step_global(struct registration_args *regargs) {
@@ -838,6 +977,9 @@ int register_multi_step_global(struct registration_args *regargs) {
 	int retval = 0;
 	float *fwhm = NULL, *roundness = NULL, *A = NULL, *B = NULL, *Acut = NULL, *scores = NULL;
 	float *dist = NULL;
+	// the transforms and included flags of each trial reference
+	regdata *trial_regdata = NULL;
+	gboolean *trial_included = NULL;
 	// local flag (and its copy) accounting both for process_all_frames flag and collecting failures along the process
 	gboolean *included = NULL, *tmp_included = NULL;
 	// local flag to make checks only on frames that matter
@@ -858,6 +1000,7 @@ int register_multi_step_global(struct registration_args *regargs) {
 	sfargs->im.from_seq = regargs->seq;
 	sfargs->layer = regargs->layer;
 	sfargs->max_stars_fitted = regargs->max_stars_candidates;
+	sfargs->detection_binning = regargs->detection_binning;
 	sfargs->stars = calloc(regargs->seq->number, sizeof(psf_star **));
 	if (!sfargs->stars) {
 		PRINT_ALLOC_ERR;
@@ -895,7 +1038,10 @@ int register_multi_step_global(struct registration_args *regargs) {
 	meaningful = calloc(regargs->seq->number, sizeof(gboolean));
 	scores = calloc(regargs->seq->number, sizeof(float));
 	dist = calloc(regargs->seq->number, sizeof(float));
-	if (!fwhm || !roundness || !B || !A || !included || !tmp_included || !meaningful || !scores || !dist) {
+	trial_regdata = malloc(MAX_TRIALS_2PASS * regargs->seq->number * sizeof(regdata));
+	trial_included = malloc(MAX_TRIALS_2PASS * regargs->seq->number * sizeof(gboolean));
+	if (!fwhm || !roundness || !B || !A || !included || !tmp_included || !meaningful || !scores || !dist ||
+			!trial_regdata || !trial_included) {
 		PRINT_ALLOC_ERR;
 		retval = 1;
 		goto free_all;
@@ -986,6 +1132,7 @@ int register_multi_step_global(struct registration_args *regargs) {
 	}
 	int best_indexes[MAX_TRIALS_2PASS];
 	int nb_aligned[MAX_TRIALS_2PASS];
+	int trial_failed[MAX_TRIALS_2PASS];
 	best_indexes[trials] = best_index;
 	float allowable_dist = (float)regargs->seq->imgparam[regargs->reference_image].rx * MAX_SHIFT_RATIO;
 	int tmp_failed;
@@ -994,6 +1141,15 @@ int register_multi_step_global(struct registration_args *regargs) {
 		tmp_failed = failed;
 		for (int i = 0; i < regargs->seq->number; i++) tmp_included[i] = included[i];
 		nb_aligned[trials] = compute_transform(regargs, sfargs, tmp_included, &tmp_failed, fwhm, roundness, B, FALSE);
+		if (nb_aligned[trials] < 0) {
+			retval = 1;
+			goto free_all;
+		}
+		memcpy(trial_regdata + trials * regargs->seq->number, regargs->seq->regparam[regargs->layer],
+				regargs->seq->number * sizeof(regdata));
+		memcpy(trial_included + trials * regargs->seq->number, tmp_included,
+				regargs->seq->number * sizeof(gboolean));
+		trial_failed[trials] = tmp_failed;
 		// if number of aligned frames is less than half the number of meaningful frames (those with enough stars)
 		// we have chosen a reference which is not framed well enough to align the sequence (the computed cog is probably meaningless as well)
 		// we set its score to FLT_MAX and start again with the next best frame
@@ -1009,10 +1165,8 @@ int register_multi_step_global(struct registration_args *regargs) {
 				siril_log_message(_("Trial #%d: After sequence analysis, we are choosing image %d as new reference for registration\n"), trials + 1, reffilenum);
 				best_indexes[trials] = best_index;
 			}
-		} else { // not necessary but a simple to have print_alignment_results
-			tmp_failed = failed;
-			for (int i = 0; i < regargs->seq->number; i++) tmp_included[i] = included[i];
-			compute_transform(regargs, sfargs, tmp_included, &tmp_failed, fwhm, roundness, B, TRUE);
+		} else {
+			print_transforms(regargs, tmp_included, fwhm, roundness);
 			break;
 		}
 	}
@@ -1035,9 +1189,13 @@ int register_multi_step_global(struct registration_args *regargs) {
 		regargs->seq->reference_image = best_index;
 		reffilenum = regargs->seq->imgparam[best_index].filenum;	// for display purposes
 		siril_log_message(_("After sequence analysis, we are choosing image %d as new reference for registration\n"), reffilenum);
-		tmp_failed = failed;
-		for (int i = 0; i < regargs->seq->number; i++) tmp_included[i] = included[i];
-		compute_transform(regargs, sfargs, tmp_included, &tmp_failed, fwhm, roundness, B, TRUE);
+		// the transforms of this trial were kept
+		memcpy(regargs->seq->regparam[regargs->layer], trial_regdata + best_try * regargs->seq->number,
+				regargs->seq->number * sizeof(regdata));
+		memcpy(tmp_included, trial_included + best_try * regargs->seq->number,
+				regargs->seq->number * sizeof(gboolean));
+		tmp_failed = trial_failed[best_try];
+		print_transforms(regargs, tmp_included, fwhm, roundness);
 	}
 	// and we copy back to the initial arrays
 	for (int i = 0; i < regargs->seq->number; i++) included[i] = tmp_included[i];
@@ -1059,11 +1217,11 @@ int register_multi_step_global(struct registration_args *regargs) {
 		}
 		new_best_index = minidx(scores, included, regargs->seq->number, NULL);
 		if (new_best_index != best_index && new_best_index > -1) { // do not recompute if none or same is found (same should not happen)
-			regargs->seq->reference_image = new_best_index;
 			reffilenum = regargs->seq->imgparam[new_best_index].filenum;	// for display purposes
 			siril_log_message(_("After sequence analysis, we are choosing image %d as new reference for registration\n"), reffilenum);
-			// back to 3. compute the transforms and store them in regparams
-			compute_transform(regargs, sfargs, included, &failed, fwhm, roundness, B, TRUE);
+			// the new reference is aligned with the others, their transforms are composed with its own
+			rebase_transforms(regargs, sfargs, included, new_best_index);
+			print_transforms(regargs, included, fwhm, roundness);
 		} else {
 			siril_log_message(_("Could not find a better frame, keeping image %d as the reference for the sequence\n"), reffilenum);
 		}
@@ -1102,6 +1260,8 @@ free_all:
 	free(meaningful);
 	free(scores);
 	free(dist);
+	free(trial_regdata);
+	free(trial_included);
 	return retval;
 }
 
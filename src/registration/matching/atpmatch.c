@@ -315,6 +315,35 @@ static int calc_trans_quintic(int nbright, s_star *star_array_A, int num_stars_A
 		s_star *star_array_B, int num_stars_B, int *winner_votes,
 		int *winner_index_A, int *winner_index_B, TRANS *trans);
 
+/*
+ * triangles of a reference list, see atRefIndexNew() below
+ */
+typedef struct s_ref_triangles {
+	int nbright;		/* number of stars used to form the triangles */
+	int num_stars;		/* number of stars in star_array */
+	double radius;		/* matching radius the grid was made for */
+	s_star *star_array;	/* list B, sorted by magnitude */
+	s_triangle *triangles;	/* pruned triangles of star_array */
+	int num_triangles;
+	int grid_size;		/* number of cells in each dimension */
+	double cell_size;
+	int *cell_start;	/* index in cell_triangles of the first
+				   triangle of each cell, grid_size^2 + 1 */
+	int *cell_triangles;	/* triangle indices, ordered by cell */
+	struct s_ref_triangles *next;
+} s_ref_triangles;
+
+struct at_ref_index {
+	GMutex lock;
+	s_ref_triangles *first;
+};
+
+static s_ref_triangles *get_ref_triangles(at_ref_index *index, int numB,
+		struct s_star *listB, int nbright, double radius);
+static int **make_vote_matrix_indexed(s_triangle *t_array_A, int num_triangles_A,
+		s_ref_triangles *ref, int nbright, double max_radius, double min_scale,
+		double max_scale, double rotation_deg, double tolerance_deg);
+
 /************************************************************************
  * <AUTO EXTRACT>
  *
@@ -332,6 +361,9 @@ static int calc_trans_quintic(int nbright, s_star *star_array_A, int num_stars_A
  * functions to perform actual tasks.  It mostly creates the proper
  * inputs and outputs for the smaller routines.
  *
+ * atFindTransIndexed takes the triangles of chainB from a reference
+ * index, when the same chainB is matched against many chainA.
+ *
  * RETURN:
  *    SH_SUCCESS         if all goes well
  *    SH_GENERIC_ERROR   if an error occurs
@@ -339,10 +371,11 @@ static int calc_trans_quintic(int nbright, s_star *star_array_A, int num_stars_A
  * </AUTO>
  */
 
-int atFindTrans(int numA, /* I: number of stars in list A */
+int atFindTransIndexed(int numA, /* I: number of stars in list A */
 struct s_star *listA, /* I: match this set of objects with list B */
 int numB, /* I: number of stars in list B */
 struct s_star *listB, /* I: match this set of objects with list A */
+at_ref_index *ref_index, /* I: triangles of list B, may be NULL */
 double radius, /* I: max radius in triangle-space allowed for */
 /*       a pair of triangles to match */
 int nobj, /* I: max number of bright stars to use in creating */
@@ -378,6 +411,7 @@ TRANS *trans /* O: place into this TRANS structure's fields */
 	s_star *star_array_B;
 	s_triangle *triangle_array_A = NULL;
 	s_triangle *triangle_array_B = NULL;
+	s_ref_triangles *ref_triangles = NULL;
 
 	num_stars_A = numA;
 	num_stars_B = numB;
@@ -468,55 +502,78 @@ TRANS *trans /* O: place into this TRANS structure's fields */
 	triangle_array_A = stars_to_triangles(star_array_A, num_stars_A, min(num_stars_A, nbright),
 			&num_triangles_A);
 	g_assert(triangle_array_A != NULL);
-	triangle_array_B = stars_to_triangles(star_array_B, num_stars_B, min(num_stars_B, nbright),
-			&num_triangles_B);
-	g_assert(triangle_array_B != NULL);
+	if (ref_index) {
+		/*
+		 * the triangles of list B come from the reference index, and
+		 * we use the sorted copy of list B they were made from
+		 */
+		ref_triangles = get_ref_triangles(ref_index, numB, listB,
+				min(num_stars_B, nbright), radius);
+		if (ref_triangles) {
+			memcpy(star_array_B, ref_triangles->star_array, num_stars_B * sizeof(s_star));
+		}
+		prune_triangle_array(triangle_array_A, &num_triangles_A);
+		if (num_triangles_A <= 0 || !ref_triangles) {
+			shError("After pruning: No more stars in array A or B\n");
+			free_star_array(star_array_A);
+			free_star_array(star_array_B);
+			shFree(triangle_array_A);
+			return (SH_GENERIC_ERROR);
+		}
+		vote_matrix = make_vote_matrix_indexed(triangle_array_A, num_triangles_A,
+				ref_triangles, nbright, radius, min_scale, max_scale,
+				rotation_deg, tolerance_deg);
+	} else {
+		triangle_array_B = stars_to_triangles(star_array_B, num_stars_B, min(num_stars_B, nbright),
+				&num_triangles_B);
+		g_assert(triangle_array_B != NULL);
 
-	/*
-	 * Now we prune the triangle arrays to eliminate those with
-	 * ratios (b/a) > AT_MATCH_RATIO,
-	 * since Valdes et al. say that this speeds things up and eliminates
-	 * lots of closely-packed triangles.
-	 */
-	prune_triangle_array(triangle_array_A, &num_triangles_A);
-	prune_triangle_array(triangle_array_B, &num_triangles_B);
-	if (num_triangles_A <= 0 || num_triangles_B <= 0) {
-		shError("After pruning: No more stars in array A or B\n");
-		free_star_array(star_array_A);
-		free_star_array(star_array_B);
-		shFree(triangle_array_A);
-		shFree(triangle_array_B);
-		return (SH_GENERIC_ERROR);
-	}
+		/*
+		 * Now we prune the triangle arrays to eliminate those with
+		 * ratios (b/a) > AT_MATCH_RATIO,
+		 * since Valdes et al. say that this speeds things up and eliminates
+		 * lots of closely-packed triangles.
+		 */
+		prune_triangle_array(triangle_array_A, &num_triangles_A);
+		prune_triangle_array(triangle_array_B, &num_triangles_B);
+		if (num_triangles_A <= 0 || num_triangles_B <= 0) {
+			shError("After pruning: No more stars in array A or B\n");
+			free_star_array(star_array_A);
+			free_star_array(star_array_B);
+			shFree(triangle_array_A);
+			shFree(triangle_array_B);
+			return (SH_GENERIC_ERROR);
+		}
 #ifdef DEBUG2
-	printf("after pruning, here comes triangle array A\n");
-	print_triangle_array(triangle_array_A, num_triangles_A,
-			star_array_A, num_stars_A);
-	printf("after pruning, here comes triangle array B\n");
-	print_triangle_array(triangle_array_B, num_triangles_B,
-			star_array_B, num_stars_B);
+		printf("after pruning, here comes triangle array A\n");
+		print_triangle_array(triangle_array_A, num_triangles_A,
+				star_array_A, num_stars_A);
+		printf("after pruning, here comes triangle array B\n");
+		print_triangle_array(triangle_array_B, num_triangles_B,
+				star_array_B, num_stars_B);
 #endif
 
-	/*
-	 * Next, we want to try to match triangles in the two arrays.
-	 * What we do is to create a "vote matrix", which is a 2-D array
-	 * with "nbright"-by-"nbright" cells.  The cell with
-	 * coords [i][j] holds the number of matched triangles in which
-	 *
-	 *        item [i] in star_array_A matches item [j] in star_array_B
-	 *
-	 * We'll use this "vote_matrix" to figure out a first guess
-	 * at the transformation between coord systems.
-	 *
-	 * Note that if there are fewer than "nbright" stars
-	 * in either list, we'll still make the vote_matrix
-	 * contain "nbright"-by-"nbright" cells ...
-	 * there will just be a lot of cells filled with zero.
-	 */
-	vote_matrix = make_vote_matrix(star_array_A, num_stars_A, star_array_B,
-			num_stars_B, triangle_array_A, num_triangles_A, triangle_array_B,
-			num_triangles_B, nbright, radius, min_scale, max_scale,
-			rotation_deg, tolerance_deg);
+		/*
+		 * Next, we want to try to match triangles in the two arrays.
+		 * What we do is to create a "vote matrix", which is a 2-D array
+		 * with "nbright"-by-"nbright" cells.  The cell with
+		 * coords [i][j] holds the number of matched triangles in which
+		 *
+		 *        item [i] in star_array_A matches item [j] in star_array_B
+		 *
+		 * We'll use this "vote_matrix" to figure out a first guess
+		 * at the transformation between coord systems.
+		 *
+		 * Note that if there are fewer than "nbright" stars
+		 * in either list, we'll still make the vote_matrix
+		 * contain "nbright"-by-"nbright" cells ...
+		 * there will just be a lot of cells filled with zero.
+		 */
+		vote_matrix = make_vote_matrix(star_array_A, num_stars_A, star_array_B,
+				num_stars_B, triangle_array_A, num_triangles_A, triangle_array_B,
+				num_triangles_B, nbright, radius, min_scale, max_scale,
+				rotation_deg, tolerance_deg);
+	}
 
 	/*
 	 * having made the vote_matrix, we next need to pick the
@@ -611,6 +668,15 @@ TRANS *trans /* O: place into this TRANS structure's fields */
 	return (SH_SUCCESS);
 }
 
+int atFindTrans(int numA, struct s_star *listA, int numB, struct s_star *listB,
+		double radius, int nobj, double min_scale, double max_scale,
+		double rotation_deg, double tolerance_deg, int max_iter,
+		double halt_sigma, TRANS *trans) {
+	return atFindTransIndexed(numA, listA, numB, listB, NULL, radius, nobj,
+			min_scale, max_scale, rotation_deg, tolerance_deg, max_iter,
+			halt_sigma, trans);
+}
+
 int atPrepareHomography(int numA, /* I: number of stars in list A */
 		struct s_star *listA, /* I: match this set of objects with list B */
 		int numB, /* I: number of stars in list B */
@@ -2283,6 +2349,214 @@ print_vote_matrix
 
 #endif /* DEBUG */
 
+/************************************************************************
+ *
+ *
+ * ROUTINE: atRefIndexNew, atRefIndexFree
+ *
+ * DESCRIPTION:
+ * A reference index keeps the triangles formed from a reference list of
+ * stars B, so that they are computed only once when many lists A are matched
+ * against the same list B, like the frames of a sequence against the
+ * reference frame. The triangles are hashed on a grid of the triangle space
+ * (ba, ca) whose cells are at least "radius" wide, so that the candidates
+ * matching a triangle of A are found in the 3x3 cells around it instead of
+ * scanning a range of "ba" values.
+ *
+ * One set of triangles is kept for each number of bright stars used, as it
+ * changes with the size of the lists and the matching attempts. A reference
+ * index must only be used with a single list B and is thread-safe.
+ *
+ * </AUTO>
+ */
+
+#define AT_REF_MAX_GRID 1024
+
+static int ref_cell_coord(const s_ref_triangles *ref, double value) {
+	int c = (int) (value / ref->cell_size);
+	if (c < 0)
+		return 0;
+	if (c >= ref->grid_size)
+		return ref->grid_size - 1;
+	return c;
+}
+
+static void free_ref_triangles(s_ref_triangles *ref) {
+	shFree(ref->star_array);
+	shFree(ref->triangles);
+	g_free(ref->cell_start);
+	g_free(ref->cell_triangles);
+	g_free(ref);
+}
+
+static s_ref_triangles *new_ref_triangles(int numB, struct s_star *listB,
+		int nbright, double radius) {
+	s_ref_triangles *ref = g_new0(s_ref_triangles, 1);
+	ref->nbright = nbright;
+	ref->num_stars = numB;
+	ref->radius = radius;
+	ref->star_array = list_to_array(numB, listB);
+	ref->triangles = stars_to_triangles(ref->star_array, numB, nbright,
+			&ref->num_triangles);
+	g_assert(ref->triangles != NULL);
+	prune_triangle_array(ref->triangles, &ref->num_triangles);
+	if (ref->num_triangles <= 0) {
+		free_ref_triangles(ref);
+		return NULL;
+	}
+
+	/* ba and ca are both in [0, 1] */
+	ref->cell_size = max(radius, 1.0 / AT_REF_MAX_GRID);
+	ref->grid_size = (int) ceil(1.0 / ref->cell_size) + 1;
+	int nb_cells = ref->grid_size * ref->grid_size;
+	ref->cell_start = g_new0(int, nb_cells + 1);
+	ref->cell_triangles = g_new(int, ref->num_triangles);
+	int *cell_of = g_new(int, ref->num_triangles);
+	for (int i = 0; i < ref->num_triangles; i++) {
+		cell_of[i] = ref_cell_coord(ref, ref->triangles[i].ba) * ref->grid_size +
+			ref_cell_coord(ref, ref->triangles[i].ca);
+		ref->cell_start[cell_of[i] + 1]++;
+	}
+	for (int c = 0; c < nb_cells; c++)
+		ref->cell_start[c + 1] += ref->cell_start[c];
+	int *fill = g_new(int, nb_cells);
+	memcpy(fill, ref->cell_start, nb_cells * sizeof(int));
+	for (int i = 0; i < ref->num_triangles; i++)
+		ref->cell_triangles[fill[cell_of[i]]++] = i;
+	g_free(fill);
+	g_free(cell_of);
+	return ref;
+}
+
+at_ref_index *atRefIndexNew() {
+	at_ref_index *index = g_new0(at_ref_index, 1);
+	g_mutex_init(&index->lock);
+	return index;
+}
+
+void atRefIndexFree(at_ref_index *index) {
+	if (!index)
+		return;
+	s_ref_triangles *ref = index->first;
+	while (ref) {
+		s_ref_triangles *next = ref->next;
+		free_ref_triangles(ref);
+		ref = next;
+	}
+	g_mutex_clear(&index->lock);
+	g_free(index);
+}
+
+/* returns the triangles of list B for nbright stars, creating them if needed */
+static s_ref_triangles *get_ref_triangles(at_ref_index *index, int numB,
+		struct s_star *listB, int nbright, double radius) {
+	s_ref_triangles *ref;
+	g_mutex_lock(&index->lock);
+	for (ref = index->first; ref; ref = ref->next) {
+		if (ref->nbright == nbright && ref->num_stars == numB && ref->radius == radius)
+			break;
+	}
+	if (!ref) {
+		ref = new_ref_triangles(numB, listB, nbright, radius);
+		if (ref) {
+			ref->next = index->first;
+			index->first = ref;
+		}
+	}
+	g_mutex_unlock(&index->lock);
+	return ref;
+}
+
+/************************************************************************
+ *
+ *
+ * ROUTINE: make_vote_matrix_indexed
+ *
+ * DESCRIPTION:
+ * Same as make_vote_matrix, with the triangles of array B taken from a
+ * reference index. We walk through the triangles of array A and look for
+ * the triangles of B in the grid cells around each of them, which gives
+ * the same votes as make_vote_matrix.
+ *
+ * RETURN:
+ *    int **             pointer to new "vote matrix"
+ *
+ * </AUTO>
+ */
+
+static int **
+make_vote_matrix_indexed(s_triangle *t_array_A, /* I: array of triangles from star_array_A */
+int num_triangles_A, /* I: number of triangles in t_array_A */
+s_ref_triangles *ref, /* I: triangles from star_array_B */
+int nbright, /* I: size of the output "vote_matrix" */
+double max_radius, /* I: max radius in triangle-space allowed */
+double min_scale, /* I: minimum permitted relative scale factor */
+double max_scale, /* I: maximum permitted relative scale factor */
+double rotation_deg, /* I: desired relative angle of coord systems (deg) */
+double tolerance_deg /* I: allowed range of orientation angles (deg) */
+) {
+	int i, j;
+	int **vote_matrix;
+	double rad2 = max_radius * max_radius;
+	double actual_angle_deg;
+	s_triangle *t_array_B = ref->triangles;
+
+	vote_matrix = (int **) shMalloc(nbright * sizeof(int *));
+	for (i = 0; i < nbright; i++) {
+		vote_matrix[i] = (int *) shMalloc(nbright * sizeof(int));
+		for (j = 0; j < nbright; j++) {
+			vote_matrix[i][j] = 0;
+		}
+	}
+
+	for (i = 0; i < num_triangles_A; i++) {
+		s_triangle *tri_A = &(t_array_A[i]);
+		if ((tri_A->a_index >= nbright) || (tri_A->b_index >= nbright)
+				|| (tri_A->c_index >= nbright)) {
+			continue;
+		}
+		int cba = ref_cell_coord(ref, tri_A->ba);
+		int cca = ref_cell_coord(ref, tri_A->ca);
+		for (int x = max(cba - 1, 0); x <= min(cba + 1, ref->grid_size - 1); x++) {
+			for (int y = max(cca - 1, 0); y <= min(cca + 1, ref->grid_size - 1); y++) {
+				int cell = x * ref->grid_size + y;
+				for (int k = ref->cell_start[cell]; k < ref->cell_start[cell + 1]; k++) {
+					s_triangle *tri_B = &(t_array_B[ref->cell_triangles[k]]);
+					if ((tri_B->a_index >= nbright) || (tri_B->b_index >= nbright)
+							|| (tri_B->c_index >= nbright)) {
+						continue;
+					}
+					double dba = tri_A->ba - tri_B->ba;
+					double dca = tri_A->ca - tri_B->ca;
+					if (dba * dba + dca * dca >= rad2)
+						continue;
+					if (min_scale != -1) {
+						double ratio = tri_A->a_length / tri_B->a_length;
+						if (ratio < min_scale || ratio > max_scale) {
+							continue;
+						}
+					}
+					if (rotation_deg != AT_MATCH_NOANGLE) {
+						if (is_desired_rotation(tri_A, tri_B, rotation_deg,
+								tolerance_deg, &actual_angle_deg) == 0) {
+							continue;
+						}
+					}
+					vote_matrix[tri_A->a_index][tri_B->a_index]++;
+					vote_matrix[tri_A->b_index][tri_B->b_index]++;
+					vote_matrix[tri_A->c_index][tri_B->c_index]++;
+				}
+			}
+		}
+	}
+
+#ifdef DEBUG
+	print_vote_matrix(vote_matrix, nbright);
+#endif
+
+	return (vote_matrix);
+}
+
 /************************************************************************
  *
  *
@@ -231,6 +231,17 @@ int atFindTrans(int numA, s_star *listA, int numB, s_star *listB,
                 double rotation_deg, double tolerance_deg,
                 int max_iter, double halt_sigma, TRANS *trans);
 
+typedef struct at_ref_index at_ref_index;
+
+at_ref_index *atRefIndexNew();
+void atRefIndexFree(at_ref_index *index);
+
+int atFindTransIndexed(int numA, s_star *listA, int numB, s_star *listB,
+                at_ref_index *ref_index,
+                double radius, int nbright, double min_scale, double max_scale,
+                double rotation_deg, double tolerance_deg,
+                int max_iter, double halt_sigma, TRANS *trans);
+
 int atApplyTrans(int num, s_star *list, TRANS *trans);
 
 int atMatchLists(int numA, s_star *listA, int numB, s_star *listB,
@@ -128,10 +128,12 @@ static int prepare_to_recalc(int num_matched_A,
 // if TRUE, we should have a trans_order input and a TRANS* output
 // if FALSE, we should have a transformation_type input and a Homography * output
 // The function starts by making sure we have the correct inputs/outputs set
-int new_star_match(psf_star **s1, psf_star **s2, int n1, int n2, int nobj_override,
+// new_star_match_indexed does the same with a reference index on s2, which
+// keeps the triangles of s2 when it is matched against many lists
+int new_star_match_indexed(psf_star **s1, psf_star **s2, int n1, int n2, int nobj_override,
 		double min_scale, double max_scale, Homography *H, TRANS *t,
 		gboolean for_astrometry, transformation_type type, int trans_type,
-		s_star **out_list_A, s_star **out_list_B) {
+		s_star **out_list_A, s_star **out_list_B, at_ref_index *ref_index) {
 	//sanity checks
 	if (for_astrometry) {
 		g_assert(t != NULL);
@@ -239,9 +241,9 @@ int new_star_match(psf_star **s1, psf_star **s2, int n1, int n2, int nobj_overri
 	/* Now, as the has not given us an initial TRANS structure, we need
 	 * to find one ourselves.
 	 */
-	int ret = atFindTrans(numA, star_list_A, numB, star_list_B, triangle_radius,
-			nobj, min_scale, max_scale, rot_angle, rot_tol, max_iter,
-			halt_sigma, trans);
+	int ret = atFindTransIndexed(numA, star_list_A, numB, star_list_B, ref_index,
+			triangle_radius, nobj, min_scale, max_scale, rot_angle, rot_tol,
+			max_iter, halt_sigma, trans);
 	if (ret != SH_SUCCESS) {
 #ifdef DEBUG
 		fprintf(stderr, "initial call to atFindTrans failed\n");
@@ -441,6 +443,15 @@ int new_star_match(psf_star **s1, psf_star **s2, int n1, int n2, int nobj_overri
 	return 0;
 }
 
+int new_star_match(psf_star **s1, psf_star **s2, int n1, int n2, int nobj_override,
+		double min_scale, double max_scale, Homography *H, TRANS *t,
+		gboolean for_astrometry, transformation_type type, int trans_type,
+		s_star **out_list_A, s_star **out_list_B) {
+	return new_star_match_indexed(s1, s2, n1, n2, nobj_override, min_scale,
+			max_scale, H, t, for_astrometry, type, trans_type, out_list_A,
+			out_list_B, NULL);
+}
+
 // star_match can output either:
 // - a Homography matrix (with the right order, set with transformation_type) for linear transformations only (global alignment)
 // - a trans matrix (with the right order, set with trans_order) for astrometry solve which can be linear, quadratic or cubic
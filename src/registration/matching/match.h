@@ -12,6 +12,11 @@ int new_star_match(psf_star **s1, psf_star **s2, int n1, int n2, int nobj_overri
 		double s_min, double s_max, Homography *H, TRANS *t, gboolean for_astrometry,
 		transformation_type type, int trans_type, s_star **out_list_A, s_star **out_list_B);
 
+int new_star_match_indexed(psf_star **s1, psf_star **s2, int n1, int n2, int nobj_override,
+		double s_min, double s_max, Homography *H, TRANS *t, gboolean for_astrometry,
+		transformation_type type, int trans_type, s_star **out_list_A, s_star **out_list_B,
+		at_ref_index *ref_index);
+
 int re_star_match(psf_star **s1, psf_star **s2, int n1, int n2,
 		TRANS *trans, s_star **out_list_A, s_star **out_list_B);
 
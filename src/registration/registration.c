@@ -253,7 +253,7 @@ gpointer register_thread_func(gpointer p) {
 		writeseqfile(args->seq);
 	retval = args->retval;
 	if (args->disto) {
-		free_disto_args(args->disto);
+		free_disto_args(args->disto, args->seq->number);
 		free(args->disto);
 	}
 	if (args->driz) {
@@ -87,6 +87,7 @@ struct star_align_data {
 	regdata *current_regdata;
 	psf_star **refstars;
 	int fitted_stars;
+	struct at_ref_index *ref_index;	// triangles of refstars for matching
 	BYTE *success;
 	point ref;
 };
@@ -113,6 +114,7 @@ struct registration_args {
 	struct starfinder_data *sfargs;		// star finder configuration for global/2pass
 	int min_pairs;			// Minimum number of star pairs for success
 	int max_stars_candidates;	// Max candidates after psf fitting for global reg
+	int detection_binning;		// if > 1, detect stars on a binned image (global, 2pass)
 	transformation_type type;	// Use affine transform  or homography
 	float percent_moved;		// for KOMBAT algorithm
 	pointf velocity;			// for comet algorithm
@@ -24,10 +24,12 @@
 
 #include "core/siril.h"
 #include "core/siril_log.h"
+#include "core/OS_utils.h"
 #include "drizzle/cdrizzleutil.h"
 #include "gui/utils.h" // TODO: used functions should not be in the gui section
 #include "algos/quality.h"
 #include "io/ser.h"
+#include "io/frame_cache.h"
 #include "opencv/opencv.h"
 #include "opencv/kombat/kombat.h"
 
@@ -52,6 +54,122 @@ static void normalizeQualityData(struct registration_args *args, double q_min, d
 	}
 }
 
+/* the spectrum of the reference frame of the last DFT registration, kept
+ * between runs to avoid reading and transforming it again */
+static struct {
+	gchar *key;
+	fftwf_complex *spectrum;
+	size_t nb_values;
+	double quality;
+} refdft_cache = { NULL, NULL, 0, 0.0 };
+static GMutex refdft_cache_mutex;
+
+static gchar *get_refdft_key(struct registration_args *args, int ref_image, const char *pattern) {
+	if (args->seq->type == SEQ_INTERNAL)
+		return NULL;
+	gchar *file_id = frame_cache_get_file_id(args->seq, ref_image);
+	if (!file_id)
+		return NULL;
+	gchar *key = g_strdup_printf("%s|%d|%d,%d,%d,%d|%s", file_id, args->layer,
+			args->selection.x, args->selection.y, args->selection.w,
+			args->selection.h, pattern);
+	g_free(file_id);
+	return key;
+}
+
+static fftwf_complex *refdft_cache_get(const gchar *key, size_t nb_values, double *quality) {
+	if (!key)
+		return NULL;
+	fftwf_complex *spectrum = NULL;
+	g_mutex_lock(&refdft_cache_mutex);
+	if (refdft_cache.key && !strcmp(refdft_cache.key, key) && refdft_cache.nb_values == nb_values) {
+		spectrum = fftwf_malloc(sizeof(fftwf_complex) * nb_values);
+		if (spectrum) {
+			memcpy(spectrum, refdft_cache.spectrum, sizeof(fftwf_complex) * nb_values);
+			*quality = refdft_cache.quality;
+		}
+	}
+	g_mutex_unlock(&refdft_cache_mutex);
+	return spectrum;
+}
+
+static void refdft_cache_put(const gchar *key, const fftwf_complex *spectrum, size_t nb_values, double quality) {
+	if (!key)
+		return;
+	fftwf_complex *copy = fftwf_malloc(sizeof(fftwf_complex) * nb_values);
+	if (!copy)
+		return;
+	memcpy(copy, spectrum, sizeof(fftwf_complex) * nb_values);
+	g_mutex_lock(&refdft_cache_mutex);
+	g_free(refdft_cache.key);
+	if (refdft_cache.spectrum)
+		fftwf_free(refdft_cache.spectrum);
+	refdft_cache.key = g_strdup(key);
+	refdft_cache.spectrum = copy;
+	refdft_cache.nb_values = nb_values;
+	refdft_cache.quality = quality;
+	g_mutex_unlock(&refdft_cache_mutex);
+}
+
+/* The frames are transformed in batches by a single plan, with the real to
+ * complex transform, which only computes half of the spectrum of the square
+ * selection: size * (size / 2 + 1) values */
+typedef fftwf_plan (*dft_planner)(int size, int howmany, float *r, fftwf_complex *c, unsigned flags);
+
+static fftwf_plan plan_forward_batch(int size, int howmany, float *r, fftwf_complex *c, unsigned flags) {
+	int n[2] = { size, size };
+	return fftwf_plan_many_dft_r2c(2, n, howmany, r, NULL, 1, size * size,
+			c, NULL, 1, size * (size / 2 + 1), flags);
+}
+
+static fftwf_plan plan_backward_batch(int size, int howmany, float *r, fftwf_complex *c, unsigned flags) {
+	int n[2] = { size, size };
+	return fftwf_plan_many_dft_c2r(2, n, howmany, c, NULL, 1, size * (size / 2 + 1),
+			r, NULL, 1, size * size, flags | FFTW_DESTROY_INPUT);
+}
+
+static fftwf_plan plan_with_wisdom(dft_planner planner, int size, int howmany,
+		float *r, fftwf_complex *c, const gchar *wisdomFile) {
+	// test for available wisdom
+	fftwf_plan plan = planner(size, howmany, r, c, FFTW_WISDOM_ONLY);
+	if (!plan) {
+		// no wisdom available, load wisdom from file
+		fftwf_import_wisdom_from_filename(wisdomFile);
+		// test again for wisdom
+		plan = planner(size, howmany, r, c, FFTW_WISDOM_ONLY);
+		if (!plan) {
+			// build plan with FFTW_MEASURE
+			plan = planner(size, howmany, r, c, FFTW_MEASURE);
+			// save the wisdom
+			fftwf_export_wisdom_to_filename(wisdomFile);
+		}
+	}
+	return plan;
+}
+
+/* two frames per thread, to read some while others are converted, and the
+ * batch must not take more than half of the memory allowed */
+static int get_dft_batch_size(unsigned int size, int nb_frames) {
+	size_t frame_mem = (size_t) size * size * sizeof(float)
+		+ (size_t) size * (size / 2 + 1) * sizeof(fftwf_complex);
+	size_t max_mem = (size_t) get_max_memory_in_MB() * BYTES_IN_A_MB / 2;
+	int batch = com.max_thread * 2;
+	if ((size_t) batch * frame_mem > max_mem)
+		batch = max_mem / frame_mem;
+	if (batch > nb_frames)
+		batch = nb_frames;
+	return max(batch, 1);
+}
+
+static void copy_selection_to_dft(fits *fit, float *dest, unsigned int sqsize) {
+	if (fit->type == DATA_USHORT) {
+		for (unsigned int x = 0; x < sqsize; x++)
+			dest[x] = (float)fit->data[x];
+	} else if (fit->type == DATA_FLOAT) {
+		memcpy(dest, fit->fdata, sqsize * sizeof(float));
+	}
+}
+
 /* Calculate shift in images to be aligned with the reference image, using
  * discrete Fourier transform on a square selected area and matching the
  * phases.
@@ -59,8 +177,9 @@ static void normalizeQualityData(struct registration_args *args, double q_min, d
 int register_shift_dft(struct registration_args *args) {
 	fits fit_ref = { 0 };
 	struct timeval t_start, t_end;
-	unsigned int frame, size, sqsize, j;
-	fftwf_complex *ref, *in, *out, *convol;
+	unsigned int size, sqsize, specsize;
+	float *img;
+	fftwf_complex *ref_spec, *spec;
 	fftwf_plan p, q;
 	int ret;
 	int abort = 0;
@@ -68,13 +187,14 @@ int register_shift_dft(struct registration_args *args) {
 	int cur_nb = 0;
 	int ref_image;
 	regdata *current_regdata;
-	double q_max = 0, q_min = DBL_MAX;
+	double q_max = 0, q_min = DBL_MAX, ref_quality = 0.0;
 	char pattern[37] = { 0 };
 
 	/* the selection needs to be squared for the DFT */
 	assert(args->selection.w == args->selection.h);
 	size = args->selection.w;
 	sqsize = size * size;
+	specsize = size * (size / 2 + 1);
 
 	if (args->filters.filter_included)
 		nb_frames = (float) args->seq->selnum;
@@ -102,11 +222,7 @@ int register_shift_dft(struct registration_args *args) {
 			_("Register DFT: loading and processing reference frame"),
 			PROGRESS_NONE);
 	ret = seq_read_frame_metadata(args->seq, ref_image, &fit_ref);
-	if (!ret)
-		ret = seq_read_frame_part(args->seq, args->layer, ref_image, &fit_ref,
-			&args->selection, FALSE, -1);
-
-	if (ret || ((fit_ref.type == DATA_USHORT && !fit_ref.data) || (fit_ref.type == DATA_FLOAT && !fit_ref.fdata))) {
+	if (ret) {
 		siril_log_message(
 				_("Register: could not load first image to register, aborting.\n"));
 		args->seq->regparam[args->layer] = NULL;
@@ -139,148 +255,175 @@ int register_shift_dft(struct registration_args *args) {
 		} else {
 			strcpy(pattern, fit_ref.keywords.bayer_pattern);
 		}
-		strcpy(fit_ref.keywords.bayer_pattern, pattern);
-		fit_ref.keywords.bayer_xoffset = args->selection.x;
-		fit_ref.keywords.bayer_yoffset = args->selection.y;
-		interpolate_nongreen(&fit_ref);
+	}
+
+	gchar *cache_key = get_refdft_key(args, ref_image, pattern);
+	ref_spec = refdft_cache_get(cache_key, specsize, &ref_quality);
+	if (ref_spec) {
+		siril_log_message(_("Reusing the reference frame of the previous run\n"));
+		clearfits(&fit_ref);
+	} else {
+		ret = seq_read_frame_part(args->seq, args->layer, ref_image, &fit_ref,
+				&args->selection, FALSE, -1);
+		if (ret || ((fit_ref.type == DATA_USHORT && !fit_ref.data) || (fit_ref.type == DATA_FLOAT && !fit_ref.fdata))) {
+			siril_log_message(
+					_("Register: could not load first image to register, aborting.\n"));
+			args->seq->regparam[args->layer] = NULL;
+			free(current_regdata);
+			clearfits(&fit_ref);
+			g_free(cache_key);
+			return ret ? ret : 1;
+		}
+		if (args->seq->nb_layers == 1) {
+			strcpy(fit_ref.keywords.bayer_pattern, pattern);
+			fit_ref.keywords.bayer_xoffset = args->selection.x;
+			fit_ref.keywords.bayer_yoffset = args->selection.y;
+			interpolate_nongreen(&fit_ref);
+		}
 	}
 	gettimeofday(&t_start, NULL);
 
-	ref = fftwf_malloc(sizeof(fftwf_complex) * sqsize);
-	in = fftwf_malloc(sizeof(fftwf_complex) * sqsize);
-	out = fftwf_malloc(sizeof(fftwf_complex) * sqsize);
-	convol = fftwf_malloc(sizeof(fftwf_complex) * sqsize);
+	int batch = get_dft_batch_size(size, (int) nb_frames);
+	img = fftwf_malloc(sizeof(float) * sqsize * batch);
+	spec = fftwf_malloc(sizeof(fftwf_complex) * specsize * batch);
+	int *batch_frames = malloc(batch * sizeof(int));
+	gboolean *batch_top_down = malloc(batch * sizeof(gboolean));
+	if (!img || !spec || !batch_frames || !batch_top_down) {
+		PRINT_ALLOC_ERR;
+		fftwf_free(img);
+		fftwf_free(spec);
+		fftwf_free(ref_spec);
+		free(batch_frames);
+		free(batch_top_down);
+		clearfits(&fit_ref);
+		g_free(cache_key);
+		args->seq->regparam[args->layer] = NULL;
+		free(current_regdata);
+		return -2;
+	}
+	siril_debug_print("DFT registration: %d frames per batch\n", batch);
 
 	set_wisdom_file();
 	gchar* wisdomFile = com.pref.fftw_conf.wisdom_file;
 #ifdef HAVE_FFTW3F_MULTITHREAD
 	fftwf_plan_with_nthreads(com.max_thread);
 #endif
-	// test for available wisdom
-	p = fftwf_plan_dft_2d(size, size, ref, out, FFTW_FORWARD, FFTW_WISDOM_ONLY);
-	if (!p) {
-		// no wisdom available, load wisdom from file
-		fftwf_import_wisdom_from_filename(wisdomFile);
-		// test again for wisdom
-		p = fftwf_plan_dft_2d(size, size, ref, out, FFTW_FORWARD, FFTW_WISDOM_ONLY);
-		if (!p) {
-			// build plan with FFTW_MEASURE
-			p = fftwf_plan_dft_2d(size, size, ref, out, FFTW_FORWARD, FFTW_MEASURE);
-			// save the wisdom
-			fftwf_export_wisdom_to_filename(wisdomFile);
-		}
-	}
-
-	q = fftwf_plan_dft_2d(size, size, convol, out, FFTW_BACKWARD, FFTW_WISDOM_ONLY | FFTW_DESTROY_INPUT);
-	if (!q) {
-		// no wisdom available, load wisdom from file
-		fftwf_import_wisdom_from_filename(wisdomFile);
-		// test again for wisdom
-		q = fftwf_plan_dft_2d(size, size, convol, out, FFTW_BACKWARD, FFTW_WISDOM_ONLY | FFTW_DESTROY_INPUT);
-		if (!q) {
-			// build plan with FFTW_MEASURE
-			q = fftwf_plan_dft_2d(size, size, convol, out, FFTW_BACKWARD, FFTW_MEASURE | FFTW_DESTROY_INPUT);
-			// save the wisdom
-			fftwf_export_wisdom_to_filename(wisdomFile);
+	// planning may overwrite the buffers, it has to be done before filling them
+	p = plan_with_wisdom(plan_forward_batch, size, batch, img, spec, wisdomFile);
+	q = plan_with_wisdom(plan_backward_batch, size, batch, img, spec, wisdomFile);
+
+	memset(img, 0, sizeof(float) * sqsize * batch);
+	if (!ref_spec) {
+		// the reference is transformed in the first slot of the batch
+		copy_selection_to_dft(&fit_ref, img, sqsize);
+		// We don't need fit_ref anymore, we can destroy it.
+		ref_quality = QualityEstimate(&fit_ref, args->layer);
+		clearfits(&fit_ref);
+		fftwf_execute(p);
+		ref_spec = fftwf_malloc(sizeof(fftwf_complex) * specsize);
+		if (ref_spec) {
+			memcpy(ref_spec, spec, sizeof(fftwf_complex) * specsize);
+			refdft_cache_put(cache_key, ref_spec, specsize, ref_quality);
+		} else {
+			PRINT_ALLOC_ERR;
+			abort = ret = 1;
 		}
 	}
-	fftwf_free(out); // was needed to build the plan, can be freed now
-	fftwf_free(convol); // was needed to build the plan, can be freed now
-
-	// copying image selection into the fftw data
-	if (fit_ref.type == DATA_USHORT) {
-		for (j = 0; j < sqsize; j++)
-			ref[j] = (float)fit_ref.data[j];
-	}
-	else if (fit_ref.type == DATA_FLOAT) {
-		for (j = 0; j < sqsize; j++)
-			ref[j] = fit_ref.fdata[j];
-	}
-
-	// We don't need fit_ref anymore, we can destroy it.
-	current_regdata[ref_image].quality = QualityEstimate(&fit_ref, args->layer);
-	clearfits(&fit_ref);
-	fftwf_execute_dft(p, ref, in); /* repeat as needed */
-
-	fftwf_free(ref); // not needed anymore
+	g_free(cache_key);
 
+	current_regdata[ref_image].quality = ref_quality;
 	set_shifts(args->seq, ref_image, args->layer, 0.0, 0.0, FALSE);
 
 	q_min = q_max = current_regdata[ref_image].quality;
 	int q_index = ref_image;
 
+	int frame = 0;
+	while (!abort && frame < args->seq->number) {
+		/* gathering the next batch of frames */
+		int n = 0;
+		for (; frame < args->seq->number && n < batch; frame++) {
+			if (frame == ref_image) continue;
+			if (args->filters.filter_included && !args->seq->imgparam[frame].incl)
+				continue;
+			batch_frames[n++] = frame;
+		}
+		if (n == 0)
+			break;
+
+		/* reading the frames, in parallel when possible */
 #ifdef _OPENMP
-#pragma omp parallel for num_threads(com.max_thread) schedule(guided) \
+#pragma omp parallel for num_threads(com.max_thread) schedule(dynamic) \
 	if (args->seq->type == SEQ_SER || ((args->seq->type == SEQ_REGULAR || args->seq->type == SEQ_FITSEQ) && fits_is_reentrant()))
 #endif
-	for (frame = 0; frame < args->seq->number; ++frame) {
-		if (abort) continue;
-		if (args->run_in_thread && !get_thread_run()) {
-			abort = 1;
-			continue;
-		}
-		if (frame == ref_image) continue;
-		if (args->filters.filter_included && !args->seq->imgparam[frame].incl)
-			continue;
-
-		fits fit = { 0 };
-		char tmpmsg[1024], tmpfilename[256];
-
-		seq_get_image_filename(args->seq, frame, tmpfilename);
-		g_snprintf(tmpmsg, 1024, _("Register: processing image %s"), tmpfilename);
-		set_progress_bar_data(tmpmsg, PROGRESS_NONE);
-		int thread_id = -1;
+		for (int k = 0; k < n; k++) {
+			if (abort) continue;
+			if (args->run_in_thread && !get_thread_run()) {
+				abort = 1;
+				continue;
+			}
+			int fr = batch_frames[k];
+			fits fit = { 0 };
+			int thread_id = -1;
 #ifdef _OPENMP
-		thread_id = omp_get_thread_num();
+			thread_id = omp_get_thread_num();
 #endif
-		if (!seq_read_frame_metadata(args->seq, frame, &fit) && !seq_read_frame_part(args->seq, args->layer, frame, &fit,
-						&args->selection, FALSE, thread_id)) {
-			int x;
+			if (seq_read_frame_metadata(args->seq, fr, &fit) || seq_read_frame_part(args->seq,
+						args->layer, fr, &fit, &args->selection, FALSE, thread_id)) {
+				clearfits(&fit);
+				abort = ret = 1;
+				continue;
+			}
 			strcpy(fit.keywords.bayer_pattern, pattern);
 			fit.keywords.bayer_xoffset = args->selection.x;
 			fit.keywords.bayer_yoffset = args->selection.y;
 			interpolate_nongreen(&fit);
-			fftwf_complex *img = fftwf_malloc(sizeof(fftwf_complex) * sqsize);
-			fftwf_complex *out2 = fftwf_malloc(sizeof(fftwf_complex) * sqsize);
 
 			// copying image selection into the fftw data
-			if (fit.type == DATA_USHORT) {
-				for (x = 0; x < sqsize; x++)
-					img[x] = (float)fit.data[x];
-			}
-			if (fit.type == DATA_FLOAT) {
-				for (x = 0; x < sqsize; x++)
-					img[x] = fit.fdata[x];
-			}
+			copy_selection_to_dft(&fit, img + (size_t) k * sqsize, sqsize);
+			batch_top_down[k] = fit.top_down;
 
-			current_regdata[frame].quality = QualityEstimate(&fit, args->layer);
+			current_regdata[fr].quality = QualityEstimate(&fit, args->layer);
 			// after this call, fit data is dead
+			clearfits(&fit);
 
 #ifdef _OPENMP
 #pragma omp critical
 #endif
 			{
-				double qual = current_regdata[frame].quality;
+				double qual = current_regdata[fr].quality;
 				if (qual > q_max) {
 					q_max = qual;
-					q_index = frame;
+					q_index = fr;
 				}
 				q_min = min(q_min, qual);
 			}
+		}
+		if (abort)
+			break;
 
-			fftwf_execute_dft(p, img, out2); /* repeat as needed */
-
-			fftwf_complex *convol2 = img; // reuse buffer
+		/* the slots after n keep data of the previous batch
+		 * and their results are ignored */
+		fftwf_execute(p);
 
-			for (x = 0; x < sqsize; x++) {
-				convol2[x] = in[x] * conjf(out2[x]);
-			}
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(com.max_thread) schedule(static)
+#endif
+		for (int k = 0; k < n; k++) {
+			fftwf_complex *convol = spec + (size_t) k * specsize;
+			for (unsigned int x = 0; x < specsize; x++)
+				convol[x] = ref_spec[x] * conjf(convol[x]);
+		}
 
-			fftwf_execute_dft(q, convol2, out2); /* repeat as needed */
+		fftwf_execute(q);
 
-			int shift = 0;
-			for (x = 1; x < sqsize; ++x) {
-				if (crealf(out2[x]) > crealf(out2[shift])) {
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(com.max_thread) schedule(static)
+#endif
+		for (int k = 0; k < n; k++) {
+			const float *corr = img + (size_t) k * sqsize;
+			unsigned int shift = 0;
+			for (unsigned int x = 1; x < sqsize; ++x) {
+				if (corr[x] > corr[shift]) {
 					shift = x;
 					// break or get last value?
 				}
@@ -294,40 +437,33 @@ int register_shift_dft(struct registration_args *args) {
 				shiftx -= size;
 			}
 
-			set_shifts(args->seq, frame, args->layer, (float)shiftx, (float)shifty,
-					fit.top_down);
-
-			// We don't need fit anymore, we can destroy it.
-			clearfits(&fit);
-
 			/* shiftx and shifty are the x and y values for translation that
 			 * would make this image aligned with the reference image.
 			 * WARNING: the y value is counted backwards, since the FITS is
 			 * stored down from up.
 			 */
+			set_shifts(args->seq, batch_frames[k], args->layer, (float)shiftx, (float)shifty,
+					batch_top_down[k]);
 #ifdef DEBUG
 			fprintf(stderr,
 					"reg: frame %d, shiftx=%f shifty=%f quality=%g\n",
-					args->seq->imgparam[frame].filenum,
-					current_regdata[frame].shiftx, current_regdata[frame].shifty,
-					current_regdata[frame].quality);
+					args->seq->imgparam[batch_frames[k]].filenum,
+					current_regdata[batch_frames[k]].shiftx, current_regdata[batch_frames[k]].shifty,
+					current_regdata[batch_frames[k]].quality);
 #endif
-			g_atomic_int_inc(&cur_nb);
-			set_progress_bar_data(NULL, (float)cur_nb / nb_frames);
-			fftwf_free(img);
-			fftwf_free(out2);
-		} else {
-			//report_fits_error(ret, error_buffer);
-			args->seq->regparam[args->layer] = NULL;
-			free(current_regdata);
-			abort = ret = 1;
-			continue;
 		}
+
+		cur_nb += n;
+		set_progress_bar_data(_("Register DFT: processing images"), (float)cur_nb / nb_frames);
 	}
 
 	fftwf_destroy_plan(p);
 	fftwf_destroy_plan(q);
-	fftwf_free(in);
+	fftwf_free(img);
+	fftwf_free(spec);
+	fftwf_free(ref_spec);
+	free(batch_frames);
+	free(batch_top_down);
 	if (!ret) {
 		normalizeQualityData(args, q_min, q_max);
 
@@ -0,0 +1,336 @@
+/*
+ * This file is part of Siril, an astronomy image processor.
+ * Copyright (C) 2005-2011 Francois Meyer (dulle at free.fr)
+ * Copyright (C) 2012-2025 team free-astro (see more in AUTHORS file)
+ * Reference site is https://siril.org
+ *
+ * Siril is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Siril is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Siril. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Incremental stacking
+ * The per-pixel accumulators of the streaming mean stacking are kept in a file
+ * next to the sequence, with the list of the images they contain. When the
+ * sequence is stacked again with the -incremental option, only the images
+ * that are not yet in the accumulators are read and folded into them, using
+ * the same normalization reference. The file is in the native byte order, it
+ * is a cache that can be removed at any time to restart a stack.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <glib/gstdio.h>
+
+#include "core/siril.h"
+#include "core/proto.h"
+#include "core/siril_date.h"
+#include "core/siril_log.h"
+#include "io/sequence.h"
+#include "stacking/stacking.h"
+#include "stacking/accumulator.h"
+
+#define ACCUMULATOR_MAGIC "SIRILACC"
+#define ACCUMULATOR_VERSION 1
+
+gchar *stack_accumulator_filename(sequence *seq) {
+	return g_strdup_printf("%s.acc", seq->seqname);
+}
+
+static struct stack_accumulator *accumulator_new(int rx, int ry, int nb_layers) {
+	struct stack_accumulator *acc = calloc(1, sizeof(struct stack_accumulator));
+	if (!acc) {
+		PRINT_ALLOC_ERR;
+		return NULL;
+	}
+	size_t n = (size_t)rx * ry * nb_layers;
+	acc->rx = rx;
+	acc->ry = ry;
+	acc->nb_layers = nb_layers;
+	acc->mean = calloc(4 * n, sizeof(double));
+	acc->count = calloc(n, sizeof(guint32));
+	if (!acc->mean || !acc->count) {
+		PRINT_ALLOC_ERR;
+		stack_accumulator_free(acc);
+		return NULL;
+	}
+	acc->m2 = acc->mean + n;
+	acc->sum = acc->m2 + n;
+	acc->norm = acc->sum + n;
+	acc->skip_frame = -1;
+	return acc;
+}
+
+void stack_accumulator_free(struct stack_accumulator *acc) {
+	if (!acc) return;
+	free(acc->filenums);
+	free(acc->mean);
+	free(acc->count);
+	g_free(acc->date_first);
+	g_free(acc->date_last);
+	free(acc);
+}
+
+static gboolean write_data(FILE *f, const void *data, size_t size) {
+	return fwrite(data, 1, size, f) == size;
+}
+
+static gboolean read_data(FILE *f, void *data, size_t size) {
+	return fread(data, 1, size, f) == size;
+}
+
+static gboolean write_string(FILE *f, const gchar *str) {
+	guint32 len = str ? strlen(str) : 0;
+	return write_data(f, &len, sizeof len) && (!len || write_data(f, str, len));
+}
+
+static gboolean read_string(FILE *f, gchar **str) {
+	guint32 len;
+	*str = NULL;
+	if (!read_data(f, &len, sizeof len) || len > 64)
+		return FALSE;
+	if (!len)
+		return TRUE;
+	*str = g_malloc0(len + 1);
+	return read_data(f, *str, len);
+}
+
+static int accumulator_save(struct stack_accumulator *acc, const char *filename) {
+	gchar *tmpname = g_strdup_printf("%s.tmp", filename);
+	FILE *f = g_fopen(tmpname, "wb");
+	if (!f) {
+		siril_log_color_message(_("Could not open %s for writing\n"), "red", tmpname);
+		g_free(tmpname);
+		return ST_GENERIC_ERROR;
+	}
+	guint32 version = ACCUMULATOR_VERSION;
+	gint32 header[8] = { acc->rx, acc->ry, acc->nb_layers, acc->bitpix,
+		acc->type_of_rejection, acc->normalize, acc->upscale_at_stacking,
+		acc->ref_filenum };
+	size_t n = (size_t)acc->rx * acc->ry * acc->nb_layers;
+	gboolean ok = write_data(f, ACCUMULATOR_MAGIC, 8) &&
+		write_data(f, &version, sizeof version) &&
+		write_data(f, header, sizeof header) &&
+		write_data(f, acc->sig, sizeof acc->sig) &&
+		write_data(f, &acc->stackcnt, sizeof acc->stackcnt) &&
+		write_data(f, &acc->livetime, sizeof acc->livetime) &&
+		write_string(f, acc->date_first) &&
+		write_data(f, &acc->exp_first, sizeof acc->exp_first) &&
+		write_string(f, acc->date_last) &&
+		write_data(f, &acc->exp_last, sizeof acc->exp_last) &&
+		write_data(f, &acc->nb_frames, sizeof acc->nb_frames) &&
+		write_data(f, acc->filenums, acc->nb_frames * sizeof(int)) &&
+		write_data(f, acc->mean, 4 * n * sizeof(double)) &&
+		write_data(f, acc->count, n * sizeof(guint32));
+	if (fclose(f))
+		ok = FALSE;
+	if (ok) {
+		g_unlink(filename);
+		ok = !g_rename(tmpname, filename);
+	}
+	if (!ok) {
+		siril_log_color_message(_("Could not save the incremental stack to %s\n"), "red", filename);
+		g_unlink(tmpname);
+	}
+	g_free(tmpname);
+	return ok ? ST_OK : ST_GENERIC_ERROR;
+}
+
+static struct stack_accumulator *accumulator_load(const char *filename) {
+	FILE *f = g_fopen(filename, "rb");
+	if (!f)
+		return NULL;
+	struct stack_accumulator *acc = NULL;
+	char magic[8];
+	guint32 version;
+	gint32 header[8];
+	if (!read_data(f, magic, 8) || memcmp(magic, ACCUMULATOR_MAGIC, 8) ||
+			!read_data(f, &version, sizeof version) || version != ACCUMULATOR_VERSION ||
+			!read_data(f, header, sizeof header) ||
+			header[0] <= 0 || header[1] <= 0 || header[2] <= 0 || header[2] > 3)
+		goto failed;
+	acc = accumulator_new(header[0], header[1], header[2]);
+	if (!acc)
+		goto failed;
+	acc->bitpix = header[3];
+	acc->type_of_rejection = header[4];
+	acc->normalize = header[5];
+	acc->upscale_at_stacking = header[6];
+	acc->ref_filenum = header[7];
+	size_t n = (size_t)acc->rx * acc->ry * acc->nb_layers;
+	if (!read_data(f, acc->sig, sizeof acc->sig) ||
+			!read_data(f, &acc->stackcnt, sizeof acc->stackcnt) ||
+			!read_data(f, &acc->livetime, sizeof acc->livetime) ||
+			!read_string(f, &acc->date_first) ||
+			!read_data(f, &acc->exp_first, sizeof acc->exp_first) ||
+			!read_string(f, &acc->date_last) ||
+			!read_data(f, &acc->exp_last, sizeof acc->exp_last) ||
+			!read_data(f, &acc->nb_frames, sizeof acc->nb_frames) ||
+			acc->nb_frames < 0)
+		goto failed;
+	acc->filenums = malloc(max(acc->nb_frames, 1) * sizeof(int));
+	if (!acc->filenums ||
+			!read_data(f, acc->filenums, acc->nb_frames * sizeof(int)) ||
+			!read_data(f, acc->mean, 4 * n * sizeof(double)) ||
+			!read_data(f, acc->count, n * sizeof(guint32)))
+		goto failed;
+	fclose(f);
+	return acc;
+
+failed:
+	siril_log_color_message(_("The incremental stack file %s is invalid, ignoring it\n"), "salmon", filename);
+	stack_accumulator_free(acc);
+	fclose(f);
+	return NULL;
+}
+
+static gboolean accumulator_has_frame(struct stack_accumulator *acc, int filenum) {
+	for (int i = 0; i < acc->nb_frames; i++)
+		if (acc->filenums[i] == filenum)
+			return TRUE;
+	return FALSE;
+}
+
+static gboolean accumulator_is_compatible(struct stack_accumulator *acc,
+		struct stacking_args *args, int rx, int ry, int ref_filenum) {
+	return acc->rx == rx && acc->ry == ry &&
+		acc->nb_layers == args->seq->nb_layers &&
+		acc->bitpix == args->seq->bitpix &&
+		acc->type_of_rejection == args->type_of_rejection &&
+		acc->sig[0] == args->sig[0] && acc->sig[1] == args->sig[1] &&
+		acc->normalize == args->normalize &&
+		acc->upscale_at_stacking == args->upscale_at_stacking &&
+		acc->ref_filenum == ref_filenum;
+}
+
+/* loads the accumulators of the sequence, or creates new ones, and restricts
+ * the list of images to stack to those that are not accumulated yet. The
+ * reference image is always kept first, for normalization and metadata */
+int stack_incremental_prepare(struct stacking_args *args) {
+	sequence *seq = args->seq;
+	int scale = args->upscale_at_stacking ? 2 : 1;
+	int rx = seq->rx * scale, ry = seq->ry * scale;
+	int ref_filenum = seq->imgparam[args->ref_image].filenum;
+
+	gchar *filename = stack_accumulator_filename(seq);
+	struct stack_accumulator *acc = accumulator_load(filename);
+	g_free(filename);
+	if (acc && !accumulator_is_compatible(acc, args, rx, ry, ref_filenum)) {
+		siril_log_color_message(_("The incremental stack was made with different images or "
+					"stacking parameters, starting a new one\n"), "salmon");
+		stack_accumulator_free(acc);
+		acc = NULL;
+	}
+
+	if (!acc) {
+		acc = accumulator_new(rx, ry, seq->nb_layers);
+		if (!acc)
+			return ST_ALLOC_ERROR;
+		acc->bitpix = seq->bitpix;
+		acc->type_of_rejection = args->type_of_rejection;
+		memcpy(acc->sig, args->sig, sizeof acc->sig);
+		acc->normalize = args->normalize;
+		acc->upscale_at_stacking = args->upscale_at_stacking;
+		acc->ref_filenum = ref_filenum;
+		acc->nb_new_frames = args->nb_images_to_stack;
+		args->acc = acc;
+		siril_log_message(_("Starting a new incremental stack\n"));
+		return ST_OK;
+	}
+
+	int *indices = malloc((args->nb_images_to_stack + 1) * sizeof(int));
+	if (!indices) {
+		PRINT_ALLOC_ERR;
+		stack_accumulator_free(acc);
+		return ST_ALLOC_ERROR;
+	}
+	gboolean ref_is_selected = FALSE;
+	int n = 1;
+	indices[0] = args->ref_image;
+	for (int i = 0; i < args->nb_images_to_stack; i++) {
+		int index = args->image_indices[i];
+		if (index == args->ref_image) {
+			ref_is_selected = TRUE;
+			continue;
+		}
+		if (!accumulator_has_frame(acc, seq->imgparam[index].filenum))
+			indices[n++] = index;
+	}
+	if (!ref_is_selected || accumulator_has_frame(acc, ref_filenum))
+		acc->skip_frame = 0;
+	acc->nb_new_frames = acc->skip_frame == 0 ? n - 1 : n;
+
+	siril_log_message(_("Incremental stacking: %d images already stacked, %d new images\n"),
+			acc->nb_frames, acc->nb_new_frames);
+	if (acc->nb_new_frames == 0)
+		siril_log_message(_("No new image to stack, the result is computed from the previous stack\n"));
+
+	free(args->image_indices);
+	args->image_indices = indices;
+	args->nb_images_to_stack = n;
+	args->acc = acc;
+	return ST_OK;
+}
+
+/* adds the first and last dates of the accumulated images to the list of the
+ * current run and keeps the extreme ones for the next run */
+void stack_incremental_add_dates(struct stacking_args *args, GList **list_date) {
+	struct stack_accumulator *acc = args->acc;
+	GDateTime *dt;
+	if (acc->date_first && (dt = FITS_date_to_date_time(acc->date_first)))
+		*list_date = g_list_prepend(*list_date, new_date_item(dt, acc->exp_first));
+	if (acc->date_last && (dt = FITS_date_to_date_time(acc->date_last)))
+		*list_date = g_list_prepend(*list_date, new_date_item(dt, acc->exp_last));
+
+	DateEvent *first = NULL, *last = NULL;
+	for (GList *l = *list_date; l; l = l->next) {
+		DateEvent *item = (DateEvent *)l->data;
+		if (!first || g_date_time_compare(item->date_obs, first->date_obs) < 0)
+			first = item;
+		if (!last || g_date_time_compare(item->date_obs, last->date_obs) > 0)
+			last = item;
+	}
+	if (first) {
+		g_free(acc->date_first);
+		acc->date_first = date_time_to_FITS_date(first->date_obs);
+		acc->exp_first = first->exposure;
+		g_free(acc->date_last);
+		acc->date_last = date_time_to_FITS_date(last->date_obs);
+		acc->exp_last = last->exposure;
+	}
+}
+
+/* records the images of the current run in the accumulators and saves them */
+int stack_incremental_commit(struct stacking_args *args) {
+	struct stack_accumulator *acc = args->acc;
+	int *filenums = realloc(acc->filenums, (acc->nb_frames + acc->nb_new_frames + 1) * sizeof(int));
+	if (!filenums) {
+		PRINT_ALLOC_ERR;
+		return ST_ALLOC_ERROR;
+	}
+	acc->filenums = filenums;
+	for (int i = 0; i < args->nb_images_to_stack; i++) {
+		if (i == acc->skip_frame)
+			continue;
+		acc->filenums[acc->nb_frames++] = args->seq->imgparam[args->image_indices[i]].filenum;
+	}
+	acc->stackcnt = args->result.keywords.stackcnt;
+	acc->livetime = args->result.keywords.livetime;
+
+	gchar *filename = stack_accumulator_filename(args->seq);
+	int retval = accumulator_save(acc, filename);
+	if (!retval)
+		siril_log_message(_("Incremental stack saved in %s, it now contains %d images\n"),
+				filename, acc->nb_frames);
+	g_free(filename);
+	return retval;
+}
@@ -0,0 +1,44 @@
+#ifndef _STACK_ACCUMULATOR_H
+#define _STACK_ACCUMULATOR_H
+
+#include "stacking.h"
+
+/* per-pixel accumulators of an incremental mean stack, for the full image.
+ * Pixel index is (channel * ry + row) * rx + column, rows in the order they
+ * are read from the images */
+struct stack_accumulator {
+	int rx, ry, nb_layers;
+	int bitpix;			// of the input images
+	rejection type_of_rejection;
+	float sig[2];
+	normalization normalize;
+	gboolean upscale_at_stacking;
+	int ref_filenum;		// file number of the normalization reference
+
+	int nb_frames;			// number of frames already accumulated
+	int *filenums;			// their file numbers
+	guint stackcnt;			// for the STACKCNT keyword
+	double livetime;		// for the LIVETIME keyword
+	gchar *date_first, *date_last;	// FITS dates of the first and last frames
+	double exp_first, exp_last;	// and their exposure
+
+	double *mean;			// running mean of the non-null values
+	double *m2;			// running sum of squared deviations
+	double *sum;			// weighted sum of the kept values
+	double *norm;			// sum of the weights of the kept values
+	guint32 *count;			// number of non-null values
+
+	/* run-time data, not saved */
+	int skip_frame;			// index in image_indices of the reference when it
+					// is only used for normalization, -1 otherwise
+	int nb_new_frames;		// number of frames added by the current run
+};
+
+gchar *stack_accumulator_filename(sequence *seq);
+void stack_accumulator_free(struct stack_accumulator *acc);
+
+int stack_incremental_prepare(struct stacking_args *args);
+void stack_incremental_add_dates(struct stacking_args *args, GList **list_date);
+int stack_incremental_commit(struct stacking_args *args);
+
+#endif
@@ -22,6 +22,7 @@
 #include "core/proto.h"
 #include "core/siril_log.h"
 #include "io/sequence.h"
+#include "io/image_format_fits.h"
 #include "opencv/opencv.h"
 
 #include "stacking/stacking.h"
@@ -68,16 +69,23 @@ gchar *get_mask_filename(sequence *seq, int index) {
 	return maskpath;
 }
 
-// check if we need to create the mask or if it already exists
+/* check if we need to create the mask or if it already exists. The masks only
+ * depend on the image: the framing and the feathering distance are applied
+ * when they are read for stacking, so they are kept between stacks */
 static gboolean compute_mask_read_hook(struct generic_seq_args *args, int i) {
-	const gchar *mask_filename = get_mask_filename(args->seq, i);
+	gchar *mask_filename = get_mask_filename(args->seq, i);
 	if (!mask_filename) {
 		return TRUE;
 	}
-	if (!g_file_test(mask_filename, G_FILE_TEST_EXISTS)) { // mask file does not exist, we need to read and create the file
-		return TRUE;
-	}
-	if (check_cachefile_date(args->seq, i, mask_filename)) { // the mask exists and is more recent than the img, we don't need to read again
+	int rx = (args->seq->is_variable) ? args->seq->imgparam[i].rx : args->seq->rx;
+	int ry = (args->seq->is_variable) ? args->seq->imgparam[i].ry : args->seq->ry;
+	int mask_rx = 0, mask_ry = 0;
+	compute_downscaled_mask_size(rx, ry, &mask_rx, &mask_ry, NULL, NULL);
+	// the mask must be more recent than the image and have its geometry
+	gboolean valid = check_cachefile_date(args->seq, i, mask_filename) &&
+		check_mask_fits(mask_filename, mask_rx, mask_ry);
+	g_free(mask_filename);
+	if (valid) {
 		siril_log_message(_("Mask for image %d already exists, skipping\n"), i + 1);
 		return FALSE;
 	}
@@ -98,7 +106,7 @@ static int compute_mask_compute_mem_limits(struct generic_seq_args *args, gboole
 	*/
 
 	int seqrx = 0, seqry = 0, maskrx = 0, maskry = 0;
-	size_t imgsize = get_max_seq_dimension(args->seq, &seqrx, &seqrx);
+	size_t imgsize = get_max_seq_dimension(args->seq, &seqrx, &seqry);
 	compute_downscaled_mask_size(seqrx, seqry, &maskrx, &maskry, NULL, NULL);
 	size_t memory_per_8b_orig_image = imgsize * sizeof(uint8_t);
 	size_t memory_per_scaled_image = maskrx * maskry * sizeof(float);
@@ -183,7 +191,7 @@ static int compute_mask_image_hook(struct generic_seq_args *args, int o, int i,
 	cvDownscaleBlendMask(rx, ry, rx_out, ry_out, buffer8in, buffer32out);
 
 	//we save the mask
-	const gchar *mask_filename = get_mask_filename(args->seq, i);
+	gchar *mask_filename = get_mask_filename(args->seq, i);
 	if (!mask_filename) {
 		siril_debug_print("failed to create the mask filename");
 		free(buffer8in);
@@ -192,10 +200,12 @@ static int compute_mask_image_hook(struct generic_seq_args *args, int o, int i,
 	}
 	if (save_mask_fits(rx_out, ry_out, buffer32out, mask_filename)) {
 		siril_log_color_message(_("Failed to save mask for image %d\n"), "red", i + 1);
+		g_free(mask_filename);
 		free(buffer8in);
 		free(buffer32out);
 		return 1;
 	}
+	g_free(mask_filename);
 	free(buffer8in);
 	free(buffer32out);
 	return 0;
@@ -27,18 +27,29 @@
 #include "core/proto.h"
 #include "core/OS_utils.h"
 #include "core/siril_log.h"
+#include "core/trace.h"
+#include "core/memory_report.h"
+#include "io/io_stats.h"
 #include "io/sequence.h"
 #include "io/ser.h"
 #include "io/image_format_fits.h"
+#include "io/fits_handle_pool.h"
+#ifdef HAVE_LIBRAW
+#include "io/raw_sequence.h"
+#endif
 #include "gui/progress_and_log.h"
 #include "algos/sorting.h"
 #include "algos/statistics.h"
 #include "algos/siril_wcs.h"
+#include "algos/half_float.h"
 #include "stacking/stacking.h"
 #include "stacking/siril_fit_linear.h"
 #include "stacking/blending.h"
+#include "stacking/accumulator.h"
+#include "stacking/readahead.h"
 #include "registration/registration.h"
 #include "opencv/opencv.h"
+#include "opencv/opencl_stacking.h"
 
 static int stack_mean_or_median(struct stacking_args *args, gboolean is_mean);
 
@@ -60,9 +71,132 @@ static int stack_mean_or_median(struct stacking_args *args, gboolean is_mean);
  * remaining ones is used.
  * ****************************************************************************/
 
+/* Blocks of regular FITS sequences are read through a pool of cfitsio handles:
+ * threads reading the same image don't wait for each other and the number of
+ * images is not limited by the number of files that can be opened. The pool
+ * has room for each image to stay opened, plus one handle per thread, if the
+ * system allows it. */
+static int stack_create_handle_pool(struct stacking_args *args) {
+	int nb_allowed_files;
+	allow_to_open_files(0, &nb_allowed_files);
+	/* at least one handle, the images being then opened one after the other */
+	int max_files = max(1, nb_allowed_files - STACK_RESERVED_FILES);
+	int capacity = min(args->nb_images_to_stack + com.max_thread, max_files);
+	args->seq->fd_pool = fits_handle_pool_new(args->seq, capacity, max_files);
+	if (!args->seq->fd_pool) {
+		/* without the pool, all images stay opened */
+		if (!allow_to_open_files(args->nb_images_to_stack, &nb_allowed_files)) {
+			siril_log_message(_("Your system does not allow one to open more than %d files at the same time. "
+						"You may consider either to enhance this limit (the method depends of "
+						"your Operating System) or to convert your FITS sequence into a SER "
+						"sequence before stacking, or to stack with the \"sum\" method.\n"),
+					nb_allowed_files);
+			return ST_GENERIC_ERROR;
+		}
+		return ST_OK;
+	}
+	if (capacity < args->nb_images_to_stack)
+		siril_log_message(_("Stacking %d images with at most %d files opened at the same time\n"),
+				args->nb_images_to_stack, capacity);
+	return ST_OK;
+}
+
+static void stack_free_handle_pool(struct stacking_args *args) {
+	fits_handle_pool_free(args->seq->fd_pool);
+	args->seq->fd_pool = NULL;
+}
+
+/* Dual-alignment stacking: the frames are stacked aligned on the stars with
+ * their registration, and aligned on a moving object like a comet, shifted by
+ * its motion since the reference frame, from the same reads. The vertical
+ * shifts of both alignments differ by a few rows at most, so the rows of a
+ * block are read for both at once, extra_rows more than the block height, and
+ * each alignment has its own stacks and rejection. */
+struct stack_comet {
+	GDateTime **dates;	// observation date of each frame
+	int extra_rows;		// rows read in addition to the height of a block
+	int *read_shifty;	// vertical shift of the rows read from each frame
+	int *shiftx[2];		// horizontal shift of each frame, aligned on the stars and on the object
+	int *row[2];		// row of the rows read from each frame where the block starts, same
+};
+
+#ifdef HAVE_LIBRAW
+/* The RAW files are decoded in parallel to get their metadata, which fills
+ * the cache of the decoded frames for the reads of the blocks */
+static int stack_open_raw_files(struct stacking_args *args, int *bitpix, int *naxis, long *naxes,
+		GList **list_date, fits *fit) {
+	int nb_frames = args->nb_images_to_stack;
+	int skip_frame = args->acc ? args->acc->skip_frame : -1;
+	if (args->maximize_framing) {
+		siril_log_message(_("Maximum framing is not supported for RAW sequences\n"));
+		return ST_GENERIC_ERROR;
+	}
+	fits *frames = calloc(nb_frames, sizeof(fits));
+	if (!frames) {
+		PRINT_ALLOC_ERR;
+		return ST_ALLOC_ERROR;
+	}
+	int retval = ST_OK;
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(com.max_thread) schedule(dynamic) if (com.max_thread > 1)
+#endif
+	for (int i = 0; i < nb_frames; ++i) {
+		if (retval || !get_thread_run())
+			continue;
+		if (raw_sequence_read_metadata(args->seq, args->image_indices[i], &frames[i])) {
+			siril_log_message(_("Opening image %d failed\n"), args->image_indices[i]);
+			retval = ST_SEQUENCE_ERROR;
+		}
+	}
+	if (!retval && !get_thread_run())
+		retval = ST_GENERIC_ERROR;
+
+	double livetime = 0.0;
+	for (int i = 0; i < nb_frames && !retval; ++i) {
+		if (frames[i].rx != frames[0].rx || frames[i].ry != frames[0].ry) {
+			siril_log_color_message(_("Image %d does not have the same size as the first image of the sequence\n"),
+					"red", args->image_indices[i]);
+			retval = ST_SEQUENCE_ERROR;
+			break;
+		}
+		GDateTime *dt = frames[i].keywords.date_obs;
+		if (args->comet && dt)
+			args->comet->dates[i] = g_date_time_ref(dt);
+		if (i != skip_frame) {
+			if (dt)
+				*list_date = g_list_prepend(*list_date,
+						new_date_item(g_date_time_ref(dt), frames[i].keywords.exposure));
+			livetime += frames[i].keywords.exposure;
+		}
+		if (args->image_indices[i] == args->ref_image)
+			copy_fits_metadata(&frames[i], fit);
+	}
+	if (!retval) {
+		naxes[0] = frames[0].rx;
+		naxes[1] = frames[0].ry;
+		naxes[2] = 1;
+		*naxis = 2;
+		*bitpix = USHORT_IMG;
+		if (args->upscale_at_stacking) {
+			naxes[0] *= 2;
+			naxes[1] *= 2;
+		}
+		fit->keywords.stackcnt = skip_frame >= 0 ? nb_frames - 1 : nb_frames;
+		fit->keywords.livetime = livetime;
+	}
+	for (int i = 0; i < nb_frames; ++i)
+		clearfits(&frames[i]);
+	free(frames);
+	return retval;
+}
+#endif
+
 int stack_open_all_files(struct stacking_args *args, int *bitpix, int *naxis, long *naxes,
 		GList **list_date, fits *fit) {
 	int nb_frames = args->nb_images_to_stack;
+	// in incremental mode, the reference may be opened only for metadata
+	int skip_frame = args->acc ? args->acc->skip_frame : -1;
+	int nb_new_frames = skip_frame >= 0 ? nb_frames - 1 : nb_frames;
 	guint stackcnt = 0;
 	double livetime = 0.0;
 	*bitpix = 0;
@@ -93,6 +227,8 @@ int stack_open_all_files(struct stacking_args *args, int *bitpix, int *naxis, lo
 			*naxis = naxes[2] == 3 ? 3 : 2;
 			*bitpix = args->seq->fitseq_file->bitpix;
 		}
+		if (args->seq->type == SEQ_REGULAR && stack_create_handle_pool(args))
+			return ST_GENERIC_ERROR;
 		double scale = (args->upscale_at_stacking) ? 2. : 1.;
 		for (int i = 0; i < nb_frames; ++i) {
 			int image_index = args->image_indices[i]; // image index in sequence
@@ -127,10 +263,16 @@ int stack_open_all_files(struct stacking_args *args, int *bitpix, int *naxis, lo
 			GDateTime *dt = NULL;
 
 			get_date_data_from_fitsfile(fptr, &dt, &current_exp, &current_livetime, &stack_count);
-			if (dt)
-				*list_date = g_list_prepend(*list_date, new_date_item(dt, current_exp));
-			livetime += current_livetime;
-			stackcnt += stack_count;
+			if (args->comet && dt)
+				args->comet->dates[i] = g_date_time_ref(dt);
+			if (i == skip_frame) {
+				if (dt) g_date_time_unref(dt);
+			} else {
+				if (dt)
+					*list_date = g_list_prepend(*list_date, new_date_item(dt, current_exp));
+				livetime += current_livetime;
+				stackcnt += stack_count;
+			}
 
 			/* We copy metadata from reference to the final fit */
 			if (image_index == args->ref_image)
@@ -149,16 +291,23 @@ int stack_open_all_files(struct stacking_args *args, int *bitpix, int *naxis, lo
 			/*we compute the dest size if maximize_framing*/
 			if (args->maximize_framing) {
 				regdata *regdat = args->seq->regparam[args->reglayer];
-				int rx = (args->seq->is_variable) ? args->seq->imgparam[image_index].rx : args->seq->rx;
-				int ry = (args->seq->is_variable) ? args->seq->imgparam[image_index].ry : args->seq->ry;
+				double rx = scale * ((args->seq->is_variable) ? args->seq->imgparam[image_index].rx : args->seq->rx);
+				double ry = scale * ((args->seq->is_variable) ? args->seq->imgparam[image_index].ry : args->seq->ry);
 				xmin = (xmin > regdat[image_index].H.h02 * scale) ? regdat[image_index].H.h02 * scale : xmin;
 				ymin = (ymin > regdat[image_index].H.h12 * scale) ? regdat[image_index].H.h12 * scale : ymin;
 				xmax = (xmax < regdat[image_index].H.h02 * scale + rx) ? regdat[image_index].H.h02 * scale + rx : xmax;
 				ymax = (ymax < regdat[image_index].H.h12 * scale + ry) ? regdat[image_index].H.h12 * scale + ry : ymax;
 			}
+
+			if (args->seq->fd_pool) {
+				// keep the handle in the pool if there is room for it
+				if (!fits_handle_pool_adopt(args->seq->fd_pool, image_index, fptr))
+					args->seq->fptr[image_index] = NULL;
+				else seq_close_image(args->seq, image_index);
+			}
 		}
 		if (stackcnt <= 0)
-			stackcnt = nb_frames;
+			stackcnt = nb_new_frames;
 		fit->keywords.stackcnt = stackcnt;
 		fit->keywords.livetime = livetime;
 		// keeping exposure of the reference frame
@@ -166,6 +315,8 @@ int stack_open_all_files(struct stacking_args *args, int *bitpix, int *naxis, lo
 		if (naxes[2] == 0)
 			naxes[2] = 1;
 		g_assert(naxes[2] <= 3);
+		naxes[0] *= (long)scale;
+		naxes[1] *= (long)scale;
 
 		gboolean update_wcs = TRUE;
 		if (args->maximize_framing) {
@@ -176,6 +327,9 @@ int stack_open_all_files(struct stacking_args *args, int *bitpix, int *naxis, lo
 			args->offset[1] = -(int)ymin;
 			siril_debug_print("new size: %ld %ld\n", naxes[0], naxes[1]);
 			siril_debug_print("new origin: %d %d\n", args->offset[0], args->offset[1]);
+		} else if (args->warp_H) {
+			// the frames are transformed to the reference frame
+			update_wcs = FALSE;
 		} else if (layer_has_registration(args->seq, args->reglayer)) {
 			double dx, dy;
 			translation_from_H(args->seq->regparam[args->reglayer][args->ref_image].H, &dx, &dy);
@@ -194,7 +348,7 @@ int stack_open_all_files(struct stacking_args *args, int *bitpix, int *naxis, lo
 			Hs.h02 = dx - args->offset[0];
 			Hs.h12 = args->offset[1] - dy;
 			// int orig_rx = (args->seq->is_variable) ? args->seq->imgparam[args->seq->reference_image].rx : args->seq->rx;
-			int orig_ry = (args->seq->is_variable) ? args->seq->imgparam[args->seq->reference_image].ry : args->seq->ry;
+			int orig_ry = (int)scale * ((args->seq->is_variable) ? args->seq->imgparam[args->seq->reference_image].ry : args->seq->ry);
 			// siril_debug_print("size: %d %d\n", orig_rx, orig_ry);
 			cvApplyFlips(&Hs, orig_ry, naxes[1]);
 			reframe_wcs(fit->keywords.wcslib, &Hs);
@@ -210,6 +364,10 @@ int stack_open_all_files(struct stacking_args *args, int *bitpix, int *naxis, lo
 			type_ser = SER_MONO;
 		naxes[2] = type_ser == SER_MONO ? 1 : 3;
 		*naxis = type_ser == SER_MONO ? 2 : 3;
+		if (args->upscale_at_stacking) {
+			naxes[0] *= 2;
+			naxes[1] *= 2;
+		}
 		/* case of Super Pixel not handled yet */
 		if (com.pref.debayer.open_debayer && com.pref.debayer.bayer_inter == BAYER_SUPER_PIXEL) {
 			siril_log_message(_("Super-pixel is not handled yet for on the fly SER stacking\n"));
@@ -219,18 +377,41 @@ int stack_open_all_files(struct stacking_args *args, int *bitpix, int *naxis, lo
 		import_metadata_from_serfile(args->seq->ser_file, fit);
 		for (int i = 0; i < nb_frames; ++i) {
 			int image_index = args->image_indices[i]; // image index in sequence
+			if (i == skip_frame)
+				continue;
 			GDateTime *dt = ser_read_frame_date(args->seq->ser_file, image_index);
+			if (args->comet && dt)
+				args->comet->dates[i] = g_date_time_ref(dt);
 			if (dt)
 				*list_date = g_list_prepend(*list_date,	new_date_item(dt, 0.0));
 		}
-		fit->keywords.stackcnt = nb_frames;
-		fit->keywords.livetime = fit->keywords.exposure * nb_frames;
+		fit->keywords.stackcnt = nb_new_frames;
+		fit->keywords.livetime = fit->keywords.exposure * nb_new_frames;
 		// keeping the fallacious exposure based on fps from the header
-	} else {
+	}
+#ifdef HAVE_LIBRAW
+	else if (args->seq->type == SEQ_RAW) {
+		int retval = stack_open_raw_files(args, bitpix, naxis, naxes, list_date, fit);
+		if (retval)
+			return retval;
+	}
+#endif
+	else {
 		siril_log_message(_("Rejection stacking is only supported for FITS images/sequences and SER sequences.\nUse \"Sum Stacking\" instead.\n"));
 		return ST_SEQUENCE_ERROR;
 	}
 
+	if (args->upscale_at_stacking) {
+		fit->keywords.pixel_size_x /= 2.;
+		fit->keywords.pixel_size_y /= 2.;
+	}
+
+	if (args->acc) {
+		stack_incremental_add_dates(args, list_date);
+		fit->keywords.stackcnt += args->acc->stackcnt;
+		fit->keywords.livetime += args->acc->livetime;
+	}
+
 	set_progress_bar_data(NULL, PROGRESS_DONE);
 	siril_debug_print("stack count: %u, livetime: %f\n", fit->keywords.stackcnt, fit->keywords.livetime);
 	return ST_OK;
@@ -275,12 +456,22 @@ static int refine_blocks_candidate(int nb_threads, int nb_channels, int minimum_
  * it will process sequentially.
  * To improve load distribution, blocks should be small enough to allow all
  * threads to work but as big as possible for the available memory.
+ * Since the cost of blocks varies with the number of rejection iterations,
+ * blocks_per_thread can request more blocks than the memory requires, that
+ * threads take from the queue of blocks until it is empty, so that they all
+ * finish at about the same time. Blocks will not be made smaller than
+ * STACK_MIN_BLOCK_HEIGHT for that.
  */
-int stack_compute_parallel_blocks(struct _image_block **blocksptr, long max_number_of_rows,
-		const long naxes[3], int nb_threads, long *largest_block_height, int *nb_blocks) {
+int stack_compute_balanced_blocks(struct _image_block **blocksptr, long max_number_of_rows,
+		const long naxes[3], int nb_threads, int blocks_per_thread,
+		long *largest_block_height, int *nb_blocks) {
 	int candidate = nb_threads;	// candidate number of blocks
-	if (nb_threads < 1 || max_number_of_rows < 1)
+	if (nb_threads < 1 || max_number_of_rows < 1 || blocks_per_thread < 1)
 		return ST_GENERIC_ERROR;
+	if (blocks_per_thread > 1) {
+		long max_blocks = naxes[1] * naxes[2] / STACK_MIN_BLOCK_HEIGHT;
+		candidate = max(nb_threads, (int)min((long)nb_threads * blocks_per_thread, max_blocks));
+	}
 	while ((max_number_of_rows * candidate) / nb_threads < naxes[1] * naxes[2])
 		candidate++;
 	candidate = refine_blocks_candidate(nb_threads, (naxes[2] == 3L) ? 3 : 1, candidate);
@@ -339,6 +530,61 @@ int stack_compute_parallel_blocks(struct _image_block **blocksptr, long max_numb
 	return ST_OK;
 }
 
+int stack_compute_parallel_blocks(struct _image_block **blocksptr, long max_number_of_rows,
+		const long naxes[3], int nb_threads, long *largest_block_height, int *nb_blocks) {
+	return stack_compute_balanced_blocks(blocksptr, max_number_of_rows, naxes,
+			nb_threads, 1, largest_block_height, nb_blocks);
+}
+
+/* the autotune command measures the best number for this machine */
+static int get_blocks_per_thread() {
+	if (com.pref.tuning.stack_blocks_per_thread > 0)
+		return com.pref.tuning.stack_blocks_per_thread;
+	return STACK_BLOCKS_PER_THREAD;
+}
+
+/* Computes the blocks of the band of rows of the result selected for this
+ * stacking (-band option), or of the whole image. The rows out of the band are
+ * not stacked and stay black, another instance stacks them. */
+static int stack_compute_band_blocks(struct stacking_args *args, struct _image_block **blocksptr,
+		long max_number_of_rows, const long naxes[3], int nb_threads,
+		long *largest_block_height, int *nb_blocks) {
+	long band_naxes[3] = { naxes[0], naxes[1], naxes[2] };
+	long first_row = 0;
+	if (args->band_rows[1] > 0) {
+		if (args->band_rows[1] > naxes[1]) {
+			siril_log_color_message(_("The band of rows to stack ends after the last row of the result (%ld), aborting\n"),
+					"red", naxes[1]);
+			return ST_GENERIC_ERROR;
+		}
+		first_row = args->band_rows[0];
+		band_naxes[1] = args->band_rows[1] - first_row;
+		siril_log_message(_("Stacking only the rows %d to %d of %ld\n"),
+				args->band_rows[0], args->band_rows[1] - 1, naxes[1]);
+	}
+	int retval = stack_compute_balanced_blocks(blocksptr, max_number_of_rows, band_naxes, nb_threads,
+			nb_threads > 1 ? get_blocks_per_thread() : 1, largest_block_height, nb_blocks);
+	if (!retval && first_row > 0) {
+		for (int j = 0; j < *nb_blocks; j++) {
+			(*blocksptr)[j].start_row += first_row;
+			(*blocksptr)[j].end_row += first_row;
+		}
+	}
+	return retval;
+}
+
+/* the band keywords tell the stackmerge command which rows of a partial stack
+ * were stacked, as 1-based rows from the top of the image */
+static void stack_set_band_keywords(struct stacking_args *args, fits *fit) {
+	if (args->band_rows[1] > 0) {
+		fit->keywords.stack_band_first = args->band_rows[0] + 1;
+		fit->keywords.stack_band_last = args->band_rows[1];
+	} else {
+		fit->keywords.stack_band_first = DEFAULT_INT_VALUE;
+		fit->keywords.stack_band_last = DEFAULT_INT_VALUE;
+	}
+}
+
 // This function reaaranges data that was written continuously to the buffer by 
 // seq_opened_read_region to the actual stride of block_data. The rest of each line
 // is padded with zeros.
@@ -363,145 +609,367 @@ static void rearrange_block_data(void *buffer, data_type itype, int rx, int ry,
 	return;
 }
 
-static int stack_read_block_data(struct stacking_args *args,
-		struct _image_block *my_block, struct _data_block *data,
+/* duplicates the pixels of the rows of a frame read at the beginning of buf,
+ * in place from the end, into the rows out_y to out_y + out_h of the frame
+ * upscaled twice, as the nearest neighbour resize of the whole frame does */
+#define UPSCALE_ROWS(type) \
+	static void upscale_rows_##type(type *buf, int src_w, int src_y, int out_y, int out_h) { \
+		for (int r = out_h - 1; r >= 0; r--) { \
+			const type *in = buf + (size_t)((out_y + r) / 2 - src_y) * src_w; \
+			type *out = buf + (size_t)r * 2 * src_w; \
+			for (int x = 2 * src_w - 1; x >= 0; x--) \
+				out[x] = in[x >> 1]; \
+		} \
+	}
+UPSCALE_ROWS(WORD)
+UPSCALE_ROWS(float)
+
+/* Reads area, in the geometry of the stack, from one frame. With upscale at
+ * stacking, the stack is twice the size of the frames: only the rows of the
+ * frame the area comes from are read, then upscaled in buffer, so that no
+ * upscaled copy of the sequence needs to be written */
+static int stack_read_region(struct stacking_args *args, int channel, int image_index,
+		void *buffer, const rectangle *area, data_type itype, int thread_id) {
+	if (!args->upscale_at_stacking)
+		return seq_opened_read_region(args->seq, channel, image_index, buffer, area, thread_id);
+	int src_y = area->y / 2;
+	rectangle src_area = { area->x / 2, src_y, area->w / 2, (area->y + area->h - 1) / 2 + 1 - src_y };
+	int retval = seq_opened_read_region(args->seq, channel, image_index, buffer, &src_area, thread_id);
+	if (retval)
+		return retval;
+	if (itype == DATA_FLOAT)
+		upscale_rows_float(buffer, src_area.w, src_y, area->y, area->h);
+	else upscale_rows_WORD(buffer, src_area.w, src_y, area->y, area->h);
+	return 0;
+}
+
+/* Reads the area of my_block from one frame of the stack transformed with its
+ * registration: only the rows of the frame that the block maps to are read,
+ * then the block is interpolated from them as cvTransformImage() would do for
+ * the whole frame, so that the registered frames never need to be written. */
+static int stack_read_block_frame_warped(struct stacking_args *args,
+		struct _image_block *my_block, int frame, void *pix,
 		long *naxes, data_type itype, int thread_id) {
+	int ielem_size = itype == DATA_FLOAT ? sizeof(float) : sizeof(WORD);
+	int image_index = args->image_indices[frame];
+	Homography H = args->warp_H[frame];
+	rectangle area = { 0, my_block->start_row, naxes[0], my_block->height };
+
+	if (processing_cancelled())
+		return ST_CANCEL;
+
+	gboolean identity = guess_transform_from_H(H) == IDENTITY_TRANSFORMATION;
+	if (!identity)
+		cvTransformBlockSourceRows(H, naxes[0], naxes[1], my_block->start_row,
+				my_block->height, args->interpolation, &area.y, &area.h);
+	if (area.h <= 0) {
+		// the block is entirely outside the frame: all black pixels
+		memset(pix, 0, my_block->height * naxes[0] * ielem_size);
+		return ST_OK;
+	}
+
+	void *buffer = pix;
+	if (!identity) {
+		buffer = malloc((size_t)area.h * naxes[0] * ielem_size);
+		if (!buffer) {
+			PRINT_ALLOC_ERR;
+			return ST_ALLOC_ERROR;
+		}
+	}
+	if (stack_read_region(args, my_block->channel, image_index, buffer, &area, itype, thread_id)) {
+		siril_log_color_message(_("Error reading one of the image areas (%d: %d %d %d %d)\n"), "red", image_index + 1,
+				area.x, area.y, area.w, area.h);
+		if (!identity)
+			free(buffer);
+		return ST_SEQUENCE_ERROR;
+	}
+	if (identity)
+		return ST_OK;
+
+	int retval = cvTransformBlock(buffer, area.y, area.h, pix, my_block->start_row,
+			my_block->height, naxes[0], naxes[1], itype, H, args->interpolation, args->clamp);
+	free(buffer);
+	return retval ? ST_GENERIC_ERROR : ST_OK;
+}
+
+static int stack_comet_new(struct stacking_args *args) {
+	int nb_frames = args->nb_images_to_stack;
+	if (!layer_has_registration(args->seq, args->reglayer)) {
+		siril_log_color_message(_("Dual-alignment stacking requires registration data in the sequence. Aborting\n"), "red");
+		return ST_GENERIC_ERROR;
+	}
+	if (args->apply_reg || args->maximize_framing || args->feather_dist > 0 || args->acc) {
+		siril_log_color_message(_("Dual-alignment stacking is not available when applying registration while stacking, "
+					"with maximized framing, feathering or incremental stacking. Aborting\n"), "red");
+		return ST_GENERIC_ERROR;
+	}
+	struct stack_comet *comet = calloc(1, sizeof(struct stack_comet));
+	int *shifts = malloc(5 * nb_frames * sizeof(int));
+	if (!comet || !shifts) {
+		PRINT_ALLOC_ERR;
+		free(comet);
+		free(shifts);
+		return ST_ALLOC_ERROR;
+	}
+	comet->dates = calloc(nb_frames, sizeof(GDateTime *));
+	if (!comet->dates) {
+		PRINT_ALLOC_ERR;
+		free(comet);
+		free(shifts);
+		return ST_ALLOC_ERROR;
+	}
+	comet->read_shifty = shifts;
+	comet->shiftx[0] = shifts + nb_frames;
+	comet->shiftx[1] = shifts + 2 * nb_frames;
+	comet->row[0] = shifts + 3 * nb_frames;
+	comet->row[1] = shifts + 4 * nb_frames;
+	args->comet = comet;
+	return ST_OK;
+}
+
+static void stack_comet_free(struct stacking_args *args) {
+	struct stack_comet *comet = args->comet;
+	if (!comet)
+		return;
+	for (int i = 0; i < args->nb_images_to_stack; i++)
+		if (comet->dates[i])
+			g_date_time_unref(comet->dates[i]);
+	free(comet->dates);
+	free(comet->read_shifty);
+	free(comet);
+	args->comet = NULL;
+}
+
+/* computes the shifts of both alignments once the dates of the frames have been
+ * read and the offsets of the registration set, by stack_open_all_files() */
+static int stack_comet_compute_shifts(struct stacking_args *args) {
+	struct stack_comet *comet = args->comet;
+	int nb_frames = args->nb_images_to_stack;
+	int ref = find_refimage_in_indices(args->image_indices, nb_frames, args->ref_image);
+	if (ref < 0 || !comet->dates[ref]) {
+		siril_log_color_message(_("The reference image is not stacked or has no observation date, "
+					"the moving object cannot be aligned. Aborting\n"), "red");
+		return ST_GENERIC_ERROR;
+	}
+	regdata *layerparam = args->seq->regparam[args->reglayer];
+	double scale = (args->upscale_at_stacking) ? 2. : 1.;
+	comet->extra_rows = 0;
+	for (int frame = 0; frame < nb_frames; frame++) {
+		int image_index = args->image_indices[frame];
+		if (!comet->dates[frame]) {
+			siril_log_color_message(_("Image %d has no observation date, the moving object cannot be aligned. Aborting\n"),
+					"red", args->seq->imgparam[image_index].filenum);
+			return ST_GENERIC_ERROR;
+		}
+		pointf reg = { 0.f, 0.f };
+		get_comet_shift(comet->dates[ref], comet->dates[frame], args->comet_velocity, &reg);
+		double dx, dy;
+		translation_from_H(layerparam[image_index].H, &dx, &dy);
+		dx -= args->offset[0];
+		dy -= args->offset[1];
+		/* same as the registration of the comet-aligned sequence written
+		 * by register_comet() */
+		int shifty[2] = { round_to_int(dy * scale), round_to_int((dy + reg.y) * scale) };
+		comet->shiftx[0][frame] = round_to_int(dx * scale);
+		comet->shiftx[1][frame] = round_to_int((dx - reg.x) * scale);
+		comet->read_shifty[frame] = min(shifty[0], shifty[1]);
+		comet->row[0][frame] = shifty[0] - comet->read_shifty[frame];
+		comet->row[1][frame] = shifty[1] - comet->read_shifty[frame];
+		comet->extra_rows = max(comet->extra_rows, abs(shifty[1] - shifty[0]));
+	}
+	siril_log_message(_("Dual-alignment stacking: the moving object drifts by up to %d rows, "
+				"read in addition to each block\n"), comet->extra_rows);
+	return ST_OK;
+}
+
+/* the vertical shift of the rows read from a frame, from its registration */
+static int stack_get_shifty(struct stacking_args *args, int frame) {
+	if (args->comet)
+		return args->comet->read_shifty[frame];
+	int scale = (args->upscale_at_stacking) ? 2 : 1;
+	double dx, dy;
+	translation_from_H(args->seq->regparam[args->reglayer][args->image_indices[frame]].H, &dx, &dy);
+	dy -= args->offset[1];
+	return round_to_int(dy * scale);
+}
 
+/* Reads the area of my_block from one frame of the stack into pix, and the
+ * corresponding blending mask into mask if masking is enabled. The vertical
+ * shift from registration is managed here, the horizontal one is left to the
+ * caller. in_block, if not NULL, is set to FALSE if the frame has no pixel in
+ * the block, with max framing most frames of a mosaic, which are not read. */
+static int stack_read_block_frame(struct stacking_args *args,
+		struct _image_block *my_block, int frame, void *pix, float *mask,
+		long *naxes, data_type itype, int thread_id, gboolean *in_block) {
 	int ielem_size = itype == DATA_FLOAT ? sizeof(float) : sizeof(WORD);
-	/* store the layer info to retrieve normalization coeffs*/
-	data->layer = (int)my_block->channel;
 	gboolean masking = (args->feather_dist > 0);
-	/* Read the block from all images, store them in pix[image] */
-	for (int frame = 0; frame < args->nb_images_to_stack; ++frame) {
-		gboolean clear = FALSE, readdata = TRUE;
-		long offset = 0;
-		int image_index = args->image_indices[frame]; // image index in sequence
-		/* area in C coordinates, starting with 0, not cfitsio coordinates. */
-		int rx = naxes[0];
-		int ry = naxes[1];
-		if (args->maximize_framing) {
-			rx = (args->seq->is_variable) ? args->seq->imgparam[image_index].rx : args->seq->rx;
-			ry = (args->seq->is_variable) ? args->seq->imgparam[image_index].ry : args->seq->ry;
-		}
-		rectangle area = {0, my_block->start_row, rx, my_block->height};
-
-		if (!get_thread_run())
-			return ST_CANCEL;
-
-		if (args->reglayer >= 0) {
-			/* Load registration data for current image and modify area.
-			 * Here, only the y shift is managed. If possible, the remaining part
-			 * of the original area is read, the rest is filled with zeros. The x
-			 * shift is managed in the main loop after the read. */
-			regdata *layerparam = args->seq->regparam[args->reglayer];
-			if (layerparam) {
-				double scale = (args->upscale_at_stacking) ? 2. : 1.;
-				double dx, dy;
-				translation_from_H(layerparam[args->image_indices[frame]].H, &dx, &dy);
-				dy -=args->offset[1];
-				int shifty = round_to_int(dy * scale);
+	gboolean clear = FALSE, readdata = TRUE;
+	long offset = 0;
+	int image_index = args->image_indices[frame]; // image index in sequence
+	/* area in C coordinates, starting with 0, not cfitsio coordinates. */
+	int rx = naxes[0];
+	int ry = naxes[1];
+	int scale = (args->upscale_at_stacking) ? 2 : 1;
+	if (args->maximize_framing) {
+		rx = scale * ((args->seq->is_variable) ? args->seq->imgparam[image_index].rx : args->seq->rx);
+		ry = scale * ((args->seq->is_variable) ? args->seq->imgparam[image_index].ry : args->seq->ry);
+	}
+	rectangle area = {0, my_block->start_row, rx, my_block->height};
+	if (in_block)
+		*in_block = TRUE;
+
+	if (args->warp_H)
+		return stack_read_block_frame_warped(args, my_block, frame, pix, naxes, itype, thread_id);
+
+	if (processing_cancelled())
+		return ST_CANCEL;
+
+	if (args->reglayer >= 0) {
+		/* Load registration data for current image and modify area.
+		 * Here, only the y shift is managed. If possible, the remaining part
+		 * of the original area is read, the rest is filled with zeros. The x
+		 * shift is managed in the main loop after the read. */
+		regdata *layerparam = args->seq->regparam[args->reglayer];
+		if (layerparam) {
+			int shifty = stack_get_shifty(args, frame);
 #ifdef STACK_DEBUG
-				fprintf(stdout, "shifty for image %d: %d\n", args->image_indices[frame], shifty);
+			fprintf(stdout, "shifty for image %d: %d\n", args->image_indices[frame], shifty);
 #endif
-				if (area.y + area.h + shifty <= 0 || area.y + shifty >= ry) {
-					// entirely outside image below or above: all black pixels
-					clear = TRUE; readdata = FALSE;
-				} else if (area.y + shifty < 0) {
-					/* we read only the bottom part of the area here, which
-					* requires an offset in pix */
-					clear = TRUE;
-					area.h += area.y + shifty;	// cropping the height
-					area.h = min(area.h, ry);
-					offset = -naxes[0] * (area.y + shifty);	// positive
-					area.y = 0;
-				} else if (area.y + area.h + shifty >= ry) {
-					/* we read only the upper part of the area here */
-					clear = TRUE;
-					area.y += shifty;
-					area.h += ry - (area.y + area.h);
-				} else {
-					area.y += shifty;
-				}
-				if (area.h <= 0) { // as a last safety net
-					clear = TRUE; readdata = FALSE;
-				}
+			if (area.y + area.h + shifty <= 0 || area.y + shifty >= ry) {
+				// entirely outside image below or above: all black pixels
+				clear = TRUE; readdata = FALSE;
+			} else if (area.y + shifty < 0) {
+				/* we read only the bottom part of the area here, which
+				* requires an offset in pix */
+				clear = TRUE;
+				area.h += area.y + shifty;	// cropping the height
+				area.h = min(area.h, ry);
+				offset = -naxes[0] * (area.y + shifty);	// positive
+				area.y = 0;
+			} else if (area.y + area.h + shifty >= ry) {
+				/* we read only the upper part of the area here */
+				clear = TRUE;
+				area.y += shifty;
+				area.h += ry - (area.y + area.h);
+			} else {
+				area.y += shifty;
 			}
+			if (area.h <= 0) { // as a last safety net
+				clear = TRUE; readdata = FALSE;
+			}
+		}
 #ifdef STACK_DEBUG
-			else fprintf(stderr, "NO REGPARAM\n");
+		else fprintf(stderr, "NO REGPARAM\n");
 #endif
 
-			if (clear) {
-				/* we are reading outside an image, fill with
-				 * zeros and attempt to read lines that fit */
-				memset(data->pix[frame], 0, my_block->height * naxes[0] * ielem_size);
-				if (masking)
-					memset(data->mask[frame], 0, my_block->height * naxes[0] * sizeof(float));
-			}
+		if (clear) {
+			/* we are reading outside an image, fill with
+			 * zeros and attempt to read lines that fit */
+			memset(pix, 0, my_block->height * naxes[0] * ielem_size);
+			if (masking)
+				memset(mask, 0, my_block->height * naxes[0] * sizeof(float));
 		}
+		if (in_block)
+			*in_block = readdata;
+	}
 
-		if (args->reglayer < 0 || readdata) {
-			// reading pixels from current frame
-			void *buffer;
-			if (itype == DATA_FLOAT)
-				buffer = ((float*)data->pix[frame]) + offset;
-			else
-				buffer = ((WORD *)data->pix[frame]) + offset;
-			int retval = seq_opened_read_region(args->seq, my_block->channel,
-					args->image_indices[frame], buffer, &area, thread_id);
-			if (retval) {
-					siril_log_color_message(_("Error reading one of the image areas (%d: %d %d %d %d)\n"), "red", args->image_indices[frame] + 1,
-					area.x, area.y, area.w, area.h);
-				return ST_SEQUENCE_ERROR;
-			}
-			if (args->maximize_framing) {
-				rearrange_block_data(buffer, itype, naxes[0], area.h, rx);
-			}
+	if (args->reglayer < 0 || readdata) {
+		// reading pixels from current frame
+		void *buffer;
+		if (itype == DATA_FLOAT)
+			buffer = ((float*)pix) + offset;
+		else
+			buffer = ((WORD *)pix) + offset;
+		int retval = stack_read_region(args, my_block->channel,
+				args->image_indices[frame], buffer, &area, itype, thread_id);
+		if (retval) {
+				siril_log_color_message(_("Error reading one of the image areas (%d: %d %d %d %d)\n"), "red", args->image_indices[frame] + 1,
+				area.x, area.y, area.w, area.h);
+			return ST_SEQUENCE_ERROR;
 		}
-		
-		if (masking && (args->reglayer < 0 || readdata)) {
-			// we need to compute the correct mask area
-			// We load the corresponding downscaled portion of the mask file (distances to black are already included)
-			// Upcsale it to the mask buffer
-			// Re-arrange it if required (as for the image block) for maximize_framing
-			// Normalize it to 1. (all values > feather_dist -> 1., values < feather_dist -> val/feather_dist)
-			// And finally apply the ramping function which has been precomputed on  RAMP_PACE + 1 points
-			const gchar *maskfile = get_mask_filename(args->seq, args->image_indices[frame]);
-			float *mask_scaled;
-			int scaled_rx = 0, scaled_ry = 0;
-			double fx = 0., fy = 0.;
-			int rx = (args->seq->is_variable) ? args->seq->imgparam[image_index].rx : args->seq->rx;
-			int ry = (args->seq->is_variable) ? args->seq->imgparam[image_index].ry : args->seq->ry;
-			compute_downscaled_mask_size(rx, ry, &scaled_rx, &scaled_ry, &fx, &fy);
-			rectangle maskscaled_area = { 0, (int)(fy * area.y), scaled_rx, (int)(fy * area.h)};
-			if (area.h == 0 || area.w == 0 || maskscaled_area.w == 0 || maskscaled_area.h == 0)
-				continue;
-			mask_scaled = malloc((size_t)(maskscaled_area.h * maskscaled_area.w * sizeof(float)));
-			if (read_mask_fits_area(maskfile, &maskscaled_area, scaled_ry, mask_scaled)) {
-				free(mask_scaled);
-				siril_log_color_message(_("Error reading one of the masks areas (%d: %d %d %d %d)\n"), "red", args->image_indices[frame] + 1,
-				maskscaled_area.x, maskscaled_area.y, maskscaled_area.w, maskscaled_area.h);
-				return ST_SEQUENCE_ERROR;
-			}
-			float *mbuffer = data->mask[frame] + offset;
-			cvUpscaleBlendMask(maskscaled_area.w, maskscaled_area.h, rx, area.h, mask_scaled, mbuffer);
+		if (args->maximize_framing) {
+			rearrange_block_data(buffer, itype, naxes[0], area.h, rx);
+		}
+	}
+	
+	if (masking && (args->reglayer < 0 || readdata)) {
+		// we need to compute the correct mask area
+		// We load the corresponding downscaled portion of the mask file (distances to black are already included)
+		// Upcsale it to the mask buffer
+		// Re-arrange it if required (as for the image block) for maximize_framing
+		// Normalize it to 1. (all values > feather_dist -> 1., values < feather_dist -> val/feather_dist)
+		// And finally apply the ramping function which has been precomputed on  RAMP_PACE + 1 points
+		float *mask_scaled;
+		int scaled_rx = 0, scaled_ry = 0;
+		double fx = 0., fy = 0.;
+		int rx = (args->seq->is_variable) ? args->seq->imgparam[image_index].rx : args->seq->rx;
+		int ry = (args->seq->is_variable) ? args->seq->imgparam[image_index].ry : args->seq->ry;
+		compute_downscaled_mask_size(rx, ry, &scaled_rx, &scaled_ry, &fx, &fy);
+		// the masks are in the geometry of the frames, not upscaled
+		fy /= scale;
+		rx *= scale;
+		rectangle maskscaled_area = { 0, (int)(fy * area.y), scaled_rx, (int)(fy * area.h)};
+		if (area.h == 0 || area.w == 0 || maskscaled_area.w == 0 || maskscaled_area.h == 0)
+			return ST_OK;
+		mask_scaled = malloc((size_t)(maskscaled_area.h * maskscaled_area.w * sizeof(float)));
+		gchar *maskfile = get_mask_filename(args->seq, args->image_indices[frame]);
+		int status = read_mask_fits_area(maskfile, &maskscaled_area, scaled_ry, mask_scaled);
+		g_free(maskfile);
+		if (status) {
 			free(mask_scaled);
-			if (args->maximize_framing) {
-				rearrange_block_data(mbuffer, DATA_FLOAT, naxes[0], area.h, rx);
-			}
-			float distf = (float)args->feather_dist;
-			float invdistf = 1.f / distf;
-			size_t block_nb_pix = my_block->height * naxes[0];
-			// we normalize and apply the ramping function for all values above 0.
-			for (size_t i = 0; i < block_nb_pix; i++) {
-				if (data->mask[frame][i]) {
-					data->mask[frame][i] = (data->mask[frame][i] > distf) ? 1.f : get_ramped_value(data->mask[frame][i] * invdistf);
-				}
+			siril_log_color_message(_("Error reading one of the masks areas (%d: %d %d %d %d)\n"), "red", args->image_indices[frame] + 1,
+			maskscaled_area.x, maskscaled_area.y, maskscaled_area.w, maskscaled_area.h);
+			return ST_SEQUENCE_ERROR;
+		}
+		float *mbuffer = mask + offset;
+		cvUpscaleBlendMask(maskscaled_area.w, maskscaled_area.h, rx, area.h, mask_scaled, mbuffer);
+		free(mask_scaled);
+		if (args->maximize_framing) {
+			rearrange_block_data(mbuffer, DATA_FLOAT, naxes[0], area.h, rx);
+		}
+		float distf = (float)args->feather_dist;
+		float invdistf = 1.f / distf;
+		size_t block_nb_pix = my_block->height * naxes[0];
+		// we normalize and apply the ramping function for all values above 0.
+		for (size_t i = 0; i < block_nb_pix; i++) {
+			if (mask[i]) {
+				mask[i] = (mask[i] > distf) ? 1.f : get_ramped_value(mask[i] * invdistf);
 			}
 		}
 	}
 	return ST_OK;
 }
 
+static int stack_read_block_data(struct stacking_args *args,
+		struct _image_block *my_block, struct _data_block *data,
+		long *naxes, data_type itype, int thread_id) {
+	/* store the layer info to retrieve normalization coeffs*/
+	data->layer = (int)my_block->channel;
+	gboolean masking = (args->feather_dist > 0);
+	/* the dual-alignment stacking reads the rows of both alignments */
+	struct _image_block read_block = *my_block;
+	if (args->comet) {
+		read_block.height += args->comet->extra_rows;
+		read_block.end_row += args->comet->extra_rows;
+	}
+	/* Read the block from all images, store them in pix[image] */
+	size_t bytes = read_block.height * naxes[0] * (itype == DATA_FLOAT ? sizeof(float) : sizeof(WORD));
+	for (int frame = 0; frame < args->nb_images_to_stack; ++frame) {
+		gint64 start = g_get_monotonic_time();
+		int retval = stack_read_block_frame(args, &read_block, frame,
+				args->half_blocks ? data->half_row : data->pix[frame],
+				masking ? data->mask[frame] : NULL, naxes, itype, thread_id,
+				&data->in_block[frame]);
+		if (retval)
+			return retval;
+		if (data->in_block[frame])
+			io_stats_add_read(args->seq->type, bytes, g_get_monotonic_time() - start);
+		if (args->half_blocks)
+			float_to_half_row(data->half_row, data->pix[frame], read_block.height * naxes[0]);
+	}
+	return ST_OK;
+}
+
 static void normalize_to16bit(int bitpix, double *mean) {
 	switch(bitpix) {
 		case BYTE_IMG:
@@ -512,6 +980,29 @@ static void normalize_to16bit(int bitpix, double *mean) {
 	}
 }
 
+/* converts the stacked value of a pixel to the output format and stores it */
+static void store_stacked_pixel(struct stacking_args *args, fits *fit, int bitpix,
+		data_type itype, long channel, size_t idx, double result) {
+	if (args->use_32bit_output) {
+		// if we renormalize afterwards, we keep the data as is
+		// otherwise, we clamp in the [0,1] range
+		if (itype == DATA_USHORT)
+			fit->fpdata[channel][idx] = (args->output_norm) ?
+				double_ushort_to_float_range(result) :
+				set_float_in_interval(double_ushort_to_float_range(result), 0.f, 1.f);
+		else
+			fit->fpdata[channel][idx] = (args->output_norm) ?
+				(float)result :
+				set_float_in_interval((float)result, 0.f, 1.f);
+	} else {
+		/* in case of 8bit data we may want to normalize to 16bits */
+		if (args->output_norm) {
+			normalize_to16bit(bitpix, &result);
+		}
+		fit->pdata[channel][idx] = round_to_WORD(result);
+	}
+}
+
 static void norm_to_0_1_range(fits *fit) {
 	float mini = FLT_MAX;
 	float maxi = -1.f * FLT_MAX;
@@ -599,41 +1090,48 @@ static int line_clipping(WORD pixel, const float sig[], float sigma, int i, floa
 	return 0;
 }
 
-static void remove_element(WORD *array, int index, int array_length) {
-	for (int i = index; i < array_length - 1; i++)
-		array[i] = array[i + 1];
-}
-
-static float siril_stats_ushort_sd(const WORD data[], const int N, float *m) {
-	double accumulator = 0.0; // accumulating in double precision is important for accuracy
-	for (int i = 0; i < N; ++i) {
-		accumulator += data[i];
+/* Generalized ESD test of the max_outliers most deviant pixels of a sorted
+ * stack, see the float version in rejection_float.c. The pixels not yet tested
+ * are the range [lo, hi) of the stack, their sums being updated for each pixel
+ * tested. */
+static void grubbs_outliers(const WORD *stack, int N, float median,
+		const float *critical_value, int max_outliers, struct ESD_outliers *out) {
+	double sum = 0.0, sum2 = 0.0;
+#ifdef _OPENMP
+#pragma omp simd reduction(+:sum,sum2)
+#endif
+	for (int i = 0; i < N; i++) {
+		const double d = stack[i] - median;
+		sum += d;
+		sum2 += d * d;
 	}
-	float mean = (float)(accumulator / N);
-	accumulator = 0.0;
-	for (int i = 0; i < N; ++i)
-		accumulator += (data[i] - mean) * (data[i] - mean);
-
-	if (m) *m = mean;
 
-	return sqrtf((float)(accumulator / (N - 1)));
-}
-
-static void grubbs_stat(WORD *stack, int N, float *GCal, int *max_ind) {
-	float avg_y;
-	float sd = siril_stats_ushort_sd(stack, N, &avg_y);
-
-	/* data are sorted */
-	float max_of_deviations = avg_y - stack[0];
-	float md2 = stack[N - 1] - avg_y;
+	int lo = 0, hi = N;
+	for (int iter = 0; iter < max_outliers; iter++) {
+		const int size = hi - lo;
+		double var = (sum2 - sum * sum / size) / (size - 1);
+		if (var < 0.0)	// rounding
+			var = 0.0;
+		const float sd = sqrtf((float) var);
+		const float avg_y = (float) (sum / size) + median;
+
+		float max_of_deviations = avg_y - stack[lo];
+		const float md2 = stack[hi - 1] - avg_y;
+		int index;
+		if (md2 > max_of_deviations) {
+			max_of_deviations = md2;
+			index = --hi;
+		} else {
+			index = lo++;
+		}
+		out[iter].out = check_G_values(max_of_deviations / sd, critical_value[iter]);
+		out[iter].x = stack[index];
+		out[iter].i = index;
 
-	if (md2 > max_of_deviations) {
-		max_of_deviations = md2;
-		*max_ind = N - 1;
-	} else {
-		*max_ind = 0;
+		const double d = stack[index] - median;
+		sum -= d;
+		sum2 -= d * d;
 	}
-	*GCal = max_of_deviations / sd;
 }
 
 int check_G_values(float Gs, float Gc) {
@@ -812,14 +1310,15 @@ static int apply_rejection_ushort(struct _data_block *data, int nb_frames, struc
 			} while (changed && N > 3);
 			break;
 		case LINEARFIT:
+			/* the stack stays sorted when rejected pixels are removed */
+			quicksort_s(stack, N);
 			do {
-				quicksort_s(stack, N);
-				for (int frame = 0; frame < N; frame++) {
-					data->yf[frame] = (float)stack[frame];
-				}
 				float a, b;
-				siril_fit_linear(data->xf, data->yf, data->m_x, data->m_dx2, N, &b, &a);
+				siril_fit_linear_ushort(stack, data->m_x, data->m_dx2, N, &b, &a);
 				float sigma = 0.f;
+#ifdef _OPENMP
+#pragma omp simd reduction(+:sigma)
+#endif
 				for (int frame = 0; frame < N; frame++)
 					sigma += fabsf(stack[frame] - (a * frame + b));
 				sigma /= (float)N;
@@ -866,19 +1365,9 @@ static int apply_rejection_ushort(struct _data_block *data, int nb_frames, struc
 			max_outliers -= removed;
 			struct ESD_outliers *out = malloc(max_outliers * sizeof(struct ESD_outliers));
 
-			memcpy(w_stack, stack, N * sizeof(WORD));
 			memset(rejected, 0, N * sizeof(int));
-			int cold = 0;
-			for (int iter = 0, size = N; iter < max_outliers; iter++, size--) {
-				float Gstat;
-				int max_index = 0;
-
-				grubbs_stat(w_stack, size, &Gstat, &max_index);
-				out[iter].out = check_G_values(Gstat, args->critical_value[iter + removed]);
-				out[iter].x = w_stack[max_index];
-				out[iter].i = (max_index == 0) ? cold++ : max_index;
-				remove_element(w_stack, max_index, size);
-			}
+			grubbs_outliers(stack, N, median, args->critical_value + removed,
+					max_outliers, out);
 			confirm_outliers(out, max_outliers, median, rejected, rej);
 			free(out);
 
@@ -1026,10 +1515,60 @@ int stack_median(struct stacking_args *args) {
 	return stack_mean_or_median(args, FALSE);
 }
 
+/* The noise of the images is normally already in the statistics cache, computed
+ * with the normalization or seqstat, and the weights are only lookups. It is not
+ * when normalizing on overlaps or if the cache was cleared, in that case the
+ * noise of the missing images is computed once and kept in the cache, saved in
+ * the sequence file. */
+static int check_noise_stats(struct stacking_args *args) {
+	sequence *seq = args->seq;
+	int nb_frames = args->nb_images_to_stack;
+	int *missing = malloc(nb_frames * sizeof(int));
+	int nb_missing = 0, retval = ST_OK;
+	if (!missing) {
+		PRINT_ALLOC_ERR;
+		return ST_ALLOC_ERROR;
+	}
+	for (int i = 0; i < nb_frames; i++) {
+		int idx = args->image_indices[i];
+		for (int layer = 0; layer < seq->nb_layers; layer++) {
+			if (!seq->stats || !seq->stats[layer] || !seq->stats[layer][idx] ||
+					seq->stats[layer][idx]->bgnoise == NULL_STATS) {
+				missing[nb_missing++] = idx;
+				break;
+			}
+		}
+	}
+	if (nb_missing) {
+		siril_log_message(_("Computing the noise of %d images missing from the statistics cache\n"), nb_missing);
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(com.max_thread) schedule(dynamic) if (seq->type == SEQ_REGULAR && fits_is_reentrant())
+#endif
+		for (int i = 0; i < nb_missing; i++) {
+			if (retval)
+				continue;
+			imstats *stats[3] = { NULL };
+			if (compute_all_channels_statistics_seqimage(seq, missing[i], NULL, STATS_SIGMEAN, SINGLE_THREADED, -1, stats)) {
+				siril_log_color_message(_("Could not compute the noise of image %d\n"), "red", missing[i] + 1);
+				retval = ST_GENERIC_ERROR;
+			}
+			for (int layer = 0; layer < seq->nb_layers; layer++)
+				free_stats(stats[layer]);
+		}
+		seq->needs_saving = TRUE;
+		if (!retval)
+			writeseqfile(seq);
+	}
+	free(missing);
+	return retval;
+}
+
 static int compute_noise_weights(struct stacking_args *args) {
 	int nb_frames = args->nb_images_to_stack;
 	int nb_layers = args->seq->nb_layers;
 
+	if (check_noise_stats(args))
+		return ST_GENERIC_ERROR;
 	args->weights = malloc(nb_layers * nb_frames * sizeof(double));
 	double *pweights[3];
 
@@ -1145,16 +1684,104 @@ static int compute_nbstars_weights(struct stacking_args *args) {
 	return ST_OK;
 }
 
+/* Rejection maps: while stacking, the number of rejected values of each pixel
+ * is stored in compact arrays, on 8 bits when there are less than 256 images.
+ * The 16-bit rejection map images are only created from them once the blocks
+ * have been released, so asking for the maps shrinks the blocks less. Index is
+ * the one of the pixel in the result image. With merged maps, only the low
+ * counts are used. */
+static int stack_rejcount_size(int nb_images_to_stack) {
+	return nb_images_to_stack <= UCHAR_MAX ? sizeof(guint8) : sizeof(WORD);
+}
+
+static int stack_rejcount_alloc(struct stacking_args *args, size_t nbpix) {
+	int nb_maps = args->merge_lowhigh_rejmaps ? 1 : 2;
+	args->rejcount_size = stack_rejcount_size(args->nb_images_to_stack);
+	for (int map = 0; map < nb_maps; map++) {
+		args->rejcount[map] = calloc(nbpix, args->rejcount_size);
+		if (!args->rejcount[map]) {
+			PRINT_ALLOC_ERR;
+			return ST_ALLOC_ERROR;
+		}
+	}
+	return ST_OK;
+}
+
+static void stack_rejcount_free(struct stacking_args *args) {
+	free(args->rejcount[0]);
+	free(args->rejcount[1]);
+	args->rejcount[0] = args->rejcount[1] = NULL;
+}
+
+static inline void stack_rejcount_set(struct stacking_args *args, int map, size_t idx, int value) {
+	if (args->rejcount_size == sizeof(guint8))
+		((guint8 *)args->rejcount[map])[idx] = (guint8)min(value, UCHAR_MAX);
+	else ((WORD *)args->rejcount[map])[idx] = truncate_to_WORD(value);
+}
+
+static inline void stack_rejcount_inc(struct stacking_args *args, int map, size_t idx) {
+	if (args->rejcount_size == sizeof(guint8))
+		((guint8 *)args->rejcount[map])[idx]++;
+	else ((WORD *)args->rejcount[map])[idx]++;
+}
+
+/* stores the counts of a pixel in the maps, as the sum of both if they are merged */
+static inline void stack_rejcount_store(struct stacking_args *args, size_t idx, const int rej[2]) {
+	if (args->merge_lowhigh_rejmaps) {
+		stack_rejcount_set(args, 0, idx, rej[0] + rej[1]);
+	} else {
+		stack_rejcount_set(args, 0, idx, rej[0]);
+		stack_rejcount_set(args, 1, idx, rej[1]);
+	}
+}
+
+/* creates the rejection map images from the counts, which are released */
+static int stack_rejcount_to_rejmaps(struct stacking_args *args, long naxes[3]) {
+	int nb_maps = args->merge_lowhigh_rejmaps ? 1 : 2;
+	size_t nbpix = naxes[0] * naxes[1] * naxes[2];
+	for (int map = 0; map < nb_maps; map++) {
+		fits **rejmap = map == 0 ? &args->rejmap_low : &args->rejmap_high;
+		if (new_fit_image(rejmap, naxes[0], naxes[1], naxes[2], DATA_USHORT)) {
+			stack_rejcount_free(args);
+			return ST_ALLOC_ERROR;
+		}
+		WORD *data = (*rejmap)->data;
+		if (args->rejcount_size == sizeof(guint8)) {
+			const guint8 *count = args->rejcount[map];
+			for (size_t i = 0; i < nbpix; i++)
+				data[i] = count[i];
+		} else {
+			memcpy(data, args->rejcount[map], nbpix * sizeof(WORD));
+		}
+		free(args->rejcount[map]);
+		args->rejcount[map] = NULL;
+		stack_set_band_keywords(args, *rejmap);
+	}
+	return ST_OK;
+}
+
+/* memory used during the stacking outside of its buffers: the cache of the
+ * decoded frames of RAW sequences, see main_stack() */
+int stack_get_reserved_MB(struct stacking_args *args) {
+#ifdef HAVE_LIBRAW
+	if (args->seq->type == SEQ_RAW && args->seq->raw_file)
+		return (int) (args->seq->raw_file->max_bytes / BYTES_IN_A_MB);
+#endif
+	return 0;
+}
+
 /* How many rows fit in memory, based on image size, number and available memory.
  * It returns at most the total number of rows of the image (naxes[1] * naxes[2]) */
-static long stack_get_max_number_of_rows(long naxes[3], data_type type, int nb_images_to_stack, int nb_rejmaps, gboolean masking) {
-	int max_memory = get_max_memory_in_MB();
+static long stack_get_max_number_of_rows(long naxes[3], data_type type, int nb_images_to_stack, int nb_rejmaps,
+		gboolean masking, gboolean half_blocks, int reserved_MB) {
+	int max_memory = get_max_memory_in_MB() - reserved_MB;
 	long total_nb_rows = naxes[1] * naxes[2];
 	int elem_size = type == DATA_FLOAT ? sizeof(float) : sizeof(WORD);
+	int block_elem_size = half_blocks ? sizeof(half_float) : elem_size;
 	int mask_elem_size = (masking) ? sizeof(float) : 0;
 
 	guint64 size_of_result = naxes[0] * naxes[1] * naxes[2] * elem_size;
-	guint64 size_of_rejmaps = naxes[0] * naxes[1] * naxes[2] * sizeof(WORD);
+	guint64 size_of_rejmaps = naxes[0] * naxes[1] * naxes[2] * stack_rejcount_size(nb_images_to_stack);
 	max_memory -= size_of_result / BYTES_IN_A_MB;
 	max_memory -= nb_rejmaps * size_of_rejmaps / BYTES_IN_A_MB;
 	if (max_memory < 0)
@@ -1163,8 +1790,10 @@ static long stack_get_max_number_of_rows(long naxes[3], data_type type, int nb_i
 	siril_log_message(_("Using %d MB memory maximum for stacking\n"), max_memory);
 	// for each datablock, we store the pixel values
 	// if masking, we also need to store all the masks in float + 1 mask in 32b to conpute the smoothing (this mask is freed for every frame)
+	// half precision blocks are read one frame at a time in float before their conversion
 	guint64 number_of_rows = (guint64)max_memory * BYTES_IN_A_MB /
-		(nb_images_to_stack * naxes[0] * (elem_size + mask_elem_size) + (masking) * naxes[0] * sizeof(float));
+		(nb_images_to_stack * naxes[0] * (block_elem_size + mask_elem_size) + (masking) * naxes[0] * sizeof(float) +
+		 (half_blocks) * naxes[0] * sizeof(float));
 	// this is how many rows we can load in parallel from all images of the
 	// sequence and be under the limit defined in config in megabytes.
 	if (total_nb_rows < number_of_rows)
@@ -1172,25 +1801,667 @@ static long stack_get_max_number_of_rows(long naxes[3], data_type type, int nb_i
 	return (long)number_of_rows;
 }
 
-static int stack_mean_or_median(struct stacking_args *args, gboolean is_mean) {
-	int bitpix, i, naxis, cur_nb = 0, retval = ST_OK, pool_size = 1;
-	long naxes[3];
-	struct _data_block *data_pool = NULL;
-	struct _image_block *blocks = NULL;
-	fits fit = { 0 }; // output result
-	fits ref = { 0 }; // reference image, used to propagate metadata
-	// data for mean/rej only
-	guint64 irej[3][2] = {{0,0}, {0,0}, {0,0}};
-	regdata *layerparam = NULL;
-
-	gboolean masking = (args->feather_dist > 0);
-	if (masking)
-		init_ramp(); // we cache the values of the masks ramping function
+static void stack_finalize_image(struct stacking_args *args, fits *fit, long naxes[3],
+		gboolean is_mean, guint64 irej[][2], GList *list_date) {
+	if (is_mean) {
+		double nb_tot = (double) naxes[0] * (double) naxes[1] * (double) args->nb_images_to_stack;
+		for (long channel = 0; channel < naxes[2]; channel++) {
+			siril_log_message(_("Pixel rejection in channel #%d: %.3lf%% - %.3lf%%\n"),
+					channel, (double) irej[channel][0] / nb_tot * 100.0,
+					(double) irej[channel][1] / nb_tot * 100.0);
+		}
+	}
+	if (args->use_32bit_output && args->output_norm)
+		norm_to_0_1_range(fit);
+	compute_date_time_keywords(list_date, fit);
+	stack_set_band_keywords(args, fit);
+}
 
-	int nb_frames = args->nb_images_to_stack; // number of frames actually used
+static void stack_finalize_result(struct stacking_args *args, fits *fit, long naxes[3],
+		gboolean is_mean, guint64 irej[][2], GList *list_date) {
+	stack_finalize_image(args, fit, naxes, is_mean, irej, list_date);
+	memcpy(&args->result, fit, sizeof(fits));
+	if (has_wcs(&args->result)) {
+		update_wcsdata_from_wcs(&args->result);
+	}
+}
+
+/* the comet-aligned result of the dual-alignment stacking, its WCS is the one
+ * of the stars and is dropped */
+static void stack_finalize_comet_result(struct stacking_args *args, fits *comet_fit, long naxes[3],
+		gboolean is_mean, guint64 irej[][2], GList *list_date) {
+	siril_log_message(_("Comet-aligned result:\n"));
+	stack_finalize_image(args, comet_fit, naxes, is_mean, irej, list_date);
+	free_wcs(comet_fit);
+	memcpy(&args->comet_result, comet_fit, sizeof(fits));
+}
+
+/******************************* STREAMING STACKING ******************************
+ * When the sequence has many frames, the blocks of the regular path, which
+ * contain the same rows for all frames, become very thin and most of the time
+ * is spent seeking in the files. In streaming mode, a block is read from one
+ * frame at a time and folded into per-pixel accumulators, so the memory
+ * required only depends on the block size and not on the number of frames.
+ *
+ * Without rejection, a single pass computes the same mean as the regular path.
+ * With sigma clipping, the first pass computes the running mean and variance
+ * of each pixel (Welford's algorithm) and a second pass accumulates the values
+ * that lie within the clipping bounds. This is exact for a single clipping
+ * iteration centred on the mean, which differs slightly from the iterative
+ * median-centred clipping of the regular path, so it is only used for sigma
+ * clipping when explicitly requested.
+ *
+ * In incremental mode (see accumulator.c), the accumulators cover the whole
+ * image and are kept between runs. New images are added in a single pass:
+ * their values are clipped against the moments of the values already
+ * accumulated before being folded into them.
+ *********************************************************************************/
+
+/* below this number of rows per block, the regular path is mostly seeking */
+#define STACK_STREAMING_MIN_ROWS 8
+
+/* same as stack_get_max_number_of_rows() but for the streaming path, where only
+ * one frame of the block and the accumulators are kept in memory */
+/* the accumulators of the pixels, mean, M2, sum, norm and count, are those of
+ * the blocks, or those of the whole image for the incremental stacks, already
+ * allocated but counted in the memory limit too. Returns 0 if they do not fit */
+static long stack_get_max_number_of_rows_streaming(long naxes[3], data_type type, int nb_images_to_stack,
+		int nb_rejmaps, gboolean image_accumulators, int reserved_MB) {
+	gint64 max_memory = get_max_memory_in_MB() - reserved_MB;
+	long total_nb_rows = naxes[1] * naxes[2];
+	int elem_size = type == DATA_FLOAT ? sizeof(float) : sizeof(WORD);
+	guint64 accumulator_size = 4 * sizeof(double) + sizeof(guint32);
+
+	guint64 nb_pixels = (guint64)naxes[0] * naxes[1] * naxes[2];
+	guint64 size_of_result = nb_pixels * elem_size;
+	guint64 size_of_rejmaps = nb_pixels * stack_rejcount_size(nb_images_to_stack);
+	max_memory -= size_of_result / BYTES_IN_A_MB;
+	max_memory -= nb_rejmaps * size_of_rejmaps / BYTES_IN_A_MB;
+	if (image_accumulators)
+		max_memory -= nb_pixels * accumulator_size / BYTES_IN_A_MB;
+	if (max_memory <= 0)
+		return 0;
+
+	// for each pixel of the block: the frame value and the accumulators
+	guint64 pixel_size = elem_size + (image_accumulators ? 0 : accumulator_size);
+	guint64 number_of_rows = (guint64)max_memory * BYTES_IN_A_MB / (naxes[0] * pixel_size);
+	if (total_nb_rows < number_of_rows)
+		return total_nb_rows;
+	return (long)number_of_rows;
+}
+
+static gboolean stack_use_streaming(struct stacking_args *args, long max_number_of_rows,
+		int nb_threads, gboolean masking) {
+	gboolean thin_blocks = max_number_of_rows / nb_threads < STACK_STREAMING_MIN_ROWS;
+	if (!args->streaming && !thin_blocks)
+		return FALSE;
+	if (masking) {
+		if (args->streaming)
+			siril_log_message(_("Streaming stacking is not compatible with feathering, using regular stacking\n"));
+		return FALSE;
+	}
+	if (args->type_of_rejection == NO_REJEC) {
+		if (!args->streaming)
+			siril_log_message(_("Not enough memory to stack with large blocks, switching to streaming stacking\n"));
+		return TRUE;
+	}
+	if (args->streaming) {
+		if (args->type_of_rejection == SIGMA)
+			return TRUE;
+		siril_log_message(_("Streaming stacking is only available without rejection or with sigma clipping, using regular stacking\n"));
+	}
+	return FALSE;
+}
+
+/* returns the normalized value of a pixel, as it would be put in the stack of
+ * the regular path */
+static inline double stack_get_normalized_pixel(struct stacking_args *args,
+		const void *pix, size_t idx, data_type itype, int layer, int frame) {
+	if (itype == DATA_FLOAT) {
+		float fpixel = args->half_blocks ? half_to_float(((const half_float *)pix)[idx]) : ((const float *)pix)[idx];
+		switch (args->normalize) {
+			default:
+			case NO_NORM:
+				return fpixel;
+			case ADDITIVE:
+			case ADDITIVE_SCALING:
+				if (fpixel == 0.f)
+					return 0.0;
+				return (float)(fpixel * args->coeff.pscale[layer][frame] - args->coeff.poffset[layer][frame]);
+			case MULTIPLICATIVE:
+			case MULTIPLICATIVE_SCALING:
+				return (float)(fpixel * args->coeff.pscale[layer][frame] * args->coeff.pmul[layer][frame]);
+		}
+	}
+	WORD pixel = ((const WORD *)pix)[idx];
+	switch (args->normalize) {
+		default:
+		case NO_NORM:
+			return pixel;
+		case ADDITIVE:
+		case ADDITIVE_SCALING:
+			if (pixel == 0)
+				return 0.0;
+			return round_to_WORD((double)pixel * args->coeff.pscale[layer][frame] - args->coeff.poffset[layer][frame]);
+		case MULTIPLICATIVE:
+		case MULTIPLICATIVE_SCALING:
+			return round_to_WORD((double)pixel * args->coeff.pscale[layer][frame] * args->coeff.pmul[layer][frame]);
+	}
+}
+
+static int stack_get_shiftx(struct stacking_args *args, int frame) {
+	if (args->reglayer < 0 || !args->seq->regparam[args->reglayer] || args->warp_H)
+		return 0;
+	double scale = (args->upscale_at_stacking) ? 2. : 1.;
+	double dx, dy;
+	translation_from_H(args->seq->regparam[args->reglayer][args->image_indices[frame]].H, &dx, &dy);
+	dx -= args->offset[0];
+	return round_to_int(dx * scale);
+}
+
+/* passes of the streaming stacking */
+enum {
+	STREAM_MOMENTS,		// running moments and sums of all values
+	STREAM_CLIPPED_SUM,	// sums of the values within the clipping bounds
+	STREAM_INCREMENTAL	// clipping with the previous moments, then both
+};
+
+struct _streaming_block {
+	void *pix;		// the block for the current frame
+	double *mean;		// running mean of the non-null values
+	double *m2;		// running sum of squared deviations
+	double *sum;		// weighted sum of the kept values
+	double *norm;		// sum of the weights of the kept values
+	guint32 *count;		// number of non-null values
+};
+
+/* returns the standard deviation of the accumulated values, or -1 to disable
+ * rejection, as the regular path does not reject when 4 values or less remain */
+static inline double stack_streaming_sigma(struct _streaming_block *sblock, size_t k) {
+	guint32 n = sblock->count[k];
+	return n > 4 ? sqrt(sblock->m2[k] / (n - 1)) : -1.0;
+}
+
+/* reads the block from one frame and folds it into the accumulators,
+ * depending on the pass, rejected values are counted */
+static int stack_streaming_add_frame(struct stacking_args *args, struct _image_block *my_block,
+		struct _streaming_block *sblock, int frame, int pass, long naxes[3],
+		data_type itype, int thread_id, guint64 brej[2]) {
+	int retval = stack_read_block_frame(args, my_block, frame, sblock->pix, NULL, naxes, itype, thread_id, NULL);
+	if (retval)
+		return retval;
+	int layer = (int)my_block->channel;
+	int shiftx = stack_get_shiftx(args, frame);
+	double weight = args->weights ? args->weights[layer * args->nb_images_to_stack + frame] : 1.0;
+	size_t layer_offset = (size_t)layer * naxes[0] * naxes[1];
+	int high_map = args->merge_lowhigh_rejmaps ? 0 : 1;
+
+	for (long y = 0; y < my_block->height; y++) {
+		size_t line_idx = y * naxes[0];
+		size_t pdata_idx = (naxes[1] - (my_block->start_row + y) - 1) * naxes[0];
+		for (long x = 0; x < naxes[0]; x++) {
+			long sx = x - shiftx;
+			if (sx < 0 || sx >= naxes[0])
+				continue;
+			double val = stack_get_normalized_pixel(args, sblock->pix, line_idx + sx, itype, layer, frame);
+			if (val == 0.0)	// null pixels are ignored, as in the regular path
+				continue;
+			size_t k = line_idx + x;
+			gboolean kept = TRUE;
+			if (pass != STREAM_MOMENTS && args->type_of_rejection == SIGMA) {
+				double sigma = stack_streaming_sigma(sblock, k);
+				if (sigma >= 0.0) {
+					if (sblock->mean[k] - val > args->sig[0] * sigma) {
+						brej[0]++;
+						if (args->create_rejmaps)
+							stack_rejcount_inc(args, 0, layer_offset + pdata_idx + x);
+						kept = FALSE;
+					} else if (val - sblock->mean[k] > args->sig[1] * sigma) {
+						brej[1]++;
+						if (args->create_rejmaps)
+							stack_rejcount_inc(args, high_map, layer_offset + pdata_idx + x);
+						kept = FALSE;
+					}
+				}
+			}
+			if (pass != STREAM_CLIPPED_SUM) {
+				sblock->count[k]++;
+				double delta = val - sblock->mean[k];
+				sblock->mean[k] += delta / sblock->count[k];
+				sblock->m2[k] += delta * (val - sblock->mean[k]);
+			}
+			if (kept) {
+				sblock->sum[k] += val * weight;
+				sblock->norm[k] += weight;
+			}
+		}
+	}
+	return ST_OK;
+}
+
+static int stack_mean_streaming(struct stacking_args *args, fits *fit, int bitpix,
+		long naxes[3], data_type itype, int nb_rejmaps, int nb_threads, guint64 irej[][2]) {
+	struct _image_block *blocks = NULL;
+	struct _streaming_block *pool = NULL;
+	struct stack_readahead *ra = NULL;
+	long largest_block_height;
+	int nb_blocks, retval = ST_OK, cur_nb = 0;
+	int nb_frames = args->nb_images_to_stack;
+	struct stack_accumulator *acc = args->acc;
+	/* new incremental stacks are started like regular ones */
+	gboolean incremental = acc && acc->nb_frames > 0;
+	int nb_passes = args->type_of_rejection == SIGMA && !incremental ? 2 : 1;
+	int ielem_size = itype == DATA_FLOAT ? sizeof(float) : sizeof(WORD);
+
+	if (acc) {
+		if (acc->rx != naxes[0] || acc->ry != naxes[1] || acc->nb_layers != naxes[2]) {
+			siril_log_color_message(_("The size of the images does not match the incremental stack, "
+						"remove its file to start a new one\n"), "red");
+			return ST_GENERIC_ERROR;
+		}
+		siril_log_message(_("Using incremental streaming stacking\n"));
+	}
+	else siril_log_message(_("Using streaming stacking\n"));
+	long max_number_of_rows = stack_get_max_number_of_rows_streaming(naxes, itype, nb_frames, nb_rejmaps, acc != NULL,
+			stack_get_reserved_MB(args));
+	if (max_number_of_rows < 1) {
+		siril_log_color_message(_("Not enough memory for the accumulators of streaming stacking, "
+					"increase the memory limit\n"), "red");
+		return ST_ALLOC_ERROR;
+	}
+	if ((retval = stack_compute_band_blocks(args, &blocks, max_number_of_rows, naxes, nb_threads,
+					&largest_block_height, &nb_blocks)))
+		return retval;
+
+	size_t npixels_in_block = largest_block_height * naxes[0];
+	pool = calloc(nb_threads, sizeof(struct _streaming_block));
+	if (!pool) {
+		PRINT_ALLOC_ERR;
+		free(blocks);
+		return ST_ALLOC_ERROR;
+	}
+	gint64 pool_bytes = 0;
+	for (int i = 0; i < nb_threads; i++) {
+		pool[i].pix = malloc(npixels_in_block * ielem_size);
+		if (!pool[i].pix) {
+			PRINT_ALLOC_ERR;
+			retval = ST_ALLOC_ERROR;
+			goto free_streaming;
+		}
+		if (acc)	// accumulators are those of the whole image
+			continue;
+		pool[i].mean = malloc(npixels_in_block * 4 * sizeof(double));
+		pool[i].count = malloc(npixels_in_block * sizeof(guint32));
+		if (!pool[i].mean || !pool[i].count) {
+			PRINT_ALLOC_ERR;
+			retval = ST_ALLOC_ERROR;
+			goto free_streaming;
+		}
+		pool[i].m2 = pool[i].mean + npixels_in_block;
+		pool[i].sum = pool[i].m2 + npixels_in_block;
+		pool[i].norm = pool[i].sum + npixels_in_block;
+	}
+	pool_bytes = (gint64) nb_threads * npixels_in_block *
+		(ielem_size + (acc ? 0 : 4 * sizeof(double) + sizeof(guint32)));
+	memory_account(MEM_STACKING, pool_bytes);
+
+	if (nb_blocks > nb_threads && !args->comet)
+		ra = stack_readahead_new(args);
+
+	siril_log_message(_("Starting stacking...\n"));
+	set_progress_bar_data(_("Rejection stacking in progress..."), PROGRESS_RESET);
+	double total = (double)(nb_blocks * nb_frames * nb_passes);
+
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(nb_threads) schedule(dynamic) if (nb_threads > 1 && (args->seq->type == SEQ_SER || fits_is_reentrant()))
+#endif
+	for (int i = 0; i < nb_blocks; i++) {
+		struct _image_block *my_block = blocks + i;
+		int thread_idx = 0;
+		guint64 brej[2] = { 0, 0 };
+		if (processing_cancelled()) retval = ST_CANCEL;
+		if (retval) continue;
+#ifdef _OPENMP
+		thread_idx = omp_get_thread_num();
+#endif
+		struct _streaming_block *sblock = &pool[thread_idx];
+		size_t nb_pix = my_block->height * naxes[0];
+		/* the block after the ones being stacked is read while we stack this one */
+		if (i + nb_threads < nb_blocks)
+			stack_readahead_block(ra, args, blocks + i + nb_threads);
+		if (acc) {
+			size_t offset = ((size_t)my_block->channel * naxes[1] + my_block->start_row) * naxes[0];
+			sblock->mean = acc->mean + offset;
+			sblock->m2 = acc->m2 + offset;
+			sblock->sum = acc->sum + offset;
+			sblock->norm = acc->norm + offset;
+			sblock->count = acc->count + offset;
+		} else {
+			memset(sblock->mean, 0, nb_pix * sizeof(double));
+			memset(sblock->m2, 0, nb_pix * sizeof(double));
+			memset(sblock->sum, 0, nb_pix * sizeof(double));
+			memset(sblock->norm, 0, nb_pix * sizeof(double));
+			memset(sblock->count, 0, nb_pix * sizeof(guint32));
+		}
+
+		for (int pass = 1; pass <= nb_passes && !retval; pass++) {
+			int stream_pass = incremental ? STREAM_INCREMENTAL :
+				(pass == 1 ? STREAM_MOMENTS : STREAM_CLIPPED_SUM);
+			for (int frame = 0; frame < nb_frames; frame++) {
+				if (acc && frame == acc->skip_frame)
+					continue;
+				int ret = stack_streaming_add_frame(args, my_block, sblock, frame, stream_pass,
+						naxes, itype, thread_idx, brej);
+				if (ret) {
+					retval = ret;
+					break;
+				}
+				g_atomic_int_inc(&cur_nb);
+				if (!(cur_nb % 16))
+					set_progress_bar_data(NULL, (double)cur_nb / total);
+			}
+			if (retval || pass == nb_passes)
+				break;
+			/* end of the first pass for sigma clipping: resetting the sums
+			 * for the second pass */
+			for (long y = 0; y < my_block->height; y++) {
+				size_t pdata_idx = (naxes[1] - (my_block->start_row + y) - 1) * naxes[0];
+				for (long x = 0; x < naxes[0]; x++) {
+					size_t k = y * naxes[0] + x;
+					sblock->sum[k] = 0.0;
+					sblock->norm[k] = 0.0;
+					if (args->create_rejmaps) {
+						static const int norej[2] = { 0, 0 };
+						stack_rejcount_store(args, my_block->channel * naxes[0] * naxes[1] + pdata_idx + x, norej);
+					}
+				}
+			}
+		}
+		if (retval) continue;
+
+		for (long y = 0; y < my_block->height; y++) {
+			size_t pdata_idx = (naxes[1] - (my_block->start_row + y) - 1) * naxes[0];
+			for (long x = 0; x < naxes[0]; x++) {
+				size_t k = y * naxes[0] + x;
+				double result;
+				if (sblock->norm[k] > 0.0)
+					result = sblock->sum[k] / sblock->norm[k];
+				else result = sblock->mean[k]; // all weights null or no value left
+				store_stacked_pixel(args, fit, bitpix, itype, my_block->channel, pdata_idx + x, result);
+			}
+		}
+
+		if (args->type_of_rejection == SIGMA) {
+#ifdef _OPENMP
+#pragma omp atomic
+#endif
+			irej[my_block->channel][0] += brej[0];
+#ifdef _OPENMP
+#pragma omp atomic
+#endif
+			irej[my_block->channel][1] += brej[1];
+		}
+	}
+
+free_streaming:
+	memory_account(MEM_STACKING, -pool_bytes);
+	for (int i = 0; i < nb_threads; i++) {
+		free(pool[i].pix);
+		if (!acc) {
+			free(pool[i].mean);
+			free(pool[i].count);
+		}
+	}
+	free(pool);
+	free(blocks);
+	stack_readahead_free(ra);
+	return retval;
+}
+
+/* stacks one line of a block by batches: the stacks of STACK_BATCH_SIZE pixels
+ * are filled at once, frame-major and converted to float, then rejected and
+ * averaged together, or for the median, sorted with the median network */
+static void stack_batch_line(struct stacking_args *args, struct _data_block *data,
+		struct _image_block *my_block, fits *fit, int bitpix, long naxes[3],
+		data_type itype, size_t line_idx, size_t pdata_idx, gboolean is_mean,
+		const sortnet_pair *median_net, int median_net_size, guint64 brej[2]) {
+	int nb_frames = args->nb_images_to_stack;
+	int layer = (int)my_block->channel;
+	int *shifts = data->batch_shifts;
+	double results[STACK_BATCH_SIZE];
+	int rej[STACK_BATCH_SIZE][2];
+
+	for (int frame = 0; frame < nb_frames; frame++)
+		shifts[frame] = stack_get_shiftx(args, frame);
+
+	for (long x = 0; x < naxes[0]; x += STACK_BATCH_SIZE) {
+		int nb_pixels = (int)min(STACK_BATCH_SIZE, naxes[0] - x);
+		for (int frame = 0; frame < nb_frames; frame++) {
+			float *row = data->batch + frame * STACK_BATCH_SIZE;
+			for (int l = 0; l < STACK_BATCH_SIZE; l++) {
+				long xx = x + l - shifts[frame];
+				if (l >= nb_pixels || xx < 0 || xx >= naxes[0])
+					row[l] = 0.f;	// outside bounds, images are black
+				else row[l] = (float) stack_get_normalized_pixel(args,
+						data->pix[frame], line_idx + xx, itype, layer, frame);
+			}
+		}
+
+		if (!is_mean) {
+			sortnet_median_batch_float(data->batch, nb_frames, STACK_BATCH_SIZE,
+					median_net, median_net_size, results);
+			for (int l = 0; l < nb_pixels; l++)
+				store_stacked_pixel(args, fit, bitpix, itype, layer, pdata_idx + x + l, results[l]);
+			continue;
+		}
+
+		apply_rejection_float_batch(data, nb_frames, args, results, rej);
+
+		for (int l = 0; l < nb_pixels; l++) {
+			size_t idx = pdata_idx + x + l;
+			brej[0] += rej[l][0];
+			brej[1] += rej[l][1];
+			if (args->create_rejmaps)
+				stack_rejcount_store(args, layer * naxes[0] * naxes[1] + idx, rej[l]);
+			store_stacked_pixel(args, fit, bitpix, itype, layer, idx, results[l]);
+		}
+	}
+}
+
+/* stacks the row y of a block for both alignments of the dual-alignment
+ * stacking, from the rows read by stack_read_block_data(). The rejection maps
+ * are those of the star-aligned result. */
+static void stack_comet_line(struct stacking_args *args, struct _data_block *data,
+		struct _image_block *my_block, fits *fit, fits *comet_fit, int bitpix,
+		long naxes[3], data_type itype, long y, size_t pdata_idx, gboolean is_mean,
+		guint64 brej[2][2]) {
+	struct stack_comet *comet = args->comet;
+	int nb_frames = args->nb_images_to_stack;
+	int layer = my_block->channel;
+	for (int o = 0; o < 2; o++) {
+		fits *out = o ? comet_fit : fit;
+		for (long x = 0; x < naxes[0]; x++) {
+			for (int frame = 0; frame < nb_frames; frame++) {
+				long sx = x - comet->shiftx[o][frame];
+				double val = 0.0;
+				if (sx >= 0 && sx < naxes[0]) {
+					size_t pix_idx = (y + comet->row[o][frame]) * naxes[0] + sx;
+					val = stack_get_normalized_pixel(args, data->pix[frame], pix_idx, itype, layer, frame);
+				}
+				if (itype == DATA_FLOAT)
+					((float *)data->stack)[frame] = (float) val;
+				else ((WORD *)data->stack)[frame] = (WORD) val;
+			}
+			double result;
+			if (is_mean) {
+				int rej[2] = { 0, 0 };
+				result = mean_and_reject(args, data, nb_frames, itype, rej);
+				brej[o][0] += rej[0];
+				brej[o][1] += rej[1];
+				if (!o && args->create_rejmaps)
+					stack_rejcount_store(args, layer * naxes[0] * naxes[1] + pdata_idx + x, rej);
+			} else if (itype == DATA_USHORT)
+				result = quickmedian(data->stack, nb_frames);
+			else result = quickmedian_float(data->stack, nb_frames);
+			store_stacked_pixel(args, out, bitpix, itype, layer, pdata_idx + x, result);
+		}
+	}
+}
+
+/* stacks a whole block read by stack_read_block_data() on the OpenCL device,
+ * for float stacks without masks. Returns non-zero if the block could not be
+ * stacked there and must be on the CPU */
+static int stack_block_on_device(struct stacking_args *args, struct _data_block *data,
+		struct _image_block *my_block, size_t npixels_in_block, fits *fit, int bitpix,
+		long naxes[3], gboolean is_mean, guint64 brej[2]) {
+	int nb_frames = args->nb_images_to_stack;
+	int layer = (int)my_block->channel;
+	float *scale = data->device_results + npixels_in_block;
+	float *offset = scale + nb_frames;
+	float *weights = offset + nb_frames;
+	int *shifts = data->device_rej + 2 * npixels_in_block;
+	const double *pweights = args->weighting_type > NO_WEIGHT ?
+		args->weights + layer * nb_frames : NULL;
+
+	for (int frame = 0; frame < nb_frames; frame++) {
+		/* the frames not read give null pixels, their rows are not read */
+		shifts[frame] = data->in_block[frame] ? data->shiftx[frame] : (int)naxes[0];
+		switch (args->normalize) {
+			default:
+			case NO_NORM:
+				scale[frame] = 1.f;
+				offset[frame] = 0.f;
+				break;
+			case ADDITIVE:
+			case ADDITIVE_SCALING:
+				scale[frame] = (float) args->coeff.pscale[layer][frame];
+				offset[frame] = (float) args->coeff.poffset[layer][frame];
+				break;
+			case MULTIPLICATIVE:
+			case MULTIPLICATIVE_SCALING:
+				scale[frame] = (float)(args->coeff.pscale[layer][frame] * args->coeff.pmul[layer][frame]);
+				offset[frame] = 0.f;
+				break;
+		}
+		if (pweights)
+			weights[frame] = (float) pweights[frame];
+	}
+
+	struct opencl_stack_block block = {
+		.pix = (const float *) data->pix[0],
+		.frame_stride = npixels_in_block,
+		.nb_frames = nb_frames,
+		.rx = (int)naxes[0],
+		.height = (int)my_block->height,
+		.shiftx = shifts,
+		.scale = scale,
+		.offset = offset,
+		.weights = pweights ? weights : NULL,
+		.type_of_rejection = args->type_of_rejection,
+		.sig = { args->sig[0], args->sig[1] },
+		.is_mean = is_mean
+	};
+	if (opencl_stack_block(&block, data->device_results, is_mean ? data->device_rej : NULL))
+		return 1;
+
+	for (long y = 0; y < my_block->height; y++) {
+		size_t pdata_idx = (naxes[1] - (my_block->start_row + y) - 1) * naxes[0];
+		const float *results = data->device_results + y * naxes[0];
+		const int *rej = data->device_rej + 2 * y * naxes[0];
+		for (long x = 0; x < naxes[0]; x++) {
+			if (is_mean) {
+				brej[0] += rej[2 * x];
+				brej[1] += rej[2 * x + 1];
+				if (args->create_rejmaps)
+					stack_rejcount_store(args, layer * naxes[0] * naxes[1] + pdata_idx + x, rej + 2 * x);
+			}
+			store_stacked_pixel(args, fit, bitpix, DATA_FLOAT, layer, pdata_idx + x, results[x]);
+		}
+	}
+	return 0;
+}
+
+/* computes the transformation of each stacked frame to the reference frame, as
+ * seqapplyreg would do it with the framing of the reference */
+static int stack_prepare_warping(struct stacking_args *args) {
+	if (!layer_has_registration(args->seq, args->reglayer)) {
+		siril_log_color_message(_("No registration data in the sequence, cannot apply it while stacking. Aborting\n"), "red");
+		return ST_GENERIC_ERROR;
+	}
+	if (args->seq->is_variable || args->maximize_framing ||
+			args->feather_dist > 0 || layer_has_distortion(args->seq, args->reglayer)) {
+		siril_log_color_message(_("Registration can be applied while stacking only to images of the same size, without distortion correction, framing or feathering. Aborting\n"), "red");
+		return ST_GENERIC_ERROR;
+	}
+	regdata *layerparam = args->seq->regparam[args->reglayer];
+	Homography Href = layerparam[args->ref_image].H;
+	if (guess_transform_from_H(Href) == NULL_TRANSFORMATION) {
+		siril_log_color_message(_("The reference image has no registration data. Aborting\n"), "red");
+		return ST_GENERIC_ERROR;
+	}
+	/* with upscale at stacking, the frames are warped in their upscaled
+	 * geometry, where the pixel x of the frame is centred on 2x + 0.5 */
+	Homography A, Ainv;
+	cvGetEye(&A);
+	cvGetEye(&Ainv);
+	if (args->upscale_at_stacking) {
+		A.h00 = A.h11 = 2.0;
+		A.h02 = A.h12 = 0.5;
+		Ainv.h00 = Ainv.h11 = 0.5;
+		Ainv.h02 = Ainv.h12 = -0.25;
+	}
+	int nb_frames = args->nb_images_to_stack;
+	args->warp_H = malloc(nb_frames * sizeof(Homography));
+	if (!args->warp_H) {
+		PRINT_ALLOC_ERR;
+		return ST_ALLOC_ERROR;
+	}
+	for (int frame = 0; frame < nb_frames; frame++) {
+		Homography Himg = layerparam[args->image_indices[frame]].H;
+		if (guess_transform_from_H(Himg) == NULL_TRANSFORMATION) {
+			siril_log_color_message(_("Image %d has no registration data, it cannot be stacked. Aborting\n"),
+					"red", args->seq->imgparam[args->image_indices[frame]].filenum);
+			free(args->warp_H);
+			args->warp_H = NULL;
+			return ST_GENERIC_ERROR;
+		}
+		cvTransfH(&Himg, &Href, &args->warp_H[frame]);
+		if (args->upscale_at_stacking) {
+			Homography AH;
+			cvMultH(A, args->warp_H[frame], &AH);
+			cvMultH(AH, Ainv, &args->warp_H[frame]);
+		}
+	}
+	siril_log_message(_("Registration is applied to the images while stacking\n"));
+	return ST_OK;
+}
+
+static int stack_mean_or_median(struct stacking_args *args, gboolean is_mean) {
+	int bitpix, i, naxis, cur_nb = 0, retval = ST_OK, pool_size = 1;
+	long naxes[3];
+	struct _data_block *data_pool = NULL;
+	struct _image_block *blocks = NULL;
+	fits fit = { 0 }; // output result
+	fits ref = { 0 }; // reference image, used to propagate metadata
+	fits comet_fit = { 0 }; // comet-aligned result of the dual-alignment stacking
+	// data for mean/rej only
+	guint64 irej[3][2] = {{0,0}, {0,0}, {0,0}};
+	guint64 irej_comet[3][2] = {{0,0}, {0,0}, {0,0}};
+	regdata *layerparam = NULL;
+	sortnet_pair *median_net = NULL; // for median only
+	struct stack_readahead *ra = NULL;
+
+	gint64 pool_bytes = 0;	// accounted memory of data_pool
+
+	gboolean masking = (args->feather_dist > 0);
+	if (masking)
+		init_ramp(); // we cache the values of the masks ramping function
+	args->half_blocks = FALSE;
+
+	int nb_frames = args->nb_images_to_stack; // number of frames actually used
 	naxes[0] = naxes[1] = 0; naxes[2] = 1;
 
-	if (nb_frames < 2) {
+	if (nb_frames < 2 && !args->acc) {
 		siril_log_message(_("Select at least two frames for stacking. Aborting.\n"));
 		return ST_GENERIC_ERROR;
 	} else if (nb_frames < 3 && is_mean && args->type_of_rejection == GESDT) {
@@ -1202,15 +2473,28 @@ static int stack_mean_or_median(struct stacking_args *args, gboolean is_mean) {
 	if (args->reglayer < 0) {
 		siril_log_message(_("No registration layer passed, ignoring registration data!\n"));
 	}
-	else layerparam = args->seq->regparam[args->reglayer];
+	else if (!args->apply_reg)
+		layerparam = args->seq->regparam[args->reglayer];
+
+	if (args->apply_reg && (retval = stack_prepare_warping(args)))
+		return retval;
 
+	io_stats_reset();
+	memory_report_begin(is_mean ? _("Rejection stacking") : _("Median stacking"));
+	memory_report_set_budget(get_max_memory_in_MB());
 	set_progress_bar_data(NULL, PROGRESS_RESET);
 
 	/* first loop: open all fits files and check they are of same size */
 	GList *list_date = NULL;
+	if (args->comet_dual && (retval = stack_comet_new(args))) {
+		goto free_and_close;
+	}
 	if ((retval = stack_open_all_files(args, &bitpix, &naxis, naxes, &list_date, &ref))) {
 		goto free_and_close;
 	}
+	if (args->comet && (retval = stack_comet_compute_shifts(args))) {
+		goto free_and_close;
+	}
 
 	if (naxes[0] == 0) {
 		// no image has been loaded
@@ -1218,8 +2502,9 @@ static int stack_mean_or_median(struct stacking_args *args, gboolean is_mean) {
 		retval = ST_SEQUENCE_ERROR;
 		goto free_and_close;
 	}
-	if (!args->maximize_framing && (naxes[0] != args->seq->rx || naxes[1] != args->seq->ry)) {
-		siril_log_color_message(_("Rejection stack error: sequence has wrong image size (%dx%d for sequence, %ldx%ld for images)\n"), "red", args->seq->rx, args->seq->ry, naxes[0], naxes[1]);
+	int scale = (args->upscale_at_stacking) ? 2 : 1;
+	if (!args->maximize_framing && (naxes[0] != scale * args->seq->rx || naxes[1] != scale * args->seq->ry)) {
+		siril_log_color_message(_("Rejection stack error: sequence has wrong image size (%dx%d for sequence, %ldx%ld for images)\n"), "red", scale * args->seq->rx, scale * args->seq->ry, naxes[0], naxes[1]);
 		retval = ST_SEQUENCE_ERROR;
 		goto free_and_close;
 	}
@@ -1236,23 +2521,30 @@ static int stack_mean_or_median(struct stacking_args *args, gboolean is_mean) {
 		goto free_and_close;
 	}
 	copy_fits_metadata(&ref, fptr);
+	if (args->comet) {
+		fits *cptr = &comet_fit;
+		if ((retval = new_fit_image(&cptr, naxes[0], naxes[1], naxes[2], fit.type))) {
+			clearfits(&ref);
+			goto free_and_close;
+		}
+		copy_fits_metadata(&ref, cptr);
+	}
 	clearfits(&ref);
 	if (!args->use_32bit_output && (args->output_norm || fit.orig_bitpix != BYTE_IMG)) {
 		fit.bitpix = USHORT_IMG;
 		if (args->output_norm)
 			fit.orig_bitpix = USHORT_IMG;
 	}
+	if (args->comet) {
+		comet_fit.bitpix = fit.bitpix;
+		comet_fit.orig_bitpix = fit.orig_bitpix;
+	}
 
-	/* initialize rejection maps */
+	/* initialize rejection counts, the maps are created after stacking */
 	if (args->create_rejmaps) {
-		if ((retval = new_fit_image(&args->rejmap_low, naxes[0], naxes[1], naxes[2], DATA_USHORT))) {
+		if ((retval = stack_rejcount_alloc(args, naxes[0] * naxes[1] * naxes[2]))) {
 			goto free_and_close;
 		}
-		if (!args->merge_lowhigh_rejmaps) {
-			if ((retval = new_fit_image(&args->rejmap_high, naxes[0], naxes[1], naxes[2], DATA_USHORT))) {
-				goto free_and_close;
-			}
-		}
 	}
 
 	/* prepare the downscaled 8b masks if masking is allowed */
@@ -1285,6 +2577,32 @@ static int stack_mean_or_median(struct stacking_args *args, gboolean is_mean) {
 	nb_threads = 1;
 #endif
 
+	switch (args->weighting_type) {
+		default:
+		case NO_WEIGHT:
+			retval = ST_OK;
+			break;
+		case NOISE_WEIGHT:
+			siril_log_message(_("Computing weights based on noise...\n"));
+			retval = compute_noise_weights(args);
+			break;
+		case WFWHM_WEIGHT:
+			siril_log_message(_("Computing weights based on wFWHM...\n"));
+			retval = compute_wfwhm_weights(args);
+			break;
+		case NBSTARS_WEIGHT:
+			siril_log_message(_("Computing weights based on number of stars...\n"));
+			retval = compute_nbstars_weights(args);
+			break;
+		case NBSTACK_WEIGHT:
+			siril_log_message(_("Computing weights based on number of stacked images...\n"));
+			break;
+	}
+	if (retval) {
+		retval = ST_GENERIC_ERROR;
+		goto free_and_close;
+	}
+
 	/* manage memory */
 	long largest_block_height;
 	int nb_blocks;
@@ -1295,9 +2613,31 @@ static int stack_mean_or_median(struct stacking_args *args, gboolean is_mean) {
 			nb_rejmaps = 1;
 		else nb_rejmaps = 2;
 	}
-	long max_number_of_rows = stack_get_max_number_of_rows(naxes, itype, args->nb_images_to_stack, nb_rejmaps, masking);
+	/* the blocks of 32-bit stacks can be kept in half precision in memory */
+	gboolean half_blocks = itype == DATA_FLOAT && com.pref.stack_half_float;
+	long max_number_of_rows = stack_get_max_number_of_rows(naxes, itype, args->nb_images_to_stack, nb_rejmaps, masking, half_blocks,
+			stack_get_reserved_MB(args));
+	if (args->comet) {
+		/* the second result and the extra rows read by each thread */
+		max_number_of_rows -= naxes[1] * naxes[2] / nb_frames + nb_threads * args->comet->extra_rows;
+		if (max_number_of_rows < 1) {
+			siril_log_color_message(_("Not enough memory for the dual-alignment stacking. Aborting\n"), "red");
+			retval = ST_ALLOC_ERROR;
+			goto free_and_close;
+		}
+	}
+
+	if (is_mean && !args->comet && (args->acc || stack_use_streaming(args, max_number_of_rows, nb_threads, masking))) {
+		retval = stack_mean_streaming(args, &fit, bitpix, naxes, itype, nb_rejmaps, nb_threads, irej);
+		if (!retval) {
+			set_progress_bar_data(_("Finalizing stacking..."), PROGRESS_NONE);
+			stack_finalize_result(args, &fit, naxes, is_mean, irej, list_date);
+		}
+		goto free_and_close;
+	}
+
 	/* Compute parallel processing data: the data blocks, later distributed to threads */
-	if ((retval = stack_compute_parallel_blocks(&blocks, max_number_of_rows, naxes, nb_threads,
+	if ((retval = stack_compute_band_blocks(args, &blocks, max_number_of_rows, naxes, nb_threads,
 					&largest_block_height, &nb_blocks))) {
 		goto free_and_close;
 	}
@@ -1310,16 +2650,40 @@ static int stack_mean_or_median(struct stacking_args *args, gboolean is_mean) {
 	pool_size = nb_threads;
 	g_assert(pool_size > 0);
 #endif
-	size_t npixels_in_block = largest_block_height * naxes[0];
+	size_t npixels_in_block = (largest_block_height + (args->comet ? args->comet->extra_rows : 0)) * naxes[0];
 	g_assert(npixels_in_block > 0);
 	int ielem_size = itype == DATA_FLOAT ? sizeof(float) : sizeof(WORD);
 	int ielem_mask_size = (masking) ? sizeof(float) : 0;
-
+	/* rejection of float stacks that can be done without sorting and
+	 * medians of small stacks are computed on batches of pixels */
+	int median_net_size = -1;
+	gboolean use_batch = FALSE;
+	if (!masking && !args->comet) {
+		if (is_mean)
+			use_batch = itype == DATA_FLOAT && rejection_float_batch_supported(args);
+		else if (nb_frames <= SORTNET_MEDIAN_MAX) {
+			median_net = malloc(SORTNET_MEDIAN_MAX_PAIRS * sizeof(sortnet_pair));
+			if (median_net)
+				median_net_size = sortnet_median_pairs(nb_frames, median_net);
+			use_batch = median_net_size >= 0;
+		}
+	}
+	/* the blocks of float stacks whose rejection does not need sorted stacks
+	 * can be stacked on the OpenCL device, the CPU paths above being kept for
+	 * the blocks that cannot */
+	gboolean use_device = !masking && !args->comet && itype == DATA_FLOAT && !half_blocks &&
+		(!is_mean || opencl_stacking_rejection_supported(args->type_of_rejection)) &&
+		opencl_stacking_available();
+
+	args->half_blocks = half_blocks;
+	int pix_elem_size = half_blocks ? sizeof(half_float) : ielem_size;
+	if (half_blocks)
+		siril_log_message(_("Stacking blocks are stored in half precision\n"));
 	fprintf(stdout, "allocating data for %d threads (each %lu MB)\n", pool_size,
-			(unsigned long)(nb_frames * npixels_in_block * ielem_size) / BYTES_IN_A_MB);
+			(unsigned long)(nb_frames * npixels_in_block * pix_elem_size) / BYTES_IN_A_MB);
 	data_pool = calloc(pool_size, sizeof(struct _data_block));
-	size_t bufferSize = ielem_size * nb_frames * (npixels_in_block + 1ul) + 4ul; // buffer for tmp and stack, added 4 byte for alignment
-	// the +1ul pixel is for storing the current pixel stack
+	size_t bufferSize = pix_elem_size * nb_frames * npixels_in_block + ielem_size * nb_frames + 4ul; // buffer for tmp and stack, added 4 byte for alignment
+	// the ielem_size * nb_frames is for storing the current pixel stack
 	if (masking)
 		bufferSize += ielem_mask_size * nb_frames * (npixels_in_block + 1ul) + 4ul; // buffer for masks and mask stack, added 4 byte for alignment
 		// the +1ul pixel is for storing the current mask stack
@@ -1329,10 +2693,7 @@ static int stack_mean_or_median(struct stacking_args *args, gboolean is_mean) {
 		if (args->type_of_rejection == WINSORIZED) {
 			bufferSize += ielem_size * nb_frames; // for w_frame
 		} else if (args->type_of_rejection == GESDT) {
-			bufferSize += ielem_size * nb_frames; // for w_frame
-			bufferSize += sizeof(float) * (int) floor(nb_frames * args->sig[0]); //and GCritical
-		} else if (args->type_of_rejection == LINEARFIT) {
-			bufferSize += 2 * sizeof(float) * nb_frames; // for xc and yc
+			bufferSize += sizeof(float) * (int) floor(nb_frames * args->sig[0]); // for GCritical
 		}
 	}
 	for (i = 0; i < pool_size; i++) {
@@ -1340,7 +2701,11 @@ static int stack_mean_or_median(struct stacking_args *args, gboolean is_mean) {
 		if (masking)
 			data_pool[i].mask = malloc(nb_frames * sizeof(float *));
 		data_pool[i].tmp = malloc(bufferSize);
-		if (!data_pool[i].pix || !data_pool[i].tmp || (masking && !data_pool[i].mask)) {
+		if (half_blocks)
+			data_pool[i].half_row = malloc(npixels_in_block * sizeof(float));
+		data_pool[i].shiftx = malloc(nb_frames * (sizeof(int) + sizeof(gboolean)));
+		if (!data_pool[i].pix || !data_pool[i].tmp || (masking && !data_pool[i].mask) ||
+				(half_blocks && !data_pool[i].half_row) || !data_pool[i].shiftx) {
 			PRINT_ALLOC_ERR;
 			gchar *available = g_format_size_full(get_available_memory(), G_FORMAT_SIZE_IEC_UNITS);
 			fprintf(stderr, "Cannot allocate %zu (free memory: %s)\n", bufferSize / BYTES_IN_A_MB, available);
@@ -1350,9 +2715,36 @@ static int stack_mean_or_median(struct stacking_args *args, gboolean is_mean) {
 			retval = ST_ALLOC_ERROR;
 			goto free_and_close;
 		}
+		data_pool[i].in_block = (gboolean *)(data_pool[i].shiftx + nb_frames);
+		size_t block_bytes = bufferSize + (half_blocks ? npixels_in_block * sizeof(float) : 0);
+		if (use_batch) {
+			data_pool[i].batch = malloc(nb_frames * (STACK_BATCH_SIZE * (sizeof(float) + sizeof(guint8)) + sizeof(int)));
+			if (!data_pool[i].batch) {
+				PRINT_ALLOC_ERR;
+				retval = ST_ALLOC_ERROR;
+				goto free_and_close;
+			}
+			block_bytes += nb_frames * (STACK_BATCH_SIZE * (sizeof(float) + sizeof(guint8)) + sizeof(int));
+			data_pool[i].batch_shifts = (int *)(data_pool[i].batch + nb_frames * STACK_BATCH_SIZE);
+			data_pool[i].batch_keep = (guint8 *)(data_pool[i].batch_shifts + nb_frames);
+		}
+		if (use_device) {
+			size_t device_bytes = (npixels_in_block + 3 * nb_frames) * sizeof(float) +
+				(2 * npixels_in_block + nb_frames) * sizeof(int);
+			data_pool[i].device_results = malloc((npixels_in_block + 3 * nb_frames) * sizeof(float));
+			data_pool[i].device_rej = malloc((2 * npixels_in_block + nb_frames) * sizeof(int));
+			if (!data_pool[i].device_results || !data_pool[i].device_rej) {
+				PRINT_ALLOC_ERR;
+				retval = ST_ALLOC_ERROR;
+				goto free_and_close;
+			}
+			block_bytes += device_bytes;
+		}
+		memory_account(MEM_STACKING, block_bytes);
+		pool_bytes += block_bytes;
 		data_pool[i].stack = (void *)((char *)data_pool[i].tmp
-				+ nb_frames * npixels_in_block * ielem_size);
-		size_t stack_offset = (size_t)ielem_size * nb_frames * (npixels_in_block + 1);
+				+ nb_frames * npixels_in_block * pix_elem_size);
+		size_t stack_offset = (size_t)pix_elem_size * nb_frames * npixels_in_block + (size_t)ielem_size * nb_frames;
 		int temp = stack_offset % sizeof(int);
 		if (temp > 0) { // align buffer
 			stack_offset += sizeof(int) - temp;
@@ -1374,7 +2766,6 @@ static int stack_mean_or_median(struct stacking_args *args, gboolean is_mean) {
 			if (args->type_of_rejection == WINSORIZED) {
 				data_pool[i].w_stack = (void*)((char*)data_pool[i].o_stack + ielem_size * nb_frames);
 			} else if (args->type_of_rejection == GESDT) {
-				data_pool[i].w_stack = (void*)((char*)data_pool[i].o_stack + ielem_size * nb_frames);
 				int max_outliers = (int) floor(nb_frames * args->sig[0]);
 				args->critical_value = malloc(max_outliers * sizeof(float));
 				for (int j = 0, size = nb_frames; j < max_outliers; j++, size--) {
@@ -1384,23 +2775,21 @@ static int stack_mean_or_median(struct stacking_args *args, gboolean is_mean) {
 					args->critical_value[j] = numerator / denominator;
 				}
 			} else if (args->type_of_rejection == LINEARFIT) {
-				data_pool[i].xf = (float (*)) ((char*)data_pool[i].o_stack + ielem_size * nb_frames);
-				data_pool[i].yf = data_pool[i].xf + nb_frames;
 				// precalculate some stuff
 				data_pool[i].m_x = (nb_frames - 1) * 0.5f;
 				data_pool[i].m_dx2 = 0.f;
 				for (int j = 0; j < nb_frames; ++j) {
 					const float dx = j - data_pool[i].m_x;
-					data_pool[i].xf[j] = 1.f / (j + 1);
-					data_pool[i].m_dx2 += (dx * dx - data_pool[i].m_dx2)
-						* data_pool[i].xf[j];
+					data_pool[i].m_dx2 += (dx * dx - data_pool[i].m_dx2) / (j + 1);
 				}
 				data_pool[i].m_dx2 = 1.f / data_pool[i].m_dx2;
 			}
 		}
 
 		for (int j = 0; j < nb_frames; ++j) {
-			if (itype == DATA_FLOAT)
+			if (half_blocks)
+				data_pool[i].pix[j] = ((half_float *)data_pool[i].tmp) + j * npixels_in_block;
+			else if (itype == DATA_FLOAT)
 				data_pool[i].pix[j] = ((float*)data_pool[i].tmp) + j * npixels_in_block;
 			else 
 				data_pool[i].pix[j] = ((WORD *)data_pool[i].tmp) + j * npixels_in_block;
@@ -1413,31 +2802,6 @@ static int stack_mean_or_median(struct stacking_args *args, gboolean is_mean) {
 		args->sd_calculator = nb_frames < 65536 ? siril_stats_ushort_sd_32 : siril_stats_ushort_sd_64;
 		args->mad_calculator = siril_stats_ushort_mad;
 	}
-	switch (args->weighting_type) {
-		default:
-		case NO_WEIGHT:
-			retval = ST_OK;
-			break;
-		case NOISE_WEIGHT:
-			siril_log_message(_("Computing weights based on noise...\n"));
-			retval = compute_noise_weights(args);
-			break;
-		case WFWHM_WEIGHT:
-			siril_log_message(_("Computing weights based on wFWHM...\n"));
-			retval = compute_wfwhm_weights(args);
-			break;
-		case NBSTARS_WEIGHT:
-			siril_log_message(_("Computing weights based on number of stars...\n"));
-			retval = compute_nbstars_weights(args);
-			break;
-		case NBSTACK_WEIGHT:
-			siril_log_message(_("Computing weights based on number of stacked images...\n"));
-			break;
-	}
-	if (retval) {
-		retval = ST_GENERIC_ERROR;
-		goto free_and_close;
-	}
 
 	siril_log_message(_("Starting stacking...\n"));
 	if (is_mean)
@@ -1445,6 +2809,32 @@ static int stack_mean_or_median(struct stacking_args *args, gboolean is_mean) {
 	else	set_progress_bar_data(_("Median stacking in progress..."), PROGRESS_RESET);
 	double total = (double)(naxes[2] * naxes[1] + 2); // for progress bar
 
+	if (nb_blocks > nb_threads && !args->comet)
+		ra = stack_readahead_new(args);
+
+	/* on NUMA machines, the threads are spread over the nodes and the pixel
+	 * buffers of their pool entry are first touched by them, so that their
+	 * pages are allocated in the memory of the node reading them */
+#ifdef _OPENMP
+	gboolean numa_bound = FALSE;
+	if (nb_threads > 1 && get_numa_node_count() > 1) {
+		size_t touch_size = (size_t) pix_elem_size * nb_frames * npixels_in_block;
+		if (masking) {
+			size_t stack_offset = (size_t) pix_elem_size * nb_frames * npixels_in_block + (size_t) ielem_size * nb_frames;
+			stack_offset += (sizeof(int) - stack_offset % sizeof(int)) % sizeof(int);
+			touch_size = stack_offset + (size_t) ielem_mask_size * nb_frames * npixels_in_block;
+		}
+		int nb_nodes = get_numa_node_count();
+#pragma omp parallel num_threads(nb_threads)
+		{
+			int t = omp_get_thread_num();
+			if (numa_bind_current_thread(t * nb_nodes / nb_threads))
+				memset(data_pool[t].tmp, 0, touch_size);
+		}
+		numa_bound = TRUE;
+	}
+#endif
+
 #ifdef _OPENMP
 #pragma omp parallel for num_threads(nb_threads) private(i) schedule(dynamic) if (nb_threads > 1 && (args->seq->type == SEQ_SER || fits_is_reentrant()))
 #endif
@@ -1455,9 +2845,10 @@ static int stack_mean_or_median(struct stacking_args *args, gboolean is_mean) {
 		struct _data_block *data;
 		int data_idx = 0;
 		guint64 brej[2] = {0, 0}; // rejection counts for the block
+		guint64 brej_dual[2][2] = {{0, 0}, {0, 0}}; // same for both alignments
 		long x, y;
 
-		if (!get_thread_run()) retval = ST_CANCEL;
+		if (processing_cancelled()) retval = ST_CANCEL;
 		if (retval) continue;
 #ifdef _OPENMP
 		data_idx = omp_get_thread_num();
@@ -1469,9 +2860,16 @@ static int stack_mean_or_median(struct stacking_args *args, gboolean is_mean) {
 #endif
 		data = &data_pool[data_idx];
 
+		/* the block after the ones being stacked is read while we stack this one */
+		if (i + nb_threads < nb_blocks)
+			stack_readahead_block(ra, args, blocks + i + nb_threads);
+
 		/**** Step 2: load image data for the corresponding image block ****/
+		gint64 span = trace_begin();
 		retval = stack_read_block_data(args, my_block, data, naxes, itype, data_idx);
 		if (retval) continue;
+		trace_end(span, "stacking", "read block", i);
+		span = trace_begin();
 
 #if defined _OPENMP && defined STACK_DEBUG
 		{
@@ -1486,7 +2884,15 @@ static int stack_mean_or_median(struct stacking_args *args, gboolean is_mean) {
 
 		/**** Step 3: iterate over the y and x of the image block and stack ****/
 		int layer = my_block->channel;
-		for (y = 0; y < my_block->height; y++)
+		for (int frame = 0; frame < nb_frames; ++frame)
+			data->shiftx[frame] = layerparam ? stack_get_shiftx(args, frame) : 0;
+		gboolean on_device = use_device && !stack_block_on_device(args, data, my_block,
+				npixels_in_block, &fit, bitpix, naxes, is_mean, brej);
+		if (on_device) {
+			g_atomic_int_add(&cur_nb, (int)my_block->height);
+			set_progress_bar_data(NULL, (double)cur_nb/total);
+		}
+		for (y = 0; !on_device && y < my_block->height; y++)
 		{
 			/* index of the pixel in the result image
 			 * we read line y, but we need to store it at
@@ -1499,41 +2905,50 @@ static int stack_mean_or_median(struct stacking_args *args, gboolean is_mean) {
 			// update progress bar
 			g_atomic_int_inc(&cur_nb);
 
-			if (!get_thread_run()) {
+			if (processing_cancelled()) {
 				retval = ST_CANCEL;
 				break;
 			}
 			if (!(cur_nb % 16))	// every 16 iterations
 				set_progress_bar_data(NULL, (double)cur_nb/total);
 
+			if (use_batch) {
+				stack_batch_line(args, data, my_block, &fit, bitpix, naxes, itype,
+						line_idx, pdata_idx, is_mean, median_net, median_net_size, brej);
+				continue;
+			}
+			if (args->comet) {
+				stack_comet_line(args, data, my_block, &fit, &comet_fit, bitpix, naxes, itype,
+						y, pdata_idx, is_mean, brej_dual);
+				continue;
+			}
+
 			for (x = 0; x < naxes[0]; ++x) {
+				/* the rejection of one row can be long with many frames */
+				if (!(x & 255) && processing_cancelled()) {
+					retval = ST_CANCEL;
+					break;
+				}
 				/* copy all images pixel values in the same row array `stack'
 				 * to optimize caching and improve readability */
 				for (int frame = 0; frame < nb_frames; ++frame) {
-					int pix_idx = line_idx + x;
-					if (layerparam) {
-						int shiftx = 0;
-						double scale = (args->upscale_at_stacking) ? 2. : 1.;
-						double dx, dy;
-						translation_from_H(layerparam[args->image_indices[frame]].H, &dx, &dy);
-						dx -= args->offset[0];
-						shiftx = round_to_int(dx * scale);
-
-
-						if (shiftx && (x - shiftx >= naxes[0] || x - shiftx < 0)) {
-							/* outside bounds, images are black. We could
-							 * also set the background value instead, if available */
-							if (itype == DATA_FLOAT)
-								((float*)data->stack)[frame] = 0.0f;
-							else ((WORD *)data->stack)[frame] = 0;
-							continue;
-						}
-
-						pix_idx -= shiftx;
+					int shiftx = data->shiftx[frame];
+					if (!data->in_block[frame] || (shiftx && (x - shiftx >= naxes[0] || x - shiftx < 0))) {
+						/* outside bounds, images are black. We could
+						 * also set the background value instead, if available */
+						if (itype == DATA_FLOAT)
+							((float*)data->stack)[frame] = 0.0f;
+						else ((WORD *)data->stack)[frame] = 0;
+						if (masking)
+							data->mstack[frame] = 0.f;
+						continue;
 					}
+					int pix_idx = line_idx + x - shiftx;
 
 					WORD pixel = 0; float fpixel = 0.f;
-					if (itype == DATA_FLOAT)
+					if (args->half_blocks)
+						fpixel = half_to_float(((half_float *) data->pix[frame])[pix_idx]);
+					else if (itype == DATA_FLOAT)
 						fpixel = ((float*) data->pix[frame])[pix_idx];
 					else
 						pixel = ((WORD*) data->pix[frame])[pix_idx];
@@ -1592,40 +3007,15 @@ static int stack_mean_or_median(struct stacking_args *args, gboolean is_mean) {
 					result = mean_and_reject(args, data, nb_frames, itype, rej);
 					brej[0] += rej[0];
 					brej[1] += rej[1];
-					if (args->create_rejmaps) {
-						if (args->merge_lowhigh_rejmaps) {
-							WORD nbrej = truncate_to_WORD(rej[0] + rej[1]);
-							args->rejmap_low->pdata[my_block->channel][pdata_idx] = nbrej;
-						}
-						else {
-							args->rejmap_low->pdata[my_block->channel][pdata_idx] = truncate_to_WORD(rej[0]);
-							args->rejmap_high->pdata[my_block->channel][pdata_idx] = truncate_to_WORD(rej[1]);
-						}
-					}
+					if (args->create_rejmaps)
+						stack_rejcount_store(args, my_block->channel * naxes[0] * naxes[1] + pdata_idx, rej);
 				} else {
 					if (itype == DATA_USHORT)
 						result = quickmedian(data->stack, nb_frames);
 					else 	result = quickmedian_float(data->stack, nb_frames);
 				}
 
-				if (args->use_32bit_output) {
-					// if we renormalize afterwards, we keep the data as is
-					// otherwise, we clamp in the [0,1] range
-					if (itype == DATA_USHORT)
-						fit.fpdata[my_block->channel][pdata_idx] = (args->output_norm) ?
-																	double_ushort_to_float_range(result) :
-																	set_float_in_interval(double_ushort_to_float_range(result), 0.f, 1.f);
-					else
-						fit.fpdata[my_block->channel][pdata_idx] = (args->output_norm) ?
-																	(float)result :
-																	set_float_in_interval((float)result, 0.f, 1.f);
-				} else {
-					/* in case of 8bit data we may want to normalize to 16bits */
-					if (args->output_norm) {
-						normalize_to16bit(bitpix, &result);
-					}
-					fit.pdata[my_block->channel][pdata_idx] = round_to_WORD(result);
-				}
+				store_stacked_pixel(args, &fit, bitpix, itype, my_block->channel, pdata_idx, result);
 				pdata_idx++;
 			} // end of for x
 		} // end of for y
@@ -1639,6 +3029,11 @@ static int stack_mean_or_median(struct stacking_args *args, gboolean is_mean) {
 					data_idx, i, min, sec);
 		}
 #endif
+		trace_end(span, "stacking", is_mean ? "rejection block" : "median block", i);
+		if (args->comet) {
+			brej[0] = brej_dual[0][0];
+			brej[1] = brej_dual[0][1];
+		}
 		if (is_mean && args->type_of_rejection != NO_REJEC) {
 #ifdef _OPENMP
 #pragma omp atomic
@@ -1648,44 +3043,63 @@ static int stack_mean_or_median(struct stacking_args *args, gboolean is_mean) {
 #pragma omp atomic
 #endif
 			irej[my_block->channel][1] += brej[1];
+			if (args->comet) {
+#ifdef _OPENMP
+#pragma omp atomic
+#endif
+				irej_comet[my_block->channel][0] += brej_dual[1][0];
+#ifdef _OPENMP
+#pragma omp atomic
+#endif
+				irej_comet[my_block->channel][1] += brej_dual[1][1];
+			}
 		}
 
 
 	} /* end of loop over parallel stacks */
 
+#ifdef _OPENMP
+	if (numa_bound) {
+#pragma omp parallel num_threads(nb_threads)
+		numa_unbind_current_thread();
+	}
+#endif
+
 	if (retval)
 		goto free_and_close;
 
 	set_progress_bar_data(_("Finalizing stacking..."), (double)cur_nb/total);
-	if (is_mean) {
-		double nb_tot = (double) naxes[0] * (double) naxes[1] * (double) nb_frames;
-		for (long channel = 0; channel < naxes[2]; channel++) {
-			siril_log_message(_("Pixel rejection in channel #%d: %.3lf%% - %.3lf%%\n"),
-					channel, (double) irej[channel][0] / nb_tot * 100.0,
-					(double) irej[channel][1] / nb_tot * 100.0);
-		}
-	}
-	if (args->use_32bit_output && args->output_norm)
-		norm_to_0_1_range(&fit);
-	compute_date_time_keywords(list_date, &fit);
-	memcpy(&args->result, &fit, sizeof(fits));
-	if (has_wcs(&args->result)) {
-		update_wcsdata_from_wcs(&args->result);
-	}
+	stack_finalize_result(args, &fit, naxes, is_mean, irej, list_date);
+	if (args->comet)
+		stack_finalize_comet_result(args, &comet_fit, naxes, is_mean, irej_comet, list_date);
 
 free_and_close:
 	fprintf(stdout, "free and close (%d)\n", retval);
+	memory_account(MEM_STACKING, -pool_bytes);
 	for (i = 0; i < nb_frames; ++i) {
 		seq_close_image(args->seq, args->image_indices[i]);
 	}
+	stack_free_handle_pool(args);
 
 	if (data_pool) {
 		for (i=0; i<pool_size; i++) {
 			if (data_pool[i].pix) free(data_pool[i].pix);
 			if (data_pool[i].tmp) free(data_pool[i].tmp);
+			if (data_pool[i].batch) free(data_pool[i].batch);
+			free(data_pool[i].half_row);
+			free(data_pool[i].shiftx);
+			free(data_pool[i].device_results);
+			free(data_pool[i].device_rej);
 		}
 		free(data_pool);
 	}
+	if (args->create_rejmaps) {
+		if (!retval && args->rejcount[0])
+			retval = stack_rejcount_to_rejmaps(args, naxes);
+		stack_rejcount_free(args);
+	}
+	free(median_net);
+	stack_readahead_free(ra);
 	g_list_free_full(list_date, (GDestroyNotify) free_list_date);
 	if (blocks) free(blocks);
 	if (args->normalize) {
@@ -1695,10 +3109,16 @@ free_and_close:
 	}
 
 	if (args->weights) free(args->weights);
+	free(args->warp_H);
+	args->warp_H = NULL;
+	stack_comet_free(args);
+	io_stats_report(is_mean ? _("Rejection stacking") : _("Median stacking"));
+	memory_report_end();
 	if (retval) {
 		/* if retval is set, gfit has not been modified */
 		if (fit.data) free(fit.data);
 		if (fit.fdata) free(fit.fdata);
+		clearfits(&comet_fit);
 		if (is_mean)
 			set_progress_bar_data(_("Rejection stacking failed. Check the log."), PROGRESS_RESET);
 		else	set_progress_bar_data(_("Median stacking failed. Check the log."), PROGRESS_RESET);
@@ -22,6 +22,43 @@
 static int compute_normalization(struct stacking_args *args);
 static int compute_normalization_overlaps(struct stacking_args *args);
 
+/* The estimators of the images are cached in the sequence file with the other
+ * statistics. They are only valid if the images were not modified since the
+ * sequence file was written, which we check like for the other cache files.
+ * Returns the number of images for which the cache was cleared. */
+static int clear_outdated_estimators(struct stacking_args *args) {
+	sequence *seq = args->seq;
+	if (seq->type == SEQ_INTERNAL || !seq->stats || seq->needs_saving)
+		return 0;	// in-memory statistics are newer than the file
+	gchar *seqfilename = g_strdup_printf("%s.seq", seq->seqname);
+	if (!g_file_test(seqfilename, G_FILE_TEST_EXISTS)) {
+		g_free(seqfilename);
+		return 0;
+	}
+	int nb_cleared = 0;
+	if (seq->type == SEQ_REGULAR) {
+		for (int i = 0; i < args->nb_images_to_stack; i++) {
+			int index = args->image_indices[i];
+			if (!check_cachefile_date(seq, index, seqfilename)) {
+				clear_stats_of_image(seq, index);
+				nb_cleared++;
+			}
+		}
+	} else if (!check_cachefile_date(seq, 0, seqfilename)) {
+		// single file sequences: all cached statistics are outdated
+		for (int layer = 0; layer < seq->nb_layers; layer++)
+			clear_stats(seq, layer);
+		nb_cleared = args->nb_images_to_stack;
+	}
+	g_free(seqfilename);
+	if (nb_cleared) {
+		siril_log_message(_("%d images were modified since their statistics were cached, "
+					"they will be computed again\n"), nb_cleared);
+		seq->needs_saving = TRUE;
+	}
+	return nb_cleared;
+}
+
 /* normalization: reading all images and making stats on their background level.
  * That's very long if not cached. */
 int do_normalization(struct stacking_args *args) {
@@ -42,6 +79,8 @@ int do_normalization(struct stacking_args *args) {
 		return args->retval;
 	}
 
+	clear_outdated_estimators(args);
+
 	if (args->overlap_norm && compute_normalization_overlaps(args)) {
 		args->retval = ST_GENERIC_ERROR;
 		return args->retval;
@@ -161,8 +200,17 @@ static void compute_factors_from_estimators(struct stacking_args *args, int ref_
 	}
 }
 
-static int normalization_get_max_number_of_threads(sequence *seq) {
-	int max_memory_MB = get_max_memory_in_MB();
+/* SER and RAW files are read without cfitsio */
+static gboolean reads_in_parallel(sequence *seq) {
+#ifdef HAVE_LIBRAW
+	if (seq->type == SEQ_RAW)
+		return TRUE;
+#endif
+	return seq->type == SEQ_SER || ((seq->type == SEQ_REGULAR || seq->type == SEQ_FITSEQ) && fits_is_reentrant());
+}
+
+static int normalization_get_max_number_of_threads(sequence *seq, int reserved_MB) {
+	int max_memory_MB = get_max_memory_in_MB() - reserved_MB;
 	/* The normalization memory consumption, n is image size and m channel size.
 	 * It uses IKSS computation in stats, which can be done only on float data.
 	 * IKSS requires computing the MAD, which requires its own copy of the data.
@@ -226,7 +274,7 @@ static int compute_normalization(struct stacking_args *args) {
 	const char *error_msg = (_("Normalization failed."));
 
 	// check memory first
-	int nb_threads = normalization_get_max_number_of_threads(args->seq);
+	int nb_threads = normalization_get_max_number_of_threads(args->seq, stack_get_reserved_MB(args));
 	if (nb_threads <= 0) {
 		set_progress_bar_data(error_msg, PROGRESS_NONE);
 		return ST_GENERIC_ERROR;
@@ -239,7 +287,7 @@ static int compute_normalization(struct stacking_args *args) {
 
 #ifdef _OPENMP
 #pragma omp parallel for num_threads(nb_threads) schedule(guided) \
-	if (args->seq->type == SEQ_SER || ((args->seq->type == SEQ_REGULAR || args->seq->type == SEQ_FITSEQ) && fits_is_reentrant()))
+	if (reads_in_parallel(args->seq))
 #endif
 
 	for (int i = 0; i < args->nb_images_to_stack; ++i) {
@@ -274,65 +322,245 @@ static int compute_normalization(struct stacking_args *args) {
 	return retval;
 }
 
-static void solve_overlap_coeffs(int nb_frames, int *index, int index_ref, size_t **Nij, double **Mij, gboolean additive, double *coeffs) {
-	int c = 0;
-	int N = nb_frames - 1;
-	double *A = calloc(N * N, sizeof(double));
-	double *B = calloc(N, sizeof(double));
-	for (int i = 0; i < N; i ++) {
-		int ii = index[i];
-		B[i] = (additive) ? (double)Nij[ii][index_ref] * (Mij[index_ref][ii] - Mij[ii][index_ref]) :
-							(double)Nij[ii][index_ref] * Mij[index_ref][ii] * Mij[ii][index_ref];
-		for (int j = 0; j < N; j ++) {
-			int ij = index[j];
-			if (ii == ij) {
-				for (int k = 0; k < nb_frames; k++) {
-					if (k != ii)
-						A[c] += (additive) ? (double)Nij[ii][k] :
-											 (double)Nij[ii][k] * Mij[ii][k] * Mij[ii][k];
-				}
-			} else {
-				A[c] = (additive) ? -(double)Nij[ii][ij] :
-									-(double)Nij[ii][ij] * Mij[ii][ij] * Mij[ij][ii];
-				if (additive)
-					B[i] += Nij[ii][ij] * (Mij[ij][ii] - Mij[ii][ij]);
+/* an overlapping pair of images, i and j are indices in the filtered list of
+ * images with i < j, ijth is the index of the pair in seq->ostats */
+typedef struct {
+	int i, j;
+	int ijth;
+	size_t Nij[3];
+	double Mij[3], Mji[3];
+	double Sij[3], Sji[3];
+} overlap_pair;
+
+/* The coefficients are the solution of a least squares problem on the differences
+ * between the estimators of each pair of overlapping images, with the reference
+ * image fixed. The system has one row per non-reference image and only one non-zero
+ * term per overlapping pair outside the diagonal. It is stored as the diagonal, the
+ * off-diagonal term of each pair (the matrix is symmetric) and the right-hand side.
+ * unknown[i] is the row of image i, -1 for the reference. scale selects the scale
+ * estimators instead of the location ones. */
+static void assemble_overlap_system(const int *unknown, int N, overlap_pair *pairs, int nb_pairs,
+		int layer, gboolean additive, gboolean scale, double *diag, double *offdiag, double *B) {
+	memset(diag, 0, N * sizeof(double));
+	memset(B, 0, N * sizeof(double));
+	for (int p = 0; p < nb_pairs; p++) {
+		overlap_pair *pair = pairs + p;
+		double Nij = (double)pair->Nij[layer];
+		double Mij = (scale) ? pair->Sij[layer] : pair->Mij[layer];
+		double Mji = (scale) ? pair->Sji[layer] : pair->Mji[layer];
+		int ui = unknown[pair->i], uj = unknown[pair->j];
+		offdiag[p] = 0.0;
+		if (Nij == 0.0)
+			continue;
+		if (additive) {
+			if (ui >= 0) {
+				diag[ui] += Nij;
+				B[ui] += Nij * (Mji - Mij);
+			}
+			if (uj >= 0) {
+				diag[uj] += Nij;
+				B[uj] += Nij * (Mij - Mji);
+			}
+			offdiag[p] = -Nij;
+		} else {
+			if (ui >= 0) {
+				diag[ui] += Nij * Mij * Mij;
+				if (uj < 0)
+					B[ui] += Nij * Mji * Mij;
 			}
-			c++;
+			if (uj >= 0) {
+				diag[uj] += Nij * Mji * Mji;
+				if (ui < 0)
+					B[uj] += Nij * Mij * Mji;
+			}
+			offdiag[p] = -Nij * Mij * Mji;
 		}
 	}
-	// and solve the system
-#ifdef DEBUG_NORM
-	if (additive) {
-		for (int i = 0; i < N; i++) {
-			for (int j = 0; j < N; j++) {
-				siril_debug_print("%10d ", (int)A[j + i * N]);
-			}
-			siril_debug_print("; %16.6f\n", B[i]);
-		} 
+}
+
+static void overlap_system_product(const int *unknown, int N, const overlap_pair *pairs, int nb_pairs,
+		const double *diag, const double *offdiag, const double *x, double *y) {
+	for (int k = 0; k < N; k++)
+		y[k] = diag[k] * x[k];
+	for (int p = 0; p < nb_pairs; p++) {
+		int ui = unknown[pairs[p].i], uj = unknown[pairs[p].j];
+		if (ui < 0 || uj < 0 || offdiag[p] == 0.0)
+			continue;
+		y[ui] += offdiag[p] * x[uj];
+		y[uj] += offdiag[p] * x[ui];
+	}
+}
+
+/* the matrix is symmetric positive definite when all images are connected to the
+ * reference, we solve it with a Jacobi preconditioned conjugate gradient, which
+ * only needs the overlapping pairs */
+static int solve_overlap_system_cg(const int *unknown, int N, const overlap_pair *pairs, int nb_pairs,
+		const double *diag, const double *offdiag, const double *B, gboolean additive, double *x) {
+	double *r = malloc(N * sizeof(double));
+	double *z = malloc(N * sizeof(double));
+	double *d = malloc(N * sizeof(double));
+	double *q = malloc(N * sizeof(double));
+	if (!r || !z || !d || !q) {
+		PRINT_ALLOC_ERR;
+		free(r); free(z); free(d); free(q);
+		return ST_ALLOC_ERROR;
+	}
+	double normB = 0.0, rz = 0.0;
+	for (int k = 0; k < N; k++) {
+		x[k] = (additive) ? 0.0 : 1.0;
+		normB += B[k] * B[k];
+	}
+	overlap_system_product(unknown, N, pairs, nb_pairs, diag, offdiag, x, q);
+	for (int k = 0; k < N; k++) {
+		r[k] = B[k] - q[k];
+		z[k] = r[k] / diag[k];
+		d[k] = z[k];
+		rz += r[k] * z[k];
+	}
+	double tol = 1e-24 * normB;
+	int iter = 0, max_iter = 10 * N + 100;
+	for (; iter < max_iter; iter++) {
+		double normr = 0.0;
+		for (int k = 0; k < N; k++)
+			normr += r[k] * r[k];
+		if (normr <= tol)
+			break;
+		overlap_system_product(unknown, N, pairs, nb_pairs, diag, offdiag, d, q);
+		double dq = 0.0;
+		for (int k = 0; k < N; k++)
+			dq += d[k] * q[k];
+		if (dq <= 0.0)
+			break;
+		double alpha = rz / dq, rz_new = 0.0;
+		for (int k = 0; k < N; k++) {
+			x[k] += alpha * d[k];
+			r[k] -= alpha * q[k];
+			z[k] = r[k] / diag[k];
+			rz_new += r[k] * z[k];
+		}
+		double beta = rz_new / rz;
+		rz = rz_new;
+		for (int k = 0; k < N; k++)
+			d[k] = z[k] + beta * d[k];
+	}
+	siril_debug_print("overlap normalization: conjugate gradient used %d iterations for %d images\n", iter, N);
+	free(r);
+	free(z);
+	free(d);
+	free(q);
+	return ST_OK;
+}
+
+static int solve_overlap_coeffs(const int *unknown, int N, overlap_pair *pairs, int nb_pairs,
+		int layer, gboolean additive, gboolean scale, double *coeffs) {
+	double *diag = malloc(N * sizeof(double));
+	double *B = malloc(N * sizeof(double));
+	double *offdiag = malloc(max(nb_pairs, 1) * sizeof(double));
+	if (!diag || !B || !offdiag) {
+		PRINT_ALLOC_ERR;
+		free(diag); free(B); free(offdiag);
+		return ST_ALLOC_ERROR;
+	}
+	assemble_overlap_system(unknown, N, pairs, nb_pairs, layer, additive, scale, diag, offdiag, B);
+	int retval = ST_OK;
+	if (N > MAX_IMAGES_FOR_OVERLAP) {
+		retval = solve_overlap_system_cg(unknown, N, pairs, nb_pairs, diag, offdiag, B, additive, coeffs);
 	} else {
+		// small systems are solved directly
+		double *A = calloc(N * N, sizeof(double));
+		if (!A) {
+			PRINT_ALLOC_ERR;
+			free(diag); free(B); free(offdiag);
+			return ST_ALLOC_ERROR;
+		}
+		for (int k = 0; k < N; k++)
+			A[k * N + k] = diag[k];
+		for (int p = 0; p < nb_pairs; p++) {
+			int ui = unknown[pairs[p].i], uj = unknown[pairs[p].j];
+			if (ui < 0 || uj < 0)
+				continue;
+			A[ui * N + uj] = offdiag[p];
+			A[uj * N + ui] = offdiag[p];
+		}
+#ifdef DEBUG_NORM
 		for (int i = 0; i < N; i++) {
 			for (int j = 0; j < N; j++) {
 				siril_debug_print("%+10.3f ", A[j + i * N]);
 			}
-			siril_debug_print("; %10.6f\n", B[i]);
+			siril_debug_print("; %16.6f\n", B[i]);
 		}
-	}
 #endif
-	gsl_matrix_view m = gsl_matrix_view_array(A, N, N);
-	gsl_vector_view b = gsl_vector_view_array(B, N);
-	gsl_vector *x = gsl_vector_alloc(N);
-	int s;
-	gsl_permutation * p = gsl_permutation_alloc(N);
-	gsl_linalg_LU_decomp(&m.matrix, p, &s);
-	gsl_linalg_LU_solve(&m.matrix, p, &b.vector, x);
+		gsl_matrix_view m = gsl_matrix_view_array(A, N, N);
+		gsl_vector_view b = gsl_vector_view_array(B, N);
+		gsl_vector_view x = gsl_vector_view_array(coeffs, N);
+		int s;
+		gsl_permutation * p = gsl_permutation_alloc(N);
+		gsl_linalg_LU_decomp(&m.matrix, p, &s);
+		gsl_linalg_LU_solve(&m.matrix, p, &b.vector, &x.vector);
+		gsl_permutation_free(p);
+		free(A);
+	}
 #ifdef DEBUG_NORM
-	gsl_vector_fprintf(stdout, x, "%g");
+	for (int k = 0; k < N; k++)
+		siril_debug_print("%g\n", coeffs[k]);
 #endif
-	gsl_permutation_free(p);
-	free(A);
+	free(diag);
 	free(B);
-	memcpy(coeffs, x->data, N * sizeof(double));
-	gsl_vector_free(x);
+	free(offdiag);
+	return retval;
+}
+
+/* checks that all images are linked to the reference by a chain of overlaps on
+ * the layer, otherwise the system has no unique solution. Returns the index of
+ * the first image that is not, -1 if they all are */
+static int find_unconnected_image(int nb_frames, int index_ref, const overlap_pair *pairs, int nb_pairs, int layer) {
+	int *first = malloc(nb_frames * sizeof(int));
+	int *next = malloc(2 * nb_pairs * sizeof(int));
+	int *stack = malloc(nb_frames * sizeof(int));
+	gboolean *visited = calloc(nb_frames, sizeof(gboolean));
+	int unconnected = -1;
+	if (!first || (nb_pairs && !next) || !stack || !visited) {
+		PRINT_ALLOC_ERR;
+		unconnected = index_ref;
+		goto free_and_return;
+	}
+	// adjacency lists: entry 2p is pair p seen from i, 2p+1 from j
+	for (int i = 0; i < nb_frames; i++)
+		first[i] = -1;
+	for (int p = 0; p < nb_pairs; p++) {
+		if (pairs[p].Nij[layer] == 0)
+			continue;
+		next[2 * p] = first[pairs[p].i];
+		first[pairs[p].i] = 2 * p;
+		next[2 * p + 1] = first[pairs[p].j];
+		first[pairs[p].j] = 2 * p + 1;
+	}
+	int nb_stacked = 0;
+	stack[nb_stacked++] = index_ref;
+	visited[index_ref] = TRUE;
+	while (nb_stacked) {
+		int i = stack[--nb_stacked];
+		for (int e = first[i]; e >= 0; e = next[e]) {
+			const overlap_pair *pair = pairs + e / 2;
+			int k = (e & 1) ? pair->i : pair->j;
+			if (!visited[k]) {
+				visited[k] = TRUE;
+				stack[nb_stacked++] = k;
+			}
+		}
+	}
+	for (int i = 0; i < nb_frames; i++) {
+		if (!visited[i]) {
+			unconnected = i;
+			break;
+		}
+	}
+free_and_return:
+	free(first);
+	free(next);
+	free(stack);
+	free(visited);
+	return unconnected;
 }
 
 void free_ostats(overlap_stats_t **ostats, int nb_layers) {
@@ -543,8 +771,8 @@ static int _compute_estimators_for_images(struct stacking_args *args, int i, int
 				siril_debug_print("%lu pixels for images %d and %d on layer %d\n", Nij, i + 1, j + 1, n);
 				seq->ostats[n][ijth].medij = (float)histogram_median_float(datai, Nij, SINGLE_THREADED);
 				seq->ostats[n][ijth].medji = (float)histogram_median_float(dataj, Nij, SINGLE_THREADED);
-				seq->ostats[n][ijth].madij = (float)siril_stats_float_mad(datai, Nij, seq->ostats[n][ijth].medij, SINGLE_THREADED, NULL);
-				seq->ostats[n][ijth].madji = (float)siril_stats_float_mad(dataj, Nij, seq->ostats[n][ijth].medji, SINGLE_THREADED, NULL);
+				seq->ostats[n][ijth].madij = (float)siril_stats_float_mad(datai, Nij, seq->ostats[n][ijth].medij, SINGLE_THREADED);
+				seq->ostats[n][ijth].madji = (float)siril_stats_float_mad(dataj, Nij, seq->ostats[n][ijth].medji, SINGLE_THREADED);
 			} else {
 				siril_debug_print("Lite overlap stats for images %d and %d on layer %d read from cache\n", i + 1, j + 1, n);
 			}
@@ -571,21 +799,26 @@ static int _compute_estimators_for_images(struct stacking_args *args, int i, int
 	return ST_OK;
 }
 
-static int normalization_overlap_get_max_number_of_threads(struct stacking_args *args) {
-	int max_memory_MB = get_max_memory_in_MB();
-	int nb_frames = args->nb_images_to_stack;
-	int nb_layers = args->seq->nb_layers;
+/* builds the list of the pairs of images that overlap, from the cached overlap
+ * areas or from the registration data, caching the areas for all layers.
+ * Normally, we should have regdata for only one layer, but what if we have for
+ * more (can't see that happening but better be safe). In that case, we will
+ * assume that the differences in overlaps should be minimal (1 or 2 lines) and
+ * that the first ever cached overlap stats are valid irrespective of the
+ * regdata which created them.
+ * The largest overlap size is returned in nbdatamax. */
+static overlap_pair *build_overlap_pairs(struct stacking_args *args, int *nb_pairs, size_t *nbdatamax) {
 	sequence *seq = args->seq;
-	/* The overlap normalization memory consumption assumes:
-		- n is max overlap size accross all pairs of images
-		- l in the number of layers
-		We need:
-		- 2 * overlap parial image stored (so 2.n.l) when we read the images
-		- 2 * data copies as floats (so 2.n as float) that are re-used for all layers
-		- 1 * data additional copy to compute MAD (not 2 because the calcs are 
-		sequential and memory freed in between calls)
-	*/
-	size_t nbdatamax = 0;
+	int nb_frames = args->nb_images_to_stack;
+	int nb_layers = seq->nb_layers;
+	int allocated = 4 * nb_frames;
+	overlap_pair *pairs = malloc(allocated * sizeof(overlap_pair));
+	if (!pairs) {
+		PRINT_ALLOC_ERR;
+		return NULL;
+	}
+	*nb_pairs = 0;
+	*nbdatamax = 0;
 	for (int i = 0; i < nb_frames; ++i) {
 		int ii = args->image_indices[i];
 		for (int j = i + 1; j < nb_frames; ++j) {
@@ -595,14 +828,9 @@ static int normalization_overlap_get_max_number_of_threads(struct stacking_args
 			if (seq->ostats[args->reglayer][ijth].i == ii && seq->ostats[args->reglayer][ijth].j == ij) { // we have some overlap data for this pair
 				nbdata = seq->ostats[args->reglayer][ijth].areai.w * seq->ostats[args->reglayer][ijth].areai.h;
 			} else {
-				args->seq->needs_saving = TRUE;
+				seq->needs_saving = TRUE;
 				rectangle areai, areaj;
-				siril_debug_print("computing stats for overlap between image %d and image %d, lite: %d\n", ii + 1, ij + 1, args->lite_norm);
 				nbdata = compute_overlap(args, ii, ij, &areai, &areaj);
-				// we cache it for all layers
-				// Normally, we should have regdata for only one layer, but what if we have for more (can't see that happening but better be safe)
-				// In that case, we will assume that the differences in overlaps should be minimal (1 or 2 lines) and that
-				// the first ever cached overlap stats are valid irrespective of the regdata which created them
 				for (int n = 0; n < nb_layers; n++) {
 					seq->ostats[n][ijth].i = ii;
 					seq->ostats[n][ijth].j = ij;
@@ -612,10 +840,40 @@ static int normalization_overlap_get_max_number_of_threads(struct stacking_args
 					}
 				}
 			}
-			if (nbdata > nbdatamax)
-				nbdatamax = nbdata;
+			if (nbdata == 0)
+				continue;
+			if (*nb_pairs == allocated) {
+				allocated *= 2;
+				overlap_pair *tmp = realloc(pairs, allocated * sizeof(overlap_pair));
+				if (!tmp) {
+					PRINT_ALLOC_ERR;
+					free(pairs);
+					return NULL;
+				}
+				pairs = tmp;
+			}
+			pairs[*nb_pairs] = (overlap_pair) { .i = i, .j = j, .ijth = ijth };
+			(*nb_pairs)++;
+			if (nbdata > *nbdatamax)
+				*nbdatamax = nbdata;
 		}
 	}
+	siril_log_message(_("%d pairs of images overlap, out of %d\n"), *nb_pairs, nb_frames * (nb_frames - 1) / 2);
+	return pairs;
+}
+
+static int normalization_overlap_get_max_number_of_threads(struct stacking_args *args, size_t nbdatamax) {
+	int max_memory_MB = get_max_memory_in_MB() - stack_get_reserved_MB(args);
+	sequence *seq = args->seq;
+	/* The overlap normalization memory consumption assumes:
+		- n is max overlap size accross all pairs of images
+		- l in the number of layers
+		We need:
+		- 2 * overlap parial image stored (so 2.n.l) when we read the images
+		- 2 * data copies as floats (so 2.n as float) that are re-used for all layers
+		- 1 * data additional copy to compute MAD (not 2 because the calcs are 
+		sequential and memory freed in between calls)
+	*/
 	size_t memory_per_pair = 2 * seq->nb_layers * nbdatamax * (get_data_type(seq->bitpix) == DATA_FLOAT ? sizeof(float) : sizeof(WORD)); // we size memory consumption with the largest possible overlap
 	size_t memory_per_stats = 2 * nbdatamax * sizeof(float);
 	unsigned int memory_per_pair_MB = ( memory_per_pair + memory_per_stats) / BYTES_IN_A_MB;
@@ -637,13 +895,15 @@ static int normalization_overlap_get_max_number_of_threads(struct stacking_args
 }
 
 static int compute_normalization_overlaps(struct stacking_args *args) {
-	int index_ref = -1, retval = 0, cur_nb = 0, c = 0;
+	int index_ref = -1, retval = 0, cur_nb = 0, nb_pairs = 0;
 	norm_coeff *coeff = &args->coeff;
 	int nb_layers = args->seq->nb_layers;
 	int nb_frames = args->nb_images_to_stack;
-	int Npairs = nb_frames * (nb_frames - 1) / 2;
 	int N = nb_frames - 1;
+	size_t nbdatamax = 0;
 	double *coeffs = NULL;
+	overlap_pair *pairs = NULL;
+	int *index = NULL, *unknown = NULL;
 	// imstats *refstats[3] = { NULL };
 
 	if (args->normalize == NO_NORM || !args->maximize_framing)	// should never happen here
@@ -686,28 +946,26 @@ static int compute_normalization_overlaps(struct stacking_args *args) {
 	// the images of the sequence (without filtering)
 	if (!args->seq->ostats) {
 		args->seq->ostats = alloc_ostats(nb_layers, args->seq->number);
-		if (!args->seq->ostats) {
-			retval  = 1;
-			goto cleanup;
-		}
+		if (!args->seq->ostats)
+			return ST_ALLOC_ERROR;
 		args->seq->needs_saving = TRUE;
+	}
 
+	// only the pairs that overlap are read and enter the system of equations
+	pairs = build_overlap_pairs(args, &nb_pairs, &nbdatamax);
+	index = malloc(N * sizeof(int));
+	unknown = malloc(nb_frames * sizeof(int));
+	coeffs = malloc(N * sizeof(double));
+	if (!pairs || !index || !unknown || !coeffs) {
+		PRINT_ALLOC_ERR;
+		retval = ST_ALLOC_ERROR;
+		goto cleanup;
 	}
-	
-	double ***Mij = malloc(nb_layers * sizeof(double **));
-	double ***Sij = malloc(nb_layers * sizeof(double **));
-	size_t ***Nij = malloc(nb_frames * sizeof(size_t **));
-	for (int n = 0; n < nb_layers; n++) {
-		Mij[n] = malloc(nb_frames * sizeof(double *));
-		Sij[n] = malloc(nb_frames * sizeof(double *));
-		Nij[n] = malloc(nb_frames * sizeof(size_t *));
-		for (int i = 0; i < nb_frames; i++) {
-			Mij[n][i] = calloc(nb_frames, sizeof(double));
-			Sij[n][i] = calloc(nb_frames, sizeof(double));
-			Nij[n][i] = calloc(nb_frames, sizeof(size_t));
-		}
+	for (int i = 0, c = 0; i < nb_frames; i++) {
+		unknown[i] = (i == index_ref) ? -1 : c;
+		if (i != index_ref)
+			index[c++] = i; // getting the filtered indexes of nonref images
 	}
-	int *index = malloc((nb_frames - 1) * sizeof(int));
 
 	char *tmpmsg = siril_log_message(_("Computing normalization on overlaps...\n"));
 	tmpmsg[strlen(tmpmsg) - 1] = '\0';
@@ -715,59 +973,55 @@ static int compute_normalization_overlaps(struct stacking_args *args) {
 
 	const char *error_msg = (_("Normalization failed."));
 	// check memory first
-	int nb_threads = normalization_overlap_get_max_number_of_threads(args);
+	int nb_threads = normalization_overlap_get_max_number_of_threads(args, nbdatamax);
 	if (nb_threads <= 0) {
 		set_progress_bar_data(error_msg, PROGRESS_NONE);
-		return ST_GENERIC_ERROR;
+		retval = ST_GENERIC_ERROR;
+		goto cleanup;
 	}
-	if (nb_threads > args->nb_images_to_stack)
-		nb_threads = args->nb_images_to_stack;
+	if (nb_threads > nb_pairs)
+		nb_threads = max(nb_pairs, 1);
 
 	set_progress_bar_data(NULL, 0.);
 
 #ifdef _OPENMP
-#pragma omp parallel for num_threads(nb_threads) schedule(guided) if (args->seq->type == SEQ_SER || ((args->seq->type == SEQ_REGULAR || args->seq->type == SEQ_FITSEQ) && fits_is_reentrant()))
+#pragma omp parallel for num_threads(nb_threads) schedule(dynamic) if (reads_in_parallel(args->seq))
 #endif
-	for (int i = 0; i < nb_frames; ++i) {
-		if (i != index_ref)
-			index[c++] = i; // getting the filtered indexes of nonref images
-		int ii = args->image_indices[i];
-		for (int j = i + 1; j < nb_frames; ++j) {
-			if (!retval) {
-				if (!get_thread_run()) {
-					retval = 1;
-					continue;
-				}
-				int ij = args->image_indices[j];
-				int ijth = get_ijth_pair_index(args->seq->number, ii, ij);
-				if (_compute_estimators_for_images(args, ii, ij)) {
-					siril_log_color_message(_("%s Check image %d first.\n"), "red",
-							error_msg, args->image_indices[i] + 1);
-					set_progress_bar_data(error_msg, PROGRESS_NONE);
-					retval = 1;
+	for (int p = 0; p < nb_pairs; ++p) {
+		if (!retval) {
+			if (!get_thread_run()) {
+				retval = 1;
+				continue;
+			}
+			overlap_pair *pair = pairs + p;
+			int ii = args->image_indices[pair->i];
+			int ij = args->image_indices[pair->j];
+			if (_compute_estimators_for_images(args, ii, ij)) {
+				siril_log_color_message(_("%s Check image %d first.\n"), "red",
+						error_msg, ii + 1);
+				set_progress_bar_data(error_msg, PROGRESS_NONE);
+				retval = 1;
+				continue;
+			}
+			for (int n = 0; n < nb_layers; n++) {
+				overlap_stats_t *ostat = &args->seq->ostats[n][pair->ijth];
+				pair->Nij[n] = ostat->Nij;
+				if (ostat->Nij == 0)
 					continue;
+				if (args->lite_norm) {
+					pair->Mij[n] = ostat->medij;
+					pair->Mji[n] = ostat->medji;
+					pair->Sij[n] = ostat->madij;
+					pair->Sji[n] = ostat->madji;
+				} else {
+					pair->Mij[n] = ostat->locij;
+					pair->Mji[n] = ostat->locji;
+					pair->Sij[n] = ostat->scaij;
+					pair->Sji[n] = ostat->scaji;
 				}
-				for (int n = 0; n < nb_layers; n++) {
-					if (args->seq->ostats[n][ijth].Nij == 0)
-						continue;
-					if (args->lite_norm) {
-						Mij[n][i][j] = args->seq->ostats[n][ijth].medij;
-						Mij[n][j][i] = args->seq->ostats[n][ijth].medji;
-						Sij[n][i][j] = args->seq->ostats[n][ijth].madij;
-						Sij[n][j][i] = args->seq->ostats[n][ijth].madji;
-					} else {
-						Mij[n][i][j] = args->seq->ostats[n][ijth].locij;
-						Mij[n][j][i] = args->seq->ostats[n][ijth].locji;
-						Sij[n][i][j] = args->seq->ostats[n][ijth].scaij;
-						Sij[n][j][i] = args->seq->ostats[n][ijth].scaji;
-					}
-
-					Nij[n][i][j] = args->seq->ostats[n][ijth].Nij;
-					Nij[n][j][i] = args->seq->ostats[n][ijth].Nij;
-				}
-				g_atomic_int_inc(&cur_nb);	// only used for progress bar
-				set_progress_bar_data(NULL, cur_nb / (double)Npairs);
 			}
+			g_atomic_int_inc(&cur_nb);	// only used for progress bar
+			set_progress_bar_data(NULL, cur_nb / (double)nb_pairs);
 		}
 	}
 	if (retval)
@@ -775,66 +1029,44 @@ static int compute_normalization_overlaps(struct stacking_args *args) {
 
 #ifdef DEBUG_NORM
 	for (int n = 0; n < nb_layers; n++) {
-		for (int i = 0; i < nb_frames; i ++) {
-			for (int j = i + 1; j < nb_frames; ++j) {
-				siril_debug_print("%d;%d;%lu;%.6f;%.6f;%.6f;%.6f\n", i + 1, j + 1, Nij[n][i][j], Mij[n][i][j], Mij[n][j][i], Sij[n][i][j], Sij[n][j][i]);
-			}
+		for (int p = 0; p < nb_pairs; p++) {
+			overlap_pair *pair = pairs + p;
+			siril_debug_print("%d;%d;%lu;%.6f;%.6f;%.6f;%.6f\n", pair->i + 1, pair->j + 1, pair->Nij[n], pair->Mij[n], pair->Mji[n], pair->Sij[n], pair->Sji[n]);
 		}
 	}
-	for (int n = 0; n < nb_layers; n++) {
-		siril_debug_print("Nij-%d\n", n);
-		for (int i = 0; i < nb_frames; i ++) {
-			for (int j = 0; j < nb_frames; ++j) {
-				siril_debug_print("%10d ", (int)Nij[n][i][j]);
-			}
-			siril_debug_print("\n");
-		}
-		siril_debug_print("\n");
-	}
-
-	for (int n = 0; n < nb_layers; n++) {
-		siril_debug_print("Mij-%d\n", n);
-		for (int i = 0; i < nb_frames; i ++) {
-			for (int j = 0; j < nb_frames; ++j) {
-				siril_debug_print("%.6f ", Mij[n][i][j]);
-			}
-			siril_debug_print("\n");
-		}
-		siril_debug_print("\n");
-	}
+#endif
 
 	for (int n = 0; n < nb_layers; n++) {
-		siril_debug_print("Sij-%d\n", n);
-		for (int i = 0; i < nb_frames; i ++) {
-			for (int j = 0; j < nb_frames; ++j) {
-				siril_debug_print("%.6f ", Sij[n][i][j]);
-			}
-			siril_debug_print("\n");
+		int unconnected = find_unconnected_image(nb_frames, index_ref, pairs, nb_pairs, n);
+		if (unconnected >= 0) {
+			siril_log_color_message(_("Image %d has no overlap with the other images, "
+						"normalization on overlaps cannot be computed. Please exclude it from the stack.\n"),
+					"red", args->image_indices[unconnected] + 1);
+			set_progress_bar_data(error_msg, PROGRESS_NONE);
+			retval = ST_GENERIC_ERROR;
+			goto cleanup;
 		}
-		siril_debug_print("\n");
 	}
-#endif
-
-	coeffs = malloc(N * sizeof(double));
 
 	if (args->normalize == MULTIPLICATIVE_SCALING || args->normalize == ADDITIVE_SCALING) {
 		for (int n = 0; n < nb_layers; n++) {
-			solve_overlap_coeffs(nb_frames, index, index_ref, Nij[n], Sij[n], FALSE, coeffs);
+			if ((retval = solve_overlap_coeffs(unknown, N, pairs, nb_pairs, n, FALSE, TRUE, coeffs)))
+				goto cleanup;
 			for (int i = 0; i < N; i ++) { // we set the coeffs for nb_frames - 1, the ref has already been init
 				coeff->pscale[n][index[i]] = coeffs[i];
 			}
-			// we re-normalize the Mij matrix by the scales found at this step
-			for (int ii = 0; ii < nb_frames; ii++) {
-				for (int jj = 0; jj < nb_frames; jj++) {
-					Mij[n][ii][jj] *= coeff->pscale[n][ii];
-				}
+			// we re-normalize the locations by the scales found at this step
+			for (int p = 0; p < nb_pairs; p++) {
+				pairs[p].Mij[n] *= coeff->pscale[n][pairs[p].i];
+				pairs[p].Mji[n] *= coeff->pscale[n][pairs[p].j];
 			}
 		}
 	}
 
 	if (args->normalize == ADDITIVE || args->normalize == ADDITIVE_SCALING) {
-		for (int n = 0; n < nb_layers; n++) { 
-			solve_overlap_coeffs(nb_frames, index, index_ref, Nij[n], Mij[n], TRUE, coeffs);
+		for (int n = 0; n < nb_layers; n++) {
+			if ((retval = solve_overlap_coeffs(unknown, N, pairs, nb_pairs, n, TRUE, FALSE, coeffs)))
+				goto cleanup;
 			for (int i = 0; i < N; i ++) { // we set the coeffs for nb_frames - 1, the ref has already been init
 				coeff->poffset[n][index[i]] = -coeffs[i];
 			}
@@ -843,7 +1075,8 @@ static int compute_normalization_overlaps(struct stacking_args *args) {
 
 	if (args->normalize == MULTIPLICATIVE) {
 		for (int n = 0; n < nb_layers; n++) {
-			solve_overlap_coeffs(nb_frames, index, index_ref, Nij[n], Mij[n], FALSE, coeffs);
+			if ((retval = solve_overlap_coeffs(unknown, N, pairs, nb_pairs, n, FALSE, FALSE, coeffs)))
+				goto cleanup;
 			for (int i = 0; i < N; i ++) {
 				coeff->pmul[n][index[i]] = coeffs[i];
 			}
@@ -851,20 +1084,9 @@ static int compute_normalization_overlaps(struct stacking_args *args) {
 	}
 
 cleanup:
-	for (int n = 0; n < nb_layers; n++) {
-		for (int i = 0; i < nb_frames; i++) {
-			free(Mij[n][i]);
-			free(Sij[n][i]);
-			free(Nij[n][i]);
-		}
-		free(Mij[n]);
-		free(Sij[n]);
-		free(Nij[n]);
-	}
-	free(Mij);
-	free(Sij);
-	free(Nij);
+	free(pairs);
 	free(index);
+	free(unknown);
 	free(coeffs);
 
 	set_progress_bar_data(NULL, PROGRESS_DONE);
@@ -0,0 +1,259 @@
+/*
+ * This file is part of Siril, an astronomy image processor.
+ * Copyright (C) 2005-2011 Francois Meyer (dulle at free.fr)
+ * Copyright (C) 2012-2025 team free-astro (see more in AUTHORS file)
+ * Reference site is https://siril.org
+ *
+ * Siril is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Siril is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Siril. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Read-ahead of the stacking blocks
+ * Block reads are synchronous: each thread reads the area of its block in all
+ * images before stacking it, so the latency of the storage adds up with the
+ * number of images. While a block is being stacked, we tell the kernel which
+ * byte ranges of each file the next block will need, so that they are read
+ * asynchronously into the page cache and the reads of the next block don't
+ * wait on the disk. No additional memory is allocated by siril for this.
+ * The hints are given on file descriptors opened for it, the data is still
+ * read with cfitsio or the SER reader. Compressed FITS files cannot be hinted.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <fcntl.h>
+#ifdef HAVE_POSIX_FADVISE
+#include <unistd.h>
+#endif
+
+#include "core/siril.h"
+#include "core/proto.h"
+#include "io/fits_sequence.h"
+#include "io/fits_handle_pool.h"
+#include "io/sequence.h"
+#include "io/ser.h"
+#include "registration/registration.h"
+#include "opencv/opencv.h"
+#include "stacking/readahead.h"
+
+struct stack_readahead {
+	int nb_frames;
+	int *fd;		// file of each frame, -1 if it cannot be hinted
+	gboolean shared_fd;	// a single file for all frames (SER and FITSEQ)
+	gint64 *data_offset;	// offset in the file of the first pixel of the frame
+	int *pixel_size;	// size in bytes of a pixel in the file
+	gboolean bottom_up;	// FITS rows are stored from the bottom
+	int planes;		// interleaved channels of SER files
+};
+
+#ifdef HAVE_POSIX_FADVISE
+
+void stack_readahead_free(struct stack_readahead *ra) {
+	if (!ra)
+		return;
+	if (ra->fd) {
+		for (int i = 0; i < ra->nb_frames; i++) {
+			if (ra->fd[i] >= 0) {
+				close(ra->fd[i]);
+				if (ra->shared_fd)
+					break;
+			}
+		}
+	}
+	free(ra->fd);
+	free(ra->data_offset);
+	free(ra->pixel_size);
+	free(ra);
+}
+
+/* gets the data address and the pixel size in the file of the current HDU */
+static int get_fits_data_address(fitsfile *fptr, gint64 *offset, int *pixel_size) {
+	int status = 0, bitpix = 0;
+	LONGLONG headstart, datastart, dataend;
+	if (fits_is_compressed_image(fptr, &status) || status)
+		return 1;
+	if (fits_get_img_type(fptr, &bitpix, &status) ||
+			fits_get_hduaddrll(fptr, &headstart, &datastart, &dataend, &status))
+		return 1;
+	*offset = (gint64)datastart;
+	*pixel_size = abs(bitpix) / 8;
+	return 0;
+}
+
+struct stack_readahead *stack_readahead_new(struct stacking_args *args) {
+	sequence *seq = args->seq;
+	int nb_frames = args->nb_images_to_stack;
+	if (seq->type != SEQ_REGULAR && seq->type != SEQ_SER && seq->type != SEQ_FITSEQ)
+		return NULL;
+	if (seq->type == SEQ_REGULAR && (seq->fz || (!seq->fptr && !seq->fd_pool)))
+		return NULL;
+	// the hints need one more file per image
+	if (seq->type == SEQ_REGULAR && seq->fd_pool &&
+			!fits_handle_pool_has_room(seq->fd_pool, nb_frames))
+		return NULL;
+
+	struct stack_readahead *ra = calloc(1, sizeof(struct stack_readahead));
+	if (!ra)
+		return NULL;
+	ra->nb_frames = nb_frames;
+	ra->fd = malloc(nb_frames * sizeof(int));
+	ra->data_offset = calloc(nb_frames, sizeof(gint64));
+	ra->pixel_size = calloc(nb_frames, sizeof(int));
+	if (!ra->fd || !ra->data_offset || !ra->pixel_size) {
+		PRINT_ALLOC_ERR;
+		free(ra->fd);
+		ra->fd = NULL;
+		stack_readahead_free(ra);
+		return NULL;
+	}
+	for (int i = 0; i < nb_frames; i++)
+		ra->fd[i] = -1;
+	ra->planes = 1;
+
+	int nb_hinted = 0;
+	if (seq->type == SEQ_SER) {
+		struct ser_struct *ser_file = seq->ser_file;
+		int fd = open(ser_file->filename, O_RDONLY);
+		if (fd >= 0) {
+			gint64 frame_size = (gint64)ser_file->image_width * ser_file->image_height *
+				ser_file->number_of_planes * ser_file->byte_pixel_depth;
+			ra->shared_fd = TRUE;
+			ra->planes = ser_file->number_of_planes;
+			for (int i = 0; i < nb_frames; i++) {
+				ra->fd[i] = fd;
+				ra->data_offset[i] = SER_HEADER_LEN + frame_size * args->image_indices[i];
+				ra->pixel_size[i] = ser_file->byte_pixel_depth;
+			}
+			nb_hinted = nb_frames;
+		}
+	} else if (seq->type == SEQ_FITSEQ) {
+		fitseq *fitseq_file = seq->fitseq_file;
+		int fd = open(fitseq_file->filename, O_RDONLY);
+		if (fd >= 0) {
+			ra->shared_fd = TRUE;
+			for (int i = 0; i < nb_frames; i++) {
+				int status = 0;
+				if (fits_movabs_hdu(fitseq_file->fptr, fitseq_file->hdu_index[args->image_indices[i]], NULL, &status) ||
+						get_fits_data_address(fitseq_file->fptr, &ra->data_offset[i], &ra->pixel_size[i]))
+					continue;
+				ra->fd[i] = fd;
+				nb_hinted++;
+			}
+			if (!nb_hinted)
+				close(fd);
+			ra->bottom_up = TRUE;
+		}
+	} else {
+		for (int i = 0; i < nb_frames; i++) {
+			int index = args->image_indices[i];
+			char filename[256];
+			if (!fit_sequence_get_image_filename(seq, index, filename, TRUE))
+				continue;
+			if (seq->fd_pool) {
+				struct fits_handle *handle = fits_handle_pool_acquire(seq->fd_pool, index);
+				if (!handle)
+					continue;
+				int err = get_fits_data_address(handle->fptr, &ra->data_offset[i], &ra->pixel_size[i]);
+				fits_handle_pool_release(seq->fd_pool, handle);
+				if (err)
+					continue;
+			}
+			else if (!seq->fptr || !seq->fptr[index] ||
+					get_fits_data_address(seq->fptr[index], &ra->data_offset[i], &ra->pixel_size[i]))
+				continue;
+			ra->fd[i] = open(filename, O_RDONLY);
+			if (ra->fd[i] >= 0)
+				nb_hinted++;
+		}
+		ra->bottom_up = TRUE;
+	}
+
+	if (!nb_hinted) {
+		stack_readahead_free(ra);
+		return NULL;
+	}
+	siril_debug_print("read-ahead enabled for %d of %d images\n", nb_hinted, nb_frames);
+	return ra;
+}
+
+/* gives the hints for the area of block in all images, with the same vertical
+ * shifts or the same source rows of the transformation as the read of the block */
+void stack_readahead_block(struct stack_readahead *ra, struct stacking_args *args,
+		const struct _image_block *block) {
+	if (!ra)
+		return;
+	sequence *seq = args->seq;
+	regdata *layerparam = (args->reglayer >= 0) ? seq->regparam[args->reglayer] : NULL;
+	int scale = (args->upscale_at_stacking) ? 2 : 1;
+	for (int frame = 0; frame < ra->nb_frames; frame++) {
+		if (ra->fd[frame] < 0)
+			continue;
+		int image_index = args->image_indices[frame];
+		int rx = (seq->is_variable) ? seq->imgparam[image_index].rx : seq->rx;
+		int ry = (seq->is_variable) ? seq->imgparam[image_index].ry : seq->ry;
+		int start = block->start_row, end = block->end_row + 1;
+		if (args->warp_H) {
+			int src_y, src_h;
+			cvTransformBlockSourceRows(args->warp_H[frame], scale * rx, scale * ry, block->start_row,
+					block->height, args->interpolation, &src_y, &src_h);
+			start = src_y;
+			end = src_y + src_h;
+		} else if (layerparam) {
+			double dx, dy;
+			translation_from_H(layerparam[image_index].H, &dx, &dy);
+			int shifty = round_to_int((dy - args->offset[1]) * scale);
+			start += shifty;
+			end += shifty;
+		}
+		if (scale > 1) {
+			// rows of the upscaled frame, read from the rows of the frame,
+			// the rows outside the frame are clipped below
+			start /= scale;
+			end = (end - 1) / scale + 1;
+		}
+		if (seq->type == SEQ_SER && ra->planes == 1 && ser_is_cfa(seq->ser_file)) {
+			// demosaicing reads a few more rows around the area
+			start -= 2;
+			end += 2;
+		}
+		start = max(start, 0);
+		end = min(end, ry);
+		if (start >= end)
+			continue;
+
+		gint64 row_size = (gint64)rx * ra->pixel_size[frame] * ra->planes;
+		gint64 offset = ra->data_offset[frame];
+		if (ra->bottom_up)	// FITS channels are stored one after the other
+			offset += ((gint64)block->channel * ry + ry - end) * row_size;
+		else offset += start * row_size;
+		posix_fadvise(ra->fd[frame], (off_t)offset, (off_t)((end - start) * row_size), POSIX_FADV_WILLNEED);
+	}
+}
+
+#else
+
+/* without posix_fadvise(), blocks are read without read-ahead hints */
+struct stack_readahead *stack_readahead_new(struct stacking_args *args) {
+	return NULL;
+}
+
+void stack_readahead_block(struct stack_readahead *ra, struct stacking_args *args,
+		const struct _image_block *block) {
+}
+
+void stack_readahead_free(struct stack_readahead *ra) {
+}
+
+#endif
@@ -0,0 +1,13 @@
+#ifndef _STACK_READAHEAD_H
+#define _STACK_READAHEAD_H
+
+#include "stacking.h"
+
+struct stack_readahead;
+
+struct stack_readahead *stack_readahead_new(struct stacking_args *args);
+void stack_readahead_block(struct stack_readahead *ra, struct stacking_args *args,
+		const struct _image_block *block);
+void stack_readahead_free(struct stack_readahead *ra);
+
+#endif
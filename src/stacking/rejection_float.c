@@ -23,6 +23,7 @@
 #include <gsl/gsl_statistics_float.h>
 
 #include "core/siril.h"
+#include "core/cpu_dispatch.h"
 #include "stacking/siril_fit_linear.h"
 #include "stacking/stacking.h"
 #include "algos/sorting.h"
@@ -74,27 +75,50 @@ static int line_clipping(float pixel, const float sig[], float sigma, int i, flo
 	return 0;
 }
 
-static void remove_element(float *array, int index, int array_length) {
-	for (int i = index; i < array_length - 1; i++)
-		array[i] = array[i + 1];
-}
-
-static void grubbs_stat(float *stack, int N, float *GCal, int *max_ind) {
-	float avg_y;
+/* Generalized ESD test of the max_outliers most deviant pixels of a sorted
+ * stack. They are always at one end of the pixels not yet tested, which are
+ * kept as the range [lo, hi) of the stack, so the sums giving their mean and
+ * standard deviation are updated for each pixel tested instead of being
+ * computed again. The pixels are centred on the median for the sums to keep
+ * their accuracy. */
+static void grubbs_outliers(const float *stack, int N, float median,
+		const float *critical_value, int max_outliers, struct ESD_outliers *out) {
+	double sum = 0.0, sum2 = 0.0;	// accumulating in double precision is important for accuracy
+#ifdef _OPENMP
+#pragma omp simd reduction(+:sum,sum2)
+#endif
+	for (int i = 0; i < N; i++) {
+		const double d = stack[i] - median;
+		sum += d;
+		sum2 += d * d;
+	}
 
-	float sd = siril_stats_float_sd(stack, N, &avg_y);
+	int lo = 0, hi = N;
+	for (int iter = 0; iter < max_outliers; iter++) {
+		const int size = hi - lo;
+		double var = (sum2 - sum * sum / size) / (size - 1);
+		if (var < 0.0)	// rounding
+			var = 0.0;
+		const float sd = sqrtf((float) var);
+		const float avg_y = (float) (sum / size) + median;
 
-	/* data are sorted */
-	float max_of_deviations = avg_y - stack[0];
-	float md2 = stack[N - 1] - avg_y;
+		float max_of_deviations = avg_y - stack[lo];
+		const float md2 = stack[hi - 1] - avg_y;
+		int index;
+		if (md2 > max_of_deviations) {
+			max_of_deviations = md2;
+			index = --hi;
+		} else {
+			index = lo++;
+		}
+		out[iter].out = check_G_values(max_of_deviations / sd, critical_value[iter]);
+		out[iter].x = stack[index];
+		out[iter].i = index;
 
-	if (md2 > max_of_deviations) {
-		max_of_deviations = md2;
-		*max_ind = N - 1;
-	} else {
-		*max_ind = 0;
+		const double d = stack[index] - median;
+		sum -= d;
+		sum2 -= d * d;
 	}
-	*GCal = max_of_deviations / sd;
 }
 
 int apply_rejection_float(struct _data_block *data, int nb_frames,
@@ -166,7 +190,7 @@ int apply_rejection_float(struct _data_block *data, int nb_frames,
 			if (args->type_of_rejection == SIGMA)
 				var = siril_stats_float_sd(stack, N, NULL);
 			else
-				var = siril_stats_float_mad(stack, N, median, SINGLE_THREADED, NULL);
+				var = siril_stats_float_mad(stack, N, median, SINGLE_THREADED);
 
 			if (!firstloop)
 				median = quickmedian_float(stack, N);
@@ -246,14 +270,15 @@ int apply_rejection_float(struct _data_block *data, int nb_frames,
 		} while (changed && N > 3);
 		break;
 	case LINEARFIT:
+		/* the stack stays sorted when rejected pixels are removed */
+		quicksort_f(stack, N);
 		do {
-			quicksort_f(stack, N);
-			for (int frame = 0; frame < N; frame++) {
-				data->yf[frame] = stack[frame];
-			}
 			float a, b;
-			siril_fit_linear(data->xf, data->yf, data->m_x, data->m_dx2, N, &b, &a);
+			siril_fit_linear_float(stack, data->m_x, data->m_dx2, N, &b, &a);
 			float sigma = 0.f;
+#ifdef _OPENMP
+#pragma omp simd reduction(+:sigma)
+#endif
 			for (int frame = 0; frame < N; frame++)
 				sigma += fabsf(stack[frame] - (a * frame + b));
 			sigma /= (float) N;
@@ -302,19 +327,9 @@ int apply_rejection_float(struct _data_block *data, int nb_frames,
 		max_outliers -= removed;
 		struct ESD_outliers *out = malloc(max_outliers * sizeof(struct ESD_outliers));
 
-		memcpy(w_stack, stack, N * sizeof(float));
 		memset(rejected, 0, N * sizeof(int));
-		int cold = 0;
-		for (int iter = 0, size = N; iter < max_outliers; iter++, size--) {
-			float Gstat;
-			int max_index = 0;
-
-			grubbs_stat(w_stack, size, &Gstat, &max_index);
-			out[iter].out = check_G_values(Gstat, args->critical_value[iter + removed]);
-			out[iter].x = w_stack[max_index];
-			out[iter].i = (max_index == 0) ? cold++ : max_index;
-			remove_element(w_stack, max_index, size);
-		}
+		grubbs_outliers(stack, N, (float) median, args->critical_value + removed,
+				max_outliers, out);
 		confirm_outliers(out, max_outliers, median, rejected, crej);
 		free(out);
 
@@ -335,3 +350,247 @@ int apply_rejection_float(struct _data_block *data, int nb_frames,
 	return N;
 }
 
+
+/* Batched rejection.
+ * The stacks of STACK_BATCH_SIZE neighbouring pixels are stored frame-major in
+ * data->batch (frame * STACK_BATCH_SIZE + lane), so that the statistics and the
+ * clipping tests are computed for all lanes in the same inner loops, which the
+ * compiler can vectorise. Rejected or null pixels are only masked out in
+ * data->batch_keep, stacks are never compacted nor sorted in place, only the
+ * medians are computed on a gathered copy of the kept values of a lane.
+ * Algorithms that need sorted stacks (winsorized, linear fit, GESDT...) keep
+ * using the per-pixel apply_rejection_float().
+ * Results are the same as the per-pixel function, except when the rejection
+ * stops because only 4 pixels would remain: the kept pixels are then the first
+ * in frame order instead of in the order left by the median computation. */
+
+gboolean rejection_float_batch_supported(struct stacking_args *args) {
+	switch (args->type_of_rejection) {
+	case NO_REJEC:
+	case PERCENTILE:
+	case SIGMA:
+	case MAD:
+		return TRUE;
+	default:
+		return FALSE;
+	}
+}
+
+/* median of the kept values of a lane, all values if keep is NULL */
+static float batch_lane_median(const float *batch, const guint8 *keep,
+		int nb_frames, int lane, float *scratch) {
+	int n = 0;
+	for (int frame = 0; frame < nb_frames; frame++) {
+		int idx = frame * STACK_BATCH_SIZE + lane;
+		if (!keep || keep[idx])
+			scratch[n++] = batch[idx];
+	}
+	if (!n) return 0.f;
+	return (float) quickmedian_float(scratch, n);
+}
+
+/* MAD of the kept values of a lane around median */
+static float batch_lane_mad(const float *batch, const guint8 *keep,
+		int nb_frames, int lane, float median, float *scratch) {
+	int n = 0;
+	for (int frame = 0; frame < nb_frames; frame++) {
+		int idx = frame * STACK_BATCH_SIZE + lane;
+		if (keep[idx])
+			scratch[n++] = fabsf(batch[idx] - median);
+	}
+	if (!n) return 0.f;
+	return (float) histogram_median_float(scratch, n, SINGLE_THREADED);
+}
+
+SIMD_BODY void rejection_float_batch_body(struct _data_block *data, int nb_frames,
+		struct stacking_args *args, double results[STACK_BATCH_SIZE],
+		int rej[STACK_BATCH_SIZE][2]) {
+	const float *batch = data->batch;
+	guint8 *keep = data->batch_keep;
+	float *scratch = (float *) data->stack;
+	const float siglow = args->sig[0];
+	const float sighigh = args->sig[1];
+	int N[STACK_BATCH_SIZE], r[STACK_BATCH_SIZE], removed[STACK_BATCH_SIZE];
+	float median[STACK_BATCH_SIZE], var[STACK_BATCH_SIZE];
+	gboolean active[STACK_BATCH_SIZE];
+	gboolean any_active = FALSE;
+
+	/* null pixels are not part of the stacks */
+	memset(N, 0, sizeof N);
+	memset(r, 0, sizeof r);
+	for (int frame = 0; frame < nb_frames; frame++) {
+		const float *row = batch + frame * STACK_BATCH_SIZE;
+		guint8 *krow = keep + frame * STACK_BATCH_SIZE;
+#ifdef _OPENMP
+#pragma omp simd
+#endif
+		for (int l = 0; l < STACK_BATCH_SIZE; l++) {
+			krow[l] = row[l] != 0.f;
+			N[l] += krow[l];
+		}
+	}
+
+	for (int l = 0; l < STACK_BATCH_SIZE; l++) {
+		rej[l][0] = rej[l][1] = 0;
+		results[l] = 0.0;
+		/* 0 or 1 pixel: no need to reject */
+		active[l] = N[l] > 1 && args->type_of_rejection != NO_REJEC;
+		if (!active[l]) continue;
+		median[l] = batch_lane_median(batch, keep, nb_frames, l, scratch);
+		if (median[l] == 0.f) {
+			/* stack mostly zero, same as the per-pixel path */
+			results[l] = batch_lane_median(batch, NULL, nb_frames, l, scratch);
+			active[l] = FALSE;
+			N[l] = -1;	// result already set
+			continue;
+		}
+		any_active = TRUE;
+	}
+
+	if (any_active && args->type_of_rejection == PERCENTILE) {
+		for (int frame = 0; frame < nb_frames; frame++) {
+			const float *row = batch + frame * STACK_BATCH_SIZE;
+			guint8 *krow = keep + frame * STACK_BATCH_SIZE;
+			for (int l = 0; l < STACK_BATCH_SIZE; l++) {
+				if (!active[l] || !krow[l]) continue;
+				if (median[l] - row[l] > median[l] * siglow) {
+					rej[l][0]++;
+					krow[l] = 0;
+				} else if (row[l] - median[l] > median[l] * sighigh) {
+					rej[l][1]++;
+					krow[l] = 0;
+				}
+			}
+		}
+		for (int l = 0; l < STACK_BATCH_SIZE; l++)
+			if (active[l])
+				N[l] -= rej[l][0] + rej[l][1];
+	}
+	else if (any_active) {	// SIGMA or MAD
+		gboolean firstloop = TRUE;
+		while (any_active) {
+			if (args->type_of_rejection == SIGMA) {
+				/* masked two-pass standard deviation, in double like
+				 * siril_stats_float_sd() */
+				double acc[STACK_BATCH_SIZE] = { 0.0 };
+				float mean[STACK_BATCH_SIZE];
+				for (int frame = 0; frame < nb_frames; frame++) {
+					const float *row = batch + frame * STACK_BATCH_SIZE;
+					const guint8 *krow = keep + frame * STACK_BATCH_SIZE;
+#ifdef _OPENMP
+#pragma omp simd
+#endif
+					for (int l = 0; l < STACK_BATCH_SIZE; l++)
+						acc[l] += krow[l] ? row[l] : 0.f;
+				}
+				for (int l = 0; l < STACK_BATCH_SIZE; l++) {
+					mean[l] = N[l] > 0 ? (float)(acc[l] / N[l]) : 0.f;
+					acc[l] = 0.0;
+				}
+				for (int frame = 0; frame < nb_frames; frame++) {
+					const float *row = batch + frame * STACK_BATCH_SIZE;
+					const guint8 *krow = keep + frame * STACK_BATCH_SIZE;
+#ifdef _OPENMP
+#pragma omp simd
+#endif
+					for (int l = 0; l < STACK_BATCH_SIZE; l++) {
+						float d = row[l] - mean[l];
+						acc[l] += krow[l] ? d * d : 0.f;
+					}
+				}
+				for (int l = 0; l < STACK_BATCH_SIZE; l++)
+					if (active[l])
+						var[l] = sqrtf((float)(acc[l] / (N[l] - 1)));
+			} else {
+				for (int l = 0; l < STACK_BATCH_SIZE; l++)
+					if (active[l])
+						var[l] = batch_lane_mad(batch, keep, nb_frames, l, median[l], scratch);
+			}
+
+			if (!firstloop) {
+				for (int l = 0; l < STACK_BATCH_SIZE; l++)
+					if (active[l])
+						median[l] = batch_lane_median(batch, keep, nb_frames, l, scratch);
+			}
+			else firstloop = FALSE;
+
+			memset(removed, 0, sizeof removed);
+			for (int frame = 0; frame < nb_frames; frame++) {
+				const float *row = batch + frame * STACK_BATCH_SIZE;
+				guint8 *krow = keep + frame * STACK_BATCH_SIZE;
+				for (int l = 0; l < STACK_BATCH_SIZE; l++) {
+					if (!active[l] || !krow[l] || N[l] - r[l] <= 4)
+						continue;	// no more rejections
+					if (median[l] - row[l] > var[l] * siglow) {
+						rej[l][0]++;
+						krow[l] = 0;
+						r[l]++;
+						removed[l]++;
+					} else if (row[l] - median[l] > var[l] * sighigh) {
+						rej[l][1]++;
+						krow[l] = 0;
+						r[l]++;
+						removed[l]++;
+					}
+				}
+			}
+
+			any_active = FALSE;
+			for (int l = 0; l < STACK_BATCH_SIZE; l++) {
+				if (!active[l]) continue;
+				N[l] -= removed[l];
+				active[l] = removed[l] > 0 && N[l] > 3;
+				any_active |= active[l];
+			}
+		}
+	}
+
+	/* weighted or plain mean of the kept pixels */
+	double sum[STACK_BATCH_SIZE] = { 0.0 }, norm[STACK_BATCH_SIZE] = { 0.0 };
+	const double *pweights = args->weighting_type > NO_WEIGHT ?
+		args->weights + data->layer * nb_frames : NULL;
+	for (int frame = 0; frame < nb_frames; frame++) {
+		const float *row = batch + frame * STACK_BATCH_SIZE;
+		const guint8 *krow = keep + frame * STACK_BATCH_SIZE;
+		const double w = pweights ? pweights[frame] : 1.0;
+#ifdef _OPENMP
+#pragma omp simd
+#endif
+		for (int l = 0; l < STACK_BATCH_SIZE; l++) {
+			sum[l] += krow[l] ? row[l] * w : 0.0;
+			norm[l] += krow[l] ? w : 0.0;
+		}
+	}
+	for (int l = 0; l < STACK_BATCH_SIZE; l++) {
+		if (N[l] < 0) continue;	// already set
+		if (N[l] == 0) {
+			results[l] = 0.0;	// only null pixels
+		} else if (norm[l] == 0.0) {
+			/* weights are all 0, use the unweighted mean */
+			double s = 0.0;
+			for (int frame = 0; frame < nb_frames; frame++) {
+				int idx = frame * STACK_BATCH_SIZE + l;
+				if (keep[idx])
+					s += batch[idx];
+			}
+			results[l] = s / N[l];
+		} else {
+			results[l] = sum[l] / norm[l];
+		}
+	}
+}
+
+typedef void (*rejection_batch_fn)(struct _data_block *, int, struct stacking_args *,
+		double [STACK_BATCH_SIZE], int [STACK_BATCH_SIZE][2]);
+SIMD_VARIANTS(rejection_batch_fn, rejection_float_batch, (struct _data_block *data, int nb_frames,
+		struct stacking_args *args, double results[STACK_BATCH_SIZE], int rej[STACK_BATCH_SIZE][2]),
+		(data, nb_frames, args, results, rej))
+
+/* Rejects and averages the nb_pixels first lanes of data->batch, unused lanes
+ * must have been filled with zeros. results receives the mean of each lane and
+ * rej the low and high rejection counts */
+void apply_rejection_float_batch(struct _data_block *data, int nb_frames,
+		struct stacking_args *args, double results[STACK_BATCH_SIZE],
+		int rej[STACK_BATCH_SIZE][2]) {
+	SIMD_CALL(rejection_float_batch)(data, nb_frames, args, results, rej);
+}
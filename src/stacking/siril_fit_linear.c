@@ -20,31 +20,51 @@
 
 #include "siril_fit_linear.h"
 
-/* code from gsl */
-/* changed for siril */
-int siril_fit_linear(const float *x, const float *y, const float m_x,
+/* Fit of y = c0 + c1 x on the n values y of a sorted stack, x being their
+ * index, from the sums of y and x y computed in a single pass.
+ * m_x is the mean of the x and m_dx2 the inverse of the mean of their squared
+ * deviations, precomputed for the full stack in the data blocks, as with the
+ * previous code from gsl.
+ * The covariance does not depend on m_x as the deviations of the y sum to 0:
+ * sum((x - m_x) (y - m_y)) = sum(x y) - m_y n (n - 1) / 2 */
+static void fit_line(double sum_y, double sum_xy, const float m_x,
 		const float m_dx2, const size_t n, float *c0, float *c1) {
-
-	float m_y = y[0];
-	for (size_t i = 1; i < n; i++) {
-		m_y += (y[i] - m_y) * x[i];
-	}
-
-	float m_dxdy = 0.f;
-	float dx = -m_x;
-	for (size_t i = 0; i < n; i++, dx += 1.f) {
-		const float dy = y[i] - m_y;
-
-		m_dxdy += (dx * dy - m_dxdy) * x[i];
-	}
+	const double m_y = sum_y / n;
+	const double m_dxdy = (sum_xy - m_y * 0.5 * n * (n - 1.0)) / n;
 
 	/* In terms of y = a + b x */
 
-	const float b = m_dxdy * m_dx2;
-	const float a = m_y - m_x * b;
+	const float b = (float) (m_dxdy * m_dx2);
+	const float a = (float) (m_y - m_x * b);
 
 	*c0 = a;
 	*c1 = b;
+}
 
+int siril_fit_linear_float(const float *y, const float m_x, const float m_dx2,
+		const size_t n, float *c0, float *c1) {
+	double sum_y = 0.0, sum_xy = 0.0;
+#ifdef _OPENMP
+#pragma omp simd reduction(+:sum_y,sum_xy)
+#endif
+	for (size_t i = 0; i < n; i++) {
+		sum_y += y[i];
+		sum_xy += (double) i * y[i];
+	}
+	fit_line(sum_y, sum_xy, m_x, m_dx2, n, c0, c1);
+	return 0;
+}
+
+int siril_fit_linear_ushort(const WORD *y, const float m_x, const float m_dx2,
+		const size_t n, float *c0, float *c1) {
+	double sum_y = 0.0, sum_xy = 0.0;
+#ifdef _OPENMP
+#pragma omp simd reduction(+:sum_y,sum_xy)
+#endif
+	for (size_t i = 0; i < n; i++) {
+		sum_y += y[i];
+		sum_xy += (double) i * y[i];
+	}
+	fit_line(sum_y, sum_xy, m_x, m_dx2, n, c0, c1);
 	return 0;
 }
@@ -21,7 +21,11 @@
 #define SRC_STACKING_SIRIL_FIT_LINEAR_H_
 
 #include <stdio.h>
+#include "core/siril.h"
 
-int siril_fit_linear(const float *x, const float *y, const float m_x, const float m_dx2, const size_t n, float *c0, float *c1);
+/* least squares line of the values of a stack against their index, m_x and
+ * m_dx2 are the mean of the indices and the inverse of their variance */
+int siril_fit_linear_float(const float *y, const float m_x, const float m_dx2, const size_t n, float *c0, float *c1);
+int siril_fit_linear_ushort(const WORD *y, const float m_x, const float m_dx2, const size_t n, float *c0, float *c1);
 
 #endif /* SRC_STACKING_SIRIL_FIT_LINEAR_H_ */
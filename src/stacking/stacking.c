@@ -45,11 +45,15 @@
 #include "io/sequence.h"
 #include "io/single_image.h"
 #include "io/ser.h"
+#ifdef HAVE_LIBRAW
+#include "io/raw_sequence.h"
+#endif
 #include "registration/registration.h"
 #include "algos/noise.h"
 #include "algos/sorting.h"
 #include "algos/siril_wcs.h"
 #include "stacking/sum.h"
+#include "stacking/accumulator.h"
 #include "opencv/opencv.h"
 
 #include "stacking.h"
@@ -83,13 +87,31 @@ gboolean evaluate_stacking_should_output_32bits(const stack_method method,
 	return seq->bitpix == FLOAT_IMG; // for min or max, only use it if input is already float
 }
 
+#ifdef HAVE_LIBRAW
+/* median and mean stacking read the frames by blocks of rows, the RAW files
+ * are decoded once if they are kept in memory, up to half of it, for the
+ * normalization and the stacking */
+static void stack_set_raw_cache(struct stacking_args *args) {
+	gint64 frame_size = (gint64) args->seq->rx * args->seq->ry * sizeof(WORD);
+	gint64 needed = frame_size * args->nb_images_to_stack;
+	gint64 size = MIN(needed, (gint64) get_max_memory_in_MB() * BYTES_IN_A_MB / 2);
+	raw_sequence_set_cache_size(args->seq->raw_file, size);
+	if (size < needed && frame_size > 0)
+		siril_log_message(_("%d of the %d RAW frames can be kept decoded in memory\n"),
+				(int) (size / frame_size), args->nb_images_to_stack);
+}
+#endif
+
 /* the function that prepares the stacking and runs it */
 void main_stack(struct stacking_args *args) {
 	int nb_allowed_files;
 	g_assert(args->ref_image >= 0 && args->ref_image < args->seq->number);
 
 	/* first of all we need to check if we can process the files */
-	if (args->seq->type == SEQ_REGULAR && args->method != stack_summing_generic) {
+	/* median and mean stacking read regular sequences through a pool of file
+	 * handles, they are not limited */
+	if (args->seq->type == SEQ_REGULAR && args->method != stack_summing_generic &&
+			args->method != stack_mean_with_rejection && args->method != stack_median) {
 		if (!allow_to_open_files(args->nb_images_to_stack, &nb_allowed_files)) {
 			siril_log_message(_("Your system does not allow one to open more than %d files at the same time. "
 						"You may consider either to enhance this limit (the method depends of "
@@ -105,17 +127,35 @@ void main_stack(struct stacking_args *args) {
 	if (args->use_32bit_output)
 		siril_log_message(_("Stacking result will be stored as a 32-bit image\n"));
 
+	// 0. incremental stacking: only the new images are stacked
+	if (args->incremental && (args->retval = stack_incremental_prepare(args)))
+		return;
+#ifdef HAVE_LIBRAW
+	if (args->seq->type == SEQ_RAW &&
+			(args->method == stack_mean_with_rejection || args->method == stack_median))
+		stack_set_raw_cache(args);
+#endif
 	// 1. normalization
 	if (do_normalization(args)) // does nothing if NO_NORM
-		return;
+		goto end_incremental;
 	// 2. up-scale
 	if (upscale_sequence(args)) // does nothing if !args->upscale_at_stacking
-		return;
+		goto end_incremental;
 	// 3. stack
 	args->retval = args->method(args);
+	if (!args->retval && args->acc)
+		args->retval = stack_incremental_commit(args);
 
 	// result is in args->result, not saved
 	describe_stack_for_history(args, &args->result.history, FALSE, FALSE);
+
+end_incremental:
+	stack_accumulator_free(args->acc);
+	args->acc = NULL;
+#ifdef HAVE_LIBRAW
+	if (args->seq->type == SEQ_RAW)
+		raw_sequence_set_cache_size(args->seq->raw_file, 0);
+#endif
 }
 
 /* the function that runs the thread. */
@@ -246,6 +286,9 @@ void _show_summary(struct stacking_args *args) {
 	if (args->feather_dist > 0)
 		siril_log_message(_("Feathering ................ over %4d pixels\n"), args->feather_dist);
 
+	if (args->apply_reg)
+		siril_log_message(_("Registration .............. applied while stacking\n"));
+
 	if (args->seq->nb_layers > 1) {
 		if (args->equalizeRGB)
 			siril_log_message(_("RGB equalization .......... enabled\n"));
@@ -374,6 +417,9 @@ void describe_stack_for_history(struct stacking_args *args, GSList **hist, gbool
 	if (args->feather_dist > 0)
 		g_string_append_printf(str, ", feather distance %d pixels", args->feather_dist);
 
+	if (args->apply_reg)
+		g_string_append(str, ", registration applied while stacking");
+
 	if (args->seq->nb_layers > 1) {
 		if (args->equalizeRGB)
 			g_string_append(str, ", equalized RGB");
@@ -638,6 +684,18 @@ void init_stacking_args(struct stacking_args *args) {
 	args->maximize_framing = FALSE;
 	memset(args->offset, 0, 2 * sizeof(int));
 	args->upscale_at_stacking = FALSE;
+	args->streaming = FALSE;
+	args->incremental = FALSE;
+	args->acc = NULL;
+	args->comet_dual = FALSE;
+	args->comet_velocity = (pointf){ 0.f, 0.f };
+	args->comet = NULL;
+	args->comet_result = (fits){ 0 };
+	args->apply_reg = FALSE;
+	args->interpolation = OPENCV_LANCZOS4;
+	args->clamp = TRUE;
+	args->warp_H = NULL;
+	memset(args->band_rows, 0, 2 * sizeof(int));
 
 	args->type_of_rejection = NO_REJEC;
 	memset(args->sig, 0, 2 * sizeof(float));
@@ -646,6 +704,8 @@ void init_stacking_args(struct stacking_args *args) {
 	args->merge_lowhigh_rejmaps = FALSE;
 	args->rejmap_low = NULL;
 	args->rejmap_high = NULL;
+	args->rejcount_size = 0;
+	args->rejcount[0] = args->rejcount[1] = NULL;
 
 	args->weighting_type = NO_WEIGHT;
 	args->weights = NULL;
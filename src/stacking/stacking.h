@@ -7,6 +7,20 @@
 //#define STACK_DEBUG
 
 #define MAX_IMAGES_FOR_OVERLAP 30 // if normalizing on overlaps with more than MAX_IMAGES_FOR_OVERLAP selected, it will trigger a warning
+				  // and the coefficients are solved iteratively instead of directly
+/* for load balancing, median and mean stacking use more blocks than threads, but
+ * not smaller than STACK_MIN_BLOCK_HEIGHT rows */
+#define STACK_BLOCKS_PER_THREAD 4
+#define STACK_MIN_BLOCK_HEIGHT 32
+/* files left for other uses than the reads of a regular FITS sequence by the
+ * median and mean stacking, which are limited to the rest */
+#define STACK_RESERVED_FILES 64
+/* number of neighbouring pixels processed together by the batched rejection */
+#define STACK_BATCH_SIZE 16
+
+struct stack_accumulator;
+struct stack_comet;
+
 /* the stacking method */
 typedef int (*stack_method)(struct stacking_args *args);
 
@@ -83,6 +97,18 @@ struct stacking_args {
 	gboolean maximize_framing;	/* maximize the framing instead of conforming to ref image size*/
 	int offset[2];				/* offset used by max framing*/
 	gboolean upscale_at_stacking; /* x2 upscale during stacking*/
+	gboolean streaming;		/* stack one frame at a time into per-pixel accumulators */
+	gboolean incremental;		/* keep the accumulators to add new images later */
+	struct stack_accumulator *acc;	/* accumulators of the incremental stacking */
+	gboolean apply_reg;		/* transform the frames with their registration while reading them */
+	int interpolation;		/* interpolation of the transformation, an opencv_interpolation */
+	gboolean clamp;			/* clamping of the interpolation */
+	int band_rows[2];		/* first and after last rows from the top of the result to stack, all if both 0 */
+	Homography *warp_H;		/* internal, transformation of each stacked frame to the reference */
+	gboolean comet_dual;		/* also stack the frames aligned on a moving object, from the same reads */
+	pointf comet_velocity;		/* velocity of the moving object, in pixels per hour */
+	struct stack_comet *comet;	/* internal, shifts of the frames for both alignments */
+	fits comet_result;		/* the result aligned on the moving object */
 
 	rejection type_of_rejection;	/* type of rejection */
 	float sig[2];			/* low and high sigma rejection or GESTD parameters */
@@ -90,12 +116,15 @@ struct stacking_args {
 	gboolean create_rejmaps;	/* main activation flag for the rejection maps creation */
 	gboolean merge_lowhigh_rejmaps;	/* create only one map */
 	fits *rejmap_low, *rejmap_high;	/* rejection maps */
+	int rejcount_size;		/* internal, 1 or 2 bytes per rejection count */
+	void *rejcount[2];		/* internal, low and high rejection counts while stacking */
 
 	weightingType weighting_type;	/* enable weights */
 	double *weights; 		/* computed weights for each (layer, image)*/
 
 	float (*sd_calculator)(const WORD *, const int); // internal, for ushort
 	float (*mad_calculator)(const WORD *, const size_t, const double, threading_type) ; // internal, for ushort
+	gboolean half_blocks;		/* internal, the pixels of the stacking blocks are stored as half_float */
 
 	struct timeval t_start;
 	int retval;
@@ -124,6 +153,14 @@ struct stacking_configuration {
 	weightingType weighting_type;
 	gboolean maximize_framing;
 	gboolean upscale_at_stacking;
+	gboolean streaming;
+	gboolean incremental;
+	gboolean apply_reg;
+	int interpolation;
+	gboolean clamp;
+	int band_rows[2];
+	gboolean comet_dual;
+	pointf comet_velocity;
 	gboolean force32b;
 };
 
@@ -144,7 +181,15 @@ struct _data_block {
 	int *rejected;	// 0 if pixel ok, 1 or -1 if rejected
 	void *o_stack;	// original unordered stack
 	void *w_stack;	// stack for the winsorized rejection
-	float *xf, *yf, m_x, m_dx2;// data for the linear fit rejection
+	float m_x, m_dx2;	// data for the linear fit rejection
+	float *batch;	// stacks of STACK_BATCH_SIZE pixels, frame-major, for batched stacking
+	int *batch_shifts;	// horizontal shift of each frame for the batched stacking
+	guint8 *batch_keep;	// 1 if the pixel of batch is kept
+	float *half_row;	// a frame of the block read before its conversion to half precision
+	int *shiftx;	// horizontal shift of each frame, the same for all pixels of a block
+	gboolean *in_block;	// FALSE if the frame has no pixel in the block read
+	float *device_results;	// block stacked on the OpenCL device, followed by the normalization and weights of the frames
+	int *device_rej;	// rejection counts of the pixels of the block stacked on the device, followed by the shifts of the frames
 	int layer;	// to identify layer for normalization
 };
 
@@ -202,8 +247,12 @@ int get_ijth_pair_index(int N, int i, int j);
 
 int check_G_values(float Gs, float Gc);
 void confirm_outliers(struct ESD_outliers *out, int N, double median, int *rejected, int rej[2]);
+int stack_get_reserved_MB(struct stacking_args *args);
 int stack_compute_parallel_blocks(struct _image_block **blocksptr, long max_number_of_rows,
 		const long naxes[3], int nb_threads, long *largest_block_height, int *nb_blocks);
+int stack_compute_balanced_blocks(struct _image_block **blocksptr, long max_number_of_rows,
+		const long naxes[3], int nb_threads, int blocks_per_thread,
+		long *largest_block_height, int *nb_blocks);
 
 /* up-scaling functions */
 
@@ -213,5 +262,9 @@ void remove_tmp_upscaled_files(struct stacking_args *args);
 /* rejection_float.c */
 
 int apply_rejection_float(struct _data_block *data, int nb_frames, struct stacking_args *args, int crej[2]);
+gboolean rejection_float_batch_supported(struct stacking_args *args);
+void apply_rejection_float_batch(struct _data_block *data, int nb_frames,
+		struct stacking_args *args, double results[STACK_BATCH_SIZE],
+		int rej[STACK_BATCH_SIZE][2]);
 
 #endif
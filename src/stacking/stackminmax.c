@@ -193,10 +193,14 @@ static int stack_addminmax(struct stacking_args *args, gboolean ismax) {
 			list_date = g_list_prepend(list_date, new_date_item(date, fit.keywords.exposure));
 		}
 
-		/* stack current image */
-		size_t i = 0;	// index in final_pixel[0]
+		/* stack current image, the rows in parallel while the frames are
+		 * read one after the other */
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(com.max_thread) schedule(static) if (nbdata > 65536)
+#endif
 		for (int y = 0; y < output_size[1]; ++y) {
 			int ny = y - shifty;
+			size_t i = (size_t)y * output_size[0];	// index in final_pixel[0]
 			for (int x = 0; x < output_size[0]; ++x) {
 				int nx = x - shiftx;
 				//printf("x=%d y=%d sx=%d sy=%d i=%d ii=%d\n",x,y,shiftx,shifty,i,ii);
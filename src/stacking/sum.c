@@ -21,6 +21,9 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <assert.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 #include "core/siril.h"
 #include "core/proto.h"
 #include "core/processing.h"
@@ -47,9 +50,19 @@ struct sum_stacking_data {
 	gboolean upscale_at_stacking; // outputs an image twice the size of the original sequence
 	int output_size[2]; // stacked image size
 	int offset[2]; // reference offset
+	int nb_bands;		// bands of rows of the sums, added under their lock
+#ifdef _OPENMP
+	omp_lock_t *band_locks;
+#endif
 	fits result;
 };
 
+/* The frames are added to the sums by bands of rows, each under its own lock,
+ * instead of with an atomic operation for each pixel: the threads start with
+ * different bands, so they rarely wait for each other, and the rows are added
+ * with plain loops. There are several bands per thread reading images */
+#define SUM_BANDS_PER_THREAD 8
+
 static int sum_stacking_prepare_hook(struct generic_seq_args *args) {
 	struct sum_stacking_data *ssdata = args->user;
 	size_t nbdata = ssdata->output_size[0] * ssdata->output_size[1];
@@ -86,25 +99,39 @@ static int sum_stacking_prepare_hook(struct generic_seq_args *args) {
 
 	ssdata->livetime = 0.0;
 	ssdata->list_date = NULL;
+
+	ssdata->nb_bands = 1;
+#ifdef _OPENMP
+	ssdata->nb_bands = max(1, min(ssdata->output_size[1], SUM_BANDS_PER_THREAD * args->max_parallel_images));
+	ssdata->band_locks = malloc(ssdata->nb_bands * sizeof(omp_lock_t));
+	if (!ssdata->band_locks) {
+		PRINT_ALLOC_ERR;
+		return ST_ALLOC_ERROR;
+	}
+	for (int b = 0; b < ssdata->nb_bands; b++)
+		omp_init_lock(&ssdata->band_locks[b]);
+#endif
 	return ST_OK;
 }
 
 static int sum_stacking_image_hook(struct generic_seq_args *args, int o, int i, fits *fit, rectangle *_, int threads) {
 	struct sum_stacking_data *ssdata = args->user;
-	int shiftx = 0, shifty = 0, nx, ny, x, y, layer;
-	size_t ii, pixel = 0;	// index in sum[0]
-	size_t nbdata = ssdata->output_size[0] * ssdata->output_size[1];
+	int shiftx = 0, shifty = 0;
+	int out_w = ssdata->output_size[0], out_h = ssdata->output_size[1];
+	size_t nbdata = (size_t)out_w * out_h;
 	/* we get some metadata at the same time: date, exposure ... */
 
 #ifdef _OPENMP
-#pragma omp atomic
+	omp_set_lock(&args->lock);
 #endif
 	ssdata->livetime += fit->keywords.exposure;
-
 	if (fit->keywords.date_obs) {
 		GDateTime *date = g_date_time_ref(fit->keywords.date_obs);
 		ssdata->list_date = g_list_prepend(ssdata->list_date, new_date_item(date, fit->keywords.exposure));
 	}
+#ifdef _OPENMP
+	omp_unset_lock(&args->lock);
+#endif
 
 	if (ssdata->reglayer != -1 && args->seq->regparam[ssdata->reglayer]) {
 		double scale = (ssdata->upscale_at_stacking) ? 2. : 1.;
@@ -121,31 +148,47 @@ static int sum_stacking_image_hook(struct generic_seq_args *args, int o, int i,
 		siril_debug_print("img %d dx %d dy %d\n", o, shiftx, shifty);
 	}
 
-	for (y = 0; y < ssdata->output_size[1]; ++y) {
-		ny = y - shifty;
-		for (x = 0; x < ssdata->output_size[0]; ++x) {
-			nx = x - shiftx;
-			if (nx >= 0 && nx < fit->rx && ny >= 0 && ny < fit->ry) {
-				// we have data for this pixel
-				ii = ny * fit->rx + nx;		// index in source image
-				if (ii < nbdata) {
-					for (layer = 0; layer < args->seq->nb_layers; ++layer) {
-						if (ssdata->input_32bits) {
+	// the columns of the output that have data in this frame
+	int x_start = max(0, shiftx);
+	int x_end = min(out_w, fit->rx + shiftx);
+	int first_band = 0;
 #ifdef _OPENMP
-#pragma omp atomic
+	first_band = (omp_get_thread_num() * SUM_BANDS_PER_THREAD) % ssdata->nb_bands;
 #endif
-							ssdata->fsum[layer][pixel] += (double)fit->fpdata[layer][ii];
-						}
-						else
+	for (int n = 0; n < ssdata->nb_bands; n++) {
+		int band = (first_band + n) % ssdata->nb_bands;
+		int y_start = (int)((gint64)out_h * band / ssdata->nb_bands);
+		int y_end = (int)((gint64)out_h * (band + 1) / ssdata->nb_bands);
+		// the rows of the output that have data in this frame
+		y_start = max(y_start, shifty);
+		y_end = min(y_end, fit->ry + shifty);
+		if (y_start >= y_end || x_start >= x_end)
+			continue;
 #ifdef _OPENMP
-#pragma omp atomic
+		omp_set_lock(&ssdata->band_locks[band]);
 #endif
-							ssdata->sum[layer][pixel] += fit->pdata[layer][ii];
-					}
+		for (int y = y_start; y < y_end; ++y) {
+			size_t ny = y - shifty;
+			size_t row = (size_t)y * out_w;
+			// pixels of the source beyond the size of the output are skipped
+			gint64 end = min((gint64)x_end, (gint64)nbdata - (gint64)(ny * fit->rx) + shiftx);
+			for (int layer = 0; layer < args->seq->nb_layers; ++layer) {
+				if (ssdata->input_32bits) {
+					double *sum = ssdata->fsum[layer] + row;
+					const float *in = fit->fpdata[layer] + ny * fit->rx - shiftx;
+					for (gint64 x = x_start; x < end; ++x)
+						sum[x] += (double)in[x];
+				} else {
+					guint64 *sum = ssdata->sum[layer] + row;
+					const WORD *in = fit->pdata[layer] + ny * fit->rx - shiftx;
+					for (gint64 x = x_start; x < end; ++x)
+						sum[x] += in[x];
 				}
 			}
-			++pixel;
 		}
+#ifdef _OPENMP
+		omp_unset_lock(&ssdata->band_locks[band]);
+#endif
 	}
 	return ST_OK;
 }
@@ -158,6 +201,15 @@ static int sum_stacking_finalize_hook(struct generic_seq_args *args) {
 	size_t i, nbdata;
 	int layer;
 
+#ifdef _OPENMP
+	if (ssdata->band_locks) {
+		for (int b = 0; b < ssdata->nb_bands; b++)
+			omp_destroy_lock(&ssdata->band_locks[b]);
+		free(ssdata->band_locks);
+		ssdata->band_locks = NULL;
+	}
+#endif
+
 	if (args->retval) {
 		if (ssdata->sum[0]) free(ssdata->sum[0]);
 		if (ssdata->fsum[0]) free(ssdata->fsum[0]);
@@ -216,18 +268,22 @@ static int sum_stacking_finalize_hook(struct generic_seq_args *args) {
 			for (layer=0; layer<args->seq->nb_layers; ++layer){
 				double *from = ssdata->fsum[layer];
 				float *to = fit->fpdata[layer];
-				for (i=0; i < nbdata; ++i) {
-					*to++ = (float)((double)(*from++) * ratio);
-				}
+#ifdef _OPENMP
+#pragma omp parallel for simd num_threads(com.max_thread) schedule(static)
+#endif
+				for (i = 0; i < nbdata; ++i)
+					to[i] = (float)(from[i] * ratio);
 			}
 		} else {
 			double ratio = 1.0 / (max == 0 ? 1 : (double)max);
 			for (layer=0; layer<args->seq->nb_layers; ++layer){
 				guint64 *from = ssdata->sum[layer];
 				float *to = fit->fpdata[layer];
-				for (i=0; i < nbdata; ++i) {
-					*to++ = (float)((double)(*from++) * ratio);
-				}
+#ifdef _OPENMP
+#pragma omp parallel for simd num_threads(com.max_thread) schedule(static)
+#endif
+				for (i = 0; i < nbdata; ++i)
+					to[i] = (float)((double)from[i] * ratio);
 			}
 		}
 	} else {
@@ -240,10 +296,19 @@ static int sum_stacking_finalize_hook(struct generic_seq_args *args) {
 		for (layer=0; layer<args->seq->nb_layers; ++layer){
 			guint64 *from = ssdata->sum[layer];
 			WORD *to = fit->pdata[layer];
-			for (i=0; i < nbdata; ++i) {
-				if (ratio == 1.0)
-					*to++ = round_to_WORD(*from++);
-				else *to++ = round_to_WORD((double)(*from++) * ratio);
+			if (ratio == 1.0) {
+				// max is not above USHRT_MAX, the sums are copied
+#ifdef _OPENMP
+#pragma omp parallel for simd num_threads(com.max_thread) schedule(static)
+#endif
+				for (i = 0; i < nbdata; ++i)
+					to[i] = (WORD)from[i];
+			} else {
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(com.max_thread) schedule(static)
+#endif
+				for (i = 0; i < nbdata; ++i)
+					to[i] = round_to_WORD((double)from[i] * ratio);
 			}
 		}
 	}
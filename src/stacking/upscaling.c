@@ -102,6 +102,8 @@ void remove_tmp_upscaled_files(struct stacking_args *args) {
  * problem with this is that at the end of the stacking, we have to close the
  * up-scaled sequence, maintain the original sequence as loaded, and display an
  * image, the result, that has a different size than the sequence's.
+ * This is only done for the sum, min and max stacking, which read whole
+ * frames.
  */
 
 struct upscale_args {
@@ -122,6 +124,10 @@ static int upscale_image_hook(struct generic_seq_args *args, int o, int i, fits
 int upscale_sequence(struct stacking_args *stackargs) {
 	if (!stackargs->upscale_at_stacking)
 		return 0;
+	/* mean and median stacking upscale the rows of the frames while they
+	 * are read, see stack_read_region() */
+	if (stackargs->method == stack_mean_with_rejection || stackargs->method == stack_median)
+		return 0;
 
 	struct generic_seq_args *args = create_default_seqargs(stackargs->seq);
 	struct upscale_args *upargs = malloc(sizeof(struct upscale_args));
@@ -0,0 +1,96 @@
+/*
+ * This file is part of Siril, an astronomy image processor.
+ * Copyright (C) 2005-2011 Francois Meyer (dulle at free.fr)
+ * Copyright (C) 2012-2025 team free-astro (see more in AUTHORS file)
+ * Reference site is https://siril.org
+ *
+ * Siril is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Siril is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Siril. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <criterion/criterion.h>
+#include <math.h>
+
+#include "core/siril.h"
+#include "registration/matching/atpmatch.h"
+
+cominfo com;	// the core data struct
+guiinfo gui;	// the gui data struct
+fits gfit;	// currently loaded image
+
+/* Matching a list of stars against a reference list with a reference index
+ * must give the same transformation as without, for all the lists matched
+ * with the same index. */
+
+#define NB_STARS 60
+
+static s_star *make_list(const double *x, const double *y, const double *mag, int n,
+		double angle, double dx, double dy) {
+	s_star *list = calloc(n, sizeof(s_star));
+	double c = cos(angle), s = sin(angle);
+	for (int i = 0; i < n; i++) {
+		list[i].id = i;
+		list[i].x = c * x[i] - s * y[i] + dx;
+		list[i].y = s * x[i] + c * y[i] + dy;
+		list[i].mag = mag[i];
+		list[i].next = i < n - 1 ? &list[i + 1] : NULL;
+	}
+	return list;
+}
+
+static void find_trans(s_star *listA, s_star *listB, at_ref_index *index, TRANS *trans) {
+	memset(trans, 0, sizeof(TRANS));
+	trans->order = AT_TRANS_LINEAR;
+	int ret = atFindTransIndexed(NB_STARS, listA, NB_STARS, listB, index,
+			AT_TRIANGLE_RADIUS, AT_MATCH_NBRIGHT, -1.0, -1.0,
+			AT_MATCH_NOANGLE, AT_MATCH_NOANGLE, AT_MATCH_MAXITER,
+			AT_MATCH_HALTSIGMA, trans);
+	cr_assert_eq(ret, SH_SUCCESS);
+}
+
+Test(atpmatch, indexed_reference) {
+	double x[NB_STARS], y[NB_STARS], mag[NB_STARS];
+	GRand *rand = g_rand_new_with_seed(42);
+	for (int i = 0; i < NB_STARS; i++) {
+		x[i] = g_rand_double_range(rand, 0.0, 2000.0);
+		y[i] = g_rand_double_range(rand, 0.0, 1500.0);
+		mag[i] = g_rand_double_range(rand, 5.0, 15.0);
+	}
+	g_rand_free(rand);
+
+	s_star *ref = make_list(x, y, mag, NB_STARS, 0.0, 0.0, 0.0);
+	at_ref_index *index = atRefIndexNew();
+	for (int frame = 0; frame < 4; frame++) {
+		double angle = 0.01 * frame, dx = 12.5 * frame, dy = -7.25 * frame;
+		s_star *listA = make_list(x, y, mag, NB_STARS, angle, dx, dy);
+		s_star *listA_bis = make_list(x, y, mag, NB_STARS, angle, dx, dy);
+		s_star *listB = make_list(x, y, mag, NB_STARS, 0.0, 0.0, 0.0);
+		TRANS plain, indexed;
+		find_trans(listA, listB, NULL, &plain);
+		find_trans(listA_bis, ref, index, &indexed);
+		cr_expect_float_eq(plain.x00, indexed.x00, 1e-9);
+		cr_expect_float_eq(plain.x10, indexed.x10, 1e-9);
+		cr_expect_float_eq(plain.x01, indexed.x01, 1e-9);
+		cr_expect_float_eq(plain.y00, indexed.y00, 1e-9);
+		cr_expect_float_eq(plain.y10, indexed.y10, 1e-9);
+		cr_expect_float_eq(plain.y01, indexed.y01, 1e-9);
+		cr_expect_eq(plain.nr, indexed.nr);
+		/* A to B is the inverse of the transformation applied to A */
+		cr_expect_float_eq(indexed.x10, cos(angle), 1e-6);
+		free(listA);
+		free(listA_bis);
+		free(listB);
+	}
+	atRefIndexFree(index);
+	free(ref);
+}
@@ -0,0 +1,302 @@
+/*
+ * This file is part of Siril, an astronomy image processor.
+ * Copyright (C) 2005-2011 Francois Meyer (dulle at free.fr)
+ * Copyright (C) 2012-2025 team free-astro (see more in AUTHORS file)
+ * Reference site is https://siril.org
+ *
+ * Siril is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Siril is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Siril. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Generator of the synthetic data of the benchmarks: the same star field seen
+ * by a mono and a colour (RGGB) camera in a few dithered frames with seeing
+ * variations, vignetting, hot pixels and noise, and the matching master bias,
+ * dark and flat. The output only depends on the arguments, so that the
+ * timings of different commits are measured on the same images.
+ *
+ * bench_synth output_directory [-frames=] [-width=] [-height=] [-seed=]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <fitsio.h>
+
+#define BIAS_LEVEL 500.0
+#define DARK_CURRENT 20.0
+#define HOT_PIXEL_LEVEL 3000.0
+#define SKY_LEVEL 800.0
+#define FLAT_LEVEL 30000.0
+#define READ_NOISE 6.0
+#define DITHER 24.0
+#define EXPOSURE 120.0
+
+struct synth_params {
+	int width, height, frames;
+	guint64 seed;
+};
+
+struct star {
+	double x, y, flux;
+	double color[3];
+};
+
+/* splitmix64, small and the same on all platforms, unlike rand() */
+static guint64 next_random(guint64 *state) {
+	guint64 z = (*state += 0x9e3779b97f4a7c15ULL);
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+	return z ^ (z >> 31);
+}
+
+static double uniform(guint64 *state) {
+	return (next_random(state) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static double gaussian(guint64 *state) {
+	double u = uniform(state), v = uniform(state);
+	return sqrt(-2.0 * log(u + 1e-300)) * cos(2.0 * M_PI * v);
+}
+
+static double vignetting(const struct synth_params *p, int x, int y) {
+	double dx = (x - 0.5 * p->width) / (0.5 * p->width);
+	double dy = (y - 0.5 * p->height) / (0.5 * p->width);
+	return 1.0 - 0.15 * (dx * dx + dy * dy);
+}
+
+static double bias_pattern(int x) {
+	return BIAS_LEVEL + 3.0 * sin(x * 0.37) + 2.0 * cos(x * 0.051);
+}
+
+/* the hot pixels come from their own generator so that all frames have them
+ * at the same place */
+static gboolean *make_hot_pixels(const struct synth_params *p) {
+	gboolean *hot = g_new0(gboolean, (size_t) p->width * p->height);
+	guint64 state = p->seed ^ 0x486f7450ULL;
+	size_t nb = (size_t) p->width * p->height / 2000;
+	for (size_t i = 0; i < nb; i++)
+		hot[next_random(&state) % ((guint64) p->width * p->height)] = TRUE;
+	return hot;
+}
+
+static struct star *make_stars(const struct synth_params *p, int *nb_stars) {
+	guint64 state = p->seed;
+	*nb_stars = p->width * p->height / 4000;
+	struct star *stars = g_new(struct star, *nb_stars);
+	for (int i = 0; i < *nb_stars; i++) {
+		stars[i].x = -DITHER + uniform(&state) * (p->width + 2.0 * DITHER);
+		stars[i].y = -DITHER + uniform(&state) * (p->height + 2.0 * DITHER);
+		stars[i].flux = fmin(300.0 * pow(uniform(&state) + 1e-3, -1.5), 400000.0);
+		double temperature = uniform(&state);
+		stars[i].color[0] = 0.7 + 0.6 * temperature;
+		stars[i].color[1] = 1.0;
+		stars[i].color[2] = 1.3 - 0.6 * temperature;
+	}
+	return stars;
+}
+
+/* channel of the pixel for an RGGB pattern, -1 for mono */
+static int cfa_channel(gboolean cfa, int x, int y) {
+	if (!cfa)
+		return -1;
+	return (y & 1) ? ((x & 1) ? 2 : 1) : ((x & 1) ? 1 : 0);
+}
+
+static void render_frame(const struct synth_params *p, const struct star *stars, int nb_stars,
+		const gboolean *hot, int frame, gboolean cfa, float *buf) {
+	static const double sky_color[3] = { 1.1, 1.0, 0.8 };
+	guint64 state = p->seed + 7919ULL * (frame + 1) + (cfa ? 104729ULL : 0ULL);
+	double dx = DITHER * (2.0 * uniform(&state) - 1.0);
+	double dy = DITHER * (2.0 * uniform(&state) - 1.0);
+	double angle = (2.0 * uniform(&state) - 1.0) * 0.1 * M_PI / 180.0;
+	double sigma = (2.6 + 0.8 * uniform(&state)) / 2.3548;
+	double ca = cos(angle), sa = sin(angle);
+	double cx = 0.5 * p->width, cy = 0.5 * p->height;
+
+	for (int y = 0; y < p->height; y++) {
+		for (int x = 0; x < p->width; x++) {
+			int c = cfa_channel(cfa, x, y);
+			buf[(size_t) y * p->width + x] = SKY_LEVEL * (c < 0 ? 1.0 : sky_color[c]);
+		}
+	}
+
+	int radius = (int) ceil(4.0 * sigma);
+	double norm = 1.0 / (2.0 * M_PI * sigma * sigma);
+	for (int i = 0; i < nb_stars; i++) {
+		double sx = ca * (stars[i].x - cx) - sa * (stars[i].y - cy) + cx + dx;
+		double sy = sa * (stars[i].x - cx) + ca * (stars[i].y - cy) + cy + dy;
+		int x0 = (int) floor(sx), y0 = (int) floor(sy);
+		if (x0 < -radius || y0 < -radius || x0 >= p->width + radius || y0 >= p->height + radius)
+			continue;
+		for (int y = MAX(0, y0 - radius); y <= MIN(p->height - 1, y0 + radius); y++) {
+			for (int x = MAX(0, x0 - radius); x <= MIN(p->width - 1, x0 + radius); x++) {
+				double r2 = (x - sx) * (x - sx) + (y - sy) * (y - sy);
+				int c = cfa_channel(cfa, x, y);
+				double flux = stars[i].flux * (c < 0 ? 1.0 : stars[i].color[c]);
+				buf[(size_t) y * p->width + x] += flux * norm * exp(-0.5 * r2 / (sigma * sigma));
+			}
+		}
+	}
+
+	for (int y = 0; y < p->height; y++) {
+		for (int x = 0; x < p->width; x++) {
+			size_t i = (size_t) y * p->width + x;
+			double signal = buf[i] * vignetting(p, x, y) + DARK_CURRENT
+				+ (hot[i] ? HOT_PIXEL_LEVEL : 0.0);
+			signal += sqrt(signal) * gaussian(&state);
+			buf[i] = signal + bias_pattern(x) + READ_NOISE * gaussian(&state);
+		}
+	}
+}
+
+static int save_frame(const char *filename, const float *buf, const struct synth_params *p,
+		const char *bayer, double exposure) {
+	size_t nbpix = (size_t) p->width * p->height;
+	unsigned short *data = g_new(unsigned short, nbpix);
+	for (size_t i = 0; i < nbpix; i++) {
+		double value = round(buf[i]);
+		data[i] = value < 0.0 ? 0 : (value > 65535.0 ? 65535 : (unsigned short) value);
+	}
+
+	fitsfile *fptr;
+	int status = 0;
+	long naxes[2] = { p->width, p->height };
+	gchar *name = g_strdup_printf("!%s", filename);	// overwrite
+	fits_create_file(&fptr, name, &status);
+	g_free(name);
+	if (!status) {
+		fits_create_img(fptr, USHORT_IMG, 2, naxes, &status);
+		fits_write_key(fptr, TDOUBLE, "EXPTIME", &exposure, "[s] Exposure time", &status);
+		fits_write_key(fptr, TSTRING, "INSTRUME", "siril-bench", "Synthetic benchmark data", &status);
+		if (bayer)
+			fits_write_key(fptr, TSTRING, "BAYERPAT", (char *) bayer, "Bayer color pattern", &status);
+		fits_write_img(fptr, TUSHORT, 1, (LONGLONG) nbpix, data, &status);
+		int close_status = 0;
+		fits_close_file(fptr, &close_status);
+	}
+	g_free(data);
+	if (status) {
+		fits_report_error(stderr, status);
+		fprintf(stderr, "Could not write %s\n", filename);
+	}
+	return status;
+}
+
+static int make_masters(const struct synth_params *p, const gboolean *hot, const char *dir, float *buf) {
+	int retval = 0;
+	gchar *filename;
+	for (int y = 0; y < p->height; y++)
+		for (int x = 0; x < p->width; x++)
+			buf[(size_t) y * p->width + x] = bias_pattern(x);
+	filename = g_build_filename(dir, "bias.fit", NULL);
+	retval |= save_frame(filename, buf, p, NULL, 0.0);
+	g_free(filename);
+
+	for (int y = 0; y < p->height; y++) {
+		for (int x = 0; x < p->width; x++) {
+			size_t i = (size_t) y * p->width + x;
+			buf[i] = bias_pattern(x) + DARK_CURRENT + (hot[i] ? HOT_PIXEL_LEVEL : 0.0);
+		}
+	}
+	filename = g_build_filename(dir, "dark.fit", NULL);
+	retval |= save_frame(filename, buf, p, NULL, EXPOSURE);
+	g_free(filename);
+
+	for (int y = 0; y < p->height; y++)
+		for (int x = 0; x < p->width; x++)
+			buf[(size_t) y * p->width + x] = FLAT_LEVEL * vignetting(p, x, y);
+	filename = g_build_filename(dir, "flat.fit", NULL);
+	retval |= save_frame(filename, buf, p, NULL, 2.0);
+	g_free(filename);
+	return retval;
+}
+
+static gboolean parse_int_arg(const char *arg, const char *name, int min, int *value) {
+	if (!g_str_has_prefix(arg, name))
+		return FALSE;
+	gchar *end;
+	gint64 v = g_ascii_strtoll(arg + strlen(name), &end, 10);
+	if (*end != '\0' || v < min || v > G_MAXINT) {
+		fprintf(stderr, "Invalid argument %s\n", arg);
+		exit(EXIT_FAILURE);
+	}
+	*value = (int) v;
+	return TRUE;
+}
+
+int main(int argc, char **argv) {
+	struct synth_params p = { 2048, 1536, 16, 1 };
+	if (argc < 2) {
+		fprintf(stderr, "Usage: %s output_directory [-frames=] [-width=] [-height=] [-seed=]\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+	for (int i = 2; i < argc; i++) {
+		int seed;
+		if (parse_int_arg(argv[i], "-frames=", 2, &p.frames) ||
+				parse_int_arg(argv[i], "-width=", 64, &p.width) ||
+				parse_int_arg(argv[i], "-height=", 64, &p.height))
+			continue;
+		if (parse_int_arg(argv[i], "-seed=", 0, &seed)) {
+			p.seed = (guint64) seed;
+			continue;
+		}
+		fprintf(stderr, "Unknown argument %s\n", argv[i]);
+		return EXIT_FAILURE;
+	}
+
+	/* results is where the scripts save their stacks */
+	const char *subdirs[] = { "lights", "cfa", "masters", "results" };
+	gchar *dirs[G_N_ELEMENTS(subdirs)];
+	for (guint i = 0; i < G_N_ELEMENTS(subdirs); i++) {
+		dirs[i] = g_build_filename(argv[1], subdirs[i], NULL);
+		if (g_mkdir_with_parents(dirs[i], 0755)) {
+			fprintf(stderr, "Could not create %s\n", dirs[i]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	int nb_stars, retval = 0;
+	struct star *stars = make_stars(&p, &nb_stars);
+	gboolean *hot = make_hot_pixels(&p);
+	float *buf = g_new(float, (size_t) p.width * p.height);
+	printf("Generating %d frames of %dx%d pixels with %d stars in %s\n",
+			p.frames, p.width, p.height, nb_stars, argv[1]);
+
+	for (int frame = 0; frame < p.frames && !retval; frame++) {
+		gchar *name = g_strdup_printf("light_%05d.fit", frame + 1);
+		gchar *filename = g_build_filename(dirs[0], name, NULL);
+		render_frame(&p, stars, nb_stars, hot, frame, FALSE, buf);
+		retval = save_frame(filename, buf, &p, NULL, EXPOSURE);
+		g_free(filename);
+		g_free(name);
+
+		name = g_strdup_printf("cfa_%05d.fit", frame + 1);
+		filename = g_build_filename(dirs[1], name, NULL);
+		render_frame(&p, stars, nb_stars, hot, frame, TRUE, buf);
+		retval |= save_frame(filename, buf, &p, "RGGB", EXPOSURE);
+		g_free(filename);
+		g_free(name);
+	}
+	if (!retval)
+		retval = make_masters(&p, hot, dirs[2], buf);
+
+	g_free(buf);
+	g_free(hot);
+	g_free(stars);
+	for (guint i = 0; i < G_N_ELEMENTS(subdirs); i++)
+		g_free(dirs[i]);
+	return retval ? EXIT_FAILURE : EXIT_SUCCESS;
+}
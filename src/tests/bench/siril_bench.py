@@ -0,0 +1,159 @@
+#!/usr/bin/env python3
+#
+# This file is part of Siril, an astronomy image processor.
+# Copyright (C) 2012-2025 team free-astro (see more in AUTHORS file)
+# Reference site is https://siril.org
+#
+# Siril is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# Runs the siril-bench pipelines with siril-cli on the synthetic data made by
+# bench_synth and writes their wall-clock times as JSON. Given the results of
+# another commit with --baseline, it fails when a pipeline got slower than
+# --threshold percent.
+
+import argparse
+import datetime
+import json
+import os
+import platform
+import shutil
+import statistics
+import subprocess
+import sys
+import time
+
+# in the order they are run, each pipeline works on the output of the
+# previous ones
+PIPELINES = ['convert', 'calibrate', 'register', 'seqapplyreg', 'stack',
+             'drizzle', 'pixelmath', 'deconvolution']
+
+FORMAT_VERSION = 1
+
+
+def git_commit(source_dir):
+    try:
+        return subprocess.run(['git', 'describe', '--always', '--dirty'], cwd=source_dir,
+                              capture_output=True, text=True, check=True).stdout.strip()
+    except (OSError, subprocess.CalledProcessError):
+        return 'unknown'
+
+
+def generate_data(args, data_dir):
+    stamp = os.path.join(data_dir, 'bench_synth.stamp')
+    params = f'{args.frames} {args.width} {args.height} {args.seed}'
+    if os.path.exists(stamp):
+        with open(stamp) as f:
+            if f.read() == params:
+                return
+    shutil.rmtree(data_dir, ignore_errors=True)
+    subprocess.run([args.synth, data_dir, f'-frames={args.frames}', f'-width={args.width}',
+                    f'-height={args.height}', f'-seed={args.seed}'], check=True)
+    with open(stamp, 'w') as f:
+        f.write(params)
+
+
+def run_pipelines(args, data_dir, run_dir, pipelines, cli_options=()):
+    shutil.rmtree(run_dir, ignore_errors=True)
+    shutil.copytree(data_dir, run_dir, symlinks=True)
+    durations = {}
+    for name in pipelines:
+        script = os.path.join(args.scripts, f'bench_{name}.ssf')
+        with open(os.path.join(run_dir, f'{name}.log'), 'w') as log:
+            start = time.perf_counter()
+            ret = subprocess.run([args.siril_cli, *cli_options, '-d', run_dir, '-s', script],
+                                 stdout=log, stderr=subprocess.STDOUT)
+            durations[name] = time.perf_counter() - start
+        if ret.returncode:
+            print(f'{name} failed, see {log.name}', file=sys.stderr)
+            durations[name] = None
+            break       # the next pipelines need its output
+        print(f'{name}: {durations[name]:.2f} s')
+    return durations
+
+
+def compare(results, baseline_file, threshold):
+    with open(baseline_file) as f:
+        baseline = json.load(f)
+    if baseline.get('dataset') != results['dataset']:
+        print('The baseline was measured on another dataset, not comparing', file=sys.stderr)
+        return 0
+    regressions = 0
+    for name, result in results['pipelines'].items():
+        old = baseline['pipelines'].get(name)
+        if not old or old['status'] != 'ok' or result['status'] != 'ok':
+            continue
+        change = (result['seconds'] / old['seconds'] - 1.0) * 100.0
+        regressed = change > threshold
+        regressions += regressed
+        print(f'{name}: {old["seconds"]:.2f} s -> {result["seconds"]:.2f} s ({change:+.1f}%)'
+              f'{" REGRESSION" if regressed else ""}')
+    return regressions
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Times the main pipelines of siril on synthetic data')
+    parser.add_argument('--siril-cli', required=True)
+    parser.add_argument('--synth', required=True, help='the bench_synth generator')
+    parser.add_argument('--scripts', default=os.path.dirname(os.path.abspath(__file__)))
+    parser.add_argument('--source-dir', default='.')
+    parser.add_argument('--workdir', required=True)
+    parser.add_argument('--output', required=True)
+    parser.add_argument('--frames', type=int, default=16)
+    parser.add_argument('--width', type=int, default=2048)
+    parser.add_argument('--height', type=int, default=1536)
+    parser.add_argument('--seed', type=int, default=1)
+    parser.add_argument('--repeat', type=int, default=int(os.environ.get('SIRIL_BENCH_REPEAT', 3)))
+    parser.add_argument('--only', nargs='+', choices=PIPELINES,
+                        help='stop after the last of these pipelines and only report them')
+    parser.add_argument('--baseline', default=os.environ.get('SIRIL_BENCH_BASELINE'),
+                        help='results of another commit to compare with')
+    parser.add_argument('--threshold', type=float, default=10.0,
+                        help='slowdown in percent reported as a regression')
+    args = parser.parse_args()
+
+    data_dir = os.path.join(args.workdir, 'data')
+    run_dir = os.path.join(args.workdir, 'run')
+    generate_data(args, data_dir)
+
+    pipelines = PIPELINES
+    if args.only:
+        pipelines = PIPELINES[:max(PIPELINES.index(p) for p in args.only) + 1]
+    runs = {name: [] for name in pipelines}
+    for i in range(args.repeat):
+        print(f'Run {i + 1}/{args.repeat}')
+        for name, duration in run_pipelines(args, data_dir, run_dir, pipelines).items():
+            runs[name].append(duration)
+
+    results = {
+        'format': FORMAT_VERSION,
+        'commit': git_commit(args.source_dir),
+        'date': datetime.datetime.now(datetime.timezone.utc).isoformat(timespec='seconds'),
+        'host': {'name': platform.node(), 'system': platform.system(),
+                 'machine': platform.machine(), 'cpus': os.cpu_count()},
+        'dataset': {'frames': args.frames, 'width': args.width, 'height': args.height,
+                    'seed': args.seed},
+        'pipelines': {},
+    }
+    for name in args.only or pipelines:
+        durations = runs[name]
+        ok = len(durations) == args.repeat and None not in durations
+        results['pipelines'][name] = {
+            'status': 'ok' if ok else 'failed',
+            # the median is less sensitive than the mean to a disturbed run
+            'seconds': statistics.median(durations) if ok else None,
+            'runs': durations,
+        }
+    with open(args.output, 'w') as f:
+        json.dump(results, f, indent=2)
+    print(f'Results written to {args.output}')
+
+    failed = any(r['status'] != 'ok' for r in results['pipelines'].values())
+    regressions = compare(results, args.baseline, args.threshold) if args.baseline else 0
+    return 1 if failed or regressions else 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,208 @@
+#!/usr/bin/env python3
+#
+# This file is part of Siril, an astronomy image processor.
+# Copyright (C) 2012-2025 team free-astro (see more in AUTHORS file)
+# Reference site is https://siril.org
+#
+# Siril is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# Runs the siril-bench pipelines on the synthetic data of bench_synth with the
+# reference paths of siril and with its optional faster paths, then checks
+# with compare_fits that their outputs agree within the error budgets. The
+# optimisations that cannot be switched off are validated against the outputs
+# of a reference commit, kept with --save-golden and given with --golden.
+
+import argparse
+import json
+import os
+import shutil
+import subprocess
+import sys
+
+import siril_bench
+
+# the settings of each mode, written as the configuration file of siril-cli
+MODES = {
+    'reference': {'core': {'opencl': 'false', 'stack_half_float': 'false', 'fftw_tiled': 'false'}},
+    'optimised': {'core': {'opencl': 'true', 'stack_half_float': 'true', 'fftw_tiled': 'true'}},
+}
+
+# compare_fits options, on pixel values normalised to [0, 1]
+BUDGETS = {
+    # calibration and conversions are computed in single precision
+    'calibration': ['-maxabs=1e-5', '-rms=1e-6'],
+    # interpolation on an OpenCL device rounds differently
+    'transformation': ['-maxabs=1e-3', '-rms=1e-5'],
+    # half precision blocks carry 11 bits, and a pixel close to a rejection
+    # threshold can change side, so only a few pixels may differ more
+    'stack': ['-rms=1e-4', '-tolerance=1e-3', '-maxdiff=1e-3'],
+    # agreement of the rejected pixels
+    'rejmap': ['-tolerance=0', '-maxdiff=1e-3'],
+    # the tiles are deconvolved with their borders only
+    'deconvolution': ['-maxabs=2e-2', '-rms=1e-3'],
+}
+
+# the outputs checked, with the pipeline that writes them and their budget
+OUTPUTS = [
+    ('calibrate', 'lights/pp_light_00001.fit', 'calibration'),
+    ('calibrate', 'cfa/pp_cfa_00001.fit', 'calibration'),
+    ('calibrate', 'cfa/ppd_cfa_00001.fit', 'calibration'),
+    ('seqapplyreg', 'lights/rmax_pp_light_00001.fit', 'transformation'),
+    ('seqapplyreg', 'lights/rcub_pp_light_00001.fit', 'transformation'),
+    ('seqapplyreg', 'lights/rarea_pp_light_00001.fit', 'transformation'),
+    ('stack', 'results/sum.fit', 'stack'),
+    ('stack', 'results/max.fit', 'stack'),
+    ('stack', 'results/median.fit', 'stack'),
+    ('stack', 'results/mean.fit', 'stack'),
+    ('stack', 'results/percentile.fit', 'stack'),
+    ('stack', 'results/sigma.fit', 'stack'),
+    ('stack', 'results/mad.fit', 'stack'),
+    ('stack', 'results/sigmedian.fit', 'stack'),
+    ('stack', 'results/winsorized.fit', 'stack'),
+    ('stack', 'results/linearfit.fit', 'stack'),
+    ('stack', 'results/gesdt.fit', 'stack'),
+    ('stack', 'results/weighted.fit', 'stack'),
+    ('stack', 'results/weighted_low_rejmap.fit', 'rejmap'),
+    ('stack', 'results/weighted_high_rejmap.fit', 'rejmap'),
+    ('stack', 'results/applyreg.fit', 'stack'),
+    ('stack', 'results/mosaic.fit', 'stack'),
+    ('stack', 'results/color.fit', 'stack'),
+    ('drizzle', 'results/drizzle.fit', 'stack'),
+    ('drizzle', 'results/bayer_drizzle.fit', 'stack'),
+    ('pixelmath', 'results/pm_mix.fit', 'stack'),
+    ('pixelmath', 'results/pm_iif.fit', 'stack'),
+    ('pixelmath', 'results/pm_mtf.fit', 'stack'),
+    ('deconvolution', 'results/deconv_rl.fit', 'deconvolution'),
+    ('deconvolution', 'results/deconv_rl_tv.fit', 'deconvolution'),
+    ('deconvolution', 'results/deconv_wiener.fit', 'deconvolution'),
+]
+
+FORMAT_VERSION = 1
+
+
+def write_config(filename, settings):
+    with open(filename, 'w') as f:
+        for group, values in settings.items():
+            f.write(f'[{group}]\n')
+            for key, value in values.items():
+                f.write(f'{key}={value}\n')
+
+
+def run_mode(args, data_dir, mode, pipelines):
+    run_dir = os.path.join(args.workdir, mode)
+    config = os.path.join(args.workdir, f'{mode}.config')
+    write_config(config, MODES[mode])
+    print(f'Running the {mode} paths')
+    durations = siril_bench.run_pipelines(args, data_dir, run_dir, pipelines, ('-i', config))
+    failed = [name for name, duration in durations.items() if duration is None]
+    return run_dir, failed
+
+
+def compare(args, reference_dir, run_dir, outputs):
+    results = {}
+    for pipeline, path, budget in outputs:
+        reference = os.path.join(reference_dir, path)
+        image = os.path.join(run_dir, path)
+        if not os.path.exists(reference) or not os.path.exists(image):
+            print(f'{path}: missing', file=sys.stderr)
+            results[path] = {'pipeline': pipeline, 'budget': budget, 'passed': False, 'missing': True}
+            continue
+        ret = subprocess.run([args.compare_fits, *BUDGETS[budget], '-json', reference, image],
+                             capture_output=True, text=True)
+        if ret.returncode > 1 or not ret.stdout.strip():
+            print(f'{path}: could not be compared\n{ret.stderr}', file=sys.stderr)
+            results[path] = {'pipeline': pipeline, 'budget': budget, 'passed': False}
+            continue
+        result = json.loads(ret.stdout.strip().splitlines()[-1])
+        result.update(pipeline=pipeline, budget=budget)
+        results[path] = result
+        print(f'{path}: max abs {result["max_abs"]:.3g}, rms {result["rms"]:.3g}, '
+              f'{result["differing_fraction"] * 100.0:.4f}% of the pixels differ'
+              f'{"" if result["passed"] else " FAILED"}')
+    return results
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Checks that the optimised paths of siril compute '
+                                     'the same images as the reference paths within error budgets')
+    parser.add_argument('--siril-cli', required=True)
+    parser.add_argument('--synth', required=True, help='the bench_synth generator')
+    parser.add_argument('--compare-fits', required=True, help='the compare_fits program')
+    parser.add_argument('--scripts', default=os.path.dirname(os.path.abspath(__file__)))
+    parser.add_argument('--source-dir', default='.')
+    parser.add_argument('--workdir', required=True)
+    parser.add_argument('--output', help='writes the comparisons as JSON')
+    parser.add_argument('--frames', type=int, default=16)
+    parser.add_argument('--width', type=int, default=1024)
+    parser.add_argument('--height', type=int, default=768)
+    parser.add_argument('--seed', type=int, default=1)
+    parser.add_argument('--only', nargs='+', choices=siril_bench.PIPELINES,
+                        help='stop after the last of these pipelines and only check their outputs')
+    golden = parser.add_mutually_exclusive_group()
+    golden.add_argument('--save-golden', metavar='DIR',
+                        help='run the reference paths only and keep their outputs in DIR')
+    golden.add_argument('--golden', metavar='DIR',
+                        help='compare the outputs of both modes with those kept by --save-golden')
+    args = parser.parse_args()
+
+    data_dir = os.path.join(args.workdir, 'data')
+    siril_bench.generate_data(args, data_dir)
+    dataset = {'frames': args.frames, 'width': args.width, 'height': args.height, 'seed': args.seed}
+
+    pipelines = siril_bench.PIPELINES
+    if args.only:
+        pipelines = pipelines[:max(pipelines.index(p) for p in args.only) + 1]
+    outputs = [o for o in OUTPUTS if not args.only or o[0] in args.only]
+
+    if args.save_golden:
+        run_dir, failed = run_mode(args, data_dir, 'reference', pipelines)
+        if failed:
+            print(f'{failed[0]} failed, no golden outputs saved', file=sys.stderr)
+            return 1
+        for _, path, _ in outputs:
+            os.makedirs(os.path.join(args.save_golden, os.path.dirname(path)), exist_ok=True)
+            shutil.copy2(os.path.join(run_dir, path), os.path.join(args.save_golden, path))
+        with open(os.path.join(args.save_golden, 'golden.json'), 'w') as f:
+            json.dump({'format': FORMAT_VERSION, 'commit': siril_bench.git_commit(args.source_dir),
+                       'dataset': dataset}, f, indent=2)
+        print(f'Golden outputs saved in {args.save_golden}')
+        return 0
+
+    if args.golden:
+        with open(os.path.join(args.golden, 'golden.json')) as f:
+            info = json.load(f)
+        if info.get('dataset') != dataset:
+            print('The golden outputs were computed on another dataset', file=sys.stderr)
+            return 1
+        print(f'Comparing with the golden outputs of {info.get("commit")}')
+
+    results = {'format': FORMAT_VERSION, 'commit': siril_bench.git_commit(args.source_dir),
+               'dataset': dataset, 'comparisons': {}}
+    failed = False
+    run_dirs = {}
+    for mode in MODES:
+        run_dirs[mode], failed_pipelines = run_mode(args, data_dir, mode, pipelines)
+        failed = failed or bool(failed_pipelines)
+    if args.golden:
+        for mode in MODES:
+            print(f'{mode} paths against the golden outputs:')
+            results['comparisons'][mode] = compare(args, args.golden, run_dirs[mode], outputs)
+    else:
+        print('optimised paths against the reference paths:')
+        results['comparisons']['optimised'] = compare(args, run_dirs['reference'],
+                                                      run_dirs['optimised'], outputs)
+
+    if args.output:
+        with open(args.output, 'w') as f:
+            json.dump(results, f, indent=2)
+        print(f'Results written to {args.output}')
+    failed = failed or any(not r['passed'] for comparisons in results['comparisons'].values()
+                           for r in comparisons.values())
+    return 1 if failed else 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
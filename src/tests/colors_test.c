@@ -0,0 +1,81 @@
+/*
+ * This file is part of Siril, an astronomy image processor.
+ * Copyright (C) 2005-2011 Francois Meyer (dulle at free.fr)
+ * Copyright (C) 2012-2025 team free-astro (see more in AUTHORS file)
+ * Reference site is https://siril.org
+ *
+ * Siril is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Siril is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Siril. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <criterion/criterion.h>
+#include "core/siril.h"
+#include "algos/colors.h"
+
+cominfo com;	// the core data struct
+guiinfo gui;	// the gui data struct
+fits gfit;	// currently loaded image
+
+#define STEPS 17
+#define NB (STEPS * STEPS * STEPS)
+
+static float r[NB], g[NB], b[NB];
+
+/* all combinations of 17 levels per channel, including equal channels */
+static void fill_rgb() {
+	int n = 0;
+	for (int i = 0; i < STEPS; i++)
+		for (int j = 0; j < STEPS; j++)
+			for (int k = 0; k < STEPS; k++) {
+				r[n] = i / (float) (STEPS - 1);
+				g[n] = j / (float) (STEPS - 1);
+				b[n] = k / (float) (STEPS - 1);
+				n++;
+			}
+}
+
+/* the batch kernels must give exactly the results of the scalar functions */
+void test_rgb_to_hsl_batch() {
+	float h[NB], s[NB], l[NB];
+	const float low = 0.1f;
+	fill_rgb();
+	rgb_to_hsl_float_sat_batch(r, g, b, low, h, s, l, NB);
+	for (int i = 0; i < NB; i++) {
+		float hs = 0.f, ss = 0.f, ls;
+		rgb_to_hsl_float_sat(r[i], g[i], b[i], low, &hs, &ss, &ls);
+		cr_expect_eq(l[i], ls, "l differs for %g %g %g", r[i], g[i], b[i]);
+		if (ls > 0.f) {
+			cr_expect_eq(h[i], hs, "h differs for %g %g %g", r[i], g[i], b[i]);
+			cr_expect_eq(s[i], ss, "s differs for %g %g %g", r[i], g[i], b[i]);
+		}
+	}
+}
+
+void test_hsl_to_rgb_batch() {
+	float h[NB], s[NB], l[NB], r2[NB], g2[NB], b2[NB];
+	fill_rgb();
+	rgb_to_hsl_float_sat_batch(r, g, b, 0.f, h, s, l, NB);
+	for (int i = 0; i < NB; i++)
+		s[i] = min(s[i] * 1.5f, 1.f);
+	hsl_to_rgb_float_sat_batch(h, s, l, r2, g2, b2, NB);
+	for (int i = 0; i < NB; i++) {
+		float rs, gs, bs;
+		hsl_to_rgb_float_sat(h[i], s[i], l[i], &rs, &gs, &bs);
+		cr_expect_eq(r2[i], rs, "r differs for %g %g %g", h[i], s[i], l[i]);
+		cr_expect_eq(g2[i], gs, "g differs for %g %g %g", h[i], s[i], l[i]);
+		cr_expect_eq(b2[i], bs, "b differs for %g %g %g", h[i], s[i], l[i]);
+	}
+}
+
+Test(colors, rgb_to_hsl_batch) { test_rgb_to_hsl_batch(); }
+Test(colors, hsl_to_rgb_batch) { test_hsl_to_rgb_batch(); }
@@ -18,26 +18,114 @@
  * along with Siril. If not, see <http://www.gnu.org/licenses/>.
  */
 
+/* compare_fits checks that two images are identical, or with error budgets
+ * that an optimised path computes the same image as the reference within
+ * them: -maxabs is the largest absolute difference allowed and -rms the root
+ * mean square of the differences, both on pixel values normalised to [0, 1],
+ * and -maxdiff the fraction of the pixels allowed to differ by more than
+ * -tolerance, which is 0 by default. With -tolerance=0 and a -maxdiff, the
+ * rejection maps of two stacks are checked for the agreement of their
+ * rejected pixels. */
+
 #include "../core/siril.h"
 #include "../core/proto.h"
 #include "../io/image_format_fits.h"
+#include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+struct error_budget {
+	double max_abs, rms, tolerance, max_diff_fraction;
+	gboolean enabled;
+};
+
+static int usage(const char *name) {
+	fprintf(stderr, "Usage: %s [-maxabs=value] [-rms=value] [-maxdiff=fraction [-tolerance=value]] "
+			"[-json] image1.fit image2.fit\n", name);
+	return 2;
+}
+
+static double pixel_value(const fits *fit, size_t i) {
+	if (fit->type == DATA_USHORT)
+		return fit->data[i] * INV_USHRT_MAX_DOUBLE;
+	return fit->fdata[i];
+}
+
+/* the images can have different types, their values are compared normalised */
+static int compare_with_budget(const fits *fits1, const fits *fits2, const struct error_budget *budget,
+		gboolean json) {
+	size_t n = fits1->naxes[0] * fits1->naxes[1] * fits1->naxes[2];
+	double max_abs = 0.0, sum_sq = 0.0;
+	size_t nb_diff = 0, nb_nan = 0;
+	for (size_t i = 0; i < n; i++) {
+		double a = pixel_value(fits1, i), b = pixel_value(fits2, i);
+		if (isnan(a) || isnan(b)) {
+			if (isnan(a) != isnan(b))
+				nb_nan++;
+			continue;
+		}
+		double diff = fabs(a - b);
+		if (diff > max_abs)
+			max_abs = diff;
+		sum_sq += diff * diff;
+		if (diff > budget->tolerance)
+			nb_diff++;
+	}
+	double rms = n ? sqrt(sum_sq / n) : 0.0;
+	double diff_fraction = n ? (nb_diff + nb_nan) / (double) n : 0.0;
+
+	gboolean failed = nb_nan > 0;
+	if (budget->max_abs >= 0.0 && max_abs > budget->max_abs)
+		failed = TRUE;
+	if (budget->rms >= 0.0 && rms > budget->rms)
+		failed = TRUE;
+	if (budget->max_diff_fraction >= 0.0 && diff_fraction > budget->max_diff_fraction)
+		failed = TRUE;
+
+	if (json) {
+		fprintf(stdout, "{\"max_abs\": %g, \"rms\": %g, \"differing\": %zu, \"differing_fraction\": %g, "
+				"\"nan_mismatches\": %zu, \"pixels\": %zu, \"passed\": %s}\n", max_abs, rms,
+				nb_diff + nb_nan, diff_fraction, nb_nan, n, failed ? "false" : "true");
+	} else {
+		fprintf(stdout, "max abs %g, rms %g, %zu pixels (%.4f%%) differ by more than %g",
+				max_abs, rms, nb_diff + nb_nan, diff_fraction * 100.0, budget->tolerance);
+		if (nb_nan)
+			fprintf(stdout, ", %zu are NaN in only one image", nb_nan);
+		fprintf(stdout, "\nimages %s the error budget\n", failed ? "exceed" : "are within");
+	}
+	return failed;
+}
+
 int main(int argc, char **argv) {
 	fits fits1 = {0}, fits2 = {0};
+	struct error_budget budget = { -1.0, -1.0, 0.0, -1.0, FALSE };
+	gboolean json = FALSE;
+	int i;
 
-	if (argc < 3) {
-		fprintf(stderr, "Usage: %s image1.fit image2.fit\n", *argv);
-		exit(2);
+	for (i = 1; i < argc && argv[i][0] == '-'; i++) {
+		if (g_str_has_prefix(argv[i], "-maxabs="))
+			budget.max_abs = g_ascii_strtod(argv[i] + 8, NULL);
+		else if (g_str_has_prefix(argv[i], "-rms="))
+			budget.rms = g_ascii_strtod(argv[i] + 5, NULL);
+		else if (g_str_has_prefix(argv[i], "-maxdiff="))
+			budget.max_diff_fraction = g_ascii_strtod(argv[i] + 9, NULL);
+		else if (g_str_has_prefix(argv[i], "-tolerance="))
+			budget.tolerance = g_ascii_strtod(argv[i] + 11, NULL);
+		else if (!strcmp(argv[i], "-json"))
+			json = TRUE;
+		else return usage(*argv);
+		if (strcmp(argv[i], "-json"))
+			budget.enabled = TRUE;
 	}
+	if (argc - i != 2)
+		return usage(*argv);
 
-	if (readfits(argv[1], &fits1, NULL, FALSE) || readfits(argv[2], &fits2, NULL, FALSE)) {
+	if (readfits(argv[i], &fits1, NULL, FALSE) || readfits(argv[i + 1], &fits2, NULL, FALSE)) {
 		exit(2);
 	}
 
-	if (fits1.header && fits2.header) {
+	if (!budget.enabled && fits1.header && fits2.header) {
 		if (strcmp(fits1.header, fits2.header))
 			fprintf(stdout, "headers differ\n");
 	}
@@ -51,6 +139,9 @@ int main(int argc, char **argv) {
 		exit(1);
 	}
 
+	if (budget.enabled)
+		return compare_with_budget(&fits1, &fits2, &budget, json);
+
 	if (fits1.type != fits2.type) {
 		fprintf(stdout, "image type differ\n");
 		exit(1);
@@ -0,0 +1,155 @@
+/*
+ * This file is part of Siril, an astronomy image processor.
+ * Copyright (C) 2005-2011 Francois Meyer (dulle at free.fr)
+ * Copyright (C) 2012-2025 team free-astro (see more in AUTHORS file)
+ * Reference site is https://siril.org
+ *
+ * Siril is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Siril is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Siril. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <criterion/criterion.h>
+#include <string.h>
+#include <unistd.h>
+#include <utime.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+#include "core/siril.h"
+#include "io/image_format_fits.h"
+#include "io/fits_sequence.h"
+#include "io/frame_cache.h"
+
+cominfo com;	// the core data struct
+guiinfo gui;	// the gui data struct
+fits gfit;	// currently loaded image
+
+#define WIDTH 256
+#define HEIGHT 256
+/* the cost of a frame in the cache, in GB as the setting */
+#define FRAME_GB ((double) WIDTH * HEIGHT * sizeof(WORD) / (BYTES_IN_A_MB * 1024.0))
+
+static gchar *filename = NULL;
+static sequence seq;
+static fitseq fseq;
+
+/* the frames are only read by the caller of the cache, the file is only used
+ * for its state */
+static void write_file(const char *content) {
+	cr_assert(g_file_set_contents(filename, content, -1, NULL));
+}
+
+static void setup() {
+	int fd = g_file_open_tmp("siril_frame_cache_XXXXXX.fit", &filename, NULL);
+	cr_assert(fd >= 0);
+	close(fd);
+	write_file("frames");
+	memset(&fseq, 0, sizeof(fitseq));
+	fseq.filename = filename;
+	memset(&seq, 0, sizeof(sequence));
+	seq.type = SEQ_FITSEQ;
+	seq.fitseq_file = &fseq;
+	seq.number = 2;
+	com.pref.frame_cache_amount = 4.0 * FRAME_GB;
+}
+
+static void teardown() {
+	frame_cache_clear();
+	g_unlink(filename);
+	g_free(filename);
+	filename = NULL;
+}
+
+static fits *create_frame(WORD value) {
+	fits *fit = NULL;
+	cr_assert(!new_fit_image(&fit, WIDTH, HEIGHT, 1, DATA_USHORT));
+	for (size_t i = 0; i < WIDTH * HEIGHT; i++)
+		fit->data[i] = value;
+	return fit;
+}
+
+/* reads frame index through the cache, the frame being made with value on a
+ * miss. Returns TRUE if it was found in the cache */
+static gboolean read_frame(int index, WORD value, fits *dest) {
+	frame_cache_slot *slot;
+	if (frame_cache_get(&seq, index, dest, FALSE, &slot))
+		return TRUE;
+	cr_assert(slot, "a slot is given on a miss");
+	fits *fit = create_frame(value);
+	frame_cache_put(slot, fit);
+	copyfits(fit, dest, CP_ALLOC | CP_COPYA | CP_FORMAT, -1);
+	clearfits(fit);
+	free(fit);
+	return FALSE;
+}
+
+static void check_frame(fits *fit, WORD value) {
+	cr_assert_eq(fit->rx, WIDTH);
+	cr_assert_eq(fit->ry, HEIGHT);
+	cr_expect_eq(fit->data[0], value);
+	cr_expect_eq(fit->data[WIDTH * HEIGHT - 1], value);
+	clearfits(fit);
+}
+
+Test(frame_cache, hit, .init = setup, .fini = teardown) {
+	fits fit = { 0 };
+	cr_expect(!read_frame(0, 100, &fit), "first read");
+	check_frame(&fit, 100);
+	cr_expect_eq(frame_cache_get_used(), WIDTH * HEIGHT * sizeof(WORD));
+	cr_expect(read_frame(0, 200, &fit), "second read");
+	check_frame(&fit, 100);
+	cr_expect(!read_frame(1, 300, &fit), "other frame");
+	check_frame(&fit, 300);
+}
+
+Test(frame_cache, invalidated_by_mtime, .init = setup, .fini = teardown) {
+	fits fit = { 0 };
+	cr_expect(!read_frame(0, 100, &fit));
+	check_frame(&fit, 100);
+	/* same size, another modification time */
+	cr_assert(!g_utime(filename, &(struct utimbuf) { .actime = 1000000, .modtime = 1000000 }));
+	cr_expect(!read_frame(0, 200, &fit), "read after the file changed");
+	check_frame(&fit, 200);
+	cr_expect(read_frame(0, 300, &fit));
+	check_frame(&fit, 200);
+	/* a rewrite changing the size */
+	write_file("other frames");
+	cr_expect(!read_frame(0, 400, &fit), "read after the file was rewritten");
+	check_frame(&fit, 400);
+}
+
+Test(frame_cache, eviction, .init = setup, .fini = teardown) {
+	fits fit = { 0 };
+	com.pref.frame_cache_amount = 1.5 * FRAME_GB;
+	cr_expect(!read_frame(0, 100, &fit));
+	clearfits(&fit);
+	cr_expect(!read_frame(1, 200, &fit));
+	clearfits(&fit);
+	cr_expect_eq(frame_cache_get_used(), WIDTH * HEIGHT * sizeof(WORD));
+	cr_expect(!read_frame(0, 300, &fit), "least recently used frame evicted");
+	check_frame(&fit, 300);
+	cr_expect(!read_frame(1, 400, &fit), "evicted by the previous read");
+	check_frame(&fit, 400);
+
+	com.pref.frame_cache_amount = 0.0;
+	frame_cache_trim();
+	cr_expect_eq(frame_cache_get_used(), 0);
+}
+
+Test(frame_cache, disabled, .init = setup, .fini = teardown) {
+	fits fit = { 0 };
+	frame_cache_slot *slot = NULL;
+	com.pref.frame_cache_amount = 0.0;
+	cr_expect(!frame_cache_get(&seq, 0, &fit, FALSE, &slot));
+	cr_expect_null(slot);
+	cr_expect_eq(frame_cache_get_used(), 0);
+}
@@ -0,0 +1,73 @@
+/*
+ * This file is part of Siril, an astronomy image processor.
+ * Copyright (C) 2005-2011 Francois Meyer (dulle at free.fr)
+ * Copyright (C) 2012-2025 team free-astro (see more in AUTHORS file)
+ * Reference site is https://siril.org
+ *
+ * Siril is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Siril is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Siril. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <criterion/criterion.h>
+#include <math.h>
+#include "core/siril.h"
+#include "algos/half_float.h"
+
+cominfo com;	// the core data struct
+guiinfo gui;	// the gui data struct
+fits gfit;	// currently loaded image
+
+/* every half value, except NaNs, survives a round trip through float */
+Test(half_float, round_trip) {
+	for (guint32 h = 0; h < 65536; h++) {
+		float f = half_to_float((half_float) h);
+		if (isnan(f))
+			continue;
+		cr_assert_eq(float_to_half(f), h, "half 0x%04x gave %g and back 0x%04x", h, f, float_to_half(f));
+	}
+}
+
+Test(half_float, known_values) {
+	cr_expect_eq(float_to_half(0.f), 0x0000);
+	cr_expect_eq(float_to_half(-0.f), 0x8000);
+	cr_expect_eq(float_to_half(1.f), 0x3c00);
+	cr_expect_eq(float_to_half(-2.f), 0xc000);
+	cr_expect_eq(float_to_half(0.5f), 0x3800);
+	cr_expect_eq(float_to_half(65504.f), 0x7bff);	// largest half
+	cr_expect_eq(float_to_half(65520.f), 0x7c00);	// rounds to infinity
+	cr_expect_eq(float_to_half(INFINITY), 0x7c00);
+	cr_expect_eq(float_to_half(5.9604645e-8f), 0x0001);	// smallest denormal
+	cr_expect_eq(float_to_half(1e-9f), 0x0000);
+	cr_expect(isnan(half_to_float(float_to_half(NAN))));
+	cr_expect_float_eq(half_to_float(0x3555), 0.33325195f, 1e-9);
+}
+
+/* ties are rounded to the even mantissa */
+Test(half_float, rounding) {
+	const float ulp = 1.f / 1024.f;	// of the halves in [1, 2)
+	cr_expect_eq(float_to_half(1.f + ulp / 2.f), 0x3c00);
+	cr_expect_eq(float_to_half(1.f + 3.f * ulp / 2.f), 0x3c02);
+	cr_expect_eq(float_to_half(1.f + ulp / 2.f + ulp / 64.f), 0x3c01);
+}
+
+/* relative error of the values used for calibrated images */
+Test(half_float, precision) {
+	float in[1000], out[1000];
+	half_float h[1000];
+	for (int i = 0; i < 1000; i++)
+		in[i] = 1e-4f + i / 1000.f;
+	float_to_half_row(in, h, 1000);
+	half_to_float_row(h, out, 1000);
+	for (int i = 0; i < 1000; i++)
+		cr_assert(fabsf(out[i] - in[i]) <= in[i] / 2048.f, "%g gave %g", in[i], out[i]);
+}
@@ -475,6 +475,74 @@ void test_a_float_b_float() {
 	cr_expect_float_eq(a->fdata[4], 1.0f, 1e-7);
 }
 
+/* the single pass calibration gives the same result as the separate steps */
+void test_calibrate_fused() {
+	fits *a = NULL, *b = NULL, *bias = NULL, *dark = NULL, *flat = NULL;
+	int size = 5;
+
+	WORD origa[] = { 0, 100, 2000, 30000, 65535 };
+	float origbias[] = { 0.01f, 0.01f, 0.01f, 0.01f, 0.01f };
+	float origdark[] = { 0.0f, 0.01f, 0.02f, 0.3f, 0.1f };
+	float origflat[] = { 0.5f, 0.4f, 0.0f, 0.6f, 0.55f };
+
+	new_fit_image_with_data(&a, size, 1, 1, DATA_USHORT, alloc_data(origa, size));
+	new_fit_image_with_data(&b, size, 1, 1, DATA_USHORT, alloc_data(origa, size));
+	new_fit_image_with_data(&bias, size, 1, 1, DATA_FLOAT, alloc_fdata(origbias, size));
+	new_fit_image_with_data(&dark, size, 1, 1, DATA_FLOAT, alloc_fdata(origdark, size));
+	new_fit_image_with_data(&flat, size, 1, 1, DATA_FLOAT, alloc_fdata(origflat, size));
+
+	int retval = imoper(a, bias, OPER_SUB, TRUE);
+	cr_assert(!retval, "imoper SUB bias failed");
+	retval = imoper(a, dark, OPER_SUB, TRUE);
+	cr_assert(!retval, "imoper SUB dark failed");
+	siril_fdiv(a, flat, 0.5f, TRUE);
+
+	float neg_ratio = 0.f;
+	retval = calibrate_fused(b, FLT_MAX, bias, dark, flat, 0.5f, &neg_ratio, 1);
+	cr_assert(!retval, "calibrate_fused failed");
+	cr_assert_eq(b->type, DATA_FLOAT);
+	for (int i = 0; i < size; i++)
+		cr_expect_eq(a->fdata[i], b->fdata[i], "pixel %d: expected %g, got %g", i, a->fdata[i], b->fdata[i]);
+	cr_expect_float_eq(neg_ratio, a->neg_ratio, 1e-7);
+}
+
+/* a chain of operations gives the same result as the separate operations */
+void test_arith_chain() {
+	fits *a = NULL, *b = NULL, *dark = NULL;
+	int size = 5;
+
+	float origa[] = { 0.0f, 0.1f, 0.2f, 0.5f, 0.9f };
+	float origdark[] = { 0.1f, 0.02f, 0.05f, 0.1f, 0.2f };
+
+	new_fit_image_with_data(&a, size, 1, 1, DATA_FLOAT, alloc_fdata(origa, size));
+	new_fit_image_with_data(&b, size, 1, 1, DATA_FLOAT, alloc_fdata(origa, size));
+	new_fit_image_with_data(&dark, size, 1, 1, DATA_FLOAT, alloc_fdata(origdark, size));
+
+	struct arith_chain chain;
+	arith_chain_init(&chain);
+	arith_chain_add_image(&chain, OPER_SUB, dark, 2.0f, ARITH_CLIP_IMOPER);
+	arith_chain_add_scalar(&chain, OPER_DIV, 0.5f, ARITH_CLIP_RANGE);
+	size_t negatives[ARITH_CHAIN_MAX_STEPS];
+	int retval = arith_chain_apply(b, &chain, DATA_USHORT, negatives, 1);
+	cr_assert(!retval, "arith_chain_apply failed");
+	cr_assert_eq(b->type, DATA_USHORT);
+	cr_expect_eq(negatives[0], 1);
+	cr_expect_eq(negatives[1], 0);
+
+	retval = soper(dark, 2.0f, OPER_MUL, TRUE);
+	cr_assert(!retval, "soper MUL failed");
+	retval = imoper(a, dark, OPER_SUB, TRUE);
+	cr_assert(!retval, "imoper SUB failed");
+	retval = soper(a, 0.5f, OPER_DIV, TRUE);
+	cr_assert(!retval, "soper DIV failed");
+	clip(a);
+	for (int i = 0; i < size; i++)
+		cr_expect_eq(b->data[i], float_to_ushort_range(a->fdata[i]), "pixel %d: expected %d, got %d",
+				i, float_to_ushort_range(a->fdata[i]), b->data[i]);
+}
+
 Test(arithmetics, ushort_ushort) { test_a_ushort_b_ushort(); }
 Test(arithmetics, ushort_float) { test_a_ushort_b_float(); }
 Test(arithmetics, float_float) { test_a_float_b_float(); }
+Test(arithmetics, calibrate_fused) { test_calibrate_fused(); }
+Test(arithmetics, arith_chain) { test_arith_chain(); }
@@ -0,0 +1,563 @@
+/*
+ * This file is part of Siril, an astronomy image processor.
+ * Copyright (C) 2005-2011 Francois Meyer (dulle at free.fr)
+ * Copyright (C) 2012-2025 team free-astro (see more in AUTHORS file)
+ * Reference site is https://siril.org
+ *
+ * Siril is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Siril is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Siril. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Micro-benchmarks of the hot kernels, for several sizes and numbers of
+ * threads. Each measure repeats the kernel until -mintime= seconds have
+ * passed and reports the time of one call. The kernels that work on a single
+ * pixel stack, array or star are called on a batch of them, distributed to
+ * the threads as the stacking or the star detection do.
+ *
+ * measure_kernels [-filter=name] [-threads=1,4,...] [-mintime=seconds] [-json]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <gsl/gsl_cdf.h>
+#include <gsl/gsl_matrix.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "../core/siril.h"
+#include "../core/proto.h"
+#include "../core/settings.h"
+#include "../algos/sorting.h"
+#include "../algos/PSF.h"
+#include "../algos/star_finder.h"
+#include "../algos/statistics.h"
+#include "../algos/demosaicing.h"
+#include "../io/image_format_fits.h"
+#include "../opencv/opencv.h"
+#include "../stacking/stacking.h"
+
+cominfo com;	// the core data struct
+guiinfo gui;	// the gui data struct
+fits gfit;	// currently loaded image
+
+typedef void (*kernel_func)(void *user, int threads);
+
+static const char *filter = NULL;
+static gint64 min_time_us = 500000;
+static gboolean json_output = FALSE;
+static int *thread_counts = NULL, nb_thread_counts = 0;
+static guint64 rng_state = 1;
+
+static double uniform() {
+	guint64 z = (rng_state += 0x9e3779b97f4a7c15ULL);
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+	return ((z ^ (z >> 31)) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static double gaussian() {
+	return sqrt(-2.0 * log(uniform() + 1e-300)) * cos(2.0 * M_PI * uniform());
+}
+
+static void set_threads(int threads) {
+	com.max_thread = threads;
+#ifdef _OPENMP
+	omp_set_num_threads(threads);
+#endif
+}
+
+/* runs the kernel once to warm the caches up, then as many times as needed to
+ * reach the minimum time, and reports the time of one call and the number of
+ * items processed per second */
+static void measure(const char *kernel, const char *variant, const char *size, double items,
+		kernel_func func, void *user, int threads) {
+	set_threads(threads);
+	func(user, threads);
+	long iterations = 0;
+	gint64 start = g_get_monotonic_time(), elapsed;
+	do {
+		func(user, threads);
+		iterations++;
+		elapsed = g_get_monotonic_time() - start;
+	} while (elapsed < min_time_us);
+	double seconds = elapsed * 1e-6 / iterations;
+	if (json_output) {
+		fprintf(stdout, "{\"kernel\": \"%s\", \"variant\": \"%s\", \"size\": \"%s\", \"threads\": %d, "
+				"\"iterations\": %ld, \"seconds\": %.9g, \"items_per_second\": %.6g}\n",
+				kernel, variant, size, threads, iterations, seconds, items / seconds);
+	} else {
+		fprintf(stdout, "%-26s %-12s %-11s %3d threads: %12.3f us (%.3g items/s)\n",
+				kernel, variant, size, threads, seconds * 1e6, items / seconds);
+	}
+	fflush(stdout);
+}
+
+static gboolean kernel_selected(const char *kernel) {
+	return !filter || strstr(kernel, filter);
+}
+
+/* a float image with stars on a noisy background, in [0, 1] */
+static fits *make_star_field(int rx, int ry, int nb_layers) {
+	fits *fit = NULL;
+	if (new_fit_image(&fit, rx, ry, nb_layers, DATA_FLOAT))
+		return NULL;
+	size_t nbpix = (size_t) rx * ry;
+	for (size_t i = 0; i < nbpix * nb_layers; i++)
+		fit->fdata[i] = 0.05f + 0.002f * (float) gaussian();
+	int nb_stars = rx * ry / 4000;
+	for (int s = 0; s < nb_stars; s++) {
+		double x = uniform() * rx, y = uniform() * ry;
+		double amplitude = 0.9 * pow(uniform() + 0.01, 2.0), sigma = 1.2;
+		for (int j = MAX(0, (int) y - 6); j < MIN(ry, (int) y + 7); j++) {
+			for (int i = MAX(0, (int) x - 6); i < MIN(rx, (int) x + 7); i++) {
+				float v = (float) (amplitude * exp(-0.5 * ((i - x) * (i - x) + (j - y) * (j - y)) / (sigma * sigma)));
+				for (int c = 0; c < nb_layers; c++)
+					fit->fdata[c * nbpix + (size_t) j * rx + i] += v;
+			}
+		}
+	}
+	return fit;
+}
+
+/******************************* rejection *******************************/
+
+#define REJECTION_STACKS 8192
+
+struct rejection_bench {
+	struct stacking_args args;
+	int nb_frames;
+	float *stacks;	// REJECTION_STACKS stacks of nb_frames values
+	struct _data_block *blocks;	// one per thread
+	int nb_blocks;
+};
+
+static void rejection_kernel(void *user, int threads) {
+	struct rejection_bench *b = (struct rejection_bench *) user;
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(threads) schedule(static)
+#endif
+	for (int p = 0; p < REJECTION_STACKS; p++) {
+#ifdef _OPENMP
+		struct _data_block *data = &b->blocks[omp_get_thread_num()];
+#else
+		struct _data_block *data = &b->blocks[0];
+#endif
+		int crej[2] = { 0, 0 };
+		memcpy(data->stack, b->stacks + (size_t) p * b->nb_frames, b->nb_frames * sizeof(float));
+		apply_rejection_float(data, b->nb_frames, &b->args, crej);
+	}
+}
+
+static void bench_rejection() {
+	const char *kernel = "apply_rejection_float";
+	if (!kernel_selected(kernel))
+		return;
+	static const struct { rejection type; const char *name; float sig[2]; } types[] = {
+		{ PERCENTILE, "percentile", { 0.2f, 0.1f } },
+		{ SIGMA, "sigma", { 3.f, 3.f } },
+		{ MAD, "mad", { 3.f, 3.f } },
+		{ SIGMEDIAN, "sigmedian", { 3.f, 3.f } },
+		{ WINSORIZED, "winsorized", { 3.f, 3.f } },
+		{ LINEARFIT, "linearfit", { 5.f, 5.f } },
+		{ GESDT, "gesdt", { 0.3f, 0.05f } }
+	};
+	static const int sizes[] = { 16, 64, 256 };
+	int max_threads = thread_counts[nb_thread_counts - 1];
+
+	for (int s = 0; s < G_N_ELEMENTS(sizes); s++) {
+		struct rejection_bench b = { 0 };
+		int n = b.nb_frames = sizes[s];
+		b.stacks = malloc((size_t) REJECTION_STACKS * n * sizeof(float));
+		for (size_t i = 0; i < (size_t) REJECTION_STACKS * n; i++) {
+			double u = uniform();
+			// 3% of hot and cold outliers, like satellites and dead pixels
+			b.stacks[i] = u < 0.015 ? 0.8f : (u < 0.03 ? 0.002f : (float) (0.1 + 0.01 * gaussian()));
+		}
+		b.nb_blocks = max_threads;
+		b.blocks = calloc(b.nb_blocks, sizeof(struct _data_block));
+		for (int t = 0; t < b.nb_blocks; t++) {
+			struct _data_block *data = &b.blocks[t];
+			data->stack = malloc(n * sizeof(float));
+			data->o_stack = malloc(n * sizeof(float));
+			data->w_stack = malloc(n * sizeof(float));
+			data->rejected = malloc(n * sizeof(int));
+			data->m_x = (n - 1) * 0.5f;
+			data->m_dx2 = 0.f;
+			for (int j = 0; j < n; ++j) {
+				const float dx = j - data->m_x;
+				data->m_dx2 += (dx * dx - data->m_dx2) / (j + 1);
+			}
+			data->m_dx2 = 1.f / data->m_dx2;
+		}
+		gchar *size = g_strdup_printf("%d", n);
+
+		for (int r = 0; r < G_N_ELEMENTS(types); r++) {
+			b.args.type_of_rejection = types[r].type;
+			b.args.sig[0] = types[r].sig[0];
+			b.args.sig[1] = types[r].sig[1];
+			b.args.weighting_type = NO_WEIGHT;
+			b.args.critical_value = NULL;
+			if (types[r].type == GESDT) {
+				// same as in stack_compute_parallel_blocks()
+				int max_outliers = (int) floor(n * b.args.sig[0]);
+				b.args.critical_value = malloc(max_outliers * sizeof(float));
+				for (int j = 0, sz = n; j < max_outliers; j++, sz--) {
+					float t_dist = gsl_cdf_tdist_Pinv(1 - b.args.sig[1] / (2 * sz), sz - 2);
+					b.args.critical_value[j] = (sz - 1) * t_dist / (sqrtf(sz) * sqrtf(sz - 2 + (t_dist * t_dist)));
+				}
+			}
+			for (int t = 0; t < nb_thread_counts; t++)
+				measure(kernel, types[r].name, size, REJECTION_STACKS, rejection_kernel, &b, thread_counts[t]);
+			free(b.args.critical_value);
+		}
+
+		g_free(size);
+		for (int t = 0; t < b.nb_blocks; t++) {
+			free(b.blocks[t].stack);
+			free(b.blocks[t].o_stack);
+			free(b.blocks[t].w_stack);
+			free(b.blocks[t].rejected);
+		}
+		free(b.blocks);
+		free(b.stacks);
+	}
+}
+
+/******************************** medians ********************************/
+
+enum median_variant { QUICKMEDIAN, HISTOGRAM, SORTNET };
+
+struct median_bench {
+	enum median_variant variant;
+	size_t n;
+	int nb_arrays;
+	float *src;	// nb_arrays arrays of n values
+	float **work;	// one per thread
+	WORD **work_ushort;
+};
+
+static void median_kernel(void *user, int threads) {
+	struct median_bench *b = (struct median_bench *) user;
+	if (b->nb_arrays == 1) {
+		// a single large array, only the histogram median is threaded
+		memcpy(b->work[0], b->src, b->n * sizeof(float));
+		if (b->variant == HISTOGRAM)
+			histogram_median_float(b->work[0], b->n, (threading_type) threads);
+		else quickmedian_float(b->work[0], b->n);
+		return;
+	}
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(threads) schedule(static)
+#endif
+	for (int a = 0; a < b->nb_arrays; a++) {
+#ifdef _OPENMP
+		int t = omp_get_thread_num();
+#else
+		int t = 0;
+#endif
+		const float *src = b->src + (size_t) a * b->n;
+		switch (b->variant) {
+		case SORTNET:
+			for (size_t i = 0; i < b->n; i++)
+				b->work_ushort[t][i] = (WORD) (src[i] * USHRT_MAX_SINGLE);
+			sortnet_median(b->work_ushort[t], b->n);
+			break;
+		case HISTOGRAM:
+			memcpy(b->work[t], src, b->n * sizeof(float));
+			histogram_median_float(b->work[t], b->n, SINGLE_THREADED);
+			break;
+		default:
+			memcpy(b->work[t], src, b->n * sizeof(float));
+			quickmedian_float(b->work[t], b->n);
+		}
+	}
+}
+
+static void bench_medians() {
+	static const struct { enum median_variant variant; const char *kernel; size_t min_size, max_size; } variants[] = {
+		{ QUICKMEDIAN, "quickmedian_float", 0, G_MAXSIZE },
+		{ HISTOGRAM, "histogram_median_float", 1024, G_MAXSIZE },
+		{ SORTNET, "sortnet_median", 0, 9 }
+	};
+	static const size_t sizes[] = { 5, 9, 64, 1024, 1 << 20, 1 << 24 };
+	int max_threads = thread_counts[nb_thread_counts - 1];
+
+	for (int v = 0; v < G_N_ELEMENTS(variants); v++) {
+		if (!kernel_selected(variants[v].kernel))
+			continue;
+		for (int s = 0; s < G_N_ELEMENTS(sizes); s++) {
+			size_t n = sizes[s];
+			if (n < variants[v].min_size || n > variants[v].max_size)
+				continue;
+			struct median_bench b = { variants[v].variant, n, (int) MAX(1, (1 << 20) / n), NULL, NULL, NULL };
+			b.src = malloc(n * b.nb_arrays * sizeof(float));
+			for (size_t i = 0; i < n * b.nb_arrays; i++)
+				b.src[i] = (float) uniform();
+			b.work = malloc(max_threads * sizeof(float *));
+			b.work_ushort = malloc(max_threads * sizeof(WORD *));
+			for (int t = 0; t < max_threads; t++) {
+				b.work[t] = malloc(n * sizeof(float));
+				b.work_ushort[t] = malloc(n * sizeof(WORD));
+			}
+			gchar *size = g_strdup_printf("%zu", n);
+			for (int t = 0; t < nb_thread_counts; t++) {
+				// the quick select of a single array is not threaded
+				if (b.nb_arrays == 1 && b.variant == QUICKMEDIAN && t > 0)
+					break;
+				measure(variants[v].kernel, b.nb_arrays == 1 ? "single" : "batch", size,
+						(double) n * b.nb_arrays, median_kernel, &b, thread_counts[t]);
+			}
+			g_free(size);
+			for (int t = 0; t < max_threads; t++) {
+				free(b.work[t]);
+				free(b.work_ushort[t]);
+			}
+			free(b.work);
+			free(b.work_ushort);
+			free(b.src);
+		}
+	}
+}
+
+/****************************** PSF fitting ******************************/
+
+#define PSF_STARS 256
+
+struct psf_bench {
+	gsl_matrix *boxes[PSF_STARS];
+	starprofile profile;
+};
+
+static void psf_kernel(void *user, int threads) {
+	struct psf_bench *b = (struct psf_bench *) user;
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(threads) schedule(dynamic)
+#endif
+	for (int s = 0; s < PSF_STARS; s++) {
+		psf_error error;
+		psf_star *psf = psf_global_minimisation(b->boxes[s], 0.05, 1.0, 1, FALSE, FALSE, NULL, FALSE, b->profile, &error);
+		free_psf(psf);
+	}
+}
+
+static void bench_psf() {
+	const char *kernel = "psf_global_minimisation";
+	if (!kernel_selected(kernel))
+		return;
+	static const int radii[] = { 5, 10, 15 };
+	static const struct { starprofile profile; const char *name; } profiles[] = {
+		{ PSF_GAUSSIAN, "gaussian" },
+		{ PSF_MOFFAT_BFREE, "moffat" }
+	};
+	for (int r = 0; r < G_N_ELEMENTS(radii); r++) {
+		struct psf_bench b;
+		int side = 2 * radii[r] + 1;
+		for (int s = 0; s < PSF_STARS; s++) {
+			b.boxes[s] = gsl_matrix_alloc(side, side);
+			double xc = radii[r] + uniform() - 0.5, yc = radii[r] + uniform() - 0.5;
+			double sigma = 1.0 + uniform(), amplitude = 0.1 + 0.5 * uniform();
+			for (int y = 0; y < side; y++)
+				for (int x = 0; x < side; x++)
+					gsl_matrix_set(b.boxes[s], y, x, 0.05 + 0.002 * gaussian() + amplitude *
+							exp(-0.5 * ((x - xc) * (x - xc) + (y - yc) * (y - yc)) / (sigma * sigma)));
+		}
+		gchar *size = g_strdup_printf("%dx%d", side, side);
+		for (int p = 0; p < G_N_ELEMENTS(profiles); p++) {
+			b.profile = profiles[p].profile;
+			for (int t = 0; t < nb_thread_counts; t++)
+				measure(kernel, profiles[p].name, size, PSF_STARS, psf_kernel, &b, thread_counts[t]);
+		}
+		g_free(size);
+		for (int s = 0; s < PSF_STARS; s++)
+			gsl_matrix_free(b.boxes[s]);
+	}
+}
+
+/***************************** image kernels *****************************/
+
+static const struct { int rx, ry; const char *name; } image_sizes[] = {
+	{ 1024, 1024, "1024x1024" },
+	{ 4096, 3072, "4096x3072" }
+};
+
+struct image_bench {
+	fits *fit;
+	float *cfa;	// for the debayer
+	float *work;
+	int interpolation;
+};
+
+static void peaker_kernel(void *user, int threads) {
+	struct image_bench *b = (struct image_bench *) user;
+	image im = { .fit = b->fit, .from_seq = NULL, .index_in_seq = -1 };
+	int nb_stars;
+	// the statistics would be reused from the previous call
+	invalidate_stats_from_fit(b->fit);
+	psf_star **stars = peaker(&im, 0, &com.pref.starfinder_conf, &nb_stars, NULL, FALSE, FALSE, 0, PSF_GAUSSIAN, threads);
+	free_fitted_stars(stars);
+}
+
+static void blur_kernel(void *user, int threads) {
+	struct image_bench *b = (struct image_bench *) user;
+	gaussian_blur_RT(b->fit, b->interpolation, threads);
+}
+
+/* the transformation is done in place, the image is transformed again at each
+ * call, which does not change the amount of work */
+static void transform_kernel(void *user, int threads) {
+	struct image_bench *b = (struct image_bench *) user;
+	Homography H;
+	cvGetEye(&H);
+	H.h00 = H.h11 = cos(0.01);
+	H.h01 = -sin(0.01);
+	H.h10 = sin(0.01);
+	H.h02 = 2.3;
+	H.h12 = -1.7;
+	cvTransformImage(b->fit, b->fit->rx, b->fit->ry, H, 1.f, b->interpolation, TRUE, NULL);
+}
+
+/* the input is normalized in place by the debayer, so it is copied first */
+static void debayer_kernel(void *user, int threads) {
+	struct image_bench *b = (struct image_bench *) user;
+	int rx = b->fit->rx, ry = b->fit->ry;
+	memcpy(b->work, b->cfa, (size_t) rx * ry * sizeof(float));
+	float *rgb = debayer_buffer_new_float(b->work, &rx, &ry, b->interpolation, BAYER_FILTER_RGGB, NULL);
+	free(rgb);
+}
+
+static void bench_images() {
+	for (int s = 0; s < G_N_ELEMENTS(image_sizes); s++) {
+		struct image_bench b = { 0 };
+		const char *size = image_sizes[s].name;
+		double nbpix = (double) image_sizes[s].rx * image_sizes[s].ry;
+		b.fit = make_star_field(image_sizes[s].rx, image_sizes[s].ry, 1);
+		if (!b.fit)
+			return;
+
+		if (kernel_selected("peaker")) {
+			for (int t = 0; t < nb_thread_counts; t++)
+				measure("peaker", "gaussian", size, nbpix, peaker_kernel, &b, thread_counts[t]);
+		}
+
+		if (kernel_selected("gaussian_blur_RT")) {
+			static const int sigmas[] = { 1, 5 };
+			for (int i = 0; i < G_N_ELEMENTS(sigmas); i++) {
+				gchar *variant = g_strdup_printf("sigma=%d", sigmas[i]);
+				b.interpolation = sigmas[i];
+				for (int t = 0; t < nb_thread_counts; t++)
+					measure("gaussian_blur_RT", variant, size, nbpix, blur_kernel, &b, thread_counts[t]);
+				g_free(variant);
+			}
+		}
+
+		if (kernel_selected("cvTransformImage")) {
+			static const struct { int interpolation; const char *name; } interpolations[] = {
+				{ OPENCV_NEAREST, "nearest" },
+				{ OPENCV_LINEAR, "linear" },
+				{ OPENCV_CUBIC, "cubic" },
+				{ OPENCV_LANCZOS4, "lanczos4" },
+				{ OPENCV_AREA, "area" }
+			};
+			for (int i = 0; i < G_N_ELEMENTS(interpolations); i++) {
+				b.interpolation = interpolations[i].interpolation;
+				for (int t = 0; t < nb_thread_counts; t++)
+					measure("cvTransformImage", interpolations[i].name, size, nbpix, transform_kernel, &b, thread_counts[t]);
+			}
+		}
+
+		if (kernel_selected("debayer_buffer_new_float")) {
+			static const struct { interpolation_method method; const char *name; } methods[] = {
+				{ BAYER_BILINEAR, "bilinear" },
+				{ BAYER_VNG, "vng" },
+				{ BAYER_AMAZE, "amaze" },
+				{ BAYER_RCD, "rcd" },
+				{ BAYER_SUPER_PIXEL, "superpixel" }
+			};
+			size_t n = (size_t) image_sizes[s].rx * image_sizes[s].ry;
+			b.cfa = malloc(n * sizeof(float));
+			b.work = malloc(n * sizeof(float));
+			for (size_t i = 0; i < n; i++) {
+				int x = i % image_sizes[s].rx, y = i / image_sizes[s].rx;
+				// the green pixels of the RGGB pattern see more sky
+				b.cfa[i] = b.fit->fdata[i] * (((x + y) & 1) ? 1.2f : 0.8f);
+			}
+			for (int i = 0; i < G_N_ELEMENTS(methods); i++) {
+				b.interpolation = methods[i].method;
+				for (int t = 0; t < nb_thread_counts; t++)
+					measure("debayer_buffer_new_float", methods[i].name, size, nbpix, debayer_kernel, &b, thread_counts[t]);
+			}
+			free(b.cfa);
+			free(b.work);
+		}
+
+		clearfits(b.fit);
+		free(b.fit);
+	}
+}
+
+static void parse_threads(const char *list) {
+	gchar **tokens = g_strsplit(list, ",", -1);
+	nb_thread_counts = 0;
+	thread_counts = realloc(thread_counts, g_strv_length(tokens) * sizeof(int));
+	for (int i = 0; tokens[i]; i++) {
+		int n = atoi(tokens[i]);
+		if (n > 0)
+			thread_counts[nb_thread_counts++] = n;
+	}
+	g_strfreev(tokens);
+}
+
+static int compare_ints(const void *a, const void *b) {
+	return *(const int *) a - *(const int *) b;
+}
+
+int main(int argc, char **argv) {
+	initialize_default_settings();
+	com.headless = TRUE;
+	com.script = TRUE;
+	int max_threads = g_get_num_processors();
+
+	for (int i = 1; i < argc; i++) {
+		if (g_str_has_prefix(argv[i], "-filter="))
+			filter = argv[i] + 8;
+		else if (g_str_has_prefix(argv[i], "-threads="))
+			parse_threads(argv[i] + 9);
+		else if (g_str_has_prefix(argv[i], "-mintime="))
+			min_time_us = (gint64) (g_ascii_strtod(argv[i] + 9, NULL) * 1e6);
+		else if (!strcmp(argv[i], "-json"))
+			json_output = TRUE;
+		else {
+			fprintf(stderr, "Usage: %s [-filter=name] [-threads=1,4,...] [-mintime=seconds] [-json]\n", argv[0]);
+			return 1;
+		}
+	}
+	if (nb_thread_counts == 0) {
+		thread_counts = malloc(2 * sizeof(int));
+		thread_counts[nb_thread_counts++] = 1;
+		if (max_threads > 1)
+			thread_counts[nb_thread_counts++] = max_threads;
+	}
+	// the buffers are allocated for the largest number of threads
+	qsort(thread_counts, nb_thread_counts, sizeof(int), compare_ints);
+
+	bench_rejection();
+	bench_medians();
+	bench_psf();
+	bench_images();
+
+	free(thread_counts);
+	return 0;
+}
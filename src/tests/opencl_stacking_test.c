@@ -0,0 +1,146 @@
+/*
+ * This file is part of Siril, an astronomy image processor.
+ * Copyright (C) 2005-2011 Francois Meyer (dulle at free.fr)
+ * Copyright (C) 2012-2025 team free-astro (see more in AUTHORS file)
+ * Reference site is https://siril.org
+ *
+ * Siril is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Siril is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Siril. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Compares the stacking of a block on the OpenCL device with the per-pixel
+ * rejection of the CPU, on a synthetic stack. The tests are skipped when no
+ * OpenCL device can run the kernel. The kernel computes in single precision
+ * and its MAD is an exact median, so the results are compared with a
+ * tolerance and the MAD rejection counts are not compared.
+ */
+
+#include <criterion/criterion.h>
+
+#include "core/siril.h"
+#include "algos/sorting.h"
+#include "stacking/stacking.h"
+#include "opencv/opencl_stacking.h"
+
+cominfo com;	// the core data struct
+guiinfo gui;	// the gui data struct
+fits gfit;	// currently loaded image
+
+#define BLOCK_RX 16
+#define BLOCK_HEIGHT 2
+#define BLOCK_PIXELS (BLOCK_RX * BLOCK_HEIGHT)
+
+static float set1[] = { 145, 125, 190, 135, 220, 130, 210, 3, 165, 165, 150, 350, 170, 180, 195, 440, 215, 135, 410, 40, 140, 175 };
+
+static float set2[] = { 7.7110e-2f, 4.7330e-1f, 5.7340e-1f, 3.3310e-1f, 5.3160e-1f, 3.6550e-1f, 3.1900e-1f, 3.4650e-1f, 2.2340e-1f, 5.3680e-1f, 4.8200e-1f, 4.8150e-1f, 2.5420e-1f, 7.3770e-1f, 6.6930e-1f, 3.8980e-1f, 5.8780e-1f, 6.6680e-1f, 6.9580e-1f, 3.6260e-1f, 7.1870e-1f, 2.6420e-1f, 5.2890e-1f, 6.1350e-1f, 2.4980e-1f, 2.7930e-1f, 7.9300e-1f, 6.6690e-1f, 5.9180e-1f, 6.5240e-1f, 8.4440e-2f, 8.1500e-1f, 3.5880e-1f, 3.7450e-1f, 5.6660e-1f, 2.5050e-1f, 5.6520e-1f, 4.6880e-1f, 9.7020e-2f, 4.9380e-1 };
+
+static void skip_without_device() {
+	com.pref.opencl_stacking = TRUE;
+	if (!opencl_stacking_available())
+		cr_skip_test("no OpenCL device can run the stacking kernel\n");
+}
+
+/* the stack of a pixel is a rotation of the set, different for each pixel */
+static float pixel_value(const float *set, int size, int frame, int pixel) {
+	return set[(frame + pixel) % size];
+}
+
+static void device_compare(const float *set, int size, rejection type, float sig[2], gboolean is_mean) {
+	float *pix = malloc((size_t) size * BLOCK_PIXELS * sizeof(float));
+	int *shiftx = calloc(size, sizeof(int));
+	float *scale = malloc(size * sizeof(float));
+	float *offset = calloc(size, sizeof(float));
+	for (int frame = 0; frame < size; frame++) {
+		scale[frame] = 1.f;
+		for (int p = 0; p < BLOCK_PIXELS; p++)
+			pix[(size_t) frame * BLOCK_PIXELS + p] = pixel_value(set, size, frame, p);
+	}
+	struct opencl_stack_block block = {
+		.pix = pix,
+		.frame_stride = BLOCK_PIXELS,
+		.nb_frames = size,
+		.rx = BLOCK_RX,
+		.height = BLOCK_HEIGHT,
+		.shiftx = shiftx,
+		.scale = scale,
+		.offset = offset,
+		.weights = NULL,
+		.type_of_rejection = type,
+		.sig = { sig[0], sig[1] },
+		.is_mean = is_mean
+	};
+	float results[BLOCK_PIXELS];
+	int rej[2 * BLOCK_PIXELS];
+	cr_assert_eq(opencl_stack_block(&block, results, rej), 0);
+
+	struct stacking_args args = { 0 };
+	struct _data_block data = { 0 };
+	args.type_of_rejection = type;
+	args.sig[0] = sig[0];
+	args.sig[1] = sig[1];
+	float *stack = malloc(size * sizeof(float));
+	data.stack = stack;
+	data.o_stack = malloc(size * sizeof(float));
+	data.w_stack = malloc(size * sizeof(float));
+	data.rejected = malloc(size * sizeof(int));
+	const float tolerance = type == MAD ? 1e-3f : 1e-4f;
+	for (int p = 0; p < BLOCK_PIXELS; p++) {
+		for (int frame = 0; frame < size; frame++)
+			stack[frame] = pixel_value(set, size, frame, p);
+		float expected;
+		if (is_mean) {
+			int crej[2] = { 0, 0 };
+			int kept = apply_rejection_float(&data, size, &args, crej);
+			double sum = 0.0;
+			for (int i = 0; i < kept; i++)
+				sum += stack[i];
+			expected = kept ? (float) (sum / kept) : 0.f;
+			if (type != MAD) {
+				cr_expect_eq(rej[2 * p], crej[0], "pixel %d: %d low rejections instead of %d", p, rej[2 * p], crej[0]);
+				cr_expect_eq(rej[2 * p + 1], crej[1], "pixel %d: %d high rejections instead of %d", p, rej[2 * p + 1], crej[1]);
+			}
+		} else {
+			expected = (float) quickmedian_float(stack, size);
+		}
+		cr_expect_float_eq(results[p], expected, tolerance * fabsf(expected),
+				"pixel %d: %g on the device, %g on the CPU", p, results[p], expected);
+	}
+	free(pix);
+	free(shiftx);
+	free(scale);
+	free(offset);
+	free(stack);
+	free(data.o_stack);
+	free(data.w_stack);
+	free(data.rejected);
+}
+
+Test(opencl_stacking, median) {
+	skip_without_device();
+	float sig[] = { 0.f, 0.f };
+	device_compare(set1, G_N_ELEMENTS(set1), NO_REJEC, sig, FALSE);
+	device_compare(set2, G_N_ELEMENTS(set2), NO_REJEC, sig, FALSE);
+}
+
+Test(opencl_stacking, rejection) {
+	skip_without_device();
+	float sig[] = { 0.3f, 0.4f };
+	device_compare(set1, G_N_ELEMENTS(set1), PERCENTILE, sig, TRUE);
+	sig[0] = 2.5f; sig[1] = 2.5f;
+	device_compare(set2, G_N_ELEMENTS(set2), SIGMA, sig, TRUE);
+	device_compare(set1, G_N_ELEMENTS(set1), SIGMA, sig, TRUE);
+	device_compare(set2, G_N_ELEMENTS(set2), MAD, sig, TRUE);
+	sig[0] = 1.5f; sig[1] = 1.5f;
+	device_compare(set2, G_N_ELEMENTS(set2), SIGMA, sig, TRUE);
+	device_compare(set2, G_N_ELEMENTS(set2), NO_REJEC, sig, TRUE);
+}
@@ -227,5 +227,51 @@ void test_photometry_ushort() {
 	free_psf(psf);
 }
 
+/* the star detection fits with psf_solver instead of GSL, the solution must
+ * be the same within the solver tolerance */
+void test_psf_solver() {
+	double bg = BG;
+	gsl_matrix *matrix = fill_star(star, DATA_FLOAT);
+	psf_error error;
+	psf_star *psf = psf_global_minimisation(matrix, bg, 1., 1, TRUE, FALSE, NULL, FALSE, PSF_GAUSSIAN, &error);
+
+	cr_assert(psf, "psf failed");
+	cr_assert(error == PSF_NO_ERR, "error was set");
+
+	cr_expect_float_eq(psf->x0, 51.27f, 2e-2, "x0: Value was %.7f vs %.7f at %3.1e\n", psf->x0, 51.27f, 2e-2);
+	cr_expect_float_eq(psf->y0, 54.24f, 2e-2, "y0: Value was %.7f vs %.7f at %3.1e\n", psf->y0, 54.24f, 2e-2);
+	cr_expect_float_eq(psf->fwhmx, 8.161f, 5e-2, "FWHMx: Value was %.7f vs %.7f at %3.1e\n", psf->fwhmx, 8.161f, 5e-2);
+	cr_expect_float_eq(psf->fwhmy, 7.250f, 5e-2, "FWHMy: Value was %.7f vs %.7f at %3.1e\n", psf->fwhmy, 7.250f, 5e-2);
+	cr_expect_float_eq(psf->A, 0.3293f, 1e-3, "A: Value was %.7f vs %.7f at %3.1e\n", psf->A, 0.3293f, 1e-3);
+	cr_expect_float_eq(psf->rmse, 2.250e-03, 1e-4, "RMSE: Value was %.7f vs %.7f at %3.1e\n", psf->rmse, 2.250e-03, 1e-4);
+
+	gsl_matrix_free(matrix);
+	free_psf(psf);
+}
+
+/* the batched fit must give the same result in every lane */
+void test_psf_solver_batch() {
+	gsl_matrix *z[3];
+	double sat[3] = { 1., 1., 1. };
+	psf_star *psf[3];
+	psf_error error[3];
+	for (int l = 0; l < 3; l++)
+		z[l] = fill_star(star, DATA_FLOAT);
+	psf_global_minimisation_batch(z, 3, BG, sat, 1, PSF_GAUSSIAN, psf, error);
+
+	for (int l = 0; l < 3; l++) {
+		cr_assert(psf[l], "psf failed in lane %d", l);
+		cr_expect(error[l] == PSF_NO_ERR, "error was set in lane %d", l);
+		cr_expect_float_eq(psf[l]->x0, 51.27f, 2e-2, "x0: Value was %.7f vs %.7f at %3.1e\n", psf[l]->x0, 51.27f, 2e-2);
+		cr_expect_float_eq(psf[l]->y0, 54.24f, 2e-2, "y0: Value was %.7f vs %.7f at %3.1e\n", psf[l]->y0, 54.24f, 2e-2);
+		cr_expect_float_eq(psf[l]->fwhmx, 8.161f, 5e-2, "FWHMx: Value was %.7f vs %.7f at %3.1e\n", psf[l]->fwhmx, 8.161f, 5e-2);
+		cr_expect_float_eq(psf[l]->fwhmy, 7.250f, 5e-2, "FWHMy: Value was %.7f vs %.7f at %3.1e\n", psf[l]->fwhmy, 7.250f, 5e-2);
+		gsl_matrix_free(z[l]);
+		free_psf(psf[l]);
+	}
+}
+
 Test(science, psf_float) { test_photometry_float(); }
 Test(science, psf_ushort) { test_photometry_ushort(); }
+Test(science, psf_solver) { test_psf_solver(); }
+Test(science, psf_solver_batch) { test_psf_solver_batch(); }
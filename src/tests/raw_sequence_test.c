@@ -0,0 +1,175 @@
+/*
+ * This file is part of Siril, an astronomy image processor.
+ * Copyright (C) 2005-2011 Francois Meyer (dulle at free.fr)
+ * Copyright (C) 2012-2025 team free-astro (see more in AUTHORS file)
+ * Reference site is https://siril.org
+ *
+ * Siril is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Siril is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Siril. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Tests of the cache of the decoded frames of RAW sequences. The frames are
+ * made by a fake decoder that counts its calls and takes some time, so that
+ * the readers of a frame being decoded have to wait for it. */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+#include <criterion/criterion.h>
+#include <string.h>
+#include <glib.h>
+#include "core/siril.h"
+#include "io/image_format_fits.h"
+#include "io/raw_sequence.h"
+
+cominfo com;	// the core data struct
+guiinfo gui;	// the gui data struct
+fits gfit;	// currently loaded image
+
+#ifdef HAVE_LIBRAW
+
+#define WIDTH 64
+#define HEIGHT 32
+#define NB_FRAMES 4
+#define NB_READERS 8
+
+static sequence seq;
+static gint decodes[NB_FRAMES], header_reads[NB_FRAMES], verbose_decodes;
+static gint decoding_now[NB_FRAMES], concurrent_decodes;
+
+static WORD pixel_value(int index, int row) {
+	return (WORD) (index * 1000 + row);
+}
+
+static int fake_decode(sequence *s, int index, fits *fit, gboolean header_only, gboolean verbose) {
+	if (header_only) {
+		g_atomic_int_inc(&header_reads[index]);
+		fit->rx = fit->naxes[0] = WIDTH;
+		fit->ry = fit->naxes[1] = HEIGHT;
+		fit->naxes[2] = 1;
+		fit->naxis = 2;
+		fit->type = DATA_USHORT;
+		fit->bitpix = fit->orig_bitpix = USHORT_IMG;
+		return 0;
+	}
+	if (g_atomic_int_add(&decoding_now[index], 1) > 0)
+		g_atomic_int_inc(&concurrent_decodes);
+	g_atomic_int_inc(&decodes[index]);
+	if (verbose)
+		g_atomic_int_inc(&verbose_decodes);
+	g_usleep(20000);
+
+	fits *frame = NULL;
+	cr_assert(!new_fit_image(&frame, WIDTH, HEIGHT, 1, DATA_USHORT));
+	/* rows are stored bottom-up */
+	for (int y = 0; y < HEIGHT; y++)
+		for (int x = 0; x < WIDTH; x++)
+			frame->data[(size_t) (HEIGHT - 1 - y) * WIDTH + x] = pixel_value(index, y);
+	memcpy(fit, frame, sizeof(fits));
+	free(frame);
+	g_atomic_int_add(&decoding_now[index], -1);
+	return 0;
+}
+
+static void setup() {
+	memset(&seq, 0, sizeof(sequence));
+	seq.type = SEQ_RAW;
+	seq.seqname = "raw_";
+	seq.number = NB_FRAMES;
+	seq.rx = WIDTH;
+	seq.ry = HEIGHT;
+	seq.nb_layers = 1;
+	seq.raw_file = raw_sequence_new("cr2", NB_FRAMES);
+	cr_assert_not_null(seq.raw_file);
+	seq.raw_file->decode = fake_decode;
+	memset(decodes, 0, sizeof(decodes));
+	memset(header_reads, 0, sizeof(header_reads));
+	memset(decoding_now, 0, sizeof(decoding_now));
+	verbose_decodes = concurrent_decodes = 0;
+}
+
+static void teardown() {
+	raw_sequence_free(seq.raw_file);
+	seq.raw_file = NULL;
+}
+
+/* reads the rows y to y + 3 of frame index and checks them */
+static void check_read(int index, int y) {
+	WORD buffer[4 * WIDTH];
+	rectangle area = { 0, y, WIDTH, 4 };
+	cr_assert(!raw_sequence_read_partial(&seq, 0, index, buffer, &area));
+	for (int i = 0; i < 4; i++) {
+		cr_expect_eq(buffer[i * WIDTH], pixel_value(index, y + i), "frame %d row %d", index, y + i);
+		cr_expect_eq(buffer[i * WIDTH + WIDTH - 1], pixel_value(index, y + i));
+	}
+}
+
+static gpointer reader(gpointer p) {
+	int first = GPOINTER_TO_INT(p);
+	/* the blocks of rows of all frames, starting from different frames */
+	for (int y = 0; y < HEIGHT; y += 8)
+		for (int n = 0; n < NB_FRAMES; n++)
+			check_read((first + n) % NB_FRAMES, y);
+	return NULL;
+}
+
+static void run_readers() {
+	GThread *threads[NB_READERS];
+	for (int i = 0; i < NB_READERS; i++)
+		threads[i] = g_thread_new("reader", reader, GINT_TO_POINTER(i % 2));
+	for (int i = 0; i < NB_READERS; i++)
+		g_thread_join(threads[i]);
+}
+
+Test(raw_sequence, cached_frames_decoded_once, .init = setup, .fini = teardown) {
+	raw_sequence_set_cache_size(seq.raw_file, (gint64) NB_FRAMES * WIDTH * HEIGHT * sizeof(WORD));
+	run_readers();
+	for (int i = 0; i < NB_FRAMES; i++)
+		cr_expect_eq(decodes[i], 1, "frame %d decoded %d times", i, decodes[i]);
+	cr_expect_eq(concurrent_decodes, 0, "the readers wait for the frame being decoded");
+	cr_expect_eq(verbose_decodes, NB_FRAMES, "the decodes for the cache are logged");
+	cr_expect_eq(seq.raw_file->used_bytes, (gint64) NB_FRAMES * WIDTH * HEIGHT * sizeof(WORD));
+}
+
+Test(raw_sequence, uncached_frames_decoded_silently, .init = setup, .fini = teardown) {
+	/* room for one frame only */
+	raw_sequence_set_cache_size(seq.raw_file, (gint64) WIDTH * HEIGHT * sizeof(WORD));
+	for (int y = 0; y < HEIGHT; y += 8)
+		for (int n = 0; n < 2; n++)
+			check_read(n, y);
+	cr_expect_eq(decodes[0], 1);
+	cr_expect_eq(decodes[1], HEIGHT / 8, "decoded for each block");
+	cr_expect_eq(verbose_decodes, 1, "only the decode of the cached frame is logged");
+	cr_expect(seq.raw_file->warned);
+}
+
+Test(raw_sequence, metadata_from_header, .init = setup, .fini = teardown) {
+	raw_sequence_set_cache_size(seq.raw_file, (gint64) NB_FRAMES * WIDTH * HEIGHT * sizeof(WORD));
+	fits fit = { 0 };
+	cr_assert(!raw_sequence_read_metadata(&seq, 0, &fit));
+	cr_expect_eq(fit.rx, WIDTH);
+	cr_expect_eq(fit.ry, HEIGHT);
+	cr_expect_null(fit.data);
+	cr_expect_eq(header_reads[0], 1);
+	cr_expect_eq(decodes[0], 0, "the metadata are read without decoding");
+	clearfits(&fit);
+
+	check_read(1, 0);
+	cr_assert(!raw_sequence_read_metadata(&seq, 1, &fit));
+	cr_expect_eq(fit.rx, WIDTH);
+	cr_expect_eq(header_reads[1], 0, "the metadata of a cached frame are taken from it");
+	cr_expect_eq(decodes[1], 1);
+	clearfits(&fit);
+}
+
+#endif
@@ -68,40 +68,36 @@ static float calculate_critical_value(int size, float alpha) {
 	return numerator / denominator;
 }
 
-static float ESD_test(float *stack, int size, float alpha, int max_outliers) {
+/* the outliers are given in the order they are tested, nb_out being the
+ * number of confirmed outliers */
+static float ESD_test(float *stack, int size, float alpha, int max_outliers,
+		const float *expected_x, const int *expected_i, int nb_out, const int expected_count[2]) {
 	struct ESD_outliers *out = malloc(max_outliers * sizeof(struct ESD_outliers));
 
 	quicksort_f(stack, size);
 	double median = gsl_stats_float_median_from_sorted_data(stack, 1, size);
-	float *w_stack = duplicate(stack, size);
 	int *rejected = calloc(size, sizeof(int));
-	int w_size = size;
-	int cold = 0;
-
-	for (int iter = 0; iter < max_outliers; iter++) {
-		float Gstat, Gcritical;
-		int max_index = 0;
-
-		Gcritical = calculate_critical_value(w_size, alpha);
-		grubbs_stat(w_stack, w_size, &Gstat, &max_index);
-		out[iter].out = check_G_values(Gstat, Gcritical);
-		out[iter].x = w_stack[max_index];
-		out[iter].i = (max_index == 0) ? cold++ : max_index;
-		remove_element(w_stack, max_index, w_size);
-		w_size--;
-	}
+	float *critical_value = malloc(max_outliers * sizeof(float));
+	for (int iter = 0; iter < max_outliers; iter++)
+		critical_value[iter] = calculate_critical_value(size - iter, alpha);
+
+	grubbs_outliers(stack, size, median, critical_value, max_outliers, out);
 	int count[2] = { 0, 0 };
 	confirm_outliers(out, max_outliers, median, rejected, count);
 	//print_outliers(out, max_outliers);
 
-	cr_expect_eq(count[0], 2);
-	cr_expect_eq(count[1], 3);
+	cr_expect_eq(count[0], expected_count[0]);
+	cr_expect_eq(count[1], expected_count[1]);
 
-	cr_expect_float_eq(out[0].x, 440.0f, 1e-6);
-	cr_expect_float_eq(out[1].x, 410.0f, 1e-6);
-	cr_expect_float_eq(out[2].x, 350.0f, 1e-6);
-	cr_expect_float_eq(out[3].x, 3.000f, 1e-6);
-	cr_expect_float_eq(out[4].x, 40.00f, 1e-6);
+	for (int k = 0; k < nb_out; k++) {
+		cr_expect_float_eq(out[k].x, expected_x[k], 1e-6, "outlier %d", k);
+		cr_expect_eq(out[k].i, expected_i[k], "index of outlier %d", k);
+		cr_expect(out[k].out, "outlier %d confirmed", k);
+		cr_expect_eq(rejected[expected_i[k]], expected_x[k] >= median ? 1 : -1,
+				"rejection flag of outlier %d", k);
+	}
+	for (int k = nb_out; k < max_outliers; k++)
+		cr_expect(!out[k].out, "candidate %d not confirmed", k);
 
 	int kept = 0;
 	double sum = 0.0;
@@ -112,15 +108,33 @@ static float ESD_test(float *stack, int size, float alpha, int max_outliers) {
 		}
 		//else printf("rejected %f\n", stack[frame]);
 	}
+	cr_expect_eq(kept, size - nb_out);
+	free(out);
+	free(rejected);
+	free(critical_value);
 	return sum / kept;
 }
 
 void test_GESDT_float() {
-	float mean = ESD_test(set1, G_N_ELEMENTS(set1), 0.05, 7);
+	const float x[] = { 440.0f, 410.0f, 350.0f, 3.0f, 40.0f };
+	const int i[] = { 21, 20, 19, 0, 1 };
+	const int count[] = { 2, 3 };
+	float mean = ESD_test(set1, G_N_ELEMENTS(set1), 0.05, 7, x, i, G_N_ELEMENTS(x), count);
 	cr_expect_float_eq(mean, 167.352936, 1e-6);
 }
 
+/* the low outlier deviates the most and is tested before the high ones */
+void test_GESDT_cold_first_float() {
+	float stack[] = { 101, 98, 160, 100, 102, 10, 99, 103, 97, 100, 150, 101, 99, 100, 98, 102 };
+	const float x[] = { 10.0f, 160.0f, 150.0f };
+	const int i[] = { 0, 15, 14 };
+	const int count[] = { 1, 2 };
+	float mean = ESD_test(stack, G_N_ELEMENTS(stack), 0.05, 4, x, i, G_N_ELEMENTS(x), count);
+	cr_expect_float_eq(mean, 100.0f, 1e-6);
+}
+
 Test(rejection, GESDT) { test_GESDT_float(); }
+Test(rejection, GESDT_cold_first) { test_GESDT_cold_first_float(); }
 
 /* NO_REJEC, PERCENTILE, SIGMA, MAD, SIGMEDIAN, WINSORIZED, LINEARFIT, GESDT */
 
@@ -162,23 +176,20 @@ Test(rejection, percentile) { test_percentile_float(); }
 
 
 static float linearfit_test(float *stack, int size, float sig[2], int rej[2]) {
-	float *xf = malloc(sizeof(float) * size);
 	float m_x = (size - 1) * 0.5f;
 	float m_dx2 = 0.f;
 	for (int j = 0; j < size; ++j) {
 		const float dx = j - m_x;
-		xf[j] = 1.f / (j + 1);
-		m_dx2 += (dx * dx - m_dx2) * xf[j];
+		m_dx2 += (dx * dx - m_dx2) / (j + 1);
 	}
 	m_dx2 = 1.f / m_dx2;
 	int *rejected = calloc(size, sizeof(int));
 
 	int changed, r = 0, N = size;
+	quicksort_f(stack, N);
 	do {
-		quicksort_f(stack, N);
-
 		float a, b;
-		siril_fit_linear(xf, stack, m_x, m_dx2, N, &b, &a);
+		siril_fit_linear_float(stack, m_x, m_dx2, N, &b, &a);
 		float sigma = 0.f;
 		for (int frame = 0; frame < N; frame++)
 			sigma += fabsf(stack[frame] - (a * frame + b));
@@ -232,3 +243,69 @@ static void test_linearfit_float() {
 
 Test(rejection, linearfit) { test_linearfit_float(); }
 
+
+/* the batched rejection must give the same results as the per-pixel one, each
+ * lane is filled with a rotation of the set to get different stacks */
+static void batch_compare(const float *set, int size, rejection type, float sig[2]) {
+	struct stacking_args args = { 0 };
+	struct _data_block data = { 0 };
+	double results[STACK_BATCH_SIZE];
+	int rej[STACK_BATCH_SIZE][2];
+
+	args.type_of_rejection = type;
+	args.sig[0] = sig[0];
+	args.sig[1] = sig[1];
+	data.batch = malloc(size * STACK_BATCH_SIZE * sizeof(float));
+	data.batch_keep = malloc(size * STACK_BATCH_SIZE);
+	data.stack = malloc(size * sizeof(float));
+	data.o_stack = malloc(size * sizeof(float));
+	data.rejected = malloc(size * sizeof(int));
+	for (int frame = 0; frame < size; frame++)
+		for (int l = 0; l < STACK_BATCH_SIZE; l++)
+			data.batch[frame * STACK_BATCH_SIZE + l] = set[(frame + l) % size];
+
+	apply_rejection_float_batch(&data, size, &args, results, rej);
+
+	for (int l = 0; l < STACK_BATCH_SIZE; l++) {
+		int crej[2] = { 0, 0 };
+		float *stack = (float *) data.stack;
+		for (int frame = 0; frame < size; frame++)
+			stack[frame] = set[(frame + l) % size];
+		int kept = apply_rejection_float(&data, size, &args, crej);
+		float mean = compute_mean(stack, kept);
+		cr_expect_eq(rej[l][0], crej[0]);
+		cr_expect_eq(rej[l][1], crej[1]);
+		cr_expect_float_eq(results[l], mean, 1e-5);
+	}
+	free(data.batch);
+	free(data.batch_keep);
+	free(data.stack);
+	free(data.o_stack);
+	free(data.rejected);
+}
+
+static void test_batch_float_level() {
+	float sig[] = { 0.3f, 0.4f };
+	batch_compare(set1, G_N_ELEMENTS(set1), PERCENTILE, sig);
+	sig[0] = 2.5f; sig[1] = 2.5f;
+	batch_compare(set2, G_N_ELEMENTS(set2), SIGMA, sig);
+	batch_compare(set1, G_N_ELEMENTS(set1), SIGMA, sig);
+	batch_compare(set2, G_N_ELEMENTS(set2), MAD, sig);
+	sig[0] = 1.5f; sig[1] = 1.5f;
+	batch_compare(set2, G_N_ELEMENTS(set2), SIGMA, sig);
+	batch_compare(set1, G_N_ELEMENTS(set1), MAD, sig);
+	batch_compare(set2, G_N_ELEMENTS(set2), NO_REJEC, sig);
+}
+
+/* with each instruction set the processor runs */
+static void test_batch_float() {
+	for (int level = SIMD_BASELINE; level < SIMD_NB_LEVELS; level++) {
+		if (!cpu_dispatch_supported(level))
+			continue;
+		cpu_dispatch_set_level(level);
+		test_batch_float_level();
+	}
+	cpu_dispatch_set_level(SIMD_BASELINE);
+}
+
+Test(rejection, batch) { test_batch_float(); }
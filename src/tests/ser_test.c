@@ -51,6 +51,7 @@ fits gfit;	// currently loaded image
 #define TMP_FILE5 "/tmp/test_tmp5.ser"
 #define TMP_FILE6 "/tmp/test_tmp6.ser"
 #define TMP_FILE7 "/tmp/test_tmp7.ser"
+#define TMP_FILE8 "/tmp/test_tmp8.ser"
 #else
 #define TMP_FILE1 ".\\test_tmp1.ser"
 #define TMP_FILE2 ".\\test_tmp2.ser"
@@ -59,6 +60,7 @@ fits gfit;	// currently loaded image
 #define TMP_FILE5 ".\\test_tmp5.ser"
 #define TMP_FILE6 ".\\test_tmp6.ser"
 #define TMP_FILE7 ".\\test_tmp7.ser"
+#define TMP_FILE8 ".\\test_tmp8.ser"
 #endif
 
 static fits *create_image(int w, int h, int layers) {
@@ -275,6 +277,56 @@ int test_ser_create_from_copy() {
 	return 0;
 }
 
+static fits *create_filled_image(int w, int h, WORD value) {
+	fits *fit = create_image(w, h, 1);
+	if (fit)
+		for (size_t i = 0; i < (size_t)w * h; i++)
+			fit->data[i] = value;
+	return fit;
+}
+
+int test_ser_direct_write() {
+	struct ser_struct *ser = malloc(sizeof(struct ser_struct));
+	ser_init_struct(ser);
+	CHECK(!ser_create_file(TMP_FILE8, ser, TRUE, NULL), "create file\n");
+	CHECK(!ser_set_direct_write(ser, 5), "direct write mode\n");
+	fits *fit = create_filled_image(20, 10, 1000);
+	set_fits_date(fit, 200);
+	CHECK(!ser_write_frame_from_fit(ser, fit, 3), "writing image\n");
+	CHECK(!ser_write_frame_from_fit(ser, NULL, 1), "writing image\n");
+	fits *fit2 = create_filled_image(20, 10, 500);
+	set_fits_date(fit2, 100);
+	CHECK(!ser_write_frame_from_fit(ser, fit2, 0), "writing image\n");
+	fits *fit3 = create_filled_image(20, 10, 2000);
+	set_fits_date(fit3, 300);
+	CHECK(!ser_write_frame_from_fit(ser, fit3, 4), "writing image\n");
+	CHECK(!ser_write_frame_from_fit(ser, NULL, 2), "writing image\n");
+	CHECK(!ser_write_and_close(ser), "close file\n");
+
+	CHECK(!ser_open_file(TMP_FILE8, ser), "reopen\n");
+	CHECK(ser->frame_count == 3, "wrong number of frames\n");
+	CHECK(ser->filesize == SER_HEADER_LEN + 3 * (20 * 10 * 2 + 8), "wrong file size\n");
+	CHECK(ser->ts, "no date information in SER\n");
+	CHECK(g_date_time_to_unix(ser_timestamp_to_date_time(ser->ts[0])) == 100,
+			"first image date is wrong\n");
+	CHECK(g_date_time_to_unix(ser_timestamp_to_date_time(ser->ts[1])) == 200,
+			"second image date is wrong\n");
+	CHECK(g_date_time_to_unix(ser_timestamp_to_date_time(ser->ts[2])) == 300,
+			"third image date is wrong\n");
+	fits read = { 0 };
+	CHECK(!ser_read_frame(ser, 1, &read, FALSE, FALSE), "reading image\n");
+	CHECK(read.data[0] == 1000 && read.data[199] == 1000, "second image data is wrong\n");
+	CHECK(!ser_read_frame(ser, 2, &read, FALSE, FALSE), "reading image\n");
+	CHECK(read.data[0] == 2000, "third image data is wrong\n");
+	clearfits(&read);
+	ser_close_file(ser);
+
+	free(ser);
+	CHECK(!unlink(TMP_FILE8), "error unlinking file " TMP_FILE8);
+	fprintf(stdout, "* test 8 passed *\n\n");
+	return 0;
+}
+
 #ifdef WITH_MAIN
 int main() {
 	int retval = 0;
@@ -285,6 +337,7 @@ int main() {
 	retval |= test_ser_with_holes();
 	retval |= test_ser_ooo_write();
 	retval |= test_ser_create_from_copy();
+	retval |= test_ser_direct_write();
 	if (retval)
 		fprintf(stderr, "TESTS FAILED\n");
 	else fprintf(stderr, "ALL TESTS PASSED\n");
@@ -298,4 +351,5 @@ Test(ser, dates) { cr_assert(!test_ser_dates()); }
 Test(ser, holes) { cr_assert(!test_ser_with_holes()); }
 Test(ser, out_of_order_write) { cr_assert(!test_ser_ooo_write()); }
 Test(ser, create_from_copy) { cr_assert(!test_ser_create_from_copy()); }
+Test(ser, direct_write) { cr_assert(!test_ser_direct_write()); }
 #endif
@@ -34,5 +34,34 @@ void test_siril_flatpak_argv_populated() {
 	cr_expect_eq(NULL, newargs[5]);
 }
 
+#define TEST_TOOL 1
+
+static gint running = 0, max_running = 0;
+
+static gpointer tool_run(gpointer data) {
+	gint64 start = siril_tool_begin(TEST_TOOL);
+	gint now = g_atomic_int_add(&running, 1) + 1;
+	gint prev;
+	while ((prev = g_atomic_int_get(&max_running)) < now &&
+			!g_atomic_int_compare_and_exchange(&max_running, prev, now));
+	g_usleep(20000);
+	g_atomic_int_add(&running, -1);
+	siril_tool_end(TEST_TOOL, start);
+	return NULL;
+}
+
+void test_siril_tool_max_concurrent() {
+	GThread *threads[6];
+	siril_tool_set_max_concurrent(TEST_TOOL, 2);
+	for (int i = 0; i < 6; i++)
+		threads[i] = g_thread_new("tool", tool_run, NULL);
+	for (int i = 0; i < 6; i++)
+		g_thread_join(threads[i]);
+	cr_expect_leq(max_running, 2);
+	cr_expect_eq(running, 0);
+	siril_tool_set_max_concurrent(TEST_TOOL, 0);
+}
+
 Test(siril, flatpak_argv_null) { test_siril_flatpak_argv_null(); }
 Test(siril, flatpak_argv_populated) { test_siril_flatpak_argv_populated(); }
+Test(siril, tool_max_concurrent) { test_siril_tool_max_concurrent(); }
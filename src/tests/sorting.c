@@ -97,3 +97,53 @@ Test(Sorting, Median)
 		cr_assert(compare_median_algos(size, 2) == 0, "Failed at size=%u", size);
 	}
 }
+
+#define NBLANES 16
+
+int compare_median_network(int datasize)
+{
+	float *data = malloc(datasize * NBLANES * sizeof(float));
+	float *lane = malloc(datasize * sizeof(float));
+	sortnet_pair *pairs = malloc(SORTNET_MEDIAN_MAX_PAIRS * sizeof(sortnet_pair));
+	double medians[NBLANES];
+	int retval = 0;
+
+	for (int i = 0; i < datasize * NBLANES; i++)
+		data[i] = (float)(rand() % 1000);
+	float *data_backup = malloc(datasize * NBLANES * sizeof(float));
+	memcpy(data_backup, data, datasize * NBLANES * sizeof(float));
+
+	int nb_pairs = sortnet_median_pairs(datasize, pairs);
+	if (nb_pairs < 0) {
+		cr_log_error("no network for size %d\n", datasize);
+		retval = 1;
+		goto end;
+	}
+	sortnet_median_batch_float(data, datasize, NBLANES, pairs, nb_pairs, medians);
+
+	for (int l = 0; l < NBLANES; l++) {
+		for (int i = 0; i < datasize; i++)
+			lane[i] = data_backup[i * NBLANES + l];
+		quicksort_f(lane, datasize);
+		double result_qsort = (datasize % 2) ? lane[datasize / 2] :
+			((double)lane[datasize / 2 - 1] + lane[datasize / 2]) / 2.0;
+		if (medians[l] != result_qsort) {
+			cr_log_error("got %g (network) and %g (qsort)\n", medians[l], result_qsort);
+			retval = 1;
+		}
+	}
+end:
+	free(data);
+	free(data_backup);
+	free(lane);
+	free(pairs);
+	return retval;
+}
+
+Test(Sorting, MedianNetwork)
+{
+	for (int size = 1; size <= SORTNET_MEDIAN_MAX; size++) {
+		cr_assert(compare_median_network(size) == 0, "Failed at size=%u", size);
+	}
+	cr_assert(sortnet_median_pairs(SORTNET_MEDIAN_MAX + 1, NULL) == -1);
+}
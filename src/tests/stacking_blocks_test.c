@@ -77,6 +77,8 @@ int check_that_blocks_cover_the_image(const long naxes[3], struct _image_block *
  *  10     3      not enough for 2      8
  *  11     3      not enough for 1      8
  *  12     3      not enough for 2     12
+ *  13     3      enough                8, 4 blocks per thread
+ *  14     3      not enough for 2     64, 4 blocks per thread
  *
  */
 
@@ -343,6 +345,52 @@ int test12() {
 	return 0;
 }
 
+int test13() {
+	// intputs
+	long naxes[] = { 1000L, 1000L, 3L };
+	long max_rows = 3001L;
+	int nb_threads = 8;
+	// outputs
+	struct _image_block *blocks = NULL;
+	int retval, nb_blocks = -1;
+	long largest_block = -1;
+
+	/* case 13: three channel images, enough memory, 8 threads, 4 blocks
+	 * per thread requested for load balancing */
+	retval = stack_compute_balanced_blocks(&blocks, max_rows, naxes, nb_threads, 4, &largest_block, &nb_blocks);
+	CHECK(!retval, "retval indicates function failed\n");
+	CHECK(nb_blocks >= 32, "number of blocks returned is %d (expected at least 32)\n", nb_blocks);
+	CHECK(blocks, "blocks is null\n");
+	CHECK(check_that_blocks_cover_the_image(naxes, blocks, nb_blocks), "blocks don't cover the whole image\n");
+	CHECK(largest_block * nb_threads <= max_rows, "this is solution is going out of memory\n");
+	fprintf(stdout, "* test 13 passed *\n");
+	return 0;
+}
+
+int test14() {
+	// intputs
+	long naxes[] = { 6024L, 4024L, 3L };
+	int nb_threads = 64;
+	int nb_images = 209;
+	long max_rows = 27295481856 / (nb_images * naxes[0] * 4);
+	// outputs
+	struct _image_block *blocks = NULL;
+	int retval, nb_blocks = -1;
+	long largest_block = -1;
+
+	/* case 14: same data as case 12 on a 64 threads machine, 4 blocks per
+	 * thread requested, blocks must not be smaller than the minimum height */
+	retval = stack_compute_balanced_blocks(&blocks, max_rows, naxes, nb_threads, 4, &largest_block, &nb_blocks);
+	CHECK(!retval, "retval indicates function failed\n");
+	CHECK(nb_blocks >= 4 * nb_threads, "number of blocks returned is %d (expected at least 256)\n", nb_blocks);
+	CHECK(blocks, "blocks is null\n");
+	CHECK(check_that_blocks_cover_the_image(naxes, blocks, nb_blocks), "blocks don't cover the whole image\n");
+	CHECK(largest_block * nb_threads <= max_rows, "this is solution is going out of memory\n");
+	CHECK(largest_block >= STACK_MIN_BLOCK_HEIGHT, "blocks are too small (%ld rows)\n", largest_block);
+	fprintf(stdout, "* test 14 passed *\n");
+	return 0;
+}
+
 #ifdef WITH_MAIN
 int main() {
 	int retval = 0;
@@ -358,6 +406,8 @@ int main() {
 	retval |= test10();
 	retval |= test11();
 	retval |= test12();
+	retval |= test13();
+	retval |= test14();
 	if (retval)
 		fprintf(stderr, "TESTS FAILED\n");
 	else fprintf(stderr, "ALL TESTS PASSED\n");
@@ -377,5 +427,7 @@ Test(stacking_blocks, test9) { cr_assert(!test9()); }
 Test(stacking_blocks, test10) { cr_assert(!test10()); }
 Test(stacking_blocks, test11) { cr_assert(!test11()); }
 Test(stacking_blocks, test12) { cr_assert(!test12()); }
+Test(stacking_blocks, test13) { cr_assert(!test13()); }
+Test(stacking_blocks, test14) { cr_assert(!test14()); }
 
 #endif